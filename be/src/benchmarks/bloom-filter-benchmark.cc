@@ -27,13 +27,14 @@
 using namespace std;
 using namespace impala;
 
-// Tests Bloom filter performance on four tasks:
+// Tests Bloom filter performance on five tasks:
 //
 // 1. Construct/destruct pairs
 // 2. Inserts
 // 3. Lookups when the item is present
 // 4. Lookups when the item is absent (this is theoretically faster than when the item is
 //    present in some Bloom filter variants)
+// 5. Lookups of the same items in batches, with BloomFilter::FindBatch()
 //
 // As in bloom-filter.h, ndv refers to the number of unique items inserted into a filter
 // and fpp is the probability of false positives.
@@ -173,6 +174,29 @@ void Absent(int batch_size, void* data) {
   }
 }
 
+// Probes batches of FIND_BATCH_SIZE hashes with BloomFilter::FindBatch().
+const int FIND_BATCH_SIZE = 1024;
+
+void FindBatch(int batch_size, void* data, const vector<uint32_t>& hashes) {
+  TestData* d = reinterpret_cast<TestData*>(data);
+  uint8_t found[FIND_BATCH_SIZE];
+  for (int i = 0; i < batch_size; i += FIND_BATCH_SIZE) {
+    int offset = i & d->vec_mask & ~(FIND_BATCH_SIZE - 1);
+    int num_hashes = min<int>(min(FIND_BATCH_SIZE, batch_size - i),
+        hashes.size() - offset);
+    d->bf.FindBatch(&hashes[offset], num_hashes, found);
+    for (int j = 0; j < num_hashes; ++j) d->result += found[j];
+  }
+}
+
+void PresentBatch(int batch_size, void* data) {
+  FindBatch(batch_size, data, reinterpret_cast<TestData*>(data)->present);
+}
+
+void AbsentBatch(int batch_size, void* data) {
+  FindBatch(batch_size, data, reinterpret_cast<TestData*>(data)->absent);
+}
+
 }  // namespace find
 
 int main(int argc, char **argv) {
@@ -217,6 +241,14 @@ int main(int argc, char **argv) {
 
         snprintf(name, sizeof(name), "absent  ndv %7dk fpp %6.1f%%", ndv/1000, fpp*100);
         suite.AddBenchmark(name, find::Absent, d);
+
+        snprintf(name, sizeof(name), "present batch ndv %7dk fpp %6.1f%%", ndv/1000,
+            fpp*100);
+        suite.AddBenchmark(name, find::PresentBatch, d);
+
+        snprintf(name, sizeof(name), "absent  batch ndv %7dk fpp %6.1f%%", ndv/1000,
+            fpp*100);
+        suite.AddBenchmark(name, find::AbsentBatch, d);
       }
     }
     cout << suite.Measure() << endl;
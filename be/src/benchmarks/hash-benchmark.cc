@@ -49,6 +49,11 @@ using namespace llvm;
 //   4. Boost Hash: boost hash function
 //   5. Crc: hash using sse4 crc hash instruction
 //   6. Codegen: hash using sse4 with the tuple types baked into the codegen function
+//   7. XxHash64: 64-bit xxHash
+//   8. VarLen: HashUtil::VarLenHash(), i.e. Crc for short and XxHash64 for long data
+//
+// The 'String' sets hash single string columns: keys of 36 characters like UUIDs, and
+// keys of 17 to 100 characters, which are typical of URLs and composite keys.
 //
 // n is the number of buckets, k is the number of items
 // Expected(collisions) = n - k + E(X)
@@ -296,6 +301,27 @@ void TestMurmur2_64MixedHash(int batch, void* d) {
   }
 }
 
+uint32_t Murmur2_64Hash32(const void* data, int32_t bytes, uint32_t seed) {
+  return HashUtil::MurmurHash2_64(data, bytes, seed);
+}
+
+uint32_t XxHash64Hash32(const void* data, int32_t bytes, uint32_t seed) {
+  return HashUtil::XxHash64(data, bytes, seed);
+}
+
+// Hashes the strings of 'd', which consists of a single string column.
+template <uint32_t (*HASH_FN)(const void*, int32_t, uint32_t)>
+void TestStringHash(int batch, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  int rows = data->num_rows;
+  for (int i = 0; i < batch; ++i) {
+    StringValue* strs = reinterpret_cast<StringValue*>(data->data);
+    for (int j = 0; j < rows; ++j) {
+      data->results[j] = HASH_FN(strs[j].ptr, strs[j].len, HashUtil::FNV_SEED);
+    }
+  }
+}
+
 int NumCollisions(TestData* data, int num_buckets) {
   vector<bool> buckets;
   buckets.resize(num_buckets);
@@ -311,6 +337,13 @@ int NumCollisions(TestData* data, int num_buckets) {
   return num_collisions;
 }
 
+// Returns the number of collisions of HASH_FN on 'data' in as many buckets as rows.
+template <uint32_t (*HASH_FN)(const void*, int32_t, uint32_t)>
+int CollisionsOf(TestData* data) {
+  TestStringHash<HASH_FN>(1, data);
+  return NumCollisions(data, data->num_rows);
+}
+
 // Codegen for looping through a batch of tuples
 // define void @HashInt(i32 %rows, i8* %data, i32* %results) {
 // entry:
@@ -422,8 +455,12 @@ int main(int argc, char **argv) {
   MemPool mem_pool(&tracker);
   RuntimeProfile int_profile(&obj_pool, "IntGen");
   RuntimeProfile mixed_profile(&obj_pool, "MixedGen");
+  RuntimeProfile uuid_profile(&obj_pool, "UuidGen");
+  RuntimeProfile long_profile(&obj_pool, "LongStringGen");
   DataProvider int_provider(&mem_pool, &int_profile);
   DataProvider mixed_provider(&mem_pool, &mixed_profile);
+  DataProvider uuid_provider(&mem_pool, &uuid_profile);
+  DataProvider long_provider(&mem_pool, &long_profile);
 
   Status status;
   scoped_ptr<LlvmCodeGen> codegen;
@@ -485,6 +522,33 @@ int main(int argc, char **argv) {
   mixed_data.results.resize(mixed_data.num_rows);
   mixed_data.jitted_fn = jitted_hash_mixed;
 
+  string uuid_std_str(36, 'a');
+  StringValue uuid_str(const_cast<char*>(uuid_std_str.c_str()), uuid_std_str.size());
+  vector<DataProvider::ColDesc> uuid_cols;
+  uuid_cols.push_back(DataProvider::ColDesc::Create<StringValue>(uuid_str, uuid_str));
+  uuid_provider.Reset(NUM_ROWS, NUM_ROWS, uuid_cols);
+
+  TestData uuid_data;
+  uuid_data.data = uuid_provider.NextBatch(&uuid_data.num_rows);
+  uuid_data.num_cols = uuid_cols.size();
+  uuid_data.results.resize(uuid_data.num_rows);
+
+  string min_long_std_str(17, 'a');
+  string max_long_std_str(100, 'z');
+  StringValue min_long_str(
+      const_cast<char*>(min_long_std_str.c_str()), min_long_std_str.size());
+  StringValue max_long_str(
+      const_cast<char*>(max_long_std_str.c_str()), max_long_std_str.size());
+  vector<DataProvider::ColDesc> long_cols;
+  long_cols.push_back(
+      DataProvider::ColDesc::Create<StringValue>(min_long_str, max_long_str));
+  long_provider.Reset(NUM_ROWS, NUM_ROWS, long_cols);
+
+  TestData long_data;
+  long_data.data = long_provider.NextBatch(&long_data.num_rows);
+  long_data.num_cols = long_cols.size();
+  long_data.results.resize(long_data.num_rows);
+
   Benchmark int_suite("Int Hash");
   int_suite.AddBenchmark("Fnv", TestFnvIntHash, &int_data);
   int_suite.AddBenchmark("Murmur2_64", TestMurmur2_64IntHash, &int_data);
@@ -500,7 +564,25 @@ int main(int argc, char **argv) {
   mixed_suite.AddBenchmark("Boost", TestBoostMixedHash, &mixed_data);
   mixed_suite.AddBenchmark("Crc", TestCrcMixedHash, &mixed_data);
   mixed_suite.AddBenchmark("Codegen", TestCodegenMixedHash, &mixed_data);
-  cout << mixed_suite.Measure();
+  cout << mixed_suite.Measure() << endl;
+
+  Benchmark uuid_suite("Uuid String Hash");
+  uuid_suite.AddBenchmark("Murmur2_64", TestStringHash<Murmur2_64Hash32>, &uuid_data);
+  uuid_suite.AddBenchmark("Crc", TestStringHash<HashUtil::CrcHash>, &uuid_data);
+  uuid_suite.AddBenchmark("XxHash64", TestStringHash<XxHash64Hash32>, &uuid_data);
+  uuid_suite.AddBenchmark("VarLen", TestStringHash<HashUtil::VarLenHash>, &uuid_data);
+  cout << uuid_suite.Measure() << endl;
+  cout << "Uuid collisions: Crc " << CollisionsOf<HashUtil::CrcHash>(&uuid_data)
+       << ", XxHash64 " << CollisionsOf<XxHash64Hash32>(&uuid_data) << endl << endl;
+
+  Benchmark long_suite("Long String Hash");
+  long_suite.AddBenchmark("Murmur2_64", TestStringHash<Murmur2_64Hash32>, &long_data);
+  long_suite.AddBenchmark("Crc", TestStringHash<HashUtil::CrcHash>, &long_data);
+  long_suite.AddBenchmark("XxHash64", TestStringHash<XxHash64Hash32>, &long_data);
+  long_suite.AddBenchmark("VarLen", TestStringHash<HashUtil::VarLenHash>, &long_data);
+  cout << long_suite.Measure() << endl;
+  cout << "Long string collisions: Crc " << CollisionsOf<HashUtil::CrcHash>(&long_data)
+       << ", XxHash64 " << CollisionsOf<XxHash64Hash32>(&long_data) << endl;
 
   return 0;
 }
@@ -19,14 +19,18 @@
 #include <sstream>
 #include <boost/thread.hpp>
 #include <boost/thread/mutex.hpp>
+#include <gflags/gflags.h>
 #include "util/benchmark.h"
 #include "util/cpu-info.h"
+#include "util/lock-profiler.h"
 #include "util/spinlock.h"
 
 #include "common/names.h"
 
 using namespace impala;
 
+DECLARE_bool(enable_lock_profiling);
+
 
 // Benchmark for locking.
 // Machine Info: Intel(R) Core(TM) i7-2600 CPU @ 3.40GHz
@@ -71,6 +75,7 @@ struct TestData {
 
 mutex lock_;
 SpinLock spinlock_;
+LockSite lock_site_("lock-benchmark");
 
 typedef function<void (int64_t, int64_t*)> Fn;
 
@@ -126,6 +131,38 @@ void BoostProduceThread(int64_t n, int64_t* value) {
   }
 }
 
+void ProfiledSpinLockConsumeThread(int64_t n, int64_t* value) {
+  for (int64_t i = 0; i < n; ++i) {
+    ProfiledLock<SpinLock> l(spinlock_, &lock_site_);
+    --(*value);
+  }
+}
+void ProfiledSpinLockProduceThread(int64_t n, int64_t* value) {
+  for (int64_t i = 0; i < n; ++i) {
+    ProfiledLock<SpinLock> l(spinlock_, &lock_site_);
+    ++(*value);
+  }
+}
+
+void ProfiledBoostConsumeThread(int64_t n, int64_t* value) {
+  for (int64_t i = 0; i < n; ++i) {
+    ProfiledLock<mutex> l(lock_, &lock_site_);
+    --(*value);
+  }
+}
+void ProfiledBoostProduceThread(int64_t n, int64_t* value) {
+  for (int64_t i = 0; i < n; ++i) {
+    ProfiledLock<mutex> l(lock_, &lock_site_);
+    ++(*value);
+  }
+}
+
+// Turns lock profiling on or off for the benchmarks that follow.
+void SetLockProfiling(bool enabled) {
+  FLAGS_enable_lock_profiling = enabled;
+  LockProfiler::Init(NULL);
+}
+
 void LaunchThreads(void* d, Fn consume_fn, Fn produce_fn, int64_t scale) {
   TestData* data = reinterpret_cast<TestData*>(d);
   data->value = 0;
@@ -168,6 +205,40 @@ void TestBoost(int batch_size, void* d) {
   CHECK_EQ(data->value, 0);
 }
 
+// The overhead of ProfiledLock while lock profiling is disabled.
+void TestProfiledSpinLockDisabled(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  SetLockProfiling(false);
+  LaunchThreads(d, ProfiledSpinLockConsumeThread, ProfiledSpinLockProduceThread,
+      batch_size);
+  CHECK_EQ(data->value, 0);
+}
+
+void TestProfiledBoostDisabled(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  SetLockProfiling(false);
+  LaunchThreads(d, ProfiledBoostConsumeThread, ProfiledBoostProduceThread, batch_size);
+  CHECK_EQ(data->value, 0);
+}
+
+// The overhead of ProfiledLock while lock profiling is enabled.
+void TestProfiledSpinLockEnabled(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  SetLockProfiling(true);
+  LaunchThreads(d, ProfiledSpinLockConsumeThread, ProfiledSpinLockProduceThread,
+      batch_size);
+  SetLockProfiling(false);
+  CHECK_EQ(data->value, 0);
+}
+
+void TestProfiledBoostEnabled(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  SetLockProfiling(true);
+  LaunchThreads(d, ProfiledBoostConsumeThread, ProfiledBoostProduceThread, batch_size);
+  SetLockProfiling(false);
+  CHECK_EQ(data->value, 0);
+}
+
 int main(int argc, char **argv) {
   CpuInfo::Init();
   cout << Benchmark::GetMachineInfo() << endl;
@@ -202,6 +273,22 @@ int main(int argc, char **argv) {
     name.str("");
     name << "Boost" << suffix.str();
     suite.AddBenchmark(name.str(), TestBoost, &data[i], baseline);
+
+    name.str("");
+    name << "ProfiledSpinLock (off)" << suffix.str();
+    suite.AddBenchmark(name.str(), TestProfiledSpinLockDisabled, &data[i], baseline);
+
+    name.str("");
+    name << "ProfiledSpinLock (on)" << suffix.str();
+    suite.AddBenchmark(name.str(), TestProfiledSpinLockEnabled, &data[i], baseline);
+
+    name.str("");
+    name << "ProfiledBoost (off)" << suffix.str();
+    suite.AddBenchmark(name.str(), TestProfiledBoostDisabled, &data[i], baseline);
+
+    name.str("");
+    name << "ProfiledBoost (on)" << suffix.str();
+    suite.AddBenchmark(name.str(), TestProfiledBoostEnabled, &data[i], baseline);
   }
   cout << suite.Measure() << endl;
 
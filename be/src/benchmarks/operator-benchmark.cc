@@ -0,0 +1,466 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <math.h>
+#include <stdio.h>
+#include <iostream>
+#include <boost/algorithm/string.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_01.hpp>
+#include <gflags/gflags.h>
+
+#include "common/init.h"
+#include "common/object-pool.h"
+#include "exec/hash-table.inline.h"
+#include "exec/sort-exec-exprs.h"
+#include "exprs/expr.h"
+#include "exprs/expr-context.h"
+#include "gutil/strings/substitute.h"
+#include "runtime/buffered-block-mgr.h"
+#include "runtime/descriptors.h"
+#include "runtime/mem-pool.h"
+#include "runtime/mem-tracker.h"
+#include "runtime/row-batch.h"
+#include "runtime/runtime-state.h"
+#include "runtime/sorter.h"
+#include "runtime/test-env.h"
+#include "runtime/tuple-row.h"
+#include "testutil/desc-tbl-builder.h"
+#include "util/benchmark.h"
+#include "util/cpu-info.h"
+#include "util/runtime-profile.h"
+#include "util/stopwatch.h"
+#include "util/test-info.h"
+#include "util/tuple-row-compare.h"
+
+#include "gen-cpp/Exprs_types.h"
+
+#include "common/names.h"
+
+using namespace boost::algorithm;
+using namespace strings;
+
+// Benchmark of the inner loops of the blocking operators: the build and probe of a hash
+// join, a grouping aggregation and a sort. The input is generated from the cardinality,
+// key skew, row width and memory limit given by the flags below, and each operator
+// reports the rows it processed per second and the bytes it spilled to disk.
+//
+// The operators are driven the way PartitionedHashJoinNode, PartitionedAggregationNode
+// and SortNode drive their HashTable and Sorter, with the same exprs and block manager,
+// but without the plan and the child nodes around them. The hash tables therefore
+// stay in memory: their partitioning and spilling are part of the exec nodes. A hash
+// table that does not fit into --max_buffers fails with a memory limit error.
+// The sort spills its runs as soon as they do not fit into --max_buffers.
+//
+// Example:
+//   operator-benchmark --num_rows=10000000 --num_keys=1000000 --key_skew=1
+//       --row_width=32 --max_buffers=16
+//
+// The time spent generating the input is not counted. The join reports its build and
+// its probe separately.
+
+DEFINE_string(operators, "join,agg,sort", "Comma-separated list of the operators to "
+    "benchmark: join, agg and sort.");
+DEFINE_int64(num_rows, 10 * 1000 * 1000, "Number of input rows of the aggregation and "
+    "the sort, and number of probe rows of the join.");
+DEFINE_int64(num_build_rows, 1000 * 1000, "Number of build rows of the join. The build "
+    "rows take the keys 0, 1, ... in turn.");
+DEFINE_int64(num_keys, 1000 * 1000, "Number of distinct keys that the input rows are "
+    "drawn from.");
+DEFINE_double(key_skew, 0, "Skew of the keys of the input rows. Keys are drawn as "
+    "num_keys * u^(1 + key_skew) for uniform u in [0, 1): 0 draws all keys with the same "
+    "probability, larger values draw the small keys more often.");
+DEFINE_int32(row_width, 16, "Width of the rows in bytes, not counting null indicators. "
+    "Rounded up to a multiple of 8. The first 8 bytes are the key.");
+DEFINE_int32(max_buffers, -1, "Memory limit of each operator in block manager buffers, "
+    "or -1 for no limit.");
+DEFINE_int32(block_size, 8 * 1024 * 1024, "Size of the block manager buffers.");
+DEFINE_int32(seed, 0, "Seed of the random number generator.");
+
+DECLARE_bool(enable_hash_table_tags);
+
+namespace impala {
+
+/// Result of one operator run.
+struct OperatorResult {
+  string name;
+  int64_t rows;
+  int64_t time_ns;
+  int64_t bytes_spilled;
+};
+
+class OperatorBenchmark {
+ public:
+  OperatorBenchmark() : rng_(FLAGS_seed), bytes_spilled_counter_(NULL) { }
+
+  /// Declares the input tuple (the BIGINT key and BIGINT payload slots) and the
+  /// intermediate tuple of the aggregation (the BIGINT key and a BIGINT count).
+  Status Init();
+
+  /// Builds a hash table from FLAGS_num_build_rows rows and probes it with
+  /// FLAGS_num_rows rows.
+  Status RunHashJoin(vector<OperatorResult>* results);
+
+  /// Counts the FLAGS_num_rows rows of each key.
+  Status RunAggregation(vector<OperatorResult>* results);
+
+  /// Sorts FLAGS_num_rows rows by their key and reads them back.
+  Status RunSort(vector<OperatorResult>* results);
+
+ private:
+  /// Creates the runtime state and block manager of the next operator run.
+  Status CreateQueryState();
+
+  /// Returns the thrift expr of a slot ref that reads 'slot'.
+  static TExpr SlotRefExpr(const SlotDescriptor* slot);
+
+  /// Returns an expr that reads 'slot', prepared and opened for rows of 'row_desc'.
+  Status CreateSlotRef(const SlotDescriptor* slot, const RowDescriptor& row_desc,
+      ExprContext** ctx);
+
+  /// Adds up to 'num_rows' rows to 'batch', whose tuples are allocated from 'pool'. If
+  /// 'sequential', the keys are 'next_key' modulo FLAGS_num_keys, which is incremented
+  /// for each row, otherwise they are drawn from the skewed distribution.
+  void FillBatch(int64_t num_rows, bool sequential, int64_t* next_key, MemPool* pool,
+      RowBatch* batch);
+
+  /// Returns the next key of the skewed distribution.
+  int64_t NextKey();
+
+  /// Returns the bytes written to disk by the block manager of the current run.
+  int64_t BytesSpilled() const;
+
+  ObjectPool pool_;
+  MemTracker tracker_;
+  boost::scoped_ptr<TestEnv> test_env_;
+  DescriptorTbl* desc_tbl_;
+  RowDescriptor* input_row_desc_;
+  RowDescriptor* agg_row_desc_;
+  TupleDescriptor* input_tuple_desc_;
+  TupleDescriptor* agg_tuple_desc_;
+
+  /// State of the current operator run.
+  RuntimeState* state_;
+  int64_t query_id_;
+
+  boost::mt19937 rng_;
+  boost::uniform_01<> uniform_;
+
+  RuntimeProfile::Counter* bytes_spilled_counter_;
+};
+
+Status OperatorBenchmark::Init() {
+  test_env_.reset(new TestEnv());
+  query_id_ = 0;
+  DescriptorTblBuilder builder(&pool_);
+  TupleDescBuilder& input_tuple = builder.DeclareTuple();
+  int num_slots = max(1, (FLAGS_row_width + 7) / 8);
+  for (int i = 0; i < num_slots; ++i) input_tuple << TYPE_BIGINT;
+  builder.DeclareTuple() << TYPE_BIGINT << TYPE_BIGINT;
+  desc_tbl_ = builder.Build();
+  input_tuple_desc_ = desc_tbl_->GetTupleDescriptor(0);
+  agg_tuple_desc_ = desc_tbl_->GetTupleDescriptor(1);
+  input_row_desc_ = pool_.Add(
+      new RowDescriptor(*desc_tbl_, vector<TTupleId>(1, 0), vector<bool>(1, false)));
+  agg_row_desc_ = pool_.Add(
+      new RowDescriptor(*desc_tbl_, vector<TTupleId>(1, 1), vector<bool>(1, false)));
+  return Status::OK();
+}
+
+Status OperatorBenchmark::CreateQueryState() {
+  RETURN_IF_ERROR(test_env_->CreateQueryState(query_id_++, FLAGS_max_buffers,
+      FLAGS_block_size, &state_));
+  state_->set_desc_tbl(desc_tbl_);
+  bytes_spilled_counter_ = state_->block_mgr()->profile()->GetCounter("BytesWritten");
+  return Status::OK();
+}
+
+TExpr OperatorBenchmark::SlotRefExpr(const SlotDescriptor* slot) {
+  TExprNode node;
+  node.__set_node_type(TExprNodeType::SLOT_REF);
+  node.__set_type(slot->type().ToThrift());
+  node.__set_num_children(0);
+  TSlotRef slot_ref;
+  slot_ref.__set_slot_id(slot->id());
+  node.__set_slot_ref(slot_ref);
+  TExpr expr;
+  expr.nodes.push_back(node);
+  return expr;
+}
+
+Status OperatorBenchmark::CreateSlotRef(const SlotDescriptor* slot,
+    const RowDescriptor& row_desc, ExprContext** ctx) {
+  RETURN_IF_ERROR(Expr::CreateExprTree(&pool_, SlotRefExpr(slot), ctx));
+  RETURN_IF_ERROR((*ctx)->Prepare(state_, row_desc, &tracker_));
+  return (*ctx)->Open(state_);
+}
+
+int64_t OperatorBenchmark::NextKey() {
+  double u = uniform_(rng_);
+  if (FLAGS_key_skew != 0) u = pow(u, 1 + FLAGS_key_skew);
+  return min<int64_t>(u * FLAGS_num_keys, FLAGS_num_keys - 1);
+}
+
+void OperatorBenchmark::FillBatch(int64_t num_rows, bool sequential, int64_t* next_key,
+    MemPool* pool, RowBatch* batch) {
+  const vector<SlotDescriptor*>& slots = input_tuple_desc_->slots();
+  while (batch->num_rows() < num_rows && !batch->AtCapacity()) {
+    Tuple* tuple = Tuple::Create(input_tuple_desc_->byte_size(), pool);
+    int64_t key = sequential ? (*next_key)++ % FLAGS_num_keys : NextKey();
+    *reinterpret_cast<int64_t*>(tuple->GetSlot(slots[0]->tuple_offset())) = key;
+    for (int i = 1; i < slots.size(); ++i) {
+      *reinterpret_cast<int64_t*>(tuple->GetSlot(slots[i]->tuple_offset())) = i;
+    }
+    int row_idx = batch->AddRow();
+    batch->GetRow(row_idx)->SetTuple(0, tuple);
+    batch->CommitLastRow();
+  }
+}
+
+int64_t OperatorBenchmark::BytesSpilled() const {
+  return bytes_spilled_counter_ == NULL ? 0 : bytes_spilled_counter_->value();
+}
+
+Status OperatorBenchmark::RunHashJoin(vector<OperatorResult>* results) {
+  RETURN_IF_ERROR(CreateQueryState());
+  ExprContext* build_expr;
+  ExprContext* probe_expr;
+  RETURN_IF_ERROR(
+      CreateSlotRef(input_tuple_desc_->slots()[0], *input_row_desc_, &build_expr));
+  RETURN_IF_ERROR(
+      CreateSlotRef(input_tuple_desc_->slots()[0], *input_row_desc_, &probe_expr));
+  vector<ExprContext*> build_exprs(1, build_expr);
+  vector<ExprContext*> probe_exprs(1, probe_expr);
+  HashTableCtx ht_ctx(build_exprs, probe_exprs, false, vector<bool>(1, false), 1, 0, 1);
+
+  BufferedBlockMgr::Client* client;
+  RETURN_IF_ERROR(state_->block_mgr()->RegisterClient("hash join", 0, false, &tracker_,
+      state_, &client));
+  scoped_ptr<HashTable> ht(HashTable::Create(state_, client, 1, NULL, 1L << 31,
+      HashTable::EstimateNumBuckets(FLAGS_num_build_rows),
+      FLAGS_enable_hash_table_tags, ht_ctx.inline_key_words()));
+  if (!ht->Init()) return Status("Exceeded the memory limit in the hash join build");
+
+  // The build rows stay in memory while the table is probed, like the build rows of
+  // a PartitionedHashJoinNode in its pinned BufferedTupleStream.
+  MemPool build_pool(&tracker_);
+  RowBatch batch(*input_row_desc_, state_->batch_size(), &tracker_);
+  MonotonicStopWatch build_timer;
+  int64_t next_key = 0;
+  for (int64_t num_rows = 0; num_rows < FLAGS_num_build_rows;
+       num_rows += batch.num_rows()) {
+    batch.Reset();
+    FillBatch(FLAGS_num_build_rows - num_rows, true, &next_key, &build_pool, &batch);
+    build_timer.Start();
+    if (!ht->CheckAndResize(batch.num_rows(), &ht_ctx)) {
+      return Status("Exceeded the memory limit in the hash join build");
+    }
+    for (int i = 0; i < batch.num_rows(); ++i) {
+      TupleRow* row = batch.GetRow(i);
+      uint32_t hash;
+      if (!ht_ctx.EvalAndHashBuild(row, &hash)) continue;
+      if (!ht->Insert(&ht_ctx, row->GetTuple(0), hash)) {
+        return Status("Exceeded the memory limit in the hash join build");
+      }
+    }
+    build_timer.Stop();
+  }
+  OperatorResult build_result = { "hash join build", FLAGS_num_build_rows,
+      static_cast<int64_t>(build_timer.ElapsedTime()), BytesSpilled() };
+  results->push_back(build_result);
+
+  MonotonicStopWatch probe_timer;
+  int64_t num_matches = 0;
+  for (int64_t num_rows = 0; num_rows < FLAGS_num_rows; num_rows += batch.num_rows()) {
+    batch.Reset();
+    FillBatch(FLAGS_num_rows - num_rows, false, NULL, batch.tuple_data_pool(), &batch);
+    probe_timer.Start();
+    for (int i = 0; i < batch.num_rows(); ++i) {
+      uint32_t hash;
+      if (!ht_ctx.EvalAndHashProbe(batch.GetRow(i), &hash)) continue;
+      HashTable::Iterator it = ht->FindProbeRow(&ht_ctx, hash);
+      for (; !it.AtEnd(); it.NextDuplicate()) ++num_matches;
+    }
+    probe_timer.Stop();
+  }
+  VLOG(1) << "Hash join produced " << num_matches << " rows";
+  OperatorResult probe_result = { "hash join probe", FLAGS_num_rows,
+      static_cast<int64_t>(probe_timer.ElapsedTime()), BytesSpilled() };
+  results->push_back(probe_result);
+
+  batch.Reset();
+  ht->Close();
+  ht_ctx.Close();
+  build_pool.FreeAll();
+  Expr::Close(build_exprs, state_);
+  Expr::Close(probe_exprs, state_);
+  return Status::OK();
+}
+
+Status OperatorBenchmark::RunAggregation(vector<OperatorResult>* results) {
+  RETURN_IF_ERROR(CreateQueryState());
+  // Like in PartitionedAggregationNode, the build exprs evaluate the grouping slot of
+  // the intermediate tuples and the probe exprs the grouping expr of the input rows.
+  ExprContext* build_expr;
+  ExprContext* probe_expr;
+  RETURN_IF_ERROR(
+      CreateSlotRef(agg_tuple_desc_->slots()[0], *agg_row_desc_, &build_expr));
+  RETURN_IF_ERROR(
+      CreateSlotRef(input_tuple_desc_->slots()[0], *input_row_desc_, &probe_expr));
+  vector<ExprContext*> build_exprs(1, build_expr);
+  vector<ExprContext*> probe_exprs(1, probe_expr);
+  HashTableCtx ht_ctx(build_exprs, probe_exprs, false, vector<bool>(1, false), 1, 0, 1);
+
+  BufferedBlockMgr::Client* client;
+  RETURN_IF_ERROR(state_->block_mgr()->RegisterClient("aggregation", 0, false,
+      &tracker_, state_, &client));
+  scoped_ptr<HashTable> ht(HashTable::Create(state_, client, 1, NULL, 1L << 31, 1024,
+      FLAGS_enable_hash_table_tags, ht_ctx.inline_key_words()));
+  if (!ht->Init()) return Status("Exceeded the memory limit in the aggregation");
+
+  int key_offset = agg_tuple_desc_->slots()[0]->tuple_offset();
+  int count_offset = agg_tuple_desc_->slots()[1]->tuple_offset();
+  MemPool agg_pool(&tracker_);
+  RowBatch batch(*input_row_desc_, state_->batch_size(), &tracker_);
+  MonotonicStopWatch timer;
+  for (int64_t num_rows = 0; num_rows < FLAGS_num_rows; num_rows += batch.num_rows()) {
+    batch.Reset();
+    FillBatch(FLAGS_num_rows - num_rows, false, NULL, batch.tuple_data_pool(), &batch);
+    timer.Start();
+    if (!ht->CheckAndResize(batch.num_rows(), &ht_ctx)) {
+      return Status("Exceeded the memory limit in the aggregation");
+    }
+    for (int i = 0; i < batch.num_rows(); ++i) {
+      TupleRow* row = batch.GetRow(i);
+      uint32_t hash;
+      if (!ht_ctx.EvalAndHashProbe(row, &hash)) continue;
+      bool found;
+      HashTable::Iterator it = ht->FindBuildRowBucket(&ht_ctx, hash, &found);
+      DCHECK(!it.AtEnd());
+      if (found) {
+        ++*reinterpret_cast<int64_t*>(it.GetTuple()->GetSlot(count_offset));
+        continue;
+      }
+      Tuple* tuple = Tuple::Create(agg_tuple_desc_->byte_size(), &agg_pool);
+      *reinterpret_cast<int64_t*>(tuple->GetSlot(key_offset)) =
+          *reinterpret_cast<int64_t*>(probe_expr->GetValue(row));
+      *reinterpret_cast<int64_t*>(tuple->GetSlot(count_offset)) = 1;
+      it.SetTuple(tuple, hash);
+    }
+    timer.Stop();
+  }
+  VLOG(1) << "Aggregation produced " << ht->size() << " groups";
+  OperatorResult result = { "aggregation", FLAGS_num_rows,
+      static_cast<int64_t>(timer.ElapsedTime()), BytesSpilled() };
+  results->push_back(result);
+
+  batch.Reset();
+  ht->Close();
+  ht_ctx.Close();
+  agg_pool.FreeAll();
+  Expr::Close(build_exprs, state_);
+  Expr::Close(probe_exprs, state_);
+  return Status::OK();
+}
+
+Status OperatorBenchmark::RunSort(vector<OperatorResult>* results) {
+  RETURN_IF_ERROR(CreateQueryState());
+  // Like SortNode, the sort tuples are materialized by one slot ref per input slot and
+  // ordered by their key.
+  vector<TExpr> ordering_exprs;
+  vector<TExpr> materialize_exprs;
+  const vector<SlotDescriptor*>& slots = input_tuple_desc_->slots();
+  for (int i = 0; i < slots.size(); ++i) {
+    materialize_exprs.push_back(SlotRefExpr(slots[i]));
+  }
+  ordering_exprs.push_back(materialize_exprs[0]);
+  SortExecExprs sort_exprs;
+  RETURN_IF_ERROR(sort_exprs.Init(ordering_exprs, &materialize_exprs, &pool_));
+  RETURN_IF_ERROR(
+      sort_exprs.Prepare(state_, *input_row_desc_, *input_row_desc_, &tracker_));
+  RETURN_IF_ERROR(sort_exprs.Open(state_));
+  TupleRowComparator less_than(sort_exprs, true, false);
+
+  RuntimeProfile profile(&pool_, "sort");
+  scoped_ptr<Sorter> sorter(new Sorter(less_than, sort_exprs.sort_tuple_slot_expr_ctxs(),
+      input_row_desc_, &tracker_, &profile, state_));
+  RETURN_IF_ERROR(sorter->Init());
+
+  RowBatch batch(*input_row_desc_, state_->batch_size(), &tracker_);
+  MonotonicStopWatch timer;
+  for (int64_t num_rows = 0; num_rows < FLAGS_num_rows; num_rows += batch.num_rows()) {
+    batch.Reset();
+    FillBatch(FLAGS_num_rows - num_rows, false, NULL, batch.tuple_data_pool(), &batch);
+    timer.Start();
+    RETURN_IF_ERROR(sorter->AddBatch(&batch));
+    timer.Stop();
+  }
+  timer.Start();
+  RETURN_IF_ERROR(sorter->InputDone());
+  bool eos = false;
+  while (!eos) {
+    batch.Reset();
+    RETURN_IF_ERROR(sorter->GetNext(&batch, &eos));
+  }
+  timer.Stop();
+  OperatorResult result = { "sort", FLAGS_num_rows,
+      static_cast<int64_t>(timer.ElapsedTime()), BytesSpilled() };
+  results->push_back(result);
+
+  batch.Reset();
+  sorter.reset();
+  sort_exprs.Close(state_);
+  return Status::OK();
+}
+
+}
+
+using namespace impala;
+
+int main(int argc, char** argv) {
+  InitCommonRuntime(argc, argv, false, TestInfo::BE_TEST);
+  cout << endl << Benchmark::GetMachineInfo() << endl;
+
+  OperatorBenchmark benchmark;
+  Status status = benchmark.Init();
+  vector<string> operators;
+  split(operators, FLAGS_operators, is_any_of(","), token_compress_on);
+  vector<OperatorResult> results;
+  for (int i = 0; status.ok() && i < operators.size(); ++i) {
+    if (operators[i] == "join") {
+      status = benchmark.RunHashJoin(&results);
+    } else if (operators[i] == "agg") {
+      status = benchmark.RunAggregation(&results);
+    } else if (operators[i] == "sort") {
+      status = benchmark.RunSort(&results);
+    } else {
+      status = Status(Substitute("Unknown operator: $0", operators[i]));
+    }
+  }
+
+  printf("%-16s %12s %11s %15s %18s\n", "Operator", "Rows", "Time (s)", "Rows/sec",
+      "Spilled (MB)");
+  printf("%s\n", string(80, '-').c_str());
+  for (int i = 0; i < results.size(); ++i) {
+    double seconds = results[i].time_ns / 1e9;
+    printf("%-16s %12ld %11.3f %15.3g %18ld\n", results[i].name.c_str(),
+        results[i].rows, seconds, seconds == 0 ? 0 : results[i].rows / seconds,
+        results[i].bytes_spilled / (1024 * 1024));
+  }
+  if (!status.ok()) {
+    cerr << status.GetDetail() << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -21,6 +21,7 @@
 #include "util/benchmark.h"
 #include "util/bit-stream-utils.inline.h"
 #include "util/cpu-info.h"
+#include "util/rle-encoding.h"
 
 #include "common/names.h"
 
@@ -108,6 +109,10 @@ struct TestData {
   int max_value;
   MemPool* pool;
   bool result;
+  // 'num_values' values that fit in 'num_bits'. 'literal_values' changes with every
+  // value, 'run_values' in runs of 16.
+  vector<int> literal_values;
+  vector<int> run_values;
 };
 
 void TestBitWriterEncode(int batch_size, void* d) {
@@ -149,6 +154,54 @@ void TestBitWriter8ByteEncode(int batch_size, void* d) {
   }
 }
 
+void TestBitWriterBatchEncode(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  int buffer_size = BitUtil::Ceil(data->num_bits * data->num_values, 8);
+  for (int i = 0; i < batch_size; ++i) {
+    BitWriter writer(data->buffer, buffer_size);
+    writer.PutValues(data->num_bits, data->num_values, &data->literal_values[0]);
+    writer.Flush();
+  }
+}
+
+void RleEncode(TestData* data, const vector<int>& values, int batch_size) {
+  int buffer_size = RleEncoder::MaxBufferSize(data->num_bits, data->num_values);
+  for (int i = 0; i < batch_size; ++i) {
+    RleEncoder encoder(data->buffer, buffer_size, data->num_bits);
+    for (int j = 0; j < data->num_values; ++j) encoder.Put(values[j]);
+    encoder.Flush();
+  }
+}
+
+void RleBatchEncode(TestData* data, const vector<int>& values, int batch_size) {
+  int buffer_size = RleEncoder::MaxBufferSize(data->num_bits, data->num_values);
+  for (int i = 0; i < batch_size; ++i) {
+    RleEncoder encoder(data->buffer, buffer_size, data->num_bits);
+    encoder.PutValues(&values[0], data->num_values);
+    encoder.Flush();
+  }
+}
+
+void TestRleEncodeLiterals(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  RleEncode(data, data->literal_values, batch_size);
+}
+
+void TestRleBatchEncodeLiterals(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  RleBatchEncode(data, data->literal_values, batch_size);
+}
+
+void TestRleEncodeRuns(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  RleEncode(data, data->run_values, batch_size);
+}
+
+void TestRleBatchEncodeRuns(int batch_size, void* d) {
+  TestData* data = reinterpret_cast<TestData*>(d);
+  RleBatchEncode(data, data->run_values, batch_size);
+}
+
 void TestBitWriterDecode(int batch_size, void* d) {
   TestData* data = reinterpret_cast<TestData*>(d);
   int64_t v;
@@ -206,6 +259,10 @@ int main(int argc, char** argv) {
     data[i].num_bits = i + 1;
     data[i].max_value = 1 << i;
     data[i].pool = &pool;
+    for (int j = 0; j < num_values; ++j) {
+      data[i].literal_values.push_back(j % (1 << data[i].num_bits));
+      data[i].run_values.push_back((j / 16) % 2);
+    }
 
     stringstream suffix;
     suffix << " " << (i+1) << "-Bit";
@@ -218,9 +275,38 @@ int main(int argc, char** argv) {
     name.str("");
     name << "\"BitWriter" << suffix.str() << "\"";
     encode_suite.AddBenchmark(name.str(), TestBitWriterEncode, &data[i], baseline);
+
+    name.str("");
+    name << "\"BitWriter batch" << suffix.str() << "\"";
+    encode_suite.AddBenchmark(name.str(), TestBitWriterBatchEncode, &data[i], baseline);
   }
   cout << encode_suite.Measure() << endl;
 
+  Benchmark rle_encode_suite("rle encode");
+  for (int i = 0; i < max_bits; ++i) {
+    stringstream suffix;
+    suffix << " " << (i+1) << "-Bit";
+
+    stringstream name;
+    name << "\"RleEncoder literals" << suffix.str() << "\"";
+    int baseline = rle_encode_suite.AddBenchmark(
+        name.str(), TestRleEncodeLiterals, &data[i], -1);
+
+    name.str("");
+    name << "\"RleEncoder batch literals" << suffix.str() << "\"";
+    rle_encode_suite.AddBenchmark(
+        name.str(), TestRleBatchEncodeLiterals, &data[i], baseline);
+
+    name.str("");
+    name << "\"RleEncoder runs" << suffix.str() << "\"";
+    baseline = rle_encode_suite.AddBenchmark(name.str(), TestRleEncodeRuns, &data[i], -1);
+
+    name.str("");
+    name << "\"RleEncoder batch runs" << suffix.str() << "\"";
+    rle_encode_suite.AddBenchmark(name.str(), TestRleBatchEncodeRuns, &data[i], baseline);
+  }
+  cout << rle_encode_suite.Measure() << endl;
+
   Benchmark decode_suite("decode");
   for (int i = 0; i < max_bits; ++i) {
     stringstream suffix;
@@ -31,7 +31,10 @@
 // The benchmarks are divided into serialization and deserialization benchmarks.
 // The serialization benchmarks test different serialization methods (the new default of
 // adjacent deduplication vs. the baseline of no deduplication) on row batches with
-// different patterns of duplication: no_dups and adjacent_dups.
+// different patterns of duplication: no_dups and adjacent_dups. Each pattern is
+// serialized with every RowBatch::DedupMode (the "_none" and "_full" suffixes and
+// adjacent without suffix) and with the TupleDedupPolicy that senders use to choose
+// the mode per batch ("_adaptive").
 // For all benchmarks we use (int, string) tuples to exercise both variable-length and
 // fixed-length slot handling. The small tuples with few slots emphasizes per-tuple
 // dedup performance rather than per-slot serialization/deserialization performance.
@@ -267,14 +270,20 @@ class RowBatchSerializeBenchmark {
 
   struct SerializeArgs {
     RowBatch* batch;
-    bool full_dedup;
+    RowBatch::DedupMode dedup_mode;
+    // If non-NULL, chooses the mode instead of 'dedup_mode'.
+    TupleDedupPolicy* dedup_policy;
   };
 
   static void TestSerialize(int batch_size, void* data) {
     SerializeArgs* args = reinterpret_cast<SerializeArgs*>(data);
     for (int iter = 0; iter < batch_size; ++iter) {
       TRowBatch trow_batch;
-      args->batch->Serialize(&trow_batch, args->full_dedup);
+      if (args->dedup_policy != NULL) {
+        args->batch->Serialize(&trow_batch, THdfsCompression::LZ4, args->dedup_policy);
+      } else {
+        args->batch->Serialize(&trow_batch, args->dedup_mode);
+      }
     }
   }
 
@@ -344,27 +353,56 @@ class RowBatchSerializeBenchmark {
     Benchmark ser_suite("serialize");
     baseline = ser_suite.AddBenchmark("ser_no_dups_baseline", TestSerializeBaseline,
         no_dup_batch, -1);
-    struct SerializeArgs no_dup_ser_args = { no_dup_batch, false };
-    struct SerializeArgs no_dup_ser_full_args = { no_dup_batch, true };
+    struct SerializeArgs no_dup_ser_none_args =
+        { no_dup_batch, RowBatch::NO_DEDUP, NULL };
+    struct SerializeArgs no_dup_ser_args =
+        { no_dup_batch, RowBatch::ADJACENT_DEDUP, NULL };
+    struct SerializeArgs no_dup_ser_full_args =
+        { no_dup_batch, RowBatch::FULL_DEDUP, NULL };
+    TupleDedupPolicy no_dup_policy;
+    struct SerializeArgs no_dup_ser_adaptive_args =
+        { no_dup_batch, RowBatch::ADJACENT_DEDUP, &no_dup_policy };
+    ser_suite.AddBenchmark("ser_no_dups_none",
+        TestSerialize, &no_dup_ser_none_args, baseline);
     ser_suite.AddBenchmark("ser_no_dups", TestSerialize, &no_dup_ser_args, baseline);
     ser_suite.AddBenchmark("ser_no_dups_full",
         TestSerialize, &no_dup_ser_full_args, baseline);
+    ser_suite.AddBenchmark("ser_no_dups_adaptive",
+        TestSerialize, &no_dup_ser_adaptive_args, baseline);
 
     baseline = ser_suite.AddBenchmark("ser_adjacent_dups_baseline",
         TestSerializeBaseline, adjacent_dup_batch, -1);
-    struct SerializeArgs adjacent_dup_ser_args = { adjacent_dup_batch, false };
-    struct SerializeArgs adjacent_dup_ser_full_args = { adjacent_dup_batch, true };
+    struct SerializeArgs adjacent_dup_ser_none_args =
+        { adjacent_dup_batch, RowBatch::NO_DEDUP, NULL };
+    struct SerializeArgs adjacent_dup_ser_args =
+        { adjacent_dup_batch, RowBatch::ADJACENT_DEDUP, NULL };
+    struct SerializeArgs adjacent_dup_ser_full_args =
+        { adjacent_dup_batch, RowBatch::FULL_DEDUP, NULL };
+    TupleDedupPolicy adjacent_dup_policy;
+    struct SerializeArgs adjacent_dup_ser_adaptive_args =
+        { adjacent_dup_batch, RowBatch::ADJACENT_DEDUP, &adjacent_dup_policy };
+    ser_suite.AddBenchmark("ser_adjacent_dups_none",
+        TestSerialize, &adjacent_dup_ser_none_args, baseline);
     ser_suite.AddBenchmark("ser_adjacent_dups",
         TestSerialize, &adjacent_dup_ser_args, baseline);
     ser_suite.AddBenchmark("ser_adjacent_dups_full",
         TestSerialize, &adjacent_dup_ser_full_args, baseline);
+    ser_suite.AddBenchmark("ser_adjacent_dups_adaptive",
+        TestSerialize, &adjacent_dup_ser_adaptive_args, baseline);
 
     baseline = ser_suite.AddBenchmark("ser_dups_baseline",
         TestSerializeBaseline, dup_batch, -1);
-    struct SerializeArgs dup_ser_args = { dup_batch, false };
-    struct SerializeArgs dup_ser_full_args = { dup_batch, true };
+    struct SerializeArgs dup_ser_none_args = { dup_batch, RowBatch::NO_DEDUP, NULL };
+    struct SerializeArgs dup_ser_args = { dup_batch, RowBatch::ADJACENT_DEDUP, NULL };
+    struct SerializeArgs dup_ser_full_args = { dup_batch, RowBatch::FULL_DEDUP, NULL };
+    TupleDedupPolicy dup_policy;
+    struct SerializeArgs dup_ser_adaptive_args =
+        { dup_batch, RowBatch::ADJACENT_DEDUP, &dup_policy };
+    ser_suite.AddBenchmark("ser_dups_none", TestSerialize, &dup_ser_none_args, baseline);
     ser_suite.AddBenchmark("ser_dups", TestSerialize, &dup_ser_args, baseline);
     ser_suite.AddBenchmark("ser_dups_full", TestSerialize, &dup_ser_full_args, baseline);
+    ser_suite.AddBenchmark("ser_dups_adaptive",
+        TestSerialize, &dup_ser_adaptive_args, baseline);
 
     cout << ser_suite.Measure() << endl;
 
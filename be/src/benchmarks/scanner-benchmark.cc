@@ -0,0 +1,377 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <gflags/gflags.h>
+
+#include "common/init.h"
+#include "common/object-pool.h"
+#include "exec/delimited-text-parser.inline.h"
+#include "exec/hdfs-scanner.h"
+#include "exec/parquet-common.h"
+#include "exec/read-write-util.h"
+#include "exec/text-converter.inline.h"
+#include "gutil/strings/substitute.h"
+#include "runtime/descriptors.h"
+#include "runtime/mem-pool.h"
+#include "runtime/mem-tracker.h"
+#include "runtime/string-value.h"
+#include "runtime/tuple.h"
+#include "testutil/desc-tbl-builder.h"
+#include "util/benchmark.h"
+#include "util/cpu-info.h"
+#include "util/dict-encoding.h"
+#include "util/stopwatch.h"
+#include "util/test-info.h"
+
+#include "common/names.h"
+
+using namespace strings;
+
+// Benchmark of the value decoding of the Parquet, text and Avro scanners. For each
+// column type, a column of generated values is encoded the way each format stores it
+// and then decoded with the same functions that the scanners use:
+//  - parquet plain: ParquetPlainEncoder::Decode() per value.
+//  - parquet dict: DictDecoder::GetValues() on RLE encoded dictionary indices.
+//  - text: DelimitedTextParser::ParseFieldLocations() and TextConverter::WriteSlot().
+//  - avro: the zig-zag varints, little-endian floats and length-prefixed strings that
+//    HdfsAvroScanner::ReadAvro*() decode.
+// The benchmark reports the decoded values per second and the encoded bytes per
+// second of each column.
+//
+// The scanners themselves need an HdfsScanNode, its scan ranges and the io manager, so
+// the I/O, decompression and row materialization around the decoders are not measured.
+// Codegen'd decoding is not measured either.
+//
+// Example:
+//   scanner-benchmark --num_values=1000000 --dict_size=1000
+
+DEFINE_int32(num_values, 1000 * 1000, "Number of values of each column.");
+DEFINE_int32(dict_size, 1000, "Number of distinct values of the dictionary encoded "
+    "Parquet columns. The other columns have up to --num_values distinct values.");
+DEFINE_int32(min_time_ms, 1000, "Minimum time each column is decoded for.");
+
+namespace impala {
+
+/// An encoded column and the decoding of all its values.
+class ColumnDecoder {
+ public:
+  ColumnDecoder(const string& format, const string& type)
+    : format_(format), type_(type) { }
+  virtual ~ColumnDecoder() { }
+
+  /// Decodes all values of the column.
+  virtual void Decode() = 0;
+
+  const string& format() const { return format_; }
+  const string& type() const { return type_; }
+  int64_t encoded_bytes() const { return data_.size(); }
+
+ protected:
+  const string format_;
+  const string type_;
+
+  /// The encoded values.
+  vector<uint8_t> data_;
+};
+
+template<typename T>
+class ParquetPlainDecoder : public ColumnDecoder {
+ public:
+  ParquetPlainDecoder(const string& type, const vector<T>& values)
+    : ColumnDecoder("parquet plain", type), values_(values.size()) {
+    for (int i = 0; i < values.size(); ++i) {
+      int offset = data_.size();
+      data_.resize(offset + ParquetPlainEncoder::ByteSize(values[i]));
+      ParquetPlainEncoder::Encode(&data_[offset], -1, values[i]);
+    }
+  }
+
+  virtual void Decode() {
+    uint8_t* buffer = &data_[0];
+    for (int i = 0; i < values_.size(); ++i) {
+      buffer += ParquetPlainEncoder::Decode(buffer, -1, &values_[i]);
+    }
+  }
+
+ private:
+  vector<T> values_;
+};
+
+template<typename T>
+class ParquetDictDecoder : public ColumnDecoder {
+ public:
+  ParquetDictDecoder(const string& type, const vector<T>& values, MemPool* pool)
+    : ColumnDecoder("parquet dict", type), values_(values.size()) {
+    DictEncoder<T> encoder(pool, -1);
+    for (int i = 0; i < values.size(); ++i) encoder.Put(values[i]);
+    dict_.resize(encoder.dict_encoded_size());
+    encoder.WriteDict(&dict_[0]);
+    data_.resize(encoder.EstimatedDataEncodedSize());
+    data_.resize(encoder.WriteData(&data_[0], data_.size()));
+    encoder.ClearIndices();
+    decoder_.Reset(&dict_[0], dict_.size(), -1);
+  }
+
+  virtual void Decode() {
+    decoder_.SetData(&data_[0], data_.size());
+    int num_decoded = decoder_.GetValues(&values_[0], values_.size());
+    DCHECK_EQ(num_decoded, values_.size());
+  }
+
+ private:
+  vector<uint8_t> dict_;
+  DictDecoder<T> decoder_;
+  vector<T> values_;
+};
+
+class TextDecoder : public ColumnDecoder {
+ public:
+  /// Each value is a line of 'values'.
+  TextDecoder(const string& type, const vector<string>& values,
+      const SlotDescriptor* slot_desc, Tuple* tuple)
+    : ColumnDecoder("text", type),
+      slot_desc_(slot_desc),
+      tuple_(tuple),
+      is_materialized_col_(true),
+      parser_(1, 0, &is_materialized_col_, '\n', ','),
+      converter_('\\', "\\N"),
+      row_end_locations_(BATCH_SIZE),
+      field_locations_(BATCH_SIZE),
+      pool_(&tracker_) {
+    for (int i = 0; i < values.size(); ++i) {
+      data_.insert(data_.end(), values[i].begin(), values[i].end());
+      data_.push_back('\n');
+    }
+  }
+
+  virtual void Decode() {
+    parser_.ParserReset();
+    char* buffer = reinterpret_cast<char*>(&data_[0]);
+    char* end = buffer + data_.size();
+    while (buffer < end) {
+      int num_tuples;
+      int num_fields;
+      char* next_column_start;
+      Status status = parser_.ParseFieldLocations(BATCH_SIZE, end - buffer, &buffer,
+          &row_end_locations_[0], &field_locations_[0], &num_tuples, &num_fields,
+          &next_column_start);
+      DCHECK(status.ok());
+      for (int i = 0; i < num_fields; ++i) {
+        converter_.WriteSlot(slot_desc_, tuple_, field_locations_[i].start,
+            field_locations_[i].len, false, false, &pool_);
+      }
+      if (num_tuples == 0) break;
+    }
+  }
+
+ private:
+  /// Maximum number of lines parsed by each ParseFieldLocations() call.
+  static const int BATCH_SIZE = 1024;
+
+  const SlotDescriptor* slot_desc_;
+
+  /// All values are written to this tuple.
+  Tuple* tuple_;
+
+  bool is_materialized_col_;
+  DelimitedTextParser parser_;
+  TextConverter converter_;
+  vector<char*> row_end_locations_;
+  vector<FieldLocation> field_locations_;
+  MemTracker tracker_;
+  MemPool pool_;
+};
+
+template<typename T>
+class AvroDecoder : public ColumnDecoder {
+ public:
+  AvroDecoder(const string& type, const vector<T>& values)
+    : ColumnDecoder("avro", type), values_(values.size()) {
+    for (int i = 0; i < values.size(); ++i) Encode(values[i]);
+  }
+
+  virtual void Decode() {
+    uint8_t* buffer = &data_[0];
+    for (int i = 0; i < values_.size(); ++i) values_[i] = DecodeValue(&buffer);
+  }
+
+ private:
+  void Encode(const T& value) {
+    int offset = data_.size();
+    data_.resize(offset + sizeof(T));
+    memcpy(&data_[offset], &value, sizeof(T));
+  }
+
+  static T DecodeValue(uint8_t** buffer) {
+    T value;
+    memcpy(&value, *buffer, sizeof(T));
+    *buffer += sizeof(T);
+    return value;
+  }
+
+  vector<T> values_;
+};
+
+template<>
+void AvroDecoder<int32_t>::Encode(const int32_t& value) {
+  uint8_t buffer[ReadWriteUtil::MAX_ZINT_LEN];
+  data_.insert(data_.end(), buffer, buffer + ReadWriteUtil::PutZInt(value, buffer));
+}
+
+template<>
+int32_t AvroDecoder<int32_t>::DecodeValue(uint8_t** buffer) {
+  return ReadWriteUtil::ReadZInt(buffer);
+}
+
+template<>
+void AvroDecoder<int64_t>::Encode(const int64_t& value) {
+  uint8_t buffer[ReadWriteUtil::MAX_ZLONG_LEN];
+  data_.insert(data_.end(), buffer, buffer + ReadWriteUtil::PutZLong(value, buffer));
+}
+
+template<>
+int64_t AvroDecoder<int64_t>::DecodeValue(uint8_t** buffer) {
+  return ReadWriteUtil::ReadZLong(buffer);
+}
+
+template<>
+void AvroDecoder<StringValue>::Encode(const StringValue& value) {
+  uint8_t buffer[ReadWriteUtil::MAX_ZLONG_LEN];
+  data_.insert(data_.end(), buffer, buffer + ReadWriteUtil::PutZLong(value.len, buffer));
+  data_.insert(data_.end(), value.ptr, value.ptr + value.len);
+}
+
+template<>
+StringValue AvroDecoder<StringValue>::DecodeValue(uint8_t** buffer) {
+  int64_t len = ReadWriteUtil::ReadZLong(buffer);
+  StringValue value(reinterpret_cast<char*>(*buffer), len);
+  *buffer += len;
+  return value;
+}
+
+/// Adds the decoders of all formats for the column 'values', whose text forms are
+/// 'text_values', to 'decoders'. 'dict_values' are the values of the dictionary encoded
+/// column.
+template<typename T>
+void AddDecoders(const string& type, const vector<T>& values,
+    const vector<T>& dict_values, const vector<string>& text_values,
+    const SlotDescriptor* slot_desc, Tuple* tuple, MemPool* pool,
+    vector<ColumnDecoder*>* decoders) {
+  decoders->push_back(new ParquetPlainDecoder<T>(type, values));
+  decoders->push_back(new ParquetDictDecoder<T>(type, dict_values, pool));
+  decoders->push_back(new TextDecoder(type, text_values, slot_desc, tuple));
+  decoders->push_back(new AvroDecoder<T>(type, values));
+}
+
+/// Returns the text form of each value of 'values'.
+template<typename T>
+vector<string> ToText(const vector<T>& values) {
+  vector<string> result;
+  for (int i = 0; i < values.size(); ++i) {
+    stringstream ss;
+    ss.precision(17);
+    ss << values[i];
+    result.push_back(ss.str());
+  }
+  return result;
+}
+
+}
+
+using namespace impala;
+
+int main(int argc, char** argv) {
+  InitCommonRuntime(argc, argv, false, TestInfo::BE_TEST);
+  cout << endl << Benchmark::GetMachineInfo() << endl;
+
+  // One slot per column type, which the text columns are written to.
+  ObjectPool obj_pool;
+  DescriptorTblBuilder builder(&obj_pool);
+  builder.DeclareTuple() << TYPE_INT << TYPE_BIGINT << TYPE_DOUBLE << TYPE_STRING;
+  TupleDescriptor* tuple_desc = builder.Build()->GetTupleDescriptor(0);
+  const vector<SlotDescriptor*>& slots = tuple_desc->slots();
+  MemTracker tracker;
+  MemPool pool(&tracker);
+  Tuple* tuple = Tuple::Create(tuple_desc->byte_size(), &pool);
+
+  boost::mt19937 rng(0);
+  boost::random::uniform_int_distribution<int64_t> all_values(0, FLAGS_num_values);
+  boost::random::uniform_int_distribution<int64_t> dict_values(0, FLAGS_dict_size - 1);
+  vector<int64_t> keys(FLAGS_num_values);
+  vector<int64_t> dict_keys(FLAGS_num_values);
+  for (int i = 0; i < FLAGS_num_values; ++i) {
+    keys[i] = all_values(rng);
+    dict_keys[i] = dict_values(rng);
+  }
+
+  vector<int32_t> ints(keys.begin(), keys.end());
+  vector<int32_t> dict_ints(dict_keys.begin(), dict_keys.end());
+  vector<int64_t> bigints(FLAGS_num_values);
+  vector<int64_t> dict_bigints(FLAGS_num_values);
+  vector<double> doubles(FLAGS_num_values);
+  vector<double> dict_doubles(FLAGS_num_values);
+  vector<string> texts(FLAGS_num_values);
+  vector<string> dict_texts(FLAGS_num_values);
+  for (int i = 0; i < FLAGS_num_values; ++i) {
+    bigints[i] = keys[i] * 1000 * 1000 * 1000;
+    dict_bigints[i] = dict_keys[i] * 1000 * 1000 * 1000;
+    doubles[i] = keys[i] / 7.0;
+    dict_doubles[i] = dict_keys[i] / 7.0;
+    texts[i] = Substitute("value-$0", keys[i]);
+    dict_texts[i] = Substitute("value-$0", dict_keys[i]);
+  }
+  vector<StringValue> string_values;
+  vector<StringValue> dict_string_values;
+  for (int i = 0; i < FLAGS_num_values; ++i) {
+    string_values.push_back(StringValue(texts[i]));
+    dict_string_values.push_back(StringValue(dict_texts[i]));
+  }
+
+  vector<ColumnDecoder*> decoders;
+  AddDecoders("INT", ints, dict_ints, ToText(ints), slots[0], tuple, &pool, &decoders);
+  AddDecoders("BIGINT", bigints, dict_bigints, ToText(bigints), slots[1], tuple, &pool,
+      &decoders);
+  AddDecoders("DOUBLE", doubles, dict_doubles, ToText(doubles), slots[2], tuple, &pool,
+      &decoders);
+  AddDecoders("STRING", string_values, dict_string_values, texts, slots[3], tuple,
+      &pool, &decoders);
+
+  printf("%-14s %-8s %15s %12s %12s\n", "Format", "Type", "Values/sec", "MB/sec",
+      "Bytes/value");
+  printf("%s\n", string(65, '-').c_str());
+  for (int i = 0; i < decoders.size(); ++i) {
+    ColumnDecoder* decoder = decoders[i];
+    MonotonicStopWatch timer;
+    timer.Start();
+    int64_t iters = 0;
+    do {
+      decoder->Decode();
+      ++iters;
+    } while (timer.ElapsedTime() < FLAGS_min_time_ms * 1000L * 1000L);
+    double seconds = timer.ElapsedTime() / 1e9;
+    printf("%-14s %-8s %15.3g %12.1f %12.2f\n", decoder->format().c_str(),
+        decoder->type().c_str(), iters * FLAGS_num_values / seconds,
+        iters * decoder->encoded_bytes() / seconds / (1024 * 1024),
+        static_cast<double>(decoder->encoded_bytes()) / FLAGS_num_values);
+    delete decoder;
+  }
+  pool.FreeAll();
+  return 0;
+}
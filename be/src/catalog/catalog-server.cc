@@ -20,6 +20,7 @@
 #include "catalog/catalog-util.h"
 #include "statestore/statestore-subscriber.h"
 #include "util/debug-util.h"
+#include "util/hash-util.h"
 #include "gen-cpp/CatalogInternalService_types.h"
 #include "gen-cpp/CatalogObjects_types.h"
 #include "gen-cpp/CatalogService_types.h"
@@ -34,6 +35,11 @@ using namespace rapidjson;
 using namespace strings;
 
 DEFINE_int32(catalog_service_port, 26000, "port where the CatalogService is running");
+DEFINE_int32(catalog_topic_partition_entries_threshold, 100, "(Advanced) HDFS tables "
+    "with at least this many partitions are published in the catalog topic with each "
+    "partition as a separate entry, so that a change to a few partitions only sends "
+    "those partitions to the impalads rather than the whole table. Set to 0 to always "
+    "publish tables as a single entry.");
 DECLARE_string(state_store_host);
 DECLARE_int32(state_store_subscriber_port);
 DECLARE_int32(state_store_port);
@@ -147,7 +153,8 @@ class CatalogServiceThriftIf : public CatalogServiceIf {
 
 CatalogServer::CatalogServer(MetricGroup* metrics)
   : thrift_iface_(new CatalogServiceThriftIf(this)),
-    thrift_serializer_(FLAGS_compact_catalog_topic), metrics_(metrics),
+    thrift_serializer_(FLAGS_compact_catalog_topic), partition_serializer_(true),
+    metrics_(metrics),
     topic_updates_ready_(false), last_sent_catalog_version_(0L),
     catalog_objects_min_version_(0L), catalog_objects_max_version_(0L) {
   topic_processing_time_metric_ = StatsMetric<double>::CreateAndRegister(metrics,
@@ -223,6 +230,7 @@ void CatalogServer::UpdateCatalogTopicCallback(
   if (delta.from_version == 0 && delta.to_version == 0 &&
       catalog_objects_min_version_ != 0) {
     catalog_topic_entry_keys_.clear();
+    published_partitions_.clear();
     last_sent_catalog_version_ = 0L;
   } else {
     // Process the pending topic update.
@@ -279,7 +287,7 @@ void CatalogServer::GatherCatalogUpdatesThread() {
         LOG(ERROR) << status.GetDetail();
       } else {
         // Use the catalog objects to build a topic update list.
-        BuildTopicUpdates(catalog_objects.objects);
+        BuildTopicUpdates(&catalog_objects.objects);
         catalog_objects_min_version_ = last_sent_catalog_version_;
         catalog_objects_max_version_ = catalog_objects.max_catalog_version;
       }
@@ -290,11 +298,11 @@ void CatalogServer::GatherCatalogUpdatesThread() {
   }
 }
 
-void CatalogServer::BuildTopicUpdates(const vector<TCatalogObject>& catalog_objects) {
+void CatalogServer::BuildTopicUpdates(vector<TCatalogObject>* catalog_objects) {
   unordered_set<string> current_entry_keys;
 
   // Add any new/updated catalog objects to the topic.
-  BOOST_FOREACH(const TCatalogObject& catalog_object, catalog_objects) {
+  BOOST_FOREACH(TCatalogObject& catalog_object, *catalog_objects) {
     const string& entry_key = TCatalogObjectToEntryKey(catalog_object);
     if (entry_key.empty()) {
       LOG_EVERY_N(WARNING, 60) << "Unable to build topic entry key for TCatalogObject: "
@@ -313,6 +321,7 @@ void CatalogServer::BuildTopicUpdates(const vector<TCatalogObject>& catalog_obje
     VLOG(1) << "Publishing update: " << entry_key << "@"
             << catalog_object.catalog_version;
 
+    BuildPartitionTopicUpdates(entry_key, &catalog_object);
     pending_topic_updates_.push_back(TTopicItem());
     TTopicItem& item = pending_topic_updates_.back();
     item.key = entry_key;
@@ -331,10 +340,91 @@ void CatalogServer::BuildTopicUpdates(const vector<TCatalogObject>& catalog_obje
     item.key = key;
     VLOG(1) << "Publishing deletion: " << key;
     // Don't set a value to mark this item as deleted.
+    DeletePublishedPartitions(key);
   }
   catalog_topic_entry_keys_.swap(current_entry_keys);
 }
 
+void CatalogServer::BuildPartitionTopicUpdates(const string& table_key,
+    TCatalogObject* catalog_object) {
+  PartitionHashMap old_partitions;
+  unordered_map<string, PartitionHashMap>::iterator published_it =
+      published_partitions_.find(table_key);
+  if (published_it != published_partitions_.end()) {
+    old_partitions.swap(published_it->second);
+    published_partitions_.erase(published_it);
+  }
+
+  if (FLAGS_catalog_topic_partition_entries_threshold > 0 &&
+      catalog_object->type == TCatalogObjectType::TABLE &&
+      catalog_object->table.__isset.hdfs_table &&
+      static_cast<int64_t>(catalog_object->table.hdfs_table.partitions.size()) >=
+      FLAGS_catalog_topic_partition_entries_threshold) {
+    THdfsTable* hdfs_table = &catalog_object->table.hdfs_table;
+    vector<TTopicItem> partition_items;
+    PartitionHashMap new_partitions;
+    bool serialized_all = true;
+    typedef map<int64_t, THdfsPartition> PartitionMap;
+    BOOST_FOREACH(PartitionMap::value_type& partition, hdfs_table->partitions) {
+      TTopicItem item;
+      Status status = partition_serializer_.Serialize(&partition.second, &item.value);
+      if (!status.ok()) {
+        LOG(ERROR) << "Error serializing partition " << partition.first << " of "
+                   << table_key << ", publishing the table as a single entry: "
+                   << status.GetDetail();
+        serialized_all = false;
+        break;
+      }
+      uint64_t hash = HashUtil::MurmurHash2_64(item.value.data(), item.value.size(), 0);
+      new_partitions[partition.first] = hash;
+      PartitionHashMap::iterator old_it = old_partitions.find(partition.first);
+      if (old_it != old_partitions.end()) {
+        bool unchanged = old_it->second == hash;
+        old_partitions.erase(old_it);
+        if (unchanged) continue;
+      }
+      item.key = PartitionEntryKey(table_key, partition.first);
+      partition_items.push_back(item);
+    }
+
+    if (serialized_all) {
+      hdfs_table->__isset.partition_ids = true;
+      hdfs_table->partition_ids.reserve(hdfs_table->partitions.size());
+      BOOST_FOREACH(const PartitionMap::value_type& partition, hdfs_table->partitions) {
+        hdfs_table->partition_ids.push_back(partition.first);
+      }
+      hdfs_table->partitions.clear();
+      VLOG(1) << "Publishing " << partition_items.size() << " of "
+              << hdfs_table->partition_ids.size() << " partitions of " << table_key;
+      pending_topic_updates_.insert(pending_topic_updates_.end(),
+          partition_items.begin(), partition_items.end());
+      published_partitions_[table_key].swap(new_partitions);
+    } else {
+      // The table is published as a single entry, so all its partition entries go.
+      BOOST_FOREACH(const PartitionHashMap::value_type& partition, new_partitions) {
+        old_partitions.insert(partition);
+      }
+    }
+  }
+
+  // Whatever is left was dropped, or the table is no longer published by partition.
+  BOOST_FOREACH(const PartitionHashMap::value_type& partition, old_partitions) {
+    pending_topic_updates_.push_back(TTopicItem());
+    pending_topic_updates_.back().key = PartitionEntryKey(table_key, partition.first);
+  }
+}
+
+void CatalogServer::DeletePublishedPartitions(const string& table_key) {
+  unordered_map<string, PartitionHashMap>::iterator published_it =
+      published_partitions_.find(table_key);
+  if (published_it == published_partitions_.end()) return;
+  BOOST_FOREACH(const PartitionHashMap::value_type& partition, published_it->second) {
+    pending_topic_updates_.push_back(TTopicItem());
+    pending_topic_updates_.back().key = PartitionEntryKey(table_key, partition.first);
+  }
+  published_partitions_.erase(published_it);
+}
+
 void CatalogServer::CatalogUrlCallback(const Webserver::ArgumentMap& args,
     Document* document) {
   TGetDbsResult get_dbs_result;
@@ -19,6 +19,7 @@
 #include <vector>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/unordered_set.hpp>
 
 #include "gen-cpp/CatalogService.h"
@@ -75,6 +76,11 @@ class CatalogServer {
   /// Thrift API implementation which proxies requests onto this CatalogService.
   boost::shared_ptr<CatalogServiceIf> thrift_iface_;
   ThriftSerializer thrift_serializer_;
+
+  /// Serializes the partitions that are published as separate topic entries. Always uses
+  /// the compact protocol, whose variable-length integers make the file descriptors of
+  /// the partitions much smaller.
+  ThriftSerializer partition_serializer_;
   MetricGroup* metrics_;
   boost::scoped_ptr<Catalog> catalog_;
   boost::scoped_ptr<StatestoreSubscriber> statestore_subscriber_;
@@ -91,6 +97,13 @@ class CatalogServer {
   /// since the last heartbeat.
   boost::unordered_set<std::string> catalog_topic_entry_keys_;
 
+  /// For each table whose partitions are published as separate topic entries, keyed by
+  /// the topic entry key of the table, maps the id of each published partition to the
+  /// hash of its serialized value. Used to publish only the partitions that changed, and
+  /// deletions for those that were dropped. Protected by catalog_lock_.
+  typedef boost::unordered_map<int64_t, uint64_t> PartitionHashMap;
+  boost::unordered_map<std::string, PartitionHashMap> published_partitions_;
+
   /// Protects catalog_update_cv_, pending_topic_updates_,
   /// catalog_objects_to/from_version_, and last_sent_catalog_version.
   boost::mutex catalog_lock_;
@@ -162,8 +175,25 @@ class CatalogServer {
   /// "TABLE:foo.bar". Encoding the object type information in the key ensures the keys
   /// are unique, as well as helps to determine what object type was removed in a state
   /// store delta update (since the state store only sends key names for deleted items).
+  /// HDFS tables with at least --catalog_topic_partition_entries_threshold partitions are
+  /// published with their partitions as separate entries, see
+  /// BuildPartitionTopicUpdates(). Their partitions are moved out of 'catalog_objects'.
   /// Must hold catalog_lock_ when calling this function.
-  void BuildTopicUpdates(const std::vector<TCatalogObject>& catalog_objects);
+  void BuildTopicUpdates(std::vector<TCatalogObject>* catalog_objects);
+
+  /// Called for each new or updated catalog object with topic entry key 'table_key'. If
+  /// it is an HDFS table with enough partitions, moves its partitions out of
+  /// 'catalog_object' into separate topic entries, of which only the new and changed
+  /// ones are added to pending_topic_updates_, and sets THdfsTable.partition_ids.
+  /// Otherwise leaves 'catalog_object' unchanged. In either case, adds deletions for
+  /// the previously published partition entries of the table that were not published
+  /// again. Must hold catalog_lock_.
+  void BuildPartitionTopicUpdates(const std::string& table_key,
+      TCatalogObject* catalog_object);
+
+  /// Adds deletions of all partition entries published for the table with topic entry
+  /// key 'table_key' to pending_topic_updates_. Must hold catalog_lock_.
+  void DeletePublishedPartitions(const std::string& table_key);
 
   /// Example output:
   /// "databases": [
@@ -26,6 +26,9 @@ using boost::algorithm::to_upper_copy;
 
 namespace impala {
 
+static const string TABLE_ENTRY_KEY_PREFIX = "TABLE:";
+static const string PARTITION_ENTRY_KEY_PREFIX = "HDFS_PARTITION:";
+
 TCatalogObjectType::type TCatalogObjectTypeFromName(const string& name) {
   const string& upper = to_upper_copy(name);
   if (upper == "DATABASE") {
@@ -184,5 +187,28 @@ string TCatalogObjectToEntryKey(const TCatalogObject& catalog_object) {
   return entry_key.str();
 }
 
+string PartitionEntryKey(const string& table_key, int64_t partition_id) {
+  DCHECK_EQ(table_key.compare(0, TABLE_ENTRY_KEY_PREFIX.size(), TABLE_ENTRY_KEY_PREFIX),
+      0);
+  stringstream entry_key;
+  entry_key << PARTITION_ENTRY_KEY_PREFIX
+            << table_key.substr(TABLE_ENTRY_KEY_PREFIX.size()) << ":" << partition_id;
+  return entry_key.str();
+}
+
+bool ParsePartitionEntryKey(const string& key, string* table_key,
+    int64_t* partition_id) {
+  const string& prefix = PARTITION_ENTRY_KEY_PREFIX;
+  if (key.compare(0, prefix.size(), prefix) != 0) return false;
+  // Table names cannot contain ':', so the last one separates the partition id.
+  size_t pos = key.rfind(":");
+  if (pos < PARTITION_ENTRY_KEY_PREFIX.size() || pos == key.size() - 1) return false;
+  *table_key = TABLE_ENTRY_KEY_PREFIX +
+      key.substr(PARTITION_ENTRY_KEY_PREFIX.size(),
+          pos - PARTITION_ENTRY_KEY_PREFIX.size());
+  *partition_id = atol(key.c_str() + pos + 1);
+  return true;
+}
+
 
 }
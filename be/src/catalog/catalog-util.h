@@ -48,6 +48,17 @@ Status TCatalogObjectFromObjectName(const TCatalogObjectType::type& object_type,
 /// Returns an empty string if there were any problem building the key.
 std::string TCatalogObjectToEntryKey(const TCatalogObject& catalog_object);
 
+/// Builds the topic entry key of the partition with 'partition_id' of the HDFS table
+/// with topic entry key 'table_key', for tables whose partitions are published as
+/// separate topic entries (see THdfsTable.partition_ids). The key format is:
+/// "HDFS_PARTITION:<fully qualified table name>:<partition id>".
+std::string PartitionEntryKey(const std::string& table_key, int64_t partition_id);
+
+/// Returns true if 'key' was built by PartitionEntryKey(), in which case 'table_key' and
+/// 'partition_id' are set to the arguments it was built from.
+bool ParsePartitionEntryKey(const std::string& key, std::string* table_key,
+    int64_t* partition_id);
+
 }
 
 #endif
@@ -0,0 +1,85 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "codegen/codegen-cache.h"
+
+#include <gflags/gflags.h>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/IR/LLVMContext.h>
+
+#include "common/logging.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+DEFINE_int64(codegen_cache_capacity, 0, "(Advanced) Maximum size of the JIT compiled "
+    "modules, measured by their fingerprints, that are kept in memory for reuse by "
+    "fragments of later queries that codegen the same functions. Set to 0 to disable "
+    "the cache.");
+
+CodegenCache::CodegenCache(int64_t capacity)
+  : capacity_(capacity),
+    size_(0) {
+}
+
+CodegenCache* CodegenCache::instance() {
+  static CodegenCache cache(FLAGS_codegen_cache_capacity);
+  return &cache;
+}
+
+shared_ptr<const CodegenCache::Module> CodegenCache::Lookup(const string& fingerprint) {
+  if (capacity_ == 0) return shared_ptr<const Module>();
+  lock_guard<mutex> l(lock_);
+  EntryMap::iterator it = entries_.find(fingerprint);
+  if (it == entries_.end()) return shared_ptr<const Module>();
+  // Move to the back, this is now the most recently used entry.
+  lru_list_.splice(lru_list_.end(), lru_list_, it->second);
+  return it->second->module;
+}
+
+void CodegenCache::Insert(const string& fingerprint,
+    const shared_ptr<const Module>& module) {
+  DCHECK(module.get() != NULL);
+  int64_t charge = fingerprint.size();
+  if (capacity_ == 0 || charge > capacity_) return;
+  lock_guard<mutex> l(lock_);
+  EntryMap::iterator existing = entries_.find(fingerprint);
+  if (existing != entries_.end()) RemoveEntry(existing->second);
+  while (size_ + charge > capacity_) {
+    DCHECK(!lru_list_.empty());
+    RemoveEntry(lru_list_.begin());
+  }
+  Entry entry;
+  entry.fingerprint = fingerprint;
+  entry.module = module;
+  entries_[fingerprint] = lru_list_.insert(lru_list_.end(), entry);
+  size_ += charge;
+}
+
+int64_t CodegenCache::size() {
+  lock_guard<mutex> l(lock_);
+  return size_;
+}
+
+int CodegenCache::num_entries() {
+  lock_guard<mutex> l(lock_);
+  return entries_.size();
+}
+
+void CodegenCache::RemoveEntry(EntryList::iterator it) {
+  size_ -= it->fingerprint.size();
+  entries_.erase(it->fingerprint);
+  lru_list_.erase(it);
+}
@@ -0,0 +1,110 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_CODEGEN_CODEGEN_CACHE_H
+#define IMPALA_CODEGEN_CODEGEN_CACHE_H
+
+#include <list>
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+namespace llvm {
+  class ExecutionEngine;
+  class LLVMContext;
+}
+
+namespace impala {
+
+/// Process-wide cache of JIT compiled modules. Fragments that codegen the same functions
+/// as an earlier fragment, e.g. repeated runs of the same query, reuse its machine code
+/// instead of optimizing and compiling the module again.
+///
+/// Entries are keyed by the fingerprint of a module, see LlvmCodeGen::GetFingerprint(),
+/// which is charged against the capacity as a proxy for the size of the optimized
+/// module and its machine code. When the total charge exceeds the capacity, the least
+/// recently used entries are evicted. Entries are immutable and shared: an evicted
+/// module stays valid for the fragments that still hold it.
+///
+/// This class is thread-safe.
+class CodegenCache {
+ public:
+  /// A JIT compiled module. Owns the execution engine, which owns the module and its
+  /// machine code, and the context they were created in.
+  struct Module {
+    /// Declared before 'execution_engine' so that it is destroyed last.
+    boost::shared_ptr<llvm::LLVMContext> context;
+    boost::shared_ptr<llvm::ExecutionEngine> execution_engine;
+
+    /// The JIT'd functions, in the order in which they were registered with
+    /// LlvmCodeGen::AddFunctionToJit().
+    std::vector<void*> jitted_fns;
+  };
+
+  /// A capacity of 0 disables the cache.
+  CodegenCache(int64_t capacity);
+
+  /// Returns the process-wide instance, which is sized by --codegen_cache_capacity.
+  static CodegenCache* instance();
+
+  bool enabled() const { return capacity_ > 0; }
+
+  /// Returns the module with 'fingerprint', or NULL if it is not cached.
+  boost::shared_ptr<const Module> Lookup(const std::string& fingerprint);
+
+  /// Inserts 'module' with 'fingerprint'. Replaces an existing entry for the same
+  /// fingerprint.
+  void Insert(const std::string& fingerprint,
+      const boost::shared_ptr<const Module>& module);
+
+  /// Sum of the charges of the cached entries.
+  int64_t size();
+
+  /// Number of entries in the cache.
+  int num_entries();
+
+ private:
+  struct Entry {
+    std::string fingerprint;
+    boost::shared_ptr<const Module> module;
+  };
+
+  typedef std::list<Entry> EntryList;
+  typedef boost::unordered_map<std::string, EntryList::iterator> EntryMap;
+
+  /// Removes the entry at 'it'. 'lock_' must be taken.
+  void RemoveEntry(EntryList::iterator it);
+
+  const int64_t capacity_;
+
+  /// Protects all members below.
+  boost::mutex lock_;
+
+  /// All entries, in least recently used order: new and accessed entries go to the
+  /// back, evictions take from the front.
+  EntryList lru_list_;
+
+  /// Maps each fingerprint to its entry in 'lru_list_'.
+  EntryMap entries_;
+
+  /// Sum of the charges of the entries in 'entries_'.
+  int64_t size_;
+};
+
+}
+
+#endif
@@ -67,6 +67,7 @@ ir_functions = [
   ["HASH_CRC", "IrCrcHash"],
   ["HASH_FNV", "IrFnvHash"],
   ["HASH_MURMUR", "IrMurmurHash"],
+  ["HASH_VAR_LEN", "IrVarLenHash"],
   ["HASH_JOIN_PROCESS_BUILD_BATCH", "12HashJoinNode17ProcessBuildBatch"],
   ["HASH_JOIN_PROCESS_PROBE_BATCH", "12HashJoinNode17ProcessProbeBatch"],
   ["PHJ_PROCESS_BUILD_BATCH", "23PartitionedHashJoinNode17ProcessBuildBatch"],
@@ -101,6 +102,7 @@ ir_functions = [
   ["READ_AVRO_STRING", "ReadAvroString"],
   ["READ_AVRO_VARCHAR", "ReadAvroVarchar"],
   ["READ_AVRO_CHAR", "ReadAvroChar"],
+  ["READ_AVRO_DECIMAL", "ReadAvroDecimal"],
   ["HDFS_SCANNER_WRITE_ALIGNED_TUPLES", "WriteAlignedTuples"],
   ["HDFS_SCANNER_GET_CONJUNCT_CTX", "GetConjunctCtx"],
   ["STRING_TO_BOOL", "IrStringToBool"],
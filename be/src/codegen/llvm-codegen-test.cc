@@ -344,6 +344,76 @@ TEST_F(LlvmCodeGenTest, MemcpyTest) {
   EXPECT_EQ(memcmp(src, dst, 4), 0);
 }
 
+// Test that the impala IR module is loaded without function bodies, and that a
+// cross-compiled function is materialized when it is used.
+TEST_F(LlvmCodeGenTest, LazyLoadImpalaIR) {
+  ObjectPool pool;
+
+  scoped_ptr<LlvmCodeGen> codegen;
+  ASSERT_OK(LlvmCodeGen::LoadImpalaIR(&pool, "test", &codegen));
+  ASSERT_TRUE(codegen.get() != NULL);
+
+  vector<Function*> functions;
+  codegen->GetFunctions(&functions);
+  ASSERT_GT(functions.size(), 0);
+  int num_materializable = 0;
+  for (int i = 0; i < functions.size(); ++i) {
+    if (functions[i]->isMaterializable()) ++num_materializable;
+  }
+  EXPECT_EQ(num_materializable, functions.size());
+
+  Function* fn = codegen->GetFunction(IRFunction::HASH_FNV);
+  ASSERT_TRUE(fn != NULL);
+  EXPECT_FALSE(fn->isMaterializable());
+  EXPECT_FALSE(fn->empty());
+}
+
+// Generates a function that takes no arguments and returns 'val'.
+static Function* CodegenReturnInt(LlvmCodeGen* codegen, const string& name, int val) {
+  LlvmCodeGen::FnPrototype prototype(codegen, name, codegen->GetType(TYPE_INT));
+  LlvmCodeGen::LlvmBuilder builder(codegen->context());
+  Function* fn = prototype.GeneratePrototype(&builder, NULL);
+  builder.CreateRet(codegen->GetIntConstant(TYPE_INT, val));
+  return codegen->FinalizeFunction(fn);
+}
+
+static void FinalizeModule(LlvmCodeGen* codegen, Status* status) {
+  *status = codegen->FinalizeModule();
+}
+
+// Test that FinalizeModule() can run on another thread and sets the registered function
+// pointers.
+TEST_F(LlvmCodeGenTest, AsyncFinalize) {
+  ObjectPool pool;
+
+  scoped_ptr<LlvmCodeGen> codegen;
+  ASSERT_OK(LlvmCodeGen::LoadImpalaIR(&pool, "test", &codegen));
+  ASSERT_TRUE(codegen.get() != NULL);
+  EXPECT_FALSE(codegen->CanFinalizeAsync());
+
+  typedef int (*TestFn)();
+  TestFn with_fallback = NULL;
+  TestFn without_fallback = NULL;
+  Function* fn = CodegenReturnInt(codegen.get(), "WithFallback", 1);
+  ASSERT_TRUE(fn != NULL);
+  codegen->AddFunctionToJit(fn, reinterpret_cast<void**>(&with_fallback), true);
+  EXPECT_TRUE(codegen->CanFinalizeAsync());
+
+  fn = CodegenReturnInt(codegen.get(), "WithoutFallback", 2);
+  ASSERT_TRUE(fn != NULL);
+  codegen->AddFunctionToJit(fn, reinterpret_cast<void**>(&without_fallback));
+  EXPECT_FALSE(codegen->CanFinalizeAsync());
+
+  Status status;
+  thread finalize_thread(FinalizeModule, codegen.get(), &status);
+  finalize_thread.join();
+  ASSERT_OK(status);
+  ASSERT_TRUE(with_fallback != NULL);
+  ASSERT_TRUE(without_fallback != NULL);
+  EXPECT_EQ(with_fallback(), 1);
+  EXPECT_EQ(without_fallback(), 2);
+}
+
 // Test codegen for hash
 TEST_F(LlvmCodeGenTest, HashTest) {
   ObjectPool pool;
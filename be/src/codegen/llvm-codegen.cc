@@ -14,8 +14,10 @@
 
 #include "codegen/llvm-codegen.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <set>
 #include <sstream>
 #include <boost/thread/mutex.hpp>
 #include <gutil/strings/substitute.h>
@@ -27,6 +29,7 @@
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm/ExecutionEngine/JIT.h>
 #include <llvm/IR/DataLayout.h>
+#include <llvm/IR/GlobalVariable.h>
 #include <llvm/Linker.h>
 #include <llvm/PassManager.h>
 #include <llvm/Support/DynamicLibrary.h>
@@ -44,6 +47,7 @@
 #include <llvm/Transforms/Utils/BasicBlockUtils.h>
 #include <llvm/Transforms/Utils/Cloning.h>
 
+#include "common/atomic.h"
 #include "common/logging.h"
 #include "codegen/codegen-anyval.h"
 #include "codegen/impala-ir-data.h"
@@ -71,6 +75,13 @@ DEFINE_string(unopt_module_dir, "",
     "if set, saves unoptimized generated IR modules to the specified directory.");
 DEFINE_string(opt_module_dir, "",
     "if set, saves optimized generated IR modules to the specified directory.");
+DEFINE_bool(lazy_load_impala_ir, true, "(Advanced) If true, only the declarations of "
+    "the cross-compiled impala IR module are parsed when a fragment creates its codegen "
+    "module. The bodies of the cross-compiled functions are parsed when they are used.");
+DEFINE_bool(async_codegen, false, "(Advanced) If true, fragments whose codegen'd "
+    "functions all have an interpreted fallback start executing with the interpreted "
+    "functions while the module is optimized and compiled on another thread, and switch "
+    "to the compiled functions once they are ready.");
 DECLARE_string(local_library_dir);
 
 namespace impala {
@@ -107,16 +118,19 @@ LlvmCodeGen::LlvmCodeGen(ObjectPool* pool, const string& id) :
   is_compiled_(false),
   context_(new llvm::LLVMContext()),
   module_(NULL),
-  execution_engine_(NULL) {
+  module_cached_(false),
+  num_fns_without_fallback_(0) {
 
   DCHECK(llvm_initialized) << "Must call LlvmCodeGen::InitializeLlvm first.";
 
   load_module_timer_ = ADD_TIMER(&profile_, "LoadTime");
   prepare_module_timer_ = ADD_TIMER(&profile_, "PrepareTime");
   module_bitcode_size_ = ADD_COUNTER(&profile_, "ModuleBitcodeSize", TUnit::BYTES);
+  num_materialized_fns_ = ADD_COUNTER(&profile_, "NumFunctionsMaterialized", TUnit::UNIT);
   codegen_timer_ = ADD_TIMER(&profile_, "CodegenTime");
   optimization_timer_ = ADD_TIMER(&profile_, "OptimizationTime");
   compile_timer_ = ADD_TIMER(&profile_, "CompileTime");
+  cache_hit_counter_ = ADD_COUNTER(&profile_, "CodegenCacheHit", TUnit::UNIT);
 
   loaded_functions_.resize(IRFunction::FN_END);
 }
@@ -134,13 +148,14 @@ Status LlvmCodeGen::LoadFromFile(ObjectPool* pool,
 }
 
 Status LlvmCodeGen::LoadFromMemory(ObjectPool* pool, MemoryBuffer* module_ir,
-    const string& module_name, const string& id, scoped_ptr<LlvmCodeGen>* codegen) {
+    const string& module_name, const string& id, scoped_ptr<LlvmCodeGen>* codegen,
+    bool lazy) {
   codegen->reset(new LlvmCodeGen(pool, id));
   SCOPED_TIMER((*codegen)->profile_.total_time_counter());
 
   Module* loaded_module;
   RETURN_IF_ERROR(LoadModuleFromMemory(codegen->get(), module_ir, module_name,
-      &loaded_module));
+      &loaded_module, lazy));
   (*codegen)->module_ = loaded_module;
 
   return (*codegen)->Init();
@@ -165,10 +180,19 @@ Status LlvmCodeGen::LoadModuleFromFile(LlvmCodeGen* codegen, const string& file,
 }
 
 Status LlvmCodeGen::LoadModuleFromMemory(LlvmCodeGen* codegen, MemoryBuffer* module_ir,
-      std::string module_name, llvm::Module** module) {
+      std::string module_name, llvm::Module** module, bool lazy) {
   SCOPED_TIMER(codegen->prepare_module_timer_);
   string error;
-  *module = ParseBitcodeFile(module_ir, codegen->context(), &error);
+  if (lazy) {
+    // The module takes ownership of the buffer it reads from, so give it its own
+    // buffer over the same data.
+    MemoryBuffer* lazy_module_ir = MemoryBuffer::getMemBuffer(module_ir->getBuffer(),
+        module_ir->getBufferIdentifier(), false);
+    *module = getLazyBitcodeModule(lazy_module_ir, codegen->context(), &error);
+    if (*module == NULL) delete lazy_module_ir;
+  } else {
+    *module = ParseBitcodeFile(module_ir, codegen->context(), &error);
+  }
   if (*module == NULL) {
     stringstream ss;
     ss << "Could not parse module " << module_name << ": " << error;
@@ -215,8 +239,10 @@ Status LlvmCodeGen::LoadImpalaIR(
   }
   scoped_ptr<MemoryBuffer> module_ir_buf(
       MemoryBuffer::getMemBuffer(module_ir, "", false));
+  // The bitcode is a static array, so a lazily loaded module can read from it for as
+  // long as the module lives.
   RETURN_IF_ERROR(LoadFromMemory(pool, module_ir_buf.get(), module_name, id,
-      codegen_ret));
+      codegen_ret, FLAGS_lazy_load_impala_ir));
   LlvmCodeGen* codegen = codegen_ret->get();
 
   // Parse module for cross compiled functions and types
@@ -296,7 +322,7 @@ Status LlvmCodeGen::Init() {
   //builder.setMCPU(llvm::sys::getHostCPUName());
   builder.setErrorStr(&error_string_);
   execution_engine_.reset(builder.create());
-  if (execution_engine_ == NULL) {
+  if (execution_engine_.get() == NULL) {
     // execution_engine_ will take ownership of the module if it is created
     delete module_;
     stringstream ss;
@@ -315,6 +341,8 @@ Status LlvmCodeGen::Init() {
 }
 
 LlvmCodeGen::~LlvmCodeGen() {
+  // The machine code of a cached module is freed when the cache releases the engine.
+  if (module_cached_) return;
   for (map<Function*, bool>::iterator iter = jitted_functions_.begin();
       iter != jitted_functions_.end(); ++iter) {
     execution_engine_->freeMachineCodeForFunction(iter->first);
@@ -338,6 +366,57 @@ string LlvmCodeGen::GetIR(bool full_module) const {
   return str;
 }
 
+/// Adds the functions and global variables that 'user' references, directly or through
+/// constant expressions, to 'globals' unless they are in 'visited'.
+static void AddReferencedGlobals(User* user, set<Value*>* visited,
+    vector<GlobalValue*>* globals) {
+  for (User::op_iterator it = user->op_begin(); it != user->op_end(); ++it) {
+    Value* operand = it->get();
+    if (!isa<Constant>(operand) || !visited->insert(operand).second) continue;
+    if (isa<GlobalValue>(operand)) {
+      globals->push_back(cast<GlobalValue>(operand));
+    } else {
+      AddReferencedGlobals(cast<Constant>(operand), visited, globals);
+    }
+  }
+}
+
+void LlvmCodeGen::GetReachableGlobals(vector<GlobalValue*>* globals) {
+  set<Value*> visited;
+  for (int i = 0; i < fns_to_jit_compile_.size(); ++i) {
+    Function* fn = fns_to_jit_compile_[i].first;
+    if (visited.insert(fn).second) globals->push_back(fn);
+  }
+  // 'globals' grows while it is walked, in the order in which the references are found.
+  for (int i = 0; i < globals->size(); ++i) {
+    GlobalValue* global = (*globals)[i];
+    Function* fn = dyn_cast<Function>(global);
+    if (fn == NULL) {
+      AddReferencedGlobals(global, &visited, globals);
+      continue;
+    }
+    MaterializeFunction(fn);
+    for (inst_iterator it = inst_begin(fn); it != inst_end(fn); ++it) {
+      AddReferencedGlobals(&*it, &visited, globals);
+    }
+  }
+}
+
+string LlvmCodeGen::GetFingerprint(const vector<GlobalValue*>& globals) const {
+  string str;
+  raw_string_ostream stream(str);
+  stream << "optimized=" << (optimizations_enabled_ && !FLAGS_disable_optimization_passes)
+         << "\n";
+  for (int i = 0; i < fns_to_jit_compile_.size(); ++i) {
+    stream << "jit " << fns_to_jit_compile_[i].first->getName() << "\n";
+  }
+  for (int i = 0; i < globals.size(); ++i) {
+    globals[i]->print(stream, NULL);
+    stream << "\n";
+  }
+  return stream.str();
+}
+
 Type* LlvmCodeGen::GetType(const ColumnType& type) {
   switch (type.type) {
     case TYPE_NULL:
@@ -453,9 +532,21 @@ Function* LlvmCodeGen::GetLibCFunction(FnPrototype* prototype) {
 
 Function* LlvmCodeGen::GetFunction(IRFunction::Type function) {
   DCHECK(loaded_functions_[function] != NULL);
+  MaterializeFunction(loaded_functions_[function]);
   return loaded_functions_[function];
 }
 
+void LlvmCodeGen::MaterializeFunction(Function* fn) {
+  if (!fn->isMaterializable()) return;
+  string error;
+  if (fn->Materialize(&error)) {
+    LOG(ERROR) << "Could not materialize " << fn->getName().str() << ": " << error;
+    is_corrupt_ = true;
+    return;
+  }
+  COUNTER_ADD(num_materialized_fns_, 1);
+}
+
 // TODO: this should return a Status
 bool LlvmCodeGen::VerifyFunction(Function* fn) {
   if (is_corrupt_) return false;
@@ -542,6 +633,7 @@ Function* LlvmCodeGen::ReplaceCallSites(Function* caller, bool update_in_place,
   DCHECK(caller != NULL);
   DCHECK(new_fn != NULL);
 
+  MaterializeFunction(caller);
   if (!update_in_place) {
     caller = CloneFunction(caller);
   } else if (jitted_functions_.find(caller) != jitted_functions_.end()) {
@@ -570,6 +662,7 @@ Function* LlvmCodeGen::ReplaceCallSites(Function* caller, bool update_in_place,
 }
 
 Function* LlvmCodeGen::CloneFunction(Function* fn) {
+  MaterializeFunction(fn);
   ValueToValueMapTy dummy_vmap;
   // CloneFunction() automatically gives the new function a unique name
   Function* fn_clone = llvm::CloneFunction(fn, dummy_vmap, false);
@@ -607,6 +700,8 @@ int LlvmCodeGen::InlineCallSites(Function* fn, bool skip_registered_fns) {
             continue;
           }
         }
+        // InlineFunction() doesn't inline functions that are not materialized.
+        MaterializeFunction(called_fn);
         call_sites.push_back(call_instr);
       }
     }
@@ -651,6 +746,15 @@ Status LlvmCodeGen::FinalizeModule() {
   DCHECK(!is_compiled_);
   is_compiled_ = true;
 
+  // Parse the bodies of the lazily loaded functions that the functions to JIT need. The
+  // others remain declarations and are removed by the optimization passes.
+  vector<GlobalValue*> reachable_globals;
+  CodegenCache* cache = CodegenCache::instance();
+  if (module_->getMaterializer() != NULL || cache->enabled()) {
+    SCOPED_TIMER(prepare_module_timer_);
+    GetReachableGlobals(&reachable_globals);
+  }
+
   if (FLAGS_unopt_module_dir.size() != 0) {
     string path = FLAGS_unopt_module_dir + "/" + id_ + "_unopt.ll";
     fstream f(path.c_str(), fstream::out | fstream::trunc);
@@ -665,6 +769,18 @@ Status LlvmCodeGen::FinalizeModule() {
   if (is_corrupt_) return Status("Module is corrupt.");
   SCOPED_TIMER(profile_.total_time_counter());
 
+  string fingerprint;
+  if (cache->enabled() && !fns_to_jit_compile_.empty()) {
+    fingerprint = GetFingerprint(reachable_globals);
+    cached_module_ = cache->Lookup(fingerprint);
+    if (cached_module_.get() != NULL) {
+      DCHECK_EQ(cached_module_->jitted_fns.size(), fns_to_jit_compile_.size());
+      PublishJittedFunctions(cached_module_->jitted_fns);
+      cache_hit_counter_->Set(1L);
+      return Status::OK();
+    }
+  }
+
   // Don't waste time optimizing module if there are no functions to JIT. This can happen
   // if the codegen object is created but no functions are successfully codegen'd.
   if (optimizations_enabled_ && !FLAGS_disable_optimization_passes &&
@@ -672,10 +788,25 @@ Status LlvmCodeGen::FinalizeModule() {
     OptimizeModule();
   }
 
-  SCOPED_TIMER(compile_timer_);
-  // JIT compile all codegen'd functions
-  for (int i = 0; i < fns_to_jit_compile_.size(); ++i) {
-    *fns_to_jit_compile_[i].second = JitFunction(fns_to_jit_compile_[i].first);
+  vector<void*> jitted_fns(fns_to_jit_compile_.size());
+  {
+    SCOPED_TIMER(compile_timer_);
+    // JIT compile all codegen'd functions
+    for (int i = 0; i < fns_to_jit_compile_.size(); ++i) {
+      jitted_fns[i] = JitFunction(fns_to_jit_compile_[i].first);
+    }
+  }
+  PublishJittedFunctions(jitted_fns);
+
+  if (!fingerprint.empty() && !is_corrupt_ &&
+      find(jitted_fns.begin(), jitted_fns.end(), static_cast<void*>(NULL)) ==
+      jitted_fns.end()) {
+    shared_ptr<CodegenCache::Module> module(new CodegenCache::Module());
+    module->context = context_;
+    module->execution_engine = execution_engine_;
+    module->jitted_fns = jitted_fns;
+    cache->Insert(fingerprint, module);
+    module_cached_ = true;
   }
 
   if (FLAGS_opt_module_dir.size() != 0) {
@@ -692,6 +823,15 @@ Status LlvmCodeGen::FinalizeModule() {
   return Status::OK();
 }
 
+void LlvmCodeGen::PublishJittedFunctions(const vector<void*>& jitted_fns) {
+  DCHECK_EQ(jitted_fns.size(), fns_to_jit_compile_.size());
+  for (int i = fns_to_jit_compile_.size() - 1; i >= 0; --i) {
+    // Make the machine code and the pointers set so far visible before this pointer.
+    AtomicUtil::MemoryBarrier();
+    *fns_to_jit_compile_[i].second = jitted_fns[i];
+  }
+}
+
 void LlvmCodeGen::OptimizeModule() {
   SCOPED_TIMER(optimization_timer_);
 
@@ -754,7 +894,8 @@ void LlvmCodeGen::OptimizeModule() {
   }
 }
 
-void LlvmCodeGen::AddFunctionToJit(Function* fn, void** fn_ptr) {
+void LlvmCodeGen::AddFunctionToJit(Function* fn, void** fn_ptr,
+    bool has_interpreted_fallback) {
   Type* decimal_val_type = GetType(CodegenAnyVal::LLVM_DECIMALVAL_NAME);
   if (fn->getReturnType() == decimal_val_type) {
     // Per the x86 calling convention ABI, DecimalVals should be returned via an extra
@@ -786,6 +927,7 @@ void LlvmCodeGen::AddFunctionToJit(Function* fn, void** fn_ptr) {
     DCHECK(fn != NULL);
   }
   fns_to_jit_compile_.push_back(make_pair(fn, fn_ptr));
+  if (!has_interpreted_fallback) ++num_fns_without_fallback_;
 }
 
 void* LlvmCodeGen::JitFunction(Function* function) {
@@ -825,7 +967,7 @@ void LlvmCodeGen::GetFunctions(vector<Function*>* functions) {
   Module::iterator fn_iter = module_->begin();
   while (fn_iter != module_->end()) {
     Function* fn = fn_iter++;
-    if (!fn->empty()) functions->push_back(fn);
+    if (!fn->empty() || fn->isMaterializable()) functions->push_back(fn);
   }
 }
 
@@ -833,7 +975,7 @@ void LlvmCodeGen::GetSymbols(unordered_set<string>* symbols) {
   Module::iterator fn_iter = module_->begin();
   while (fn_iter != module_->end()) {
     Function* fn = fn_iter++;
-    if (!fn->empty()) symbols->insert(fn->getName());
+    if (!fn->empty() || fn->isMaterializable()) symbols->insert(fn->getName());
   }
 }
 
@@ -1130,6 +1272,11 @@ Function* LlvmCodeGen::GetMurmurHashFunction(int len) {
   return GetLenOptimizedHashFn(this, IRFunction::HASH_MURMUR, len);
 }
 
+Function* LlvmCodeGen::GetVarLenHashFunction() {
+  if (CpuInfo::IsSupported(CpuInfo::SSE4_2)) return GetFunction(IRFunction::HASH_VAR_LEN);
+  return GetMurmurHashFunction();
+}
+
 void LlvmCodeGen::ReplaceInstWithValue(Instruction* from, Value* to) {
   BasicBlock::iterator iter(from);
   llvm::ReplaceInstWithValue(from->getParent()->getInstList(), iter, to);
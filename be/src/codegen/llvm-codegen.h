@@ -16,12 +16,14 @@
 #ifndef IMPALA_CODEGEN_LLVM_CODEGEN_H
 #define IMPALA_CODEGEN_LLVM_CODEGEN_H
 
+#include "codegen/codegen-cache.h"
 #include "common/status.h"
 
 #include <map>
 #include <string>
 #include <vector>
 #include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/unordered_set.hpp>
 
@@ -94,6 +96,9 @@ class SubExprElimination;
 /// Afterward, FinalizeModule() should be called at which point all codegened functions
 /// are optimized. After FinalizeModule() returns, all function pointers registered with
 /// AddFunctionToJit() will be pointing to the appropriate JIT'd function.
+/// If every registered function has an interpreted fallback (see CanFinalizeAsync()),
+/// FinalizeModule() may instead run on another thread while the fragment executes, and
+/// the function pointers change from NULL to the JIT'd functions while they are in use.
 //
 /// Currently, each query will create and initialize one of these
 /// objects.  This requires loading and parsing the cross compiled modules.
@@ -120,6 +125,8 @@ class LlvmCodeGen {
   /// Loads and parses the precompiled impala IR module
   /// 'codegen' will contain the created object on success.
   /// 'id' is used for outputting the IR module for debugging.
+  /// With --lazy_load_impala_ir, only the declarations are parsed here. The body of a
+  /// function is parsed when it is first used, see MaterializeFunction().
   static Status LoadImpalaIR(
       ObjectPool*, const std::string& id, boost::scoped_ptr<LlvmCodeGen>* codegen);
 
@@ -131,9 +138,11 @@ class LlvmCodeGen {
 
   /// Load a pre-compiled IR module from module_ir.  This creates a top level codegen
   /// object.  codegen will contain the created object on success.
+  /// If 'lazy' is true, function bodies are parsed on demand from the data of
+  /// 'module_ir', which must outlive 'codegen'.
   static Status LoadFromMemory(ObjectPool*, llvm::MemoryBuffer* module_ir,
       const std::string& module_name, const std::string& id,
-      boost::scoped_ptr<LlvmCodeGen>* codegen);
+      boost::scoped_ptr<LlvmCodeGen>* codegen, bool lazy = false);
 
   /// Removes all jit compiled dynamically linked functions from the process.
   ~LlvmCodeGen();
@@ -250,8 +259,21 @@ class LlvmCodeGen {
   /// Optimize and compile the module. This should be called after all functions to JIT
   /// have been added to the module via AddFunctionToJit(). If optimizations_enabled_ is
   /// false, the module will not be optimized before compilation.
+  /// If the CodegenCache is enabled and has a module with the same fingerprint, the
+  /// registered function pointers are set to its functions instead, and this module is
+  /// not compiled. Otherwise the compiled module is added to the cache.
+  /// The function pointers are only set once all functions are compiled, in the reverse
+  /// order of their registration, so that a caller that sees a registered pointer as
+  /// non-NULL also sees the ones it registered after it as non-NULL.
   Status FinalizeModule();
 
+  /// Returns true if functions were registered with AddFunctionToJit() and all of them
+  /// have an interpreted fallback, in which case FinalizeModule() may be called from
+  /// another thread after Prepare() while the fragment is executing.
+  bool CanFinalizeAsync() const {
+    return !fns_to_jit_compile_.empty() && num_fns_without_fallback_ == 0;
+  }
+
   /// Replaces all instructions that call 'target_name' with a call instruction
   /// to the new_fn.  Returns the modified function.
   /// - target_name is the unmangled function name that should be replaced.
@@ -277,6 +299,14 @@ class LlvmCodeGen {
   /// Returns a copy of fn. The copy is added to the module.
   llvm::Function* CloneFunction(llvm::Function* fn);
 
+  /// Parses the body of 'fn' if the module is loaded lazily and it has not been parsed
+  /// yet. Until then 'fn' looks like a declaration. The functions returned by
+  /// GetFunction() and the ones that ReplaceCallSites(), CloneFunction() and
+  /// InlineCallSites() work on are materialized by those functions, and the ones
+  /// reachable from the functions to JIT by FinalizeModule(), so this only needs to be
+  /// called by code that inspects the body of a cross-compiled function directly.
+  void MaterializeFunction(llvm::Function* fn);
+
   /// Replace all uses of the instruction 'from' with the value 'to', and delete
   /// 'from'. This is a wrapper around llvm::ReplaceInstWithValue().
   void ReplaceInstWithValue(llvm::Instruction* from, llvm::Value* to);
@@ -325,7 +355,12 @@ class LlvmCodeGen {
   /// This will also wrap functions returning DecimalVals in an ABI-compliant wrapper (see
   /// the comment in the .cc file for details). This is so we don't accidentally try to
   /// call non-compliant code from native code.
-  void AddFunctionToJit(llvm::Function* fn, void** fn_ptr);
+  //
+  /// 'has_interpreted_fallback' must only be true if the callers of *fn_ptr check it
+  /// for NULL each time they use it, e.g. once per row batch, and run an interpreted
+  /// path instead. *fn_ptr may then be set concurrently, see CanFinalizeAsync().
+  void AddFunctionToJit(llvm::Function* fn, void** fn_ptr,
+      bool has_interpreted_fallback = false);
 
   /// Verfies the function, e.g., checks that the IR is well-formed.  Returns false if
   /// function is invalid.
@@ -361,6 +396,10 @@ class LlvmCodeGen {
   llvm::Function* GetFnvHashFunction(int num_bytes = -1);
   llvm::Function* GetMurmurHashFunction(int num_bytes = -1);
 
+  /// Returns the function for variable-length data with the same signature, which
+  /// computes the same hashes as HashUtil::VarLenHash().
+  llvm::Function* GetVarLenHashFunction();
+
   /// Allocate stack storage for local variables.  This is similar to traditional c, where
   /// all the variables must be declared at the top of the function.  This helper can be
   /// called from anywhere and will add a stack allocation for 'var' at the beginning of
@@ -412,7 +451,8 @@ class LlvmCodeGen {
   llvm::Type* void_type() { return void_type_; }
   llvm::Type* i128_type() { return llvm::Type::getIntNTy(context(), 128); }
 
-  /// Fills 'functions' with all the functions that are defined in the module.
+  /// Fills 'functions' with all the functions that are defined in the module, including
+  /// the ones that are not materialized yet.
   /// Note: this does not include functions that are just declared
   void GetFunctions(std::vector<llvm::Function*>* functions);
 
@@ -441,8 +481,11 @@ class LlvmCodeGen {
   /// Loads an LLVM module. 'module_ir' should be a reference to a memory buffer containing
   /// LLVM bitcode. module_name is the name of the module to use when reporting errors.
   /// The caller is responsible for cleaning up module.
+  /// If 'lazy' is true, only the declarations are parsed and the function bodies are read
+  /// from the data of 'module_ir' when they are materialized, so the data must outlive
+  /// the module. 'module_ir' itself is not referenced by the module.
   static Status LoadModuleFromMemory(LlvmCodeGen* codegen, llvm::MemoryBuffer* module_ir,
-      std::string module_name, llvm::Module** module);
+      std::string module_name, llvm::Module** module, bool lazy = false);
 
   /// Loads a module at 'file' and links it to the module associated with
   /// this LlvmCodeGen object. The module must be on the local filesystem.
@@ -479,6 +522,23 @@ class LlvmCodeGen {
   /// Optimizes the module. This includes pruning the module of any unused functions.
   void OptimizeModule();
 
+  /// Fills 'globals' with the functions registered with AddFunctionToJit() and all
+  /// functions and global variables they transitively reference, in the order in which
+  /// they are found. The functions are materialized on the way.
+  void GetReachableGlobals(std::vector<llvm::GlobalValue*>* globals);
+
+  /// Returns a fingerprint of the functions registered with AddFunctionToJit(): the IR
+  /// of all functions and global variables they transitively reference, which are
+  /// 'globals' as returned by GetReachableGlobals(), and the optimization setting.
+  /// Modules with the same fingerprint compile to interchangeable machine code.
+  /// Constants that embed the addresses of per-query objects are part of the IR, so
+  /// such modules never match those of other queries.
+  std::string GetFingerprint(const std::vector<llvm::GlobalValue*>& globals) const;
+
+  /// Sets the registered function pointers to 'jitted_fns', in the reverse order of
+  /// their registration.
+  void PublishJittedFunctions(const std::vector<void*>& jitted_fns);
+
   /// Clears generated hash fns.  This is only used for testing.
   void ClearHashFns();
 
@@ -503,9 +563,15 @@ class LlvmCodeGen {
   /// Time spent compiling the module.
   RuntimeProfile::Counter* compile_timer_;
 
+  /// Set to 1 if FinalizeModule() reused a module from the CodegenCache.
+  RuntimeProfile::Counter* cache_hit_counter_;
+
   /// Total size of bitcode modules loaded in bytes.
   RuntimeProfile::Counter* module_bitcode_size_;
 
+  /// Number of function bodies parsed from a lazily loaded module.
+  RuntimeProfile::Counter* num_materialized_fns_;
+
   /// whether or not optimizations are enabled
   bool optimizations_enabled_;
 
@@ -524,14 +590,23 @@ class LlvmCodeGen {
 
   /// Top level llvm object.  Objects from different contexts do not share anything.
   /// We can have multiple instances of the LlvmCodeGen object in different threads
-  boost::scoped_ptr<llvm::LLVMContext> context_;
+  /// Shared with the CodegenCache if the compiled module was added to it.
+  boost::shared_ptr<llvm::LLVMContext> context_;
 
   /// Top level codegen object.  Contains everything to jit one 'unit' of code.
   /// Owned by the execution_engine_.
   llvm::Module* module_;
 
-  /// Execution/Jitting engine.
-  boost::scoped_ptr<llvm::ExecutionEngine> execution_engine_;
+  /// Execution/Jitting engine. Shared with the CodegenCache if the compiled module was
+  /// added to it, in which case the cache owns its machine code.
+  boost::shared_ptr<llvm::ExecutionEngine> execution_engine_;
+
+  /// True if the compiled module was added to the CodegenCache.
+  bool module_cached_;
+
+  /// The cached module whose functions FinalizeModule() used instead of compiling this
+  /// module. Keeps its machine code alive until this object is destroyed.
+  boost::shared_ptr<const CodegenCache::Module> cached_module_;
 
   /// Keeps track of all the functions that have been jit compiled and linked into
   /// the process. Special care needs to be taken if we need to modify these functions.
@@ -575,6 +650,9 @@ class LlvmCodeGen {
   /// The vector of functions to automatically JIT compile after FinalizeModule().
   std::vector<std::pair<llvm::Function*, void**> > fns_to_jit_compile_;
 
+  /// Number of functions in fns_to_jit_compile_ without an interpreted fallback.
+  int num_fns_without_fallback_;
+
   /// Debug strings that will be outputted by jitted code.  This is a copy of all
   /// strings passed to CodegenDebugTrace.
   std::vector<std::string> debug_strings_;
@@ -67,6 +67,11 @@ DEFINE_string(redaction_rules_file, "", "Absolute path to sensitive data redacti
     "Web UI and audit records. Query results will not be affected. Refer to the "
     "documentation for the rule file format.");
 
+DEFINE_bool(free_pool_use_slabs, false, "(Advanced) If true, the FreePools of UDF and "
+    "UDA function contexts group allocations of the same size into 64KB slabs and "
+    "return slabs whose allocations were all freed to the system, instead of keeping "
+    "all memory until the function context is closed.");
+
 // Stress option for testing failed memory allocation. Debug builds only.
 #ifndef NDEBUG
 DEFINE_int32(stress_free_pool_alloc, 0, "A stress option which causes memory allocations "
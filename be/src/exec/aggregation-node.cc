@@ -162,7 +162,8 @@ Status AggregationNode::Prepare(RuntimeState* state) {
       if (codegen_process_row_batch_fn_ != NULL) {
         // Update to using codegen'd process row batch.
         codegen->AddFunctionToJit(codegen_process_row_batch_fn_,
-            reinterpret_cast<void**>(&process_row_batch_fn_));
+            reinterpret_cast<void**>(&process_row_batch_fn_),
+            /* has_interpreted_fallback */ true);
         codegen_enabled = true;
       }
     }
@@ -173,6 +174,7 @@ Status AggregationNode::Prepare(RuntimeState* state) {
 
 Status AggregationNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   RETURN_IF_ERROR(ExecNode::Open(state));
 
   RETURN_IF_ERROR(Expr::Open(probe_expr_ctxs_, state));
@@ -229,6 +231,7 @@ Status AggregationNode::Open(RuntimeState* state) {
 
 Status AggregationNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
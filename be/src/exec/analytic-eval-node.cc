@@ -19,6 +19,7 @@
 #include "exprs/agg-fn-evaluator.h"
 #include "runtime/buffered-tuple-stream.inline.h"
 #include "runtime/descriptors.h"
+#include "runtime/raw-value.h"
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 #include "udf/udf-internal.h"
@@ -44,6 +45,7 @@ AnalyticEvalNode::AnalyticEvalNode(ObjectPool* pool, const TPlanNode& tnode,
     order_by_eq_expr_ctx_(NULL),
     rows_start_offset_(0),
     rows_end_offset_(0),
+    has_sliding_min_max_(false),
     has_first_val_null_offset_(false),
     first_val_null_offset_(0),
     client_(NULL),
@@ -116,7 +118,12 @@ Status AnalyticEvalNode::Init(const TPlanNode& tnode, RuntimeState* state) {
     const TFunction& fn = analytic_node.analytic_functions[i].nodes[0].fn;
     is_lead_fn_.push_back("lead" == fn.name.function_name);
     has_lead_fn = has_lead_fn || is_lead_fn_.back();
+    is_sliding_min_max_.push_back(fn_scope_ == ROWS && window_.__isset.window_start &&
+        (evaluator->agg_op() == AggFnEvaluator::MIN ||
+         evaluator->agg_op() == AggFnEvaluator::MAX));
+    has_sliding_min_max_ = has_sliding_min_max_ || is_sliding_min_max_.back();
   }
+  min_max_windows_.resize(evaluators_.size());
   DCHECK(!has_lead_fn || !window_.__isset.window_start);
   DCHECK(fn_scope_ != PARTITION || analytic_node.order_by_exprs.empty());
   DCHECK(window_.__isset.window_end || !window_.__isset.window_start)
@@ -174,12 +181,15 @@ Status AnalyticEvalNode::Prepare(RuntimeState* state) {
 
   RETURN_IF_ERROR(state->block_mgr()->RegisterClient(
       Substitute("AnalyticEvalNode id=$0 ptr=$1", id_, this),
-      2, false, mem_tracker(), state, &client_));
+      MIN_REQUIRED_BUFFERS, false, mem_tracker(), state, &client_));
+  state->block_mgr()->SetClientWaitTimer(client_,
+      ADD_TIMER(runtime_profile(), SPILL_WAIT_TIMER));
   return Status::OK();
 }
 
 Status AnalyticEvalNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   RETURN_IF_ERROR(ExecNode::Open(state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
@@ -341,6 +351,11 @@ inline Status AnalyticEvalNode::AddRow(int64_t stream_idx, TupleRow* row) {
           *child(0)->row_desc().tuple_descriptors()[0],
           curr_tuple_pool_.get());
       window_tuples_.push_back(pair<int64_t, Tuple*>(stream_idx, tuple));
+      if (has_sliding_min_max_) {
+        for (int i = 0; i < evaluators_.size(); ++i) {
+          if (is_sliding_min_max_[i]) AddMinMaxWindowRow(i, stream_idx, tuple);
+        }
+      }
     }
   }
 
@@ -414,11 +429,70 @@ inline void AnalyticEvalNode::TryRemoveRowsBeforeWindow(int64_t stream_idx) {
   DCHECK(!window_tuples_.empty()) << DebugStateString(true);
   DCHECK_EQ(remove_idx + max<int64_t>(rows_start_offset_, 0),
       window_tuples_.front().first) << DebugStateString(true);
+  RemoveFirstWindowTuple();
+}
+
+void AnalyticEvalNode::RemoveFirstWindowTuple() {
+  DCHECK(!window_tuples_.empty());
   TupleRow* remove_row = reinterpret_cast<TupleRow*>(&window_tuples_.front().second);
-  AggFnEvaluator::Remove(evaluators_, fn_ctxs_, remove_row, curr_tuple_);
+  if (!has_sliding_min_max_) {
+    AggFnEvaluator::Remove(evaluators_, fn_ctxs_, remove_row, curr_tuple_);
+  } else {
+    for (int i = 0; i < evaluators_.size(); ++i) {
+      if (is_sliding_min_max_[i]) {
+        RemoveMinMaxWindowRow(i, window_tuples_.front().first);
+      } else {
+        evaluators_[i]->Remove(fn_ctxs_[i], remove_row, curr_tuple_);
+      }
+    }
+  }
   window_tuples_.pop_front();
 }
 
+void AnalyticEvalNode::AddMinMaxWindowRow(int fn_idx, int64_t stream_idx,
+    Tuple* tuple) {
+  AggFnEvaluator* evaluator = evaluators_[fn_idx];
+  DCHECK_EQ(evaluator->input_expr_ctxs().size(), 1);
+  ExprContext* input_ctx = evaluator->input_expr_ctxs()[0];
+  void* value = input_ctx->GetValue(reinterpret_cast<TupleRow*>(&tuple));
+  // MIN() and MAX() ignore NULLs.
+  if (value == NULL) return;
+  const ColumnType& type = input_ctx->root()->type();
+  bool is_min = evaluator->agg_op() == AggFnEvaluator::MIN;
+  deque<MinMaxWindowRow>* window = &min_max_windows_[fn_idx];
+  // Rows with a value that is not better than the new one leave the window earlier, so
+  // they can never become the result again.
+  while (!window->empty()) {
+    int cmp = RawValue::Compare(window->back().value, value, type);
+    if (is_min ? cmp < 0 : cmp > 0) break;
+    window->pop_back();
+  }
+  MinMaxWindowRow window_row;
+  window_row.idx = stream_idx;
+  window_row.tuple = tuple;
+  // The value may live in memory owned by the input expr, so it is copied.
+  window_row.value = curr_tuple_pool_->Allocate(type.GetSlotSize());
+  RawValue::Write(value, window_row.value, type, curr_tuple_pool_.get());
+  window->push_back(window_row);
+}
+
+void AnalyticEvalNode::RemoveMinMaxWindowRow(int fn_idx, int64_t stream_idx) {
+  deque<MinMaxWindowRow>* window = &min_max_windows_[fn_idx];
+  // The row was dropped from the deque earlier, the result does not change.
+  if (window->empty() || window->front().idx != stream_idx) return;
+  VLOG_ROW << id() << " Remove min/max fn=" << fn_idx << " idx=" << stream_idx;
+  window->pop_front();
+  // Replace the result by the value of the next row in the deque. Finalize() releases
+  // resources of the previous value, e.g. a copied string; the result is not needed.
+  AggFnEvaluator* evaluator = evaluators_[fn_idx];
+  evaluator->Finalize(fn_ctxs_[fn_idx], curr_tuple_, dummy_result_tuple_);
+  evaluator->Init(fn_ctxs_[fn_idx], curr_tuple_);
+  if (!window->empty()) {
+    evaluator->Add(fn_ctxs_[fn_idx],
+        reinterpret_cast<TupleRow*>(&window->front().tuple), curr_tuple_);
+  }
+}
+
 inline void AnalyticEvalNode::TryAddRemainingResults(int64_t partition_idx,
     int64_t prev_partition_idx) {
   DCHECK_LT(prev_partition_idx, partition_idx);
@@ -450,9 +524,7 @@ inline void AnalyticEvalNode::TryAddRemainingResults(int64_t partition_idx,
       // and add the result tuple at the next index.
       VLOG_ROW << id() << " Remove window_row_idx=" << window_tuples_.front().first
                << " for result row at idx=" << next_result_idx;
-      TupleRow* remove_row = reinterpret_cast<TupleRow*>(&window_tuples_.front().second);
-      AggFnEvaluator::Remove(evaluators_, fn_ctxs_, remove_row, curr_tuple_);
-      window_tuples_.pop_front();
+      RemoveFirstWindowTuple();
     }
     AddResultTuple(last_result_idx_ + 1);
   }
@@ -510,6 +582,7 @@ inline Status AnalyticEvalNode::InitNextPartition(RuntimeState* state,
     TryAddRemainingResults(stream_idx, prev_partition_stream_idx);
   }
   window_tuples_.clear();
+  for (int i = 0; i < min_max_windows_.size(); ++i) min_max_windows_[i].clear();
 
   VLOG_ROW << id() << " Reset curr_tuple";
   // Call finalize to release resources; result is not needed but the dst tuple must be
@@ -723,6 +796,7 @@ inline int64_t AnalyticEvalNode::NumOutputRowsReady() const {
 
 Status AnalyticEvalNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
@@ -781,6 +855,7 @@ Status AnalyticEvalNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool*
 Status AnalyticEvalNode::Reset(RuntimeState* state) {
   result_tuples_.clear();
   window_tuples_.clear();
+  for (int i = 0; i < min_max_windows_.size(); ++i) min_max_windows_[i].clear();
   last_result_idx_ = -1;
   curr_partition_idx_ = -1;
   prev_pool_last_result_idx_ = -1;
@@ -810,6 +885,12 @@ Status AnalyticEvalNode::Reset(RuntimeState* state) {
   return ExecNode::Reset(state);
 }
 
+void AnalyticEvalNode::GetBufferRequirements(int64_t buffer_size, int* min_buffers,
+    int* desired_buffers) const {
+  *min_buffers = MIN_REQUIRED_BUFFERS;
+  *desired_buffers = EstimatedBuffers(buffer_size, *min_buffers);
+}
+
 void AnalyticEvalNode::Close(RuntimeState* state) {
   if (is_closed()) return;
   if (client_ != NULL) state->block_mgr()->ClearReservations(client_);
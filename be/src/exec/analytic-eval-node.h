@@ -15,6 +15,8 @@
 #ifndef IMPALA_EXEC_ANALYTIC_EVAL_NODE_H
 #define IMPALA_EXEC_ANALYTIC_EVAL_NODE_H
 
+#include <deque>
+
 #include "exec/exec-node.h"
 #include "exprs/expr.h"
 #include "exprs/expr-context.h"
@@ -55,6 +57,11 @@ class AggFnEvaluator;
 /// multiple rows have the same values for the order by exprs. The number of buffered
 /// rows may be an entire partition or even the entire input. Therefore, the output
 /// rows are buffered and may spill to disk via the BufferedTupleStream.
+///
+/// MIN() and MAX() cannot undo an Add() with Remove(), so over ROWS windows with a start
+/// bound each of them keeps a monotonic deque of the rows in the window (see
+/// min_max_windows_). The front of the deque is the current result, so sliding the
+/// window costs amortized O(1) per row regardless of the window size.
 class AnalyticEvalNode : public ExecNode {
  public:
   AnalyticEvalNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs);
@@ -66,6 +73,8 @@ class AnalyticEvalNode : public ExecNode {
   virtual Status GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos);
   virtual Status Reset(RuntimeState* state);
   virtual void Close(RuntimeState* state);
+  virtual void GetBufferRequirements(int64_t buffer_size, int* min_buffers,
+      int* desired_buffers) const;
 
  protected:
   /// Frees local allocations from evaluators_
@@ -74,6 +83,9 @@ class AnalyticEvalNode : public ExecNode {
   virtual void DebugString(int indentation_level, std::stringstream* out) const;
 
  private:
+  /// Buffers reserved for the input stream: one to write and one to read.
+  static const int MIN_REQUIRED_BUFFERS = 2;
+
   /// The scope over which analytic functions are evaluated. Functions are either
   /// evaluated over a window (specified by a TAnalyticWindow) or an entire partition.
   /// This is used to avoid more complex logic where we often branch based on these
@@ -151,6 +163,22 @@ class AnalyticEvalNode : public ExecNode {
   /// ProcessChildBatch().
   void TryRemoveRowsBeforeWindow(int64_t stream_idx);
 
+  /// Removes the first tuple of window_tuples_ from curr_tuple_. Evaluators that support
+  /// Remove() are called with the tuple, the sliding MIN()/MAX() evaluators are handled
+  /// by RemoveMinMaxWindowRow().
+  void RemoveFirstWindowTuple();
+
+  /// Adds the row at index stream_idx of input_stream_, which was just added to
+  /// window_tuples_ as 'tuple', to the deque of the sliding MIN()/MAX() evaluator
+  /// 'fn_idx'. Rows that can no longer be the result of the window are dropped from the
+  /// back of the deque.
+  void AddMinMaxWindowRow(int fn_idx, int64_t stream_idx, Tuple* tuple);
+
+  /// Removes the row at index stream_idx of input_stream_ from the window of the sliding
+  /// MIN()/MAX() evaluator 'fn_idx'. If the row was the current result, the slot of the
+  /// evaluator in curr_tuple_ is recomputed from the next row in the deque.
+  void RemoveMinMaxWindowRow(int fn_idx, int64_t stream_idx);
+
   /// Initializes state at the start of a new partition. stream_idx is the index of the
   /// current input row from input_stream_.
   Status InitNextPartition(RuntimeState* state, int64_t stream_idx);
@@ -222,6 +250,12 @@ class AnalyticEvalNode : public ExecNode {
   /// determine which slots need to be reset.
   std::vector<bool> is_lead_fn_;
 
+  /// Indicates if each evaluator is MIN() or MAX() over a ROWS window with a start bound.
+  /// These evaluators do not support Remove() and keep their window in
+  /// min_max_windows_ instead. Set in Init().
+  std::vector<bool> is_sliding_min_max_;
+  bool has_sliding_min_max_;
+
   /// If true, evaluating FIRST_VALUE requires special null handling when initializing new
   /// partitions determined by the offset. Set in Open() by inspecting the agg fns.
   bool has_first_val_null_offset_;
@@ -280,6 +314,21 @@ class AnalyticEvalNode : public ExecNode {
   /// TODO: Remove and use BufferedTupleStream (needs support for multiple readers).
   std::list<std::pair<int64_t, Tuple*> > window_tuples_;
 
+  /// A row of the window of a sliding MIN()/MAX() evaluator: the index into
+  /// input_stream_, the window tuple from window_tuples_ and a copy of the input value,
+  /// which is allocated from the same pool as the window tuple.
+  struct MinMaxWindowRow {
+    int64_t idx;
+    Tuple* tuple;
+    void* value;
+  };
+
+  /// For each evaluator with is_sliding_min_max_ set, the rows of window_tuples_ that may
+  /// still become the result of the window, in order of their index. The values are
+  /// strictly increasing for MIN() and decreasing for MAX(), so the front is the result
+  /// for the current window. NULL values are never added. Empty for other evaluators.
+  std::vector<std::deque<MinMaxWindowRow> > min_max_windows_;
+
   /// The index of the last row from input_stream_ associated with output row containing
   /// resources in prev_tuple_pool_. -1 when the pool is empty. Resources from
   /// prev_tuple_pool_ can only be transferred to an output batch once all rows containing
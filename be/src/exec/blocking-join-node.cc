@@ -20,7 +20,9 @@
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 #include "util/debug-util.h"
+#include "util/lock-profiler.h"
 #include "util/runtime-profile.h"
+#include "util/sampling-profiler.h"
 #include "util/time.h"
 
 #include "gen-cpp/PlanNodes_types.h"
@@ -141,6 +143,10 @@ void BlockingJoinNode::BuildSideThread(RuntimeState* state, Promise<Status>* sta
   Status s;
   {
     SCOPED_TIMER(state->total_cpu_timer());
+    SCOPED_NODE_COUNTERS(this);
+    SamplingProfiler::ScopedTag sampling_tag(state->query_id(),
+        state->fragment_instance_id());
+    LockProfiler::ScopedWaitCounter lock_wait(state->total_lock_wait_timer());
     s = ConstructBuildSide(state);
   }
   // IMPALA-1863: If the build-side thread failed, then we need to close the right
@@ -158,6 +164,7 @@ void BlockingJoinNode::BuildSideThread(RuntimeState* state, Promise<Status>* sta
 
 Status BlockingJoinNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   RETURN_IF_ERROR(ExecNode::Open(state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
@@ -20,6 +20,7 @@
 #include "common/logging.h"
 #include "exec/hdfs-table-sink.h"
 #include "exec/hbase-table-sink.h"
+#include "exec/incr-stats-util.h"
 #include "exec/exec-node.h"
 #include "exprs/expr.h"
 #include "gen-cpp/ImpalaInternalService_types.h"
@@ -98,6 +99,13 @@ void DataSink::MergeInsertStats(const TInsertStats& src_stats,
       dst_stats->__set_parquet_stats(src_stats.parquet_stats);
     }
   }
+  if (src_stats.__isset.column_stats) {
+    for (map<string, TIntermediateColumnStats>::const_iterator it =
+         src_stats.column_stats.begin(); it != src_stats.column_stats.end(); ++it) {
+      MergeIntermediateColumnStats(it->second, &dst_stats->column_stats[it->first]);
+    }
+    dst_stats->__isset.column_stats = true;
+  }
 }
 
 string DataSink::OutputInsertStats(const PartitionStatusMap& stats,
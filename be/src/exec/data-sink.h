@@ -52,6 +52,11 @@ class DataSink {
   /// eos should be true when the last batch is passed to Send()
   virtual Status Send(RuntimeState* state, RowBatch* batch, bool eos) = 0;
 
+  /// Returns false if the rows sent from now on would be discarded, e.g. because the
+  /// receivers of a data stream were closed once they had all the rows they need. The
+  /// fragment then stops producing rows and finishes early.
+  virtual bool NeedsMoreRows() { return true; }
+
   /// Flushes any remaining buffered state.
   /// Further Send() calls are illegal after FlushFinal(). This is to be called only
   /// before calling Close().
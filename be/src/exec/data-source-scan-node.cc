@@ -26,6 +26,7 @@
 #include "runtime/row-batch.h"
 #include "runtime/string-value.h"
 #include "runtime/tuple-row.h"
+#include "util/bit-util.h"
 #include "util/jni-util.h"
 #include "util/periodic-counter-updater.h"
 #include "util/runtime-profile.h"
@@ -55,10 +56,21 @@ const string ERROR_INVALID_TIMESTAMP = "Data source returned invalid timestamp d
     "This likely indicates a problem with the data source library.";
 const string ERROR_INVALID_DECIMAL = "Data source returned invalid decimal data. "
     "This likely indicates a problem with the data source library.";
+const string ERROR_ROWS_AND_COLUMNAR_ROWS = "Data source returned both a row batch and "
+    "a columnar row batch. This likely indicates a problem with the data source "
+    "library.";
+const string ERROR_INVALID_NUM_ROWS = "Data source returned a columnar row batch "
+    "without a valid number of rows. This likely indicates a problem with the data "
+    "source library.";
 
 // Size of an encoded TIMESTAMP
 const size_t TIMESTAMP_SIZE = sizeof(int64_t) + sizeof(int32_t);
 
+// Size of a value of the given type in TColumnBuffer.fixed_vals.
+inline int ColumnarValueSize(const ColumnType& type) {
+  return type.type == TYPE_TIMESTAMP ? TIMESTAMP_SIZE : type.GetByteSize();
+}
+
 DataSourceScanNode::DataSourceScanNode(ObjectPool* pool, const TPlanNode& tnode,
     const DescriptorTbl& descs)
     : ScanNode(pool, tnode, descs),
@@ -87,6 +99,7 @@ Status DataSourceScanNode::Prepare(RuntimeState* state) {
 
 Status DataSourceScanNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   RETURN_IF_ERROR(ExecNode::Open(state));
   RETURN_IF_CANCELLED(state);
 
@@ -118,6 +131,10 @@ Status DataSourceScanNode::Open(RuntimeState* state) {
 }
 
 Status DataSourceScanNode::ValidateRowBatchSize() {
+  if (input_batch_->__isset.columnar_rows) {
+    if (input_batch_->__isset.rows) return Status(ERROR_ROWS_AND_COLUMNAR_ROWS);
+    return ValidateColumnarRowBatch();
+  }
   if (!input_batch_->__isset.rows) return Status::OK();
   const vector<TColumnData>& cols = input_batch_->rows.cols;
   if (tuple_desc_->slots().size() != cols.size()) {
@@ -138,6 +155,50 @@ Status DataSourceScanNode::ValidateRowBatchSize() {
   return Status::OK();
 }
 
+Status DataSourceScanNode::ValidateColumnarRowBatch() {
+  const TColumnarRowBatch& batch = input_batch_->columnar_rows;
+  const vector<TColumnBuffer>& cols = batch.cols;
+  if (tuple_desc_->slots().size() != cols.size()) {
+    return Status(
+        Substitute(ERROR_NUM_COLUMNS, tuple_desc_->slots().size(), cols.size()));
+  }
+  if (!batch.__isset.num_rows || batch.num_rows < 0 ||
+      batch.num_rows > numeric_limits<int32_t>::max()) {
+    return Status(ERROR_INVALID_NUM_ROWS);
+  }
+  num_rows_ = batch.num_rows;
+
+  for (int i = 0; i < tuple_desc_->slots().size(); ++i) {
+    const ColumnType& type = tuple_desc_->slots()[i]->type();
+    const TColumnBuffer& col = cols[i];
+    Status invalid_col_data(Substitute(ERROR_INVALID_COL_DATA, TypeToString(type.type)));
+    if (col.__isset.null_bitmap && col.null_bitmap.size() < BitUtil::Ceil(num_rows_, 8)) {
+      return invalid_col_data;
+    }
+    if (type.type != TYPE_STRING) {
+      if (col.fixed_vals.size() !=
+          static_cast<int64_t>(num_rows_) * ColumnarValueSize(type)) {
+        return invalid_col_data;
+      }
+      continue;
+    }
+    // The offsets must be ascending and within string_data, so that the strings can be
+    // copied without further checks.
+    if (col.string_offsets.size() !=
+        (static_cast<int64_t>(num_rows_) + 1) * sizeof(int32_t)) {
+      return invalid_col_data;
+    }
+    const int32_t* offsets = reinterpret_cast<const int32_t*>(col.string_offsets.data());
+    if (offsets[0] < 0 || offsets[num_rows_] > col.string_data.size()) {
+      return invalid_col_data;
+    }
+    for (int row = 0; row < num_rows_; ++row) {
+      if (offsets[row + 1] < offsets[row]) return invalid_col_data;
+    }
+  }
+  return Status::OK();
+}
+
 Status DataSourceScanNode::GetNextInputBatch() {
   input_batch_.reset(new TGetNextResult());
   next_row_idx_ = 0;
@@ -286,22 +347,108 @@ Status DataSourceScanNode::MaterializeNextRow(MemPool* tuple_pool) {
   return Status::OK();
 }
 
+void DataSourceScanNode::MaterializeColumnarRows(int num_rows, MemPool* tuple_pool,
+    Tuple* tuples) {
+  const vector<TColumnBuffer>& cols = input_batch_->columnar_rows.cols;
+  int tuple_size = tuple_desc_->byte_size();
+  uint8_t* tuple_mem = reinterpret_cast<uint8_t*>(tuples);
+  // Initializes all the tuples, including their null indicators, at once.
+  memset(tuple_mem, 0, num_rows * tuple_size);
+
+  for (int i = 0; i < tuple_desc_->slots().size(); ++i) {
+    const SlotDescriptor* slot_desc = tuple_desc_->slots()[i];
+    const TColumnBuffer& col = cols[i];
+    // The slot of the current row, advanced by a tuple for every row.
+    uint8_t* slot = tuple_mem + slot_desc->tuple_offset();
+    switch (slot_desc->type().type) {
+      case TYPE_STRING: {
+        const int32_t* offsets =
+            reinterpret_cast<const int32_t*>(col.string_offsets.data()) + next_row_idx_;
+        // The strings of all the rows are copied with a single allocation.
+        int data_len = offsets[num_rows] - offsets[0];
+        char* data = reinterpret_cast<char*>(tuple_pool->Allocate(data_len));
+        memcpy(data, col.string_data.data() + offsets[0], data_len);
+        for (int row = 0; row < num_rows; ++row, slot += tuple_size) {
+          StringValue* val = reinterpret_cast<StringValue*>(slot);
+          val->ptr = data + (offsets[row] - offsets[0]);
+          val->len = offsets[row + 1] - offsets[row];
+        }
+        break;
+      }
+      case TYPE_TIMESTAMP: {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(col.fixed_vals.data()) +
+            next_row_idx_ * TIMESTAMP_SIZE;
+        for (int row = 0; row < num_rows; ++row, slot += tuple_size) {
+          *reinterpret_cast<TimestampValue*>(slot) = TimestampValue(
+              ReadWriteUtil::GetInt<uint64_t>(bytes),
+              ReadWriteUtil::GetInt<uint32_t>(bytes + sizeof(int64_t)));
+          bytes += TIMESTAMP_SIZE;
+        }
+        break;
+      }
+      default: {
+        // The values have the same representation as the slots.
+        int val_size = slot_desc->type().GetByteSize();
+        const uint8_t* vals = reinterpret_cast<const uint8_t*>(col.fixed_vals.data()) +
+            next_row_idx_ * val_size;
+        for (int row = 0; row < num_rows; ++row, slot += tuple_size) {
+          memcpy(slot, vals, val_size);
+          vals += val_size;
+        }
+        break;
+      }
+    }
+
+    if (!col.__isset.null_bitmap) continue;
+    const uint8_t* null_bitmap = reinterpret_cast<const uint8_t*>(col.null_bitmap.data());
+    for (int row = 0; row < num_rows; ++row) {
+      int input_row = next_row_idx_ + row;
+      if ((null_bitmap[input_row / 8] >> (input_row % 8)) & 1) {
+        Tuple* tuple = reinterpret_cast<Tuple*>(tuple_mem + row * tuple_size);
+        tuple->SetNull(slot_desc->null_indicator_offset());
+      }
+    }
+  }
+}
+
+void DataSourceScanNode::GetNextColumnar(RowBatch* row_batch) {
+  int64_t num_rows = min<int64_t>(num_rows_ - next_row_idx_,
+      row_batch->capacity() - row_batch->num_rows());
+  if (limit_ != -1) num_rows = min(num_rows, limit_ - num_rows_returned_);
+  int tuple_size = tuple_desc_->byte_size();
+  uint8_t* tuple_mem = row_batch->tuple_data_pool()->Allocate(num_rows * tuple_size);
+  MaterializeColumnarRows(num_rows, row_batch->tuple_data_pool(),
+      reinterpret_cast<Tuple*>(tuple_mem));
+  next_row_idx_ += num_rows;
+
+  ExprContext** ctxs = &conjunct_ctxs_[0];
+  int num_ctxs = conjunct_ctxs_.size();
+  for (int i = 0; i < num_rows; ++i) {
+    int row_idx = row_batch->AddRow();
+    TupleRow* tuple_row = row_batch->GetRow(row_idx);
+    tuple_row->SetTuple(tuple_idx_, reinterpret_cast<Tuple*>(tuple_mem + i * tuple_size));
+    if (ExecNode::EvalConjuncts(ctxs, num_ctxs, tuple_row)) {
+      row_batch->CommitLastRow();
+      ++num_rows_returned_;
+    }
+  }
+}
+
 Status DataSourceScanNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   if (ReachedLimit()) {
     *eos = true;
     return Status::OK();
   }
   *eos = false;
 
-  // create new tuple buffer for row_batch
   MemPool* tuple_pool = row_batch->tuple_data_pool();
-  int tuple_buffer_size = row_batch->MaxTupleBufferSize();
-  void* tuple_buffer = tuple_pool->Allocate(tuple_buffer_size);
-  tuple_ = reinterpret_cast<Tuple*>(tuple_buffer);
+  // Only allocated if a TRowBatch is returned by the data source.
+  tuple_ = NULL;
   ExprContext** ctxs = &conjunct_ctxs_[0];
   int num_ctxs = conjunct_ctxs_.size();
 
@@ -310,6 +457,15 @@ Status DataSourceScanNode::GetNext(RuntimeState* state, RowBatch* row_batch, boo
       SCOPED_TIMER(materialize_tuple_timer());
       // copy rows until we hit the limit/capacity or until we exhaust input_batch_
       while (!ReachedLimit() && !row_batch->AtCapacity() && InputBatchHasNext()) {
+        if (input_batch_->__isset.columnar_rows) {
+          GetNextColumnar(row_batch);
+          continue;
+        }
+        if (tuple_ == NULL) {
+          // create new tuple buffer for row_batch
+          tuple_ = reinterpret_cast<Tuple*>(
+              tuple_pool->Allocate(row_batch->MaxTupleBufferSize()));
+        }
         RETURN_IF_ERROR(MaterializeNextRow(tuple_pool));
         int row_idx = row_batch->AddRow();
         TupleRow* tuple_row = row_batch->GetRow(row_idx);
@@ -327,7 +483,8 @@ Status DataSourceScanNode::GetNext(RuntimeState* state, RowBatch* row_batch, boo
       COUNTER_SET(rows_returned_counter_, num_rows_returned_);
 
       if (ReachedLimit() || row_batch->AtCapacity() || input_batch_->eos) {
-        *eos = ReachedLimit() || input_batch_->eos;
+        // The last input batch may not fit into row_batch.
+        *eos = ReachedLimit() || (input_batch_->eos && !InputBatchHasNext());
         return Status::OK();
       }
     }
@@ -33,7 +33,9 @@ class Tuple;
 /// Scan node for external data sources. The external data source jar is loaded
 /// in Prepare() (via an ExternalDataSourceExecutor), and then the data source
 /// is called to receive row batches when necessary. This node converts the
-/// rows stored in a thrift structure to RowBatches. The external data source is
+/// rows stored in a thrift structure to RowBatches. The data source may return its rows
+/// either in a TRowBatch, which is converted value by value, or in a TColumnarRowBatch,
+/// which is copied into the tuples a column at a time. The external data source is
 /// closed in Close().
 class DataSourceScanNode : public ScanNode {
  public:
@@ -83,8 +85,9 @@ class DataSourceScanNode : public ScanNode {
   /// thrift representation of the rows.
   boost::scoped_ptr<extdatasource::TGetNextResult> input_batch_;
 
-  /// The number of rows in input_batch_->rows. The data source should have set
-  /// TRowBatch.num_rows, but we compute it just in case they haven't.
+  /// The number of rows in input_batch_->rows or input_batch_->columnar_rows. The data
+  /// source should have set TRowBatch.num_rows, but we compute it just in case they
+  /// haven't.
   int num_rows_;
 
   /// The index of the next row in input_batch_,
@@ -99,6 +102,16 @@ class DataSourceScanNode : public ScanNode {
   /// Materializes the next row (next_row_idx_) into tuple_.
   Status MaterializeNextRow(MemPool* mem_pool);
 
+  /// Materializes the 'num_rows' rows of input_batch_->columnar_rows starting at
+  /// next_row_idx_ into the consecutive tuples starting at 'tuples'. String data is
+  /// copied into 'mem_pool'.
+  void MaterializeColumnarRows(int num_rows, MemPool* mem_pool, Tuple* tuples);
+
+  /// Returns the rows of input_batch_->columnar_rows that pass the conjuncts into
+  /// 'row_batch', until it is at capacity, the limit is reached or the input batch is
+  /// exhausted.
+  void GetNextColumnar(RowBatch* row_batch);
+
   /// Gets the next batch from the data source, stored in input_batch_.
   Status GetNextInputBatch();
 
@@ -106,9 +119,15 @@ class DataSourceScanNode : public ScanNode {
   /// contain the same number of rows.
   Status ValidateRowBatchSize();
 
+  /// Validate that the buffers of input_batch_->columnar_rows are consistent with the
+  /// column types and the number of rows.
+  Status ValidateColumnarRowBatch();
+
   /// True if input_batch_ has more rows.
   bool InputBatchHasNext() {
-    if (!input_batch_->__isset.rows) return false;
+    if (!input_batch_->__isset.rows && !input_batch_->__isset.columnar_rows) {
+      return false;
+    }
     return next_row_idx_ < num_rows_;
   }
 };
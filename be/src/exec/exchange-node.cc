@@ -15,6 +15,7 @@
 #include "exec/exchange-node.h"
 
 #include <boost/scoped_ptr.hpp>
+#include <gutil/strings/substitute.h>
 
 #include "runtime/data-stream-mgr.h"
 #include "runtime/data-stream-recvr.h"
@@ -30,6 +31,12 @@ using namespace impala;
 
 DEFINE_int32(exchg_node_buffer_size_bytes, 1024 * 1024 * 10,
              "(Advanced) Maximum size of per-query receive-side buffer");
+DEFINE_bool(exchg_node_spill_merging_input, true, "(Advanced) If true, merging "
+    "exchange nodes spill incoming batches to disk once their receive-side buffer is "
+    "full, rather than blocking the senders until the merge consumes the buffered "
+    "batches.");
+
+using strings::Substitute;
 
 ExchangeNode::ExchangeNode(
     ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs)
@@ -63,9 +70,19 @@ Status ExchangeNode::Prepare(RuntimeState* state) {
   convert_row_batch_timer_ = ADD_TIMER(runtime_profile(), "ConvertRowBatchTime");
   // TODO: figure out appropriate buffer size
   DCHECK_GT(num_senders_, 0);
+  // A merge waits for the sender whose rows come next, so a full buffer of batches from
+  // the other senders stalls them all. Spilling those batches lets the senders go on.
+  BufferedBlockMgr::Client* spill_client = NULL;
+  if (is_merging_ && FLAGS_exchg_node_spill_merging_input) {
+    RETURN_IF_ERROR(state->block_mgr()->RegisterClient(
+        Substitute("ExchangeNode id=$0 ptr=$1", id_, this), 0, true, mem_tracker(),
+        state, &spill_client));
+    state->block_mgr()->SetClientWaitTimer(spill_client,
+        ADD_TIMER(runtime_profile(), SPILL_WAIT_TIMER));
+  }
   stream_recvr_ = ExecEnv::GetInstance()->stream_mgr()->CreateRecvr(state,
       input_row_desc_, state->fragment_instance_id(), id_, num_senders_,
-      FLAGS_exchg_node_buffer_size_bytes, runtime_profile(), is_merging_);
+      FLAGS_exchg_node_buffer_size_bytes, runtime_profile(), is_merging_, spill_client);
   if (is_merging_) {
     RETURN_IF_ERROR(sort_exec_exprs_.Prepare(
         state, row_descriptor_, row_descriptor_, expr_mem_tracker()));
@@ -76,6 +93,7 @@ Status ExchangeNode::Prepare(RuntimeState* state) {
 
 Status ExchangeNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   RETURN_IF_ERROR(ExecNode::Open(state));
   if (is_merging_) {
     RETURN_IF_ERROR(sort_exec_exprs_.Open(state));
@@ -116,11 +134,20 @@ Status ExchangeNode::FillInputRowBatch(RuntimeState* state) {
   return ret_status;
 }
 
+void ExchangeNode::CloseRecvrAtLimit(RowBatch* output_batch) {
+  if (stream_recvr_ == NULL) return;
+  stream_recvr_->TransferAllResources(output_batch);
+  stream_recvr_->Close();
+  stream_recvr_.reset();
+  input_batch_ = NULL;
+}
+
 Status ExchangeNode::GetNext(RuntimeState* state, RowBatch* output_batch, bool* eos) {
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   if (ReachedLimit()) {
-    stream_recvr_->TransferAllResources(output_batch);
+    CloseRecvrAtLimit(output_batch);
     *eos = true;
     return Status::OK();
   } else {
@@ -153,7 +180,7 @@ Status ExchangeNode::GetNext(RuntimeState* state, RowBatch* output_batch, bool*
       COUNTER_SET(rows_returned_counter_, num_rows_returned_);
 
       if (ReachedLimit()) {
-        stream_recvr_->TransferAllResources(output_batch);
+        CloseRecvrAtLimit(output_batch);
         *eos = true;
         return Status::OK();
       }
@@ -195,12 +222,13 @@ Status ExchangeNode::GetNextMerging(RuntimeState* state, RowBatch* output_batch,
   if (ReachedLimit()) {
     output_batch->set_num_rows(output_batch->num_rows() - (num_rows_returned_ - limit_));
     *eos = true;
+    CloseRecvrAtLimit(output_batch);
+  } else if (*eos) {
+    // On eos, transfer all remaining resources from the input batches maintained
+    // by the merger to the output batch.
+    stream_recvr_->TransferAllResources(output_batch);
   }
 
-  // On eos, transfer all remaining resources from the input batches maintained
-  // by the merger to the output batch.
-  if (*eos) stream_recvr_->TransferAllResources(output_batch);
-
   COUNTER_SET(rows_returned_counter_, num_rows_returned_);
   return Status::OK();
 }
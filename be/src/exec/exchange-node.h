@@ -64,6 +64,11 @@ class ExchangeNode : public ExecNode {
   /// Only used when is_merging_ is false.
   Status FillInputRowBatch(RuntimeState* state);
 
+  /// Called once the limit is reached. Transfers the remaining resources of the receiver
+  /// to 'output_batch' and closes it right away, so that the senders learn that no more
+  /// rows are needed and stop instead of running until the query is cancelled.
+  void CloseRecvrAtLimit(RowBatch* output_batch);
+
   int num_senders_;  // needed for stream_recvr_ construction
 
   /// The underlying DataStreamRecvr instance. Ownership is shared between this
@@ -14,7 +14,9 @@
 
 #include "exec/exec-node.h"
 
+#include <limits>
 #include <sstream>
+#include <sys/resource.h>
 #include <unistd.h>  // for sleep()
 
 #include <thrift/protocol/TDebugProtocol.h>
@@ -32,12 +34,14 @@
 #include "exec/hash-join-node.h"
 #include "exec/hbase-scan-node.h"
 #include "exec/hdfs-scan-node.h"
+#include "exec/merge-join-node.h"
 #include "exec/nested-loop-join-node.h"
 #include "exec/partitioned-aggregation-node.h"
 #include "exec/partitioned-hash-join-node.h"
 #include "exec/select-node.h"
 #include "exec/singular-row-src-node.h"
 #include "exec/sort-node.h"
+#include "exec/sorted-aggregation-node.h"
 #include "exec/subplan-node.h"
 #include "exec/topn-node.h"
 #include "exec/union-node.h"
@@ -47,7 +51,9 @@
 #include "runtime/mem-pool.h"
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
+#include "util/bit-util.h"
 #include "util/debug-util.h"
+#include "util/periodic-counter-updater.h"
 #include "util/runtime-profile.h"
 
 #include "common/names.h"
@@ -57,17 +63,26 @@ using namespace llvm;
 // TODO: remove when we remove hash-join-node.cc and aggregation-node.cc
 DEFINE_bool(enable_partitioned_hash_join, true, "Enable partitioned hash join");
 DEFINE_bool(enable_partitioned_aggregation, true, "Enable partitioned hash agg");
+DEFINE_bool(enable_sorted_aggregation, true, "Aggregate input that is sorted on the "
+    "grouping exprs without a hash table");
+DEFINE_bool(enable_merge_join, true, "Join inputs that are sorted on the join exprs by "
+    "merging them instead of building a hash table");
 
 namespace impala {
 
 const string ExecNode::ROW_THROUGHPUT_COUNTER = "RowsReturnedRate";
+const string ExecNode::LOCAL_USER_TIME_COUNTER = "LocalUserTime";
+const string ExecNode::LOCAL_SYS_TIME_COUNTER = "LocalSysTime";
+const string ExecNode::IO_WAIT_TIMER = "IoWaitTime";
+const string ExecNode::RUNTIME_FILTER_WAIT_TIMER = "RuntimeFilterWaitTime";
+const string ExecNode::SPILL_WAIT_TIMER = "SpillWaitTime";
 
 int ExecNode::GetNodeIdFromProfile(RuntimeProfile* p) {
   return p->metadata();
 }
 
 ExecNode::RowBatchQueue::RowBatchQueue(int max_batches) :
-    BlockingQueue<RowBatch*>(max_batches) {
+    MpscBlockingQueue<RowBatch*>(max_batches) {
 }
 
 ExecNode::RowBatchQueue::~RowBatchQueue() {
@@ -115,16 +130,70 @@ ExecNode::ExecNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl
     debug_action_(TDebugAction::WAIT),
     limit_(tnode.limit),
     num_rows_returned_(0),
+    estimated_memory_(tnode.__isset.estimated_stats &&
+        tnode.estimated_stats.__isset.memory_used ?
+        tnode.estimated_stats.memory_used : -1),
     rows_returned_counter_(NULL),
     rows_returned_rate_(NULL),
+    mem_usage_timeseries_counter_(NULL),
+    rows_returned_timeseries_counter_(NULL),
     containing_subplan_(NULL),
+    instructions_per_cycle_(NULL),
     is_closed_(false) {
+  for (int i = 0; i < NUM_SCOPED_VALUES; ++i) scoped_counters_[i] = NULL;
   InitRuntimeProfile(PrintPlanNodeType(tnode.node_type));
 }
 
 ExecNode::~ExecNode() {
 }
 
+__thread ExecNode::ScopedNodeCounters* ExecNode::ScopedNodeCounters::current_ = NULL;
+
+// Returns the user and system CPU time of the calling thread in ns.
+static void ReadThreadCpuTimes(int64_t* user_ns, int64_t* sys_ns) {
+  rusage usage;
+  int ret = getrusage(RUSAGE_THREAD, &usage);
+  DCHECK_EQ(ret, 0);
+  *user_ns = usage.ru_utime.tv_sec * 1000L * 1000L * 1000L +
+      usage.ru_utime.tv_usec * 1000L;
+  *sys_ns = usage.ru_stime.tv_sec * 1000L * 1000L * 1000L +
+      usage.ru_stime.tv_usec * 1000L;
+}
+
+ExecNode::ScopedNodeCounters::ScopedNodeCounters(ExecNode* node)
+  : node_(NULL),
+    parent_(NULL),
+    count_hw_events_(false) {
+  if (node->scoped_counters_[USER_TIME] == NULL) return;
+  node_ = node;
+  parent_ = current_;
+  current_ = this;
+  memset(nested_values_, 0, sizeof(nested_values_));
+  count_hw_events_ = node->scoped_counters_[ThreadHwCounters::CYCLES] != NULL &&
+      ThreadHwCounters::Read(start_values_);
+  ReadThreadCpuTimes(&start_values_[USER_TIME], &start_values_[SYS_TIME]);
+}
+
+ExecNode::ScopedNodeCounters::~ScopedNodeCounters() {
+  if (node_ == NULL) return;
+  DCHECK_EQ(current_, this);
+  current_ = parent_;
+  int64_t end_values[NUM_SCOPED_VALUES];
+  ReadThreadCpuTimes(&end_values[USER_TIME], &end_values[SYS_TIME]);
+  bool hw_events_read = count_hw_events_ && ThreadHwCounters::Read(end_values);
+  for (int i = hw_events_read ? 0 : USER_TIME; i < NUM_SCOPED_VALUES; ++i) {
+    int64_t value = end_values[i] - start_values_[i];
+    COUNTER_ADD(node_->scoped_counters_[i], value - nested_values_[i]);
+    if (parent_ != NULL) parent_->nested_values_[i] += value;
+  }
+  if (!hw_events_read) return;
+  int64_t cycles = node_->scoped_counters_[ThreadHwCounters::CYCLES]->value();
+  if (cycles > 0) {
+    COUNTER_SET(node_->instructions_per_cycle_, static_cast<double>(
+        node_->scoped_counters_[ThreadHwCounters::INSTRUCTIONS]->value()) / cycles);
+  }
+}
+
 Status ExecNode::Init(const TPlanNode& tnode, RuntimeState* state) {
   RETURN_IF_ERROR(
       Expr::CreateExprTrees(pool_, tnode.conjuncts, &conjunct_ctxs_));
@@ -136,6 +205,20 @@ Status ExecNode::Prepare(RuntimeState* state) {
   DCHECK(runtime_profile_.get() != NULL);
   rows_returned_counter_ =
       ADD_COUNTER(runtime_profile_, "RowsReturned", TUnit::UNIT);
+  scoped_counters_[USER_TIME] = ADD_TIMER(runtime_profile_, LOCAL_USER_TIME_COUNTER);
+  scoped_counters_[SYS_TIME] = ADD_TIMER(runtime_profile_, LOCAL_SYS_TIME_COUNTER);
+  if (state->query_options().enable_hw_perf_counters) {
+    scoped_counters_[ThreadHwCounters::CYCLES] =
+        ADD_COUNTER(runtime_profile_, "HWCycles", TUnit::UNIT);
+    scoped_counters_[ThreadHwCounters::INSTRUCTIONS] =
+        ADD_COUNTER(runtime_profile_, "HWInstructions", TUnit::UNIT);
+    scoped_counters_[ThreadHwCounters::LLC_MISSES] =
+        ADD_COUNTER(runtime_profile_, "HWLLCMisses", TUnit::UNIT);
+    scoped_counters_[ThreadHwCounters::BRANCH_MISSES] =
+        ADD_COUNTER(runtime_profile_, "HWBranchMisses", TUnit::UNIT);
+    instructions_per_cycle_ =
+        ADD_COUNTER(runtime_profile_, "HWInstructionsPerCycle", TUnit::DOUBLE_VALUE);
+  }
   mem_tracker_.reset(new MemTracker(
       runtime_profile_.get(), -1, -1, runtime_profile_->name(),
       state->instance_mem_tracker()));
@@ -145,6 +228,12 @@ Status ExecNode::Prepare(RuntimeState* state) {
       ROW_THROUGHPUT_COUNTER, TUnit::UNIT_PER_SECOND,
       bind<int64_t>(&RuntimeProfile::UnitsPerSecond, rows_returned_counter_,
         runtime_profile()->total_time_counter()));
+  mem_usage_timeseries_counter_ = runtime_profile()->AddTimeSeriesCounter("MemoryUsage",
+      TUnit::BYTES, bind<int64_t>(mem_fn(&MemTracker::consumption), mem_tracker_.get()));
+  // num_rows_returned_ is sampled directly, rows_returned_counter_ is only updated by
+  // some nodes before Close().
+  rows_returned_timeseries_counter_ = runtime_profile()->AddTimeSeriesCounter(
+      "RowsReturned", TUnit::UNIT, bind<int64_t>(mem_fn(&ExecNode::rows_returned), this));
 
   RETURN_IF_ERROR(Expr::Prepare(conjunct_ctxs_, state, row_desc(), expr_mem_tracker()));
   AddExprCtxsToFree(conjunct_ctxs_);
@@ -175,6 +264,8 @@ void ExecNode::Close(RuntimeState* state) {
   if (rows_returned_counter_ != NULL) {
     COUNTER_SET(rows_returned_counter_, num_rows_returned_);
   }
+  PeriodicCounterUpdater::StopTimeSeriesCounter(mem_usage_timeseries_counter_);
+  PeriodicCounterUpdater::StopTimeSeriesCounter(rows_returned_timeseries_counter_);
   for (int i = 0; i < children_.size(); ++i) {
     children_[i]->Close(state);
   }
@@ -286,13 +377,20 @@ Status ExecNode::CreateNode(ObjectPool* pool, const TPlanNode& tnode,
       *node = pool->Add(new DataSourceScanNode(pool, tnode, descs));
       break;
     case TPlanNodeType::AGGREGATION_NODE:
-      if (FLAGS_enable_partitioned_aggregation) {
+      if (tnode.agg_node.__isset.input_is_sorted && tnode.agg_node.input_is_sorted &&
+          FLAGS_enable_sorted_aggregation) {
+        *node = pool->Add(new SortedAggregationNode(pool, tnode, descs));
+      } else if (FLAGS_enable_partitioned_aggregation) {
         *node = pool->Add(new PartitionedAggregationNode(pool, tnode, descs));
       } else {
         *node = pool->Add(new AggregationNode(pool, tnode, descs));
       }
       break;
     case TPlanNodeType::HASH_JOIN_NODE:
+      if (tnode.hash_join_node.__isset.merge_is_asc_order && FLAGS_enable_merge_join) {
+        *node = pool->Add(new MergeJoinNode(pool, tnode, descs));
+        break;
+      }
       // The (old) HashJoinNode does not support left-anti, right-semi, and right-anti
       // joins.
       if (tnode.hash_join_node.join_op == TJoinOp::LEFT_ANTI_JOIN ||
@@ -393,6 +491,32 @@ void ExecNode::CollectNodes(TPlanNodeType::type node_type, vector<ExecNode*>* no
   }
 }
 
+void ExecNode::GetBufferRequirements(int64_t buffer_size, int* min_buffers,
+    int* desired_buffers) const {
+  *min_buffers = 0;
+  *desired_buffers = 0;
+}
+
+void ExecNode::CollectBufferRequirements(int64_t buffer_size, int* min_buffers,
+    int* desired_buffers) const {
+  int node_min_buffers;
+  int node_desired_buffers;
+  GetBufferRequirements(buffer_size, &node_min_buffers, &node_desired_buffers);
+  DCHECK_GE(node_desired_buffers, node_min_buffers);
+  *min_buffers += node_min_buffers;
+  *desired_buffers += node_desired_buffers;
+  for (int i = 0; i < children_.size(); ++i) {
+    children_[i]->CollectBufferRequirements(buffer_size, min_buffers, desired_buffers);
+  }
+}
+
+int ExecNode::EstimatedBuffers(int64_t buffer_size, int min_buffers) const {
+  if (estimated_memory_ <= 0) return min_buffers;
+  int64_t estimated_buffers = BitUtil::Ceil(estimated_memory_, buffer_size);
+  return max<int64_t>(min_buffers, min<int64_t>(estimated_buffers,
+      std::numeric_limits<int>::max()));
+}
+
 void ExecNode::CollectScanNodes(vector<ExecNode*>* nodes) {
   CollectNodes(TPlanNodeType::HDFS_SCAN_NODE, nodes);
   CollectNodes(TPlanNodeType::HBASE_SCAN_NODE, nodes);
@@ -428,6 +552,22 @@ bool ExecNode::EvalConjuncts(ExprContext* const* ctxs, int num_ctxs, TupleRow* r
   return true;
 }
 
+void ExecNode::EvalConjunctsOnSelection(ExprContext* const* ctxs, int num_ctxs,
+    RowBatch* batch) {
+  DCHECK(batch->has_selection());
+  int* selection = batch->selection();
+  int num_selected = batch->num_selected_rows();
+  for (int i = 0; i < num_ctxs && num_selected > 0; ++i) {
+    int num_kept = 0;
+    for (int j = 0; j < num_selected; ++j) {
+      BooleanVal v = ctxs[i]->GetBooleanVal(batch->GetRow(selection[j]));
+      if (!v.is_null && v.val) selection[num_kept++] = selection[j];
+    }
+    num_selected = num_kept;
+  }
+  batch->set_num_selected_rows(num_selected);
+}
+
 Status ExecNode::QueryMaintenance(RuntimeState* state) {
   FreeLocalAllocations();
   return state->CheckQueryState();
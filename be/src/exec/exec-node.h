@@ -23,7 +23,8 @@
 #include "exprs/expr-context.h"
 #include "runtime/descriptors.h"  // for RowDescriptor
 #include "util/runtime-profile.h"
-#include "util/blocking-queue.h"
+#include "util/mpsc-blocking-queue.h"
+#include "util/perf-counters.h"
 #include "gen-cpp/PlanNodes_types.h"
 
 namespace impala {
@@ -135,11 +136,30 @@ class ExecNode {
   /// Collect all scan node types.
   void CollectScanNodes(std::vector<ExecNode*>* nodes);
 
+  /// Returns the number of block mgr buffers of 'buffer_size' bytes that this node needs
+  /// to run at all in 'min_buffers', and the number that it would like to have to run
+  /// without spilling in 'desired_buffers'. Nodes that don't use the block mgr return
+  /// 0 for both. Valid after Prepare().
+  virtual void GetBufferRequirements(int64_t buffer_size, int* min_buffers,
+      int* desired_buffers) const;
+
+  /// Adds the GetBufferRequirements() of all nodes of this subtree to 'min_buffers' and
+  /// 'desired_buffers'.
+  void CollectBufferRequirements(int64_t buffer_size, int* min_buffers,
+      int* desired_buffers) const;
+
   /// Evaluate ExprContexts over row.  Returns true if all exprs return true.
   /// TODO: This doesn't use the vector<Expr*> signature because I haven't figured
   /// out how to deal with declaring a templated std:vector type in IR
   static bool EvalConjuncts(ExprContext* const* ctxs, int num_ctxs, TupleRow* row);
 
+  /// Evaluates ExprContexts over the selected rows of 'batch', which must have a
+  /// selection, and removes the rows for which any of them doesn't return true from the
+  /// selection. Each expr is evaluated over all rows still selected before the next one,
+  /// so a row is only evaluated by the exprs up to the first one that rejects it.
+  static void EvalConjunctsOnSelection(ExprContext* const* ctxs, int num_ctxs,
+      RowBatch* batch);
+
   /// Codegen EvalConjuncts(). Returns a non-OK status if the function couldn't be
   /// codegen'd. The codegen'd version uses inlined, codegen'd GetBooleanVal() functions.
   static Status CodegenEvalConjuncts(
@@ -182,17 +202,72 @@ class ExecNode {
   /// Names of counters shared by all exec nodes
   static const std::string ROW_THROUGHPUT_COUNTER;
 
+  /// Names of the counters of the user and system CPU time of a node's own work in its
+  /// Open() and GetNext() calls, see ScopedNodeCounters.
+  static const std::string LOCAL_USER_TIME_COUNTER;
+  static const std::string LOCAL_SYS_TIME_COUNTER;
+
+  /// Names of the timers of the wall clock time a node blocked in Open() and GetNext(),
+  /// by reason: for scanner threads to read and materialize rows, for runtime filters to
+  /// arrive and for the block mgr to read or write spilled blocks. Nodes only have the
+  /// timers of the waits they can incur. The time an exchange node waits for rows is its
+  /// profile's inactive time.
+  static const std::string IO_WAIT_TIMER;
+  static const std::string RUNTIME_FILTER_WAIT_TIMER;
+  static const std::string SPILL_WAIT_TIMER;
+
  protected:
   friend class DataSink;
 
+  /// Indexes of the values counted by ScopedNodeCounters: the hardware events, indexed by
+  /// ThreadHwCounters::Counter, followed by the user and system CPU time in ns.
+  enum ScopedValue {
+    USER_TIME = ThreadHwCounters::NUM_COUNTERS,
+    SYS_TIME,
+    NUM_SCOPED_VALUES
+  };
+
+  /// Measures the CPU time of the calling thread while it is in scope, and also counts
+  /// its hardware events if the ENABLE_HW_PERF_COUNTERS query option is set, and adds
+  /// them to the profile of 'node'. The values of scopes nested in the same thread, i.e.
+  /// of the Open() and GetNext() calls of the children, are excluded, so that each node
+  /// only counts its own work. Work that a node does in other threads, e.g. in scanner
+  /// threads, is only counted if the thread enters a scope of its own.
+  class ScopedNodeCounters {
+   public:
+    ScopedNodeCounters(ExecNode* node);
+    ~ScopedNodeCounters();
+
+   private:
+    /// The innermost scope of the calling thread.
+    static __thread ScopedNodeCounters* current_;
+
+    /// NULL if the node has not been prepared and has no counters.
+    ExecNode* node_;
+
+    /// The enclosing scope of the same thread, or NULL.
+    ScopedNodeCounters* parent_;
+
+    /// True if the hardware events are counted in addition to the CPU times, i.e. if
+    /// the node has counters for them and they could be read.
+    bool count_hw_events_;
+
+    /// The values when the scope was entered.
+    int64_t start_values_[NUM_SCOPED_VALUES];
+
+    /// The values counted by the scopes nested in this one.
+    int64_t nested_values_[NUM_SCOPED_VALUES];
+  };
+
   /// Extends blocking queue for row batches. Row batches have a property that
   /// they must be processed in the order they were produced, even in cancellation
   /// paths. Preceding row batches can contain ptrs to memory in subsequent row batches
   /// and we need to make sure those ptrs stay valid.
   /// Row batches that are added after Shutdown() are queued in another queue, which can
   /// be cleaned up during Close().
-  /// All functions are thread safe.
-  class RowBatchQueue : public BlockingQueue<RowBatch*> {
+  /// Batches may be added by any number of threads, but only one thread at a time may
+  /// get them or call Cleanup(), which lets the queue hand them over without locks.
+  class RowBatchQueue : public MpscBlockingQueue<RowBatch*> {
    public:
     /// max_batches is the maximum number of row batches that can be queued.
     /// When the queue is full, producers will block.
@@ -238,10 +313,25 @@ class ExecNode {
   int64_t limit_;  // -1: no limit
   int64_t num_rows_returned_;
 
+  /// The planner's estimate of the peak memory of this node on one host, or -1 if there
+  /// is none.
+  int64_t estimated_memory_;
+
   boost::scoped_ptr<RuntimeProfile> runtime_profile_;
   RuntimeProfile::Counter* rows_returned_counter_;
   RuntimeProfile::Counter* rows_returned_rate_;
 
+  /// Sampled memory consumption of mem_tracker_ and number of rows returned at even
+  /// time intervals.
+  RuntimeProfile::TimeSeriesCounter* mem_usage_timeseries_counter_;
+  RuntimeProfile::TimeSeriesCounter* rows_returned_timeseries_counter_;
+
+  /// The counters of the values measured by ScopedNodeCounters, indexed by ScopedValue,
+  /// and the instructions per cycle computed from the hardware events. The hardware
+  /// event counters are NULL unless the ENABLE_HW_PERF_COUNTERS query option is set.
+  RuntimeProfile::Counter* scoped_counters_[NUM_SCOPED_VALUES];
+  RuntimeProfile::Counter* instructions_per_cycle_;
+
   /// Account for peak memory used by this node
   boost::scoped_ptr<MemTracker> mem_tracker_;
 
@@ -274,6 +364,10 @@ class ExecNode {
 
   virtual bool IsScanNode() const { return false; }
 
+  /// Returns the number of buffers of 'buffer_size' bytes that hold the planner's memory
+  /// estimate of this node, but at least 'min_buffers'. For GetBufferRequirements().
+  int EstimatedBuffers(int64_t buffer_size, int min_buffers) const;
+
   void InitRuntimeProfile(const std::string& name);
 
   /// Executes debug_action_ if phase matches debug_phase_.
@@ -326,5 +420,10 @@ class ExecNode {
   std::vector<ExprContext*> expr_ctxs_to_free_;
 };
 
+/// Measures the CPU time and hardware events of the enclosing Open() or GetNext() call of
+/// 'node', see ExecNode::ScopedNodeCounters.
+#define SCOPED_NODE_COUNTERS(node) \
+  ExecNode::ScopedNodeCounters MACRO_CONCAT(SCOPED_NODE_COUNTERS, __COUNTER__)(node)
+
 }
 #endif
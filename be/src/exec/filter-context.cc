@@ -32,7 +32,11 @@ FilterStats::FilterStats(RuntimeProfile* runtime_profile, bool is_partition_filt
 
   // TODO: These only apply to Parquet, so only register them in that case.
   RegisterCounterGroup(FilterStats::ROWS_KEY);
-  if (is_partition_filter) RegisterCounterGroup(FilterStats::ROW_GROUPS_KEY);
+  scanners_disabled_counter_ =
+      ADD_COUNTER(profile, "Scanners that disabled filter", TUnit::UNIT);
+  // Row groups are filtered on partition columns or, for other columns, on their
+  // dictionaries.
+  RegisterCounterGroup(FilterStats::ROW_GROUPS_KEY);
 }
 
 void FilterStats::IncrCounters(const string& key, int32_t total, int32_t processed,
@@ -56,6 +60,18 @@ void FilterStats::RegisterCounterGroup(const string& key) {
   counters[key] = counter;
 }
 
+void FilterStats::AddSample(int64_t considered, int64_t rejected,
+    int64_t min_sample_rows, double min_reject_ratio) const {
+  int64_t total = sampled_rows_.UpdateAndFetch(considered);
+  int64_t total_rejected = sampled_rejected_rows_.UpdateAndFetch(rejected);
+  if (total < min_sample_rows) return;
+  if (total_rejected >= min_reject_ratio * total) return;
+  if (!disabled_.CompareAndSwap(0, 1)) return;
+  profile->AddInfoString("Disabled", Substitute("filter rejected $0 of $1 sampled "
+      "rows, below the minimum reject ratio of $2", total_rejected, total,
+      min_reject_ratio));
+}
+
 Status FilterContext::CloneFrom(const FilterContext& from, RuntimeState* state) {
   filter = from.filter;
   stats = from.stats;
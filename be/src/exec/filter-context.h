@@ -19,12 +19,14 @@
 #include <boost/unordered_map.hpp>
 #include <gutil/strings/substitute.h>
 
+#include "common/atomic.h"
 #include "exprs/expr-context.h"
 #include "util/runtime-profile.h"
 
 namespace impala {
 
 class BloomFilter;
+class MinMaxFilter;
 class RuntimeFilter;
 
 /// Container struct for per-filter statistics, with statistics for each granularity of
@@ -63,6 +65,21 @@ class FilterStats {
   /// Adds a new counter group with key 'key'. Not thread safe.
   void RegisterCounterGroup(const std::string& key);
 
+  /// Adds the outcome of applying the filter to 'considered' rows in one scanner, of
+  /// which it rejected 'rejected', to the tally of the whole scan. Once at least
+  /// 'min_sample_rows' rows were sampled and the filter rejected fewer than
+  /// 'min_reject_ratio' of them, it is disabled for the scanners that start afterwards
+  /// and the decision is recorded in the profile. Thread safe.
+  void AddSample(int64_t considered, int64_t rejected, int64_t min_sample_rows,
+      double min_reject_ratio) const;
+
+  /// Called by a scanner that stopped applying the filter because it rejected too few
+  /// of its rows. Thread safe.
+  void RecordScannerDisabled() const { scanners_disabled_counter_->Add(1); }
+
+  /// True if AddSample() disabled the filter.
+  bool disabled() const { return disabled_.Read() != 0; }
+
  private:
   /// Map from some key to statistics for that key.
   typedef boost::unordered_map<std::string, CounterGroup> CountersMap;
@@ -70,6 +87,16 @@ class FilterStats {
 
   /// Runtime profile to which counters are added. Owned by runtime state's object pool.
   RuntimeProfile* profile;
+
+  /// Number of scanners that stopped applying the filter.
+  RuntimeProfile::Counter* scanners_disabled_counter_;
+
+  /// Rows sampled by AddSample() and how many of them the filter rejected.
+  mutable AtomicInt<int64_t> sampled_rows_;
+  mutable AtomicInt<int64_t> sampled_rejected_rows_;
+
+  /// Set to 1 once AddSample() disabled the filter.
+  mutable AtomicInt<int32_t> disabled_;
 };
 
 /// FilterContext contains all metadata for a single runtime filter, and allows the filter
@@ -87,12 +114,16 @@ struct FilterContext {
   /// Working copy of local bloom filter
   BloomFilter* local_bloom_filter;
 
+  /// Working copy of the local range filter, NULL if the expr's type has no ranges.
+  MinMaxFilter* local_min_max_filter;
+
   /// Clones this FilterContext for use in a multi-threaded context (i.e. by scanner
   /// threads).
   Status CloneFrom(const FilterContext& from, RuntimeState* state);
 
   FilterContext()
-      : expr(NULL), filter(NULL), local_bloom_filter(NULL) { }
+      : expr(NULL), filter(NULL), local_bloom_filter(NULL),
+        local_min_max_filter(NULL) { }
 };
 
 }
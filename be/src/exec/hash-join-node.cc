@@ -150,7 +150,8 @@ Status HashJoinNode::Prepare(RuntimeState* state) {
     codegen_process_build_batch_fn_ = CodegenProcessBuildBatch(state, hash_fn);
     if (codegen_process_build_batch_fn_ != NULL) {
       codegen->AddFunctionToJit(codegen_process_build_batch_fn_,
-          reinterpret_cast<void**>(&process_build_batch_fn_));
+          reinterpret_cast<void**>(&process_build_batch_fn_),
+          /* has_interpreted_fallback */ true);
       build_codegen_enabled = true;
     }
 
@@ -159,7 +160,8 @@ Status HashJoinNode::Prepare(RuntimeState* state) {
       Function* codegen_process_probe_batch_fn = CodegenProcessProbeBatch(state, hash_fn);
       if (codegen_process_probe_batch_fn != NULL) {
         codegen->AddFunctionToJit(codegen_process_probe_batch_fn,
-            reinterpret_cast<void**>(&process_probe_batch_fn_));
+            reinterpret_cast<void**>(&process_probe_batch_fn_),
+            /* has_interpreted_fallback */ true);
         probe_codegen_enabled = true;
       }
     }
@@ -258,6 +260,7 @@ Status HashJoinNode::InitGetNext(TupleRow* first_probe_row) {
 
 Status HashJoinNode::GetNext(RuntimeState* state, RowBatch* out_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
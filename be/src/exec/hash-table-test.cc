@@ -44,7 +44,7 @@ namespace impala {
 
 class HashTableTest : public testing::Test {
  public:
-  HashTableTest() : mem_pool_(&tracker_) {}
+  HashTableTest() : mem_pool_(&tracker_), use_tags_(false), inline_key_words_(0) {}
 
  protected:
   scoped_ptr<TestEnv> test_env_;
@@ -55,6 +55,10 @@ class HashTableTest : public testing::Test {
   vector<ExprContext*> build_expr_ctxs_;
   vector<ExprContext*> probe_expr_ctxs_;
 
+  // Whether CreateHashTable() creates hash tables with bucket tags and inline keys.
+  bool use_tags_;
+  int inline_key_words_;
+
   virtual void SetUp() {
     test_env_.reset(new TestEnv());
 
@@ -192,7 +196,7 @@ class HashTableTest : public testing::Test {
     EXPECT_EQ(initial_num_buckets, BitUtil::NextPowerOfTwo(initial_num_buckets));
     int64_t max_num_buckets = 1L << 31;
     table->reset(new HashTable(quadratic, runtime_state_, client, 1, NULL,
-          max_num_buckets, initial_num_buckets));
+          max_num_buckets, initial_num_buckets, use_tags_, inline_key_words_));
     return (*table)->Init();
   }
 
@@ -253,6 +257,33 @@ class HashTableTest : public testing::Test {
   // are all there using a full table scan. It also validates that Find() is correct
   // testing for probe rows that are both there and not.
   // The hash table is resized a few times and the scans/finds are tested again.
+  // Probes the rows in 'data' the way PartitionedHashJoinNode does for large hash
+  // tables: all rows are hashed and their buckets prefetched first, then the expr values
+  // of each row are restored with EvalProbe() before it is looked up.
+  void BatchProbeTest(HashTable* table, HashTableCtx* ht_ctx, ProbeTestData* data,
+      int num_data) {
+    vector<uint32_t> hashes(num_data);
+    vector<bool> valid(num_data);
+    for (int i = 0; i < num_data; ++i) {
+      valid[i] = ht_ctx->EvalAndHashProbe(data[i].probe_row, &hashes[i]);
+      if (valid[i]) table->PrefetchBucket<false>(hashes[i]);
+    }
+    for (int i = 0; i < num_data; ++i) {
+      if (!valid[i]) continue;
+      TupleRow* row = data[i].probe_row;
+      ht_ctx->EvalProbe(row);
+      HashTable::Iterator iter = table->FindProbeRow(ht_ctx, hashes[i]);
+      if (data[i].expected_build_rows.size() == 0) {
+        EXPECT_TRUE(iter.AtEnd());
+      } else {
+        ASSERT_FALSE(iter.AtEnd());
+        EXPECT_EQ(data[i].expected_build_rows[0]->GetTuple(0),
+                  iter.GetRow()->GetTuple(0));
+        ValidateMatch(row, iter.GetRow());
+      }
+    }
+  }
+
   void BasicTest(bool quadratic, int initial_num_buckets) {
     TupleRow* build_rows[5];
     TupleRow* scan_rows[5] = {0};
@@ -283,6 +314,7 @@ class HashTableTest : public testing::Test {
     // Do a full table scan and validate returned pointers
     FullScan(hash_table.get(), &ht_ctx, 0, 5, true, scan_rows, build_rows);
     ProbeTest(hash_table.get(), &ht_ctx, probe_rows, 10, false);
+    BatchProbeTest(hash_table.get(), &ht_ctx, probe_rows, 10);
 
     // Double the size of the hash table and scan again.
     ResizeTable(hash_table.get(), 2048, &ht_ctx);
@@ -585,6 +617,94 @@ TEST_F(HashTableTest, HashEmpty) {
   ht_ctx.Close();
 }
 
+// Runs the tests that probe, insert and resize with tagged buckets.
+TEST_F(HashTableTest, TaggedTest) {
+  use_tags_ = true;
+  for (int quadratic = 0; quadratic < 2; ++quadratic) {
+    BasicTest(quadratic, 1);
+    BasicTest(quadratic, 65536);
+    ScanTest(quadratic, 1024, 1000, 5);
+    GrowTableTest(quadratic);
+    InsertFullTest(quadratic, 64);
+  }
+}
+
+TEST_F(HashTableTest, InlineKeysTest) {
+  // A single INT key fits inline, also with its null byte if NULLs are stored. NULLs that
+  // are stored but not found can't be compared inline.
+  for (int i = 0; i < 3; ++i) {
+    HashTableCtx ht_ctx(build_expr_ctxs_, probe_expr_ctxs_, i > 0,
+        std::vector<bool>(build_expr_ctxs_.size(), i == 1), 1, 2, 1);
+    EXPECT_EQ(i < 2, ht_ctx.inline_keys());
+    ht_ctx.Close();
+  }
+
+  inline_key_words_ = 1;
+  for (int tags = 0; tags < 2; ++tags) {
+    use_tags_ = tags;
+    BasicTest(true, 1);
+    BasicTest(false, 1024);
+    GrowTableTest(true);
+    InsertFullTest(true, 64);
+  }
+}
+
+// Composite keys of several columns are compared inline as long as they fit in
+// MAX_INLINE_KEY_WORDS words.
+TEST_F(HashTableTest, CompositeInlineKeysTest) {
+  RowDescriptor desc;
+  vector<ExprContext*> build_ctxs;
+  vector<ExprContext*> probe_ctxs;
+  for (int i = 0; i < 7; ++i) {
+    build_ctxs.push_back(pool_.Add(new ExprContext(
+        pool_.Add(new SlotRef(TYPE_INT, 1, true /* nullable */)))));
+    probe_ctxs.push_back(pool_.Add(new ExprContext(
+        pool_.Add(new SlotRef(TYPE_INT, 1, true /* nullable */)))));
+  }
+  ASSERT_OK(Expr::Prepare(build_ctxs, NULL, desc, &tracker_));
+  ASSERT_OK(Expr::Open(build_ctxs, NULL));
+  ASSERT_OK(Expr::Prepare(probe_ctxs, NULL, desc, &tracker_));
+  ASSERT_OK(Expr::Open(probe_ctxs, NULL));
+
+  // Six INT keys and their null bytes take 30 bytes, seven don't fit anymore.
+  for (int num_keys = 1; num_keys <= 7; ++num_keys) {
+    vector<ExprContext*> build_keys(build_ctxs.begin(), build_ctxs.begin() + num_keys);
+    vector<ExprContext*> probe_keys(probe_ctxs.begin(), probe_ctxs.begin() + num_keys);
+    HashTableCtx ht_ctx(build_keys, probe_keys, true, vector<bool>(num_keys, true),
+        1, 0, 1);
+    EXPECT_EQ(num_keys < 7 ? BitUtil::Ceil(num_keys * 5, 8) : 0,
+        ht_ctx.inline_key_words());
+    if (!ht_ctx.inline_keys()) {
+      ht_ctx.Close();
+      continue;
+    }
+
+    inline_key_words_ = ht_ctx.inline_key_words();
+    scoped_ptr<HashTable> hash_table;
+    ASSERT_TRUE(CreateHashTable(true, 4, &hash_table));
+    // NULL keys only match each other.
+    for (int i = -1; i < 10; ++i) {
+      TupleRow* row = i < 0 ? CreateNullTupleRow() : CreateTupleRow(i);
+      uint32_t hash = 0;
+      ASSERT_TRUE(ht_ctx.EvalAndHashBuild(row, &hash));
+      ASSERT_TRUE(hash_table->CheckAndResize(1, &ht_ctx));
+      ASSERT_TRUE(hash_table->Insert(&ht_ctx, row->GetTuple(0), hash));
+    }
+    for (int i = -1; i < 20; ++i) {
+      TupleRow* row = i < 0 ? CreateNullTupleRow() : CreateTupleRow(i);
+      uint32_t hash = 0;
+      ASSERT_TRUE(ht_ctx.EvalAndHashProbe(row, &hash));
+      HashTable::Iterator iter = hash_table->FindProbeRow(&ht_ctx, hash);
+      EXPECT_EQ(i >= 10, iter.AtEnd()) << num_keys << " " << i;
+    }
+    hash_table->Close();
+    ht_ctx.Close();
+  }
+  inline_key_words_ = 0;
+  Expr::Close(build_ctxs, NULL);
+  Expr::Close(probe_ctxs, NULL);
+}
+
 TEST_F(HashTableTest, VeryLowMemTest) {
   VeryLowMemTest(true);
   VeryLowMemTest(false);
@@ -28,7 +28,9 @@
 #include "runtime/raw-value.h"
 #include "runtime/runtime-state.h"
 #include "runtime/string-value.inline.h"
+#include "util/cpu-info.h"
 #include "util/debug-util.h"
+#include "util/huge-page-allocator.h"
 #include "util/impalad-metrics.h"
 
 #include "common/names.h"
@@ -38,6 +40,12 @@ using namespace llvm;
 using namespace strings;
 
 DEFINE_bool(enable_quadratic_probing, true, "Enable quadratic probing hash table");
+DEFINE_bool(enable_hash_table_prefetch, true, "(Advanced) Enables hashing whole row "
+    "batches and prefetching their hash table buckets before inserting or probing, for "
+    "hash tables that are larger than the L2 cache");
+DEFINE_bool(enable_hash_table_tags, true, "(Advanced) Keeps a tag byte per bucket in "
+    "join and aggregation hash tables, so that probes skip most non-matching buckets "
+    "without reading them");
 
 const char* HashTableCtx::LLVM_CLASS_NAME = "class.impala::HashTableCtx";
 
@@ -105,6 +113,29 @@ HashTableCtx::HashTableCtx(const std::vector<ExprContext*>& build_expr_ctxs,
   memset(expr_values_buffer_, 0, sizeof(uint8_t) * results_buffer_size_);
   expr_value_null_bits_ = new uint8_t[build_expr_ctxs.size()];
 
+  // Comparing the bytes of the results buffer is exact for these types. Nulls are only
+  // equal to each other if all columns find them.
+  int inline_key_bytes = results_buffer_size_ +
+      (stores_nulls_ ? build_expr_ctxs_.size() : 0);
+  bool inline_keys = var_result_begin_ == -1 &&
+      inline_key_bytes <= MAX_INLINE_KEY_WORDS * sizeof(uint64_t);
+  for (int i = 0; i < build_expr_ctxs_.size(); ++i) {
+    switch (build_expr_ctxs_[i]->root()->type().type) {
+      case TYPE_BOOLEAN:
+      case TYPE_TINYINT:
+      case TYPE_SMALLINT:
+      case TYPE_INT:
+      case TYPE_BIGINT:
+      case TYPE_DECIMAL:
+        break;
+      default:
+        inline_keys = false;
+    }
+    if (stores_nulls_ && !finds_nulls_[i]) inline_keys = false;
+  }
+  inline_key_words_ = inline_keys ?
+      BitUtil::Ceil(inline_key_bytes, sizeof(uint64_t)) : 0;
+
   // Populate the seeds to use for all the levels. TODO: revisit how we generate these.
   DCHECK_GE(max_levels, 0);
   DCHECK_LT(max_levels, sizeof(SEED_PRIMES) / sizeof(SEED_PRIMES[0]));
@@ -116,6 +147,11 @@ HashTableCtx::HashTableCtx(const std::vector<ExprContext*>& build_expr_ctxs,
   }
 }
 
+bool HashTable::UseBatchPrefetch(int64_t bytes) {
+  return FLAGS_enable_hash_table_prefetch &&
+      bytes > CpuInfo::CacheSize(CpuInfo::L2_CACHE);
+}
+
 void HashTableCtx::Close() {
   // TODO: use tr1::array?
   DCHECK(expr_values_buffer_ != NULL);
@@ -170,7 +206,7 @@ uint32_t HashTableCtx::HashVariableLenRow() {
       // Hash the string
       // TODO: when using CRC hash on empty string, this only swaps bytes.
       StringValue* str = reinterpret_cast<StringValue*>(loc);
-      hash = Hash(str->ptr, str->len, hash);
+      hash = HashVarLen(str->ptr, str->len, hash);
     }
   }
   return hash;
@@ -204,25 +240,29 @@ const double HashTable::MAX_FILL_FACTOR = 0.75f;
 HashTable* HashTable::Create(RuntimeState* state,
     BufferedBlockMgr::Client* client, int num_build_tuples,
     BufferedTupleStream* tuple_stream, int64_t max_num_buckets,
-    int64_t initial_num_buckets) {
-  return new HashTable(FLAGS_enable_quadratic_probing, state, client,
-      num_build_tuples, tuple_stream, max_num_buckets, initial_num_buckets);
+    int64_t initial_num_buckets, bool use_tags, int inline_key_words) {
+  return new HashTable(FLAGS_enable_quadratic_probing, state, client, num_build_tuples,
+      tuple_stream, max_num_buckets, initial_num_buckets, use_tags, inline_key_words);
 }
 
 HashTable::HashTable(bool quadratic_probing, RuntimeState* state,
     BufferedBlockMgr::Client* client, int num_build_tuples, BufferedTupleStream* stream,
-    int64_t max_num_buckets, int64_t num_buckets)
+    int64_t max_num_buckets, int64_t num_buckets, bool use_tags, int inline_key_words)
   : state_(state),
     block_mgr_client_(client),
     tuple_stream_(stream),
     stores_tuples_(num_build_tuples == 1),
     quadratic_probing_(quadratic_probing),
+    use_tags_(use_tags),
+    inline_key_words_(inline_key_words),
     total_data_page_size_(0),
     next_node_(NULL),
     node_remaining_current_page_(0),
     num_duplicate_nodes_(0),
     max_num_buckets_(max_num_buckets),
     buckets_(NULL),
+    tags_(NULL),
+    inline_keys_(NULL),
     num_buckets_(num_buckets),
     num_filled_buckets_(0),
     num_buckets_with_duplicates_(0),
@@ -234,19 +274,48 @@ HashTable::HashTable(bool quadratic_probing, RuntimeState* state,
   DCHECK_GT(num_buckets, 0) << "num_buckets must be larger than 0";
   DCHECK(stores_tuples_ || stream != NULL);
   DCHECK(client != NULL);
+  DCHECK_GE(inline_key_words, 0);
+  DCHECK_LE(inline_key_words, HashTableCtx::MAX_INLINE_KEY_WORDS);
 }
 
 bool HashTable::Init() {
-  int64_t buckets_byte_size = num_buckets_ * sizeof(Bucket);
-  if (!state_->block_mgr()->ConsumeMemory(block_mgr_client_, buckets_byte_size)) {
+  if (!state_->block_mgr()->ConsumeMemory(block_mgr_client_,
+      BucketsByteSize(num_buckets_))) {
     num_buckets_ = 0;
     return false;
   }
-  buckets_ = reinterpret_cast<Bucket*>(malloc(buckets_byte_size));
-  memset(buckets_, 0, buckets_byte_size);
+  AllocateBuckets(num_buckets_, &buckets_, &tags_, &inline_keys_);
   return true;
 }
 
+void HashTable::AllocateBuckets(int64_t num_buckets, Bucket** buckets, uint8_t** tags,
+    uint64_t** inline_keys) {
+  // The bucket arrays are probed randomly, so large ones are backed by huge pages if
+  // they are enabled.
+  int64_t buckets_byte_size = num_buckets * sizeof(Bucket);
+  *buckets = reinterpret_cast<Bucket*>(HugePageAllocator::Allocate(buckets_byte_size));
+  memset(*buckets, 0, buckets_byte_size);
+  *tags = NULL;
+  if (use_tags_) {
+    *tags = HugePageAllocator::Allocate(num_buckets);
+    memset(*tags, EMPTY_TAG, num_buckets);
+  }
+  *inline_keys = NULL;
+  if (inline_key_words_ > 0) {
+    *inline_keys = reinterpret_cast<uint64_t*>(HugePageAllocator::Allocate(
+        num_buckets * inline_key_words_ * sizeof(uint64_t)));
+  }
+}
+
+void HashTable::FreeBuckets(int64_t num_buckets, Bucket* buckets, uint8_t* tags,
+    uint64_t* inline_keys) {
+  HugePageAllocator::Free(reinterpret_cast<uint8_t*>(buckets),
+      num_buckets * sizeof(Bucket));
+  HugePageAllocator::Free(tags, num_buckets);
+  HugePageAllocator::Free(reinterpret_cast<uint8_t*>(inline_keys),
+      num_buckets * inline_key_words_ * sizeof(uint64_t));
+}
+
 void HashTable::Close() {
   // Print statistics only for the large or heavily used hash tables.
   // TODO: Tweak these numbers/conditions, or print them always?
@@ -261,8 +330,8 @@ void HashTable::Close() {
     ImpaladMetrics::HASH_TABLE_TOTAL_BYTES->Increment(-total_data_page_size_);
   }
   data_pages_.clear();
-  if (buckets_ != NULL) free(buckets_);
-  state_->block_mgr()->ReleaseMemory(block_mgr_client_, num_buckets_ * sizeof(Bucket));
+  FreeBuckets(num_buckets_, buckets_, tags_, inline_keys_);
+  state_->block_mgr()->ReleaseMemory(block_mgr_client_, BucketsByteSize(num_buckets_));
 }
 
 bool HashTable::CheckAndResize(uint64_t buckets_to_fill, HashTableCtx* ht_ctx) {
@@ -291,12 +360,13 @@ bool HashTable::ResizeBuckets(int64_t num_buckets, HashTableCtx* ht_ctx) {
   // Note that while we copying over the contents of the old hash table, we need to have
   // allocated both the old and the new hash table. Once we finish, we return the memory
   // of the old hash table.
-  int64_t old_size = num_buckets_ * sizeof(Bucket);
-  int64_t new_size = num_buckets * sizeof(Bucket);
+  int64_t old_size = BucketsByteSize(num_buckets_);
+  int64_t new_size = BucketsByteSize(num_buckets);
   if (!state_->block_mgr()->ConsumeMemory(block_mgr_client_, new_size)) return false;
-  Bucket* new_buckets = reinterpret_cast<Bucket*>(malloc(new_size));
-  DCHECK(new_buckets != NULL);
-  memset(new_buckets, 0, new_size);
+  Bucket* new_buckets;
+  uint8_t* new_tags;
+  uint64_t* new_inline_keys;
+  AllocateBuckets(num_buckets, &new_buckets, &new_tags, &new_inline_keys);
 
   // Walk the old table and copy all the filled buckets to the new (resized) table.
   // We do not have to do anything with the duplicate nodes. This operation is expected
@@ -305,18 +375,26 @@ bool HashTable::ResizeBuckets(int64_t num_buckets, HashTableCtx* ht_ctx) {
        NextFilledBucket(&iter.bucket_idx_, &iter.node_)) {
     Bucket* bucket_to_copy = &buckets_[iter.bucket_idx_];
     bool found = false;
-    int64_t bucket_idx =
-        Probe<true>(new_buckets, num_buckets, NULL, bucket_to_copy->hash, &found);
+    int64_t bucket_idx = Probe<true>(new_buckets, new_tags, num_buckets, NULL,
+        bucket_to_copy->hash, &found);
     DCHECK(!found);
     DCHECK_NE(bucket_idx, Iterator::BUCKET_NOT_FOUND) << " Probe failed even though "
         " there are free buckets. " << num_buckets << " " << num_filled_buckets_;
     Bucket* dst_bucket = &new_buckets[bucket_idx];
     *dst_bucket = *bucket_to_copy;
+    if (new_tags != NULL) new_tags[bucket_idx] = HashTag(bucket_to_copy->hash);
+    if (new_inline_keys != NULL) {
+      memcpy(&new_inline_keys[bucket_idx * inline_key_words_],
+          &inline_keys_[iter.bucket_idx_ * inline_key_words_],
+          inline_key_words_ * sizeof(uint64_t));
+    }
   }
 
+  FreeBuckets(num_buckets_, buckets_, tags_, inline_keys_);
   num_buckets_ = num_buckets;
-  free(buckets_);
   buckets_ = new_buckets;
+  tags_ = new_tags;
+  inline_keys_ = new_inline_keys;
   state_->block_mgr()->ReleaseMemory(block_mgr_client_, old_size);
   return true;
 }
@@ -616,7 +694,7 @@ Status HashTableCtx::CodegenEvalRow(RuntimeState* state, bool build, Function**
 //       (i64 119151312 to %"struct.impala::StringValue"*), i32 0, i32 0)
 //   %5 = load i32* getelementptr inbounds (%"struct.impala::StringValue"* inttoptr
 //       (i64 119151312 to %"struct.impala::StringValue"*), i32 0, i32 1)
-//   %6 = call i32 @IrCrcHash(i8* %4, i32 %5, i32 %0)
+//   %6 = call i32 @IrVarLenHash(i8* %4, i32 %5, i32 %0)
 //   br label %continue
 //
 // continue:                                         ; preds = %not_null, %null
@@ -727,7 +805,7 @@ Status HashTableCtx::CodegenHashCurrentRow(RuntimeState* state, bool use_murmur,
 
       // Call hash(ptr, len, hash_result);
       Function* general_hash_fn = use_murmur ? codegen->GetMurmurHashFunction() :
-                                  codegen->GetHashFunction();
+                                  codegen->GetVarLenHashFunction();
       Value* string_hash_result =
           builder.CreateCall3(general_hash_fn, ptr, len, hash_result, "string_hash");
 
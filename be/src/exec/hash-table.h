@@ -39,6 +39,7 @@ class Expr;
 class ExprContext;
 class LlvmCodeGen;
 class MemTracker;
+class RowBatch;
 class RowDescriptor;
 class RuntimeState;
 class Tuple;
@@ -128,6 +129,8 @@ class HashTableCtx {
 
   void set_level(int level);
   int level() const { return level_; }
+
+  bool stores_nulls() const { return stores_nulls_; }
   uint32_t seed(int level) { return seeds_.at(level); }
 
   TupleRow* row() const { return row_; }
@@ -146,6 +149,24 @@ class HashTableCtx {
     return expr_value_null_bits_[expr_idx];
   }
 
+  /// Maximum number of 64-bit words of an inline key.
+  static const int MAX_INLINE_KEY_WORDS = 4;
+
+  /// Returns true if the keys fit in at most MAX_INLINE_KEY_WORDS 64-bit words (see
+  /// InlineKey()) and two rows are equal exactly if their inline keys are equal. This is
+  /// the case for keys of fixed-width integer-like types that are at most 32 bytes
+  /// together, plus one byte per key if nulls are stored, e.g. GROUP BY on up to six
+  /// INT columns. Hash tables for such keys can be created with inline_key_words() so
+  /// that they compare keys without evaluating the build rows.
+  bool inline_keys() const { return inline_key_words_ > 0; }
+
+  /// Returns the number of 64-bit words of the inline keys, 0 if inline_keys() is false.
+  int inline_key_words() const { return inline_key_words_; }
+
+  /// Writes the keys of the last row evaluated, packed into inline_key_words() words, to
+  /// 'key'. Only valid if inline_keys() is true.
+  void IR_ALWAYS_INLINE InlineKey(uint64_t* key) const;
+
   /// Evaluate and hash the build/probe row, returning in *hash. Returns false if this
   /// row should be rejected (doesn't need to be processed further) because it
   /// contains NULL.
@@ -154,6 +175,29 @@ class HashTableCtx {
   bool IR_ALWAYS_INLINE EvalAndHashBuild(TupleRow* row, uint32_t* hash);
   bool IR_ALWAYS_INLINE EvalAndHashProbe(TupleRow* row, uint32_t* hash);
 
+  /// Evaluates the build/probe exprs over 'row' without hashing it. Used to restore the
+  /// expr values of a row that was hashed earlier by EvalAndHashBatch() before it is
+  /// inserted or looked up.
+  void IR_ALWAYS_INLINE EvalBuild(TupleRow* row);
+  void IR_ALWAYS_INLINE EvalProbe(TupleRow* row);
+
+  /// First pass of the batched insert and probe paths: evaluates and hashes all rows of
+  /// 'batch' with EvalAndHashBuild() if BUILD_ROWS is true or with EvalAndHashProbe()
+  /// otherwise, and saves the results for batch_row_valid() and batch_hash(). The
+  /// caller then prefetches the buckets of the rows (see HashTable::PrefetchBucket())
+  /// and processes the rows in a second pass, restoring the expr values of each row
+  /// with EvalBuild()/EvalProbe() first. The results are valid until the next call.
+  template <bool BUILD_ROWS>
+  void IR_ALWAYS_INLINE EvalAndHashBatch(RowBatch* batch);
+
+  /// Returns whether row 'i' of the batch passed to EvalAndHashBatch() was accepted,
+  /// i.e. what EvalAndHashBuild()/EvalAndHashProbe() returned for it.
+  bool batch_row_valid(int i) const { return batch_rows_valid_[i]; }
+
+  /// Returns the hash of row 'i' of the batch passed to EvalAndHashBatch(). Only valid if
+  /// batch_row_valid(i).
+  uint32_t batch_hash(int i) const { return batch_hashes_[i]; }
+
   int results_buffer_size() const { return results_buffer_size_; }
 
   /// Codegen for evaluating a tuple row.  Codegen'd function matches the signature
@@ -206,6 +250,13 @@ class HashTableCtx {
     return HashUtil::MurmurHash2_64(input, len, hash);
   }
 
+  /// Like Hash(), but for the data of strings. Long strings are hashed with xxHash at
+  /// the first level, see HashUtil::VarLenHash().
+  uint32_t inline HashVarLen(const void* input, int len, int32_t hash) {
+    if (level_ == 0) return HashUtil::VarLenHash(input, len, hash);
+    return HashUtil::MurmurHash2_64(input, len, hash);
+  }
+
   /// Evaluate 'row' over build exprs caching the results in 'expr_values_buffer_' This
   /// will be replaced by codegen.  We do not want this function inlined when cross
   /// compiled because we need to be able to differentiate between EvalBuildRow and
@@ -270,6 +321,9 @@ class HashTableCtx {
   /// codegen.
   int results_buffer_size_;
 
+  /// See inline_key_words(). Never changes once set.
+  int inline_key_words_;
+
   /// Buffer to store evaluated expr results.  This address must not change once
   /// allocated since the address is baked into the codegen.
   uint8_t* expr_values_buffer_;
@@ -281,6 +335,10 @@ class HashTableCtx {
   /// Scratch buffer to generate rows on the fly.
   TupleRow* row_;
 
+  /// Results of the last EvalAndHashBatch(), indexed by row. Grown as needed.
+  std::vector<uint32_t> batch_hashes_;
+  std::vector<uint8_t> batch_rows_valid_;
+
   /// Cross-compiled functions to access member variables used in CodegenHashCurrentRow().
   uint32_t GetHashSeed() const;
 };
@@ -294,6 +352,12 @@ class HashTableCtx {
 /// value, the one in the bucket. The data is either a tuple stream index or a Tuple*.
 /// This array of buckets is sparse, we are shooting for up to 3/4 fill factor (75%). The
 /// data allocated by the hash table comes from the BufferedBlockMgr.
+///
+/// A hash table can optionally keep a second, parallel array with one tag byte per
+/// bucket: 0 for an empty bucket, otherwise a 7-bit fingerprint of the hash (see
+/// HashTag()). Probes then read the tags first and only touch a bucket, and the row it
+/// points to, if its tag matches. Since 16 tags fit in the space of a single bucket, most
+/// empty and non-matching buckets are skipped without a cache miss on the bucket array.
 class HashTable {
  private:
 
@@ -357,9 +421,15 @@ class HashTable {
   ///    -1, if it unlimited.
   ///  - initial_num_buckets: number of buckets that the hash table should be initialized
   ///    with.
+  ///  - use_tags: if true, the table keeps a tag byte per bucket to reject most
+  ///    non-matching buckets without reading them. This costs one byte per bucket.
+  ///  - inline_key_words: if not 0, the table keeps the inline key of each entry next to
+  ///    the buckets and compares keys with it, instead of evaluating the build row. Must
+  ///    be 0 or the inline_key_words() of the HashTableCtx of the table. This costs
+  ///    eight bytes per word and bucket.
   static HashTable* Create(RuntimeState* state, BufferedBlockMgr::Client* client,
       int num_build_tuples, BufferedTupleStream* tuple_stream, int64_t max_num_buckets,
-      int64_t initial_num_buckets);
+      int64_t initial_num_buckets, bool use_tags, int inline_key_words);
 
   /// Allocates the initial bucket structure. Returns false if OOM.
   bool Init();
@@ -392,6 +462,18 @@ class HashTable {
   /// Used during the probe phase of hash joins.
   Iterator IR_ALWAYS_INLINE FindProbeRow(HashTableCtx* ht_ctx, uint32_t hash);
 
+  /// Prefetches the bucket at which the lookup or insert of 'hash' starts, for writing
+  /// if FOR_WRITE is true. Callers that process many rows can prefetch the buckets of all
+  /// of them first, so that the cache misses overlap instead of each FindProbeRow() or
+  /// Insert() waiting for its own.
+  template <bool FOR_WRITE>
+  void IR_ALWAYS_INLINE PrefetchBucket(uint32_t hash);
+
+  /// Returns true if the batched, prefetching insert and probe paths should be used for
+  /// hash tables with a total size of 'bytes'. These cost a second evaluation of the
+  /// exprs of each row, which only pays off if the buckets don't fit in the CPU caches.
+  static bool UseBatchPrefetch(int64_t bytes);
+
   /// If a match is found in the table, return an iterator as in FindProbeRow(). If a
   /// match was not present, return an iterator pointing to the empty bucket where the key
   /// should be inserted. Returns End() if the table is full. The caller can set the data
@@ -422,9 +504,12 @@ class HashTable {
     /// Assume max 66% fill factor and no duplicates.
     return BitUtil::NextPowerOfTwo(3 * num_rows / 2);
   }
-  static int64_t EstimateSize(int64_t num_rows) {
+  /// Includes the tag bytes, which only tables created with 'use_tags' have, and the
+  /// inline keys of 'inline_key_words' words.
+  static int64_t EstimateSize(int64_t num_rows, int inline_key_words) {
     int64_t num_buckets = EstimateNumBuckets(num_rows);
-    return num_buckets * sizeof(Bucket);
+    return num_buckets * (sizeof(Bucket) + sizeof(uint8_t) +
+        inline_key_words * sizeof(uint64_t));
   }
 
   /// Returns the memory occupied by the hash table, takes into account the number of
@@ -442,7 +527,9 @@ class HashTable {
   bool CheckAndResize(uint64_t buckets_to_fill, HashTableCtx* ht_ctx);
 
   /// Returns the number of bytes allocated to the hash table from the block manager.
-  int64_t ByteSize() const { return num_buckets_ * sizeof(Bucket) + total_data_page_size_; }
+  int64_t ByteSize() const {
+    return BucketsByteSize(num_buckets_) + total_data_page_size_;
+  }
 
   /// Returns an iterator at the beginning of the hash table.  Advancing this iterator
   /// will traverse all elements.
@@ -556,7 +643,8 @@ class HashTable {
   ///    opposed to linear.
   HashTable(bool quadratic_probing, RuntimeState* state, BufferedBlockMgr::Client* client,
       int num_build_tuples, BufferedTupleStream* tuple_stream,
-      int64_t max_num_buckets, int64_t initial_num_buckets);
+      int64_t max_num_buckets, int64_t initial_num_buckets, bool use_tags,
+      int inline_key_words);
 
   /// Performs the probing operation according to the probing algorithm (linear or
   /// quadratic. Returns one of the following:
@@ -574,12 +662,30 @@ class HashTable {
   /// comparing two rows.
   /// 'hash' must be the hash returned by these functions.
   /// 'found' indicates that a bucket that contains an equal row is found.
+  /// 'tags' are the tags of 'buckets', or NULL if the table has no tags.
   ///
   /// There are wrappers of this function that perform the Find and Insert logic.
   template <bool FORCE_NULL_EQUALITY>
-  int64_t IR_ALWAYS_INLINE Probe(Bucket* buckets, int64_t num_buckets,
+  int64_t IR_ALWAYS_INLINE Probe(Bucket* buckets, uint8_t* tags, int64_t num_buckets,
       HashTableCtx* ht_ctx, uint32_t hash, bool* found);
 
+  /// Returns the tag of buckets holding entries with 'hash'. Never returns EMPTY_TAG.
+  /// The tag is taken from bits 21 to 27 of the hash: the low bits select the bucket and
+  /// the high bits the partition (see NUM_PARTITIONING_BITS in the exec nodes), so these
+  /// bits still differ between the entries of a table with up to 2^21 buckets.
+  static uint8_t HashTag(uint32_t hash) { return 0x80 | ((hash >> 21) & 0x7f); }
+
+  /// Returns true if the inline key of the entries of the bucket at 'bucket_idx' is
+  /// 'key'.
+  bool IR_ALWAYS_INLINE InlineKeyEquals(int64_t bucket_idx, const uint64_t* key) const;
+
+  /// Returns the number of bytes of the bucket array, and the tags and inline keys if
+  /// there are any, of a table with 'num_buckets' buckets.
+  int64_t BucketsByteSize(int64_t num_buckets) const {
+    return num_buckets * (sizeof(Bucket) + (use_tags_ ? sizeof(uint8_t) : 0) +
+        inline_key_words_ * sizeof(uint64_t));
+  }
+
   /// Performs the insert logic. Returns the HtData* of the bucket or duplicate node
   /// where the data should be inserted. Returns NULL if the insert was not successful.
   HtData* IR_ALWAYS_INLINE InsertInternal(HashTableCtx* ht_ctx, uint32_t hash);
@@ -593,6 +699,13 @@ class HashTable {
   /// Resize the hash table to 'num_buckets'. Returns false on OOM.
   bool ResizeBuckets(int64_t num_buckets, HashTableCtx* ht_ctx);
 
+  /// Allocates and initializes the bucket, tag and inline key arrays (the latter two
+  /// only if they are used) for 'num_buckets' buckets, or frees them.
+  void AllocateBuckets(int64_t num_buckets, Bucket** buckets, uint8_t** tags,
+      uint64_t** inline_keys);
+  void FreeBuckets(int64_t num_buckets, Bucket* buckets, uint8_t* tags,
+      uint64_t* inline_keys);
+
   /// Appends the DuplicateNode pointed by next_node_ to 'bucket' and moves the next_node_
   /// pointer to the next DuplicateNode in the page, updating the remaining node counter.
   DuplicateNode* IR_ALWAYS_INLINE AppendNextNode(Bucket* bucket);
@@ -626,6 +739,9 @@ class HashTable {
   /// defined as the number of non-empty buckets / total_buckets
   static const double MAX_FILL_FACTOR;
 
+  /// Tag of an empty bucket.
+  static const uint8_t EMPTY_TAG = 0;
+
   RuntimeState* state_;
 
   /// Client to allocate data pages with.
@@ -645,6 +761,13 @@ class HashTable {
   /// Quadratic probing enabled (as opposed to linear).
   const bool quadratic_probing_;
 
+  /// Whether the table keeps the 'tags_' array.
+  const bool use_tags_;
+
+  /// Number of words of the inline key of each bucket in 'inline_keys_', 0 if the table
+  /// does not keep them.
+  const int inline_key_words_;
+
   /// Data pages for all nodes. These are always pinned.
   std::vector<BufferedBlockMgr::Block*> data_pages_;
 
@@ -666,6 +789,14 @@ class HashTable {
   /// control memory footprint.
   Bucket* buckets_;
 
+  /// Tag of each bucket in 'buckets_', NULL if 'use_tags_' is false. Owned by this node.
+  uint8_t* tags_;
+
+  /// Inline key (see HashTableCtx::InlineKey()) of the entries of each bucket in
+  /// 'buckets_', 'inline_key_words_' words per bucket. NULL if 'inline_key_words_' is 0.
+  /// Only valid for filled buckets. Owned by this node.
+  uint64_t* inline_keys_;
+
   /// Total number of buckets (filled and empty).
   int64_t num_buckets_;
 
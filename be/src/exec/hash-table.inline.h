@@ -20,6 +20,7 @@
 
 #include "exprs/expr.h"
 #include "exprs/expr-context.h"
+#include "runtime/row-batch.h"
 
 namespace impala {
 
@@ -37,30 +38,99 @@ inline bool HashTableCtx::EvalAndHashProbe(TupleRow* row, uint32_t* hash) {
   return true;
 }
 
+inline void HashTableCtx::EvalBuild(TupleRow* row) {
+  EvalBuildRow(row);
+}
+
+inline void HashTableCtx::EvalProbe(TupleRow* row) {
+  EvalProbeRow(row);
+}
+
+inline void HashTableCtx::InlineKey(uint64_t* key) const {
+  DCHECK_GT(inline_key_words_, 0);
+  // The null bits follow the values and the rest of the last word is zero. Null values
+  // have a constant in the results buffer, which the null bits tell apart from the same
+  // non-null value.
+  key[inline_key_words_ - 1] = 0;
+  uint8_t* key_bytes = reinterpret_cast<uint8_t*>(key);
+  memcpy(key_bytes, expr_values_buffer_, results_buffer_size_);
+  if (stores_nulls_) {
+    memcpy(key_bytes + results_buffer_size_, expr_value_null_bits_,
+        build_expr_ctxs_.size());
+  }
+}
+
+template <bool BUILD_ROWS>
+inline void HashTableCtx::EvalAndHashBatch(RowBatch* batch) {
+  const int num_rows = batch->num_rows();
+  if (UNLIKELY(batch_hashes_.size() < num_rows)) {
+    batch_hashes_.resize(batch->capacity());
+    batch_rows_valid_.resize(batch->capacity());
+  }
+  for (int i = 0; i < num_rows; ++i) {
+    TupleRow* row = batch->GetRow(i);
+    batch_rows_valid_[i] = BUILD_ROWS ? EvalAndHashBuild(row, &batch_hashes_[i]) :
+        EvalAndHashProbe(row, &batch_hashes_[i]);
+  }
+}
+
+inline bool HashTable::InlineKeyEquals(int64_t bucket_idx, const uint64_t* key) const {
+  const uint64_t* bucket_key = &inline_keys_[bucket_idx * inline_key_words_];
+  // Keys of up to 16 bytes, the most common ones, are compared without a loop.
+  if (inline_key_words_ == 1) return bucket_key[0] == key[0];
+  if (inline_key_words_ == 2) {
+    return ((bucket_key[0] ^ key[0]) | (bucket_key[1] ^ key[1])) == 0;
+  }
+  return memcmp(bucket_key, key, inline_key_words_ * sizeof(uint64_t)) == 0;
+}
+
 template <bool FORCE_NULL_EQUALITY>
-inline int64_t HashTable::Probe(Bucket* buckets, int64_t num_buckets,
+inline int64_t HashTable::Probe(Bucket* buckets, uint8_t* tags, int64_t num_buckets,
     HashTableCtx* ht_ctx, uint32_t hash, bool* found) {
   DCHECK(buckets != NULL);
   DCHECK_GT(num_buckets, 0);
   *found = false;
   int64_t bucket_idx = hash & (num_buckets - 1);
+  const uint8_t tag = HashTag(hash);
+  // With inline keys, comparing them replaces Equals(). If there are tags as well, the
+  // bucket itself is not read at all.
+  const bool compare_inline_keys = ht_ctx != NULL && inline_keys_ != NULL;
+  uint64_t inline_key[HashTableCtx::MAX_INLINE_KEY_WORDS];
+  if (compare_inline_keys) {
+    DCHECK_EQ(ht_ctx->inline_key_words(), inline_key_words_);
+    ht_ctx->InlineKey(inline_key);
+  }
 
   // In case of linear probing it counts the total number of steps for statistics and
   // for knowing when to exit the loop (e.g. by capping the total travel length). In case
   // of quadratic probing it is also used for calculating the length of the next jump.
   int64_t step = 0;
   do {
-    Bucket* bucket = &buckets[bucket_idx];
-    if (!bucket->filled) return bucket_idx;
-    if (hash == bucket->hash) {
-      if (ht_ctx != NULL &&
-          ht_ctx->Equals<FORCE_NULL_EQUALITY>(GetRow(bucket, ht_ctx->row_))) {
+    // With tags, only look at the bucket if its tag matches.
+    if (tags != NULL && compare_inline_keys && tags[bucket_idx] == tag) {
+      // The bucket is filled, the key alone decides whether it matches.
+      DCHECK_EQ(buckets, buckets_);
+      if (InlineKeyEquals(bucket_idx, inline_key)) {
         *found = true;
         return bucket_idx;
       }
-      // Row equality failed, or not performed. This is a hash collision. Continue
-      // searching.
       ++num_hash_collisions_;
+    } else if (tags == NULL || tags[bucket_idx] == tag) {
+      Bucket* bucket = &buckets[bucket_idx];
+      if (!bucket->filled) return bucket_idx;
+      if (hash == bucket->hash) {
+        if (ht_ctx != NULL && (compare_inline_keys ?
+            InlineKeyEquals(bucket_idx, inline_key) :
+            ht_ctx->Equals<FORCE_NULL_EQUALITY>(GetRow(bucket, ht_ctx->row_)))) {
+          *found = true;
+          return bucket_idx;
+        }
+        // Row equality failed, or not performed. This is a hash collision. Continue
+        // searching.
+        ++num_hash_collisions_;
+      }
+    } else if (tags[bucket_idx] == EMPTY_TAG) {
+      return bucket_idx;
     }
     // Move to the next bucket.
     ++step;
@@ -83,7 +153,7 @@ inline HashTable::HtData* HashTable::InsertInternal(HashTableCtx* ht_ctx,
     uint32_t hash) {
   ++num_probes_;
   bool found = false;
-  int64_t bucket_idx = Probe<true>(buckets_, num_buckets_, ht_ctx, hash, &found);
+  int64_t bucket_idx = Probe<true>(buckets_, tags_, num_buckets_, ht_ctx, hash, &found);
   DCHECK_NE(bucket_idx, Iterator::BUCKET_NOT_FOUND);
   if (found) {
     // We need to insert a duplicate node, note that this may fail to allocate memory.
@@ -92,6 +162,9 @@ inline HashTable::HtData* HashTable::InsertInternal(HashTableCtx* ht_ctx,
     return &new_node->htdata;
   } else {
     PrepareBucketForInsert(bucket_idx, hash);
+    if (inline_keys_ != NULL) {
+      ht_ctx->InlineKey(&inline_keys_[bucket_idx * inline_key_words_]);
+    }
     return &buckets_[bucket_idx].bucketData.htdata;
   }
 }
@@ -122,7 +195,7 @@ inline bool HashTable::Insert(HashTableCtx* ht_ctx, Tuple* tuple, uint32_t hash)
 inline HashTable::Iterator HashTable::FindProbeRow(HashTableCtx* ht_ctx, uint32_t hash) {
   ++num_probes_;
   bool found = false;
-  int64_t bucket_idx = Probe<false>(buckets_, num_buckets_, ht_ctx, hash, &found);
+  int64_t bucket_idx = Probe<false>(buckets_, tags_, num_buckets_, ht_ctx, hash, &found);
   if (found) {
     return Iterator(this, ht_ctx->row(), bucket_idx,
         buckets_[bucket_idx].bucketData.duplicates);
@@ -130,10 +203,25 @@ inline HashTable::Iterator HashTable::FindProbeRow(HashTableCtx* ht_ctx, uint32_
   return End();
 }
 
+template <bool FOR_WRITE>
+inline void HashTable::PrefetchBucket(uint32_t hash) {
+  DCHECK(buckets_ != NULL);
+  const int64_t bucket_idx = hash & (num_buckets_ - 1);
+  // Prefetch into all cache levels.
+  if (tags_ != NULL) __builtin_prefetch(&tags_[bucket_idx], FOR_WRITE, 3);
+  __builtin_prefetch(&buckets_[bucket_idx], FOR_WRITE, 3);
+}
+
 inline HashTable::Iterator HashTable::FindBuildRowBucket(
     HashTableCtx* ht_ctx, uint32_t hash, bool* found) {
   ++num_probes_;
-  int64_t bucket_idx = Probe<true>(buckets_, num_buckets_, ht_ctx, hash, found);
+  int64_t bucket_idx = Probe<true>(buckets_, tags_, num_buckets_, ht_ctx, hash, found);
+  // Store the key of an empty bucket now, Iterator::SetTuple() fills it without
+  // 'ht_ctx'. Until then the key is not read.
+  if (inline_keys_ != NULL && !*found &&
+      LIKELY(bucket_idx != Iterator::BUCKET_NOT_FOUND)) {
+    ht_ctx->InlineKey(&inline_keys_[bucket_idx * inline_key_words_]);
+  }
   DuplicateNode* duplicates = LIKELY(bucket_idx != Iterator::BUCKET_NOT_FOUND) ?
       buckets_[bucket_idx].bucketData.duplicates : NULL;
   return Iterator(this, ht_ctx->row(), bucket_idx, duplicates);
@@ -164,7 +252,10 @@ inline HashTable::Iterator HashTable::FirstUnmatched(HashTableCtx* ctx) {
 inline void HashTable::NextFilledBucket(int64_t* bucket_idx, DuplicateNode** node) {
   ++*bucket_idx;
   for (; *bucket_idx < num_buckets_; ++*bucket_idx) {
-    if (buckets_[*bucket_idx].filled) {
+    // The tags are denser than the buckets, prefer them for skipping empty buckets.
+    bool filled = tags_ != NULL ?
+        tags_[*bucket_idx] != EMPTY_TAG : buckets_[*bucket_idx].filled;
+    if (filled) {
       *node = buckets_[*bucket_idx].bucketData.duplicates;
       return;
     }
@@ -184,6 +275,7 @@ inline void HashTable::PrepareBucketForInsert(int64_t bucket_idx, uint32_t hash)
   bucket->matched = false;
   bucket->hasDuplicates = false;
   bucket->hash = hash;
+  if (tags_ != NULL) tags_[bucket_idx] = HashTag(hash);
 }
 
 inline HashTable::DuplicateNode* HashTable::AppendNextNode(Bucket* bucket) {
@@ -354,7 +446,7 @@ inline void HashTableCtx::set_level(int level) {
 }
 
 inline int64_t HashTable::CurrentMemSize() const {
-  return num_buckets_ * sizeof(Bucket) + num_duplicate_nodes_ * sizeof(DuplicateNode);
+  return BucketsByteSize(num_buckets_) + num_duplicate_nodes_ * sizeof(DuplicateNode);
 }
 
 inline int64_t HashTable::NumInsertsBeforeResize() const {
@@ -16,7 +16,10 @@
 
 #include <algorithm>
 #include <boost/foreach.hpp>
+#include <gflags/gflags.h>
 
+#include "exprs/expr.h"
+#include "exprs/expr-context.h"
 #include "runtime/runtime-state.h"
 #include "runtime/row-batch.h"
 #include "runtime/string-value.h"
@@ -31,6 +34,12 @@
 #include "common/names.h"
 using namespace impala;
 
+DEFINE_int32(max_hbase_scanner_threads, 4, "(Advanced) The maximum number of threads "
+    "an HBase scan node uses to scan its regions concurrently. If 1, the regions are "
+    "scanned one after the other by the fragment's thread.");
+
+DECLARE_int32(max_row_batches);
+
 HBaseScanNode::HBaseScanNode(ObjectPool* pool, const TPlanNode& tnode,
                              const DescriptorTbl& descs)
     : ScanNode(pool, tnode, descs),
@@ -41,6 +50,9 @@ HBaseScanNode::HBaseScanNode(ObjectPool* pool, const TPlanNode& tnode,
       filters_(tnode.hbase_scan_node.filters),
       num_errors_(0),
       hbase_scanner_(NULL),
+      next_scan_range_idx_(0),
+      num_active_scanner_threads_(0),
+      done_(false),
       row_key_slot_(NULL),
       row_key_binary_encoded_(false),
       text_converter_(new TextConverter('\\', "", false)),
@@ -57,8 +69,6 @@ Status HBaseScanNode::Prepare(RuntimeState* state) {
   RETURN_IF_ERROR(ScanNode::Prepare(state));
   read_timer_ = ADD_TIMER(runtime_profile(), TOTAL_HBASE_READ_TIMER);
 
-  hbase_scanner_.reset(new HBaseTableScanner(this, state->htable_factory(), state));
-
   tuple_desc_ = state->desc_tbl().GetTupleDescriptor(tuple_id_);
   if (tuple_desc_ == NULL) {
     // TODO: make sure we print all available diagnostic output to our error log
@@ -109,6 +119,9 @@ Status HBaseScanNode::Prepare(RuntimeState* state) {
       sr.set_stop_key(key_range.stopKey);
     }
   }
+  if (scan_range_vector_.size() <= 1 || FLAGS_max_hbase_scanner_threads <= 1) {
+    hbase_scanner_.reset(new HBaseTableScanner(this, state->htable_factory(), state));
+  }
   return Status::OK();
 }
 
@@ -117,18 +130,37 @@ Status HBaseScanNode::Open(RuntimeState* state) {
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   JNIEnv* env = getJNIEnv();
 
   // No need to initialize hbase_scanner_ if there are no scan ranges.
   if (scan_range_vector_.size() == 0) return Status::OK();
-  return hbase_scanner_->StartScan(env, tuple_desc_, scan_range_vector_, filters_);
+  if (hbase_scanner_.get() != NULL) {
+    return hbase_scanner_->StartScan(env, tuple_desc_, scan_range_vector_, filters_);
+  }
+
+  int num_threads = min<int>(FLAGS_max_hbase_scanner_threads, scan_range_vector_.size());
+  int max_batches =
+      FLAGS_max_row_batches > 0 ? FLAGS_max_row_batches : 2 * num_threads;
+  materialized_row_batches_.reset(new RowBatchQueue(max_batches));
+  RuntimeProfile::Counter* num_threads_started_counter =
+      ADD_COUNTER(runtime_profile(), NUM_SCANNER_THREADS_STARTED, TUnit::UNIT);
+  num_active_scanner_threads_ = num_threads;
+  for (int i = 0; i < num_threads; ++i) {
+    stringstream ss;
+    ss << "scanner-thread(" << i << ")";
+    scanner_threads_.AddThread(new Thread("hbase-scan-node", ss.str(),
+        &HBaseScanNode::ScannerThread, this, state));
+    COUNTER_ADD(num_threads_started_counter, 1);
+  }
+  return Status::OK();
 }
 
 void HBaseScanNode::WriteTextSlot(
     const string& family, const string& qualifier,
     void* value, int value_length, SlotDescriptor* slot,
-    RuntimeState* state, MemPool* pool, bool* error_in_row) {
-  if (!text_converter_->WriteSlot(slot, tuple_,
+    RuntimeState* state, MemPool* pool, Tuple* tuple, bool* error_in_row) {
+  if (!text_converter_->WriteSlot(slot, tuple,
       reinterpret_cast<char*>(value), value_length, true, false, pool)) {
     *error_in_row = true;
     if (state->LogHasSpace()) {
@@ -150,6 +182,7 @@ Status HBaseScanNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eo
   // but there's still some considerable time inside here.
   // TODO: need to understand how the time is spent inside this function.
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   SCOPED_THREAD_COUNTER_MEASUREMENT(scanner_thread_counters());
 
   if (scan_range_vector_.empty() || ReachedLimit()) {
@@ -158,39 +191,76 @@ Status HBaseScanNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eo
   }
   *eos = false;
 
+  if (materialized_row_batches_.get() != NULL) {
+    RowBatch* materialized_batch = materialized_row_batches_->GetBatch();
+    if (materialized_batch == NULL) {
+      // The queue was shut down either because all scan ranges are complete or a
+      // scanner thread encountered an error.
+      *eos = true;
+      lock_guard<mutex> l(lock_);
+      return status_;
+    }
+    row_batch->AcquireState(materialized_batch);
+    delete materialized_batch;
+    // The scanner threads don't know about the limit, so they may have materialized
+    // more rows than necessary.
+    num_rows_returned_ += row_batch->num_rows();
+    if (ReachedLimit()) {
+      int num_rows_over = num_rows_returned_ - limit_;
+      row_batch->set_num_rows(row_batch->num_rows() - num_rows_over);
+      num_rows_returned_ -= num_rows_over;
+      *eos = true;
+      SetDone(Status::OK());
+    }
+    COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+    return Status::OK();
+  }
+
+  int num_rows_before = row_batch->num_rows();
+  Status status = MaterializeBatch(state, getJNIEnv(), hbase_scanner_.get(),
+      conjunct_ctxs_, limit_ == -1 ? -1 : limit_ - num_rows_returned_, row_batch, eos);
+  num_rows_returned_ += row_batch->num_rows() - num_rows_before;
+  COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+  RETURN_IF_ERROR(status);
+  if (*eos && num_errors_ > 0) {
+    const HBaseTableDescriptor* hbase_table =
+        static_cast<const HBaseTableDescriptor*> (tuple_desc_->table_desc());
+    state->ReportFileErrors(hbase_table->table_name(), num_errors_);
+  }
+  if (ReachedLimit()) *eos = true;
+  return Status::OK();
+}
+
+Status HBaseScanNode::MaterializeBatch(RuntimeState* state, JNIEnv* env,
+    HBaseTableScanner* scanner, const vector<ExprContext*>& conjunct_ctxs,
+    int64_t max_rows, RowBatch* row_batch, bool* eos) {
+  *eos = false;
   // Create new tuple buffer for row_batch.
-  tuple_buffer_size_ = row_batch->MaxTupleBufferSize();
-  tuple_ = Tuple::Create(tuple_buffer_size_, row_batch->tuple_data_pool());
+  Tuple* tuple = Tuple::Create(row_batch->MaxTupleBufferSize(),
+      row_batch->tuple_data_pool());
 
   // Indicates whether the current row has conversion errors. Used for error reporting.
   bool error_in_row = false;
 
-  // Indicates whether there are more rows to process. Set in hbase_scanner_.Next().
-  JNIEnv* env = getJNIEnv();
+  // Indicates whether there are more rows to process. Set in scanner->Next().
   bool has_next = false;
+  int64_t num_rows = 0;
   while (true) {
     RETURN_IF_CANCELLED(state);
-    RETURN_IF_ERROR(QueryMaintenance(state));
-    if (ReachedLimit() || row_batch->AtCapacity()) {
+    if (num_rows == max_rows || row_batch->AtCapacity() || done_) {
       // hang on to last allocated chunk in pool, we'll keep writing into it in the
       // next GetNext() call
-      *eos = ReachedLimit();
       return Status::OK();
     }
-    RETURN_IF_ERROR(hbase_scanner_->Next(env, &has_next));
+    RETURN_IF_ERROR(scanner->Next(env, &has_next));
     if (!has_next) {
-      if (num_errors_ > 0) {
-        const HBaseTableDescriptor* hbase_table =
-            static_cast<const HBaseTableDescriptor*> (tuple_desc_->table_desc());
-        state->ReportFileErrors(hbase_table->table_name(), num_errors_);
-      }
       *eos = true;
       return Status::OK();
     }
 
     int row_idx = row_batch->AddRow();
     TupleRow* row = row_batch->GetRow(row_idx);
-    row->SetTuple(tuple_idx_, tuple_);
+    row->SetTuple(tuple_idx_, tuple);
 
     {
       // Measure row key and column value materialization time
@@ -199,32 +269,32 @@ Status HBaseScanNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eo
       // Write row key slot.
       if (row_key_slot_ != NULL) {
         if (row_key_binary_encoded_) {
-          RETURN_IF_ERROR(hbase_scanner_->GetRowKey(env, row_key_slot_, tuple_));
+          RETURN_IF_ERROR(scanner->GetRowKey(env, row_key_slot_, tuple));
         } else {
           void* key;
           int key_length;
-          RETURN_IF_ERROR(hbase_scanner_->GetRowKey(env, &key, &key_length));
+          RETURN_IF_ERROR(scanner->GetRowKey(env, &key, &key_length));
           WriteTextSlot("key", "", key, key_length, row_key_slot_, state,
-              row_batch->tuple_data_pool(), &error_in_row);
+              row_batch->tuple_data_pool(), tuple, &error_in_row);
         }
       }
 
       // Write non-key slots.
       for (int i = 0; i < sorted_non_key_slots_.size(); ++i) {
         if (sorted_cols_[i]->binary_encoded) {
-          RETURN_IF_ERROR(hbase_scanner_->GetValue(env, sorted_cols_[i]->family,
-              sorted_cols_[i]->qualifier, sorted_non_key_slots_[i], tuple_));
+          RETURN_IF_ERROR(scanner->GetValue(env, sorted_cols_[i]->family,
+              sorted_cols_[i]->qualifier, sorted_non_key_slots_[i], tuple));
         } else {
           void* value;
           int value_length;
-          RETURN_IF_ERROR(hbase_scanner_->GetValue(env, sorted_cols_[i]->family,
+          RETURN_IF_ERROR(scanner->GetValue(env, sorted_cols_[i]->family,
               sorted_cols_[i]->qualifier, &value, &value_length));
           if (value == NULL) {
-            tuple_->SetNull(sorted_non_key_slots_[i]->null_indicator_offset());
+            tuple->SetNull(sorted_non_key_slots_[i]->null_indicator_offset());
           } else {
             WriteTextSlot(sorted_cols_[i]->family, sorted_cols_[i]->qualifier,
                 value, value_length, sorted_non_key_slots_[i], state,
-                row_batch->tuple_data_pool(), &error_in_row);
+                row_batch->tuple_data_pool(), tuple, &error_in_row);
           }
         }
       }
@@ -239,7 +309,7 @@ Status HBaseScanNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eo
         ss << "hbase table: " << table_name_ << endl;
         void* key;
         int key_length;
-        hbase_scanner_->GetRowKey(env, &key, &key_length);
+        scanner->GetRowKey(env, &key, &key_length);
         ss << "row key: " << string(reinterpret_cast<const char*>(key), key_length);
         state->LogError(ErrorMsg(TErrorCode::GENERAL, ss.str()));
       }
@@ -249,17 +319,16 @@ Status HBaseScanNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eo
       }
     }
 
-    if (EvalConjuncts(&conjunct_ctxs_[0], conjunct_ctxs_.size(), row)) {
+    if (EvalConjuncts(&conjunct_ctxs[0], conjunct_ctxs.size(), row)) {
       row_batch->CommitLastRow();
-      ++num_rows_returned_;
-      COUNTER_SET(rows_returned_counter_, num_rows_returned_);
-      char* new_tuple = reinterpret_cast<char*>(tuple_);
+      ++num_rows;
+      char* new_tuple = reinterpret_cast<char*>(tuple);
       new_tuple += tuple_desc_->byte_size();
-      tuple_ = reinterpret_cast<Tuple*>(new_tuple);
+      tuple = reinterpret_cast<Tuple*>(new_tuple);
     } else {
       // make sure to reset null indicators since we're overwriting
       // the tuple assembled for the previous row
-      tuple_->Init(tuple_desc_->byte_size());
+      tuple->Init(tuple_desc_->byte_size());
     }
     COUNTER_ADD(rows_read_counter_, 1);
   }
@@ -267,6 +336,59 @@ Status HBaseScanNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eo
   return Status::OK();
 }
 
+void HBaseScanNode::ScannerThread(RuntimeState* state) {
+  SCOPED_THREAD_COUNTER_MEASUREMENT(scanner_thread_counters());
+  SCOPED_TIMER(state->total_cpu_timer());
+  JNIEnv* env = getJNIEnv();
+  // Expr contexts are not thread-safe, so every thread evaluates its own clones.
+  vector<ExprContext*> conjunct_ctxs;
+  Status status = Expr::CloneIfNotExists(conjunct_ctxs_, state, &conjunct_ctxs);
+  while (status.ok() && !done_) {
+    int range_idx = next_scan_range_idx_.FetchAndUpdate(1);
+    if (range_idx >= scan_range_vector_.size()) break;
+    status = ScanRegion(state, env, conjunct_ctxs, range_idx);
+  }
+  Expr::Close(conjunct_ctxs, state);
+  if (!status.ok()) {
+    if (status.IsMemLimitExceeded()) state->SetMemLimitExceeded();
+    SetDone(status);
+  }
+  if (num_active_scanner_threads_.UpdateAndFetch(-1) == 0) {
+    materialized_row_batches_->Shutdown();
+  }
+}
+
+Status HBaseScanNode::ScanRegion(RuntimeState* state, JNIEnv* env,
+    const vector<ExprContext*>& conjunct_ctxs, int range_idx) {
+  HBaseTableScanner scanner(this, state->htable_factory(), state);
+  // Must outlive the scan, see HBaseTableScanner::StartScan().
+  HBaseTableScanner::ScanRangeVector scan_range(1, scan_range_vector_[range_idx]);
+  Status status = scanner.StartScan(env, tuple_desc_, scan_range, filters_);
+  bool eos = !status.ok();
+  while (!eos && !done_) {
+    RowBatch* batch = new RowBatch(row_desc(), state->batch_size(), mem_tracker());
+    status = MaterializeBatch(state, env, &scanner, conjunct_ctxs, -1, batch, &eos);
+    ExprContext::FreeLocalAllocations(conjunct_ctxs);
+    if (!status.ok() || batch->num_rows() == 0) {
+      delete batch;
+      if (!status.ok()) break;
+      continue;
+    }
+    materialized_row_batches_->AddBatch(batch);
+  }
+  scanner.Close(env);
+  return status;
+}
+
+void HBaseScanNode::SetDone(const Status& status) {
+  {
+    lock_guard<mutex> l(lock_);
+    if (status_.ok()) status_ = status;
+    done_ = true;
+  }
+  if (materialized_row_batches_.get() != NULL) materialized_row_batches_->Shutdown();
+}
+
 Status HBaseScanNode::Reset(RuntimeState* state) {
   DCHECK(false) << "NYI";
   return Status("NYI");
@@ -278,6 +400,11 @@ void HBaseScanNode::Close(RuntimeState* state) {
   PeriodicCounterUpdater::StopRateCounter(total_throughput_counter());
   PeriodicCounterUpdater::StopTimeSeriesCounter(bytes_read_timeseries_counter_);
 
+  if (materialized_row_batches_.get() != NULL) {
+    SetDone(Status::OK());
+    scanner_threads_.JoinAll();
+    materialized_row_batches_->Cleanup();
+  }
   if (hbase_scanner_.get() != NULL) {
     JNIEnv* env = getJNIEnv();
     hbase_scanner_->Close(env);
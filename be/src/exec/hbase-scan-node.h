@@ -17,15 +17,23 @@
 #define IMPALA_EXEC_HBASE_SCAN_NODE_H_
 
 #include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include "common/atomic.h"
 #include "runtime/descriptors.h"
 #include "exec/hbase-table-scanner.h"
 #include "exec/scan-node.h"
+#include "util/thread.h"
 
 namespace impala {
 
 class TextConverter;
 class Tuple;
 
+/// Scans the regions of an HBase table. If the node has several scan ranges (one per
+/// region), up to --max_hbase_scanner_threads scanner threads scan them concurrently,
+/// each one range at a time with its own HBaseTableScanner, and queue the row batches
+/// they materialize for GetNext(). Otherwise, the ranges are scanned by GetNext() of the
+/// fragment's thread with hbase_scanner_.
 class HBaseScanNode : public ScanNode {
  public:
   HBaseScanNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs);
@@ -36,17 +44,18 @@ class HBaseScanNode : public ScanNode {
   /// initialize hbase_scanner_, and create text_converter_.
   virtual Status Prepare(RuntimeState* state);
 
-  /// Start HBase scan using hbase_scanner_.
+  /// Start HBase scan using hbase_scanner_, or start the scanner threads.
   virtual Status Open(RuntimeState* state);
 
   /// Fill the next row batch by calling Next() on the hbase_scanner_,
-  /// converting text data in HBase cells to binary data.
+  /// converting text data in HBase cells to binary data. If there are scanner threads,
+  /// returns the next batch they materialized instead.
   virtual Status GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos);
 
   /// NYI
   virtual Status Reset(RuntimeState* state);
 
-  /// Close the hbase_scanner_, and report errors.
+  /// Stop the scanner threads, close the hbase_scanner_, and report errors.
   virtual void Close(RuntimeState* state);
 
   const int suggested_max_caching() const { return suggested_max_caching_; }
@@ -82,11 +91,35 @@ class HBaseScanNode : public ScanNode {
   std::vector<THBaseFilter> filters_;
 
   /// Counts the total number of conversion errors for this table.
-  int num_errors_;
+  AtomicInt<int> num_errors_;
 
-  /// Jni helper for scanning an HBase table.
+  /// Jni helper for scanning an HBase table. Only used if there are no scanner threads.
   boost::scoped_ptr<HBaseTableScanner> hbase_scanner_;
 
+  /// Threads scanning the scan ranges concurrently. Empty if the ranges are scanned by
+  /// GetNext().
+  ThreadGroup scanner_threads_;
+
+  /// Index of the next scan range in scan_range_vector_ for a scanner thread to scan.
+  AtomicInt<int> next_scan_range_idx_;
+
+  /// Number of scanner threads that have not finished yet. The last one shuts down
+  /// materialized_row_batches_.
+  AtomicInt<int> num_active_scanner_threads_;
+
+  /// Row batches materialized by the scanner threads, returned by GetNext().
+  boost::scoped_ptr<RowBatchQueue> materialized_row_batches_;
+
+  /// Protects status_.
+  boost::mutex lock_;
+
+  /// The first error hit by a scanner thread, returned by GetNext().
+  Status status_;
+
+  /// Set when the scanner threads should stop, either because a scanner thread hit an
+  /// error, the limit was reached or the node is closed.
+  volatile bool done_;
+
   /// List of non-row-key slots sorted by col_pos(). Populated in Prepare().
   std::vector<SlotDescriptor*> sorted_non_key_slots_;
 
@@ -103,12 +136,6 @@ class HBaseScanNode : public ScanNode {
   /// True, if row key is binary encoded
   bool row_key_binary_encoded_;
 
-  /// Size of tuple buffer determined by size of tuples and capacity of row batches.
-  int tuple_buffer_size_;
-
-  /// Current tuple.
-  Tuple* tuple_;
-
   /// Helper class for converting text to other types;
   boost::scoped_ptr<TextConverter> text_converter_;
 
@@ -116,12 +143,32 @@ class HBaseScanNode : public ScanNode {
   /// will be 0.
   int suggested_max_caching_;
 
-  /// Writes a slot in tuple_ from an HBase value containing text data.
+  /// Writes a slot in tuple from an HBase value containing text data.
   /// The HBase value is converted into the appropriate target type.
   void WriteTextSlot(
       const std::string& family, const std::string& qualifier,
       void* value, int value_length, SlotDescriptor* slot,
-      RuntimeState* state, MemPool* pool, bool* error_in_row);
+      RuntimeState* state, MemPool* pool, Tuple* tuple, bool* error_in_row);
+
+  /// Adds the rows read from 'scanner' that pass 'conjunct_ctxs' to 'row_batch', until
+  /// it is at capacity, 'max_rows' rows were added (unless it is -1) or the scanner is
+  /// exhausted, in which case '*eos' is set to true.
+  Status MaterializeBatch(RuntimeState* state, JNIEnv* env, HBaseTableScanner* scanner,
+      const std::vector<ExprContext*>& conjunct_ctxs, int64_t max_rows,
+      RowBatch* row_batch, bool* eos);
+
+  /// Main function of the scanner threads. Scans scan ranges until there are none left
+  /// or done_ is set.
+  void ScannerThread(RuntimeState* state);
+
+  /// Scans scan_range_vector_[range_idx] with a new HBaseTableScanner and queues the
+  /// row batches in materialized_row_batches_.
+  Status ScanRegion(RuntimeState* state, JNIEnv* env,
+      const std::vector<ExprContext*>& conjunct_ctxs, int range_idx);
+
+  /// Sets done_ and shuts down materialized_row_batches_. If 'status' is not ok and no
+  /// error was recorded yet, it is recorded in status_.
+  void SetDone(const Status& status);
 };
 
 }
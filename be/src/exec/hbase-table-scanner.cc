@@ -31,8 +31,7 @@ using namespace impala;
 
 jclass HBaseTableScanner::scan_cl_ = NULL;
 jclass HBaseTableScanner::resultscanner_cl_ = NULL;
-jclass HBaseTableScanner::result_cl_ = NULL;
-jclass HBaseTableScanner::cell_cl_ = NULL;
+jclass HBaseTableScanner::result_batcher_cl_ = NULL;
 jclass HBaseTableScanner::hconstants_cl_ = NULL;
 jclass HBaseTableScanner::filter_list_cl_ = NULL;
 jclass HBaseTableScanner::filter_list_op_cl_ = NULL;
@@ -47,22 +46,9 @@ jmethodID HBaseTableScanner::scan_add_column_id_ = NULL;
 jmethodID HBaseTableScanner::scan_set_filter_id_ = NULL;
 jmethodID HBaseTableScanner::scan_set_start_row_id_ = NULL;
 jmethodID HBaseTableScanner::scan_set_stop_row_id_ = NULL;
-jmethodID HBaseTableScanner::resultscanner_next_id_ = NULL;
 jmethodID HBaseTableScanner::resultscanner_close_id_ = NULL;
-jmethodID HBaseTableScanner::result_isempty_id_ = NULL;
-jmethodID HBaseTableScanner::result_raw_cells_id_ = NULL;
-jmethodID HBaseTableScanner::cell_get_row_array_ = NULL;
-jmethodID HBaseTableScanner::cell_get_family_array_ = NULL;
-jmethodID HBaseTableScanner::cell_get_qualifier_array_ = NULL;
-jmethodID HBaseTableScanner::cell_get_value_array_ = NULL;
-jmethodID HBaseTableScanner::cell_get_family_offset_id_ = NULL;
-jmethodID HBaseTableScanner::cell_get_family_length_id_ = NULL;
-jmethodID HBaseTableScanner::cell_get_qualifier_offset_id_ = NULL;
-jmethodID HBaseTableScanner::cell_get_qualifier_length_id_ = NULL;
-jmethodID HBaseTableScanner::cell_get_row_offset_id_ = NULL;
-jmethodID HBaseTableScanner::cell_get_row_length_id_ = NULL;
-jmethodID HBaseTableScanner::cell_get_value_offset_id_ = NULL;
-jmethodID HBaseTableScanner::cell_get_value_length_id_ = NULL;
+jmethodID HBaseTableScanner::result_batcher_ctor_ = NULL;
+jmethodID HBaseTableScanner::result_batcher_fill_id_ = NULL;
 jmethodID HBaseTableScanner::filter_list_ctor_ = NULL;
 jmethodID HBaseTableScanner::filter_list_add_filter_id_ = NULL;
 jmethodID HBaseTableScanner::single_column_value_filter_ctor_ = NULL;
@@ -89,11 +75,17 @@ HBaseTableScanner::HBaseTableScanner(
     htable_(NULL),
     scan_(NULL),
     resultscanner_(NULL),
-    cells_(NULL),
+    result_batcher_(NULL),
+    batch_buffer_(NULL),
+    batch_buffer_size_(0),
+    num_batch_rows_(0),
+    batch_row_idx_(0),
+    batch_pos_(NULL),
+    row_key_(NULL),
+    row_key_length_(0),
     cell_index_(0),
     num_requested_cells_(0),
     num_addl_requested_cols_(0),
-    num_cells_(0),
     all_cells_present_(false),
     value_pool_(new MemPool(scan_node_->mem_tracker())),
     scan_setup_timer_(ADD_TIMER(scan_node_->runtime_profile(),
@@ -118,15 +110,15 @@ Status HBaseTableScanner::Init() {
   }
 
   // Global class references:
-  // HTable, Scan, ResultScanner, Result, ImmutableBytesWritable, HConstants.
+  // Scan, ResultScanner, HBaseResultBatcher, HConstants.
   RETURN_IF_ERROR(
       JniUtil::GetGlobalClassRef(env, "org/apache/hadoop/hbase/client/Scan", &scan_cl_));
   RETURN_IF_ERROR(
       JniUtil::GetGlobalClassRef(env, "org/apache/hadoop/hbase/client/ResultScanner",
           &resultscanner_cl_));
   RETURN_IF_ERROR(
-      JniUtil::GetGlobalClassRef(env, "org/apache/hadoop/hbase/client/Result",
-          &result_cl_));
+      JniUtil::GetGlobalClassRef(env, "com/cloudera/impala/util/HBaseResultBatcher",
+          &result_batcher_cl_));
   RETURN_IF_ERROR(
       JniUtil::GetGlobalClassRef(env, "org/apache/hadoop/hbase/HConstants",
           &hconstants_cl_));
@@ -149,22 +141,6 @@ Status HBaseTableScanner::Init() {
           "org/apache/hadoop/hbase/client/ScannerTimeoutException",
           &scanner_timeout_ex_cl_));
 
-  // Distinguish HBase versions by checking for the existence of the Cell class.
-  // HBase 0.95.2: Use Cell class and corresponding methods.
-  // HBase prior to 0.95.2: Use the KeyValue class and Cell-equivalent methods.
-  bool has_cell_class = JniUtil::ClassExists(env, "org/apache/hadoop/hbase/Cell");
-  if (has_cell_class) {
-    LOG(INFO) << "Detected HBase version >= 0.95.2";
-    RETURN_IF_ERROR(
-        JniUtil::GetGlobalClassRef(env, "org/apache/hadoop/hbase/Cell", &cell_cl_));
-  } else {
-    // Assume a non-CDH5 HBase version because the Cell class wasn't found.
-    LOG(INFO) << "Detected HBase version < 0.95.2";
-    RETURN_IF_ERROR(
-        JniUtil::GetGlobalClassRef(env, "org/apache/hadoop/hbase/KeyValue",
-            &cell_cl_));
-  }
-
   // Scan method ids.
   scan_ctor_ = env->GetMethodID(scan_cl_, "<init>", "()V");
   RETURN_ERROR_IF_EXC(env);
@@ -189,62 +165,14 @@ Status HBaseTableScanner::Init() {
   RETURN_ERROR_IF_EXC(env);
 
   // ResultScanner method ids.
-  resultscanner_next_id_ = env->GetMethodID(resultscanner_cl_, "next",
-      "()Lorg/apache/hadoop/hbase/client/Result;");
-  RETURN_ERROR_IF_EXC(env);
   resultscanner_close_id_ = env->GetMethodID(resultscanner_cl_, "close", "()V");
   RETURN_ERROR_IF_EXC(env);
 
-  // Result method ids.
-  if (has_cell_class) {
-    result_raw_cells_id_ = env->GetMethodID(result_cl_, "rawCells",
-        "()[Lorg/apache/hadoop/hbase/Cell;");
-  } else {
-    result_raw_cells_id_ = env->GetMethodID(result_cl_, "raw",
-        "()[Lorg/apache/hadoop/hbase/KeyValue;");
-  }
-  RETURN_ERROR_IF_EXC(env);
-  result_isempty_id_ = env->GetMethodID(result_cl_, "isEmpty", "()Z");
-  RETURN_ERROR_IF_EXC(env);
-
-
-  // Cell or equivalent KeyValue method ids.
-  // Method ids to retrieve buffers backing different portions of row data.
-  if (has_cell_class) {
-    cell_get_row_array_ = env->GetMethodID(cell_cl_, "getRowArray", "()[B");
-    RETURN_ERROR_IF_EXC(env);
-    cell_get_family_array_ = env->GetMethodID(cell_cl_, "getFamilyArray", "()[B");
-    RETURN_ERROR_IF_EXC(env);
-    cell_get_qualifier_array_ = env->GetMethodID(cell_cl_, "getQualifierArray", "()[B");
-    RETURN_ERROR_IF_EXC(env);
-    cell_get_value_array_ = env->GetMethodID(cell_cl_, "getValueArray", "()[B");
-    RETURN_ERROR_IF_EXC(env);
-  } else {
-    // In HBase versions prior to 0.95.2 all data from a row is backed by the same buffer
-    cell_get_row_array_ = cell_get_family_array_ =
-        cell_get_qualifier_array_ = cell_get_value_array_ =
-        env->GetMethodID(cell_cl_, "getBuffer", "()[B");
-    RETURN_ERROR_IF_EXC(env);
-  }
-  // Method ids for retrieving lengths and offsets into buffers backing different
-  // portions of row data. Both the Cell and KeyValue classes support these methods.
-  cell_get_family_offset_id_ = env->GetMethodID(cell_cl_, "getFamilyOffset", "()I");
+  // HBaseResultBatcher method ids.
+  result_batcher_ctor_ = env->GetMethodID(result_batcher_cl_, "<init>",
+      "(Lorg/apache/hadoop/hbase/client/ResultScanner;)V");
   RETURN_ERROR_IF_EXC(env);
-  cell_get_family_length_id_ = env->GetMethodID(cell_cl_, "getFamilyLength", "()B");
-  RETURN_ERROR_IF_EXC(env);
-  cell_get_qualifier_offset_id_ =
-      env->GetMethodID(cell_cl_, "getQualifierOffset", "()I");
-  RETURN_ERROR_IF_EXC(env);
-  cell_get_qualifier_length_id_ =
-      env->GetMethodID(cell_cl_, "getQualifierLength", "()I");
-  RETURN_ERROR_IF_EXC(env);
-  cell_get_row_offset_id_ = env->GetMethodID(cell_cl_, "getRowOffset", "()I");
-  RETURN_ERROR_IF_EXC(env);
-  cell_get_row_length_id_ = env->GetMethodID(cell_cl_, "getRowLength", "()S");
-  RETURN_ERROR_IF_EXC(env);
-  cell_get_value_offset_id_ = env->GetMethodID(cell_cl_, "getValueOffset", "()I");
-  RETURN_ERROR_IF_EXC(env);
-  cell_get_value_length_id_ = env->GetMethodID(cell_cl_, "getValueLength", "()I");
+  result_batcher_fill_id_ = env->GetMethodID(result_batcher_cl_, "fill", "(JII)I");
   RETURN_ERROR_IF_EXC(env);
 
   // HConstants fields.
@@ -413,18 +341,16 @@ Status HBaseTableScanner::HandleResultScannerTimeout(JNIEnv* env, bool* timeout)
 
   *timeout = true;
   const ScanRange& scan_range = (*scan_range_vector_)[current_scan_range_idx_];
-  // If cells_ is NULL, then the ResultScanner timed out before it was ever used
-  // so we can just re-create the ResultScanner with the same scan_range
-  if (cells_ == NULL) return InitScanRange(env, scan_range);
+  // If no row of this range was returned yet, then we can just re-create the
+  // ResultScanner with the same scan_range
+  if (last_row_key_.empty()) return InitScanRange(env, scan_range);
 
   JniLocalFrame jni_frame;
   RETURN_IF_ERROR(jni_frame.push(env));
-  DCHECK_LT(cell_index_, num_cells_);
-  jobject cell = env->GetObjectArrayElement(cells_, cell_index_);
-  // Specifically set the start_bytes to the next row since some of them were already
-  // read
-  jbyteArray start_bytes =
-    (jbyteArray) env->CallObjectMethod(cell, cell_get_row_array_);
+  // Specifically set the start_bytes to the row right after the last one returned,
+  // which is the smallest key greater than it.
+  jbyteArray start_bytes;
+  RETURN_IF_ERROR(CreateByteArray(env, last_row_key_ + '\0', &start_bytes));
   jbyteArray end_bytes;
   CreateByteArray(env, scan_range.stop_key(), &end_bytes);
   return InitScanRange(env, start_bytes, end_bytes);
@@ -454,13 +380,21 @@ Status HBaseTableScanner::InitScanRange(JNIEnv* env, jbyteArray start_bytes,
     // resultscanner_.close();
     env->CallObjectMethod(resultscanner_, resultscanner_close_id_);
     env->DeleteGlobalRef(resultscanner_);
+    env->DeleteGlobalRef(result_batcher_);
     RETURN_ERROR_IF_EXC(env);
     resultscanner_ = NULL;
+    result_batcher_ = NULL;
   }
   // resultscanner_ = htable_.getScanner(scan_);
   RETURN_IF_ERROR(htable_->GetResultScanner(scan_, &resultscanner_));
   resultscanner_ = env->NewGlobalRef(resultscanner_);
   RETURN_ERROR_IF_EXC(env);
+  // result_batcher_ = new HBaseResultBatcher(resultscanner_);
+  result_batcher_ =
+      env->NewObject(result_batcher_cl_, result_batcher_ctor_, resultscanner_);
+  RETURN_ERROR_IF_EXC(env);
+  result_batcher_ = env->NewGlobalRef(result_batcher_);
+  RETURN_ERROR_IF_EXC(env);
   return Status::OK();
 }
 
@@ -473,6 +407,17 @@ Status HBaseTableScanner::StartScan(JNIEnv* env, const TupleDescriptor* tuple_de
   // Record the ranges
   scan_range_vector_ = &scan_range_vector;
   current_scan_range_idx_ = 0;
+  last_row_key_.clear();
+
+  num_batch_rows_ = 0;
+  batch_row_idx_ = 0;
+  DCHECK(batch_buffer_ == NULL);
+  batch_buffer_ = value_pool_->TryAllocate(DEFAULT_BATCH_BUFFER_SIZE);
+  if (batch_buffer_ == NULL) {
+    return state_->SetMemLimitExceeded(scan_node_->mem_tracker(),
+        DEFAULT_BATCH_BUFFER_SIZE);
+  }
+  batch_buffer_size_ = DEFAULT_BATCH_BUFFER_SIZE;
 
   // Now, scan the first range (we should have at least one range). The
   // resultscanner_ is NULL and gets created in InitScanRange, so we don't
@@ -496,73 +441,108 @@ Status HBaseTableScanner::CreateByteArray(JNIEnv* env, const string& s,
   return Status::OK();
 }
 
-Status HBaseTableScanner::Next(JNIEnv* env, bool* has_next) {
-  JniLocalFrame jni_frame;
-  RETURN_IF_ERROR(jni_frame.push(env));
-  jobject result = NULL;
-  {
-    SCOPED_TIMER(scan_node_->read_timer());
-    while (true) {
-      DCHECK(resultscanner_ != NULL);
-      // result_ = resultscanner_.next();
-      result = env->CallObjectMethod(resultscanner_, resultscanner_next_id_);
-      // Normally we would check for a JNI exception via RETURN_ERROR_IF_EXC, but we
-      // need to also check for scanner timeouts and handle them specially, which is
-      // done by HandleResultScannerTimeout(). If a timeout occurred, then it will
-      // re-create the ResultScanner so we can try again.
-      bool timeout;
-      RETURN_IF_ERROR(HandleResultScannerTimeout(env, &timeout));
-      if (timeout) {
-        result = env->CallObjectMethod(resultscanner_, resultscanner_next_id_);
-        // There shouldn't be a timeout now, so we will just return any errors.
-        RETURN_ERROR_IF_EXC(env);
-      }
-      // jump to the next region when finished with the current region.
-      if (result == NULL && current_scan_range_idx_ + 1 < scan_range_vector_->size()) {
-        ++current_scan_range_idx_;
-        RETURN_IF_ERROR(InitScanRange(env,
-            (*scan_range_vector_)[current_scan_range_idx_]));
-        continue;
-      }
+inline int HBaseTableScanner::FillBatchBuffer(JNIEnv* env) {
+  // return result_batcher_.fill(batch_buffer_, batch_buffer_size_, batch_size);
+  return env->CallIntMethod(result_batcher_, result_batcher_fill_id_,
+      reinterpret_cast<jlong>(batch_buffer_), batch_buffer_size_, state_->batch_size());
+}
 
-      // Ignore empty rows
-      if (result != NULL &&
-          JNI_TRUE == env->CallBooleanMethod(result, result_isempty_id_)) {
-        continue;
+Status HBaseTableScanner::FetchBatch(JNIEnv* env) {
+  SCOPED_TIMER(scan_node_->read_timer());
+  // The rows of the previous batch are handed out, so a timed out ResultScanner must
+  // resume after the last one.
+  if (num_batch_rows_ > 0) last_row_key_.assign(row_key_, row_key_length_);
+  num_batch_rows_ = 0;
+  batch_row_idx_ = 0;
+  while (true) {
+    DCHECK(result_batcher_ != NULL);
+    int num_rows = FillBatchBuffer(env);
+    // Normally we would check for a JNI exception via RETURN_ERROR_IF_EXC, but we
+    // need to also check for scanner timeouts and handle them specially, which is
+    // done by HandleResultScannerTimeout(). If a timeout occurred, then it will
+    // re-create the ResultScanner so we can try again.
+    bool timeout;
+    RETURN_IF_ERROR(HandleResultScannerTimeout(env, &timeout));
+    if (timeout) {
+      num_rows = FillBatchBuffer(env);
+      // There shouldn't be a timeout now, so we will just return any errors.
+      RETURN_ERROR_IF_EXC(env);
+    }
+    if (num_rows < 0) {
+      // The next row alone is larger than the buffer, which only holds this scanner's
+      // rows, so it can be replaced by one that is large enough.
+      int new_size = max(batch_buffer_size_ * 2, -num_rows);
+      value_pool_->FreeAll();
+      batch_buffer_ = value_pool_->TryAllocate(new_size);
+      if (batch_buffer_ == NULL) {
+        batch_buffer_size_ = 0;
+        return state_->SetMemLimitExceeded(scan_node_->mem_tracker(), new_size);
       }
-      break;
+      batch_buffer_size_ = new_size;
+      continue;
+    }
+    // jump to the next region when finished with the current region.
+    if (num_rows == 0 && current_scan_range_idx_ + 1 < scan_range_vector_->size()) {
+      ++current_scan_range_idx_;
+      last_row_key_.clear();
+      RETURN_IF_ERROR(InitScanRange(env,
+          (*scan_range_vector_)[current_scan_range_idx_]));
+      continue;
     }
+    num_batch_rows_ = num_rows;
+    batch_pos_ = batch_buffer_;
+    return Status::OK();
   }
+}
 
-  if (result == NULL) {
-    *has_next = false;
-    return Status::OK();
+inline char* HBaseTableScanner::ReadBytes(int* length) {
+  *length = *reinterpret_cast<int32_t*>(batch_pos_);
+  char* data = reinterpret_cast<char*>(batch_pos_ + sizeof(int32_t));
+  batch_pos_ += sizeof(int32_t) + *length;
+  return data;
+}
+
+Status HBaseTableScanner::Next(JNIEnv* env, bool* has_next) {
+  if (batch_row_idx_ == num_batch_rows_) {
+    RETURN_IF_ERROR(FetchBatch(env));
+    if (num_batch_rows_ == 0) {
+      *has_next = false;
+      return Status::OK();
+    }
   }
+  ++batch_row_idx_;
+
+  // Decode the row at batch_pos_, see HBaseResultBatcher for its layout.
+  row_key_ = ReadBytes(&row_key_length_);
+  int num_cells = *reinterpret_cast<int32_t*>(batch_pos_);
+  batch_pos_ += sizeof(int32_t);
+  int64_t bytes_read = row_key_length_;
+  cells_.resize(num_cells);
+  for (int i = 0; i < num_cells; ++i) {
+    Cell* cell = &cells_[i];
+    cell->family = ReadBytes(&cell->family_length);
+    cell->qualifier = ReadBytes(&cell->qualifier_length);
+    cell->value = ReadBytes(&cell->value_length);
+    bytes_read += cell->family_length + cell->qualifier_length + cell->value_length;
+  }
+  COUNTER_ADD(scan_node_->bytes_read_counter(), bytes_read);
 
-  if (cells_ != NULL) env->DeleteGlobalRef(cells_);
-  // cells_ = result.raw();
-  cells_ = reinterpret_cast<jobjectArray>(
-      env->CallObjectMethod(result, result_raw_cells_id_));
-  cells_ = reinterpret_cast<jobjectArray>(env->NewGlobalRef(cells_));
-  num_cells_ = env->GetArrayLength(cells_);
-  // Check that raw() didn't return more cells than expected.
+  // Check that the row doesn't have more cells than expected.
   // If num_requested_cells_ is 0 then only row key is asked for and this check
   // should pass.
-  if (num_cells_ > num_requested_cells_ + num_addl_requested_cols_
+  if (num_cells > num_requested_cells_ + num_addl_requested_cols_
       && num_requested_cells_ + num_addl_requested_cols_ != 0) {
     *has_next = false;
     return Status("Encountered more cells than expected.");
   }
   // If all requested columns are present, and we didn't ask for any extra ones to work
-  // around an hbase bug, we avoid family-/qualifier comparisons in NextValue().
-  if (num_cells_ == num_requested_cells_ && num_addl_requested_cols_ == 0) {
+  // around an hbase bug, we avoid family-/qualifier comparisons in GetCurrentValue().
+  if (num_cells == num_requested_cells_ && num_addl_requested_cols_ == 0) {
     all_cells_present_ = true;
   } else {
     all_cells_present_ = false;
   }
   cell_index_ = 0;
-
-  value_pool_->Clear();
   *has_next = true;
   return Status::OK();
 }
@@ -573,108 +553,44 @@ inline void HBaseTableScanner::WriteTupleSlot(const SlotDescriptor* slot_desc,
   BitUtil::ByteSwap(slot, data, slot_desc->type().GetByteSize());
 }
 
-inline void HBaseTableScanner::GetRowKey(JNIEnv* env, jobject cell,
-    void** data, int* length) {
-  int offset = env->CallIntMethod(cell, cell_get_row_offset_id_);
-  *length = env->CallShortMethod(cell, cell_get_row_length_id_);
-  jbyteArray jdata =
-      (jbyteArray) env->CallObjectMethod(cell, cell_get_row_array_);
-  *data = value_pool_->Allocate(*length);
-  env->GetByteArrayRegion(jdata, offset, *length, reinterpret_cast<jbyte*>(*data));
-  COUNTER_ADD(scan_node_->bytes_read_counter(), *length);
-}
-
-inline void HBaseTableScanner::GetFamily(JNIEnv* env, jobject cell,
-    void** data, int* length) {
-  int offset = env->CallIntMethod(cell, cell_get_family_offset_id_);
-  *length = env->CallShortMethod(cell, cell_get_family_length_id_);
-  jbyteArray jdata =
-      (jbyteArray) env->CallObjectMethod(cell, cell_get_family_array_);
-  *data = value_pool_->Allocate(*length);
-  env->GetByteArrayRegion(jdata, offset, *length, reinterpret_cast<jbyte*>(*data));
-  COUNTER_ADD(scan_node_->bytes_read_counter(), *length);
-}
-
-inline void HBaseTableScanner::GetQualifier(JNIEnv* env, jobject cell,
-    void** data, int* length) {
-  int offset = env->CallIntMethod(cell, cell_get_qualifier_offset_id_);
-  *length = env->CallIntMethod(cell, cell_get_qualifier_length_id_);
-  jbyteArray jdata =
-      (jbyteArray) env->CallObjectMethod(cell, cell_get_qualifier_array_);
-  *data = value_pool_->Allocate(*length);
-  env->GetByteArrayRegion(jdata, offset, *length, reinterpret_cast<jbyte*>(*data));
-  COUNTER_ADD(scan_node_->bytes_read_counter(), *length);
-}
-
-inline void HBaseTableScanner::GetValue(JNIEnv* env, jobject cell,
-    void** data, int* length) {
-  int offset = env->CallIntMethod(cell, cell_get_value_offset_id_);
-  *length = env->CallIntMethod(cell, cell_get_value_length_id_);
-  jbyteArray jdata =
-      (jbyteArray) env->CallObjectMethod(cell, cell_get_value_array_);
-  *data = value_pool_->Allocate(*length);
-  env->GetByteArrayRegion(jdata, offset, *length, reinterpret_cast<jbyte*>(*data));
-  COUNTER_ADD(scan_node_->bytes_read_counter(), *length);
-}
-
 Status HBaseTableScanner::GetRowKey(JNIEnv* env, void** key, int* key_length) {
-  jobject cell = env->GetObjectArrayElement(cells_, 0);
-  GetRowKey(env, cell, key, key_length);
-  RETURN_ERROR_IF_EXC(env);
+  *key = row_key_;
+  *key_length = row_key_length_;
   return Status::OK();
 }
 
 Status HBaseTableScanner::GetRowKey(JNIEnv* env, const SlotDescriptor* slot_desc,
     Tuple* tuple) {
-  void* key;
-  int key_length;
-  jobject cell = env->GetObjectArrayElement(cells_, 0);
-  GetRowKey(env, cell, &key, &key_length);
-  DCHECK_EQ(key_length, slot_desc->type().GetByteSize());
-  WriteTupleSlot(slot_desc, tuple, reinterpret_cast<char*>(key));
-  RETURN_ERROR_IF_EXC(env);
+  DCHECK_EQ(row_key_length_, slot_desc->type().GetByteSize());
+  WriteTupleSlot(slot_desc, tuple, row_key_);
   return Status::OK();
 }
 
-Status HBaseTableScanner::GetCurrentValue(JNIEnv* env, const string& family,
-    const string& qualifier, void** data, int* length, bool* is_null) {
+void HBaseTableScanner::GetCurrentValue(const string& family, const string& qualifier,
+    void** data, int* length, bool* is_null) {
   // Current row doesn't have any more cells. All remaining values are NULL.
-  if (cell_index_ >= num_cells_) {
+  if (cell_index_ >= cells_.size()) {
     *is_null = true;
-    return Status::OK();
+    return;
   }
-  JniLocalFrame jni_frame;
-  RETURN_IF_ERROR(jni_frame.push(env));
-  jobject cell = env->GetObjectArrayElement(cells_, cell_index_);
+  const Cell& cell = cells_[cell_index_];
   if (!all_cells_present_) {
-    // Check family. If it doesn't match, we have a NULL value.
-    void* family_data;
-    int family_length;
-    GetFamily(env, cell, &family_data, &family_length);
-    if (CompareStrings(family, family_data, family_length) != 0) {
+    // Check family and qualifier. If they don't match, we have a NULL value.
+    if (CompareStrings(family, cell.family, cell.family_length) != 0 ||
+        CompareStrings(qualifier, cell.qualifier, cell.qualifier_length) != 0) {
       *is_null = true;
-      return Status::OK();
-    }
-
-    // Check qualifier. If it doesn't match, we have a NULL value.
-    void* qualifier_data;
-    int qualifier_length;
-    GetQualifier(env, cell, &qualifier_data, &qualifier_length);
-    if (CompareStrings(qualifier, qualifier_data, qualifier_length) != 0) {
-      *is_null = true;
-      return Status::OK();
+      return;
     }
   }
-  GetValue(env, cell, data, length);
+  *data = cell.value;
+  *length = cell.value_length;
   *is_null = false;
-  return Status::OK();
 }
 
 Status HBaseTableScanner::GetValue(JNIEnv* env, const string& family,
     const string& qualifier, void** value, int* value_length) {
   bool is_null;
-  GetCurrentValue(env, family, qualifier, value, value_length, &is_null);
-  RETURN_ERROR_IF_EXC(env);
+  GetCurrentValue(family, qualifier, value, value_length, &is_null);
   if (is_null) {
     *value = NULL;
     *value_length = 0;
@@ -689,8 +605,7 @@ Status HBaseTableScanner::GetValue(JNIEnv* env, const string& family,
   void* value;
   int value_length;
   bool is_null;
-  GetCurrentValue(env, family, qualifier, &value, &value_length, &is_null);
-  RETURN_ERROR_IF_EXC(env);
+  GetCurrentValue(family, qualifier, &value, &value_length, &is_null);
   if (is_null) {
     tuple->SetNull(slot_desc->null_indicator_offset());
     return Status::OK();
@@ -701,12 +616,12 @@ Status HBaseTableScanner::GetValue(JNIEnv* env, const string& family,
   return Status::OK();
 }
 
-int HBaseTableScanner::CompareStrings(const string& s, void* data, int length) {
+int HBaseTableScanner::CompareStrings(const string& s, const void* data, int length) {
   int slength = static_cast<int>(s.length());
   if (slength == 0 && length == 0) return 0;
   if (length == 0) return 1;
   if (slength == 0) return -1;
-  int result = memcmp(s.data(), reinterpret_cast<char*>(data), min(slength, length));
+  int result = memcmp(s.data(), data, min(slength, length));
   if (result == 0 && slength != length) {
     return (slength < length ? -1 : 1);
   } else {
@@ -733,13 +648,15 @@ void HBaseTableScanner::Close(JNIEnv* env) {
       }
     }
     env->DeleteGlobalRef(resultscanner_);
+    env->DeleteGlobalRef(result_batcher_);
     resultscanner_ = NULL;
+    result_batcher_ = NULL;
   }
   if (scan_ != NULL) env->DeleteGlobalRef(scan_);
-  if (cells_ != NULL) env->DeleteGlobalRef(cells_);
 
   // Close the HTable so that the connections are not kept around.
   if (htable_.get() != NULL) htable_->Close(state_);
 
   value_pool_->FreeAll();
+  batch_buffer_ = NULL;
 }
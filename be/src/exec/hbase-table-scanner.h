@@ -52,11 +52,10 @@ class HBaseScanNode;
 /// be overridden by the query option hbase_caching. FE will also suggest a max value such
 /// that it won't put too much memory pressure on the region server.
 //
-/// HBase version compatibility: Starting from HBase 0.95.2 result rows are represented by
-/// Cells instead of KeyValues (prior HBase versions). To mitigate this API
-/// incompatibility the Cell class and its methods are replaced with corresponding
-/// KeyValue equivalents if the Cell is not found in the classpath. The HBase version
-/// detection and KeyValue/Cell replacements are performed in Init().
+/// Rows are not read from the ResultScanner one cell at a time. Instead, the frontend's
+/// HBaseResultBatcher copies as many rows as fit into batch_buffer_ with a single JNI
+/// call, and Next() decodes them from there without crossing JNI again. The layout of
+/// the rows in the buffer is described in HBaseResultBatcher.
 //
 /// Note: When none of the requested family/qualifiers exist in a particular row,
 /// HBase will not return the row at all, leading to "missing" NULL values.
@@ -112,7 +111,7 @@ class HBaseTableScanner {
   /// Returns non-ok status if an error occurred.
   Status Next(JNIEnv* env, bool* has_next);
 
-  /// Get the current HBase row key.
+  /// Get the current HBase row key. Valid until the following Next().
   Status GetRowKey(JNIEnv* env, void** key, int* key_length);
 
   /// Write the current HBase row key into the tuple slot.
@@ -142,6 +141,19 @@ class HBaseTableScanner {
  private:
   static const int DEFAULT_ROWS_CACHED = 1024;
 
+  /// Initial size of batch_buffer_. It grows if a single row does not fit.
+  static const int DEFAULT_BATCH_BUFFER_SIZE = 1024 * 1024;
+
+  /// Location of a cell of the current row in batch_buffer_.
+  struct Cell {
+    const char* family;
+    int family_length;
+    const char* qualifier;
+    int qualifier_length;
+    char* value;
+    int value_length;
+  };
+
   /// The enclosing HBaseScanNode.
   HBaseScanNode* scan_node_;
   RuntimeState* state_;
@@ -149,9 +161,7 @@ class HBaseTableScanner {
   /// Global class references created with JniUtil. Cleanup is done in JniUtil::Cleanup().
   static jclass scan_cl_;
   static jclass resultscanner_cl_;
-  static jclass result_cl_;
-  /// Cell or KeyValue class depending on HBase version (see class comment).
-  static jclass cell_cl_;
+  static jclass result_batcher_cl_;
   static jclass hconstants_cl_;
   static jclass filter_list_cl_;
   static jclass filter_list_op_cl_;
@@ -168,22 +178,9 @@ class HBaseTableScanner {
   static jmethodID scan_set_filter_id_;
   static jmethodID scan_set_start_row_id_;
   static jmethodID scan_set_stop_row_id_;
-  static jmethodID resultscanner_next_id_;
   static jmethodID resultscanner_close_id_;
-  static jmethodID result_isempty_id_;
-  static jmethodID result_raw_cells_id_;
-  static jmethodID cell_get_row_array_;
-  static jmethodID cell_get_family_array_;
-  static jmethodID cell_get_qualifier_array_;
-  static jmethodID cell_get_value_array_;
-  static jmethodID cell_get_family_offset_id_;
-  static jmethodID cell_get_family_length_id_;
-  static jmethodID cell_get_qualifier_offset_id_;
-  static jmethodID cell_get_qualifier_length_id_;
-  static jmethodID cell_get_row_offset_id_;
-  static jmethodID cell_get_row_length_id_;
-  static jmethodID cell_get_value_offset_id_;
-  static jmethodID cell_get_value_length_id_;
+  static jmethodID result_batcher_ctor_;
+  static jmethodID result_batcher_fill_id_;
   static jmethodID filter_list_ctor_;
   static jmethodID filter_list_add_filter_id_;
   static jmethodID single_column_value_filter_ctor_;
@@ -204,15 +201,34 @@ class HBaseTableScanner {
 
   /// Instances related to scanning a table. Set in StartScan(). They are global references
   /// because they cannot be automatically garbage collected by the JVM.
-  jobject scan_;           // Java type Scan
-  jobject resultscanner_;  // Java type ResultScanner
+  jobject scan_;            // Java type Scan
+  jobject resultscanner_;   // Java type ResultScanner
+  jobject result_batcher_;  // Java type HBaseResultBatcher, wraps resultscanner_
+
+  /// Native buffer that result_batcher_ copies rows into. Allocated from value_pool_.
+  uint8_t* batch_buffer_;
+  int batch_buffer_size_;
+
+  /// Number of rows in batch_buffer_ and the number of them returned by Next().
+  int num_batch_rows_;
+  int batch_row_idx_;
+
+  /// Start of the next row in batch_buffer_ to be decoded by Next().
+  uint8_t* batch_pos_;
 
-  /// Helper members for retrieving results from a scan. Updated in Next() and
-  /// used by GetRowKey() and GetValue(). Result of resultscanner_.next().raw()
-  /// Java type Cell[] or KeyValue[] depending on HBase version.
-  jobjectArray cells_;
+  /// Key of the current row. Points into batch_buffer_.
+  char* row_key_;
+  int row_key_length_;
 
-  /// Current position in cells_. Incremented in NextValue(). Reset in Next().
+  /// Key of the last row of the previous batch. A ResultScanner that timed out is
+  /// re-created to start after it. Empty if no row of the current scan range was
+  /// returned before the current batch.
+  std::string last_row_key_;
+
+  /// Cells of the current row. Updated in Next() and used by GetValue().
+  std::vector<Cell> cells_;
+
+  /// Current position in cells_. Incremented in GetValue(). Reset in Next().
   int cell_index_;
 
   /// Number of requested cells (i.e., the number of added family/qualifier pairs).
@@ -223,15 +239,11 @@ class HBaseTableScanner {
   /// hbase bug
   int num_addl_requested_cols_;
 
-  /// Number of cells returned from last result_.raw().
-  int num_cells_;
-
   /// Indicates whether all requested cells are present in the current cells_.
   /// If set to true, all family/qualifier comparisons are avoided in NextValue().
   bool all_cells_present_;
 
-  /// Pool for allocating keys/values retrieved from HBase.
-  /// Memory allocated from this pool is valid until the following Next().
+  /// Pool that batch_buffer_ is allocated from.
   boost::scoped_ptr<MemPool> value_pool_;
 
   /// Number of rows for caching that will be passed to scanners.
@@ -246,7 +258,7 @@ class HBaseTableScanner {
 
   /// Checks for and handles a ScannerTimeoutException which is thrown if the
   /// ResultScanner times out. If a timeout occurs, the ResultScanner is re-created
-  /// (with the scan range adjusted if some results have already been returned) and
+  /// (starting after last_row_key_ if some results have already been returned) and
   /// the exception is cleared. If any other exception is thrown, the error message
   /// is returned in the status.
   /// 'timeout' is true if a ScannerTimeoutException was thrown, false otherwise.
@@ -255,7 +267,7 @@ class HBaseTableScanner {
   /// Lexicographically compares s with the string in data having given length.
   /// Returns a value > 0 if s is greater, a value < 0 if s is smaller,
   /// and 0 if they are equal.
-  int CompareStrings(const std::string& s, void* data, int length);
+  int CompareStrings(const std::string& s, const void* data, int length);
 
   /// Turn strings into Java byte array.
   Status CreateByteArray(JNIEnv* env, const std::string& s, jbyteArray* bytes);
@@ -270,25 +282,22 @@ class HBaseTableScanner {
   /// arrays
   Status InitScanRange(JNIEnv* env, jbyteArray start_bytes, jbyteArray end_bytes);
 
-  /// Copies the row key of cell into value_pool_ and returns it via *data and *length.
-  inline void GetRowKey(JNIEnv* env, jobject cell, void** data, int* length);
-
-  /// Copies the column family of cell into value_pool_ and returns it
-  /// via *data and *length.
-  inline void GetFamily(JNIEnv* env, jobject cell, void** data, int* length);
+  /// Refills batch_buffer_ with the next rows of the scan, moving on to the next scan
+  /// range when the current one is exhausted. Sets num_batch_rows_ to 0 if there are no
+  /// more rows.
+  Status FetchBatch(JNIEnv* env);
 
-  /// Copies the column qualifier of cell into value_pool_ and returns it
-  /// via *data and *length.
-  inline void GetQualifier(JNIEnv* env, jobject cell, void** data, int* length);
+  /// Calls result_batcher_.fill() on batch_buffer_ and returns its result.
+  inline int FillBatchBuffer(JNIEnv* env);
 
-  /// Copies the value of cell into value_pool_ and returns it via *data and *length.
-  inline void GetValue(JNIEnv* env, jobject cell, void** data, int* length);
+  /// Reads a length-prefixed byte string at batch_pos_ and advances batch_pos_ past it.
+  inline char* ReadBytes(int* length);
 
   /// Returns the current value of cells_[cell_index_] in *data and *length
   /// if its family/qualifier match the given family/qualifier.
   /// Otherwise, sets *is_null to true indicating a mismatch in family or qualifier.
-  inline Status GetCurrentValue(JNIEnv* env, const std::string& family,
-      const std::string& qualifier, void** data, int* length, bool* is_null);
+  inline void GetCurrentValue(const std::string& family, const std::string& qualifier,
+      void** data, int* length, bool* is_null);
 
   /// Write to a tuple slot with the given hbase binary formatted data, which is in
   /// big endian.
@@ -67,6 +67,7 @@ Function* HdfsAvroScanner::Codegen(HdfsScanNode* node,
 
 BaseSequenceScanner::FileHeader* HdfsAvroScanner::AllocateFileHeader() {
   AvroFileHeader* header = new AvroFileHeader();
+  header->schema = NULL;
   header->template_tuple = template_tuple_;
   return header;
 }
@@ -123,24 +124,19 @@ Status HdfsAvroScanner::ParseMetadata() {
       RETURN_IF_FALSE(stream_->ReadBytes(value_len, &value, &parse_status_));
 
       if (key == AVRO_SCHEMA_KEY) {
-        avro_schema_t raw_file_schema;
-        int error = avro_schema_from_json_length(
-            reinterpret_cast<char*>(value), value_len, &raw_file_schema);
-        if (error != 0) {
-          stringstream ss;
-          ss << "Failed to parse file schema: " << avro_strerror();
-          return Status(ss.str());
+        const AvroResolvedSchema* resolved_schema;
+        RETURN_IF_ERROR(GetResolvedSchema(
+            string(reinterpret_cast<char*>(value), value_len), &resolved_schema));
+        avro_header_->schema = resolved_schema->schema.get();
+        avro_header_->use_codegend_decode_avro_data =
+            resolved_schema->use_codegend_decode_avro_data;
+        // The template tuple depends on the partition, so the default values are written
+        // for every file.
+        BOOST_FOREACH(const AvroResolvedSchema::DefaultValue& default_value,
+            resolved_schema->default_values) {
+          RETURN_IF_ERROR(WriteDefaultValue(default_value.slot_desc, default_value.value,
+              default_value.field_name));
         }
-        AvroSchemaElement* file_schema = avro_header_->schema.get();
-        RETURN_IF_ERROR(AvroSchemaElement::ConvertSchema(raw_file_schema, file_schema));
-
-        RETURN_IF_ERROR(ResolveSchemas(scan_node_->avro_schema(), file_schema));
-
-        // We currently codegen a function only for the table schema. If this file's
-        // schema is different from the table schema, don't use the codegen'd function and
-        // use the interpreted path instead.
-        avro_header_->use_codegend_decode_avro_data = avro_schema_equal(
-            scan_node_->avro_schema().schema, file_schema->schema);
 
       } else if (key == AVRO_CODEC_KEY) {
         string avro_codec(reinterpret_cast<char*>(value), value_len);
@@ -167,22 +163,52 @@ Status HdfsAvroScanner::ParseMetadata() {
   VLOG_FILE << stream_->filename() << ": "
             << (header_->is_compressed ?  "compressed" : "not compressed");
   if (header_->is_compressed) VLOG_FILE << header_->codec;
-  if (avro_header_->schema->children.empty()) {
+  if (avro_header_->schema == NULL || avro_header_->schema->children.empty()) {
     return Status("Schema not found in file header metadata");
   }
   return Status::OK();
 }
 
+Status HdfsAvroScanner::GetResolvedSchema(const string& schema_json,
+    const AvroResolvedSchema** resolved_schema) {
+  *resolved_schema = scan_node_->GetAvroResolvedSchema(schema_json);
+  if (*resolved_schema != NULL) return Status::OK();
+
+  avro_schema_t raw_file_schema;
+  int error = avro_schema_from_json_length(
+      schema_json.data(), schema_json.size(), &raw_file_schema);
+  if (error != 0) {
+    stringstream ss;
+    ss << "Failed to parse file schema: " << avro_strerror();
+    return Status(ss.str());
+  }
+  scoped_ptr<AvroResolvedSchema> file_schema(new AvroResolvedSchema());
+  RETURN_IF_ERROR(
+      AvroSchemaElement::ConvertSchema(raw_file_schema, file_schema->schema.get()));
+  RETURN_IF_ERROR(ResolveSchemas(scan_node_->avro_schema(), file_schema.get()));
+
+  // We currently codegen a function only for the table schema. If this file's schema is
+  // different from the table schema, don't use the codegen'd function and use the
+  // interpreted path instead.
+  file_schema->use_codegend_decode_avro_data = avro_schema_equal(
+      scan_node_->avro_schema().schema, file_schema->schema->schema);
+  *resolved_schema =
+      scan_node_->AddAvroResolvedSchema(schema_json, file_schema.release());
+  return Status::OK();
+}
+
 // Schema resolution is performed per materialized slot (meaning we don't perform schema
 // resolution for non-materialized columns). For each slot, we traverse the table schema
 // using the column path (i.e., the traversal is by ordinal). We simultaneously traverse
 // the file schema using the table schema's field names. The final field should exist in
 // both schemas and be promotable to the slot type. If the file schema is missing a field,
-// we check for a default value in the table schema and use that instead.
+// we check for a default value in the table schema and use that instead. Default values
+// are only validated when they are written to the template tuple.
 // TODO: test unresolvable schemas
 // TODO: improve error messages
 Status HdfsAvroScanner::ResolveSchemas(const AvroSchemaElement& table_root,
-                                       AvroSchemaElement* file_root) {
+                                       AvroResolvedSchema* resolved_schema) {
+  AvroSchemaElement* file_root = resolved_schema->schema.get();
   if (table_root.schema->type != AVRO_RECORD) return Status("Table schema is not a record");
   if (file_root->schema->type != AVRO_RECORD) return Status("File schema is not a record");
 
@@ -215,7 +241,11 @@ Status HdfsAvroScanner::ResolveSchemas(const AvroSchemaElement& table_root,
         if (default_value == NULL) {
           return Status(TErrorCode::AVRO_MISSING_DEFAULT, field_name);
         }
-        RETURN_IF_ERROR(WriteDefaultValue(slot_desc, default_value, field_name));
+        AvroResolvedSchema::DefaultValue resolved_default;
+        resolved_default.slot_desc = slot_desc;
+        resolved_default.value = default_value;
+        resolved_default.field_name = field_name;
+        resolved_schema->default_values.push_back(resolved_default);
         DCHECK_EQ(i, path.size() - 1) <<
             "WriteDefaultValue() doesn't support default records yet, should have failed";
         continue;
@@ -781,10 +811,15 @@ Status HdfsAvroScanner::CodegenReadScalar(const AvroSchemaElement& element,
     case AVRO_BYTES:
       if (slot_desc != NULL && slot_desc->type().type == TYPE_VARCHAR) {
         read_field_fn = codegen->GetFunction(IRFunction::READ_AVRO_VARCHAR);
+      } else if (slot_desc != NULL && slot_desc->type().type == TYPE_CHAR) {
+        read_field_fn = codegen->GetFunction(IRFunction::READ_AVRO_CHAR);
       } else {
         read_field_fn = codegen->GetFunction(IRFunction::READ_AVRO_STRING);
       }
       break;
+    case AVRO_DECIMAL:
+      read_field_fn = codegen->GetFunction(IRFunction::READ_AVRO_DECIMAL);
+      break;
     default:
       return Status(Substitute(
           "Failed to codegen MaterializeTuple() due to unsupported type: $0",
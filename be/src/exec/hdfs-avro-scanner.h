@@ -61,7 +61,9 @@
 //
 /// TODO:
 /// - implement SkipComplex()
-/// - codegen a function per unique file schema, rather than just the table schema
+/// - codegen a function per unique file schema, rather than just the table schema (the
+///   module is compiled before any file header is read, so this requires codegen at
+///   scan time)
 /// - once Exprs are thread-safe, we can cache the jitted function directly
 /// - microbenchmark codegen'd functions (this and other scanners)
 
@@ -104,8 +106,9 @@ class HdfsAvroScanner : public BaseSequenceScanner {
 
  private:
   struct AvroFileHeader : public BaseSequenceScanner::FileHeader {
-    /// The root of the file schema tree (i.e. the top-level record schema of the file)
-    ScopedAvroSchemaElement schema;
+    /// The root of the file schema tree (i.e. the top-level record schema of the file).
+    /// Owned by the scan node, which shares it between all files with this schema.
+    const AvroSchemaElement* schema;
 
     /// Template tuple for this file containing partition key values and default values.
     /// NULL if there are no materialized partition keys and no default values are
@@ -138,12 +141,20 @@ class HdfsAvroScanner : public BaseSequenceScanner {
   /// Utility function for decoding and parsing file header metadata
   Status ParseMetadata();
 
+  /// Returns the file schema with JSON representation 'schema_json' resolved against the
+  /// table schema. Files with a schema that the scan node has seen before reuse its
+  /// resolved schema, otherwise the schema is parsed, resolved and added to the scan
+  /// node's cache.
+  Status GetResolvedSchema(const std::string& schema_json,
+      const AvroResolvedSchema** resolved_schema);
+
   /// Resolves the table schema (i.e. the reader schema) against the file schema (i.e. the
   /// writer schema), and sets the 'slot_desc' fields of the nodes of the file schema
-  /// corresponding to materialized slots. Calls WriteDefaultValue() as
-  /// appropriate. Returns a non-OK status if the schemas could not be resolved.
+  /// corresponding to materialized slots. Materialized slots missing from the file schema
+  /// are added to resolved_schema->default_values. Returns a non-OK status if the
+  /// schemas could not be resolved.
   Status ResolveSchemas(const AvroSchemaElement& table_root,
-                        AvroSchemaElement* file_root);
+                        AvroResolvedSchema* resolved_schema);
 
   // Returns Status::OK iff table_schema (the reader schema) can be resolved against
   // file_schema (the writer schema). field_name is used for error messages.
@@ -24,9 +24,12 @@
 #include "common/object-pool.h"
 #include "common/logging.h"
 #include "exec/hdfs-scan-node.h"
+#include "exec/parquet-metadata-cache.h"
 #include "exec/scanner-context.inline.h"
 #include "exec/read-write-util.h"
+#include "exec/topn-bound.h"
 #include "exprs/expr.h"
+#include "exprs/slot-ref.h"
 #include "runtime/collection-value-builder.h"
 #include "runtime/descriptors.h"
 #include "runtime/runtime-state.h"
@@ -39,12 +42,14 @@
 #include "runtime/string-value.h"
 #include "util/bitmap.h"
 #include "util/bit-util.h"
+#include "util/bloom-filter.h"
 #include "util/decompress.h"
 #include "util/debug-util.h"
 #include "util/error-util.h"
 #include "util/dict-encoding.h"
 #include "util/rle-encoding.h"
 #include "util/runtime-profile.h"
+#include "util/string-parser.h"
 #include "rpc/thrift-util.h"
 
 #include "common/names.h"
@@ -63,6 +68,24 @@ DEFINE_bool(convert_legacy_hive_parquet_utc_timestamps, false,
 DEFINE_double(parquet_min_filter_reject_ratio, 0.1, "(Advanced) If the percentage of "
     "rows rejected by a runtime filter drops below this value, the filter is disabled.");
 
+DEFINE_bool(parquet_late_materialization, true, "(Advanced) If true, the Parquet scanner "
+    "evaluates the conjuncts after reading only the columns they reference and skips "
+    "over the values of the other columns for rows that do not pass.");
+
+DEFINE_int64(parquet_row_group_prefetch_max_bytes, 64L * 1024L * 1024L, "(Advanced) "
+    "Maximum number of bytes of io buffers a Parquet scanner may tie up by issuing the "
+    "column ranges of the next row group while the current one is being assembled. "
+    "Set to 0 to disable prefetching.");
+
+DEFINE_bool(parquet_dictionary_filtering, true, "(Advanced) If true, the Parquet scanner "
+    "evaluates conjuncts that only reference a string column once per entry of the "
+    "column's dictionary instead of once per row, if all values of the column chunk are "
+    "dictionary encoded.");
+
+DEFINE_bool(parquet_skip_row_groups_using_stats, true, "(Advanced) If true, row groups "
+    "are skipped if their min/max column statistics show that no row can pass the scan "
+    "conjuncts.");
+
 const int64_t HdfsParquetScanner::FOOTER_SIZE = 100 * 1024;
 
 // Max data page header size in bytes. This is an estimate and only needs to be an upper
@@ -82,6 +105,11 @@ static_assert(
     !(ROWS_PER_FILTER_SELECTIVITY_CHECK & (ROWS_PER_FILTER_SELECTIVITY_CHECK - 1)),
     "ROWS_PER_FILTER_SELECTIVITY_CHECK must be a power of two");
 
+// The number of rows, summed over all scanners of a scan node, a filter must have been
+// applied to before its selectivity is trusted enough to disable it for the scanners
+// that have yet to start.
+const int64_t MIN_ROWS_TO_DISABLE_FILTER_FOR_SCAN = 4 * ROWS_PER_FILTER_SELECTIVITY_CHECK;
+
 // TODO: refactor error reporting across all scanners to be more consistent (e.g. make
 // sure file name is always included, errors are reported exactly once)
 // TODO: rename these macros so its easier to tell them apart
@@ -128,8 +156,16 @@ Status HdfsParquetScanner::IssueInitialRanges(HdfsScanNode* scan_node,
       return Status(Substitute("Parquet file $0 has an invalid file length: $1",
           files[i]->filename, files[i]->file_length));
     }
-    // Compute the offset of the file footer.
-    int64_t footer_size = min(FOOTER_SIZE, files[i]->file_length);
+    // Compute the offset of the file footer. If the footer is cached, only read the
+    // fixed size tail to validate the file, ProcessFooter() gets the rest from the cache.
+    // If the entry is evicted in the meantime, ProcessFooter() reads the metadata with
+    // additional ranges.
+    int64_t footer_size = FOOTER_SIZE;
+    if (ParquetMetadataCache::instance()->Contains(files[i]->filename,
+        files[i]->mtime)) {
+      footer_size = sizeof(int32_t) + sizeof(PARQUET_VERSION_NUMBER);
+    }
+    footer_size = min(footer_size, files[i]->file_length);
     int64_t footer_start = files[i]->file_length - footer_size;
 
     // Try to find the split with the footer.
@@ -190,6 +226,10 @@ namespace impala {
 
 HdfsParquetScanner::HdfsParquetScanner(HdfsScanNode* scan_node, RuntimeState* state)
     : HdfsScanner(scan_node, state),
+      late_materialization_(false),
+      num_conjunct_readers_(0),
+      dict_filter_tuple_(NULL),
+      prefetched_row_group_idx_(-1),
       metadata_range_(NULL),
       dictionary_pool_(new MemPool(scan_node->mem_tracker())),
       assemble_rows_timer_(scan_node_->materialize_tuple_timer()) {
@@ -205,18 +245,43 @@ HdfsParquetScanner::~HdfsParquetScanner() {
 /// Overrides RleDecoder so it can use RLE decoding and internal bit reader.
 class HdfsParquetScanner::LevelDecoder : protected RleDecoder {
  public:
-  LevelDecoder() {};
+  LevelDecoder()
+    : max_level_(0),
+      num_cached_levels_(0),
+      cached_level_idx_(0),
+      num_levels_remaining_(0) {}
 
   /// Initialize the LevelDecoder. Reads and advances the provided data buffer if the
   /// encoding requires reading metadata from the page header.
   Status Init(const string& filename, parquet::Encoding::type encoding, int max_level,
       int num_buffered_values, uint8_t** data, int* data_size);
 
-  /// Reads the next level.
+  /// Reads the next level. Returns -1 if there are no more levels or if the batch of the
+  /// level contains a level above the max level.
   inline int16_t ReadLevel();
 
  private:
+  /// Number of levels decoded at once into cached_levels_.
+  static const int LEVEL_BATCH_SIZE = 128;
+
+  /// Decodes the next batch of levels into cached_levels_ and validates them. Returns
+  /// false if no levels could be decoded or one of them is invalid.
+  bool FillCache();
+
   parquet::Encoding::type encoding_;
+
+  /// Levels above this are invalid. Checked for a whole batch at a time, so that the
+  /// readers need not check each level.
+  int max_level_;
+
+  /// Levels decoded ahead of time by FillCache(). ReadLevel() returns
+  /// cached_levels_[cached_level_idx_] until all 'num_cached_levels_' are consumed.
+  uint8_t cached_levels_[LEVEL_BATCH_SIZE];
+  int num_cached_levels_;
+  int cached_level_idx_;
+
+  /// Number of levels in the page that have not been decoded into the cache yet.
+  int num_levels_remaining_;
 };
 
 /// Base class for reading a column. Reads a logical column, not necessarily a column
@@ -282,6 +347,14 @@ class HdfsParquetScanner::ColumnReader {
   virtual bool ReadNonRepeatedValue(MemPool* pool, Tuple* tuple,
       bool* conjuncts_passed) = 0;
 
+  /// Same as ReadNonRepeatedValue() but advances past the current value without writing
+  /// it to a tuple. Used to skip the values of rows that have already been filtered.
+  /// Only valid for scalar columns not in collections.
+  virtual bool SkipNonRepeatedValue() {
+    DCHECK(false) << "Skipping values is only supported for scalar columns";
+    return false;
+  }
+
   /// Advances this column reader's def and rep levels to the next logical value, i.e. to
   /// the next scalar value or the beginning of the next collection, without attempting to
   /// read the value. This is used to skip past def/rep levels that don't materialize a
@@ -295,6 +368,16 @@ class HdfsParquetScanner::ColumnReader {
   /// true.
   virtual bool NextLevels() = 0;
 
+  /// Calls NextLevels() until rep_level() is at most 'rep_level', i.e. skips to the start
+  /// of the next collection at that level. Returns false like NextLevels(). Scalar
+  /// readers override this to skip with a single virtual call.
+  virtual bool NextLevelsUntil(int rep_level) {
+    do {
+      if (!NextLevels()) return false;
+    } while (rep_level_ > rep_level);
+    return true;
+  }
+
   /// Should only be called if pos_slot_desc_ is non-NULL. Writes pos_current_value_ to
   /// 'tuple' (i.e. "reads" the synthetic position field of the parent collection into
   /// 'tuple') and increments pos_current_value_.
@@ -472,6 +555,25 @@ class HdfsParquetScanner::BaseScalarColumnReader :
 
   int64_t total_len() const { return metadata_->total_compressed_size; }
   int col_idx() const { return node_.col_idx; }
+
+  /// Returns true if the dictionary of the current column chunk has been read and none
+  /// of its entries passes 'filter', i.e. every row whose value in this column is
+  /// dictionary encoded fails the filter. Returns false if there is no dictionary or if
+  /// this cannot be determined.
+  virtual bool DictionaryFailsFilter(const RuntimeFilter* filter) { return false; }
+
+  /// Evaluates 'conjunct_ctxs', which must only reference this column's slot, once for
+  /// each entry of the dictionary of the current column chunk and once for NULL, using
+  /// the slot in 'scratch_tuple' to hold the values. Afterwards, ReadValue() sets
+  /// *conjuncts_passed to false for values that fail the conjuncts by looking up their
+  /// dictionary index, so the conjuncts don't need to be evaluated per row. All data
+  /// pages of the column chunk must be dictionary encoded. Returns false, without
+  /// evaluating the conjuncts, if the reader does not support this for the column chunk
+  /// or if the dictionary has more than 'max_entries' entries.
+  virtual bool InitDictFilter(const vector<ExprContext*>& conjunct_ctxs,
+      Tuple* scratch_tuple, int64_t max_entries) {
+    return false;
+  }
   THdfsCompression::type codec() const {
     if (metadata_ == NULL) return THdfsCompression::NONE;
     return PARQUET_TO_IMPALA_CODEC[metadata_->codec];
@@ -482,6 +584,8 @@ class HdfsParquetScanner::BaseScalarColumnReader :
   /// next data page if necessary.
   virtual bool NextLevels() { return NextLevels<true>(); }
 
+  virtual bool NextLevelsUntil(int rep_level);
+
   // TODO: Some encodings might benefit a lot from a SkipValues(int num_rows) if
   // we know this row can be skipped. This could be very useful with stats and big
   // sections can be skipped. Implement that when we can benefit from it.
@@ -587,7 +691,11 @@ class HdfsParquetScanner::ScalarColumnReader :
   ScalarColumnReader(HdfsParquetScanner* parent, const SchemaNode& node,
       const SlotDescriptor* slot_desc)
     : BaseScalarColumnReader(parent, node, slot_desc),
-      dict_decoder_init_(false) {
+      dict_decoder_init_(false),
+      dict_filter_active_(false),
+      dict_filter_null_passes_(true),
+      num_cached_values_(0),
+      cached_value_idx_(0) {
     if (!MATERIALIZED) {
       // We're not materializing any values, just counting them. No need (or ability) to
       // initialize state used to materialize values.
@@ -622,6 +730,55 @@ class HdfsParquetScanner::ScalarColumnReader :
     return ReadValue<false>(pool, tuple, conjuncts_passed);
   }
 
+  virtual bool DictionaryFailsFilter(const RuntimeFilter* filter) {
+    // Values that need conversion are hashed after conversion, so the dictionary
+    // entries cannot be probed directly.
+    if (!MATERIALIZED || !dict_decoder_init_ || NeedsConversion()) return false;
+    const ColumnType& type = slot_desc_->type();
+    for (int i = 0; i < dict_decoder_.num_entries(); ++i) {
+      T val;
+      dict_decoder_.GetDictValue(i, &val);
+      if (filter->Eval<void>(&val, type)) return false;
+    }
+    return true;
+  }
+
+  virtual bool InitDictFilter(const vector<ExprContext*>& conjunct_ctxs,
+      Tuple* scratch_tuple, int64_t max_entries) {
+    if (!MATERIALIZED || !dict_decoder_init_ || NeedsConversion()) return false;
+    if (dict_decoder_.num_entries() > max_entries) return false;
+    // The filter must be in place before any value of the chunk is decoded.
+    if (page_encoding_ != parquet::Encoding::PLAIN_DICTIONARY || num_cached_values_ > 0) {
+      return false;
+    }
+    TupleRow* row = reinterpret_cast<TupleRow*>(&scratch_tuple);
+    T* slot = reinterpret_cast<T*>(scratch_tuple->GetSlot(tuple_offset_));
+    dict_filter_.resize(dict_decoder_.num_entries());
+    scratch_tuple->SetNotNull(null_indicator_offset_);
+    for (int i = 0; i < dict_decoder_.num_entries(); ++i) {
+      dict_decoder_.GetDictValue(i, slot);
+      dict_filter_[i] =
+          ExecNode::EvalConjuncts(&conjunct_ctxs[0], conjunct_ctxs.size(), row);
+    }
+    scratch_tuple->SetNull(null_indicator_offset_);
+    dict_filter_null_passes_ =
+        ExecNode::EvalConjuncts(&conjunct_ctxs[0], conjunct_ctxs.size(), row);
+    ExprContext::FreeLocalAllocations(conjunct_ctxs);
+    dict_filter_active_ = true;
+    return true;
+  }
+
+  virtual bool SkipNonRepeatedValue() {
+    DCHECK_EQ(max_rep_level(), 0);
+    if (MATERIALIZED && def_level_ >= max_def_level()) {
+      // The value still has to be decoded to advance past it, but it is neither
+      // converted nor written to a tuple.
+      T val;
+      if (UNLIKELY(!DecodeValue(&val))) return false;
+    }
+    return NextLevels<false>();
+  }
+
  protected:
   template <bool IN_COLLECTION>
   inline bool ReadValue(MemPool* pool, Tuple* tuple, bool* conjuncts_passed) {
@@ -642,6 +799,7 @@ class HdfsParquetScanner::ScalarColumnReader :
     } else {
       // Null value
       tuple->SetNull(null_indicator_offset_);
+      if (dict_filter_active_) *conjuncts_passed &= dict_filter_null_passes_;
       return NextLevels<IN_COLLECTION>();
     }
   }
@@ -649,6 +807,7 @@ class HdfsParquetScanner::ScalarColumnReader :
   virtual DictDecoderBase* CreateDictionaryDecoder(uint8_t* values, int size) {
     dict_decoder_.Reset(values, size, fixed_len_size_);
     dict_decoder_init_ = true;
+    dict_filter_active_ = false;
     return &dict_decoder_;
   }
 
@@ -658,6 +817,7 @@ class HdfsParquetScanner::ScalarColumnReader :
 
   virtual void ClearDictionaryDecoder() {
     dict_decoder_init_ = false;
+    dict_filter_active_ = false;
   }
 
   virtual Status InitDataPage(uint8_t* data, int size) {
@@ -677,7 +837,17 @@ class HdfsParquetScanner::ScalarColumnReader :
         return Status("File corrupt. Missing dictionary page.");
       }
       dict_decoder_.SetData(data, size);
+    } else if (dict_filter_active_) {
+      // The conjuncts the dictionary filter replaces would not be applied to PLAIN
+      // values.
+      stringstream ss;
+      ss << "File '" << filename() << "' is corrupt: column '" << schema_element().name
+         << "' has a PLAIN encoded data page, but its column chunk metadata does not "
+         << "list the PLAIN encoding.";
+      return Status(ss.str());
     }
+    num_cached_values_ = 0;
+    cached_value_idx_ = 0;
 
     // TODO: Perform filter selectivity checks here.
     return Status::OK();
@@ -694,18 +864,47 @@ class HdfsParquetScanner::ScalarColumnReader :
   inline bool ReadSlot(void* slot, MemPool* pool, bool* conjuncts_passed) {
     T val;
     T* val_ptr = NeedsConversion() ? &val : reinterpret_cast<T*>(slot);
+    if (UNLIKELY(!DecodeValue(val_ptr))) return false;
+    if (NeedsConversion()) ConvertSlot(&val, reinterpret_cast<T*>(slot), pool);
+    if (dict_filter_active_ && !dict_filter_[cached_indices_[cached_value_idx_ - 1]]) {
+      *conjuncts_passed = false;
+    }
+
+    return NextLevels<IN_COLLECTION>();
+  }
+
+  /// Decodes the current value into *val_ptr. Returns false and sets parse_status_ if
+  /// the value could not be decoded.
+  inline bool DecodeValue(T* val_ptr) {
     if (page_encoding_ == parquet::Encoding::PLAIN_DICTIONARY) {
-      if (UNLIKELY(!dict_decoder_.GetValue(val_ptr))) {
-        SetDictDecodeError();
-        return false;
+      if (UNLIKELY(cached_value_idx_ == num_cached_values_)) {
+        if (UNLIKELY(!FillDictValueCache())) {
+          SetDictDecodeError();
+          return false;
+        }
       }
+      // Use memcpy so that the cache does not need to be 16 byte aligned for
+      // Decimal16Value (see IMPALA-959).
+      memcpy(val_ptr, &cached_values_[cached_value_idx_++], sizeof(T));
     } else {
       DCHECK_EQ(page_encoding_, parquet::Encoding::PLAIN);
       data_ += ParquetPlainEncoder::Decode<T>(data_, fixed_len_size_, val_ptr);
     }
-    if (NeedsConversion()) ConvertSlot(&val, reinterpret_cast<T*>(slot), pool);
+    return true;
+  }
 
-    return NextLevels<IN_COLLECTION>();
+  /// Decodes the next batch of dictionary-encoded values into cached_values_. Returns
+  /// false if the data is invalid or there are no more values in the page.
+  bool FillDictValueCache() {
+    // The current value was already accounted for in num_buffered_values_. Decoding
+    // at most this many values means we never read past the end of the page.
+    int batch_size = min(num_buffered_values_ + 1, DICT_VALUE_BATCH_SIZE);
+    int num_decoded = dict_decoder_.GetValues(cached_values_,
+        dict_filter_active_ ? cached_indices_ : NULL, batch_size);
+    if (num_decoded <= 0) return false;
+    num_cached_values_ = num_decoded;
+    cached_value_idx_ = 0;
+    return true;
   }
 
   /// Most column readers never require conversion, so we can avoid branches by
@@ -733,6 +932,25 @@ class HdfsParquetScanner::ScalarColumnReader :
   /// True if dict_decoder_ has been initialized with a dictionary page.
   bool dict_decoder_init_;
 
+  /// True if InitDictFilter() was called for the current dictionary. If so,
+  /// dict_filter_[i] is true if dictionary entry i passed the conjuncts and
+  /// dict_filter_null_passes_ is true if NULL did.
+  bool dict_filter_active_;
+  bool dict_filter_null_passes_;
+  vector<bool> dict_filter_;
+
+  /// Number of dictionary-encoded values decoded at once into cached_values_.
+  static const int DICT_VALUE_BATCH_SIZE = 128;
+
+  /// Values of the current data page decoded ahead of time by FillDictValueCache().
+  /// Only used for PLAIN_DICTIONARY pages.
+  T cached_values_[DICT_VALUE_BATCH_SIZE];
+
+  /// Dictionary indices of cached_values_. Only filled in if dict_filter_active_.
+  int cached_indices_[DICT_VALUE_BATCH_SIZE];
+  int num_cached_values_;
+  int cached_value_idx_;
+
   /// true if decoded values must be converted before being written to an output tuple.
   bool needs_conversion_;
 
@@ -741,6 +959,9 @@ class HdfsParquetScanner::ScalarColumnReader :
   int fixed_len_size_;
 };
 
+template<typename T, bool MATERIALIZED>
+const int HdfsParquetScanner::ScalarColumnReader<T, MATERIALIZED>::DICT_VALUE_BATCH_SIZE;
+
 template<>
 inline bool HdfsParquetScanner::ScalarColumnReader<StringValue, true>::NeedsConversion() const {
   return needs_conversion_;
@@ -800,6 +1021,18 @@ class HdfsParquetScanner::BoolColumnReader :
     return ReadValue<false>(pool, tuple, conjuncts_passed);
   }
 
+  virtual bool SkipNonRepeatedValue() {
+    DCHECK_EQ(max_rep_level(), 0);
+    if (def_level_ >= max_def_level()) {
+      bool val;
+      if (!bool_values_.GetValue(1, &val)) {
+        parent_->parse_status_ = Status("Invalid bool column.");
+        return false;
+      }
+    }
+    return NextLevels<false>();
+  }
+
  protected:
   virtual DictDecoderBase* CreateDictionaryDecoder(uint8_t* values, int size) {
     DCHECK(false) << "Dictionary encoding is not supported for bools. Should never "
@@ -869,6 +1102,20 @@ Status HdfsParquetScanner::Prepare(ScannerContext* context) {
       ADD_COUNTER(scan_node_->runtime_profile(), "NumColumns", TUnit::UNIT);
   num_row_groups_counter_ =
       ADD_COUNTER(scan_node_->runtime_profile(), "NumRowGroups", TUnit::UNIT);
+  num_stats_filtered_row_groups_counter_ = ADD_COUNTER(scan_node_->runtime_profile(),
+      "NumStatsFilteredRowGroups", TUnit::UNIT);
+  num_dict_filtered_row_groups_counter_ = ADD_COUNTER(scan_node_->runtime_profile(),
+      "NumDictFilteredRowGroups", TUnit::UNIT);
+  num_dict_filtered_column_chunks_counter_ = ADD_COUNTER(scan_node_->runtime_profile(),
+      "NumDictFilteredColumnChunks", TUnit::UNIT);
+  num_topn_filtered_row_groups_counter_ = ADD_COUNTER(scan_node_->runtime_profile(),
+      "NumTopNFilteredRowGroups", TUnit::UNIT);
+  num_bloom_filtered_row_groups_counter_ = ADD_COUNTER(scan_node_->runtime_profile(),
+      "NumBloomFilteredRowGroups", TUnit::UNIT);
+  num_prefetched_row_groups_counter_ = ADD_COUNTER(scan_node_->runtime_profile(),
+      "NumPrefetchedRowGroups", TUnit::UNIT);
+  num_footer_cache_hits_counter_ = ADD_COUNTER(scan_node_->runtime_profile(),
+      "NumFooterCacheHits", TUnit::UNIT);
 
   scan_node_->IncNumScannersCodegenDisabled();
 
@@ -879,10 +1126,15 @@ Status HdfsParquetScanner::Prepare(ScannerContext* context) {
     filter_ctxs_.push_back(ctx);
   }
   filter_stats_.resize(filter_ctxs_.size());
+  // Don't sample again the filters that earlier scanners found to be ineffective.
+  for (int i = 0; i < filter_ctxs_.size(); ++i) {
+    if (filter_ctxs_[i]->stats->disabled()) filter_stats_[i].enabled = 0;
+  }
   return Status::OK();
 }
 
 void HdfsParquetScanner::Close() {
+  CancelPrefetchedRanges();
   vector<THdfsCompression::type> compression_types;
 
   // Visit each column reader, including collection reader children.
@@ -1200,10 +1452,16 @@ Status HdfsParquetScanner::BaseScalarColumnReader::ReadDataPage() {
   return Status::OK();
 }
 
+const int HdfsParquetScanner::LevelDecoder::LEVEL_BATCH_SIZE;
+
 Status HdfsParquetScanner::LevelDecoder::Init(const string& filename,
     parquet::Encoding::type encoding, int max_level,
     int num_buffered_values, uint8_t** data, int* data_size) {
   encoding_ = encoding;
+  max_level_ = max_level;
+  num_cached_levels_ = 0;
+  cached_level_idx_ = 0;
+  num_levels_remaining_ = num_buffered_values;
   int32_t num_bytes = 0;
   switch (encoding) {
     case parquet::Encoding::RLE: {
@@ -1236,24 +1494,48 @@ Status HdfsParquetScanner::LevelDecoder::Init(const string& filename,
 
 // TODO More codegen here as well.
 inline int16_t HdfsParquetScanner::LevelDecoder::ReadLevel() {
-  bool valid;
-  uint8_t level;
+  if (UNLIKELY(cached_level_idx_ == num_cached_levels_)) {
+    if (!FillCache()) return -1;
+  }
+  return cached_levels_[cached_level_idx_++];
+}
+
+bool HdfsParquetScanner::LevelDecoder::FillCache() {
+  // Never decode past the end of the page: trailing bits are padding.
+  int batch_size = min(num_levels_remaining_, LEVEL_BATCH_SIZE);
+  if (batch_size <= 0) return false;
+  int num_decoded;
   if (encoding_ == parquet::Encoding::RLE) {
-    valid = Get(&level);
+    num_decoded = GetValues(batch_size, cached_levels_);
   } else {
     DCHECK_EQ(encoding_, parquet::Encoding::BIT_PACKED);
-    valid = bit_reader_.GetValue(1, &level);
+    num_decoded = bit_reader_.UnpackBatch(1, batch_size, cached_levels_);
+  }
+  num_levels_remaining_ -= num_decoded;
+  // The loop is vectorized by the compiler, unlike a check of each level when it is
+  // read.
+  uint8_t batch_max_level = 0;
+  for (int i = 0; i < num_decoded; ++i) {
+    batch_max_level = max(batch_max_level, cached_levels_[i]);
+  }
+  if (UNLIKELY(batch_max_level > max_level_)) {
+    num_levels_remaining_ = 0;
+    num_cached_levels_ = 0;
+    cached_level_idx_ = 0;
+    return false;
   }
-  return LIKELY(valid) ? level : -1;
+  num_cached_levels_ = num_decoded;
+  cached_level_idx_ = 0;
+  return num_decoded > 0;
 }
 
-// TODO(skye): try reading + caching many levels at once to avoid error checking etc on
-// each call (here and RLE decoder) for perf
 inline int16_t HdfsParquetScanner::BaseScalarColumnReader::ReadDefinitionLevel() {
   DCHECK_GT(max_def_level(), 0);
+  // The decoder validated the level against max_def_level().
   int16_t def_level = def_levels_.ReadLevel();
+  DCHECK_LE(def_level, max_def_level());
 
-  if (UNLIKELY(def_level < 0 || def_level > max_def_level())) {
+  if (UNLIKELY(def_level < 0)) {
     SetLevelError(TErrorCode::PARQUET_DEF_LEVEL_ERROR);
     return -1;
   }
@@ -1263,8 +1545,9 @@ inline int16_t HdfsParquetScanner::BaseScalarColumnReader::ReadDefinitionLevel()
 inline int16_t HdfsParquetScanner::BaseScalarColumnReader::ReadRepetitionLevel() {
   DCHECK_GT(max_rep_level(), 0);
   int16_t rep_level = rep_levels_.ReadLevel();
+  DCHECK_LE(rep_level, max_rep_level());
 
-  if (UNLIKELY(rep_level < 0 || rep_level > max_rep_level())) {
+  if (UNLIKELY(rep_level < 0)) {
     SetLevelError(TErrorCode::PARQUET_REP_LEVEL_ERROR);
     return -1;
   }
@@ -1293,6 +1576,14 @@ bool HdfsParquetScanner::BaseScalarColumnReader::NextLevels() {
   return parent_->parse_status_.ok();
 }
 
+bool HdfsParquetScanner::BaseScalarColumnReader::NextLevelsUntil(int rep_level) {
+  // Same as the base class, but NextLevels<true>() is inlined into the loop.
+  do {
+    if (!NextLevels<true>()) return false;
+  } while (rep_level_ > rep_level);
+  return true;
+}
+
 bool HdfsParquetScanner::BaseScalarColumnReader::NextPage() {
   parent_->assemble_rows_timer_.Stop();
   parent_->parse_status_ = ReadDataPage();
@@ -1311,10 +1602,8 @@ bool HdfsParquetScanner::CollectionColumnReader::NextLevels() {
   DCHECK(!children_.empty());
   DCHECK_LE(rep_level_, new_collection_rep_level());
   for (int c = 0; c < children_.size(); ++c) {
-    do {
-      // TODO(skye): verify somewhere that all column readers are at end
-      if (!children_[c]->NextLevels()) return false;
-    } while (children_[c]->rep_level() > new_collection_rep_level());
+    // TODO(skye): verify somewhere that all column readers are at end
+    if (!children_[c]->NextLevelsUntil(new_collection_rep_level())) return false;
   }
   UpdateDerivedState();
   return true;
@@ -1468,6 +1757,550 @@ int HdfsParquetScanner::CountScalarColumns(const vector<ColumnReader*>& column_r
   return num_columns;
 }
 
+namespace {
+
+/// Returns true if statistics can be trusted for columns of 'type'. Statistics of
+/// BYTE_ARRAY and FIXED_LEN_BYTE_ARRAY columns written by older Parquet-MR versions
+/// used a signed byte comparison (PARQUET-251) and the sort order of INT96 timestamps
+/// is undefined, so only plain numeric columns are considered.
+bool StatsSupportedForType(const ColumnType& type) {
+  switch (type.type) {
+    case TYPE_TINYINT:
+    case TYPE_SMALLINT:
+    case TYPE_INT:
+    case TYPE_BIGINT:
+    case TYPE_FLOAT:
+    case TYPE_DOUBLE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/// Evaluates the constant 'expr' and writes it as a native value of expr->type() to
+/// 'value'. Returns false if the value is NULL.
+bool EvalConstant(Expr* expr, ExprContext* ctx, void* value) {
+  switch (expr->type().type) {
+    case TYPE_TINYINT: {
+      TinyIntVal v = expr->GetTinyIntVal(ctx, NULL);
+      *reinterpret_cast<int8_t*>(value) = v.val;
+      return !v.is_null;
+    }
+    case TYPE_SMALLINT: {
+      SmallIntVal v = expr->GetSmallIntVal(ctx, NULL);
+      *reinterpret_cast<int16_t*>(value) = v.val;
+      return !v.is_null;
+    }
+    case TYPE_INT: {
+      IntVal v = expr->GetIntVal(ctx, NULL);
+      *reinterpret_cast<int32_t*>(value) = v.val;
+      return !v.is_null;
+    }
+    case TYPE_BIGINT: {
+      BigIntVal v = expr->GetBigIntVal(ctx, NULL);
+      *reinterpret_cast<int64_t*>(value) = v.val;
+      return !v.is_null;
+    }
+    case TYPE_FLOAT: {
+      FloatVal v = expr->GetFloatVal(ctx, NULL);
+      *reinterpret_cast<float*>(value) = v.val;
+      return !v.is_null && !isnan(v.val);
+    }
+    case TYPE_DOUBLE: {
+      DoubleVal v = expr->GetDoubleVal(ctx, NULL);
+      *reinterpret_cast<double*>(value) = v.val;
+      return !v.is_null && !isnan(v.val);
+    }
+    default:
+      DCHECK(false) << expr->type();
+      return false;
+  }
+}
+
+/// Evaluates the constant 'expr' of an integer or STRING type and sets 'hash' to its
+/// ParquetBloomFilterHash(). Returns false if the value is NULL.
+bool EvalBloomFilterHash(Expr* expr, ExprContext* ctx, uint32_t* hash) {
+  if (expr->type().type == TYPE_STRING) {
+    StringVal v = expr->GetStringVal(ctx, NULL);
+    if (v.is_null) return false;
+    *hash = ParquetBloomFilterHash(StringValue(reinterpret_cast<char*>(v.ptr), v.len));
+    return true;
+  }
+  int64_t value;
+  if (!EvalConstant(expr, ctx, &value)) return false;
+  switch (expr->type().type) {
+    case TYPE_TINYINT:
+      *hash = ParquetBloomFilterHash(*reinterpret_cast<int8_t*>(&value));
+      return true;
+    case TYPE_SMALLINT:
+      *hash = ParquetBloomFilterHash(*reinterpret_cast<int16_t*>(&value));
+      return true;
+    case TYPE_INT:
+      *hash = ParquetBloomFilterHash(*reinterpret_cast<int32_t*>(&value));
+      return true;
+    case TYPE_BIGINT:
+      *hash = ParquetBloomFilterHash(value);
+      return true;
+    default:
+      DCHECK(false) << expr->type();
+      return false;
+  }
+}
+
+template <typename T>
+bool DecodeStatsValue(const string& encoded, int encoded_size, void* value) {
+  if (encoded.size() < encoded_size) return false;
+  uint8_t* buffer = reinterpret_cast<uint8_t*>(const_cast<char*>(encoded.data()));
+  ParquetPlainEncoder::Decode(buffer, -1, reinterpret_cast<T*>(value));
+  return true;
+}
+
+/// Decodes a PLAIN-encoded min or max value of a column of 'type' into 'value'. Returns
+/// false if 'encoded' is not a valid value.
+bool DecodeStatsValue(const string& encoded, const ColumnType& type, void* value) {
+  int encoded_size = ParquetPlainEncoder::ByteSize(type);
+  switch (type.type) {
+    case TYPE_TINYINT: return DecodeStatsValue<int8_t>(encoded, encoded_size, value);
+    case TYPE_SMALLINT: return DecodeStatsValue<int16_t>(encoded, encoded_size, value);
+    case TYPE_INT: return DecodeStatsValue<int32_t>(encoded, encoded_size, value);
+    case TYPE_BIGINT: return DecodeStatsValue<int64_t>(encoded, encoded_size, value);
+    case TYPE_FLOAT:
+      return DecodeStatsValue<float>(encoded, encoded_size, value) &&
+          !isnan(*reinterpret_cast<float*>(value));
+    case TYPE_DOUBLE:
+      return DecodeStatsValue<double>(encoded, encoded_size, value) &&
+          !isnan(*reinterpret_cast<double*>(value));
+    default:
+      DCHECK(false) << type;
+      return false;
+  }
+}
+
+/// Returns false if 'expr' or one of its children calls a UDF or a builtin that may
+/// return different results for the same arguments.
+bool IsDeterministic(const Expr* expr) {
+  const TFunction& fn = expr->fn();
+  if (fn.binary_type != TFunctionBinaryType::BUILTIN) return false;
+  const string& fn_name = fn.name.function_name;
+  if (fn_name == "rand" || fn_name == "random") return false;
+  for (int i = 0; i < expr->GetNumChildren(); ++i) {
+    if (!IsDeterministic(expr->GetChild(i))) return false;
+  }
+  return true;
+}
+
+/// Returns true if 'expr' only references the slot 'slot_id' and always returns the
+/// same result for the same value of the slot, so that it can be evaluated once per
+/// dictionary entry instead of once per row.
+bool IsDictFilterConjunct(const Expr* expr, SlotId slot_id) {
+  vector<SlotId> slot_ids;
+  if (expr->GetSlotIds(&slot_ids) == 0) return false;
+  for (int i = 0; i < slot_ids.size(); ++i) {
+    if (slot_ids[i] != slot_id) return false;
+  }
+  return IsDeterministic(expr);
+}
+
+}
+
+Status HdfsParquetScanner::ResolveFileColumn(Expr* slot_expr,
+    const SlotDescriptor** slot_desc, int* col_idx) {
+  DCHECK(slot_expr->is_slotref());
+  *slot_desc = NULL;
+  *col_idx = -1;
+  SlotId slot_id = static_cast<SlotRef*>(slot_expr)->slot_id();
+  BOOST_FOREACH(const SlotDescriptor* desc, scan_node_->tuple_desc()->slots()) {
+    if (desc->id() == slot_id) {
+      *slot_desc = desc;
+      break;
+    }
+  }
+  if (*slot_desc == NULL) return Status::OK();
+  // Partition columns are not stored in the file.
+  if ((*slot_desc)->col_pos() < scan_node_->num_partition_keys()) return Status::OK();
+
+  SchemaNode* node = NULL;
+  bool pos_field;
+  bool missing_field;
+  RETURN_IF_ERROR(
+      ResolvePath((*slot_desc)->col_path(), &node, &pos_field, &missing_field));
+  if (missing_field || pos_field || node->col_idx < 0 || node->max_rep_level > 0) {
+    return Status::OK();
+  }
+  // Only use the column if the file's physical type is the one the column reader
+  // expects. Mismatches are reported when the column is read.
+  if (!node->element->__isset.type || node->element->type !=
+      IMPALA_TO_PARQUET_TYPES[(*slot_desc)->type().type]) {
+    return Status::OK();
+  }
+  *col_idx = node->col_idx;
+  return Status::OK();
+}
+
+Status HdfsParquetScanner::InitStatsConjuncts() {
+  DCHECK(stats_conjuncts_.empty());
+  BOOST_FOREACH(ExprContext* ctx, *scanner_conjunct_ctxs_) {
+    Expr* root = ctx->root();
+    if (root->GetNumChildren() != 2) continue;
+    if (root->fn().binary_type != TFunctionBinaryType::BUILTIN) continue;
+    const string& fn_name = root->fn().name.function_name;
+    StatsConjunct::Op op;
+    if (fn_name == "eq") {
+      op = StatsConjunct::EQ;
+    } else if (fn_name == "lt") {
+      op = StatsConjunct::LT;
+    } else if (fn_name == "le") {
+      op = StatsConjunct::LE;
+    } else if (fn_name == "gt") {
+      op = StatsConjunct::GT;
+    } else if (fn_name == "ge") {
+      op = StatsConjunct::GE;
+    } else {
+      continue;
+    }
+
+    // Normalize to '<slot> <op> <constant>'.
+    Expr* slot_expr = root->GetChild(0);
+    Expr* constant_expr = root->GetChild(1);
+    if (!slot_expr->is_slotref()) {
+      swap(slot_expr, constant_expr);
+      if (op == StatsConjunct::LT) {
+        op = StatsConjunct::GT;
+      } else if (op == StatsConjunct::LE) {
+        op = StatsConjunct::GE;
+      } else if (op == StatsConjunct::GT) {
+        op = StatsConjunct::LT;
+      } else if (op == StatsConjunct::GE) {
+        op = StatsConjunct::LE;
+      }
+    }
+    if (!slot_expr->is_slotref() || !constant_expr->IsConstant()) continue;
+    if (!StatsSupportedForType(slot_expr->type()) ||
+        slot_expr->type() != constant_expr->type()) {
+      continue;
+    }
+
+    const SlotDescriptor* slot_desc;
+    int col_idx;
+    RETURN_IF_ERROR(ResolveFileColumn(slot_expr, &slot_desc, &col_idx));
+    if (col_idx < 0) continue;
+
+    StatsConjunct stats_conjunct;
+    stats_conjunct.slot_desc = slot_desc;
+    stats_conjunct.col_idx = col_idx;
+    stats_conjunct.op = op;
+    // A NULL constant means the conjunct never passes, but leave that to the planner.
+    if (!EvalConstant(constant_expr, ctx, &stats_conjunct.value)) continue;
+    stats_conjuncts_.push_back(stats_conjunct);
+  }
+  return Status::OK();
+}
+
+bool HdfsParquetScanner::RowGroupFailsStats(const parquet::RowGroup& row_group) {
+  BOOST_FOREACH(const StatsConjunct& conjunct, stats_conjuncts_) {
+    if (conjunct.col_idx >= row_group.columns.size()) continue;
+    const parquet::ColumnMetaData& col_metadata =
+        row_group.columns[conjunct.col_idx].meta_data;
+    if (!col_metadata.__isset.statistics) continue;
+    const parquet::Statistics& stats = col_metadata.statistics;
+    // Comparisons with NULL never pass.
+    if (stats.__isset.null_count && stats.null_count == row_group.num_rows) return true;
+    if (!stats.__isset.min || !stats.__isset.max) continue;
+
+    const ColumnType& type = conjunct.slot_desc->type();
+    int64_t min_value;
+    int64_t max_value;
+    if (!DecodeStatsValue(stats.min, type, &min_value) ||
+        !DecodeStatsValue(stats.max, type, &max_value)) {
+      continue;
+    }
+    int min_cmp = RawValue::Compare(&min_value, &conjunct.value, type);
+    int max_cmp = RawValue::Compare(&max_value, &conjunct.value, type);
+    switch (conjunct.op) {
+      case StatsConjunct::EQ:
+        if (min_cmp > 0 || max_cmp < 0) return true;
+        break;
+      case StatsConjunct::LT:
+        if (min_cmp >= 0) return true;
+        break;
+      case StatsConjunct::LE:
+        if (min_cmp > 0) return true;
+        break;
+      case StatsConjunct::GT:
+        if (max_cmp <= 0) return true;
+        break;
+      case StatsConjunct::GE:
+        if (max_cmp < 0) return true;
+        break;
+    }
+  }
+  return false;
+}
+
+Status HdfsParquetScanner::InitBloomFilterConjuncts() {
+  DCHECK(bloom_filter_conjuncts_.empty());
+  BOOST_FOREACH(ExprContext* ctx, *scanner_conjunct_ctxs_) {
+    Expr* root = ctx->root();
+    if (root->GetNumChildren() < 2) continue;
+    if (root->fn().binary_type != TFunctionBinaryType::BUILTIN) continue;
+    const string& fn_name = root->fn().name.function_name;
+    Expr* slot_expr = root->GetChild(0);
+    vector<Expr*> constant_exprs;
+    if (fn_name == "eq" && root->GetNumChildren() == 2) {
+      constant_exprs.push_back(root->GetChild(1));
+      if (!slot_expr->is_slotref()) swap(slot_expr, constant_exprs[0]);
+    } else if (fn_name == "in_iterate" || fn_name == "in_set_lookup") {
+      for (int i = 1; i < root->GetNumChildren(); ++i) {
+        constant_exprs.push_back(root->GetChild(i));
+      }
+    } else {
+      continue;
+    }
+    if (!slot_expr->is_slotref()) continue;
+    // The file may store CHAR and VARCHAR values longer than the column, which are
+    // truncated when they are read, so only STRING columns are probed.
+    const ColumnType& type = slot_expr->type();
+    if (type.type == TYPE_VARCHAR || type.type == TYPE_CHAR ||
+        !ParquetBloomFilterSupported(type)) {
+      continue;
+    }
+
+    BloomFilterConjunct conjunct;
+    bool all_constant = true;
+    BOOST_FOREACH(Expr* constant_expr, constant_exprs) {
+      if (!constant_expr->IsConstant() || constant_expr->type() != type) {
+        all_constant = false;
+        break;
+      }
+      // NULLs never pass the equality.
+      uint32_t hash;
+      if (EvalBloomFilterHash(constant_expr, ctx, &hash)) {
+        conjunct.hashes.push_back(hash);
+      }
+    }
+    if (!all_constant || conjunct.hashes.empty()) continue;
+
+    const SlotDescriptor* slot_desc;
+    RETURN_IF_ERROR(ResolveFileColumn(slot_expr, &slot_desc, &conjunct.col_idx));
+    if (conjunct.col_idx < 0) continue;
+    bloom_filter_conjuncts_.push_back(conjunct);
+  }
+  return Status::OK();
+}
+
+Status HdfsParquetScanner::ReadBloomFilter(const parquet::ColumnMetaData& col_metadata,
+    scoped_ptr<BloomFilter>* filter) {
+  filter->reset();
+  int64_t offset = -1;
+  int log_space = -1;
+  BOOST_FOREACH(const parquet::KeyValue& kv, col_metadata.key_value_metadata) {
+    if (!kv.__isset.value) continue;
+    StringParser::ParseResult result;
+    if (kv.key == PARQUET_BLOOM_FILTER_OFFSET_KEY) {
+      offset = StringParser::StringToInt<int64_t>(
+          kv.value.c_str(), kv.value.size(), &result);
+      if (result != StringParser::PARSE_SUCCESS) offset = -1;
+    } else if (kv.key == PARQUET_BLOOM_FILTER_LOG_SPACE_KEY) {
+      log_space = StringParser::StringToInt<int>(
+          kv.value.c_str(), kv.value.size(), &result);
+      if (result != StringParser::PARSE_SUCCESS) log_space = -1;
+    }
+  }
+  // The writer never writes filters of less than two buckets. Filters larger than an io
+  // buffer are not worth a synchronous read.
+  DiskIoMgr* io_mgr = scan_node_->runtime_state()->io_mgr();
+  if (offset < 0 || log_space < 7 || log_space > 30) return Status::OK();
+  int64_t len = BloomFilter::GetExpectedHeapSpaceUsed(log_space);
+  if (len > io_mgr->max_read_buffer_size()) return Status::OK();
+  const HdfsFileDesc* file_desc = scan_node_->GetFileDesc(filename());
+  if (offset + len > file_desc->file_length) {
+    return Status(Substitute("File $0: metadata is corrupt. Bloom filter at offset $1 "
+        "of $2 bytes exceeds the file size $3.", filename(), offset, len,
+        file_desc->file_length));
+  }
+
+  DiskIoMgr::ScanRange* range = scan_node_->AllocateScanRange(
+      metadata_range_->fs(), filename(), len, offset, -1, metadata_range_->disk_id(),
+      metadata_range_->try_cache(), metadata_range_->expected_local(),
+      file_desc->mtime);
+  DiskIoMgr::BufferDescriptor* io_buffer = NULL;
+  RETURN_IF_ERROR(io_mgr->Read(scan_node_->reader_context(), range, &io_buffer));
+  TBloomFilter thrift_filter;
+  thrift_filter.log_heap_space = log_space;
+  thrift_filter.directory.assign(io_buffer->buffer(), io_buffer->len());
+  io_buffer->Return();
+  if (thrift_filter.directory.size() != len) {
+    return Status(Substitute("File $0: could not read the Bloom filter at offset $1.",
+        filename(), offset));
+  }
+  filter->reset(new BloomFilter(thrift_filter, NULL, NULL));
+  return Status::OK();
+}
+
+Status HdfsParquetScanner::RowGroupFailsBloomFilters(int row_group_idx, bool* fails) {
+  *fails = false;
+  if (bloom_filter_conjuncts_.empty()) return Status::OK();
+  DCHECK_LT(row_group_idx, bloom_filter_results_.size());
+  int8_t* result = &bloom_filter_results_[row_group_idx];
+  if (*result >= 0) {
+    *fails = *result;
+    return Status::OK();
+  }
+  const parquet::RowGroup& row_group = file_metadata_.row_groups[row_group_idx];
+  BOOST_FOREACH(const BloomFilterConjunct& conjunct, bloom_filter_conjuncts_) {
+    if (conjunct.col_idx >= row_group.columns.size()) continue;
+    scoped_ptr<BloomFilter> filter;
+    RETURN_IF_ERROR(
+        ReadBloomFilter(row_group.columns[conjunct.col_idx].meta_data, &filter));
+    if (filter == NULL) continue;
+    bool found = false;
+    for (int i = 0; i < conjunct.hashes.size() && !found; ++i) {
+      found = filter->Find(conjunct.hashes[i]);
+    }
+    if (!found) {
+      *fails = true;
+      break;
+    }
+  }
+  *result = *fails;
+  return Status::OK();
+}
+
+bool HdfsParquetScanner::RowGroupFailsDictionaryFilters(
+    const parquet::RowGroup& row_group) {
+  for (int i = 0; i < filter_ctxs_.size(); ++i) {
+    if (!filter_stats_[i].enabled) continue;
+    const RuntimeFilter* filter = filter_ctxs_[i]->filter;
+    if (filter->GetBloomFilter() == NULL) continue;
+    Expr* filter_expr = filter_ctxs_[i]->expr->root();
+    if (!filter_expr->is_slotref()) continue;
+    SlotId slot_id = static_cast<SlotRef*>(filter_expr)->slot_id();
+
+    BOOST_FOREACH(ColumnReader* col_reader, column_readers_) {
+      if (col_reader->IsCollectionReader() || col_reader->max_rep_level() > 0) continue;
+      if (col_reader->slot_desc() == NULL || col_reader->slot_desc()->id() != slot_id) {
+        continue;
+      }
+      BaseScalarColumnReader* scalar_reader =
+          static_cast<BaseScalarColumnReader*>(col_reader);
+      const parquet::ColumnMetaData& col_metadata =
+          row_group.columns[scalar_reader->col_idx()].meta_data;
+      // The dictionary only covers all values if no data page fell back to PLAIN.
+      if (find(col_metadata.encodings.begin(), col_metadata.encodings.end(),
+          parquet::Encoding::PLAIN) != col_metadata.encodings.end()) {
+        break;
+      }
+      // Rows with NULLs in this column are not covered by the dictionary.
+      bool may_have_nulls = scalar_reader->max_def_level() > 0 &&
+          (!col_metadata.__isset.statistics ||
+           !col_metadata.statistics.__isset.null_count ||
+           col_metadata.statistics.null_count > 0);
+      if (may_have_nulls && filter->Eval<void>(NULL, filter_expr->type())) break;
+      if (scalar_reader->DictionaryFailsFilter(filter)) {
+        filter_ctxs_[i]->stats->IncrCounters(FilterStats::ROW_GROUPS_KEY, 1, 1, 1);
+        return true;
+      }
+      break;
+    }
+  }
+  return false;
+}
+
+bool HdfsParquetScanner::RowGroupFailsMinMaxFilters(const parquet::RowGroup& row_group,
+    bool update_filter_stats) {
+  for (int i = 0; i < filter_ctxs_.size(); ++i) {
+    if (!filter_stats_[i].enabled) continue;
+    const MinMaxFilter* min_max_filter = filter_ctxs_[i]->filter->GetMinMaxFilter();
+    if (min_max_filter == NULL) continue;
+    Expr* filter_expr = filter_ctxs_[i]->expr->root();
+    if (!filter_expr->is_slotref()) continue;
+    const ColumnType& type = filter_expr->type();
+    if (!MinMaxFilter::SupportsType(type)) continue;
+    SlotId slot_id = static_cast<SlotRef*>(filter_expr)->slot_id();
+
+    BOOST_FOREACH(ColumnReader* col_reader, column_readers_) {
+      if (col_reader->IsCollectionReader() || col_reader->max_rep_level() > 0) continue;
+      if (col_reader->slot_desc() == NULL || col_reader->slot_desc()->id() != slot_id) {
+        continue;
+      }
+      BaseScalarColumnReader* scalar_reader =
+          static_cast<BaseScalarColumnReader*>(col_reader);
+      const parquet::ColumnMetaData& col_metadata =
+          row_group.columns[scalar_reader->col_idx()].meta_data;
+      if (!col_metadata.__isset.statistics) break;
+      const parquet::Statistics& stats = col_metadata.statistics;
+      // NULLs only pass if the filter has one, the range only covers non-NULL values.
+      bool may_have_nulls = scalar_reader->max_def_level() > 0 &&
+          (!stats.__isset.null_count || stats.null_count > 0);
+      if (may_have_nulls && min_max_filter->has_null()) break;
+      bool fails;
+      if (stats.__isset.null_count && stats.null_count == row_group.num_rows) {
+        fails = true;
+      } else {
+        if (!stats.__isset.min || !stats.__isset.max) break;
+        int64_t min_value;
+        int64_t max_value;
+        if (!DecodeStatsValue(stats.min, type, &min_value) ||
+            !DecodeStatsValue(stats.max, type, &max_value)) {
+          break;
+        }
+        fails = !min_max_filter->OverlapsRange(MinMaxFilter::GetValue(&min_value, type),
+            MinMaxFilter::GetValue(&max_value, type));
+      }
+      if (!fails) break;
+      if (update_filter_stats) {
+        filter_ctxs_[i]->stats->IncrCounters(FilterStats::ROW_GROUPS_KEY, 1, 1, 1);
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+bool HdfsParquetScanner::RowGroupFailsTopNBound(const parquet::RowGroup& row_group) {
+  const TopNBound* bound = scan_node_->topn_bound();
+  if (bound == NULL || !bound->is_set()) return false;
+  BOOST_FOREACH(ColumnReader* col_reader, column_readers_) {
+    if (col_reader->IsCollectionReader() || col_reader->max_rep_level() > 0) continue;
+    if (col_reader->slot_desc() == NULL ||
+        col_reader->slot_desc()->id() != bound->slot_id()) {
+      continue;
+    }
+    const ColumnType& type = col_reader->slot_desc()->type();
+    if (!MinMaxFilter::SupportsType(type)) return false;
+    BaseScalarColumnReader* scalar_reader =
+        static_cast<BaseScalarColumnReader*>(col_reader);
+    const parquet::ColumnMetaData& col_metadata =
+        row_group.columns[scalar_reader->col_idx()].meta_data;
+    if (!col_metadata.__isset.statistics) return false;
+    const parquet::Statistics& stats = col_metadata.statistics;
+    bool may_have_nulls = scalar_reader->max_def_level() > 0 &&
+        (!stats.__isset.null_count || stats.null_count > 0);
+    if (may_have_nulls && !bound->NullsFail()) return false;
+    if (stats.__isset.null_count && stats.null_count == row_group.num_rows) return true;
+    if (!stats.__isset.min || !stats.__isset.max) return false;
+    int64_t min_value;
+    int64_t max_value;
+    if (!DecodeStatsValue(stats.min, type, &min_value) ||
+        !DecodeStatsValue(stats.max, type, &max_value)) {
+      return false;
+    }
+    return bound->RangeFails(MinMaxFilter::GetValue(&min_value, type),
+        MinMaxFilter::GetValue(&max_value, type));
+  }
+  return false;
+}
+
+// A row group is processed by the split that contains its mid point.
+static bool IsRowGroupInSplit(const parquet::RowGroup& row_group,
+    const DiskIoMgr::ScanRange* split_range) {
+  int64_t row_group_mid_pos = GetRowGroupMidOffset(row_group);
+  int64_t split_offset = split_range->offset();
+  int64_t split_length = split_range->len();
+  return row_group_mid_pos >= split_offset &&
+      row_group_mid_pos < split_offset + split_length;
+}
+
 Status HdfsParquetScanner::ProcessSplit() {
   DCHECK(parse_status_.ok()) << "Invalid parse_status_" << parse_status_.GetDetail();
   // First process the file metadata in the footer
@@ -1480,6 +2313,12 @@ Status HdfsParquetScanner::ProcessSplit() {
   RETURN_IF_ERROR(CreateColumnReaders(*scan_node_->tuple_desc(), &column_readers_));
   COUNTER_SET(num_cols_counter_,
       static_cast<int64_t>(CountScalarColumns(column_readers_)));
+  if (FLAGS_parquet_skip_row_groups_using_stats) {
+    RETURN_IF_ERROR(InitStatsConjuncts());
+    RETURN_IF_ERROR(InitBloomFilterConjuncts());
+    bloom_filter_results_.assign(file_metadata_.row_groups.size(), -1);
+  }
+  InitLateMaterialization();
 
   // The scanner-wide stream was used only to read the file footer.  Each column has added
   // its own stream.
@@ -1495,11 +2334,21 @@ Status HdfsParquetScanner::ProcessSplit() {
         reinterpret_cast<ScanRangeMetadata*>(metadata_range_->meta_data())->original_split;
     RETURN_IF_ERROR(ValidateColumnOffsets(row_group));
 
-    int64_t row_group_mid_pos = GetRowGroupMidOffset(row_group);
-    int64_t split_offset = split_range->offset();
-    int64_t split_length = split_range->len();
-    if (!(row_group_mid_pos >= split_offset &&
-        row_group_mid_pos < split_offset + split_length)) continue;
+    if (!IsRowGroupInSplit(row_group, split_range)) continue;
+    if (RowGroupFailsStats(row_group) || RowGroupFailsMinMaxFilters(row_group, true)) {
+      COUNTER_ADD(num_stats_filtered_row_groups_counter_, 1);
+      continue;
+    }
+    bool fails_bloom_filters;
+    RETURN_IF_ERROR(RowGroupFailsBloomFilters(i, &fails_bloom_filters));
+    if (fails_bloom_filters) {
+      COUNTER_ADD(num_bloom_filtered_row_groups_counter_, 1);
+      continue;
+    }
+    if (RowGroupFailsTopNBound(row_group)) {
+      COUNTER_ADD(num_topn_filtered_row_groups_counter_, 1);
+      continue;
+    }
     COUNTER_ADD(num_row_groups_counter_, 1);
 
     // Attach any resources and clear the streams before starting a new row group. These
@@ -1510,6 +2359,8 @@ Status HdfsParquetScanner::ProcessSplit() {
     CommitRows(0);
 
     RETURN_IF_ERROR(InitColumns(i, column_readers_));
+    // Start reading the next row group while this one is assembled.
+    PrefetchRowGroup(i + 1);
 
     assemble_rows_timer_.Start();
 
@@ -1526,6 +2377,14 @@ Status HdfsParquetScanner::ProcessSplit() {
       DCHECK(parse_status_.ok()) << "Invalid parse_status_" << parse_status_.GetDetail();
     }
 
+    if (continue_execution && RowGroupFailsDictionaryFilters(row_group)) {
+      assemble_rows_timer_.Stop();
+      COUNTER_ADD(num_dict_filtered_row_groups_counter_, 1);
+      context_->ReleaseCompletedResources(batch_, /* done */ true);
+      continue;
+    }
+    InitDictFilters(row_group);
+
     bool filters_pass = true;
     if (continue_execution) {
       continue_execution = in_collection ?
@@ -1570,7 +2429,10 @@ bool HdfsParquetScanner::AssembleRows(const TupleDescriptor* tuple_desc,
   }
 
   Tuple* template_tuple = template_tuple_map_[tuple_desc];
-  const vector<ExprContext*> conjunct_ctxs = scanner_conjuncts_map_[tuple_desc->id()];
+  // The conjuncts of top-level tuples that were evaluated against dictionaries by
+  // InitDictFilters() are applied by the column readers.
+  const vector<ExprContext*>& conjunct_ctxs = MATERIALIZING_COLLECTION ?
+      scanner_conjuncts_map_[tuple_desc->id()] : row_group_conjunct_ctxs_;
 
   int64_t rows_read = 0;
   bool continue_execution = !scan_node_->ReachedLimit() && !context_->cancelled();
@@ -1619,6 +2481,7 @@ bool HdfsParquetScanner::AssembleRows(const TupleDescriptor* tuple_desc,
       num_rows = std::min(
           num_rows, static_cast<int64_t>(scan_node_->runtime_state()->batch_size()));
     }
+    Tuple* first_tuple = tuple;
     int num_to_commit = 0;
     int row_idx = 0;
     for (row_idx = 0; row_idx < num_rows && !end_of_collection; ++row_idx) {
@@ -1629,14 +2492,23 @@ bool HdfsParquetScanner::AssembleRows(const TupleDescriptor* tuple_desc,
       bool materialize_tuple = !IN_COLLECTION || column_readers[0]->def_level() >=
           column_readers[0]->def_level_of_immediate_repeated_ancestor();
       InitTuple(tuple_desc, template_tuple, tuple);
-      continue_execution =
-          ReadRow<IN_COLLECTION>(column_readers, tuple, pool, &materialize_tuple);
+      // Late materialization evaluates the conjuncts while reading the row.
+      bool late_materialization = !MATERIALIZING_COLLECTION && late_materialization_;
+      if (late_materialization) {
+        row->SetTuple(scan_node_->tuple_idx(), tuple);
+        continue_execution = ReadRowLateMaterialized(column_readers, conjunct_ctxs,
+            tuple, row, pool, &materialize_tuple);
+      } else {
+        continue_execution =
+            ReadRow<IN_COLLECTION>(column_readers, tuple, pool, &materialize_tuple);
+      }
       if (UNLIKELY(!continue_execution)) break;
       end_of_collection = column_readers[0]->rep_level() <= new_collection_rep_level;
 
       if (materialize_tuple) {
         if (!MATERIALIZING_COLLECTION) row->SetTuple(scan_node_->tuple_idx(), tuple);
-        if (ExecNode::EvalConjuncts(&conjunct_ctxs[0], conjunct_ctxs.size(), row)) {
+        if (late_materialization ||
+            ExecNode::EvalConjuncts(&conjunct_ctxs[0], conjunct_ctxs.size(), row)) {
           if (!MATERIALIZING_COLLECTION) row = next_row(row);
           tuple = next_tuple(tuple_desc->byte_size(), tuple);
           ++num_to_commit;
@@ -1653,6 +2525,9 @@ bool HdfsParquetScanner::AssembleRows(const TupleDescriptor* tuple_desc,
 
     rows_read += row_idx;
     COUNTER_ADD(scan_node_->rows_read_counter(), row_idx);
+    if (!IN_COLLECTION && !late_materialization_) {
+      num_to_commit = EvalRuntimeFiltersBatch(first_tuple, num_to_commit);
+    }
     if (!MATERIALIZING_COLLECTION) {
       Status query_status = CommitRows(num_to_commit);
       if (!query_status.ok()) continue_execution = false;
@@ -1709,34 +2584,227 @@ inline bool HdfsParquetScanner::ReadRow(const vector<ColumnReader*>& column_read
   }
   *materialize_tuple &= conjuncts_passed;
 
-  if (!IN_COLLECTION && *materialize_tuple) {
-    TupleRow* tuple_row_mem = reinterpret_cast<TupleRow*>(&tuple);
-    int num_filters = filter_ctxs_.size();
-    for (int i = 0; i < num_filters; ++i) {
-      LocalFilterStats* stats = &filter_stats_[i];
-      if (!stats->enabled) continue;
-      ++stats->total_possible;
-      // Check filter effectiveness every ROWS_PER_FILTER_SELECTIVITY_CHECK rows.
-      if (UNLIKELY(
-          !(stats->total_possible & (ROWS_PER_FILTER_SELECTIVITY_CHECK - 1)))) {
-        double reject_ratio = stats->rejected / static_cast<double>(stats->considered);
-        if (reject_ratio < FLAGS_parquet_min_filter_reject_ratio) {
-          stats->enabled = 0;
-          continue;
-        }
+  // Runtime filters of top-level tuples are evaluated by AssembleRows() over the whole
+  // batch with EvalRuntimeFiltersBatch().
+  return continue_execution;
+}
+
+inline bool HdfsParquetScanner::ReadRowLateMaterialized(
+    const vector<ColumnReader*>& column_readers,
+    const vector<ExprContext*>& conjunct_ctxs, Tuple* tuple, TupleRow* row,
+    MemPool* pool, bool* materialize_tuple) {
+  DCHECK(late_materialization_);
+  bool conjuncts_passed = true;
+  int size = column_readers.size();
+  int c = 0;
+  for (; c < num_conjunct_readers_; ++c) {
+    if (UNLIKELY(!column_readers[c]->ReadNonRepeatedValue(pool, tuple,
+        &conjuncts_passed))) {
+      return false;
+    }
+  }
+  *materialize_tuple = conjuncts_passed &&
+      ExecNode::EvalConjuncts(&conjunct_ctxs[0], conjunct_ctxs.size(), row);
+  if (*materialize_tuple) {
+    for (; c < size; ++c) {
+      if (UNLIKELY(!column_readers[c]->ReadNonRepeatedValue(pool, tuple,
+          &conjuncts_passed))) {
+        return false;
       }
-      ++stats->considered;
-      const RuntimeFilter* filter = filter_ctxs_[i]->filter;
-      void* e = filter_ctxs_[i]->expr->GetValue(tuple_row_mem);
-      if (!filter->Eval<void>(e, filter_ctxs_[i]->expr->root()->type())) {
-        ++stats->rejected;
-        *materialize_tuple = false;
-        break;
+    }
+    *materialize_tuple = EvalRuntimeFilters(tuple);
+  } else {
+    for (; c < size; ++c) {
+      if (UNLIKELY(!column_readers[c]->SkipNonRepeatedValue())) return false;
+    }
+  }
+  return true;
+}
+
+inline bool HdfsParquetScanner::EvalRuntimeFilters(Tuple* tuple) {
+  TupleRow* tuple_row_mem = reinterpret_cast<TupleRow*>(&tuple);
+  int num_filters = filter_ctxs_.size();
+  for (int i = 0; i < num_filters; ++i) {
+    LocalFilterStats* stats = &filter_stats_[i];
+    if (!stats->enabled) continue;
+    ++stats->total_possible;
+    const RuntimeFilter* filter = filter_ctxs_[i]->filter;
+    // Rows seen before the filter arrived say nothing about its selectivity.
+    if (filter->GetBloomFilter() == NULL) continue;
+    // Check filter effectiveness every ROWS_PER_FILTER_SELECTIVITY_CHECK rows.
+    if (UNLIKELY(stats->considered > 0 &&
+        !(stats->considered & (ROWS_PER_FILTER_SELECTIVITY_CHECK - 1)))) {
+      if (!CheckFilterSelectivity(i)) continue;
+    }
+    ++stats->considered;
+    void* e = filter_ctxs_[i]->expr->GetValue(tuple_row_mem);
+    if (!filter->Eval<void>(e, filter_ctxs_[i]->expr->root()->type())) {
+      ++stats->rejected;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool HdfsParquetScanner::CheckFilterSelectivity(int filter_idx) {
+  LocalFilterStats* stats = &filter_stats_[filter_idx];
+  const FilterStats* scan_stats = filter_ctxs_[filter_idx]->stats;
+  scan_stats->AddSample(stats->considered - stats->reported_considered,
+      stats->rejected - stats->reported_rejected, MIN_ROWS_TO_DISABLE_FILTER_FOR_SCAN,
+      FLAGS_parquet_min_filter_reject_ratio);
+  stats->reported_considered = stats->considered;
+  stats->reported_rejected = stats->rejected;
+  if (stats->considered == 0) return true;
+  double reject_ratio = stats->rejected / static_cast<double>(stats->considered);
+  if (reject_ratio >= FLAGS_parquet_min_filter_reject_ratio) return true;
+  stats->enabled = 0;
+  scan_stats->RecordScannerDisabled();
+  return false;
+}
+
+int HdfsParquetScanner::EvalRuntimeFiltersBatch(Tuple* first_tuple, int num_tuples) {
+  if (filter_ctxs_.empty() || num_tuples == 0) return num_tuples;
+  if (filter_tuple_idxs_.size() < num_tuples) {
+    filter_tuple_idxs_.resize(num_tuples);
+    filter_hashes_.resize(num_tuples);
+    filter_found_.resize(num_tuples);
+  }
+  const int tuple_byte_size = scan_node_->tuple_desc()->byte_size();
+  uint8_t* tuple_mem = reinterpret_cast<uint8_t*>(first_tuple);
+  for (int i = 0; i < num_tuples; ++i) filter_tuple_idxs_[i] = i;
+  int num_passed = num_tuples;
+
+  int num_filters = filter_ctxs_.size();
+  for (int i = 0; i < num_filters && num_passed > 0; ++i) {
+    LocalFilterStats* stats = &filter_stats_[i];
+    if (!stats->enabled) continue;
+    stats->total_possible += num_passed;
+    const RuntimeFilter* filter = filter_ctxs_[i]->filter;
+    // Read the bloom filter once, it may be set concurrently. Until it arrives all rows
+    // pass, as in RuntimeFilter::Eval(), and they say nothing about its selectivity.
+    const BloomFilter* bloom_filter = filter->GetBloomFilter();
+    if (bloom_filter == NULL) continue;
+    // Check filter effectiveness every ROWS_PER_FILTER_SELECTIVITY_CHECK rows.
+    if (UNLIKELY(stats->considered / ROWS_PER_FILTER_SELECTIVITY_CHECK !=
+        (stats->considered + num_passed) / ROWS_PER_FILTER_SELECTIVITY_CHECK)) {
+      if (!CheckFilterSelectivity(i)) continue;
+    }
+    stats->considered += num_passed;
+    const MinMaxFilter* min_max_filter = filter->GetMinMaxFilter();
+    ExprContext* expr_ctx = filter_ctxs_[i]->expr;
+    const ColumnType& col_type = expr_ctx->root()->type();
+
+    // The value returned by GetValue() may be overwritten by the next call, so the range
+    // check and the hash are computed right away. Only the bloom filter probe is batched.
+    int num_hashed = 0;
+    for (int j = 0; j < num_passed; ++j) {
+      int tuple_idx = filter_tuple_idxs_[j];
+      Tuple* tuple = reinterpret_cast<Tuple*>(tuple_mem + tuple_idx * tuple_byte_size);
+      void* e = expr_ctx->GetValue(reinterpret_cast<TupleRow*>(&tuple));
+      if (min_max_filter != NULL && !min_max_filter->Find(e, col_type)) continue;
+      filter_hashes_[num_hashed] =
+          RawValue::GetHashValue(e, col_type, RuntimeFilterBank::DefaultHashSeed());
+      filter_tuple_idxs_[num_hashed++] = tuple_idx;
+    }
+    bloom_filter->FindBatch(&filter_hashes_[0], num_hashed, &filter_found_[0]);
+    int num_found = 0;
+    for (int j = 0; j < num_hashed; ++j) {
+      filter_tuple_idxs_[num_found] = filter_tuple_idxs_[j];
+      num_found += filter_found_[j];
+    }
+    stats->rejected += num_passed - num_found;
+    num_passed = num_found;
+  }
+
+  // The rows of the batch already point to consecutive tuples, so only the tuples need
+  // to be moved. 'filter_tuple_idxs_' is increasing, so no tuple is overwritten before
+  // it is moved.
+  for (int i = 0; i < num_passed; ++i) {
+    int tuple_idx = filter_tuple_idxs_[i];
+    if (tuple_idx == i) continue;
+    memcpy(tuple_mem + i * tuple_byte_size, tuple_mem + tuple_idx * tuple_byte_size,
+        tuple_byte_size);
+  }
+  return num_passed;
+}
+
+void HdfsParquetScanner::InitDictFilters(const parquet::RowGroup& row_group) {
+  row_group_conjunct_ctxs_ = *scanner_conjunct_ctxs_;
+  if (!FLAGS_parquet_dictionary_filtering) return;
+  BOOST_FOREACH(ColumnReader* col_reader, column_readers_) {
+    if (row_group_conjunct_ctxs_.empty()) return;
+    if (col_reader->IsCollectionReader() || col_reader->max_rep_level() > 0) continue;
+    const SlotDescriptor* slot_desc = col_reader->slot_desc();
+    if (slot_desc == NULL) continue;
+    // Per-row evaluation of conjuncts on other types is cheap enough.
+    PrimitiveType type = slot_desc->type().type;
+    if (type != TYPE_STRING && type != TYPE_VARCHAR) continue;
+    BaseScalarColumnReader* scalar_reader =
+        static_cast<BaseScalarColumnReader*>(col_reader);
+    const parquet::ColumnMetaData& col_metadata =
+        row_group.columns[scalar_reader->col_idx()].meta_data;
+    // The dictionary only covers all values if no data page fell back to PLAIN.
+    if (find(col_metadata.encodings.begin(), col_metadata.encodings.end(),
+        parquet::Encoding::PLAIN) != col_metadata.encodings.end()) {
+      continue;
+    }
+
+    vector<ExprContext*> dict_conjunct_ctxs;
+    vector<ExprContext*> other_conjunct_ctxs;
+    BOOST_FOREACH(ExprContext* ctx, row_group_conjunct_ctxs_) {
+      if (IsDictFilterConjunct(ctx->root(), slot_desc->id())) {
+        dict_conjunct_ctxs.push_back(ctx);
+      } else {
+        other_conjunct_ctxs.push_back(ctx);
       }
     }
+    if (dict_conjunct_ctxs.empty()) continue;
+    if (dict_filter_tuple_ == NULL) {
+      dict_filter_tuple_ = scan_node_->InitEmptyTemplateTuple(*scan_node_->tuple_desc());
+    }
+    // Evaluating the conjuncts for more entries than there are rows doesn't pay off.
+    if (!scalar_reader->InitDictFilter(dict_conjunct_ctxs, dict_filter_tuple_,
+        row_group.num_rows)) {
+      continue;
+    }
+    row_group_conjunct_ctxs_.swap(other_conjunct_ctxs);
+    COUNTER_ADD(num_dict_filtered_column_chunks_counter_, 1);
   }
+}
 
-  return continue_execution;
+void HdfsParquetScanner::InitLateMaterialization() {
+  late_materialization_ = false;
+  num_conjunct_readers_ = 0;
+  if (!FLAGS_parquet_late_materialization || scanner_conjunct_ctxs_->empty()) return;
+  BOOST_FOREACH(ColumnReader* col_reader, column_readers_) {
+    // Values can only be skipped for top-level scalar columns.
+    if (col_reader->IsCollectionReader() || col_reader->max_rep_level() > 0) return;
+  }
+
+  vector<SlotId> conjunct_slot_ids;
+  BOOST_FOREACH(ExprContext* ctx, *scanner_conjunct_ctxs_) {
+    ctx->root()->GetSlotIds(&conjunct_slot_ids);
+  }
+  // Move the readers of slots referenced by the conjuncts to the front, preserving the
+  // relative order of the readers otherwise.
+  vector<ColumnReader*> conjunct_readers;
+  vector<ColumnReader*> other_readers;
+  BOOST_FOREACH(ColumnReader* col_reader, column_readers_) {
+    const SlotDescriptor* slot_desc = col_reader->slot_desc();
+    if (slot_desc != NULL && find(conjunct_slot_ids.begin(), conjunct_slot_ids.end(),
+        slot_desc->id()) != conjunct_slot_ids.end()) {
+      conjunct_readers.push_back(col_reader);
+    } else {
+      other_readers.push_back(col_reader);
+    }
+  }
+  // Nothing can be skipped if the conjuncts reference all columns.
+  if (other_readers.empty()) return;
+  num_conjunct_readers_ = conjunct_readers.size();
+  column_readers_ = conjunct_readers;
+  column_readers_.insert(column_readers_.end(), other_readers.begin(),
+      other_readers.end());
+  late_materialization_ = true;
 }
 
 Status HdfsParquetScanner::ProcessFooter(bool* eosr) {
@@ -1793,12 +2861,16 @@ Status HdfsParquetScanner::ProcessFooter(bool* eosr) {
   vector<uint8_t> metadata_buffer;
 
   DCHECK(metadata_range_ != NULL);
-  if (UNLIKELY(metadata_size > remaining_bytes_buffered)) {
+  const HdfsFileDesc* file_desc = stream_->file_desc();
+  shared_ptr<const parquet::FileMetaData> cached_metadata =
+      ParquetMetadataCache::instance()->Lookup(filename(), file_desc->mtime);
+  if (cached_metadata.get() != NULL) {
+    COUNTER_ADD(num_footer_cache_hits_counter_, 1);
+    file_metadata_ = *cached_metadata;
+  } else if (UNLIKELY(metadata_size > remaining_bytes_buffered)) {
     // In this case, the metadata is bigger than our guess meaning there are
     // not enough bytes in the footer range from IssueInitialRanges().
     // We'll just issue more ranges to the IoMgr that is the actual footer.
-    const HdfsFileDesc* file_desc = scan_node_->GetFileDesc(filename());
-    DCHECK(file_desc != NULL);
     // The start of the metadata is:
     // file_length - 4-byte metadata size - footer-size - metadata size
     int64_t metadata_start = file_desc->file_length -
@@ -1838,18 +2910,27 @@ Status HdfsParquetScanner::ProcessFooter(bool* eosr) {
     DCHECK_EQ(metadata_bytes_to_read, 0);
   }
 
-  // Deserialize file header
-  // TODO: this takes ~7ms for a 1000-column table, figure out how to reduce this.
-  Status status =
-      DeserializeThriftMsg(metadata_ptr, &metadata_size, true, &file_metadata_);
-  if (!status.ok()) {
-    return Status(Substitute("File $0 has invalid file metadata at file offset $1. "
-        "Error = $2.", filename(),
-        metadata_size + sizeof(PARQUET_VERSION_NUMBER) + sizeof(uint32_t),
-        status.GetDetail()));
+  uint32_t serialized_size = metadata_size;
+  if (cached_metadata.get() == NULL) {
+    // Deserialize file header
+    // TODO: this takes ~7ms for a 1000-column table, figure out how to reduce this.
+    Status status =
+        DeserializeThriftMsg(metadata_ptr, &metadata_size, true, &file_metadata_);
+    if (!status.ok()) {
+      return Status(Substitute("File $0 has invalid file metadata at file offset $1. "
+          "Error = $2.", filename(),
+          metadata_size + sizeof(PARQUET_VERSION_NUMBER) + sizeof(uint32_t),
+          status.GetDetail()));
+    }
   }
 
   RETURN_IF_ERROR(ValidateFileMetadata());
+  if (cached_metadata.get() == NULL) {
+    // Only cache valid footers. The entry is charged its serialized size.
+    ParquetMetadataCache::instance()->Insert(filename(), file_desc->mtime,
+        shared_ptr<const parquet::FileMetaData>(
+            new parquet::FileMetaData(file_metadata_)), serialized_size);
+  }
   // Parse file schema
   RETURN_IF_ERROR(CreateSchemaTree(file_metadata_.schema, &schema_));
 
@@ -2248,28 +3329,54 @@ Status HdfsParquetScanner::CreateCountingReader(
 
 Status HdfsParquetScanner::InitColumns(
     int row_group_idx, const vector<ColumnReader*>& column_readers) {
+  // All the scan ranges (one for each column).
+  vector<DiskIoMgr::ScanRange*> col_ranges;
+  bool prefetched = row_group_idx == prefetched_row_group_idx_;
+  if (prefetched) {
+    col_ranges.swap(prefetched_ranges_);
+    prefetched_row_group_idx_ = -1;
+  } else {
+    CancelPrefetchedRanges();
+    RETURN_IF_ERROR(CreateColumnRanges(row_group_idx, column_readers, &col_ranges));
+  }
+
+  int range_idx = 0;
+  RETURN_IF_ERROR(
+      InitColumnStreams(row_group_idx, column_readers, col_ranges, &range_idx));
+  DCHECK_EQ(range_idx, col_ranges.size());
+
+  // Prefetched ranges have already been issued.
+  if (prefetched) return Status::OK();
+
+  // Issue all the column chunks to the io mgr and have them scheduled immediately.
+  // This means these ranges aren't returned via DiskIoMgr::GetNextRange and
+  // instead are scheduled to be read immediately.
+  RETURN_IF_ERROR(scan_node_->runtime_state()->io_mgr()->AddScanRanges(
+      scan_node_->reader_context(), col_ranges, true));
+
+  return Status::OK();
+}
+
+Status HdfsParquetScanner::CreateColumnRanges(int row_group_idx,
+    const vector<ColumnReader*>& column_readers,
+    vector<DiskIoMgr::ScanRange*>* col_ranges) {
   const HdfsFileDesc* file_desc = scan_node_->GetFileDesc(filename());
   DCHECK(file_desc != NULL);
   parquet::RowGroup& row_group = file_metadata_.row_groups[row_group_idx];
 
-  // All the scan ranges (one for each column).
-  vector<DiskIoMgr::ScanRange*> col_ranges;
   // Used to validate that the number of values in each reader in column_readers_ is the
   // same.
   int num_values = -1;
-  // Used to validate we issued the right number of scan ranges
-  int num_scalar_readers = 0;
 
   BOOST_FOREACH(ColumnReader* col_reader, column_readers) {
     if (col_reader->IsCollectionReader()) {
       CollectionColumnReader* collection_reader =
           static_cast<CollectionColumnReader*>(col_reader);
-      collection_reader->Reset();
-      // Recursively init child readers
-      RETURN_IF_ERROR(InitColumns(row_group_idx, *collection_reader->children()));
+      // Recursively create ranges for child readers
+      RETURN_IF_ERROR(
+          CreateColumnRanges(row_group_idx, *collection_reader->children(), col_ranges));
       continue;
     }
-    ++num_scalar_readers;
 
     BaseScalarColumnReader* scalar_reader =
         static_cast<BaseScalarColumnReader*>(col_reader);
@@ -2328,7 +3435,31 @@ Status HdfsParquetScanner::InitColumns(
         metadata_range_->fs(), filename(), col_len, col_start, scalar_reader->col_idx(),
         split_range->disk_id(), split_range->try_cache(), column_range_local,
         file_desc->mtime);
-    col_ranges.push_back(col_range);
+    col_ranges->push_back(col_range);
+  }
+  return Status::OK();
+}
+
+Status HdfsParquetScanner::InitColumnStreams(int row_group_idx,
+    const vector<ColumnReader*>& column_readers,
+    const vector<DiskIoMgr::ScanRange*>& col_ranges, int* range_idx) {
+  parquet::RowGroup& row_group = file_metadata_.row_groups[row_group_idx];
+  BOOST_FOREACH(ColumnReader* col_reader, column_readers) {
+    if (col_reader->IsCollectionReader()) {
+      CollectionColumnReader* collection_reader =
+          static_cast<CollectionColumnReader*>(col_reader);
+      collection_reader->Reset();
+      // Recursively init child readers
+      RETURN_IF_ERROR(InitColumnStreams(row_group_idx, *collection_reader->children(),
+          col_ranges, range_idx));
+      continue;
+    }
+
+    BaseScalarColumnReader* scalar_reader =
+        static_cast<BaseScalarColumnReader*>(col_reader);
+    const parquet::ColumnChunk& col_chunk = row_group.columns[scalar_reader->col_idx()];
+    DCHECK_LT(*range_idx, col_ranges.size());
+    DiskIoMgr::ScanRange* col_range = col_ranges[(*range_idx)++];
 
     // Get the stream that will be used for this column
     ScannerContext::Stream* stream = context_->AddStream(col_range);
@@ -2345,15 +3476,57 @@ Status HdfsParquetScanner::InitColumns(
       stream->set_contains_tuple_data(false);
     }
   }
-  DCHECK_EQ(col_ranges.size(), num_scalar_readers);
+  return Status::OK();
+}
 
-  // Issue all the column chunks to the io mgr and have them scheduled immediately.
-  // This means these ranges aren't returned via DiskIoMgr::GetNextRange and
-  // instead are scheduled to be read immediately.
-  RETURN_IF_ERROR(scan_node_->runtime_state()->io_mgr()->AddScanRanges(
-      scan_node_->reader_context(), col_ranges, true));
+void HdfsParquetScanner::PrefetchRowGroup(int start_idx) {
+  DCHECK_EQ(prefetched_row_group_idx_, -1);
+  if (FLAGS_parquet_row_group_prefetch_max_bytes <= 0) return;
+  const DiskIoMgr::ScanRange* split_range =
+      reinterpret_cast<ScanRangeMetadata*>(metadata_range_->meta_data())->original_split;
+  for (int i = start_idx; i < file_metadata_.row_groups.size(); ++i) {
+    const parquet::RowGroup& row_group = file_metadata_.row_groups[i];
+    if (row_group.num_rows == 0) continue;
+    // Leave reporting invalid metadata to ProcessSplit().
+    if (!ValidateColumnOffsets(row_group).ok()) return;
+    if (!IsRowGroupInSplit(row_group, split_range)) continue;
+    if (RowGroupFailsStats(row_group) || RowGroupFailsMinMaxFilters(row_group, false) ||
+        RowGroupFailsTopNBound(row_group)) {
+      continue;
+    }
+    // The result is kept for ProcessSplit(), so the filters are only read once.
+    bool fails_bloom_filters;
+    if (!RowGroupFailsBloomFilters(i, &fails_bloom_filters).ok()) return;
+    if (fails_bloom_filters) continue;
 
-  return Status::OK();
+    vector<DiskIoMgr::ScanRange*> col_ranges;
+    if (!CreateColumnRanges(i, column_readers_, &col_ranges).ok()) return;
+    // Each issued range buffers at least one io buffer before it is consumed.
+    DiskIoMgr* io_mgr = scan_node_->runtime_state()->io_mgr();
+    int64_t prefetch_bytes = 0;
+    BOOST_FOREACH(DiskIoMgr::ScanRange* range, col_ranges) {
+      prefetch_bytes += min<int64_t>(range->len(), io_mgr->max_read_buffer_size());
+    }
+    if (prefetch_bytes > FLAGS_parquet_row_group_prefetch_max_bytes ||
+        prefetch_bytes > scan_node_->mem_tracker()->SpareCapacity()) {
+      return;
+    }
+    if (!io_mgr->AddScanRanges(scan_node_->reader_context(), col_ranges, true).ok()) {
+      return;
+    }
+    prefetched_row_group_idx_ = i;
+    prefetched_ranges_.swap(col_ranges);
+    COUNTER_ADD(num_prefetched_row_groups_counter_, 1);
+    return;
+  }
+}
+
+void HdfsParquetScanner::CancelPrefetchedRanges() {
+  BOOST_FOREACH(DiskIoMgr::ScanRange* range, prefetched_ranges_) {
+    range->Cancel(Status::CANCELLED);
+  }
+  prefetched_ranges_.clear();
+  prefetched_row_group_idx_ = -1;
 }
 
 Status HdfsParquetScanner::CreateSchemaTree(const vector<parquet::SchemaElement>& schema,
@@ -2503,7 +3676,8 @@ Status HdfsParquetScanner::ValidateColumn(
   // Check the compression is supported.
   if (file_data.meta_data.codec != parquet::CompressionCodec::UNCOMPRESSED &&
       file_data.meta_data.codec != parquet::CompressionCodec::SNAPPY &&
-      file_data.meta_data.codec != parquet::CompressionCodec::GZIP) {
+      file_data.meta_data.codec != parquet::CompressionCodec::GZIP &&
+      file_data.meta_data.codec != parquet::CompressionCodec::ZSTD) {
     stringstream ss;
     ss << "File '" << filename() << "' uses an unsupported compression: "
         << file_data.meta_data.codec << " for column '" << schema_element.name
@@ -21,6 +21,7 @@
 
 namespace impala {
 
+class BloomFilter;
 class CollectionValueBuilder;
 struct HdfsFileDesc;
 
@@ -394,24 +395,104 @@ class HdfsParquetScanner : public HdfsScanner {
     /// available from row 0).
     int64_t total_possible;
 
+    /// Values of 'considered' and 'rejected' that were last added to the scan-wide
+    /// sample with FilterStats::AddSample().
+    int64_t reported_considered;
+    int64_t reported_rejected;
+
     /// Use known-width type to act as logical boolean.  Set to 1 if corresponding filter
     /// in filter_ctxs_ should be applied, 0 if it was ineffective and was disabled.
     uint8_t enabled;
 
     /// Padding to ensure structs do not straddle cache-line boundary.
-    uint8_t padding[7];
+    uint8_t padding[23];
 
-    LocalFilterStats() : considered(0), rejected(0), total_possible(0), enabled(1) { }
+    LocalFilterStats()
+      : considered(0), rejected(0), total_possible(0), reported_considered(0),
+        reported_rejected(0), enabled(1) { }
   };
 
+  /// A conjunct of the form '<slot> <op> <constant>' over a top-level scalar column that
+  /// is materialized in the file. These are evaluated against the min/max statistics of
+  /// each row group to skip row groups in which no row can pass the conjunct.
+  struct StatsConjunct {
+    enum Op { EQ, LT, LE, GT, GE };
+
+    const SlotDescriptor* slot_desc;
+
+    /// Index into parquet::RowGroup::columns of the column 'slot_desc' is read from.
+    int col_idx;
+
+    /// The comparison, with the slot as the left operand.
+    Op op;
+
+    /// The constant operand as a native value of slot_desc->type(). Only numeric types
+    /// are supported, so 8 bytes are always enough.
+    int64_t value;
+  };
+
+  /// Conjuncts that can be evaluated against row group statistics. Populated by
+  /// InitStatsConjuncts().
+  std::vector<StatsConjunct> stats_conjuncts_;
+
+  /// A conjunct of the form '<slot> = <constant>' or '<slot> IN (<constants>)' over a
+  /// top-level integer or STRING column that is materialized in the file. Row groups
+  /// whose Bloom filter of the column contains none of the constants are skipped, see
+  /// HdfsParquetTableWriter for how the filters are written.
+  struct BloomFilterConjunct {
+    /// Index into parquet::RowGroup::columns of the column the slot is read from.
+    int col_idx;
+
+    /// ParquetBloomFilterHash() of each non-NULL constant.
+    std::vector<uint32_t> hashes;
+  };
+
+  /// Populated by InitBloomFilterConjuncts().
+  std::vector<BloomFilterConjunct> bloom_filter_conjuncts_;
+
+  /// For each row group of the file, 1 if RowGroupFailsBloomFilters() found that it
+  /// fails, 0 if it passes and -1 if it was not checked yet.
+  std::vector<int8_t> bloom_filter_results_;
+
   /// Track statistics of each filter (one for each filter in filter_ctxs_) per scanner so
   /// that expensive aggregation up to the scan node can be performed once, during
   /// Close().
   vector<LocalFilterStats> filter_stats_;
 
+  /// Scratch space for EvalRuntimeFiltersBatch(): the indexes of the tuples that passed
+  /// the filters so far, the hashes of their values and the bloom filter results.
+  std::vector<int> filter_tuple_idxs_;
+  std::vector<uint32_t> filter_hashes_;
+  std::vector<uint8_t> filter_found_;
+
   /// Column reader for each materialized columns for this file.
   std::vector<ColumnReader*> column_readers_;
 
+  /// True if the conjuncts are evaluated after only reading the columns they reference,
+  /// so that the values of the other columns can be skipped for rows that don't pass.
+  /// Only used for files without collection columns. Set by InitLateMaterialization().
+  bool late_materialization_;
+
+  /// If late_materialization_ is true, the number of readers at the front of
+  /// column_readers_ that read slots referenced by the conjuncts.
+  int num_conjunct_readers_;
+
+  /// The conjuncts of the top-level tuple that are evaluated per row for the current row
+  /// group, i.e. the ones that were not evaluated against dictionaries. Set by
+  /// InitDictFilters().
+  std::vector<ExprContext*> row_group_conjunct_ctxs_;
+
+  /// Scratch tuple to evaluate conjuncts against dictionary entries. Allocated on first
+  /// use.
+  Tuple* dict_filter_tuple_;
+
+  /// Index of the row group whose column ranges are in 'prefetched_ranges_', or -1 if no
+  /// row group was prefetched.
+  int prefetched_row_group_idx_;
+
+  /// Column ranges issued by PrefetchRowGroup(), in the order of CreateColumnRanges().
+  std::vector<DiskIoMgr::ScanRange*> prefetched_ranges_;
+
   /// File metadata thrift object
   parquet::FileMetaData file_metadata_;
 
@@ -437,6 +518,32 @@ class HdfsParquetScanner : public HdfsScanner {
   /// Number of row groups that need to be read.
   RuntimeProfile::Counter* num_row_groups_counter_;
 
+  /// Number of row groups that were skipped because their statistics showed that no row
+  /// could pass the conjuncts.
+  RuntimeProfile::Counter* num_stats_filtered_row_groups_counter_;
+
+  /// Number of row groups skipped because of the TopNBound of the scan node.
+  RuntimeProfile::Counter* num_topn_filtered_row_groups_counter_;
+
+  /// Number of row groups skipped because their Bloom filters ruled out all constants
+  /// of an equality or IN conjunct.
+  RuntimeProfile::Counter* num_bloom_filtered_row_groups_counter_;
+
+  /// Number of row groups that were skipped because a runtime filter rejected all
+  /// entries of a dictionary that covers all values of a column.
+  RuntimeProfile::Counter* num_dict_filtered_row_groups_counter_;
+
+  /// Number of column chunks whose conjuncts were evaluated once per dictionary entry
+  /// instead of once per row.
+  RuntimeProfile::Counter* num_dict_filtered_column_chunks_counter_;
+
+  /// Number of row groups whose column ranges were issued while the previous row group
+  /// was still being assembled.
+  RuntimeProfile::Counter* num_prefetched_row_groups_counter_;
+
+  /// Number of files whose footer was found in the ParquetMetadataCache.
+  RuntimeProfile::Counter* num_footer_cache_hits_counter_;
+
   const char* filename() const { return metadata_range_->file(); }
 
   /// Reads data using 'column_readers' to materialize instances of 'tuple_desc'
@@ -484,6 +591,43 @@ class HdfsParquetScanner : public HdfsScanner {
   inline bool ReadRow(const std::vector<ColumnReader*>& column_readers, Tuple* tuple,
       MemPool* pool, bool* materialize_tuple);
 
+  /// Variant of ReadRow() for top-level tuples used when late_materialization_ is true.
+  /// Reads the first num_conjunct_readers_ columns, evaluates 'conjunct_ctxs' against
+  /// 'row' (which must already point to 'tuple') and only materializes the remaining
+  /// columns if the conjuncts pass. Otherwise the values of the remaining columns are
+  /// skipped. *materialize_tuple is set to true if the row passed the conjuncts and the
+  /// runtime filters. Returns false if execution should be aborted.
+  inline bool ReadRowLateMaterialized(const std::vector<ColumnReader*>& column_readers,
+      const std::vector<ExprContext*>& conjunct_ctxs, Tuple* tuple, TupleRow* row,
+      MemPool* pool, bool* materialize_tuple);
+
+  /// Evaluates the enabled runtime filters in filter_ctxs_ against 'tuple' and updates
+  /// filter_stats_. Returns false if any filter rejects the row.
+  inline bool EvalRuntimeFilters(Tuple* tuple);
+
+  /// Called every ROWS_PER_FILTER_SELECTIVITY_CHECK rows that the filter at 'filter_idx'
+  /// was applied to. Adds them to the scan-wide sample and disables the filter in this
+  /// scanner if it rejected too few rows. Returns true if the filter stays enabled.
+  bool CheckFilterSelectivity(int filter_idx);
+
+  /// Evaluates the enabled runtime filters in filter_ctxs_ against the 'num_tuples'
+  /// consecutive tuples starting at 'first_tuple', one filter at a time so that the
+  /// bloom filters are probed in batches. Moves the tuples that pass to the front and
+  /// returns their number. Updates filter_stats_.
+  int EvalRuntimeFiltersBatch(Tuple* first_tuple, int num_tuples);
+
+  /// Decides whether late materialization can be used for this file and if so, reorders
+  /// column_readers_ so that the readers of slots referenced by the conjuncts come first.
+  /// Must be called after CreateColumnReaders().
+  void InitLateMaterialization();
+
+  /// Sets row_group_conjunct_ctxs_ for 'row_group'. Conjuncts that only reference a
+  /// top-level string column whose values are all dictionary encoded are evaluated once
+  /// per dictionary entry by the column's reader, which then filters the rows by their
+  /// dictionary indices, and are left out of row_group_conjunct_ctxs_. Must be called
+  /// after the column readers have read the first page of the row group.
+  void InitDictFilters(const parquet::RowGroup& row_group);
+
   /// Find and return the last split in the file if it is assigned to this scan node.
   /// Returns NULL otherwise.
   static DiskIoMgr::ScanRange* FindFooterSplit(HdfsFileDesc* file);
@@ -492,6 +636,53 @@ class HdfsParquetScanner : public HdfsScanner {
   /// pages and checking if the column offsets lie within the file.
   Status ValidateColumnOffsets(const parquet::RowGroup& row_group);
 
+  /// Populates stats_conjuncts_ from the conjuncts on the scan node's tuple. Must be
+  /// called after the file schema has been resolved.
+  Status InitStatsConjuncts();
+
+  /// Returns true if the column statistics of 'row_group' prove that no row in it can
+  /// pass stats_conjuncts_, in which case the row group does not need to be read.
+  bool RowGroupFailsStats(const parquet::RowGroup& row_group);
+
+  /// Sets 'slot_desc' to the descriptor of the SlotRef 'slot_expr' and 'col_idx' to the
+  /// index of the top-level, non-repeated column of the file it is read from, if there
+  /// is one and its physical type is the expected one. Otherwise 'col_idx' is set to
+  /// -1.
+  Status ResolveFileColumn(Expr* slot_expr, const SlotDescriptor** slot_desc,
+      int* col_idx);
+
+  /// Populates bloom_filter_conjuncts_ from the conjuncts on the scan node's tuple. Must
+  /// be called after the file schema has been resolved.
+  Status InitBloomFilterConjuncts();
+
+  /// Reads the Bloom filter that 'col_metadata' points to into 'filter'. Leaves
+  /// 'filter' NULL if the column chunk has no usable filter.
+  Status ReadBloomFilter(const parquet::ColumnMetaData& col_metadata,
+      boost::scoped_ptr<BloomFilter>* filter);
+
+  /// Sets 'fails' to true if the Bloom filters of the row group 'row_group_idx' contain
+  /// none of the constants of one of bloom_filter_conjuncts_. Reads the filters of each
+  /// row group at most once.
+  Status RowGroupFailsBloomFilters(int row_group_idx, bool* fails);
+
+  /// Returns true if a runtime filter on a top-level column rejects every entry of the
+  /// column's dictionary in 'row_group' and all values of the column chunk are
+  /// dictionary encoded, in which case no row of the row group can pass. Must be called
+  /// after the column readers have read the first page of the row group.
+  bool RowGroupFailsDictionaryFilters(const parquet::RowGroup& row_group);
+
+  /// Returns true if the range of a runtime filter on a top-level integer column does
+  /// not overlap the column's min/max statistics in 'row_group', in which case no row of
+  /// the row group can pass. Only counts the rejection in the filter's stats if
+  /// 'update_filter_stats' is true.
+  bool RowGroupFailsMinMaxFilters(const parquet::RowGroup& row_group,
+      bool update_filter_stats);
+
+  /// Returns true if the min/max statistics in 'row_group' of the column of the scan
+  /// node's TopNBound show that no row of the row group can be part of the top-n above
+  /// the scan.
+  bool RowGroupFailsTopNBound(const parquet::RowGroup& row_group);
+
   /// Process the file footer and parse file_metadata_.  This should be called with the
   /// last FOOTER_SIZE bytes in context_.
   /// *eosr is a return value.  If true, the scan range is complete (e.g. select count(*))
@@ -535,10 +726,35 @@ class HdfsParquetScanner : public HdfsScanner {
   /// Walks file_metadata_ and initiates reading the materialized columns.  This
   /// initializes 'column_readers' and issues the reads for the columns. 'column_readers'
   /// should be the readers used to materialize a single tuple (i.e., column_readers_ or
-  /// the children of a collection node).
+  /// the children of a collection node). If the ranges of 'row_group_idx' were already
+  /// issued by PrefetchRowGroup(), they are reused instead of being read again.
   Status InitColumns(
       int row_group_idx, const std::vector<ColumnReader*>& column_readers);
 
+  /// Validates the column chunks of 'row_group_idx' read by 'column_readers' and
+  /// allocates a scan range for each of them, in reader order, appending them to
+  /// 'col_ranges'. The ranges are not issued to the io mgr.
+  Status CreateColumnRanges(int row_group_idx,
+      const std::vector<ColumnReader*>& column_readers,
+      std::vector<DiskIoMgr::ScanRange*>* col_ranges);
+
+  /// Resets 'column_readers' to read 'row_group_idx' from streams over 'col_ranges',
+  /// which must have been created by CreateColumnRanges(). 'range_idx' is the index of
+  /// the next unused range and is advanced past the ranges consumed.
+  Status InitColumnStreams(int row_group_idx,
+      const std::vector<ColumnReader*>& column_readers,
+      const std::vector<DiskIoMgr::ScanRange*>& col_ranges, int* range_idx);
+
+  /// Issues the column ranges of the first row group at or after 'start_idx' that this
+  /// split will read, so that its io overlaps with assembling the current row group.
+  /// Nothing is issued if the buffers the ranges would tie up exceed
+  /// FLAGS_parquet_row_group_prefetch_max_bytes or the spare capacity of the scan node's
+  /// mem tracker. Errors are ignored here and reported when the row group is read.
+  void PrefetchRowGroup(int start_idx);
+
+  /// Cancels the ranges issued by PrefetchRowGroup() that were not consumed.
+  void CancelPrefetchedRanges();
+
   /// Validates the file metadata
   Status ValidateFileMetadata();
 
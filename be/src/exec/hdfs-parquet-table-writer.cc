@@ -18,21 +18,28 @@
 #include "exprs/expr.h"
 #include "exprs/expr-context.h"
 #include "runtime/decimal-value.h"
+#include "runtime/mem-pool.h"
 #include "runtime/raw-value.h"
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 #include "runtime/string-value.inline.h"
 #include "util/bit-stream-utils.h"
 #include "util/bit-util.h"
+#include "util/bloom-filter.h"
 #include "util/buffer-builder.h"
 #include "util/compress.h"
+#include "util/counting-barrier.h"
 #include "util/debug-util.h"
 #include "util/dict-encoding.h"
 #include "util/hdfs-util.h"
 #include "util/rle-encoding.h"
+#include "util/thread-pool.h"
 #include "rpc/thrift-util.h"
 
 #include <sstream>
+#include <boost/algorithm/string.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include "gen-cpp/ImpalaService_types.h"
 
@@ -40,6 +47,20 @@
 using namespace impala;
 using namespace parquet;
 using namespace apache::thrift;
+using boost::algorithm::is_any_of;
+using boost::algorithm::split;
+using boost::algorithm::to_lower;
+using boost::algorithm::to_lower_copy;
+using boost::algorithm::token_compress_on;
+using boost::algorithm::trim;
+
+DEFINE_int32(parquet_writer_encoding_threads, 0, "(Advanced) Number of threads of a "
+    "process-wide pool that Parquet writers use to encode and compress the columns of "
+    "a row batch in parallel. Each writer splits its columns into at most this many "
+    "groups. If 0 or 1, columns are encoded serially by the fragment thread.");
+DEFINE_int32(parquet_bloom_filter_log_space, 20, "(Advanced) Log2 of the size in bytes "
+    "of the Bloom filter that Parquet writers write into each row group for each column "
+    "listed in the PARQUET_BLOOM_FILTER_COLUMNS query option.");
 
 // Managing file sizes: We need to estimate how big the files being buffered
 // are in order to split them correctly in HDFS. Having a file that is too big
@@ -77,6 +98,158 @@ using namespace apache::thrift;
 
 namespace impala {
 
+// Returns true if the min and max values of columns of 'type' are written to the
+// statistics of data pages and column chunks. The sort order of INT96 timestamps is
+// undefined and readers disagree about the order of FIXED_LEN_BYTE_ARRAY decimals, so
+// only integers, floating point values and strings qualify. The null counts are written
+// for all types.
+static bool MinMaxStatsSupported(const ColumnType& type) {
+  switch (type.type) {
+    case TYPE_TINYINT:
+    case TYPE_SMALLINT:
+    case TYPE_INT:
+    case TYPE_BIGINT:
+    case TYPE_FLOAT:
+    case TYPE_DOUBLE:
+    case TYPE_STRING:
+    case TYPE_VARCHAR:
+    case TYPE_CHAR:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Min and max of values of a column, in the order the format defines for their
+// physical type: numerically for INT32, INT64, FLOAT and DOUBLE and by unsigned bytes
+// for BYTE_ARRAY. NaNs are ignored since they are not ordered. Copies string values, so
+// that they outlive the row batches they came from.
+template<typename T>
+class ColumnStats {
+ public:
+  ColumnStats() : has_values_(false) { }
+
+  void Update(const T& v) {
+    if (UNLIKELY(IsNaN(v))) return;
+    if (UNLIKELY(!has_values_)) {
+      Copy(v, &min_, &min_buffer_);
+      Copy(v, &max_, &max_buffer_);
+      has_values_ = true;
+    } else if (Less(v, min_)) {
+      Copy(v, &min_, &min_buffer_);
+    } else if (Less(max_, v)) {
+      Copy(v, &max_, &max_buffer_);
+    }
+  }
+
+  void Merge(const ColumnStats<T>& other) {
+    if (!other.has_values_) return;
+    Update(other.min_);
+    Update(other.max_);
+  }
+
+  void Reset() { has_values_ = false; }
+
+  // Sets the PLAIN encoded min and max in 'stats' if there are any values.
+  // 'encoded_size' is the size of an encoded value, or -1 for strings.
+  void Encode(int encoded_size, parquet::Statistics* stats) const {
+    if (!has_values_) return;
+    string encoded_min, encoded_max;
+    if (!EncodeValue(min_, encoded_size, &encoded_min)) return;
+    if (!EncodeValue(max_, encoded_size, &encoded_max)) return;
+    stats->__set_min(encoded_min);
+    stats->__set_max(encoded_max);
+  }
+
+ private:
+  // Strings longer than this are not written as min or max, to keep page headers and
+  // the footer small.
+  static const int MAX_STRING_STATS_LEN = 256;
+
+  static bool IsNaN(const T& v) { return false; }
+  static bool Less(const T& a, const T& b) { return a < b; }
+  static void Copy(const T& v, T* dst, string* buffer) { *dst = v; }
+
+  // Returns false if 'v' should not be written.
+  static bool EncodeValue(const T& v, int encoded_size, string* encoded) {
+    DCHECK_GT(encoded_size, 0);
+    encoded->resize(encoded_size);
+    ParquetPlainEncoder::Encode(
+        reinterpret_cast<uint8_t*>(&(*encoded)[0]), encoded_size, v);
+    return true;
+  }
+
+  bool has_values_;
+  T min_;
+  T max_;
+
+  // Own the data of min_ and max_ for strings.
+  string min_buffer_;
+  string max_buffer_;
+};
+
+template<>
+inline bool ColumnStats<float>::IsNaN(const float& v) { return isnan(v); }
+
+template<>
+inline bool ColumnStats<double>::IsNaN(const double& v) { return isnan(v); }
+
+template<>
+inline bool ColumnStats<StringValue>::Less(const StringValue& a, const StringValue& b) {
+  int len = min(a.len, b.len);
+  int cmp = len == 0 ? 0 : memcmp(a.ptr, b.ptr, len);
+  return cmp < 0 || (cmp == 0 && a.len < b.len);
+}
+
+template<>
+inline void ColumnStats<StringValue>::Copy(const StringValue& v, StringValue* dst,
+    string* buffer) {
+  buffer->assign(v.ptr, v.len);
+  *dst = StringValue(const_cast<char*>(buffer->data()), buffer->size());
+}
+
+// Statistics of BYTE_ARRAY columns are the bare bytes, without the length prefix of
+// the PLAIN encoding.
+template<>
+inline bool ColumnStats<StringValue>::EncodeValue(const StringValue& v, int encoded_size,
+    string* encoded) {
+  if (v.len > MAX_STRING_STATS_LEN) return false;
+  encoded->assign(v.ptr, v.len);
+  return true;
+}
+
+// Returns the hash of 'v' in the Bloom filters of the column chunks, see
+// ParquetBloomFilterHash(). Only called for types for which
+// ParquetBloomFilterSupported() is true.
+template<typename T>
+inline uint32_t BloomFilterHash(const T& v) {
+  DCHECK(false);
+  return 0;
+}
+
+template<>
+inline uint32_t BloomFilterHash(const int8_t& v) {
+  return ParquetBloomFilterHash(static_cast<int64_t>(v));
+}
+
+template<>
+inline uint32_t BloomFilterHash(const int16_t& v) {
+  return ParquetBloomFilterHash(static_cast<int64_t>(v));
+}
+
+template<>
+inline uint32_t BloomFilterHash(const int32_t& v) {
+  return ParquetBloomFilterHash(static_cast<int64_t>(v));
+}
+
+template<>
+inline uint32_t BloomFilterHash(const int64_t& v) { return ParquetBloomFilterHash(v); }
+
+template<>
+inline uint32_t BloomFilterHash(const StringValue& v) {
+  return ParquetBloomFilterHash(v);
+}
+
 // Base class for column writers. This contains most of the logic except for
 // the type specific functions which are implemented in the subclasses.
 class HdfsParquetTableWriter::BaseColumnWriter {
@@ -90,13 +263,23 @@ class HdfsParquetTableWriter::BaseColumnWriter {
       total_uncompressed_byte_size_(0),
       dict_encoder_base_(NULL),
       def_levels_(NULL),
-      values_buffer_len_(DEFAULT_DATA_PAGE_SIZE) {
+      values_buffer_len_(DEFAULT_DATA_PAGE_SIZE),
+      reusable_mem_pool_(new MemPool(parent->parent_->mem_tracker())),
+      per_file_mem_pool_(new MemPool(parent->parent_->mem_tracker())),
+      thrift_serializer_(new ThriftSerializer(true)),
+      file_size_delta_(0),
+      page_estimate_(0),
+      dict_estimate_(0),
+      compressed_bytes_(0),
+      uncompressed_bytes_(0),
+      compression_ratio_(1.0),
+      bloom_filter_log_space_(-1) {
     Codec::CreateCompressor(NULL, false, codec, &compressor_);
 
     def_levels_ = parent_->state_->obj_pool()->Add(
-        new RleEncoder(parent_->reusable_col_mem_pool_->Allocate(DEFAULT_DATA_PAGE_SIZE),
+        new RleEncoder(reusable_mem_pool_->Allocate(DEFAULT_DATA_PAGE_SIZE),
                        DEFAULT_DATA_PAGE_SIZE, 1));
-    values_buffer_ = parent_->reusable_col_mem_pool_->Allocate(values_buffer_len_);
+    values_buffer_ = reusable_mem_pool_->Allocate(values_buffer_len_);
   }
 
   virtual ~BaseColumnWriter() {}
@@ -128,6 +311,32 @@ class HdfsParquetTableWriter::BaseColumnWriter {
     num_values_ = 0;
     total_compressed_byte_size_ = 0;
     current_encoding_ = Encoding::PLAIN;
+    num_nulls_ = 0;
+    file_size_delta_ = 0;
+    page_estimate_ = 0;
+    dict_estimate_ = 0;
+    if (bloom_filter_log_space_ >= 0) {
+      bloom_filter_.reset(new BloomFilter(bloom_filter_log_space_, NULL, NULL));
+    }
+  }
+
+  // Makes this column keep a Bloom filter of 2^log_space bytes of its values, which
+  // WriteBloomFilter() writes into each row group. Must be called before Reset().
+  void EnableBloomFilter(int log_space) {
+    DCHECK(ParquetBloomFilterSupported(type()));
+    bloom_filter_log_space_ = log_space;
+    parent_->parent_->mem_tracker()->Consume(bloom_filter_size());
+  }
+
+  // Writes the Bloom filter of the values appended since the last Reset(), if there is
+  // one, at *file_pos and records it in the key_value_metadata of 'metadata'. Must be
+  // called after Flush(). *file_pos is incremented by the filter size.
+  Status WriteBloomFilter(int64_t* file_pos, parquet::ColumnMetaData* metadata);
+
+  // Bytes that each Bloom filter of this column takes in the file, or 0 if it has none.
+  int64_t bloom_filter_size() const {
+    if (bloom_filter_log_space_ < 0) return 0;
+    return BloomFilter::GetExpectedHeapSpaceUsed(bloom_filter_log_space_);
   }
 
   // Close this writer. This is only called after Flush() and no more rows will
@@ -135,6 +344,29 @@ class HdfsParquetTableWriter::BaseColumnWriter {
   void Close() {
     if (compressor_.get() != NULL) compressor_->Close();
     if (dict_encoder_base_ != NULL) dict_encoder_base_->ClearIndices();
+    reusable_mem_pool_->FreeAll();
+    per_file_mem_pool_->FreeAll();
+    compression_staging_buffer_.clear();
+    if (bloom_filter_log_space_ >= 0) {
+      bloom_filter_.reset();
+      parent_->parent_->mem_tracker()->Release(bloom_filter_size());
+      bloom_filter_log_space_ = -1;
+    }
+  }
+
+  // Sets the statistics of all values appended since the last Reset(). Must be called
+  // after Flush().
+  void GetStatistics(parquet::Statistics* stats) {
+    stats->__set_null_count(num_nulls_);
+    EncodeChunkMinMax(stats);
+  }
+
+  // Returns the growth of the file size estimate since the last call, see
+  // HdfsParquetTableWriter::file_size_estimate_.
+  int64_t TakeFileSizeDelta() {
+    int64_t delta = file_size_delta_;
+    file_size_delta_ = 0;
+    return delta;
   }
 
   const ColumnType& type() const { return expr_ctx_->root()->type(); }
@@ -159,9 +391,26 @@ class HdfsParquetTableWriter::BaseColumnWriter {
   // Encodes out all data for the current page and updates the metadata.
   virtual void FinalizeCurrentPage();
 
+  // Sets the min and max of the values of the current page in 'stats', if the subclass
+  // keeps them, and resets them for the next page. Called by FinalizeCurrentPage().
+  virtual void EncodePageMinMax(parquet::Statistics* stats) { }
+
+  // Sets the min and max of the values of all finalized pages in 'stats', if the
+  // subclass keeps them.
+  virtual void EncodeChunkMinMax(parquet::Statistics* stats) { }
+
   // Update current_page_ to a new page, reusing pages allocated if possible.
   void NewPage();
 
+  // Sets the contribution to the file size estimate of data of which
+  // 'uncompressed_bytes' are encoded but not compressed yet to their size at the
+  // compression ratio seen so far. '*estimate' is the previous contribution.
+  void UpdateEstimate(int64_t uncompressed_bytes, int64_t* estimate) {
+    int64_t new_estimate = uncompressed_bytes * compression_ratio_;
+    file_size_delta_ += new_estimate - *estimate;
+    *estimate = new_estimate;
+  }
+
   // Writes out the dictionary encoded data buffered in dict_encoder_.
   void WriteDictDataPage();
 
@@ -212,6 +461,9 @@ class HdfsParquetTableWriter::BaseColumnWriter {
   int64_t total_uncompressed_byte_size_;
   Encoding::type current_encoding_;
 
+  // Number of NULLs in the finalized pages.
+  int64_t num_nulls_;
+
   // Created and set by the base class.
   DictEncoderBase* dict_encoder_base_;
 
@@ -225,6 +477,46 @@ class HdfsParquetTableWriter::BaseColumnWriter {
   uint8_t* values_buffer_;
   // The size of values_buffer_.
   int values_buffer_len_;
+
+  // The remaining members are owned by this column so that different columns can be
+  // encoded by different threads, see HdfsParquetTableWriter::EncodeRows().
+
+  // Memory for buffers that are reused for the duration of the writer (i.e. reused
+  // across files).
+  scoped_ptr<MemPool> reusable_mem_pool_;
+
+  // Memory for the pages and the dictionary of the current file. Cleared by
+  // HdfsParquetTableWriter::InitNewFile().
+  scoped_ptr<MemPool> per_file_mem_pool_;
+
+  // Staging buffer to use to compress data.  This is used only if compression is
+  // enabled and is reused between all data pages.
+  vector<uint8_t> compression_staging_buffer_;
+
+  // Serializes the page headers.
+  scoped_ptr<ThriftSerializer> thrift_serializer_;
+
+  // Bytes added to the file size estimate that the parent has not taken yet.
+  int64_t file_size_delta_;
+
+  // The estimated compressed sizes of the current page and of the dictionary that are
+  // included in the file size estimate, see UpdateEstimate(). The estimate of a page is
+  // replaced by its actual size when it is finalized.
+  int64_t page_estimate_;
+  int64_t dict_estimate_;
+
+  // Sizes of all data pages this writer finalized, across row groups and files, after
+  // and before compression, and their ratio.
+  int64_t compressed_bytes_;
+  int64_t uncompressed_bytes_;
+  double compression_ratio_;
+
+  // Log2 of the size of bloom_filter_, or -1 if this column has no Bloom filter.
+  int bloom_filter_log_space_;
+
+  // Filter of the values of the current row group. The subclass inserts each value
+  // it encodes.
+  scoped_ptr<BloomFilter> bloom_filter_;
 };
 
 // Per type column writer.
@@ -234,7 +526,8 @@ class HdfsParquetTableWriter::ColumnWriter :
  public:
   ColumnWriter(HdfsParquetTableWriter* parent, ExprContext* ctx,
       const THdfsCompression::type& codec) : BaseColumnWriter(parent, ctx, codec),
-      num_values_since_dict_size_check_(0) {
+      num_values_since_dict_size_check_(0),
+      write_min_max_(MinMaxStatsSupported(ctx->root()->type())) {
     DCHECK_NE(ctx->root()->type().type, TYPE_BOOLEAN);
     encoded_value_size_ = ParquetPlainEncoder::ByteSize(ctx->root()->type());
   }
@@ -245,20 +538,25 @@ class HdfsParquetTableWriter::ColumnWriter :
     // it will fall back to plain.
     current_encoding_ = Encoding::PLAIN_DICTIONARY;
     dict_encoder_.reset(
-        new DictEncoder<T>(parent_->per_file_mem_pool_.get(), encoded_value_size_));
+        new DictEncoder<T>(per_file_mem_pool_.get(), encoded_value_size_));
     dict_encoder_base_ = dict_encoder_.get();
+    page_stats_.Reset();
+    chunk_stats_.Reset();
   }
 
  protected:
   virtual bool EncodeValue(void* value, int64_t* bytes_needed) {
+    T* v = CastValue(value);
     if (current_encoding_ == Encoding::PLAIN_DICTIONARY) {
       if (UNLIKELY(num_values_since_dict_size_check_ >=
                    DICTIONARY_DATA_PAGE_SIZE_CHECK_PERIOD)) {
         num_values_since_dict_size_check_ = 0;
-        if (dict_encoder_->EstimatedDataEncodedSize() >= page_size_) return false;
+        int64_t data_size = dict_encoder_->EstimatedDataEncodedSize();
+        if (data_size >= page_size_) return false;
+        UpdateEstimate(data_size, &page_estimate_);
       }
       ++num_values_since_dict_size_check_;
-      *bytes_needed = dict_encoder_->Put(*CastValue(value));
+      *bytes_needed = dict_encoder_->Put(*v);
       // If the dictionary contains the maximum number of values, switch to plain
       // encoding.  The current dictionary encoded page is written out.
       if (UNLIKELY(*bytes_needed < 0)) {
@@ -266,9 +564,10 @@ class HdfsParquetTableWriter::ColumnWriter :
         current_encoding_ = Encoding::PLAIN;
         return false;
       }
-      parent_->file_size_estimate_ += *bytes_needed;
+      if (*bytes_needed > 0) {
+        UpdateEstimate(dict_encoder_->dict_encoded_size(), &dict_estimate_);
+      }
     } else if (current_encoding_ == Encoding::PLAIN) {
-      T* v = CastValue(value);
       *bytes_needed = encoded_value_size_ < 0 ?
           ParquetPlainEncoder::ByteSize<T>(*v) : encoded_value_size_;
       if (current_page_->header.uncompressed_page_size + *bytes_needed > page_size_) {
@@ -279,13 +578,27 @@ class HdfsParquetTableWriter::ColumnWriter :
           ParquetPlainEncoder::Encode(dst_ptr, encoded_value_size_, *v);
       DCHECK_EQ(*bytes_needed, written_len);
       current_page_->header.uncompressed_page_size += written_len;
+      UpdateEstimate(current_page_->header.uncompressed_page_size, &page_estimate_);
     } else {
       // TODO: support other encodings here
       DCHECK(false);
     }
+    if (write_min_max_) page_stats_.Update(*v);
+    if (bloom_filter_ != NULL) bloom_filter_->Insert(BloomFilterHash(*v));
     return true;
   }
 
+  virtual void EncodePageMinMax(parquet::Statistics* stats) {
+    if (!write_min_max_) return;
+    page_stats_.Encode(encoded_value_size_, stats);
+    chunk_stats_.Merge(page_stats_);
+    page_stats_.Reset();
+  }
+
+  virtual void EncodeChunkMinMax(parquet::Statistics* stats) {
+    if (write_min_max_) chunk_stats_.Encode(encoded_value_size_, stats);
+  }
+
  private:
   // The period, in # of rows, to check the estimated dictionary page size against
   // the data page size. We want to start a new data page when the estimated size
@@ -308,6 +621,13 @@ class HdfsParquetTableWriter::ColumnWriter :
   // Temporary string value to hold CHAR(N)
   StringValue temp_;
 
+  // True if the min and max values are written, see MinMaxStatsSupported().
+  const bool write_min_max_;
+
+  // Min and max of the values of the current page and of the finalized pages.
+  ColumnStats<T> page_stats_;
+  ColumnStats<T> chunk_stats_;
+
   // Converts a slot pointer to a raw value suitable for encoding
   inline T* CastValue(void* value) {
     return reinterpret_cast<T*>(value);
@@ -379,10 +699,12 @@ inline Status HdfsParquetTableWriter::BaseColumnWriter::AppendRow(TupleRow* row)
 
     // Nulls don't get encoded.
     if (value == NULL) break;
-    ++current_page_->num_non_null;
 
     int64_t bytes_needed = 0;
-    if (EncodeValue(value, &bytes_needed)) break;
+    if (EncodeValue(value, &bytes_needed)) {
+      ++current_page_->num_non_null;
+      break;
+    }
 
     // Value didn't fit on page, try again on a new page.
     FinalizeCurrentPage();
@@ -400,7 +722,7 @@ inline Status HdfsParquetTableWriter::BaseColumnWriter::AppendRow(TupleRow* row)
         return Status(ss.str());
       }
       values_buffer_len_ = page_size_;
-      values_buffer_ = parent_->reusable_col_mem_pool_->Allocate(values_buffer_len_);
+      values_buffer_ = reusable_mem_pool_->Allocate(values_buffer_len_);
     }
     NewPage();
   }
@@ -417,7 +739,7 @@ inline void HdfsParquetTableWriter::BaseColumnWriter::WriteDictDataPage() {
     // len < 0 indicates the data doesn't fit into a data page. Allocate a larger data
     // page.
     values_buffer_len_ *= 2;
-    values_buffer_ = parent_->reusable_col_mem_pool_->Allocate(values_buffer_len_);
+    values_buffer_ = reusable_mem_pool_->Allocate(values_buffer_len_);
     len = dict_encoder_base_->WriteData(values_buffer_, values_buffer_len_);
   }
   dict_encoder_base_->ClearIndices();
@@ -450,7 +772,7 @@ Status HdfsParquetTableWriter::BaseColumnWriter::Flush(int64_t* file_pos,
     header.__set_dictionary_page_header(dict_header);
 
     // Write the dictionary page data, compressing it if necessary.
-    uint8_t* dict_buffer = parent_->per_file_mem_pool_->Allocate(
+    uint8_t* dict_buffer = per_file_mem_pool_->Allocate(
         header.uncompressed_page_size);
     dict_encoder_base_->WriteDict(dict_buffer);
     if (compressor_.get() != NULL) {
@@ -459,14 +781,14 @@ Status HdfsParquetTableWriter::BaseColumnWriter::Flush(int64_t* file_pos,
           compressor_->MaxOutputLen(header.uncompressed_page_size);
       DCHECK_GT(max_compressed_size, 0);
       uint8_t* compressed_data =
-          parent_->per_file_mem_pool_->Allocate(max_compressed_size);
+          per_file_mem_pool_->Allocate(max_compressed_size);
       header.compressed_page_size = max_compressed_size;
       compressor_->ProcessBlock32(true, header.uncompressed_page_size, dict_buffer,
           &header.compressed_page_size, &compressed_data);
       dict_buffer = compressed_data;
       // We allocated the output based on the guessed size, return the extra allocated
       // bytes back to the mem pool.
-      parent_->per_file_mem_pool_->ReturnPartialAllocation(
+      per_file_mem_pool_->ReturnPartialAllocation(
           max_compressed_size - header.compressed_page_size);
     } else {
       header.compressed_page_size = header.uncompressed_page_size;
@@ -474,8 +796,7 @@ Status HdfsParquetTableWriter::BaseColumnWriter::Flush(int64_t* file_pos,
 
     uint8_t* header_buffer;
     uint32_t header_len;
-    RETURN_IF_ERROR(parent_->thrift_serializer_->Serialize(
-        &header, &header_len, &header_buffer));
+    RETURN_IF_ERROR(thrift_serializer_->Serialize(&header, &header_len, &header_buffer));
     RETURN_IF_ERROR(parent_->Write(header_buffer, header_len));
     *file_pos += header_len;
     total_compressed_byte_size_ += header_len;
@@ -502,8 +823,7 @@ Status HdfsParquetTableWriter::BaseColumnWriter::Flush(int64_t* file_pos,
     // Write data page header
     uint8_t* buffer = NULL;
     uint32_t len = 0;
-    RETURN_IF_ERROR(
-        parent_->thrift_serializer_->Serialize(&page.header, &len, &buffer));
+    RETURN_IF_ERROR(thrift_serializer_->Serialize(&page.header, &len, &buffer));
     RETURN_IF_ERROR(parent_->Write(buffer, len));
     *file_pos += len;
 
@@ -514,6 +834,28 @@ Status HdfsParquetTableWriter::BaseColumnWriter::Flush(int64_t* file_pos,
   return Status::OK();
 }
 
+Status HdfsParquetTableWriter::BaseColumnWriter::WriteBloomFilter(int64_t* file_pos,
+    parquet::ColumnMetaData* metadata) {
+  if (bloom_filter_ == NULL || num_values_ == 0) return Status::OK();
+  TBloomFilter thrift_filter;
+  bloom_filter_->ToThrift(&thrift_filter);
+  DCHECK_EQ(thrift_filter.directory.size(), bloom_filter_size());
+  KeyValue offset;
+  offset.key = PARQUET_BLOOM_FILTER_OFFSET_KEY;
+  offset.__set_value(lexical_cast<string>(*file_pos));
+  KeyValue log_space;
+  log_space.key = PARQUET_BLOOM_FILTER_LOG_SPACE_KEY;
+  log_space.__set_value(lexical_cast<string>(thrift_filter.log_heap_space));
+  metadata->key_value_metadata.push_back(offset);
+  metadata->key_value_metadata.push_back(log_space);
+  metadata->__isset.key_value_metadata = true;
+
+  RETURN_IF_ERROR(parent_->Write(thrift_filter.directory.data(),
+      thrift_filter.directory.size()));
+  *file_pos += thrift_filter.directory.size();
+  return Status::OK();
+}
+
 void HdfsParquetTableWriter::BaseColumnWriter::FinalizeCurrentPage() {
   DCHECK(current_page_ != NULL);
   if (current_page_->finalized) return;
@@ -528,6 +870,15 @@ void HdfsParquetTableWriter::BaseColumnWriter::FinalizeCurrentPage() {
   PageHeader& header = current_page_->header;
   header.data_page_header.encoding = current_encoding_;
 
+  // Write the statistics of this page. The page header is reused, so this overwrites
+  // those of an earlier page.
+  int64_t num_nulls = header.data_page_header.num_values - current_page_->num_non_null;
+  parquet::Statistics page_stats;
+  page_stats.__set_null_count(num_nulls);
+  EncodePageMinMax(&page_stats);
+  header.data_page_header.__set_statistics(page_stats);
+  num_nulls_ += num_nulls;
+
   // Compute size of definition bits
   def_levels_->Flush();
   current_page_->num_def_bytes = sizeof(int32_t) + def_levels_->len();
@@ -537,12 +888,11 @@ void HdfsParquetTableWriter::BaseColumnWriter::FinalizeCurrentPage() {
   uint8_t* uncompressed_data = NULL;
   if (compressor_.get() == NULL) {
     uncompressed_data =
-        parent_->per_file_mem_pool_->Allocate(header.uncompressed_page_size);
+        per_file_mem_pool_->Allocate(header.uncompressed_page_size);
   } else {
     // We have compression.  Combine into the staging buffer.
-    parent_->compression_staging_buffer_.resize(
-        header.uncompressed_page_size);
-    uncompressed_data = &parent_->compression_staging_buffer_[0];
+    compression_staging_buffer_.resize(header.uncompressed_page_size);
+    uncompressed_data = &compression_staging_buffer_[0];
   }
 
   BufferBuilder buffer(uncompressed_data, header.uncompressed_page_size);
@@ -564,7 +914,7 @@ void HdfsParquetTableWriter::BaseColumnWriter::FinalizeCurrentPage() {
     int64_t max_compressed_size =
         compressor_->MaxOutputLen(header.uncompressed_page_size);
     DCHECK_GT(max_compressed_size, 0);
-    uint8_t* compressed_data = parent_->per_file_mem_pool_->Allocate(max_compressed_size);
+    uint8_t* compressed_data = per_file_mem_pool_->Allocate(max_compressed_size);
     header.compressed_page_size = max_compressed_size;
     compressor_->ProcessBlock32(true, header.uncompressed_page_size, uncompressed_data,
         &header.compressed_page_size, &compressed_data);
@@ -572,20 +922,25 @@ void HdfsParquetTableWriter::BaseColumnWriter::FinalizeCurrentPage() {
 
     // We allocated the output based on the guessed size, return the extra allocated
     // bytes back to the mem pool.
-    parent_->per_file_mem_pool_->ReturnPartialAllocation(
+    per_file_mem_pool_->ReturnPartialAllocation(
         max_compressed_size - header.compressed_page_size);
   }
 
   // Add the size of the data page header
   uint8_t* header_buffer;
   uint32_t header_len = 0;
-  parent_->thrift_serializer_->Serialize(
-      &current_page_->header, &header_len, &header_buffer);
+  thrift_serializer_->Serialize(&current_page_->header, &header_len, &header_buffer);
 
   current_page_->finalized = true;
   total_compressed_byte_size_ += header_len + header.compressed_page_size;
   total_uncompressed_byte_size_ += header_len + header.uncompressed_page_size;
-  parent_->file_size_estimate_ += header_len + header.compressed_page_size;
+  file_size_delta_ += header_len + header.compressed_page_size - page_estimate_;
+  page_estimate_ = 0;
+  compressed_bytes_ += header.compressed_page_size;
+  uncompressed_bytes_ += header.uncompressed_page_size;
+  if (uncompressed_bytes_ > 0) {
+    compression_ratio_ = static_cast<double>(compressed_bytes_) / uncompressed_bytes_;
+  }
   def_levels_->Clear();
 }
 
@@ -619,8 +974,7 @@ HdfsParquetTableWriter::HdfsParquetTableWriter(HdfsTableSink* parent, RuntimeSta
       current_row_group_(NULL),
       row_count_(0),
       file_size_limit_(0),
-      reusable_col_mem_pool_(new MemPool(parent_->mem_tracker())),
-      per_file_mem_pool_(new MemPool(parent_->mem_tracker())),
+      file_size_correction_(1.0),
       row_idx_(0) {
 }
 
@@ -645,7 +999,8 @@ Status HdfsParquetTableWriter::Init() {
   }
   if (!(codec == THdfsCompression::NONE ||
         codec == THdfsCompression::GZIP ||
-        codec == THdfsCompression::SNAPPY)) {
+        codec == THdfsCompression::SNAPPY ||
+        codec == THdfsCompression::ZSTD)) {
     stringstream ss;
     ss << "Invalid parquet compression codec " << Codec::GetCodecName(codec);
     return Status(ss.str());
@@ -719,8 +1074,29 @@ Status HdfsParquetTableWriter::Init() {
         DCHECK(false);
     }
     columns_[i] = state_->obj_pool()->Add(writer);
-    columns_[i]->Reset();
   }
+
+  if (!query_options.parquet_bloom_filter_columns.empty()) {
+    vector<string> bloom_filter_cols;
+    split(bloom_filter_cols, query_options.parquet_bloom_filter_columns,
+        is_any_of(","), token_compress_on);
+    BOOST_FOREACH(string& col_name, bloom_filter_cols) {
+      trim(col_name);
+      to_lower(col_name);
+    }
+    int num_clustering_cols = table_desc_->num_clustering_cols();
+    for (int i = 0; i < columns_.size(); ++i) {
+      if (!ParquetBloomFilterSupported(columns_[i]->type())) continue;
+      string col_name = to_lower_copy(
+          table_desc_->col_descs()[i + num_clustering_cols].name());
+      if (find(bloom_filter_cols.begin(), bloom_filter_cols.end(), col_name) ==
+          bloom_filter_cols.end()) {
+        continue;
+      }
+      columns_[i]->EnableBloomFilter(FLAGS_parquet_bloom_filter_log_space);
+    }
+  }
+  for (int i = 0; i < columns_.size(); ++i) columns_[i]->Reset();
   RETURN_IF_ERROR(CreateSchema());
   return Status::OK();
 }
@@ -810,7 +1186,7 @@ uint64_t HdfsParquetTableWriter::default_block_size() const {
 Status HdfsParquetTableWriter::InitNewFile() {
   DCHECK(current_row_group_ == NULL);
 
-  per_file_mem_pool_->Clear();
+  for (int i = 0; i < columns_.size(); ++i) columns_[i]->per_file_mem_pool_->Clear();
 
   // Get the file limit
   RETURN_IF_ERROR(HdfsTableSink::GetFileBlockSize(output_, &file_size_limit_));
@@ -828,13 +1204,12 @@ Status HdfsParquetTableWriter::InitNewFile() {
   // With arbitrary encoding schemes, it is  not possible to know if appending
   // a new row will push us over the limit until after encoding it.  Rolling back
   // a row can be tricky as well so instead we will stop the file when it is
-  // 2 * DEFAULT_DATA_PAGE_SIZE * num_cols short of the limit. e.g. 50 cols with 8K data
-  // pages, means we stop 800KB shy of the limit.
-  // Data pages calculate their size precisely when they are complete so having
-  // a two page buffer guarantees we will never go over (unless there are huge values
-  // that require increasing the page size).
-  // TODO: this should be made dynamic based on the size of rows seen so far.
-  // This would for example, let us account for very long string columns.
+  // DEFAULT_DATA_PAGE_SIZE * num_cols short of the limit. e.g. 50 cols with 64K data
+  // pages, means we stop 3.2MB shy of the limit.
+  // Data pages calculate their size precisely when they are complete and the pages
+  // that are still being filled are estimated at the compression ratio of their
+  // column, so a one page buffer covers the error of the estimate of the last pages.
+  // Errors that affect every file the same way are corrected by file_size_correction_.
   if (file_size_limit_ < MinBlockSize()) {
     stringstream ss;
     ss << "Parquet file size " << file_size_limit_ << " bytes is too small for "
@@ -842,8 +1217,17 @@ Status HdfsParquetTableWriter::InitNewFile() {
        << "PARQUET_FILE_SIZE to at least " << MinBlockSize() << ".";
     return Status(ss.str());
   }
-  file_size_limit_ -= 2 * DEFAULT_DATA_PAGE_SIZE * columns_.size();
-  DCHECK_GE(file_size_limit_, DEFAULT_DATA_PAGE_SIZE * columns_.size());
+  file_size_limit_ -= DEFAULT_DATA_PAGE_SIZE * columns_.size();
+  DCHECK_GE(file_size_limit_, 2 * DEFAULT_DATA_PAGE_SIZE * columns_.size());
+  // Leave room for the Bloom filters of the row group, but not at the expense of the
+  // data pages.
+  int64_t bloom_filter_bytes = 0;
+  for (int i = 0; i < columns_.size(); ++i) {
+    bloom_filter_bytes += columns_[i]->bloom_filter_size();
+  }
+  file_size_limit_ = max<int64_t>(
+      (file_size_limit_ - bloom_filter_bytes) / file_size_correction_,
+      DEFAULT_DATA_PAGE_SIZE * columns_.size());
   file_pos_ = 0;
   row_count_ = 0;
   file_size_estimate_ = 0;
@@ -866,12 +1250,19 @@ Status HdfsParquetTableWriter::AppendRowBatch(RowBatch* batch,
     limit = row_group_indices.size();
   }
 
+  if (FLAGS_parquet_writer_encoding_threads > 1 && columns_.size() > 1) {
+    RETURN_IF_ERROR(AppendRowsParallel(batch, row_group_indices, limit, new_file));
+    if (!*new_file) row_idx_ = 0;
+    return Status::OK();
+  }
+
   bool all_rows = row_group_indices.empty();
   for (; row_idx_ < limit;) {
     TupleRow* current_row = all_rows ?
         batch->GetRow(row_idx_) : batch->GetRow(row_group_indices[row_idx_]);
     for (int j = 0; j < columns_.size(); ++j) {
       RETURN_IF_ERROR(columns_[j]->AppendRow(current_row));
+      file_size_estimate_ += columns_[j]->TakeFileSizeDelta();
     }
     ++row_idx_;
     ++row_count_;
@@ -890,6 +1281,95 @@ Status HdfsParquetTableWriter::AppendRowBatch(RowBatch* batch,
   return Status::OK();
 }
 
+struct HdfsParquetTableWriter::EncodeTask {
+  RowBatch* batch;
+  const vector<int32_t>* row_group_indices;
+
+  // The rows [start_row, start_row + num_rows) are appended to the columns
+  // [first_col, end_col) of 'writer'.
+  HdfsParquetTableWriter* writer;
+  int start_row;
+  int num_rows;
+  int first_col;
+  int end_col;
+
+  // Set by EncodeRows() before 'barrier' is notified.
+  Status status;
+  CountingBarrier* barrier;
+};
+
+ThreadPool<HdfsParquetTableWriter::EncodeTask*>*
+HdfsParquetTableWriter::encoding_pool() {
+  DCHECK_GT(FLAGS_parquet_writer_encoding_threads, 1);
+  static ThreadPool<EncodeTask*> pool("hdfs-table-sink", "parquet-encoding",
+      FLAGS_parquet_writer_encoding_threads, 4 * FLAGS_parquet_writer_encoding_threads,
+      &EncodeRows);
+  return &pool;
+}
+
+void HdfsParquetTableWriter::EncodeRows(int thread_id, EncodeTask* const& task) {
+  NotifyBarrierOnExit notify(task->barrier);
+  bool all_rows = task->row_group_indices->empty();
+  int end_row = task->start_row + task->num_rows;
+  // Column by column, so that the state of one encoder stays in the cache.
+  for (int j = task->first_col; j < task->end_col; ++j) {
+    BaseColumnWriter* column = task->writer->columns_[j];
+    for (int i = task->start_row; i < end_row; ++i) {
+      TupleRow* row = all_rows ? task->batch->GetRow(i) :
+          task->batch->GetRow((*task->row_group_indices)[i]);
+      task->status = column->AppendRow(row);
+      if (!task->status.ok()) return;
+    }
+  }
+}
+
+int HdfsParquetTableWriter::NextChunkRows(int num_remaining) const {
+  int num_rows = min(num_remaining, static_cast<int>(ENCODING_CHUNK_ROWS));
+  if (row_count_ == 0) return num_rows;
+  // Extrapolate from the rows encoded so far how many more fit into the file, so that
+  // a chunk only overshoots the limit by about a row, as in the serial case.
+  int64_t bytes_per_row = max<int64_t>(file_size_estimate_ / row_count_, 1);
+  int64_t rows_left = (file_size_limit_ - file_size_estimate_) / bytes_per_row + 1;
+  return max<int64_t>(min<int64_t>(num_rows, rows_left), 1);
+}
+
+Status HdfsParquetTableWriter::AppendRowsParallel(RowBatch* batch,
+    const vector<int32_t>& row_group_indices, int limit, bool* new_file) {
+  int num_tasks = min<int>(FLAGS_parquet_writer_encoding_threads, columns_.size());
+  vector<EncodeTask> tasks(num_tasks);
+  while (row_idx_ < limit) {
+    int num_rows = NextChunkRows(limit - row_idx_);
+    CountingBarrier barrier(num_tasks);
+    for (int i = 0; i < num_tasks; ++i) {
+      EncodeTask* task = &tasks[i];
+      task->batch = batch;
+      task->row_group_indices = &row_group_indices;
+      task->writer = this;
+      task->start_row = row_idx_;
+      task->num_rows = num_rows;
+      task->first_col = i * columns_.size() / num_tasks;
+      task->end_col = (i + 1) * columns_.size() / num_tasks;
+      task->barrier = &barrier;
+      // Encode on this thread if the pool is shutting down.
+      if (!encoding_pool()->Offer(task)) EncodeRows(-1, task);
+    }
+    barrier.Wait();
+    for (int i = 0; i < num_tasks; ++i) RETURN_IF_ERROR(tasks[i].status);
+    for (int j = 0; j < columns_.size(); ++j) {
+      file_size_estimate_ += columns_[j]->TakeFileSizeDelta();
+    }
+    row_idx_ += num_rows;
+    row_count_ += num_rows;
+    output_->num_rows += num_rows;
+
+    if (file_size_estimate_ > file_size_limit_) {
+      *new_file = true;
+      return Status::OK();
+    }
+  }
+  return Status::OK();
+}
+
 Status HdfsParquetTableWriter::Finalize() {
   SCOPED_TIMER(parent_->hdfs_write_timer());
 
@@ -898,6 +1378,7 @@ Status HdfsParquetTableWriter::Finalize() {
   file_metadata_.num_rows = row_count_;
   RETURN_IF_ERROR(FlushCurrentRowGroup());
   RETURN_IF_ERROR(WriteFileFooter());
+  UpdateFileSizeCorrection();
   stats_.__set_parquet_stats(parquet_stats_);
   COUNTER_ADD(parent_->rows_inserted_counter(), row_count_);
   return Status::OK();
@@ -908,9 +1389,6 @@ void HdfsParquetTableWriter::Close() {
   for (int i = 0; i < columns_.size(); ++i) {
     columns_[i]->Close();
   }
-  reusable_col_mem_pool_->FreeAll();
-  per_file_mem_pool_->FreeAll();
-  compression_staging_buffer_.clear();
 }
 
 Status HdfsParquetTableWriter::WriteFileHeader() {
@@ -942,6 +1420,11 @@ Status HdfsParquetTableWriter::FlushCurrentRowGroup() {
         columns_[i]->total_uncompressed_size();
     current_row_group_->columns[i].meta_data.total_compressed_size =
         columns_[i]->total_compressed_size();
+    parquet::Statistics stats;
+    columns_[i]->GetStatistics(&stats);
+    current_row_group_->columns[i].meta_data.__set_statistics(stats);
+    RETURN_IF_ERROR(columns_[i]->WriteBloomFilter(
+        &file_pos_, &current_row_group_->columns[i].meta_data));
     current_row_group_->total_byte_size += columns_[i]->total_compressed_size();
     current_row_group_->num_rows = columns_[i]->num_values();
     current_row_group_->columns[i].file_offset = file_pos_;
@@ -981,6 +1464,22 @@ Status HdfsParquetTableWriter::WriteFileFooter() {
   // Write footer
   RETURN_IF_ERROR(Write<uint32_t>(file_metadata_len));
   RETURN_IF_ERROR(Write(PARQUET_VERSION_NUMBER, sizeof(PARQUET_VERSION_NUMBER)));
+  file_pos_ += file_metadata_len + sizeof(uint32_t) + sizeof(PARQUET_VERSION_NUMBER);
   return Status::OK();
 }
 
+void HdfsParquetTableWriter::UpdateFileSizeCorrection() {
+  // Files that were cut short by the end of the input say little about the estimate.
+  if (file_size_estimate_ < file_size_limit_ / 2) return;
+  int64_t bloom_filter_bytes = 0;
+  for (int i = 0; i < columns_.size(); ++i) {
+    bloom_filter_bytes += columns_[i]->bloom_filter_size();
+  }
+  double correction =
+      static_cast<double>(file_pos_ - bloom_filter_bytes) / file_size_estimate_;
+  // Bound the correction, so that a single unusual file cannot derail the next one.
+  file_size_correction_ = max(0.5, min(2.0, correction));
+  VLOG_FILE << "Parquet file size estimate " << file_size_estimate_ << ", actual size "
+            << file_pos_ << ", correction " << file_size_correction_;
+}
+
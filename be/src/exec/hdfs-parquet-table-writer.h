@@ -33,10 +33,13 @@ class Expr;
 struct OutputPartition;
 class RuntimeState;
 class ThriftSerializer;
+template <typename T> class ThreadPool;
 class TupleRow;
 
 /// The writer consumes all rows passed to it and writes the evaluated output_exprs
 /// as a parquet file in hdfs.
+/// If --parquet_writer_encoding_threads is greater than 1, the columns are split into
+/// groups that encode and compress chunks of rows in parallel on a process-wide pool.
 /// TODO: (parts of the format that are not implemented)
 /// - group var encoding
 /// - compression
@@ -98,6 +101,10 @@ class HdfsParquetTableWriter : public HdfsTableWriter {
   /// Minimum file size.  If the configured size is less, fail.
   static const int HDFS_MIN_FILE_SIZE = 8 * 1024 * 1024;
 
+  /// Maximum number of rows that the columns encode in parallel between two checks of
+  /// the file size.
+  static const int ENCODING_CHUNK_ROWS = 1024;
+
   /// Per-column information state.  This contains some metadata as well as the
   /// data buffers.
   class BaseColumnWriter;
@@ -121,6 +128,9 @@ class HdfsParquetTableWriter : public HdfsTableWriter {
   /// Write the file metadata and footer.
   Status WriteFileFooter();
 
+  /// Updates file_size_correction_ after the current file was finished.
+  void UpdateFileSizeCorrection();
+
   /// Flushes the current row group to file.  This will compute the final
   /// offsets of column chunks, updating the file metadata.
   Status FlushCurrentRowGroup();
@@ -129,8 +139,28 @@ class HdfsParquetTableWriter : public HdfsTableWriter {
   /// new row group.  current_row_group_ will be flushed.
   Status AddRowGroup();
 
+  /// A chunk of rows that is appended to a group of columns on the encoding pool.
+  /// Defined in the .cc.
+  struct EncodeTask;
+
+  /// Returns the process-wide pool that encodes columns, which has
+  /// --parquet_writer_encoding_threads threads.
+  static ThreadPool<EncodeTask*>* encoding_pool();
+
+  /// Work function of encoding_pool().
+  static void EncodeRows(int thread_id, EncodeTask* const& task);
+
+  /// Returns the number of rows to encode in the next chunk, at most 'num_remaining'.
+  int NextChunkRows(int num_remaining) const;
+
+  /// Parallel version of the loop in AppendRowBatch(). Appends the rows from row_idx_
+  /// up to 'limit' in chunks, each of which is encoded by all column groups before
+  /// the file size is checked.
+  Status AppendRowsParallel(RowBatch* batch,
+      const std::vector<int32_t>& row_group_indices, int limit, bool* new_file);
+
   /// Thrift serializer utility object.  Reusing this object allows for
-  /// fewer memory allocations.
+  /// fewer memory allocations.  Used for the file metadata, the columns have their own.
   boost::scoped_ptr<ThriftSerializer> thrift_serializer_;
 
   /// File metdata thrift description.
@@ -146,37 +176,34 @@ class HdfsParquetTableWriter : public HdfsTableWriter {
   int64_t row_count_;
 
   /// Current estimate of the total size of the file.  The file size estimate includes
-  /// the running size of the (uncompressed) dictionary, the size of all finalized
-  /// (compressed) data pages and their page headers.
+  /// the size of all finalized (compressed) data pages and their page headers, and the
+  /// running sizes of the dictionaries and of the current data pages at the
+  /// compression ratio their columns achieved so far. The columns accumulate their
+  /// contributions, which are added after each row or chunk of rows.
   /// If this size exceeds file_size_limit_, the current data is written and a new file
   /// is started.
   int64_t file_size_estimate_;
 
-  /// Limit on the total size of the file.
+  /// Limit on file_size_estimate_. This is the file size target less a reserve, scaled
+  /// by file_size_correction_.
   int64_t file_size_limit_;
 
+  /// Ratio of the actual size of the last file this writer finished to its final
+  /// estimate, excluding the Bloom filters. The limit of the next file is divided by it,
+  /// so that systematic errors of the estimate, e.g. the compression of the
+  /// dictionaries or the size of the footer, do not make every file miss the target.
+  double file_size_correction_;
+
   /// The file location in the current output file.  This is the number of bytes
   /// that have been written to the file so far.  The metadata uses file offsets
   /// in a few places.
   int64_t file_pos_;
 
-  /// Memory for column/block buffers that are reused for the duration of the
-  /// writer (i.e. reused across files).
-  boost::scoped_ptr<MemPool> reusable_col_mem_pool_;
-
-  /// Memory for column/block buffers that is allocated per file.  We need to
-  /// reset this pool after flushing a file.
-  boost::scoped_ptr<MemPool> per_file_mem_pool_;
-
   /// Current position in the batch being written.  This must be persistent across
   /// calls since the writer may stop in the middle of a row batch and ask for a new
   /// file.
   int row_idx_;
 
-  /// Staging buffer to use to compress data.  This is used only if compression is
-  /// enabled and is reused between all data pages.
-  std::vector<uint8_t> compression_staging_buffer_;
-
   /// For each column, the on disk size written.
   TParquetInsertStats parquet_stats_;
 };
@@ -411,14 +411,20 @@ inline Status HdfsRCFileScanner::NextRow() {
 }
 
 Status HdfsRCFileScanner::ReadColumnBuffers() {
+  // Bytes of the columns that are not materialized since the last materialized one.
+  // Adjacent skipped columns are skipped together, without reading them out of the io
+  // buffers or decompressing them.
+  int64_t skip_len = 0;
   for (int col_idx = 0; col_idx < columns_.size(); ++col_idx) {
     ColumnInfo& column = columns_[col_idx];
     if (!columns_[col_idx].materialize_column) {
-      // Not materializing this column, just skip it.
-      RETURN_IF_FALSE(
-          stream_->SkipBytes(column.buffer_len, &parse_status_));
+      skip_len += column.buffer_len;
       continue;
     }
+    if (skip_len > 0) {
+      RETURN_IF_FALSE(stream_->SkipBytes(skip_len, &parse_status_));
+      skip_len = 0;
+    }
 
     // TODO: Stream through these column buffers instead of reading everything
     // in at once.
@@ -445,6 +451,7 @@ Status HdfsRCFileScanner::ReadColumnBuffers() {
           uncompressed_data, column.buffer_len);
     }
   }
+  if (skip_len > 0) RETURN_IF_FALSE(stream_->SkipBytes(skip_len, &parse_status_));
   return Status::OK();
 }
 
@@ -36,21 +36,28 @@
 #include "common/object-pool.h"
 #include "exprs/expr-context.h"
 #include "runtime/descriptors.h"
+#include "runtime/exec-env.h"
 #include "runtime/hdfs-fs-cache.h"
 #include "runtime/runtime-filter.h"
 #include "runtime/runtime-state.h"
 #include "runtime/mem-pool.h"
+#include "runtime/mem-tracker.h"
 #include "runtime/raw-value.h"
 #include "runtime/row-batch.h"
 #include "util/bit-util.h"
 #include "util/container-util.h"
+#include "util/cpu-info.h"
 #include "util/debug-util.h"
 #include "util/disk-info.h"
 #include "util/error-util.h"
 #include "util/hdfs-util.h"
 #include "util/impalad-metrics.h"
+#include "util/lock-profiler.h"
 #include "util/periodic-counter-updater.h"
 #include "util/runtime-profile.h"
+#include "util/sampling-profiler.h"
+#include "util/stopwatch.h"
+#include "util/thread-pool.h"
 
 #include "gen-cpp/PlanNodes_types.h"
 
@@ -62,7 +69,24 @@ DEFINE_bool(suppress_unknown_disk_id_warnings, false,
     " provide volume/disk information.");
 DEFINE_int32(runtime_filter_wait_time_ms, 1000, "(Advanced) the maximum time, in ms, "
     "that a scan node will wait for expected runtime filters to arrive.");
+DEFINE_int32(scanner_task_time_slice_ms, 50, "(Advanced) The time, in ms, after which "
+    "a scanner running on the shared scanner task pool lets the other waiting scanners "
+    "run, once it has finished its current scan range. See --num_scanner_task_threads.");
+DEFINE_bool(adaptive_scanner_threads, true, "(Advanced) If true, a scan node only "
+    "starts more scanner threads while the consumer of its row batches is starved, i.e. "
+    "its row batch queue has mostly been empty recently, and scanner threads exit while "
+    "the queue has consistently been full, to free their memory and thread tokens.");
+DEFINE_int64(text_scan_range_max_bytes, 0, "(Advanced) If greater than 0, splits of "
+    "uncompressed text files that are larger than this are broken up into scan ranges "
+    "of at most this many bytes, so that several scanner threads parse a large split in "
+    "parallel.");
 DECLARE_string(cgroup_hierarchy_path);
+
+// Levels of HdfsScanNode::queue_fill_permille_ at or below which the consumer is
+// starved, so more scanner threads may be started, and at or above which the queue is
+// full, so scanner threads exit.
+static const int32_t STARVED_QUEUE_FILL_PERMILLE = 250;
+static const int32_t FULL_QUEUE_FILL_PERMILLE = 900;
 DECLARE_bool(enable_rm);
 
 namespace filesystem = boost::filesystem;
@@ -110,10 +134,20 @@ HdfsScanNode::HdfsScanNode(ObjectPool* pool, const TPlanNode& tnode,
       bytes_read_dn_cache_(NULL),
       num_remote_ranges_(NULL),
       unexpected_remote_bytes_(NULL),
+      data_cache_hit_bytes_(NULL),
+      data_cache_miss_bytes_(NULL),
+      data_cache_num_evictions_(NULL),
+      io_wait_timer_(NULL),
+      runtime_filter_wait_timer_(NULL),
+      num_scanner_threads_retired_counter_(NULL),
+      queue_fill_permille_(0),
       done_(false),
       all_ranges_started_(false),
+      num_scanner_threads_(0),
+      num_scanner_tasks_(0),
       counters_running_(false),
-      rm_callback_id_(-1) {
+      rm_callback_id_(-1),
+      topn_bound_(NULL) {
   max_materialized_row_batches_ = FLAGS_max_row_batches;
   if (max_materialized_row_batches_ <= 0) {
     // TODO: This parameter has an U-shaped effect on performance: increasing the value
@@ -185,6 +219,7 @@ bool HdfsScanNode::FilePassesFilterPredicates(const vector<FilterContext>& filte
 }
 
 bool HdfsScanNode::WaitForRuntimeFilters(int32_t time_ms) {
+  SCOPED_TIMER(runtime_filter_wait_timer_);
   vector<string> arrived_filter_ids;
   int32_t start = MonotonicMillis();
   for (auto& ctx: filter_ctxs_) {
@@ -212,6 +247,7 @@ bool HdfsScanNode::WaitForRuntimeFilters(int32_t time_ms) {
 
 Status HdfsScanNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
 
   if (!initial_ranges_issued_) {
     // We do this in GetNext() to maximise the amount of work we can do while waiting for
@@ -274,7 +310,16 @@ Status HdfsScanNode::GetNextInternal(
     return Status::OK();
   }
   *eos = false;
-  RowBatch* materialized_batch = materialized_row_batches_->GetBatch();
+  // Start more scanner threads as soon as the consumer becomes starved, since there may
+  // be no other event that offers thread tokens.
+  if (SampleQueueFill() && FLAGS_adaptive_scanner_threads) {
+    ThreadTokenAvailableCb(runtime_state_->resource_pool());
+  }
+  RowBatch* materialized_batch;
+  {
+    SCOPED_TIMER(io_wait_timer_);
+    materialized_batch = materialized_row_batches_->GetBatch();
+  }
   if (materialized_batch != NULL) {
     num_owned_io_buffers_ -= materialized_batch->num_io_buffers();
     row_batch->AcquireState(materialized_batch);
@@ -347,6 +392,27 @@ void* HdfsScanNode::GetFileMetadata(const string& filename) {
   return it->second;
 }
 
+const AvroResolvedSchema* HdfsScanNode::GetAvroResolvedSchema(
+    const string& schema_json) {
+  unique_lock<mutex> l(metadata_lock_);
+  unordered_map<string, AvroResolvedSchema*>::iterator it =
+      avro_resolved_schemas_.find(schema_json);
+  if (it == avro_resolved_schemas_.end()) return NULL;
+  return it->second;
+}
+
+const AvroResolvedSchema* HdfsScanNode::AddAvroResolvedSchema(
+    const string& schema_json, AvroResolvedSchema* schema) {
+  unique_lock<mutex> l(metadata_lock_);
+  pair<unordered_map<string, AvroResolvedSchema*>::iterator, bool> result =
+      avro_resolved_schemas_.insert(make_pair(schema_json, schema));
+  if (!result.second) {
+    delete schema;
+    return result.first->second;
+  }
+  return runtime_state_->obj_pool()->Add(schema);
+}
+
 void* HdfsScanNode::GetCodegenFn(THdfsFileFormat::type type) {
   CodegendFnMap::iterator it = codegend_fn_map_.find(type);
   if (it == codegend_fn_map_.end()) return NULL;
@@ -568,10 +634,24 @@ Status HdfsScanNode::Prepare(RuntimeState* state) {
     if (runtime_state_->query_options().disable_cached_reads) {
       DCHECK(!try_cache) << "Params should not have had this set.";
     }
-    file_desc->splits.push_back(
-        AllocateScanRange(file_desc->fs, file_desc->filename.c_str(), split.length,
-            split.offset, split.partition_id, (*scan_range_params_)[i].volume_id,
-            try_cache, expected_local, file_desc->mtime));
+    // The text scanner starts parsing at the first tuple delimiter of its range and
+    // reads past the end of the range to finish the last tuple, so uncompressed text
+    // splits can be cut at arbitrary offsets.
+    int64_t range_len = split.length;
+    if (FLAGS_text_scan_range_max_bytes > 0 &&
+        partition_desc->file_format() == THdfsFileFormat::TEXT &&
+        file_desc->file_compression == THdfsCompression::NONE) {
+      range_len = min<int64_t>(range_len, FLAGS_text_scan_range_max_bytes);
+    }
+    int64_t offset = 0;
+    do {
+      file_desc->splits.push_back(
+          AllocateScanRange(file_desc->fs, file_desc->filename.c_str(),
+              min(range_len, split.length - offset), split.offset + offset,
+              split.partition_id, (*scan_range_params_)[i].volume_id, try_cache,
+              expected_local, file_desc->mtime));
+      offset += range_len;
+    } while (offset < split.length);
   }
 
   // Compute the minimum bytes required to start a new thread. This is based on the
@@ -661,8 +741,10 @@ Status HdfsScanNode::Prepare(RuntimeState* state) {
     if (fn != NULL) {
       LlvmCodeGen* codegen;
       RETURN_IF_ERROR(runtime_state_->GetCodegen(&codegen));
+      // Scanners that are created before the function is compiled don't use it.
       codegen->AddFunctionToJit(
-          fn, &codegend_fn_map_[static_cast<THdfsFileFormat::type>(format)]);
+          fn, &codegend_fn_map_[static_cast<THdfsFileFormat::type>(format)],
+          /* has_interpreted_fallback */ true);
     }
   }
 
@@ -720,6 +802,8 @@ Status HdfsScanNode::Open(RuntimeState* state) {
 
   RETURN_IF_ERROR(runtime_state_->io_mgr()->RegisterContext(
       &reader_context_, mem_tracker()));
+  runtime_state_->io_mgr()->set_io_weight(reader_context_,
+      DiskIoMgr::GetPoolIoWeight(state->fragment_params().params.request_pool));
 
   // Initialize HdfsScanNode specific counters
   read_timer_ = ADD_TIMER(runtime_profile(), TOTAL_HDFS_READ_TIMER);
@@ -736,6 +820,8 @@ Status HdfsScanNode::Open(RuntimeState* state) {
   }
   num_scanner_threads_started_counter_ =
       ADD_COUNTER(runtime_profile(), NUM_SCANNER_THREADS_STARTED, TUnit::UNIT);
+  num_scanner_threads_retired_counter_ =
+      ADD_COUNTER(runtime_profile(), "NumScannerThreadsRetired", TUnit::UNIT);
 
   runtime_state_->io_mgr()->set_bytes_read_counter(reader_context_, bytes_read_counter());
   runtime_state_->io_mgr()->set_read_timer(reader_context_, read_timer());
@@ -759,6 +845,14 @@ Status HdfsScanNode::Open(RuntimeState* state) {
       TUnit::UNIT);
   unexpected_remote_bytes_ = ADD_COUNTER(runtime_profile(), "BytesReadRemoteUnexpected",
       TUnit::BYTES);
+  data_cache_hit_bytes_ = ADD_COUNTER(runtime_profile(), "DataCacheHitBytes",
+      TUnit::BYTES);
+  data_cache_miss_bytes_ = ADD_COUNTER(runtime_profile(), "DataCacheMissBytes",
+      TUnit::BYTES);
+  data_cache_num_evictions_ = ADD_COUNTER(runtime_profile(), "DataCacheEvictions",
+      TUnit::UNIT);
+  io_wait_timer_ = ADD_TIMER(runtime_profile(), IO_WAIT_TIMER);
+  runtime_filter_wait_timer_ = ADD_TIMER(runtime_profile(), RUNTIME_FILTER_WAIT_TIMER);
 
   max_compressed_text_file_length_ = runtime_profile()->AddHighWaterMarkCounter(
       "MaxCompressedTextFileLength", TUnit::BYTES);
@@ -803,6 +897,11 @@ void HdfsScanNode::Close(RuntimeState* state) {
   }
 
   scanner_threads_.JoinAll();
+  {
+    // Wait for the scanner tasks that are still queued or running in the task pool.
+    unique_lock<mutex> l(lock_);
+    while (num_scanner_tasks_ > 0) scanner_tasks_done_cv_.wait(l);
+  }
 
   num_owned_io_buffers_ -= materialized_row_batches_->Cleanup();
   DCHECK_EQ(num_owned_io_buffers_, 0) << "ScanNode has leaked io buffers";
@@ -862,7 +961,15 @@ Status HdfsScanNode::AddDiskIoRanges(const vector<DiskIoMgr::ScanRange*>& ranges
 
 void HdfsScanNode::AddMaterializedRowBatch(RowBatch* row_batch) {
   InitNullCollectionValues(row_batch);
+  int64_t num_rows = row_batch->num_rows();
   materialized_row_batches_->AddBatch(row_batch);
+  // The scanners evaluate all conjuncts, so the queued rows are returned as they are.
+  // The queue hands out the batches queued before it was shut down, which already hold
+  // enough rows for the limit.
+  if (limit_ != -1 && num_rows > 0 &&
+      num_rows_queued_.UpdateAndFetch(num_rows) >= limit_) {
+    SetDone();
+  }
 }
 
 void HdfsScanNode::InitNullCollectionValues(const TupleDescriptor* tuple_desc,
@@ -930,6 +1037,21 @@ bool HdfsScanNode::EnoughMemoryForScannerThread(bool new_thread) {
   return est_additional_scanner_mem < mem_tracker()->SpareCapacity();
 }
 
+bool HdfsScanNode::SampleQueueFill() {
+  int64_t size = min<int64_t>(materialized_row_batches_->GetSize(),
+      max_materialized_row_batches_);
+  int32_t sample = size * 1000 / max_materialized_row_batches_;
+  while (true) {
+    int32_t old_fill = queue_fill_permille_.Read();
+    // Each sample has a weight of 1/8.
+    int32_t new_fill = old_fill + (sample - old_fill) / 8;
+    if (queue_fill_permille_.CompareAndSwap(old_fill, new_fill)) {
+      return old_fill > STARVED_QUEUE_FILL_PERMILLE &&
+          new_fill <= STARVED_QUEUE_FILL_PERMILLE;
+    }
+  }
+}
+
 void HdfsScanNode::ThreadTokenAvailableCb(ThreadResourceMgr::ResourcePool* pool) {
   // This is called to start up new scanner threads. It's not a big deal if we
   // spin up more than strictly necessary since they will go through and terminate
@@ -940,7 +1062,8 @@ void HdfsScanNode::ThreadTokenAvailableCb(ThreadResourceMgr::ResourcePool* pool)
   //     active scanner threads.
   //  4. Don't start up if no initial ranges have been issued (see IMPALA-1722).
   //  5. Don't start up a ScannerThread if materialized_row_batches_ is full since
-  //     we are not scanner bound.
+  //     we are not scanner bound. With --adaptive_scanner_threads, also don't start
+  //     up unless the queue has mostly been empty recently (see queue_fill_permille_).
   //  6. Don't start up a thread if there isn't enough memory left to run it.
   //  7. Don't start up if there are no thread tokens.
   //  8. Don't start up if we are running too many threads for our vcore allocation
@@ -967,6 +1090,8 @@ void HdfsScanNode::ThreadTokenAvailableCb(ThreadResourceMgr::ResourcePool* pool)
     // Cases 5 and 6.
     if (active_scanner_thread_counter_.value() > 0 &&
         (materialized_row_batches_->GetSize() >= max_materialized_row_batches_ ||
+         (FLAGS_adaptive_scanner_threads &&
+          queue_fill_permille_.Read() > STARVED_QUEUE_FILL_PERMILLE) ||
          !EnoughMemoryForScannerThread(true))) {
       break;
     }
@@ -985,10 +1110,26 @@ void HdfsScanNode::ThreadTokenAvailableCb(ThreadResourceMgr::ResourcePool* pool)
 
     COUNTER_ADD(&active_scanner_thread_counter_, 1);
     COUNTER_ADD(num_scanner_threads_started_counter_, 1);
-    stringstream ss;
-    ss << "scanner-thread(" << num_scanner_threads_started_counter_->value() << ")";
-    scanner_threads_.AddThread(
-        new Thread("hdfs-scan-node", ss.str(), &HdfsScanNode::ScannerThread, this));
+    // The first scanner always gets a thread of its own, so that this scan node keeps
+    // making progress even if all the threads of the task pool are blocked, e.g. on the
+    // full row batch queues of other scan nodes. Scanners of queries that run in a
+    // cgroup can't share the pool threads either.
+    CallableThreadPool* task_pool = runtime_state_->exec_env()->scanner_task_pool();
+    bool started_task = false;
+    if (task_pool != NULL && num_scanner_threads_ > 0 &&
+        runtime_state_->cgroup().empty()) {
+      ++num_scanner_tasks_;
+      started_task = task_pool->Offer(
+          bind<void>(mem_fn(&HdfsScanNode::ScannerThread), this, true));
+      if (!started_task) --num_scanner_tasks_;
+    }
+    if (!started_task) {
+      ++num_scanner_threads_;
+      stringstream ss;
+      ss << "scanner-thread(" << num_scanner_threads_started_counter_->value() << ")";
+      scanner_threads_.AddThread(new Thread("hdfs-scan-node", ss.str(),
+          &HdfsScanNode::ScannerThread, this, false));
+    }
     started_scanner = true;
 
     if (runtime_state_->query_resource_mgr() != NULL) {
@@ -998,9 +1139,23 @@ void HdfsScanNode::ThreadTokenAvailableCb(ThreadResourceMgr::ResourcePool* pool)
   if (!started_scanner) ++num_skipped_tokens_;
 }
 
-void HdfsScanNode::ScannerThread() {
+void HdfsScanNode::ScannerThread(bool is_task) {
   SCOPED_THREAD_COUNTER_MEASUREMENT(scanner_thread_counters());
   SCOPED_TIMER(runtime_state_->total_cpu_timer());
+  SamplingProfiler::ScopedTag sampling_tag(runtime_state_->query_id(),
+      runtime_state_->fragment_instance_id());
+  LockProfiler::ScopedWaitCounter lock_wait(runtime_state_->total_lock_wait_timer());
+  // The scanners allocate their batches' memory from this node's tracker. Buffering
+  // it keeps the many scanner threads from contending on the consumption of the
+  // query's and the process' trackers.
+  MemTracker::ThreadBuffer mem_tracker_buffer(mem_tracker());
+  // Scanner threads may be started from other fragments' threads, which don't share
+  // this fragment's affinity, so pin them explicitly. The threads of the task pool are
+  // shared by all the queries and are left alone.
+  if (!is_task && runtime_state_->numa_node() != -1) {
+    Status pin_status = CpuInfo::PinThreadToNumaNode(runtime_state_->numa_node());
+    if (!pin_status.ok()) VLOG_QUERY << pin_status.GetDetail();
+  }
 
   // Make thread-local copy of filter contexts to prune scan ranges, and to pass to the
   // scanner for finer-grained filtering.
@@ -1013,17 +1168,28 @@ void HdfsScanNode::ScannerThread() {
     filter_ctxs.push_back(filter);
   }
 
+  CallableThreadPool* task_pool = runtime_state_->exec_env()->scanner_task_pool();
+  MonotonicStopWatch task_timer;
+  task_timer.Start();
+  bool yield = false;
   while (!done_) {
+    SampleQueueFill();
     {
       // Check if we have enough resources (thread token and memory) to keep using
-      // this thread.
+      // this thread, and if the consumer keeps up with it. The last scanner with a
+      // thread of its own keeps it, see ThreadTokenAvailableCb().
       unique_lock<mutex> l(lock_);
-      if (active_scanner_thread_counter_.value() > 1) {
-        if (runtime_state_->resource_pool()->optional_exceeded() ||
+      if (active_scanner_thread_counter_.value() > 1 &&
+          (is_task || num_scanner_threads_ > 1)) {
+        bool queue_full = FLAGS_adaptive_scanner_threads &&
+            queue_fill_permille_.Read() >= FULL_QUEUE_FILL_PERMILLE;
+        if (queue_full) COUNTER_ADD(num_scanner_threads_retired_counter_, 1);
+        if (queue_full || runtime_state_->resource_pool()->optional_exceeded() ||
             !EnoughMemoryForScannerThread(false)) {
           // We can't break here. We need to update the counter with the lock held or else
           // all threads might see active_scanner_thread_counter_.value > 1
           COUNTER_ADD(&active_scanner_thread_counter_, -1);
+          if (!is_task) --num_scanner_threads_;
           // Unlock before releasing the thread token to avoid deadlock in
           // ThreadTokenAvailableCb().
           l.unlock();
@@ -1037,6 +1203,7 @@ void HdfsScanNode::ScannerThread() {
               ctx.expr->Close(runtime_state_);
             }
           }
+          if (is_task) ScannerTaskDone();
           return;
         }
       } else {
@@ -1056,6 +1223,7 @@ void HdfsScanNode::ScannerThread() {
     // GetNextRange() and the check for when all ranges are complete.
     int num_unqueued_files = num_unqueued_files_;
     AtomicUtil::MemoryBarrier();
+    if (filter_status.ok()) PruneUnstartedRanges(filter_ctxs);
     Status status = runtime_state_->io_mgr()->GetNextRange(reader_context_, &scan_range);
 
     if (status.ok() && scan_range != NULL) {
@@ -1100,6 +1268,14 @@ void HdfsScanNode::ScannerThread() {
       all_ranges_started_ = true;
       break;
     }
+
+    // Give the pool thread to the other waiting tasks once this task has used up its
+    // time slice, so that the scanners of all the queries make progress.
+    if (is_task && task_pool->GetQueueSize() > 0 &&
+        task_timer.ElapsedTime() > FLAGS_scanner_task_time_slice_ms * 1000L * 1000L) {
+      yield = true;
+      break;
+    }
   }
 
   if (filter_status.ok()) {
@@ -1109,11 +1285,31 @@ void HdfsScanNode::ScannerThread() {
     }
   }
 
+  // The task keeps its thread token and stays active while it is queued again. If the
+  // pool was shut down, it is finished like any other scanner.
+  if (yield && task_pool->Offer(
+      bind<void>(mem_fn(&HdfsScanNode::ScannerThread), this, true))) {
+    return;
+  }
+
+  if (!is_task) {
+    unique_lock<mutex> l(lock_);
+    --num_scanner_threads_;
+  }
   COUNTER_ADD(&active_scanner_thread_counter_, -1);
   if (runtime_state_->query_resource_mgr() != NULL) {
     runtime_state_->query_resource_mgr()->NotifyThreadUsageChange(-1);
   }
   runtime_state_->resource_pool()->ReleaseThreadToken(false);
+  if (is_task) ScannerTaskDone();
+}
+
+void HdfsScanNode::ScannerTaskDone() {
+  unique_lock<mutex> l(lock_);
+  DCHECK_GT(num_scanner_tasks_, 0);
+  // Notified with the lock held, since Close() may return and the scan node may be
+  // destroyed as soon as the lock is released.
+  if (--num_scanner_tasks_ == 0) scanner_tasks_done_cv_.notify_all();
 }
 
 bool HdfsScanNode::PartitionPassesFilterPredicates(int32_t partition_id,
@@ -1140,6 +1336,36 @@ bool HdfsScanNode::PartitionPassesFilterPredicates(int32_t partition_id,
   return true;
 }
 
+void HdfsScanNode::PruneUnstartedRanges(const vector<FilterContext>& filter_ctxs) {
+  int num_arrived = 0;
+  for (const FilterContext& ctx: filter_ctxs) {
+    if (ctx.filter->filter_desc().is_bound_by_partition_columns &&
+        ctx.filter->GetBloomFilter() != NULL) {
+      ++num_arrived;
+    }
+  }
+  // Only one thread prunes for each newly arrived set of filters.
+  int num_applied = num_partition_filters_applied_;
+  if (num_arrived <= num_applied) return;
+  if (!num_partition_filters_applied_.CompareAndSwap(num_applied, num_arrived)) return;
+
+  vector<DiskIoMgr::ScanRange*> pruned_ranges;
+  runtime_state_->io_mgr()->RemoveUnstartedRanges(reader_context_,
+      [this, &filter_ctxs](DiskIoMgr::ScanRange* range) {
+        ScanRangeMetadata* metadata =
+            reinterpret_cast<ScanRangeMetadata*>(range->meta_data());
+        return !PartitionPassesFilterPredicates(metadata->partition_id,
+            FilterStats::SPLITS_KEY, filter_ctxs);
+      },
+      &pruned_ranges);
+  if (pruned_ranges.empty()) return;
+  VLOG_FILE << "Scan node (id=" << id() << ") pruned " << pruned_ranges.size()
+            << " unstarted scan ranges with runtime filters";
+  // Mark the ranges as done, as ProcessSplit() does for ranges that fail the filters.
+  scan_ranges_complete_counter()->Add(pruned_ranges.size());
+  progress_.Update(pruned_ranges.size());
+}
+
 Status HdfsScanNode::ProcessSplit(const vector<FilterContext>& filter_ctxs,
     DiskIoMgr::ScanRange* scan_range) {
 
@@ -1316,6 +1542,12 @@ void HdfsScanNode::StopAndFinalizeCounters() {
         runtime_state_->io_mgr()->num_remote_ranges(reader_context_)));
     unexpected_remote_bytes_->Set(
         runtime_state_->io_mgr()->unexpected_remote_bytes(reader_context_));
+    data_cache_hit_bytes_->Set(
+        runtime_state_->io_mgr()->data_cache_hit_bytes(reader_context_));
+    data_cache_miss_bytes_->Set(
+        runtime_state_->io_mgr()->data_cache_miss_bytes(reader_context_));
+    data_cache_num_evictions_->Set(
+        runtime_state_->io_mgr()->data_cache_num_evictions(reader_context_));
 
     if (unexpected_remote_bytes_->value() >= UNEXPECTED_REMOTE_BYTES_WARN_THRESHOLD) {
       runtime_state_->LogError(ErrorMsg(TErrorCode::GENERAL, Substitute(
@@ -47,6 +47,7 @@ class DescriptorTbl;
 class HdfsScanner;
 class RowBatch;
 class RuntimeFilter;
+class TopNBound;
 class Status;
 class Tuple;
 class TPlanNode;
@@ -202,6 +203,8 @@ class HdfsScanNode : public ScanNode {
   /// Adds a materialized row batch for the scan node.  This is called from scanner
   /// threads.
   /// This function will block if materialized_row_batches_ is full.
+  /// Once the queued batches hold enough rows to reach the limit, the scan is stopped
+  /// (see SetDone()) so that the remaining scan ranges are not read.
   void AddMaterializedRowBatch(RowBatch* row_batch);
 
   /// Allocate a new scan range object, stored in the runtime state's object pool. For
@@ -260,6 +263,17 @@ class HdfsScanNode : public ScanNode {
   /// This is thread safe.
   void SetFileMetadata(const std::string& filename, void* metadata);
 
+  /// Returns the Avro file schema with JSON representation 'schema_json' resolved
+  /// against the table schema, or NULL if no file with this schema was opened yet.
+  /// This is thread safe.
+  const AvroResolvedSchema* GetAvroResolvedSchema(const std::string& schema_json);
+
+  /// Caches 'schema' as the resolved schema for 'schema_json' and takes ownership of it.
+  /// If another scanner cached one first, 'schema' is deleted and that one is returned
+  /// instead. This is thread safe.
+  const AvroResolvedSchema* AddAvroResolvedSchema(const std::string& schema_json,
+      AvroResolvedSchema* schema);
+
   /// Called by the scanner when a range is complete.  Used to trigger done_ and
   /// to log progress.  This *must* only be called after the scanner has completely
   /// finished the scan range (i.e. context->Flush()).
@@ -310,6 +324,11 @@ class HdfsScanNode : public ScanNode {
 
   const std::vector<FilterContext> filter_ctxs() const { return filter_ctxs_; }
 
+  /// Bound on the first sort key published by the TopNNode above this node, or NULL.
+  /// Set before Open(), the bound itself is updated while the scan is running.
+  const TopNBound* topn_bound() const { return topn_bound_; }
+  void set_topn_bound(const TopNBound* topn_bound) { topn_bound_ = topn_bound; }
+
  private:
   friend class ScannerContext;
 
@@ -371,6 +390,10 @@ class HdfsScanNode : public ScanNode {
   /// Number of files that have not been issued from the scanners.
   AtomicInt<int> num_unqueued_files_;
 
+  /// Number of rows in the batches added to materialized_row_batches_. Only maintained
+  /// if the scan node has a limit.
+  AtomicInt<int64_t> num_rows_queued_;
+
   /// Map of HdfsScanner objects to file types.  Only one scanner object will be
   /// created for each file type.  Objects stored in runtime_state's pool.
   typedef std::map<THdfsFileFormat::type, HdfsScanner*> ScannerMap;
@@ -389,6 +412,10 @@ class HdfsScanNode : public ScanNode {
   /// the per-scanner ScannerContext..
   std::vector<FilterContext> filter_ctxs_;
 
+  /// Number of partition column filters in 'filter_ctxs_' that had arrived when the
+  /// unstarted scan ranges were last pruned with them, see PruneUnstartedRanges().
+  AtomicInt<int> num_partition_filters_applied_;
+
   /// is_materialized_col_[i] = <true i-th column should be materialized, false otherwise>
   /// for 0 <= i < total # columns in table
   //
@@ -411,6 +438,10 @@ class HdfsScanNode : public ScanNode {
   boost::mutex metadata_lock_;
   std::map<std::string, void*> per_file_metadata_;
 
+  /// File schemas of the Avro files opened so far, keyed by their JSON representation.
+  /// Protected by metadata_lock_. The schemas are owned by the runtime state's pool.
+  boost::unordered_map<std::string, AvroResolvedSchema*> avro_resolved_schemas_;
+
   /// Thread group for all scanner worker threads
   ThreadGroup scanner_threads_;
 
@@ -457,6 +488,28 @@ class HdfsScanNode : public ScanNode {
   /// Total number of bytes read remotely that were expected to be local
   RuntimeProfile::Counter* unexpected_remote_bytes_;
 
+  /// Bytes of remote reads served from and missing in the io mgr's local data cache, and
+  /// number of cache entries evicted for this scan's data.
+  RuntimeProfile::Counter* data_cache_hit_bytes_;
+  RuntimeProfile::Counter* data_cache_miss_bytes_;
+  RuntimeProfile::Counter* data_cache_num_evictions_;
+
+  /// Time GetNext() waited for the scanner threads to queue a row batch and for the
+  /// runtime filters to arrive.
+  RuntimeProfile::Counter* io_wait_timer_;
+  RuntimeProfile::Counter* runtime_filter_wait_timer_;
+
+  /// Number of scanner threads that gave up their thread token because
+  /// materialized_row_batches_ was consistently full.
+  RuntimeProfile::Counter* num_scanner_threads_retired_counter_;
+
+  /// Exponentially weighted moving average of how full materialized_row_batches_ is, in
+  /// permille of max_materialized_row_batches_. Sampled by GetNext() and by the scanner
+  /// threads between ranges. With --adaptive_scanner_threads, new scanner threads are
+  /// only started while it is low, i.e. the consumer is starved, and scanner threads
+  /// exit while it is high.
+  AtomicInt<int32_t> queue_fill_permille_;
+
   /// Lock protects access between scanner thread and main query thread (the one calling
   /// GetNext()) for all fields below.  If this lock and any other locks needs to be taken
   /// together, this lock must be taken first.
@@ -472,6 +525,15 @@ class HdfsScanNode : public ScanNode {
   /// being processed by scanner threads, but no new ScannerThreads should be started.
   bool all_ranges_started_;
 
+  /// Number of scanners running on a thread of their own, in scanner_threads_.
+  int num_scanner_threads_;
+
+  /// Number of scanners that were offered to the process-wide scanner task pool and
+  /// have not finished yet, whether they are queued or running. Close() waits for it to
+  /// drop to 0 and scanner_tasks_done_cv_ is signalled when it does.
+  int num_scanner_tasks_;
+  boost::condition_variable scanner_tasks_done_cv_;
+
   /// Pool for allocating some amounts of memory that is shared between scanners.
   /// e.g. partition key tuple and their string buffers
   boost::scoped_ptr<MemPool> scan_node_pool_;
@@ -497,12 +559,20 @@ class HdfsScanNode : public ScanNode {
   /// to remove the callback before this scan node is destroyed.
   int32_t rm_callback_id_;
 
+  /// Not owned, see topn_bound().
+  const TopNBound* topn_bound_;
+
   /// Called when scanner threads are available for this scan node. This will
   /// try to spin up as many scanner threads as the quota allows.
   /// This is also called whenever a new range is added to the IoMgr to 'pull'
   /// thread tokens if they are available.
   void ThreadTokenAvailableCb(ThreadResourceMgr::ResourcePool* pool);
 
+  /// Adds the current size of materialized_row_batches_ to queue_fill_permille_.
+  /// Returns true if this sample made the average drop to the level at which more
+  /// scanner threads may be started.
+  bool SampleQueueFill();
+
   /// Create and prepare new scanner for this partition type.
   /// If the scanner is successfully created, it is returned in 'scanner'.
   Status CreateAndPrepareScanner(HdfsPartitionDescriptor* partition,
@@ -511,7 +581,16 @@ class HdfsScanNode : public ScanNode {
   /// Main function for scanner thread. This thread pulls the next range to be
   /// processed from the IoMgr and then processes the entire range end to end.
   /// This thread terminates when all scan ranges are complete or an error occurred.
-  void ScannerThread();
+  /// If 'is_task' is true, this runs as a task on a thread of ExecEnv's scanner task
+  /// pool, which is shared by all the scan nodes of the process. Once the task has run
+  /// for --scanner_task_time_slice_ms and other tasks are waiting, it yields the pool
+  /// thread after the current range and offers itself to the pool again, keeping its
+  /// thread token.
+  void ScannerThread(bool is_task);
+
+  /// Called as the very last step of a scanner task, after which the scan node must not
+  /// be accessed by the task.
+  void ScannerTaskDone();
 
   /// Process the entire scan range with a new scanner object. Executed in scanner
   /// thread. 'filter_ctxs' is a clone of the class-wide filter_ctxs_, used to filter rows
@@ -562,6 +641,12 @@ class HdfsScanNode : public ScanNode {
   /// true if all filters arrived within the time limit (as measured from the time of
   /// RuntimeFilterBank::RegisterFilter()), false otherwise.
   bool WaitForRuntimeFilters(int32_t time_ms);
+
+  /// If partition column filters have arrived since the last call, removes the scan
+  /// ranges that have not been started yet and whose partitions don't pass
+  /// 'filter_ctxs' from the IoMgr, and marks them as complete. This keeps late filters
+  /// from paying for the IO of ranges they reject. Called by the scanner threads.
+  void PruneUnstartedRanges(const std::vector<FilterContext>& filter_ctxs);
 };
 
 }
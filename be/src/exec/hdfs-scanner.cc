@@ -49,6 +49,14 @@
 using namespace impala;
 using namespace llvm;
 
+// Attaching io buffers to the row batches that reference them saves copying the data,
+// but the buffers are only recycled once the batch is consumed. The memory of the
+// attached buffers already bounds the size of a batch, this also bounds the number of
+// small or zero-copy (e.g. HDFS cached) buffers, which don't count towards it.
+DEFINE_int32(max_io_buffers_per_row_batch, 8, "(Advanced) Maximum number of io buffers "
+    "a scanner attaches to a row batch before passing it on, even if the batch is not "
+    "full yet.");
+
 const char* FieldLocation::LLVM_CLASS_NAME = "struct.impala::FieldLocation";
 const char* HdfsScanner::LLVM_CLASS_NAME = "class.impala::HdfsScanner";
 
@@ -172,9 +180,16 @@ Status HdfsScanner::CommitRows(int num_rows) {
 
   // We need to pass the row batch to the scan node if there is too much memory attached,
   // which can happen if the query is very selective. We need to release memory even
-  // if no rows passed predicates.
-  if (batch_->AtCapacity() || context_->num_completed_io_buffers() > 0) {
+  // if no rows passed predicates. Completed io buffers are attached to the batch right
+  // away, since its rows may reference them, but the batch keeps filling up until it
+  // is at capacity or holds too many of them.
+  bool at_capacity = batch_->AtCapacity();
+  if (at_capacity || context_->num_completed_io_buffers() > 0) {
     context_->ReleaseCompletedResources(batch_, /* done */ false);
+  }
+  if (at_capacity || batch_->AtCapacity() ||
+      batch_->num_io_buffers() >= FLAGS_max_io_buffers_per_row_batch) {
+    PrepareToReturnBatch();
     scan_node_->AddMaterializedRowBatch(batch_);
     StartNewRowBatch();
   }
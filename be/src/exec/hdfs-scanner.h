@@ -265,13 +265,20 @@ class HdfsScanner {
   int GetCollectionMemory(CollectionValueBuilder* builder, MemPool** pool,
       Tuple** tuple_mem, TupleRow** tuple_row_mem);
 
-  /// Commit num_rows to the current row batch.  If this completes, the row batch is
-  /// enqueued with the scan node and StartNewRowBatch() is called.
+  /// Commit num_rows to the current row batch and attach the completed io buffers to it.
+  /// If this completes the row batch, or it holds --max_io_buffers_per_row_batch io
+  /// buffers, the row batch is enqueued with the scan node and StartNewRowBatch() is
+  /// called.
   /// Returns Status::OK if the query is not cancelled and hasn't exceeded any mem limits.
   /// Scanner can call this with 0 rows to flush any pending resources (attached pools
   /// and io buffers) to minimize memory consumption.
   Status CommitRows(int num_rows);
 
+  /// Called by CommitRows() right before batch_ is enqueued with the scan node. Rows of
+  /// later batches must not reference memory attached to batch_, so scanners that keep
+  /// data of a partially materialized tuple there must copy it out here.
+  virtual void PrepareToReturnBatch() { }
+
   /// Attach all remaining resources from context_ to batch_ and send batch_ to the scan
   /// node. This must be called after all rows have been committed and no further
   /// resources are needed from context_ (in practice this will happen in each scanner
@@ -24,12 +24,19 @@
 #include "runtime/tuple.h"
 #include "runtime/tuple-row.h"
 #include "util/codec.h"
+#include "util/promise.h"
+#include "util/thread-pool.h"
 
 #include "common/names.h"
 
 using namespace impala;
 using namespace llvm;
 
+DEFINE_int32(sequence_scanner_decompression_threads, 0, "(Advanced) Number of threads "
+    "that decompress blocks of block-compressed sequence files ahead of the scanner "
+    "threads, so that decompression and parsing of a scan range overlap. Set to 0 to "
+    "decompress in the scanner threads.");
+
 const char* const HdfsSequenceScanner::SEQFILE_VALUE_CLASS_NAME =
     "org.apache.hadoop.io.Text";
 
@@ -46,6 +53,57 @@ HdfsSequenceScanner::HdfsSequenceScanner(HdfsScanNode* scan_node, RuntimeState*
 HdfsSequenceScanner::~HdfsSequenceScanner() {
 }
 
+struct HdfsSequenceScanner::DecompressTask {
+  Codec* decompressor;
+  RuntimeProfile::Counter* decompress_timer;
+
+  /// Copy of the compressed block, the stream buffers it was read from are released on
+  /// the next read.
+  vector<uint8_t> compressed_data;
+  int64_t num_records;
+
+  /// Set by DecompressBlock() before 'done' is set.
+  Status status;
+  uint8_t* decompressed_data;
+  int64_t decompressed_len;
+  Promise<bool> done;
+};
+
+ThreadPool<HdfsSequenceScanner::DecompressTask*>*
+HdfsSequenceScanner::decompression_pool() {
+  DCHECK_GT(FLAGS_sequence_scanner_decompression_threads, 0);
+  // Each scanner has at most one block in flight.
+  static ThreadPool<DecompressTask*> pool("hdfs-scan-node", "seq-decompression",
+      FLAGS_sequence_scanner_decompression_threads,
+      4 * FLAGS_sequence_scanner_decompression_threads, &DecompressBlock);
+  return &pool;
+}
+
+void HdfsSequenceScanner::DecompressBlock(int thread_id, DecompressTask* const& task) {
+  {
+    SCOPED_TIMER(task->decompress_timer);
+    task->decompressed_data = NULL;
+    task->status = task->decompressor->ProcessBlock(false,
+        task->compressed_data.size(), task->compressed_data.data(),
+        &task->decompressed_len, &task->decompressed_data);
+  }
+  task->done.Set(true);
+}
+
+void HdfsSequenceScanner::Close() {
+  // The pool thread may still reference the pending block and the pipelined pool.
+  if (pending_block_.get() != NULL) {
+    pending_block_->done.Get();
+    pending_block_.reset();
+  }
+  if (pipelined_decompressor_.get() != NULL) {
+    pipelined_decompressor_->Close();
+    pipelined_decompressor_.reset();
+  }
+  if (pipelined_data_pool_.get() != NULL) pipelined_data_pool_->FreeAll();
+  BaseSequenceScanner::Close();
+}
+
 // Codegen for materialized parsed data into tuples.
 Function* HdfsSequenceScanner::Codegen(HdfsScanNode* node,
     const vector<ExprContext*>& conjunct_ctxs) {
@@ -161,6 +219,10 @@ inline Status HdfsSequenceScanner::GetRecord(uint8_t** record_ptr,
 Status HdfsSequenceScanner::ProcessBlockCompressedScanRange() {
   DCHECK(header_->is_compressed);
 
+  if (FLAGS_sequence_scanner_decompression_threads > 0) {
+    return ProcessBlockCompressedScanRangePipelined();
+  }
+
   while (!finished()) {
     if (scan_node_->ReachedLimit()) return Status::OK();
 
@@ -177,24 +239,93 @@ Status HdfsSequenceScanner::ProcessBlockCompressedScanRange() {
     if (stream_->eof()) return Status::OK();
 
     // Step 3
-    int sync_indicator;
-    RETURN_IF_FALSE(stream_->ReadInt(&sync_indicator, &parse_status_));
-    if (sync_indicator != -1) {
-      if (state_->LogHasSpace()) {
-        stringstream ss;
-        ss << "Expecting sync indicator (-1) at file offset "
-           << (stream_->file_offset() - sizeof(int)) << ".  "
-           << "Sync indicator found " << sync_indicator << ".";
-        state_->LogError(ErrorMsg(TErrorCode::GENERAL, ss.str()));
-      }
-      return Status("Bad sync hash");
+    RETURN_IF_ERROR(ReadSyncMarker());
+  }
+
+  return Status::OK();
+}
+
+// Same steps as ProcessBlockCompressedScanRange(), except that step 3 and the read of
+// the next block happen before step 2, so that the next block decompresses while the
+// current one is parsed.
+Status HdfsSequenceScanner::ProcessBlockCompressedScanRangePipelined() {
+  if (pipelined_decompressor_.get() == NULL) {
+    pipelined_data_pool_.reset(new MemPool(scan_node_->mem_tracker()));
+    RETURN_IF_ERROR(Codec::CreateDecompressor(pipelined_data_pool_.get(), false,
+        decompression_type_, &pipelined_decompressor_));
+  }
+
+  if (!finished()) RETURN_IF_ERROR(StartDecompressingNextBlock());
+  while (pending_block_.get() != NULL) {
+    if (scan_node_->ReachedLimit()) return Status::OK();
+    RETURN_IF_ERROR(FinishPendingBlock());
+
+    // SequenceFiles don't end with syncs
+    if (!stream_->eof()) {
+      RETURN_IF_ERROR(ReadSyncMarker());
+      if (!finished()) RETURN_IF_ERROR(StartDecompressingNextBlock());
     }
-    RETURN_IF_ERROR(ReadSync());
+
+    while (num_buffered_records_in_compressed_block_ > 0) {
+      RETURN_IF_ERROR(ProcessDecompressedBlock());
+    }
+  }
+
+  return Status::OK();
+}
+
+Status HdfsSequenceScanner::StartDecompressingNextBlock() {
+  DCHECK(pending_block_.get() == NULL);
+  int64_t num_records;
+  uint8_t* compressed_data;
+  int64_t block_size;
+  RETURN_IF_ERROR(ReadCompressedBlockData(&num_records, &compressed_data, &block_size));
+
+  DecompressTask* task = new DecompressTask();
+  pending_block_.reset(task);
+  task->decompressor = pipelined_decompressor_.get();
+  task->decompress_timer = decompress_timer_;
+  task->compressed_data.assign(compressed_data, compressed_data + block_size);
+  task->num_records = num_records;
+  if (!decompression_pool()->Offer(task)) {
+    pending_block_.reset();
+    return Status("Sequence file decompression pool was shut down.");
   }
+  return Status::OK();
+}
 
+Status HdfsSequenceScanner::FinishPendingBlock() {
+  DCHECK(pending_block_.get() != NULL);
+  pending_block_->done.Get();
+  boost::scoped_ptr<DecompressTask> task(pending_block_.release());
+  RETURN_IF_ERROR(task->status);
+  VLOG_FILE << "Decompressed " << task->compressed_data.size() << " to "
+            << task->decompressed_len;
+
+  // Pass the previous block to the batch, we don't need it anymore.
+  AttachPool(data_buffer_pool_.get(), true);
+  data_buffer_pool_->AcquireData(pipelined_data_pool_.get(), false);
+  num_buffered_records_in_compressed_block_ = task->num_records;
+  next_record_in_compressed_block_ = task->decompressed_data;
   return Status::OK();
 }
 
+Status HdfsSequenceScanner::ReadSyncMarker() {
+  int sync_indicator;
+  RETURN_IF_FALSE(stream_->ReadInt(&sync_indicator, &parse_status_));
+  if (sync_indicator != -1) {
+    if (state_->LogHasSpace()) {
+      stringstream ss;
+      ss << "Expecting sync indicator (-1) at file offset "
+         << (stream_->file_offset() - sizeof(int)) << ".  "
+         << "Sync indicator found " << sync_indicator << ".";
+      state_->LogError(ErrorMsg(TErrorCode::GENERAL, ss.str()));
+    }
+    return Status("Bad sync hash");
+  }
+  return ReadSync();
+}
+
 Status HdfsSequenceScanner::ProcessDecompressedBlock() {
   MemPool* pool;
   TupleRow* tuple_row;
@@ -445,13 +576,30 @@ Status HdfsSequenceScanner::ReadCompressedBlock() {
     AttachPool(data_buffer_pool_.get(), true);
   }
 
-  RETURN_IF_FALSE(stream_->ReadVLong(
-      &num_buffered_records_in_compressed_block_, &parse_status_));
-  if (num_buffered_records_in_compressed_block_ < 0) {
+  uint8_t* compressed_data = NULL;
+  int64_t block_size = 0;
+  RETURN_IF_ERROR(ReadCompressedBlockData(&num_buffered_records_in_compressed_block_,
+      &compressed_data, &block_size));
+
+  {
+    int64_t len;
+    SCOPED_TIMER(decompress_timer_);
+    RETURN_IF_ERROR(decompressor_->ProcessBlock(false, block_size, compressed_data,
+                                                &len, &unparsed_data_buffer_));
+    VLOG_FILE << "Decompressed " << block_size << " to " << len;
+    next_record_in_compressed_block_ = unparsed_data_buffer_;
+  }
+
+  return Status::OK();
+}
+
+Status HdfsSequenceScanner::ReadCompressedBlockData(int64_t* num_records,
+    uint8_t** compressed_data, int64_t* block_size) {
+  RETURN_IF_FALSE(stream_->ReadVLong(num_records, &parse_status_));
+  if (*num_records < 0) {
     if (state_->LogHasSpace()) {
       stringstream ss;
-      ss << "Bad compressed block record count: "
-         << num_buffered_records_in_compressed_block_;
+      ss << "Bad compressed block record count: " << *num_records;
       state_->LogError(ErrorMsg(TErrorCode::GENERAL, ss.str()));
     }
     return Status("bad record count");
@@ -466,27 +614,15 @@ Status HdfsSequenceScanner::ReadCompressedBlock() {
   RETURN_IF_FALSE(stream_->SkipText(&parse_status_));
 
   // Read the compressed value buffer from the unbuffered stream.
-  int64_t block_size = 0;
-  RETURN_IF_FALSE(stream_->ReadVLong(&block_size, &parse_status_));
+  RETURN_IF_FALSE(stream_->ReadVLong(block_size, &parse_status_));
   // Check for a reasonable size
-  if (block_size > MAX_BLOCK_SIZE || block_size < 0) {
+  if (*block_size > MAX_BLOCK_SIZE || *block_size < 0) {
     stringstream ss;
-    ss << "Compressed block size is: " << block_size;
+    ss << "Compressed block size is: " << *block_size;
     return Status(ss.str());
   }
 
-  uint8_t* compressed_data = NULL;
-  RETURN_IF_FALSE(stream_->ReadBytes(block_size, &compressed_data, &parse_status_));
-
-  {
-    int64_t len;
-    SCOPED_TIMER(decompress_timer_);
-    RETURN_IF_ERROR(decompressor_->ProcessBlock(false, block_size, compressed_data,
-                                                &len, &unparsed_data_buffer_));
-    VLOG_FILE << "Decompressed " << block_size << " to " << len;
-    next_record_in_compressed_block_ = unparsed_data_buffer_;
-  }
-
+  RETURN_IF_FALSE(stream_->ReadBytes(*block_size, compressed_data, &parse_status_));
   return Status::OK();
 }
 
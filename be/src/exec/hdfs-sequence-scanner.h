@@ -151,6 +151,7 @@
 
 namespace impala {
 
+template <typename T> class ThreadPool;
 class DelimitedTextParser;
 
 class HdfsSequenceScanner : public BaseSequenceScanner {
@@ -165,6 +166,7 @@ class HdfsSequenceScanner : public BaseSequenceScanner {
   
   /// Implementation of HdfsScanner interface.
   virtual Status Prepare(ScannerContext* context);
+  virtual void Close();
 
   /// Codegen writing tuples and evaluating predicates.
   static llvm::Function* Codegen(HdfsScanNode*,
@@ -199,10 +201,34 @@ class HdfsSequenceScanner : public BaseSequenceScanner {
   /// more common and can be parsed more efficiently in larger pieces.
   Status ProcessBlockCompressedScanRange();
 
+  /// Same as ProcessBlockCompressedScanRange(), but decompresses the next block on the
+  /// shared decompression pool while the current block is parsed. At most one block is
+  /// decompressed ahead, which bounds the extra memory to one compressed and one
+  /// decompressed block. Used if --sequence_scanner_decompression_threads > 0.
+  Status ProcessBlockCompressedScanRangePipelined();
+
   /// Read a compressed block. Does NOT read sync or -1 marker preceding sync.
   /// Decompress to unparsed_data_buffer_ allocated from unparsed_data_buffer_pool_.
   Status ReadCompressedBlock();
 
+  /// Reads the header and the compressed value buffer of the next block. Sets
+  /// 'num_records' to the number of records in the block. 'compressed_data' is only
+  /// valid until the next read from stream_.
+  Status ReadCompressedBlockData(int64_t* num_records, uint8_t** compressed_data,
+      int64_t* block_size);
+
+  /// Reads the -1 marker and the sync that follow each compressed block.
+  Status ReadSyncMarker();
+
+  /// Reads the next compressed block and hands a copy of it to the decompression
+  /// pool. Sets pending_block_.
+  Status StartDecompressingNextBlock();
+
+  /// Waits for pending_block_ to be decompressed and makes it the current block, i.e.
+  /// sets next_record_in_compressed_block_ and num_buffered_records_in_compressed_block_.
+  /// The memory of the previous block is passed to the row batch.
+  Status FinishPendingBlock();
+
   /// Utility function for parsing next_record_in_compressed_block_. Called by
   /// ProcessBlockCompressedScanRange.
   Status ProcessDecompressedBlock();
@@ -253,6 +279,26 @@ class HdfsSequenceScanner : public BaseSequenceScanner {
 
   /// Next record from block compressed data.
   uint8_t* next_record_in_compressed_block_;
+
+  /// A compressed block that is handed to the decompression pool. Defined in the .cc.
+  struct DecompressTask;
+
+  /// Returns the process-wide pool that decompresses blocks, which has
+  /// --sequence_scanner_decompression_threads threads.
+  static ThreadPool<DecompressTask*>* decompression_pool();
+
+  /// Work function of decompression_pool().
+  static void DecompressBlock(int thread_id, DecompressTask* const& task);
+
+  /// The block that is being decompressed on the decompression pool, if any. Must be
+  /// waited for before the scanner is closed.
+  boost::scoped_ptr<DecompressTask> pending_block_;
+
+  /// Decompressor and output memory for blocks decompressed on the decompression pool.
+  /// Only used by one pool thread at a time. After a block is decompressed, its memory
+  /// moves to data_buffer_pool_.
+  boost::scoped_ptr<MemPool> pipelined_data_pool_;
+  boost::scoped_ptr<Codec> pipelined_decompressor_;
 };
 
 } // namespace impala
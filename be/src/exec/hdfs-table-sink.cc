@@ -37,6 +37,7 @@
 #include <hdfs.h>
 #include <boost/scoped_ptr.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <gflags/gflags.h>
 #include <stdlib.h>
 
 #include "gen-cpp/ImpalaInternalService_constants.h"
@@ -47,6 +48,10 @@ using boost::posix_time::microsec_clock;
 using boost::posix_time::ptime;
 using namespace strings;
 
+DEFINE_bool(compute_stats_on_insert, false, "If true, INSERTs gather the incremental "
+    "stats of the data they write. Partitions created by the INSERT store them, so that "
+    "COMPUTE INCREMENTAL STATS doesn't have to scan them.");
+
 namespace impala {
 
 const static string& ROOT_PARTITION_KEY =
@@ -59,7 +64,10 @@ HdfsTableSink::HdfsTableSink(const RowDescriptor& row_desc,
        table_id_(tsink.table_sink.target_table_id),
        select_list_texprs_(select_list_texprs),
        partition_key_texprs_(tsink.table_sink.hdfs_table_sink.partition_key_exprs),
-       overwrite_(tsink.table_sink.hdfs_table_sink.overwrite) {
+       overwrite_(tsink.table_sink.hdfs_table_sink.overwrite),
+       input_is_clustered_(tsink.table_sink.hdfs_table_sink.__isset.input_is_clustered &&
+           tsink.table_sink.hdfs_table_sink.input_is_clustered),
+       current_clustered_partition_(NULL) {
   DCHECK(tsink.__isset.table_sink);
 }
 
@@ -92,6 +100,15 @@ Status HdfsTableSink::PrepareExprs(RuntimeState* state) {
   DCHECK_GE(output_expr_ctxs_.size(),
       table_desc_->num_cols() - table_desc_->num_clustering_cols()) << DebugString();
 
+  if (FLAGS_compute_stats_on_insert) {
+    // Match the columns that COMPUTE STATS gathers stats for.
+    int num_clustering_cols = table_desc_->num_clustering_cols();
+    for (int i = 0; i < table_desc_->num_cols() - num_clustering_cols; ++i) {
+      const ColumnType& type = table_desc_->col_descs()[i + num_clustering_cols].type();
+      if (!type.IsComplexType()) column_stats_col_idxs_.push_back(i);
+    }
+  }
+
   // Prepare literal partition key exprs
   BOOST_FOREACH(
       const HdfsTableDescriptor::PartitionIdToDescriptorMap::value_type& id_to_desc,
@@ -388,6 +405,13 @@ Status HdfsTableSink::InitOutputPartition(RuntimeState* state,
   // could incorrectly create an empty file or empty partition.
   if (empty_partition) return Status::OK();
 
+  for (int col_idx: column_stats_col_idxs_) {
+    const ColumnDescriptor& col_desc =
+        table_desc_->col_descs()[col_idx + table_desc_->num_clustering_cols()];
+    output_partition->column_stats.push_back(
+        IntermediateColumnStatsBuilder(col_desc.name(), col_desc.type()));
+  }
+
   switch (partition_descriptor.file_format()) {
     case THdfsFileFormat::TEXT:
       output_partition->writer.reset(
@@ -511,20 +535,10 @@ Status HdfsTableSink::Send(RuntimeState* state, RowBatch* batch, bool eos) {
     RETURN_IF_ERROR(GetOutputPartition(state, ROOT_PARTITION_KEY, &partition_pair,
         empty_input_batch));
     if (!empty_input_batch) {
-      // Pass the row batch to the writer. If new_file is returned true then the current
-      // file is finalized and a new file is opened.
-      // The writer tracks where it is in the batch when it returns with new_file set.
-      OutputPartition* output_partition = partition_pair->first;
-      bool new_file;
-      do {
-        RETURN_IF_ERROR(output_partition->writer->AppendRowBatch(
-            batch, partition_pair->second, &new_file));
-        if (new_file) {
-          RETURN_IF_ERROR(FinalizePartitionFile(state, output_partition));
-          RETURN_IF_ERROR(CreateNewTmpFile(state, output_partition));
-        }
-      } while (new_file);
+      RETURN_IF_ERROR(WriteRowsToPartition(state, batch, partition_pair));
     }
+  } else if (input_is_clustered_) {
+    if (!empty_input_batch) RETURN_IF_ERROR(WriteClusteredRowBatch(state, batch));
   } else {
     for (int i = 0; i < batch->num_rows(); ++i) {
       current_row_ = batch->GetRow(i);
@@ -537,19 +551,8 @@ Status HdfsTableSink::Send(RuntimeState* state, RowBatch* batch, bool eos) {
     }
     for (PartitionMap::iterator partition = partition_keys_to_output_partitions_.begin();
          partition != partition_keys_to_output_partitions_.end(); ++partition) {
-      OutputPartition* output_partition = partition->second.first;
       if (partition->second.second.empty()) continue;
-
-      bool new_file;
-      do {
-        RETURN_IF_ERROR(output_partition->writer->AppendRowBatch(
-            batch, partition->second.second, &new_file));
-        if (new_file) {
-          RETURN_IF_ERROR(FinalizePartitionFile(state, output_partition));
-          RETURN_IF_ERROR(CreateNewTmpFile(state, output_partition));
-        }
-      } while (new_file);
-      partition->second.second.clear();
+      RETURN_IF_ERROR(WriteRowsToPartition(state, batch, &partition->second));
     }
   }
 
@@ -565,6 +568,56 @@ Status HdfsTableSink::Send(RuntimeState* state, RowBatch* batch, bool eos) {
   return Status::OK();
 }
 
+Status HdfsTableSink::WriteRowsToPartition(RuntimeState* state, RowBatch* batch,
+    PartitionPair* partition_pair) {
+  // Pass the row batch to the writer. If new_file is returned true then the current
+  // file is finalized and a new file is opened.
+  // The writer tracks where it is in the batch when it returns with new_file set.
+  OutputPartition* output_partition = partition_pair->first;
+  UpdateColumnStats(output_partition, batch, partition_pair->second);
+  bool new_file;
+  do {
+    RETURN_IF_ERROR(output_partition->writer->AppendRowBatch(
+        batch, partition_pair->second, &new_file));
+    if (new_file) {
+      RETURN_IF_ERROR(FinalizePartitionFile(state, output_partition));
+      RETURN_IF_ERROR(CreateNewTmpFile(state, output_partition));
+    }
+  } while (new_file);
+  partition_pair->second.clear();
+  return Status::OK();
+}
+
+Status HdfsTableSink::WriteClusteredRowBatch(RuntimeState* state, RowBatch* batch) {
+  DCHECK_GT(batch->num_rows(), 0);
+  for (int i = 0; i < batch->num_rows(); ++i) {
+    current_row_ = batch->GetRow(i);
+    string key;
+    GetHashTblKey(dynamic_partition_key_expr_ctxs_, &key);
+    if (current_clustered_partition_ == NULL || key != current_clustered_partition_key_) {
+      if (current_clustered_partition_ != NULL) {
+        // The previous partition is complete. Write its rows of this batch and release
+        // its writer. The planner's sort guarantees that its key does not reappear.
+        PartitionPair* previous = current_clustered_partition_;
+        OutputPartition* partition = previous->first;
+        if (!previous->second.empty()) {
+          RETURN_IF_ERROR(WriteRowsToPartition(state, batch, previous));
+        }
+        RETURN_IF_ERROR(FinalizePartitionFile(state, partition));
+        if (partition->writer.get() != NULL) partition->writer->Close();
+        partition_keys_to_output_partitions_.erase(current_clustered_partition_key_);
+        current_clustered_partition_ = NULL;
+      }
+      RETURN_IF_ERROR(
+          GetOutputPartition(state, key, &current_clustered_partition_, false));
+      current_clustered_partition_key_ = key;
+    }
+    current_clustered_partition_->second.push_back(i);
+  }
+  // The last partition stays open for the next batch.
+  return WriteRowsToPartition(state, batch, current_clustered_partition_);
+}
+
 Status HdfsTableSink::FinalizePartitionFile(RuntimeState* state,
                                             OutputPartition* partition) {
   if (partition->tmp_hdfs_file == NULL && !overwrite_) return Status::OK();
@@ -573,6 +626,7 @@ Status HdfsTableSink::FinalizePartitionFile(RuntimeState* state,
   // OutputPartition writer could be NULL if there is no row to output.
   if (partition->writer.get() != NULL) {
     RETURN_IF_ERROR(partition->writer->Finalize());
+    RETURN_IF_ERROR(partition->writer->FlushWrites());
 
     // Track total number of appended rows per partition in runtime
     // state. partition->num_rows counts number of rows appended is per-file.
@@ -584,14 +638,35 @@ Status HdfsTableSink::FinalizePartitionFile(RuntimeState* state,
     DCHECK(it != state->per_partition_status()->end());
     it->second.num_appended_rows += partition->num_rows;
     DataSink::MergeInsertStats(partition->writer->stats(), &it->second.stats);
+    for (int i = 0; i < partition->column_stats.size(); ++i) {
+      IntermediateColumnStatsBuilder* builder = &partition->column_stats[i];
+      builder->Flush(&it->second.stats.column_stats[builder->col_name()]);
+      it->second.stats.__isset.column_stats = true;
+    }
   }
 
   ClosePartitionFile(state, partition);
   return Status::OK();
 }
 
+void HdfsTableSink::UpdateColumnStats(OutputPartition* partition, RowBatch* batch,
+    const vector<int32_t>& row_group_indices) {
+  if (partition->column_stats.empty()) return;
+  int num_rows =
+      row_group_indices.empty() ? batch->num_rows() : row_group_indices.size();
+  for (int i = 0; i < num_rows; ++i) {
+    TupleRow* row = batch->GetRow(row_group_indices.empty() ? i : row_group_indices[i]);
+    for (int j = 0; j < column_stats_col_idxs_.size(); ++j) {
+      partition->column_stats[j].Update(
+          output_expr_ctxs_[column_stats_col_idxs_[j]]->GetValue(row));
+    }
+  }
+}
+
 void HdfsTableSink::ClosePartitionFile(RuntimeState* state, OutputPartition* partition) {
   if (partition->tmp_hdfs_file == NULL) return;
+  // No-op if FinalizePartitionFile() flushed the writes.
+  if (partition->writer.get() != NULL) partition->writer->CancelWrites();
   int hdfs_ret = hdfsCloseFile(hdfs_connection_, partition->tmp_hdfs_file);
   VLOG_FILE << "hdfsCloseFile() file=" << partition->current_file_name;
   if (hdfs_ret != 0) {
@@ -659,6 +734,7 @@ Status HdfsTableSink::GetFileBlockSize(OutputPartition* output_partition, int64_
 string HdfsTableSink::DebugString() const {
   stringstream out;
   out << "HdfsTableSink(overwrite=" << (overwrite_ ? "true" : "false")
+      << " input_is_clustered=" << (input_is_clustered_ ? "true" : "false")
       << " table_desc=" << table_desc_->DebugString()
       << " partition_key_exprs=" << Expr::DebugString(partition_key_expr_ctxs_)
       << " output_exprs=" << Expr::DebugString(output_expr_ctxs_)
@@ -23,6 +23,7 @@
 /// needed for scoped_ptr to work on ObjectPool
 #include "common/object-pool.h"
 #include "exec/data-sink.h"
+#include "exec/incr-stats-util.h"
 #include "runtime/descriptors.h"
 #include "util/runtime-profile.h"
 
@@ -85,6 +86,11 @@ struct OutputPartition {
   /// The descriptor for this partition.
   const HdfsPartitionDescriptor* partition_descriptor;
 
+  /// Stats of the rows appended to the current file, one per column in
+  /// HdfsTableSink::column_stats_col_idxs_. Empty unless --compute_stats_on_insert is
+  /// set.
+  std::vector<IntermediateColumnStatsBuilder> column_stats;
+
   OutputPartition();
 };
 
@@ -106,6 +112,10 @@ struct OutputPartition {
 /// partition_key_exprs from tsink.
 /// A map of opened Hdfs files (corresponding to partitions) is maintained.
 /// Each row may belong to different partition than the one before it.
+/// If the planner sorted the input by the partition keys (input_is_clustered in tsink),
+/// the rows of each partition arrive consecutively and only the partition of the
+/// current rows is kept open. It is finalized and closed when the key changes, which
+/// bounds the memory of inserts into many partitions.
 //
 /// Failure behavior:
 /// In Exec() all data is written to Hdfs files in a temporary directory.
@@ -210,6 +220,20 @@ class HdfsTableSink : public DataSink {
   /// Closes the hdfs file for this partition as well as the writer.
   void ClosePartitionFile(RuntimeState* state, OutputPartition* partition);
 
+  /// Writes the rows of 'batch' in partition_pair->second (or all rows if that is empty)
+  /// to the partition, starting new files as needed, and clears partition_pair->second.
+  Status WriteRowsToPartition(RuntimeState* state, RowBatch* batch,
+      PartitionPair* partition_pair);
+
+  /// Writes a non-empty batch of clustered input, see input_is_clustered_. Finalizes and
+  /// closes the current partition whenever the partition key changes.
+  Status WriteClusteredRowBatch(RuntimeState* state, RowBatch* batch);
+
+  /// Adds the rows of 'batch' at 'row_group_indices' (or all rows if that is empty) to
+  /// the column stats of 'partition'.
+  void UpdateColumnStats(OutputPartition* partition, RowBatch* batch,
+      const std::vector<int32_t>& row_group_indices);
+
   /// Descriptor of target table. Set in Prepare().
   const HdfsTableDescriptor* table_desc_;
 
@@ -219,6 +243,11 @@ class HdfsTableSink : public DataSink {
   /// Exprs that materialize output values
   std::vector<ExprContext*> output_expr_ctxs_;
 
+  /// Indices into 'output_expr_ctxs_' of the columns whose stats are gathered while
+  /// writing. These are all scalar non-partition columns if --compute_stats_on_insert is
+  /// set, otherwise empty. Set in Prepare().
+  std::vector<int> column_stats_col_idxs_;
+
   /// Current row from the current RowBatch to output
   TupleRow* current_row_;
 
@@ -245,6 +274,15 @@ class HdfsTableSink : public DataSink {
   /// Indicates whether the existing partitions should be overwritten.
   bool overwrite_;
 
+  /// True if the input is sorted by the partition keys.
+  bool input_is_clustered_;
+
+  /// If input_is_clustered_, the key and entry in partition_keys_to_output_partitions_
+  /// of the partition of the last row, which is the only open one. NULL before the
+  /// first row.
+  std::string current_clustered_partition_key_;
+  PartitionPair* current_clustered_partition_;
+
   /// The directory in which to write intermediate results. Set to
   /// <hdfs_table_base_dir>/_impala_insert_staging/ during Prepare()
   std::string staging_dir_;
@@ -14,8 +14,21 @@
 
 #include "exec/hdfs-table-writer.h"
 
+#include <gflags/gflags.h>
+
+#include "runtime/mem-tracker.h"
+#include "util/thread-pool.h"
+
 #include "common/names.h"
 
+DEFINE_int32(table_writer_io_threads, 4, "(Advanced) Number of threads of a "
+    "process-wide pool that write the output of table writers to HDFS or S3 while the "
+    "fragment threads keep encoding rows. If 0, the fragment threads write "
+    "synchronously.");
+DEFINE_int64(table_writer_write_behind_bytes, 8 * 1024 * 1024, "(Advanced) Maximum "
+    "number of bytes that each table writer queues for the IO threads before it waits "
+    "for their writes to complete.");
+
 namespace impala {
 
 HdfsTableWriter::HdfsTableWriter(HdfsTableSink* parent,
@@ -27,14 +40,112 @@ HdfsTableWriter::HdfsTableWriter(HdfsTableSink* parent,
     state_(state),
     output_(output),
     table_desc_(table_desc),
-    output_expr_ctxs_(output_expr_ctxs) {
+    output_expr_ctxs_(output_expr_ctxs),
+    queued_bytes_(0),
+    write_in_flight_(false) {
   int num_non_partition_cols =
       table_desc_->num_cols() - table_desc_->num_clustering_cols();
   DCHECK_GE(output_expr_ctxs_.size(), num_non_partition_cols) << parent_->DebugString();
 }
 
+HdfsTableWriter::~HdfsTableWriter() {
+  CancelWrites();
+}
+
+ThreadPool<HdfsTableWriter*>* HdfsTableWriter::write_behind_pool() {
+  DCHECK_GT(FLAGS_table_writer_io_threads, 0);
+  static ThreadPool<HdfsTableWriter*> pool("hdfs-table-sink", "write-behind",
+      FLAGS_table_writer_io_threads, 4 * FLAGS_table_writer_io_threads,
+      &WriteQueuedBuffers);
+  return &pool;
+}
+
+void HdfsTableWriter::WriteQueuedBuffers(int thread_id, HdfsTableWriter* const& writer) {
+  while (true) {
+    vector<uint8_t>* buffer;
+    bool failed;
+    {
+      lock_guard<mutex> l(writer->write_lock_);
+      if (writer->write_queue_.empty()) {
+        writer->write_in_flight_ = false;
+        writer->write_cv_.notify_all();
+        return;
+      }
+      buffer = writer->write_queue_.front();
+      writer->write_queue_.pop_front();
+      failed = !writer->write_status_.ok();
+    }
+    Status status;
+    if (!failed) status = writer->WriteToFile(&(*buffer)[0], buffer->size());
+    int64_t len = buffer->size();
+    delete buffer;
+    writer->parent_->mem_tracker()->Release(len);
+
+    lock_guard<mutex> l(writer->write_lock_);
+    writer->queued_bytes_ -= len;
+    if (!status.ok() && writer->write_status_.ok()) writer->write_status_ = status;
+    writer->write_cv_.notify_all();
+  }
+}
+
 Status HdfsTableWriter::Write(const uint8_t* data, int32_t len) {
   DCHECK_GE(len, 0);
+  COUNTER_ADD(parent_->bytes_written_counter(), len);
+  stats_.bytes_written += len;
+  if (FLAGS_table_writer_io_threads <= 0) return WriteToFile(data, len);
+  write_buffer_.insert(write_buffer_.end(), data, data + len);
+  if (write_buffer_.size() >= WRITE_BEHIND_BUFFER_SIZE) return SubmitWriteBuffer();
+  return Status::OK();
+}
+
+Status HdfsTableWriter::SubmitWriteBuffer() {
+  if (write_buffer_.empty()) return Status::OK();
+  vector<uint8_t>* buffer = new vector<uint8_t>();
+  buffer->swap(write_buffer_);
+  write_buffer_.reserve(WRITE_BEHIND_BUFFER_SIZE);
+  int64_t len = buffer->size();
+  parent_->mem_tracker()->Consume(len);
+  {
+    unique_lock<mutex> l(write_lock_);
+    // Always admit a buffer into an empty queue, so that buffers larger than the limit
+    // make progress.
+    while (write_status_.ok() && queued_bytes_ > 0 &&
+        queued_bytes_ + len > FLAGS_table_writer_write_behind_bytes) {
+      write_cv_.wait(l);
+    }
+    if (!write_status_.ok()) {
+      delete buffer;
+      parent_->mem_tracker()->Release(len);
+      return write_status_;
+    }
+    write_queue_.push_back(buffer);
+    queued_bytes_ += len;
+    if (write_in_flight_) return Status::OK();
+    write_in_flight_ = true;
+  }
+  write_behind_pool()->Offer(this);
+  return Status::OK();
+}
+
+Status HdfsTableWriter::FlushWrites() {
+  Status status = SubmitWriteBuffer();
+  unique_lock<mutex> l(write_lock_);
+  while (write_in_flight_) write_cv_.wait(l);
+  RETURN_IF_ERROR(status);
+  return write_status_;
+}
+
+void HdfsTableWriter::CancelWrites() {
+  write_buffer_.clear();
+  unique_lock<mutex> l(write_lock_);
+  // The IO thread drops the remaining buffers once it sees the error.
+  if (write_status_.ok() && write_in_flight_) write_status_ = Status::CANCELLED;
+  while (write_in_flight_) write_cv_.wait(l);
+  DCHECK(write_queue_.empty());
+  DCHECK_EQ(queued_bytes_, 0);
+}
+
+Status HdfsTableWriter::WriteToFile(const uint8_t* data, int32_t len) {
   int ret = hdfsWrite(output_->hdfs_connection, output_->tmp_hdfs_file, data, len);
   if (ret == -1) {
     string error_msg = GetHdfsErrorMsg("");
@@ -44,8 +155,6 @@ Status HdfsTableWriter::Write(const uint8_t* data, int32_t len) {
         << " " << error_msg;
     return Status(msg.str());
   }
-  COUNTER_ADD(parent_->bytes_written_counter(), len);
-  stats_.bytes_written += len;
   return Status::OK();
 }
 }
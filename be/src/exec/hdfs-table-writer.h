@@ -17,7 +17,11 @@
 #define IMPALA_EXEC_HDFS_TABLE_WRITER_H
 
 #include <hdfs.h>
+#include <deque>
+#include <vector>
 #include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/unordered_map.hpp>
 
 #include "runtime/descriptors.h"
@@ -26,6 +30,8 @@
 
 namespace impala {
 
+template <typename T> class ThreadPool;
+
 /// Pure virtual class for writing to hdfs table partition files.
 /// Subclasses implement the code needed to write to a specific file type.
 /// A subclass needs to implement functions to format and add rows to the file
@@ -44,7 +50,7 @@ class HdfsTableWriter {
                   const HdfsTableDescriptor* table_desc,
                   const std::vector<ExprContext*>& output_expr_ctxs);
 
-  virtual ~HdfsTableWriter() { }
+  virtual ~HdfsTableWriter();
 
   /// The sequence of calls to this object are:
   /// 1. Init()
@@ -55,6 +61,13 @@ class HdfsTableWriter {
   /// arbitrarily large file), 1-4 is called once.
   /// For files formats that are not splittable (i.e. columnar formats, compressed
   /// text), 1) is called once and 2-4) is called repeatedly for each file.
+///
+/// Unless --table_writer_io_threads is 0, the data passed to Write() is buffered and
+/// written to the file by a process-wide pool of IO threads, so that the fragment
+/// thread can keep encoding rows while earlier data travels to the DataNodes. Each
+/// writer queues at most --table_writer_write_behind_bytes and writes its buffers in
+/// order, one at a time. FlushWrites() must be called after Finalize() and before the
+/// file is closed.
 
   /// Do initialization of writer.
   virtual Status Init() = 0;
@@ -82,6 +95,14 @@ class HdfsTableWriter {
   /// Called once when this writer should cleanup any resources.
   virtual void Close() = 0;
 
+  /// Waits until all data passed to Write() is written to the current file. Returns
+  /// the error of the first write that failed.
+  Status FlushWrites();
+
+  /// Drops the data that is not written yet and waits for the write in progress, if
+  /// any. Must be called before the current file is closed on error paths.
+  void CancelWrites();
+
   /// Returns the stats for this writer.
   TInsertStats& stats() { return stats_; };
 
@@ -126,6 +147,42 @@ class HdfsTableWriter {
   /// Subclass should populate any file format specific stats.
   TInsertStats stats_;
 
+ private:
+  /// Size of the buffers that are handed to the IO threads.
+  static const int WRITE_BEHIND_BUFFER_SIZE = 1024 * 1024;
+
+  static ThreadPool<HdfsTableWriter*>* write_behind_pool();
+
+  /// Writes the queued buffers of 'writer' until its queue is empty. Executed by the
+  /// threads of write_behind_pool().
+  static void WriteQueuedBuffers(int thread_id, HdfsTableWriter* const& writer);
+
+  /// Calls hdfsWrite() for the current file.
+  Status WriteToFile(const uint8_t* data, int32_t len);
+
+  /// Queues write_buffer_ for the IO threads. Blocks while the queue is full.
+  Status SubmitWriteBuffer();
+
+  /// Data passed to Write() that is not queued yet. Only used by the fragment thread.
+  std::vector<uint8_t> write_buffer_;
+
+  /// Protects the members below and signals write_cv_ when a buffer is written.
+  boost::mutex write_lock_;
+  boost::condition_variable write_cv_;
+
+  /// Buffers to write, in file order. Owned by this writer.
+  std::deque<std::vector<uint8_t>*> write_queue_;
+
+  /// Total size of the buffers in write_queue_ and of the one being written. Tracked
+  /// by the parent's MemTracker.
+  int64_t queued_bytes_;
+
+  /// True while an IO thread works on this writer's queue. At most one does, so that
+  /// the buffers are written in order.
+  bool write_in_flight_;
+
+  /// First error returned by hdfsWrite() on an IO thread. Later buffers are dropped.
+  Status write_status_;
 };
 }
 #endif
@@ -80,11 +80,12 @@ Status HdfsTextScanner::IssueInitialRanges(HdfsScanNode* scan_node,
       case THdfsCompression::SNAPPY:
       case THdfsCompression::SNAPPY_BLOCKED:
       case THdfsCompression::BZIP2:
+      case THdfsCompression::ZSTD:
         ++compressed_text_files;
         for (int j = 0; j < files[i]->splits.size(); ++j) {
-          // In order to decompress gzip-, snappy- and bzip2-compressed text files, we
-          // need to read entire files. Only read a file if we're assigned the first split
-          // to avoid reading multi-block files with multiple scanners.
+          // In order to decompress gzip-, snappy-, bzip2- and zstd-compressed text files,
+          // we need to read entire files. Only read a file if we're assigned the first
+          // split to avoid reading multi-block files with multiple scanners.
           DiskIoMgr::ScanRange* split = files[i]->splits[j];
 
           // We only process the split that starts at offset 0.
@@ -663,11 +664,8 @@ int HdfsTextScanner::WriteFields(MemPool* pool, TupleRow* tuple_row,
   if (slot_idx_ != 0) {
     DCHECK(tuple_ != NULL);
     int num_partial_fields = scan_node_->materialized_slots().size() - slot_idx_;
-    // Corner case where there will be no materialized tuples but at least one col
-    // worth of string data.  In this case, make a deep copy and reuse the byte buffer.
-    bool copy_strings = num_partial_fields > num_fields;
     num_partial_fields = min(num_partial_fields, num_fields);
-    WritePartialTuple(fields, num_partial_fields, copy_strings);
+    WritePartialTuple(fields, num_partial_fields, decompressor_.get() != NULL);
 
     // This handles case 1.  If the tuple is complete and we've found a tuple delimiter
     // this time around (i.e. num_tuples > 0), add it to the row batch.  Otherwise,
@@ -736,10 +734,10 @@ int HdfsTextScanner::WriteFields(MemPool* pool, TupleRow* tuple_row,
   if (num_fields != 0) {
     DCHECK(tuple_ != NULL);
     InitTuple(template_tuple_, partial_tuple_);
-    // If there have been no materialized tuples at this point, copy string data
-    // out of byte_buffer and reuse the byte_buffer.  The copied data can be at
-    // most one tuple's worth.
-    WritePartialTuple(fields, num_fields, num_tuples_materialized == 0);
+    // Strings can reference uncompressed data until the tuple is complete, its io
+    // buffer is attached to the batch the tuple ends up in (see PrepareToReturnBatch()).
+    // Decompressed data may be overwritten by the next block, so it is copied.
+    WritePartialTuple(fields, num_fields, decompressor_.get() != NULL);
     partial_tuple_empty_ = false;
   }
   DCHECK_LE(slot_idx_, scan_node_->materialized_slots().size());
@@ -771,7 +769,7 @@ int HdfsTextScanner::WritePartialTuple(FieldLocation* fields,
 
     const SlotDescriptor* desc = scan_node_->materialized_slots()[slot_idx_];
     if (!text_converter_->WriteSlot(desc, partial_tuple_,
-        fields[i].start, len, true, need_escape, data_buffer_pool_.get())) {
+        fields[i].start, len, copy_strings, need_escape, data_buffer_pool_.get())) {
       ReportColumnParseError(desc, fields[i].start, len);
       error_in_row_ = true;
     }
@@ -779,3 +777,19 @@ int HdfsTextScanner::WritePartialTuple(FieldLocation* fields,
   }
   return next_line_offset;
 }
+
+void HdfsTextScanner::PrepareToReturnBatch() {
+  // Decompressed strings were copied by WritePartialTuple() already.
+  if (partial_tuple_empty_ || decompressor_.get() != NULL) return;
+  // Only the first slot_idx_ slots have been written, the others may be uninitialized.
+  for (int i = 0; i < slot_idx_; ++i) {
+    const SlotDescriptor* desc = scan_node_->materialized_slots()[i];
+    if (!desc->type().IsVarLenStringType()) continue;
+    if (partial_tuple_->IsNull(desc->null_indicator_offset())) continue;
+    StringValue* str = partial_tuple_->GetStringSlot(desc->tuple_offset());
+    if (str->len == 0) continue;
+    char* copy = reinterpret_cast<char*>(data_buffer_pool_->Allocate(str->len));
+    memcpy(copy, str->ptr, str->len);
+    str->ptr = copy;
+  }
+}
@@ -134,9 +134,15 @@ class HdfsTextScanner : public HdfsScanner {
 
   /// Utility function to write out 'num_fields' to 'tuple_'.  This is used to parse
   /// partial tuples.  Returns bytes processed.  If copy_strings is true, strings
-  /// from fields will be copied into the boundary pool.
+  /// from fields will be copied into data_buffer_pool_. Otherwise they reference the
+  /// byte buffer, and are only copied by PrepareToReturnBatch() if the batch is
+  /// returned before the tuple is complete.
   int WritePartialTuple(FieldLocation*, int num_fields, bool copy_strings);
 
+  /// Copies the strings of partial_tuple_, if any, into data_buffer_pool_, since they
+  /// may reference io buffers or boundary data that is attached to batch_.
+  virtual void PrepareToReturnBatch();
+
   /// Appends the current file and line to the RuntimeState's error log.
   /// row_idx is 0-based (in current batch) where the parse error occured.
   virtual void LogRowParseError(int row_idx, std::stringstream*);
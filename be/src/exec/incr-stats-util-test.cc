@@ -18,7 +18,9 @@
 #include <cmath>
 
 #include "common/logging.h"
+#include "exec/incr-stats-util.h"
 #include "exprs/aggregate-functions.h"
+#include "runtime/string-value.h"
 
 #include "common/names.h"
 
@@ -69,6 +71,44 @@ TEST(RleTest, TestEncode) {
   ASSERT_EQ(DecodeNdv(encoded, is_encoded), test);
 }
 
+TEST(IntermediateColumnStatsTest, MergeFlushes) {
+  // Stats flushed in two parts and merged must match stats built in one go.
+  IntermediateColumnStatsBuilder whole("c", ColumnType(TYPE_BIGINT));
+  IntermediateColumnStatsBuilder part("c", ColumnType(TYPE_BIGINT));
+  TIntermediateColumnStats whole_stats;
+  TIntermediateColumnStats merged_stats;
+  for (int64_t i = 0; i < 1000; ++i) {
+    const int64_t* value = (i % 10 == 0) ? NULL : &i;
+    whole.Update(value);
+    part.Update(value);
+    if (i == 500) part.Flush(&merged_stats);
+  }
+  whole.Flush(&whole_stats);
+  part.Flush(&merged_stats);
+
+  EXPECT_EQ(100, merged_stats.num_nulls);
+  EXPECT_EQ(900, merged_stats.num_rows);
+  EXPECT_EQ(8, merged_stats.max_width);
+  EXPECT_EQ(8, merged_stats.avg_width);
+  EXPECT_EQ(DecodeNdv(whole_stats.intermediate_ndv, whole_stats.is_ndv_encoded),
+      DecodeNdv(merged_stats.intermediate_ndv, merged_stats.is_ndv_encoded));
+}
+
+TEST(IntermediateColumnStatsTest, StringWidths) {
+  IntermediateColumnStatsBuilder builder("s", ColumnType(TYPE_STRING));
+  char data[] = "abcd";
+  StringValue short_value(data, 1);
+  StringValue long_value(data, 4);
+  builder.Update(&short_value);
+  builder.Update(&long_value);
+  builder.Update(NULL);
+  TIntermediateColumnStats stats;
+  builder.Flush(&stats);
+  EXPECT_EQ(4, stats.max_width);
+  EXPECT_EQ(2.5, stats.avg_width);
+  EXPECT_EQ(2, stats.num_rows);
+  EXPECT_EQ(1, stats.num_nulls);
+}
 
 int main(int argc, char** argv) {
   //InitCommonRuntime(argc, argv, true);
@@ -22,11 +22,13 @@
 
 #include "common/compiler-util.h"
 #include "common/logging.h"
+#include "runtime/string-value.inline.h"
 #include "service/hs2-util.h"
 #include "udf/udf.h"
 #include "gen-cpp/CatalogService_types.h"
 #include "gen-cpp/CatalogObjects_types.h"
 #include "exprs/aggregate-functions.h"
+#include "util/hash-util.h"
 
 #include "common/names.h"
 
@@ -36,13 +38,13 @@ using namespace impala_udf;
 using namespace strings;
 
 // Finalize method for the NDV_NO_FINALIZE() UDA, which only copies the intermediate state
-// of the NDV computation into its output StringVal.
+// of the NDV computation into its output StringVal. The output always has the dense
+// HLL_LEN registers, which is what the incremental stats are stored as.
 StringVal IncrementNdvFinalize(FunctionContext* ctx, const StringVal& src) {
   if (UNLIKELY(src.is_null)) return src;
-  DCHECK_EQ(src.len, AggregateFunctions::HLL_LEN);
-  StringVal result_str(ctx, src.len);
+  StringVal result_str(ctx, AggregateFunctions::HLL_LEN);
   if (UNLIKELY(result_str.is_null)) return result_str;
-  memcpy(result_str.ptr, src.ptr, src.len);
+  AggregateFunctions::HllGetRegisters(src, result_str.ptr);
   ctx->Free(src.ptr);
   return result_str;
 }
@@ -307,4 +309,100 @@ void FinalizePartitionedColumnStats(const TTableSchema& col_stats_schema,
   params->__isset.column_stats = true;
 }
 
+void MergeIntermediateColumnStats(const TIntermediateColumnStats& src,
+    TIntermediateColumnStats* dst) {
+  if (!dst->__isset.intermediate_ndv) {
+    *dst = src;
+    return;
+  }
+  string ndv = DecodeNdv(dst->intermediate_ndv, dst->is_ndv_encoded);
+  string src_ndv = DecodeNdv(src.intermediate_ndv, src.is_ndv_encoded);
+  DCHECK_EQ(ndv.size(), src_ndv.size());
+  for (int i = 0; i < ndv.size(); ++i) {
+    ndv[i] = std::max<uint8_t>(ndv[i], src_ndv[i]);
+  }
+  bool is_encoded;
+  dst->__set_intermediate_ndv(EncodeNdv(ndv, &is_encoded));
+  dst->__set_is_ndv_encoded(is_encoded);
+  if (dst->num_nulls >= 0 && src.num_nulls >= 0) {
+    dst->__set_num_nulls(dst->num_nulls + src.num_nulls);
+  } else {
+    dst->__set_num_nulls(-1);
+  }
+  dst->__set_max_width(std::max(dst->max_width, src.max_width));
+  int64_t num_rows = dst->num_rows + src.num_rows;
+  if (num_rows > 0) {
+    dst->__set_avg_width((dst->avg_width * dst->num_rows + src.avg_width * src.num_rows)
+        / num_rows);
+  }
+  dst->__set_num_rows(num_rows);
+}
+
+IntermediateColumnStatsBuilder::IntermediateColumnStatsBuilder(const string& col_name,
+    const ColumnType& type)
+  : col_name_(col_name),
+    type_(type),
+    registers_(AggregateFunctions::HLL_LEN, 0),
+    num_nulls_(0),
+    num_rows_(0),
+    max_width_(0),
+    total_width_(0) {
+}
+
+void IntermediateColumnStatsBuilder::Update(const void* value) {
+  if (value == NULL) {
+    ++num_nulls_;
+    return;
+  }
+  ++num_rows_;
+
+  // Hash the value the way AggregateFunctions::HllUpdate() hashes the matching AnyVal,
+  // the registers have to be the same as NDV_NO_FINALIZE()'s to be mergeable.
+  const void* data = value;
+  int len = type_.GetByteSize();
+  int width = type_.GetSlotSize();
+  if (type_.type == TYPE_CHAR) {
+    data = StringValue::CharSlotToPtr(value, type_);
+    len = type_.len;
+    width = type_.len;
+  } else if (type_.IsStringType()) {
+    const StringValue* string_value = reinterpret_cast<const StringValue*>(value);
+    data = string_value->ptr;
+    len = string_value->len;
+    width = string_value->len;
+  } else if (type_.type == TYPE_TIMESTAMP) {
+    // TimestampVals are hashed without their padding.
+    len = 12;
+  }
+  max_width_ = std::max(max_width_, width);
+  total_width_ += width;
+
+  uint64_t hash_value = HashUtil::MurmurHash2_64(data, len, HashUtil::FNV64_SEED);
+  if (hash_value != 0) {
+    int idx = hash_value & (AggregateFunctions::HLL_LEN - 1);
+    uint8_t first_one_bit =
+        __builtin_ctzl(hash_value >> AggregateFunctions::HLL_PRECISION) + 1;
+    registers_[idx] = std::max<uint8_t>(registers_[idx], first_one_bit);
+  }
+}
+
+void IntermediateColumnStatsBuilder::Flush(TIntermediateColumnStats* stats) {
+  TIntermediateColumnStats new_stats;
+  bool is_encoded;
+  new_stats.__set_intermediate_ndv(EncodeNdv(registers_, &is_encoded));
+  new_stats.__set_is_ndv_encoded(is_encoded);
+  new_stats.__set_num_nulls(num_nulls_);
+  new_stats.__set_max_width(max_width_);
+  new_stats.__set_avg_width(
+      num_rows_ == 0 ? 0 : static_cast<double>(total_width_) / num_rows_);
+  new_stats.__set_num_rows(num_rows_);
+  MergeIntermediateColumnStats(new_stats, stats);
+
+  registers_.assign(AggregateFunctions::HLL_LEN, 0);
+  num_nulls_ = 0;
+  num_rows_ = 0;
+  max_width_ = 0;
+  total_width_ = 0;
+}
+
 }
@@ -12,12 +12,18 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#ifndef IMPALA_EXEC_INCR_STATS_UTIL_H
+#define IMPALA_EXEC_INCR_STATS_UTIL_H
+
 #include "gen-cpp/TCLIService_types.h"
 #include "gen-cpp/CatalogService_types.h"
 #include "gen-cpp/CatalogObjects_types.h"
 
+#include <string>
 #include <vector>
 
+#include "runtime/types.h"
+
 namespace impala {
 
 /// Populates the supplied TAlterTableUpdateStatsParams argument with per-column statistics
@@ -30,4 +36,46 @@ void FinalizePartitionedColumnStats(
     const std::vector<std::vector<std::string> >& expected_partitions,
     const apache::hive::service::cli::thrift::TRowSet& rowset,
     int32_t num_partition_cols, TAlterTableUpdateStatsParams* params);
+
+/// Merges the intermediate stats 'src' of one column into 'dst', which may be empty.
+/// Both must be for disjoint sets of rows of the same column.
+void MergeIntermediateColumnStats(const TIntermediateColumnStats& src,
+    TIntermediateColumnStats* dst);
+
+/// Gathers the intermediate stats of one column from its values, giving the same
+/// results as the child queries of COMPUTE INCREMENTAL STATS. Table sinks use this to
+/// compute the stats of the data they write, so that it doesn't have to be scanned again.
+class IntermediateColumnStatsBuilder {
+ public:
+  IntermediateColumnStatsBuilder(const std::string& col_name, const ColumnType& type);
+
+  /// Adds the slot value 'value', which is NULL for a NULL value.
+  void Update(const void* value);
+
+  /// Merges the stats of the values added since the last call into 'stats' and resets
+  /// this builder.
+  void Flush(TIntermediateColumnStats* stats);
+
+  const std::string& col_name() const { return col_name_; }
+
+ private:
+  std::string col_name_;
+  ColumnType type_;
+
+  /// Dense HLL registers of the values.
+  std::string registers_;
+
+  int64_t num_nulls_;
+
+  /// Number of non-NULL values.
+  int64_t num_rows_;
+
+  int32_t max_width_;
+
+  /// Sum of the widths of the non-NULL values.
+  int64_t total_width_;
+};
+
 }
+
+#endif
@@ -0,0 +1,440 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "exec/merge-join-node.h"
+
+#include <sstream>
+
+#include "exprs/expr.h"
+#include "exprs/expr-context.h"
+#include "runtime/mem-pool.h"
+#include "runtime/raw-value.h"
+#include "runtime/row-batch.h"
+#include "runtime/runtime-state.h"
+#include "runtime/tuple-row.h"
+#include "util/debug-util.h"
+#include "util/runtime-profile.h"
+
+#include "gen-cpp/PlanNodes_types.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+MergeJoinNode::MergeJoinNode(ObjectPool* pool, const TPlanNode& tnode,
+    const DescriptorTbl& descs)
+  : ExecNode(pool, tnode, descs),
+    join_op_(tnode.hash_join_node.join_op),
+    left_tuple_row_size_(0),
+    right_tuple_row_size_(0),
+    staging_row_(NULL),
+    left_batch_pos_(0),
+    left_eos_(false),
+    right_batch_pos_(0),
+    right_eos_(false),
+    left_row_(NULL),
+    left_row_matched_(false),
+    state_(COMPARE_KEYS),
+    group_pos_(0),
+    eos_(false),
+    left_row_counter_(NULL),
+    right_row_counter_(NULL),
+    max_group_rows_counter_(NULL) {
+}
+
+MergeJoinNode::~MergeJoinNode() {
+  // The batches must be cleaned up in Close() to ensure proper resource freeing.
+  DCHECK(left_batch_ == NULL);
+  DCHECK(right_batch_ == NULL);
+}
+
+Status MergeJoinNode::Init(const TPlanNode& tnode, RuntimeState* state) {
+  RETURN_IF_ERROR(ExecNode::Init(tnode, state));
+  DCHECK(tnode.__isset.hash_join_node);
+  const THashJoinNode& join_node = tnode.hash_join_node;
+  DCHECK_NE(join_op_, TJoinOp::NULL_AWARE_LEFT_ANTI_JOIN);
+  DCHECK((join_op_ != TJoinOp::LEFT_SEMI_JOIN && join_op_ != TJoinOp::LEFT_ANTI_JOIN &&
+      join_op_ != TJoinOp::RIGHT_SEMI_JOIN && join_op_ != TJoinOp::RIGHT_ANTI_JOIN) ||
+      conjunct_ctxs_.size() == 0);
+  DCHECK_EQ(join_node.merge_is_asc_order.size(), join_node.eq_join_conjuncts.size());
+  DCHECK_EQ(join_node.merge_nulls_first.size(), join_node.eq_join_conjuncts.size());
+  for (int i = 0; i < join_node.eq_join_conjuncts.size(); ++i) {
+    const TEqJoinCondition& eq_join_conjunct = join_node.eq_join_conjuncts[i];
+    DCHECK(!eq_join_conjunct.is_not_distinct_from);
+    ExprContext* ctx;
+    RETURN_IF_ERROR(Expr::CreateExprTree(pool_, eq_join_conjunct.left, &ctx));
+    left_key_ctxs_.push_back(ctx);
+    RETURN_IF_ERROR(Expr::CreateExprTree(pool_, eq_join_conjunct.right, &ctx));
+    right_key_ctxs_.push_back(ctx);
+  }
+  is_asc_order_ = join_node.merge_is_asc_order;
+  nulls_first_ = join_node.merge_nulls_first;
+  RETURN_IF_ERROR(Expr::CreateExprTrees(pool_, join_node.other_join_conjuncts,
+      &other_join_conjunct_ctxs_));
+  return Status::OK();
+}
+
+Status MergeJoinNode::Prepare(RuntimeState* state) {
+  SCOPED_TIMER(runtime_profile_->total_time_counter());
+  RETURN_IF_ERROR(ExecNode::Prepare(state));
+
+  RETURN_IF_ERROR(Expr::Prepare(left_key_ctxs_, state, child(0)->row_desc(),
+      expr_mem_tracker()));
+  AddExprCtxsToFree(left_key_ctxs_);
+  RETURN_IF_ERROR(Expr::Prepare(right_key_ctxs_, state, child(1)->row_desc(),
+      expr_mem_tracker()));
+  AddExprCtxsToFree(right_key_ctxs_);
+  // other_join_conjunct_ctxs_ are evaluated in the context of rows assembled from all
+  // left and right tuples.
+  RowDescriptor full_row_desc(child(0)->row_desc(), child(1)->row_desc());
+  RETURN_IF_ERROR(Expr::Prepare(other_join_conjunct_ctxs_, state, full_row_desc,
+      expr_mem_tracker()));
+  AddExprCtxsToFree(other_join_conjunct_ctxs_);
+
+  left_row_counter_ = ADD_COUNTER(runtime_profile(), "ProbeRows", TUnit::UNIT);
+  right_row_counter_ = ADD_COUNTER(runtime_profile(), "BuildRows", TUnit::UNIT);
+  max_group_rows_counter_ = ADD_COUNTER(runtime_profile(), "MaxGroupRows", TUnit::UNIT);
+
+  left_tuple_row_size_ = child(0)->row_desc().tuple_descriptors().size() * sizeof(Tuple*);
+  right_tuple_row_size_ =
+      child(1)->row_desc().tuple_descriptors().size() * sizeof(Tuple*);
+  if (join_op_ == TJoinOp::LEFT_ANTI_JOIN || join_op_ == TJoinOp::LEFT_SEMI_JOIN ||
+      join_op_ == TJoinOp::RIGHT_ANTI_JOIN || join_op_ == TJoinOp::RIGHT_SEMI_JOIN) {
+    staging_row_ = reinterpret_cast<TupleRow*>(
+        new char[left_tuple_row_size_ + right_tuple_row_size_]);
+  }
+
+  group_pool_.reset(new MemPool(mem_tracker()));
+  left_batch_.reset(
+      new RowBatch(child(0)->row_desc(), state->batch_size(), mem_tracker()));
+  right_batch_.reset(
+      new RowBatch(child(1)->row_desc(), state->batch_size(), mem_tracker()));
+  return Status::OK();
+}
+
+Status MergeJoinNode::Open(RuntimeState* state) {
+  SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
+  RETURN_IF_ERROR(ExecNode::Open(state));
+  RETURN_IF_ERROR(Expr::Open(left_key_ctxs_, state));
+  RETURN_IF_ERROR(Expr::Open(right_key_ctxs_, state));
+  RETURN_IF_ERROR(Expr::Open(other_join_conjunct_ctxs_, state));
+  RETURN_IF_CANCELLED(state);
+  RETURN_IF_ERROR(QueryMaintenance(state));
+  RETURN_IF_ERROR(child(0)->Open(state));
+  RETURN_IF_ERROR(child(1)->Open(state));
+
+  eos_ = false;
+  state_ = COMPARE_KEYS;
+  left_eos_ = false;
+  left_batch_pos_ = 0;
+  right_eos_ = false;
+  right_batch_pos_ = 0;
+  RETURN_IF_ERROR(NextLeftRow(state, NULL));
+  RETURN_IF_ERROR(NextGroup(state, NULL));
+  return Status::OK();
+}
+
+Status MergeJoinNode::GetNext(RuntimeState* state, RowBatch* out_batch, bool* eos) {
+  DCHECK(!out_batch->AtCapacity());
+  SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
+  RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
+  RETURN_IF_CANCELLED(state);
+  RETURN_IF_ERROR(QueryMaintenance(state));
+
+  while (!eos_ && !out_batch->AtCapacity()) {
+    switch (state_) {
+      case COMPARE_KEYS: {
+        // Stop early if no remaining row of either input can be returned.
+        if ((left_row_ == NULL && (group_rows_.empty() || !ReturnsGroupRows())) ||
+            (group_rows_.empty() && !ReturnsUnmatchedLeftRows())) {
+          eos_ = true;
+          break;
+        }
+        int cmp;
+        bool has_null = false;
+        if (left_row_ == NULL) {
+          cmp = 1;
+        } else if (group_rows_.empty()) {
+          cmp = -1;
+        } else {
+          cmp = CompareToGroupKey(left_row_, left_key_ctxs_, &has_null);
+        }
+        if (cmp > 0) {
+          // No remaining left row can match the group.
+          state_ = OUTPUT_GROUP;
+          group_pos_ = 0;
+        } else if (cmp < 0 || has_null) {
+          left_row_matched_ = false;
+          ProcessUnmatchedLeftRow(out_batch);
+          RETURN_IF_ERROR(NextLeftRow(state, out_batch));
+        } else {
+          state_ = JOIN_LEFT_ROW;
+          group_pos_ = 0;
+          left_row_matched_ = false;
+        }
+        break;
+      }
+      case JOIN_LEFT_ROW: {
+        bool done;
+        JoinLeftRow(out_batch, &done);
+        // ProcessUnmatchedLeftRow() may add a row.
+        if (!done || out_batch->AtCapacity()) break;
+        ProcessUnmatchedLeftRow(out_batch);
+        RETURN_IF_ERROR(NextLeftRow(state, out_batch));
+        state_ = COMPARE_KEYS;
+        break;
+      }
+      case OUTPUT_GROUP: {
+        bool done;
+        OutputGroupRows(out_batch, &done);
+        if (!done) break;
+        RETURN_IF_ERROR(NextGroup(state, out_batch));
+        state_ = COMPARE_KEYS;
+        break;
+      }
+      default:
+        DCHECK(false) << "Unknown state: " << state_;
+    }
+    if (ReachedLimit()) eos_ = true;
+  }
+
+  if (ReachedLimit()) {
+    out_batch->set_num_rows(out_batch->num_rows() - (num_rows_returned_ - limit_));
+    num_rows_returned_ = limit_;
+    eos_ = true;
+  }
+  if (eos_) {
+    left_batch_->TransferResourceOwnership(out_batch);
+    out_batch->tuple_data_pool()->AcquireData(group_pool_.get(), false);
+  }
+  *eos = eos_;
+  COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+  return Status::OK();
+}
+
+Status MergeJoinNode::Reset(RuntimeState* state) {
+  left_batch_->Reset();
+  right_batch_->Reset();
+  group_rows_.clear();
+  group_matched_.clear();
+  group_pool_->FreeAll();
+  left_row_ = NULL;
+  return ExecNode::Reset(state);
+}
+
+void MergeJoinNode::Close(RuntimeState* state) {
+  if (is_closed()) return;
+  left_batch_.reset();
+  right_batch_.reset();
+  if (group_pool_.get() != NULL) group_pool_->FreeAll();
+  if (staging_row_ != NULL) delete[] staging_row_;
+  Expr::Close(left_key_ctxs_, state);
+  Expr::Close(right_key_ctxs_, state);
+  Expr::Close(other_join_conjunct_ctxs_, state);
+  ExecNode::Close(state);
+}
+
+int MergeJoinNode::CompareToGroupKey(TupleRow* row,
+    const vector<ExprContext*>& key_ctxs, bool* has_null) {
+  DCHECK_EQ(key_ctxs.size(), group_key_.size());
+  for (int i = 0; i < key_ctxs.size(); ++i) {
+    void* value = key_ctxs[i]->GetValue(row);
+    void* group_value = group_key_[i];
+    // The sort order of NULLs is independent of asc/desc.
+    if (value == NULL || group_value == NULL) {
+      *has_null = true;
+      if (value == group_value) continue;
+      return (value == NULL) == nulls_first_[i] ? -1 : 1;
+    }
+    int result = RawValue::Compare(value, group_value, key_ctxs[i]->root()->type());
+    if (result != 0) return is_asc_order_[i] ? result : -result;
+  }
+  return 0;
+}
+
+void MergeJoinNode::InitGroupKey(TupleRow* row) {
+  group_key_.resize(right_key_ctxs_.size());
+  for (int i = 0; i < right_key_ctxs_.size(); ++i) {
+    void* value = right_key_ctxs_[i]->GetValue(row);
+    if (value == NULL) {
+      group_key_[i] = NULL;
+      continue;
+    }
+    // The exprs may return values that the next evaluation overwrites.
+    const ColumnType& type = right_key_ctxs_[i]->root()->type();
+    group_key_[i] = group_pool_->Allocate(type.GetSlotSize());
+    RawValue::Write(value, group_key_[i], type, group_pool_.get());
+  }
+}
+
+Status MergeJoinNode::NextLeftRow(RuntimeState* state, RowBatch* out_batch) {
+  while (left_batch_pos_ == left_batch_->num_rows()) {
+    if (out_batch != NULL) {
+      left_batch_->TransferResourceOwnership(out_batch);
+    } else {
+      left_batch_->Reset();
+    }
+    if (left_eos_) {
+      left_row_ = NULL;
+      return Status::OK();
+    }
+    RETURN_IF_ERROR(child(0)->GetNext(state, left_batch_.get(), &left_eos_));
+    left_batch_pos_ = 0;
+    COUNTER_ADD(left_row_counter_, left_batch_->num_rows());
+  }
+  left_row_ = left_batch_->GetRow(left_batch_pos_++);
+  return Status::OK();
+}
+
+Status MergeJoinNode::NextGroup(RuntimeState* state, RowBatch* out_batch) {
+  // The output batch may reference the rows of the discarded group.
+  if (out_batch != NULL) {
+    out_batch->tuple_data_pool()->AcquireData(group_pool_.get(), false);
+  } else {
+    group_pool_->FreeAll();
+  }
+  group_rows_.clear();
+  const vector<TupleDescriptor*>& descs = child(1)->row_desc().tuple_descriptors();
+  while (true) {
+    if (right_batch_pos_ == right_batch_->num_rows()) {
+      // The group rows are copies, so no output row references the batch.
+      right_batch_->Reset();
+      if (right_eos_) break;
+      RETURN_IF_ERROR(child(1)->GetNext(state, right_batch_.get(), &right_eos_));
+      right_batch_pos_ = 0;
+      COUNTER_ADD(right_row_counter_, right_batch_->num_rows());
+      // Groups of hot keys may be large.
+      RETURN_IF_CANCELLED(state);
+      RETURN_IF_ERROR(QueryMaintenance(state));
+      continue;
+    }
+    TupleRow* row = right_batch_->GetRow(right_batch_pos_);
+    if (group_rows_.empty()) {
+      InitGroupKey(row);
+    } else {
+      bool has_null = false;
+      if (CompareToGroupKey(row, right_key_ctxs_, &has_null) != 0) break;
+    }
+    group_rows_.push_back(row->DeepCopy(descs, group_pool_.get()));
+    ++right_batch_pos_;
+  }
+  group_matched_.assign(group_rows_.size(), false);
+  int64_t num_group_rows = group_rows_.size();
+  if (num_group_rows > max_group_rows_counter_->value()) {
+    COUNTER_SET(max_group_rows_counter_, num_group_rows);
+  }
+  return Status::OK();
+}
+
+void MergeJoinNode::JoinLeftRow(RowBatch* out_batch, bool* done) {
+  *done = false;
+  ExprContext* const* other_join_conjunct_ctxs = &other_join_conjunct_ctxs_[0];
+  int num_other_join_conjuncts = other_join_conjunct_ctxs_.size();
+  ExprContext* const* conjunct_ctxs = &conjunct_ctxs_[0];
+  int num_conjuncts = conjunct_ctxs_.size();
+  for (; group_pos_ < group_rows_.size(); ++group_pos_) {
+    if (out_batch->AtCapacity()) return;
+    TupleRow* right_row = group_rows_[group_pos_];
+    if (staging_row_ != NULL) {
+      // Semi and anti joins.
+      if (join_op_ == TJoinOp::RIGHT_SEMI_JOIN && group_matched_[group_pos_]) continue;
+      CreateOutputRow(staging_row_, left_row_, right_row);
+      if (!EvalConjuncts(other_join_conjunct_ctxs, num_other_join_conjuncts,
+          staging_row_)) {
+        continue;
+      }
+      left_row_matched_ = true;
+      group_matched_[group_pos_] = true;
+      if (join_op_ == TJoinOp::LEFT_SEMI_JOIN || join_op_ == TJoinOp::LEFT_ANTI_JOIN) {
+        // The first match decides about the left row.
+        if (join_op_ == TJoinOp::LEFT_SEMI_JOIN) AddOutputRow(out_batch, left_row_, NULL);
+        group_pos_ = group_rows_.size();
+        break;
+      }
+      continue;
+    }
+    TupleRow* out_row = out_batch->GetRow(out_batch->AddRow());
+    CreateOutputRow(out_row, left_row_, right_row);
+    if (!EvalConjuncts(other_join_conjunct_ctxs, num_other_join_conjuncts, out_row)) {
+      continue;
+    }
+    left_row_matched_ = true;
+    group_matched_[group_pos_] = true;
+    if (!EvalConjuncts(conjunct_ctxs, num_conjuncts, out_row)) continue;
+    out_batch->CommitLastRow();
+    ++num_rows_returned_;
+  }
+  *done = true;
+}
+
+void MergeJoinNode::ProcessUnmatchedLeftRow(RowBatch* out_batch) {
+  if (left_row_matched_ || !ReturnsUnmatchedLeftRows()) return;
+  AddOutputRow(out_batch, left_row_, NULL);
+}
+
+void MergeJoinNode::OutputGroupRows(RowBatch* out_batch, bool* done) {
+  *done = false;
+  if (!ReturnsGroupRows()) group_pos_ = group_rows_.size();
+  for (; group_pos_ < group_rows_.size(); ++group_pos_) {
+    if (out_batch->AtCapacity()) return;
+    // Right semi joins return the matched rows, all others the unmatched ones.
+    if (group_matched_[group_pos_] != (join_op_ == TJoinOp::RIGHT_SEMI_JOIN)) continue;
+    AddOutputRow(out_batch, NULL, group_rows_[group_pos_]);
+  }
+  *done = true;
+}
+
+void MergeJoinNode::AddOutputRow(RowBatch* out_batch, TupleRow* left_row,
+    TupleRow* right_row) {
+  TupleRow* out_row = out_batch->GetRow(out_batch->AddRow());
+  if (join_op_ == TJoinOp::LEFT_SEMI_JOIN || join_op_ == TJoinOp::LEFT_ANTI_JOIN) {
+    out_batch->CopyRow(left_row, out_row);
+  } else if (join_op_ == TJoinOp::RIGHT_SEMI_JOIN ||
+      join_op_ == TJoinOp::RIGHT_ANTI_JOIN) {
+    out_batch->CopyRow(right_row, out_row);
+  } else {
+    CreateOutputRow(out_row, left_row, right_row);
+  }
+  if (!EvalConjuncts(&conjunct_ctxs_[0], conjunct_ctxs_.size(), out_row)) return;
+  VLOG_ROW << "match row: " << PrintRow(out_row, row_desc());
+  out_batch->CommitLastRow();
+  ++num_rows_returned_;
+}
+
+void MergeJoinNode::CreateOutputRow(TupleRow* out_row, TupleRow* left_row,
+    TupleRow* right_row) {
+  uint8_t* out_ptr = reinterpret_cast<uint8_t*>(out_row);
+  if (left_row == NULL) {
+    memset(out_ptr, 0, left_tuple_row_size_);
+  } else {
+    memcpy(out_ptr, left_row, left_tuple_row_size_);
+  }
+  if (right_row == NULL) {
+    memset(out_ptr + left_tuple_row_size_, 0, right_tuple_row_size_);
+  } else {
+    memcpy(out_ptr + left_tuple_row_size_, right_row, right_tuple_row_size_);
+  }
+}
+
+void MergeJoinNode::DebugString(int indentation_level, stringstream* out) const {
+  *out << string(indentation_level * 2, ' ');
+  *out << "MergeJoinNode(eos=" << (eos_ ? "true" : "false")
+       << " group_rows=" << group_rows_.size()
+       << " left_keys=" << Expr::DebugString(left_key_ctxs_)
+       << " right_keys=" << Expr::DebugString(right_key_ctxs_);
+  ExecNode::DebugString(indentation_level, out);
+  *out << ")";
+}
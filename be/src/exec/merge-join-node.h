@@ -0,0 +1,188 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_EXEC_MERGE_JOIN_NODE_H
+#define IMPALA_EXEC_MERGE_JOIN_NODE_H
+
+#include <boost/scoped_ptr.hpp>
+
+#include "exec/exec-node.h"
+
+#include "gen-cpp/PlanNodes_types.h"  // for TJoinOp
+
+namespace impala {
+
+class MemPool;
+class RowBatch;
+class TupleRow;
+
+/// Node for equi-joins whose inputs are both sorted on the join exprs, i.e. whose
+/// children are sorts or merging exchanges that order by them in the same direction. The
+/// planner marks such hash joins and the backend creates this node instead of a hash
+/// join. Both inputs are streamed: the node only keeps the group of right rows that have
+/// the join key of the current left row, and the current batch of each input. Memory use
+/// therefore depends on the size of the largest group rather than on the size of the
+/// right input, and rows are returned while the inputs are consumed.
+///
+/// All join modes except the null-aware left anti join are supported. Rows with a NULL
+/// join key never match. Right rows without a match are returned (right outer, full
+/// outer and right anti joins) or dropped when their group is discarded, i.e. once a
+/// left row with a larger key arrives.
+///
+/// The output row layout is the same as for the hash join nodes.
+class MergeJoinNode : public ExecNode {
+ public:
+  MergeJoinNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs);
+
+  virtual ~MergeJoinNode();
+
+  virtual Status Init(const TPlanNode& tnode, RuntimeState* state);
+  virtual Status Prepare(RuntimeState* state);
+  virtual Status Open(RuntimeState* state);
+  virtual Status GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos);
+  virtual Status Reset(RuntimeState* state);
+  virtual void Close(RuntimeState* state);
+
+ protected:
+  virtual void DebugString(int indentation_level, std::stringstream* out) const;
+
+ private:
+  /// What GetNext() does next.
+  enum State {
+    /// Compare the key of the current left row with the key of the current group.
+    COMPARE_KEYS,
+    /// Join the current left row with the group rows starting at group_pos_.
+    JOIN_LEFT_ROW,
+    /// Output the unmatched (or, for right semi joins, matched) group rows starting at
+    /// group_pos_, then read the next group.
+    OUTPUT_GROUP,
+  };
+
+  const TJoinOp::type join_op_;
+
+  /// Exprs of the join keys, evaluated over left and right rows. Both inputs are sorted
+  /// on them.
+  std::vector<ExprContext*> left_key_ctxs_;
+  std::vector<ExprContext*> right_key_ctxs_;
+
+  /// Ordering of the inputs on each join key.
+  std::vector<bool> is_asc_order_;
+  std::vector<bool> nulls_first_;
+
+  /// Non-equi-join conjuncts, evaluated over rows assembled from the left and right
+  /// tuples.
+  std::vector<ExprContext*> other_join_conjunct_ctxs_;
+
+  /// Size of the tuple ptrs of left and right rows.
+  int left_tuple_row_size_;
+  int right_tuple_row_size_;
+
+  /// Row assembled from a left and a right row, used to evaluate the other join
+  /// conjuncts for semi and anti joins, which only return the tuples of one side.
+  TupleRow* staging_row_;
+
+  /// Current batch of each input and the position of its next row.
+  boost::scoped_ptr<RowBatch> left_batch_;
+  int left_batch_pos_;
+  bool left_eos_;
+  boost::scoped_ptr<RowBatch> right_batch_;
+  int right_batch_pos_;
+  bool right_eos_;
+
+  /// The left row to join next. NULL once the left input is exhausted.
+  TupleRow* left_row_;
+
+  /// True if 'left_row_' matched a group row.
+  bool left_row_matched_;
+
+  /// The group: consecutive right rows with the same join key. The rows and the key
+  /// values are deep-copied into 'group_pool_', whose memory is handed to the output
+  /// batch when the group is discarded. 'group_rows_' is empty once the right input is
+  /// exhausted.
+  boost::scoped_ptr<MemPool> group_pool_;
+  std::vector<TupleRow*> group_rows_;
+  std::vector<bool> group_matched_;
+  std::vector<void*> group_key_;
+
+  State state_;
+
+  /// Position in 'group_rows_' in the JOIN_LEFT_ROW and OUTPUT_GROUP states.
+  int group_pos_;
+
+  /// True if no more rows are returned.
+  bool eos_;
+
+  RuntimeProfile::Counter* left_row_counter_;
+  RuntimeProfile::Counter* right_row_counter_;
+
+  /// Largest number of rows in a group.
+  RuntimeProfile::Counter* max_group_rows_counter_;
+
+  /// Returns a negative value if the key of 'row', evaluated with 'key_ctxs', sorts
+  /// before the key of the group, a positive value if it sorts after it, and 0 if they
+  /// are equal. Sets 'has_null' if a key value of the group or the row is NULL.
+  int CompareToGroupKey(TupleRow* row, const std::vector<ExprContext*>& key_ctxs,
+      bool* has_null);
+
+  /// Advances 'left_row_' to the next left row, fetching the next left batch if needed.
+  /// The memory of the current batch is handed to 'out_batch'. 'out_batch' may only be
+  /// NULL if no row that references the current batch was returned.
+  Status NextLeftRow(RuntimeState* state, RowBatch* out_batch);
+
+  /// Discards the current group, handing its memory to 'out_batch', and reads the next
+  /// one from the right input. 'out_batch' is NULL as for NextLeftRow().
+  Status NextGroup(RuntimeState* state, RowBatch* out_batch);
+
+  /// Sets the key of the group to the key of its first row 'row'.
+  void InitGroupKey(TupleRow* row);
+
+  /// Joins 'left_row_' with the group rows from group_pos_ on, until the output batch
+  /// is full. Sets 'done' if all group rows were processed.
+  void JoinLeftRow(RowBatch* out_batch, bool* done);
+
+  /// Called once 'left_row_' was joined with the group or can't have a match. Outputs
+  /// it if it didn't match and the join returns unmatched left rows.
+  void ProcessUnmatchedLeftRow(RowBatch* out_batch);
+
+  /// Outputs the group rows from group_pos_ on that the join returns when the group is
+  /// discarded, until the output batch is full. Sets 'done' if all group rows were
+  /// processed.
+  void OutputGroupRows(RowBatch* out_batch, bool* done);
+
+  /// Adds the output row for 'left_row' and 'right_row', either of which may be NULL,
+  /// to 'out_batch' if it passes the conjuncts. Semi and anti joins only return the
+  /// tuples of one side.
+  void AddOutputRow(RowBatch* out_batch, TupleRow* left_row, TupleRow* right_row);
+
+  /// Writes the row assembled from 'left_row' and 'right_row' to 'out_row'.
+  void CreateOutputRow(TupleRow* out_row, TupleRow* left_row, TupleRow* right_row);
+
+  /// Returns true if the join returns left rows without a match.
+  bool ReturnsUnmatchedLeftRows() const {
+    return join_op_ == TJoinOp::LEFT_OUTER_JOIN || join_op_ == TJoinOp::FULL_OUTER_JOIN ||
+        join_op_ == TJoinOp::LEFT_ANTI_JOIN;
+  }
+
+  /// Returns true if the join returns group rows when the group is discarded.
+  bool ReturnsGroupRows() const {
+    return join_op_ == TJoinOp::RIGHT_OUTER_JOIN ||
+        join_op_ == TJoinOp::FULL_OUTER_JOIN || join_op_ == TJoinOp::RIGHT_ANTI_JOIN ||
+        join_op_ == TJoinOp::RIGHT_SEMI_JOIN;
+  }
+};
+
+}
+
+#endif
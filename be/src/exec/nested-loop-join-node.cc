@@ -14,11 +14,14 @@
 
 #include "exec/nested-loop-join-node.h"
 
+#include <algorithm>
 #include <sstream>
+#include <gflags/gflags.h>
 #include <gutil/strings/substitute.h>
 
 #include "exec/row-batch-cache.h"
 #include "exprs/expr.h"
+#include "exprs/slot-ref.h"
 #include "runtime/mem-pool.h"
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
@@ -31,13 +34,71 @@
 using namespace impala;
 using namespace strings;
 
+DEFINE_bool(enable_nlj_range_index, true, "Evaluate range join conjuncts of nested "
+    "loop joins with a sorted index of the build rows.");
+
+/// Minimum number of build rows for which the range index is built.
+static const int64_t MIN_RANGE_INDEX_BUILD_ROWS = 64;
+
+/// Number of candidate build rows for which the range conjuncts are evaluated at once.
+static const int RANGE_BLOCK_SIZE = 1024;
+
+namespace {
+
+/// Returns true if 'expr' is a slot of integer type.
+bool IsIntSlotRef(const Expr* expr) {
+  if (!expr->is_slotref()) return false;
+  switch (expr->type().type) {
+    case TYPE_TINYINT:
+    case TYPE_SMALLINT:
+    case TYPE_INT:
+    case TYPE_BIGINT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/// Reads the value of the integer-typed 'slot' of 'tuple' into 'value'. Returns false
+/// if the value is NULL.
+bool ReadIntSlot(const SlotRef* slot, Tuple* tuple, int64_t* value) {
+  if (tuple == NULL || tuple->IsNull(slot->null_indicator_offset())) return false;
+  const void* ptr = tuple->GetSlot(slot->slot_offset());
+  switch (slot->type().type) {
+    case TYPE_TINYINT:
+      *value = *reinterpret_cast<const int8_t*>(ptr);
+      break;
+    case TYPE_SMALLINT:
+      *value = *reinterpret_cast<const int16_t*>(ptr);
+      break;
+    case TYPE_INT:
+      *value = *reinterpret_cast<const int32_t*>(ptr);
+      break;
+    case TYPE_BIGINT:
+      *value = *reinterpret_cast<const int64_t*>(ptr);
+      break;
+    default:
+      DCHECK(false) << slot->type();
+      return false;
+  }
+  return true;
+}
+
+}
+
 NestedLoopJoinNode::NestedLoopJoinNode(ObjectPool* pool, const TPlanNode& tnode,
     const DescriptorTbl& descs)
   : BlockingJoinNode("NestedLoopJoinNode", tnode.nested_loop_join_node.join_op, pool,
         tnode, descs),
     build_batches_(NULL),
     current_build_row_idx_(0),
-    process_unmatched_build_rows_(false) {
+    process_unmatched_build_rows_(false),
+    use_range_index_(false),
+    range_index_mem_(0),
+    range_pos_(0),
+    range_end_(0),
+    range_selection_pos_(0),
+    range_candidates_counter_(NULL) {
 }
 
 NestedLoopJoinNode::~NestedLoopJoinNode() {
@@ -71,6 +132,11 @@ Status NestedLoopJoinNode::Prepare(RuntimeState* state) {
   RowDescriptor full_row_desc(child(0)->row_desc(), child(1)->row_desc());
   RETURN_IF_ERROR(Expr::Prepare(
       join_conjunct_ctxs_, state, full_row_desc, expr_mem_tracker()));
+  InitRangeConjuncts();
+  if (!range_conjuncts_.empty()) {
+    range_candidates_counter_ =
+        ADD_COUNTER(runtime_profile(), "RangeIndexCandidateRows", TUnit::UNIT);
+  }
   build_batch_cache_.reset(new RowBatchCache(
       child(1)->row_desc(), state->batch_size(), mem_tracker()));
 
@@ -100,6 +166,7 @@ Status NestedLoopJoinNode::Reset(RuntimeState* state) {
   current_probe_row_ = NULL;
   probe_batch_pos_ = 0;
   process_unmatched_build_rows_ = false;
+  ResetRangeIndex();
   build_batch_cache_->Reset();
   return BlockingJoinNode::Reset(state);
 }
@@ -109,6 +176,7 @@ void NestedLoopJoinNode::Close(RuntimeState* state) {
   raw_build_batches_.Reset();
   copied_build_batches_.Reset();
   build_batches_ = NULL;
+  ResetRangeIndex();
   Expr::Close(join_conjunct_ctxs_, state);
   if (matching_build_rows_ != NULL) {
     mem_tracker()->Release(matching_build_rows_->MemUsage());
@@ -192,6 +260,7 @@ Status NestedLoopJoinNode::ConstructBuildSide(RuntimeState* state) {
       matching_build_rows_->Reset(num_bits);
     }
   }
+  if (!range_conjuncts_.empty()) BuildRangeIndex();
   return Status::OK();
 }
 
@@ -219,6 +288,7 @@ Status NestedLoopJoinNode::InitGetNext(TupleRow* first_left_row) {
   build_row_iterator_ = build_batches_->Iterator();
   current_build_row_idx_ = 0;
   matched_probe_ = false;
+  if (use_range_index_ && first_left_row != NULL) InitRangeProbe();
   return Status::OK();
 }
 
@@ -226,6 +296,7 @@ Status NestedLoopJoinNode::GetNext(RuntimeState* state, RowBatch* output_batch,
     bool* eos) {
   DCHECK(!output_batch->AtCapacity());
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
@@ -606,6 +677,9 @@ Status NestedLoopJoinNode::ProcessUnmatchedBuildRows(
 
 Status NestedLoopJoinNode::FindBuildMatches(
     RuntimeState* state, RowBatch* output_batch, bool* return_output_batch) {
+  if (use_range_index_) {
+    return FindRangeMatches(state, output_batch, return_output_batch);
+  }
   *return_output_batch = false;
   ExprContext* const* join_conjunct_ctxs = &join_conjunct_ctxs_[0];
   size_t num_join_ctxs = join_conjunct_ctxs_.size();
@@ -673,6 +747,281 @@ Status NestedLoopJoinNode::NextProbeRow(RuntimeState* state, RowBatch* output_ba
   // We have a valid probe row; reset the build row iterator.
   build_row_iterator_ = build_batches_->Iterator();
   current_build_row_idx_ = 0;
+  if (use_range_index_) InitRangeProbe();
   VLOG_ROW << "left row: " << GetLeftChildRowString(current_probe_row_);
   return Status::OK();
 }
+
+Status NestedLoopJoinNode::FindRangeMatches(
+    RuntimeState* state, RowBatch* output_batch, bool* return_output_batch) {
+  *return_output_batch = false;
+  ExprContext* const* join_conjunct_ctxs = &residual_join_conjunct_ctxs_[0];
+  size_t num_join_ctxs = residual_join_conjunct_ctxs_.size();
+  ExprContext* const* conjunct_ctxs = &conjunct_ctxs_[0];
+  size_t num_ctxs = conjunct_ctxs_.size();
+
+  while (true) {
+    DCHECK(current_probe_row_ != NULL);
+    if (range_selection_pos_ == range_selection_.size()) {
+      if (range_pos_ == range_end_) break;
+      if (ReachedLimit()) {
+        eos_ = true;
+        *return_output_batch = true;
+        COUNTER_ADD(rows_returned_counter_, output_batch->num_rows());
+        return Status::OK();
+      }
+      RETURN_IF_CANCELLED(state);
+      RETURN_IF_ERROR(QueryMaintenance(state));
+      SelectRangeCandidates(std::min<int64_t>(range_pos_ + RANGE_BLOCK_SIZE, range_end_));
+      continue;
+    }
+    int64_t pos = range_selection_[range_selection_pos_++];
+    TupleRow* output_row = output_batch->GetRow(output_batch->AddRow());
+    CreateOutputRow(output_row, current_probe_row_, range_build_rows_[pos]);
+    if (!EvalConjuncts(join_conjunct_ctxs, num_join_ctxs, output_row)) continue;
+    matched_probe_ = true;
+    if (matching_build_rows_ != NULL) {
+      matching_build_rows_->Set<false>(range_build_row_idxs_[pos], true);
+    }
+    if (!EvalConjuncts(conjunct_ctxs, num_ctxs, output_row)) continue;
+    VLOG_ROW << "match row: " << PrintRow(output_row, row_desc());
+    output_batch->CommitLastRow();
+    ++num_rows_returned_;
+    if (output_batch->AtCapacity()) {
+      *return_output_batch = true;
+      COUNTER_ADD(rows_returned_counter_, output_batch->num_rows());
+      return Status::OK();
+    }
+  }
+  COUNTER_ADD(rows_returned_counter_, output_batch->num_rows());
+  return Status::OK();
+}
+
+void NestedLoopJoinNode::InitRangeConjuncts() {
+  DCHECK(range_conjuncts_.empty());
+  residual_join_conjunct_ctxs_ = join_conjunct_ctxs_;
+  if (!FLAGS_enable_nlj_range_index) return;
+  // Only the join modes that use FindBuildMatches() support the range index.
+  if (join_op_ != TJoinOp::INNER_JOIN && join_op_ != TJoinOp::LEFT_OUTER_JOIN &&
+      join_op_ != TJoinOp::RIGHT_OUTER_JOIN && join_op_ != TJoinOp::FULL_OUTER_JOIN) {
+    return;
+  }
+  if (child(1)->type() == TPlanNodeType::type::SINGULAR_ROW_SRC_NODE) return;
+
+  int num_probe_tuples = child(0)->row_desc().tuple_descriptors().size();
+  vector<ExprContext*> residual_ctxs;
+  for (int i = 0; i < join_conjunct_ctxs_.size(); ++i) {
+    Expr* root = join_conjunct_ctxs_[i]->root();
+    RangeConjunct conjunct;
+    bool is_range_conjunct = root->GetNumChildren() == 2 &&
+        root->fn().binary_type == TFunctionBinaryType::BUILTIN;
+    if (is_range_conjunct) {
+      const string& fn_name = root->fn().name.function_name;
+      if (fn_name == "lt") {
+        conjunct.op = RangeConjunct::LT;
+      } else if (fn_name == "le") {
+        conjunct.op = RangeConjunct::LE;
+      } else if (fn_name == "gt") {
+        conjunct.op = RangeConjunct::GT;
+      } else if (fn_name == "ge") {
+        conjunct.op = RangeConjunct::GE;
+      } else {
+        is_range_conjunct = false;
+      }
+    }
+    if (is_range_conjunct) {
+      // Normalize to '<build slot> <op> <probe slot>'.
+      Expr* build_expr = root->GetChild(0);
+      Expr* probe_expr = root->GetChild(1);
+      if (IsIntSlotRef(build_expr) &&
+          static_cast<SlotRef*>(build_expr)->tuple_idx() < num_probe_tuples) {
+        swap(build_expr, probe_expr);
+        if (conjunct.op == RangeConjunct::LT) {
+          conjunct.op = RangeConjunct::GT;
+        } else if (conjunct.op == RangeConjunct::LE) {
+          conjunct.op = RangeConjunct::GE;
+        } else if (conjunct.op == RangeConjunct::GT) {
+          conjunct.op = RangeConjunct::LT;
+        } else {
+          conjunct.op = RangeConjunct::LE;
+        }
+      }
+      is_range_conjunct = IsIntSlotRef(build_expr) && IsIntSlotRef(probe_expr) &&
+          build_expr->type() == probe_expr->type() &&
+          static_cast<SlotRef*>(build_expr)->tuple_idx() >= num_probe_tuples &&
+          static_cast<SlotRef*>(probe_expr)->tuple_idx() < num_probe_tuples;
+      if (is_range_conjunct) {
+        conjunct.build_slot = static_cast<SlotRef*>(build_expr);
+        conjunct.probe_slot = static_cast<SlotRef*>(probe_expr);
+        conjunct.build_tuple_idx = conjunct.build_slot->tuple_idx() - num_probe_tuples;
+      }
+    }
+    if (!is_range_conjunct) {
+      residual_ctxs.push_back(join_conjunct_ctxs_[i]);
+      continue;
+    }
+    // The build rows are sorted on the slot of the first range conjunct.
+    conjunct.on_sort_slot = range_conjuncts_.empty() ||
+        conjunct.build_slot->slot_id() == range_conjuncts_[0].build_slot->slot_id();
+    conjunct.probe_value = 0;
+    range_conjuncts_.push_back(conjunct);
+  }
+  if (!range_conjuncts_.empty()) residual_join_conjunct_ctxs_.swap(residual_ctxs);
+}
+
+void NestedLoopJoinNode::BuildRangeIndex() {
+  ResetRangeIndex();
+  int64_t num_rows = build_batches_->total_num_rows();
+  if (num_rows < MIN_RANGE_INDEX_BUILD_ROWS) return;
+  int64_t mem = num_rows * (sizeof(TupleRow*) * 2 + sizeof(int64_t) * 4 +
+      range_conjuncts_.size() * (sizeof(int64_t) + sizeof(uint8_t)));
+  // Without the index, the join conjuncts are evaluated with exprs.
+  if (!mem_tracker()->TryConsume(mem)) return;
+  range_index_mem_ = mem;
+
+  const RangeConjunct& sort_conjunct = range_conjuncts_[0];
+  vector<TupleRow*> rows;
+  rows.reserve(num_rows);
+  // Values of the sort slot and positions of the build rows.
+  vector<pair<int64_t, int64_t> > sort_keys;
+  sort_keys.reserve(num_rows);
+  for (RowBatchList::TupleRowIterator it = build_batches_->Iterator(); !it.AtEnd();
+       it.Next()) {
+    TupleRow* row = it.GetRow();
+    int64_t value;
+    // Rows with a NULL sort slot never pass the conjuncts on it.
+    if (ReadIntSlot(sort_conjunct.build_slot,
+        row->GetTuple(sort_conjunct.build_tuple_idx), &value)) {
+      sort_keys.push_back(make_pair(value, static_cast<int64_t>(rows.size())));
+    }
+    rows.push_back(row);
+  }
+  std::sort(sort_keys.begin(), sort_keys.end());
+
+  int64_t num_index_rows = sort_keys.size();
+  range_sort_values_.resize(num_index_rows);
+  range_build_row_idxs_.resize(num_index_rows);
+  range_build_rows_.resize(num_index_rows);
+  for (int64_t i = 0; i < num_index_rows; ++i) {
+    range_sort_values_[i] = sort_keys[i].first;
+    range_build_row_idxs_[i] = sort_keys[i].second;
+    range_build_rows_[i] = rows[sort_keys[i].second];
+  }
+  for (int i = 0; i < range_conjuncts_.size(); ++i) {
+    RangeConjunct* conjunct = &range_conjuncts_[i];
+    if (conjunct->on_sort_slot) continue;
+    conjunct->build_values.resize(num_index_rows);
+    conjunct->build_not_null.resize(num_index_rows);
+    for (int64_t j = 0; j < num_index_rows; ++j) {
+      TupleRow* row = range_build_rows_[j];
+      bool not_null = ReadIntSlot(conjunct->build_slot,
+          row->GetTuple(conjunct->build_tuple_idx), &conjunct->build_values[j]);
+      if (!not_null) conjunct->build_values[j] = 0;
+      conjunct->build_not_null[j] = not_null;
+    }
+  }
+  use_range_index_ = true;
+}
+
+void NestedLoopJoinNode::ResetRangeIndex() {
+  use_range_index_ = false;
+  vector<TupleRow*>().swap(range_build_rows_);
+  vector<int64_t>().swap(range_build_row_idxs_);
+  vector<int64_t>().swap(range_sort_values_);
+  for (int i = 0; i < range_conjuncts_.size(); ++i) {
+    vector<int64_t>().swap(range_conjuncts_[i].build_values);
+    vector<uint8_t>().swap(range_conjuncts_[i].build_not_null);
+  }
+  range_selection_.clear();
+  range_selection_pos_ = 0;
+  range_pos_ = 0;
+  range_end_ = 0;
+  mem_tracker()->Release(range_index_mem_);
+  range_index_mem_ = 0;
+}
+
+void NestedLoopJoinNode::InitRangeProbe() {
+  DCHECK(current_probe_row_ != NULL);
+  range_selection_.clear();
+  range_selection_pos_ = 0;
+  range_pos_ = 0;
+  range_end_ = range_sort_values_.size();
+  vector<int64_t>::const_iterator first = range_sort_values_.begin();
+  vector<int64_t>::const_iterator last = range_sort_values_.end();
+  for (int i = 0; i < range_conjuncts_.size(); ++i) {
+    RangeConjunct* conjunct = &range_conjuncts_[i];
+    if (!ReadIntSlot(conjunct->probe_slot,
+        current_probe_row_->GetTuple(conjunct->probe_slot->tuple_idx()),
+        &conjunct->probe_value)) {
+      // Comparisons with NULL never pass.
+      range_end_ = 0;
+      return;
+    }
+    if (!conjunct->on_sort_slot) continue;
+    int64_t value = conjunct->probe_value;
+    switch (conjunct->op) {
+      case RangeConjunct::LT:
+        range_end_ = std::min(range_end_,
+            static_cast<int64_t>(lower_bound(first, last, value) - first));
+        break;
+      case RangeConjunct::LE:
+        range_end_ = std::min(range_end_,
+            static_cast<int64_t>(upper_bound(first, last, value) - first));
+        break;
+      case RangeConjunct::GT:
+        range_pos_ = std::max(range_pos_,
+            static_cast<int64_t>(upper_bound(first, last, value) - first));
+        break;
+      case RangeConjunct::GE:
+        range_pos_ = std::max(range_pos_,
+            static_cast<int64_t>(lower_bound(first, last, value) - first));
+        break;
+    }
+  }
+  if (range_end_ < range_pos_) range_end_ = range_pos_;
+  COUNTER_ADD(range_candidates_counter_, range_end_ - range_pos_);
+}
+
+void NestedLoopJoinNode::SelectRangeCandidates(int64_t end) {
+  int n = end - range_pos_;
+  DCHECK_GT(n, 0);
+  DCHECK_LE(n, RANGE_BLOCK_SIZE);
+  uint8_t selected[RANGE_BLOCK_SIZE];
+  memset(selected, 1, n);
+  for (int i = 0; i < range_conjuncts_.size(); ++i) {
+    const RangeConjunct& conjunct = range_conjuncts_[i];
+    if (conjunct.on_sort_slot) continue;
+    // Branch-free loops over the arrays of build values that the compiler vectorizes.
+    const int64_t* values = &conjunct.build_values[range_pos_];
+    const uint8_t* not_null = &conjunct.build_not_null[range_pos_];
+    int64_t probe_value = conjunct.probe_value;
+    switch (conjunct.op) {
+      case RangeConjunct::LT:
+        for (int j = 0; j < n; ++j) {
+          selected[j] &= not_null[j] & (values[j] < probe_value);
+        }
+        break;
+      case RangeConjunct::LE:
+        for (int j = 0; j < n; ++j) {
+          selected[j] &= not_null[j] & (values[j] <= probe_value);
+        }
+        break;
+      case RangeConjunct::GT:
+        for (int j = 0; j < n; ++j) {
+          selected[j] &= not_null[j] & (values[j] > probe_value);
+        }
+        break;
+      case RangeConjunct::GE:
+        for (int j = 0; j < n; ++j) {
+          selected[j] &= not_null[j] & (values[j] >= probe_value);
+        }
+        break;
+    }
+  }
+  range_selection_.clear();
+  range_selection_pos_ = 0;
+  for (int j = 0; j < n; ++j) {
+    if (selected[j]) range_selection_.push_back(range_pos_ + j);
+  }
+  range_pos_ = end;
+}
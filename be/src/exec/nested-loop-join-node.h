@@ -32,6 +32,7 @@ class Bitmap;
 class RowBatch;
 class TupleRow;
 class RowBatchCache;
+class SlotRef;
 
 /// Operator to perform nested-loop join.
 /// This operator does not support spill to disk. Supports all join modes except
@@ -42,6 +43,14 @@ class RowBatchCache;
 /// this node. If the batches reference tuple data they do not own, the copying mode is
 /// used and all data is deep copied into memory owned by this node.
 ///
+/// Inner and outer joins with range join conjuncts, i.e. comparisons '<build slot> <op>
+/// <probe slot>' of integer-typed slots such as the bounds of a BETWEEN, don't pair each
+/// probe row with all build rows. Instead the build rows are sorted on the build slot of
+/// the first range conjunct and the conjuncts on that slot narrow the build rows of each
+/// probe row down to a range found by binary search. The other range conjuncts are
+/// evaluated on arrays of build values, a block of candidate rows at a time, and only
+/// the remaining join conjuncts are evaluated with exprs.
+///
 /// TODO: Add support for null-aware left-anti join.
 class NestedLoopJoinNode : public BlockingJoinNode {
  public:
@@ -94,12 +103,65 @@ class NestedLoopJoinNode : public BlockingJoinNode {
   /// RIGHT OUTER JOIN, RIGHT ANTI JOIN and FULL OUTER JOIN modes.
   bool process_unmatched_build_rows_;
 
+  /// True if the build rows were indexed for range_conjuncts_. The remaining members of
+  /// this block are only used if it is true.
+  bool use_range_index_;
+
+  /// The build rows that aren't NULL in the slot of the first range conjunct, sorted on
+  /// its value, their positions in build_batches_ and their values.
+  std::vector<TupleRow*> range_build_rows_;
+  std::vector<int64_t> range_build_row_idxs_;
+  std::vector<int64_t> range_sort_values_;
+
+  /// Bytes of the range index counted against the mem tracker.
+  int64_t range_index_mem_;
+
+  /// The candidate rows for current_probe_row_ are range_build_rows_[range_pos_] to
+  /// range_build_rows_[range_end_ - 1]. The candidates before range_pos_ were
+  /// evaluated with the range conjuncts and those that passed were added to
+  /// range_selection_, of which the first range_selection_pos_ were processed.
+  int64_t range_pos_;
+  int64_t range_end_;
+  std::vector<int64_t> range_selection_;
+  int range_selection_pos_;
+
   /// END: Members that must be Reset()
   /////////////////////////////////////////
 
   /// Join conjuncts
   std::vector<ExprContext*> join_conjunct_ctxs_;
 
+  /// A join conjunct '<build slot> <op> <probe slot>' on integer-typed slots.
+  struct RangeConjunct {
+    enum Op { LT, LE, GT, GE };
+    Op op;
+    const SlotRef* build_slot;
+    const SlotRef* probe_slot;
+
+    /// Index of the tuple of 'build_slot' in build rows.
+    int build_tuple_idx;
+
+    /// True if 'build_slot' is the slot the build rows are sorted on. Such conjuncts
+    /// are evaluated by the binary search.
+    bool on_sort_slot;
+
+    /// Values of 'build_slot' for each of range_build_rows_ and whether they are
+    /// non-NULL. Only populated if 'on_sort_slot' is false.
+    std::vector<int64_t> build_values;
+    std::vector<uint8_t> build_not_null;
+
+    /// The value of 'probe_slot' for current_probe_row_.
+    int64_t probe_value;
+  };
+
+  /// Range join conjuncts, if the join mode supports the range index, and the other
+  /// join conjuncts, which are evaluated with exprs when the range index is used.
+  std::vector<RangeConjunct> range_conjuncts_;
+  std::vector<ExprContext*> residual_join_conjunct_ctxs_;
+
+  /// Number of candidate build rows found with the range index.
+  RuntimeProfile::Counter* range_candidates_counter_;
+
   Status GetNextInnerJoin(RuntimeState* state, RowBatch* output_batch);
   Status GetNextLeftOuterJoin(RuntimeState* state, RowBatch* output_batch);
   Status GetNextRightOuterJoin(RuntimeState* state, RowBatch* output_batch);
@@ -117,6 +179,29 @@ class NestedLoopJoinNode : public BlockingJoinNode {
   Status FindBuildMatches(RuntimeState* state, RowBatch* output_batch,
       bool* return_output_batch);
 
+  /// Same as FindBuildMatches() if the range index is used.
+  Status FindRangeMatches(RuntimeState* state, RowBatch* output_batch,
+      bool* return_output_batch);
+
+  /// Splits join_conjunct_ctxs_ into range_conjuncts_ and
+  /// residual_join_conjunct_ctxs_. Must be called after the conjuncts were prepared.
+  void InitRangeConjuncts();
+
+  /// Sorts the build rows for the range index, if there are enough of them and the
+  /// index fits into the memory limit. Otherwise all join conjuncts are evaluated with
+  /// exprs.
+  void BuildRangeIndex();
+
+  /// Releases the memory of the range index.
+  void ResetRangeIndex();
+
+  /// Looks up the candidate build rows for current_probe_row_ in the range index.
+  void InitRangeProbe();
+
+  /// Evaluates the range conjuncts that are not on the sort slot for candidates
+  /// range_pos_ up to 'end' and adds those that pass to range_selection_.
+  void SelectRangeCandidates(int64_t end);
+
   /// Retrieves the next probe row from the left child. This function does
   /// not guarantee that a valid probe row is produced as it may exit if
   /// the output_batch is at capacity. If a valid probe row is retrieved, the
@@ -29,6 +29,7 @@
 #include "util/debug-util.h"
 #include "util/error-util.h"
 #include "util/impalad-metrics.h"
+#include "util/min-max-filter.h"
 
 #include "common/names.h"
 
@@ -138,8 +139,12 @@ bool OldHashTable::EvalRow(
 void OldHashTable::AddBloomFilters() {
   vector<BloomFilter*> bloom_filters;
   bloom_filters.resize(filters_.size());
+  vector<MinMaxFilter*> min_max_filters(filters_.size(), NULL);
   for (int i = 0; i < filters_.size(); ++i) {
     bloom_filters[i] = state_->filter_bank()->AllocateScratchBloomFilter();
+    if (MinMaxFilter::SupportsType(filter_expr_ctxs_[i]->root()->type())) {
+      min_max_filters[i] = state_->filter_bank()->AllocateScratchMinMaxFilter();
+    }
   }
 
   OldHashTable::Iterator iter = Begin();
@@ -152,6 +157,9 @@ void OldHashTable::AddBloomFilters() {
           RawValue::GetHashValue(e, build_expr_ctxs_[i]->root()->type(),
               RuntimeFilterBank::DefaultHashSeed());
       bloom_filters[i]->Insert(h);
+      if (min_max_filters[i] != NULL) {
+        min_max_filters[i]->Insert(e, filter_expr_ctxs_[i]->root()->type());
+      }
     }
     iter.Next<false>();
   }
@@ -160,7 +168,7 @@ void OldHashTable::AddBloomFilters() {
   for (int i = 0; i < filters_.size(); ++i) {
     if (bloom_filters[i] == NULL) continue;
     state_->filter_bank()->UpdateFilterFromLocal(filters_[i]->filter_desc().filter_id,
-        bloom_filters[i]);
+        bloom_filters[i], min_max_filters[i]);
   }
 }
 
@@ -21,6 +21,7 @@
 #include "runtime/decimal-value.h"
 #include "runtime/string-value.h"
 #include "util/bit-util.h"
+#include "util/hash-util.h"
 
 /// This file contains common elements between the parquet Writer and Scanner.
 namespace impala {
@@ -52,25 +53,68 @@ const parquet::Type::type IMPALA_TO_PARQUET_TYPES[] = {
   parquet::Type::BYTE_ARRAY,  // CHAR(N)
 };
 
-/// Mapping of Parquet codec enums to Impala enums
+/// Mapping of Parquet codec enums to Impala enums. Columns with codecs that Impala
+/// can't read are rejected when the file metadata is validated.
 const THdfsCompression::type PARQUET_TO_IMPALA_CODEC[] = {
   THdfsCompression::NONE,
   THdfsCompression::SNAPPY,
   THdfsCompression::GZIP,
-  THdfsCompression::LZO
+  THdfsCompression::LZO,
+  THdfsCompression::NONE,  // BROTLI, not supported
+  THdfsCompression::LZ4,   // Uses Hadoop's framing, not supported
+  THdfsCompression::ZSTD
 };
 
 /// Mapping of Impala codec enums to Parquet enums
 const parquet::CompressionCodec::type IMPALA_TO_PARQUET_CODEC[] = {
-  parquet::CompressionCodec::UNCOMPRESSED,
-  parquet::CompressionCodec::SNAPPY,  // DEFAULT
-  parquet::CompressionCodec::GZIP,    // GZIP
-  parquet::CompressionCodec::GZIP,    // DEFLATE
-  parquet::CompressionCodec::SNAPPY,
-  parquet::CompressionCodec::SNAPPY,  // SNAPPY_BLOCKED
-  parquet::CompressionCodec::LZO,
+  parquet::CompressionCodec::UNCOMPRESSED,  // NONE
+  parquet::CompressionCodec::SNAPPY,        // DEFAULT
+  parquet::CompressionCodec::GZIP,          // GZIP
+  parquet::CompressionCodec::GZIP,          // DEFLATE
+  parquet::CompressionCodec::SNAPPY,        // BZIP2
+  parquet::CompressionCodec::SNAPPY,        // SNAPPY
+  parquet::CompressionCodec::SNAPPY,        // SNAPPY_BLOCKED
+  parquet::CompressionCodec::LZO,           // LZO
+  parquet::CompressionCodec::LZ4,           // LZ4
+  parquet::CompressionCodec::ZSTD,          // ZSTD
 };
 
+/// Keys of the ColumnMetaData key_value_metadata under which HdfsParquetTableWriter
+/// records the Bloom filter of a column chunk: the file offset of its directory, which
+/// is written right after the data pages of the column chunk, and the log2 of its size.
+/// The filters are not the ones of the Parquet format: they are BloomFilter directories
+/// of the values hashed with ParquetBloomFilterHash().
+const char* const PARQUET_BLOOM_FILTER_OFFSET_KEY = "impala.bloom_filter_offset";
+const char* const PARQUET_BLOOM_FILTER_LOG_SPACE_KEY = "impala.bloom_filter_log_space";
+
+/// Returns true if Bloom filters are written and probed for columns of 'type'.
+inline bool ParquetBloomFilterSupported(const ColumnType& type) {
+  switch (type.type) {
+    case TYPE_TINYINT:
+    case TYPE_SMALLINT:
+    case TYPE_INT:
+    case TYPE_BIGINT:
+    case TYPE_STRING:
+    case TYPE_VARCHAR:
+    case TYPE_CHAR:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/// Hashes of values in the Bloom filters of Parquet files. Integers of all widths hash
+/// as their 64-bit value and CHARs as their unpadded bytes, so that a file's filters do
+/// not depend on the column type the scanning table declares. The hash must be the same
+/// on all hosts, so the CPU dependent HashUtil::Hash() is not used.
+inline uint32_t ParquetBloomFilterHash(int64_t v) {
+  return HashUtil::MurmurHash2_64(&v, sizeof(v), 0);
+}
+
+inline uint32_t ParquetBloomFilterHash(const StringValue& v) {
+  return HashUtil::MurmurHash2_64(v.ptr, v.len, 0);
+}
+
 /// The plain encoding does not maintain any state so all these functions
 /// are static helpers.
 /// TODO: we are using templates to provide a generic interface (over the
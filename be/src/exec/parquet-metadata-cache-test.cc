@@ -0,0 +1,87 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include "exec/parquet-metadata-cache.h"
+
+#include "common/names.h"
+
+namespace impala {
+
+// Returns a footer with 'num_rows' rows.
+shared_ptr<const parquet::FileMetaData> MakeMetadata(int64_t num_rows) {
+  shared_ptr<parquet::FileMetaData> metadata(new parquet::FileMetaData());
+  metadata->num_rows = num_rows;
+  return metadata;
+}
+
+TEST(ParquetMetadataCacheTest, Basic) {
+  ParquetMetadataCache cache(100);
+  EXPECT_TRUE(cache.Lookup("file", 1).get() == NULL);
+  cache.Insert("file", 1, MakeMetadata(10), 10);
+  cache.Insert("other_file", 1, MakeMetadata(20), 20);
+  EXPECT_TRUE(cache.Contains("file", 1));
+  EXPECT_EQ(10, cache.Lookup("file", 1)->num_rows);
+  EXPECT_EQ(20, cache.Lookup("other_file", 1)->num_rows);
+  EXPECT_EQ(30, cache.size());
+
+  // A rewritten file has a new mtime and misses.
+  EXPECT_FALSE(cache.Contains("file", 2));
+  EXPECT_TRUE(cache.Lookup("file", 2).get() == NULL);
+
+  // Inserting an existing key replaces the entry.
+  cache.Insert("file", 1, MakeMetadata(30), 15);
+  EXPECT_EQ(30, cache.Lookup("file", 1)->num_rows);
+  EXPECT_EQ(35, cache.size());
+  EXPECT_EQ(2, cache.num_entries());
+
+  // Entries larger than the cache are not inserted.
+  cache.Insert("large_file", 1, MakeMetadata(40), 101);
+  EXPECT_FALSE(cache.Contains("large_file", 1));
+}
+
+TEST(ParquetMetadataCacheTest, Eviction) {
+  ParquetMetadataCache cache(30);
+  cache.Insert("a", 1, MakeMetadata(1), 10);
+  cache.Insert("b", 1, MakeMetadata(2), 10);
+  cache.Insert("c", 1, MakeMetadata(3), 10);
+
+  // Touch 'a' so that 'b' is the least recently used entry.
+  shared_ptr<const parquet::FileMetaData> a = cache.Lookup("a", 1);
+  cache.Insert("d", 1, MakeMetadata(4), 10);
+  EXPECT_FALSE(cache.Contains("b", 1));
+  EXPECT_TRUE(cache.Contains("a", 1));
+  EXPECT_TRUE(cache.Contains("c", 1));
+  EXPECT_TRUE(cache.Contains("d", 1));
+
+  // Evicted entries stay valid for their holders.
+  cache.Insert("e", 1, MakeMetadata(5), 30);
+  EXPECT_EQ(1, cache.num_entries());
+  EXPECT_EQ(1, a->num_rows);
+}
+
+TEST(ParquetMetadataCacheTest, Disabled) {
+  ParquetMetadataCache cache(0);
+  cache.Insert("file", 1, MakeMetadata(10), 0);
+  EXPECT_TRUE(cache.Lookup("file", 1).get() == NULL);
+  EXPECT_FALSE(cache.Contains("file", 1));
+}
+
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
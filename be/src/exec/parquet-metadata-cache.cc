@@ -0,0 +1,105 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "exec/parquet-metadata-cache.h"
+
+#include <boost/functional/hash.hpp>
+#include <gflags/gflags.h>
+
+#include "common/logging.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+DEFINE_int64(parquet_metadata_cache_capacity, 256L * 1024L * 1024L, "(Advanced) "
+    "Maximum number of bytes of serialized Parquet file footers that are kept in memory "
+    "across queries. Set to 0 to disable the cache.");
+
+namespace impala {
+
+size_t hash_value(const ParquetMetadataCache::CacheKey& key) {
+  size_t seed = 0;
+  boost::hash_combine(seed, key.filename);
+  boost::hash_combine(seed, key.mtime);
+  return seed;
+}
+
+}
+
+ParquetMetadataCache::ParquetMetadataCache(int64_t capacity)
+  : capacity_(capacity),
+    size_(0) {
+}
+
+ParquetMetadataCache* ParquetMetadataCache::instance() {
+  static ParquetMetadataCache cache(FLAGS_parquet_metadata_cache_capacity);
+  return &cache;
+}
+
+shared_ptr<const parquet::FileMetaData> ParquetMetadataCache::Lookup(
+    const string& filename, int64_t mtime) {
+  if (capacity_ == 0) return shared_ptr<const parquet::FileMetaData>();
+  CacheKey key = {filename, mtime};
+  lock_guard<mutex> l(lock_);
+  EntryMap::iterator it = entries_.find(key);
+  if (it == entries_.end()) return shared_ptr<const parquet::FileMetaData>();
+  // Move to the back, this is now the most recently used entry.
+  lru_list_.splice(lru_list_.end(), lru_list_, it->second);
+  return it->second->metadata;
+}
+
+bool ParquetMetadataCache::Contains(const string& filename, int64_t mtime) {
+  if (capacity_ == 0) return false;
+  CacheKey key = {filename, mtime};
+  lock_guard<mutex> l(lock_);
+  return entries_.find(key) != entries_.end();
+}
+
+void ParquetMetadataCache::Insert(const string& filename, int64_t mtime,
+    const shared_ptr<const parquet::FileMetaData>& metadata, int64_t charge) {
+  DCHECK(metadata.get() != NULL);
+  DCHECK_GE(charge, 0);
+  if (capacity_ == 0 || charge > capacity_) return;
+  CacheKey key = {filename, mtime};
+  lock_guard<mutex> l(lock_);
+  EntryMap::iterator existing = entries_.find(key);
+  if (existing != entries_.end()) RemoveEntry(existing->second);
+  while (size_ + charge > capacity_) {
+    DCHECK(!lru_list_.empty());
+    RemoveEntry(lru_list_.begin());
+  }
+  Entry entry;
+  entry.key = key;
+  entry.metadata = metadata;
+  entry.charge = charge;
+  entries_[key] = lru_list_.insert(lru_list_.end(), entry);
+  size_ += charge;
+}
+
+int64_t ParquetMetadataCache::size() {
+  lock_guard<mutex> l(lock_);
+  return size_;
+}
+
+int ParquetMetadataCache::num_entries() {
+  lock_guard<mutex> l(lock_);
+  return entries_.size();
+}
+
+void ParquetMetadataCache::RemoveEntry(EntryList::iterator it) {
+  size_ -= it->charge;
+  entries_.erase(it->key);
+  lru_list_.erase(it);
+}
@@ -0,0 +1,111 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_EXEC_PARQUET_METADATA_CACHE_H
+#define IMPALA_EXEC_PARQUET_METADATA_CACHE_H
+
+#include <list>
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "gen-cpp/parquet_types.h"
+
+namespace impala {
+
+/// Process-wide cache of deserialized Parquet file footers. Scanners of files that are
+/// read by many queries can skip both the footer reads and the (expensive for wide
+/// tables) Thrift deserialization.
+///
+/// Entries are keyed by (file name, mtime), so a rewritten file misses the cache. Each
+/// entry is charged its serialized metadata size, which is a proxy for its in-memory
+/// size. When the total charge exceeds the capacity, the least recently used entries
+/// are evicted. Entries are immutable and shared, an evicted entry stays valid for the
+/// callers that still hold it.
+///
+/// This class is thread-safe.
+class ParquetMetadataCache {
+ public:
+  /// A capacity of 0 disables the cache.
+  ParquetMetadataCache(int64_t capacity);
+
+  /// Returns the process-wide instance, which is sized by
+  /// --parquet_metadata_cache_capacity.
+  static ParquetMetadataCache* instance();
+
+  /// Returns the footer of 'filename' as of 'mtime', or NULL if it is not cached.
+  boost::shared_ptr<const parquet::FileMetaData> Lookup(const std::string& filename,
+      int64_t mtime);
+
+  /// Returns true if the footer of 'filename' as of 'mtime' is cached. Unlike Lookup(),
+  /// does not count as a use of the entry.
+  bool Contains(const std::string& filename, int64_t mtime);
+
+  /// Inserts the footer of 'filename' as of 'mtime', charging 'charge' bytes against the
+  /// capacity. Replaces an existing entry for the same key.
+  void Insert(const std::string& filename, int64_t mtime,
+      const boost::shared_ptr<const parquet::FileMetaData>& metadata, int64_t charge);
+
+  int64_t capacity() const { return capacity_; }
+
+  /// Sum of the charges of the cached entries.
+  int64_t size();
+
+  /// Number of entries in the cache.
+  int num_entries();
+
+ private:
+  struct CacheKey {
+    std::string filename;
+    int64_t mtime;
+
+    bool operator==(const CacheKey& other) const {
+      return mtime == other.mtime && filename == other.filename;
+    }
+  };
+  friend std::size_t hash_value(const CacheKey& key);
+
+  struct Entry {
+    CacheKey key;
+    boost::shared_ptr<const parquet::FileMetaData> metadata;
+    int64_t charge;
+  };
+
+  typedef std::list<Entry> EntryList;
+  typedef boost::unordered_map<CacheKey, EntryList::iterator> EntryMap;
+
+  /// Removes the entry at 'it'. 'lock_' must be taken.
+  void RemoveEntry(EntryList::iterator it);
+
+  const int64_t capacity_;
+
+  /// Protects all members below.
+  boost::mutex lock_;
+
+  /// All entries, in least recently used order: new and accessed entries go to the
+  /// back, evictions take from the front.
+  EntryList lru_list_;
+
+  /// Maps each key to its entry in 'lru_list_'.
+  EntryMap entries_;
+
+  /// Sum of the charges of the entries in 'entries_'.
+  int64_t size_;
+};
+
+}
+
+#endif
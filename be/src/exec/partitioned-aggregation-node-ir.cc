@@ -45,22 +45,52 @@ Status PartitionedAggregationNode::ProcessBatch(RowBatch* batch, HashTableCtx* h
   int num_rows = batch->num_rows();
   RETURN_IF_ERROR(CheckAndResizeHashPartitions(num_rows, ht_ctx));
 
+  int64_t hash_tbls_bytes = 0;
+  for (int i = 0; i < hash_partitions_.size(); ++i) {
+    HashTable* ht = hash_partitions_[i]->hash_tbl.get();
+    if (ht != NULL) hash_tbls_bytes += ht->ByteSize();
+  }
+  if (HashTable::UseBatchPrefetch(hash_tbls_bytes)) {
+    // Hash all rows and prefetch their buckets before aggregating any of them, so that
+    // the cache misses on the buckets overlap.
+    ht_ctx->EvalAndHashBatch<AGGREGATED_ROWS>(batch);
+    for (int i = 0; i < num_rows; ++i) {
+      if (!ht_ctx->batch_row_valid(i)) continue;
+      const uint32_t hash = ht_ctx->batch_hash(i);
+      Partition* partition = hash_partitions_[hash >> (32 - NUM_PARTITIONING_BITS)];
+      HashTable* ht = partition->hash_tbl.get();
+      if (ht != NULL) ht->PrefetchBucket<true>(hash);
+    }
+    for (int i = 0; i < num_rows; ++i) {
+      if (!ht_ctx->batch_row_valid(i)) continue;
+      TupleRow* row = batch->GetRow(i);
+      if (AGGREGATED_ROWS) {
+        ht_ctx->EvalBuild(row);
+      } else {
+        ht_ctx->EvalProbe(row);
+      }
+      RETURN_IF_ERROR(ProcessRow<AGGREGATED_ROWS>(row, ht_ctx, ht_ctx->batch_hash(i)));
+    }
+    return Status::OK();
+  }
+
   for (int i = 0; i < num_rows; ++i) {
-    RETURN_IF_ERROR(ProcessRow<AGGREGATED_ROWS>(batch->GetRow(i), ht_ctx));
+    TupleRow* row = batch->GetRow(i);
+    uint32_t hash = 0;
+    if (AGGREGATED_ROWS) {
+      if (!ht_ctx->EvalAndHashBuild(row, &hash)) continue;
+    } else {
+      if (!ht_ctx->EvalAndHashProbe(row, &hash)) continue;
+    }
+    RETURN_IF_ERROR(ProcessRow<AGGREGATED_ROWS>(row, ht_ctx, hash));
   }
 
   return Status::OK();
 }
 
 template<bool AGGREGATED_ROWS>
-Status PartitionedAggregationNode::ProcessRow(TupleRow* row, HashTableCtx* ht_ctx) {
-  uint32_t hash = 0;
-  if (AGGREGATED_ROWS) {
-    if (!ht_ctx->EvalAndHashBuild(row, &hash)) return Status::OK();
-  } else {
-    if (!ht_ctx->EvalAndHashProbe(row, &hash)) return Status::OK();
-  }
-
+Status PartitionedAggregationNode::ProcessRow(TupleRow* row, HashTableCtx* ht_ctx,
+    uint32_t hash) {
   // To process this row, we first see if it can be aggregated or inserted into this
   // partition's hash table. If we need to insert it and that fails, due to OOM, we
   // spill the partition. The partition to spill is not necessarily dst_partition,
@@ -87,6 +117,7 @@ Status PartitionedAggregationNode::ProcessRow(TupleRow* row, HashTableCtx* ht_ct
   } else if (found) {
     // Row is already in hash table. Do the aggregation and we're done.
     UpdateTuple(&dst_partition->agg_fn_ctxs[0], it.GetTuple(), row);
+    ++dst_partition->recent_group_hits;
     return Status::OK();
   }
 
@@ -152,12 +183,22 @@ Status PartitionedAggregationNode::ProcessBatchStreaming(bool needs_serialize,
     uint32_t hash;
     if (!ht_ctx_->EvalAndHashProbe(in_row, &hash)) continue;
     const uint32_t partition_idx = hash >> (32 - NUM_PARTITIONING_BITS);
+    Partition* partition = hash_partitions_[partition_idx];
 
-    if (TryAddToHashTable(ht_ctx, hash_partitions_[partition_idx], in_row, hash,
-          &remaining_capacity[partition_idx], &process_batch_status_)) {
-      continue;
+    // Rows of partitions that are passing through are not probed, but they still need
+    // to be evaluated above to construct their intermediate tuples.
+    if (LIKELY(partition->streaming_passthrough_rows_left == 0)) {
+      if (UNLIKELY(partition->streaming_probe_rows == STREAMING_REDUCTION_SAMPLE_ROWS)) {
+        CheckStreamingReduction(partition);
+      }
+      if (TryAddToHashTable(ht_ctx, partition, in_row, hash,
+            &remaining_capacity[partition_idx], &process_batch_status_)) {
+        continue;
+      }
+      RETURN_IF_ERROR(process_batch_status_);
+    } else {
+      --partition->streaming_passthrough_rows_left;
     }
-    RETURN_IF_ERROR(process_batch_status_);
 
     // Tuple is not going into hash table, add it to the output batch.
     Tuple* intermediate_tuple = ConstructIntermediateTuple(agg_fn_ctxs_,
@@ -190,6 +231,8 @@ bool PartitionedAggregationNode::TryAddToHashTable(HashTableCtx* ht_ctx,
   DCHECK_GE(*remaining_capacity, 0);
   bool found;
   HashTable::Iterator it = partition->hash_tbl->FindBuildRowBucket(ht_ctx, hash, &found);
+  ++partition->streaming_probe_rows;
+  if (!found) ++partition->streaming_probe_misses;
   Tuple* intermediate_tuple;
   if (found) {
     intermediate_tuple = it.GetTuple();
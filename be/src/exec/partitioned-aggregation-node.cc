@@ -24,12 +24,15 @@
 #include "codegen/codegen-anyval.h"
 #include "codegen/llvm-codegen.h"
 #include "exec/hash-table.inline.h"
+#include "exec/unnest-node.h"
 #include "exprs/agg-fn-evaluator.h"
+#include "exprs/cached-expr.h"
 #include "exprs/expr.h"
 #include "exprs/expr-context.h"
 #include "exprs/slot-ref.h"
 #include "runtime/buffered-tuple-stream.inline.h"
 #include "runtime/descriptors.h"
+#include "runtime/exec-env.h"
 #include "runtime/mem-pool.h"
 #include "runtime/raw-value.h"
 #include "runtime/row-batch.h"
@@ -40,12 +43,30 @@
 #include "udf/udf-internal.h"
 #include "util/debug-util.h"
 #include "util/runtime-profile.h"
+#include "util/thread.h"
 
 #include "gen-cpp/Exprs_types.h"
 #include "gen-cpp/PlanNodes_types.h"
 
 #include "common/names.h"
 
+DECLARE_bool(enable_hash_table_tags);
+DECLARE_bool(enable_stream_string_interning);
+
+DEFINE_bool(enable_batch_agg_fns, true, "(Advanced) If true, aggregations without "
+    "grouping update COUNT, SUM, MIN and MAX over numeric types a row batch at a time.");
+DEFINE_int32(agg_threads, 4, "(Advanced) Maximum number of threads that an "
+    "aggregation which is not a streaming pre-aggregation uses to aggregate its input. "
+    "Set to 1 to disable parallel aggregation.");
+DEFINE_double(streaming_preagg_min_observed_reduction, 1.05, "(Advanced) A streaming "
+    "pre-aggregation stops probing the hash table of a partition and passes its rows "
+    "through if the observed reduction factor, i.e. the number of probed rows divided by "
+    "the number of them that did not match an existing group, is below this value. Set "
+    "to 0 to disable.");
+DEFINE_int64(streaming_preagg_passthrough_rows, 256 * 1024, "(Advanced) The number of "
+    "rows of a partition that a streaming pre-aggregation passes through without probing "
+    "before it samples the reduction factor of the partition again.");
+
 using namespace impala;
 using namespace llvm;
 using namespace strings;
@@ -106,6 +127,9 @@ PartitionedAggregationNode::PartitionedAggregationNode(
     needs_finalize_(tnode.agg_node.need_finalize),
     is_streaming_preagg_(tnode.agg_node.use_streaming_preaggregation),
     needs_serialize_(false),
+    use_batch_agg_fns_(false),
+    count_unnested_rows_(false),
+    subexpr_cache_(NULL),
     block_mgr_client_(NULL),
     output_partition_(NULL),
     process_row_batch_fn_(NULL),
@@ -124,6 +148,8 @@ PartitionedAggregationNode::PartitionedAggregationNode(
     num_passthrough_rows_(NULL),
     preagg_estimated_reduction_(NULL),
     preagg_streaming_ht_min_reduction_(NULL),
+    num_preagg_passthrough_switches_(NULL),
+    subexpr_cache_hits_(NULL),
     estimated_input_cardinality_(tnode.agg_node.estimated_input_cardinality),
     singleton_output_tuple_(NULL),
     singleton_output_tuple_returned_(true),
@@ -148,6 +174,7 @@ Status PartitionedAggregationNode::Init(const TPlanNode& tnode, RuntimeState* st
         pool_, tnode.agg_node.aggregate_functions[i], &evaluator));
     aggregate_evaluators_.push_back(evaluator);
   }
+  aggregate_fn_descs_ = tnode.agg_node.aggregate_functions;
   return Status::OK();
 }
 
@@ -185,6 +212,8 @@ Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
         runtime_profile(), "ReductionFactorEstimate", TUnit::DOUBLE_VALUE);
     preagg_streaming_ht_min_reduction_ = ADD_COUNTER(
         runtime_profile(), "ReductionFactorThresholdToExpand", TUnit::DOUBLE_VALUE);
+    num_preagg_passthrough_switches_ =
+        ADD_COUNTER(runtime_profile(), "PassThroughSwitches", TUnit::UNIT);
   } else {
     build_timer_ = ADD_TIMER(runtime_profile(), "BuildTime");
     num_row_repartitioned_ =
@@ -203,6 +232,18 @@ Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
   DCHECK_EQ(intermediate_tuple_desc_->slots().size(),
         output_tuple_desc_->slots().size());
 
+  // The grouping exprs and the aggregate function inputs are evaluated over the same
+  // input rows, so subexpressions that they share only need to be computed once.
+  vector<ExprContext*> input_ctxs = grouping_expr_ctxs_;
+  for (int i = 0; i < aggregate_evaluators_.size(); ++i) {
+    const vector<ExprContext*>& ctxs = aggregate_evaluators_[i]->input_expr_ctxs();
+    input_ctxs.insert(input_ctxs.end(), ctxs.begin(), ctxs.end());
+  }
+  subexpr_cache_ = CachedExpr::ShareSubexprs(pool_, input_ctxs);
+  if (subexpr_cache_ != NULL) {
+    subexpr_cache_hits_ = ADD_COUNTER(runtime_profile(), "SubexprCacheHits", TUnit::UNIT);
+  }
+
   RETURN_IF_ERROR(Expr::Prepare(grouping_expr_ctxs_, state, child(0)->row_desc(),
       expr_mem_tracker()));
   AddExprCtxsToFree(grouping_expr_ctxs_);
@@ -243,6 +284,18 @@ Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
     needs_serialize_ |= aggregate_evaluators_[i]->SupportsSerialize();
   }
 
+  use_batch_agg_fns_ = FLAGS_enable_batch_agg_fns && grouping_expr_ctxs_.empty();
+  for (int i = 0; i < aggregate_evaluators_.size(); ++i) {
+    use_batch_agg_fns_ &= aggregate_evaluators_[i]->SupportsAddBatch();
+  }
+  count_unnested_rows_ = use_batch_agg_fns_ && !is_streaming_preagg_ &&
+      child(0)->type() == TPlanNodeType::UNNEST_NODE &&
+      static_cast<UnnestNode*>(child(0))->CanCountRows();
+  for (int i = 0; i < aggregate_evaluators_.size(); ++i) {
+    count_unnested_rows_ &= aggregate_evaluators_[i]->is_count_star() &&
+        !aggregate_evaluators_[i]->is_merge();
+  }
+
   if (grouping_expr_ctxs_.empty()) {
     // Create single output tuple; we need to output something even if our input is empty.
     singleton_output_tuple_ =
@@ -257,6 +310,8 @@ Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
     RETURN_IF_ERROR(state_->block_mgr()->RegisterClient(
         Substitute("PartitionedAggregationNode id=$0 ptr=$1", id_, this),
         MinRequiredBuffers(), true, mem_tracker(), state, &block_mgr_client_));
+    state_->block_mgr()->SetClientWaitTimer(block_mgr_client_,
+        ADD_TIMER(runtime_profile(), SPILL_WAIT_TIMER));
     RETURN_IF_ERROR(CreateHashPartitions(0));
   }
 
@@ -270,6 +325,12 @@ Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
     DCHECK(serialize_stream_->has_write_block());
   }
 
+  if (use_batch_agg_fns_) {
+    // The batched aggregate functions don't benefit from codegen.
+    AddRuntimeExecOption("Batched Aggregate Functions");
+    return Status::OK();
+  }
+
   bool codegen_enabled = false;
   Status codegen_status;
   if (state->codegen_enabled()) {
@@ -280,7 +341,8 @@ Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
       codegen_status = CodegenProcessBatchStreaming(&codegen_process_batch_streaming_fn);
       if (codegen_status.ok()) {
         codegen->AddFunctionToJit(codegen_process_batch_streaming_fn,
-            reinterpret_cast<void**>(&process_batch_streaming_fn_));
+            reinterpret_cast<void**>(&process_batch_streaming_fn_),
+            /* has_interpreted_fallback */ true);
         codegen_enabled = true;
       }
     } else {
@@ -288,7 +350,8 @@ Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
       codegen_status = CodegenProcessBatch(&codegen_process_row_batch_fn);
       if (codegen_status.ok()) {
         codegen->AddFunctionToJit(codegen_process_row_batch_fn,
-            reinterpret_cast<void**>(&process_row_batch_fn_));
+            reinterpret_cast<void**>(&process_row_batch_fn_),
+            /* has_interpreted_fallback */ true);
         codegen_enabled = true;
       }
     }
@@ -299,6 +362,7 @@ Status PartitionedAggregationNode::Prepare(RuntimeState* state) {
 
 Status PartitionedAggregationNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   RETURN_IF_ERROR(ExecNode::Open(state));
 
   RETURN_IF_ERROR(Expr::Open(grouping_expr_ctxs_, state));
@@ -314,32 +378,35 @@ Status PartitionedAggregationNode::Open(RuntimeState* state) {
   // Streaming preaggregations do all processing in GetNext().
   if (is_streaming_preagg_) return Status::OK();
 
-  RowBatch batch(child(0)->row_desc(), state->batch_size(), mem_tracker());
-  // Read all the rows from the child and process them.
-  bool eos = false;
-  do {
-    RETURN_IF_CANCELLED(state);
-    RETURN_IF_ERROR(QueryMaintenance(state));
-    RETURN_IF_ERROR(children_[0]->GetNext(state, &batch, &eos));
-
-    if (UNLIKELY(VLOG_ROW_IS_ON)) {
-      for (int i = 0; i < batch.num_rows(); ++i) {
-        TupleRow* row = batch.GetRow(i);
-        VLOG_ROW << "input row: " << PrintRow(row, children_[0]->row_desc());
-      }
-    }
-
+  bool parallel = FLAGS_agg_threads > 1 && !grouping_expr_ctxs_.empty() &&
+      !IsInSubplan();
+  // UDAs may not expect to be called concurrently.
+  for (int i = 0; i < aggregate_evaluators_.size(); ++i) {
+    parallel &= aggregate_evaluators_[i]->is_builtin();
+  }
+  if (parallel) {
+    RETURN_IF_ERROR(ConsumeInputParallel(state));
+  } else if (count_unnested_rows_) {
+    // Only the number of items of the collection matters, so no rows are materialized.
     SCOPED_TIMER(build_timer_);
-    if (process_row_batch_fn_ != NULL) {
-      RETURN_IF_ERROR(process_row_batch_fn_(this, &batch, ht_ctx_.get()));
-    } else if (grouping_expr_ctxs_.empty()) {
-      RETURN_IF_ERROR(ProcessBatchNoGrouping(&batch));
-    } else {
-      // There is grouping, so we will do partitioned aggregation.
-      RETURN_IF_ERROR(ProcessBatch<false>(&batch, ht_ctx_.get()));
+    int64_t num_rows = static_cast<UnnestNode*>(child(0))->CountRemainingRows();
+    for (int i = 0; i < aggregate_evaluators_.size(); ++i) {
+      aggregate_evaluators_[i]->AddCountStar(
+          agg_fn_ctxs_[i], num_rows, singleton_output_tuple_);
     }
-    batch.Reset();
-  } while (!eos);
+  } else {
+    RowBatch batch(child(0)->row_desc(), state->batch_size(), mem_tracker());
+    // Read all the rows from the child and process them.
+    bool eos = false;
+    do {
+      RETURN_IF_CANCELLED(state);
+      RETURN_IF_ERROR(QueryMaintenance(state));
+      RETURN_IF_ERROR(children_[0]->GetNext(state, &batch, &eos));
+      SCOPED_TIMER(build_timer_);
+      RETURN_IF_ERROR(ProcessInputBatch(&batch));
+      batch.Reset();
+    } while (!eos);
+  }
 
   // The child can be closed at this point in most cases because we have consumed all of
   // the input from the child and transfered ownership of the resources we need. The
@@ -357,9 +424,274 @@ Status PartitionedAggregationNode::Open(RuntimeState* state) {
   return Status::OK();
 }
 
+Status PartitionedAggregationNode::ProcessInputBatch(RowBatch* batch) {
+  if (UNLIKELY(VLOG_ROW_IS_ON)) {
+    for (int i = 0; i < batch->num_rows(); ++i) {
+      TupleRow* row = batch->GetRow(i);
+      VLOG_ROW << "input row: " << PrintRow(row, children_[0]->row_desc());
+    }
+  }
+
+  if (use_batch_agg_fns_) {
+    ProcessBatchNoGroupingBatched(batch);
+  } else if (process_row_batch_fn_ != NULL) {
+    RETURN_IF_ERROR(process_row_batch_fn_(this, batch, ht_ctx_.get()));
+  } else if (grouping_expr_ctxs_.empty()) {
+    RETURN_IF_ERROR(ProcessBatchNoGrouping(batch));
+  } else {
+    // There is grouping, so we will do partitioned aggregation.
+    RETURN_IF_ERROR(ProcessBatch<false>(batch, ht_ctx_.get()));
+  }
+  return Status::OK();
+}
+
+Status PartitionedAggregationNode::ConsumeInputParallel(RuntimeState* state) {
+  DCHECK(!is_streaming_preagg_);
+  DCHECK(!grouping_expr_ctxs_.empty());
+  boost::ptr_vector<AggThread> threads;
+  Status status;
+  for (int i = 1; i < FLAGS_agg_threads; ++i) {
+    if (!state->resource_pool()->TryAcquireThreadToken()) break;
+    AggThread* thread = new AggThread();
+    threads.push_back(thread);
+    status = PrepareAggThread(state, thread);
+    if (!status.ok()) break;
+  }
+  if (status.ok() && !threads.empty()) {
+    AddRuntimeExecOption(Substitute("Aggregated With $0 Threads", threads.size() + 1));
+  }
+
+  vector<vector<HashedRow> > rows_by_partition(PARTITION_FANOUT);
+  boost::ptr_vector<RowBatch> batches;
+  int64_t num_round_rows = 0;
+  bool eos = false;
+  while (status.ok() && !eos) {
+    // Don't return early, the thread tokens must be released below.
+    if (state->is_cancelled()) status = Status::CANCELLED;
+    if (status.ok()) status = QueryMaintenance(state);
+    if (!status.ok()) break;
+    RowBatch* batch =
+        new RowBatch(child(0)->row_desc(), state->batch_size(), mem_tracker());
+    batches.push_back(batch);
+    status = children_[0]->GetNext(state, batch, &eos);
+    if (!status.ok()) break;
+    num_round_rows += batch->num_rows();
+    if (!threads.empty() && num_round_rows < MIN_ROWS_PER_PARALLEL_ROUND && !eos) {
+      continue;
+    }
+
+    if (threads.empty() || num_round_rows < MIN_ROWS_PER_PARALLEL_ROUND) {
+      SCOPED_TIMER(build_timer_);
+      for (int i = 0; status.ok() && i < batches.size(); ++i) {
+        status = ProcessInputBatch(&batches[i]);
+      }
+    } else {
+      status = AggregateRoundParallel(state, &threads, &batches, &rows_by_partition);
+    }
+    batches.clear();
+    num_round_rows = 0;
+  }
+
+  for (int i = 0; i < threads.size(); ++i) {
+    CloseAggThread(state, &threads[i]);
+    state->resource_pool()->ReleaseThreadToken(false);
+  }
+  return status;
+}
+
+Status PartitionedAggregationNode::PrepareAggThread(RuntimeState* state,
+    AggThread* thread) {
+  RETURN_IF_ERROR(Expr::CloneIfNotExists(build_expr_ctxs_, state,
+      &thread->build_expr_ctxs));
+  RETURN_IF_ERROR(Expr::CloneIfNotExists(grouping_expr_ctxs_, state,
+      &thread->grouping_expr_ctxs));
+  thread->ht_ctx.reset(new HashTableCtx(thread->build_expr_ctxs,
+      thread->grouping_expr_ctxs, true,
+      std::vector<bool>(thread->build_expr_ctxs.size(), true),
+      state->fragment_hash_seed(), MAX_PARTITION_DEPTH, 1));
+  thread->ht_ctx->set_level(ht_ctx_->level());
+
+  int slot_idx = grouping_expr_ctxs_.size();
+  for (int i = 0; i < aggregate_fn_descs_.size(); ++i, ++slot_idx) {
+    AggFnEvaluator* evaluator;
+    RETURN_IF_ERROR(AggFnEvaluator::Create(pool_, aggregate_fn_descs_[i], &evaluator));
+    thread->evaluators.push_back(evaluator);
+    FunctionContext* evaluator_ctx = NULL;
+    RETURN_IF_ERROR(evaluator->Prepare(state, child(0)->row_desc(),
+        intermediate_tuple_desc_->slots()[slot_idx],
+        output_tuple_desc_->slots()[slot_idx], agg_fn_pool_.get(), &evaluator_ctx));
+    thread->evaluator_ctxs.push_back(evaluator_ctx);
+    state->obj_pool()->Add(evaluator_ctx);
+    RETURN_IF_ERROR(evaluator->Open(state, evaluator_ctx));
+  }
+  return Status::OK();
+}
+
+void PartitionedAggregationNode::CloseAggThread(RuntimeState* state,
+    AggThread* thread) {
+  for (int i = 0; i < thread->evaluators.size(); ++i) {
+    thread->evaluators[i]->Close(state);
+  }
+  for (int i = 0; i < thread->evaluator_ctxs.size(); ++i) {
+    thread->evaluator_ctxs[i]->impl()->Close();
+  }
+  if (thread->ht_ctx.get() != NULL) thread->ht_ctx->Close();
+  Expr::Close(thread->build_expr_ctxs, state);
+  Expr::Close(thread->grouping_expr_ctxs, state);
+}
+
+Status PartitionedAggregationNode::AggregateRoundParallel(RuntimeState* state,
+    boost::ptr_vector<AggThread>* threads, boost::ptr_vector<RowBatch>* batches,
+    vector<vector<HashedRow> >* rows_by_partition) {
+  SCOPED_TIMER(build_timer_);
+  for (int i = 0; i < PARTITION_FANOUT; ++i) (*rows_by_partition)[i].clear();
+  for (int i = 0; i < batches->size(); ++i) {
+    RowBatch* batch = &(*batches)[i];
+    for (int j = 0; j < batch->num_rows(); ++j) {
+      HashedRow hashed_row;
+      hashed_row.row = batch->GetRow(j);
+      if (!ht_ctx_->EvalAndHashProbe(hashed_row.row, &hashed_row.hash)) continue;
+      (*rows_by_partition)[hashed_row.hash >> (32 - NUM_PARTITIONING_BITS)].push_back(
+          hashed_row);
+    }
+  }
+
+  // Make room in the hash tables for all rows of the round, as in
+  // CheckAndResizeHashPartitions(). Partitions that spill here are left to this thread.
+  for (int i = 0; i < PARTITION_FANOUT; ++i) {
+    Partition* partition = hash_partitions_[i];
+    while (!partition->is_spilled()) {
+      {
+        SCOPED_TIMER(ht_resize_timer_);
+        if (partition->hash_tbl->CheckAndResize((*rows_by_partition)[i].size(),
+            ht_ctx_.get())) {
+          break;
+        }
+      }
+      RETURN_IF_ERROR(SpillPartition());
+    }
+  }
+
+  // Start with the partitions with the most rows so that no thread is left with a large
+  // one at the end.
+  typedef std::pair<int, int> NumRowsAndPartition;
+  vector<NumRowsAndPartition> partitions_by_rows;
+  for (int i = 0; i < PARTITION_FANOUT; ++i) {
+    if (hash_partitions_[i]->is_spilled() || (*rows_by_partition)[i].empty()) continue;
+    partitions_by_rows.push_back(
+        NumRowsAndPartition((*rows_by_partition)[i].size(), i));
+  }
+  std::sort(partitions_by_rows.begin(), partitions_by_rows.end(),
+      std::greater<NumRowsAndPartition>());
+  vector<int> partition_idxs;
+  for (int i = 0; i < partitions_by_rows.size(); ++i) {
+    partition_idxs.push_back(partitions_by_rows[i].second);
+  }
+
+  vector<int> num_aggregated(PARTITION_FANOUT, 0);
+  AtomicInt<int> next_partition(0);
+  Status status;
+  {
+    ThreadGroup agg_threads;
+    if (!state->cgroup().empty()) {
+      agg_threads.SetCgroupsMgr(state->exec_env()->cgroups_mgr());
+      agg_threads.SetCgroup(state->cgroup());
+    }
+    for (int i = 0; i < threads->size(); ++i) {
+      AggThread* thread = &(*threads)[i];
+      agg_threads.AddThread(new Thread(node_name_, Substitute("agg thread $0", i),
+          bind(&PartitionedAggregationNode::AggregatePartitionsThread, this,
+              thread->ht_ctx.get(), &thread->evaluators, &partition_idxs,
+              rows_by_partition, &next_partition, &num_aggregated, &thread->status)));
+    }
+    AggregatePartitionsThread(ht_ctx_.get(), &aggregate_evaluators_, &partition_idxs,
+        rows_by_partition, &next_partition, &num_aggregated, &status);
+    agg_threads.JoinAll();
+  }
+  for (int i = 0; i < threads->size(); ++i) {
+    AggThread* thread = &(*threads)[i];
+    if (status.ok()) status = thread->status;
+    thread->status = Status::OK();
+    ExprContext::FreeLocalAllocations(thread->build_expr_ctxs);
+    ExprContext::FreeLocalAllocations(thread->grouping_expr_ctxs);
+    for (int j = 0; j < thread->evaluators.size(); ++j) {
+      ExprContext::FreeLocalAllocations(thread->evaluators[j]->input_expr_ctxs());
+    }
+  }
+  RETURN_IF_ERROR(status);
+
+  // Aggregate the remaining rows with the serial algorithm, which can spill. These are
+  // the rows of spilled partitions and the rows that the threads had no memory for.
+  scoped_ptr<RowBatch> remaining_rows(
+      new RowBatch(child(0)->row_desc(), state->batch_size(), mem_tracker()));
+  for (int i = 0; i < PARTITION_FANOUT; ++i) {
+    const vector<HashedRow>& rows = (*rows_by_partition)[i];
+    for (int j = num_aggregated[i]; j < rows.size(); ++j) {
+      if (remaining_rows->AtCapacity()) {
+        RETURN_IF_ERROR(ProcessInputBatch(remaining_rows.get()));
+        remaining_rows->Reset();
+      }
+      int row_idx = remaining_rows->AddRow();
+      remaining_rows->CopyRow(rows[j].row, remaining_rows->GetRow(row_idx));
+      remaining_rows->CommitLastRow();
+    }
+  }
+  return ProcessInputBatch(remaining_rows.get());
+}
+
+void PartitionedAggregationNode::AggregatePartitionsThread(HashTableCtx* ht_ctx,
+    const vector<AggFnEvaluator*>* evaluators, const vector<int>* partition_idxs,
+    const vector<vector<HashedRow> >* rows_by_partition, AtomicInt<int>* next_partition,
+    vector<int>* num_aggregated, Status* status) {
+  while (true) {
+    int idx = next_partition->FetchAndUpdate(1);
+    if (idx >= partition_idxs->size()) break;
+    int partition_idx = (*partition_idxs)[idx];
+    *status = AggregatePartitionRows(ht_ctx, *evaluators, hash_partitions_[partition_idx],
+        (*rows_by_partition)[partition_idx], &(*num_aggregated)[partition_idx]);
+    if (!status->ok()) break;
+  }
+}
+
+Status PartitionedAggregationNode::AggregatePartitionRows(HashTableCtx* ht_ctx,
+    const vector<AggFnEvaluator*>& evaluators, Partition* partition,
+    const vector<HashedRow>& rows, int* num_aggregated) {
+  DCHECK(!partition->is_spilled());
+  HashTable* ht = partition->hash_tbl.get();
+  BufferedTupleStream* stream = partition->aggregated_row_stream.get();
+  Status status;
+  for (int i = 0; i < rows.size(); ++i) {
+    TupleRow* row = rows[i].row;
+    ht_ctx->EvalProbe(row);
+    bool found;
+    HashTable::Iterator it = ht->FindBuildRowBucket(ht_ctx, rows[i].hash, &found);
+    DCHECK(!it.AtEnd()) << "Hash table had no free buckets";
+    Tuple* intermediate_tuple;
+    if (found) {
+      intermediate_tuple = it.GetTuple();
+      // Only this thread aggregates into 'partition'.
+      ++partition->recent_group_hits;
+    } else {
+      intermediate_tuple = ConstructIntermediateTuple(evaluators, ht_ctx,
+          partition->agg_fn_ctxs, stream, &status);
+      if (intermediate_tuple == NULL) {
+        *num_aggregated = i;
+        return status;
+      }
+      it.SetTuple(intermediate_tuple, rows[i].hash);
+    }
+    for (int j = 0; j < evaluators.size(); ++j) {
+      evaluators[j]->Add(partition->agg_fn_ctxs[j], row, intermediate_tuple);
+    }
+  }
+  *num_aggregated = rows.size();
+  return Status::OK();
+}
+
 Status PartitionedAggregationNode::GetNext(RuntimeState* state, RowBatch* row_batch,
     bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
@@ -578,6 +910,19 @@ bool PartitionedAggregationNode::ShouldExpandPreaggHashTables() const {
   return estimated_reduction > min_reduction;
 }
 
+void PartitionedAggregationNode::CheckStreamingReduction(Partition* partition) {
+  DCHECK_EQ(partition->streaming_probe_rows, STREAMING_REDUCTION_SAMPLE_ROWS);
+  // The observed reduction factor is streaming_probe_rows / streaming_probe_misses.
+  // Compare without dividing, a sample where every row matched a group has no misses.
+  if (partition->streaming_probe_rows < FLAGS_streaming_preagg_min_observed_reduction *
+      partition->streaming_probe_misses) {
+    partition->streaming_passthrough_rows_left = FLAGS_streaming_preagg_passthrough_rows;
+    COUNTER_ADD(num_preagg_passthrough_switches_, 1);
+  }
+  partition->streaming_probe_rows = 0;
+  partition->streaming_probe_misses = 0;
+}
+
 void PartitionedAggregationNode::CleanupHashTbl(
     const vector<FunctionContext*>& agg_fn_ctxs, HashTable::Iterator it) {
   if (!needs_finalize_ && !needs_serialize_) return;
@@ -623,6 +968,18 @@ Status PartitionedAggregationNode::Reset(RuntimeState* state) {
   return ExecNode::Reset(state);
 }
 
+void PartitionedAggregationNode::GetBufferRequirements(int64_t buffer_size,
+    int* min_buffers, int* desired_buffers) const {
+  // Aggregations without grouping and streaming preaggregations don't need buffers.
+  if (grouping_expr_ctxs_.empty() || is_streaming_preagg_) {
+    *min_buffers = 0;
+    *desired_buffers = 0;
+    return;
+  }
+  *min_buffers = MinRequiredBuffers();
+  *desired_buffers = EstimatedBuffers(buffer_size, *min_buffers);
+}
+
 void PartitionedAggregationNode::Close(RuntimeState* state) {
   if (is_closed()) return;
 
@@ -640,6 +997,9 @@ void PartitionedAggregationNode::Close(RuntimeState* state) {
 
   ClosePartitions();
 
+  if (subexpr_cache_ != NULL) {
+    COUNTER_SET(subexpr_cache_hits_, subexpr_cache_->num_hits());
+  }
   child_batch_.reset();
   for (int i = 0; i < aggregate_evaluators_.size(); ++i) {
     aggregate_evaluators_[i]->Close(state);
@@ -696,6 +1056,11 @@ Status PartitionedAggregationNode::Partition::InitStreams() {
         parent->child(0)->row_desc(), parent->state_->block_mgr(),
       parent->block_mgr_client_, true /* use_initial_small_buffers */,
         false /* read_write */));
+    // The aggregated rows are written with AllocateRow(), so only the spilled input rows
+    // can be interned.
+    if (FLAGS_enable_stream_string_interning) {
+      unaggregated_row_stream->EnableStringInterning();
+    }
     // This stream is only used to spill, no need to ever have this pinned.
     RETURN_IF_ERROR(unaggregated_row_stream->Init(parent->id(), parent->runtime_profile(),
         false));
@@ -715,7 +1080,8 @@ bool PartitionedAggregationNode::Partition::InitHashTable() {
   static const int64_t PAGG_DEFAULT_HASH_TABLE_SZ = 1024;
 
   hash_tbl.reset(HashTable::Create(parent->state_, parent->block_mgr_client_, 1,
-      NULL, 1L << (32 - NUM_PARTITIONING_BITS), PAGG_DEFAULT_HASH_TABLE_SZ));
+      NULL, 1L << (32 - NUM_PARTITIONING_BITS), PAGG_DEFAULT_HASH_TABLE_SZ,
+      FLAGS_enable_hash_table_tags, parent->ht_ctx_->inline_key_words()));
   return hash_tbl->Init();
 }
 
@@ -869,14 +1235,14 @@ Tuple* PartitionedAggregationNode::ConstructSingletonOutputTuple(
     const vector<FunctionContext*>& agg_fn_ctxs, MemPool* pool) {
   DCHECK(grouping_expr_ctxs_.empty());
   Tuple* output_tuple = Tuple::Create(intermediate_tuple_desc_->byte_size(), pool);
-  InitAggSlots(agg_fn_ctxs, output_tuple);
+  InitAggSlots(aggregate_evaluators_, agg_fn_ctxs, output_tuple);
   return output_tuple;
 }
 
 Tuple* PartitionedAggregationNode::ConstructIntermediateTuple(
     const vector<FunctionContext*>& agg_fn_ctxs, MemPool* pool, Status* status) {
   const int fixed_size = intermediate_tuple_desc_->byte_size();
-  const int varlen_size = GroupingExprsVarlenSize();
+  const int varlen_size = GroupingExprsVarlenSize(ht_ctx_.get());
   uint8_t* tuple_data = pool->TryAllocate(fixed_size + varlen_size);
   if (tuple_data == NULL) {
     *status = Status::MemLimitExceeded();
@@ -889,18 +1255,26 @@ Tuple* PartitionedAggregationNode::ConstructIntermediateTuple(
   memset(tuple_data, 0, fixed_size);
   Tuple* intermediate_tuple = reinterpret_cast<Tuple*>(tuple_data);
   uint8_t* varlen_data = tuple_data + fixed_size;
-  CopyGroupingValues(intermediate_tuple, varlen_data, varlen_size);
-  InitAggSlots(agg_fn_ctxs, intermediate_tuple);
+  CopyGroupingValues(ht_ctx_.get(), intermediate_tuple, varlen_data, varlen_size);
+  InitAggSlots(aggregate_evaluators_, agg_fn_ctxs, intermediate_tuple);
   return intermediate_tuple;
 }
 
 Tuple* PartitionedAggregationNode::ConstructIntermediateTuple(
     const vector<FunctionContext*>& agg_fn_ctxs,
     BufferedTupleStream* stream, Status* status) {
+  return ConstructIntermediateTuple(aggregate_evaluators_, ht_ctx_.get(), agg_fn_ctxs,
+      stream, status);
+}
+
+Tuple* PartitionedAggregationNode::ConstructIntermediateTuple(
+    const vector<AggFnEvaluator*>& evaluators, HashTableCtx* ht_ctx,
+    const vector<FunctionContext*>& agg_fn_ctxs, BufferedTupleStream* stream,
+    Status* status) {
   DCHECK(stream != NULL && status != NULL);
   // Allocate space for the entire tuple in the stream.
   const int fixed_size = intermediate_tuple_desc_->byte_size();
-  const int varlen_size = GroupingExprsVarlenSize();
+  const int varlen_size = GroupingExprsVarlenSize(ht_ctx);
   uint8_t* varlen_buffer;
   uint8_t* fixed_buffer = stream->AllocateRow(fixed_size, varlen_size, &varlen_buffer,
       status);
@@ -919,39 +1293,39 @@ Tuple* PartitionedAggregationNode::ConstructIntermediateTuple(
 
   Tuple* intermediate_tuple = reinterpret_cast<Tuple*>(fixed_buffer);
   intermediate_tuple->Init(fixed_size);
-  CopyGroupingValues(intermediate_tuple, varlen_buffer, varlen_size);
-  InitAggSlots(agg_fn_ctxs, intermediate_tuple);
+  CopyGroupingValues(ht_ctx, intermediate_tuple, varlen_buffer, varlen_size);
+  InitAggSlots(evaluators, agg_fn_ctxs, intermediate_tuple);
   return intermediate_tuple;
 }
 
-int PartitionedAggregationNode::GroupingExprsVarlenSize() {
+int PartitionedAggregationNode::GroupingExprsVarlenSize(HashTableCtx* ht_ctx) {
   int varlen_size = 0;
   // TODO: The hash table could compute this as it hashes.
   for (int expr_idx: string_grouping_exprs_) {
-    StringValue* sv = reinterpret_cast<StringValue*>(ht_ctx_->last_expr_value(expr_idx));
+    StringValue* sv = reinterpret_cast<StringValue*>(ht_ctx->last_expr_value(expr_idx));
     // Avoid branching by multiplying length by null bit.
-    varlen_size += sv->len * !ht_ctx_->last_expr_value_null(expr_idx);
+    varlen_size += sv->len * !ht_ctx->last_expr_value_null(expr_idx);
   }
   return varlen_size;
 }
 
 // TODO: codegen this function.
-void PartitionedAggregationNode::CopyGroupingValues(Tuple* intermediate_tuple,
-    uint8_t* buffer, int varlen_size) {
+void PartitionedAggregationNode::CopyGroupingValues(HashTableCtx* ht_ctx,
+    Tuple* intermediate_tuple, uint8_t* buffer, int varlen_size) {
   // Copy over all grouping slots (the variable length data is copied below).
   for (int i = 0; i < grouping_expr_ctxs_.size(); ++i) {
     SlotDescriptor* slot_desc = intermediate_tuple_desc_->slots()[i];
-    if (ht_ctx_->last_expr_value_null(i)) {
+    if (ht_ctx->last_expr_value_null(i)) {
       intermediate_tuple->SetNull(slot_desc->null_indicator_offset());
     } else {
-      void* src = ht_ctx_->last_expr_value(i);
+      void* src = ht_ctx->last_expr_value(i);
       void* dst = intermediate_tuple->GetSlot(slot_desc->tuple_offset());
       memcpy(dst, src, slot_desc->slot_size());
     }
   }
 
   for (int expr_idx: string_grouping_exprs_) {
-    if (ht_ctx_->last_expr_value_null(expr_idx)) continue;
+    if (ht_ctx->last_expr_value_null(expr_idx)) continue;
 
     SlotDescriptor* slot_desc = intermediate_tuple_desc_->slots()[expr_idx];
     // ptr and len were already copied to the fixed-len part of string value
@@ -964,12 +1338,12 @@ void PartitionedAggregationNode::CopyGroupingValues(Tuple* intermediate_tuple,
 }
 
 // TODO: codegen this function.
-void PartitionedAggregationNode::InitAggSlots(
+void PartitionedAggregationNode::InitAggSlots(const vector<AggFnEvaluator*>& evaluators,
     const vector<FunctionContext*>& agg_fn_ctxs, Tuple* intermediate_tuple) {
   vector<SlotDescriptor*>::const_iterator slot_desc =
       intermediate_tuple_desc_->slots().begin() + grouping_expr_ctxs_.size();
-  for (int i = 0; i < aggregate_evaluators_.size(); ++i, ++slot_desc) {
-    AggFnEvaluator* evaluator = aggregate_evaluators_[i];
+  for (int i = 0; i < evaluators.size(); ++i, ++slot_desc) {
+    AggFnEvaluator* evaluator = evaluators[i];
     evaluator->Init(agg_fn_ctxs[i], intermediate_tuple);
     // Codegen specific path for min/max.
     // To minimize branching on the UpdateTuple path, initialize the result value
@@ -1000,6 +1374,13 @@ void PartitionedAggregationNode::InitAggSlots(
   }
 }
 
+void PartitionedAggregationNode::ProcessBatchNoGroupingBatched(RowBatch* batch) {
+  DCHECK(use_batch_agg_fns_);
+  for (int i = 0; i < aggregate_evaluators_.size(); ++i) {
+    aggregate_evaluators_[i]->AddBatch(agg_fn_ctxs_[i], batch, singleton_output_tuple_);
+  }
+}
+
 void PartitionedAggregationNode::UpdateTuple(FunctionContext** agg_fn_ctxs,
     Tuple* tuple, TupleRow* row, bool is_merge) {
   DCHECK(tuple != NULL || aggregate_evaluators_.empty());
@@ -1254,9 +1635,9 @@ Status PartitionedAggregationNode::ProcessStream(BufferedTupleStream* input_stre
 
 Status PartitionedAggregationNode::SpillPartition() {
   int64_t max_freed_mem = 0;
-  int partition_idx = -1;
+  vector<int64_t> freed_mem(hash_partitions_.size(), 0);
 
-  // Iterate over the partitions and pick the largest partition that is not spilled.
+  // Compute how much memory spilling each partition that is not spilled would free.
   for (int i = 0; i < hash_partitions_.size(); ++i) {
     if (hash_partitions_[i]->is_closed) continue;
     if (hash_partitions_[i]->is_spilled()) continue;
@@ -1265,16 +1646,33 @@ Status PartitionedAggregationNode::SpillPartition() {
     mem += hash_partitions_[i]->hash_tbl->ByteSize();
     mem += hash_partitions_[i]->agg_fn_pool->total_reserved_bytes();
     DCHECK_GT(mem, 0); // At least the hash table buckets should occupy memory.
-    if (mem > max_freed_mem) {
-      max_freed_mem = mem;
-      partition_idx = i;
-    }
+    freed_mem[i] = mem;
+    max_freed_mem = max(max_freed_mem, mem);
   }
-  if (partition_idx == -1) {
+  if (max_freed_mem == 0) {
     // Could not find a partition to spill. This means the mem limit was just too low.
     return state_->block_mgr()->MemLimitTooLowError(block_mgr_client_, id());
   }
 
+  // After a partition is spilled, each of its rows is written to disk instead of being
+  // aggregated in memory. This costs the most for partitions that absorb many rows into
+  // their existing groups, e.g. the ones holding the hot keys of a skewed GROUP BY, so
+  // those are kept in memory: of the partitions that free at least half as much memory
+  // as the largest one, spill the one with the fewest recent group hits.
+  int partition_idx = -1;
+  for (int i = 0; i < hash_partitions_.size(); ++i) {
+    if (freed_mem[i] == 0 || freed_mem[i] * 2 < max_freed_mem) continue;
+    if (partition_idx == -1 || hash_partitions_[i]->recent_group_hits <
+        hash_partitions_[partition_idx]->recent_group_hits) {
+      partition_idx = i;
+    }
+  }
+  DCHECK_NE(partition_idx, -1);
+  // Start a new window, so that partitions that were hot a long time ago are not
+  // favoured forever.
+  for (int i = 0; i < hash_partitions_.size(); ++i) {
+    hash_partitions_[i]->recent_group_hits = 0;
+  }
   return hash_partitions_[partition_idx]->Spill();
 }
 
@@ -1760,17 +2158,19 @@ Status PartitionedAggregationNode::CodegenProcessBatch(Function** fn) {
     RETURN_IF_ERROR(ht_ctx_->CodegenEvalRow(state_, false, &eval_grouping_expr_fn));
 
     // Replace call sites
+    // ProcessBatch() has a row-at-a-time path and a batched, prefetching path. The
+    // latter evaluates each row twice: once to hash it and once before processing it.
     process_batch_fn = codegen->ReplaceCallSites(process_batch_fn, false,
         eval_grouping_expr_fn, "EvalProbeRow", &replaced);
-    DCHECK_EQ(replaced, 1);
+    DCHECK_EQ(replaced, 3);
 
     process_batch_fn = codegen->ReplaceCallSites(process_batch_fn, true,
         hash_fn, "HashCurrentRow", &replaced);
-    DCHECK_EQ(replaced, 1);
+    DCHECK_EQ(replaced, 2);
 
     process_batch_fn = codegen->ReplaceCallSites(process_batch_fn, true,
         build_equals_fn, "Equals", &replaced);
-    DCHECK_EQ(replaced, 1);
+    DCHECK_EQ(replaced, 2);
   }
 
   process_batch_fn = codegen->ReplaceCallSites(process_batch_fn, false,
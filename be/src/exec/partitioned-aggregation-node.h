@@ -17,8 +17,11 @@
 #define IMPALA_EXEC_PARTITIONED_AGGREGATION_NODE_H
 
 #include <functional>
+#include <boost/ptr_container/ptr_vector.hpp>
 #include <boost/scoped_ptr.hpp>
 
+#include "common/atomic.h"
+
 #include "exec/exec-node.h"
 #include "exec/hash-table.h"
 #include "runtime/buffered-block-mgr.h"
@@ -38,6 +41,7 @@ class LlvmCodeGen;
 class RowBatch;
 class RuntimeState;
 struct StringValue;
+class SubexprCache;
 class Tuple;
 class TupleDescriptor;
 class SlotDescriptor;
@@ -101,6 +105,21 @@ class SlotDescriptor;
 /// through. If the node is not a streaming pre-aggregation, it responds to memory
 /// pressure by spilling partitions to disk.
 ///
+/// Independently of memory pressure, a streaming preaggregation measures the reduction
+/// factor that each partition's hash table achieves on a sample of its input rows. If it
+/// is below --streaming_preagg_min_observed_reduction, the rows of that partition are
+/// passed through without probing the hash table for the next
+/// --streaming_preagg_passthrough_rows rows, after which the partition is sampled again.
+/// This avoids spending CPU on hashing unique keys in high-cardinality aggregations.
+///
+/// Parallel aggregation: aggregations that are not streaming preaggregations, e.g. the
+/// merge aggregation after an exchange, can consume their input with up to
+/// --agg_threads threads. The input is consumed in rounds. In each round, the node's
+/// thread partitions the rows, then each thread aggregates the rows of a disjoint set of
+/// partitions with its own clones of the exprs and aggregate function evaluators. Only
+/// the node's thread spills: rows that a worker can't fit into memory are aggregated by
+/// the node's thread at the end of the round.
+///
 /// TODO: Buffer rows before probing into the hash table?
 /// TODO: After spilling, we can still maintain a very small hash table just to remove
 /// some number of rows (from likely going to disk).
@@ -128,6 +147,8 @@ class PartitionedAggregationNode : public ExecNode {
   virtual Status GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos);
   virtual Status Reset(RuntimeState* state);
   virtual void Close(RuntimeState* state);
+  virtual void GetBufferRequirements(int64_t buffer_size, int* min_buffers,
+      int* desired_buffers) const;
 
   static const char* LLVM_CLASS_NAME;
 
@@ -190,6 +211,24 @@ class PartitionedAggregationNode : public ExecNode {
   /// Contains any evaluators that require the serialize step.
   bool needs_serialize_;
 
+  /// The thrift descriptions of the aggregate functions, used to create the evaluators
+  /// of the threads of a parallel aggregation.
+  std::vector<TExpr> aggregate_fn_descs_;
+
+  /// True if there is no grouping and all aggregate functions support
+  /// AggFnEvaluator::AddBatch(), in which case input batches are processed by
+  /// ProcessBatchNoGroupingBatched().
+  bool use_batch_agg_fns_;
+
+  /// True if all aggregate functions are COUNT(*) and the child is an UnnestNode whose
+  /// items all become rows, in which case Open() adds the number of items to the counts
+  /// without fetching any rows. Only set if 'use_batch_agg_fns_' is true.
+  bool count_unnested_rows_;
+
+  /// Results of the subexpressions that are shared by grouping_expr_ctxs_ and the input
+  /// exprs of aggregate_evaluators_, see CachedExpr. NULL if there are none.
+  SubexprCache* subexpr_cache_;
+
   std::vector<AggFnEvaluator*> aggregate_evaluators_;
 
   /// FunctionContext for each aggregate function and backing MemPool. String data
@@ -281,6 +320,13 @@ class PartitionedAggregationNode : public ExecNode {
   /// Expose the minimum reduction factor to continue growing the hash tables.
   RuntimeProfile::Counter* preagg_streaming_ht_min_reduction_;
 
+  /// The number of times a partition switched to pass-through because its observed
+  /// reduction factor was too low.
+  RuntimeProfile::Counter* num_preagg_passthrough_switches_;
+
+  /// Number of evaluations of shared subexpressions answered by subexpr_cache_.
+  RuntimeProfile::Counter* subexpr_cache_hits_;
+
   /// The estimated number of input rows from the planner.
   int64_t estimated_input_cardinality_;
 
@@ -329,7 +375,9 @@ class PartitionedAggregationNode : public ExecNode {
   /// require an unaggregated stream.
   struct Partition {
     Partition(PartitionedAggregationNode* parent, int level)
-      : parent(parent), is_closed(false), level(level) {}
+      : parent(parent), is_closed(false), level(level), recent_group_hits(0),
+        streaming_probe_rows(0), streaming_probe_misses(0),
+        streaming_passthrough_rows_left(0) {}
 
     ~Partition();
 
@@ -383,6 +431,21 @@ class PartitionedAggregationNode : public ExecNode {
 
     /// Unaggregated rows that are spilled. Always NULL for streaming pre-aggregations.
     boost::scoped_ptr<BufferedTupleStream> unaggregated_row_stream;
+
+    /// Number of input rows that were aggregated into an existing group of 'hash_tbl'
+    /// since a partition of the node was last spilled. Used by SpillPartition() to tell
+    /// hot partitions from cold ones.
+    int64_t recent_group_hits;
+
+    /// Streaming preaggregations only: the number of rows probed into 'hash_tbl' since
+    /// the reduction factor was last checked, and how many of them did not match an
+    /// existing group.
+    int64_t streaming_probe_rows;
+    int64_t streaming_probe_misses;
+
+    /// Streaming preaggregations only: the number of rows of this partition that are
+    /// still to be passed through without probing 'hash_tbl'.
+    int64_t streaming_passthrough_rows_left;
   };
 
   /// Stream used to store serialized spilled rows. Only used if needs_serialize_
@@ -412,20 +475,29 @@ class PartitionedAggregationNode : public ExecNode {
       MemPool* pool, Status* status);
 
 
+  /// Same as the stream version of ConstructIntermediateTuple() above, but takes the
+  /// grouping values from 'ht_ctx' and initializes the aggregate slots with
+  /// 'evaluators' instead of 'ht_ctx_' and 'aggregate_evaluators_'. Used by the worker
+  /// threads of a parallel aggregation.
+  Tuple* ConstructIntermediateTuple(const std::vector<AggFnEvaluator*>& evaluators,
+      HashTableCtx* ht_ctx, const std::vector<impala_udf::FunctionContext*>& agg_fn_ctxs,
+      BufferedTupleStream* stream, Status* status);
+
   /// Returns the number of bytes of variable-length data for the grouping values stored
-  /// in 'ht_ctx_'.
-  int GroupingExprsVarlenSize();
+  /// in 'ht_ctx'.
+  int GroupingExprsVarlenSize(HashTableCtx* ht_ctx);
 
-  /// Initializes intermediate tuple by copying grouping values stored in 'ht_ctx_' that
+  /// Initializes intermediate tuple by copying grouping values stored in 'ht_ctx' that
   /// that were computed over 'current_row_' using 'grouping_expr_ctxs_'. Writes the
   /// var-len data into buffer. 'buffer' points to the start of a buffer of at least the
   /// size of the variable-length data: 'varlen_size'.
-  void CopyGroupingValues(Tuple* intermediate_tuple, uint8_t* buffer, int varlen_size);
+  void CopyGroupingValues(HashTableCtx* ht_ctx, Tuple* intermediate_tuple,
+      uint8_t* buffer, int varlen_size);
 
-  /// Initializes the aggregate function slots of an intermediate tuple.
-  /// Any var-len data is allocated from the FunctionContexts.
-  void InitAggSlots(const vector<impala_udf::FunctionContext*>& agg_fn_ctxs,
-      Tuple* intermediate_tuple);
+  /// Initializes the aggregate function slots of an intermediate tuple with
+  /// 'evaluators'. Any var-len data is allocated from the FunctionContexts.
+  void InitAggSlots(const std::vector<AggFnEvaluator*>& evaluators,
+      const vector<impala_udf::FunctionContext*>& agg_fn_ctxs, Tuple* intermediate_tuple);
 
   /// Updates the given aggregation intermediate tuple with aggregation values computed
   /// over 'row' using 'agg_fn_ctxs'. Whether the agg fn evaluator calls Update() or
@@ -455,6 +527,69 @@ class PartitionedAggregationNode : public ExecNode {
   /// ProcessBatch() for codegen. This function is replaced by codegen.
   Status ProcessBatchNoGrouping(RowBatch* batch, HashTableCtx* ht_ctx = NULL);
 
+  /// Does the aggregation for all tuple rows in the batch when there is no grouping by
+  /// updating one aggregate function at a time for the whole batch. Only valid if
+  /// 'use_batch_agg_fns_' is true.
+  void ProcessBatchNoGroupingBatched(RowBatch* batch);
+
+  /// Processes one batch of input rows in Open() with the serial algorithm. The caller
+  /// times it with 'build_timer_'.
+  Status ProcessInputBatch(RowBatch* batch);
+
+  /// State of a thread of a parallel aggregation. It owns clones of the exprs and
+  /// evaluators, so that it can evaluate and aggregate rows concurrently with the others.
+  struct AggThread {
+    std::vector<ExprContext*> build_expr_ctxs;
+    std::vector<ExprContext*> grouping_expr_ctxs;
+    boost::scoped_ptr<HashTableCtx> ht_ctx;
+    std::vector<AggFnEvaluator*> evaluators;
+    std::vector<impala_udf::FunctionContext*> evaluator_ctxs;
+    Status status;
+  };
+
+  /// An input row of a round of a parallel aggregation and its hash.
+  struct HashedRow {
+    TupleRow* row;
+    uint32_t hash;
+  };
+
+  /// The minimum number of input rows in a round of a parallel aggregation. Threads are
+  /// started for each round, this amortizes their startup cost.
+  static const int64_t MIN_ROWS_PER_PARALLEL_ROUND = 64 * 1024;
+
+  /// Consumes all rows from child(0) in Open(), aggregating them with up to
+  /// --agg_threads threads. Falls back to the serial algorithm if no thread tokens are
+  /// available.
+  Status ConsumeInputParallel(RuntimeState* state);
+
+  /// Creates the clones in 'thread'.
+  Status PrepareAggThread(RuntimeState* state, AggThread* thread);
+  void CloseAggThread(RuntimeState* state, AggThread* thread);
+
+  /// Aggregates the rows of 'batches' with the node's thread and 'threads'.
+  /// 'rows_by_partition' is scratch space with PARTITION_FANOUT entries.
+  Status AggregateRoundParallel(RuntimeState* state,
+      boost::ptr_vector<AggThread>* threads, boost::ptr_vector<RowBatch>* batches,
+      std::vector<std::vector<HashedRow> >* rows_by_partition);
+
+  /// Thread function of AggregateRoundParallel(). Claims the partitions in
+  /// 'partition_idxs' one by one through 'next_partition' and aggregates their rows
+  /// with AggregatePartitionRows(). Sets the entries of 'num_aggregated', which is
+  /// indexed by partition.
+  void AggregatePartitionsThread(HashTableCtx* ht_ctx,
+      const std::vector<AggFnEvaluator*>* evaluators,
+      const std::vector<int>* partition_idxs,
+      const std::vector<std::vector<HashedRow> >* rows_by_partition,
+      AtomicInt<int>* next_partition, std::vector<int>* num_aggregated, Status* status);
+
+  /// Aggregates 'rows' into the hash table of 'partition', using 'ht_ctx' and
+  /// 'evaluators'. The hash table must have room for all rows. Stops at the first row for
+  /// which there is no memory for a new intermediate tuple, since only the node's thread
+  /// can spill. Sets *num_aggregated to the number of rows that were aggregated.
+  Status AggregatePartitionRows(HashTableCtx* ht_ctx,
+      const std::vector<AggFnEvaluator*>& evaluators, Partition* partition,
+      const std::vector<HashedRow>& rows, int* num_aggregated);
+
   /// Processes a batch of rows. This is the core function of the algorithm. We partition
   /// the rows into hash_partitions_, spilling as necessary.
   /// If AGGREGATED_ROWS is true, it means that the rows in the batch are already
@@ -465,11 +600,12 @@ class PartitionedAggregationNode : public ExecNode {
   template<bool AGGREGATED_ROWS>
   Status IR_ALWAYS_INLINE ProcessBatch(RowBatch* batch, HashTableCtx* ht_ctx);
 
-  /// This function processes each individual row in ProcessBatch(). Must be inlined into
-  /// ProcessBatch for codegen to substitute function calls with codegen'd versions.
-  /// May spill partitions if not enough memory is available.
+  /// This function processes each individual row in ProcessBatch(). 'row' must have
+  /// been evaluated by 'ht_ctx' (which holds its expr values) and 'hash' is its hash.
+  /// Must be inlined into ProcessBatch for codegen to substitute function calls with
+  /// codegen'd versions. May spill partitions if not enough memory is available.
   template<bool AGGREGATED_ROWS>
-  Status IR_ALWAYS_INLINE ProcessRow(TupleRow* row, HashTableCtx* ht_ctx);
+  Status IR_ALWAYS_INLINE ProcessRow(TupleRow* row, HashTableCtx* ht_ctx, uint32_t hash);
 
   /// Create a new intermediate tuple in partition, initialized with row. ht_ctx is
   /// the context for the partition's hash table and hash is the precomputed hash of
@@ -512,10 +648,20 @@ class PartitionedAggregationNode : public ExecNode {
   /// the preagg should pass through any rows it can't fit in its tables.
   bool ShouldExpandPreaggHashTables() const;
 
+  /// Number of rows of a partition that are probed into its hash table before its
+  /// observed reduction factor is checked.
+  static const int64_t STREAMING_REDUCTION_SAMPLE_ROWS = 16 * 1024;
+
+  /// Checks the reduction factor that 'partition' observed over the last
+  /// STREAMING_REDUCTION_SAMPLE_ROWS probes, switches it to pass-through if the factor
+  /// is too low and starts a new sample.
+  void CheckStreamingReduction(Partition* partition);
+
   /// Streaming processing of in_batch from child. Rows from child are either aggregated
   /// into the hash table or added to 'out_batch' in the intermediate tuple format.
   /// 'in_batch' is processed entirely, and 'out_batch' must have enough capacity to
-  /// store all of the rows in 'in_batch'.
+  /// store all of the rows in 'in_batch'. Rows of partitions that are passing through
+  /// because of a low observed reduction factor are not probed into the hash table.
   /// 'needs_serialize' is an argument so that codegen can replace it with a constant,
   ///     rather than using the member variable 'needs_serialize_'.
   /// 'remaining_capacity' is an array with PARTITION_FANOUT entries with the number of
@@ -532,7 +678,8 @@ class PartitionedAggregationNode : public ExecNode {
   /// true if successful or false if the table is full. 'remaining_capacity' keeps track
   /// of how many more entries can be added to the hash table so we can avoid retrying
   /// inserts. It is decremented if an insert succeeds and set to zero if an insert
-  /// fails. If an error occurs, returns false and sets 'status'.
+  /// fails. If an error occurs, returns false and sets 'status'. Counts the probe in the
+  /// reduction factor sample of 'partition'.
   bool IR_ALWAYS_INLINE TryAddToHashTable(HashTableCtx* ht_ctx, Partition* partition,
       TupleRow* in_row, uint32_t hash, int* remaining_capacity, Status* status);
 
@@ -556,7 +703,9 @@ class PartitionedAggregationNode : public ExecNode {
   /// partition from aggregated_partitions_ and repartitions it.
   Status NextPartition();
 
-  /// Picks a partition from hash_partitions_ to spill.
+  /// Picks a partition from hash_partitions_ to spill. Among the partitions that free
+  /// close to the most memory, the one whose groups were updated the least since the
+  /// last spill is picked.
   Status SpillPartition();
 
   /// Moves the partitions in hash_partitions_ to aggregated_partitions_ or
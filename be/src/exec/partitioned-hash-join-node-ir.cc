@@ -49,6 +49,24 @@ int PartitionedHashJoinNode::ProcessProbeBatch(
   const int max_rows = out_batch->capacity() - out_batch->num_rows();
   int num_rows_added = 0;
 
+  // A batch is always started from its first row and at least one row is consumed per
+  // call, so a position of 0 means this is the first call for this batch.
+  if (probe_batch_pos_ == 0) {
+    probe_batch_hashed_ = prefetch_probe_buckets_;
+    if (probe_batch_hashed_) {
+      // Hash all rows and prefetch their buckets before probing any of them, so that
+      // the cache misses on the buckets overlap.
+      ht_ctx->EvalAndHashBatch<false>(probe_batch_.get());
+      const int num_rows = probe_batch_->num_rows();
+      for (int i = 0; i < num_rows; ++i) {
+        if (!ht_ctx->batch_row_valid(i)) continue;
+        const uint32_t hash = ht_ctx->batch_hash(i);
+        HashTable* hash_tbl = hash_tbls_[hash >> (32 - NUM_PARTITIONING_BITS)];
+        if (hash_tbl != NULL) hash_tbl->PrefetchBucket<false>(hash);
+      }
+    }
+  }
+
   while (probe_batch_pos_ >= 0) {
     if (current_probe_row_ != NULL) {
       while (!hash_tbl_iterator_.AtEnd()) {
@@ -175,10 +193,18 @@ next_row:
     }
 
     // Establish current_probe_row_ and find its corresponding partition.
-    current_probe_row_ = probe_batch_->GetRow(probe_batch_pos_++);
+    current_probe_row_ = probe_batch_->GetRow(probe_batch_pos_);
     matched_probe_ = false;
     uint32_t hash;
-    if (!ht_ctx->EvalAndHashProbe(current_probe_row_, &hash)) {
+    bool row_valid;
+    if (probe_batch_hashed_) {
+      row_valid = ht_ctx->batch_row_valid(probe_batch_pos_);
+      hash = ht_ctx->batch_hash(probe_batch_pos_);
+    } else {
+      row_valid = ht_ctx->EvalAndHashProbe(current_probe_row_, &hash);
+    }
+    ++probe_batch_pos_;
+    if (!row_valid) {
       if (JoinOp == TJoinOp::NULL_AWARE_LEFT_ANTI_JOIN) {
         // For NAAJ, we need to treat NULLs on the probe carefully. The logic is:
         // 1. No build rows -> Return this row.
@@ -199,6 +225,8 @@ next_row:
     }
     const uint32_t partition_idx = hash >> (32 - NUM_PARTITIONING_BITS);
     if (LIKELY(hash_tbls_[partition_idx] != NULL)) {
+      // The expr values of the first pass were overwritten by the rows after this one.
+      if (probe_batch_hashed_) ht_ctx->EvalProbe(current_probe_row_);
       hash_tbl_iterator_= hash_tbls_[partition_idx]->FindProbeRow(ht_ctx, hash);
     } else {
       Partition* partition = hash_partitions_[partition_idx];
@@ -272,6 +300,7 @@ Status PartitionedHashJoinNode::ProcessBuildBatch(RowBatch* build_batch) {
     Partition* partition = hash_partitions_[partition_idx];
     const bool result = AppendRow(partition->build_rows(), build_row, &buildStatus_);
     if (UNLIKELY(!result)) return buildStatus_;
+    partition->UpdateHotKeys(hash);
   }
   return Status::OK();
 }
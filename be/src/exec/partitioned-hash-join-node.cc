@@ -14,6 +14,7 @@
 
 #include "exec/partitioned-hash-join-node.inline.h"
 
+#include <algorithm>
 #include <functional>
 #include <numeric>
 #include <sstream>
@@ -26,10 +27,13 @@
 #include "exprs/slot-ref.h"
 #include "runtime/buffered-block-mgr.h"
 #include "runtime/buffered-tuple-stream.inline.h"
+#include "runtime/exec-env.h"
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 #include "util/debug-util.h"
+#include "util/min-max-filter.h"
 #include "util/runtime-profile.h"
+#include "util/thread.h"
 
 #include "gen-cpp/PlanNodes_types.h"
 
@@ -37,6 +41,15 @@
 
 DEFINE_bool(enable_phj_probe_side_filtering, true,
     "Enables pushing PHJ build side filters to probe side");
+DEFINE_int32(hash_join_build_threads, 8, "(Advanced) Maximum number of threads that "
+    "build the hash tables of the in-memory partitions of a partitioned hash join. "
+    "Threads other than the join's own are only used if thread tokens are available.");
+DEFINE_bool(enable_phj_spill_before_build, true, "(Advanced) If the estimated hash "
+    "tables of the in-memory partitions of a partitioned hash join don't fit in the "
+    "available memory, spill the largest partitions before building any hash table so "
+    "that as many partitions as possible stay in memory.");
+DECLARE_bool(enable_hash_table_tags);
+DECLARE_bool(enable_stream_string_interning);
 
 using namespace impala;
 using namespace llvm;
@@ -52,6 +65,8 @@ PartitionedHashJoinNode::PartitionedHashJoinNode(
     null_aware_eval_timer_(NULL),
     state_(PARTITIONING_BUILD),
     partition_pool_(new ObjectPool()),
+    prefetch_probe_buckets_(false),
+    probe_batch_hashed_(false),
     input_partition_(NULL),
     null_aware_partition_(NULL),
     non_empty_build_(false),
@@ -158,6 +173,8 @@ Status PartitionedHashJoinNode::Prepare(RuntimeState* state) {
   RETURN_IF_ERROR(state->block_mgr()->RegisterClient(
       Substitute("PartitionedHashJoinNode id=$0 ptr=$1", id_, this),
       MinRequiredBuffers(), true, mem_tracker(), state, &block_mgr_client_));
+  state->block_mgr()->SetClientWaitTimer(block_mgr_client_,
+      ADD_TIMER(runtime_profile(), SPILL_WAIT_TIMER));
 
   const bool should_store_nulls = join_op_ == TJoinOp::RIGHT_OUTER_JOIN ||
       join_op_ == TJoinOp::RIGHT_ANTI_JOIN || join_op_ == TJoinOp::FULL_OUTER_JOIN ||
@@ -282,6 +299,12 @@ void PartitionedHashJoinNode::ClosePartitions() {
   partition_pool_->Clear();
 }
 
+void PartitionedHashJoinNode::GetBufferRequirements(int64_t buffer_size,
+    int* min_buffers, int* desired_buffers) const {
+  *min_buffers = MinRequiredBuffers();
+  *desired_buffers = EstimatedBuffers(buffer_size, *min_buffers);
+}
+
 void PartitionedHashJoinNode::Close(RuntimeState* state) {
   if (is_closed()) return;
   if (ht_ctx_.get() != NULL) ht_ctx_->Close();
@@ -316,14 +339,26 @@ PartitionedHashJoinNode::Partition::Partition(RuntimeState* state,
       state->block_mgr(), parent_->block_mgr_client_,
       true /* use_initial_small_buffers */, false /* read_write */ );
   DCHECK(probe_rows_ != NULL);
+  if (FLAGS_enable_stream_string_interning) {
+    build_rows_->EnableStringInterning();
+    probe_rows_->EnableStringInterning();
+  }
+  memset(hot_key_counts_, 0, sizeof(hot_key_counts_));
 }
 
 PartitionedHashJoinNode::Partition::~Partition() {
   DCHECK(is_closed());
 }
 
+int64_t PartitionedHashJoinNode::Partition::MaxHotKeyRows() const {
+  int64_t max_rows = 0;
+  for (int i = 0; i < NUM_HOT_KEYS; ++i) max_rows = std::max(max_rows, hot_key_counts_[i]);
+  return max_rows;
+}
+
 int64_t PartitionedHashJoinNode::Partition::EstimatedInMemSize() const {
-  return build_rows_->byte_size() + HashTable::EstimateSize(build_rows_->num_rows());
+  return build_rows_->byte_size() + HashTable::EstimateSize(build_rows_->num_rows(),
+      parent_->ht_ctx_->inline_key_words());
 }
 
 void PartitionedHashJoinNode::Partition::Close(RowBatch* batch) {
@@ -410,17 +445,17 @@ Status PartitionedHashJoinNode::Partition::Spill(bool unpin_all_build) {
 }
 
 Status PartitionedHashJoinNode::Partition::BuildHashTable(RuntimeState* state,
-    bool* built, const bool add_runtime_filters) {
+    bool* built, const bool add_runtime_filters, BuildThread* thread) {
   if (add_runtime_filters) {
-    return BuildHashTableInternal<true>(state, built);
+    return BuildHashTableInternal<true>(state, thread, built);
   } else {
-    return BuildHashTableInternal<false>(state, built);
+    return BuildHashTableInternal<false>(state, thread, built);
   }
 }
 
 template<bool const BUILD_RUNTIME_FILTERS>
 Status PartitionedHashJoinNode::Partition::BuildHashTableInternal(
-    RuntimeState* state, bool* built) {
+    RuntimeState* state, BuildThread* thread, bool* built) {
   DCHECK(build_rows_ != NULL);
   *built = false;
 
@@ -434,10 +469,13 @@ Status PartitionedHashJoinNode::Partition::BuildHashTableInternal(
 
   RowBatch batch(parent_->child(1)->row_desc(), state->batch_size(),
       parent_->mem_tracker());
-  HashTableCtx* ctx = parent_->ht_ctx_.get();
+  HashTableCtx* ctx = thread == NULL ? parent_->ht_ctx_.get() : thread->ht_ctx.get();
+  const vector<FilterContext>& filters =
+      thread == NULL ? parent_->filters_ : thread->filters;
   // TODO: move the batch and indices as members to avoid reallocating.
   vector<BufferedTupleStream::RowIdx> indices;
   bool eos = false;
+  bool prefetch_buckets = false;
 
   // Allocate the partition-local hash table. Initialize the number of buckets based on
   // the number of build rows (the number of rows is known at this point). This assumes
@@ -453,35 +491,61 @@ Status PartitionedHashJoinNode::Partition::BuildHashTableInternal(
       HashTable::EstimateNumBuckets(build_rows()->num_rows()) : state->batch_size() * 2;
   hash_tbl_.reset(HashTable::Create(state, parent_->block_mgr_client_,
       parent_->child(1)->row_desc().tuple_descriptors().size(), build_rows(),
-      1 << (32 - NUM_PARTITIONING_BITS), estimated_num_buckets));
+      1 << (32 - NUM_PARTITIONING_BITS), estimated_num_buckets,
+      FLAGS_enable_hash_table_tags, parent_->ht_ctx_->inline_key_words()));
   if (!hash_tbl_->Init()) goto not_built;
 
   if (BUILD_RUNTIME_FILTERS) {
     DCHECK_EQ(level_, 0) << "Should not add filters if repartitioning";
   }
+  // The table is sized for all the rows up front, so its size does not change.
+  prefetch_buckets = HashTable::UseBatchPrefetch(hash_tbl_->ByteSize());
   do {
     RETURN_IF_ERROR(build_rows_->GetNext(&batch, &eos, &indices));
     DCHECK_EQ(batch.num_rows(), indices.size());
     int num_rows = batch.num_rows();
     DCHECK_LE(num_rows, hash_tbl_->EmptyBuckets()) << build_rows()->RowConsumesMemory();
     SCOPED_TIMER(parent_->build_timer_);
+    if (prefetch_buckets) {
+      // Hash all rows and prefetch their buckets before inserting any of them.
+      ctx->EvalAndHashBatch<true>(&batch);
+      for (int i = 0; i < num_rows; ++i) {
+        if (ctx->batch_row_valid(i)) hash_tbl_->PrefetchBucket<true>(ctx->batch_hash(i));
+      }
+    }
     for (int i = 0; i < num_rows; ++i) {
       TupleRow* row = batch.GetRow(i);
       uint32_t hash = 0;
-      if (!ctx->EvalAndHashBuild(row, &hash)) continue;
+      if (prefetch_buckets) {
+        if (!ctx->batch_row_valid(i)) continue;
+        hash = ctx->batch_hash(i);
+        ctx->EvalBuild(row);
+      } else if (!ctx->EvalAndHashBuild(row, &hash)) {
+        continue;
+      }
       if (UNLIKELY(!hash_tbl_->Insert(ctx, indices[i], row, hash))) goto not_built;
       if (BUILD_RUNTIME_FILTERS) {
-        BOOST_FOREACH(const FilterContext& ctx, parent_->filters_) {
+        BOOST_FOREACH(const FilterContext& ctx, filters) {
           if (ctx.local_bloom_filter == NULL) continue;
           void* e = ctx.expr->GetValue(row);
           uint32_t h = RawValue::GetHashValue(e, ctx.expr->root()->type(),
               RuntimeFilterBank::DefaultHashSeed());
           ctx.local_bloom_filter->Insert(h);
+          if (ctx.local_min_max_filter != NULL) {
+            ctx.local_min_max_filter->Insert(e, ctx.expr->root()->type());
+          }
         }
       }
     }
     RETURN_IF_ERROR(state->GetQueryStatus());
-    parent_->FreeLocalAllocations();
+    if (thread == NULL) {
+      parent_->FreeLocalAllocations();
+    } else {
+      ExprContext::FreeLocalAllocations(thread->build_expr_ctxs);
+      BOOST_FOREACH(const FilterContext& ctx, thread->filters) {
+        ctx.expr->FreeLocalAllocations();
+      }
+    }
     batch.Reset();
   } while (!eos);
 
@@ -506,6 +570,10 @@ bool PartitionedHashJoinNode::AllocateRuntimeFilters(RuntimeState* state) {
   DCHECK(ht_ctx_.get() != NULL);
   for (int i = 0; i < filters_.size(); ++i) {
     filters_[i].local_bloom_filter = state->filter_bank()->AllocateScratchBloomFilter();
+    if (MinMaxFilter::SupportsType(filters_[i].expr->root()->type())) {
+      filters_[i].local_min_max_filter =
+          state->filter_bank()->AllocateScratchMinMaxFilter();
+    }
   }
   return true;
 }
@@ -518,7 +586,7 @@ bool PartitionedHashJoinNode::PublishRuntimeFilters(RuntimeState* state) {
     BOOST_FOREACH(const FilterContext& ctx, filters_) {
       if (ctx.local_bloom_filter == NULL) continue;
       state->filter_bank()->UpdateFilterFromLocal(ctx.filter->filter_desc().filter_id,
-          ctx.local_bloom_filter);
+          ctx.local_bloom_filter, ctx.local_min_max_filter);
     }
     return true;
   }
@@ -804,6 +872,28 @@ Status PartitionedHashJoinNode::PrepareNextPartition(RuntimeState* state) {
   }
 
   if (!built) {
+    // The rows of a single key can't be split by repartitioning. If they alone don't fit
+    // in memory, repartitioning would rewrite them once more only to fail at the next
+    // level, so fail now.
+    int64_t hot_key_rows = input_partition_->MaxHotKeyRows();
+    int64_t num_build_rows = input_partition_->build_rows()->num_rows();
+    if (hot_key_rows > 0 && num_build_rows > 0) {
+      int64_t hot_key_mem = static_cast<int64_t>(
+          input_partition_->build_rows()->byte_size() *
+          (static_cast<double>(hot_key_rows) / num_build_rows)) +
+          HashTable::EstimateSize(hot_key_rows, ht_ctx_->inline_key_words());
+      if (hot_key_mem >= mem_limit) {
+        Status status = Status::MemLimitExceeded();
+        status.AddDetail(Substitute("Cannot perform hash join at node with id $0. "
+            "At least $1 of the $2 build rows of a spilled partition have the same join "
+            "key, which needs an estimated $3 bytes of memory but only $4 are available. "
+            "Repartitioning level $5.", id_, hot_key_rows, num_build_rows, hot_key_mem,
+            mem_limit, input_partition_->level_));
+        state->SetMemLimitExceeded();
+        return status;
+      }
+    }
+
     // This build partition still does not fit in memory, repartition.
     UpdateState(REPARTITIONING);
     DCHECK(input_partition_->is_spilled());
@@ -834,6 +924,7 @@ Status PartitionedHashJoinNode::PrepareNextPartition(RuntimeState* state) {
     for (int i = 0; i < PARTITION_FANOUT; ++i) {
       hash_tbls_[i] = input_partition_->hash_tbl();
     }
+    UpdatePrefetchProbeBuckets();
     UpdateState(PROBING_SPILLED_PARTITION);
   }
 
@@ -858,6 +949,7 @@ int64_t PartitionedHashJoinNode::LargestSpilledPartition() const {
 Status PartitionedHashJoinNode::GetNext(RuntimeState* state, RowBatch* out_batch,
     bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   DCHECK(!out_batch->AtCapacity());
 
@@ -1211,26 +1303,46 @@ Status PartitionedHashJoinNode::BuildHashTables(RuntimeState* state) {
     can_add_runtime_filters_ = false;
   }
 
-  // First loop over the partitions and build hash tables for the partitions that did
-  // not already spill.
+  // Close the empty partitions and collect the ones that did not already spill.
+  vector<Partition*> partitions_to_build;
   BOOST_FOREACH(Partition* partition, hash_partitions_) {
     if (partition->build_rows()->num_rows() == 0) {
       // This partition is empty, no need to do anything else.
       partition->Close(NULL);
-      continue;
+    } else if (!partition->is_spilled()) {
+      DCHECK(partition->build_rows()->is_pinned());
+      partitions_to_build.push_back(partition);
     }
+  }
+  if (FLAGS_enable_phj_spill_before_build) {
+    RETURN_IF_ERROR(SpillPartitionsToFitHashTables(&partitions_to_build));
+  }
+  int64_t num_rows_to_build = 0;
+  BOOST_FOREACH(Partition* partition, partitions_to_build) {
+    num_rows_to_build += partition->build_rows()->num_rows();
+  }
 
-    if (!partition->is_spilled()) {
+  if (FLAGS_hash_join_build_threads > 1 && partitions_to_build.size() > 1 &&
+      num_rows_to_build >= MIN_ROWS_FOR_PARALLEL_BUILD && !IsInSubplan()) {
+    vector<Partition*> not_built;
+    RETURN_IF_ERROR(BuildHashTablesParallel(state, partitions_to_build, &not_built));
+    // If we did not have enough memory to build a hash table, we need to spill its
+    // partition (clean up the hash table, unpin build).
+    BOOST_FOREACH(Partition* partition, not_built) {
+      RETURN_IF_ERROR(partition->Spill(true));
+    }
+  } else {
+    BOOST_FOREACH(Partition* partition, partitions_to_build) {
       bool built = false;
-      DCHECK(partition->build_rows()->is_pinned());
       RETURN_IF_ERROR(partition->BuildHashTable(state, &built, can_add_runtime_filters_));
       // If we did not have enough memory to build this hash table, we need to spill this
       // partition (clean up the hash table, unpin build).
       if (!built) RETURN_IF_ERROR(partition->Spill(true));
     }
-
-    DCHECK(!can_add_runtime_filters_ || !partition->is_spilled())
-        << "Runtime filters enabled despite spilling";
+  }
+  BOOST_FOREACH(Partition* partition, hash_partitions_) {
+    DCHECK(!can_add_runtime_filters_ || partition->is_closed() ||
+        !partition->is_spilled()) << "Runtime filters enabled despite spilling";
   }
 
   // Collect all the spilled partitions that don't have an IO buffer. We need to reserve
@@ -1287,9 +1399,192 @@ Status PartitionedHashJoinNode::BuildHashTables(RuntimeState* state) {
   for (int i = 0; i < PARTITION_FANOUT; ++i) {
     hash_tbls_[i] = hash_partitions_[i]->hash_tbl();
   }
+  UpdatePrefetchProbeBuckets();
+  return Status::OK();
+}
+
+Status PartitionedHashJoinNode::SpillPartitionsToFitHashTables(
+    vector<Partition*>* partitions) {
+  int64_t available_mem = mem_tracker()->SpareCapacity();
+  int64_t needed_mem = 0;
+  BOOST_FOREACH(Partition* partition, *partitions) {
+    needed_mem += HashTable::EstimateSize(partition->build_rows()->num_rows(),
+        ht_ctx_->inline_key_words());
+  }
+  if (needed_mem <= available_mem) return Status::OK();
+
+  // Spilling the largest partitions first keeps the most partitions in memory, and frees
+  // their build rows for the hash tables of the others. The large partitions are also
+  // the ones that are the most likely to be skewed and need repartitioning anyway.
+  typedef std::pair<int64_t, Partition*> SizeAndPartition;
+  vector<SizeAndPartition> partitions_by_size;
+  BOOST_FOREACH(Partition* partition, *partitions) {
+    partitions_by_size.push_back(
+        SizeAndPartition(partition->build_rows()->byte_size(), partition));
+  }
+  std::sort(partitions_by_size.begin(), partitions_by_size.end(),
+      std::greater<SizeAndPartition>());
+  partitions->clear();
+  for (int i = 0; i < partitions_by_size.size(); ++i) {
+    Partition* partition = partitions_by_size[i].second;
+    if (needed_mem <= available_mem) {
+      partitions->push_back(partition);
+      continue;
+    }
+    VLOG(2) << "Spilling partition " << partition << " of join=" << id_
+            << " before building its hash table. Estimated memory needed for the hash "
+            << "tables: " << needed_mem << ", available: " << available_mem;
+    needed_mem -= HashTable::EstimateSize(partition->build_rows()->num_rows(),
+        ht_ctx_->inline_key_words());
+    available_mem += partitions_by_size[i].first;
+    RETURN_IF_ERROR(partition->Spill(true));
+  }
   return Status::OK();
 }
 
+Status PartitionedHashJoinNode::BuildHashTablesParallel(RuntimeState* state,
+    const vector<Partition*>& partitions, vector<Partition*>* not_built) {
+  // Start with the largest partitions so that no thread is left with a large one at the
+  // end.
+  typedef std::pair<int64_t, Partition*> SizeAndPartition;
+  vector<SizeAndPartition> partitions_by_size;
+  BOOST_FOREACH(Partition* partition, partitions) {
+    partitions_by_size.push_back(
+        SizeAndPartition(partition->build_rows()->num_rows(), partition));
+  }
+  std::sort(partitions_by_size.begin(), partitions_by_size.end(),
+      std::greater<SizeAndPartition>());
+  vector<Partition*> sorted_partitions;
+  for (int i = 0; i < partitions_by_size.size(); ++i) {
+    sorted_partitions.push_back(partitions_by_size[i].second);
+  }
+
+  int max_threads = std::min<int>(FLAGS_hash_join_build_threads, partitions.size());
+  boost::ptr_vector<BuildThread> threads;
+  Status status;
+  for (int i = 1; i < max_threads; ++i) {
+    if (!state->resource_pool()->TryAcquireThreadToken()) break;
+    BuildThread* thread = new BuildThread();
+    bool allocated = false;
+    status = PrepareBuildThread(state, thread, &allocated);
+    if (!status.ok() || !allocated) {
+      CloseBuildThread(state, thread);
+      delete thread;
+      state->resource_pool()->ReleaseThreadToken(false);
+      break;
+    }
+    threads.push_back(thread);
+  }
+
+  vector<uint8_t> built(partitions.size(), 0);
+  if (status.ok()) {
+    if (!threads.empty()) {
+      AddRuntimeExecOption(Substitute("Hash Tables Built With $0 Threads",
+          threads.size() + 1));
+    }
+    AtomicInt<int> next_partition(0);
+    ThreadGroup build_threads;
+    if (!state->cgroup().empty()) {
+      build_threads.SetCgroupsMgr(state->exec_env()->cgroups_mgr());
+      build_threads.SetCgroup(state->cgroup());
+    }
+    for (int i = 0; i < threads.size(); ++i) {
+      BuildThread* thread = &threads[i];
+      build_threads.AddThread(new Thread(node_name_, Substitute("build thread $0", i),
+          bind(&PartitionedHashJoinNode::BuildHashTablesThread, this, state, thread,
+              &sorted_partitions, &next_partition, &built, &thread->status)));
+    }
+    BuildHashTablesThread(state, NULL, &sorted_partitions, &next_partition, &built,
+        &status);
+    build_threads.JoinAll();
+  }
+
+  BOOST_FOREACH(BuildThread& thread, threads) {
+    if (status.ok()) status = thread.status;
+    // Merge the thread's runtime filters into the node's.
+    for (int i = 0; i < thread.filters.size(); ++i) {
+      if (filters_[i].local_bloom_filter == NULL) continue;
+      filters_[i].local_bloom_filter->Or(*thread.filters[i].local_bloom_filter);
+      if (filters_[i].local_min_max_filter != NULL) {
+        filters_[i].local_min_max_filter->Or(*thread.filters[i].local_min_max_filter);
+      }
+    }
+    CloseBuildThread(state, &thread);
+  }
+  RETURN_IF_ERROR(status);
+
+  for (int i = 0; i < sorted_partitions.size(); ++i) {
+    if (!built[i]) not_built->push_back(sorted_partitions[i]);
+  }
+  return Status::OK();
+}
+
+Status PartitionedHashJoinNode::PrepareBuildThread(RuntimeState* state,
+    BuildThread* thread, bool* allocated) {
+  *allocated = false;
+  RETURN_IF_ERROR(Expr::CloneIfNotExists(build_expr_ctxs_, state,
+      &thread->build_expr_ctxs));
+  thread->ht_ctx.reset(new HashTableCtx(thread->build_expr_ctxs, probe_expr_ctxs_,
+      ht_ctx_->stores_nulls(), is_not_distinct_from_, state->fragment_hash_seed(),
+      MAX_PARTITION_DEPTH, child(1)->row_desc().tuple_descriptors().size()));
+  thread->ht_ctx->set_level(ht_ctx_->level());
+  if (can_add_runtime_filters_) {
+    thread->filters.resize(filters_.size());
+    for (int i = 0; i < filters_.size(); ++i) {
+      RETURN_IF_ERROR(thread->filters[i].CloneFrom(filters_[i], state));
+      if (filters_[i].local_bloom_filter == NULL) continue;
+      // The thread's rows must be in the node's filters, so without a filter of its own
+      // the thread can't be used.
+      thread->filters[i].local_bloom_filter =
+          state->filter_bank()->AllocateScratchBloomFilter();
+      if (thread->filters[i].local_bloom_filter == NULL) return Status::OK();
+      if (filters_[i].local_min_max_filter != NULL) {
+        thread->filters[i].local_min_max_filter =
+            state->filter_bank()->AllocateScratchMinMaxFilter();
+        if (thread->filters[i].local_min_max_filter == NULL) return Status::OK();
+      }
+    }
+  }
+  *allocated = true;
+  return Status::OK();
+}
+
+void PartitionedHashJoinNode::CloseBuildThread(RuntimeState* state,
+    BuildThread* thread) {
+  if (thread->ht_ctx.get() != NULL) thread->ht_ctx->Close();
+  Expr::Close(thread->build_expr_ctxs, state);
+  BOOST_FOREACH(const FilterContext& ctx, thread->filters) {
+    if (ctx.expr != NULL) ctx.expr->Close(state);
+  }
+}
+
+void PartitionedHashJoinNode::BuildHashTablesThread(RuntimeState* state,
+    BuildThread* thread, const vector<Partition*>* partitions,
+    AtomicInt<int>* next_partition, vector<uint8_t>* built, Status* status) {
+  while (true) {
+    int idx = next_partition->FetchAndUpdate(1);
+    if (idx >= partitions->size()) break;
+    bool partition_built = false;
+    *status = (*partitions)[idx]->BuildHashTable(state, &partition_built,
+        can_add_runtime_filters_, thread);
+    if (!status->ok()) break;
+    (*built)[idx] = partition_built;
+  }
+  // Release the thread token as soon as possible, as in BlockingJoinNode.
+  if (thread != NULL) state->resource_pool()->ReleaseThreadToken(false);
+}
+
+void PartitionedHashJoinNode::UpdatePrefetchProbeBuckets() {
+  int64_t hash_tbls_bytes = 0;
+  for (int i = 0; i < PARTITION_FANOUT; ++i) {
+    if (hash_tbls_[i] == NULL) continue;
+    // All entries are the same table if the probe is not partitioned.
+    if (i > 0 && hash_tbls_[i] == hash_tbls_[i - 1]) continue;
+    hash_tbls_bytes += hash_tbls_[i]->ByteSize();
+  }
+  prefetch_probe_buckets_ = HashTable::UseBatchPrefetch(hash_tbls_bytes);
+}
+
 Status PartitionedHashJoinNode::EvaluateNullProbe(BufferedTupleStream* build) {
   if (null_probe_rows_ == NULL || null_probe_rows_->num_rows() == 0) {
     return Status::OK();
@@ -1617,11 +1912,14 @@ Status PartitionedHashJoinNode::CodegenProcessBuildBatch(
         "function failed verification, see log");
   }
 
-  // Register native function pointers
+  // Register native function pointers. FinalizeModule() sets the level 0 function
+  // before process_build_batch_fn_, which ProcessBuildInput() checks.
   codegen->AddFunctionToJit(process_build_batch_fn,
-                            reinterpret_cast<void**>(&process_build_batch_fn_));
+      reinterpret_cast<void**>(&process_build_batch_fn_),
+      /* has_interpreted_fallback */ true);
   codegen->AddFunctionToJit(process_build_batch_fn_level0,
-                            reinterpret_cast<void**>(&process_build_batch_fn_level0_));
+      reinterpret_cast<void**>(&process_build_batch_fn_level0_),
+      /* has_interpreted_fallback */ true);
   return Status::OK();
 }
 
@@ -1714,7 +2012,9 @@ Status PartitionedHashJoinNode::CodegenProcessProbeBatch(
   int replaced = 0;
   process_probe_batch_fn = codegen->ReplaceCallSites(process_probe_batch_fn, true,
       eval_row_fn, "EvalProbeRow", &replaced);
-  DCHECK_EQ(replaced, 1);
+  // One call in each of the two hashing paths and one to restore the expr values of
+  // rows hashed by the first pass.
+  DCHECK_EQ(replaced, 3);
 
   process_probe_batch_fn = codegen->ReplaceCallSites(process_probe_batch_fn, true,
       create_output_row_fn, "CreateOutputRow", &replaced);
@@ -1747,11 +2047,11 @@ Status PartitionedHashJoinNode::CodegenProcessProbeBatch(
   // process_probe_batch_fn uses murmur
   Function* process_probe_batch_fn_level0 = codegen->ReplaceCallSites(
       process_probe_batch_fn, false, hash_fn, "HashCurrentRow", &replaced);
-  DCHECK_EQ(replaced, 1);
+  DCHECK_EQ(replaced, 2);
 
   process_probe_batch_fn = codegen->ReplaceCallSites(
       process_probe_batch_fn, true, murmur_hash_fn, "HashCurrentRow", &replaced);
-  DCHECK_EQ(replaced, 1);
+  DCHECK_EQ(replaced, 2);
 
   // Finalize ProcessProbeBatch functions
   process_probe_batch_fn = codegen->OptimizeFunctionWithExprs(process_probe_batch_fn);
@@ -1766,10 +2066,13 @@ Status PartitionedHashJoinNode::CodegenProcessProbeBatch(
         "level-zero ProcessProbeBatch() function failed verification, see log");
   }
 
-  // Register native function pointers
+  // Register native function pointers. FinalizeModule() sets the level 0 function
+  // before process_probe_batch_fn_, which GetNext() checks.
   codegen->AddFunctionToJit(process_probe_batch_fn,
-                            reinterpret_cast<void**>(&process_probe_batch_fn_));
+      reinterpret_cast<void**>(&process_probe_batch_fn_),
+      /* has_interpreted_fallback */ true);
   codegen->AddFunctionToJit(process_probe_batch_fn_level0,
-                            reinterpret_cast<void**>(&process_probe_batch_fn_level0_));
+      reinterpret_cast<void**>(&process_probe_batch_fn_level0_),
+      /* has_interpreted_fallback */ true);
   return Status::OK();
 }
@@ -16,6 +16,7 @@
 #ifndef IMPALA_EXEC_PARTITIONED_HASH_JOIN_NODE_H
 #define IMPALA_EXEC_PARTITIONED_HASH_JOIN_NODE_H
 
+#include <boost/ptr_container/ptr_vector.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/unordered_set.hpp>
 #include <boost/thread.hpp>
@@ -24,6 +25,7 @@
 #include "exec/blocking-join-node.h"
 #include "exec/exec-node.h"
 #include "exec/filter-context.h"
+#include "common/atomic.h"
 #include "exec/hash-table.h"
 #include "runtime/buffered-block-mgr.h"
 
@@ -54,9 +56,17 @@ class BufferedTupleStream;
 /// TODO: don't copy tuple rows so often.
 /// TODO: we need multiple hash functions. Each repartition needs new hash functions
 /// or new bits. Multiplicative hashing?
-/// TODO: think about details about multithreading. Multiple partitions in parallel?
-/// Multiple threads against a single partition? How to build hash tables in parallel?
+/// The hash tables of the in-memory partitions are built in parallel by up to
+/// --hash_join_build_threads threads (see BuildHashTablesParallel()).
+/// TODO: think about details about multithreading. Multiple threads against a single
+/// partition? Partition the build input in parallel?
 /// TODO: BuildHashTables() should start with the partitions that are already pinned.
+/// TODO: share the build side of broadcast joins between the instances of a fragment
+/// on the same impalad, building the hash tables once and probing them read-only from
+/// each instance. The scheduler currently runs at most one instance of a fragment per
+/// host, so there is nothing to share yet. Sharing also needs the build to be owned by
+/// the query rather than the node, never spill (probing must not repartition) and keep
+/// the matched bits of right outer/semi/anti joins per instance.
 class PartitionedHashJoinNode : public BlockingJoinNode {
  public:
   PartitionedHashJoinNode(ObjectPool* pool, const TPlanNode& tnode,
@@ -69,6 +79,8 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
   virtual Status GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos);
   virtual Status Reset(RuntimeState* state);
   virtual void Close(RuntimeState* state);
+  virtual void GetBufferRequirements(int64_t buffer_size, int* min_buffers,
+      int* desired_buffers) const;
 
  protected:
   virtual void AddToDebugString(int indentation_level, std::stringstream* out) const;
@@ -136,6 +148,10 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
   /// TODO: we can revisit and try harder to explicitly detect skew.
   static const int MAX_PARTITION_DEPTH = 16;
 
+  /// Minimum total number of rows of the partitions to build for the build to use more
+  /// than one thread. Below this, starting the threads costs more than it saves.
+  static const int64_t MIN_ROWS_FOR_PARALLEL_BUILD = 64 * 1024;
+
   /// Append the row to stream. In the common case, the row is just in memory and the
   /// append succeeds. If the append fails, we fallback to the slower path of
   /// AppendRowStreamFull().
@@ -172,6 +188,51 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
   /// structures.
   Status BuildHashTables(RuntimeState* state);
 
+  /// Spills the largest of 'partitions', which must all be in memory, until the
+  /// estimated size of the hash tables of the others fits in the spare memory. This
+  /// avoids building hash tables that fail part way for lack of memory, and keeps as
+  /// many partitions in memory as possible. Removes the spilled partitions from
+  /// 'partitions'.
+  Status SpillPartitionsToFitHashTables(std::vector<Partition*>* partitions);
+
+  /// The state of one additional thread of a parallel hash table build. Expr contexts are
+  /// not thread-safe, so each additional thread evaluates its own clones of the build and
+  /// filter exprs and adds the build rows to its own runtime filters, which are merged
+  /// into filters_ once the build is done.
+  struct BuildThread {
+    std::vector<ExprContext*> build_expr_ctxs;
+    boost::scoped_ptr<HashTableCtx> ht_ctx;
+
+    /// Clones of filters_ with thread-local filters. Empty if no filters are built.
+    std::vector<FilterContext> filters;
+
+    /// The first error hit by the thread.
+    Status status;
+  };
+
+  /// Builds the hash tables of 'partitions', none of which may be spilled, on this thread
+  /// and as many additional threads as allowed by --hash_join_build_threads and the
+  /// available thread tokens. Adds the partitions whose hash tables did not fit in
+  /// memory to 'not_built'. Spilling them is left to the caller.
+  Status BuildHashTablesParallel(RuntimeState* state,
+      const std::vector<Partition*>& partitions, std::vector<Partition*>* not_built);
+
+  /// Clones the exprs and allocates the runtime filters for 'thread'. Sets '*allocated'
+  /// to false if the filters could not be allocated, in which case the thread must not
+  /// be used. 'thread' must be closed with CloseBuildThread() either way.
+  Status PrepareBuildThread(RuntimeState* state, BuildThread* thread, bool* allocated);
+
+  /// Releases the exprs and the hash table context of 'thread'.
+  void CloseBuildThread(RuntimeState* state, BuildThread* thread);
+
+  /// Body of each thread of BuildHashTablesParallel(). Builds the hash tables of the
+  /// partitions taken from 'partitions' through 'next_partition' until none are left or
+  /// a build fails, in which case the error is returned in 'status'. 'thread' is NULL for
+  /// the calling thread, which uses the node's own contexts and filters.
+  void BuildHashTablesThread(RuntimeState* state, BuildThread* thread,
+      const std::vector<Partition*>* partitions, AtomicInt<int>* next_partition,
+      std::vector<uint8_t>* built, Status* status);
+
   /// Process probe rows from probe_batch_. Returns either if out_batch is full or
   /// probe_batch_ is entirely consumed.
   /// For RIGHT_ANTI_JOIN, all this function does is to mark whether each build row
@@ -251,6 +312,10 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
   /// Prepares for probing the next batch.
   void ResetForProbe();
 
+  /// Sets prefetch_probe_buckets_ based on the size of the hash tables in hash_tbls_.
+  /// Called whenever hash_tbls_ is populated.
+  void UpdatePrefetchProbeBuckets();
+
   /// For each filter in filters_, allocate a bloom_filter from the fragment-local
   /// RuntimeFilterBank and store it in runtime_filters_ to populate during the build
   /// phase. Returns false if filter construction is disabled.
@@ -319,8 +384,8 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
   BufferedBlockMgr::Client* block_mgr_client_;
 
   /// Used for hash-related functionality, such as evaluating rows and calculating hashes.
-  /// TODO: If we want to multi-thread then this context should be thread-local and not
-  /// associated with the node.
+  /// The additional threads of a parallel hash table build use their own contexts, see
+  /// BuildThread.
   boost::scoped_ptr<HashTableCtx> ht_ctx_;
 
   /// The iterator that corresponds to the look up of current_probe_row_.
@@ -386,6 +451,16 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
   ///  hash_tbls_[i] = input_partition_->hash_tbl();
   HashTable* hash_tbls_[PARTITION_FANOUT];
 
+  /// If true, ProcessProbeBatch() hashes a new probe batch in a first pass and prefetches
+  /// the hash table bucket of each row, before probing the rows in a second pass. Set if
+  /// the hash tables are too large to stay in the CPU caches, in which case bucket cache
+  /// misses dominate the probe time.
+  bool prefetch_probe_buckets_;
+
+  /// True if the rows of probe_batch_ were hashed in the first pass and their hashes are
+  /// in ht_ctx_ (see HashTableCtx::EvalAndHashBatch()).
+  bool probe_batch_hashed_;
+
   /// The current input partition to be processed (not in spilled_partitions_).
   /// This partition can either serve as the source for a repartitioning step, or
   /// if the hash table fits in memory, the source of the probe rows.
@@ -458,18 +533,27 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
     /// If the partition could not be built due to memory pressure, *built is set to false
     /// and the caller is responsible for spilling this partition.
     /// If 'BUILD_RUNTIME_FILTERS' is set, populates runtime filters.
+    /// If 'thread' is non-NULL, its contexts and filters are used instead of the
+    /// node's, so that several partitions can be built concurrently.
     template<bool const BUILD_RUNTIME_FILTERS>
-    Status BuildHashTableInternal(RuntimeState* state, bool* built);
+    Status BuildHashTableInternal(RuntimeState* state, BuildThread* thread, bool* built);
 
     /// Wrapper for the template-based BuildHashTable() based on 'add_runtime_filters'.
     Status BuildHashTable(RuntimeState* state, bool* built,
-        const bool add_runtime_filters);
+        const bool add_runtime_filters, BuildThread* thread = NULL);
 
     /// Spills this partition, cleaning up and unpinning blocks.
     /// If 'unpin_all_build' is true, the build stream is completely unpinned, otherwise,
     /// it is unpinned with one buffer remaining.
     Status Spill(bool unpin_all_build);
 
+    /// Adds a build row with 'hash' to the summary of the most frequent hashes.
+    void UpdateHotKeys(uint32_t hash);
+
+    /// Returns a lower bound for the number of build rows that have the most frequent
+    /// hash of this partition.
+    int64_t MaxHotKeyRows() const;
+
    private:
     friend class PartitionedHashJoinNode;
 
@@ -497,6 +581,14 @@ class PartitionedHashJoinNode : public BlockingJoinNode {
     /// If NULL, ownership has been transfered.
     BufferedTupleStream* build_rows_;
     BufferedTupleStream* probe_rows_;
+
+    /// Misra-Gries summary of the hashes of the build rows added to this partition. Each
+    /// count is a lower bound of the number of rows with that hash, and any hash of more
+    /// than 1 / (NUM_HOT_KEYS + 1) of the rows is present. The rows of a key always have
+    /// the same hash, so a large count means that repartitioning can't split the rows.
+    static const int NUM_HOT_KEYS = 4;
+    uint32_t hot_key_hashes_[NUM_HOT_KEYS];
+    int64_t hot_key_counts_[NUM_HOT_KEYS];
   };
 
   /// llvm function and signature for codegening build batch.
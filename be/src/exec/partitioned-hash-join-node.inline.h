@@ -28,6 +28,26 @@ inline void PartitionedHashJoinNode::ResetForProbe() {
   hash_tbl_iterator_.SetAtEnd();
 }
 
+inline void PartitionedHashJoinNode::Partition::UpdateHotKeys(uint32_t hash) {
+  int free_idx = -1;
+  for (int i = 0; i < NUM_HOT_KEYS; ++i) {
+    if (hot_key_counts_[i] == 0) {
+      free_idx = i;
+    } else if (hot_key_hashes_[i] == hash) {
+      ++hot_key_counts_[i];
+      return;
+    }
+  }
+  if (free_idx != -1) {
+    hot_key_hashes_[free_idx] = hash;
+    hot_key_counts_[free_idx] = 1;
+    return;
+  }
+  // No counter for 'hash' and none free: this row and one row of each tracked hash
+  // cancel out.
+  for (int i = 0; i < NUM_HOT_KEYS; ++i) --hot_key_counts_[i];
+}
+
 inline bool PartitionedHashJoinNode::AppendRow(BufferedTupleStream* stream,
     TupleRow* row, Status* status) {
   if (LIKELY(stream->AddRow(row, status))) return true;
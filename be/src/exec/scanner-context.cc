@@ -293,6 +293,40 @@ Status ScannerContext::Stream::GetBytesInternal(int64_t requested_len,
   return Status::OK();
 }
 
+Status ScannerContext::Stream::SkipBytesInternal(int64_t length) {
+  DCHECK_GT(length, *output_buffer_bytes_left_);
+  int64_t bytes_left = length;
+  // The bytes in the boundary buffer come before those in the current io buffer.
+  if (boundary_buffer_bytes_left_ > 0) {
+    DCHECK_EQ(output_buffer_pos_, &boundary_buffer_pos_);
+    bytes_left -= boundary_buffer_bytes_left_;
+    total_bytes_returned_ += boundary_buffer_bytes_left_;
+    boundary_buffer_pos_ += boundary_buffer_bytes_left_;
+    boundary_buffer_bytes_left_ = 0;
+  }
+  output_buffer_pos_ = &io_buffer_pos_;
+  output_buffer_bytes_left_ = &io_buffer_bytes_left_;
+
+  while (bytes_left > io_buffer_bytes_left_) {
+    bytes_left -= io_buffer_bytes_left_;
+    total_bytes_returned_ += io_buffer_bytes_left_;
+    io_buffer_pos_ += io_buffer_bytes_left_;
+    io_buffer_bytes_left_ = 0;
+
+    // Past the end of the scan range, read the rest of the skipped bytes at once.
+    RETURN_IF_ERROR(GetNextBuffer(bytes_left));
+    if (parent_->cancelled()) return Status::CANCELLED;
+    if (io_buffer_bytes_left_ == 0) {
+      // No more bytes (i.e. EOF)
+      return ReportIncompleteRead(length, length - bytes_left);
+    }
+  }
+  io_buffer_pos_ += bytes_left;
+  io_buffer_bytes_left_ -= bytes_left;
+  total_bytes_returned_ += bytes_left;
+  return Status::OK();
+}
+
 bool ScannerContext::cancelled() const {
   return scan_node_->done_;
 }
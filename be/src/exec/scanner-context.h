@@ -221,6 +221,10 @@ class ScannerContext {
     Status GetBytesInternal(int64_t requested_len, uint8_t** buffer, bool peek,
                             int64_t* out_len);
 
+    /// SkipBytes helper to handle the slow path. Unlike GetBytesInternal(), the skipped
+    /// bytes are not copied into the boundary buffer, the io buffers are just consumed.
+    Status SkipBytesInternal(int64_t length);
+
     /// Gets (and blocks) for the next io buffer. After fetching all buffers in the scan
     /// range, performs synchronous reads past the scan range until EOF.
     //
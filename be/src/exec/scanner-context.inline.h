@@ -65,18 +65,19 @@ inline bool ScannerContext::Stream::ReadBytes(int64_t length, uint8_t** buf,
   return true;
 }
 
-/// TODO: consider implementing a Skip in the context/stream object that's more
-/// efficient than GetBytes.
 inline bool ScannerContext::Stream::SkipBytes(int64_t length, Status* status) {
-  uint8_t* dummy_buf;
-  int64_t bytes_read;
-  RETURN_IF_FALSE(GetBytes(length, &dummy_buf, &bytes_read, status));
-  if (UNLIKELY(length != bytes_read)) {
-    DCHECK_LT(bytes_read, length);
-    *status = ReportIncompleteRead(length, bytes_read);
+  if (UNLIKELY(length < 0)) {
+    *status = ReportInvalidRead(length);
     return false;
   }
-  return true;
+  if (LIKELY(length <= *output_buffer_bytes_left_)) {
+    total_bytes_returned_ += length;
+    *output_buffer_pos_ += length;
+    *output_buffer_bytes_left_ -= length;
+    return true;
+  }
+  *status = SkipBytesInternal(length);
+  return status->ok();
 }
 
 inline bool ScannerContext::Stream::SkipText(Status* status) {
@@ -39,6 +39,7 @@ Status SelectNode::Prepare(RuntimeState* state) {
 
 Status SelectNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   RETURN_IF_ERROR(ExecNode::Open(state));
   RETURN_IF_ERROR(child(0)->Open(state));
   child_row_batch_.reset(
@@ -48,9 +49,11 @@ Status SelectNode::Open(RuntimeState* state) {
 
 Status SelectNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
 
-  if (ReachedLimit() || (child_row_idx_ == child_row_batch_->num_rows() && child_eos_)) {
+  if (ReachedLimit() ||
+      (child_row_idx_ == child_row_batch_->num_selected_rows() && child_eos_)) {
     // we're already done or we exhausted the last child batch and there won't be any
     // new ones
     *eos = true;
@@ -63,18 +66,23 @@ Status SelectNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos)
   while (true) {
     RETURN_IF_CANCELLED(state);
     RETURN_IF_ERROR(QueryMaintenance(state));
-    if (child_row_idx_ == child_row_batch_->num_rows()) {
+    if (child_row_idx_ == child_row_batch_->num_selected_rows()) {
       child_row_idx_ = 0;
       // fetch next batch
       child_row_batch_->TransferResourceOwnership(row_batch);
       child_row_batch_->Reset();
       if (row_batch->AtCapacity()) return Status::OK();
       RETURN_IF_ERROR(child(0)->GetNext(state, child_row_batch_.get(), &child_eos_));
+      // Filter the whole batch up front, one conjunct at a time. CopyRows() then only
+      // visits the rows that passed.
+      if (!child_row_batch_->has_selection()) child_row_batch_->SelectAllRows();
+      EvalConjunctsOnSelection(&conjunct_ctxs_[0], conjunct_ctxs_.size(),
+          child_row_batch_.get());
     }
 
     if (CopyRows(row_batch)) {
       *eos = ReachedLimit()
-          || (child_row_idx_ == child_row_batch_->num_rows() && child_eos_);
+          || (child_row_idx_ == child_row_batch_->num_selected_rows() && child_eos_);
       if (*eos) child_row_batch_->TransferResourceOwnership(row_batch);
       return Status::OK();
     }
@@ -89,24 +97,20 @@ Status SelectNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos)
 }
 
 bool SelectNode::CopyRows(RowBatch* output_batch) {
-  ExprContext** conjunct_ctxs = &conjunct_ctxs_[0];
-  int num_conjunct_ctxs = conjunct_ctxs_.size();
-
-  while (child_row_idx_ < child_row_batch_->num_rows()) {
+  while (child_row_idx_ < child_row_batch_->num_selected_rows()) {
     // Add a new row to output_batch
     int dst_row_idx = output_batch->AddRow();
     TupleRow* dst_row = output_batch->GetRow(dst_row_idx);
-    TupleRow* src_row = child_row_batch_->GetRow(child_row_idx_);
+    TupleRow* src_row =
+        child_row_batch_->GetRow(child_row_batch_->selected_row_idx(child_row_idx_));
     // Make sure to increment row idx before returning.
     ++child_row_idx_;
 
-    if (EvalConjuncts(conjunct_ctxs, num_conjunct_ctxs, src_row)) {
-      output_batch->CopyRow(src_row, dst_row);
-      output_batch->CommitLastRow();
-      ++num_rows_returned_;
-      COUNTER_SET(rows_returned_counter_, num_rows_returned_);
-      if (ReachedLimit() || output_batch->AtCapacity()) return true;
-    }
+    output_batch->CopyRow(src_row, dst_row);
+    output_batch->CommitLastRow();
+    ++num_rows_returned_;
+    COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+    if (ReachedLimit() || output_batch->AtCapacity()) return true;
   }
   return output_batch->AtCapacity();
 }
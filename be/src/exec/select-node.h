@@ -46,7 +46,7 @@ class SelectNode : public ExecNode {
   /// current row batch of child
   boost::scoped_ptr<RowBatch> child_row_batch_;
 
-  /// index of current row in child_row_batch_
+  /// index into the selection of child_row_batch_ of the next row to return
   int child_row_idx_;
 
   /// true if last GetNext() call on child signalled eos
@@ -55,8 +55,8 @@ class SelectNode : public ExecNode {
   /// END: Members that must be Reset()
   /////////////////////////////////////////
 
-  /// Copy rows from child_row_batch_ for which conjuncts_ evaluate to true to
-  /// output_batch, up to limit_.
+  /// Copy the selected rows of child_row_batch_, i.e. the ones for which conjuncts_
+  /// evaluated to true, to output_batch, up to limit_.
   /// Return true if limit was hit or output_batch should be returned, otherwise false.
   bool CopyRows(RowBatch* output_batch);
 };
@@ -13,20 +13,40 @@
 // limitations under the License.
 
 #include "exec/sort-node.h"
+
+#include <gflags/gflags.h>
+
 #include "exec/sort-exec-exprs.h"
+#include "runtime/mem-pool.h"
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 #include "runtime/sorted-run-merger.h"
+#include "runtime/tuple.h"
 
 #include "common/names.h"
 
+DEFINE_int32(sort_presort_window_rows, 0, "(Advanced) If > 0, sort nodes pass their "
+    "input through a window of this many rows that reorders nearly sorted input, so "
+    "that it can be sorted in near-linear time. The window is disabled as soon as the "
+    "input turns out not to be sorted within it.");
+
 namespace impala {
 
+/// The presort window pool is compacted once it grew by this many bytes since the last
+/// compaction.
+static const int64_t WINDOW_POOL_COMPACTION_BYTES = 8 * 1024 * 1024;
+
 SortNode::SortNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs)
   : ExecNode(pool, tnode, descs),
     offset_(tnode.sort_node.__isset.offset ? tnode.sort_node.offset : 0),
+    sort_tuple_desc_(NULL),
+    presort_window_disabled_counter_(NULL),
     sorter_(NULL),
-    num_rows_skipped_(0) {
+    num_rows_skipped_(0),
+    use_presort_window_(false),
+    window_pool_live_bytes_(0),
+    last_emitted_(NULL),
+    num_window_rows_(0) {
 }
 
 SortNode::~SortNode() {
@@ -46,25 +66,39 @@ Status SortNode::Prepare(RuntimeState* state) {
   RETURN_IF_ERROR(sort_exec_exprs_.Prepare(
       state, child(0)->row_desc(), row_descriptor_, expr_mem_tracker()));
   AddExprCtxsToFree(sort_exec_exprs_);
-  TupleRowComparator less_than(sort_exec_exprs_, is_asc_order_, nulls_first_);
+  less_than_.reset(new TupleRowComparator(sort_exec_exprs_, is_asc_order_,
+      nulls_first_));
 
   bool codegen_enabled = false;
   Status codegen_status;
   if (state->codegen_enabled()) {
-    codegen_status = less_than.Codegen(state);
+    codegen_status = less_than_->Codegen(state);
     codegen_enabled = codegen_status.ok();
   }
   AddCodegenExecOption(codegen_enabled, codegen_status);
 
   sorter_.reset(new Sorter(
-      less_than, sort_exec_exprs_.sort_tuple_slot_expr_ctxs(),
+      *less_than_, sort_exec_exprs_.sort_tuple_slot_expr_ctxs(),
       &row_descriptor_, mem_tracker(), runtime_profile(), state));
   RETURN_IF_ERROR(sorter_->Init());
+
+  sort_tuple_desc_ = row_descriptor_.tuple_descriptors()[0];
+  use_presort_window_ = FLAGS_sort_presort_window_rows > 0;
+  if (use_presort_window_) {
+    window_.reset(new priority_queue<Tuple*, vector<Tuple*>, TupleGreater>(
+        TupleGreater(less_than_.get())));
+    window_pool_.reset(new MemPool(mem_tracker()));
+    emitted_batch_.reset(
+        new RowBatch(row_descriptor_, state->batch_size(), mem_tracker()));
+    presort_window_disabled_counter_ =
+        ADD_COUNTER(runtime_profile(), "PresortWindowDisabledAfterRows", TUnit::UNIT);
+  }
   return Status::OK();
 }
 
 Status SortNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   RETURN_IF_ERROR(ExecNode::Open(state));
   RETURN_IF_ERROR(sort_exec_exprs_.Open(state));
   RETURN_IF_CANCELLED(state);
@@ -83,6 +117,7 @@ Status SortNode::Open(RuntimeState* state) {
 
 Status SortNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
@@ -124,13 +159,31 @@ Status SortNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
 Status SortNode::Reset(RuntimeState* state) {
   num_rows_skipped_ = 0;
   if (sorter_.get() != NULL) sorter_->Reset();
+  if (window_.get() != NULL) {
+    while (!window_->empty()) window_->pop();
+    emitted_batch_->Reset();
+    window_pool_->FreeAll();
+    window_pool_live_bytes_ = 0;
+    last_emitted_ = NULL;
+    num_window_rows_ = 0;
+    use_presort_window_ = true;
+  }
   return ExecNode::Reset(state);
 }
 
+void SortNode::GetBufferRequirements(int64_t buffer_size, int* min_buffers,
+    int* desired_buffers) const {
+  *min_buffers = sorter_.get() == NULL ? 0 : sorter_->MinRequiredBuffers();
+  *desired_buffers = EstimatedBuffers(buffer_size, *min_buffers);
+}
+
 void SortNode::Close(RuntimeState* state) {
   if (is_closed()) return;
   sort_exec_exprs_.Close(state);
   sorter_.reset();
+  window_.reset();
+  emitted_batch_.reset();
+  if (window_pool_.get() != NULL) window_pool_->FreeAll();
   ExecNode::Close(state);
 }
 
@@ -153,12 +206,104 @@ Status SortNode::SortInput(RuntimeState* state) {
   do {
     batch.Reset();
     RETURN_IF_ERROR(child(0)->GetNext(state, &batch, &eos));
-    RETURN_IF_ERROR(sorter_->AddBatch(&batch));
+    if (use_presort_window_) {
+      RETURN_IF_ERROR(AddBatchToWindow(state, &batch));
+    } else {
+      RETURN_IF_ERROR(sorter_->AddBatch(&batch));
+    }
     RETURN_IF_CANCELLED(state);
     RETURN_IF_ERROR(QueryMaintenance(state));
   } while(!eos);
+  if (use_presort_window_) {
+    RETURN_IF_ERROR(FlushWindow());
+    window_pool_->FreeAll();
+  }
   RETURN_IF_ERROR(sorter_->InputDone());
   return Status::OK();
 }
 
+Status SortNode::AddBatchToWindow(RuntimeState* state, RowBatch* batch) {
+  const vector<ExprContext*>& slot_expr_ctxs =
+      sort_exec_exprs_.sort_tuple_slot_expr_ctxs();
+  for (int i = 0; i < batch->num_rows(); ++i) {
+    Tuple* tuple = Tuple::Create(sort_tuple_desc_->byte_size(), window_pool_.get());
+    tuple->MaterializeExprs<false>(batch->GetRow(i), *sort_tuple_desc_, slot_expr_ctxs,
+        window_pool_.get());
+    if (!use_presort_window_) {
+      // The window was disabled earlier in this batch.
+      RETURN_IF_ERROR(EmitTuple(tuple));
+      continue;
+    }
+    ++num_window_rows_;
+    window_->push(tuple);
+    if (window_->size() <= static_cast<size_t>(FLAGS_sort_presort_window_rows)) {
+      continue;
+    }
+    Tuple* min_tuple = window_->top();
+    if (last_emitted_ != NULL && (*less_than_)(min_tuple, last_emitted_)) {
+      // The input is not sorted within the window, so it would only reorder the input
+      // partially. Leave the ordering of the remaining input to the sorter.
+      COUNTER_SET(presort_window_disabled_counter_, num_window_rows_);
+      RETURN_IF_ERROR(FlushWindow());
+      use_presort_window_ = false;
+      continue;
+    }
+    window_->pop();
+    RETURN_IF_ERROR(EmitTuple(min_tuple));
+    last_emitted_ = min_tuple;
+  }
+  RETURN_IF_ERROR(FlushEmittedTuples());
+  if (!use_presort_window_) {
+    // All tuples were copied by the sorter.
+    window_pool_->FreeAll();
+  } else if (window_pool_->total_allocated_bytes() >
+      window_pool_live_bytes_ + WINDOW_POOL_COMPACTION_BYTES) {
+    CompactWindowPool();
+  }
+  return Status::OK();
+}
+
+Status SortNode::EmitTuple(Tuple* tuple) {
+  int row_idx = emitted_batch_->AddRow();
+  emitted_batch_->GetRow(row_idx)->SetTuple(0, tuple);
+  emitted_batch_->CommitLastRow();
+  if (emitted_batch_->AtCapacity()) RETURN_IF_ERROR(FlushEmittedTuples());
+  return Status::OK();
+}
+
+Status SortNode::FlushEmittedTuples() {
+  if (emitted_batch_->num_rows() == 0) return Status::OK();
+  RETURN_IF_ERROR(sorter_->AddMaterializedBatch(emitted_batch_.get()));
+  emitted_batch_->Reset();
+  return Status::OK();
+}
+
+Status SortNode::FlushWindow() {
+  while (!window_->empty()) {
+    RETURN_IF_ERROR(EmitTuple(window_->top()));
+    window_->pop();
+  }
+  last_emitted_ = NULL;
+  return FlushEmittedTuples();
+}
+
+void SortNode::CompactWindowPool() {
+  DCHECK_EQ(emitted_batch_->num_rows(), 0);
+  scoped_ptr<MemPool> new_pool(new MemPool(mem_tracker()));
+  vector<Tuple*> tuples;
+  tuples.reserve(window_->size());
+  while (!window_->empty()) {
+    tuples.push_back(window_->top()->DeepCopy(*sort_tuple_desc_, new_pool.get()));
+    window_->pop();
+  }
+  // The tuples are in sorted order, so each push is constant time.
+  for (int i = 0; i < tuples.size(); ++i) window_->push(tuples[i]);
+  if (last_emitted_ != NULL) {
+    last_emitted_ = last_emitted_->DeepCopy(*sort_tuple_desc_, new_pool.get());
+  }
+  window_pool_->FreeAll();
+  window_pool_.swap(new_pool);
+  window_pool_live_bytes_ = window_pool_->total_allocated_bytes();
+}
+
 }
@@ -15,6 +15,9 @@
 #ifndef IMPALA_EXEC_SORT_NODE_H
 #define IMPALA_EXEC_SORT_NODE_H
 
+#include <queue>
+#include <boost/scoped_ptr.hpp>
+
 #include "exec/exec-node.h"
 #include "exec/sort-exec-exprs.h"
 #include "runtime/sorter.h"
@@ -31,6 +34,15 @@ namespace impala {
 /// in Open() to fill it with sorted rows.
 /// If a merge phase was performed in the sort, sorted rows are deep copied into
 /// the output batch. Otherwise, the sorter instance owns the sorted data.
+//
+/// For input that is nearly sorted, e.g. clustered by event time, the node can pass its
+/// input through a presort window of --sort_presort_window_rows rows: a min-heap of
+/// materialized tuples from which the smallest one is handed to the sorter whenever the
+/// window is full. If no input row is further than the window size from its sorted
+/// position, the sorter receives its input in order and each run is detected as already
+/// sorted, so the sort is near-linear. As soon as a tuple would leave the window out of
+/// order, the window is flushed and the remaining input goes to the sorter directly,
+/// which then sorts it fully.
 class SortNode : public ExecNode {
  public:
   SortNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs);
@@ -42,6 +54,8 @@ class SortNode : public ExecNode {
   virtual Status GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos);
   virtual Status Reset(RuntimeState* state);
   virtual void Close(RuntimeState* state);
+  virtual void GetBufferRequirements(int64_t buffer_size, int* min_buffers,
+      int* desired_buffers) const;
 
  protected:
   virtual void DebugString(int indentation_level, std::stringstream* out) const;
@@ -50,6 +64,29 @@ class SortNode : public ExecNode {
   /// Fetch input rows and feed them to the sorter until the input is exhausted.
   Status SortInput(RuntimeState* state);
 
+  /// Materializes the rows of 'batch' and passes them through the presort window.
+  Status AddBatchToWindow(RuntimeState* state, RowBatch* batch);
+
+  /// Adds 'tuple' to emitted_batch_, passing the batch to the sorter once it is full.
+  Status EmitTuple(Tuple* tuple);
+
+  /// Passes the tuples in emitted_batch_ to the sorter.
+  Status FlushEmittedTuples();
+
+  /// Emits all tuples of the window in order and passes them to the sorter.
+  Status FlushWindow();
+
+  /// Copies the tuples of the window and last_emitted_ to a new pool, freeing the memory
+  /// of the tuples that already went to the sorter.
+  void CompactWindowPool();
+
+  /// Returns true if lhs sorts after rhs. Orders the presort window as a min-heap.
+  struct TupleGreater {
+    TupleGreater(const TupleRowComparator* less_than) : less_than(less_than) { }
+    bool operator()(Tuple* lhs, Tuple* rhs) const { return (*less_than)(rhs, lhs); }
+    const TupleRowComparator* less_than;
+  };
+
   /// Number of rows to skip.
   int64_t offset_;
 
@@ -58,6 +95,16 @@ class SortNode : public ExecNode {
   std::vector<bool> is_asc_order_;
   std::vector<bool> nulls_first_;
 
+  /// Comparator of the sort tuples, used by the presort window.
+  boost::scoped_ptr<TupleRowComparator> less_than_;
+
+  /// Descriptor of the sort tuples.
+  TupleDescriptor* sort_tuple_desc_;
+
+  /// Number of input rows that had been added when the presort window was disabled
+  /// because the input was not sorted within it.
+  RuntimeProfile::Counter* presort_window_disabled_counter_;
+
   /////////////////////////////////////////
   /// BEGIN: Members that must be Reset()
 
@@ -67,6 +114,27 @@ class SortNode : public ExecNode {
   /// Keeps track of the number of rows skipped for handling offset_.
   int64_t num_rows_skipped_;
 
+  /// True while the input is passed through the presort window.
+  bool use_presort_window_;
+
+  /// The presort window and the pool holding its tuples, the tuples in emitted_batch_
+  /// and last_emitted_.
+  boost::scoped_ptr<std::priority_queue<Tuple*, std::vector<Tuple*>, TupleGreater> >
+      window_;
+  boost::scoped_ptr<MemPool> window_pool_;
+
+  /// Bytes allocated from window_pool_ after the last compaction.
+  int64_t window_pool_live_bytes_;
+
+  /// The tuple that last left the window, NULL if none did yet.
+  Tuple* last_emitted_;
+
+  /// Tuples that left the window and are yet to be added to the sorter.
+  boost::scoped_ptr<RowBatch> emitted_batch_;
+
+  /// Number of input rows added to the window.
+  int64_t num_window_rows_;
+
   /// END: Members that must be Reset()
   /////////////////////////////////////////
 };
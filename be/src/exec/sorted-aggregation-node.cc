@@ -0,0 +1,308 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "exec/sorted-aggregation-node.h"
+
+#include <sstream>
+
+#include "exprs/agg-fn-evaluator.h"
+#include "exprs/expr.h"
+#include "exprs/expr-context.h"
+#include "runtime/descriptors.h"
+#include "runtime/mem-pool.h"
+#include "runtime/raw-value.h"
+#include "runtime/row-batch.h"
+#include "runtime/runtime-state.h"
+#include "runtime/tuple.h"
+#include "runtime/tuple-row.h"
+#include "udf/udf-internal.h"
+#include "util/debug-util.h"
+#include "util/runtime-profile.h"
+
+#include "gen-cpp/PlanNodes_types.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+SortedAggregationNode::SortedAggregationNode(ObjectPool* pool, const TPlanNode& tnode,
+    const DescriptorTbl& descs)
+  : ExecNode(pool, tnode, descs),
+    intermediate_tuple_id_(tnode.agg_node.intermediate_tuple_id),
+    intermediate_tuple_desc_(NULL),
+    output_tuple_id_(tnode.agg_node.output_tuple_id),
+    output_tuple_desc_(NULL),
+    needs_finalize_(tnode.agg_node.need_finalize),
+    current_tuple_(NULL),
+    child_batch_idx_(0),
+    child_eos_(false),
+    num_groups_counter_(NULL) {
+}
+
+Status SortedAggregationNode::Init(const TPlanNode& tnode, RuntimeState* state) {
+  RETURN_IF_ERROR(ExecNode::Init(tnode, state));
+  DCHECK(!tnode.agg_node.grouping_exprs.empty());
+  RETURN_IF_ERROR(
+      Expr::CreateExprTrees(pool_, tnode.agg_node.grouping_exprs, &grouping_expr_ctxs_));
+  for (int i = 0; i < tnode.agg_node.aggregate_functions.size(); ++i) {
+    AggFnEvaluator* evaluator;
+    RETURN_IF_ERROR(AggFnEvaluator::Create(
+        pool_, tnode.agg_node.aggregate_functions[i], &evaluator));
+    aggregate_evaluators_.push_back(evaluator);
+  }
+  return Status::OK();
+}
+
+Status SortedAggregationNode::Prepare(RuntimeState* state) {
+  SCOPED_TIMER(runtime_profile_->total_time_counter());
+  RETURN_IF_ERROR(ExecNode::Prepare(state));
+
+  tuple_pool_.reset(new MemPool(mem_tracker()));
+  agg_fn_pool_.reset(new MemPool(expr_mem_tracker()));
+  num_groups_counter_ = ADD_COUNTER(runtime_profile(), "NumGroups", TUnit::UNIT);
+
+  intermediate_tuple_desc_ =
+      state->desc_tbl().GetTupleDescriptor(intermediate_tuple_id_);
+  output_tuple_desc_ = state->desc_tbl().GetTupleDescriptor(output_tuple_id_);
+  DCHECK_EQ(intermediate_tuple_desc_->slots().size(),
+      output_tuple_desc_->slots().size());
+  RETURN_IF_ERROR(Expr::Prepare(
+      grouping_expr_ctxs_, state, child(0)->row_desc(), expr_mem_tracker()));
+  AddExprCtxsToFree(grouping_expr_ctxs_);
+
+  agg_fn_ctxs_.resize(aggregate_evaluators_.size());
+  int j = grouping_expr_ctxs_.size();
+  for (int i = 0; i < aggregate_evaluators_.size(); ++i, ++j) {
+    SlotDescriptor* intermediate_slot_desc = intermediate_tuple_desc_->slots()[j];
+    SlotDescriptor* output_slot_desc = output_tuple_desc_->slots()[j];
+    RETURN_IF_ERROR(aggregate_evaluators_[i]->Prepare(state, child(0)->row_desc(),
+        intermediate_slot_desc, output_slot_desc, agg_fn_pool_.get(), &agg_fn_ctxs_[i]));
+    state->obj_pool()->Add(agg_fn_ctxs_[i]);
+  }
+  return Status::OK();
+}
+
+Status SortedAggregationNode::Open(RuntimeState* state) {
+  SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
+  RETURN_IF_ERROR(ExecNode::Open(state));
+  RETURN_IF_ERROR(Expr::Open(grouping_expr_ctxs_, state));
+  DCHECK_EQ(aggregate_evaluators_.size(), agg_fn_ctxs_.size());
+  for (int i = 0; i < aggregate_evaluators_.size(); ++i) {
+    RETURN_IF_ERROR(aggregate_evaluators_[i]->Open(state, agg_fn_ctxs_[i]));
+  }
+  RETURN_IF_ERROR(children_[0]->Open(state));
+  if (child_batch_.get() == NULL) {
+    child_batch_.reset(
+        new RowBatch(child(0)->row_desc(), state->batch_size(), mem_tracker()));
+  }
+  return Status::OK();
+}
+
+Status SortedAggregationNode::GetNext(RuntimeState* state, RowBatch* row_batch,
+    bool* eos) {
+  SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
+  RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
+  RETURN_IF_CANCELLED(state);
+  RETURN_IF_ERROR(QueryMaintenance(state));
+
+  while (!row_batch->AtCapacity() && !ReachedLimit()) {
+    if (child_batch_idx_ == child_batch_->num_rows()) {
+      if (child_eos_) {
+        // The last group ends with the input.
+        if (current_tuple_ != NULL) OutputCurrentGroup(row_batch);
+        break;
+      }
+      // The grouping values of 'current_tuple_' were copied, so the rows of the
+      // previous batch and the local allocations of their exprs aren't needed anymore.
+      child_batch_->Reset();
+      child_batch_idx_ = 0;
+      RETURN_IF_CANCELLED(state);
+      for (int i = 0; i < aggregate_evaluators_.size(); ++i) {
+        ExprContext::FreeLocalAllocations(aggregate_evaluators_[i]->input_expr_ctxs());
+      }
+      RETURN_IF_ERROR(ExecNode::QueryMaintenance(state));
+      RETURN_IF_ERROR(child(0)->GetNext(state, child_batch_.get(), &child_eos_));
+      // Check for failures in the aggregate functions.
+      RETURN_IF_ERROR(state->GetQueryStatus());
+      continue;
+    }
+
+    TupleRow* row = child_batch_->GetRow(child_batch_idx_++);
+    if (current_tuple_ != NULL && !IsCurrentGroup(row)) OutputCurrentGroup(row_batch);
+    if (current_tuple_ == NULL) {
+      current_tuple_ = ConstructIntermediateTuple(row);
+      // Check for failures during AggFnEvaluator::Init().
+      RETURN_IF_ERROR(state->GetQueryStatus());
+    }
+    AggFnEvaluator::Add(aggregate_evaluators_, agg_fn_ctxs_, row, current_tuple_);
+  }
+
+  // The returned rows reference the grouping values in 'tuple_pool_'. Hand its memory
+  // to the output batch and move the tuple of the group that is still open.
+  Tuple* open_tuple = current_tuple_;
+  row_batch->tuple_data_pool()->AcquireData(tuple_pool_.get(), false);
+  if (open_tuple != NULL) current_tuple_ = CopyIntermediateTuple(open_tuple);
+
+  *eos = ReachedLimit() ||
+      (child_eos_ && child_batch_idx_ == child_batch_->num_rows() &&
+       current_tuple_ == NULL);
+  COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+  return Status::OK();
+}
+
+Status SortedAggregationNode::Reset(RuntimeState* state) {
+  DiscardCurrentGroup();
+  tuple_pool_->FreeAll();
+  child_batch_->Reset();
+  child_batch_idx_ = 0;
+  child_eos_ = false;
+  return ExecNode::Reset(state);
+}
+
+void SortedAggregationNode::Close(RuntimeState* state) {
+  if (is_closed()) return;
+
+  DiscardCurrentGroup();
+  child_batch_.reset();
+  if (tuple_pool_.get() != NULL) tuple_pool_->FreeAll();
+
+  DCHECK(agg_fn_ctxs_.empty() || aggregate_evaluators_.size() == agg_fn_ctxs_.size());
+  for (int i = 0; i < aggregate_evaluators_.size(); ++i) {
+    aggregate_evaluators_[i]->Close(state);
+    if (!agg_fn_ctxs_.empty()) agg_fn_ctxs_[i]->impl()->Close();
+  }
+  if (agg_fn_pool_.get() != NULL) agg_fn_pool_->FreeAll();
+
+  Expr::Close(grouping_expr_ctxs_, state);
+  ExecNode::Close(state);
+}
+
+void SortedAggregationNode::DiscardCurrentGroup() {
+  if (current_tuple_ == NULL) return;
+  // Serialize/Finalize the unfinished group in order to free any memory allocated by
+  // UDAs. Finalize() requires a dst tuple but we don't need the result.
+  if (needs_finalize_) {
+    Tuple* dummy_dst = Tuple::Create(output_tuple_desc_->byte_size(), tuple_pool_.get());
+    AggFnEvaluator::Finalize(aggregate_evaluators_, agg_fn_ctxs_, current_tuple_,
+        dummy_dst);
+  } else {
+    AggFnEvaluator::Serialize(aggregate_evaluators_, agg_fn_ctxs_, current_tuple_);
+  }
+  current_tuple_ = NULL;
+}
+
+Status SortedAggregationNode::QueryMaintenance(RuntimeState* state) {
+  for (int i = 0; i < aggregate_evaluators_.size(); ++i) {
+    ExprContext::FreeLocalAllocations(aggregate_evaluators_[i]->input_expr_ctxs());
+  }
+  ExprContext::FreeLocalAllocations(agg_fn_ctxs_);
+  return ExecNode::QueryMaintenance(state);
+}
+
+bool SortedAggregationNode::IsCurrentGroup(TupleRow* row) {
+  DCHECK(current_tuple_ != NULL);
+  for (int i = 0; i < grouping_expr_ctxs_.size(); ++i) {
+    SlotDescriptor* slot_desc = intermediate_tuple_desc_->slots()[i];
+    void* val = grouping_expr_ctxs_[i]->GetValue(row);
+    bool slot_is_null = current_tuple_->IsNull(slot_desc->null_indicator_offset());
+    // NULLs are grouped together.
+    if (val == NULL || slot_is_null) {
+      if (val != NULL || !slot_is_null) return false;
+      continue;
+    }
+    void* slot = current_tuple_->GetSlot(slot_desc->tuple_offset());
+    if (!RawValue::Eq(val, slot, slot_desc->type())) return false;
+  }
+  return true;
+}
+
+Tuple* SortedAggregationNode::ConstructIntermediateTuple(TupleRow* row) {
+  Tuple* tuple = Tuple::Create(intermediate_tuple_desc_->byte_size(), tuple_pool_.get());
+  for (int i = 0; i < grouping_expr_ctxs_.size(); ++i) {
+    SlotDescriptor* slot_desc = intermediate_tuple_desc_->slots()[i];
+    void* val = grouping_expr_ctxs_[i]->GetValue(row);
+    if (val == NULL) {
+      tuple->SetNull(slot_desc->null_indicator_offset());
+    } else {
+      RawValue::Write(val, tuple, slot_desc, tuple_pool_.get());
+    }
+  }
+  AggFnEvaluator::Init(aggregate_evaluators_, agg_fn_ctxs_, tuple);
+  return tuple;
+}
+
+Tuple* SortedAggregationNode::CopyIntermediateTuple(Tuple* tuple) {
+  int byte_size = intermediate_tuple_desc_->byte_size();
+  Tuple* copy = Tuple::Create(byte_size, tuple_pool_.get());
+  memcpy(copy, tuple, byte_size);
+  for (int i = 0; i < grouping_expr_ctxs_.size(); ++i) {
+    SlotDescriptor* slot_desc = intermediate_tuple_desc_->slots()[i];
+    if (!slot_desc->type().IsVarLenStringType()) continue;
+    if (tuple->IsNull(slot_desc->null_indicator_offset())) continue;
+    RawValue::Write(tuple->GetSlot(slot_desc->tuple_offset()), copy, slot_desc,
+        tuple_pool_.get());
+  }
+  return copy;
+}
+
+void SortedAggregationNode::OutputCurrentGroup(RowBatch* row_batch) {
+  DCHECK(current_tuple_ != NULL);
+  Tuple* dst = current_tuple_;
+  if (needs_finalize_ && intermediate_tuple_id_ != output_tuple_id_) {
+    dst = Tuple::Create(output_tuple_desc_->byte_size(), row_batch->tuple_data_pool());
+  }
+  if (needs_finalize_) {
+    AggFnEvaluator::Finalize(aggregate_evaluators_, agg_fn_ctxs_, current_tuple_, dst);
+  } else {
+    AggFnEvaluator::Serialize(aggregate_evaluators_, agg_fn_ctxs_, current_tuple_);
+  }
+  // Copy grouping values from the intermediate tuple to dst. The var-len data stays
+  // in 'tuple_pool_', which is handed to 'row_batch' at the end of GetNext().
+  if (dst != current_tuple_) {
+    for (int i = 0; i < grouping_expr_ctxs_.size(); ++i) {
+      SlotDescriptor* src_slot_desc = intermediate_tuple_desc_->slots()[i];
+      SlotDescriptor* dst_slot_desc = output_tuple_desc_->slots()[i];
+      void* src_slot = NULL;
+      if (!current_tuple_->IsNull(src_slot_desc->null_indicator_offset())) {
+        src_slot = current_tuple_->GetSlot(src_slot_desc->tuple_offset());
+      }
+      RawValue::Write(src_slot, dst, dst_slot_desc, NULL);
+    }
+  }
+  current_tuple_ = NULL;
+  COUNTER_ADD(num_groups_counter_, 1);
+
+  int row_idx = row_batch->AddRow();
+  TupleRow* row = row_batch->GetRow(row_idx);
+  row->SetTuple(0, dst);
+  if (ExecNode::EvalConjuncts(&conjunct_ctxs_[0], conjunct_ctxs_.size(), row)) {
+    VLOG_ROW << "output row: " << PrintRow(row, row_desc());
+    row_batch->CommitLastRow();
+    ++num_rows_returned_;
+  }
+}
+
+void SortedAggregationNode::DebugString(int indentation_level, stringstream* out) const {
+  *out << string(indentation_level * 2, ' ');
+  *out << "SortedAggregationNode("
+       << "intermediate_tuple_id=" << intermediate_tuple_id_
+       << " output_tuple_id=" << output_tuple_id_
+       << " needs_finalize=" << needs_finalize_
+       << " grouping_exprs=" << Expr::DebugString(grouping_expr_ctxs_)
+       << " agg_exprs=" << AggFnEvaluator::DebugString(aggregate_evaluators_);
+  ExecNode::DebugString(indentation_level, out);
+  *out << ")";
+}
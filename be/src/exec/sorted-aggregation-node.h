@@ -0,0 +1,125 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_EXEC_SORTED_AGGREGATION_NODE_H
+#define IMPALA_EXEC_SORTED_AGGREGATION_NODE_H
+
+#include <boost/scoped_ptr.hpp>
+
+#include "exec/exec-node.h"
+#include "runtime/descriptors.h"  // for TupleId
+
+namespace impala {
+
+class AggFnEvaluator;
+class MemPool;
+class RowBatch;
+class RuntimeState;
+class Tuple;
+class TupleDescriptor;
+
+/// Node for aggregations whose input is sorted on the grouping exprs, i.e. whose
+/// child is a sort or a merging exchange that orders by them. All rows of a group are
+/// adjacent in the input, so the node only keeps the intermediate tuple of the current
+/// group and emits it as soon as a row of the next group arrives. Unlike the hash
+/// aggregation nodes, memory use does not depend on the number of groups, the node
+/// never spills and output rows are streamed while the input is consumed.
+///
+/// The planner only picks this node for aggregations with grouping exprs. The
+/// intermediate and output tuples have the same layout as for the hash aggregation
+/// nodes: the grouping slots precede the aggregation slots.
+class SortedAggregationNode : public ExecNode {
+ public:
+  SortedAggregationNode(ObjectPool* pool, const TPlanNode& tnode,
+      const DescriptorTbl& descs);
+
+  virtual Status Init(const TPlanNode& tnode, RuntimeState* state);
+  virtual Status Prepare(RuntimeState* state);
+  virtual Status Open(RuntimeState* state);
+  virtual Status GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos);
+  virtual Status Reset(RuntimeState* state);
+  virtual void Close(RuntimeState* state);
+
+ protected:
+  /// Frees local allocations of the aggregate functions and their input exprs. Results
+  /// of Finalize() are local allocations that the returned rows may reference, so this
+  /// must only be called before rows are added to a new output batch.
+  virtual Status QueryMaintenance(RuntimeState* state);
+
+  virtual void DebugString(int indentation_level, std::stringstream* out) const;
+
+ private:
+  std::vector<ExprContext*> grouping_expr_ctxs_;
+  std::vector<AggFnEvaluator*> aggregate_evaluators_;
+
+  /// FunctionContext for each agg fn and backing pool.
+  std::vector<impala_udf::FunctionContext*> agg_fn_ctxs_;
+  boost::scoped_ptr<MemPool> agg_fn_pool_;
+
+  /// Tuple into which Update()/Merge()/Serialize() results are stored.
+  TupleId intermediate_tuple_id_;
+  TupleDescriptor* intermediate_tuple_desc_;
+
+  /// Tuple into which Finalize() results are stored. Possibly the same as
+  /// the intermediate tuple.
+  TupleId output_tuple_id_;
+  TupleDescriptor* output_tuple_desc_;
+
+  /// True if the aggregate functions need a finalize step.
+  bool needs_finalize_;
+
+  /// Holds the intermediate tuple of the current group, including its grouping values,
+  /// and the tuples of the groups emitted since the last GetNext() call. Its memory is
+  /// handed to the output batch at the end of each GetNext().
+  boost::scoped_ptr<MemPool> tuple_pool_;
+
+  /// Intermediate tuple of the group that the last consumed input row belongs to. NULL
+  /// before the first input row and after the last group was emitted.
+  Tuple* current_tuple_;
+
+  /// Current batch of input rows and the index of the next row to aggregate. The
+  /// output batch may fill up in the middle of an input batch.
+  boost::scoped_ptr<RowBatch> child_batch_;
+  int child_batch_idx_;
+  bool child_eos_;
+
+  /// Number of groups that were emitted, before evaluating the conjuncts.
+  RuntimeProfile::Counter* num_groups_counter_;
+
+  /// Returns true if the grouping exprs evaluate to the grouping values of
+  /// 'current_tuple_' over 'row'.
+  bool IsCurrentGroup(TupleRow* row);
+
+  /// Constructs a new intermediate tuple from 'tuple_pool_', initialized to the
+  /// grouping values of 'row'. The aggregation slots are set to their initial values.
+  Tuple* ConstructIntermediateTuple(TupleRow* row);
+
+  /// Returns a copy of the intermediate tuple 'tuple' allocated from 'tuple_pool_'.
+  /// Only the grouping values are deep-copied: the aggregation slots reference memory
+  /// of the aggregate functions.
+  Tuple* CopyIntermediateTuple(Tuple* tuple);
+
+  /// Frees the aggregate function state of 'current_tuple_', if any, without
+  /// returning it. Used when the node is reset or closed before the end of the input.
+  void DiscardCurrentGroup();
+
+  /// Finalizes or serializes 'current_tuple_' into a row of 'row_batch', evaluates the
+  /// conjuncts over it and resets 'current_tuple_'.
+  void OutputCurrentGroup(RowBatch* row_batch);
+};
+
+}
+
+#endif
@@ -0,0 +1,82 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_EXEC_TOPN_BOUND_H
+#define IMPALA_EXEC_TOPN_BOUND_H
+
+#include "common/atomic.h"
+#include "runtime/descriptors.h"  // for SlotId
+
+namespace impala {
+
+/// Bound on the first sort key of a TopNNode, published by the node to the
+/// HdfsScanNode that feeds it. Once the TopNNode holds LIMIT + OFFSET rows, input rows
+/// whose first sort key sorts strictly after the first sort key of its last row can't
+/// be part of the result, so scanners may skip them, e.g. whole Parquet row groups
+/// based on their column statistics.
+///
+/// The bound is on an integer-typed slot of the scan tuple and only ever gets tighter.
+/// It is updated by the TopNNode's thread and read by scanner threads without locking:
+/// a stale bound is looser but still correct.
+class TopNBound {
+ public:
+  /// 'slot_id' is the slot of the scan tuple that the first sort key is evaluated from.
+  TopNBound(SlotId slot_id, bool is_asc, bool nulls_first)
+    : slot_id_(slot_id),
+      is_asc_(is_asc),
+      nulls_first_(nulls_first),
+      value_(0),
+      is_set_(0) {
+  }
+
+  SlotId slot_id() const { return slot_id_; }
+
+  /// Returns true if the bound was set, i.e. the top-n is full.
+  bool is_set() const { return is_set_ != 0; }
+
+  /// Sets the bound to 'value', the first sort key of the last row of the full top-n.
+  void Update(int64_t value) {
+    value_ = value;
+    // Readers only look at 'value_' once 'is_set_' is set, and x86 does not reorder
+    // stores.
+    is_set_ = 1;
+  }
+
+  /// Returns true if no value in [min_value, max_value] can be part of the top-n.
+  /// Must only be called if is_set().
+  bool RangeFails(int64_t min_value, int64_t max_value) const {
+    int64_t bound = value_;
+    return is_asc_ ? min_value > bound : max_value < bound;
+  }
+
+  /// Returns true if NULLs can't be part of the top-n. Must only be called if is_set().
+  bool NullsFail() const {
+    // The last row has a non-NULL key, so NULLs are worse iff they sort last.
+    return !nulls_first_;
+  }
+
+ private:
+  const SlotId slot_id_;
+  const bool is_asc_;
+  const bool nulls_first_;
+
+  /// First sort key of the last row of the top-n, valid if 'is_set_' is non-zero.
+  AtomicInt<int64_t> value_;
+  AtomicInt<int> is_set_;
+};
+
+}
+
+#endif
@@ -15,16 +15,23 @@
 #include "exec/topn-node.h"
 
 #include <sstream>
+#include <gflags/gflags.h>
 
+#include "exec/hdfs-scan-node.h"
+#include "exec/topn-bound.h"
 #include "exprs/expr.h"
+#include "exprs/slot-ref.h"
 #include "runtime/descriptors.h"
 #include "runtime/mem-pool.h"
 #include "runtime/raw-value.h"
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
+#include "runtime/sorter.h"
 #include "runtime/tuple.h"
 #include "runtime/tuple-row.h"
 #include "util/debug-util.h"
+#include "util/key-normalizer.inline.h"
+#include "util/min-max-filter.h"
 #include "util/runtime-profile.h"
 
 #include "gen-cpp/Exprs_types.h"
@@ -35,6 +42,13 @@
 using std::priority_queue;
 using namespace impala;
 
+DEFINE_bool(enable_topn_scan_bound, true, "(Advanced) If true, a TopN node publishes the "
+    "first sort key of its last row to the HDFS scan node below it, which skips Parquet "
+    "row groups whose statistics show that none of their rows can be in the top-n.");
+DEFINE_int64(topn_spill_threshold_bytes, 256L * 1024L * 1024L, "(Advanced) Number of "
+    "bytes of tuple data above which a TopN node with a large limit switches from its "
+    "in-memory priority queue to an external sort that can spill to disk.");
+
 TopNNode::TopNNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs)
   : ExecNode(pool, tnode, descs),
     offset_(tnode.sort_node.__isset.offset ? tnode.sort_node.offset : 0),
@@ -42,10 +56,19 @@ TopNNode::TopNNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl
     tuple_row_less_than_(NULL),
     tmp_tuple_(NULL),
     tuple_pool_(NULL),
+    topn_bound_(NULL),
+    topn_bound_slot_(NULL),
+    num_spilled_queues_counter_(NULL),
     num_rows_skipped_(0),
+    top_key_over_budget_(false),
+    top_key_prefix_valid_(false),
+    use_sorter_(false),
     priority_queue_(NULL) {
 }
 
+TopNNode::~TopNNode() {
+}
+
 Status TopNNode::Init(const TPlanNode& tnode, RuntimeState* state) {
   RETURN_IF_ERROR(ExecNode::Init(tnode, state));
   RETURN_IF_ERROR(sort_exec_exprs_.Init(tnode.sort_node.sort_info, pool_));
@@ -78,11 +101,45 @@ Status TopNNode::Prepare(RuntimeState* state) {
       new priority_queue<Tuple*, vector<Tuple*>, TupleRowComparator>(
           *tuple_row_less_than_));
   materialized_tuple_desc_ = row_descriptor_.tuple_descriptors()[0];
+
+  const vector<ExprContext*>& ordering_ctxs = sort_exec_exprs_.lhs_ordering_expr_ctxs();
+  bool can_normalize = !ordering_ctxs.empty();
+  for (int i = 0; i < ordering_ctxs.size(); ++i) {
+    can_normalize &= KeyNormalizer::IsSupportedType(ordering_ctxs[i]->root()->type());
+  }
+  if (can_normalize) {
+    key_normalizer_.reset(new KeyNormalizer(ordering_ctxs, KEY_PREFIX_LEN,
+        is_asc_order_, nulls_first_));
+  }
+  if (FLAGS_enable_topn_scan_bound) InitTopNBound();
+  num_spilled_queues_counter_ =
+      ADD_COUNTER(runtime_profile(), "NumSpilledQueues", TUnit::UNIT);
   return Status::OK();
 }
 
+void TopNNode::InitTopNBound() {
+  if (IsInSubplan() || child(0)->type() != TPlanNodeType::HDFS_SCAN_NODE) return;
+  // The first sort key must be a slot of the materialized tuple that is copied from an
+  // integer slot of the scan tuple.
+  Expr* first_key = sort_exec_exprs_.lhs_ordering_expr_ctxs()[0]->root();
+  if (!first_key->is_slotref()) return;
+  SlotId sort_slot_id = static_cast<SlotRef*>(first_key)->slot_id();
+  const vector<SlotDescriptor*>& slots = materialized_tuple_desc_->slots();
+  for (int i = 0; i < slots.size(); ++i) {
+    if (slots[i]->id() != sort_slot_id) continue;
+    Expr* src = sort_exec_exprs_.sort_tuple_slot_expr_ctxs()[i]->root();
+    if (!src->is_slotref() || !MinMaxFilter::SupportsType(src->type())) return;
+    topn_bound_ = pool_->Add(new TopNBound(static_cast<SlotRef*>(src)->slot_id(),
+        is_asc_order_[0], nulls_first_[0]));
+    topn_bound_slot_ = slots[i];
+    static_cast<HdfsScanNode*>(child(0))->set_topn_bound(topn_bound_);
+    return;
+  }
+}
+
 Status TopNNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   RETURN_IF_ERROR(ExecNode::Open(state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
@@ -101,15 +158,27 @@ Status TopNNode::Open(RuntimeState* state) {
     do {
       batch.Reset();
       RETURN_IF_ERROR(child(0)->GetNext(state, &batch, &eos));
-      for (int i = 0; i < batch.num_rows(); ++i) {
-        InsertTupleRow(batch.GetRow(i));
+      if (use_sorter_) {
+        RETURN_IF_ERROR(sorter_->AddBatch(&batch));
+      } else {
+        for (int i = 0; i < batch.num_rows(); ++i) {
+          InsertTupleRow(batch.GetRow(i));
+        }
+        if (topn_bound_ != NULL) UpdateTopNBound();
+        if (tuple_pool_->total_allocated_bytes() > FLAGS_topn_spill_threshold_bytes) {
+          RETURN_IF_ERROR(CompactOrSpillQueue(state));
+        }
       }
       RETURN_IF_CANCELLED(state);
       RETURN_IF_ERROR(QueryMaintenance(state));
     } while (!eos);
   }
-  DCHECK_LE(priority_queue_->size(), limit_ + offset_);
-  PrepareForOutput();
+  if (use_sorter_) {
+    RETURN_IF_ERROR(sorter_->InputDone());
+  } else {
+    DCHECK_LE(priority_queue_->size(), limit_ + offset_);
+    PrepareForOutput();
+  }
 
   // Unless we are inside a subplan expecting to call Open()/GetNext() on the child
   // again, the child can be closed at this point.
@@ -119,9 +188,11 @@ Status TopNNode::Open(RuntimeState* state) {
 
 Status TopNNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
+  if (use_sorter_) return GetNextFromSorter(state, row_batch, eos);
   while (!row_batch->AtCapacity() && (get_next_iter_ != sorted_top_n_.end())) {
     if (num_rows_skipped_ < offset_) {
       ++get_next_iter_;
@@ -151,6 +222,9 @@ Status TopNNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
 Status TopNNode::Reset(RuntimeState* state) {
   while(!priority_queue_->empty()) priority_queue_->pop();
   num_rows_skipped_ = 0;
+  top_key_prefix_valid_ = false;
+  if (use_sorter_) RETURN_IF_ERROR(sorter_->Reset());
+  use_sorter_ = false;
   // We deliberately do not free the tuple_pool_ here to allow selective transferring
   // of resources in the future.
   return ExecNode::Reset(state);
@@ -159,6 +233,7 @@ Status TopNNode::Reset(RuntimeState* state) {
 void TopNNode::Close(RuntimeState* state) {
   if (is_closed()) return;
   if (tuple_pool_.get() != NULL) tuple_pool_->FreeAll();
+  sorter_.reset();
   sort_exec_exprs_.Close(state);
   ExecNode::Close(state);
 }
@@ -177,7 +252,7 @@ void TopNNode::InsertTupleRow(TupleRow* input_row) {
     Tuple* top_tuple = priority_queue_->top();
     tmp_tuple_->MaterializeExprs<false>(input_row, *materialized_tuple_desc_,
             sort_exec_exprs_.sort_tuple_slot_expr_ctxs(), NULL);
-    if ((*tuple_row_less_than_)(tmp_tuple_, top_tuple)) {
+    if (LessThanTop(tmp_tuple_)) {
       // TODO: DeepCopy() will allocate new buffers for the string data. This needs
       // to be fixed to use a freelist
       tmp_tuple_->DeepCopy(top_tuple, *materialized_tuple_desc_, tuple_pool_.get());
@@ -185,10 +260,121 @@ void TopNNode::InsertTupleRow(TupleRow* input_row) {
       priority_queue_->pop();
     }
   }
+  // The top may change with any insert.
+  if (insert_tuple != NULL) top_key_prefix_valid_ = false;
 
   if (insert_tuple != NULL) priority_queue_->push(insert_tuple);
 }
 
+inline bool TopNNode::LessThanTop(Tuple* tuple) {
+  Tuple* top_tuple = priority_queue_->top();
+  if (key_normalizer_.get() == NULL) return (*tuple_row_less_than_)(tuple, top_tuple);
+  if (!top_key_prefix_valid_) {
+    top_key_over_budget_ = key_normalizer_->NormalizeKey(
+        reinterpret_cast<TupleRow*>(&top_tuple), top_key_prefix_);
+    top_key_prefix_valid_ = true;
+  }
+  uint8_t key_prefix[KEY_PREFIX_LEN];
+  bool key_over_budget =
+      key_normalizer_->NormalizeKey(reinterpret_cast<TupleRow*>(&tuple), key_prefix);
+  int result = memcmp(key_prefix, top_key_prefix_, KEY_PREFIX_LEN);
+  if (result != 0) return result < 0;
+  // Equal prefixes of complete keys are equal keys.
+  if (!key_over_budget && !top_key_over_budget_) return false;
+  return (*tuple_row_less_than_)(tuple, top_tuple);
+}
+
+void TopNNode::UpdateTopNBound() {
+  DCHECK(topn_bound_ != NULL);
+  if (priority_queue_->size() < limit_ + offset_) return;
+  Tuple* top_tuple = priority_queue_->top();
+  // A NULL key doesn't bound the non-NULL values that may still enter the top-n.
+  if (top_tuple->IsNull(topn_bound_slot_->null_indicator_offset())) return;
+  topn_bound_->Update(MinMaxFilter::GetValue(
+      top_tuple->GetSlot(topn_bound_slot_->tuple_offset()), topn_bound_slot_->type()));
+}
+
+Status TopNNode::CompactOrSpillQueue(RuntimeState* state) {
+  vector<Tuple*> tuples;
+  tuples.reserve(priority_queue_->size());
+  int64_t live_bytes = 0;
+  while (!priority_queue_->empty()) {
+    tuples.push_back(priority_queue_->top());
+    live_bytes += tuples.back()->TotalByteSize(*materialized_tuple_desc_);
+    priority_queue_->pop();
+  }
+  top_key_prefix_valid_ = false;
+
+  if (live_bytes <= FLAGS_topn_spill_threshold_bytes / 2) {
+    // Most of the pool is held by tuples that were replaced in the queue, copy the live
+    // ones to a new pool.
+    scoped_ptr<MemPool> new_pool(new MemPool(mem_tracker()));
+    for (int i = 0; i < tuples.size(); ++i) {
+      priority_queue_->push(tuples[i]->DeepCopy(*materialized_tuple_desc_,
+          new_pool.get()));
+    }
+    tmp_tuple_ = reinterpret_cast<Tuple*>(
+        new_pool->Allocate(materialized_tuple_desc_->byte_size()));
+    tuple_pool_->FreeAll();
+    tuple_pool_.swap(new_pool);
+    return Status::OK();
+  }
+
+  if (sorter_.get() == NULL) {
+    sorter_.reset(new Sorter(*tuple_row_less_than_,
+        sort_exec_exprs_.sort_tuple_slot_expr_ctxs(), &row_descriptor_, mem_tracker(),
+        runtime_profile(), state));
+    RETURN_IF_ERROR(sorter_->Init());
+  }
+  // Hand the tuples of the queue to the sorter, which copies them.
+  RowBatch batch(row_descriptor_, state->batch_size(), mem_tracker());
+  for (int i = 0; i < tuples.size(); ++i) {
+    int row_idx = batch.AddRow();
+    batch.GetRow(row_idx)->SetTuple(0, tuples[i]);
+    batch.CommitLastRow();
+    if (batch.AtCapacity() || i == tuples.size() - 1) {
+      RETURN_IF_ERROR(sorter_->AddMaterializedBatch(&batch));
+      batch.Reset();
+    }
+  }
+  tuple_pool_->FreeAll();
+  tmp_tuple_ = NULL;
+  use_sorter_ = true;
+  COUNTER_ADD(num_spilled_queues_counter_, 1);
+  return Status::OK();
+}
+
+Status TopNNode::GetNextFromSorter(RuntimeState* state, RowBatch* row_batch,
+    bool* eos) {
+  if (ReachedLimit()) {
+    *eos = true;
+    return Status::OK();
+  }
+  DCHECK_EQ(row_batch->num_rows(), 0);
+  RETURN_IF_ERROR(sorter_->GetNext(row_batch, eos));
+  while (num_rows_skipped_ < offset_) {
+    num_rows_skipped_ += row_batch->num_rows();
+    // Throw away rows in the output batch until the offset is skipped.
+    int rows_to_keep = num_rows_skipped_ - offset_;
+    if (rows_to_keep > 0) {
+      row_batch->CopyRows(0, row_batch->num_rows() - rows_to_keep, rows_to_keep);
+      row_batch->set_num_rows(rows_to_keep);
+    } else {
+      row_batch->set_num_rows(0);
+    }
+    if (rows_to_keep > 0 || *eos) break;
+    RETURN_IF_ERROR(sorter_->GetNext(row_batch, eos));
+  }
+
+  num_rows_returned_ += row_batch->num_rows();
+  if (ReachedLimit()) {
+    row_batch->set_num_rows(row_batch->num_rows() - (num_rows_returned_ - limit_));
+    *eos = true;
+  }
+  COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+  return Status::OK();
+}
+
 // Reverse the order of the tuples in the priority queue
 void TopNNode::PrepareForOutput() {
   sorted_top_n_.resize(priority_queue_->size());
@@ -26,8 +26,11 @@
 
 namespace impala {
 
+class KeyNormalizer;
 class MemPool;
 class RuntimeState;
+class Sorter;
+class TopNBound;
 class Tuple;
 
 /// Node for in-memory TopN (ORDER BY ... LIMIT)
@@ -35,9 +38,24 @@ class Tuple;
 /// This node will materialize its input rows into a new tuple using the expressions
 /// in sort_tuple_slot_exprs_ in its sort_exec_exprs_ member.
 /// TopN is implemented by storing rows in a priority queue.
+//
+/// Once the queue is full, most input rows sort after its top and are rejected. To make
+/// that check cheap, the normalized prefix of the sort key of the top is cached and
+/// compared to the prefix of the input row with memcmp(), if all sort keys can be
+/// normalized. If the child is an HdfsScanNode and the first sort key is an integer
+/// slot of the scan, the first sort key of the top is also published to the scan node as
+/// a TopNBound, which lets the scanners skip data that can't make it into the top-n.
+//
+/// For large limits and offsets the queue may not fit in memory. If tuple_pool_ grows
+/// beyond --topn_spill_threshold_bytes, it is first compacted, since replaced queue
+/// entries are not freed. If the live tuples still take up more than half of the
+/// threshold, the node becomes an external sort: the tuples of the queue and all further
+/// input rows are added to a Sorter, which can spill to disk via the BufferedBlockMgr,
+/// and the output skips the offset and stops at the limit like the SortNode.
 class TopNNode : public ExecNode {
  public:
   TopNNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs);
+  virtual ~TopNNode();
 
   virtual Status Init(const TPlanNode& tnode, RuntimeState* state);
   virtual Status Prepare(RuntimeState* state);
@@ -60,6 +78,28 @@ class TopNNode : public ExecNode {
   /// Flatten and reverse the priority queue.
   void PrepareForOutput();
 
+  /// Creates topn_bound_ and sets it on the child scan node, if the first sort key
+  /// allows it.
+  void InitTopNBound();
+
+  /// Updates topn_bound_ from the top of the full priority queue.
+  void UpdateTopNBound();
+
+  /// Returns true if the materialized 'tuple' sorts before the top of the queue.
+  bool LessThanTop(Tuple* tuple);
+
+  /// Number of bytes of the normalized sort keys that are compared with memcmp().
+  static const int KEY_PREFIX_LEN = 16;
+
+  /// Called if tuple_pool_ grew beyond the threshold. Copies the tuples of the queue to a
+  /// new pool, or, if they are too large, moves them into sorter_ and sets
+  /// use_sorter_.
+  Status CompactOrSpillQueue(RuntimeState* state);
+
+  /// Returns the next batch of sorted rows from sorter_, after skipping the first
+  /// offset_ rows and up to the limit.
+  Status GetNextFromSorter(RuntimeState* state, RowBatch* row_batch, bool* eos);
+
   /// Number of rows to skip.
   int64_t offset_;
 
@@ -89,12 +129,39 @@ class TopNNode : public ExecNode {
   // Iterator over elements in sorted_top_n_.
   std::vector<Tuple*>::iterator get_next_iter_;
 
+  /// Normalizes the sort keys of materialized tuples. NULL if some sort key can't be
+  /// normalized.
+  boost::scoped_ptr<KeyNormalizer> key_normalizer_;
+
+  /// Bound published to the child scan node, NULL if there is none. Owned by pool_.
+  TopNBound* topn_bound_;
+
+  /// Slot of the materialized tuple that holds the first sort key, if topn_bound_ is
+  /// not NULL.
+  SlotDescriptor* topn_bound_slot_;
+
+  /// External sort that replaces the priority queue if it grew too large, created on
+  /// first use.
+  boost::scoped_ptr<Sorter> sorter_;
+
+  /// Number of times the priority queue was moved into sorter_.
+  RuntimeProfile::Counter* num_spilled_queues_counter_;
+
   /////////////////////////////////////////
   /// BEGIN: Members that must be Reset()
 
   /// Number of rows skipped. Used for adhering to offset_.
   int64_t num_rows_skipped_;
 
+  /// Normalized sort key prefix of the top of priority_queue_ and whether the key did
+  /// not fit into it. Only valid if top_key_prefix_valid_ is true.
+  uint8_t top_key_prefix_[KEY_PREFIX_LEN];
+  bool top_key_over_budget_;
+  bool top_key_prefix_valid_;
+
+  /// True if the input is sorted by sorter_ instead of the priority queue.
+  bool use_sorter_;
+
   /// The priority queue will never have more elements in it than the LIMIT + OFFSET.
   /// The stl priority queue doesn't support a max size, so to get that functionality,
   /// the order of the queue is the opposite of what the ORDER BY clause specifies, such
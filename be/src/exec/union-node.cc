@@ -15,6 +15,7 @@
 #include "exec/union-node.h"
 #include "exprs/expr.h"
 #include "exprs/expr-context.h"
+#include "exprs/slot-ref.h"
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 #include "runtime/raw-value.h"
@@ -76,12 +77,42 @@ Status UnionNode::Prepare(RuntimeState* state) {
         result_expr_ctx_lists_[i], state, child(i)->row_desc(), expr_mem_tracker()));
     AddExprCtxsToFree(result_expr_ctx_lists_[i]);
     DCHECK_EQ(result_expr_ctx_lists_[i].size(), tuple_desc_->slots().size());
+    is_pass_through_.push_back(IsChildPassThrough(state, i));
   }
   return Status::OK();
 }
 
+bool UnionNode::IsChildPassThrough(RuntimeState* state, int child_idx) const {
+  const RowDescriptor& child_row_desc = child(child_idx)->row_desc();
+  if (child_row_desc.tuple_descriptors().size() != 1) return false;
+  if (child_row_desc.TupleIsNullable(0)) return false;
+  const TupleDescriptor* child_tuple_desc = child_row_desc.tuple_descriptors()[0];
+  if (child_tuple_desc->byte_size() != tuple_desc_->byte_size()) return false;
+  if (child_tuple_desc->slots().size() != tuple_desc_->slots().size()) return false;
+  const vector<ExprContext*>& ctxs = result_expr_ctx_lists_[child_idx];
+  for (int i = 0; i < ctxs.size(); ++i) {
+    if (!ctxs[i]->root()->is_slotref()) return false;
+    const SlotRef* slot_ref = static_cast<const SlotRef*>(ctxs[i]->root());
+    const SlotDescriptor* src_slot =
+        state->desc_tbl().GetSlotDescriptor(slot_ref->slot_id());
+    const SlotDescriptor* dst_slot = tuple_desc_->slots()[i];
+    DCHECK(src_slot != NULL);
+    if (src_slot->parent() != child_tuple_desc) return false;
+    if (src_slot->type() != dst_slot->type()) return false;
+    if (src_slot->tuple_offset() != dst_slot->tuple_offset()) return false;
+    const NullIndicatorOffset& src_null = src_slot->null_indicator_offset();
+    const NullIndicatorOffset& dst_null = dst_slot->null_indicator_offset();
+    if (src_null.byte_offset != dst_null.byte_offset) return false;
+    if (src_null.bit_mask != dst_null.bit_mask) return false;
+  }
+  // The union's slots have distinct offsets, so the child slots matched above are
+  // distinct as well and, since the slot counts are equal, make up the whole tuple.
+  return true;
+}
+
 Status UnionNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   RETURN_IF_ERROR(ExecNode::Open(state));
   // Open const expr lists.
   for (int i = 0; i < const_result_expr_ctx_lists_.size(); ++i) {
@@ -113,12 +144,12 @@ Status UnionNode::OpenCurrentChild(RuntimeState* state) {
 
 Status UnionNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   RETURN_IF_ERROR(ExecDebugAction(TExecNodePhase::GETNEXT, state));
   RETURN_IF_CANCELLED(state);
   RETURN_IF_ERROR(QueryMaintenance(state));
-  // Create new tuple buffer for row_batch.
-  int tuple_buffer_size = row_batch->MaxTupleBufferSize();
-  Tuple* tuple = Tuple::Create(tuple_buffer_size, row_batch->tuple_data_pool());
+  // The tuple buffer for row_batch is only created once a row needs to be materialized.
+  Tuple* tuple = NULL;
 
   // Fetch from children, evaluate corresponding exprs and materialize.
   while (child_idx_ < children_.size()) {
@@ -130,17 +161,38 @@ Status UnionNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
       RETURN_IF_CANCELLED(state);
       RETURN_IF_ERROR(QueryMaintenance(state));
 
-      // Continue materializing exprs on child_row_batch_ into row batch.
-      RETURN_IF_ERROR(EvalAndMaterializeExprs(result_expr_ctx_lists_[child_idx_], false,
-          &tuple, row_batch));
-      if (row_batch->AtCapacity() || ReachedLimit()) {
-        *eos = ReachedLimit();
-        return Status::OK();
+      if (is_pass_through_[child_idx_]) {
+        CopyPassThroughRows(row_batch);
+        if (ReachedLimit()) {
+          // The returned rows reference the memory of child_row_batch_.
+          child_row_batch_->TransferResourceOwnership(row_batch);
+          *eos = true;
+          return Status::OK();
+        }
+        if (row_batch->AtCapacity()) {
+          *eos = false;
+          return Status::OK();
+        }
+        // All rows of child_row_batch_ were returned, so its memory goes with them.
+        child_row_batch_->TransferResourceOwnership(row_batch);
+      } else {
+        // Continue materializing exprs on child_row_batch_ into row batch.
+        RETURN_IF_ERROR(EvalAndMaterializeExprs(result_expr_ctx_lists_[child_idx_],
+            false, &tuple, row_batch));
+        if (row_batch->AtCapacity() || ReachedLimit()) {
+          *eos = ReachedLimit();
+          return Status::OK();
+        }
+        child_row_batch_->Reset();
       }
 
       // Fetch new batch if one is available, otherwise move on to next child.
       if (child_eos_) break;
-      child_row_batch_->Reset();
+      // The transferred memory may have filled up row_batch.
+      if (row_batch->AtCapacity()) {
+        *eos = false;
+        return Status::OK();
+      }
       RETURN_IF_ERROR(child(child_idx_)->GetNext(state, child_row_batch_.get(),
           &child_eos_));
       child_row_idx_ = 0;
@@ -157,6 +209,10 @@ Status UnionNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
     // again, the child can be closed at this point.
     if (!IsInSubplan()) child(child_idx_)->Close(state);
     ++child_idx_;
+    if (row_batch->AtCapacity()) {
+      *eos = false;
+      return Status::OK();
+    }
   }
 
   // Evaluate and materialize the const expr lists exactly once.
@@ -177,6 +233,24 @@ Status UnionNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   return Status::OK();
 }
 
+void UnionNode::CopyPassThroughRows(RowBatch* row_batch) {
+  ExprContext* const* conjunct_ctxs = &conjunct_ctxs_[0];
+  int num_conjunct_ctxs = conjunct_ctxs_.size();
+  while (child_row_idx_ < child_row_batch_->num_rows() && !row_batch->AtCapacity()) {
+    TupleRow* child_row = child_row_batch_->GetRow(child_row_idx_);
+    ++child_row_idx_;
+    // The conjuncts can be evaluated over the child's row directly because its tuple
+    // has the layout of tuple_desc_.
+    if (!EvalConjuncts(conjunct_ctxs, num_conjunct_ctxs, child_row)) continue;
+    int row_idx = row_batch->AddRow();
+    row_batch->CopyRow(child_row, row_batch->GetRow(row_idx));
+    row_batch->CommitLastRow();
+    ++num_rows_returned_;
+    if (ReachedLimit()) break;
+  }
+  COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+}
+
 Status UnionNode::Reset(RuntimeState* state) {
   child_row_idx_ = 0;
   const_result_expr_idx_ = 0;
@@ -208,6 +282,9 @@ Status UnionNode::EvalAndMaterializeExprs(const vector<ExprContext*>& ctxs,
   bool done = true;
   ExprContext* const* conjunct_ctxs = &conjunct_ctxs_[0];
   int num_conjunct_ctxs = conjunct_ctxs_.size();
+  if (*tuple == NULL) {
+    *tuple = Tuple::Create(row_batch->MaxTupleBufferSize(), row_batch->tuple_data_pool());
+  }
 
   do {
     TupleRow* child_row = NULL;
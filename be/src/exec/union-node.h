@@ -32,6 +32,10 @@ class TupleRow;
 /// evaluated expressions into row batches. The UnionNode pulls row batches from its
 /// children sequentially, i.e., it exhausts one child completely before moving
 /// on to the next one.
+/// Children whose rows already have the layout of the union's tuple, e.g. the scans
+/// of a UNION ALL over tables with the same schema, are passed through: their rows are
+/// returned as they are and the memory of their batches is transferred to the output
+/// instead of copying every row into a new tuple.
 class UnionNode : public ExecNode {
  public:
   UnionNode(ObjectPool* pool, const TPlanNode& tnode, const DescriptorTbl& descs);
@@ -56,6 +60,10 @@ class UnionNode : public ExecNode {
   /// Exprs materialized by this node. The i-th result expr list refers to the i-th child.
   std::vector<std::vector<ExprContext*> > result_expr_ctx_lists_;
 
+  /// The i-th entry is true if the rows of the i-th child are passed through. Set in
+  /// Prepare().
+  std::vector<bool> is_pass_through_;
+
   /////////////////////////////////////////
   /// BEGIN: Members that must be Reset()
 
@@ -82,9 +90,21 @@ class UnionNode : public ExecNode {
   /// and sets child_row_idx_ to 0. May set child_eos_.
   Status OpenCurrentChild(RuntimeState* state);
 
+  /// Returns true if the rows of the i-th child can be returned without evaluating its
+  /// result exprs: it produces a single non-nullable tuple with the layout of
+  /// tuple_desc_ and every result expr is a reference to the slot at the same position.
+  bool IsChildPassThrough(RuntimeState* state, int child_idx) const;
+
+  /// Copies the rows of child_row_batch_ starting from child_row_idx_ that pass the
+  /// conjuncts into row_batch, until it is at capacity or the limit is reached. The
+  /// memory of child_row_batch_ must be transferred to an output batch before the batch
+  /// is reused.
+  void CopyPassThroughRows(RowBatch* row_batch);
+
   /// Evaluates exprs on all rows in child_row_batch_ starting from child_row_idx_,
   /// and materializes their results into *tuple.
-  /// Adds *tuple into row_batch, and increments *tuple.
+  /// Adds *tuple into row_batch, and increments *tuple. If *tuple is NULL, a tuple
+  /// buffer is allocated first.
   /// If const_exprs is true, then the exprs are evaluated exactly once without
   /// fetching rows from child_row_batch_.
   /// Only commits tuples to row_batch if they are not filtered by conjuncts.
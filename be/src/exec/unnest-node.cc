@@ -12,6 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+
 #include "common/status.h"
 #include "exec/unnest-node.h"
 #include "exec/subplan-node.h"
@@ -85,6 +87,7 @@ Status UnnestNode::Prepare(RuntimeState* state) {
 
 Status UnnestNode::Open(RuntimeState* state) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   RETURN_IF_ERROR(ExecNode::Open(state));
   RETURN_IF_ERROR(coll_expr_ctx_->Open(state));
 
@@ -121,6 +124,7 @@ Status UnnestNode::Open(RuntimeState* state) {
 
 Status UnnestNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos) {
   SCOPED_TIMER(runtime_profile_->total_time_counter());
+  SCOPED_NODE_COUNTERS(this);
   // Avoid expensive query maintenance overhead for small collections.
   if (item_idx_ > 0) {
     RETURN_IF_CANCELLED(state);
@@ -130,6 +134,18 @@ Status UnnestNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos)
 
   // Populate the output row_batch with tuples from the collection.
   DCHECK(coll_value_ != NULL);
+  if (conjunct_ctxs_.empty()) {
+    // Every item becomes a row, so the rows are added in bulk.
+    int num_rows = std::min(coll_value_->num_tuples - item_idx_,
+        row_batch->capacity() - row_batch->num_rows());
+    int row_idx = row_batch->AddRows(num_rows);
+    uint8_t* item = coll_value_->ptr + item_idx_ * item_byte_size_;
+    for (int i = 0; i < num_rows; ++i, item += item_byte_size_) {
+      row_batch->GetRow(row_idx + i)->SetTuple(0, reinterpret_cast<Tuple*>(item));
+    }
+    row_batch->CommitRows(num_rows);
+    item_idx_ += num_rows;
+  }
   while (item_idx_ < coll_value_->num_tuples) {
     Tuple* item =
         reinterpret_cast<Tuple*>(coll_value_->ptr + item_idx_ * item_byte_size_);
@@ -158,6 +174,16 @@ Status UnnestNode::GetNext(RuntimeState* state, RowBatch* row_batch, bool* eos)
   return Status::OK();
 }
 
+int64_t UnnestNode::CountRemainingRows() {
+  DCHECK(CanCountRows());
+  DCHECK(coll_value_ != NULL);
+  int64_t num_rows = coll_value_->num_tuples - item_idx_;
+  item_idx_ = coll_value_->num_tuples;
+  num_rows_returned_ += num_rows;
+  COUNTER_SET(rows_returned_counter_, num_rows_returned_);
+  return num_rows;
+}
+
 Status UnnestNode::Reset(RuntimeState* state) {
   item_idx_ = 0;
   return ExecNode::Reset(state);
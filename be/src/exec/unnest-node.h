@@ -58,6 +58,15 @@ class UnnestNode : public ExecNode {
   virtual Status Reset(RuntimeState* state);
   virtual void Close(RuntimeState* state);
 
+  /// Returns true if every remaining item of the collection becomes an output row, i.e.
+  /// there are no conjuncts and no limit.
+  bool CanCountRows() const { return conjunct_ctxs_.empty() && limit_ == -1; }
+
+  /// Consumes the remaining items of the collection without materializing any rows, like
+  /// GetNext() calls until eos whose rows are only counted, and returns their number.
+  /// Used for COUNT(*) over the collection. Only valid if CanCountRows().
+  int64_t CountRemainingRows();
+
  private:
   friend class SubplanNode;
 
@@ -4,6 +4,7 @@
 #include <gtest/gtest.h>
 
 #include "experiments/string-search-sse.h"
+#include "runtime/string-search.h"
 
 #include "common/names.h"
 
@@ -57,6 +58,12 @@ void TestSearch(const char* haystack_orig, const char* needle_orig,
   int not_null_offset = needle2.Search(haystack_str_val);
   EXPECT_EQ(not_null_offset, libc_offset);
   
+  // StringSearch doesn't match empty needles.
+  if (needle_len > 0) {
+    StringSearch needle3(&needle_str_val);
+    EXPECT_EQ(needle3.Search(&haystack_str_val), libc_offset);
+  }
+
   // Ensure haystack/needle are unmodified
   EXPECT_EQ(strlen(needle_null_terminated), needle_len);
   EXPECT_EQ(strlen(haystack_null_terminated), haystack_len);
@@ -97,6 +104,16 @@ TEST(StringSearchTest, Basic) {
   TestSearch("abcde", "de");
   TestSearch("abcdede", "cde");
   TestSearch("abcdacde", "cde");
+
+  // Long haystacks, which are searched 16 positions at a time
+  TestSearch("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab", "ab");
+  TestSearch("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab", "aab");
+  TestSearch("abababababababababababababababababababc", "abc");
+  TestSearch("abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz", "xyz");
+  TestSearch("abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz", "xyza");
+  TestSearch("abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz", "mnopqrstuvwxyzab");
+  TestSearch("abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz", "zz");
+  TestSearch("abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz", "xyz", 50);
 }
 
 }
@@ -22,7 +22,9 @@
 #include "exprs/aggregate-functions.h"
 #include "exprs/expr-context.h"
 #include "exprs/anyval-util.h"
+#include "exprs/slot-ref.h"
 #include "runtime/lib-cache.h"
+#include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 #include "udf/udf-internal.h"
 #include "util/debug-util.h"
@@ -336,6 +338,164 @@ static void SetAnyVal(const SlotDescriptor* desc, Tuple* tuple, AnyVal* dst) {
   AnyValUtil::SetAnyVal(slot, desc->type(), dst);
 }
 
+bool AggFnEvaluator::SupportsAddBatch() const {
+  if (!is_builtin() || input_expr_ctxs_.size() > 1) return false;
+  const PrimitiveType intermediate = intermediate_type().type;
+  if (agg_op_ == COUNT && !is_merge_) return intermediate == TYPE_BIGINT;
+  if (input_expr_ctxs_.empty()) return false;
+  const PrimitiveType input = input_expr_ctxs_[0]->root()->type().type;
+  switch (agg_op_) {
+    case COUNT:
+      // Merging counts sums them.
+      return input == TYPE_BIGINT && intermediate == TYPE_BIGINT;
+    case SUM:
+      switch (input) {
+        case TYPE_TINYINT:
+        case TYPE_SMALLINT:
+        case TYPE_INT:
+        case TYPE_BIGINT:
+          return intermediate == TYPE_BIGINT;
+        case TYPE_FLOAT:
+        case TYPE_DOUBLE:
+          return intermediate == TYPE_DOUBLE;
+        default:
+          return false;
+      }
+    case MIN:
+    case MAX:
+      switch (input) {
+        case TYPE_TINYINT:
+        case TYPE_SMALLINT:
+        case TYPE_INT:
+        case TYPE_BIGINT:
+        case TYPE_FLOAT:
+        case TYPE_DOUBLE:
+          return intermediate == input;
+        default:
+          return false;
+      }
+    default:
+      return false;
+  }
+}
+
+void AggFnEvaluator::AddBatch(FunctionContext* agg_fn_ctx, RowBatch* batch,
+    Tuple* dst) {
+  DCHECK(SupportsAddBatch());
+  const int num_rows = batch->num_rows();
+  if (is_count_star() && !is_merge_) {
+    AddCountStar(agg_fn_ctx, num_rows, dst);
+    return;
+  }
+  if (agg_op_ == COUNT && !is_merge_) {
+    DCHECK(!dst->IsNull(intermediate_slot_desc_->null_indicator_offset()));
+    int64_t* count =
+        reinterpret_cast<int64_t*>(dst->GetSlot(intermediate_slot_desc_->tuple_offset()));
+    *count += CountNonNullInputs(batch);
+    agg_fn_ctx->impl()->IncrementNumUpdates(num_rows);
+    return;
+  }
+
+  int64_t num_values = 0;
+  switch (input_expr_ctxs_[0]->root()->type().type) {
+#define ADD_BATCH_CASE(type, T, SumT) \
+    case type: \
+      if (agg_op_ == MIN) { \
+        num_values = AddBatchInternal<MIN, T, T>(batch, dst); \
+      } else if (agg_op_ == MAX) { \
+        num_values = AddBatchInternal<MAX, T, T>(batch, dst); \
+      } else { \
+        num_values = AddBatchInternal<SUM, T, SumT>(batch, dst); \
+      } \
+      break;
+    ADD_BATCH_CASE(TYPE_TINYINT, int8_t, int64_t)
+    ADD_BATCH_CASE(TYPE_SMALLINT, int16_t, int64_t)
+    ADD_BATCH_CASE(TYPE_INT, int32_t, int64_t)
+    ADD_BATCH_CASE(TYPE_BIGINT, int64_t, int64_t)
+    ADD_BATCH_CASE(TYPE_FLOAT, float, double)
+    ADD_BATCH_CASE(TYPE_DOUBLE, double, double)
+#undef ADD_BATCH_CASE
+    default:
+      DCHECK(false) << "Unsupported type for AddBatch()";
+  }
+  // Like SumUpdate(), don't count NULL inputs of SUM as updates.
+  agg_fn_ctx->impl()->IncrementNumUpdates(agg_op_ == SUM ? num_values : num_rows);
+}
+
+void AggFnEvaluator::AddCountStar(FunctionContext* agg_fn_ctx, int64_t num_rows,
+    Tuple* dst) {
+  DCHECK(SupportsAddBatch());
+  DCHECK(is_count_star() && !is_merge_);
+  DCHECK(!dst->IsNull(intermediate_slot_desc_->null_indicator_offset()));
+  int64_t* count =
+      reinterpret_cast<int64_t*>(dst->GetSlot(intermediate_slot_desc_->tuple_offset()));
+  *count += num_rows;
+  agg_fn_ctx->impl()->IncrementNumUpdates(num_rows);
+}
+
+template <AggFnEvaluator::AggregationOp OP, typename T, typename AccT>
+static inline void AccumulateValue(T val, AccT* acc, bool* has_value) {
+  if (OP == AggFnEvaluator::SUM) {
+    *acc += val;
+  } else if (OP == AggFnEvaluator::MIN) {
+    if (!*has_value || val < *acc) *acc = val;
+  } else {
+    DCHECK_EQ(OP, AggFnEvaluator::MAX);
+    if (!*has_value || val > *acc) *acc = val;
+  }
+  *has_value = true;
+}
+
+template <AggFnEvaluator::AggregationOp OP, typename T, typename AccT>
+int64_t AggFnEvaluator::AddBatchInternal(RowBatch* batch, Tuple* dst) {
+  const NullIndicatorOffset& dst_null_offset =
+      intermediate_slot_desc_->null_indicator_offset();
+  AccT* dst_slot =
+      reinterpret_cast<AccT*>(dst->GetSlot(intermediate_slot_desc_->tuple_offset()));
+  // Aggregate into a local so that the loop doesn't store to 'dst' for every row.
+  bool has_value = !dst->IsNull(dst_null_offset);
+  AccT acc = has_value ? *dst_slot : 0;
+  int64_t num_values = 0;
+  const int num_rows = batch->num_rows();
+  ExprContext* input_ctx = input_expr_ctxs_[0];
+  if (input_ctx->root()->is_slotref()) {
+    const SlotRef* slot_ref = static_cast<const SlotRef*>(input_ctx->root());
+    const int tuple_idx = slot_ref->tuple_idx();
+    const int slot_offset = slot_ref->slot_offset();
+    const NullIndicatorOffset null_offset = slot_ref->null_indicator_offset();
+    for (int i = 0; i < num_rows; ++i) {
+      Tuple* tuple = batch->GetRow(i)->GetTuple(tuple_idx);
+      if (tuple == NULL || tuple->IsNull(null_offset)) continue;
+      AccumulateValue<OP, T, AccT>(
+          *reinterpret_cast<T*>(tuple->GetSlot(slot_offset)), &acc, &has_value);
+      ++num_values;
+    }
+  } else {
+    for (int i = 0; i < num_rows; ++i) {
+      void* val = input_ctx->GetValue(batch->GetRow(i));
+      if (val == NULL) continue;
+      AccumulateValue<OP, T, AccT>(*reinterpret_cast<T*>(val), &acc, &has_value);
+      ++num_values;
+    }
+  }
+  if (has_value) {
+    dst->SetNotNull(dst_null_offset);
+    *dst_slot = acc;
+  }
+  return num_values;
+}
+
+int64_t AggFnEvaluator::CountNonNullInputs(RowBatch* batch) {
+  DCHECK_EQ(input_expr_ctxs_.size(), 1);
+  ExprContext* input_ctx = input_expr_ctxs_[0];
+  const int num_rows = batch->num_rows();
+  int64_t count = 0;
+  for (int i = 0; i < num_rows; ++i) {
+    if (input_ctx->GetValue(batch->GetRow(i)) != NULL) ++count;
+  }
+  return count;
+}
+
 void AggFnEvaluator::Update(
     FunctionContext* agg_fn_ctx, TupleRow* row, Tuple* dst, void* fn) {
   if (fn == NULL) return;
@@ -41,6 +41,7 @@ class ExprContext;
 class MemPool;
 class MemTracker;
 class ObjectPool;
+class RowBatch;
 class RowDescriptor;
 class RuntimeState;
 class SlotDescriptor;
@@ -130,6 +131,21 @@ class AggFnEvaluator {
   /// is_merge_. That is, from the caller, it doesn't mater.
   void Add(FunctionContext* agg_fn_ctx, TupleRow* src, Tuple* dst);
 
+  /// Returns true if AddBatch() can be used for this function. This is the case for the
+  /// builtin COUNT, SUM, MIN and MAX over numeric types.
+  bool SupportsAddBatch() const;
+
+  /// Adds all rows of 'batch' to the intermediate state dst, with the same result as
+  /// calling Add() for each row. Only valid if SupportsAddBatch(). Avoids the function
+  /// call and AnyVal conversions per row, and reads input values directly from the
+  /// input tuples if the input expr is a SlotRef.
+  void AddBatch(FunctionContext* agg_fn_ctx, RowBatch* batch, Tuple* dst);
+
+  /// Adds 'num_rows' rows to the intermediate state dst of a COUNT(*), with the same
+  /// result as AddBatch() for that many rows, without needing the rows. Only valid if
+  /// SupportsAddBatch(), is_count_star() and !is_merge().
+  void AddCountStar(FunctionContext* agg_fn_ctx, int64_t num_rows, Tuple* dst);
+
   /// Updates the intermediate state dst to remove the input src row, i.e. undoes
   /// Add(src, dst). Only used internally for analytic fn builtins.
   void Remove(FunctionContext* agg_fn_ctx, TupleRow* src, Tuple* dst);
@@ -217,6 +233,15 @@ class AggFnEvaluator {
   /// generate the calls into the UDA functions (like for UDFs).
   /// Remove these functions when this is supported.
 
+  /// Implements AddBatch() for SUM, MIN and MAX, selected by 'OP', with input values of
+  /// type 'T' and intermediate values of type 'AccT'. Returns the number of non-NULL
+  /// input values.
+  template <AggregationOp OP, typename T, typename AccT>
+  int64_t AddBatchInternal(RowBatch* batch, Tuple* dst);
+
+  /// Returns the number of rows in 'batch' for which the single input expr is not NULL.
+  int64_t CountNonNullInputs(RowBatch* batch);
+
   /// Sets up the arguments to call fn. This converts from the agg-expr signature,
   /// taking TupleRow to the UDA signature taking AnvVals by populating the staging
   /// AnyVals.
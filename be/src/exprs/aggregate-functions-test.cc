@@ -26,6 +26,7 @@
 #include "runtime/multi-precision.h"
 #include "udf/udf.h"
 #include "udf/uda-test-harness.h"
+#include "udf/udf-test-harness.h"
 #include "util/decimal-util.h"
 
 #include "common/names.h"
@@ -162,6 +163,161 @@ TEST(HistogramTest, TestString) {
   EXPECT_TRUE(test.Execute(input, StringVal(&expected[0]))) << test.GetErrorMsg();
 }
 
+// Returns the NDV intermediate value of the ints in [start, end).
+StringVal HllOfRange(FunctionContext* ctx, int start, int end) {
+  StringVal hll;
+  AggregateFunctions::HllInit(ctx, &hll);
+  for (int i = start; i < end; ++i) AggregateFunctions::HllUpdate(ctx, IntVal(i), &hll);
+  return hll;
+}
+
+TEST(HllTest, SparseAndDense) {
+  FunctionContext::TypeDesc int_type;
+  int_type.type = FunctionContext::TYPE_INT;
+  FunctionContext::TypeDesc return_type;
+  return_type.type = FunctionContext::TYPE_BIGINT;
+  FunctionContext* ctx = UdfTestHarness::CreateTestContext(return_type,
+      vector<FunctionContext::TypeDesc>(1, int_type));
+
+  // Small inputs stay sparse, large ones become dense. Merging any combination of the
+  // two must give the same registers as updating with all the input.
+  const int sizes[] = {0, 10, 100, 10000};
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      int num_values = sizes[i] + sizes[j];
+      StringVal dst = HllOfRange(ctx, 0, sizes[i]);
+      StringVal src = HllOfRange(ctx, sizes[i], num_values);
+      StringVal expected = HllOfRange(ctx, 0, num_values);
+      EXPECT_EQ(sizes[i] >= 10000, dst.len == AggregateFunctions::HLL_LEN);
+      AggregateFunctions::HllMerge(ctx, src, &dst);
+
+      uint8_t registers[AggregateFunctions::HLL_LEN];
+      uint8_t expected_registers[AggregateFunctions::HLL_LEN];
+      AggregateFunctions::HllGetRegisters(dst, registers);
+      AggregateFunctions::HllGetRegisters(expected, expected_registers);
+      EXPECT_EQ(0, memcmp(registers, expected_registers, AggregateFunctions::HLL_LEN))
+          << sizes[i] << " " << sizes[j];
+
+      int64_t estimate = AggregateFunctions::HllFinalize(ctx, dst).val;
+      EXPECT_NEAR(num_values, estimate, num_values / 10) << num_values;
+      ctx->Free(src.ptr);
+      ctx->Free(expected.ptr);
+    }
+  }
+  UdfTestHarness::CloseContext(ctx);
+}
+
+TEST(TopKTest, MergeFindsHeavyHitters) {
+  FunctionContext::TypeDesc int_type;
+  int_type.type = FunctionContext::TYPE_INT;
+  FunctionContext::TypeDesc bigint_type;
+  bigint_type.type = FunctionContext::TYPE_BIGINT;
+  FunctionContext::TypeDesc string_type;
+  string_type.type = FunctionContext::TYPE_STRING;
+  vector<FunctionContext::TypeDesc> arg_types;
+  arg_types.push_back(int_type);
+  arg_types.push_back(bigint_type);
+  FunctionContext* update_ctx = UdfTestHarness::CreateTestContext(string_type,
+      arg_types);
+  BigIntVal k(3);
+  UdfTestHarness::SetConstantArgs(update_ctx, vector<AnyVal*>(2, &k));
+  FunctionContext* merge_ctx = UdfTestHarness::CreateTestContext(string_type,
+      vector<FunctionContext::TypeDesc>(1, string_type));
+
+  // Value i in [1, 3] occurs 1000 / i times, spread over two inputs that also contain
+  // many more distinct values than there are counters.
+  StringVal inputs[2];
+  for (int i = 0; i < 2; ++i) {
+    AggregateFunctions::TopKInit<IntVal>(update_ctx, &inputs[i]);
+    for (int j = 0; j < 1000; ++j) {
+      AggregateFunctions::TopKUpdate(update_ctx, IntVal(i * 1000 + j + 100), k,
+          &inputs[i]);
+      for (int v = 1; v <= 3; ++v) {
+        if (j % (2 * v) != 0) continue;
+        AggregateFunctions::TopKUpdate(update_ctx, IntVal(v), k, &inputs[i]);
+      }
+    }
+    inputs[i] = AggregateFunctions::TopKSerialize<IntVal>(update_ctx, inputs[i]);
+  }
+  ASSERT_FALSE(update_ctx->has_error()) << update_ctx->error_msg();
+
+  StringVal merged;
+  AggregateFunctions::TopKInit<IntVal>(merge_ctx, &merged);
+  for (int i = 0; i < 2; ++i) {
+    AggregateFunctions::TopKMerge<IntVal>(merge_ctx, inputs[i], &merged);
+    update_ctx->Free(inputs[i].ptr);
+  }
+  StringVal result = AggregateFunctions::TopKFinalize<IntVal>(merge_ctx, merged);
+  string result_str(reinterpret_cast<char*>(result.ptr), result.len);
+
+  // The estimated counts are upper bounds of the true ones.
+  vector<string> entries;
+  split(entries, result_str, is_any_of(","));
+  ASSERT_EQ(3, entries.size()) << result_str;
+  for (int v = 1; v <= 3; ++v) {
+    trim(entries[v - 1]);
+    int value;
+    int64_t count;
+    ASSERT_EQ(2, sscanf(entries[v - 1].c_str(), "%d (%ld)", &value, &count))
+        << result_str;
+    EXPECT_EQ(v, value) << result_str;
+    EXPECT_GE(count, 1000 / v) << result_str;
+  }
+  merge_ctx->Free(result.ptr);
+  UdfTestHarness::CloseContext(update_ctx);
+  UdfTestHarness::CloseContext(merge_ctx);
+}
+
+TEST(TDigestTest, MergedQuantiles) {
+  FunctionContext::TypeDesc double_type;
+  double_type.type = FunctionContext::TYPE_DOUBLE;
+  FunctionContext::TypeDesc string_type;
+  string_type.type = FunctionContext::TYPE_STRING;
+  FunctionContext* update_ctx = UdfTestHarness::CreateTestContext(string_type,
+      vector<FunctionContext::TypeDesc>(2, double_type));
+  FunctionContext* merge_ctx = UdfTestHarness::CreateTestContext(double_type,
+      vector<FunctionContext::TypeDesc>(1, string_type));
+
+  // Spread the values in [0, 100000) round-robin over several inputs, so that each of
+  // them covers the whole range.
+  const int num_values = 100000;
+  const int num_inputs = 4;
+  const double quantiles[] = {0, 0.01, 0.5, 0.99, 0.999, 1};
+  for (int i = 0; i < 6; ++i) {
+    DoubleVal q(quantiles[i]);
+    UdfTestHarness::SetConstantArgs(update_ctx, vector<AnyVal*>(2, &q));
+    StringVal merged;
+    AggregateFunctions::TDigestInit(merge_ctx, &merged);
+    for (int j = 0; j < num_inputs; ++j) {
+      StringVal input;
+      AggregateFunctions::TDigestInit(update_ctx, &input);
+      for (int v = j; v < num_values; v += num_inputs) {
+        AggregateFunctions::TDigestUpdate(update_ctx, DoubleVal(v), q, &input);
+      }
+      input = AggregateFunctions::TDigestSerialize(update_ctx, input);
+      // The serialized state only holds the compressed centroids.
+      EXPECT_LT(input.len, 4096);
+      AggregateFunctions::TDigestMerge(merge_ctx, input, &merged);
+      update_ctx->Free(input.ptr);
+    }
+    DoubleVal result = AggregateFunctions::TDigestFinalize(merge_ctx, merged);
+    ASSERT_FALSE(result.is_null);
+    EXPECT_NEAR(quantiles[i] * (num_values - 1), result.val, num_values * 0.005)
+        << quantiles[i];
+  }
+  EXPECT_FALSE(update_ctx->has_error()) << update_ctx->error_msg();
+
+  // NULLs and NaNs are ignored.
+  StringVal empty;
+  AggregateFunctions::TDigestInit(merge_ctx, &empty);
+  AggregateFunctions::TDigestUpdate(merge_ctx, DoubleVal::null(), DoubleVal(), &empty);
+  AggregateFunctions::TDigestUpdate(merge_ctx, DoubleVal(NAN), DoubleVal(), &empty);
+  EXPECT_TRUE(AggregateFunctions::TDigestFinalize(merge_ctx, empty).is_null);
+
+  UdfTestHarness::CloseContext(update_ctx);
+  UdfTestHarness::CloseContext(merge_ctx);
+}
+
 int main(int argc, char** argv) {
   impala::InitGoogleLoggingSafe(argv[0]);
   impala::DecimalUtil::InitMaxUnscaledDecimal16();
@@ -14,8 +14,10 @@
 
 #include "exprs/aggregate-functions.h"
 
+#include <emmintrin.h>
 #include <math.h>
 #include <algorithm>
+#include <limits>
 #include <map>
 #include <sstream>
 #include <utility>
@@ -170,6 +172,16 @@ static const StringVal DEFAULT_STRING_CONCAT_DELIM((uint8_t*)", ", 2);
 const int AggregateFunctions::HLL_PRECISION = 10;
 const int AggregateFunctions::HLL_LEN = 1024; // 2^HLL_PRECISION
 
+// Number of low bits of a sparse HLL entry that hold the register value. The largest
+// value is 64 - HLL_PRECISION + 1, which fits.
+static const int HLL_SPARSE_VALUE_BITS = 6;
+static const uint16_t HLL_SPARSE_VALUE_MASK = (1 << HLL_SPARSE_VALUE_BITS) - 1;
+
+// Largest size in bytes of a sparse HLL intermediate value. Adding an entry beyond this
+// converts it to a dense one. Inserting into the sorted entries gets slower as they grow,
+// and past HLL_LEN / 2 bytes the memory savings are small.
+static const int HLL_SPARSE_MAX_LEN = AggregateFunctions::HLL_LEN / 2;
+
 void AggregateFunctions::InitNull(FunctionContext*, AnyVal* dst) {
   dst->is_null = true;
 }
@@ -1133,15 +1145,541 @@ T AggregateFunctions::AppxMedianFinalize(FunctionContext* ctx,
   return result;
 }
 
+// APPX_TOPK() constants.
+// Largest k that APPX_TOPK() accepts.
+const static int TOPK_MAX_K = 100;
+// Number of counters kept per requested value. More counters make the counts and the
+// ranks of the top k values more accurate, but every update scans all counters.
+const static int TOPK_COUNTERS_PER_K = 8;
+const static int TOPK_MIN_COUNTERS = 64;
+const static int MAX_TOPK_STRING_LEN = 64;
+
+// A value tracked by APPX_TOPK().
+template <typename T>
+struct TopKValue {
+  T val;
+
+  TopKValue() { }
+  TopKValue(const T& val) : val(val) { }
+
+  bool operator==(const TopKValue& other) const { return val.val == other.val.val; }
+  void Print(ostream* os) const { *os << val.val; }
+};
+
+template <>
+void TopKValue<TinyIntVal>::Print(ostream* os) const {
+  *os << static_cast<int32_t>(val.val);
+}
+
+template <>
+bool TopKValue<DecimalVal>::operator==(const TopKValue& other) const {
+  return val.val16 == other.val.val16;
+}
+
+template <>
+void TopKValue<DecimalVal>::Print(ostream* os) const { *os << val.val16; }
+
+template <>
+bool TopKValue<TimestampVal>::operator==(const TopKValue& other) const {
+  return val.date == other.val.date && val.time_of_day == other.val.time_of_day;
+}
+
+template <>
+void TopKValue<TimestampVal>::Print(ostream* os) const {
+  *os << TimestampValue::FromTimestampVal(val).DebugString();
+}
+
+// Like ReservoirSample<StringVal>, strings are stored truncated in a fixed size array.
+// Strings that only differ after the first MAX_TOPK_STRING_LEN bytes are counted as the
+// same value.
+template <>
+struct TopKValue<StringVal> {
+  uint8_t val[MAX_TOPK_STRING_LEN];
+  int len;
+
+  TopKValue() : len(0) { }
+
+  TopKValue(const StringVal& string_val) {
+    len = std::min(string_val.len, MAX_TOPK_STRING_LEN);
+    memcpy(&val[0], string_val.ptr, len);
+  }
+
+  bool operator==(const TopKValue& other) const {
+    return len == other.len && memcmp(&val[0], &other.val[0], len) == 0;
+  }
+
+  void Print(ostream* os) const {
+    *os << string(reinterpret_cast<const char*>(&val[0]), len);
+  }
+};
+
+// A Space-Saving counter of APPX_TOPK(). 'count' is an upper bound of the number of
+// occurrences of 'val', which overestimates it by at most 'error'.
+template <typename T>
+struct TopKCounter {
+  TopKValue<T> val;
+  int64_t count;
+  int64_t error;
+
+  TopKCounter() : count(0), error(0) { }
+  TopKCounter(const TopKValue<T>& val, int64_t count, int64_t error)
+    : val(val), count(count), error(error) { }
+};
+
+template <typename T>
+bool TopKCountGreater(const TopKCounter<T>& i, const TopKCounter<T>& j) {
+  return i.count > j.count;
+}
+
+// The intermediate state of APPX_TOPK(), a Space-Saving summary (Metwally et al.,
+// "Efficient Computation of Frequent and Top-k Elements in Data Streams"). The header
+// is followed by the counters. Serialized states only contain the counters in use.
+struct TopKState {
+  int32_t k;
+
+  // Maximum number of counters, 0 if the state was initialized in a merge phase and
+  // has not merged any input yet.
+  int32_t max_counters;
+  int32_t num_counters;
+  int32_t padding;
+
+  template <typename T>
+  TopKCounter<T>* counters() { return reinterpret_cast<TopKCounter<T>*>(this + 1); }
+
+  // Returns the largest count that a value missing from the summary can have.
+  template <typename T>
+  int64_t MissingCount() {
+    if (num_counters == 0 || num_counters < max_counters) return 0;
+    TopKCounter<T>* c = counters<T>();
+    int64_t min_count = c[0].count;
+    for (int i = 1; i < num_counters; ++i) min_count = std::min(min_count, c[i].count);
+    return min_count;
+  }
+};
+
+template <typename T>
+static int TopKStateLen(int num_counters) {
+  return sizeof(TopKState) + num_counters * sizeof(TopKCounter<T>);
+}
+
+template <typename T>
+void AggregateFunctions::TopKInit(FunctionContext* ctx, StringVal* dst) {
+  // In a merge phase there is no 'k' argument, it is taken from the merged states.
+  int k = 0;
+  if (ctx->GetNumArgs() == 2) {
+    DCHECK(ctx->IsArgConstant(1));
+    BigIntVal* k_val = reinterpret_cast<BigIntVal*>(ctx->GetConstantArg(1));
+    if (k_val == NULL || k_val->is_null || k_val->val < 1 || k_val->val > TOPK_MAX_K) {
+      stringstream ss;
+      ss << "The second argument of APPX_TOPK() must be a constant between 1 and "
+         << TOPK_MAX_K;
+      ctx->SetError(ss.str().c_str());
+      k = 1;
+    } else {
+      k = k_val->val;
+    }
+  }
+  int max_counters = k == 0 ? 0 : std::max(k * TOPK_COUNTERS_PER_K, TOPK_MIN_COUNTERS);
+  AllocBuffer(ctx, dst, TopKStateLen<T>(max_counters));
+  if (UNLIKELY(dst->is_null)) {
+    DCHECK(!ctx->impl()->state()->GetQueryStatus().ok());
+    return;
+  }
+  TopKState* state = reinterpret_cast<TopKState*>(dst->ptr);
+  state->k = k;
+  state->max_counters = max_counters;
+  state->num_counters = 0;
+}
+
+template <typename T>
+void AggregateFunctions::TopKUpdate(FunctionContext* ctx, const T& src,
+    const BigIntVal&, StringVal* dst) {
+  if (src.is_null) return;
+  DCHECK(!dst->is_null);
+  TopKState* state = reinterpret_cast<TopKState*>(dst->ptr);
+  DCHECK_GT(state->max_counters, 0);
+  TopKCounter<T>* counters = state->counters<T>();
+  TopKValue<T> val(src);
+  int min_idx = 0;
+  for (int i = 0; i < state->num_counters; ++i) {
+    if (counters[i].val == val) {
+      ++counters[i].count;
+      return;
+    }
+    if (counters[i].count < counters[min_idx].count) min_idx = i;
+  }
+  if (state->num_counters < state->max_counters) {
+    counters[state->num_counters++] = TopKCounter<T>(val, 1, 0);
+    return;
+  }
+  // The new value replaces the least frequent one. It may have occurred as often as
+  // the replaced value before, without being counted.
+  int64_t min_count = counters[min_idx].count;
+  counters[min_idx] = TopKCounter<T>(val, min_count + 1, min_count);
+}
+
+template <typename T>
+void AggregateFunctions::TopKMerge(FunctionContext* ctx, const StringVal& src_val,
+    StringVal* dst_val) {
+  if (src_val.is_null) return;
+  DCHECK(!dst_val->is_null);
+  TopKState* src = reinterpret_cast<TopKState*>(src_val.ptr);
+  TopKState* dst = reinterpret_cast<TopKState*>(dst_val->ptr);
+  DCHECK_EQ(src_val.len, TopKStateLen<T>(src->num_counters));
+  if (src->max_counters > dst->max_counters) {
+    int len = TopKStateLen<T>(src->max_counters);
+    uint8_t* ptr = ctx->Reallocate(dst_val->ptr, len);
+    if (UNLIKELY(ptr == NULL)) {
+      DCHECK(!ctx->impl()->state()->GetQueryStatus().ok());
+      return;
+    }
+    *dst_val = StringVal(ptr, len);
+    dst = reinterpret_cast<TopKState*>(ptr);
+    dst->k = src->k;
+    dst->max_counters = src->max_counters;
+  }
+
+  // Merge the two summaries as described in Agarwal et al., "Mergeable Summaries". A
+  // value that is missing from one of them may have occurred up to that summary's
+  // MissingCount() times.
+  TopKCounter<T>* src_counters = src->counters<T>();
+  TopKCounter<T>* dst_counters = dst->counters<T>();
+  int64_t src_missing_count = src->MissingCount<T>();
+  int64_t dst_missing_count = dst->MissingCount<T>();
+  vector<TopKCounter<T> > merged(dst_counters, dst_counters + dst->num_counters);
+  vector<bool> src_merged(src->num_counters, false);
+  for (int i = 0; i < dst->num_counters; ++i) {
+    int j = 0;
+    while (j < src->num_counters && !(src_counters[j].val == merged[i].val)) ++j;
+    if (j < src->num_counters) {
+      merged[i].count += src_counters[j].count;
+      merged[i].error += src_counters[j].error;
+      src_merged[j] = true;
+    } else {
+      merged[i].count += src_missing_count;
+      merged[i].error += src_missing_count;
+    }
+  }
+  for (int j = 0; j < src->num_counters; ++j) {
+    if (src_merged[j]) continue;
+    merged.push_back(TopKCounter<T>(src_counters[j].val,
+        src_counters[j].count + dst_missing_count,
+        src_counters[j].error + dst_missing_count));
+  }
+
+  // Keep the most frequent values.
+  if (merged.size() > static_cast<size_t>(dst->max_counters)) {
+    std::nth_element(merged.begin(), merged.begin() + dst->max_counters, merged.end(),
+        TopKCountGreater<T>);
+    merged.resize(dst->max_counters);
+  }
+  std::copy(merged.begin(), merged.end(), dst_counters);
+  dst->num_counters = merged.size();
+}
+
+template <typename T>
+StringVal AggregateFunctions::TopKSerialize(FunctionContext* ctx,
+    const StringVal& src) {
+  if (UNLIKELY(src.is_null)) return src;
+  // Leave out the unused counters.
+  TopKState* state = reinterpret_cast<TopKState*>(src.ptr);
+  StringVal result =
+      StringVal::CopyFrom(ctx, src.ptr, TopKStateLen<T>(state->num_counters));
+  ctx->Free(src.ptr);
+  return result;
+}
+
+template <typename T>
+StringVal AggregateFunctions::TopKFinalize(FunctionContext* ctx, const StringVal& src) {
+  if (UNLIKELY(src.is_null)) return src;
+  TopKState* state = reinterpret_cast<TopKState*>(src.ptr);
+  TopKCounter<T>* counters = state->counters<T>();
+  int num_results = std::min(state->k, state->num_counters);
+  std::partial_sort(counters, counters + num_results, counters + state->num_counters,
+      TopKCountGreater<T>);
+
+  stringstream out;
+  for (int i = 0; i < num_results; ++i) {
+    counters[i].val.Print(&out);
+    out << " (" << counters[i].count << ")";
+    if (i < num_results - 1) out << ", ";
+  }
+  const string& out_str = out.str();
+  StringVal result = StringVal::CopyFrom(ctx,
+      reinterpret_cast<const uint8_t*>(out_str.c_str()), out_str.size());
+  ctx->Free(src.ptr);
+  return result;
+}
+
+// APPX_QUANTILE() constants.
+// The t-digest compression parameter. Larger values keep more centroids, which makes
+// the estimates more accurate but the state larger.
+const static int TDIGEST_COMPRESSION = 100;
+// Upper bound of the number of centroids after a compression. The scale function below
+// spans TDIGEST_COMPRESSION / 2 and every two adjacent centroids span more than 1, so
+// compressions leave at most TDIGEST_COMPRESSION + 2 centroids.
+const static int TDIGEST_MAX_CENTROIDS = TDIGEST_COMPRESSION + 2;
+// Number of centroids that are buffered before they are compressed.
+const static int TDIGEST_BUFFER_SIZE = 5 * TDIGEST_COMPRESSION;
+
+struct TDigestCentroid {
+  double mean;
+  double weight;
+};
+
+bool TDigestCentroidLess(const TDigestCentroid& i, const TDigestCentroid& j) {
+  return i.mean < j.mean;
+}
+
+// The intermediate state of APPX_QUANTILE(), a merging t-digest (Dunning and Ertl,
+// "Computing Extremely Accurate Quantiles Using t-Digests"). The header is followed by
+// 'num_centroids' compressed centroids, which are sorted by mean, and then by
+// 'num_buffered' centroids that were added since the last compression. The in-memory
+// state always has room for TDIGEST_MAX_CENTROIDS + TDIGEST_BUFFER_SIZE centroids.
+// Serialized states are compressed and only contain the centroids in use.
+struct TDigestState {
+  // The requested quantile, negative if the state was initialized in a merge phase and
+  // has not merged any input yet.
+  double quantile;
+  double min;
+  double max;
+  int32_t num_centroids;
+  int32_t num_buffered;
+
+  TDigestCentroid* centroids() { return reinterpret_cast<TDigestCentroid*>(this + 1); }
+
+  void Add(double mean, double weight) {
+    if (num_centroids + num_buffered == TDIGEST_MAX_CENTROIDS + TDIGEST_BUFFER_SIZE) {
+      Compress();
+    }
+    TDigestCentroid* c = &centroids()[num_centroids + num_buffered++];
+    c->mean = mean;
+    c->weight = weight;
+  }
+
+  // Sorts all centroids and greedily merges neighbours while the merged centroid spans
+  // at most 1 in the k1 scale function. The scale function makes the centroids near
+  // the tails small, which keeps extreme quantiles accurate.
+  void Compress() {
+    if (num_buffered == 0) return;
+    TDigestCentroid* c = centroids();
+    int n = num_centroids + num_buffered;
+    sort(c, c + n, TDigestCentroidLess);
+    double total_weight = 0;
+    for (int i = 0; i < n; ++i) total_weight += c[i].weight;
+
+    int num_out = 0;
+    TDigestCentroid current = c[0];
+    double weight_so_far = 0;
+    double k_left = ScaleFn(0);
+    for (int i = 1; i < n; ++i) {
+      double merged_weight = current.weight + c[i].weight;
+      if (ScaleFn((weight_so_far + merged_weight) / total_weight) - k_left <= 1) {
+        current.mean += (c[i].mean - current.mean) * c[i].weight / merged_weight;
+        current.weight = merged_weight;
+      } else {
+        c[num_out++] = current;
+        weight_so_far += current.weight;
+        k_left = ScaleFn(weight_so_far / total_weight);
+        current = c[i];
+      }
+    }
+    c[num_out++] = current;
+    DCHECK_LE(num_out, TDIGEST_MAX_CENTROIDS);
+    num_centroids = num_out;
+    num_buffered = 0;
+  }
+
+  static double ScaleFn(double q) {
+    return TDIGEST_COMPRESSION / (2 * M_PI) * asin(2 * std::min(q, 1.0) - 1);
+  }
+};
+
+static int TDigestStateLen(int num_centroids) {
+  return sizeof(TDigestState) + num_centroids * sizeof(TDigestCentroid);
+}
+
+void AggregateFunctions::TDigestInit(FunctionContext* ctx, StringVal* dst) {
+  AllocBuffer(ctx, dst, TDigestStateLen(TDIGEST_MAX_CENTROIDS + TDIGEST_BUFFER_SIZE));
+  if (UNLIKELY(dst->is_null)) {
+    DCHECK(!ctx->impl()->state()->GetQueryStatus().ok());
+    return;
+  }
+  TDigestState* state = reinterpret_cast<TDigestState*>(dst->ptr);
+  // In a merge phase there is no quantile argument, it is taken from the merged states.
+  state->quantile = -1;
+  if (ctx->GetNumArgs() == 2) {
+    DCHECK(ctx->IsArgConstant(1));
+    DoubleVal* q = reinterpret_cast<DoubleVal*>(ctx->GetConstantArg(1));
+    if (q == NULL || q->is_null || !(q->val >= 0 && q->val <= 1)) {
+      ctx->SetError(
+          "The second argument of APPX_QUANTILE() must be a constant between 0 and 1");
+      state->quantile = 0.5;
+    } else {
+      state->quantile = q->val;
+    }
+  }
+  state->min = std::numeric_limits<double>::infinity();
+  state->max = -std::numeric_limits<double>::infinity();
+  state->num_centroids = 0;
+  state->num_buffered = 0;
+}
+
+void AggregateFunctions::TDigestUpdate(FunctionContext* ctx, const DoubleVal& src,
+    const DoubleVal&, StringVal* dst) {
+  // NaNs have no rank, skip them like NULLs.
+  if (src.is_null || isnan(src.val)) return;
+  DCHECK(!dst->is_null);
+  TDigestState* state = reinterpret_cast<TDigestState*>(dst->ptr);
+  state->min = std::min(state->min, src.val);
+  state->max = std::max(state->max, src.val);
+  state->Add(src.val, 1);
+}
+
+void AggregateFunctions::TDigestMerge(FunctionContext* ctx, const StringVal& src_val,
+    StringVal* dst_val) {
+  if (src_val.is_null) return;
+  DCHECK(!dst_val->is_null);
+  TDigestState* src = reinterpret_cast<TDigestState*>(src_val.ptr);
+  TDigestState* dst = reinterpret_cast<TDigestState*>(dst_val->ptr);
+  DCHECK_EQ(src->num_buffered, 0);
+  DCHECK_EQ(src_val.len, TDigestStateLen(src->num_centroids));
+  if (dst->quantile < 0) dst->quantile = src->quantile;
+  dst->min = std::min(dst->min, src->min);
+  dst->max = std::max(dst->max, src->max);
+  TDigestCentroid* src_centroids = src->centroids();
+  for (int i = 0; i < src->num_centroids; ++i) {
+    dst->Add(src_centroids[i].mean, src_centroids[i].weight);
+  }
+}
+
+StringVal AggregateFunctions::TDigestSerialize(FunctionContext* ctx,
+    const StringVal& src) {
+  if (UNLIKELY(src.is_null)) return src;
+  TDigestState* state = reinterpret_cast<TDigestState*>(src.ptr);
+  state->Compress();
+  StringVal result =
+      StringVal::CopyFrom(ctx, src.ptr, TDigestStateLen(state->num_centroids));
+  ctx->Free(src.ptr);
+  return result;
+}
+
+DoubleVal AggregateFunctions::TDigestFinalize(FunctionContext* ctx,
+    const StringVal& src) {
+  if (UNLIKELY(src.is_null)) return DoubleVal::null();
+  TDigestState* state = reinterpret_cast<TDigestState*>(src.ptr);
+  state->Compress();
+  int n = state->num_centroids;
+  if (n == 0) {
+    ctx->Free(src.ptr);
+    return DoubleVal::null();
+  }
+
+  // Each centroid is assumed to be centered on its mean, i.e. half of its weight is
+  // below it. Interpolate linearly between the means of neighbouring centroids, and
+  // between the min (max) and the first (last) centroid.
+  TDigestCentroid* c = state->centroids();
+  double total_weight = 0;
+  for (int i = 0; i < n; ++i) total_weight += c[i].weight;
+  double target = state->quantile * total_weight;
+  double first_half = c[0].weight / 2;
+  double last_half = c[n - 1].weight / 2;
+  double result;
+  if (target <= first_half) {
+    result = state->min + (c[0].mean - state->min) * target / first_half;
+  } else if (target >= total_weight - last_half) {
+    result = c[n - 1].mean + (state->max - c[n - 1].mean) *
+        (target - (total_weight - last_half)) / last_half;
+  } else {
+    double weight_so_far = first_half;
+    int i = 0;
+    double delta = (c[0].weight + c[1].weight) / 2;
+    while (target > weight_so_far + delta && i < n - 2) {
+      weight_so_far += delta;
+      ++i;
+      delta = (c[i].weight + c[i + 1].weight) / 2;
+    }
+    result = c[i].mean + (c[i + 1].mean - c[i].mean) * (target - weight_so_far) / delta;
+  }
+  result = std::max(state->min, std::min(state->max, result));
+  ctx->Free(src.ptr);
+  return DoubleVal(result);
+}
+
+// The NDV intermediate value is stored in one of two representations, which are told
+// apart by their length:
+//  - Dense: HLL_LEN bytes, one per register.
+//  - Sparse: fewer than HLL_LEN bytes, a sorted array of uint16_t entries, one for each
+//    non-zero register. Each entry holds the register index in its upper bits and the
+//    register value in its lower HLL_SPARSE_VALUE_BITS bits.
+// Values start out sparse, so that groups with few distinct values (the common case
+// when grouping by a high-cardinality key) only take a few bytes and don't have to
+// initialize and merge HLL_LEN registers.
 void AggregateFunctions::HllInit(FunctionContext* ctx, StringVal* dst) {
-  AllocBuffer(ctx, dst, HLL_LEN);
+  // An empty sparse value. The buffer is allocated by the first update.
+  *dst = StringVal();
+}
+
+// Converts the sparse intermediate value 'dst' to a dense one. Returns false and leaves
+// 'dst' unchanged if the allocation fails.
+static bool HllSparseToDense(FunctionContext* ctx, StringVal* dst) {
+  DCHECK_LT(dst->len, AggregateFunctions::HLL_LEN);
+  uint8_t* registers = ctx->Allocate(AggregateFunctions::HLL_LEN);
+  if (UNLIKELY(registers == NULL)) {
+    DCHECK(!ctx->impl()->state()->GetQueryStatus().ok());
+    return false;
+  }
+  AggregateFunctions::HllGetRegisters(*dst, registers);
+  ctx->Free(dst->ptr);
+  *dst = StringVal(registers, AggregateFunctions::HLL_LEN);
+  return true;
+}
+
+// Sets register 'idx' of 'dst' to 'value' if that is larger than its current value.
+// May grow a sparse 'dst' or convert it to a dense one.
+static void HllUpdateRegister(FunctionContext* ctx, int idx, uint8_t value,
+    StringVal* dst) {
+  DCHECK_GT(value, 0);
+  if (dst->len == AggregateFunctions::HLL_LEN) {
+    dst->ptr[idx] = std::max(dst->ptr[idx], value);
+    return;
+  }
+
+  // The entries are sorted by register index, which is in their upper bits.
+  uint16_t* entries = reinterpret_cast<uint16_t*>(dst->ptr);
+  int num_entries = dst->len / sizeof(uint16_t);
+  uint16_t key = idx << HLL_SPARSE_VALUE_BITS;
+  uint16_t* it = std::lower_bound(entries, entries + num_entries, key);
+  if (it != entries + num_entries && (*it >> HLL_SPARSE_VALUE_BITS) == idx) {
+    if ((*it & HLL_SPARSE_VALUE_MASK) < value) *it = key | value;
+    return;
+  }
+
+  if (dst->len + static_cast<int>(sizeof(uint16_t)) > HLL_SPARSE_MAX_LEN) {
+    if (!HllSparseToDense(ctx, dst)) return;
+    dst->ptr[idx] = value;
+    return;
+  }
+  int pos = it - entries;
+  // The pool allocations are rounded up to a power of two, so most of these don't move
+  // the buffer.
+  uint8_t* ptr = ctx->Reallocate(dst->ptr, dst->len + sizeof(uint16_t));
+  if (UNLIKELY(ptr == NULL)) {
+    DCHECK(!ctx->impl()->state()->GetQueryStatus().ok());
+    return;
+  }
+  entries = reinterpret_cast<uint16_t*>(ptr);
+  memmove(entries + pos + 1, entries + pos, (num_entries - pos) * sizeof(uint16_t));
+  entries[pos] = key | value;
+  dst->ptr = ptr;
+  dst->len += sizeof(uint16_t);
 }
 
 template <typename T>
 void AggregateFunctions::HllUpdate(FunctionContext* ctx, const T& src, StringVal* dst) {
   if (src.is_null) return;
   DCHECK(!dst->is_null);
-  DCHECK_EQ(dst->len, HLL_LEN);
+  DCHECK_LE(dst->len, HLL_LEN);
   uint64_t hash_value =
       AnyValUtil::Hash64(src, *ctx->GetArgType(0), HashUtil::FNV64_SEED);
   if (hash_value != 0) {
@@ -1149,7 +1687,7 @@ void AggregateFunctions::HllUpdate(FunctionContext* ctx, const T& src, StringVal
     // find the first 1 bit after the index bits.
     int idx = hash_value & (HLL_LEN - 1);
     uint8_t first_one_bit = __builtin_ctzl(hash_value >> HLL_PRECISION) + 1;
-    dst->ptr[idx] = ::max(dst->ptr[idx], first_one_bit);
+    HllUpdateRegister(ctx, idx, first_one_bit, dst);
   }
 }
 
@@ -1157,10 +1695,41 @@ void AggregateFunctions::HllMerge(FunctionContext* ctx, const StringVal& src,
     StringVal* dst) {
   DCHECK(!dst->is_null);
   DCHECK(!src.is_null);
-  DCHECK_EQ(dst->len, HLL_LEN);
-  DCHECK_EQ(src.len, HLL_LEN);
-  for (int i = 0; i < src.len; ++i) {
-    dst->ptr[i] = ::max(dst->ptr[i], src.ptr[i]);
+  DCHECK_LE(dst->len, HLL_LEN);
+  DCHECK_LE(src.len, HLL_LEN);
+  if (src.len != HLL_LEN) {
+    const uint16_t* entries = reinterpret_cast<const uint16_t*>(src.ptr);
+    int num_entries = src.len / sizeof(uint16_t);
+    for (int i = 0; i < num_entries; ++i) {
+      HllUpdateRegister(ctx, entries[i] >> HLL_SPARSE_VALUE_BITS,
+          entries[i] & HLL_SPARSE_VALUE_MASK, dst);
+    }
+    return;
+  }
+
+  if (dst->len != HLL_LEN && !HllSparseToDense(ctx, dst)) return;
+  // Take the maximum of 16 registers at a time. SSE2 is always available on x86-64.
+  for (int i = 0; i < HLL_LEN; i += sizeof(__m128i)) {
+    __m128i src_registers =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src.ptr + i));
+    __m128i dst_registers = _mm_loadu_si128(reinterpret_cast<__m128i*>(dst->ptr + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst->ptr + i),
+        _mm_max_epu8(src_registers, dst_registers));
+  }
+}
+
+void AggregateFunctions::HllGetRegisters(const StringVal& src, uint8_t* registers) {
+  DCHECK(!src.is_null);
+  DCHECK_LE(src.len, HLL_LEN);
+  if (src.len == HLL_LEN) {
+    memcpy(registers, src.ptr, HLL_LEN);
+    return;
+  }
+  memset(registers, 0, HLL_LEN);
+  const uint16_t* entries = reinterpret_cast<const uint16_t*>(src.ptr);
+  int num_entries = src.len / sizeof(uint16_t);
+  for (int i = 0; i < num_entries; ++i) {
+    registers[entries[i] >> HLL_SPARSE_VALUE_BITS] = entries[i] & HLL_SPARSE_VALUE_MASK;
   }
 }
 
@@ -1206,7 +1775,14 @@ uint64_t AggregateFunctions::HllFinalEstimate(const uint8_t* buckets,
 
 BigIntVal AggregateFunctions::HllFinalize(FunctionContext* ctx, const StringVal& src) {
   if (UNLIKELY(src.is_null)) return BigIntVal::null();
-  uint64_t estimate = HllFinalEstimate(src.ptr, src.len);
+  uint64_t estimate;
+  if (src.len == HLL_LEN) {
+    estimate = HllFinalEstimate(src.ptr, src.len);
+  } else {
+    uint8_t registers[HLL_LEN];
+    HllGetRegisters(src, registers);
+    estimate = HllFinalEstimate(registers, HLL_LEN);
+  }
   ctx->Free(src.ptr);
   return estimate;
 }
@@ -1719,6 +2295,111 @@ template TimestampVal AggregateFunctions::AppxMedianFinalize<TimestampVal>(
 template DecimalVal AggregateFunctions::AppxMedianFinalize<DecimalVal>(
     FunctionContext*, const StringVal&);
 
+template void AggregateFunctions::TopKInit<BooleanVal>(
+    FunctionContext*, StringVal*);
+template void AggregateFunctions::TopKInit<TinyIntVal>(
+    FunctionContext*, StringVal*);
+template void AggregateFunctions::TopKInit<SmallIntVal>(
+    FunctionContext*, StringVal*);
+template void AggregateFunctions::TopKInit<IntVal>(
+    FunctionContext*, StringVal*);
+template void AggregateFunctions::TopKInit<BigIntVal>(
+    FunctionContext*, StringVal*);
+template void AggregateFunctions::TopKInit<FloatVal>(
+    FunctionContext*, StringVal*);
+template void AggregateFunctions::TopKInit<DoubleVal>(
+    FunctionContext*, StringVal*);
+template void AggregateFunctions::TopKInit<StringVal>(
+    FunctionContext*, StringVal*);
+template void AggregateFunctions::TopKInit<TimestampVal>(
+    FunctionContext*, StringVal*);
+template void AggregateFunctions::TopKInit<DecimalVal>(
+    FunctionContext*, StringVal*);
+
+template void AggregateFunctions::TopKUpdate<BooleanVal>(
+    FunctionContext*, const BooleanVal&, const BigIntVal&, StringVal*);
+template void AggregateFunctions::TopKUpdate<TinyIntVal>(
+    FunctionContext*, const TinyIntVal&, const BigIntVal&, StringVal*);
+template void AggregateFunctions::TopKUpdate<SmallIntVal>(
+    FunctionContext*, const SmallIntVal&, const BigIntVal&, StringVal*);
+template void AggregateFunctions::TopKUpdate<IntVal>(
+    FunctionContext*, const IntVal&, const BigIntVal&, StringVal*);
+template void AggregateFunctions::TopKUpdate<BigIntVal>(
+    FunctionContext*, const BigIntVal&, const BigIntVal&, StringVal*);
+template void AggregateFunctions::TopKUpdate<FloatVal>(
+    FunctionContext*, const FloatVal&, const BigIntVal&, StringVal*);
+template void AggregateFunctions::TopKUpdate<DoubleVal>(
+    FunctionContext*, const DoubleVal&, const BigIntVal&, StringVal*);
+template void AggregateFunctions::TopKUpdate<StringVal>(
+    FunctionContext*, const StringVal&, const BigIntVal&, StringVal*);
+template void AggregateFunctions::TopKUpdate<TimestampVal>(
+    FunctionContext*, const TimestampVal&, const BigIntVal&, StringVal*);
+template void AggregateFunctions::TopKUpdate<DecimalVal>(
+    FunctionContext*, const DecimalVal&, const BigIntVal&, StringVal*);
+
+template void AggregateFunctions::TopKMerge<BooleanVal>(
+    FunctionContext*, const StringVal&, StringVal*);
+template void AggregateFunctions::TopKMerge<TinyIntVal>(
+    FunctionContext*, const StringVal&, StringVal*);
+template void AggregateFunctions::TopKMerge<SmallIntVal>(
+    FunctionContext*, const StringVal&, StringVal*);
+template void AggregateFunctions::TopKMerge<IntVal>(
+    FunctionContext*, const StringVal&, StringVal*);
+template void AggregateFunctions::TopKMerge<BigIntVal>(
+    FunctionContext*, const StringVal&, StringVal*);
+template void AggregateFunctions::TopKMerge<FloatVal>(
+    FunctionContext*, const StringVal&, StringVal*);
+template void AggregateFunctions::TopKMerge<DoubleVal>(
+    FunctionContext*, const StringVal&, StringVal*);
+template void AggregateFunctions::TopKMerge<StringVal>(
+    FunctionContext*, const StringVal&, StringVal*);
+template void AggregateFunctions::TopKMerge<TimestampVal>(
+    FunctionContext*, const StringVal&, StringVal*);
+template void AggregateFunctions::TopKMerge<DecimalVal>(
+    FunctionContext*, const StringVal&, StringVal*);
+
+template StringVal AggregateFunctions::TopKSerialize<BooleanVal>(
+    FunctionContext*, const StringVal&);
+template StringVal AggregateFunctions::TopKSerialize<TinyIntVal>(
+    FunctionContext*, const StringVal&);
+template StringVal AggregateFunctions::TopKSerialize<SmallIntVal>(
+    FunctionContext*, const StringVal&);
+template StringVal AggregateFunctions::TopKSerialize<IntVal>(
+    FunctionContext*, const StringVal&);
+template StringVal AggregateFunctions::TopKSerialize<BigIntVal>(
+    FunctionContext*, const StringVal&);
+template StringVal AggregateFunctions::TopKSerialize<FloatVal>(
+    FunctionContext*, const StringVal&);
+template StringVal AggregateFunctions::TopKSerialize<DoubleVal>(
+    FunctionContext*, const StringVal&);
+template StringVal AggregateFunctions::TopKSerialize<StringVal>(
+    FunctionContext*, const StringVal&);
+template StringVal AggregateFunctions::TopKSerialize<TimestampVal>(
+    FunctionContext*, const StringVal&);
+template StringVal AggregateFunctions::TopKSerialize<DecimalVal>(
+    FunctionContext*, const StringVal&);
+
+template StringVal AggregateFunctions::TopKFinalize<BooleanVal>(
+    FunctionContext*, const StringVal&);
+template StringVal AggregateFunctions::TopKFinalize<TinyIntVal>(
+    FunctionContext*, const StringVal&);
+template StringVal AggregateFunctions::TopKFinalize<SmallIntVal>(
+    FunctionContext*, const StringVal&);
+template StringVal AggregateFunctions::TopKFinalize<IntVal>(
+    FunctionContext*, const StringVal&);
+template StringVal AggregateFunctions::TopKFinalize<BigIntVal>(
+    FunctionContext*, const StringVal&);
+template StringVal AggregateFunctions::TopKFinalize<FloatVal>(
+    FunctionContext*, const StringVal&);
+template StringVal AggregateFunctions::TopKFinalize<DoubleVal>(
+    FunctionContext*, const StringVal&);
+template StringVal AggregateFunctions::TopKFinalize<StringVal>(
+    FunctionContext*, const StringVal&);
+template StringVal AggregateFunctions::TopKFinalize<TimestampVal>(
+    FunctionContext*, const StringVal&);
+template StringVal AggregateFunctions::TopKFinalize<DecimalVal>(
+    FunctionContext*, const StringVal&);
+
 template void AggregateFunctions::HllUpdate(
     FunctionContext*, const BooleanVal&, StringVal*);
 template void AggregateFunctions::HllUpdate(
@@ -166,11 +166,40 @@ class AggregateFunctions {
   template <typename T>
   static StringVal HistogramFinalize(FunctionContext*, const StringVal& src);
 
+  /// Approximate top-k, APPX_TOPK(col, k). Returns the (approximately) k most frequent
+  /// values with their estimated counts, e.g. "a (100), b (50)". Uses a Space-Saving
+  /// summary with a bounded number of counters, so the intermediate state has a fixed
+  /// maximum size and merges cheaply. Estimated counts are upper bounds.
+  template <typename T>
+  static void TopKInit(FunctionContext*, StringVal* dst);
+  template <typename T>
+  static void TopKUpdate(FunctionContext*, const T& src, const BigIntVal& k,
+      StringVal* dst);
+  template <typename T>
+  static void TopKMerge(FunctionContext*, const StringVal& src, StringVal* dst);
+  template <typename T>
+  static StringVal TopKSerialize(FunctionContext*, const StringVal& src);
+  template <typename T>
+  static StringVal TopKFinalize(FunctionContext*, const StringVal& src);
+
+  /// Approximate quantile, APPX_QUANTILE(col, q). Returns an estimate of the q-th
+  /// quantile of col, for a constant q in [0, 1]. Uses a merging t-digest, so the
+  /// intermediate state has bounded size for any input, merges cheaply and is most
+  /// accurate for extreme quantiles like 0.99 or 0.999.
+  static void TDigestInit(FunctionContext*, StringVal* dst);
+  static void TDigestUpdate(FunctionContext*, const DoubleVal& src, const DoubleVal& q,
+      StringVal* dst);
+  static void TDigestMerge(FunctionContext*, const StringVal& src, StringVal* dst);
+  static StringVal TDigestSerialize(FunctionContext*, const StringVal& src);
+  static DoubleVal TDigestFinalize(FunctionContext*, const StringVal& src);
+
   /// Hyperloglog distinct estimate algorithm.
   /// See these papers for more details.
   /// 1) Hyperloglog: The analysis of a near-optimal cardinality estimation
   /// algorithm (2007)
   /// 2) HyperLogLog in Practice (paper from google with some improvements)
+  /// The intermediate value uses a sparse representation until enough registers are
+  /// set, and a dense array of HLL_LEN registers after that. See HllInit().
   static const int HLL_PRECISION;
   static const int HLL_LEN;
   static void HllInit(FunctionContext*, StringVal* slot);
@@ -179,6 +208,10 @@ class AggregateFunctions {
   static void HllMerge(FunctionContext*, const StringVal& src, StringVal* dst);
   static BigIntVal HllFinalize(FunctionContext*, const StringVal& src);
 
+  /// Writes the HLL_LEN registers of the sparse or dense intermediate value 'src' to
+  /// 'registers'.
+  static void HllGetRegisters(const StringVal& src, uint8_t* registers);
+
   /// Utility method to compute the final result of an HLL estimation from num_buckets
   /// estimates.
   static uint64_t HllFinalEstimate(const uint8_t* buckets, int32_t num_buckets);
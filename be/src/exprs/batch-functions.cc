@@ -0,0 +1,172 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "exprs/batch-functions.h"
+
+#include <boost/unordered_map.hpp>
+
+#include "exprs/cast-functions.h"
+#include "exprs/operators.h"
+#include "exprs/timestamp-functions.h"
+#include "exprs/udf-builtins.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+typedef boost::unordered_map<const void*, BatchScalarFn> BatchFnMap;
+
+template<typename R, typename A, R (*FN)(FunctionContext*, const A&)>
+static void UnaryBatchFn(FunctionContext* ctx, int num_rows, const void* const* args,
+    void* results) {
+  const A* a = reinterpret_cast<const A*>(args[0]);
+  R* r = reinterpret_cast<R*>(results);
+  for (int i = 0; i < num_rows; ++i) r[i] = FN(ctx, a[i]);
+}
+
+template<typename R, typename A, typename B,
+    R (*FN)(FunctionContext*, const A&, const B&)>
+static void BinaryBatchFn(FunctionContext* ctx, int num_rows, const void* const* args,
+    void* results) {
+  const A* a = reinterpret_cast<const A*>(args[0]);
+  const B* b = reinterpret_cast<const B*>(args[1]);
+  R* r = reinterpret_cast<R*>(results);
+  for (int i = 0; i < num_rows; ++i) r[i] = FN(ctx, a[i], b[i]);
+}
+
+template<typename R, typename A, R (*FN)(FunctionContext*, const A&)>
+static void RegisterUnary(BatchFnMap* fns) {
+  (*fns)[reinterpret_cast<const void*>(FN)] = &UnaryBatchFn<R, A, FN>;
+}
+
+template<typename R, typename A, typename B,
+    R (*FN)(FunctionContext*, const A&, const B&)>
+static void RegisterBinary(BatchFnMap* fns) {
+  (*fns)[reinterpret_cast<const void*>(FN)] = &BinaryBatchFn<R, A, B, FN>;
+}
+
+#define REGISTER_BINARY_OP(NAME, TYPE) \
+  RegisterBinary<TYPE, TYPE, TYPE, &Operators::NAME##_##TYPE##_##TYPE>(fns)
+
+#define REGISTER_INT_OPS(NAME) \
+  REGISTER_BINARY_OP(NAME, TinyIntVal); \
+  REGISTER_BINARY_OP(NAME, SmallIntVal); \
+  REGISTER_BINARY_OP(NAME, IntVal); \
+  REGISTER_BINARY_OP(NAME, BigIntVal)
+
+#define REGISTER_NUMERIC_OPS(NAME) \
+  REGISTER_INT_OPS(NAME); \
+  REGISTER_BINARY_OP(NAME, FloatVal); \
+  REGISTER_BINARY_OP(NAME, DoubleVal)
+
+#define REGISTER_BITNOT(TYPE) \
+  RegisterUnary<TYPE, TYPE, &Operators::Bitnot_##TYPE>(fns)
+
+#define REGISTER_PREDICATE(NAME, TYPE) \
+  RegisterBinary<BooleanVal, TYPE, TYPE, &Operators::NAME##_##TYPE##_##TYPE>(fns)
+
+#define REGISTER_PREDICATES(NAME) \
+  REGISTER_PREDICATE(NAME, BooleanVal); \
+  REGISTER_PREDICATE(NAME, TinyIntVal); \
+  REGISTER_PREDICATE(NAME, SmallIntVal); \
+  REGISTER_PREDICATE(NAME, IntVal); \
+  REGISTER_PREDICATE(NAME, BigIntVal); \
+  REGISTER_PREDICATE(NAME, FloatVal); \
+  REGISTER_PREDICATE(NAME, DoubleVal); \
+  REGISTER_PREDICATE(NAME, StringVal); \
+  REGISTER_PREDICATE(NAME, TimestampVal); \
+  RegisterBinary<BooleanVal, StringVal, StringVal, &Operators::NAME##_Char_Char>(fns)
+
+#define REGISTER_TIMESTAMP_FIELD(NAME) \
+  RegisterUnary<IntVal, TimestampVal, &TimestampFunctions::NAME>(fns)
+
+#define REGISTER_CAST(FROM_TYPE, TO_TYPE) \
+  RegisterUnary<TO_TYPE, FROM_TYPE, &CastFunctions::CastTo##TO_TYPE>(fns)
+
+#define REGISTER_CASTS_TO(TO_TYPE, T1, T2, T3, T4, T5, T6) \
+  REGISTER_CAST(T1, TO_TYPE); \
+  REGISTER_CAST(T2, TO_TYPE); \
+  REGISTER_CAST(T3, TO_TYPE); \
+  REGISTER_CAST(T4, TO_TYPE); \
+  REGISTER_CAST(T5, TO_TYPE); \
+  REGISTER_CAST(T6, TO_TYPE)
+
+// The registrations live here rather than next to the builtins because operators.cc,
+// cast-functions.cc and the timestamp builtins are also cross-compiled into the impala
+// IR module.
+static BatchFnMap* CreateBatchFns() {
+  BatchFnMap* fns = new BatchFnMap();
+  REGISTER_NUMERIC_OPS(Add);
+  REGISTER_NUMERIC_OPS(Subtract);
+  REGISTER_NUMERIC_OPS(Multiply);
+  REGISTER_BINARY_OP(Divide, DoubleVal);
+  REGISTER_INT_OPS(Int_divide);
+  REGISTER_INT_OPS(Mod);
+  REGISTER_INT_OPS(Bitand);
+  REGISTER_INT_OPS(Bitxor);
+  REGISTER_INT_OPS(Bitor);
+  REGISTER_BITNOT(TinyIntVal);
+  REGISTER_BITNOT(SmallIntVal);
+  REGISTER_BITNOT(IntVal);
+  REGISTER_BITNOT(BigIntVal);
+
+  REGISTER_PREDICATES(Eq);
+  REGISTER_PREDICATES(Ne);
+  REGISTER_PREDICATES(Gt);
+  REGISTER_PREDICATES(Lt);
+  REGISTER_PREDICATES(Ge);
+  REGISTER_PREDICATES(Le);
+  REGISTER_PREDICATES(DistinctFrom);
+  REGISTER_PREDICATES(NotDistinct);
+
+  REGISTER_CASTS_TO(BooleanVal,
+      TinyIntVal, SmallIntVal, IntVal, BigIntVal, FloatVal, DoubleVal);
+  REGISTER_CASTS_TO(TinyIntVal,
+      BooleanVal, SmallIntVal, IntVal, BigIntVal, FloatVal, DoubleVal);
+  REGISTER_CASTS_TO(SmallIntVal,
+      BooleanVal, TinyIntVal, IntVal, BigIntVal, FloatVal, DoubleVal);
+  REGISTER_CASTS_TO(IntVal,
+      BooleanVal, TinyIntVal, SmallIntVal, BigIntVal, FloatVal, DoubleVal);
+  REGISTER_CASTS_TO(BigIntVal,
+      BooleanVal, TinyIntVal, SmallIntVal, IntVal, FloatVal, DoubleVal);
+  REGISTER_CASTS_TO(FloatVal,
+      BooleanVal, TinyIntVal, SmallIntVal, IntVal, BigIntVal, DoubleVal);
+  REGISTER_CASTS_TO(DoubleVal,
+      BooleanVal, TinyIntVal, SmallIntVal, IntVal, BigIntVal, FloatVal);
+
+  REGISTER_TIMESTAMP_FIELD(Year);
+  REGISTER_TIMESTAMP_FIELD(Month);
+  REGISTER_TIMESTAMP_FIELD(DayOfWeek);
+  REGISTER_TIMESTAMP_FIELD(DayOfMonth);
+  REGISTER_TIMESTAMP_FIELD(DayOfYear);
+  REGISTER_TIMESTAMP_FIELD(Hour);
+  REGISTER_TIMESTAMP_FIELD(Minute);
+  REGISTER_TIMESTAMP_FIELD(Second);
+  IntVal (*extract)(FunctionContext*, const StringVal&, const TimestampVal&) =
+      &UdfBuiltins::Extract;
+  IntVal (*swapped_extract)(FunctionContext*, const TimestampVal&, const StringVal&) =
+      &UdfBuiltins::Extract;
+  (*fns)[reinterpret_cast<const void*>(extract)] = &UdfBuiltins::ExtractBatch;
+  (*fns)[reinterpret_cast<const void*>(swapped_extract)] =
+      &UdfBuiltins::SwappedExtractBatch;
+  return fns;
+}
+
+BatchScalarFn BatchFunctions::Lookup(const void* scalar_fn) {
+  // Built on first use and never modified afterwards, so lookups need no lock.
+  static const BatchFnMap* fns = CreateBatchFns();
+  BatchFnMap::const_iterator it = fns->find(scalar_fn);
+  return it == fns->end() ? NULL : it->second;
+}
@@ -0,0 +1,44 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#ifndef IMPALA_EXPRS_BATCH_FUNCTIONS_H
+#define IMPALA_EXPRS_BATCH_FUNCTIONS_H
+
+#include "udf/udf.h"
+
+using namespace impala_udf;
+
+namespace impala {
+
+/// Signature of the batch version of a scalar function. 'args' holds one array of
+/// 'num_rows' *Vals per argument of the scalar function, and the 'num_rows' results are
+/// written to 'results'. This is the same signature as that of batch UDFs.
+typedef UdfBatchFn BatchScalarFn;
+
+/// Registry of the batch versions of builtins, which are used by
+/// ScalarFnCall::EvalBatch() instead of calling the builtin through its function pointer
+/// once per row. The batch versions call the builtin in a loop in which it is inlined,
+/// so that simple functions like the arithmetic operators, comparisons and casts
+/// between numeric types compile to tight loops over the argument arrays.
+class BatchFunctions {
+ public:
+  /// Returns the batch version of the builtin 'scalar_fn', or NULL if it has none.
+  static BatchScalarFn Lookup(const void* scalar_fn);
+};
+
+}
+
+#endif
@@ -0,0 +1,274 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "exprs/cached-expr.h"
+
+#include <sstream>
+#include <gflags/gflags.h>
+
+#include "common/object-pool.h"
+#include "exprs/expr-context.h"
+#include "exprs/hive-udf-call.h"
+#include "exprs/literal.h"
+#include "exprs/scalar-fn-call.h"
+#include "exprs/slot-ref.h"
+#include "runtime/string-value.h"
+#include "runtime/tuple-row.h"
+#include "runtime/tuple.h"
+
+#include "gen-cpp/Exprs_types.h"
+
+#include "common/names.h"
+
+using namespace impala;
+using namespace impala_udf;
+
+DEFINE_bool(enable_subexpr_caching, true, "(Advanced) If true, expensive "
+    "subexpressions that occur more than once in the grouping exprs and aggregate "
+    "function inputs of an aggregation are evaluated once per distinct input.");
+
+CachedExpr::CachedExpr(Expr* child, int cache_idx)
+  : Expr(child->type()),
+    cache_idx_(cache_idx) {
+  children_.push_back(child);
+}
+
+SubexprCache* CachedExpr::ShareSubexprs(ObjectPool* pool,
+    const vector<ExprContext*>& ctxs) {
+  if (!FLAGS_enable_subexpr_caching) return NULL;
+  // Count the occurrences of each cacheable subexpression, including nested ones.
+  map<string, int> counts;
+  for (int i = 0; i < ctxs.size(); ++i) {
+    vector<const Expr*> stack(1, ctxs[i]->root());
+    while (!stack.empty()) {
+      const Expr* e = stack.back();
+      stack.pop_back();
+      string fingerprint;
+      if (IsExpensive(e) && GetFingerprint(e, &fingerprint)) ++counts[fingerprint];
+      for (int j = 0; j < e->GetNumChildren(); ++j) stack.push_back(e->GetChild(j));
+    }
+  }
+  // Wrap the outermost repeated subexpressions.
+  map<string, int> cache_idxs;
+  for (int i = 0; i < ctxs.size(); ++i) {
+    WrapSubexprs(pool, counts, &cache_idxs, &ctxs[i]->root_);
+  }
+  if (cache_idxs.empty()) return NULL;
+  SubexprCache* cache = pool->Add(new SubexprCache(cache_idxs.size()));
+  for (int i = 0; i < ctxs.size(); ++i) ctxs[i]->subexpr_cache_ = cache;
+  VLOG_QUERY << "Caching " << cache_idxs.size() << " shared subexpressions of "
+             << Expr::DebugString(ctxs);
+  return cache;
+}
+
+void CachedExpr::WrapSubexprs(ObjectPool* pool, const map<string, int>& counts,
+    map<string, int>* cache_idxs, Expr** e) {
+  string fingerprint;
+  if (IsExpensive(*e) && GetFingerprint(*e, &fingerprint)) {
+    map<string, int>::const_iterator count = counts.find(fingerprint);
+    DCHECK(count != counts.end());
+    if (count->second > 1) {
+      // All occurrences of the same subexpression share one entry.
+      map<string, int>::iterator it = cache_idxs->find(fingerprint);
+      int cache_idx = it != cache_idxs->end() ? it->second : cache_idxs->size();
+      (*cache_idxs)[fingerprint] = cache_idx;
+      *e = pool->Add(new CachedExpr(*e, cache_idx));
+      return;
+    }
+  }
+  for (int i = 0; i < (*e)->children_.size(); ++i) {
+    WrapSubexprs(pool, counts, cache_idxs, &(*e)->children_[i]);
+  }
+}
+
+bool CachedExpr::IsExpensive(const Expr* e) {
+  if (dynamic_cast<const HiveUdfCall*>(e) != NULL) return true;
+  if (dynamic_cast<const ScalarFnCall*>(e) == NULL) return false;
+  return e->fn_.binary_type != TFunctionBinaryType::BUILTIN ||
+      e->type_.IsVarLenStringType() || e->type_.type == TYPE_TIMESTAMP;
+}
+
+bool CachedExpr::GetFingerprint(const Expr* e, string* fingerprint) {
+  // CHAR values have several slot layouts and complex types have no scalar value, so
+  // they cannot be part of the key or the result.
+  if (e->type_.type == TYPE_CHAR || e->type_.IsComplexType()) return false;
+  stringstream out;
+  if (e->is_slotref()) {
+    out << "slot(" << static_cast<const SlotRef*>(e)->slot_id() << ")";
+  } else if (dynamic_cast<const Literal*>(e) != NULL) {
+    out << e->DebugString();
+  } else if (dynamic_cast<const ScalarFnCall*>(e) != NULL ||
+      dynamic_cast<const HiveUdfCall*>(e) != NULL) {
+    // The results of these builtins differ between calls with the same arguments.
+    const string& name = e->fn_.name.function_name;
+    if (e->fn_.binary_type == TFunctionBinaryType::BUILTIN &&
+        (name == "rand" || name == "random" || name == "uuid" || name == "sleep")) {
+      return false;
+    }
+    out << "fn(" << e->fn_.name.function_name << "," << e->fn_.binary_type << ","
+        << e->fn_.hdfs_location << "," << e->fn_.scalar_fn.symbol << ")";
+  } else {
+    return false;
+  }
+  out << ":" << e->type_.DebugString() << "(";
+  fingerprint->append(out.str());
+  for (int i = 0; i < e->children_.size(); ++i) {
+    if (!GetFingerprint(e->children_[i], fingerprint)) return false;
+    fingerprint->push_back(',');
+  }
+  fingerprint->push_back(')');
+  return true;
+}
+
+Status CachedExpr::Prepare(RuntimeState* state, const RowDescriptor& row_desc,
+    ExprContext* context) {
+  RETURN_IF_ERROR(Expr::Prepare(state, row_desc, context));
+  // Cache hits of strings are copied into memory of this FunctionContext.
+  RegisterFunctionContext(context, state);
+  input_slots_.clear();
+  CollectInputSlots(children_[0]);
+  return Status::OK();
+}
+
+void CachedExpr::CollectInputSlots(Expr* e) {
+  if (e->is_slotref()) {
+    input_slots_.push_back(static_cast<SlotRef*>(e));
+    return;
+  }
+  for (int i = 0; i < e->children_.size(); ++i) CollectInputSlots(e->children_[i]);
+}
+
+void CachedExpr::ComputeKey(TupleRow* row, string* key) const {
+  key->clear();
+  for (int i = 0; i < input_slots_.size(); ++i) {
+    const SlotRef* slot_ref = input_slots_[i];
+    const Tuple* tuple = row->GetTuple(slot_ref->tuple_idx());
+    if (tuple == NULL || tuple->IsNull(slot_ref->null_indicator_offset())) {
+      key->push_back('\0');
+      continue;
+    }
+    key->push_back('\1');
+    const void* slot = tuple->GetSlot(slot_ref->slot_offset());
+    if (slot_ref->type().IsVarLenStringType()) {
+      // The length is included so that the boundaries between values are unambiguous.
+      const StringValue* str = reinterpret_cast<const StringValue*>(slot);
+      key->append(reinterpret_cast<const char*>(&str->len), sizeof(str->len));
+      key->append(str->ptr, str->len);
+    } else {
+      key->append(reinterpret_cast<const char*>(slot), slot_ref->type().GetByteSize());
+    }
+  }
+}
+
+bool CachedExpr::Lookup(ExprContext* context, TupleRow* row,
+    SubexprCache::Entry** entry) {
+  SubexprCache* cache = context->subexpr_cache();
+  DCHECK(cache != NULL);
+  DCHECK_LT(cache_idx_, cache->entries_.size());
+  *entry = &cache->entries_[cache_idx_];
+  ComputeKey(row, &cache->scratch_key_);
+  if ((*entry)->valid && (*entry)->key == cache->scratch_key_) {
+    ++cache->num_hits_;
+    return true;
+  }
+  (*entry)->key.swap(cache->scratch_key_);
+  (*entry)->valid = true;
+  return false;
+}
+
+template<typename VAL_TYPE>
+VAL_TYPE CachedExpr::GetCachedVal(ExprContext* context, TupleRow* row,
+    VAL_TYPE (Expr::*get_val)(ExprContext*, TupleRow*)) {
+  if (context->subexpr_cache() == NULL) return (children_[0]->*get_val)(context, row);
+  DCHECK_LE(sizeof(VAL_TYPE), sizeof(SubexprCache::Entry::val));
+  SubexprCache::Entry* entry;
+  VAL_TYPE result;
+  if (Lookup(context, row, &entry)) {
+    memcpy(&result, entry->val, sizeof(VAL_TYPE));
+  } else {
+    result = (children_[0]->*get_val)(context, row);
+    memcpy(entry->val, &result, sizeof(VAL_TYPE));
+  }
+  return result;
+}
+
+Status CachedExpr::GetCodegendComputeFn(RuntimeState* state, llvm::Function** fn) {
+  return GetCodegendComputeFnWrapper(state, fn);
+}
+
+BooleanVal CachedExpr::GetBooleanVal(ExprContext* context, TupleRow* row) {
+  return GetCachedVal(context, row, &Expr::GetBooleanVal);
+}
+
+TinyIntVal CachedExpr::GetTinyIntVal(ExprContext* context, TupleRow* row) {
+  return GetCachedVal(context, row, &Expr::GetTinyIntVal);
+}
+
+SmallIntVal CachedExpr::GetSmallIntVal(ExprContext* context, TupleRow* row) {
+  return GetCachedVal(context, row, &Expr::GetSmallIntVal);
+}
+
+IntVal CachedExpr::GetIntVal(ExprContext* context, TupleRow* row) {
+  return GetCachedVal(context, row, &Expr::GetIntVal);
+}
+
+BigIntVal CachedExpr::GetBigIntVal(ExprContext* context, TupleRow* row) {
+  return GetCachedVal(context, row, &Expr::GetBigIntVal);
+}
+
+FloatVal CachedExpr::GetFloatVal(ExprContext* context, TupleRow* row) {
+  return GetCachedVal(context, row, &Expr::GetFloatVal);
+}
+
+DoubleVal CachedExpr::GetDoubleVal(ExprContext* context, TupleRow* row) {
+  return GetCachedVal(context, row, &Expr::GetDoubleVal);
+}
+
+TimestampVal CachedExpr::GetTimestampVal(ExprContext* context, TupleRow* row) {
+  return GetCachedVal(context, row, &Expr::GetTimestampVal);
+}
+
+DecimalVal CachedExpr::GetDecimalVal(ExprContext* context, TupleRow* row) {
+  return GetCachedVal(context, row, &Expr::GetDecimalVal);
+}
+
+StringVal CachedExpr::GetStringVal(ExprContext* context, TupleRow* row) {
+  if (context->subexpr_cache() == NULL) return children_[0]->GetStringVal(context, row);
+  SubexprCache::Entry* entry;
+  if (!Lookup(context, row, &entry)) {
+    // The result is returned as is. A copy of its data is kept for later hits, because
+    // the result may point into the row or into local allocations of the child.
+    StringVal result = children_[0]->GetStringVal(context, row);
+    if (!result.is_null) {
+      entry->string_data.assign(reinterpret_cast<const char*>(result.ptr), result.len);
+    }
+    memcpy(entry->val, &result, sizeof(StringVal));
+    return result;
+  }
+  StringVal cached;
+  memcpy(&cached, entry->val, sizeof(StringVal));
+  if (cached.is_null) return StringVal::null();
+  // Callers may hold on to the result until the local allocations of 'context' are
+  // freed, while the entry is overwritten by the next miss, so the data is copied.
+  return StringVal::CopyFrom(context->fn_context(fn_context_index_),
+      reinterpret_cast<const uint8_t*>(entry->string_data.data()),
+      entry->string_data.size());
+}
+
+string CachedExpr::DebugString() const {
+  stringstream out;
+  out << "CachedExpr(cache_idx=" << cache_idx_ << " " << Expr::DebugString() << ")";
+  return out.str();
+}
@@ -0,0 +1,151 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#ifndef IMPALA_EXPRS_CACHED_EXPR_H
+#define IMPALA_EXPRS_CACHED_EXPR_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+#include "exprs/expr.h"
+
+namespace impala {
+
+class ObjectPool;
+class SlotRef;
+
+/// Results of the CachedExprs of a group of ExprContexts that are evaluated over the same
+/// rows by one thread, e.g. the grouping exprs and the aggregate function inputs of an
+/// aggregation node. Each entry holds the last result of one shared subexpression along
+/// with the values of the slots it was computed from. Owned by the exec node, which
+/// creates it with CachedExpr::ShareSubexprs(). Not thread-safe.
+class SubexprCache {
+ public:
+  SubexprCache(int num_entries) : entries_(num_entries), num_hits_(0) { }
+
+  /// Number of evaluations that were answered from the cache.
+  int64_t num_hits() const { return num_hits_; }
+
+ private:
+  friend class CachedExpr;
+
+  struct Entry {
+    Entry() : valid(false) { }
+
+    /// False until the first result is stored.
+    bool valid;
+
+    /// The input slot values of the cached result, see CachedExpr::ComputeKey().
+    std::string key;
+
+    /// The cached *Val. The string data of a StringVal is stored in 'string_data'.
+    uint8_t val[sizeof(impala_udf::DecimalVal)];
+    std::string string_data;
+  };
+
+  std::vector<Entry> entries_;
+
+  /// Reused buffer to compute keys into.
+  std::string scratch_key_;
+
+  int64_t num_hits_;
+};
+
+/// Wrapper around a subexpression that occurs more than once in the exprs of a node, for
+/// example a UDF or a regexp_extract() call that appears in both the GROUP BY and the
+/// SELECT list. The first evaluation for a row computes the child and stores its result
+/// in the SubexprCache of the ExprContext, later evaluations with the same input slot
+/// values return the stored result. Only deterministic subexpressions made up of function
+/// calls, slot refs and literals are cached, so the result is a function of the input
+/// slot values.
+///
+/// ExprContexts without a cache, in particular clones, evaluate the child directly, so
+/// the expr tree can be shared by all threads. The cached subexpressions are always
+/// evaluated by the interpreted compute functions.
+class CachedExpr : public Expr {
+ public:
+  /// Finds the expensive subexpressions that occur more than once in the expr trees of
+  /// 'ctxs', wraps each occurrence in a CachedExpr and sets the cache of the contexts to
+  /// a new SubexprCache, which is added to 'pool' and returned. Returns NULL and leaves
+  /// the exprs unchanged if there are no such subexpressions or if
+  /// --enable_subexpr_caching is false. Must be called before the contexts are prepared.
+  static SubexprCache* ShareSubexprs(ObjectPool* pool,
+      const std::vector<ExprContext*>& ctxs);
+
+  virtual Status GetCodegendComputeFn(RuntimeState* state, llvm::Function** fn);
+
+  virtual BooleanVal GetBooleanVal(ExprContext* context, TupleRow* row);
+  virtual TinyIntVal GetTinyIntVal(ExprContext* context, TupleRow* row);
+  virtual SmallIntVal GetSmallIntVal(ExprContext* context, TupleRow* row);
+  virtual IntVal GetIntVal(ExprContext* context, TupleRow* row);
+  virtual BigIntVal GetBigIntVal(ExprContext* context, TupleRow* row);
+  virtual FloatVal GetFloatVal(ExprContext* context, TupleRow* row);
+  virtual DoubleVal GetDoubleVal(ExprContext* context, TupleRow* row);
+  virtual StringVal GetStringVal(ExprContext* context, TupleRow* row);
+  virtual TimestampVal GetTimestampVal(ExprContext* context, TupleRow* row);
+  virtual DecimalVal GetDecimalVal(ExprContext* context, TupleRow* row);
+
+  virtual std::string DebugString() const;
+
+ protected:
+  virtual Status Prepare(RuntimeState* state, const RowDescriptor& row_desc,
+      ExprContext* context);
+
+ private:
+  CachedExpr(Expr* child, int cache_idx);
+
+  /// Returns true if 'e' is worth caching: a call of a UDF or of a builtin that returns a
+  /// string or a timestamp.
+  static bool IsExpensive(const Expr* e);
+
+  /// Appends a string that identifies the subexpression 'e' to 'fingerprint'. Returns
+  /// false if 'e' cannot be cached.
+  static bool GetFingerprint(const Expr* e, std::string* fingerprint);
+
+  /// Wraps the subexpressions of 'e' whose fingerprints appear in 'counts' at least
+  /// twice, see ShareSubexprs(). '*e' is replaced if 'e' itself is wrapped.
+  /// 'cache_idxs' maps fingerprints to the entries of the wrapped subexpressions.
+  static void WrapSubexprs(ObjectPool* pool, const std::map<std::string, int>& counts,
+      std::map<std::string, int>* cache_idxs, Expr** e);
+
+  /// Adds the slot refs in the subtree of 'e' to input_slots_.
+  void CollectInputSlots(Expr* e);
+
+  /// Writes the values of input_slots_ in 'row' to 'key'. Equal keys imply equal values.
+  void ComputeKey(TupleRow* row, std::string* key) const;
+
+  /// Returns the result of the child for 'row', from the cache if possible, for the
+  /// *Val types without out-of-line data. 'get_val' is the child's Get*Val() function.
+  template<typename VAL_TYPE>
+  VAL_TYPE GetCachedVal(ExprContext* context, TupleRow* row,
+      VAL_TYPE (Expr::*get_val)(ExprContext*, TupleRow*));
+
+  /// Looks up the entry of this expr for 'row' in the cache of 'context'. Returns true
+  /// on a hit. On a miss, '*entry' must be filled in by the caller.
+  bool Lookup(ExprContext* context, TupleRow* row, SubexprCache::Entry** entry);
+
+  /// Index of the entry in SubexprCache::entries_.
+  const int cache_idx_;
+
+  /// The slot refs of the cached subexpression.
+  std::vector<SlotRef*> input_slots_;
+};
+
+}
+
+#endif
@@ -367,6 +367,88 @@ bool CaseExpr::AnyValEq(const ColumnType& type, const AnyVal* v1, const AnyVal*
   }
 }
 
+void CaseExpr::EvalBatch(ExprContext* ctx, RowBatch* batch, const int* sel,
+    int num_rows, void* results) {
+  if (num_rows == 0) return;
+  int num_children = GetNumChildren();
+  const ColumnType& case_type = children()[0]->type();
+  int case_val_size = AnyValUtil::AnyValSize(case_type);
+  int val_size = AnyValUtil::AnyValSize(type_);
+  // The rows that no WHEN expr matched yet, the rows that matched the current WHEN expr
+  // and the rows that get the ELSE value, with the positions of their results.
+  int* remaining_sel = reinterpret_cast<int*>(
+      AllocateBatchScratch(ctx, 6 * num_rows * sizeof(int)));
+  int* remaining_pos = remaining_sel + num_rows;
+  int* match_sel = remaining_pos + num_rows;
+  int* match_pos = match_sel + num_rows;
+  int* else_sel = match_pos + num_rows;
+  int* else_pos = else_sel + num_rows;
+  int num_remaining = 0;
+  int num_else = 0;
+
+  // If there's no case expression, the when values are compared to "true".
+  BooleanVal true_val(true);
+  const uint8_t* case_vals = NULL;
+  if (has_case_expr()) {
+    case_vals = reinterpret_cast<const uint8_t*>(
+        EvalChildBatch(0, ctx, batch, sel, num_rows));
+  }
+  for (int i = 0; i < num_rows; ++i) {
+    int row = sel == NULL ? i : sel[i];
+    if (case_vals != NULL &&
+        reinterpret_cast<const AnyVal*>(case_vals + i * case_val_size)->is_null) {
+      else_sel[num_else] = row;
+      else_pos[num_else++] = i;
+    } else {
+      remaining_sel[num_remaining] = row;
+      remaining_pos[num_remaining++] = i;
+    }
+  }
+
+  int loop_start = has_case_expr() ? 1 : 0;
+  int loop_end = has_else_expr() ? num_children - 1 : num_children;
+  for (int i = loop_start; i < loop_end && num_remaining > 0; i += 2) {
+    const uint8_t* when_vals = reinterpret_cast<const uint8_t*>(
+        EvalChildBatch(i, ctx, batch, remaining_sel, num_remaining));
+    int num_match = 0;
+    int num_left = 0;
+    for (int j = 0; j < num_remaining; ++j) {
+      const AnyVal* when_val =
+          reinterpret_cast<const AnyVal*>(when_vals + j * case_val_size);
+      const AnyVal* case_val = case_vals == NULL ? &true_val :
+          reinterpret_cast<const AnyVal*>(case_vals + remaining_pos[j] * case_val_size);
+      if (!when_val->is_null && AnyValEq(case_type, case_val, when_val)) {
+        match_sel[num_match] = remaining_sel[j];
+        match_pos[num_match++] = remaining_pos[j];
+      } else {
+        remaining_sel[num_left] = remaining_sel[j];
+        remaining_pos[num_left++] = remaining_pos[j];
+      }
+    }
+    if (num_match > 0) {
+      void* then_vals = EvalChildBatch(i + 1, ctx, batch, match_sel, num_match);
+      ScatterBatch(then_vals, match_pos, num_match, val_size, results);
+    }
+    num_remaining = num_left;
+  }
+
+  memcpy(else_sel + num_else, remaining_sel, num_remaining * sizeof(int));
+  memcpy(else_pos + num_else, remaining_pos, num_remaining * sizeof(int));
+  num_else += num_remaining;
+  if (num_else == 0) return;
+  if (has_else_expr()) {
+    void* else_vals = EvalChildBatch(num_children - 1, ctx, batch, else_sel, num_else);
+    ScatterBatch(else_vals, else_pos, num_else, val_size, results);
+  } else {
+    uint8_t* out = reinterpret_cast<uint8_t*>(results);
+    for (int i = 0; i < num_else; ++i) {
+      AnyVal* result = reinterpret_cast<AnyVal*>(out + else_pos[i] * val_size);
+      memset(result, 0, val_size);
+      result->is_null = true;
+    }
+  }
+}
+
 #define CASE_COMPUTE_FN(THEN_TYPE) \
   THEN_TYPE CaseExpr::Get##THEN_TYPE(ExprContext* ctx, TupleRow* row) { \
     FunctionContext* fn_ctx = ctx->fn_context(fn_context_index_); \
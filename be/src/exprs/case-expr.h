@@ -40,6 +40,11 @@ class CaseExpr: public Expr {
   virtual TimestampVal GetTimestampVal(ExprContext* ctx, TupleRow* row);
   virtual DecimalVal GetDecimalVal(ExprContext* ctx, TupleRow* row);
 
+  /// Evaluates each WHEN expr for the rows that no earlier WHEN expr matched, and each
+  /// THEN expr and the ELSE expr only for the rows that return it.
+  virtual void EvalBatch(ExprContext* ctx, RowBatch* batch, const int* sel,
+      int num_rows, void* results);
+
  protected:
   friend class Expr;
   friend class ComputeFunctions;
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "exprs/conditional-functions.h"
+#include "exprs/anyval-util.h"
 #include "runtime/runtime-state.h"
 #include "udf/udf.h"
 
@@ -31,6 +32,42 @@ CONDITIONAL_CODEGEN_FN(NullIfExpr);
 CONDITIONAL_CODEGEN_FN(IfExpr);
 CONDITIONAL_CODEGEN_FN(CoalesceExpr);
 
+void IfExpr::EvalBatch(ExprContext* context, RowBatch* batch, const int* sel,
+    int num_rows, void* results) {
+  DCHECK_EQ(children_.size(), 3);
+  if (num_rows == 0) return;
+  const BooleanVal* cond = reinterpret_cast<const BooleanVal*>(
+      EvalChildBatch(0, context, batch, sel, num_rows));
+  // Split the rows into the selections of the two branches. 'then_pos' and 'else_pos'
+  // are the positions in 'results' of the rows in 'then_sel' and 'else_sel'.
+  int* then_sel = reinterpret_cast<int*>(
+      AllocateBatchScratch(context, 4 * num_rows * sizeof(int)));
+  int* then_pos = then_sel + num_rows;
+  int* else_sel = then_pos + num_rows;
+  int* else_pos = else_sel + num_rows;
+  int num_then = 0;
+  int num_else = 0;
+  for (int i = 0; i < num_rows; ++i) {
+    int row = sel == NULL ? i : sel[i];
+    if (cond[i].is_null || !cond[i].val) {
+      else_sel[num_else] = row;
+      else_pos[num_else++] = i;
+    } else {
+      then_sel[num_then] = row;
+      then_pos[num_then++] = i;
+    }
+  }
+  int val_size = AnyValUtil::AnyValSize(type_);
+  if (num_then > 0) {
+    void* then_vals = EvalChildBatch(1, context, batch, then_sel, num_then);
+    ScatterBatch(then_vals, then_pos, num_then, val_size, results);
+  }
+  if (num_else > 0) {
+    void* else_vals = EvalChildBatch(2, context, batch, else_sel, num_else);
+    ScatterBatch(else_vals, else_pos, num_else, val_size, results);
+  }
+}
+
 BooleanVal ConditionalFunctions::IsFalse(FunctionContext* ctx, const BooleanVal& val) {
   if (val.is_null) return BooleanVal(false);
   return BooleanVal(!val.val);
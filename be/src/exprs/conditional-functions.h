@@ -112,6 +112,11 @@ class IfExpr : public Expr {
   virtual TimestampVal GetTimestampVal(ExprContext* context, TupleRow* row);
   virtual DecimalVal GetDecimalVal(ExprContext* context, TupleRow* row);
 
+  /// Evaluates the condition for all rows and each branch only for the rows that take
+  /// it.
+  virtual void EvalBatch(ExprContext* context, RowBatch* batch, const int* sel,
+      int num_rows, void* results);
+
   virtual Status GetCodegendComputeFn(RuntimeState* state, llvm::Function** fn);
   virtual std::string DebugString() const { return Expr::DebugString("IfExpr"); }
 
@@ -17,6 +17,7 @@
 #include <sstream>
 
 #include "exprs/expr.h"
+#include "exprs/folded-constant.h"
 #include "runtime/mem-pool.h"
 #include "runtime/runtime-state.h"
 #include "udf/udf-internal.h"
@@ -31,6 +32,7 @@ const char* ExprContext::LLVM_CLASS_NAME = "class.impala::ExprContext";
 ExprContext::ExprContext(Expr* root)
   : fn_contexts_ptr_(NULL),
     root_(root),
+    subexpr_cache_(NULL),
     is_clone_(false),
     prepared_(false),
     opened_(false),
@@ -50,6 +52,7 @@ Status ExprContext::Prepare(RuntimeState* state, const RowDescriptor& row_desc,
   DCHECK(pool_.get() == NULL);
   prepared_ = true;
   pool_.reset(new MemPool(tracker));
+  FoldedConstant::FoldConstantArgs(state->obj_pool(), &root_);
   return root_->Prepare(state, row_desc, this);
 }
 
@@ -75,6 +78,7 @@ void ExprContext::Close(RuntimeState* state) {
   }
   // pool_ can be NULL if Prepare() was never called
   if (pool_ != NULL) pool_->FreeAll();
+  if (batch_pool_ != NULL) batch_pool_->FreeAll();
   closed_ = true;
 }
 
@@ -108,6 +112,31 @@ Status ExprContext::Clone(RuntimeState* state, ExprContext** new_ctx) {
   return root_->Open(state, *new_ctx, FunctionContext::THREAD_LOCAL);
 }
 
+void ExprContext::EvalBatch(RowBatch* batch, const int* sel, int num_rows,
+    void* results) {
+  DCHECK(opened_);
+  root_->EvalBatch(this, batch, sel, num_rows, results);
+  if (batch_pool_ != NULL) batch_pool_->Clear();
+}
+
+int ExprContext::EvalConjunctsBatch(const vector<ExprContext*>& ctxs, RowBatch* batch,
+    int* sel, int num_rows) {
+  DCHECK(sel != NULL);
+  vector<BooleanVal> results(num_rows);
+  for (int i = 0; i < ctxs.size() && num_rows > 0; ++i) {
+    DCHECK_EQ(ctxs[i]->root()->type().type, TYPE_BOOLEAN);
+    ctxs[i]->EvalBatch(batch, sel, num_rows, &results[0]);
+    // Compact 'sel' without branching on the results.
+    int num_selected = 0;
+    for (int j = 0; j < num_rows; ++j) {
+      sel[num_selected] = sel[j];
+      num_selected += !results[j].is_null & results[j].val;
+    }
+    num_rows = num_selected;
+  }
+  return num_rows;
+}
+
 void ExprContext::FreeLocalAllocations() {
   FreeLocalAllocations(fn_contexts_);
 }
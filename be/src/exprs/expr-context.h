@@ -30,6 +30,8 @@ class Expr;
 class MemPool;
 class MemTracker;
 class RuntimeState;
+class RowBatch;
+class SubexprCache;
 class RowDescriptor;
 class TColumnValue;
 class TupleRow;
@@ -110,6 +112,11 @@ class ExprContext {
   Expr* root() { return root_; }
   bool closed() { return closed_; }
 
+  /// The cache of the CachedExprs in the expr tree, shared with the other contexts of
+  /// the same exec node. NULL if there are no CachedExprs and for clones, which evaluate
+  /// the cached subexpressions directly.
+  SubexprCache* subexpr_cache() { return subexpr_cache_; }
+
   /// Calls Get*Val on root_
   BooleanVal GetBooleanVal(TupleRow* row);
   TinyIntVal GetTinyIntVal(TupleRow* row);
@@ -123,6 +130,17 @@ class ExprContext {
   TimestampVal GetTimestampVal(TupleRow* row);
   DecimalVal GetDecimalVal(TupleRow* row);
 
+  /// Evaluates the expr tree over rows of 'batch' and writes the results, an array of
+  /// 'num_rows' *Vals of the root's type, to 'results'. The i-th result is for row
+  /// sel[i], or for row i if 'sel' is NULL. See Expr::EvalBatch().
+  void EvalBatch(RowBatch* batch, const int* sel, int num_rows, void* results);
+
+  /// Evaluates the boolean exprs of 'ctxs' over the rows sel[0..num_rows) of 'batch' and
+  /// removes the rows for which any of them returns false or NULL from 'sel', keeping the
+  /// order of the remaining rows. Returns the number of remaining rows.
+  static int EvalConjunctsBatch(const std::vector<ExprContext*>& ctxs, RowBatch* batch,
+      int* sel, int num_rows);
+
   /// Frees all local allocations made by fn_contexts_. This can be called when result
   /// data from this context is no longer needed.
   void FreeLocalAllocations();
@@ -132,6 +150,8 @@ class ExprContext {
   static const char* LLVM_CLASS_NAME;
 
  private:
+  friend class CachedExpr;
+  friend class FoldedConstant;
   friend class Expr;
   /// Users of private GetValue()
   friend class HiveUdfCall;
@@ -149,9 +169,16 @@ class ExprContext {
   /// Pool backing fn_contexts_. Counts against the runtime state's UDF mem tracker.
   boost::scoped_ptr<MemPool> pool_;
 
+  /// Scratch memory for the intermediate results of EvalBatch(). Created on first use
+  /// and cleared after each EvalBatch() call.
+  boost::scoped_ptr<MemPool> batch_pool_;
+
   /// The expr tree this context is for.
   Expr* root_;
 
+  /// Set by CachedExpr::ShareSubexprs(). Not owned.
+  SubexprCache* subexpr_cache_;
+
   /// Stores the result of the root expr. This is used in interpreted code when we need a
   /// void*.
   ExprValue result_;
@@ -1762,6 +1762,8 @@ TEST_F(ExprTest, StringFunctions) {
   TestStringValue("split_part('abc@@def@@@@ghi', '@@', 4)", "ghi");
   TestStringValue("split_part('abc@@def@@ghi', '@@', 4)", "");
   TestStringValue("split_part('', '@@', 1)", "");
+  TestStringValue("split_part('the quick brown fox jumps over the lazy dog', ' ', 8)",
+      "lazy");
   TestStringValue("split_part('abcdef', '', 1)", "abcdef");
   TestStringValue("split_part('', '', 1)", "");
   TestIsNull("split_part(NULL, NULL, 1)", TYPE_STRING);
@@ -1788,6 +1790,13 @@ TEST_F(ExprTest, StringFunctions) {
   TestStringValue("ucase('hello')", "HELLO");
   TestIsNull("upper(NULL)", TYPE_STRING);
   TestIsNull("ucase(NULL)", TYPE_STRING);
+  // Strings longer than 16 characters are converted 16 at a time.
+  TestStringValue("lower('THE QUICK BROWN FOX JUMPS over the lazy [DOG]')",
+      "the quick brown fox jumps over the lazy [dog]");
+  TestStringValue("upper('the quick brown fox jumps OVER THE LAZY {dog}')",
+      "THE QUICK BROWN FOX JUMPS OVER THE LAZY {DOG}");
+  TestStringValue("lower('already lower case, no copy needed')",
+      "already lower case, no copy needed");
 
   TestStringValue("initcap('')", "");
   TestStringValue("initcap('a')", "A");
@@ -1867,6 +1876,9 @@ TEST_F(ExprTest, StringFunctions) {
   TestStringValue("rtrim('   abcdefg')", "   abcdefg");
   TestStringValue("rtrim('abc  defg')", "abc  defg");
   TestIsNull("rtrim(NULL)", TYPE_STRING);
+  TestStringValue("trim(concat(space(40), 'a b', space(33)))", "a b");
+  TestStringValue("ltrim(concat(space(17), 'abc', space(17)))", "abc" + string(17, ' '));
+  TestStringValue("rtrim(concat(space(17), 'abc', space(17)))", string(17, ' ') + "abc");
 
   TestStringValue("btrim('     abcdefg   ')", "abcdefg");
   TestStringValue("btrim('     abcdefg')", "abcdefg");
@@ -1985,6 +1997,8 @@ TEST_F(ExprTest, StringFunctions) {
   TestStringValue("concat('a')", "a");
   TestStringValue("concat('a', 'b')", "ab");
   TestStringValue("concat('a', 'b', 'cde')", "abcde");
+  TestStringValue("concat('', 'abc', '')", "abc");
+  TestStringValue("concat('', '')", "");
   TestStringValue("concat('a', 'b', 'cde', 'fg')", "abcdefg");
   TestStringValue("concat('a', 'b', 'cde', '', 'fg', '')", "abcdefg");
   TestIsNull("concat(NULL)", TYPE_STRING);
@@ -3200,6 +3214,19 @@ TEST_F(ExprTest, TimestampFunctions) {
       "'Europe/Moscow') as string)", "2012-01-05 05:00:00");
   TestStringValue("cast(from_utc_timestamp(cast(1333594800 as timestamp),"
       "'Europe/Moscow') as string)", "2012-04-05 07:00:00");
+  // Daylight saving time transitions on the northern and southern hemisphere.
+  TestStringValue("cast(from_utc_timestamp(cast(1457863199 as timestamp),"
+      "'PST') as string)", "2016-03-13 01:59:59");
+  TestStringValue("cast(from_utc_timestamp(cast(1457863200 as timestamp),"
+      "'PST') as string)", "2016-03-13 03:00:00");
+  TestStringValue("cast(from_utc_timestamp(cast(1475337599 as timestamp),"
+      "'Australia/Sydney') as string)", "2016-10-02 01:59:59");
+  TestStringValue("cast(from_utc_timestamp(cast(1475337600 as timestamp),"
+      "'Australia/Sydney') as string)", "2016-10-02 03:00:00");
+  TestStringValue("cast(to_utc_timestamp(cast('2016-03-13 01:59:59' as timestamp),"
+      "'PST') as string)", "2016-03-13 09:59:59");
+  TestStringValue("cast(to_utc_timestamp(cast('2016-03-13 03:00:00' as timestamp),"
+      "'PST') as string)", "2016-03-13 10:00:00");
 
   // Regression for IMPALA-1105
   TestIsNull("cast(cast('NOTATIMESTAMP' as timestamp) as string)", TYPE_STRING);
@@ -5742,6 +5769,18 @@ TEST_F(ExprTest, UuidTest) {
   EXPECT_TRUE(string_set.size() == NUM_UUIDS);
 }
 
+// The constant arguments of the outer function calls are folded into FoldedConstants.
+TEST_F(ExprTest, FoldedConstants) {
+  TestStringValue("concat(concat('a', 'b'), upper('c'))", "abC");
+  TestIsNull("concat(concat('a', cast(NULL as string)), 'c')", TYPE_STRING);
+  TestValue("length(concat(repeat('x', 100), 'y')) + abs(-1)", TYPE_INT, 102);
+  TestValue("year(cast('2016-01-01' as timestamp) + interval 1 year)", TYPE_INT, 2017);
+  TestValue("cast(2.5 as decimal(10,1)) * cast(2 as decimal(10,1)) > 4.9",
+      TYPE_BOOLEAN, true);
+  // Errors of folded arguments are reported when the expr is opened.
+  TestError("concat(split_part('abc@@def', '@@', 0), 'x')");
+}
+
 } // namespace impala
 
 int main(int argc, char **argv) {
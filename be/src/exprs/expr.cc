@@ -56,6 +56,8 @@
 #include "gen-cpp/Exprs_types.h"
 #include "gen-cpp/Data_types.h"
 #include "runtime/lib-cache.h"
+#include "runtime/mem-pool.h"
+#include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 #include "runtime/raw-value.h"
 #include "udf/udf.h"
@@ -700,6 +702,97 @@ DecimalVal Expr::GetDecimalVal(ExprContext* context, TupleRow* row) {
   return DecimalVal::null();
 }
 
+// Evaluates 'e' over the rows one at a time by calling the Get*Val() function GET_VAL.
+template<typename T, T (Expr::*GET_VAL)(ExprContext*, TupleRow*)>
+static void EvalRowByRow(Expr* e, ExprContext* context, RowBatch* batch, const int* sel,
+    int num_rows, void* results) {
+  T* out = reinterpret_cast<T*>(results);
+  for (int i = 0; i < num_rows; ++i) {
+    out[i] = (e->*GET_VAL)(context, batch->GetRow(sel == NULL ? i : sel[i]));
+  }
+}
+
+void Expr::EvalBatch(ExprContext* context, RowBatch* batch, const int* sel,
+    int num_rows, void* results) {
+  switch (type_.type) {
+    case TYPE_BOOLEAN:
+      EvalRowByRow<BooleanVal, &Expr::GetBooleanVal>(
+          this, context, batch, sel, num_rows, results);
+      break;
+    case TYPE_TINYINT:
+      EvalRowByRow<TinyIntVal, &Expr::GetTinyIntVal>(
+          this, context, batch, sel, num_rows, results);
+      break;
+    case TYPE_SMALLINT:
+      EvalRowByRow<SmallIntVal, &Expr::GetSmallIntVal>(
+          this, context, batch, sel, num_rows, results);
+      break;
+    case TYPE_INT:
+      EvalRowByRow<IntVal, &Expr::GetIntVal>(
+          this, context, batch, sel, num_rows, results);
+      break;
+    case TYPE_BIGINT:
+      EvalRowByRow<BigIntVal, &Expr::GetBigIntVal>(
+          this, context, batch, sel, num_rows, results);
+      break;
+    case TYPE_FLOAT:
+      EvalRowByRow<FloatVal, &Expr::GetFloatVal>(
+          this, context, batch, sel, num_rows, results);
+      break;
+    case TYPE_DOUBLE:
+      EvalRowByRow<DoubleVal, &Expr::GetDoubleVal>(
+          this, context, batch, sel, num_rows, results);
+      break;
+    case TYPE_STRING:
+    case TYPE_VARCHAR:
+    case TYPE_CHAR:
+      EvalRowByRow<StringVal, &Expr::GetStringVal>(
+          this, context, batch, sel, num_rows, results);
+      break;
+    case TYPE_TIMESTAMP:
+      EvalRowByRow<TimestampVal, &Expr::GetTimestampVal>(
+          this, context, batch, sel, num_rows, results);
+      break;
+    case TYPE_DECIMAL:
+      EvalRowByRow<DecimalVal, &Expr::GetDecimalVal>(
+          this, context, batch, sel, num_rows, results);
+      break;
+    case TYPE_ARRAY:
+    case TYPE_MAP:
+      EvalRowByRow<CollectionVal, &Expr::GetCollectionVal>(
+          this, context, batch, sel, num_rows, results);
+      break;
+    default:
+      DCHECK(false) << "Type not implemented: " << type_;
+  }
+}
+
+void* Expr::EvalChildBatch(int child_idx, ExprContext* context, RowBatch* batch,
+    const int* sel, int num_rows) {
+  Expr* child = children_[child_idx];
+  int val_size = child->type_.IsCollectionType() ?
+      sizeof(CollectionVal) : AnyValUtil::AnyValSize(child->type_);
+  void* results = AllocateBatchScratch(context, num_rows * val_size);
+  child->EvalBatch(context, batch, sel, num_rows, results);
+  return results;
+}
+
+uint8_t* Expr::AllocateBatchScratch(ExprContext* context, int64_t len) {
+  if (context->batch_pool_ == NULL) {
+    context->batch_pool_.reset(new MemPool(context->pool_->mem_tracker()));
+  }
+  return context->batch_pool_->Allocate(len);
+}
+
+void Expr::ScatterBatch(const void* src, const int* pos, int n, int val_size,
+    void* dst) {
+  const uint8_t* in = reinterpret_cast<const uint8_t*>(src);
+  uint8_t* out = reinterpret_cast<uint8_t*>(dst);
+  for (int i = 0; i < n; ++i) {
+    memcpy(out + pos[i] * val_size, in + i * val_size, val_size);
+  }
+}
+
 Status Expr::GetFnContextError(ExprContext* ctx) {
   if (fn_context_index_ != -1) {
     FunctionContext* fn_ctx = ctx->fn_context(fn_context_index_);
@@ -116,6 +116,7 @@ class Expr;
 class IsNullExpr;
 class LlvmCodeGen;
 class ObjectPool;
+class RowBatch;
 class RowDescriptor;
 class RuntimeState;
 class TColumnValue;
@@ -143,6 +144,17 @@ class Expr {
   virtual TimestampVal GetTimestampVal(ExprContext* context, TupleRow*);
   virtual DecimalVal GetDecimalVal(ExprContext* context, TupleRow*);
 
+  /// Batch compute function. Evaluates this expr over 'num_rows' rows of 'batch' and
+  /// writes the results, an array of 'num_rows' *Vals of type(), to 'results'. The i-th
+  /// result is for row sel[i] of 'batch', or for row i if 'sel' is NULL. Exprs are
+  /// evaluated with this through ExprContext::EvalBatch().
+  /// The default implementation calls the Get*Val() function for each row. Subclasses
+  /// override it to evaluate their children column by column and process the results
+  /// in tight loops, which avoids the virtual call per row and node of the interpreted
+  /// path when codegen is disabled.
+  virtual void EvalBatch(ExprContext* context, RowBatch* batch, const int* sel,
+      int num_rows, void* results);
+
   /// Get the number of digits after the decimal that should be displayed for this value.
   /// Returns -1 if no scale has been specified (currently the scale is only set for
   /// doubles set by RoundUpTo). GetValue() must have already been called.
@@ -155,6 +167,7 @@ class Expr {
 
   const ColumnType& type() const { return type_; }
   bool is_slotref() const { return is_slotref_; }
+  const TFunction& fn() const { return fn_; }
 
   const std::vector<Expr*>& children() const { return children_; }
 
@@ -281,6 +294,8 @@ class Expr {
 
  protected:
   friend class AggFnEvaluator;
+  friend class CachedExpr;
+  friend class FoldedConstant;
   friend class CastExpr;
   friend class ComputeFunctions;
   friend class DecimalFunctions;
@@ -326,6 +341,22 @@ class Expr {
   virtual void Close(RuntimeState* state, ExprContext* context,
       FunctionContext::FunctionStateScope scope = FunctionContext::FRAGMENT_LOCAL);
 
+  /// Calls EvalBatch() on children_[child_idx] for the rows specified by 'batch', 'sel'
+  /// and 'num_rows' and returns its results. The results are allocated with
+  /// AllocateBatchScratch().
+  void* EvalChildBatch(int child_idx, ExprContext* context, RowBatch* batch,
+      const int* sel, int num_rows);
+
+  /// Returns 'len' bytes of scratch memory for use by EvalBatch(). The memory is owned
+  /// by 'context' and valid until the ExprContext::EvalBatch() call that is in progress
+  /// returns.
+  static uint8_t* AllocateBatchScratch(ExprContext* context, int64_t len);
+
+  /// Copies the 'n' *Vals of 'val_size' bytes in 'src' to the positions 'pos' of 'dst'.
+  /// Used by EvalBatch() of exprs that evaluate their children over subsets of the rows.
+  static void ScatterBatch(const void* src, const int* pos, int n, int val_size,
+      void* dst);
+
   /// Cache entry for the library implementing this function.
   LibCache::LibCacheEntry* cache_entry_;
 
@@ -0,0 +1,255 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#include "exprs/folded-constant.h"
+
+#include <sstream>
+#include <gflags/gflags.h>
+
+#include "codegen/codegen-anyval.h"
+#include "codegen/llvm-codegen.h"
+#include "common/object-pool.h"
+#include "exprs/anyval-util.h"
+#include "exprs/expr-context.h"
+#include "exprs/hive-udf-call.h"
+#include "exprs/literal.h"
+#include "exprs/null-literal.h"
+#include "exprs/scalar-fn-call.h"
+#include "runtime/runtime-state.h"
+
+#include "gen-cpp/Exprs_types.h"
+
+#include "common/names.h"
+
+using namespace impala;
+using namespace impala_udf;
+using namespace llvm;
+
+DEFINE_bool(fold_constant_subexprs, true, "(Advanced) If true, constant arguments of "
+    "function calls that are not literals, e.g. now() - interval 1 day, are evaluated "
+    "once per fragment instead of once per row.");
+
+FoldedConstant::FoldedConstant(Expr* child)
+  : Expr(child->type()),
+    is_null_(true) {
+  children_.push_back(child);
+}
+
+void FoldedConstant::FoldConstantArgs(ObjectPool* pool, Expr** root) {
+  if (!FLAGS_fold_constant_subexprs) return;
+  Expr* e = *root;
+  if (dynamic_cast<FoldedConstant*>(e) != NULL) return;
+  bool is_fn_call = dynamic_cast<ScalarFnCall*>(e) != NULL;
+  for (int i = 0; i < e->children_.size(); ++i) {
+    if (is_fn_call && IsFoldable(e->children_[i])) {
+      e->children_[i] = pool->Add(new FoldedConstant(e->children_[i]));
+    } else {
+      FoldConstantArgs(pool, &e->children_[i]);
+    }
+  }
+}
+
+bool FoldedConstant::IsFoldable(const Expr* e) {
+  if (!e->IsConstant()) return false;
+  // Literals are already as cheap as the folded value.
+  if (dynamic_cast<const Literal*>(e) != NULL) return false;
+  if (dynamic_cast<const NullLiteral*>(e) != NULL) return false;
+  if (dynamic_cast<const FoldedConstant*>(e) != NULL) return false;
+  if (!IsDeterministic(e)) return false;
+  // CHAR values have several slot layouts and complex types have no scalar value.
+  return e->type_.type != TYPE_NULL && e->type_.type != TYPE_CHAR &&
+      !e->type_.IsComplexType();
+}
+
+bool FoldedConstant::IsDeterministic(const Expr* e) {
+  if (dynamic_cast<const ScalarFnCall*>(e) != NULL ||
+      dynamic_cast<const HiveUdfCall*>(e) != NULL) {
+    // Exprs without arguments are constant, but these builtins return a different
+    // result for each row. UDFs may as well.
+    if (e->fn_.binary_type != TFunctionBinaryType::BUILTIN) return false;
+    const string& name = e->fn_.name.function_name;
+    if (name == "rand" || name == "random" || name == "uuid" || name == "sleep") {
+      return false;
+    }
+  }
+  for (int i = 0; i < e->children_.size(); ++i) {
+    if (!IsDeterministic(e->children_[i])) return false;
+  }
+  return true;
+}
+
+Status FoldedConstant::Open(RuntimeState* state, ExprContext* context,
+    FunctionContext::FunctionStateScope scope) {
+  RETURN_IF_ERROR(Expr::Open(state, context, scope));
+  // Clones share the value computed for the original context.
+  if (scope != FunctionContext::FRAGMENT_LOCAL) return Status::OK();
+  void* val = context->GetValue(children_[0], NULL);
+  RETURN_IF_ERROR(children_[0]->GetFnContextError(context));
+  is_null_ = val == NULL;
+  if (is_null_) return Status::OK();
+  if (type_.IsVarLenStringType()) {
+    // The result may point into local allocations of the child, which are freed.
+    const StringValue* str = reinterpret_cast<const StringValue*>(val);
+    value_.string_data.assign(str->ptr, str->len);
+    value_.string_val.ptr = const_cast<char*>(value_.string_data.data());
+    value_.string_val.len = value_.string_data.size();
+  } else {
+    memcpy(ValuePtr(), val, type_.GetSlotSize());
+  }
+  return Status::OK();
+}
+
+void* FoldedConstant::ValuePtr() {
+  switch (type_.type) {
+    case TYPE_BOOLEAN: return &value_.bool_val;
+    case TYPE_TINYINT: return &value_.tinyint_val;
+    case TYPE_SMALLINT: return &value_.smallint_val;
+    case TYPE_INT: return &value_.int_val;
+    case TYPE_BIGINT: return &value_.bigint_val;
+    case TYPE_FLOAT: return &value_.float_val;
+    case TYPE_DOUBLE: return &value_.double_val;
+    case TYPE_STRING:
+    case TYPE_VARCHAR:
+      return &value_.string_val;
+    case TYPE_TIMESTAMP: return &value_.timestamp_val;
+    case TYPE_DECIMAL:
+      switch (type_.GetByteSize()) {
+        case 4: return &value_.decimal4_val;
+        case 8: return &value_.decimal8_val;
+        case 16: return &value_.decimal16_val;
+        default: break;
+      }
+      break;
+    default:
+      break;
+  }
+  DCHECK(false) << type_.DebugString();
+  return NULL;
+}
+
+Status FoldedConstant::GetCodegendComputeFn(RuntimeState* state, llvm::Function** fn) {
+  if (ir_compute_fn_ != NULL) {
+    *fn = ir_compute_fn_;
+    return Status::OK();
+  }
+  LlvmCodeGen* codegen;
+  RETURN_IF_ERROR(state->GetCodegen(&codegen));
+  Value* args[2];
+  *fn = CreateIrFunctionPrototype(codegen, "FoldedConstant", &args);
+  BasicBlock* entry_block = BasicBlock::Create(codegen->context(), "entry", *fn);
+  LlvmCodeGen::LlvmBuilder builder(entry_block);
+
+  // The value is only known after Open(), so it is loaded from this object instead of
+  // being embedded as a constant.
+  CodegenAnyVal v = CodegenAnyVal::GetNonNullVal(codegen, &builder, type_);
+  Value* is_null_ptr =
+      codegen->CastPtrToLlvmPtr(codegen->GetPtrType(TYPE_BOOLEAN), &is_null_);
+  v.SetIsNull(builder.CreateLoad(is_null_ptr, "is_null"));
+  v.SetFromRawPtr(codegen->CastPtrToLlvmPtr(codegen->ptr_type(), ValuePtr()));
+  builder.CreateRet(v.value());
+  *fn = codegen->FinalizeFunction(*fn);
+  ir_compute_fn_ = *fn;
+  return Status::OK();
+}
+
+BooleanVal FoldedConstant::GetBooleanVal(ExprContext* context, TupleRow* row) {
+  DCHECK_EQ(type_.type, TYPE_BOOLEAN) << type_;
+  if (is_null_) return BooleanVal::null();
+  return BooleanVal(value_.bool_val);
+}
+
+TinyIntVal FoldedConstant::GetTinyIntVal(ExprContext* context, TupleRow* row) {
+  DCHECK_EQ(type_.type, TYPE_TINYINT) << type_;
+  if (is_null_) return TinyIntVal::null();
+  return TinyIntVal(value_.tinyint_val);
+}
+
+SmallIntVal FoldedConstant::GetSmallIntVal(ExprContext* context, TupleRow* row) {
+  DCHECK_EQ(type_.type, TYPE_SMALLINT) << type_;
+  if (is_null_) return SmallIntVal::null();
+  return SmallIntVal(value_.smallint_val);
+}
+
+IntVal FoldedConstant::GetIntVal(ExprContext* context, TupleRow* row) {
+  DCHECK_EQ(type_.type, TYPE_INT) << type_;
+  if (is_null_) return IntVal::null();
+  return IntVal(value_.int_val);
+}
+
+BigIntVal FoldedConstant::GetBigIntVal(ExprContext* context, TupleRow* row) {
+  DCHECK_EQ(type_.type, TYPE_BIGINT) << type_;
+  if (is_null_) return BigIntVal::null();
+  return BigIntVal(value_.bigint_val);
+}
+
+FloatVal FoldedConstant::GetFloatVal(ExprContext* context, TupleRow* row) {
+  DCHECK_EQ(type_.type, TYPE_FLOAT) << type_;
+  if (is_null_) return FloatVal::null();
+  return FloatVal(value_.float_val);
+}
+
+DoubleVal FoldedConstant::GetDoubleVal(ExprContext* context, TupleRow* row) {
+  DCHECK_EQ(type_.type, TYPE_DOUBLE) << type_;
+  if (is_null_) return DoubleVal::null();
+  return DoubleVal(value_.double_val);
+}
+
+StringVal FoldedConstant::GetStringVal(ExprContext* context, TupleRow* row) {
+  DCHECK(type_.IsVarLenStringType()) << type_;
+  if (is_null_) return StringVal::null();
+  StringVal result;
+  value_.string_val.ToStringVal(&result);
+  return result;
+}
+
+TimestampVal FoldedConstant::GetTimestampVal(ExprContext* context, TupleRow* row) {
+  DCHECK_EQ(type_.type, TYPE_TIMESTAMP) << type_;
+  if (is_null_) return TimestampVal::null();
+  TimestampVal result;
+  value_.timestamp_val.ToTimestampVal(&result);
+  return result;
+}
+
+DecimalVal FoldedConstant::GetDecimalVal(ExprContext* context, TupleRow* row) {
+  DCHECK_EQ(type_.type, TYPE_DECIMAL) << type_;
+  if (is_null_) return DecimalVal::null();
+  switch (type_.GetByteSize()) {
+    case 4:
+      return DecimalVal(value_.decimal4_val.value());
+    case 8:
+      return DecimalVal(value_.decimal8_val.value());
+    case 16:
+      return DecimalVal(value_.decimal16_val.value());
+    default:
+      DCHECK(false) << type_.DebugString();
+  }
+  return DecimalVal::null();
+}
+
+void FoldedConstant::EvalBatch(ExprContext* context, RowBatch* batch, const int* sel,
+    int num_rows, void* results) {
+  if (num_rows == 0) return;
+  Expr::EvalBatch(context, batch, sel, 1, results);
+  int val_size = AnyValUtil::AnyValSize(type_);
+  uint8_t* out = reinterpret_cast<uint8_t*>(results);
+  for (int i = 1; i < num_rows; ++i) memcpy(out + i * val_size, out, val_size);
+}
+
+string FoldedConstant::DebugString() const {
+  stringstream out;
+  out << "FoldedConstant(" << Expr::DebugString() << ")";
+  return out.str();
+}
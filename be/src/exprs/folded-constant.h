@@ -0,0 +1,95 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#ifndef IMPALA_EXPRS_FOLDED_CONSTANT_H
+#define IMPALA_EXPRS_FOLDED_CONSTANT_H
+
+#include <string>
+
+#include "exprs/expr.h"
+#include "exprs/expr-value.h"
+
+namespace impala {
+
+class ObjectPool;
+
+/// Wrapper around a constant subexpression that is not a literal, for example
+/// now() - interval 7 days, concat('a', 'b') or cast('2016-01-01' as timestamp) as the
+/// argument of a function call. The child is evaluated once when the ExprContext is
+/// opened for the fragment, and the compute functions return the stored value like a
+/// Literal does. The codegen'd compute function loads the value from this object, so
+/// that it can be generated before the value is known.
+///
+/// Only the arguments of ScalarFnCalls are folded: ScalarFnCall::Open() evaluates its
+/// constant arguments anyway, so folding them never evaluates an expr that would not
+/// have been evaluated otherwise, e.g. one in a branch of a CASE that is never taken.
+///
+/// The child is prepared, opened and closed like any other child expr. Clones of the
+/// context share the value computed for the original. Calls of nondeterministic
+/// functions such as rand() are never folded.
+class FoldedConstant : public Expr {
+ public:
+  /// Wraps the constant subexpressions that are arguments of ScalarFnCalls in the tree
+  /// rooted at '*root' in FoldedConstants added to 'pool'. Literals are left alone, as
+  /// are all exprs if --fold_constant_subexprs is false. Must be called before the tree
+  /// is prepared.
+  static void FoldConstantArgs(ObjectPool* pool, Expr** root);
+
+  virtual Status GetCodegendComputeFn(RuntimeState* state, llvm::Function** fn);
+
+  virtual BooleanVal GetBooleanVal(ExprContext* context, TupleRow* row);
+  virtual TinyIntVal GetTinyIntVal(ExprContext* context, TupleRow* row);
+  virtual SmallIntVal GetSmallIntVal(ExprContext* context, TupleRow* row);
+  virtual IntVal GetIntVal(ExprContext* context, TupleRow* row);
+  virtual BigIntVal GetBigIntVal(ExprContext* context, TupleRow* row);
+  virtual FloatVal GetFloatVal(ExprContext* context, TupleRow* row);
+  virtual DoubleVal GetDoubleVal(ExprContext* context, TupleRow* row);
+  virtual StringVal GetStringVal(ExprContext* context, TupleRow* row);
+  virtual TimestampVal GetTimestampVal(ExprContext* context, TupleRow* row);
+  virtual DecimalVal GetDecimalVal(ExprContext* context, TupleRow* row);
+
+  /// Copies the value to all results.
+  virtual void EvalBatch(ExprContext* context, RowBatch* batch, const int* sel,
+      int num_rows, void* results);
+
+  virtual std::string DebugString() const;
+
+ protected:
+  virtual Status Open(RuntimeState* state, ExprContext* context,
+      FunctionContext::FunctionStateScope scope = FunctionContext::FRAGMENT_LOCAL);
+
+ private:
+  FoldedConstant(Expr* child);
+
+  /// Returns true if 'e' is a constant expr that is worth folding.
+  static bool IsFoldable(const Expr* e);
+
+  /// Returns false if 'e' contains a function call whose result may differ between calls
+  /// with the same arguments.
+  static bool IsDeterministic(const Expr* e);
+
+  /// Returns a pointer to the field of value_ for type_.
+  void* ValuePtr();
+
+  /// The value of the child, only valid if is_null_ is false. Set by the Open() of the
+  /// original context.
+  ExprValue value_;
+  bool is_null_;
+};
+
+}
+
+#endif
@@ -24,6 +24,9 @@
 #include "rpc/jni-thrift-util.h"
 #include "runtime/lib-cache.h"
 #include "runtime/runtime-state.h"
+#include "runtime/string-value.h"
+#include "runtime/timestamp-value.h"
+#include "udf/udf-internal.h"
 #include "util/bit-util.h"
 
 #include "gen-cpp/Frontend_types.h"
@@ -33,6 +36,7 @@
 const char* EXECUTOR_CLASS = "com/cloudera/impala/hive/executor/UdfExecutor";
 const char* EXECUTOR_CTOR_SIGNATURE ="([B)V";
 const char* EXECUTOR_EVALUATE_SIGNATURE = "()V";
+const char* EXECUTOR_EVALUATE_BATCH_SIGNATURE = "(IJJJJ)V";
 const char* EXECUTOR_CLOSE_SIGNATURE = "()V";
 
 namespace impala {
@@ -41,6 +45,7 @@ struct JniContext {
   jclass cl;
   jobject executor;
   jmethodID evalute_id;
+  jmethodID evaluate_batch_id;
   jmethodID close_id;
 
   uint8_t* input_values_buffer;
@@ -51,19 +56,109 @@ struct JniContext {
 
   AnyVal* output_anyval;
 
+  /// Columnar buffers of HiveUdfCall::EvalBatch() for up to 'batch_capacity' rows.
+  /// Allocated on first use.
+  int batch_capacity;
+  uint8_t* batch_input_nulls;
+  uint8_t* batch_input_values;
+  uint8_t* batch_output_nulls;
+  uint8_t* batch_output_values;
+
   JniContext()
     : cl(NULL),
       executor(NULL),
       evalute_id(NULL),
+      evaluate_batch_id(NULL),
       close_id(NULL),
       input_values_buffer(NULL),
       input_nulls_buffer(NULL),
       output_value_buffer(NULL),
       warning_logged(false),
-      output_anyval(NULL) {
+      output_anyval(NULL),
+      batch_capacity(0),
+      batch_input_nulls(NULL),
+      batch_input_values(NULL),
+      batch_output_nulls(NULL),
+      batch_output_values(NULL) {
+  }
+
+  void FreeBatchBuffers() {
+    delete[] batch_input_nulls;
+    delete[] batch_input_values;
+    delete[] batch_output_nulls;
+    delete[] batch_output_values;
+    batch_input_nulls = NULL;
+    batch_input_values = NULL;
+    batch_output_nulls = NULL;
+    batch_output_values = NULL;
+    batch_capacity = 0;
   }
 };
 
+namespace {
+
+/// Writes the 'num_rows' *Vals in 'vals' to a column of null bytes and a column of
+/// slots, see HiveUdfCall::EvalBatch().
+template<typename VAL_TYPE, typename NATIVE_TYPE>
+void WriteInputColumn(const void* vals, int num_rows, uint8_t* nulls, uint8_t* values) {
+  const VAL_TYPE* in = reinterpret_cast<const VAL_TYPE*>(vals);
+  NATIVE_TYPE* out = reinterpret_cast<NATIVE_TYPE*>(values);
+  for (int i = 0; i < num_rows; ++i) {
+    nulls[i] = in[i].is_null;
+    if (!in[i].is_null) out[i] = in[i].val;
+  }
+}
+
+void WriteInputColumn(const ColumnType& type, const void* vals, int num_rows,
+    uint8_t* nulls, uint8_t* values) {
+  switch (type.type) {
+    case TYPE_BOOLEAN:
+      WriteInputColumn<BooleanVal, bool>(vals, num_rows, nulls, values);
+      break;
+    case TYPE_TINYINT:
+      WriteInputColumn<TinyIntVal, int8_t>(vals, num_rows, nulls, values);
+      break;
+    case TYPE_SMALLINT:
+      WriteInputColumn<SmallIntVal, int16_t>(vals, num_rows, nulls, values);
+      break;
+    case TYPE_INT:
+      WriteInputColumn<IntVal, int32_t>(vals, num_rows, nulls, values);
+      break;
+    case TYPE_BIGINT:
+      WriteInputColumn<BigIntVal, int64_t>(vals, num_rows, nulls, values);
+      break;
+    case TYPE_FLOAT:
+      WriteInputColumn<FloatVal, float>(vals, num_rows, nulls, values);
+      break;
+    case TYPE_DOUBLE:
+      WriteInputColumn<DoubleVal, double>(vals, num_rows, nulls, values);
+      break;
+    case TYPE_TIMESTAMP: {
+      const TimestampVal* in = reinterpret_cast<const TimestampVal*>(vals);
+      TimestampValue* out = reinterpret_cast<TimestampValue*>(values);
+      for (int i = 0; i < num_rows; ++i) {
+        nulls[i] = in[i].is_null;
+        if (!in[i].is_null) out[i] = TimestampValue::FromTimestampVal(in[i]);
+      }
+      break;
+    }
+    case TYPE_STRING:
+    case TYPE_VARCHAR: {
+      const StringVal* in = reinterpret_cast<const StringVal*>(vals);
+      StringValue* out = reinterpret_cast<StringValue*>(values);
+      for (int i = 0; i < num_rows; ++i) {
+        nulls[i] = in[i].is_null;
+        if (!in[i].is_null) out[i] = StringValue::FromStringVal(in[i]);
+      }
+      break;
+    }
+    default:
+      DCHECK(false) << "NYI";
+  }
+}
+
+}
+
 HiveUdfCall::HiveUdfCall(const TExprNode& node)
   : Expr(node),
     input_buffer_size_(0) {
@@ -150,6 +245,109 @@ AnyVal* HiveUdfCall::Evaluate(ExprContext* ctx, TupleRow* row) {
   return jni_ctx->output_anyval;
 }
 
+int64_t HiveUdfCall::BatchInputOffset(int child_idx, int num_rows) const {
+  int64_t offset = 0;
+  for (int i = 0; i < child_idx; ++i) {
+    int64_t column_size =
+        static_cast<int64_t>(num_rows) * GetChild(i)->type().GetSlotSize();
+    // Align each column to 8 bytes, like the arguments in input_values_buffer.
+    offset += BitUtil::RoundUp(column_size, 8);
+  }
+  return offset;
+}
+
+void HiveUdfCall::EvalBatch(ExprContext* ctx, RowBatch* batch, const int* sel,
+    int num_rows, void* results) {
+  if (num_rows == 0) return;
+  FunctionContext* fn_ctx = ctx->fn_context(fn_context_index_);
+  JniContext* jni_ctx = reinterpret_cast<JniContext*>(
+      fn_ctx->GetFunctionState(FunctionContext::THREAD_LOCAL));
+  DCHECK(jni_ctx != NULL);
+  int val_size = AnyValUtil::AnyValSize(type_);
+  uint8_t* out = reinterpret_cast<uint8_t*>(results);
+
+  JNIEnv* env = getJNIEnv();
+  if (env == NULL) {
+    stringstream ss;
+    ss << "Hive UDF path=" << fn_.hdfs_location << " class=" << fn_.scalar_fn.symbol
+      << " failed due to JNI issue getting the JNIEnv object";
+    fn_ctx->SetError(ss.str().c_str());
+    for (int i = 0; i < num_rows; ++i) {
+      reinterpret_cast<AnyVal*>(out + i * val_size)->is_null = true;
+    }
+    return;
+  }
+
+  if (num_rows > jni_ctx->batch_capacity) {
+    jni_ctx->FreeBatchBuffers();
+    jni_ctx->batch_input_nulls = new uint8_t[GetNumChildren() * num_rows];
+    jni_ctx->batch_input_values =
+        new uint8_t[BatchInputOffset(GetNumChildren(), num_rows)];
+    jni_ctx->batch_output_nulls = new uint8_t[num_rows];
+    jni_ctx->batch_output_values = new uint8_t[num_rows * type_.GetSlotSize()];
+    jni_ctx->batch_capacity = num_rows;
+  }
+
+  // Evaluate the children column by column into the input buffers.
+  for (int i = 0; i < GetNumChildren(); ++i) {
+    void* child_vals = EvalChildBatch(i, ctx, batch, sel, num_rows);
+    WriteInputColumn(GetChild(i)->type(), child_vals, num_rows,
+        jni_ctx->batch_input_nulls + i * num_rows,
+        jni_ctx->batch_input_values + BatchInputOffset(i, num_rows));
+  }
+
+  // Rows that the executor does not write, e.g. after an unexpected exception, are NULL.
+  memset(jni_ctx->batch_output_nulls, 1, num_rows);
+  jvalue args[5];
+  args[0].i = num_rows;
+  args[1].j = reinterpret_cast<jlong>(jni_ctx->batch_input_nulls);
+  args[2].j = reinterpret_cast<jlong>(jni_ctx->batch_input_values);
+  args[3].j = reinterpret_cast<jlong>(jni_ctx->batch_output_nulls);
+  args[4].j = reinterpret_cast<jlong>(jni_ctx->batch_output_values);
+  env->CallNonvirtualVoidMethodA(
+      jni_ctx->executor, jni_ctx->cl, jni_ctx->evaluate_batch_id, args);
+  // The executor evaluates the remaining rows if the UDF fails for some of them and
+  // reports the first failure.
+  Status status = JniUtil::GetJniExceptionMsg(env);
+  if (!status.ok() && !jni_ctx->warning_logged) {
+    stringstream ss;
+    ss << "Hive UDF path=" << fn_.hdfs_location << " class=" << fn_.scalar_fn.symbol
+      << " failed due to: " << status.GetDetail();
+    fn_ctx->AddWarning(ss.str().c_str());
+    jni_ctx->warning_logged = true;
+  }
+
+  int slot_size = type_.GetSlotSize();
+  uint8_t* string_data = NULL;
+  if (type_.IsVarLenStringType()) {
+    // Copy all string results with one allocation.
+    int64_t string_data_len = 0;
+    for (int i = 0; i < num_rows; ++i) {
+      if (jni_ctx->batch_output_nulls[i]) continue;
+      string_data_len += reinterpret_cast<StringValue*>(
+          jni_ctx->batch_output_values + i * slot_size)->len;
+    }
+    if (string_data_len > 0) {
+      string_data = fn_ctx->impl()->AllocateLocal(string_data_len);
+      if (string_data == NULL) memset(jni_ctx->batch_output_nulls, 1, num_rows);
+    }
+  }
+  for (int i = 0; i < num_rows; ++i) {
+    AnyVal* dst = reinterpret_cast<AnyVal*>(out + i * val_size);
+    if (jni_ctx->batch_output_nulls[i]) {
+      dst->is_null = true;
+      continue;
+    }
+    AnyValUtil::SetAnyVal(jni_ctx->batch_output_values + i * slot_size, type_, dst);
+    if (string_data != NULL) {
+      StringVal* str = reinterpret_cast<StringVal*>(dst);
+      memcpy(string_data, str->ptr, str->len);
+      str->ptr = string_data;
+      string_data += str->len;
+    }
+  }
+}
+
 Status HiveUdfCall::Prepare(RuntimeState* state, const RowDescriptor& row_desc,
                             ExprContext* ctx) {
   RETURN_IF_ERROR(Expr::Prepare(state, row_desc, ctx));
@@ -192,6 +390,9 @@ Status HiveUdfCall::Open(RuntimeState* state, ExprContext* ctx,
   jni_ctx->evalute_id = env->GetMethodID(
       jni_ctx->cl, "evaluate", EXECUTOR_EVALUATE_SIGNATURE);
   RETURN_ERROR_IF_EXC(env);
+  jni_ctx->evaluate_batch_id = env->GetMethodID(
+      jni_ctx->cl, "evaluateBatch", EXECUTOR_EVALUATE_BATCH_SIGNATURE);
+  RETURN_ERROR_IF_EXC(env);
   jni_ctx->close_id = env->GetMethodID(
       jni_ctx->cl, "close", EXECUTOR_CLOSE_SIGNATURE);
   RETURN_ERROR_IF_EXC(env);
@@ -262,6 +463,7 @@ void HiveUdfCall::Close(RuntimeState* state, ExprContext* ctx,
         delete jni_ctx->output_anyval;
         jni_ctx->output_anyval = NULL;
       }
+      jni_ctx->FreeBatchBuffers();
     } else {
       DCHECK(!ctx->opened_);
     }
@@ -54,6 +54,19 @@ class RuntimeState;
 /// The BE reads the StringValue as normal.
 //
 /// If the UDF ran into an error, the FE throws an exception.
+//
+/// EvalBatch() amortizes the JNI call over a whole batch of rows. The children are
+/// evaluated column by column and their results are written to columnar input buffers,
+/// then UdfExecutor.evaluateBatch() evaluates the UDF for every row with a single JNI
+/// call and writes the results to columnar output buffers. The layout of the buffers
+/// for 'n' rows is:
+///  - input nulls: n bytes for each argument, one per row.
+///  - input values: a column of n slots for each argument, each column starting at a
+///    multiple of 8 bytes.
+///  - output nulls: n bytes, one per row.
+///  - output values: n slots of the return type. The string data of the output
+///    StringValues is owned by the executor and valid until the next call, so it is
+///    copied into the FunctionContext.
 class HiveUdfCall : public Expr {
  public:
   virtual Status Prepare(RuntimeState* state, const RowDescriptor& row_desc,
@@ -74,6 +87,10 @@ class HiveUdfCall : public Expr {
   virtual TimestampVal GetTimestampVal(ExprContext* ctx, TupleRow*);
   virtual DecimalVal GetDecimalVal(ExprContext* ctx, TupleRow*);
 
+  /// Evaluates the UDF for all rows with a single JNI call, see above.
+  virtual void EvalBatch(ExprContext* ctx, RowBatch* batch, const int* sel,
+      int num_rows, void* results);
+
   virtual Status GetCodegendComputeFn(RuntimeState* state, llvm::Function** fn);
 
  protected:
@@ -89,6 +106,11 @@ class HiveUdfCall : public Expr {
   /// error.
   AnyVal* Evaluate(ExprContext* ctx, TupleRow* row);
 
+  /// Returns the byte offset of the input column of child 'child_idx' in the columnar
+  /// input buffer of a batch of 'num_rows' rows. The offset for GetNumChildren() is the
+  /// size of the buffer.
+  int64_t BatchInputOffset(int child_idx, int num_rows) const;
+
   /// The path on the local FS to the UDF's jar
   std::string local_location_;
 
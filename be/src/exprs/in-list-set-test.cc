@@ -0,0 +1,137 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <limits>
+#include <set>
+#include <stdlib.h>
+#include <boost/lexical_cast.hpp>
+#include <gtest/gtest.h>
+
+#include "exprs/in-list-set.h"
+#include "util/cpu-info.h"
+
+#include "common/names.h"
+
+namespace impala {
+
+// Checks that 'set', which contains the values of 'ref', finds exactly those among the
+// values in 'probes'.
+template<typename T>
+void CheckContains(const InListSet<T>& set, const std::set<T>& ref,
+    const vector<T>& probes) {
+  for (int i = 0; i < probes.size(); ++i) {
+    EXPECT_EQ(ref.find(probes[i]) != ref.end(), set.Contains(probes[i])) << probes[i];
+  }
+}
+
+// Builds an InListSet of 'values', checks that it uses 'strategy' and probes it with the
+// values, their neighbours and the extreme values of T.
+template<typename T>
+void TestIntegers(const vector<int64_t>& values, InListSetBase::Strategy strategy) {
+  InListSet<T> set;
+  std::set<T> ref;
+  vector<T> probes;
+  for (int i = 0; i < values.size(); ++i) {
+    T val = static_cast<T>(values[i]);
+    set.Insert(val);
+    ref.insert(val);
+    probes.push_back(val - 1);
+    probes.push_back(val);
+    probes.push_back(val + 1);
+  }
+  set.Finalize();
+  if (!values.empty()) EXPECT_EQ(strategy, set.strategy());
+  probes.push_back(0);
+  probes.push_back(std::numeric_limits<T>::min());
+  probes.push_back(std::numeric_limits<T>::max());
+  CheckContains(set, ref, probes);
+}
+
+// Returns 'n' random values and a duplicate, each one at least 'min_gap' and at most
+// 2 * 'min_gap' larger than the previous one, starting at -'n' * 'min_gap' / 2.
+vector<int64_t> RandomValues(int n, int64_t min_gap) {
+  vector<int64_t> values;
+  int64_t val = -n * min_gap / 2;
+  for (int i = 0; i < n; ++i) {
+    values.push_back(val);
+    val += min_gap + rand() % (min_gap + 1);
+  }
+  std::random_shuffle(values.begin(), values.end());
+  if (n > 0) values.push_back(values[0]);
+  return values;
+}
+
+TEST(InListSetTest, Bitmap) {
+  for (int n = 0; n < 20; ++n) {
+    TestIntegers<int8_t>(RandomValues(n, 1), InListSetBase::BITMAP);
+    TestIntegers<int16_t>(RandomValues(n, 100), InListSetBase::BITMAP);
+    TestIntegers<int32_t>(RandomValues(n, 100), InListSetBase::BITMAP);
+    TestIntegers<int64_t>(RandomValues(n, 100), InListSetBase::BITMAP);
+  }
+  // Larger sets use a bitmap if it has at most 64 bits per value.
+  TestIntegers<int32_t>(RandomValues(4000, 1), InListSetBase::BITMAP);
+  TestIntegers<int64_t>(RandomValues(4000, 30), InListSetBase::BITMAP);
+}
+
+TEST(InListSetTest, SortedArray) {
+  for (int n = 2; n < 20; ++n) {
+    TestIntegers<int32_t>(RandomValues(n, 1 << 20), InListSetBase::SORTED_ARRAY);
+    TestIntegers<int64_t>(RandomValues(n, 1 << 20), InListSetBase::SORTED_ARRAY);
+  }
+  TestIntegers<int32_t>(RandomValues(4000, 200), InListSetBase::SORTED_ARRAY);
+  TestIntegers<int64_t>(RandomValues(1000, 1L << 40), InListSetBase::SORTED_ARRAY);
+
+  // The range of these values doesn't even fit into the type.
+  vector<int64_t> extremes;
+  extremes.push_back(std::numeric_limits<int64_t>::min());
+  extremes.push_back(std::numeric_limits<int64_t>::max());
+  TestIntegers<int64_t>(extremes, InListSetBase::SORTED_ARRAY);
+}
+
+TEST(InListSetTest, PerfectHash) {
+  for (int n = 0; n <= 4096; n = n < 20 ? n + 1 : n * 2) {
+    // The strings need stable addresses.
+    vector<string> strs(n);
+    InListSet<StringValue> set;
+    std::set<StringValue> ref;
+    for (int i = 0; i < n; ++i) {
+      // Include the empty string and duplicates.
+      if (i > 0) strs[i] = lexical_cast<string>(rand() % (3 * n));
+      StringValue val(const_cast<char*>(strs[i].data()), strs[i].size());
+      set.Insert(val);
+      ref.insert(val);
+    }
+    set.Finalize();
+    EXPECT_EQ(InListSetBase::PERFECT_HASH, set.strategy());
+
+    vector<string> probe_strs;
+    probe_strs.push_back("");
+    for (int i = 0; i < 3 * n + 10; ++i) probe_strs.push_back(lexical_cast<string>(i));
+    vector<StringValue> probes;
+    for (int i = 0; i < probe_strs.size(); ++i) {
+      probes.push_back(StringValue(const_cast<char*>(probe_strs[i].data()),
+          probe_strs[i].size()));
+    }
+    CheckContains(set, ref, probes);
+  }
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  impala::CpuInfo::Init();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,271 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_EXPRS_IN_LIST_SET_H
+#define IMPALA_EXPRS_IN_LIST_SET_H
+
+#include <algorithm>
+#include <set>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+#include "common/compiler-util.h"
+#include "common/logging.h"
+#include "runtime/string-value.inline.h"
+#include "util/bit-util.h"
+#include "util/bitmap.h"
+#include "util/hash-util.h"
+
+namespace impala {
+
+/// The lookup structures an InListSet can use.
+class InListSetBase {
+ public:
+  enum Strategy {
+    /// A std::set of the values. Used for all types not listed below.
+    TREE_SET,
+    /// One bit for each value between the minimum and the maximum value. Used for
+    /// integer values whose range is small compared to their number.
+    BITMAP,
+    /// The values in sorted order, which are searched without branches. Used for the
+    /// other integer values.
+    SORTED_ARRAY,
+    /// A collision-free hash table, so that a lookup costs one hash and at most one
+    /// comparison. Used for strings.
+    PERFECT_HASH,
+  };
+};
+
+/// Set of the constant values of an IN list, see InPredicate::SetLookupPrepare(). All
+/// values must be added with Insert() before Finalize() is called, which builds the
+/// lookup structure. Afterwards only Contains() may be called.
+template<typename T>
+class InListSet : public InListSetBase {
+ public:
+  void Insert(const T& val) { set_.insert(val); }
+  void Finalize() { }
+  bool Contains(const T& val) const { return set_.find(val) != set_.end(); }
+  Strategy strategy() const { return TREE_SET; }
+
+ private:
+  std::set<T> set_;
+};
+
+/// InListSet of signed integers.
+template<typename T>
+class IntegerInListSet : public InListSetBase {
+ public:
+  IntegerInListSet() : strategy_(SORTED_ARRAY), min_(0), range_(0), bitmap_(0) { }
+
+  void Insert(const T& val) { values_.push_back(val); }
+
+  void Finalize() {
+    std::sort(values_.begin(), values_.end());
+    values_.erase(std::unique(values_.begin(), values_.end()), values_.end());
+    if (values_.empty()) return;
+    min_ = values_.front();
+    range_ = Offset(values_.back());
+    // The bitmap is used if it is small enough to stay in the cache anyway, or if it
+    // takes no more memory than the sorted array of 64-bit values.
+    if (range_ < std::max<uint64_t>(MIN_BITMAP_BITS, 64 * values_.size())) {
+      bitmap_.Reset(range_ + 1);
+      for (int i = 0; i < values_.size(); ++i) {
+        bitmap_.Set<false>(Offset(values_[i]), true);
+      }
+      values_.clear();
+      strategy_ = BITMAP;
+    }
+  }
+
+  bool Contains(const T& val) const {
+    if (strategy_ == BITMAP) {
+      uint64_t offset = Offset(val);
+      return offset <= range_ && bitmap_.Get<false>(offset);
+    }
+    DCHECK_EQ(strategy_, SORTED_ARRAY);
+    int n = values_.size();
+    if (UNLIKELY(n == 0)) return false;
+    // Each step halves the range [base, base + n) that 'val' may be in. The comparison
+    // compiles to a conditional move, so there are no branches to mispredict.
+    const T* base = &values_[0];
+    while (n > 1) {
+      int half = n / 2;
+      base = base[half] <= val ? base + half : base;
+      n -= half;
+    }
+    return *base == val;
+  }
+
+  Strategy strategy() const { return strategy_; }
+
+ private:
+  /// Bitmaps of up to this many bits are always used.
+  static const uint64_t MIN_BITMAP_BITS = 64 * 1024;
+
+  /// Returns the distance of 'val' from min_. Values below min_ wrap around to offsets
+  /// larger than range_.
+  uint64_t Offset(T val) const {
+    return static_cast<uint64_t>(val) - static_cast<uint64_t>(min_);
+  }
+
+  Strategy strategy_;
+
+  /// The values in ascending order if strategy_ is SORTED_ARRAY, empty otherwise.
+  std::vector<T> values_;
+
+  /// The smallest value and the offset of the largest one from it.
+  T min_;
+  uint64_t range_;
+
+  /// Bit i is set if min_ + i is in the set. Only used if strategy_ is BITMAP.
+  Bitmap bitmap_;
+};
+
+template<typename T>
+const uint64_t IntegerInListSet<T>::MIN_BITMAP_BITS;
+
+template<> class InListSet<int8_t> : public IntegerInListSet<int8_t> { };
+template<> class InListSet<int16_t> : public IntegerInListSet<int16_t> { };
+template<> class InListSet<int32_t> : public IntegerInListSet<int32_t> { };
+template<> class InListSet<int64_t> : public IntegerInListSet<int64_t> { };
+
+/// InListSet of strings. The perfect hash table is built with 'hash and displace': the
+/// values are hashed into buckets of a few values each, and for each bucket, starting
+/// with the largest ones, a displacement is searched that rehashes all its values to
+/// free slots of the table. A lookup hashes the value once, mixes the hash with the
+/// displacement of its bucket and compares the value with the one in the resulting slot.
+/// Falls back to TREE_SET in the unlikely case that no displacement is found for some
+/// bucket.
+template<>
+class InListSet<StringValue> : public InListSetBase {
+ public:
+  InListSet() : strategy_(PERFECT_HASH) { }
+
+  void Insert(const StringValue& val) { values_.push_back(val); }
+
+  void Finalize() {
+    std::sort(values_.begin(), values_.end());
+    values_.erase(std::unique(values_.begin(), values_.end()), values_.end());
+    int n = values_.size();
+    // At most two values per bucket and a load factor of at most 0.5 make finding the
+    // displacements fast.
+    int num_buckets = BitUtil::NextPowerOfTwo(std::max(n / 2, 1));
+    int num_slots = BitUtil::NextPowerOfTwo(std::max(2 * n, 1));
+    bucket_mask_ = num_buckets - 1;
+    slot_mask_ = num_slots - 1;
+    displacements_.assign(num_buckets, 0);
+    slots_.assign(num_slots, -1);
+
+    std::vector<uint64_t> hashes(n);
+    std::vector<std::vector<int> > buckets(num_buckets);
+    int max_bucket_size = 0;
+    for (int i = 0; i < n; ++i) {
+      hashes[i] = Hash(values_[i]);
+      std::vector<int>* bucket = &buckets[hashes[i] & bucket_mask_];
+      bucket->push_back(i);
+      max_bucket_size = std::max<int>(max_bucket_size, bucket->size());
+    }
+    for (int size = max_bucket_size; size > 0; --size) {
+      for (int b = 0; b < num_buckets; ++b) {
+        if (buckets[b].size() != size) continue;
+        if (!PlaceBucket(buckets[b], hashes, &displacements_[b])) {
+          FallBackToTreeSet();
+          return;
+        }
+      }
+    }
+  }
+
+  bool Contains(const StringValue& val) const {
+    if (UNLIKELY(strategy_ == TREE_SET)) return set_.find(val) != set_.end();
+    DCHECK_EQ(strategy_, PERFECT_HASH);
+    uint64_t hash = Hash(val);
+    int idx = slots_[Displace(hash, displacements_[hash & bucket_mask_]) & slot_mask_];
+    return idx >= 0 && values_[idx] == val;
+  }
+
+  Strategy strategy() const { return strategy_; }
+
+ private:
+  /// Number of displacements tried for each bucket before giving up.
+  static const uint32_t MAX_DISPLACEMENT = 1 << 16;
+
+  static uint64_t Hash(const StringValue& val) {
+    return HashUtil::MurmurHash2_64(val.ptr, val.len, 0);
+  }
+
+  /// Rehashes 'hash' for 'displacement' with the finalizer of MurmurHash3, so that the
+  /// slots of different displacements are independent.
+  static uint64_t Displace(uint64_t hash, uint32_t displacement) {
+    uint64_t h = hash + displacement * 0x9e3779b97f4a7c15ULL;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  /// Searches a displacement that maps the values with indexes 'bucket' to distinct free
+  /// slots, which are then assigned to them. Returns false if there is none.
+  bool PlaceBucket(const std::vector<int>& bucket, const std::vector<uint64_t>& hashes,
+      uint32_t* displacement) {
+    for (uint32_t d = 0; d < MAX_DISPLACEMENT; ++d) {
+      int num_placed = 0;
+      for (; num_placed < bucket.size(); ++num_placed) {
+        int* slot = &slots_[Displace(hashes[bucket[num_placed]], d) & slot_mask_];
+        if (*slot != -1) break;
+        *slot = bucket[num_placed];
+      }
+      if (num_placed == bucket.size()) {
+        *displacement = d;
+        return true;
+      }
+      // Free the slots taken by this attempt.
+      for (int i = 0; i < num_placed; ++i) {
+        slots_[Displace(hashes[bucket[i]], d) & slot_mask_] = -1;
+      }
+    }
+    return false;
+  }
+
+  void FallBackToTreeSet() {
+    set_.insert(values_.begin(), values_.end());
+    values_.clear();
+    displacements_.clear();
+    slots_.clear();
+    strategy_ = TREE_SET;
+  }
+
+  Strategy strategy_;
+
+  /// The distinct values. Only used if strategy_ is PERFECT_HASH.
+  std::vector<StringValue> values_;
+
+  /// The displacement of each bucket, indexed by the low bits of the hashes.
+  uint64_t bucket_mask_;
+  std::vector<uint32_t> displacements_;
+
+  /// The index into values_ of the value in each slot of the table, or -1.
+  uint64_t slot_mask_;
+  std::vector<int> slots_;
+
+  /// Only used if strategy_ is TREE_SET.
+  std::set<StringValue> set_;
+};
+
+}
+
+#endif
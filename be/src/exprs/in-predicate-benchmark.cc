@@ -15,7 +15,14 @@
 
 // Note: The results do not include the pre-processing in the prepare function that is
 // necessary for SetLookup but not Iterate. None of the values searched for are in the
-// fabricated IN list (i.e. hit rate is 0).
+// fabricated IN list (i.e. hit rate is 0), except for the 'dense int' benchmarks, whose
+// values are drawn from a range of 4 * n values.
+//
+// SetLookup uses the InListSet strategy that the prepare function picks for the values:
+// a sorted array for the random ints, a bitmap for the dense ints and a perfect hash
+// table for the strings. 'std::set' is the std::set that SetLookup used before and is
+// still used for the other types. The results below were measured before these
+// strategies were added, i.e. their SetLookup numbers are those of std::set.
 
 // Machine Info: Intel(R) Core(TM) i7-2600 CPU @ 3.40GHz
 // int n=1:              Function     Rate (iters/ms)          Comparison
@@ -190,6 +197,7 @@ class InPredicateBenchmark {
     vector<T> anyvals;
     vector<AnyVal*> anyval_ptrs;
     InPredicate::SetLookupState<SetType> state;
+    std::set<SetType> tree_set;
 
     vector<T> search_vals;
 
@@ -201,18 +209,20 @@ class InPredicateBenchmark {
 
   template<typename T, typename SetType>
   static TestData<T, SetType> CreateTestData(int num_values,
-      const FunctionContext::TypeDesc& type, int num_search_vals = 100) {
+      const FunctionContext::TypeDesc& type, int num_search_vals = 100,
+      int max_value = RAND_MAX) {
     srand(time(NULL));
     TestData<T, SetType> data;
     data.anyvals.resize(num_values);
     data.anyval_ptrs.resize(num_values);
     for (int i = 0; i < num_values; ++i) {
-      data.anyvals[i] = MakeAnyVal<T>(rand());
+      data.anyvals[i] = MakeAnyVal<T>(rand() % max_value);
       data.anyval_ptrs[i] = &data.anyvals[i];
+      data.tree_set.insert(GetVal<T, SetType>(&type, data.anyvals[i]));
     }
 
     for (int i = 0; i < num_search_vals; ++i) {
-      data.search_vals.push_back(MakeAnyVal<T>(rand()));
+      data.search_vals.push_back(MakeAnyVal<T>(rand() % max_value));
     }
 
     FunctionContext* ctx = CreateContext(num_values, type);
@@ -242,6 +252,18 @@ class InPredicateBenchmark {
     }
   }
 
+  template<typename T, typename SetType>
+  static void TestTreeSet(int batch_size, void* d) {
+    TestData<T, SetType>* data = reinterpret_cast<TestData<T, SetType>*>(d);
+    for (int i = 0; i < batch_size; ++i) {
+      BOOST_FOREACH(const T& search_val, data->search_vals) {
+        SetType val = GetVal<T, SetType>(data->state.type, search_val);
+        if (data->tree_set.find(val) != data->tree_set.end()) ++data->total_found_set;
+        ++data->total_set;
+      }
+    }
+  }
+
   template<typename T, typename SetType>
   static void TestIterate(int batch_size, void* d) {
     TestData<T, SetType>* data = reinterpret_cast<TestData<T, SetType>*>(d);
@@ -263,6 +285,8 @@ class InPredicateBenchmark {
         InPredicateBenchmark::CreateTestData<IntVal, int32_t>(n, type);
     suite.AddBenchmark(Substitute("SetLookup n=$0", n),
                        InPredicateBenchmark::TestSetLookup<IntVal, int32_t>, &data);
+    suite.AddBenchmark(Substitute("std::set n=$0", n),
+                       InPredicateBenchmark::TestTreeSet<IntVal, int32_t>, &data);
     suite.AddBenchmark(Substitute("Iterate n=$0", n),
                        InPredicateBenchmark::TestIterate<IntVal, int32_t>, &data);
     cout << suite.Measure() << endl;
@@ -270,6 +294,21 @@ class InPredicateBenchmark {
     // cout << "Found iter: " << (double)data.total_found_iter / data.total_iter << endl;
   }
 
+  static void RunDenseIntBenchmark(int n) {
+    Benchmark suite(Substitute("dense int n=$0", n));
+    FunctionContext::TypeDesc type;
+    type.type = FunctionContext::TYPE_INT;
+    TestData<IntVal, int32_t> data =
+        InPredicateBenchmark::CreateTestData<IntVal, int32_t>(n, type, 100, 4 * n);
+    suite.AddBenchmark(Substitute("SetLookup n=$0", n),
+                       InPredicateBenchmark::TestSetLookup<IntVal, int32_t>, &data);
+    suite.AddBenchmark(Substitute("std::set n=$0", n),
+                       InPredicateBenchmark::TestTreeSet<IntVal, int32_t>, &data);
+    suite.AddBenchmark(Substitute("Iterate n=$0", n),
+                       InPredicateBenchmark::TestIterate<IntVal, int32_t>, &data);
+    cout << suite.Measure() << endl;
+  }
+
   static void RunStringBenchmark(int n) {
     Benchmark suite(Substitute("string n=$0", n));
     FunctionContext::TypeDesc type;
@@ -278,6 +317,8 @@ class InPredicateBenchmark {
         InPredicateBenchmark::CreateTestData<StringVal, StringValue>(n, type);
     suite.AddBenchmark(Substitute("SetLookup n=$0", n),
                        InPredicateBenchmark::TestSetLookup<StringVal, StringValue>, &data);
+    suite.AddBenchmark(Substitute("std::set n=$0", n),
+                       InPredicateBenchmark::TestTreeSet<StringVal, StringValue>, &data);
     suite.AddBenchmark(Substitute("Iterate n=$0", n),
                        InPredicateBenchmark::TestIterate<StringVal, StringValue>, &data);
     cout << suite.Measure() << endl;
@@ -319,11 +360,19 @@ int main(int argc, char **argv) {
 
   for (int i = 1; i <= 10; ++i) InPredicateBenchmark::RunIntBenchmark(i);
   InPredicateBenchmark::RunIntBenchmark(400);
+  InPredicateBenchmark::RunIntBenchmark(4000);
+
+  cout << endl;
+
+  InPredicateBenchmark::RunDenseIntBenchmark(10);
+  InPredicateBenchmark::RunDenseIntBenchmark(400);
+  InPredicateBenchmark::RunDenseIntBenchmark(4000);
 
   cout << endl;
 
   for (int i = 1; i <= 10; ++i) InPredicateBenchmark::RunStringBenchmark(i);
   InPredicateBenchmark::RunStringBenchmark(400);
+  InPredicateBenchmark::RunStringBenchmark(4000);
 
   for (int i = 1; i <= 4; ++i) InPredicateBenchmark::RunDecimalBenchmark(i);
   InPredicateBenchmark::RunDecimalBenchmark(400);
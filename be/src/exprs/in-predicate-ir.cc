@@ -67,9 +67,10 @@ void InPredicate::SetLookupPrepare(
     if (arg->is_null) {
       state->contains_null = true;
     } else {
-      state->val_set.insert(GetVal<T, SetType>(state->type, *arg));
+      state->val_set.Insert(GetVal<T, SetType>(state->type, *arg));
     }
   }
+  state->val_set.Finalize();
   ctx->SetFunctionState(scope, state);
 }
 
@@ -106,8 +107,7 @@ BooleanVal InPredicate::SetLookup(
     SetLookupState<SetType>* state, const T& v) {
   DCHECK(state != NULL);
   SetType val = GetVal<T, SetType>(state->type, v);
-  bool found = state->val_set.find(val) != state->val_set.end();
-  if (found) return BooleanVal(true);
+  if (state->val_set.Contains(val)) return BooleanVal(true);
   if (state->contains_null) return BooleanVal::null();
   return BooleanVal(false);
 }
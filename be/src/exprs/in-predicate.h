@@ -17,6 +17,7 @@
 #define IMPALA_EXPRS_IN_PREDICATE_H_
 
 #include <string>
+#include "exprs/in-list-set.h"
 #include "exprs/predicate.h"
 #include "udf/udf.h"
 
@@ -28,7 +29,9 @@ namespace impala {
 //
 /// 1) SET_LOOKUP: This strategy is for when all the values in the IN list are constant. In
 ///    the prepare function, we create a set of the constant values from the IN list, and
-///    use this set to lookup a given 'val'.
+///    use this set to lookup a given 'val'. The set picks its lookup structure based on
+///    the type and the values, e.g. a bitmap for integers in a small range or a perfect
+///    hash table for strings (see InListSet).
 //
 /// 2) ITERATE: This is the fallback strategy for when their are non-constant IN list
 ///    values, or very few values in the IN list. We simply iterate through every
@@ -278,9 +281,7 @@ class InPredicate : public Predicate {
     bool contains_null;
 
     /// The set of all non-NULL constant values in the IN list.
-    /// Note: boost::unordered_set and std::binary_search performed worse based on the
-    /// in-predicate-benchmark
-    std::set<SetType> val_set;
+    InListSet<SetType> val_set;
 
     /// The type of the arguments
     const FunctionContext::TypeDesc* type;
@@ -19,6 +19,7 @@
 #include <re2/stringpiece.h>
 #include <sstream>
 
+#include "exprs/regex-cache.h"
 #include "gutil/strings/substitute.h"
 #include "runtime/string-value.inline.h"
 #include "string-functions.h"
@@ -103,7 +104,7 @@ void LikePredicate::LikePrepareInternal(FunctionContext* context,
       opts.set_never_nl(false);
       opts.set_dot_nl(true);
       opts.set_case_sensitive(case_sensitive);
-      state->regex_.reset(new RE2(re_pattern, opts));
+      state->regex_ = RegexCache::instance()->GetRegex(re_pattern, opts);
       if (!state->regex_->ok()) {
         context->SetError(
             strings::Substitute("Invalid regex: $0", pattern_val.ptr).c_str());
@@ -173,7 +174,7 @@ void LikePredicate::RegexPrepareInternal(FunctionContext* context,
     } else {
       RE2::Options opts;
       opts.set_case_sensitive(case_sensitive);
-      state->regex_.reset(new RE2(pattern_str, opts));
+      state->regex_ = RegexCache::instance()->GetRegex(pattern_str, opts);
       if (!state->regex_->ok()) {
         stringstream error;
         error << "Invalid regex expression" << pattern->ptr;
@@ -218,7 +219,7 @@ void LikePredicate::RegexpLikePrepare(FunctionContext* context,
       return;
     }
     string pattern_str(reinterpret_cast<const char*>(pattern->ptr), pattern->len);
-    state->regex_.reset(new RE2(pattern_str, opts));
+    state->regex_ = RegexCache::instance()->GetRegex(pattern_str, opts);
     if (!state->regex_->ok()) {
       error << "Invalid regex expression" << pattern->ptr;
       context->SetError(error.str().c_str());
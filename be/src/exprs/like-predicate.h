@@ -16,7 +16,7 @@
 #ifndef IMPALA_EXPRS_LIKE_PREDICATE_H_
 #define IMPALA_EXPRS_LIKE_PREDICATE_H_
 
-#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 #include <re2/re2.h>
 #include <string>
 
@@ -71,8 +71,9 @@ class LikePredicate: public Predicate {
     /// in the value.
     StringSearch substring_pattern_;
 
-    /// Used for RLIKE and REGEXP predicates if the pattern is a constant argument.
-    boost::scoped_ptr<re2::RE2> regex_;
+    /// Used for RLIKE and REGEXP predicates if the pattern is a constant argument. Shared
+    /// with other users of the same pattern through the RegexCache.
+    boost::shared_ptr<const re2::RE2> regex_;
 
     LikePredicateState() : escape_char_('\\') {
     }
@@ -18,6 +18,7 @@
 
 #include "codegen/codegen-anyval.h"
 #include "codegen/llvm-codegen.h"
+#include "exprs/anyval-util.h"
 #include "runtime/runtime-state.h"
 #include "gen-cpp/Exprs_types.h"
 
@@ -317,6 +318,15 @@ DecimalVal Literal::GetDecimalVal(ExprContext* context, TupleRow* row) {
   return DecimalVal();
 }
 
+void Literal::EvalBatch(ExprContext* context, RowBatch* batch, const int* sel,
+    int num_rows, void* results) {
+  if (num_rows == 0) return;
+  Expr::EvalBatch(context, batch, sel, 1, results);
+  int val_size = AnyValUtil::AnyValSize(type_);
+  uint8_t* out = reinterpret_cast<uint8_t*>(results);
+  for (int i = 1; i < num_rows; ++i) memcpy(out + i * val_size, out, val_size);
+}
+
 string Literal::DebugString() const {
   stringstream out;
   out << "Literal(value=";
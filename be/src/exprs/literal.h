@@ -54,6 +54,10 @@ class Literal: public Expr {
   virtual impala_udf::StringVal GetStringVal(ExprContext*, TupleRow*);
   virtual impala_udf::DecimalVal GetDecimalVal(ExprContext*, TupleRow*);
 
+  /// Evaluates the literal once and copies it to all results.
+  virtual void EvalBatch(ExprContext* context, RowBatch* batch, const int* sel,
+      int num_rows, void* results);
+
  protected:
   friend class Expr;
 
@@ -0,0 +1,115 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "exprs/regex-cache.h"
+
+#include <sstream>
+#include <gflags/gflags.h>
+
+#include "common/logging.h"
+#include "util/impalad-metrics.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+DEFINE_int32(regex_cache_capacity, 1024, "(Advanced) Maximum number of compiled "
+    "regular expressions of constant LIKE, RLIKE and REGEXP patterns that are shared by "
+    "all queries. Set to 0 to compile the patterns for every fragment instance.");
+DEFINE_int64(regex_max_mem, 8L * 1024L * 1024L, "(Advanced) Maximum memory, in bytes, "
+    "that each compiled regular expression may use for its program and DFA states. "
+    "Matching falls back to a slower algorithm if the DFA exceeds its share.");
+
+RegexCache::RegexCache(int capacity, int64_t max_mem)
+  : capacity_(capacity),
+    max_mem_(max_mem) {
+}
+
+RegexCache* RegexCache::instance() {
+  static RegexCache cache(FLAGS_regex_cache_capacity, FLAGS_regex_max_mem);
+  return &cache;
+}
+
+shared_ptr<const re2::RE2> RegexCache::GetRegex(const string& pattern,
+    const re2::RE2::Options& options) {
+  re2::RE2::Options opts(options);
+  opts.set_max_mem(max_mem_);
+  if (capacity_ == 0) return shared_ptr<const re2::RE2>(new re2::RE2(pattern, opts));
+
+  string key = GetKey(pattern, opts);
+  {
+    lock_guard<mutex> l(lock_);
+    EntryMap::iterator it = entries_.find(key);
+    if (it != entries_.end()) {
+      // Move to the back, this is now the most recently used entry.
+      lru_list_.splice(lru_list_.end(), lru_list_, it->second);
+      return it->second->regex;
+    }
+  }
+
+  // Compile without holding the lock. If another thread compiles the same pattern
+  // concurrently, the later insert replaces the earlier one, which stays valid for its
+  // users.
+  shared_ptr<const re2::RE2> regex(new re2::RE2(pattern, opts));
+  if (!regex->ok()) return regex;
+  int delta = 0;
+  {
+    lock_guard<mutex> l(lock_);
+    EntryMap::iterator existing = entries_.find(key);
+    if (existing != entries_.end()) {
+      lru_list_.erase(existing->second);
+      entries_.erase(existing);
+      --delta;
+    }
+    while (entries_.size() >= static_cast<size_t>(capacity_)) {
+      DCHECK(!lru_list_.empty());
+      entries_.erase(lru_list_.front().key);
+      lru_list_.pop_front();
+      --delta;
+    }
+    Entry entry;
+    entry.key = key;
+    entry.regex = regex;
+    entries_[key] = lru_list_.insert(lru_list_.end(), entry);
+    ++delta;
+  }
+  UpdateMetrics(delta);
+  return regex;
+}
+
+int RegexCache::num_entries() {
+  lock_guard<mutex> l(lock_);
+  return entries_.size();
+}
+
+string RegexCache::GetKey(const string& pattern, const re2::RE2::Options& options) {
+  stringstream key;
+  key << options.max_mem() << ":" << options.encoding() << ":"
+      << options.posix_syntax() << options.longest_match() << options.log_errors()
+      << options.literal() << options.never_nl() << options.dot_nl()
+      << options.never_capture() << options.case_sensitive() << options.perl_classes()
+      << options.word_boundary() << options.one_line() << ":" << pattern;
+  return key.str();
+}
+
+void RegexCache::UpdateMetrics(int delta) {
+  if (delta == 0) return;
+  if (ImpaladMetrics::REGEX_CACHE_NUM_ENTRIES != NULL) {
+    ImpaladMetrics::REGEX_CACHE_NUM_ENTRIES->Increment(delta);
+  }
+  if (ImpaladMetrics::REGEX_CACHE_MEM_BUDGET_BYTES != NULL) {
+    ImpaladMetrics::REGEX_CACHE_MEM_BUDGET_BYTES->Increment(delta * max_mem_);
+  }
+}
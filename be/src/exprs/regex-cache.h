@@ -0,0 +1,92 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#ifndef IMPALA_EXPRS_REGEX_CACHE_H
+#define IMPALA_EXPRS_REGEX_CACHE_H
+
+#include <list>
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <re2/re2.h>
+
+namespace impala {
+
+/// Process-wide cache of compiled regular expressions, shared by the LIKE, RLIKE and
+/// REGEXP predicates and the regexp_*() functions with constant patterns. Every fragment
+/// instance and thread that evaluates the same pattern with the same options uses the
+/// same RE2 object instead of compiling its own. RE2 objects are thread-safe, so the
+/// cached ones can be matched against concurrently.
+///
+/// Each cached regex may use up to --regex_max_mem bytes for its compiled program and
+/// the DFA states that it builds lazily while matching. RE2 doesn't report how much of
+/// that budget is in use, so the cache accounts for the full budget of each entry in the
+/// impala-server.regex-cache.mem-budget-bytes metric. At most --regex_cache_capacity
+/// regexes are cached; beyond that, the least recently used ones are evicted. Evicted
+/// regexes stay valid for the users that still hold them.
+///
+/// This class is thread-safe.
+class RegexCache {
+ public:
+  /// A capacity of 0 disables the cache: every call to GetRegex() compiles the pattern.
+  RegexCache(int capacity, int64_t max_mem);
+
+  /// Returns the process-wide instance, which is configured by the flags above.
+  static RegexCache* instance();
+
+  /// Returns the compiled regex for 'pattern' with 'options', with the memory budget of
+  /// the cache applied to 'options'. Compiles the pattern if it isn't cached yet. The
+  /// returned regex may not be ok(), in which case it isn't cached.
+  boost::shared_ptr<const re2::RE2> GetRegex(const std::string& pattern,
+      const re2::RE2::Options& options);
+
+  /// Number of regexes in the cache.
+  int num_entries();
+
+ private:
+  struct Entry {
+    std::string key;
+    boost::shared_ptr<const re2::RE2> regex;
+  };
+
+  typedef std::list<Entry> EntryList;
+  typedef boost::unordered_map<std::string, EntryList::iterator> EntryMap;
+
+  /// Returns the key of 'pattern' with 'options'.
+  static std::string GetKey(const std::string& pattern,
+      const re2::RE2::Options& options);
+
+  /// Adds 'delta' entries to the metrics.
+  void UpdateMetrics(int delta);
+
+  const int capacity_;
+  const int64_t max_mem_;
+
+  /// Protects all members below.
+  boost::mutex lock_;
+
+  /// All entries, in least recently used order: new and accessed entries go to the
+  /// back, evictions take from the front.
+  EntryList lru_list_;
+
+  /// Maps each key to its entry in 'lru_list_'.
+  EntryMap entries_;
+};
+
+}
+
+#endif
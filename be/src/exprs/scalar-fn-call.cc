@@ -18,6 +18,7 @@
 #include <gutil/strings/substitute.h>
 #include <llvm/IR/Attributes.h>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/Support/InstIterator.h>
 
 #include "codegen/codegen-anyval.h"
 #include "codegen/llvm-codegen.h"
@@ -25,6 +26,7 @@
 #include "exprs/expr-context.h"
 #include "runtime/hdfs-fs-cache.h"
 #include "runtime/lib-cache.h"
+#include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 #include "runtime/types.h"
 #include "udf/udf-internal.h"
@@ -34,10 +36,18 @@
 
 #include "common/names.h"
 
+DECLARE_bool(async_codegen);
+
 using namespace impala;
 using namespace impala_udf;
 using namespace strings;
 
+// Symbols of the FunctionContext accessors that InlineFnContextConstants() replaces.
+static const char* IS_ARG_CONSTANT_SYMBOL =
+    "_ZNK10impala_udf15FunctionContext13IsArgConstantEi";
+static const char* GET_NUM_ARGS_SYMBOL =
+    "_ZNK10impala_udf15FunctionContext10GetNumArgsEv";
+
 ScalarFnCall::ScalarFnCall(const TExprNode& node)
   : Expr(node),
     vararg_start_idx_(node.__isset.vararg_start_idx ?
@@ -45,7 +55,8 @@ ScalarFnCall::ScalarFnCall(const TExprNode& node)
     scalar_fn_wrapper_(NULL),
     prepare_fn_(NULL),
     close_fn_(NULL),
-    scalar_fn_(NULL) {
+    scalar_fn_(NULL),
+    batch_fn_(NULL) {
   DCHECK_NE(fn_.binary_type, TFunctionBinaryType::JAVA);
 }
 
@@ -112,21 +123,7 @@ Status ScalarFnCall::Prepare(RuntimeState* state, const RowDescriptor& desc,
     if (char_arg) {
       DCHECK(NumFixedArgs() <= 8 && fn_.binary_type == TFunctionBinaryType::BUILTIN);
     }
-    Status status = LibCache::instance()->GetSoFunctionPtr(
-        fn_.hdfs_location, fn_.scalar_fn.symbol, &scalar_fn_, &cache_entry_);
-    if (!status.ok()) {
-      if (fn_.binary_type == TFunctionBinaryType::BUILTIN) {
-        // Builtins symbols should exist unless there is a version mismatch.
-        status.SetErrorMsg(ErrorMsg(TErrorCode::MISSING_BUILTIN,
-            fn_.name.function_name, fn_.scalar_fn.symbol));
-        return status;
-      } else {
-        DCHECK_EQ(fn_.binary_type, TFunctionBinaryType::NATIVE);
-        return Status(Substitute("Problem loading UDF '$0':\n$1",
-            fn_.name.function_name, status.GetDetail()));
-        return status;
-      }
-    }
+    RETURN_IF_ERROR(LoadScalarFn());
   } else {
     // If we got here, either codegen is enabled or we need codegen to run this function.
     LlvmCodeGen* codegen;
@@ -144,8 +141,13 @@ Status ScalarFnCall::Prepare(RuntimeState* state, const RowDescriptor& desc,
 
     llvm::Function* ir_udf_wrapper;
     RETURN_IF_ERROR(GetCodegendComputeFn(state, &ir_udf_wrapper));
+    // The interpreted path is needed if the module is compiled while the fragment runs.
+    bool has_interpreted_fallback = FLAGS_async_codegen &&
+        fn_.binary_type != TFunctionBinaryType::IR && NumFixedArgs() <= 8;
+    if (has_interpreted_fallback) RETURN_IF_ERROR(LoadScalarFn());
     // TODO: don't do this for child exprs
-    codegen->AddFunctionToJit(ir_udf_wrapper, &scalar_fn_wrapper_);
+    codegen->AddFunctionToJit(ir_udf_wrapper, &scalar_fn_wrapper_,
+        has_interpreted_fallback);
   }
 
   if (fn_.scalar_fn.__isset.prepare_fn_symbol) {
@@ -156,6 +158,14 @@ Status ScalarFnCall::Prepare(RuntimeState* state, const RowDescriptor& desc,
     RETURN_IF_ERROR(GetFunction(state, fn_.scalar_fn.close_fn_symbol,
         reinterpret_cast<void**>(&close_fn_)));
   }
+  if (fn_.scalar_fn.__isset.batch_fn_symbol) {
+    // The frontend rejects batch functions of UDFs with variable arguments.
+    DCHECK_EQ(vararg_start_idx_, -1);
+    RETURN_IF_ERROR(GetFunction(state, fn_.scalar_fn.batch_fn_symbol,
+        reinterpret_cast<void**>(&batch_fn_)));
+  } else if (scalar_fn_ != NULL && vararg_start_idx_ == -1) {
+    batch_fn_ = BatchFunctions::Lookup(scalar_fn_);
+  }
 
   return Status::OK();
 }
@@ -167,9 +177,9 @@ Status ScalarFnCall::Open(RuntimeState* state, ExprContext* ctx,
   FunctionContext* fn_ctx = ctx->fn_context(fn_context_index_);
 
   if (scalar_fn_ != NULL) {
-    // We're in the interpreted path (i.e. no JIT). Populate our FunctionContext's
-    // staging_input_vals, which will be reused across calls to scalar_fn_.
-    DCHECK(scalar_fn_wrapper_ == NULL);
+    // We're in the interpreted path (i.e. no JIT, or the JIT'd wrapper may not be
+    // compiled yet). Populate our FunctionContext's staging_input_vals, which will be
+    // reused across calls to scalar_fn_.
     ObjectPool* obj_pool = state->obj_pool();
     vector<AnyVal*>* input_vals = fn_ctx->impl()->staging_input_vals();
     for (int i = 0; i < NumFixedArgs(); ++i) {
@@ -478,6 +488,7 @@ Status ScalarFnCall::GetUdf(RuntimeState* state, llvm::Function** udf) {
     *udf = codegen->CloneFunction(*udf);
     (*udf)->setName(demangled_name);
     InlineConstants(codegen, *udf);
+    InlineFnContextConstants(codegen, *udf);
     *udf = codegen->FinalizeFunction(*udf);
     DCHECK(*udf != NULL);
   } else {
@@ -490,6 +501,13 @@ Status ScalarFnCall::GetUdf(RuntimeState* state, llvm::Function** udf) {
          << " from LLVM module " << fn_.hdfs_location;
       return Status(ss.str());
     }
+    // Specialize a clone of the UDF for the arguments of this call. FinalizeFunction()
+    // marks it always-inline, so that it is inlined into our wrapper, and with the
+    // wrapper into the operator functions in OptimizeFunctionWithExprs(). There the
+    // folded IsArgConstant() checks and the inlined constant children are propagated
+    // through the UDF body.
+    *udf = codegen->CloneFunction(*udf);
+    InlineFnContextConstants(codegen, *udf);
     *udf = codegen->FinalizeFunction(*udf);
     if (*udf == NULL) {
       return Status(
@@ -499,6 +517,56 @@ Status ScalarFnCall::GetUdf(RuntimeState* state, llvm::Function** udf) {
   return Status::OK();
 }
 
+int ScalarFnCall::InlineFnContextConstants(LlvmCodeGen* codegen, llvm::Function* fn) {
+  int replaced = 0;
+  for (llvm::inst_iterator iter = llvm::inst_begin(fn), end = llvm::inst_end(fn);
+       iter != end; ) {
+    // Increment iter now so we don't mess it up modifying the instruction below
+    llvm::Instruction* instr = &*(iter++);
+    if (!llvm::isa<llvm::CallInst>(instr)) continue;
+    llvm::CallInst* call_instr = llvm::cast<llvm::CallInst>(instr);
+    llvm::Function* called_fn = call_instr->getCalledFunction();
+    if (called_fn == NULL) continue;
+    // Only calls on the FunctionContext* argument of 'fn' are about this expr.
+    if (!llvm::isa<llvm::Argument>(call_instr->getArgOperand(0))) continue;
+
+    llvm::Value* constant = NULL;
+    if (called_fn->getName() == IS_ARG_CONSTANT_SYMBOL) {
+      llvm::ConstantInt* i_arg =
+          llvm::dyn_cast<llvm::ConstantInt>(call_instr->getArgOperand(1));
+      if (i_arg == NULL) continue;
+      // Open() sets the constant arguments to the values of the constant children.
+      int64_t i = i_arg->getSExtValue();
+      bool is_constant = i >= 0 && i < children_.size() && children_[i]->IsConstant();
+      constant = is_constant ? codegen->true_value() : codegen->false_value();
+    } else if (called_fn->getName() == GET_NUM_ARGS_SYMBOL) {
+      constant = codegen->GetIntConstant(TYPE_INT, children_.size());
+    } else {
+      continue;
+    }
+    DCHECK_EQ(constant->getType(), call_instr->getType());
+    call_instr->replaceAllUsesWith(constant);
+    call_instr->eraseFromParent();
+    ++replaced;
+  }
+  return replaced;
+}
+
+Status ScalarFnCall::LoadScalarFn() {
+  Status status = LibCache::instance()->GetSoFunctionPtr(
+      fn_.hdfs_location, fn_.scalar_fn.symbol, &scalar_fn_, &cache_entry_);
+  if (status.ok()) return status;
+  if (fn_.binary_type == TFunctionBinaryType::BUILTIN) {
+    // Builtins symbols should exist unless there is a version mismatch.
+    status.SetErrorMsg(ErrorMsg(TErrorCode::MISSING_BUILTIN,
+        fn_.name.function_name, fn_.scalar_fn.symbol));
+    return status;
+  }
+  DCHECK_EQ(fn_.binary_type, TFunctionBinaryType::NATIVE);
+  return Status(Substitute("Problem loading UDF '$0':\n$1",
+      fn_.name.function_name, status.GetDetail()));
+}
+
 Status ScalarFnCall::GetFunction(RuntimeState* state, const string& symbol, void** fn) {
   if (fn_.binary_type == TFunctionBinaryType::NATIVE ||
       fn_.binary_type == TFunctionBinaryType::BUILTIN) {
@@ -680,6 +748,20 @@ typedef TimestampVal (*TimestampWrapper)(ExprContext*, TupleRow*);
 typedef DecimalVal (*DecimalWrapper)(ExprContext*, TupleRow*);
 
 // TODO: macroify this?
+void ScalarFnCall::EvalBatch(ExprContext* context, RowBatch* batch, const int* sel,
+    int num_rows, void* results) {
+  if (batch_fn_ == NULL || num_rows == 0) {
+    Expr::EvalBatch(context, batch, sel, num_rows, results);
+    return;
+  }
+  const void** args = reinterpret_cast<const void**>(
+      AllocateBatchScratch(context, children_.size() * sizeof(void*)));
+  for (int i = 0; i < children_.size(); ++i) {
+    args[i] = EvalChildBatch(i, context, batch, sel, num_rows);
+  }
+  batch_fn_(context->fn_context(fn_context_index_), num_rows, args, results);
+}
+
 BooleanVal ScalarFnCall::GetBooleanVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(type_.type, TYPE_BOOLEAN);
   DCHECK(context != NULL);
@@ -18,6 +18,7 @@
 
 #include <string>
 
+#include "exprs/batch-functions.h"
 #include "exprs/expr.h"
 #include "udf/udf.h"
 
@@ -74,6 +75,11 @@ class ScalarFnCall: public Expr {
   virtual TimestampVal GetTimestampVal(ExprContext* context, TupleRow*);
   virtual DecimalVal GetDecimalVal(ExprContext* context, TupleRow*);
 
+  /// Uses the batch version of the function if it has one: the batch_fn of a UDF, see
+  /// UdfBatchFn, or that of a builtin, see BatchFunctions.
+  virtual void EvalBatch(ExprContext* context, RowBatch* batch, const int* sel,
+      int num_rows, void* results);
+
  private:
   /// If this function has var args, children()[vararg_start_idx_] is the first vararg
   /// argument.
@@ -95,17 +101,31 @@ class ScalarFnCall: public Expr {
   UdfClose close_fn_;
 
   /// If running with codegen disabled, scalar_fn_ will be a pointer to the non-JIT'd
-  /// scalar function.
+  /// scalar function. With --async_codegen it is also set for builtins and native UDFs
+  /// that are codegen'd, and used until scalar_fn_wrapper_ is compiled.
   void* scalar_fn_;
 
+  /// The batch version of the function, or NULL if there is none. Set in Prepare(), or
+  /// when the module is JIT'd for IR UDFs.
+  BatchScalarFn batch_fn_;
+
   /// Returns the number of non-vararg arguments
   int NumFixedArgs() const {
     return vararg_start_idx_ >= 0 ? vararg_start_idx_ : children_.size();
   }
 
+  /// Loads the native or builtin function into scalar_fn_.
+  Status LoadScalarFn();
+
   /// Loads the native or IR function from HDFS and puts the result in *udf.
   Status GetUdf(RuntimeState* state, llvm::Function** udf);
 
+  /// Finds the calls to FunctionContext::IsArgConstant() with an immediate argument and
+  /// to FunctionContext::GetNumArgs() in 'fn', the IR of the function called by this
+  /// expr, and replaces them with their results, which only depend on the children.
+  /// Returns the number of calls replaced.
+  int InlineFnContextConstants(LlvmCodeGen* codegen, llvm::Function* fn);
+
   /// Loads the native or IR function 'symbol' from HDFS and puts the result in *fn.
   /// If the function is loaded from an IR module, it cannot be called until the module
   /// has been JIT'd (i.e. after Prepare() has completed).
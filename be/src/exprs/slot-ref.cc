@@ -20,6 +20,7 @@
 #include "codegen/llvm-codegen.h"
 #include "gen-cpp/Exprs_types.h"
 #include "runtime/collection-value.h"
+#include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 
 #include "common/names.h"
@@ -363,6 +364,49 @@ Status SlotRef::GetCodegendComputeFn(RuntimeState* state, llvm::Function** fn) {
   return Status::OK();
 }
 
+template<typename VAL_TYPE, typename NATIVE_TYPE>
+void SlotRef::EvalNumericBatch(RowBatch* batch, const int* sel, int num_rows,
+    void* results) {
+  VAL_TYPE* out = reinterpret_cast<VAL_TYPE*>(results);
+  for (int i = 0; i < num_rows; ++i) {
+    Tuple* t = batch->GetRow(sel == NULL ? i : sel[i])->GetTuple(tuple_idx_);
+    if (t == NULL || t->IsNull(null_indicator_offset_)) {
+      out[i] = VAL_TYPE::null();
+    } else {
+      out[i] = VAL_TYPE(*reinterpret_cast<NATIVE_TYPE*>(t->GetSlot(slot_offset_)));
+    }
+  }
+}
+
+void SlotRef::EvalBatch(ExprContext* context, RowBatch* batch, const int* sel,
+    int num_rows, void* results) {
+  switch (type_.type) {
+    case TYPE_BOOLEAN:
+      EvalNumericBatch<BooleanVal, bool>(batch, sel, num_rows, results);
+      break;
+    case TYPE_TINYINT:
+      EvalNumericBatch<TinyIntVal, int8_t>(batch, sel, num_rows, results);
+      break;
+    case TYPE_SMALLINT:
+      EvalNumericBatch<SmallIntVal, int16_t>(batch, sel, num_rows, results);
+      break;
+    case TYPE_INT:
+      EvalNumericBatch<IntVal, int32_t>(batch, sel, num_rows, results);
+      break;
+    case TYPE_BIGINT:
+      EvalNumericBatch<BigIntVal, int64_t>(batch, sel, num_rows, results);
+      break;
+    case TYPE_FLOAT:
+      EvalNumericBatch<FloatVal, float>(batch, sel, num_rows, results);
+      break;
+    case TYPE_DOUBLE:
+      EvalNumericBatch<DoubleVal, double>(batch, sel, num_rows, results);
+      break;
+    default:
+      Expr::EvalBatch(context, batch, sel, num_rows, results);
+  }
+}
+
 BooleanVal SlotRef::GetBooleanVal(ExprContext* context, TupleRow* row) {
   DCHECK_EQ(type_.type, TYPE_BOOLEAN);
   Tuple* t = row->GetTuple(tuple_idx_);
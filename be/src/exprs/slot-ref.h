@@ -38,6 +38,11 @@ class SlotRef : public Expr {
   virtual bool IsConstant() const { return false; }
   virtual int GetSlotIds(std::vector<SlotId>* slot_ids) const;
   const SlotId& slot_id() const { return slot_id_; }
+  int tuple_idx() const { return tuple_idx_; }
+  int slot_offset() const { return slot_offset_; }
+  const NullIndicatorOffset& null_indicator_offset() const {
+    return null_indicator_offset_;
+  }
 
   virtual Status GetCodegendComputeFn(RuntimeState* state, llvm::Function** fn);
 
@@ -53,7 +58,15 @@ class SlotRef : public Expr {
   virtual impala_udf::DecimalVal GetDecimalVal(ExprContext* context, TupleRow*);
   virtual impala_udf::CollectionVal GetCollectionVal(ExprContext* context, TupleRow*);
 
+  /// Reads fixed-width numeric slots directly. Other types are read row by row.
+  virtual void EvalBatch(ExprContext* context, RowBatch* batch, const int* sel,
+      int num_rows, void* results);
+
  protected:
+  /// Implements EvalBatch() for slots of NATIVE_TYPE that are returned as VAL_TYPE.
+  template<typename VAL_TYPE, typename NATIVE_TYPE>
+  void EvalNumericBatch(RowBatch* batch, const int* sel, int num_rows, void* results);
+
   int tuple_idx_;  // within row
   int slot_offset_;  // within tuple
   NullIndicatorOffset null_indicator_offset_;  // within tuple
@@ -22,8 +22,11 @@
 
 #include "exprs/anyval-util.h"
 #include "exprs/expr.h"
+#include "exprs/regex-cache.h"
 #include "runtime/string-value.inline.h"
+#include "runtime/string-search.h"
 #include "runtime/tuple-row.h"
+#include "util/sse-util.h"
 #include "util/url-parser.h"
 
 #include "common/names.h"
@@ -34,6 +37,79 @@ using std::bitset;
 // NOTE: be careful not to use string::append.  It is not performant.
 namespace impala {
 
+// The kernels below process 16 characters at a time with SSE2, which all x86-64 CPUs
+// support, and the remaining characters one at a time. Signed comparisons are fine for
+// ASCII ranges: characters >= 0x80 are negative and never in range.
+
+// Returns the index of the first of the 'len' characters at 's' that is between 'lo'
+// and 'hi', or 'len' if there is none.
+static int FindFirstInRange(const uint8_t* s, int len, char lo, char hi) {
+  const __m128i below = _mm_set1_epi8(lo - 1);
+  const __m128i above = _mm_set1_epi8(hi + 1);
+  int i = 0;
+  for (; i + SSEUtil::CHARS_PER_128_BIT_REGISTER <= len;
+       i += SSEUtil::CHARS_PER_128_BIT_REGISTER) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+    int in_range = _mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpgt_epi8(v, below), _mm_cmplt_epi8(v, above)));
+    if (in_range != 0) return i + __builtin_ctz(in_range);
+  }
+  for (; i < len; ++i) {
+    if (s[i] >= lo && s[i] <= hi) return i;
+  }
+  return len;
+}
+
+// Copies the 'len' characters at 'src' to 'dst' and flips the case of the ASCII letters
+// between 'lo' and 'hi'. This matches ::tolower() and ::toupper() in the C locale.
+static void FlipCase(const uint8_t* src, int len, char lo, char hi, uint8_t* dst) {
+  const __m128i below = _mm_set1_epi8(lo - 1);
+  const __m128i above = _mm_set1_epi8(hi + 1);
+  const __m128i case_bit = _mm_set1_epi8(0x20);
+  int i = 0;
+  for (; i + SSEUtil::CHARS_PER_128_BIT_REGISTER <= len;
+       i += SSEUtil::CHARS_PER_128_BIT_REGISTER) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    __m128i in_range = _mm_and_si128(_mm_cmpgt_epi8(v, below), _mm_cmplt_epi8(v, above));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+        _mm_xor_si128(v, _mm_and_si128(in_range, case_bit)));
+  }
+  for (; i < len; ++i) {
+    dst[i] = (src[i] >= lo && src[i] <= hi) ? src[i] ^ 0x20 : src[i];
+  }
+}
+
+// Returns the number of leading spaces of the 'len' characters at 's'.
+static int CountLeadingSpaces(const uint8_t* s, int len) {
+  const __m128i space = _mm_set1_epi8(' ');
+  int i = 0;
+  for (; i + SSEUtil::CHARS_PER_128_BIT_REGISTER <= len;
+       i += SSEUtil::CHARS_PER_128_BIT_REGISTER) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+    int not_space = ~_mm_movemask_epi8(_mm_cmpeq_epi8(v, space)) & 0xffff;
+    if (not_space != 0) return i + __builtin_ctz(not_space);
+  }
+  while (i < len && s[i] == ' ') ++i;
+  return i;
+}
+
+// Returns the number of trailing spaces of the 'len' characters at 's'.
+static int CountTrailingSpaces(const uint8_t* s, int len) {
+  const __m128i space = _mm_set1_epi8(' ');
+  // The characters from 'end' on are spaces.
+  int end = len;
+  for (; end >= SSEUtil::CHARS_PER_128_BIT_REGISTER;
+       end -= SSEUtil::CHARS_PER_128_BIT_REGISTER) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+        s + end - SSEUtil::CHARS_PER_128_BIT_REGISTER));
+    int not_space = ~_mm_movemask_epi8(_mm_cmpeq_epi8(v, space)) & 0xffff;
+    // The highest bit of 'not_space' is the last character that is not a space.
+    if (not_space != 0) return len - end + __builtin_clz(not_space) - 16;
+  }
+  while (end > 0 && s[end - 1] == ' ') --end;
+  return len - end;
+}
+
 // This behaves identically to the mysql implementation, namely:
 //  - 1-indexed positions
 //  - supported negative positions (count from the end of the string)
@@ -159,21 +235,25 @@ IntVal StringFunctions::CharLength(FunctionContext* context, const StringVal& st
 
 StringVal StringFunctions::Lower(FunctionContext* context, const StringVal& str) {
   if (str.is_null) return StringVal::null();
+  // Strings without upper case letters are returned as is, without a copy.
+  int first = FindFirstInRange(str.ptr, str.len, 'A', 'Z');
+  if (first == str.len) return str;
   StringVal result(context, str.len);
   if (UNLIKELY(result.is_null)) return result;
-  for (int i = 0; i < str.len; ++i) {
-    result.ptr[i] = ::tolower(str.ptr[i]);
-  }
+  memcpy(result.ptr, str.ptr, first);
+  FlipCase(str.ptr + first, str.len - first, 'A', 'Z', result.ptr + first);
   return result;
 }
 
 StringVal StringFunctions::Upper(FunctionContext* context, const StringVal& str) {
   if (str.is_null) return StringVal::null();
+  // Strings without lower case letters are returned as is, without a copy.
+  int first = FindFirstInRange(str.ptr, str.len, 'a', 'z');
+  if (first == str.len) return str;
   StringVal result(context, str.len);
   if (UNLIKELY(result.is_null)) return result;
-  for (int i = 0; i < str.len; ++i) {
-    result.ptr[i] = ::toupper(str.ptr[i]);
-  }
+  memcpy(result.ptr, str.ptr, first);
+  FlipCase(str.ptr + first, str.len - first, 'a', 'z', result.ptr + first);
   return result;
 }
 
@@ -237,39 +317,20 @@ StringVal StringFunctions::Translate(FunctionContext* context, const StringVal&
 
 StringVal StringFunctions::Trim(FunctionContext* context, const StringVal& str) {
   if (str.is_null) return StringVal::null();
-  // Find new starting position.
-  int32_t begin = 0;
-  while (begin < str.len && str.ptr[begin] == ' ') {
-    ++begin;
-  }
-  // Find new ending position.
-  int32_t end = str.len - 1;
-  while (end > begin && str.ptr[end] == ' ') {
-    --end;
-  }
-  return StringVal(str.ptr + begin, end - begin + 1);
+  int32_t begin = CountLeadingSpaces(str.ptr, str.len);
+  int32_t len = str.len - begin;
+  return StringVal(str.ptr + begin, len - CountTrailingSpaces(str.ptr + begin, len));
 }
 
 StringVal StringFunctions::Ltrim(FunctionContext* context, const StringVal& str) {
   if (str.is_null) return StringVal::null();
-  // Find new starting position.
-  int32_t begin = 0;
-  while (begin < str.len && str.ptr[begin] == ' ') {
-    ++begin;
-  }
+  int32_t begin = CountLeadingSpaces(str.ptr, str.len);
   return StringVal(str.ptr + begin, str.len - begin);
 }
 
 StringVal StringFunctions::Rtrim(FunctionContext* context, const StringVal& str) {
   if (str.is_null) return StringVal::null();
-  if (str.len == 0) return str;
-  // Find new ending position.
-  int32_t end = str.len - 1;
-  while (end > 0 && str.ptr[end] == ' ') {
-    --end;
-  }
-  DCHECK_GE(end, 0);
-  return StringVal(str.ptr, (str.ptr[end] == ' ') ? end : end + 1);
+  return StringVal(str.ptr, str.len - CountTrailingSpaces(str.ptr, str.len));
 }
 
 IntVal StringFunctions::Ascii(FunctionContext* context, const StringVal& str) {
@@ -314,31 +375,67 @@ IntVal StringFunctions::LocatePos(FunctionContext* context, const StringVal& sub
   }
 }
 
+// Sets 'options' to the options of the regexp functions for 'match_parameter'. Returns
+// false and sets 'error_str' if 'match_parameter' is invalid.
+static bool GetRegexOptions(const StringVal& match_parameter, string* error_str,
+    re2::RE2::Options* options) {
+  // Disable error logging in case e.g. every row causes an error
+  options->set_log_errors(false);
+  // Return the leftmost longest match (rather than the first match).
+  options->set_longest_match(true);
+  return match_parameter.is_null ||
+      StringFunctions::SetRE2Options(match_parameter, error_str, options);
+}
+
+static void SetCompileError(const StringVal& pattern, const re2::RE2& re,
+    string* error_str) {
+  stringstream ss;
+  ss << "Could not compile regexp pattern: " << AnyValUtil::ToString(pattern) << endl
+     << "Error: " << re.error();
+  *error_str = ss.str();
+}
+
 // The caller owns the returned regex. Returns NULL if the pattern could not be compiled.
 re2::RE2* CompileRegex(const StringVal& pattern, string* error_str,
     const StringVal& match_parameter) {
   re2::StringPiece pattern_sp(reinterpret_cast<char*>(pattern.ptr), pattern.len);
   re2::RE2::Options options;
-  // Disable error logging in case e.g. every row causes an error
-  options.set_log_errors(false);
-  // Return the leftmost longest match (rather than the first match).
-  options.set_longest_match(true);
-  if (!match_parameter.is_null &&
-      !StringFunctions::SetRE2Options(match_parameter, error_str, &options)) {
-    return NULL;
-  }
+  if (!GetRegexOptions(match_parameter, error_str, &options)) return NULL;
   re2::RE2* re = new re2::RE2(pattern_sp, options);
   if (!re->ok()) {
-    stringstream ss;
-    ss << "Could not compile regexp pattern: " << AnyValUtil::ToString(pattern) << endl
-       << "Error: " << re->error();
-    *error_str = ss.str();
+    SetCompileError(pattern, *re, error_str);
     delete re;
     return NULL;
   }
   return re;
 }
 
+// Function state of the regexp functions with constant patterns: a reference to the
+// compiled pattern in the RegexCache.
+typedef boost::shared_ptr<const re2::RE2> CachedRegex;
+
+// Returns the compiled regex for a constant pattern from the RegexCache. The caller owns
+// the returned reference. Returns NULL if the pattern could not be compiled.
+static CachedRegex* GetCachedRegex(const StringVal& pattern, string* error_str,
+    const StringVal& match_parameter) {
+  re2::RE2::Options options;
+  if (!GetRegexOptions(match_parameter, error_str, &options)) return NULL;
+  CachedRegex re = RegexCache::instance()->GetRegex(AnyValUtil::ToString(pattern),
+      options);
+  if (!re->ok()) {
+    SetCompileError(pattern, *re, error_str);
+    return NULL;
+  }
+  return new CachedRegex(re);
+}
+
+// Returns the regex that the prepare function compiled, or NULL if there is none.
+static const re2::RE2* GetConstantRegex(FunctionContext* context) {
+  CachedRegex* re = reinterpret_cast<CachedRegex*>(
+      context->GetFunctionState(FunctionContext::FRAGMENT_LOCAL));
+  return re == NULL ? NULL : re->get();
+}
+
 // This function sets options in the RE2 library before pattern matching.
 bool StringFunctions::SetRE2Options(const StringVal& match_parameter,
     string* error_str, re2::RE2::Options* opts) {
@@ -378,7 +475,7 @@ void StringFunctions::RegexpPrepare(
   if (pattern->is_null) return;
 
   string error_str;
-  re2::RE2* re = CompileRegex(*pattern, &error_str, StringVal::null());
+  CachedRegex* re = GetCachedRegex(*pattern, &error_str, StringVal::null());
   if (re == NULL) {
     context->SetError(error_str.c_str());
     return;
@@ -389,7 +486,7 @@ void StringFunctions::RegexpPrepare(
 void StringFunctions::RegexpClose(
     FunctionContext* context, FunctionContext::FunctionStateScope scope) {
   if (scope != FunctionContext::FRAGMENT_LOCAL) return;
-  re2::RE2* re = reinterpret_cast<re2::RE2*>(context->GetFunctionState(scope));
+  CachedRegex* re = reinterpret_cast<CachedRegex*>(context->GetFunctionState(scope));
   delete re;
 }
 
@@ -398,9 +495,8 @@ StringVal StringFunctions::RegexpExtract(FunctionContext* context, const StringV
   if (str.is_null || pattern.is_null || index.is_null) return StringVal::null();
   if (index.val < 0) return StringVal();
 
-  re2::RE2* re = reinterpret_cast<re2::RE2*>(
-      context->GetFunctionState(FunctionContext::FRAGMENT_LOCAL));
-  scoped_ptr<re2::RE2> scoped_re; // destroys re if we have to locally compile it
+  const re2::RE2* re = GetConstantRegex(context);
+  scoped_ptr<const re2::RE2> scoped_re; // destroys re if we have to locally compile it
   if (re == NULL) {
     DCHECK(!context->IsArgConstant(1));
     string error_str;
@@ -430,9 +526,8 @@ StringVal StringFunctions::RegexpReplace(FunctionContext* context, const StringV
     const StringVal& pattern, const StringVal& replace) {
   if (str.is_null || pattern.is_null || replace.is_null) return StringVal::null();
 
-  re2::RE2* re = reinterpret_cast<re2::RE2*>(
-      context->GetFunctionState(FunctionContext::FRAGMENT_LOCAL));
-  scoped_ptr<re2::RE2> scoped_re; // destroys re if state->re is NULL
+  const re2::RE2* re = GetConstantRegex(context);
+  scoped_ptr<const re2::RE2> scoped_re; // destroys re if state->re is NULL
   if (re == NULL) {
     DCHECK(!context->IsArgConstant(1));
     string error_str;
@@ -468,7 +563,7 @@ void StringFunctions::RegexpMatchCountPrepare(FunctionContext* context,
     match_parameter = reinterpret_cast<StringVal*>(context->GetConstantArg(3));
   }
   string error_str;
-  re2::RE2* re = CompileRegex(*pattern, &error_str, match_parameter == NULL ?
+  CachedRegex* re = GetCachedRegex(*pattern, &error_str, match_parameter == NULL ?
       StringVal::null() : *match_parameter);
   if (re == NULL) {
     context->SetError(error_str.c_str());
@@ -499,10 +594,9 @@ IntVal StringFunctions::RegexpMatchCount4Args(FunctionContext* context,
     return IntVal::null();
   }
 
-  re2::RE2* re = reinterpret_cast<re2::RE2*>(
-      context->GetFunctionState(FunctionContext::FRAGMENT_LOCAL));
+  const re2::RE2* re = GetConstantRegex(context);
   // Destroys re if we have to locally compile it.
-  scoped_ptr<re2::RE2> scoped_re;
+  scoped_ptr<const re2::RE2> scoped_re;
   if (re == NULL) {
     DCHECK(!context->IsArgConstant(1) || (context->GetNumArgs() == 4 &&
         !context->IsArgConstant(3)));
@@ -553,13 +647,24 @@ StringVal StringFunctions::ConcatWs(FunctionContext* context, const StringVal& s
 
   if (strs[0].is_null) return StringVal::null();
   int32_t total_size = strs[0].len;
+  // The last non-empty argument, if there is only one.
+  int32_t only_non_empty = 0;
+  int32_t num_non_empty = strs[0].len > 0;
 
   // Loop once to compute the final size and reserve space.
   for (int32_t i = 1; i < num_children; ++i) {
     if (strs[i].is_null) return StringVal::null();
     total_size += sep.len + strs[i].len;
+    if (strs[i].len > 0) {
+      only_non_empty = i;
+      ++num_non_empty;
+    }
   }
+  // Without a separator, the result is the only non-empty argument, if there is one.
+  // It is returned as is, without a copy.
+  if (sep.len == 0 && num_non_empty <= 1) return strs[only_non_empty];
   StringVal result(context, total_size);
+  if (UNLIKELY(result.is_null)) return result;
   uint8_t* ptr = result.ptr;
 
   // Loop again to append the data.
@@ -749,16 +854,6 @@ StringVal StringFunctions::BTrimString(FunctionContext* ctx,
   return StringVal(str.ptr + begin, end - begin + 1);
 }
 
-// Similar to strstr() except that the strings are not null-terminated
-static char* locate_substring(char* haystack, int hay_len, char* needle, int needle_len) {
-  DCHECK_GT(needle_len, 0);
-  for (int i = 0; i < hay_len - needle_len + 1; ++i) {
-    char* possible_needle = haystack + i;
-    if (strncmp(possible_needle, needle, needle_len) == 0) return possible_needle;
-  }
-  return NULL;
-}
-
 StringVal StringFunctions::SplitPart(FunctionContext* context,
     const StringVal& str, const StringVal& delim, const BigIntVal& field) {
   if (str.is_null || delim.is_null || field.is_null) return StringVal::null();
@@ -770,24 +865,24 @@ StringVal StringFunctions::SplitPart(FunctionContext* context,
     return StringVal::null();
   }
   if (delim.len == 0) return str;
-  char* str_start = reinterpret_cast<char*>(str.ptr);
-  char* str_part = str_start;
-  char* delimiter = reinterpret_cast<char*>(delim.ptr);
+  StringValue delim_sv = StringValue::FromStringVal(delim);
+  StringSearch search(&delim_sv);
+  // The part of 'str' after the last delimiter found so far. The result is a view of it.
+  StringValue remaining = StringValue::FromStringVal(str);
   for (int cur_pos = 1; ; ++cur_pos) {
-    int remaining_len = str.len - (str_part - str_start);
-    char* delim_ref = locate_substring(str_part, remaining_len, delimiter, delim.len);
-    if (delim_ref == NULL) {
+    int match = search.Search(&remaining);
+    if (match == -1) {
       if (cur_pos == field_pos) {
-        return StringVal(reinterpret_cast<uint8_t*>(str_part), remaining_len);
+        return StringVal(reinterpret_cast<uint8_t*>(remaining.ptr), remaining.len);
       }
       // Return empty string if required field position is not found.
       return StringVal();
     }
     if (cur_pos == field_pos) {
-      return StringVal(reinterpret_cast<uint8_t*>(str_part),
-          delim_ref - str_part);
+      return StringVal(reinterpret_cast<uint8_t*>(remaining.ptr), match);
     }
-    str_part = delim_ref + delim.len;
+    remaining.ptr += match + delim.len;
+    remaining.len -= match + delim.len;
   }
   return StringVal();
 }
@@ -17,6 +17,7 @@
 #include <boost/date_time/time_zone_base.hpp>
 #include <boost/date_time/local_time/local_time.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/type_traits/is_same.hpp>
 #include <ctime>
 #include <gutil/strings/substitute.h>
 
@@ -24,6 +25,7 @@
 #include "exprs/expr.h"
 #include "exprs/anyval-util.h"
 
+#include "runtime/civil-time.h"
 #include "runtime/tuple-row.h"
 #include "runtime/timestamp-value.h"
 #include "util/path-builder.h"
@@ -277,45 +279,41 @@ StringVal TimestampFunctions::DayName(FunctionContext* context, const TimestampV
    }
 }
 
+// Except for WeekOfYear(), the functions below extract the fields with CivilTime from
+// the representation of 'ts_val' instead of converting it to boost types.
 IntVal TimestampFunctions::Year(FunctionContext* context, const TimestampVal& ts_val) {
-  if (ts_val.is_null) return IntVal::null();
-  const TimestampValue& ts_value = TimestampValue::FromTimestampVal(ts_val);
-  if (!ts_value.HasDate()) return IntVal::null();
-  return IntVal(ts_value.date().year());
+  if (ts_val.is_null || CivilTime::IsSpecialDate(ts_val.date)) return IntVal::null();
+  return IntVal(CivilTime::Year(ts_val.date));
 }
 
-
 IntVal TimestampFunctions::Month(FunctionContext* context, const TimestampVal& ts_val) {
-  if (ts_val.is_null) return IntVal::null();
-  const TimestampValue& ts_value = TimestampValue::FromTimestampVal(ts_val);
-  if (!ts_value.HasDate()) return IntVal::null();
-  return IntVal(ts_value.date().month());
+  if (ts_val.is_null || CivilTime::IsSpecialDate(ts_val.date)) return IntVal::null();
+  int year, month, day;
+  CivilTime::ToYearMonthDay(ts_val.date, &year, &month, &day);
+  return IntVal(month);
 }
 
-
 IntVal TimestampFunctions::DayOfWeek(FunctionContext* context,
     const TimestampVal& ts_val) {
-  if (ts_val.is_null) return IntVal::null();
-  const TimestampValue& ts_value = TimestampValue::FromTimestampVal(ts_val);
-  if (!ts_value.HasDate()) return IntVal::null();
-  // Sql has the result in [1,7] where 1 = Sunday. Boost has 0 = Sunday.
-  return IntVal(ts_value.date().day_of_week() + 1);
+  if (ts_val.is_null || CivilTime::IsSpecialDate(ts_val.date)) return IntVal::null();
+  // Sql has the result in [1,7] where 1 = Sunday. CivilTime has 0 = Sunday.
+  return IntVal(CivilTime::DayOfWeek(ts_val.date) + 1);
 }
 
 IntVal TimestampFunctions::DayOfMonth(FunctionContext* context,
     const TimestampVal& ts_val) {
-  if (ts_val.is_null) return IntVal::null();
-  const TimestampValue& ts_value = TimestampValue::FromTimestampVal(ts_val);
-  if (!ts_value.HasDate()) return IntVal::null();
-  return IntVal(ts_value.date().day());
+  if (ts_val.is_null || CivilTime::IsSpecialDate(ts_val.date)) return IntVal::null();
+  int year, month, day;
+  CivilTime::ToYearMonthDay(ts_val.date, &year, &month, &day);
+  return IntVal(day);
 }
 
 IntVal TimestampFunctions::DayOfYear(FunctionContext* context,
     const TimestampVal& ts_val) {
-  if (ts_val.is_null) return IntVal::null();
-  const TimestampValue& ts_value = TimestampValue::FromTimestampVal(ts_val);
-  if (!ts_value.HasDate()) return IntVal::null();
-  return IntVal(ts_value.date().day_of_year());
+  if (ts_val.is_null || CivilTime::IsSpecialDate(ts_val.date)) return IntVal::null();
+  int year, month, day;
+  CivilTime::ToYearMonthDay(ts_val.date, &year, &month, &day);
+  return IntVal(CivilTime::DayOfYear(year, month, day));
 }
 
 IntVal TimestampFunctions::WeekOfYear(FunctionContext* context,
@@ -327,24 +325,24 @@ IntVal TimestampFunctions::WeekOfYear(FunctionContext* context,
 }
 
 IntVal TimestampFunctions::Hour(FunctionContext* context, const TimestampVal& ts_val) {
-  if (ts_val.is_null) return IntVal::null();
-  const TimestampValue& ts_value = TimestampValue::FromTimestampVal(ts_val);
-  if (!ts_value.HasTime()) return IntVal::null();
-  return IntVal(ts_value.time().hours());
+  if (ts_val.is_null || CivilTime::IsSpecialTime(ts_val.time_of_day)) {
+    return IntVal::null();
+  }
+  return IntVal(CivilTime::Hours(ts_val.time_of_day));
 }
 
 IntVal TimestampFunctions::Minute(FunctionContext* context, const TimestampVal& ts_val) {
-  if (ts_val.is_null) return IntVal::null();
-  const TimestampValue& ts_value = TimestampValue::FromTimestampVal(ts_val);
-  if (!ts_value.HasTime()) return IntVal::null();
-  return IntVal(ts_value.time().minutes());
+  if (ts_val.is_null || CivilTime::IsSpecialTime(ts_val.time_of_day)) {
+    return IntVal::null();
+  }
+  return IntVal(CivilTime::Minutes(ts_val.time_of_day));
 }
 
 IntVal TimestampFunctions::Second(FunctionContext* context, const TimestampVal& ts_val) {
-  if (ts_val.is_null) return IntVal::null();
-  const TimestampValue& ts_value = TimestampValue::FromTimestampVal(ts_val);
-  if (!ts_value.HasTime()) return IntVal::null();
-  return IntVal(ts_value.time().seconds());
+  if (ts_val.is_null || CivilTime::IsSpecialTime(ts_val.time_of_day)) {
+    return IntVal::null();
+  }
+  return IntVal(CivilTime::Seconds(ts_val.time_of_day));
 }
 
 TimestampVal TimestampFunctions::Now(FunctionContext* context) {
@@ -712,6 +710,21 @@ TimestampVal TimestampFunctions::AddSub(FunctionContext* context,
         is_add ? "add" : "subtract", num_interval_units.val).c_str());
     return TimestampVal::null();
   }
+  if (boost::is_same<Interval, Days>::value || boost::is_same<Interval, Weeks>::value) {
+    // Fast path: adding days only changes the day number. Results outside the years
+    // that every boost version supports take the boost path below, which reports them.
+    int64_t days = boost::is_same<Interval, Weeks>::value ?
+        7 * num_interval_units.val : num_interval_units.val;
+    int64_t day_number =
+        static_cast<uint32_t>(timestamp.date) + (is_add ? days : -days);
+    if (LIKELY(!CivilTime::IsSpecialTime(timestamp.time_of_day) &&
+        day_number >= CivilTime::ToDayNumber(MIN_YEAR, 1, 1) &&
+        day_number <= CivilTime::ToDayNumber(9999, 12, 31))) {
+      TimestampVal result_val(day_number, timestamp.time_of_day);
+      DcheckAddSubResult(timestamp, result_val, is_add, num_interval_units.val);
+      return result_val;
+    }
+  }
   try {
     ptime datetime;
     value.ToPtime(&datetime);
@@ -741,12 +754,29 @@ IntVal TimestampFunctions::DateDiff(FunctionContext* context,
     const TimestampVal& ts_val1,
     const TimestampVal& ts_val2) {
   if (ts_val1.is_null || ts_val2.is_null) return IntVal::null();
-  const TimestampValue& ts_value1 = TimestampValue::FromTimestampVal(ts_val1);
-  const TimestampValue& ts_value2 = TimestampValue::FromTimestampVal(ts_val2);
-  if (!ts_value1.HasDate() || !ts_value2.HasDate()) {
+  if (CivilTime::IsSpecialDate(ts_val1.date) || CivilTime::IsSpecialDate(ts_val2.date)) {
     return IntVal::null();
   }
-  return IntVal((ts_value1.date() - ts_value2.date()).days());
+  return IntVal(static_cast<int64_t>(static_cast<uint32_t>(ts_val1.date)) -
+      static_cast<uint32_t>(ts_val2.date));
+}
+
+void TimestampFunctions::UtcConversionPrepare(FunctionContext* context,
+    FunctionContext::FunctionStateScope scope) {
+  if (scope != FunctionContext::THREAD_LOCAL || !context->IsArgConstant(1)) return;
+  StringVal tz_val = *reinterpret_cast<StringVal*>(context->GetConstantArg(1));
+  if (tz_val.is_null) return;
+  const StringValue& tz_ref = StringValue::FromStringVal(tz_val);
+  context->SetFunctionState(scope, new PreparedTimezone(tz_ref.DebugString()));
+}
+
+void TimestampFunctions::UtcConversionClose(FunctionContext* context,
+    FunctionContext::FunctionStateScope scope) {
+  if (scope == FunctionContext::THREAD_LOCAL) {
+    PreparedTimezone* prepared =
+        reinterpret_cast<PreparedTimezone*>(context->GetFunctionState(scope));
+    delete prepared;
+  }
 }
 
 // This function uses inline asm functions, which we believe to be from the boost library.
@@ -758,8 +788,13 @@ TimestampVal TimestampFunctions::FromUtc(FunctionContext* context,
   const TimestampValue& ts_value = TimestampValue::FromTimestampVal(ts_val);
   if (!ts_value.HasDateOrTime()) return TimestampVal::null();
 
+  PreparedTimezone* prepared = reinterpret_cast<PreparedTimezone*>(
+      context->GetFunctionState(FunctionContext::THREAD_LOCAL));
+  TimestampVal return_val;
+  if (prepared != NULL && prepared->FromUtc(ts_val, &return_val)) return return_val;
+
   const StringValue& tz_string_value = StringValue::FromStringVal(tz_string_val);
-  time_zone_ptr timezone =
+  time_zone_ptr timezone = prepared != NULL ? prepared->GetZone(ts_value) :
       TimezoneDatabase::FindTimezone(tz_string_value.DebugString(), ts_value);
   if (timezone == NULL) {
     // This should return null. Hive just ignores it.
@@ -773,7 +808,6 @@ TimestampVal TimestampFunctions::FromUtc(FunctionContext* context,
   ts_value.ToPtime(&temp);
   local_date_time lt(temp, timezone);
   TimestampValue return_value = lt.local_time();
-  TimestampVal return_val;
   return_value.ToTimestampVal(&return_val);
   return return_val;
 }
@@ -787,8 +821,13 @@ TimestampVal TimestampFunctions::ToUtc(FunctionContext* context,
   const TimestampValue& ts_value = TimestampValue::FromTimestampVal(ts_val);
   if (!ts_value.HasDateOrTime()) return TimestampVal::null();
 
+  PreparedTimezone* prepared = reinterpret_cast<PreparedTimezone*>(
+      context->GetFunctionState(FunctionContext::THREAD_LOCAL));
+  TimestampVal return_val;
+  if (prepared != NULL && prepared->ToUtc(ts_val, &return_val)) return return_val;
+
   const StringValue& tz_string_value = StringValue::FromStringVal(tz_string_val);
-  time_zone_ptr timezone =
+  time_zone_ptr timezone = prepared != NULL ? prepared->GetZone(ts_value) :
       TimezoneDatabase::FindTimezone(tz_string_value.DebugString(), ts_value);
   // This should raise some sort of error or at least null. Hive Just ignores it.
   if (timezone == NULL) {
@@ -801,7 +840,6 @@ TimestampVal TimestampFunctions::ToUtc(FunctionContext* context,
   local_date_time lt(ts_value.date(), ts_value.time(),
       timezone, local_date_time::NOT_DATE_TIME_ON_ERROR);
   TimestampValue return_value(lt.utc_time());
-  TimestampVal return_val;
   return_value.ToTimestampVal(&return_val);
   return return_val;
 }
@@ -877,6 +915,131 @@ time_zone_ptr TimezoneDatabase::FindTimezone(const string& tz, const TimestampVa
   return time_zone_ptr();
 }
 
+// FindTimezone() switches to the pre-2011 rules of Moscow before this day.
+static const uint32_t MSK_RULE_CHANGE_DAY = CivilTime::ToDayNumber(2011, 4, 1);
+
+// The fast path is limited to timestamps whose conversions stay in the supported range,
+// which is also where boost::gregorian::greg_year is valid.
+static const uint32_t FIRST_FAST_PATH_DAY =
+    CivilTime::ToDayNumber(TimestampFunctions::MIN_YEAR, 1, 1) + 1;
+static const uint32_t LAST_FAST_PATH_DAY = CivilTime::ToDayNumber(9999, 12, 31) - 1;
+
+PreparedTimezone::PreparedTimezone(const string& tz) {
+  Date change_day(MSK_RULE_CHANGE_DAY);
+  InitZone(TimezoneDatabase::FindTimezone(tz, TimestampValue(change_day, Hours(0))),
+      &zone_);
+  InitZone(TimezoneDatabase::FindTimezone(tz,
+      TimestampValue(change_day - Days(1), Hours(0))), &pre_2011_zone_);
+}
+
+void PreparedTimezone::InitZone(const time_zone_ptr& tz, Zone* zone) {
+  zone->tz = tz;
+  zone->base_offset = tz == NULL ? 0 : tz->base_utc_offset().total_seconds();
+  zone->dst_offset = tz == NULL || !tz->has_dst() ? 0 : tz->dst_offset().total_seconds();
+  for (int i = 0; i < DST_CACHE_SIZE; ++i) zone->dst_cache[i].year = -1;
+}
+
+const time_zone_ptr& PreparedTimezone::GetZone(const TimestampValue& tv) const {
+  if (pre_2011_zone_.tz != zone_.tz && tv.date() < Date(MSK_RULE_CHANGE_DAY)) {
+    return pre_2011_zone_.tz;
+  }
+  return zone_.tz;
+}
+
+PreparedTimezone::Zone* PreparedTimezone::SelectZone(const TimestampVal& ts_val) {
+  uint32_t day_number = ts_val.date;
+  if (day_number < FIRST_FAST_PATH_DAY || day_number > LAST_FAST_PATH_DAY ||
+      CivilTime::IsSpecialTime(ts_val.time_of_day)) {
+    return NULL;
+  }
+  Zone* zone = day_number < MSK_RULE_CHANGE_DAY ? &pre_2011_zone_ : &zone_;
+  return zone->tz == NULL ? NULL : zone;
+}
+
+const PreparedTimezone::DstTransitions& PreparedTimezone::GetDstTransitions(Zone* zone,
+    int year) {
+  DstTransitions* dst = &zone->dst_cache[year & (DST_CACHE_SIZE - 1)];
+  if (LIKELY(dst->year == year)) return *dst;
+  dst->year = year;
+  // The start is in local standard time, the end in local daylight saving time.
+  ptime start = zone->tz->dst_local_start_time(year);
+  ptime end = zone->tz->dst_local_end_time(year);
+  dst->valid = false;
+  if (start.is_special() || end.is_special() || start.date() == end.date()) return *dst;
+  // boost decides on the days of the transitions by the time of day only, so the times
+  // that are skipped or repeated must be within these days. Transitions at midnight are
+  // left out, since boost may have normalized a rule of 24:00 to midnight of the next
+  // day, which it applies differently.
+  int64_t start_time = start.time_of_day().total_seconds();
+  int64_t end_time = end.time_of_day().total_seconds();
+  if (zone->dst_offset <= 0 || start_time == 0 ||
+      start_time + zone->dst_offset > CivilTime::SECONDS_PER_DAY ||
+      end_time < zone->dst_offset || end_time == 0) {
+    return *dst;
+  }
+  dst->valid = true;
+  dst->northern = start.date() < end.date();
+  dst->start = start.date().day_number() * CivilTime::SECONDS_PER_DAY + start_time;
+  dst->end = end.date().day_number() * CivilTime::SECONDS_PER_DAY + end_time -
+      zone->dst_offset;
+  return *dst;
+}
+
+// Returns 'ts_val' moved by 'offset' seconds, which is less than a day.
+static inline TimestampVal AddSeconds(const TimestampVal& ts_val, int64_t offset) {
+  int64_t day_number = static_cast<uint32_t>(ts_val.date);
+  int64_t nanos = ts_val.time_of_day + offset * CivilTime::NANOS_PER_SECOND;
+  if (nanos < 0) {
+    nanos += CivilTime::NANOS_PER_DAY;
+    --day_number;
+  } else if (nanos >= CivilTime::NANOS_PER_DAY) {
+    nanos -= CivilTime::NANOS_PER_DAY;
+    ++day_number;
+  }
+  return TimestampVal(day_number, nanos);
+}
+
+// Returns the local standard time 'seconds' since the start of day number 0 falls into.
+static inline int YearOfSeconds(int64_t seconds) {
+  return CivilTime::Year(seconds / CivilTime::SECONDS_PER_DAY);
+}
+
+bool PreparedTimezone::FromUtc(const TimestampVal& ts_val, TimestampVal* result) {
+  Zone* zone = SelectZone(ts_val);
+  if (zone == NULL) return false;
+  int64_t offset = zone->base_offset;
+  if (zone->dst_offset != 0) {
+    // Like boost, decide on daylight saving time by the local standard time.
+    int64_t seconds = static_cast<uint32_t>(ts_val.date) * CivilTime::SECONDS_PER_DAY +
+        ts_val.time_of_day / CivilTime::NANOS_PER_SECOND + zone->base_offset;
+    const DstTransitions& dst = GetDstTransitions(zone, YearOfSeconds(seconds));
+    if (!dst.valid) return false;
+    if (IsDst(dst, seconds)) offset += zone->dst_offset;
+  }
+  *result = AddSeconds(ts_val, offset);
+  return true;
+}
+
+bool PreparedTimezone::ToUtc(const TimestampVal& ts_val, TimestampVal* result) {
+  Zone* zone = SelectZone(ts_val);
+  if (zone == NULL) return false;
+  int64_t offset = -zone->base_offset;
+  if (zone->dst_offset != 0) {
+    int64_t seconds = static_cast<uint32_t>(ts_val.date) * CivilTime::SECONDS_PER_DAY +
+        ts_val.time_of_day / CivilTime::NANOS_PER_SECOND;
+    const DstTransitions& dst = GetDstTransitions(zone, YearOfSeconds(seconds));
+    if (!dst.valid) return false;
+    // boost returns not_a_date_time for skipped and repeated local times.
+    if ((seconds >= dst.start && seconds < dst.start + zone->dst_offset) ||
+        (seconds >= dst.end && seconds < dst.end + zone->dst_offset)) {
+      return false;
+    }
+    if (IsDst(dst, seconds)) offset -= zone->dst_offset;
+  }
+  *result = AddSeconds(ts_val, offset);
+  return true;
+}
+
 // Explicit template instantiation is required for proper linking. These functions
 // are only indirectly called via a function pointer provided by the opcode registry
 // which does not trigger implicit template instantiation.
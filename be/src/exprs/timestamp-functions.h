@@ -88,6 +88,12 @@ class TimestampFunctions {
       const StringVal& fmt);
 
   /// Convert a timestamp to or from a particular timezone based time.
+  /// If the timezone is constant, UtcConversionPrepare() resolves it to a
+  /// PreparedTimezone once per thread.
+  static void UtcConversionPrepare(FunctionContext* context,
+      FunctionContext::FunctionStateScope scope);
+  static void UtcConversionClose(FunctionContext* context,
+      FunctionContext::FunctionStateScope scope);
   static TimestampVal FromUtc(FunctionContext* context,
     const TimestampVal& ts_val, const StringVal& tz_string_val);
   static TimestampVal ToUtc(FunctionContext* context,
@@ -208,6 +214,83 @@ class TimezoneDatabase {
   static std::vector<std::string> tz_region_list_;
 };
 
+/// A timezone resolved with TimezoneDatabase::FindTimezone(), with a cache of its
+/// daylight saving time transitions, for converting many timestamps to and from the
+/// same zone.
+/// boost::local_time::local_date_time evaluates the rules of the zone for every
+/// timestamp; here they are evaluated once per year and a conversion only compares the
+/// timestamp with the start and end of the year's daylight saving time.
+///
+/// FromUtc() and ToUtc() return false for timestamps they cannot convert exactly like
+/// boost does: timestamps near the ends of the supported range, local times that are
+/// skipped or repeated at a transition, and zones whose transitions are at midnight or
+/// span days. Those are left to the boost conversion with GetZone().
+///
+/// Not thread-safe, the cache is updated by the conversions.
+class PreparedTimezone {
+ public:
+  PreparedTimezone(const std::string& tz);
+
+  /// Returns what FindTimezone() returns for the timezone and 'tv'. NULL if the timezone
+  /// is unknown.
+  const boost::local_time::time_zone_ptr& GetZone(const TimestampValue& tv) const;
+
+  /// Converts 'ts_val', which must not be NULL, from UTC to local time. Returns false
+  /// without setting 'result' if the fast path does not apply.
+  bool FromUtc(const TimestampVal& ts_val, TimestampVal* result);
+
+  /// Converts 'ts_val', which must not be NULL, from local time to UTC. Returns false
+  /// without setting 'result' if the fast path does not apply.
+  bool ToUtc(const TimestampVal& ts_val, TimestampVal* result);
+
+ private:
+  /// Number of years whose transitions are cached per zone. Must be a power of two.
+  static const int DST_CACHE_SIZE = 16;
+
+  /// The daylight saving time of one year, in seconds since the start of day number 0
+  /// in local standard time. Local times in [start, start + dst_offset) are skipped, the
+  /// ones in [end, end + dst_offset) are repeated.
+  struct DstTransitions {
+    int year;
+    /// False if the transitions cannot be handled by the fast path.
+    bool valid;
+    /// True if 'start' is before 'end' in the year, false on the southern hemisphere.
+    bool northern;
+    int64_t start;
+    int64_t end;
+  };
+
+  struct Zone {
+    boost::local_time::time_zone_ptr tz;
+    /// Offsets in seconds.
+    int64_t base_offset;
+    int64_t dst_offset;
+    DstTransitions dst_cache[DST_CACHE_SIZE];
+  };
+
+  /// Initializes 'zone' for 'tz'.
+  static void InitZone(const boost::local_time::time_zone_ptr& tz, Zone* zone);
+
+  /// Returns the transitions of 'year' from the cache of 'zone', computing them if they
+  /// are not cached.
+  static const DstTransitions& GetDstTransitions(Zone* zone, int year);
+
+  /// Returns true if 'seconds' in local standard time is in daylight saving time.
+  static bool IsDst(const DstTransitions& dst, int64_t seconds) {
+    return dst.northern ? seconds >= dst.start && seconds < dst.end :
+        seconds >= dst.start || seconds < dst.end;
+  }
+
+  /// Returns the zone for 'ts_val', or NULL if 'ts_val' is not in the range of the fast
+  /// path or the timezone is unknown.
+  Zone* SelectZone(const TimestampVal& ts_val);
+
+  /// The zone after and before Moscow's change of rules in 2011, see FindTimezone(). The
+  /// same for all other timezones.
+  Zone zone_;
+  Zone pre_2011_zone_;
+};
+
 } // namespace impala
 
 #endif
@@ -22,6 +22,7 @@
 #include <string>
 
 #include "gen-cpp/Exprs_types.h"
+#include "runtime/civil-time.h"
 #include "runtime/runtime-state.h"
 #include "runtime/timestamp-value.h"
 #include "udf/udf-internal.h"
@@ -29,10 +30,6 @@
 
 #include "common/names.h"
 
-using boost::gregorian::date;
-using boost::gregorian::date_duration;
-using boost::posix_time::ptime;
-using boost::posix_time::time_duration;
 using namespace impala;
 using namespace strings;
 
@@ -144,91 +141,17 @@ TruncUnit::Type StrToTruncUnit(FunctionContext* ctx, const StringVal& unit_str)
   }
 }
 
-// Returns the most recent date, no later than orig_date, which is on week_day
+// Returns the most recent day, no later than 'day_number', which is on 'week_day'
 // week_day: 0==Sunday, 1==Monday, ...
-date GoBackToWeekday(const date& orig_date, int week_day) {
-  int current_week_day = orig_date.day_of_week();
-  int diff = current_week_day - week_day;
-  if (diff == 0) return orig_date;
-  if (diff > 0) {
-    // ex. Weds(3) shifts to Tues(2), so we go back 1 day
-    return orig_date - date_duration(diff);
-  }
-  // ex. Tues(2) shifts to Weds(3), so we go back 6 days
-  DCHECK_LT(diff, 0);
-  return orig_date - date_duration(7 + diff);
-}
-
-// Truncate to first day of year
-TimestampValue TruncYear(const date& orig_date) {
-  date new_date(orig_date.year(), 1, 1);
-  time_duration new_time(0, 0, 0, 0);
-  return TimestampValue(new_date, new_time);
-}
-
-// Truncate to first day of quarter
-TimestampValue TruncQuarter(const date& orig_date) {
-  int first_month_of_quarter = BitUtil::RoundDown(orig_date.month() - 1, 3) + 1;
-  date new_date(orig_date.year(), first_month_of_quarter, 1);
-  time_duration new_time(0, 0, 0, 0);
-  return TimestampValue(new_date, new_time);
-}
-
-// Truncate to first day of month
-TimestampValue TruncMonth(const date& orig_date) {
-  date new_date(orig_date.year(), orig_date.month(), 1);
-  time_duration new_time(0, 0, 0, 0);
-  return TimestampValue(new_date, new_time);
-}
-
-// Same day of the week as the first day of the year
-TimestampValue TruncWW(const date& orig_date) {
-  const date& first_day_of_year = TruncYear(orig_date).date();
-  int target_week_day = first_day_of_year.day_of_week();
-  date new_date = GoBackToWeekday(orig_date, target_week_day);
-  time_duration new_time(0, 0, 0, 0);
-  return TimestampValue(new_date, new_time);
-}
-
-// Same day of the week as the first day of the month
-TimestampValue TruncW(const date& orig_date) {
-  const date& first_day_of_mon = TruncMonth(orig_date).date();
-  const date& new_date = GoBackToWeekday(orig_date, first_day_of_mon.day_of_week());
-  time_duration new_time(0, 0, 0, 0);
-  return TimestampValue(new_date, new_time);
-}
-
-// Truncate to midnight on the given date
-TimestampValue TruncDay(const date& orig_date) {
-  time_duration new_time(0, 0, 0, 0);
-  return TimestampValue(orig_date, new_time);
-}
-
-// Date of the previous Monday
-TimestampValue TruncDayOfWeek(const date& orig_date) {
-  const date& new_date = GoBackToWeekday(orig_date, 1);
-  time_duration new_time(0, 0, 0, 0);
-  return TimestampValue(new_date, new_time);
-}
-
-// Truncate minutes, seconds, and parts of seconds
-TimestampValue TruncHour(const date& orig_date, const time_duration& orig_time) {
-  time_duration new_time(orig_time.hours(), 0, 0, 0);
-  return TimestampValue(orig_date, new_time);
-}
-
-// Truncate seconds and parts of seconds
-TimestampValue TruncMinute(const date& orig_date, const time_duration& orig_time) {
-  time_duration new_time(orig_time.hours(), orig_time.minutes(), 0, 0);
-  return TimestampValue(orig_date, new_time);
+inline uint32_t GoBackToWeekday(uint32_t day_number, int week_day) {
+  // ex. Weds(3) shifts to Tues(2), so we go back 1 day. Tues(2) shifts to Weds(3), so
+  // we go back 6 days.
+  return day_number - (CivilTime::DayOfWeek(day_number) - week_day + 7) % 7;
 }
 
 TimestampVal UdfBuiltins::Trunc(FunctionContext* context, const TimestampVal& tv,
     const StringVal &unit_str) {
   if (tv.is_null) return TimestampVal::null();
-  const TimestampValue& ts = TimestampValue::FromTimestampVal(tv);
-  const date& orig_date = ts.date();
-  const time_duration& orig_time = ts.time();
 
   // resolve trunc_unit using the prepared state if possible, o.w. parse now
   // TruncPrepare() can only parse trunc_unit if user passes it as a string literal
@@ -245,9 +168,6 @@ TimestampVal UdfBuiltins::Trunc(FunctionContext* context, const TimestampVal& tv
     }
   }
 
-  TimestampValue ret;
-  TimestampVal ret_val;
-
   // check for invalid or malformed timestamps
   switch (trunc_unit) {
     case TruncUnit::YEAR:
@@ -257,52 +177,63 @@ TimestampVal UdfBuiltins::Trunc(FunctionContext* context, const TimestampVal& tv
     case TruncUnit::W:
     case TruncUnit::DAY:
     case TruncUnit::DAY_OF_WEEK:
-      if (orig_date.is_special()) return TimestampVal::null();
+      if (CivilTime::IsSpecialDate(tv.date)) return TimestampVal::null();
       break;
     case TruncUnit::HOUR:
     case TruncUnit::MINUTE:
-      if (orig_time.is_special()) return TimestampVal::null();
+      if (CivilTime::IsSpecialTime(tv.time_of_day)) return TimestampVal::null();
       break;
     case TruncUnit::UNIT_INVALID:
       DCHECK(false);
   }
 
+  // The units down to days truncate the time to midnight and compute the day of the
+  // result with CivilTime, the others keep the date.
+  uint32_t day_number = tv.date;
+  int year, month, day;
+  if (trunc_unit != TruncUnit::HOUR && trunc_unit != TruncUnit::MINUTE) {
+    CivilTime::ToYearMonthDay(day_number, &year, &month, &day);
+  }
   switch(trunc_unit) {
     case TruncUnit::YEAR:
-      ret = TruncYear(orig_date);
-      break;
+      // Truncate to first day of year
+      return TimestampVal(CivilTime::ToDayNumber(year, 1, 1), 0);
     case TruncUnit::QUARTER:
-      ret = TruncQuarter(orig_date);
-      break;
+      // Truncate to first day of quarter
+      return TimestampVal(
+          CivilTime::ToDayNumber(year, BitUtil::RoundDown(month - 1, 3) + 1, 1), 0);
     case TruncUnit::MONTH:
-      ret = TruncMonth(orig_date);
-      break;
-    case TruncUnit::WW:
-      ret = TruncWW(orig_date);
-      break;
-    case TruncUnit::W:
-      ret = TruncW(orig_date);
-      break;
+      // Truncate to first day of month
+      return TimestampVal(CivilTime::ToDayNumber(year, month, 1), 0);
+    case TruncUnit::WW: {
+      // Same day of the week as the first day of the year
+      int week_day = CivilTime::DayOfWeek(CivilTime::ToDayNumber(year, 1, 1));
+      return TimestampVal(GoBackToWeekday(day_number, week_day), 0);
+    }
+    case TruncUnit::W: {
+      // Same day of the week as the first day of the month
+      int week_day = CivilTime::DayOfWeek(CivilTime::ToDayNumber(year, month, 1));
+      return TimestampVal(GoBackToWeekday(day_number, week_day), 0);
+    }
     case TruncUnit::DAY:
-      ret = TruncDay(orig_date);
-      break;
+      // Truncate to midnight on the given date
+      return TimestampVal(day_number, 0);
     case TruncUnit::DAY_OF_WEEK:
-      ret = TruncDayOfWeek(orig_date);
-      break;
+      // Date of the previous Monday
+      return TimestampVal(GoBackToWeekday(day_number, 1), 0);
     case TruncUnit::HOUR:
-      ret = TruncHour(orig_date, orig_time);
-      break;
+      // Truncate minutes, seconds, and parts of seconds
+      return TimestampVal(tv.date,
+          tv.time_of_day - tv.time_of_day % CivilTime::NANOS_PER_HOUR);
     case TruncUnit::MINUTE:
-      ret = TruncMinute(orig_date, orig_time);
-      break;
+      // Truncate seconds and parts of seconds
+      return TimestampVal(tv.date,
+          tv.time_of_day - tv.time_of_day % CivilTime::NANOS_PER_MINUTE);
     default:
       // internal error: implies StrToTruncUnit out of sync with this switch
       context->SetError(Substitute("truncate unit $0 not supported", trunc_unit).c_str());
       return TimestampVal::null();
   }
-
-  ret.ToTimestampVal(&ret_val);
-  return ret_val;
 }
 
 void UdfBuiltins::TruncPrepare(FunctionContext* ctx,
@@ -347,6 +278,47 @@ TExtractField::type StrToExtractField(FunctionContext* ctx, const StringVal& uni
   return TExtractField::INVALID_FIELD;
 }
 
+// Returns 'field' of 'tv', which is not NULL. The fields are computed with CivilTime from
+// the representation of 'tv'.
+inline IntVal ExtractField(TExtractField::type field, const TimestampVal& tv) {
+  bool date_is_special = CivilTime::IsSpecialDate(tv.date);
+  bool time_is_special = CivilTime::IsSpecialTime(tv.time_of_day);
+  int year, month, day;
+  switch (field) {
+    case TExtractField::YEAR:
+    case TExtractField::MONTH:
+    case TExtractField::DAY:
+      if (date_is_special) return IntVal::null();
+      CivilTime::ToYearMonthDay(tv.date, &year, &month, &day);
+      if (field == TExtractField::YEAR) return IntVal(year);
+      if (field == TExtractField::MONTH) return IntVal(month);
+      return IntVal(day);
+    case TExtractField::HOUR:
+      if (time_is_special) return IntVal::null();
+      return IntVal(CivilTime::Hours(tv.time_of_day));
+    case TExtractField::MINUTE:
+      if (time_is_special) return IntVal::null();
+      return IntVal(CivilTime::Minutes(tv.time_of_day));
+    case TExtractField::SECOND:
+      if (time_is_special) return IntVal::null();
+      return IntVal(CivilTime::Seconds(tv.time_of_day));
+    case TExtractField::MILLISECOND:
+      if (time_is_special) return IntVal::null();
+      return IntVal((tv.time_of_day / 1000000) % 1000);
+    case TExtractField::EPOCH: {
+      if (time_is_special || date_is_special) return IntVal::null();
+      int64_t seconds = CivilTime::ToUnixTime(tv.date, tv.time_of_day);
+      // The difference to the epoch is truncated towards zero.
+      if (seconds < 0 && tv.time_of_day % CivilTime::NANOS_PER_SECOND != 0) ++seconds;
+      return IntVal(seconds);
+    }
+    default: {
+      DCHECK(false) << field;
+      return IntVal::null();
+    }
+  }
+}
+
 IntVal UdfBuiltins::Extract(FunctionContext* context, const StringVal& unit_str,
     const TimestampVal& tv) {
   // resolve extract_field using the prepared state if possible, o.w. parse now
@@ -366,66 +338,72 @@ IntVal UdfBuiltins::Extract(FunctionContext* context, const StringVal& unit_str,
     }
   }
 
-  const date& orig_date = *reinterpret_cast<const date*>(&tv.date);
-  const time_duration& time = *reinterpret_cast<const time_duration*>(&tv.time_of_day);
+  return ExtractField(field, tv);
+}
 
-  switch (field) {
+IntVal UdfBuiltins::Extract(FunctionContext* context, const TimestampVal& tv,
+    const StringVal& unit_str) {
+  return Extract(context, unit_str, tv);
+}
+
+template<TExtractField::type FIELD>
+static void ExtractFieldBatch(int num_rows, const TimestampVal* tvs, IntVal* results) {
+  for (int i = 0; i < num_rows; ++i) {
+    results[i] = tvs[i].is_null ? IntVal::null() : ExtractField(FIELD, tvs[i]);
+  }
+}
+
+// 'args[unit_idx]' are the fields and 'args[1 - unit_idx]' the timestamps.
+static void ExtractBatchImpl(FunctionContext* context, int num_rows,
+    const void* const* args, void* results, int unit_idx) {
+  const StringVal* units = reinterpret_cast<const StringVal*>(args[unit_idx]);
+  const TimestampVal* tvs = reinterpret_cast<const TimestampVal*>(args[1 - unit_idx]);
+  IntVal* r = reinterpret_cast<IntVal*>(results);
+  void* state = context->GetFunctionState(FunctionContext::THREAD_LOCAL);
+  if (state == NULL) {
+    for (int i = 0; i < num_rows; ++i) {
+      r[i] = UdfBuiltins::Extract(context, units[i], tvs[i]);
+    }
+    return;
+  }
+  switch (*reinterpret_cast<TExtractField::type*>(state)) {
     case TExtractField::YEAR:
+      ExtractFieldBatch<TExtractField::YEAR>(num_rows, tvs, r);
+      break;
     case TExtractField::MONTH:
+      ExtractFieldBatch<TExtractField::MONTH>(num_rows, tvs, r);
+      break;
     case TExtractField::DAY:
-      if (orig_date.is_special()) return IntVal::null();
+      ExtractFieldBatch<TExtractField::DAY>(num_rows, tvs, r);
       break;
     case TExtractField::HOUR:
+      ExtractFieldBatch<TExtractField::HOUR>(num_rows, tvs, r);
+      break;
     case TExtractField::MINUTE:
+      ExtractFieldBatch<TExtractField::MINUTE>(num_rows, tvs, r);
+      break;
     case TExtractField::SECOND:
+      ExtractFieldBatch<TExtractField::SECOND>(num_rows, tvs, r);
+      break;
     case TExtractField::MILLISECOND:
-      if (time.is_special()) return IntVal::null();
+      ExtractFieldBatch<TExtractField::MILLISECOND>(num_rows, tvs, r);
       break;
     case TExtractField::EPOCH:
-      if (time.is_special() || orig_date.is_special()) return IntVal::null();
+      ExtractFieldBatch<TExtractField::EPOCH>(num_rows, tvs, r);
       break;
-    case TExtractField::INVALID_FIELD:
+    default:
       DCHECK(false);
   }
+}
 
-  switch (field) {
-    case TExtractField::YEAR: {
-      return IntVal(orig_date.year());
-    }
-    case TExtractField::MONTH: {
-      return IntVal(orig_date.month());
-    }
-    case TExtractField::DAY: {
-      return IntVal(orig_date.day());
-    }
-    case TExtractField::HOUR: {
-      return IntVal(time.hours());
-    }
-    case TExtractField::MINUTE: {
-      return IntVal(time.minutes());
-    }
-    case TExtractField::SECOND: {
-      return IntVal(time.seconds());
-    }
-    case TExtractField::MILLISECOND: {
-      return IntVal(time.total_milliseconds() - time.total_seconds() * 1000);
-    }
-    case TExtractField::EPOCH: {
-      ptime epoch_date(date(1970, 1, 1), time_duration(0, 0, 0));
-      ptime cur_date(orig_date, time);
-      time_duration diff = cur_date - epoch_date;
-      return IntVal(diff.total_seconds());
-    }
-    default: {
-      DCHECK(false) << field;
-      return IntVal::null();
-    }
-  }
+void UdfBuiltins::ExtractBatch(FunctionContext* context, int num_rows,
+    const void* const* args, void* results) {
+  ExtractBatchImpl(context, num_rows, args, results, 0);
 }
 
-IntVal UdfBuiltins::Extract(FunctionContext* context, const TimestampVal& tv,
-    const StringVal& unit_str) {
-  return Extract(context, unit_str, tv);
+void UdfBuiltins::SwappedExtractBatch(FunctionContext* context, int num_rows,
+    const void* const* args, void* results) {
+  ExtractBatchImpl(context, num_rows, args, results, 1);
 }
 
 void UdfBuiltins::ExtractPrepare(FunctionContext* ctx,
@@ -92,6 +92,13 @@ class UdfBuiltins {
   static void ExtractClose(FunctionContext* context,
       FunctionContext::FunctionStateScope scope);
 
+  /// Batch versions of the two Extract() functions, see BatchScalarFn. If the field is
+  /// constant, the rows are evaluated in a loop that is specialized for it.
+  static void ExtractBatch(FunctionContext* context, int num_rows,
+      const void* const* args, void* results);
+  static void SwappedExtractBatch(FunctionContext* context, int num_rows,
+      const void* const* args, void* results);
+
   /// Converts a set of doubles to double[] stored as a StringVal
   /// Stored as a StringVal with each double value encoded in IEEE back to back
   /// The returned StringVal ptr can be casted to a double*
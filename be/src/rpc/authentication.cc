@@ -64,6 +64,7 @@ DECLARE_string(principal);
 DECLARE_string(be_principal);
 DECLARE_string(krb5_conf);
 DECLARE_string(krb5_debug_file);
+DECLARE_string(sasl_qop);
 
 DEFINE_int32(kerberos_reinit_interval, 60,
     "Interval, in minutes, between kerberos ticket renewals.");
@@ -964,6 +965,12 @@ Status AuthManager::Init() {
     }
   }
 
+  if (FLAGS_sasl_qop != "auth" && FLAGS_sasl_qop != "auth-int" &&
+      FLAGS_sasl_qop != "auth-conf") {
+    return Status(Substitute("--sasl_qop must be one of 'auth', 'auth-int' or "
+        "'auth-conf', got '$0'", FLAGS_sasl_qop));
+  }
+
   if (FLAGS_principal.empty() && !FLAGS_be_principal.empty()) {
     return Status("A back end principal (--be_principal) was supplied without "
         "also supplying a regular principal (--principal). Either --principal "
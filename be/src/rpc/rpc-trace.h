@@ -27,6 +27,7 @@
 
 namespace impala {
 
+class HistogramMetric;
 class Webserver;
 class MetricGroup;
 
@@ -83,6 +84,9 @@ class RpcEventHandler : public apache::thrift::TProcessorEventHandler {
     /// Summary statistics for the time taken to respond to this method
     StatsMetric<double>* time_stats;
 
+    /// Distribution of the time taken to respond to this method, for its tail latency.
+    HistogramMetric* latency_histogram;
+
     /// Number of invocations in flight
     AtomicInt<uint32_t> num_in_flight;
   };
@@ -92,8 +96,8 @@ class RpcEventHandler : public apache::thrift::TProcessorEventHandler {
 
   /// Created per-Rpc invocation
   struct InvocationContext {
-    /// Monotonic milliseconds (typically boot time) when the call started.
-    const int64_t start_time_ms;
+    /// Monotonic nanoseconds (typically boot time) when the call started.
+    const int64_t start_time_ns;
 
     /// Per-connection information, owned by ThriftServer. The lifetime of this struct is
     /// tied to the lifetime of the connection, which is guaranteed to be longer than the
@@ -105,7 +109,7 @@ class RpcEventHandler : public apache::thrift::TProcessorEventHandler {
 
     InvocationContext(int64_t start_time, const ThriftServer::ConnectionContext* cnxn_ctx,
         MethodDescriptor* descriptor)
-        : start_time_ms(start_time), cnxn_ctx(cnxn_ctx), method_descriptor(descriptor) { }
+        : start_time_ns(start_time), cnxn_ctx(cnxn_ctx), method_descriptor(descriptor) { }
   };
 
   /// Protects method_map_ and rpc_counter_
@@ -16,7 +16,10 @@
 
 #include <boost/assign.hpp>
 #include <boost/lexical_cast.hpp>
+#include <errno.h>
 #include <ostream>
+#include <poll.h>
+#include <sys/socket.h>
 #include <thrift/Thrift.h>
 #include <gutil/strings/substitute.h>
 
@@ -28,6 +31,10 @@ using namespace apache::thrift::transport;
 using namespace apache::thrift;
 using namespace strings;
 
+DEFINE_bool(rpc_client_keepalive, true, "(Advanced) If true, TCP keepalive is enabled on "
+    "the connections of Thrift clients, so that idle connections, e.g. the ones kept "
+    "in the client caches, are not dropped by firewalls and dead servers are detected.");
+
 DECLARE_string(ssl_client_ca_certificate);
 
 namespace impala {
@@ -37,6 +44,13 @@ Status ThriftClientImpl::Open() {
   try {
     if (!transport_->isOpen()) {
       transport_->open();
+      if (FLAGS_rpc_client_keepalive) {
+        int keepalive = 1;
+        if (setsockopt(socket_->getSocketFD(), SOL_SOCKET, SO_KEEPALIVE, &keepalive,
+            sizeof(keepalive)) != 0) {
+          VLOG(1) << "Could not enable TCP keepalive on connection to " << address_;
+        }
+      }
     }
   } catch (const TException& e) {
     return Status(Substitute("Couldn't open transport for $0 ($1)",
@@ -98,4 +112,17 @@ Status ThriftClientImpl::CreateSocket() {
   return Status::OK();
 }
 
+bool ThriftClientImpl::IsConnectionHealthy() {
+  if (socket_.get() == NULL || !socket_->isOpen()) return false;
+  pollfd fd;
+  fd.fd = socket_->getSocketFD();
+  fd.events = POLLIN;
+  fd.revents = 0;
+  // Readable means that the server closed the connection (EOF), reset it, or sent
+  // something nobody asked for.
+  int ret = poll(&fd, 1, 0);
+  if (ret < 0) return errno == EINTR;
+  return ret == 0;
+}
+
 }
@@ -64,6 +64,11 @@ class ThriftClientImpl {
   /// Set send timeout on the underlying TSocket.
   void setSendTimeout(int32_t ms) { socket_->setSendTimeout(ms); }
 
+  /// Returns false if the connection is closed, or if the server closed or reset it.
+  /// Must only be called on idle clients, i.e. between RPCs: an idle connection should
+  /// never have anything to read, so any pending input means it can't be used any more.
+  bool IsConnectionHealthy();
+
  protected:
   ThriftClientImpl(const std::string& ipaddress, int port, bool ssl)
       : address_(MakeNetworkAddress(ipaddress, port)), ssl_(ssl) {
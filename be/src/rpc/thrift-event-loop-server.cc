@@ -0,0 +1,240 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "rpc/thrift-event-loop-server.h"
+
+#include <errno.h>
+#include <limits>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <boost/foreach.hpp>
+#include <gutil/strings/substitute.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TServerTransport.h>
+#include <thrift/transport/TSocket.h>
+
+#include "common/logging.h"
+#include "util/error-util.h"
+
+#include "common/names.h"
+
+using boost::dynamic_pointer_cast;
+using namespace apache::thrift;
+using namespace apache::thrift::protocol;
+using namespace apache::thrift::server;
+using namespace apache::thrift::transport;
+using namespace impala;
+using namespace strings;
+
+// Maximum number of events returned by one epoll_wait() call, and the time after which
+// it returns anyway so that the IO threads notice stop().
+static const int MAX_EPOLL_EVENTS = 64;
+static const int EPOLL_WAIT_TIMEOUT_MS = 100;
+
+// The state of one client connection, as TThreadedServer keeps it in its per-connection
+// task.
+struct ThriftEventLoopServer::Connection {
+  shared_ptr<TSocket> socket;
+  shared_ptr<TTransport> input_transport;
+  shared_ptr<TTransport> output_transport;
+  shared_ptr<TProtocol> input_protocol;
+  shared_ptr<TProtocol> output_protocol;
+  shared_ptr<TProcessor> processor;
+
+  // Returned by the event handler's createContext().
+  void* context;
+};
+
+ThriftEventLoopServer::ThriftEventLoopServer(const shared_ptr<TProcessor>& processor,
+    const shared_ptr<TServerTransport>& socket,
+    const shared_ptr<TTransportFactory>& factory,
+    const shared_ptr<TProtocolFactory>& protocol, const string& name,
+    int num_io_threads, int num_worker_threads)
+  : TServer(processor, socket, factory, protocol),
+    name_(name),
+    num_io_threads_(max(num_io_threads, 1)),
+    num_worker_threads_(max(num_worker_threads, 1)),
+    stop_(false),
+    epoll_fd_(-1) {
+}
+
+ThriftEventLoopServer::~ThriftEventLoopServer() {
+  if (epoll_fd_ != -1) close(epoll_fd_);
+}
+
+void ThriftEventLoopServer::serve() {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ == -1) {
+    throw TException(Substitute("epoll_create1() failed: $0", GetStrErrMsg()));
+  }
+  serverTransport_->listen();
+  worker_pool_.reset(new ThreadPool<Connection*>("thrift-server", name_ + "-worker",
+      num_worker_threads_, numeric_limits<int32_t>::max(),
+      bind<void>(mem_fn(&ThriftEventLoopServer::ProcessConnection), this, _1, _2)));
+  for (int i = 0; i < num_io_threads_; ++i) {
+    io_threads_.AddThread(new Thread("thrift-server",
+        Substitute("$0-io($1:$2)", name_, i + 1, num_io_threads_),
+        &ThriftEventLoopServer::IoThread, this));
+  }
+  if (eventHandler_ != NULL) eventHandler_->preServe();
+
+  while (!stop_) {
+    shared_ptr<TTransport> client;
+    try {
+      client = serverTransport_->accept();
+    } catch (const TTransportException& e) {
+      if (stop_) break;
+      LOG(WARNING) << "ThriftEventLoopServer '" << name_ << "' failed to accept a "
+                   << "connection: " << e.what();
+      continue;
+    }
+    Connection* connection = new Connection();
+    connection->socket = dynamic_pointer_cast<TSocket>(client);
+    DCHECK(connection->socket != NULL);
+    connection->context = NULL;
+    try {
+      connection->input_transport = inputTransportFactory_->getTransport(client);
+      connection->output_transport = outputTransportFactory_->getTransport(client);
+      connection->input_protocol =
+          inputProtocolFactory_->getProtocol(connection->input_transport);
+      connection->output_protocol =
+          outputProtocolFactory_->getProtocol(connection->output_transport);
+      connection->processor = getProcessor(connection->input_protocol,
+          connection->output_protocol, client);
+    } catch (const TException& e) {
+      LOG(WARNING) << "ThriftEventLoopServer '" << name_ << "' failed to set up a "
+                   << "connection: " << e.what();
+      client->close();
+      delete connection;
+      continue;
+    }
+    if (eventHandler_ != NULL) {
+      connection->context = eventHandler_->createContext(connection->input_protocol,
+          connection->output_protocol);
+    }
+    {
+      lock_guard<mutex> l(connections_lock_);
+      connections_.insert(connection);
+    }
+    if (!WatchConnection(connection, true)) CloseConnection(connection);
+  }
+
+  io_threads_.JoinAll();
+  worker_pool_->DrainAndShutdown();
+  vector<Connection*> connections;
+  {
+    lock_guard<mutex> l(connections_lock_);
+    connections.assign(connections_.begin(), connections_.end());
+  }
+  BOOST_FOREACH(Connection* connection, connections) {
+    CloseConnection(connection);
+  }
+}
+
+void ThriftEventLoopServer::stop() {
+  stop_ = true;
+  serverTransport_->interrupt();
+}
+
+void ThriftEventLoopServer::IoThread() {
+  epoll_event events[MAX_EPOLL_EVENTS];
+  while (!stop_) {
+    int num_events = epoll_wait(epoll_fd_, events, MAX_EPOLL_EVENTS,
+        EPOLL_WAIT_TIMEOUT_MS);
+    if (num_events == -1) {
+      if (errno == EINTR) continue;
+      LOG(ERROR) << "ThriftEventLoopServer '" << name_ << "': epoll_wait() failed: "
+                 << GetStrErrMsg();
+      break;
+    }
+    // A connection is only reported once before it is re-armed, so it is processed by
+    // one worker at a time. Hang-ups are processed like requests, and the worker closes
+    // the connection when it reads the end of the stream.
+    for (int i = 0; i < num_events; ++i) {
+      worker_pool_->Offer(static_cast<Connection*>(events[i].data.ptr));
+    }
+  }
+}
+
+// Returns true if 'transport' already holds bytes of the next request, which epoll
+// can't report since they have been read from the socket.
+static bool HasBufferedInput(TTransport* transport) {
+  TBufferedTransport* buffered = dynamic_cast<TBufferedTransport*>(transport);
+  if (buffered == NULL) return false;
+  uint32_t len = 1;
+  return buffered->borrow(NULL, &len) != NULL;
+}
+
+void ThriftEventLoopServer::ProcessConnection(int thread_id,
+    Connection* const& connection) {
+  bool keep_open = true;
+  try {
+    do {
+      if (eventHandler_ != NULL) {
+        eventHandler_->processContext(connection->context, connection->input_transport);
+      }
+      keep_open = connection->processor->process(connection->input_protocol,
+          connection->output_protocol, connection->context);
+    } while (keep_open && HasBufferedInput(connection->input_transport.get()));
+  } catch (const TTransportException& e) {
+    if (e.getType() != TTransportException::END_OF_FILE) {
+      LOG(WARNING) << "ThriftEventLoopServer '" << name_ << "' client died: "
+                   << e.what();
+    }
+    keep_open = false;
+  } catch (const TException& e) {
+    LOG(ERROR) << "ThriftEventLoopServer '" << name_ << "': " << e.what();
+    keep_open = false;
+  }
+  if (!keep_open || stop_ || !WatchConnection(connection, false)) {
+    CloseConnection(connection);
+  }
+}
+
+bool ThriftEventLoopServer::WatchConnection(Connection* connection, bool add) {
+  epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+  event.data.ptr = connection;
+  if (epoll_ctl(epoll_fd_, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD,
+      connection->socket->getSocketFD(), &event) == 0) {
+    return true;
+  }
+  LOG(WARNING) << "ThriftEventLoopServer '" << name_ << "': epoll_ctl() failed: "
+               << GetStrErrMsg();
+  return false;
+}
+
+void ThriftEventLoopServer::CloseConnection(Connection* connection) {
+  {
+    lock_guard<mutex> l(connections_lock_);
+    if (connections_.erase(connection) == 0) return;
+  }
+  // Stop watching the socket before the connection is freed.
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, connection->socket->getSocketFD(), NULL);
+  if (eventHandler_ != NULL) {
+    eventHandler_->deleteContext(connection->context, connection->input_protocol,
+        connection->output_protocol);
+  }
+  try {
+    connection->input_transport->close();
+    connection->output_transport->close();
+    connection->socket->close();
+  } catch (const TTransportException& e) {
+    LOG(WARNING) << "ThriftEventLoopServer '" << name_ << "' failed to close a "
+                 << "connection: " << e.what();
+  }
+  delete connection;
+}
@@ -0,0 +1,96 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_RPC_THRIFT_EVENT_LOOP_SERVER_H
+#define IMPALA_RPC_THRIFT_EVENT_LOOP_SERVER_H
+
+#include <string>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_set.hpp>
+#include <thrift/server/TServer.h>
+
+#include "util/thread.h"
+#include "util/thread-pool.h"
+
+namespace impala {
+
+/// Thrift server that doesn't dedicate a thread to each connection. The sockets of the
+/// connections are watched by a small number of IO threads with epoll, and whenever a
+/// request starts to arrive on one of them, the connection is handed to a pool of
+/// worker threads, which reads the request, calls the processor and writes the response
+/// with blocking IO, as the other servers do. The connection is then watched again.
+/// Idle connections therefore don't hold any thread, and the number of worker threads
+/// only bounds the number of RPCs that are processed concurrently.
+///
+/// Clients don't need a framed transport: since a worker reads a whole request, the
+/// usual buffered transport over a plain socket works. Transports that buffer data
+/// that epoll can't see, i.e. SSL and SASL, are not supported.
+class ThriftEventLoopServer : public apache::thrift::server::TServer {
+ public:
+  ///  - name: used to name the threads of the server
+  ///  - num_io_threads: number of threads that wait for requests on the connections
+  ///  - num_worker_threads: number of threads that process requests
+  ThriftEventLoopServer(const boost::shared_ptr<apache::thrift::TProcessor>& processor,
+      const boost::shared_ptr<apache::thrift::transport::TServerTransport>& socket,
+      const boost::shared_ptr<apache::thrift::transport::TTransportFactory>& factory,
+      const boost::shared_ptr<apache::thrift::protocol::TProtocolFactory>& protocol,
+      const std::string& name, int num_io_threads, int num_worker_threads);
+
+  virtual ~ThriftEventLoopServer();
+
+  /// Accepts connections until stop() is called. From TServer.
+  virtual void serve();
+
+  /// Makes serve() return, after which all connections are closed. From TServer.
+  virtual void stop();
+
+ private:
+  struct Connection;
+
+  /// Waits for requests on the connections and hands the connections to worker_pool_.
+  void IoThread();
+
+  /// Processes the requests that have arrived on 'connection', then watches it again or
+  /// closes it once the client has disconnected. Run by the threads of worker_pool_.
+  void ProcessConnection(int thread_id, Connection* const& connection);
+
+  /// Registers the socket of 'connection' with epoll_fd_ for the next request. With
+  /// 'add' false, re-arms the socket after a request.
+  bool WatchConnection(Connection* connection, bool add);
+
+  /// Calls the event handler, then closes and frees 'connection'.
+  void CloseConnection(Connection* connection);
+
+  const std::string name_;
+  const int num_io_threads_;
+  const int num_worker_threads_;
+
+  /// Set by stop().
+  volatile bool stop_;
+
+  int epoll_fd_;
+  ThreadGroup io_threads_;
+  boost::scoped_ptr<ThreadPool<Connection*> > worker_pool_;
+
+  /// All the open connections, which serve() closes when it returns.
+  boost::mutex connections_lock_;
+  boost::unordered_set<Connection*> connections_;
+};
+
+}
+
+#endif
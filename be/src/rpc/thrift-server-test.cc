@@ -16,6 +16,7 @@
 
 #include "testutil/gtest-util.h"
 #include "rpc/thrift-client.h"
+#include "runtime/client-cache.h"
 #include "service/fe-support.h"
 #include "service/impala-server.h"
 #include "common/init.h"
@@ -134,6 +135,63 @@ TEST(SslTest, ClientBeforeServer) {
     ssl_client.iface()->RegisterSubscriber(resp, TRegisterSubscriberRequest());
 }
 
+TEST(EventLoopServerTest, MoreConnectionsThanWorkers) {
+  // With two worker threads, a ThreadPool server could only serve two of the clients,
+  // which all keep their connection open.
+  ThriftServer* server = new ThriftServer("DummyStatestore", MakeProcessor(),
+      FLAGS_state_store_port + 7, NULL, NULL, 2, ThriftServer::EventLoop);
+  ASSERT_OK(server->Start());
+
+  const int NUM_CLIENTS = 8;
+  vector<shared_ptr<ThriftClient<StatestoreServiceClient> > > clients;
+  for (int i = 0; i < NUM_CLIENTS; ++i) {
+    clients.push_back(shared_ptr<ThriftClient<StatestoreServiceClient> >(
+        new ThriftClient<StatestoreServiceClient>(
+            "localhost", FLAGS_state_store_port + 7, "", NULL, false)));
+    ASSERT_OK(clients.back()->Open());
+  }
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < NUM_CLIENTS; ++i) {
+      TRegisterSubscriberResponse resp;
+      EXPECT_NO_THROW({
+        clients[i]->iface()->RegisterSubscriber(resp, TRegisterSubscriberRequest());
+      });
+    }
+  }
+  clients.clear();
+  server->StopForTesting();
+}
+
+TEST(ClientCacheTest, WarmUpAndReplaceBrokenClients) {
+  ThriftServer* server = new ThriftServer("DummyStatestore", MakeProcessor(),
+      FLAGS_state_store_port + 8, NULL, NULL, 5);
+  ASSERT_OK(server->Start());
+
+  ClientCache<StatestoreServiceClient> cache;
+  TNetworkAddress address = MakeNetworkAddress("localhost", FLAGS_state_store_port + 8);
+  const string& expected = Substitute("localhost:$0:3]", FLAGS_state_store_port + 8);
+  cache.WarmUp(address, 3);
+  cache.DoMaintenance();
+  EXPECT_NE(cache.DebugString().find(expected), string::npos) << cache.DebugString();
+
+  // Closed clients are replaced by new ones that work.
+  cache.CloseConnections(address);
+  cache.DoMaintenance();
+  EXPECT_NE(cache.DebugString().find(expected), string::npos) << cache.DebugString();
+  {
+    Status status;
+    ClientConnection<StatestoreServiceClient> client(&cache, address, &status);
+    ASSERT_OK(status);
+    TRegisterSubscriberResponse resp;
+    status = client.DoRpc(&StatestoreServiceClient::RegisterSubscriber,
+        TRegisterSubscriberRequest(), &resp);
+    EXPECT_OK(status);
+  }
+  // The server waits for its connections to be closed before stopping.
+  cache.TestShutdown();
+  server->StopForTesting();
+}
+
 int main(int argc, char** argv) {
   InitCommonRuntime(argc, argv, false);
   ::testing::InitGoogleTest(&argc, argv);
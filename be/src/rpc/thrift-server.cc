@@ -32,6 +32,7 @@
 
 #include "gen-cpp/Types_types.h"
 #include "rpc/authentication.h"
+#include "rpc/thrift-event-loop-server.h"
 #include "rpc/thrift-server.h"
 #include "rpc/thrift-thread.h"
 #include "util/debug-util.h"
@@ -56,6 +57,8 @@ using namespace apache::thrift;
 
 DEFINE_int32(rpc_cnxn_attempts, 10, "Deprecated");
 DEFINE_int32(rpc_cnxn_retry_interval_ms, 2000, "Deprecated");
+DEFINE_int32(rpc_io_threads, 2, "(Advanced) Number of threads of each event loop server "
+    "that wait for requests on its connections.");
 
 DECLARE_string(principal);
 DECLARE_string(keytab_file);
@@ -401,6 +404,12 @@ Status ThriftServer::Start() {
   shared_ptr<TTransportFactory> transport_factory;
   RETURN_IF_ERROR(CreateSocket(&server_socket));
   RETURN_IF_ERROR(auth_provider_->GetServerTransportFactory(&transport_factory));
+  if (server_type_ == EventLoop && (ssl_enabled() || auth_provider_->is_sasl())) {
+    // Both SSL and SASL buffer data that epoll doesn't see.
+    LOG(WARNING) << "ThriftServer '" << name_ << "' can't use an event loop with SSL "
+                 << "or SASL, starting a thread per connection instead";
+    server_type_ = Threaded;
+  }
   switch (server_type_) {
     case ThreadPool:
       {
@@ -416,6 +425,11 @@ Status ThriftServer::Start() {
       server_.reset(new TThreadedServer(processor_, server_socket,
           transport_factory, protocol_factory, thread_factory));
       break;
+    case EventLoop:
+      server_.reset(new ThriftEventLoopServer(processor_, server_socket,
+          transport_factory, protocol_factory, name_, FLAGS_rpc_io_threads,
+          num_worker_threads_));
+      break;
     default:
       stringstream error_msg;
       error_msg << "Unsupported server type: " << server_type_;
@@ -443,7 +457,7 @@ void ThriftServer::Join() {
 void ThriftServer::StopForTesting() {
   DCHECK(server_thread_ != NULL);
   DCHECK(server_);
-  DCHECK_EQ(server_type_, Threaded);
+  DCHECK(server_type_ == Threaded || server_type_ == EventLoop);
   server_->stop();
   if (started_) Join();
 }
@@ -84,11 +84,16 @@ class ThriftServer {
 
   static const int DEFAULT_WORKER_THREADS = 2;
 
-  /// There are 2 servers supported by Thrift with different threading models.
+  /// There are 2 servers supported by Thrift with different threading models, plus our
+  /// own ThriftEventLoopServer.
   /// ThreadPool  -- Allocates a fixed number of threads. A thread is used by a
   ///                connection until it closes.
   /// Threaded    -- Allocates 1 thread per connection, as needed.
-  enum ServerType { ThreadPool = 0, Threaded };
+  /// EventLoop   -- Watches the connections with --rpc_io_threads threads, and
+  ///                processes requests with a fixed number of worker threads, so that
+  ///                idle connections don't use a thread. Falls back to Threaded if SSL
+  ///                or SASL is enabled.
+  enum ServerType { ThreadPool = 0, Threaded, EventLoop };
 
   /// Creates, but does not start, a new server on the specified port
   /// that exports the supplied interface.
@@ -122,7 +127,7 @@ class ThriftServer {
   void Join();
 
   /// FOR TESTING ONLY; stop the server and block until the server is stopped; use it
-  /// only if it is a Threaded server.
+  /// only if it is a Threaded or EventLoop server.
   void StopForTesting();
 
   /// Starts the main server thread. Once this call returns, clients
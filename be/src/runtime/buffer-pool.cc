@@ -0,0 +1,152 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "runtime/buffer-pool.h"
+
+#include <boost/thread/locks.hpp>
+
+#include "runtime/mem-tracker.h"
+#include "util/bit-util.h"
+#include "util/cpu-info.h"
+#include "util/huge-page-allocator.h"
+#include "util/impalad-metrics.h"
+
+#include "common/names.h"
+
+namespace impala {
+
+BufferPool::BufferPool(int64_t min_buffer_size, int64_t max_buffer_size,
+    int max_free_buffers, MemTracker* process_mem_tracker)
+  : min_buffer_size_(min_buffer_size),
+    max_free_buffers_(max_free_buffers),
+    mem_tracker_(new MemTracker(-1, -1, "Buffer Pool: Free Buffers",
+        process_mem_tracker)),
+    num_free_buffers_(0) {
+  DCHECK_GT(min_buffer_size, 0);
+  DCHECK_GE(max_buffer_size, min_buffer_size);
+  num_size_classes_ =
+      BitUtil::Log2(BitUtil::Ceil(max_buffer_size, min_buffer_size)) + 1;
+  shards_.resize(CpuInfo::num_numa_nodes());
+  for (int i = 0; i < shards_.size(); ++i) {
+    shards_[i] = new Shard();
+    shards_[i]->free_buffers.resize(num_size_classes_);
+  }
+}
+
+BufferPool::~BufferPool() {
+  FreeCachedBuffers();
+  for (int i = 0; i < shards_.size(); ++i) delete shards_[i];
+  mem_tracker_->UnregisterFromParent();
+}
+
+int BufferPool::SizeClass(int64_t len) const {
+  return BitUtil::Log2(BitUtil::Ceil(len, min_buffer_size_));
+}
+
+int64_t BufferPool::BufferSize(int64_t len) const {
+  DCHECK_GT(len, 0);
+  int size_class = SizeClass(len);
+  if (size_class >= num_size_classes_) return len;
+  return min_buffer_size_ << size_class;
+}
+
+int BufferPool::CurrentNode() const {
+  if (shards_.size() == 1) return 0;
+  return CpuInfo::GetCurrentNumaNode();
+}
+
+uint8_t* BufferPool::Allocate(int64_t len) {
+  int64_t buffer_size = BufferSize(len);
+  int size_class = SizeClass(len);
+  if (size_class < num_size_classes_ && num_free_buffers_ > 0) {
+    // Prefer a buffer of the local node, then one of any other node.
+    int node = CurrentNode();
+    for (int i = 0; i < shards_.size(); ++i) {
+      uint8_t* buffer =
+          TakeFreeBuffer(shards_[(node + i) % shards_.size()], size_class);
+      if (buffer != NULL) {
+        UpdateFreeBuffers(-1, -buffer_size);
+        return buffer;
+      }
+    }
+  }
+  return HugePageAllocator::Allocate(buffer_size);
+}
+
+uint8_t* BufferPool::TakeFreeBuffer(Shard* shard, int size_class) {
+  lock_guard<SpinLock> l(shard->lock);
+  vector<uint8_t*>* free_buffers = &shard->free_buffers[size_class];
+  if (free_buffers->empty()) return NULL;
+  uint8_t* buffer = free_buffers->back();
+  free_buffers->pop_back();
+  return buffer;
+}
+
+void BufferPool::Free(uint8_t* buffer, int64_t len) {
+  DCHECK(buffer != NULL);
+  int64_t buffer_size = BufferSize(len);
+  int size_class = SizeClass(len);
+  if (size_class < num_size_classes_) {
+    // Account for the buffer before it is visible to Allocate(), so that the tracker
+    // never goes negative.
+    UpdateFreeBuffers(1, buffer_size);
+    Shard* shard = shards_[CurrentNode()];
+    {
+      lock_guard<SpinLock> l(shard->lock);
+      vector<uint8_t*>* free_buffers = &shard->free_buffers[size_class];
+      if (free_buffers->size() < static_cast<size_t>(max_free_buffers_)) {
+        free_buffers->push_back(buffer);
+        return;
+      }
+    }
+    UpdateFreeBuffers(-1, -buffer_size);
+  }
+  HugePageAllocator::Free(buffer, buffer_size);
+}
+
+void BufferPool::FreeCachedBuffers() {
+  for (int i = 0; i < shards_.size(); ++i) {
+    vector<vector<uint8_t*> > free_buffers(num_size_classes_);
+    {
+      lock_guard<SpinLock> l(shards_[i]->lock);
+      free_buffers.swap(shards_[i]->free_buffers);
+    }
+    int num_freed = 0;
+    int64_t bytes_freed = 0;
+    for (int size_class = 0; size_class < num_size_classes_; ++size_class) {
+      int64_t buffer_size = min_buffer_size_ << size_class;
+      for (int j = 0; j < free_buffers[size_class].size(); ++j) {
+        HugePageAllocator::Free(free_buffers[size_class][j], buffer_size);
+        ++num_freed;
+        bytes_freed += buffer_size;
+      }
+    }
+    UpdateFreeBuffers(-num_freed, -bytes_freed);
+  }
+}
+
+void BufferPool::UpdateFreeBuffers(int num, int64_t bytes) {
+  if (num == 0) return;
+  num_free_buffers_ += num;
+  if (bytes > 0) {
+    mem_tracker_->Consume(bytes);
+  } else {
+    mem_tracker_->Release(-bytes);
+  }
+  if (ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS != NULL) {
+    ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS->Increment(num);
+  }
+}
+
+}
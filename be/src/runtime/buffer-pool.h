@@ -0,0 +1,116 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_RUNTIME_BUFFER_POOL_H
+#define IMPALA_RUNTIME_BUFFER_POOL_H
+
+#include <vector>
+#include <boost/scoped_ptr.hpp>
+
+#include "common/atomic.h"
+#include "util/spinlock.h"
+
+namespace impala {
+
+class MemTracker;
+
+/// Process-wide cache of large buffers, shared by the DiskIoMgr's IO buffers and the
+/// io-sized block buffers of the BufferedBlockMgrs of all queries. Buffers that are
+/// freed are cached and handed out again instead of being returned to the allocator, so
+/// that memory released by one query's spilling operators or scans is reused by the next
+/// query rather than fragmenting the heap and inflating the process RSS.
+///
+/// Buffer sizes are quantized to power-of-two multiples of 'min_buffer_size', up to the
+/// first such size that is >= 'max_buffer_size'. Each size has its own free lists.
+/// Larger buffers are allocated and freed directly. The free lists are sharded by NUMA
+/// node: a buffer is cached on the node of the CPU that frees it and handed out
+/// preferably to threads running on the same node, which are likely the ones that
+/// touched its pages. Buffers cached on other nodes are used before allocating new ones.
+///
+/// Buffers are allocated with the HugePageAllocator, so large ones may be backed by huge
+/// pages.
+///
+/// Memory accounting for buffers in use is left to the callers, which charge it to the
+/// trackers of their queries. The bytes of the cached free buffers are charged to the
+/// pool's own tracker, a child of the process tracker.
+///
+/// Thread-safe.
+class BufferPool {
+ public:
+  /// 'max_free_buffers' is the maximum number of free buffers of each size that are
+  /// cached on each NUMA node. If it is 0, buffers are never cached.
+  BufferPool(int64_t min_buffer_size, int64_t max_buffer_size, int max_free_buffers,
+      MemTracker* process_mem_tracker);
+
+  /// Frees the cached buffers. All buffers must have been returned.
+  ~BufferPool();
+
+  /// Returns the size of the buffer that Allocate() returns for 'len' bytes.
+  int64_t BufferSize(int64_t len) const;
+
+  /// Returns a buffer of BufferSize(len) bytes, reusing a cached one if possible.
+  uint8_t* Allocate(int64_t len);
+
+  /// Returns 'buffer', which was allocated for 'len' bytes, to the pool.
+  void Free(uint8_t* buffer, int64_t len);
+
+  /// Frees all cached buffers. Registered as a GC function of the process tracker.
+  void FreeCachedBuffers();
+
+  /// Returns the number of cached free buffers.
+  int num_free_buffers() const { return num_free_buffers_; }
+
+  MemTracker* mem_tracker() { return mem_tracker_.get(); }
+
+ private:
+  /// Free buffers cached on one NUMA node. There is one list per buffer size, indexed by
+  /// the Log2 of the size in units of min_buffer_size_.
+  struct Shard {
+    SpinLock lock;
+    std::vector<std::vector<uint8_t*> > free_buffers;
+  };
+
+  const int64_t min_buffer_size_;
+  const int max_free_buffers_;
+
+  /// Number of buffer sizes that are cached.
+  int num_size_classes_;
+
+  /// One shard per NUMA node.
+  std::vector<Shard*> shards_;
+
+  /// Tracks the bytes of the cached free buffers.
+  boost::scoped_ptr<MemTracker> mem_tracker_;
+
+  AtomicInt<int> num_free_buffers_;
+
+  /// Returns the index of the size class for 'len', which is >= num_size_classes_ if
+  /// buffers of that size aren't cached.
+  int SizeClass(int64_t len) const;
+
+  /// Returns the NUMA node of the CPU that the calling thread runs on.
+  int CurrentNode() const;
+
+  /// Removes a free buffer of 'size_class' from 'shard'. Returns NULL if there is none.
+  uint8_t* TakeFreeBuffer(Shard* shard, int size_class);
+
+  /// Called when 'num' free buffers of 'bytes' in total were added to (if positive) or
+  /// removed from (if negative) the free lists.
+  void UpdateFreeBuffers(int num, int64_t bytes);
+};
+
+}
+
+#endif
@@ -61,6 +61,7 @@ const static int WRITE_WAIT_MILLIS = 500;
 const static int WRITE_CHECK_INTERVAL_MILLIS = 10;
 
 DECLARE_bool(disk_spill_encryption);
+DECLARE_string(disk_spill_compression_codec);
 
 namespace impala {
 
@@ -775,6 +776,45 @@ TEST_F(BufferedBlockMgrTest, DeleteSingleBlocks) {
   TearDownMgrs();
 }
 
+// Test that read-ahead hints are only issued for blocks that were evicted and don't
+// affect the blocks' state.
+TEST_F(BufferedBlockMgrTest, ReadAhead) {
+  int max_num_buffers = 2;
+  BufferedBlockMgr::Client* client;
+  BufferedBlockMgr* block_mgr = CreateMgrAndClient(0, max_num_buffers, block_size_,
+      0, false, client_tracker_.get(), &client);
+  RuntimeProfile::Counter* read_ahead =
+      block_mgr->profile()->GetCounter("ReadAheadBlocks");
+
+  vector<BufferedBlockMgr::Block*> blocks;
+  AllocateBlocks(block_mgr, client, max_num_buffers, &blocks);
+  // Pinned blocks are in memory.
+  blocks[0]->ReadAhead();
+  EXPECT_EQ(0, read_ahead->value());
+
+  // Evict both blocks by allocating new ones in their place.
+  UnpinBlocks(blocks);
+  WaitForWrites(block_mgr);
+  vector<BufferedBlockMgr::Block*> new_blocks;
+  AllocateBlocks(block_mgr, client, max_num_buffers, &new_blocks);
+  for (int i = 0; i < max_num_buffers; ++i) {
+    blocks[i]->ReadAhead();
+    EXPECT_FALSE(blocks[i]->is_pinned());
+  }
+  EXPECT_EQ(max_num_buffers, read_ahead->value());
+
+  UnpinBlocks(new_blocks);
+  for (int i = 0; i < max_num_buffers; ++i) {
+    bool pinned;
+    EXPECT_OK(blocks[i]->Pin(&pinned));
+    EXPECT_TRUE(pinned);
+    ValidateBlock(blocks[i], i);
+  }
+  DeleteBlocks(blocks);
+  DeleteBlocks(new_blocks);
+  TearDownMgrs();
+}
+
 // Test that all APIs return cancelled after close.
 TEST_F(BufferedBlockMgrTest, Close) {
   int max_num_buffers = 5;
@@ -1334,6 +1374,82 @@ TEST_F(BufferedBlockMgrTest, ClientOversubscription) {
   TearDownMgrs();
 }
 
+// Test that fragment instances get their minimum buffers up front or fail before they
+// run, and get as much of their desired buffers as is left.
+TEST_F(BufferedBlockMgrTest, ReserveFragmentBuffers) {
+  int max_num_buffers = 10;
+  const int block_size = 1024;
+  BufferedBlockMgr* block_mgr = CreateMgr(0, max_num_buffers, block_size);
+
+  int reserved1;
+  EXPECT_OK(block_mgr->ReserveFragmentBuffers(4, 6, &reserved1));
+  EXPECT_EQ(reserved1, 6);
+  // Only 4 buffers are left, so the second instance gets its minimum but less than it
+  // wants.
+  int reserved2;
+  EXPECT_OK(block_mgr->ReserveFragmentBuffers(3, 8, &reserved2));
+  EXPECT_EQ(reserved2, 4);
+  // Nothing is left for a third instance.
+  int reserved3;
+  EXPECT_TRUE(block_mgr->ReserveFragmentBuffers(1, 1, &reserved3).IsMemLimitExceeded());
+  EXPECT_OK(block_mgr->ReserveFragmentBuffers(0, 0, &reserved3));
+  EXPECT_EQ(reserved3, 0);
+
+  // Releasing a reservation makes room again.
+  block_mgr->ReleaseFragmentBuffers(reserved1);
+  EXPECT_OK(block_mgr->ReserveFragmentBuffers(1, 1, &reserved3));
+  EXPECT_EQ(reserved3, 1);
+  block_mgr->ReleaseFragmentBuffers(reserved2);
+  block_mgr->ReleaseFragmentBuffers(reserved3);
+  TearDownMgrs();
+}
+
+// Test that ReclaimMemory() frees idle buffers of all queries, largest consumers first,
+// and that spilled blocks can be pinned again.
+TEST_F(BufferedBlockMgrTest, ReclaimMemory) {
+  const int max_num_buffers = 4;
+  const int64_t ALL_BYTES = 1L << 40;
+  vector<BufferedBlockMgr*> block_mgrs;
+  vector<BufferedBlockMgr::Client*> clients;
+  CreateMgrsAndClients(0, 2, max_num_buffers, block_size_, 0, false,
+      client_tracker_.get(), &block_mgrs, &clients);
+  vector<BufferedBlockMgr::Block*> blocks0;
+  vector<BufferedBlockMgr::Block*> blocks1;
+  AllocateBlocks(block_mgrs[0], clients[0], 2, &blocks0);
+  AllocateBlocks(block_mgrs[1], clients[1], max_num_buffers, &blocks1);
+
+  // Pinned blocks are not reclaimed.
+  EXPECT_EQ(BufferedBlockMgr::ReclaimMemory(ALL_BYTES), 0);
+
+  // The first round starts writing the unpinned blocks, the second one frees their
+  // buffers.
+  UnpinBlocks(blocks0);
+  UnpinBlocks(blocks1);
+  int64_t bytes_reclaimed = BufferedBlockMgr::ReclaimMemory(ALL_BYTES);
+  WaitForWrites(block_mgrs);
+  bytes_reclaimed += BufferedBlockMgr::ReclaimMemory(ALL_BYTES);
+  EXPECT_EQ(bytes_reclaimed, (2 + max_num_buffers) * block_size_);
+  EXPECT_EQ(block_mgrs[0]->bytes_allocated(), 0);
+  EXPECT_EQ(block_mgrs[1]->bytes_allocated(), 0);
+
+  // The blocks are read back.
+  PinBlocks(blocks0);
+  PinBlocks(blocks1);
+  for (int i = 0; i < blocks1.size(); ++i) {
+    EXPECT_EQ(*reinterpret_cast<int32_t*>(blocks1[i]->buffer()), i);
+  }
+
+  // Deleting the blocks leaves their buffers free. Only the largest consumer has to give
+  // them up to reclaim a single byte.
+  DeleteBlocks(blocks0);
+  DeleteBlocks(blocks1);
+  EXPECT_EQ(BufferedBlockMgr::ReclaimMemory(1), max_num_buffers * block_size_);
+  EXPECT_EQ(block_mgrs[0]->bytes_allocated(), 2 * block_size_);
+  EXPECT_EQ(block_mgrs[1]->bytes_allocated(), 0);
+  EXPECT_EQ(BufferedBlockMgr::ReclaimMemory(1), 2 * block_size_);
+  TearDownMgrs();
+}
+
 TEST_F(BufferedBlockMgrTest, SingleRandom_plain) {
   FLAGS_disk_spill_encryption = false;
   TestRandomInternalSingle(1024);
@@ -1382,6 +1498,22 @@ TEST_F(BufferedBlockMgrTest, Multi4Random_encryption) {
 //   TestRandomInternalMulti(8);
 // }
 
+TEST_F(BufferedBlockMgrTest, SingleRandom_compression) {
+  FLAGS_disk_spill_encryption = false;
+  FLAGS_disk_spill_compression_codec = "lz4";
+  TestRandomInternalSingle(8 * 1024);
+  FLAGS_disk_spill_compression_codec = "zstd";
+  TestRandomInternalSingle(8 * 1024);
+  FLAGS_disk_spill_compression_codec = "";
+}
+
+TEST_F(BufferedBlockMgrTest, Multi2Random_compression_encryption) {
+  FLAGS_disk_spill_encryption = true;
+  FLAGS_disk_spill_compression_codec = "snappy";
+  TestRandomInternalMulti(2, 8 * 1024);
+  FLAGS_disk_spill_compression_codec = "";
+}
+
 
 TEST_F(BufferedBlockMgrTest, CreateDestroyMulti) {
   CreateDestroyMulti();
@@ -13,35 +13,51 @@
 // limitations under the License.
 
 #include "runtime/runtime-state.h"
+#include "runtime/buffer-pool.h"
 #include "runtime/mem-tracker.h"
 #include "runtime/mem-pool.h"
 #include "runtime/buffered-block-mgr.h"
 #include "runtime/tmp-file-mgr.h"
 #include "util/runtime-profile.h"
+#include "util/codec.h"
 #include "util/disk-info.h"
 #include "util/filesystem-util.h"
 #include "util/impalad-metrics.h"
+#include "util/lock-profiler.h"
+#include "util/time.h"
 #include "util/uid-util.h"
 
+#include <algorithm>
+#include <fcntl.h>
+#include <limits>
+#include <unistd.h>
 #include <openssl/rand.h>
 #include <openssl/evp.h>
 #include <openssl/sha.h>
 #include <openssl/err.h>
 
+#include <boost/algorithm/string.hpp>
 #include <gutil/strings/substitute.h>
 
 DEFINE_bool(disk_spill_encryption, false, "Set this to encrypt and perform an integrity "
   "check on all data spilled to disk during a query");
+DEFINE_string(disk_spill_compression_codec, "", "If set, blocks spilled to disk are "
+  "compressed with this codec first. One of 'lz4', 'snappy' or 'zstd'. Blocks that "
+  "don't compress are written uncompressed.");
 
 #include "common/names.h"
 
 using namespace strings;   // for Substitute
+using boost::algorithm::iequals;
 
 namespace impala {
 
 BufferedBlockMgr::BlockMgrsMap BufferedBlockMgr::query_to_block_mgrs_;
 SpinLock BufferedBlockMgr::static_block_mgrs_lock_;
 
+// The acquisitions of lock_ by all block mgrs.
+static LockSite lock_site("BufferedBlockMgr::lock_");
+
 
 struct BufferedBlockMgr::Client {
   Client(const string& debug_info, BufferedBlockMgr* mgr, int num_reserved_buffers,
@@ -55,7 +71,8 @@ struct BufferedBlockMgr::Client {
         num_reserved_buffers_(num_reserved_buffers),
         tolerates_oversubscription_(tolerates_oversubscription),
         num_tmp_reserved_buffers_(0),
-        num_pinned_buffers_(0) {
+        num_pinned_buffers_(0),
+        wait_timer_(NULL) {
     DCHECK(tracker != NULL);
   }
 
@@ -95,6 +112,9 @@ struct BufferedBlockMgr::Client {
   /// Number of buffers pinned by this client.
   int num_pinned_buffers_;
 
+  /// Time the client waited for spill IO, see SetClientWaitTimer(). Unowned, may be NULL.
+  RuntimeProfile::Counter* wait_timer_;
+
   void PinBuffer(BufferDescriptor* buffer) {
     DCHECK(buffer != NULL);
     if (buffer->len == mgr_->max_block_size()) {
@@ -130,8 +150,10 @@ BufferedBlockMgr::Block::Block(BufferedBlockMgr* block_mgr)
     client_(NULL),
     write_range_(NULL),
     tmp_file_(NULL),
+    write_issue_time_ns_(0),
     valid_data_len_(0),
-    num_rows_(0) {
+    num_rows_(0),
+    is_compressed_(false) {
 }
 
 Status BufferedBlockMgr::Block::Pin(bool* pinned, Block* release_block, bool unpin) {
@@ -146,6 +168,10 @@ void BufferedBlockMgr::Block::Delete() {
   block_mgr_->DeleteBlock(this);
 }
 
+void BufferedBlockMgr::Block::ReadAhead() {
+  block_mgr_->ReadAheadBlock(this);
+}
+
 void BufferedBlockMgr::Block::Init() {
   // No locks are taken because the block is new or has previously been deleted.
   is_pinned_ = false;
@@ -200,6 +226,19 @@ string BufferedBlockMgr::Block::DebugString() const {
   return ss.str();
 }
 
+// Returns the codec named by --disk_spill_compression_codec. Only codecs that don't keep
+// state between blocks can be used, since the codecs are shared by all writers.
+static THdfsCompression::type GetSpillCompressionType() {
+  const string& codec = FLAGS_disk_spill_compression_codec;
+  if (codec.empty() || iequals(codec, "none")) return THdfsCompression::NONE;
+  if (iequals(codec, "lz4")) return THdfsCompression::LZ4;
+  if (iequals(codec, "snappy")) return THdfsCompression::SNAPPY;
+  if (iequals(codec, "zstd")) return THdfsCompression::ZSTD;
+  LOG(WARNING) << "Invalid --disk_spill_compression_codec '" << codec
+               << "', spilled blocks will not be compressed.";
+  return THdfsCompression::NONE;
+}
+
 BufferedBlockMgr::BufferedBlockMgr(RuntimeState* state, TmpFileMgr* tmp_file_mgr,
     int64_t block_size)
   : max_block_size_(block_size),
@@ -211,12 +250,14 @@ BufferedBlockMgr::BufferedBlockMgr(RuntimeState* state, TmpFileMgr* tmp_file_mgr
     initialized_(false),
     unfullfilled_reserved_buffers_(0),
     total_pinned_buffers_(0),
+    fragment_reserved_buffers_(0),
     non_local_outstanding_writes_(0),
     io_mgr_(state->io_mgr()),
     is_cancelled_(false),
     writes_issued_(0),
     encryption_(FLAGS_disk_spill_encryption),
-    check_integrity_(FLAGS_disk_spill_encryption) {
+    check_integrity_(FLAGS_disk_spill_encryption),
+    compression_type_(GetSpillCompressionType()) {
 }
 
 Status BufferedBlockMgr::Create(RuntimeState* state, MemTracker* parent,
@@ -241,6 +282,84 @@ Status BufferedBlockMgr::Create(RuntimeState* state, MemTracker* parent,
   return Status::OK();
 }
 
+/// A block mgr and its memory consumption.
+typedef std::pair<int64_t, shared_ptr<BufferedBlockMgr> > BlockMgrConsumption;
+
+/// Orders block mgrs by decreasing memory consumption.
+static bool LargerConsumption(const BlockMgrConsumption& a,
+    const BlockMgrConsumption& b) {
+  return a.first > b.first;
+}
+
+int64_t BufferedBlockMgr::ReclaimMemory(int64_t bytes_to_reclaim) {
+  if (bytes_to_reclaim <= 0) return 0;
+  vector<shared_ptr<BufferedBlockMgr> > block_mgrs;
+  {
+    lock_guard<SpinLock> lock(static_block_mgrs_lock_);
+    for (BlockMgrsMap::iterator it = query_to_block_mgrs_.begin();
+         it != query_to_block_mgrs_.end(); ++it) {
+      shared_ptr<BufferedBlockMgr> mgr = it->second.lock();
+      if (mgr != NULL) block_mgrs.push_back(mgr);
+    }
+  }
+
+  vector<BlockMgrConsumption> consumers;
+  for (int i = 0; i < block_mgrs.size(); ++i) {
+    BufferedBlockMgr* mgr = block_mgrs[i].get();
+    // Don't block: the thread that hit the limit may hold this lock.
+    unique_lock<mutex> l(mgr->lock_, boost::try_to_lock);
+    if (!l.owns_lock() || !mgr->initialized_) continue;
+    consumers.push_back(
+        BlockMgrConsumption(mgr->mem_tracker_->consumption(), block_mgrs[i]));
+  }
+  std::sort(consumers.begin(), consumers.end(), LargerConsumption);
+
+  int64_t bytes_reclaimed = 0;
+  for (int i = 0; i < consumers.size() && bytes_reclaimed < bytes_to_reclaim; ++i) {
+    bytes_reclaimed += consumers[i].second->ReleaseReclaimableBuffers();
+  }
+  if (bytes_reclaimed > 0) {
+    VLOG_QUERY << "Reclaimed " << PrettyPrinter::Print(bytes_reclaimed, TUnit::BYTES)
+               << " from the block mgrs of " << consumers.size() << " queries";
+  }
+  return bytes_reclaimed;
+}
+
+int64_t BufferedBlockMgr::ReleaseReclaimableBuffers() {
+  unique_lock<mutex> lock(lock_, boost::try_to_lock);
+  if (!lock.owns_lock() || !initialized_ || is_cancelled_) return 0;
+  int64_t bytes_released = 0;
+  while (!free_io_buffers_.empty()) {
+    // The buffer either has no block or belongs to an unpinned block that was written.
+    // That block will be read back from disk when it is pinned again.
+    BufferDescriptor* buffer_desc = free_io_buffers_.Dequeue();
+    all_io_buffers_.erase(buffer_desc->all_buffers_it);
+    if (buffer_desc->block != NULL) buffer_desc->block->buffer_desc_ = NULL;
+    FreeBuffer(buffer_desc->buffer, max_block_size_);
+    mem_tracker_->Release(buffer_desc->len);
+    bytes_released += buffer_desc->len;
+  }
+  bytes_reclaimed_counter_->Add(bytes_released);
+
+  // Spill the unpinned blocks, so that the next reclamation can free their buffers if
+  // the query hasn't reused them by then.
+  if (!disable_spill_) {
+    while (!unpinned_blocks_.empty()) {
+      Block* write_block = unpinned_blocks_.PopBack();
+      write_block->client_local_ = false;
+      Status status = WriteUnpinnedBlock(write_block);
+      if (!status.ok()) {
+        VLOG_QUERY << "Query: " << query_id_ << " write unpinned buffers failed: "
+                   << status.GetDetail();
+        break;
+      }
+      ++non_local_outstanding_writes_;
+    }
+  }
+  DCHECK(Validate()) << endl << DebugInternal();
+  return bytes_released;
+}
+
 int64_t BufferedBlockMgr::available_buffers(Client* client) const {
   int64_t unused_reserved = client->num_reserved_buffers_ +
       client->num_tmp_reserved_buffers_ - client->num_pinned_buffers_;
@@ -262,14 +381,47 @@ Status BufferedBlockMgr::RegisterClient(const string& debug_info,
   DCHECK_GE(num_reserved_buffers, 0);
   Client* aClient = new Client(debug_info, this, num_reserved_buffers,
       tolerates_oversubscription, tracker, state);
-  lock_guard<mutex> lock(lock_);
+  ProfiledLock<mutex> lock(lock_, &lock_site);
   *client = obj_pool_.Add(aClient);
   unfullfilled_reserved_buffers_ += num_reserved_buffers;
   return Status::OK();
 }
 
+Status BufferedBlockMgr::ReserveFragmentBuffers(int min_buffers, int desired_buffers,
+    int* reserved_buffers) {
+  DCHECK_GE(min_buffers, 0);
+  DCHECK_GE(desired_buffers, min_buffers);
+  ProfiledLock<mutex> lock(lock_, &lock_site);
+  int64_t limit_buffers = mem_tracker_->has_limit() ?
+      mem_tracker_->limit() / max_block_size() : std::numeric_limits<int>::max();
+  int64_t available = max<int64_t>(limit_buffers - fragment_reserved_buffers_, 0);
+  if (available < min_buffers) {
+    Status status = Status::MemLimitExceeded();
+    status.AddDetail(Substitute("The memory limit is set too low to run the spilling "
+        "operators of a fragment instance. They require at least $0 in total, but "
+        "only $1 is left after the reservations of other instances of the query.",
+        PrettyPrinter::Print(min_buffers * max_block_size(), TUnit::BYTES),
+        PrettyPrinter::Print(available * max_block_size(), TUnit::BYTES)));
+    return status;
+  }
+  *reserved_buffers = min<int64_t>(desired_buffers, available);
+  fragment_reserved_buffers_ += *reserved_buffers;
+  return Status::OK();
+}
+
+void BufferedBlockMgr::ReleaseFragmentBuffers(int num_buffers) {
+  ProfiledLock<mutex> lock(lock_, &lock_site);
+  fragment_reserved_buffers_ -= num_buffers;
+  DCHECK_GE(fragment_reserved_buffers_, 0);
+}
+
+void BufferedBlockMgr::SetClientWaitTimer(Client* client,
+    RuntimeProfile::Counter* timer) {
+  client->wait_timer_ = timer;
+}
+
 void BufferedBlockMgr::ClearReservations(Client* client) {
-  lock_guard<mutex> lock(lock_);
+  ProfiledLock<mutex> lock(lock_, &lock_site);
   // TODO: Can the modifications to the client's mem variables can be made w/o the lock?
   if (client->num_pinned_buffers_ < client->num_reserved_buffers_) {
     unfullfilled_reserved_buffers_ -=
@@ -282,7 +434,7 @@ void BufferedBlockMgr::ClearReservations(Client* client) {
 }
 
 bool BufferedBlockMgr::TryAcquireTmpReservation(Client* client, int num_buffers) {
-  lock_guard<mutex> lock(lock_);
+  ProfiledLock<mutex> lock(lock_, &lock_site);
   // TODO: Can the modifications to the client's mem variables can be made w/o the lock?
   DCHECK_EQ(client->num_tmp_reserved_buffers_, 0);
   if (client->num_pinned_buffers_ < client->num_reserved_buffers_) {
@@ -307,7 +459,7 @@ bool BufferedBlockMgr::ConsumeMemory(Client* client, int64_t size) {
   }
   int buffers_needed = BitUtil::Ceil(size, max_block_size());
   DCHECK_GT(buffers_needed, 0) << "Trying to consume 0 memory";
-  unique_lock<mutex> lock(lock_);
+  ProfiledLock<mutex> lock(lock_, &lock_site);
 
   if (size < max_block_size() && mem_tracker_->TryConsume(size)) {
     // For small allocations (less than a block size), just let the allocation through.
@@ -341,12 +493,16 @@ bool BufferedBlockMgr::ConsumeMemory(Client* client, int64_t size) {
   int buffers_acquired = 0;
   do {
     BufferDescriptor* buffer_desc = NULL;
-    Status s = FindBuffer(lock, &buffer_desc); // This waits on the lock.
+    Status s;
+    {
+      SCOPED_TIMER(client->wait_timer_);
+      s = FindBuffer(lock, &buffer_desc); // This waits on the lock.
+    }
     if (buffer_desc == NULL) break;
     DCHECK(s.ok());
     all_io_buffers_.erase(buffer_desc->all_buffers_it);
     if (buffer_desc->block != NULL) buffer_desc->block->buffer_desc_ = NULL;
-    delete[] buffer_desc->buffer;
+    FreeBuffer(buffer_desc->buffer, max_block_size_);
     ++buffers_acquired;
   } while (buffers_acquired != buffers_needed);
 
@@ -383,7 +539,7 @@ void BufferedBlockMgr::ReleaseMemory(Client* client, int64_t size) {
 
 void BufferedBlockMgr::Cancel() {
   {
-    lock_guard<mutex> lock(lock_);
+    ProfiledLock<mutex> lock(lock_, &lock_site);
     if (is_cancelled_) return;
     is_cancelled_ = true;
   }
@@ -392,7 +548,7 @@ void BufferedBlockMgr::Cancel() {
 }
 
 bool BufferedBlockMgr::IsCancelled() {
-  lock_guard<mutex> lock(lock_);
+  ProfiledLock<mutex> lock(lock_, &lock_site);
   return is_cancelled_;
 }
 
@@ -418,7 +574,7 @@ Status BufferedBlockMgr::GetNewBlock(Client* client, Block* unpin_block, Block**
   Status status;
 
   {
-    lock_guard<mutex> lock(lock_);
+    ProfiledLock<mutex> lock(lock_, &lock_site);
     if (is_cancelled_) return Status::CANCELLED;
     new_block = GetUnusedBlock(client);
     DCHECK(new_block->Validate()) << endl << new_block->DebugString();
@@ -428,8 +584,7 @@ Status BufferedBlockMgr::GetNewBlock(Client* client, Block* unpin_block, Block**
     if (len > 0 && len < max_block_size_) {
       DCHECK(unpin_block == NULL);
       if (client->tracker_->TryConsume(len)) {
-        // TODO: Have a cache of unused blocks of size 'len' (0, max_block_size_)
-        uint8_t* buffer = new uint8_t[len];
+        uint8_t* buffer = AllocateBuffer(len);
         // Descriptors for non-I/O sized buffers are deleted when the block is deleted.
         new_block->buffer_desc_ = new BufferDescriptor(buffer, len);
         new_block->buffer_desc_->block = new_block;
@@ -483,7 +638,7 @@ Status BufferedBlockMgr::TransferBuffer(Block* dst, Block* src, bool unpin) {
   Status status = Status::OK();
   DCHECK(dst != NULL);
   DCHECK(src != NULL);
-  unique_lock<mutex> lock(lock_);
+  ProfiledLock<mutex> lock(lock_, &lock_site);
 
   // First write out the src block.
   DCHECK(src->is_pinned_);
@@ -501,6 +656,7 @@ Status BufferedBlockMgr::TransferBuffer(Block* dst, Block* src, bool unpin) {
       return status;
     }
     // Wait for the write to complete.
+    SCOPED_TIMER(src->client_->wait_timer_);
     while (src->in_write_ && !is_cancelled_) {
       src->write_complete_cv_.wait(lock);
     }
@@ -550,9 +706,10 @@ BufferedBlockMgr::~BufferedBlockMgr() {
   // WriteComplete() callback gets executed it is going to access invalid memory.
   // See IMPALA-1890.
   DCHECK_EQ(non_local_outstanding_writes_, 0) << endl << DebugInternal();
-  // Delete tmp files.
+  // Delete tmp files. Unlinking large files can take a while, so it is done in the
+  // background to not delay the teardown of the query.
   BOOST_FOREACH(TmpFileMgr::File& file, tmp_files_) {
-    file.Remove();
+    file.RemoveAsync();
   }
   tmp_files_.clear();
 
@@ -567,7 +724,7 @@ BufferedBlockMgr::~BufferedBlockMgr() {
   // Free memory resources.
   BOOST_FOREACH(BufferDescriptor* buffer, all_io_buffers_) {
     mem_tracker_->Release(buffer->len);
-    delete[] buffer->buffer;
+    FreeBuffer(buffer->buffer, max_block_size_);
   }
   DCHECK_EQ(mem_tracker_->consumption(), 0);
   mem_tracker_->UnregisterFromParent();
@@ -609,6 +766,9 @@ Status BufferedBlockMgr::PinBlock(Block* block, bool* pinned, Block* release_blo
   DCHECK(block != NULL);
   DCHECK(!block->is_deleted_);
   Status status;
+  // Compressed blocks are read into this buffer and decompressed into the block's buffer.
+  boost::scoped_array<uint8_t> compressed_buffer;
+  uint8_t* read_buffer = NULL;
   *pinned = false;
   if (block->is_pinned_) {
     *pinned = true;
@@ -630,7 +790,7 @@ Status BufferedBlockMgr::PinBlock(Block* block, bool* pinned, Block* release_blo
 
     if (block->buffer_desc_ != NULL) {
       {
-        lock_guard<mutex> lock(lock_);
+        ProfiledLock<mutex> lock(lock_, &lock_site);
         if (free_io_buffers_.Contains(block->buffer_desc_)) {
           DCHECK(!block->is_pinned_ && !block->in_write_ &&
                  !unpinned_blocks_.Contains(block)) << endl << block->DebugString();
@@ -660,9 +820,16 @@ Status BufferedBlockMgr::PinBlock(Block* block, bool* pinned, Block* release_blo
 
   DCHECK(block->write_range_ != NULL) << block->DebugString() << endl << release_block;
 
+  read_buffer = block->buffer();
+  if (block->is_compressed_) {
+    compressed_buffer.reset(new uint8_t[block->write_range_->len()]);
+    read_buffer = compressed_buffer.get();
+  }
+
   {
     // Read the block from disk if it was not in memory.
     SCOPED_TIMER(disk_read_timer_);
+    SCOPED_TIMER(block->client_->wait_timer_);
     // Create a ScanRange to perform the read.
     DiskIoMgr::ScanRange* scan_range =
         obj_pool_.Add(new DiskIoMgr::ScanRange());
@@ -680,7 +847,7 @@ Status BufferedBlockMgr::PinBlock(Block* block, bool* pinned, Block* release_blo
       DiskIoMgr::BufferDescriptor* io_mgr_buffer;
       status = scan_range->GetNext(&io_mgr_buffer);
       if (!status.ok()) goto error;
-      memcpy(block->buffer() + offset, io_mgr_buffer->buffer(), io_mgr_buffer->len());
+      memcpy(read_buffer + offset, io_mgr_buffer->buffer(), io_mgr_buffer->len());
       offset += io_mgr_buffer->len();
       buffer_eosr = io_mgr_buffer->eosr();
       io_mgr_buffer->Return();
@@ -690,13 +857,18 @@ Status BufferedBlockMgr::PinBlock(Block* block, bool* pinned, Block* release_blo
 
   // Verify integrity first, because the hash was generated from encrypted data.
   if (check_integrity_) {
-    status = VerifyHash(block);
+    status = VerifyHash(block, read_buffer, block->write_range_->len());
     if (!status.ok()) goto error;
   }
 
   // Decryption is done in-place, since the buffer can't be accessed by anyone else.
   if (encryption_) {
-    status = Decrypt(block);
+    status = Decrypt(block, read_buffer, block->write_range_->len());
+    if (!status.ok()) goto error;
+  }
+
+  if (block->is_compressed_) {
+    status = Decompress(block, read_buffer, block->write_range_->len());
     if (!status.ok()) goto error;
   }
 
@@ -712,7 +884,7 @@ error:
 Status BufferedBlockMgr::UnpinBlock(Block* block) {
   DCHECK(!block->is_deleted_) << "Unpin for deleted block.";
 
-  lock_guard<mutex> unpinned_lock(lock_);
+  ProfiledLock<mutex> unpinned_lock(lock_, &lock_site);
   if (is_cancelled_) return Status::CANCELLED;
   DCHECK(block->Validate()) << endl << block->DebugString();
   if (!block->is_pinned_) return Status::OK();
@@ -777,25 +949,31 @@ Status BufferedBlockMgr::WriteUnpinnedBlock(Block* block) {
     block->tmp_file_ = tmp_file;
   }
 
-  uint8_t* outbuf = NULL;
+  uint8_t* outbuf = block->buffer();
+  int64_t len = block->valid_data_len_;
+  block->is_compressed_ = false;
+  if (compressor_.get() != NULL) RETURN_IF_ERROR(Compress(block, &outbuf, &len));
   if (encryption_) {
     // The block->buffer() could be accessed during the write path, so we have to
     // make a copy of it while writing.
-    RETURN_IF_ERROR(Encrypt(block, &outbuf));
-  } else {
-    outbuf = block->buffer();
+    RETURN_IF_ERROR(Encrypt(block, outbuf, len, &outbuf));
+    // The compressed data was copied into the encrypted buffer, it is no longer needed.
+    block->compressed_write_buffer_.reset();
   }
 
-  if (check_integrity_) SetHash(block);
+  if (check_integrity_) SetHash(block, outbuf, len);
 
-  block->write_range_->SetData(outbuf, block->valid_data_len_);
+  block->write_range_->SetData(outbuf, len);
 
   // Issue write through DiskIoMgr.
+  block->write_issue_time_ns_ = MonotonicNanos();
   RETURN_IF_ERROR(io_mgr_->AddWriteRange(io_request_context_, block->write_range_));
+  block->tmp_file_->WriteIssued();
   block->in_write_ = true;
   DCHECK(block->Validate()) << endl << block->DebugString();
   outstanding_writes_counter_->Add(1);
-  bytes_written_counter_->Add(block->valid_data_len_);
+  bytes_written_counter_->Add(len);
+  uncompressed_bytes_written_counter_->Add(block->valid_data_len_);
   ++writes_issued_;
   if (writes_issued_ == 1) {
     if (ImpaladMetrics::NUM_QUERIES_SPILLED != NULL) {
@@ -809,11 +987,25 @@ Status BufferedBlockMgr::AllocateScratchSpace(int64_t block_size,
     TmpFileMgr::File** tmp_file, int64_t* file_offset) {
   // Assumes block manager lock is already taken.
   vector<Status> errs;
-  // Find the next physical file in round-robin order and create a write range for it.
+  vector<bool> tried(tmp_files_.size(), false);
   for (int attempt = 0; attempt < tmp_files_.size(); ++attempt) {
-    *tmp_file = &tmp_files_[next_block_index_];
-    next_block_index_ = (next_block_index_ + 1) % tmp_files_.size();
-    if ((*tmp_file)->is_blacklisted()) continue;
+    // Pick the usable file whose device is expected to finish the write first. Scan
+    // from next_block_index_ so that ties are broken round-robin.
+    int best_idx = -1;
+    int64_t best_write_time = 0;
+    for (int i = 0; i < tmp_files_.size(); ++i) {
+      int idx = (next_block_index_ + i) % tmp_files_.size();
+      if (tried[idx] || tmp_files_[idx].is_blacklisted()) continue;
+      int64_t write_time = tmp_files_[idx].EstimateWriteTimeNs(block_size);
+      if (best_idx == -1 || write_time < best_write_time) {
+        best_idx = idx;
+        best_write_time = write_time;
+      }
+    }
+    if (best_idx == -1) break;
+    tried[best_idx] = true;
+    next_block_index_ = (best_idx + 1) % tmp_files_.size();
+    *tmp_file = &tmp_files_[best_idx];
     Status status = (*tmp_file)->AllocateSpace(max_block_size_, file_offset);
     if (status.ok()) return Status::OK();
     // Log error and try other files if there was a problem. Problematic files will be
@@ -832,7 +1024,7 @@ Status BufferedBlockMgr::AllocateScratchSpace(int64_t block_size,
 
 void BufferedBlockMgr::WriteComplete(Block* block, const Status& write_status) {
   Status status = Status::OK();
-  lock_guard<mutex> lock(lock_);
+  ProfiledLock<mutex> lock(lock_, &lock_site);
   outstanding_writes_counter_->Add(-1);
   DCHECK(Validate()) << endl << DebugInternal();
   DCHECK(is_cancelled_ || block->in_write_) << "WriteComplete() for block not in write."
@@ -842,10 +1034,13 @@ void BufferedBlockMgr::WriteComplete(Block* block, const Status& write_status) {
     --non_local_outstanding_writes_;
   }
   block->in_write_ = false;
+  block->tmp_file_->WriteComplete(block->write_range_->len(),
+      block->write_issue_time_ns_, write_status.ok());
 
   // Explicitly release our temporarily allocated buffer here so that it doesn't
   // hang around needlessly.
   if (encryption_) EncryptDone(block);
+  block->compressed_write_buffer_.reset();
 
   // ReturnUnusedBlock() will clear the block, so save required state in local vars.
   // state is not valid if the block was deleted because the state may be torn down
@@ -910,10 +1105,37 @@ void BufferedBlockMgr::WriteComplete(Block* block, const Status& write_status) {
 }
 
 void BufferedBlockMgr::DeleteBlock(Block* block) {
-  unique_lock<mutex> lock(lock_);
+  ProfiledLock<mutex> lock(lock_, &lock_site);
   DeleteBlockLocked(lock, block);
 }
 
+void BufferedBlockMgr::ReadAheadBlock(Block* block) {
+  string path;
+  int64_t offset;
+  int64_t len;
+  {
+    ProfiledLock<mutex> lock(lock_, &lock_site);
+    DCHECK(!block->is_deleted_);
+    // Nothing to do if the block's buffer still holds the data or if the block was
+    // never written.
+    if (is_cancelled_ || block->is_pinned_ || block->in_write_ ||
+        block->buffer_desc_ != NULL || block->valid_data_len_ == 0) {
+      return;
+    }
+    DCHECK(block->write_range_ != NULL);
+    path = block->write_range_->file();
+    offset = block->write_range_->offset();
+    len = block->write_range_->len();
+  }
+
+  // This is only a hint, errors are ignored and will be reported by the Pin() call.
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) return;
+  posix_fadvise(fd, offset, len, POSIX_FADV_WILLNEED);
+  close(fd);
+  read_ahead_counter_->Add(1);
+}
+
 void BufferedBlockMgr::DeleteBlockLocked(const unique_lock<mutex>& lock, Block* block) {
   DCHECK(lock.mutex() == &lock_ && lock.owns_lock());
   DCHECK(block->Validate()) << endl << DebugInternal();
@@ -943,7 +1165,7 @@ void BufferedBlockMgr::DeleteBlockLocked(const unique_lock<mutex>& lock, Block*
   if (block->buffer_desc_ != NULL) {
     if (block->buffer_desc_->len != max_block_size_) {
       // Just delete the block for now.
-      delete[] block->buffer_desc_->buffer;
+      FreeBuffer(block->buffer_desc_->buffer, block->buffer_desc_->len);
       block->client_->tracker_->Release(block->buffer_desc_->len);
       delete block->buffer_desc_;
       block->buffer_desc_ = NULL;
@@ -977,7 +1199,7 @@ Status BufferedBlockMgr::FindBufferForBlock(Block* block, bool* in_mem) {
       << "Pinned or deleted block " << endl << block->DebugString();
   *in_mem = false;
 
-  unique_lock<mutex> l(lock_);
+  ProfiledLock<mutex> l(lock_, &lock_site);
   if (is_cancelled_) return Status::CANCELLED;
 
   // First check if there is enough reserved memory to satisfy this request.
@@ -1023,7 +1245,10 @@ Status BufferedBlockMgr::FindBufferForBlock(Block* block, bool* in_mem) {
     *in_mem = true;
   } else {
     BufferDescriptor* buffer_desc = NULL;
-    RETURN_IF_ERROR(FindBuffer(l, &buffer_desc));
+    {
+      SCOPED_TIMER(block->client_->wait_timer_);
+      RETURN_IF_ERROR(FindBuffer(l, &buffer_desc));
+    }
 
     if (buffer_desc == NULL) {
       // There are no free buffers or blocks we can evict. We need to fail this request.
@@ -1083,7 +1308,7 @@ Status BufferedBlockMgr::FindBuffer(unique_lock<mutex>& lock,
   DCHECK(block_write_threshold_ > 0 || disable_spill_);
   if ((free_io_buffers_.size() < block_write_threshold_ || disable_spill_) &&
       mem_tracker_->TryConsume(max_block_size_)) {
-    uint8_t* new_buffer = new uint8_t[max_block_size_];
+    uint8_t* new_buffer = AllocateBuffer(max_block_size_);
     *buffer_desc = obj_pool_.Add(new BufferDescriptor(new_buffer, max_block_size_));
     (*buffer_desc)->all_buffers_it = all_io_buffers_.insert(
         all_io_buffers_.end(), *buffer_desc);
@@ -1125,6 +1350,28 @@ Status BufferedBlockMgr::FindBuffer(unique_lock<mutex>& lock,
   return Status::OK();
 }
 
+uint8_t* BufferedBlockMgr::AllocateBuffer(int64_t len) {
+  BufferPool* pool = GetBufferPool(len);
+  if (pool == NULL) return new uint8_t[len];
+  return pool->Allocate(len);
+}
+
+void BufferedBlockMgr::FreeBuffer(uint8_t* buffer, int64_t len) {
+  BufferPool* pool = GetBufferPool(len);
+  if (pool == NULL) {
+    delete[] buffer;
+  } else {
+    pool->Free(buffer, len);
+  }
+}
+
+BufferPool* BufferedBlockMgr::GetBufferPool(int64_t len) {
+  BufferPool* pool = io_mgr_->buffer_pool();
+  // The pool rounds other sizes up, which would allocate more than is tracked.
+  if (pool == NULL || pool->BufferSize(len) != len) return NULL;
+  return pool;
+}
+
 BufferedBlockMgr::Block* BufferedBlockMgr::GetUnusedBlock(Client* client) {
   DCHECK(client != NULL);
   Block* new_block = NULL;
@@ -1237,7 +1484,7 @@ bool BufferedBlockMgr::Validate() const {
 
 string BufferedBlockMgr::DebugString(Client* client) {
   stringstream ss;
-  unique_lock<mutex> l(lock_);
+  ProfiledLock<mutex> l(lock_, &lock_site);
   ss <<  DebugInternal();
   if (client != NULL) ss << endl << client->DebugString();
   return ss.str();
@@ -1260,7 +1507,7 @@ string BufferedBlockMgr::DebugInternal() const {
 
 void BufferedBlockMgr::Init(DiskIoMgr* io_mgr, RuntimeProfile* parent_profile,
     MemTracker* parent_tracker, int64_t mem_limit) {
-  unique_lock<mutex> l(lock_);
+  ProfiledLock<mutex> l(lock_, &lock_site);
   if (initialized_) return;
 
   io_mgr->RegisterContext(&io_request_context_);
@@ -1285,10 +1532,28 @@ void BufferedBlockMgr::Init(DiskIoMgr* io_mgr, RuntimeProfile* parent_profile,
   outstanding_writes_counter_ =
       ADD_COUNTER(profile_.get(), "BlockWritesOutstanding", TUnit::UNIT);
   buffered_pin_counter_ = ADD_COUNTER(profile_.get(), "BufferedPins", TUnit::UNIT);
+  read_ahead_counter_ = ADD_COUNTER(profile_.get(), "ReadAheadBlocks", TUnit::UNIT);
   disk_read_timer_ = ADD_TIMER(profile_.get(), "TotalReadBlockTime");
   buffer_wait_timer_ = ADD_TIMER(profile_.get(), "TotalBufferWaitTime");
   encryption_timer_ = ADD_TIMER(profile_.get(), "TotalEncryptionTime");
   integrity_check_timer_ = ADD_TIMER(profile_.get(), "TotalIntegrityCheckTime");
+  bytes_reclaimed_counter_ = ADD_COUNTER(profile_.get(), "BytesReclaimed", TUnit::BYTES);
+  compression_timer_ = ADD_TIMER(profile_.get(), "TotalCompressionTime");
+  uncompressed_bytes_written_counter_ =
+      ADD_COUNTER(profile_.get(), "UncompressedBytesWritten", TUnit::BYTES);
+
+  if (compression_type_ != THdfsCompression::NONE) {
+    Status status = Codec::CreateCompressor(NULL, false, compression_type_, &compressor_);
+    if (status.ok()) {
+      status = Codec::CreateDecompressor(NULL, false, compression_type_, &decompressor_);
+    }
+    if (!status.ok()) {
+      LOG(WARNING) << "Could not create the spill compression codec, spilled blocks will "
+                   << "not be compressed: " << status.GetDetail();
+      compressor_.reset();
+      decompressor_.reset();
+    }
+  }
 
   // Create a new mem_tracker and allocate buffers.
   mem_tracker_.reset(new MemTracker(
@@ -1336,9 +1601,46 @@ static Status OpenSSLErr(const string& msg) {
   return Status(Substitute("Openssl Error: $0", errstream.str()));
 }
 
-Status BufferedBlockMgr::Encrypt(Block* block, uint8_t** outbuf) {
+Status BufferedBlockMgr::Compress(Block* block, uint8_t** outbuf, int64_t* len) {
+  DCHECK(compressor_.get() != NULL);
+  DCHECK(!block->is_pinned_);
+  DCHECK(!block->in_write_);
+  SCOPED_TIMER(compression_timer_);
+  int64_t max_compressed_len = compressor_->MaxOutputLen(block->valid_data_len_);
+  block->compressed_write_buffer_.reset(new uint8_t[max_compressed_len]);
+  uint8_t* compressed_data = block->compressed_write_buffer_.get();
+  int64_t compressed_len = max_compressed_len;
+  RETURN_IF_ERROR(compressor_->ProcessBlock(true, block->valid_data_len_,
+      block->buffer(), &compressed_len, &compressed_data));
+  if (compressed_len >= block->valid_data_len_) {
+    // Not worth it, write the block as is.
+    block->compressed_write_buffer_.reset();
+    return Status::OK();
+  }
+  block->is_compressed_ = true;
+  *outbuf = compressed_data;
+  *len = compressed_len;
+  return Status::OK();
+}
+
+Status BufferedBlockMgr::Decompress(Block* block, const uint8_t* data, int64_t len) {
+  DCHECK(decompressor_.get() != NULL);
+  DCHECK(block->is_compressed_);
+  SCOPED_TIMER(compression_timer_);
+  uint8_t* output = block->buffer();
+  int64_t output_len = block->valid_data_len_;
+  RETURN_IF_ERROR(decompressor_->ProcessBlock(true, len, data, &output_len, &output));
+  if (output_len != block->valid_data_len_) {
+    return Status(Substitute("Spilled block decompressed to $0 bytes, expected $1",
+        output_len, block->valid_data_len_));
+  }
+  return Status::OK();
+}
+
+Status BufferedBlockMgr::Encrypt(Block* block, const uint8_t* data, int64_t len,
+    uint8_t** outbuf) {
   DCHECK(encryption_);
-  DCHECK(block->buffer());
+  DCHECK(data);
   DCHECK(!block->is_pinned_);
   DCHECK(!block->in_write_);
   DCHECK(outbuf);
@@ -1349,10 +1651,10 @@ Status BufferedBlockMgr::Encrypt(Block* block, uint8_t** outbuf) {
   // writes of the same Block.
   RAND_bytes(block->key_, sizeof(block->key_));
   RAND_bytes(block->iv_, sizeof(block->iv_));
-  block->encrypted_write_buffer_.reset(new uint8_t[block->valid_data_len_]);
+  block->encrypted_write_buffer_.reset(new uint8_t[len]);
 
   EVP_CIPHER_CTX ctx;
-  int len = static_cast<int>(block->valid_data_len_);
+  int cipher_len = static_cast<int>(len);
 
   // Create and initialize the context for encryption
   EVP_CIPHER_CTX_init(&ctx);
@@ -1365,22 +1667,23 @@ Status BufferedBlockMgr::Encrypt(Block* block, uint8_t** outbuf) {
     return OpenSSLErr("EVP_EncryptInit_ex failure");
   }
 
-  // Encrypt block->buffer() into the new encrypted_write_buffer_
-  if (EVP_EncryptUpdate(&ctx, block->encrypted_write_buffer_.get(), &len,
-        block->buffer(), len) != 1) {
+  // Encrypt 'data' into the new encrypted_write_buffer_
+  if (EVP_EncryptUpdate(&ctx, block->encrypted_write_buffer_.get(), &cipher_len,
+        data, cipher_len) != 1) {
     return OpenSSLErr("EVP_EncryptUpdate failure");
   }
 
   // This is safe because we're using CFB mode without padding.
-  DCHECK_EQ(len, block->valid_data_len_);
+  DCHECK_EQ(cipher_len, len);
 
   // Finalize encryption.
-  if (1 != EVP_EncryptFinal_ex(&ctx, block->encrypted_write_buffer_.get() + len, &len)) {
+  if (1 != EVP_EncryptFinal_ex(&ctx, block->encrypted_write_buffer_.get() + cipher_len,
+        &cipher_len)) {
     return OpenSSLErr("EVP_EncryptFinal failure");
   }
 
   // Again safe due to CFB with no padding
-  DCHECK_EQ(len, 0);
+  DCHECK_EQ(cipher_len, 0);
 
   *outbuf = block->encrypted_write_buffer_.get();
   return Status::OK();
@@ -1392,13 +1695,13 @@ void BufferedBlockMgr::EncryptDone(Block* block) {
   block->encrypted_write_buffer_.reset();
 }
 
-Status BufferedBlockMgr::Decrypt(Block* block) {
+Status BufferedBlockMgr::Decrypt(Block* block, uint8_t* data, int64_t len) {
   DCHECK(encryption_);
-  DCHECK(block->buffer());
+  DCHECK(data);
   SCOPED_TIMER(encryption_timer_);
 
   EVP_CIPHER_CTX ctx;
-  int len = static_cast<int>(block->valid_data_len_);
+  int cipher_len = static_cast<int>(len);
 
   // Create and initialize the context for encryption
   EVP_CIPHER_CTX_init(&ctx);
@@ -1409,46 +1712,39 @@ Status BufferedBlockMgr::Decrypt(Block* block) {
     return OpenSSLErr("EVP_DecryptInit_ex failure");
   }
 
-  // Decrypt block->buffer() in-place.  Safe because no one is accessing it.
-  if (EVP_DecryptUpdate(&ctx, block->buffer(), &len, block->buffer(), len) != 1) {
+  // Decrypt 'data' in-place.  Safe because no one is accessing it.
+  if (EVP_DecryptUpdate(&ctx, data, &cipher_len, data, cipher_len) != 1) {
     return OpenSSLErr("EVP_DecryptUpdate failure");
   }
 
   // This is safe because we're using CFB mode without padding.
-  DCHECK_EQ(len, block->valid_data_len_);
+  DCHECK_EQ(cipher_len, len);
 
   // Finalize decryption.
-  if (1 != EVP_DecryptFinal_ex(&ctx, block->buffer() + len, &len)) {
+  if (1 != EVP_DecryptFinal_ex(&ctx, data + cipher_len, &cipher_len)) {
     return OpenSSLErr("EVP_DecryptFinal failure");
   }
 
   // Again safe due to CFB with no padding
-  DCHECK_EQ(len, 0);
+  DCHECK_EQ(cipher_len, 0);
 
   return Status::OK();
 }
 
-void BufferedBlockMgr::SetHash(Block* block) {
+void BufferedBlockMgr::SetHash(Block* block, const uint8_t* data, int64_t len) {
   DCHECK(check_integrity_);
+  DCHECK(data);
   SCOPED_TIMER(integrity_check_timer_);
-  uint8_t* data = NULL;
-  if (encryption_) {
-    DCHECK(block->encrypted_write_buffer_.get());
-    data = block->encrypted_write_buffer_.get();
-  } else {
-    DCHECK(block->buffer());
-    data = block->buffer();
-  }
   // Explicitly ignore the return value from SHA256(); it can't fail.
-  (void) SHA256(data, block->valid_data_len_, block->hash_);
+  (void) SHA256(data, len, block->hash_);
 }
 
-Status BufferedBlockMgr::VerifyHash(Block* block) {
+Status BufferedBlockMgr::VerifyHash(Block* block, const uint8_t* data, int64_t len) {
   DCHECK(check_integrity_);
-  DCHECK(block->buffer());
+  DCHECK(data);
   SCOPED_TIMER(integrity_check_timer_);
   uint8_t test_hash[SHA256_DIGEST_LENGTH];
-  (void) SHA256(block->buffer(), block->valid_data_len_, test_hash);
+  (void) SHA256(data, len, test_hash);
   if (memcmp(test_hash, block->hash_, SHA256_DIGEST_LENGTH) != 0) {
     return Status("Block verification failure");
   }
@@ -15,16 +15,20 @@
 #ifndef IMPALA_RUNTIME_BUFFERED_BLOCK_MGR
 #define IMPALA_RUNTIME_BUFFERED_BLOCK_MGR
 
+#include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include "runtime/disk-io-mgr.h"
 #include "runtime/tmp-file-mgr.h"
+#include "gen-cpp/CatalogObjects_types.h"
 
 #include <openssl/aes.h>
 #include <openssl/sha.h>
 
 namespace impala {
 
+class BufferPool;
+class Codec;
 class RuntimeState;
 
 /// The BufferedBlockMgr is used to allocate and manage blocks of data using a fixed memory
@@ -156,6 +160,12 @@ class BufferedBlockMgr {
     /// Non-blocking.
     void Delete();
 
+    /// Hints that this block will be pinned soon. If the block's data is only on disk,
+    /// asks the OS to start reading it into the page cache so that a later Pin() does
+    /// not wait for the disk. Does not use a buffer and does not change the block's
+    /// state. Non-blocking.
+    void ReadAhead();
+
     void AddRow() { ++num_rows_; }
     int num_rows() const { return num_rows_; }
 
@@ -246,12 +256,24 @@ class BufferedBlockMgr {
     /// and offset in write_range_. The File is owned by BufferedBlockMgr, not TmpFileMgr.
     TmpFileMgr::File* tmp_file_;
 
+    /// MonotonicNanos() time at which the current write was issued. Only valid while
+    /// in_write_ is true.
+    int64_t write_issue_time_ns_;
+
     /// Length of valid (i.e. allocated) data within the block.
     int64_t valid_data_len_;
 
     /// Number of rows in this block.
     int num_rows_;
 
+    /// If compression is on, in the write path we allocate a new buffer to hold
+    /// compressed data while it's being written to disk, or until it is encrypted.
+    boost::scoped_array<uint8_t> compressed_write_buffer_;
+
+    /// True if the last write of this block was compressed. Blocks that don't compress
+    /// are written as is. The length on disk is the length of write_range_.
+    bool is_compressed_;
+
     /// If encryption_ is on, in the write path we allocate a new buffer to hold
     /// encrypted data while it's being written to disk.  The read path, having no
     /// references to the data, can be decrypted in place.
@@ -309,6 +331,18 @@ class BufferedBlockMgr {
 
   ~BufferedBlockMgr();
 
+  /// Arbitrates memory between queries when the process memory limit is hit: frees
+  /// memory held by the block mgrs of all queries, largest consumers first, until at
+  /// least 'bytes_to_reclaim' bytes were freed or none is left to reclaim. Returns the
+  /// number of bytes freed.
+  /// Only memory that no client is using is reclaimed: free buffers, including the
+  /// buffers of unpinned blocks that were already written. Writes are started for the
+  /// other unpinned blocks so that their buffers can be reclaimed once the writes
+  /// complete. Pinned blocks are never taken away from their clients.
+  /// Block mgrs whose lock is held, e.g. by the thread that hit the limit, are skipped.
+  /// The freed buffers are returned to the buffer pool, if there is one.
+  static int64_t ReclaimMemory(int64_t bytes_to_reclaim);
+
   /// Registers a client with num_reserved_buffers. The returned client is owned
   /// by the BufferedBlockMgr and has the same lifetime as it.
   /// We allow oversubscribing the reserved buffers. It is likely that the
@@ -331,6 +365,27 @@ class BufferedBlockMgr {
   /// Clears all reservations for this client.
   void ClearReservations(Client* client);
 
+  /// Sets the timer to which the time the client waits for its blocks to be read from
+  /// or written to disk, or for buffers to be freed by writes, is added. 'timer' is
+  /// owned by the caller and may be NULL.
+  void SetClientWaitTimer(Client* client, RuntimeProfile::Counter* timer);
+
+  /// Negotiates the buffers of a fragment instance up front, rather than leaving its
+  /// operators to discover mid-execution that they can't get their minimum. The
+  /// instance needs 'min_buffers' to run and would like 'desired_buffers'. The buffers
+  /// reserved so far by the other instances of the query that use this block mgr are
+  /// subtracted from its limit. If the rest can't hold 'min_buffers', returns a
+  /// MEM_LIMIT_EXCEEDED error. Otherwise reserves between 'min_buffers' and
+  /// 'desired_buffers' buffers, as many as are left, and returns that number in
+  /// 'reserved_buffers'. The operators still grow past the reservation into spare
+  /// capacity at runtime. The reservation must be released with
+  /// ReleaseFragmentBuffers() when the instance is done.
+  Status ReserveFragmentBuffers(int min_buffers, int desired_buffers,
+      int* reserved_buffers);
+
+  /// Releases 'num_buffers' reserved by ReserveFragmentBuffers().
+  void ReleaseFragmentBuffers(int num_buffers);
+
   /// Tries to acquire a one-time reservation of num_buffers. The semantics are:
   ///  - If this call fails, the next 'num_buffers' calls to Pin()/GetNewBlock() might
   ///    not have enough memory.
@@ -344,7 +399,9 @@ class BufferedBlockMgr {
   /// Return a new pinned block. If there is no memory for this block, *block will be set
   /// to NULL.
   /// If len > 0, GetNewBlock() will return a block with a buffer of size len. len
-  /// must be less than max_block_size and this block cannot be unpinned.
+  /// must be less than max_block_size and this block cannot be unpinned. Callers should
+  /// use power-of-two sizes of at least 64KB (the size classes of the buffer pool), whose
+  /// buffers are recycled through the process-wide buffer pool rather than the heap.
   /// This function will try to allocate new memory for the block up to the limit.
   /// Otherwise it will (conceptually) write out an unpinned block and use that memory.
   /// The caller can pass a non-NULL 'unpin_block' to transfer memory from 'unpin_block'
@@ -400,6 +457,7 @@ class BufferedBlockMgr {
   MemTracker* get_tracker(Client* client) const;
   int64_t max_block_size() const { return max_block_size_; }
   int64_t bytes_allocated() const;
+  int64_t bytes_written() const { return bytes_written_counter_->value(); }
   RuntimeProfile* profile() { return profile_.get(); }
   int writes_issued() const { return writes_issued_; }
 
@@ -443,6 +501,9 @@ class BufferedBlockMgr {
   void DeleteBlock(Block* block);
   void DeleteBlockLocked(const boost::unique_lock<boost::mutex>& lock, Block* block);
 
+  /// Performs the work of Block::ReadAhead(). Must be called without the lock_ taken.
+  void ReadAheadBlock(Block* block);
+
   /// If the 'block' is NULL, checks if cancelled and returns. Otherwise, depending on
   /// 'unpin' calls either  DeleteBlock() or UnpinBlock(), which both first check for
   /// cancellation. It should be called without the lock_ acquired.
@@ -479,6 +540,20 @@ class BufferedBlockMgr {
   /// Must be called with the lock_ already taken. This function can block.
   Status FindBuffer(boost::unique_lock<boost::mutex>& lock, BufferDescriptor** buffer);
 
+  /// Allocates and frees block buffers of 'len' bytes. They come from the buffer pool of
+  /// io_mgr_, which is shared with the other queries, if it caches buffers of that size.
+  uint8_t* AllocateBuffer(int64_t len);
+  void FreeBuffer(uint8_t* buffer, int64_t len);
+
+  /// Returns the buffer pool of io_mgr_ if buffers of 'len' bytes can be allocated from
+  /// it, NULL otherwise.
+  BufferPool* GetBufferPool(int64_t len);
+
+  /// Frees all free buffers and starts writing all unpinned blocks. Returns the number
+  /// of bytes freed. Does nothing if lock_ can't be taken without blocking.
+  /// Called by ReclaimMemory().
+  int64_t ReleaseReclaimableBuffers();
+
   /// Writes unpinned blocks via DiskIoMgr until one of the following is true:
   ///   1. The number of outstanding writes >= (block_write_threshold_ - num free buffers)
   ///   2. There are no more unpinned blocks
@@ -550,6 +625,9 @@ class BufferedBlockMgr {
   /// The total number of pinned buffers across all clients.
   int total_pinned_buffers_;
 
+  /// The total number of buffers reserved by ReserveFragmentBuffers().
+  int fragment_reserved_buffers_;
+
   /// Number of outstanding writes (Writes issued but not completed).
   /// This does not include client-local writes.
   int non_local_outstanding_writes_;
@@ -583,11 +661,13 @@ class BufferedBlockMgr {
   std::list<BufferDescriptor*> all_io_buffers_;
 
   /// Temporary physical file handle, (one per tmp device) to which blocks may be written.
-  /// Blocks are round-robined across these files.
+  /// Each block goes to the file whose device is expected to complete the write first,
+  /// based on the device's outstanding writes (from all queries) and observed
+  /// throughput. Ties are broken round-robin.
   boost::ptr_vector<TmpFileMgr::File> tmp_files_;
 
-  /// Index into tmp_files_ denoting the file to which the next block to be persisted will
-  /// be written.
+  /// Index into tmp_files_ of the file at which the search for the file to which the
+  /// next block is persisted starts. Used to break ties round-robin.
   int next_block_index_;
 
   /// DiskIoMgr handles to read and write blocks.
@@ -615,6 +695,9 @@ class BufferedBlockMgr {
   /// Number of Pin() calls that did not require a disk read.
   RuntimeProfile::Counter* buffered_pin_counter_;
 
+  /// Number of read-ahead hints issued for blocks that were only on disk.
+  RuntimeProfile::Counter* read_ahead_counter_;
+
   /// Time taken for disk reads.
   RuntimeProfile::Counter* disk_read_timer_;
 
@@ -630,9 +713,19 @@ class BufferedBlockMgr {
   /// Time spent in disk spill encryption and decryption.
   RuntimeProfile::Counter* encryption_timer_;
 
+  /// Time spent in disk spill compression and decompression.
+  RuntimeProfile::Counter* compression_timer_;
+
+  /// Number of bytes of block data that were compressed before being written. Together
+  /// with bytes_written_counter_ this shows the compression ratio.
+  RuntimeProfile::Counter* uncompressed_bytes_written_counter_;
+
   /// Time spent in disk spill integrity generation and checking.
   RuntimeProfile::Counter* integrity_check_timer_;
 
+  /// Number of bytes of buffers freed by ReclaimMemory() on behalf of other queries.
+  RuntimeProfile::Counter* bytes_reclaimed_counter_;
+
   /// Number of writes issued.
   int writes_issued_;
 
@@ -647,21 +740,38 @@ class BufferedBlockMgr {
       BlockMgrsMap;
   static BlockMgrsMap query_to_block_mgrs_;
 
-  /// Takes the data in buffer(), allocates encrypted_write_buffer_, and returns
+  /// Compresses the data in buffer() into compressed_write_buffer_. If the data
+  /// compresses, sets is_compressed_ and points 'outbuf' and 'len' to the compressed
+  /// data. Otherwise they are left unchanged.
+  Status Compress(Block* block, uint8_t** outbuf, int64_t* len);
+
+  /// Decompresses the 'len' bytes at 'data' into buffer().
+  Status Decompress(Block* block, const uint8_t* data, int64_t len);
+
+  /// Takes the 'len' bytes at 'data', allocates encrypted_write_buffer_, and returns
   /// a pointer to the encrypted data in outbuf.
-  Status Encrypt(Block* block, uint8_t** outbuf);
+  Status Encrypt(Block* block, const uint8_t* data, int64_t len, uint8_t** outbuf);
 
   /// Deallocates temporary buffer alloced in Encrypt().
   void EncryptDone(Block* block);
 
-  /// Decrypts the contents of buffer() in place.
-  Status Decrypt(Block* block);
+  /// Decrypts the 'len' bytes at 'data' in place.
+  Status Decrypt(Block* block, uint8_t* data, int64_t len);
+
+  /// Takes a cryptographic hash of the 'len' bytes at 'data' and sets hash_ with it.
+  void SetHash(Block* block, const uint8_t* data, int64_t len);
+
+  /// Verifies that the 'len' bytes at 'data' match those that were set by SetHash()
+  Status VerifyHash(Block* block, const uint8_t* data, int64_t len);
 
-  /// Takes a cryptographic hash of the data and sets hash_ with it.
-  void SetHash(Block* block);
+  /// Codec that spilled blocks are compressed with, set by
+  /// --disk_spill_compression_codec. NONE if spilled blocks are not compressed.
+  const THdfsCompression::type compression_type_;
 
-  /// Verifies that the contents of buffer() match those that were set by SetHash()
-  Status VerifyHash(Block* block);
+  /// If compression_type_ is not NONE, the codecs used to compress and decompress
+  /// blocks. Both are stateless and may be used by several threads at once.
+  boost::scoped_ptr<Codec> compressor_;
+  boost::scoped_ptr<Codec> decompressor_;
 
   /// Set to true if --disk_spill_encryption is true.  When true, blocks will be encrypted
   /// before being written to disk.
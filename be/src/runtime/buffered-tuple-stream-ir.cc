@@ -87,7 +87,11 @@ bool BufferedTupleStream::DeepCopyInternal(TupleRow* row) {
   for (int i = 0; i < inlined_string_slots_.size(); ++i) {
     const Tuple* tuple = row->GetTuple(inlined_string_slots_[i].first);
     if (HasNullableTuple && tuple == NULL) continue;
-    if (UNLIKELY(!CopyStrings(tuple, inlined_string_slots_[i].second))) return false;
+    if (intern_strings_) {
+      if (UNLIKELY(!InternStrings(tuple, inlined_string_slots_[i].second))) return false;
+    } else {
+      if (UNLIKELY(!CopyStrings(tuple, inlined_string_slots_[i].second))) return false;
+    }
   }
 
   // Copy inlined collection slots. We copy collection data in a well-defined order so
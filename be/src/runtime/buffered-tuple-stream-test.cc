@@ -278,12 +278,15 @@ class SimpleTupleStreamTest : public testing::Test {
 
   // Test adding num_batches of ints to the stream and reading them back.
   // If unpin_stream is true, operate the stream in unpinned mode.
+  // If intern_strings is true, the stream interns its strings.
   // Assumes that enough buffers are available to read and write the stream.
   template <typename T>
   void TestValues(int num_batches, RowDescriptor* desc, bool gen_null,
-      bool unpin_stream, int num_rows = BATCH_SIZE, bool use_small_buffers = true) {
+      bool unpin_stream, int num_rows = BATCH_SIZE, bool use_small_buffers = true,
+      bool intern_strings = false) {
     BufferedTupleStream stream(runtime_state_, *desc, runtime_state_->block_mgr(),
         client_, use_small_buffers, false);
+    if (intern_strings) stream.EnableStringInterning();
     ASSERT_OK(stream.Init(-1, NULL, true));
 
     if (unpin_stream) ASSERT_OK(stream.UnpinStream());
@@ -626,7 +629,7 @@ TEST_F(SimpleTupleStreamTest, SmallBuffers) {
     ASSERT_OK(status);
   }
   EXPECT_LT(stream.bytes_in_mem(false), buffer_size);
-  EXPECT_LT(stream.byte_size(), buffer_size);
+  EXPECT_EQ(stream.byte_size(), 64 * 1024);
   ASSERT_TRUE(stream.using_small_buffers());
 
   // 40 MB of ints
@@ -636,6 +639,8 @@ TEST_F(SimpleTupleStreamTest, SmallBuffers) {
     ASSERT_OK(status);
     if (!ret) {
       ASSERT_TRUE(stream.using_small_buffers());
+      // The small blocks doubled in size up to --stream_max_small_block_size.
+      EXPECT_EQ(stream.byte_size(), (64 + 128 + 256 + 512) * 1024);
       bool got_buffer;
       ASSERT_OK(stream.SwitchToIoBuffers(&got_buffer));
       ASSERT_TRUE(got_buffer);
@@ -651,6 +656,23 @@ TEST_F(SimpleTupleStreamTest, SmallBuffers) {
   stream.Close();
 }
 
+// Test that interned strings are read back correctly.
+TEST_F(SimpleTupleStreamTest, InternedStrings) {
+  InitBlockMgr(-1, IO_BLOCK_SIZE);
+  TestValues<StringValue>(1, string_desc_, false, false, BATCH_SIZE, true, true);
+  TestValues<StringValue>(10, string_desc_, false, false, BATCH_SIZE, false, true);
+  TestValues<StringValue>(10, string_desc_, false, true, BATCH_SIZE, true, true);
+}
+
+// Test that interned strings only reference strings in their own block, so that blocks
+// can be spilled.
+TEST_F(SimpleTupleStreamTest, InternedStringsSpill) {
+  int buffer_size = 100 * sizeof(int);
+  InitBlockMgr(10 * buffer_size, buffer_size);
+  TestValues<StringValue>(1, string_desc_, false, true, BATCH_SIZE, true, true);
+  TestValues<StringValue>(100, string_desc_, false, true, BATCH_SIZE, true, true);
+}
+
 // Test that tuple stream functions if it references strings outside stream. The
 // aggregation node relies on this since it updates tuples in-place.
 TEST_F(SimpleTupleStreamTest, StringsOutsideStream) {
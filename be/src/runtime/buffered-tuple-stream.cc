@@ -15,6 +15,7 @@
 #include "runtime/buffered-tuple-stream.h"
 
 #include <boost/bind.hpp>
+#include <gflags/gflags.h>
 #include <gutil/strings/substitute.h>
 
 #include "runtime/collection-value.h"
@@ -29,12 +30,23 @@
 using namespace impala;
 using namespace strings;
 
-// The first NUM_SMALL_BLOCKS of the tuple stream are made of blocks less than the
-// IO size. These blocks never spill.
-// TODO: Consider adding a 4MB in-memory buffer that would split the gap between the
-// 512KB in-memory buffer and the 8MB (IO-sized) spillable buffer.
-static const int64_t INITIAL_BLOCK_SIZES[] = { 64 * 1024, 512 * 1024 };
-static const int NUM_SMALL_BLOCKS = sizeof(INITIAL_BLOCK_SIZES) / sizeof(int64_t);
+DEFINE_int32(stream_read_ahead_blocks, 2, "(Advanced) Number of blocks past the current "
+    "read block of an unpinned tuple stream that are read ahead from disk. Set to 0 to "
+    "disable read-ahead.");
+DEFINE_int64(stream_max_small_block_size, 512 * 1024, "(Advanced) Largest block of a "
+    "tuple stream that is smaller than the IO size. Streams start with a 64KB block and "
+    "double the size of each new block up to this size before they switch to IO-sized "
+    "blocks.");
+DEFINE_bool(enable_stream_string_interning, false, "(Advanced) If true, hash joins and "
+    "aggregations store repeated strings of the rows they buffer or spill only once per "
+    "block of their tuple streams. Saves memory for low-cardinality string columns at "
+    "the cost of a hash table lookup per string.");
+
+// The first blocks of the tuple stream are less than the IO size. Their sizes start at
+// MIN_SMALL_BLOCK_SIZE and double up to FLAGS_stream_max_small_block_size, so that
+// small streams use little memory. These blocks never spill. The sizes are powers of
+// two so that their buffers are recycled by the buffer pool.
+static const int64_t MIN_SMALL_BLOCK_SIZE = 64 * 1024;
 
 string BufferedTupleStream::RowIdx::DebugString() const {
   stringstream ss;
@@ -66,9 +78,13 @@ BufferedTupleStream::BufferedTupleStream(RuntimeState* state,
     write_block_(NULL),
     num_pinned_(0),
     num_small_blocks_(0),
+    last_small_block_len_(0),
     closed_(false),
     num_rows_(0),
     pinned_(true),
+    intern_strings_(false),
+    num_interned_string_bytes_(0),
+    interned_string_bytes_(NULL),
     pin_timer_(NULL),
     unpin_timer_(NULL),
     get_new_block_timer_(NULL) {
@@ -150,6 +166,9 @@ Status BufferedTupleStream::Init(int node_id, RuntimeProfile* profile, bool pinn
     pin_timer_ = ADD_TIMER(profile, "PinTime");
     unpin_timer_ = ADD_TIMER(profile, "UnpinTime");
     get_new_block_timer_ = ADD_TIMER(profile, "GetNewBlockTime");
+    if (intern_strings_) {
+      interned_string_bytes_ = ADD_COUNTER(profile, "InternedStringBytes", TUnit::BYTES);
+    }
   }
 
   max_null_indicators_size_ = ComputeNumNullIndicatorBytes(block_mgr_->max_block_size());
@@ -161,7 +180,7 @@ Status BufferedTupleStream::Init(int node_id, RuntimeProfile* profile, bool pinn
         PrettyPrinter::Print(null_indicators_size,  TUnit::BYTES));
   }
 
-  if (block_mgr_->max_block_size() < INITIAL_BLOCK_SIZES[0]) {
+  if (block_mgr_->max_block_size() <= MIN_SMALL_BLOCK_SIZE) {
     use_small_buffers_ = false;
   }
 
@@ -173,6 +192,11 @@ Status BufferedTupleStream::Init(int node_id, RuntimeProfile* profile, bool pinn
   return Status::OK();
 }
 
+void BufferedTupleStream::EnableStringInterning() {
+  DCHECK_EQ(max_null_indicators_size_, -1) << "Must be called before Init()";
+  intern_strings_ = !inlined_string_slots_.empty();
+}
+
 Status BufferedTupleStream::SwitchToIoBuffers(bool* got_buffer) {
   if (!use_small_buffers_) {
     *got_buffer = (write_block_ != NULL);
@@ -196,6 +220,10 @@ void BufferedTupleStream::Close() {
   blocks_.clear();
   num_pinned_ = 0;
   DCHECK_EQ(num_pinned_, NumPinned(blocks_));
+  write_block_strings_.clear();
+  if (interned_string_bytes_ != NULL) {
+    interned_string_bytes_->Add(num_interned_string_bytes_);
+  }
   closed_ = true;
 }
 
@@ -265,6 +293,8 @@ Status BufferedTupleStream::NewWriteBlock(int64_t block_len, int64_t null_indica
   write_tuple_idx_ = 0;
   write_ptr_ = new_block->buffer() + write_block_null_indicators_size_;
   write_end_ptr_ = new_block->buffer() + block_len;
+  // References to interned strings never leave their block.
+  write_block_strings_.clear();
 
   blocks_.push_back(new_block);
   block_start_idx_.push_back(new_block->buffer());
@@ -276,6 +306,7 @@ Status BufferedTupleStream::NewWriteBlock(int64_t block_len, int64_t null_indica
     DCHECK_EQ(num_pinned_, NumPinned(blocks_));
   } else {
     ++num_small_blocks_;
+    last_small_block_len_ = block_len;
   }
   total_byte_size_ += block_len;
   return Status::OK();
@@ -286,17 +317,17 @@ Status BufferedTupleStream::NewWriteBlockForRow(int64_t row_size, bool* got_bloc
   int64_t null_indicators_size;
   if (use_small_buffers_) {
     *got_block = false;
-    if (blocks_.size() < NUM_SMALL_BLOCKS) {
-      block_len = INITIAL_BLOCK_SIZES[blocks_.size()];
+    // Each small block is twice as large as the previous one. Skip sizes that a single
+    // row of tuples and null indicators (if any) doesn't fit in.
+    block_len = num_small_blocks_ == 0 ? MIN_SMALL_BLOCK_SIZE : 2 * last_small_block_len_;
+    while (block_len < block_mgr_->max_block_size() &&
+        block_len <= FLAGS_stream_max_small_block_size) {
       null_indicators_size = ComputeNumNullIndicatorBytes(block_len);
-      // Use small buffer only if:
-      // 1. the small buffer's size is smaller than the configured max block size.
-      // 2. a single row of tuples and null indicators (if any) fit in the small buffer.
-      //
-      // If condition 2 above is not met, we will bail. An alternative would be
-      // to try the next larger small buffer.
-      *got_block = block_len < block_mgr_->max_block_size() &&
-          null_indicators_size >= 0 && row_size + null_indicators_size <= block_len;
+      if (null_indicators_size >= 0 && row_size + null_indicators_size <= block_len) {
+        *got_block = true;
+        break;
+      }
+      block_len *= 2;
     }
     // Do not switch to IO-buffers automatically. Do not get a buffer.
     if (!*got_block) return Status::OK();
@@ -374,9 +405,20 @@ Status BufferedTupleStream::NextReadBlock() {
     read_end_ptr_ = (*read_block_)->buffer() + (*read_block_)->buffer_len();
   }
   DCHECK_EQ(num_pinned_, NumPinned(blocks_)) << DebugString();
+  ReadAhead();
   return Status::OK();
 }
 
+void BufferedTupleStream::ReadAhead() {
+  if (pinned_ || read_block_ == blocks_.end()) return;
+  list<BufferedBlockMgr::Block*>::iterator it = read_block_;
+  for (int i = 0; i < FLAGS_stream_read_ahead_blocks; ++i) {
+    if (++it == blocks_.end()) break;
+    // Pinned blocks, e.g. the write block of a read/write stream, are in memory.
+    if (!(*it)->is_pinned()) (*it)->ReadAhead();
+  }
+}
+
 Status BufferedTupleStream::PrepareForRead(bool delete_on_read, bool* got_buffer) {
   DCHECK(!closed_);
   if (blocks_.empty()) return Status::OK();
@@ -418,6 +460,7 @@ Status BufferedTupleStream::PrepareForRead(bool delete_on_read, bool* got_buffer
   rows_returned_ = 0;
   read_block_idx_ = 0;
   delete_on_read_ = delete_on_read;
+  ReadAhead();
   if (got_buffer != NULL) *got_buffer = true;
   return Status::OK();
 }
@@ -621,7 +664,11 @@ Status BufferedTupleStream::GetNextInternal(RowBatch* batch, bool* eos,
     for (int j = 0; j < inlined_string_slots_.size(); ++j) {
       Tuple* tuple = output_row->GetTuple(inlined_string_slots_[j].first);
       if (HAS_NULLABLE_TUPLE && tuple == NULL) continue;
-      FixUpStringsForRead(inlined_string_slots_[j].second, tuple);
+      if (intern_strings_) {
+        FixUpInternedStringsForRead(inlined_string_slots_[j].second, tuple);
+      } else {
+        FixUpStringsForRead(inlined_string_slots_[j].second, tuple);
+      }
     }
 
     // Update collection slot ptrs, skipping external collections. We traverse the
@@ -663,6 +710,72 @@ void BufferedTupleStream::FixUpStringsForRead(const vector<SlotDescriptor*>& str
   }
 }
 
+bool BufferedTupleStream::InternStrings(const Tuple* tuple,
+    const vector<SlotDescriptor*>& string_slots) {
+  for (int i = 0; i < string_slots.size(); ++i) {
+    const SlotDescriptor* slot_desc = string_slots[i];
+    if (tuple->IsNull(slot_desc->null_indicator_offset())) continue;
+    const StringValue* sv = tuple->GetStringSlot(slot_desc->tuple_offset());
+    if (sv->len < MIN_INTERNED_STRING_LEN) {
+      if (LIKELY(sv->len > 0)) {
+        if (UNLIKELY(write_block_bytes_remaining() < sv->len)) return false;
+        memcpy(write_ptr_, sv->ptr, sv->len);
+        write_ptr_ += sv->len;
+      }
+      continue;
+    }
+
+    boost::unordered_map<StringValue, uint32_t>::const_iterator it =
+        write_block_strings_.find(*sv);
+    if (it != write_block_strings_.end()) {
+      if (UNLIKELY(write_block_bytes_remaining() < 1 + sizeof(uint32_t))) return false;
+      *write_ptr_++ = 1;
+      memcpy(write_ptr_, &it->second, sizeof(uint32_t));
+      write_ptr_ += sizeof(uint32_t);
+      num_interned_string_bytes_ += sv->len - sizeof(uint32_t) - 1;
+      continue;
+    }
+    if (UNLIKELY(write_block_bytes_remaining() < 1 + sv->len)) return false;
+    *write_ptr_++ = 0;
+    memcpy(write_ptr_, sv->ptr, sv->len);
+    // The key points to the copy, which stays in the block while it is written.
+    if (write_block_strings_.size() < MAX_INTERNED_STRINGS_PER_BLOCK) {
+      write_block_strings_[StringValue(reinterpret_cast<char*>(write_ptr_), sv->len)] =
+          write_ptr_ - write_block_->buffer();
+    }
+    write_ptr_ += sv->len;
+  }
+  return true;
+}
+
+void BufferedTupleStream::FixUpInternedStringsForRead(
+    const vector<SlotDescriptor*>& string_slots, Tuple* tuple) {
+  DCHECK(tuple != NULL);
+  for (int i = 0; i < string_slots.size(); ++i) {
+    const SlotDescriptor* slot_desc = string_slots[i];
+    if (tuple->IsNull(slot_desc->null_indicator_offset())) continue;
+
+    StringValue* sv = tuple->GetStringSlot(slot_desc->tuple_offset());
+    if (sv->len >= MIN_INTERNED_STRING_LEN) {
+      // The tag and the offset are left unchanged, so that the block can be read again.
+      DCHECK_GE(read_block_bytes_remaining(), 1);
+      const bool is_reference = *read_ptr_++;
+      if (is_reference) {
+        DCHECK_GE(read_block_bytes_remaining(), sizeof(uint32_t));
+        uint32_t offset;
+        memcpy(&offset, read_ptr_, sizeof(offset));
+        DCHECK_LT(offset, read_ptr_ - (*read_block_)->buffer());
+        sv->ptr = reinterpret_cast<char*>((*read_block_)->buffer() + offset);
+        read_ptr_ += sizeof(offset);
+        continue;
+      }
+    }
+    DCHECK_LE(sv->len, read_block_bytes_remaining());
+    sv->ptr = reinterpret_cast<char*>(read_ptr_);
+    read_ptr_ += sv->len;
+  }
+}
+
 void BufferedTupleStream::FixUpCollectionsForRead(const vector<SlotDescriptor*>& collection_slots,
     Tuple* tuple) {
   DCHECK(tuple != NULL);
@@ -703,7 +816,9 @@ int64_t BufferedTupleStream::ComputeRowSize(TupleRow* row) const {
     const vector<SlotDescriptor*>& slots = inlined_string_slots_[i].second;
     for (auto it = slots.begin(); it != slots.end(); ++it) {
       if (tuple->IsNull((*it)->null_indicator_offset())) continue;
-      size += tuple->GetStringSlot((*it)->tuple_offset())->len;
+      int len = tuple->GetStringSlot((*it)->tuple_offset())->len;
+      // With interning, this is the size in a block that has none of the strings yet.
+      size += len + (intern_strings_ && len >= MIN_INTERNED_STRING_LEN);
     }
   }
 
@@ -17,9 +17,11 @@
 
 #include <vector>
 #include <set>
+#include <boost/unordered_map.hpp>
 
 #include "common/status.h"
 #include "runtime/buffered-block-mgr.h"
+#include "runtime/string-value.h"
 
 namespace impala {
 
@@ -42,9 +44,9 @@ class TupleRow;
 /// needs to maintain 64 streams (1 buffer per partition) would need, by default,
 /// 64 * 8MB = 512MB of buffering. A query with 5 of these operators would require
 /// 2.56GB just to run, regardless of how much of that is used. This is
-/// problematic for small queries. Instead we will start with a fixed number of small
-/// buffers (currently 2 small buffers: one 64KB and one 512KB) and only start using IO
-/// sized buffers when those fill up. The small buffers never spill.
+/// problematic for small queries. Instead we will start with small buffers that grow
+/// (64KB, then doubling up to --stream_max_small_block_size, 512KB by default) and only
+/// start using IO sized buffers when those fill up. The small buffers never spill.
 /// The stream will *not* automatically switch from using small buffers to IO-sized
 /// buffers when all the small buffers for this stream have been used.
 ///
@@ -128,6 +130,16 @@ class TupleRow;
 /// the batch returned from GetNext() has the need_to_return flag set, any tuple memory
 /// returned so far from the stream may be freed on the next call to GetNext().
 ///
+/// String interning:
+/// If EnableStringInterning() was called, a string of an inlined string slot that is
+/// long enough and was already written to the current write block is not copied again.
+/// Such strings are stored with a one byte tag, which is 1 for a reference to the first
+/// copy, followed by the offset of that copy in the block as an int32, and 0 if the
+/// string data follows. Shorter strings are stored as usual. Since the references do not
+/// leave the block, the dictionary of the strings of a block is the block itself and
+/// needs no extra work when blocks are spilled or relocated. The strings of collection
+/// items are never interned.
+///
 /// Manual construction of rows with AllocateRow():
 /// The BufferedTupleStream supports allocation of uninitialized rows with AllocateRow().
 /// The caller of AllocateRow() is responsible for writing the row with exactly the
@@ -150,10 +162,6 @@ class TupleRow;
 ///     fewer gaps in case of many rows with NULL tuples.
 ///   - We will want to multithread this. Add a AddBlock() call so the synchronization
 ///     happens at the block level. This is a natural extension.
-///   - Instead of allocating all blocks from the block_mgr, allocate some blocks that
-///     are much smaller (e.g. 16K and doubling up to the block size). This way, very
-///     small streams (a common case) will use very little memory. This small blocks
-///     are always in memory since spilling them frees up negligible memory.
 ///   - Return row batches in GetNext() instead of filling one in
 class BufferedTupleStream {
  public:
@@ -238,6 +246,10 @@ class BufferedTupleStream {
   /// then AddRow() again.
   bool AddRow(TupleRow* row, Status* status);
 
+  /// Interns repeated strings of inlined string slots within each block, as described
+  /// above. Must be called before Init(). Cannot be used together with AllocateRow().
+  void EnableStringInterning();
+
   /// Allocates space to store a row of with fixed length 'fixed_size' and variable
   /// length data 'varlen_size'. If successful, returns the pointer where fixed length
   /// data should be stored and assigns 'varlen_data' to where var-len data should
@@ -365,6 +377,25 @@ class BufferedTupleStream {
   /// stream, grouped by tuple_idx.
   std::vector<std::pair<int, std::vector<SlotDescriptor*> > > inlined_coll_slots_;
 
+  /// Strings shorter than this are never interned, the reference would not be shorter.
+  static const int MIN_INTERNED_STRING_LEN = 8;
+
+  /// Maximum number of distinct strings of a block that can be referenced by later rows.
+  static const int MAX_INTERNED_STRINGS_PER_BLOCK = 4096;
+
+  /// Whether EnableStringInterning() was called.
+  bool intern_strings_;
+
+  /// Offsets in write_block_ of the copies of the strings that later rows of the block
+  /// reference, keyed by the copies. Only used if 'intern_strings_' is true, cleared for
+  /// each new write block.
+  boost::unordered_map<StringValue, uint32_t> write_block_strings_;
+
+  /// Number of bytes of string data that interning did not copy into the stream, added
+  /// to 'interned_string_bytes_' in Close().
+  int64_t num_interned_string_bytes_;
+  RuntimeProfile::Counter* interned_string_bytes_;
+
   /// Block manager and client used to allocate, pin and release blocks. Not owned.
   BufferedBlockMgr* block_mgr_;
   BufferedBlockMgr::Client* block_mgr_client_;
@@ -421,6 +452,9 @@ class BufferedTupleStream {
   /// The total number of small blocks in blocks_;
   int num_small_blocks_;
 
+  /// Size of the last small block that was added. The next one is twice as large.
+  int64_t last_small_block_len_;
+
   bool closed_; // Used for debugging.
 
   /// Number of rows stored in the stream.
@@ -450,6 +484,11 @@ class BufferedTupleStream {
   /// write_block_.
   bool CopyStrings(const Tuple* tuple, const std::vector<SlotDescriptor*>& string_slots);
 
+  /// Same as CopyStrings(), but stores references to strings that are already in
+  /// write_block_ instead of copying them again. Used if 'intern_strings_' is true.
+  bool InternStrings(const Tuple* tuple,
+      const std::vector<SlotDescriptor*>& string_slots);
+
   /// Helper function to deep copy collections in collection_slots from tuple into
   /// write_block_. Updates write_ptr_ to the end of the collection data added. Returns
   /// false if the data does not fit in the current write block.. After returning false,
@@ -478,6 +517,11 @@ class BufferedTupleStream {
   /// Updates read_block_, read_ptr_, read_tuple_idx_ and read_end_ptr_.
   Status NextReadBlock();
 
+  /// Hints the block mgr to read the next --stream_read_ahead_blocks unpinned blocks
+  /// after read_block_ from disk, so that NextReadBlock() finds their data in the page
+  /// cache. No-op for pinned streams.
+  void ReadAhead();
+
   /// Returns the total additional bytes that this row will consume in write_block_ if
   /// appended to the block. This includes the fixed length part of the row and the
   /// data for inlined_string_slots_ and inlined_coll_slots_.
@@ -498,6 +542,10 @@ class BufferedTupleStream {
   /// StringValue's length field.
   void FixUpStringsForRead(const vector<SlotDescriptor*>& string_slots, Tuple* tuple);
 
+  /// Same as FixUpStringsForRead() for strings written with InternStrings().
+  void FixUpInternedStringsForRead(const vector<SlotDescriptor*>& string_slots,
+      Tuple* tuple);
+
   /// Helper function for GetNextInternal(). For each collection slot in collection_slots,
   /// recursively update any pointers in the CollectionValue to point to the corresponding
   /// var len data stored inline in the stream, advancing read_ptr_ as data is read.
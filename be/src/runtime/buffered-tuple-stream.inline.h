@@ -36,6 +36,7 @@ inline uint8_t* BufferedTupleStream::AllocateRow(int fixed_size, int varlen_size
     uint8_t** varlen_data, Status* status) {
   DCHECK(!closed_);
   DCHECK(!has_nullable_tuple_) << "AllocateRow does not support nullable tuples";
+  DCHECK(!intern_strings_) << "AllocateRow does not support string interning";
   const int total_size = fixed_size + varlen_size;
   if (UNLIKELY(write_block_ == NULL || write_block_bytes_remaining() < total_size)) {
     bool got_block;
@@ -0,0 +1,36 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "runtime/civil-time.h"
+
+using namespace impala;
+
+const uint8_t CivilTime::DAYS_IN_MONTH[2][12] = {
+  { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 },
+  { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 }
+};
+
+const uint16_t CivilTime::DAYS_BEFORE_MONTH[2][12] = {
+  { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 },
+  { 0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335 }
+};
+
+const int64_t CivilTime::NANOS_PER_SECOND;
+const int64_t CivilTime::NANOS_PER_MINUTE;
+const int64_t CivilTime::NANOS_PER_HOUR;
+const int64_t CivilTime::NANOS_PER_DAY;
+const int64_t CivilTime::SECONDS_PER_DAY;
+const uint32_t CivilTime::UNIX_EPOCH_DAY_NUMBER;
+const uint32_t CivilTime::DAY_NUMBER_OF_YEAR_ONE;
+const uint32_t CivilTime::DAY_NUMBER_OF_MARCH_YEAR_ZERO;
@@ -0,0 +1,143 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_RUNTIME_CIVIL_TIME_H
+#define IMPALA_RUNTIME_CIVIL_TIME_H
+
+#include <boost/cstdint.hpp>
+
+namespace impala {
+
+/// Conversions between the representation of a TimestampValue (and TimestampVal) and
+/// civil dates and times, without going through boost::gregorian and
+/// boost::posix_time. A date is a day number, the Julian day number that
+/// boost::gregorian::date stores, and a time is the number of nanoseconds since
+/// midnight, the ticks of boost::posix_time::time_duration. The conversions are a few
+/// integer operations and table lookups without branches on the values, instead of the
+/// range checked and exception throwing boost calls.
+///
+/// Dates must be in the proleptic Gregorian calendar from year 1 on. Callers check
+/// IsSpecialDate() and IsSpecialTime() first, the conversions do not validate their
+/// arguments.
+class CivilTime {
+ public:
+  static const int64_t NANOS_PER_SECOND = 1000000000L;
+  static const int64_t NANOS_PER_MINUTE = 60L * NANOS_PER_SECOND;
+  static const int64_t NANOS_PER_HOUR = 60L * NANOS_PER_MINUTE;
+  static const int64_t NANOS_PER_DAY = 24L * NANOS_PER_HOUR;
+  static const int64_t SECONDS_PER_DAY = 24L * 60L * 60L;
+
+  /// Day number of 1970-01-01.
+  static const uint32_t UNIX_EPOCH_DAY_NUMBER = 2440588;
+
+  /// Returns true if 'day_number' is one of the special values of boost::gregorian::date
+  /// (not_a_date_time and the infinities), which are 0 and the two largest values.
+  static bool IsSpecialDate(uint32_t day_number) {
+    return day_number - 1U >= 0xFFFFFFFDU;
+  }
+
+  /// Returns true if 'nanos' is one of the special values of
+  /// boost::posix_time::time_duration, which are the smallest and the two largest
+  /// int64_t values.
+  static bool IsSpecialTime(int64_t nanos) {
+    uint64_t biased = static_cast<uint64_t>(nanos) + 0x8000000000000000ULL;
+    return biased - 1ULL >= 0xFFFFFFFFFFFFFFFDULL;
+  }
+
+  static bool IsLeapYear(int year) {
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+  }
+
+  static int DaysInMonth(int year, int month) {
+    return DAYS_IN_MONTH[IsLeapYear(year)][month - 1];
+  }
+
+  /// Returns the day number of 'year'-'month'-'day'.
+  static uint32_t ToDayNumber(int year, int month, int day) {
+    uint32_t y = year - 1;
+    uint32_t days_before_year = 365 * y + y / 4 - y / 100 + y / 400;
+    return DAY_NUMBER_OF_YEAR_ONE + days_before_year +
+        DAYS_BEFORE_MONTH[IsLeapYear(year)][month - 1] + day - 1;
+  }
+
+  /// Converts 'day_number' to a year, a month in [1, 12] and a day in [1, 31]. This
+  /// counts years from March 1st so that the leap day is the last day of a year, which
+  /// maps days within a year to months with a multiplication and a division.
+  static void ToYearMonthDay(uint32_t day_number, int* year, int* month, int* day) {
+    uint32_t z = day_number - DAY_NUMBER_OF_MARCH_YEAR_ZERO;
+    uint32_t era = z / 146097;
+    uint32_t day_of_era = z - era * 146097;
+    uint32_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 -
+        day_of_era / 146096) / 365;
+    uint32_t day_of_year =
+        day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    // Month counted from March.
+    uint32_t mp = (5 * day_of_year + 2) / 153;
+    *day = day_of_year - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = era * 400 + year_of_era + (*month <= 2);
+  }
+
+  static int Year(uint32_t day_number) {
+    int year, month, day;
+    ToYearMonthDay(day_number, &year, &month, &day);
+    return year;
+  }
+
+  /// Returns the day of the year in [1, 366].
+  static int DayOfYear(int year, int month, int day) {
+    return DAYS_BEFORE_MONTH[IsLeapYear(year)][month - 1] + day;
+  }
+
+  /// Returns the day of the week, 0 is Sunday.
+  static int DayOfWeek(uint32_t day_number) { return (day_number + 1) % 7; }
+
+  static int Hours(int64_t nanos) { return nanos / NANOS_PER_HOUR; }
+  static int Minutes(int64_t nanos) { return (nanos / NANOS_PER_MINUTE) % 60; }
+  static int Seconds(int64_t nanos) { return (nanos / NANOS_PER_SECOND) % 60; }
+
+  /// Returns the seconds from the Unix epoch to 'day_number' and 'nanos', rounded
+  /// towards negative infinity.
+  static int64_t ToUnixTime(uint32_t day_number, int64_t nanos) {
+    return (static_cast<int64_t>(day_number) - UNIX_EPOCH_DAY_NUMBER) * SECONDS_PER_DAY +
+        nanos / NANOS_PER_SECOND;
+  }
+
+  /// Converts 'unix_time' to a day number and the nanoseconds within that day.
+  static void FromUnixTime(int64_t unix_time, uint32_t* day_number, int64_t* nanos) {
+    int64_t days = unix_time / SECONDS_PER_DAY;
+    int64_t seconds = unix_time % SECONDS_PER_DAY;
+    // Round the days towards negative infinity, so that the seconds are positive.
+    if (seconds < 0) {
+      --days;
+      seconds += SECONDS_PER_DAY;
+    }
+    *day_number = UNIX_EPOCH_DAY_NUMBER + days;
+    *nanos = seconds * NANOS_PER_SECOND;
+  }
+
+ private:
+  /// Day numbers of 0001-01-01 and 0000-03-01.
+  static const uint32_t DAY_NUMBER_OF_YEAR_ONE = 1721426;
+  static const uint32_t DAY_NUMBER_OF_MARCH_YEAR_ZERO = 1721120;
+
+  /// Indexed by whether the year is a leap year and the month - 1.
+  static const uint8_t DAYS_IN_MONTH[2][12];
+  static const uint16_t DAYS_BEFORE_MONTH[2][12];
+};
+
+}
+
+#endif
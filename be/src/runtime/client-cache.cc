@@ -22,10 +22,13 @@
 #include <memory>
 
 #include <boost/foreach.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <gflags/gflags.h>
 
 #include "common/logging.h"
 #include "util/container-util.h"
 #include "util/network-util.h"
+#include "util/thread.h"
 #include "rpc/thrift-util.h"
 #include "gen-cpp/ImpalaInternalService.h"
 
@@ -35,18 +38,35 @@ using namespace apache::thrift::server;
 using namespace apache::thrift::transport;
 using namespace apache::thrift::protocol;
 
+DEFINE_int32(client_cache_maintenance_interval_ms, 10000, "(Advanced) Interval, in ms, "
+    "at which the idle clients of the client caches are checked, and the ones whose "
+    "connection was closed by the server are replaced. If 0, they are only checked when "
+    "clients are warmed up.");
+
 namespace impala {
 
-Status ClientCacheHelper::GetClient(const TNetworkAddress& address,
-    ClientFactory factory_method, ClientKey* client_key) {
-  shared_ptr<PerHostCache> host_cache;
+ClientCacheHelper::~ClientCacheHelper() {
+  if (maintenance_thread_.get() == NULL) return;
   {
-    lock_guard<mutex> lock(cache_lock_);
-    VLOG(2) << "GetClient(" << address << ")";
-    shared_ptr<PerHostCache>* ptr = &per_host_caches_[address];
-    if (ptr->get() == NULL) ptr->reset(new PerHostCache());
-    host_cache = *ptr;
+    lock_guard<mutex> lock(maintenance_lock_);
+    shut_down_ = true;
   }
+  maintenance_cv_.notify_one();
+  maintenance_thread_->Join();
+}
+
+shared_ptr<ClientCacheHelper::PerHostCache> ClientCacheHelper::GetHostCache(
+    const TNetworkAddress& address) {
+  lock_guard<mutex> lock(cache_lock_);
+  shared_ptr<PerHostCache>* ptr = &per_host_caches_[address];
+  if (ptr->get() == NULL) ptr->reset(new PerHostCache());
+  return *ptr;
+}
+
+Status ClientCacheHelper::GetClient(const TNetworkAddress& address,
+    ClientFactory factory_method, ClientKey* client_key) {
+  VLOG(2) << "GetClient(" << address << ")";
+  shared_ptr<PerHostCache> host_cache = GetHostCache(address);
 
   {
     lock_guard<mutex> lock(host_cache->lock);
@@ -196,6 +216,94 @@ void ClientCacheHelper::TestShutdown() {
   }
 }
 
+void ClientCacheHelper::WarmUp(const TNetworkAddress& address, int num_clients) {
+  DCHECK_GE(num_clients, 0);
+  shared_ptr<PerHostCache> host_cache = GetHostCache(address);
+  {
+    lock_guard<mutex> lock(host_cache->lock);
+    if (host_cache->num_warm_clients == num_clients) return;
+    VLOG(1) << "WarmUp(): keeping " << num_clients << " idle clients for " << address;
+    host_cache->num_warm_clients = num_clients;
+  }
+  {
+    lock_guard<mutex> lock(maintenance_lock_);
+    maintenance_pending_ = true;
+  }
+  maintenance_cv_.notify_one();
+}
+
+void ClientCacheHelper::DoMaintenance(ClientFactory factory_method) {
+  vector<pair<TNetworkAddress, shared_ptr<PerHostCache> > > host_caches;
+  {
+    lock_guard<mutex> lock(cache_lock_);
+    host_caches.assign(per_host_caches_.begin(), per_host_caches_.end());
+  }
+  for (int i = 0; i < host_caches.size(); ++i) {
+    const TNetworkAddress& address = host_caches[i].first;
+    PerHostCache* host_cache = host_caches[i].second.get();
+    int num_missing;
+    {
+      // Idle clients can't be in the middle of an RPC, so it is safe to check them.
+      lock_guard<mutex> lock(host_cache->lock);
+      lock_guard<mutex> map_lock(client_map_lock_);
+      list<ClientKey>::iterator it = host_cache->clients.begin();
+      while (it != host_cache->clients.end()) {
+        ClientMap::iterator client = client_map_.find(*it);
+        DCHECK(client != client_map_.end());
+        if (client->second->IsConnectionHealthy()) {
+          ++it;
+          continue;
+        }
+        VLOG(1) << "Removing idle client with broken connection to " << address;
+        client_map_.erase(client);
+        it = host_cache->clients.erase(it);
+        if (metrics_enabled_) total_clients_metric_->Increment(-1);
+      }
+      num_missing = host_cache->num_warm_clients -
+          static_cast<int>(host_cache->clients.size());
+    }
+
+    // Clients are opened without holding any lock, so that GetClient() calls for the
+    // same host can go ahead.
+    for (int j = 0; j < num_missing; ++j) {
+      ClientKey client_key;
+      Status status = CreateClient(address, factory_method, &client_key);
+      if (!status.ok()) {
+        VLOG(1) << "Could not warm up client for " << address << ": "
+                << status.GetDetail();
+        break;
+      }
+      lock_guard<mutex> lock(host_cache->lock);
+      host_cache->clients.push_back(client_key);
+    }
+  }
+}
+
+void ClientCacheHelper::StartMaintenanceThread(ClientFactory factory_method) {
+  DCHECK(maintenance_thread_.get() == NULL);
+  maintenance_thread_.reset(new Thread("client-cache", "maintenance",
+      &ClientCacheHelper::MaintenanceLoop, this, factory_method));
+}
+
+void ClientCacheHelper::MaintenanceLoop(ClientFactory factory_method) {
+  while (true) {
+    {
+      unique_lock<mutex> lock(maintenance_lock_);
+      while (!maintenance_pending_ && !shut_down_) {
+        if (FLAGS_client_cache_maintenance_interval_ms <= 0) {
+          maintenance_cv_.wait(lock);
+        } else if (!maintenance_cv_.timed_wait(lock, boost::posix_time::milliseconds(
+            FLAGS_client_cache_maintenance_interval_ms))) {
+          break;
+        }
+      }
+      if (shut_down_) return;
+      maintenance_pending_ = false;
+    }
+    DoMaintenance(factory_method);
+  }
+}
+
 void ClientCacheHelper::InitMetrics(MetricGroup* metrics, const string& key_prefix) {
   DCHECK(metrics != NULL);
   // Not strictly needed if InitMetrics is called before any cache usage, but ensures that
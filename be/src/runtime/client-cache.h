@@ -19,6 +19,8 @@
 #include <list>
 #include <string>
 #include <boost/unordered_map.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/bind.hpp>
 
@@ -30,6 +32,8 @@
 
 namespace impala {
 
+class Thread;
+
 /// Opaque pointer type which allows users of ClientCache to refer to particular client
 /// instances without requiring that we parameterise ClientCacheHelper by type.
 typedef void* ClientKey;
@@ -52,6 +56,12 @@ typedef void* ClientKey;
 /// we deliberately avoid using it so that we don't have to parameterise this class by
 /// type, and thus this entire class doesn't get inlined every time it gets used.
 //
+/// To spare the first RPCs to a host the cost of connecting (and of the SASL handshake),
+/// a number of 'warm' clients can be requested for it with WarmUp(). The maintenance
+/// thread, once started with StartMaintenanceThread(), opens them in the background,
+/// and every --client_cache_maintenance_interval_ms it replaces the idle clients whose
+/// connection was closed by the server, e.g. because it restarted.
+//
 /// This class is thread-safe.
 //
 /// TODO: shut down clients in the background if they don't get used for a period of time
@@ -101,6 +111,21 @@ class ClientCacheHelper {
   /// and the total number in the cache.
   void InitMetrics(MetricGroup* metrics, const std::string& key_prefix);
 
+  /// Asks for at least 'num_clients' idle clients to 'address' to be kept in the cache.
+  /// Does not block: the clients are created by the maintenance thread. A value of 0
+  /// stops replenishing the clients of 'address', e.g. because it left the cluster.
+  void WarmUp(const TNetworkAddress& address, int num_clients);
+
+  /// Removes the idle clients whose connection is broken, then creates the clients
+  /// requested by WarmUp() using 'factory_method'. Called by the maintenance thread.
+  void DoMaintenance(ClientFactory factory_method);
+
+  /// Starts the thread that calls DoMaintenance() when WarmUp() is called and every
+  /// --client_cache_maintenance_interval_ms. May only be called once.
+  void StartMaintenanceThread(ClientFactory factory_method);
+
+  ~ClientCacheHelper();
+
  private:
   template <class T> friend class ClientCache;
   /// Private constructor so that only ClientCache can instantiate this class.
@@ -110,7 +135,9 @@ class ClientCacheHelper {
         wait_ms_(wait_ms),
         send_timeout_ms_(send_timeout_ms),
         recv_timeout_ms_(recv_timeout_ms),
-        metrics_enabled_(false) { }
+        metrics_enabled_(false),
+        maintenance_pending_(false),
+        shut_down_(false) { }
 
   /// There are three lock categories - the cache-wide lock (cache_lock_), the locks for a
   /// specific cache (PerHostCache::lock) and the lock for the set of all clients
@@ -129,11 +156,16 @@ class ClientCacheHelper {
   /// are considered to be immediately in use, and so don't exist in their PerHostCache
   /// until they are released for the first time.
   struct PerHostCache {
-    /// Protects clients.
+    /// Protects clients and num_warm_clients.
     boost::mutex lock;
 
     /// List of client keys for this entry's host.
     std::list<ClientKey> clients;
+
+    /// Number of idle clients the maintenance thread keeps in 'clients', set by WarmUp().
+    int num_warm_clients;
+
+    PerHostCache() : num_warm_clients(0) { }
   };
 
   /// Protects per_host_caches_
@@ -178,9 +210,30 @@ class ClientCacheHelper {
   /// Total clients in the cache, including those in use
   IntGauge* total_clients_metric_;
 
+  /// Protects maintenance_pending_ and shut_down_, and is used with maintenance_cv_.
+  boost::mutex maintenance_lock_;
+
+  /// Signalled by WarmUp() and the destructor to wake up the maintenance thread.
+  boost::condition_variable maintenance_cv_;
+
+  /// True if WarmUp() was called since the last DoMaintenance().
+  bool maintenance_pending_;
+
+  /// Set by the destructor to stop the maintenance thread.
+  bool shut_down_;
+
+  /// Runs MaintenanceLoop(). NULL until StartMaintenanceThread() is called.
+  boost::scoped_ptr<Thread> maintenance_thread_;
+
   /// Create a new client for specific address in 'client' and put it in client_map_
   Status CreateClient(const TNetworkAddress& address, ClientFactory factory_method,
       ClientKey* client_key);
+
+  /// Returns the PerHostCache of 'address', creating it if there is none yet.
+  boost::shared_ptr<PerHostCache> GetHostCache(const TNetworkAddress& address);
+
+  /// Body of maintenance_thread_. Calls DoMaintenance() until shut_down_ is set.
+  void MaintenanceLoop(ClientFactory factory_method);
 };
 
 template<class T>
@@ -301,6 +354,23 @@ class ClientCache {
     client_cache_helper_.InitMetrics(metrics, key_prefix);
   }
 
+  /// Keeps at least 'num_clients' idle clients to 'address' in the cache, see
+  /// ClientCacheHelper::WarmUp().
+  void WarmUp(const TNetworkAddress& address, int num_clients) {
+    client_cache_helper_.WarmUp(address, num_clients);
+  }
+
+  /// Replaces the broken idle clients and creates the clients asked for by WarmUp().
+  /// Only needs to be called if the maintenance thread was not started.
+  void DoMaintenance() {
+    client_cache_helper_.DoMaintenance(client_factory_);
+  }
+
+  /// Starts the background thread that does the work of DoMaintenance().
+  void StartMaintenanceThread() {
+    client_cache_helper_.StartMaintenanceThread(client_factory_);
+  }
+
  private:
   friend class ClientConnection<T>;
 
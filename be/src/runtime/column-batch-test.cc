@@ -0,0 +1,168 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "testutil/gtest-util.h"
+#include "runtime/column-batch.h"
+#include "runtime/mem-tracker.h"
+#include "runtime/row-batch.h"
+#include "runtime/tuple-row.h"
+#include "testutil/desc-tbl-builder.h"
+#include "util/cpu-info.h"
+
+#include "common/names.h"
+
+namespace impala {
+
+const int NUM_ROWS = 100;
+
+class ColumnBatchTest : public testing::Test {
+ protected:
+  ObjectPool pool_;
+  scoped_ptr<MemTracker> tracker_;
+  RowDescriptor* row_desc_;
+
+  virtual void SetUp() {
+    tracker_.reset(new MemTracker());
+    vector<bool> nullable_tuples(1, true);
+    vector<TTupleId> tuple_ids(1, static_cast<TTupleId>(0));
+    DescriptorTblBuilder builder(&pool_);
+    builder.DeclareTuple() << TYPE_INT << TYPE_BIGINT;
+    row_desc_ = pool_.Add(new RowDescriptor(*builder.Build(), tuple_ids,
+        nullable_tuples));
+  }
+
+  virtual void TearDown() {
+    pool_.Clear();
+    tracker_.reset();
+  }
+
+  const TupleDescriptor& tuple_desc() { return *row_desc_->tuple_descriptors()[0]; }
+
+  // Fills 'batch' with rows (i, i * 10), where every 10th int value is NULL.
+  void FillBatch(ColumnBatch* batch) {
+    int idx = batch->AddRows(NUM_ROWS);
+    int32_t* ints = batch->column(0)->values<int32_t>();
+    int64_t* bigints = batch->column(1)->values<int64_t>();
+    for (int i = 0; i < NUM_ROWS; ++i) {
+      ints[idx + i] = i;
+      bigints[idx + i] = i * 10;
+      if (i % 10 == 0) batch->column(0)->SetNull(idx + i, true);
+    }
+    batch->CommitRows(NUM_ROWS);
+  }
+};
+
+TEST_F(ColumnBatchTest, Filter) {
+  ColumnBatch batch(tuple_desc(), NUM_ROWS, tracker_.get());
+  FillBatch(&batch);
+  EXPECT_EQ(batch.num_selected(), NUM_ROWS);
+
+  // 50..99 minus the NULLs at 50, 60, 70, 80 and 90.
+  EXPECT_EQ(batch.FilterColumn<int32_t>(0, ColumnBatch::GE, 50), 45);
+  // The bigint column has no NULLs, 'batch' now holds 51..69 minus 60.
+  EXPECT_EQ(batch.FilterColumn<int64_t>(1, ColumnBatch::LT, 700), 18);
+  for (int i = 1; i < batch.num_selected(); ++i) {
+    EXPECT_LT(batch.selected_row(i - 1), batch.selected_row(i));
+  }
+  EXPECT_EQ(batch.FilterColumn<int32_t>(0, ColumnBatch::EQ, 55), 1);
+  EXPECT_EQ(batch.selected_row(0), 55);
+
+  batch.Reset();
+  FillBatch(&batch);
+  EXPECT_EQ(batch.FilterNull(0, true), 10);
+  batch.Reset();
+  FillBatch(&batch);
+  EXPECT_EQ(batch.FilterNull(0, false), 90);
+}
+
+TEST_F(ColumnBatchTest, Aggregates) {
+  ColumnBatch batch(tuple_desc(), NUM_ROWS, tracker_.get());
+  FillBatch(&batch);
+
+  int64_t sum = 0;
+  batch.Sum<int32_t, int64_t>(0, &sum);
+  // Sum of 0..99 minus the NULLs at multiples of 10.
+  EXPECT_EQ(sum, 4950 - 450);
+  EXPECT_EQ(batch.CountNonNull(0), 90);
+  EXPECT_EQ(batch.CountNonNull(1), 100);
+
+  int32_t min_val;
+  int32_t max_val;
+  EXPECT_TRUE(batch.Min<int32_t>(0, &min_val));
+  EXPECT_TRUE(batch.Max<int32_t>(0, &max_val));
+  EXPECT_EQ(min_val, 1);
+  EXPECT_EQ(max_val, 99);
+
+  batch.FilterColumn<int64_t>(1, ColumnBatch::LE, 200);
+  sum = 0;
+  batch.Sum<int64_t, int64_t>(1, &sum);
+  EXPECT_EQ(sum, 2100);
+
+  // Only NULLs remain: MIN() is undefined.
+  batch.FilterColumn<int64_t>(1, ColumnBatch::EQ, 0);
+  min_val = -1;
+  EXPECT_FALSE(batch.Min<int32_t>(0, &min_val));
+  EXPECT_EQ(min_val, -1);
+}
+
+// Converts a ColumnBatch to a RowBatch and back.
+TEST_F(ColumnBatchTest, RowBatchConversion) {
+  ColumnBatch batch(tuple_desc(), NUM_ROWS, tracker_.get());
+  FillBatch(&batch);
+  batch.FilterColumn<int64_t>(1, ColumnBatch::NE, 420);
+  const SlotDescriptor* int_slot = tuple_desc().slots()[0];
+  const SlotDescriptor* bigint_slot = tuple_desc().slots()[1];
+
+  // Use a small row batch to exercise resuming materialization.
+  RowBatch row_batch(*row_desc_, NUM_ROWS / 3, tracker_.get());
+  int start = 0;
+  while (start < batch.num_selected()) {
+    row_batch.Reset();
+    int n = batch.MaterializeRows(start, &row_batch, 0);
+    ASSERT_GT(n, 0);
+    EXPECT_EQ(n, row_batch.num_rows());
+    for (int i = 0; i < n; ++i) {
+      int row_idx = batch.selected_row(start + i);
+      Tuple* tuple = row_batch.GetRow(i)->GetTuple(0);
+      EXPECT_EQ(tuple->IsNull(int_slot->null_indicator_offset()), row_idx % 10 == 0);
+      if (row_idx % 10 != 0) {
+        EXPECT_EQ(*reinterpret_cast<int32_t*>(tuple->GetSlot(int_slot->tuple_offset())),
+            row_idx);
+      }
+      EXPECT_EQ(
+          *reinterpret_cast<int64_t*>(tuple->GetSlot(bigint_slot->tuple_offset())),
+          row_idx * 10);
+    }
+    start += n;
+  }
+  EXPECT_EQ(start, NUM_ROWS - 1);
+
+  RowBatch all_rows(*row_desc_, NUM_ROWS, tracker_.get());
+  EXPECT_EQ(batch.MaterializeRows(0, &all_rows, 0), NUM_ROWS - 1);
+  ColumnBatch round_trip(tuple_desc(), NUM_ROWS, tracker_.get());
+  EXPECT_EQ(round_trip.AppendFromRowBatch(&all_rows, 0, 0), all_rows.num_rows());
+  for (int i = 0; i < round_trip.num_rows(); ++i) {
+    int row_idx = batch.selected_row(i);
+    EXPECT_EQ(round_trip.column(0)->IsNull(i), row_idx % 10 == 0);
+    EXPECT_EQ(round_trip.column(1)->values<int64_t>()[i], row_idx * 10);
+  }
+}
+
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  impala::CpuInfo::Init();
+  return RUN_ALL_TESTS();
+}
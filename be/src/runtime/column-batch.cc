@@ -0,0 +1,226 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "runtime/column-batch.h"
+
+#include <sstream>
+
+#include "runtime/mem-tracker.h"
+#include "runtime/raw-value.h"
+#include "runtime/row-batch.h"
+#include "runtime/tuple-row.h"
+#include "util/bit-util.h"
+
+#include "common/names.h"
+
+namespace impala {
+
+ColumnBatch::ColumnBatch(const TupleDescriptor& tuple_desc, int capacity,
+    MemTracker* mem_tracker)
+  : tuple_desc_(tuple_desc),
+    capacity_(capacity),
+    mem_tracker_(mem_tracker),
+    num_rows_(0),
+    has_selection_(false),
+    num_selected_(0),
+    selection_(NULL),
+    values_buffer_(NULL),
+    values_buffer_size_(0),
+    aux_data_pool_(mem_tracker) {
+  DCHECK(mem_tracker_ != NULL);
+  DCHECK_GT(capacity, 0);
+  DCHECK(IsSupported(tuple_desc));
+
+  // Lay out the value arrays back to back, each aligned to a cache line so that the
+  // kernels never straddle two columns in the same line.
+  const vector<SlotDescriptor*>& slots = tuple_desc_.slots();
+  vector<int64_t> offsets;
+  for (int i = 0; i < slots.size(); ++i) {
+    offsets.push_back(values_buffer_size_);
+    values_buffer_size_ +=
+        BitUtil::RoundUp(static_cast<int64_t>(slots[i]->slot_size()) * capacity, 64);
+  }
+  int64_t selection_offset = values_buffer_size_;
+  values_buffer_size_ += capacity * sizeof(int);
+
+  // TODO: switch to Init() pattern so we can check memory limit and return Status.
+  mem_tracker_->Consume(values_buffer_size_);
+  values_buffer_ = reinterpret_cast<uint8_t*>(malloc(values_buffer_size_));
+  DCHECK(values_buffer_ != NULL);
+  selection_ = reinterpret_cast<int*>(values_buffer_ + selection_offset);
+
+  for (int i = 0; i < slots.size(); ++i) {
+    columns_.push_back(new Column(slots[i], values_buffer_ + offsets[i], capacity));
+  }
+}
+
+ColumnBatch::~ColumnBatch() {
+  aux_data_pool_.FreeAll();
+  for (int i = 0; i < columns_.size(); ++i) delete columns_[i];
+  free(values_buffer_);
+  mem_tracker_->Release(values_buffer_size_);
+}
+
+bool ColumnBatch::IsSupported(const TupleDescriptor& tuple_desc) {
+  for (int i = 0; i < tuple_desc.slots().size(); ++i) {
+    if (tuple_desc.slots()[i]->type().IsCollectionType()) return false;
+  }
+  return true;
+}
+
+void ColumnBatch::Reset() {
+  num_rows_ = 0;
+  has_selection_ = false;
+  num_selected_ = 0;
+  for (int i = 0; i < columns_.size(); ++i) columns_[i]->Reset();
+  aux_data_pool_.FreeAll();
+}
+
+int ColumnBatch::GetColumnIdx(SlotId slot_id) const {
+  for (int i = 0; i < columns_.size(); ++i) {
+    if (columns_[i]->slot_desc()->id() == slot_id) return i;
+  }
+  return -1;
+}
+
+void ColumnBatch::InitSelection() {
+  if (has_selection_) return;
+  for (int i = 0; i < num_rows_; ++i) selection_[i] = i;
+  num_selected_ = num_rows_;
+  has_selection_ = true;
+}
+
+int ColumnBatch::FilterNull(int col_idx, bool keep_nulls) {
+  const Column* col = columns_[col_idx];
+  if (!col->has_nulls()) {
+    // Fast path: no value is NULL.
+    if (keep_nulls) {
+      num_selected_ = 0;
+      has_selection_ = true;
+    }
+    return num_selected();
+  }
+  InitSelection();
+  int num_out = 0;
+  for (int i = 0; i < num_selected_; ++i) {
+    int row_idx = selection_[i];
+    selection_[num_out] = row_idx;
+    num_out += col->IsNull(row_idx) == keep_nulls;
+  }
+  num_selected_ = num_out;
+  return num_selected_;
+}
+
+int64_t ColumnBatch::CountNonNull(int col_idx) const {
+  const Column* col = columns_[col_idx];
+  if (!col->has_nulls()) return num_selected();
+  int64_t count = 0;
+  int n = num_selected();
+  for (int i = 0; i < n; ++i) count += !col->IsNull(selected_row(i));
+  return count;
+}
+
+int ColumnBatch::MaterializeRows(int start, RowBatch* dst, int tuple_idx) {
+  DCHECK_GE(start, 0);
+  DCHECK_LE(start, num_selected());
+  DCHECK(dst->row_desc().tuple_descriptors()[tuple_idx] == &tuple_desc_);
+  int num_rows = min(num_selected() - start, dst->capacity() - dst->num_rows());
+  if (num_rows <= 0) return 0;
+
+  int tuple_byte_size = tuple_desc_.byte_size();
+  uint8_t* tuple_mem = NULL;
+  if (tuple_byte_size > 0) {
+    tuple_mem = dst->tuple_data_pool()->Allocate(tuple_byte_size * num_rows);
+  }
+
+  int dst_row_idx = dst->AddRows(num_rows);
+  for (int i = 0; i < num_rows; ++i) {
+    TupleRow* dst_row = dst->GetRow(dst_row_idx + i);
+    dst->ClearRow(dst_row);
+    if (tuple_mem == NULL) continue;
+    Tuple* tuple = reinterpret_cast<Tuple*>(tuple_mem + i * tuple_byte_size);
+    memset(tuple, 0, tuple_desc_.num_null_bytes());
+    int row_idx = selected_row(start + i);
+    for (int c = 0; c < columns_.size(); ++c) {
+      const Column* col = columns_[c];
+      const SlotDescriptor* slot_desc = col->slot_desc();
+      if (col->has_nulls() && col->IsNull(row_idx)) {
+        tuple->SetNull(slot_desc->null_indicator_offset());
+      } else {
+        memcpy(tuple->GetSlot(slot_desc->tuple_offset()), col->GetValue(row_idx),
+            col->value_size());
+      }
+    }
+    dst_row->SetTuple(tuple_idx, tuple);
+  }
+  dst->CommitRows(num_rows);
+  return num_rows;
+}
+
+int ColumnBatch::AppendFromRowBatch(RowBatch* src, int tuple_idx, int start_row) {
+  DCHECK(src->row_desc().tuple_descriptors()[tuple_idx] == &tuple_desc_);
+  int num_rows = min(src->num_rows() - start_row, capacity_ - num_rows_);
+  if (num_rows <= 0) return 0;
+
+  int dst_row_idx = AddRows(num_rows);
+  // Transpose one column at a time so that the writes to the value array are
+  // sequential.
+  for (int c = 0; c < columns_.size(); ++c) {
+    Column* col = columns_[c];
+    const SlotDescriptor* slot_desc = col->slot_desc();
+    const NullIndicatorOffset& null_offset = slot_desc->null_indicator_offset();
+    int tuple_offset = slot_desc->tuple_offset();
+    for (int i = 0; i < num_rows; ++i) {
+      Tuple* tuple = src->GetRow(start_row + i)->GetTuple(tuple_idx);
+      if (tuple == NULL || tuple->IsNull(null_offset)) {
+        col->SetNull(dst_row_idx + i, true);
+      } else {
+        memcpy(col->GetValue(dst_row_idx + i), tuple->GetSlot(tuple_offset),
+            col->value_size());
+      }
+    }
+  }
+  CommitRows(num_rows);
+  return num_rows;
+}
+
+void ColumnBatch::TransferResourceOwnership(RowBatch* dst) {
+  dst->tuple_data_pool()->AcquireData(&aux_data_pool_, false);
+}
+
+string ColumnBatch::DebugString() const {
+  stringstream ss;
+  ss << "ColumnBatch(num_rows=" << num_rows_ << " num_selected=" << num_selected()
+     << " capacity=" << capacity_ << ")" << endl;
+  int n = num_selected();
+  for (int i = 0; i < n; ++i) {
+    int row_idx = selected_row(i);
+    ss << row_idx << ": [";
+    for (int c = 0; c < columns_.size(); ++c) {
+      const Column* col = columns_[c];
+      if (c > 0) ss << " ";
+      if (col->has_nulls() && col->IsNull(row_idx)) {
+        ss << "NULL";
+        continue;
+      }
+      string str;
+      RawValue::PrintValue(col->GetValue(row_idx), col->slot_desc()->type(), -1, &str);
+      ss << str;
+    }
+    ss << "]" << endl;
+  }
+  return ss.str();
+}
+
+}
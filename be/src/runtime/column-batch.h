@@ -0,0 +1,346 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_RUNTIME_COLUMN_BATCH_H
+#define IMPALA_RUNTIME_COLUMN_BATCH_H
+
+#include <vector>
+
+#include "common/logging.h"
+#include "gutil/macros.h"
+#include "runtime/descriptors.h"
+#include "runtime/mem-pool.h"
+#include "util/bitmap.h"
+
+namespace impala {
+
+class MemTracker;
+class RowBatch;
+
+/// A ColumnBatch is the columnar counterpart of a RowBatch for a single tuple. Instead
+/// of an array of tuple pointers, it stores one contiguous value array per slot plus a
+/// null bitmap per slot. Operators that only evaluate simple scalar predicates or simple
+/// aggregates (SUM/COUNT/MIN/MAX) can then loop over a single value array without
+/// chasing a tuple pointer per row per slot, which lets the compiler vectorize the loop.
+///
+/// Values are stored with the same in-memory representation as tuple slots (e.g. a
+/// StringValue for string slots), so converting between the two layouts is a memcpy of
+/// slot_size() bytes per value. Variable-length data referenced by string slots is not
+/// copied; it either stays in the memory of the source RowBatch (the caller must keep it
+/// alive) or is allocated from aux_data_pool() by the producer, in which case it is handed
+/// to the consumer via TransferResourceOwnership().
+///
+/// Rows that have been filtered out are not compacted. Instead the batch maintains an
+/// optional selection vector with the indices of the surviving rows, in increasing
+/// order. Predicate kernels only narrow the selection; MaterializeRows() and the
+/// aggregate kernels only consider selected rows.
+///
+/// ColumnBatches are converted to RowBatches with MaterializeRows() at the boundary to
+/// operators that have not been vectorized, and can be built from RowBatches with
+/// AppendFromRowBatch().
+///
+/// Collection-typed slots are not supported.
+class ColumnBatch {
+ public:
+  /// Comparison operators supported by FilterColumn().
+  enum CompareOp {
+    EQ,
+    NE,
+    LT,
+    LE,
+    GT,
+    GE
+  };
+
+  /// The values and null indicators of a single slot.
+  class Column {
+   public:
+    const SlotDescriptor* slot_desc() const { return slot_desc_; }
+
+    /// Size in bytes of a single value, the same as slot_desc()->slot_size().
+    int value_size() const { return value_size_; }
+
+    /// Returns the start of the value array, interpreted as values of type T. T must
+    /// match the in-memory slot type.
+    template <typename T>
+    T* values() {
+      DCHECK_EQ(sizeof(T), value_size_);
+      return reinterpret_cast<T*>(values_);
+    }
+    template <typename T>
+    const T* values() const {
+      DCHECK_EQ(sizeof(T), value_size_);
+      return reinterpret_cast<const T*>(values_);
+    }
+
+    void* GetValue(int row_idx) { return values_ + row_idx * value_size_; }
+    const void* GetValue(int row_idx) const { return values_ + row_idx * value_size_; }
+
+    bool IsNull(int row_idx) const { return null_bitmap_.Get<false>(row_idx); }
+    void SetNull(int row_idx, bool is_null) {
+      null_bitmap_.Set<false>(row_idx, is_null);
+      has_nulls_ |= is_null;
+    }
+
+    /// False if no value in the column has been set to NULL since the last Reset().
+    /// Kernels use this to skip the null checks entirely.
+    bool has_nulls() const { return has_nulls_; }
+
+   private:
+    friend class ColumnBatch;
+
+    Column(const SlotDescriptor* slot_desc, uint8_t* values, int capacity)
+      : slot_desc_(slot_desc),
+        value_size_(slot_desc->slot_size()),
+        values_(values),
+        null_bitmap_(capacity),
+        has_nulls_(false) {
+    }
+
+    void Reset() {
+      if (has_nulls_) null_bitmap_.SetAllBits(false);
+      has_nulls_ = false;
+    }
+
+    const SlotDescriptor* slot_desc_;
+    const int value_size_;
+
+    /// Not owned, points into ColumnBatch::values_buffer_.
+    uint8_t* values_;
+    Bitmap null_bitmap_;
+    bool has_nulls_;
+  };
+
+  /// Create a batch for up to 'capacity' instances of 'tuple_desc'. All materialized
+  /// slots of 'tuple_desc' get a column. 'mem_tracker' cannot be NULL.
+  ColumnBatch(const TupleDescriptor& tuple_desc, int capacity, MemTracker* mem_tracker);
+
+  ~ColumnBatch();
+
+  /// Returns true if all the slots in 'tuple_desc' can be stored in a ColumnBatch.
+  static bool IsSupported(const TupleDescriptor& tuple_desc);
+
+  /// Same contract as RowBatch::AddRows()/CommitRows(): AddRows() returns the index of
+  /// the first row to populate, CommitRows() makes them visible.
+  int AddRows(int n) {
+    DCHECK_LE(num_rows_ + n, capacity_);
+    return num_rows_;
+  }
+
+  void CommitRows(int n) {
+    DCHECK_GE(n, 0);
+    DCHECK_LE(num_rows_ + n, capacity_);
+    DCHECK(!has_selection_) << "Cannot add rows after filtering";
+    num_rows_ += n;
+  }
+
+  /// Resets the batch so it can be reused. Frees any memory in aux_data_pool().
+  void Reset();
+
+  int num_rows() const { return num_rows_; }
+  int capacity() const { return capacity_; }
+  bool AtCapacity() const { return num_rows_ == capacity_; }
+  const TupleDescriptor& tuple_desc() const { return tuple_desc_; }
+  MemPool* aux_data_pool() { return &aux_data_pool_; }
+
+  int num_columns() const { return columns_.size(); }
+  Column* column(int col_idx) { return columns_[col_idx]; }
+  const Column* column(int col_idx) const { return columns_[col_idx]; }
+
+  /// Returns the index of the column for 'slot_id', or -1 if there is none.
+  int GetColumnIdx(SlotId slot_id) const;
+
+  /// The number of rows that survived filtering. Equal to num_rows() if no predicate
+  /// has been applied.
+  int num_selected() const { return has_selection_ ? num_selected_ : num_rows_; }
+
+  /// Returns the row index of the i-th selected row.
+  int selected_row(int i) const {
+    DCHECK_LT(i, num_selected());
+    return has_selection_ ? selection_[i] : i;
+  }
+
+  /// Narrows the selection to the rows for which 'value' 'op' 'constant' holds for the
+  /// column at 'col_idx'. NULL values never pass. T must match the slot type. Returns
+  /// the number of rows still selected.
+  template <typename T>
+  int FilterColumn(int col_idx, CompareOp op, const T& constant);
+
+  /// Narrows the selection to rows where the column at 'col_idx' is (or is not) NULL.
+  int FilterNull(int col_idx, bool keep_nulls);
+
+  /// Aggregate kernels over the selected rows of the column at 'col_idx'. NULLs are
+  /// ignored, as in the SQL aggregate functions. T is the slot type and ACC the type of
+  /// the accumulator (e.g. int64_t for SUM over an INT column).
+  /// Sum() adds to the in/out parameter '*result'. Min()/Max() set '*result' to the
+  /// smallest/largest selected non-NULL value and return false (leaving '*result'
+  /// unchanged) if there is none.
+  int64_t CountNonNull(int col_idx) const;
+  template <typename T, typename ACC>
+  void Sum(int col_idx, ACC* result) const;
+  template <typename T>
+  bool Min(int col_idx, T* result) const;
+  template <typename T>
+  bool Max(int col_idx, T* result) const;
+
+  /// Converts the selected rows to the row layout. Tuples are allocated from 'dst's
+  /// tuple pool and written to tuple 'tuple_idx' of each row; other tuples of the row are
+  /// set to NULL. Starts at selected row 'start' and stops when 'dst' is at capacity.
+  /// Returns the number of selected rows that were materialized; the caller should pass
+  /// start + return value to the next call.
+  int MaterializeRows(int start, RowBatch* dst, int tuple_idx);
+
+  /// Appends tuple 'tuple_idx' of rows [start_row, src->num_rows()) of 'src' to this
+  /// batch, stopping when this batch is at capacity. NULL tuples produce a row with all
+  /// slots NULL. Variable-length data is not copied. Returns the number of rows appended.
+  int AppendFromRowBatch(RowBatch* src, int tuple_idx, int start_row);
+
+  /// Transfers the memory in aux_data_pool() to 'dst'.
+  void TransferResourceOwnership(RowBatch* dst);
+
+  std::string DebugString() const;
+
+ private:
+  /// Switches from the implicit 'all rows' selection to an explicit selection vector.
+  void InitSelection();
+
+  template <typename T, CompareOp OP>
+  int FilterColumnInternal(const Column* col, const T& constant);
+
+  const TupleDescriptor& tuple_desc_;
+  const int capacity_;
+  MemTracker* mem_tracker_;  // not owned
+
+  /// Number of committed rows.
+  int num_rows_;
+
+  /// If false, all num_rows_ rows are selected and selection_ is not used.
+  bool has_selection_;
+  int num_selected_;
+
+  /// Array of capacity_ row indices, valid up to num_selected_ if has_selection_.
+  int* selection_;
+
+  /// Single malloc'd buffer that holds the value arrays of all columns, plus the
+  /// selection vector. Its size is counted against mem_tracker_.
+  uint8_t* values_buffer_;
+  int64_t values_buffer_size_;
+
+  /// Columns in the same order as the materialized slots of tuple_desc_. Owned.
+  std::vector<Column*> columns_;
+
+  /// Memory for variable-length data written by producers of this batch.
+  MemPool aux_data_pool_;
+
+  DISALLOW_COPY_AND_ASSIGN(ColumnBatch);
+};
+
+template <typename T>
+inline int ColumnBatch::FilterColumn(int col_idx, CompareOp op, const T& constant) {
+  const Column* col = columns_[col_idx];
+  switch (op) {
+    case EQ: return FilterColumnInternal<T, EQ>(col, constant);
+    case NE: return FilterColumnInternal<T, NE>(col, constant);
+    case LT: return FilterColumnInternal<T, LT>(col, constant);
+    case LE: return FilterColumnInternal<T, LE>(col, constant);
+    case GT: return FilterColumnInternal<T, GT>(col, constant);
+    case GE: return FilterColumnInternal<T, GE>(col, constant);
+  }
+  DCHECK(false);
+  return num_selected();
+}
+
+template <typename T, ColumnBatch::CompareOp OP>
+inline int ColumnBatch::FilterColumnInternal(const Column* col, const T& constant) {
+  const T* values = col->values<T>();
+  const bool check_nulls = col->has_nulls();
+  InitSelection();
+  // Write the index of every row unconditionally and only advance the output position
+  // if it passes. This keeps the loop free of branches on the predicate result.
+  int num_out = 0;
+  for (int i = 0; i < num_selected_; ++i) {
+    int row_idx = selection_[i];
+    const T& v = values[row_idx];
+    bool pass;
+    switch (OP) {
+      case EQ: pass = v == constant; break;
+      case NE: pass = !(v == constant); break;
+      case LT: pass = v < constant; break;
+      case LE: pass = v <= constant; break;
+      case GT: pass = v > constant; break;
+      case GE: pass = v >= constant; break;
+    }
+    if (check_nulls) pass &= !col->IsNull(row_idx);
+    selection_[num_out] = row_idx;
+    num_out += pass;
+  }
+  num_selected_ = num_out;
+  return num_selected_;
+}
+
+template <typename T, typename ACC>
+inline void ColumnBatch::Sum(int col_idx, ACC* result) const {
+  const Column* col = columns_[col_idx];
+  const T* values = col->values<T>();
+  ACC sum = 0;
+  if (!has_selection_ && !col->has_nulls()) {
+    for (int i = 0; i < num_rows_; ++i) sum += values[i];
+  } else {
+    int n = num_selected();
+    for (int i = 0; i < n; ++i) {
+      int row_idx = selected_row(i);
+      if (!col->IsNull(row_idx)) sum += values[row_idx];
+    }
+  }
+  *result += sum;
+}
+
+template <typename T>
+inline bool ColumnBatch::Min(int col_idx, T* result) const {
+  const Column* col = columns_[col_idx];
+  const T* values = col->values<T>();
+  bool found = false;
+  T min_val = T();
+  int n = num_selected();
+  for (int i = 0; i < n; ++i) {
+    int row_idx = selected_row(i);
+    if (col->has_nulls() && col->IsNull(row_idx)) continue;
+    if (!found || values[row_idx] < min_val) min_val = values[row_idx];
+    found = true;
+  }
+  if (found) *result = min_val;
+  return found;
+}
+
+template <typename T>
+inline bool ColumnBatch::Max(int col_idx, T* result) const {
+  const Column* col = columns_[col_idx];
+  const T* values = col->values<T>();
+  bool found = false;
+  T max_val = T();
+  int n = num_selected();
+  for (int i = 0; i < n; ++i) {
+    int row_idx = selected_row(i);
+    if (col->has_nulls() && col->IsNull(row_idx)) continue;
+    if (!found || values[row_idx] > max_val) max_val = values[row_idx];
+    found = true;
+  }
+  if (found) *result = max_val;
+  return found;
+}
+
+}
+
+#endif
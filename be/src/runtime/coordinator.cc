@@ -15,6 +15,7 @@
 #include "runtime/coordinator.h"
 
 #include <limits>
+#include <list>
 #include <map>
 #include <memory>
 #include <thrift/protocol/TDebugProtocol.h>
@@ -48,6 +49,7 @@
 #include "runtime/row-batch.h"
 #include "runtime/parallel-executor.h"
 #include "scheduling/scheduler.h"
+#include "service/fragment-mgr.h"
 #include "exec/data-sink.h"
 #include "exec/scan-node.h"
 #include "util/bloom-filter.h"
@@ -58,6 +60,7 @@
 #include "util/hdfs-bulk-ops.h"
 #include "util/hdfs-util.h"
 #include "util/llama-util.h"
+#include "util/min-max-filter.h"
 #include "util/network-util.h"
 #include "util/pretty-printer.h"
 #include "util/summary-util.h"
@@ -87,6 +90,10 @@ DECLARE_string(hostname);
 
 DEFINE_bool(insert_inherit_permissions, false, "If true, new directories created by "
     "INSERTs will inherit the permissions of their parent directories");
+DEFINE_bool(batch_fragment_start_rpcs, true, "(Advanced) If true, the coordinator starts "
+    "the fragment instances of a query on each backend with a single rpc, which sends "
+    "the plan of each fragment once. Set to false while some backends run a version "
+    "without the ExecPlanFragments() rpc.");
 
 namespace impala {
 
@@ -535,10 +542,16 @@ Status Coordinator::StartRemoteFragments(QuerySchedule* schedule) {
   query_events_->MarkEvent(
       Substitute("Ready to start $0 remote fragments", num_fragment_instances));
 
+  // The instances to start on each backend, if they are started with one rpc per
+  // backend.
+  unordered_map<TNetworkAddress, vector<RemoteFragmentInstance> > instances_per_host;
   int fragment_instance_idx = 0;
   bool has_coordinator_fragment =
       request.fragments[0].partition.type == TPartitionType::UNPARTITIONED;
   filter_mode_ = schedule->query_options().runtime_filter_mode;
+  if (filter_mode_ == TRuntimeFilterMode::GLOBAL) {
+    num_instances_per_host_.resize(request.fragments.size());
+  }
   // Start one fragment instance per fragment per host (number of hosts running each
   // fragment may not be constant).
   for (int fragment_idx = (has_coordinator_fragment ? 1 : 0);
@@ -551,6 +564,11 @@ Status Coordinator::StartRemoteFragments(QuerySchedule* schedule) {
       UpdateFilterRoutingTable(request.fragments[fragment_idx].plan.nodes, num_hosts,
           fragment_instance_idx);
     }
+    if (filter_mode_ == TRuntimeFilterMode::GLOBAL) {
+      BOOST_FOREACH(const TNetworkAddress& host, params->hosts) {
+        ++num_instances_per_host_[fragment_idx][host];
+      }
+    }
 
     fragment_profiles_[fragment_idx].num_instances = num_hosts;
     // Start one fragment instance for every fragment_instance required by the
@@ -561,6 +579,17 @@ Status Coordinator::StartRemoteFragments(QuerySchedule* schedule) {
          ++per_fragment_instance_idx) {
       DebugOptions* fragment_instance_debug_options =
           debug_options.IsApplicable(fragment_instance_idx) ? &debug_options : NULL;
+      if (FLAGS_batch_fragment_start_rpcs) {
+        RemoteFragmentInstance instance;
+        instance.fragment_exec_params = params;
+        instance.plan_fragment = &request.fragments[fragment_idx];
+        instance.debug_options = fragment_instance_debug_options;
+        instance.fragment_instance_idx = fragment_instance_idx++;
+        instance.fragment_idx = fragment_idx;
+        instance.per_fragment_instance_idx = per_fragment_instance_idx;
+        instances_per_host[params->hosts[per_fragment_instance_idx]].push_back(instance);
+        continue;
+      }
       exec_env_->fragment_exec_thread_pool()->Offer(
           bind<void>(mem_fn(&Coordinator::ExecRemoteFragment), this,
               params, // fragment_exec_params
@@ -573,6 +602,13 @@ Status Coordinator::StartRemoteFragments(QuerySchedule* schedule) {
     }
   }
   filter_routing_table_complete_ = true;
+  typedef unordered_map<TNetworkAddress, vector<RemoteFragmentInstance> >::value_type
+      HostInstances;
+  BOOST_FOREACH(HostInstances& host_instances, instances_per_host) {
+    exec_env_->fragment_exec_thread_pool()->Offer(
+        bind<void>(mem_fn(&Coordinator::ExecRemoteFragments), this,
+            &host_instances.second, schedule));
+  }
   exec_complete_barrier_->Wait();
   query_events_->MarkEvent(
       Substitute("All $0 remote fragments started", fragment_instance_idx));
@@ -687,8 +723,9 @@ Status Coordinator::UpdateStatus(const Status& status, const TUniqueId& instance
   return query_status_;
 }
 
-void Coordinator::PopulatePathPermissionCache(hdfsFS fs, const string& path_str,
-    PermissionCache* permissions_cache) {
+// Returns all prefixes (including the complete path) of the path component of
+// 'path_str'. So hdfs://host:port/a/b/c leads to /a, /a/b, /a/b/c.
+static void GetPathPrefixes(const string& path_str, vector<string>* prefixes) {
   // Find out if the path begins with a hdfs:// -style prefix, and remove it and the
   // location (e.g. host:port) if so.
   int scheme_end = path_str.find("://");
@@ -704,25 +741,26 @@ void Coordinator::PopulatePathPermissionCache(hdfsFS fs, const string& path_str,
   vector<string> components;
   split(components, stripped_str, is_any_of("/"));
 
-  // Build a set of all prefixes (including the complete string) of stripped_path. So
-  // /a/b/c/d leads to a vector of: /a, /a/b, /a/b/c, /a/b/c/d
-  vector<string> prefixes;
   // Stores the current prefix
   stringstream accumulator;
   BOOST_FOREACH(const string& component, components) {
     if (component.empty()) continue;
     accumulator << "/" << component;
-    prefixes.push_back(accumulator.str());
+    prefixes->push_back(accumulator.str());
   }
+}
+
+void Coordinator::PopulatePathPermissionCache(const string& path_str,
+    const PathInfoMap& path_infos, PermissionCache* permissions_cache) {
+  vector<string> prefixes;
+  GetPathPrefixes(path_str, &prefixes);
 
-  // Now for each prefix, stat() it to see if a) it exists and b) if so what its
-  // permissions are. When we meet a directory that doesn't exist, we record the fact that
-  // we need to create it, and the permissions of its parent dir to inherit.
+  // Now for each prefix, check a) if it exists and b) if so what its permissions are.
+  // When we meet a directory that doesn't exist, we record the fact that we need to
+  // create it, and the permissions of its parent dir to inherit.
   //
-  // Every prefix is recorded in the PermissionCache so we don't do more than one stat()
-  // for each path. If we need to create the directory, we record it as the pair (true,
-  // perms) so that the caller can identify which directories need their permissions
-  // explicitly set.
+  // If we need to create the directory, we record it as the pair (true, perms) so that
+  // the caller can identify which directories need their permissions explicitly set.
 
   // Set to the permission of the immediate parent (i.e. the permissions to inherit if the
   // current dir doesn't exist).
@@ -730,13 +768,12 @@ void Coordinator::PopulatePathPermissionCache(hdfsFS fs, const string& path_str,
   BOOST_FOREACH(const string& path, prefixes) {
     PermissionCache::const_iterator it = permissions_cache->find(path);
     if (it == permissions_cache->end()) {
-      hdfsFileInfo* info = hdfsGetPathInfo(fs, path.c_str());
-      if (info != NULL) {
+      PathInfoMap::const_iterator info = path_infos.find(path);
+      DCHECK(info != path_infos.end()) << path;
+      if (info != path_infos.end() && info->second.exists) {
         // File exists, so fill the cache with its current permissions.
-        permissions_cache->insert(
-            make_pair(path, make_pair(false, info->mPermissions)));
-        permissions = info->mPermissions;
-        hdfsFreeFileInfo(info, 1);
+        permissions = info->second.permissions;
+        permissions_cache->insert(make_pair(path, make_pair(false, permissions)));
       } else {
         // File doesn't exist, so we need to set its permissions to its immediate parent
         // once it's been created.
@@ -768,13 +805,13 @@ Status Coordinator::FinalizeSuccessfulInsert() {
   DCHECK(hdfs_table != NULL) << "INSERT target table not known in descriptor table: "
                              << finalize_params_.table_id;
 
-  // Loop over all partitions that were updated by this insert, and create the set of
-  // filesystem operations required to create the correct partition structure on disk.
+  // Look up the location of each partition that was updated by this insert in the
+  // descriptor table, and collect the paths whose existence and permissions are needed
+  // to decide on the filesystem operations, so that they can all be looked up in
+  // parallel instead of with one round trip to the NameNode after the other.
+  vector<string> part_paths;
+  PathInfoMap path_infos;
   BOOST_FOREACH(const PartitionStatusMap::value_type& partition, per_partition_status_) {
-    SCOPED_TIMER(ADD_CHILD_TIMER(query_profile_, "Overwrite/PartitionCreationTimer",
-          "FinalizationTimer"));
-
-    // Look up the partition in the descriptor table.
     stringstream part_path_ss;
     if (partition.second.id == -1) {
       // If this is a non-existant partition, use the default partition location of
@@ -787,7 +824,34 @@ Status Coordinator::FinalizeSuccessfulInsert() {
                            << "\n" <<  PrintThrift(runtime_state()->fragment_params());
       part_path_ss << part->location();
     }
-    const string& part_path = part_path_ss.str();
+    part_paths.push_back(part_path_ss.str());
+    // The root directory of an overwritten table is listed instead.
+    if (finalize_params_.is_overwrite && partition.first.empty()) continue;
+    path_infos[part_paths.back()];
+    if (FLAGS_insert_inherit_permissions) {
+      vector<string> prefixes;
+      GetPathPrefixes(part_paths.back(), &prefixes);
+      BOOST_FOREACH(const string& prefix, prefixes) path_infos[prefix];
+    }
+  }
+  {
+    SCOPED_TIMER(ADD_CHILD_TIMER(query_profile_, "PathInspectionTimer",
+          "FinalizationTimer"));
+    HdfsOperationSet path_info_ops(&hdfs_connection);
+    BOOST_FOREACH(PathInfoMap::value_type& path_info, path_infos) {
+      path_info_ops.Add(GET_PATH_INFO, path_info.first, &path_info.second);
+    }
+    // Paths that do not exist are not errors, so there are none to report.
+    path_info_ops.Execute(exec_env_->hdfs_op_thread_pool(), false);
+  }
+
+  // Loop over all partitions that were updated by this insert, and create the set of
+  // filesystem operations required to create the correct partition structure on disk.
+  int part_idx = 0;
+  BOOST_FOREACH(const PartitionStatusMap::value_type& partition, per_partition_status_) {
+    SCOPED_TIMER(ADD_CHILD_TIMER(query_profile_, "Overwrite/PartitionCreationTimer",
+          "FinalizationTimer"));
+    const string& part_path = part_paths[part_idx++];
 
     // If this is an overwrite insert, we will need to delete any updated partitions
     if (finalize_params_.is_overwrite) {
@@ -831,9 +895,9 @@ Status Coordinator::FinalizeSuccessfulInsert() {
         // TODO: There's a potential race here between checking for the directory
         // and a third-party deleting it.
         if (FLAGS_insert_inherit_permissions) {
-          PopulatePathPermissionCache(hdfs_connection, part_path, &permissions_cache);
+          PopulatePathPermissionCache(part_path, path_infos, &permissions_cache);
         }
-        if (hdfsExists(hdfs_connection, part_path.c_str()) != -1) {
+        if (path_infos[part_path].exists) {
           partition_create_ops.Add(DELETE_THEN_CREATE, part_path);
         } else {
           // Otherwise just create the directory.
@@ -842,9 +906,9 @@ Status Coordinator::FinalizeSuccessfulInsert() {
       }
     } else {
       if (FLAGS_insert_inherit_permissions) {
-        PopulatePathPermissionCache(hdfs_connection, part_path, &permissions_cache);
+        PopulatePathPermissionCache(part_path, path_infos, &permissions_cache);
       }
-      if (hdfsExists(hdfs_connection, part_path.c_str()) == -1) {
+      if (!path_infos[part_path].exists) {
         partition_create_ops.Add(CREATE_DIR, part_path);
       }
     }
@@ -909,6 +973,8 @@ Status Coordinator::FinalizeSuccessfulInsert() {
   // 5. Optionally update the permissions of the created partition directories
   // Do this last in case we make the dirs unwriteable.
   if (FLAGS_insert_inherit_permissions) {
+    SCOPED_TIMER(ADD_CHILD_TIMER(query_profile_, "PermissionUpdateTimer",
+          "FinalizationTimer"));
     HdfsOperationSet chmod_ops(&hdfs_connection);
     BOOST_FOREACH(const PermissionCache::value_type& perm, permissions_cache) {
       bool new_dir = perm.second.first;
@@ -1368,6 +1434,121 @@ void Coordinator::ExecRemoteFragment(const FragmentExecParams* fragment_exec_par
   return;
 }
 
+void Coordinator::ExecRemoteFragments(const vector<RemoteFragmentInstance>* instances,
+    QuerySchedule* schedule) {
+  DCHECK(!instances->empty());
+  NotifyBarrierOnExit notifier(exec_complete_barrier_.get(), instances->size());
+  const TNetworkAddress& coord = MakeNetworkAddress(FLAGS_hostname, FLAGS_be_port);
+  TExecPlanFragmentsParams rpc_params;
+  rpc_params.__set_protocol_version(ImpalaInternalServiceVersion::V1);
+  rpc_params.__set_query_ctx(query_ctx_);
+  rpc_params.__isset.fragments = true;
+  rpc_params.__isset.desc_tbls = true;
+  rpc_params.__isset.instances = true;
+  // Indexes into rpc_params.fragments of the fragments sent for each fragment of the
+  // query. The instances of a fragment share one unless they are given different
+  // runtime filters.
+  map<int, vector<int> > sent_fragments;
+  vector<FragmentInstanceState*> exec_states;
+  BOOST_FOREACH(const RemoteFragmentInstance& instance, *instances) {
+    TExecPlanFragmentParams instance_params;
+    SetExecPlanFragmentParams(*schedule, *instance.plan_fragment,
+        *instance.fragment_exec_params, instance.fragment_instance_idx,
+        instance.fragment_idx, instance.per_fragment_instance_idx, coord,
+        &instance_params);
+    if (instance.debug_options != NULL) {
+      instance_params.params.__set_debug_node_id(instance.debug_options->node_id);
+      instance_params.params.__set_debug_action(instance.debug_options->action);
+      instance_params.params.__set_debug_phase(instance.debug_options->phase);
+    }
+    FragmentInstanceState* exec_state = obj_pool()->Add(
+        new FragmentInstanceState(instance.fragment_idx, instance.fragment_exec_params,
+            instance.per_fragment_instance_idx, obj_pool()));
+    exec_state->ComputeTotalSplitSize(instance_params.params.per_node_scan_ranges);
+    fragment_instance_states_[instance.fragment_instance_idx] = exec_state;
+    exec_states.push_back(exec_state);
+
+    vector<int>* fragment_idxs = &sent_fragments[instance.fragment_idx];
+    int sent_fragment_idx = -1;
+    for (int i = 0; i < fragment_idxs->size(); ++i) {
+      if (rpc_params.fragments[(*fragment_idxs)[i]] == instance_params.fragment) {
+        sent_fragment_idx = (*fragment_idxs)[i];
+        break;
+      }
+    }
+    if (sent_fragment_idx == -1) {
+      sent_fragment_idx = rpc_params.fragments.size();
+      fragment_idxs->push_back(sent_fragment_idx);
+      rpc_params.fragments.push_back(TPlanFragment());
+      swap(rpc_params.fragments.back(), instance_params.fragment);
+      rpc_params.desc_tbls.push_back(TDescriptorTable());
+      swap(rpc_params.desc_tbls.back(), instance_params.desc_tbl);
+    }
+
+    rpc_params.instances.push_back(TExecPlanFragmentInstance());
+    TExecPlanFragmentInstance* rpc_instance = &rpc_params.instances.back();
+    rpc_instance->fragment_idx = sent_fragment_idx;
+    swap(rpc_instance->params, instance_params.params);
+    const TPlanFragmentInstanceCtx& ctx = instance_params.fragment_instance_ctx;
+    rpc_instance->fragment_instance_id = ctx.fragment_instance_id;
+    rpc_instance->per_fragment_instance_idx = ctx.per_fragment_instance_idx;
+    rpc_instance->num_fragment_instances = ctx.num_fragment_instances;
+    rpc_instance->fragment_instance_idx = ctx.fragment_instance_idx;
+    if (instance_params.__isset.reserved_resource) {
+      rpc_instance->__set_reserved_resource(instance_params.reserved_resource);
+      rpc_instance->__set_local_resource_address(instance_params.local_resource_address);
+    }
+  }
+  const TNetworkAddress& impalad_address = exec_states[0]->impalad_address();
+  VLOG_FILE << "making rpc: ExecPlanFragments query_id=" << query_id_
+            << " num_instances=" << exec_states.size()
+            << " num_fragments=" << rpc_params.fragments.size()
+            << " host=" << impalad_address;
+
+  // Guard against concurrent UpdateExecStatus() that may arrive after RPC returns.
+  list<lock_guard<mutex> > locks;
+  BOOST_FOREACH(FragmentInstanceState* exec_state, exec_states) {
+    locks.emplace_back(*exec_state->lock());
+  }
+  int64_t start = MonotonicMillis();
+
+  Status client_connect_status;
+  ImpalaInternalServiceConnection backend_client(exec_env_->impalad_client_cache(),
+      impalad_address, &client_connect_status);
+  if (!client_connect_status.ok()) {
+    BOOST_FOREACH(FragmentInstanceState* exec_state, exec_states) {
+      exec_state->SetInitialStatus(client_connect_status);
+    }
+    return;
+  }
+
+  TExecPlanFragmentsResult thrift_result;
+  Status rpc_status = backend_client.DoRpc(
+      &ImpalaInternalServiceClient::ExecPlanFragments, rpc_params, &thrift_result);
+  if (rpc_status.ok() && thrift_result.statuses.size() != exec_states.size()) {
+    rpc_status = Status(Substitute("Expected $0 statuses, got $1", exec_states.size(),
+        thrift_result.statuses.size()));
+  }
+
+  int64_t rpc_latency = MonotonicMillis() - start;
+  const string ERR_TEMPLATE = "ExecPlanRequest rpc query_id=$0 instance_id=$1 failed: $2";
+  for (int i = 0; i < exec_states.size(); ++i) {
+    FragmentInstanceState* exec_state = exec_states[i];
+    exec_state->SetRpcLatency(rpc_latency);
+    Status exec_plan_status = rpc_status;
+    if (rpc_status.ok()) exec_plan_status = Status(thrift_result.statuses[i]);
+    if (!exec_plan_status.ok()) {
+      const string& err_msg = Substitute(ERR_TEMPLATE, PrintId(query_id()),
+          PrintId(exec_state->fragment_instance_id()),
+          exec_plan_status.msg().GetFullMessageDetails());
+      VLOG_QUERY << err_msg;
+      exec_state->SetInitialStatus(Status(err_msg));
+      continue;
+    }
+    exec_state->SetInitialStatus(Status::OK());
+  }
+}
+
 void Coordinator::Cancel(const Status* cause) {
   lock_guard<mutex> l(lock_);
   // if the query status indicates an error, cancellation has already been initiated
@@ -1391,6 +1572,10 @@ void Coordinator::CancelInternal() {
 }
 
 void Coordinator::CancelRemoteFragments() {
+  // Pick the instances to cancel first so that the rpcs below can be sent in parallel:
+  // with many backends, sending them one after the other makes cancellation take as long
+  // as the sum of all round trips.
+  vector<FragmentInstanceState*> to_cancel;
   for (int i = 0; i < fragment_instance_states_.size(); ++i) {
     FragmentInstanceState* exec_state = fragment_instance_states_[i];
 
@@ -1415,42 +1600,60 @@ void Coordinator::CancelRemoteFragments() {
 
     // set an error status to make sure we only cancel this once
     exec_state->SetStatus(Status::CANCELLED);
+    to_cancel.push_back(exec_state);
+  }
 
-    // if we get an error while trying to get a connection to the backend,
-    // keep going
-    Status status;
-    ImpalaInternalServiceConnection backend_client(
-        exec_env_->impalad_client_cache(), exec_state->impalad_address(), &status);
-    if (!status.ok()) continue;
-
-    TCancelPlanFragmentParams params;
-    params.protocol_version = ImpalaInternalServiceVersion::V1;
-    params.__set_fragment_instance_id(exec_state->fragment_instance_id());
-    TCancelPlanFragmentResult res;
-    VLOG_QUERY << "sending CancelPlanFragment rpc for instance_id="
-               << exec_state->fragment_instance_id() << " backend="
-               << exec_state->impalad_address();
-    Status rpc_status = backend_client.DoRpc(
-        &ImpalaInternalServiceClient::CancelPlanFragment, params, &res);
-    if (!rpc_status.ok()) {
-      exec_state->status()->MergeStatus(rpc_status);
-      stringstream msg;
-      msg << "CancelPlanFragment rpc query_id=" << query_id_
-          << " instance_id=" << exec_state->fragment_instance_id()
-          << " failed: " << rpc_status.msg().msg();
-      // make a note of the error status, but keep on cancelling the other fragments
-      exec_state->status()->AddDetail(msg.str());
-      continue;
-    }
-    if (res.status.status_code != TErrorCode::OK) {
-      exec_state->status()->AddDetail(join(res.status.error_msgs, "; "));
+  if (!to_cancel.empty()) {
+    CountingBarrier cancel_barrier(to_cancel.size());
+    BOOST_FOREACH(FragmentInstanceState* exec_state, to_cancel) {
+      bool offered = exec_env_->fragment_exec_thread_pool()->Offer(
+          bind<void>(mem_fn(&Coordinator::CancelRemoteFragment), this, exec_state,
+              &cancel_barrier));
+      if (!offered) CancelRemoteFragment(exec_state, &cancel_barrier);
     }
+    cancel_barrier.Wait();
   }
 
   // notify that we completed with an error
   backend_completion_cv_.notify_all();
 }
 
+void Coordinator::CancelRemoteFragment(FragmentInstanceState* exec_state,
+    CountingBarrier* barrier) {
+  NotifyBarrierOnExit notifier(barrier);
+  // if we get an error while trying to get a connection to the backend,
+  // keep going
+  Status status;
+  ImpalaInternalServiceConnection backend_client(
+      exec_env_->impalad_client_cache(), exec_state->impalad_address(), &status);
+  if (!status.ok()) return;
+
+  TCancelPlanFragmentParams params;
+  params.protocol_version = ImpalaInternalServiceVersion::V1;
+  params.__set_fragment_instance_id(exec_state->fragment_instance_id());
+  TCancelPlanFragmentResult res;
+  VLOG_QUERY << "sending CancelPlanFragment rpc for instance_id="
+             << exec_state->fragment_instance_id() << " backend="
+             << exec_state->impalad_address();
+  Status rpc_status = backend_client.DoRpc(
+      &ImpalaInternalServiceClient::CancelPlanFragment, params, &res);
+
+  lock_guard<mutex> l(*exec_state->lock());
+  if (!rpc_status.ok()) {
+    exec_state->status()->MergeStatus(rpc_status);
+    stringstream msg;
+    msg << "CancelPlanFragment rpc query_id=" << query_id_
+        << " instance_id=" << exec_state->fragment_instance_id()
+        << " failed: " << rpc_status.msg().msg();
+    // make a note of the error status, but keep on cancelling the other fragments
+    exec_state->status()->AddDetail(msg.str());
+    return;
+  }
+  if (res.status.status_code != TErrorCode::OK) {
+    exec_state->status()->AddDetail(join(res.status.error_msgs, "; "));
+  }
+}
+
 Status Coordinator::UpdateFragmentExecStatus(const TReportExecStatusParams& params) {
   VLOG_FILE << "UpdateFragmentExecStatus() query_id=" << query_id_
             << " status=" << params.status.status_code
@@ -1601,6 +1804,15 @@ bool Coordinator::PrepareCatalogUpdate(TUpdateCatalogRequest* catalog_update) {
 
   BOOST_FOREACH(const PartitionStatusMap::value_type& partition, per_partition_status_) {
     catalog_update->created_partitions.insert(partition.first);
+    // Pass on the column stats that the table sinks gathered.
+    const TInsertStats& stats = partition.second.stats;
+    if (stats.__isset.column_stats) {
+      TPartitionStats* partition_stats =
+          &catalog_update->partition_stats[partition.first];
+      partition_stats->stats.__set_num_rows(partition.second.num_appended_rows);
+      partition_stats->__set_intermediate_col_stats(stats.column_stats);
+      catalog_update->__isset.partition_stats = true;
+    }
   }
 
   return catalog_update->created_partitions.size() != 0;
@@ -1647,32 +1859,60 @@ void Coordinator::ComputeFragmentSummaryStats(
   data.root_profile->AddChild(fragment_instance_state->profile());
 }
 
+// Returns the value of the counter 'name' of 'profile', or 0 if it has none.
+static int64_t GetCounterValue(RuntimeProfile* profile, const string& name) {
+  RuntimeProfile::Counter* counter = profile->GetCounter(name);
+  return counter == NULL ? 0 : counter->value();
+}
+
 void Coordinator::UpdateExecSummary(int fragment_idx, int instance_idx,
     RuntimeProfile* profile) {
   vector<RuntimeProfile*> children;
   profile->GetAllChildren(&children);
 
-  lock_guard<SpinLock> l(exec_summary_lock_);
+  // Read the counters before taking the lock, which is shared by all status reports of
+  // the query.
+  vector<pair<int, TExecStats> > node_stats;
+  node_stats.reserve(children.size());
   for (int i = 0; i < children.size(); ++i) {
     int id = ExecNode::GetNodeIdFromProfile(children[i]);
     if (id == -1) continue;
+    node_stats.push_back(make_pair(id, TExecStats()));
+    TExecStats& stats = node_stats.back().second;
+    RuntimeProfile::Counter* rows_counter = children[i]->GetCounter("RowsReturned");
+    RuntimeProfile::Counter* mem_counter = children[i]->GetCounter("PeakMemoryUsage");
+    if (rows_counter != NULL) stats.__set_cardinality(rows_counter->value());
+    if (mem_counter != NULL) stats.__set_memory_used(mem_counter->value());
+    stats.__set_latency_ns(children[i]->local_time());
+    // The CPU time of the node's own work in the main thread plus that of its scanner
+    // threads, if it is a scan node.
+    const string& scanner_prefix = ScanNode::SCANNER_THREAD_COUNTERS_PREFIX;
+    int64_t user_time = GetCounterValue(children[i], ExecNode::LOCAL_USER_TIME_COUNTER) +
+        GetCounterValue(children[i], scanner_prefix + "UserTime");
+    int64_t sys_time = GetCounterValue(children[i], ExecNode::LOCAL_SYS_TIME_COUNTER) +
+        GetCounterValue(children[i], scanner_prefix + "SysTime");
+    stats.__set_user_cpu_time_ns(user_time);
+    stats.__set_sys_cpu_time_ns(sys_time);
+    stats.__set_cpu_time_ns(user_time + sys_time);
+    stats.__set_io_wait_ns(GetCounterValue(children[i], ExecNode::IO_WAIT_TIMER));
+    // Only the data stream receivers of exchange nodes mark time as inactive.
+    stats.__set_exchange_wait_ns(children[i]->inactive_timer()->value());
+    stats.__set_runtime_filter_wait_ns(
+        GetCounterValue(children[i], ExecNode::RUNTIME_FILTER_WAIT_TIMER));
+    stats.__set_spill_wait_ns(GetCounterValue(children[i], ExecNode::SPILL_WAIT_TIMER));
+  }
 
+  lock_guard<SpinLock> l(exec_summary_lock_);
+  for (int i = 0; i < node_stats.size(); ++i) {
     TPlanNodeExecSummary& exec_summary =
-        exec_summary_.nodes[plan_node_id_to_summary_map_[id]];
+        exec_summary_.nodes[plan_node_id_to_summary_map_[node_stats[i].first]];
     if (exec_summary.exec_stats.empty()) {
       // First time, make an exec_stats for each instance this plan node is running on.
       DCHECK_LT(fragment_idx, fragment_profiles_.size());
       exec_summary.exec_stats.resize(fragment_profiles_[fragment_idx].num_instances);
     }
     DCHECK_LT(instance_idx, exec_summary.exec_stats.size());
-    TExecStats& stats = exec_summary.exec_stats[instance_idx];
-
-    RuntimeProfile::Counter* rows_counter = children[i]->GetCounter("RowsReturned");
-    RuntimeProfile::Counter* mem_counter = children[i]->GetCounter("PeakMemoryUsage");
-    if (rows_counter != NULL) stats.__set_cardinality(rows_counter->value());
-    if (mem_counter != NULL) stats.__set_memory_used(mem_counter->value());
-    stats.__set_latency_ns(children[i]->local_time());
-    // TODO: we don't track cpu time per node now. Do that.
+    exec_summary.exec_stats[instance_idx] = node_stats[i].second;
     exec_summary.__isset.exec_stats = true;
   }
   VLOG(2) << PrintExecSummary(exec_summary_);
@@ -1746,31 +1986,8 @@ void Coordinator::ReportQuerySummary() {
     }
 
     // Add per node peak memory usage as InfoString
-    // Map from Impalad address to peak memory usage of this query
-    typedef unordered_map<TNetworkAddress, int64_t> PerNodePeakMemoryUsage;
     PerNodePeakMemoryUsage per_node_peak_mem_usage;
-    if (executor_.get() != NULL) {
-      // Coordinator fragment is not included in fragment_instance_states_.
-      RuntimeProfile::Counter* mem_usage_counter =
-          executor_->profile()->GetCounter(
-              PlanFragmentExecutor::PER_HOST_PEAK_MEM_COUNTER);
-      if (mem_usage_counter != NULL) {
-        TNetworkAddress coord = MakeNetworkAddress(FLAGS_hostname, FLAGS_be_port);
-        per_node_peak_mem_usage[coord] = mem_usage_counter->value();
-      }
-    }
-    for (int i = 0; i < fragment_instance_states_.size(); ++i) {
-      int64_t initial_usage = 0;
-      int64_t* mem_usage = FindOrInsert(&per_node_peak_mem_usage,
-          fragment_instance_states_[i]->impalad_address(), initial_usage);
-      RuntimeProfile::Counter* mem_usage_counter =
-          fragment_instance_states_[i]->profile()->GetCounter(
-              PlanFragmentExecutor::PER_HOST_PEAK_MEM_COUNTER);
-      if (mem_usage_counter != NULL && mem_usage_counter->value() > *mem_usage) {
-        per_node_peak_mem_usage[fragment_instance_states_[i]->impalad_address()] =
-            mem_usage_counter->value();
-      }
-    }
+    GetPerNodePeakMemUsage(&per_node_peak_mem_usage);
     stringstream info;
     BOOST_FOREACH(PerNodePeakMemoryUsage::value_type entry, per_node_peak_mem_usage) {
       info << entry.first << "("
@@ -1780,6 +1997,62 @@ void Coordinator::ReportQuerySummary() {
   }
 }
 
+void Coordinator::GetPerNodePeakMemUsage(PerNodePeakMemoryUsage* usage) {
+  if (executor_.get() != NULL) {
+    // Coordinator fragment is not included in fragment_instance_states_.
+    RuntimeProfile::Counter* mem_usage_counter =
+        executor_->profile()->GetCounter(
+            PlanFragmentExecutor::PER_HOST_PEAK_MEM_COUNTER);
+    if (mem_usage_counter != NULL) {
+      TNetworkAddress coord = MakeNetworkAddress(FLAGS_hostname, FLAGS_be_port);
+      (*usage)[coord] = mem_usage_counter->value();
+    }
+  }
+  for (int i = 0; i < fragment_instance_states_.size(); ++i) {
+    int64_t initial_usage = 0;
+    int64_t* mem_usage = FindOrInsert(usage,
+        fragment_instance_states_[i]->impalad_address(), initial_usage);
+    RuntimeProfile::Counter* mem_usage_counter =
+        fragment_instance_states_[i]->profile()->GetCounter(
+            PlanFragmentExecutor::PER_HOST_PEAK_MEM_COUNTER);
+    if (mem_usage_counter != NULL && mem_usage_counter->value() > *mem_usage) {
+      *mem_usage = mem_usage_counter->value();
+    }
+  }
+}
+
+int64_t Coordinator::GetMaxPerNodePeakMemUsage() {
+  PerNodePeakMemoryUsage per_node_peak_mem_usage;
+  GetPerNodePeakMemUsage(&per_node_peak_mem_usage);
+  int64_t max_usage = -1;
+  BOOST_FOREACH(const PerNodePeakMemoryUsage::value_type& entry,
+      per_node_peak_mem_usage) {
+    max_usage = max(max_usage, entry.second);
+  }
+  return max_usage;
+}
+
+// Returns the number of bytes written by the block mgr whose profile is a child of
+// 'profile', or 0 if there is none.
+static int64_t GetSpilledBytes(RuntimeProfile* profile) {
+  vector<RuntimeProfile*> children;
+  profile->GetChildren(&children);
+  BOOST_FOREACH(RuntimeProfile* child, children) {
+    if (child->name() == "BlockMgr") return GetCounterValue(child, "BytesWritten");
+  }
+  return 0;
+}
+
+int64_t Coordinator::GetTotalSpilledBytes() {
+  // There is one block mgr per query and backend, whose profile is added to the profile
+  // of the fragment instance that created it.
+  int64_t total = executor_.get() == NULL ? 0 : GetSpilledBytes(executor_->profile());
+  for (int i = 0; i < fragment_instance_states_.size(); ++i) {
+    total += GetSpilledBytes(fragment_instance_states_[i]->profile());
+  }
+  return total;
+}
+
 string Coordinator::GetErrorLog() {
   ErrorLogMap merged;
   {
@@ -1825,6 +2098,18 @@ void Coordinator::SetExecPlanFragmentParams(QuerySchedule& schedule,
           // all its targets or none, and the none case is handled by checking if the
           // filter is in the routing table.
           required_filters.push_back(desc);
+          if (plan_node.__isset.hash_join_node && !desc.is_broadcast_join
+              && !desc.has_local_target
+              && fragment_idx < num_instances_per_host_.size()) {
+            // The instances on the same backend merge their filters before sending them.
+            const unordered_map<TNetworkAddress, int>& num_instances =
+                num_instances_per_host_[fragment_idx];
+            unordered_map<TNetworkAddress, int>::const_iterator it =
+                num_instances.find(params.hosts[per_fragment_instance_idx]);
+            if (it != num_instances.end() && it->second > 1) {
+              required_filters.back().__set_num_local_producers(it->second);
+            }
+          }
         }
         plan_node.__set_runtime_filters(required_filters);
       }
@@ -1848,13 +2133,18 @@ void Coordinator::SetExecPlanFragmentParams(QuerySchedule& schedule,
     }
   }
   rpc_params->params.__set_request_pool(schedule.request_pool());
-  FragmentScanRangeAssignment::const_iterator it =
-      params.scan_range_assignment.find(exec_host);
-  // Scan ranges may not always be set, so use an empty structure if so.
-  const PerNodeScanRanges& scan_ranges =
-      (it != params.scan_range_assignment.end()) ? it->second : PerNodeScanRanges();
-
-  rpc_params->params.__set_per_node_scan_ranges(scan_ranges);
+  if (!params.per_instance_scan_ranges.empty()) {
+    DCHECK_EQ(params.per_instance_scan_ranges.size(), params.hosts.size());
+    rpc_params->params.__set_per_node_scan_ranges(
+        params.per_instance_scan_ranges[per_fragment_instance_idx]);
+  } else {
+    FragmentScanRangeAssignment::const_iterator it =
+        params.scan_range_assignment.find(exec_host);
+    // Scan ranges may not always be set, so use an empty structure if so.
+    const PerNodeScanRanges& scan_ranges =
+        (it != params.scan_range_assignment.end()) ? it->second : PerNodeScanRanges();
+    rpc_params->params.__set_per_node_scan_ranges(scan_ranges);
+  }
   rpc_params->params.__set_per_exch_num_senders(params.per_exch_num_senders);
   rpc_params->params.__set_destinations(params.destinations);
   rpc_params->params.__set_sender_id(params.sender_id_base + per_fragment_instance_idx);
@@ -1934,24 +2224,6 @@ void Coordinator::SetExecPlanDescriptorTable(const TPlanFragment& fragment,
 
   rpc_params->__set_desc_tbl(thrift_desc_tbl);
 }
-namespace {
-
-void DistributeFilters(shared_ptr<TPublishFilterParams> params, TNetworkAddress impalad,
-    TUniqueId fragment_instance_id) {
-  Status status;
-  ImpalaInternalServiceConnection backend_client(
-      ExecEnv::GetInstance()->impalad_client_cache(), impalad, &status);
-  if (!status.ok()) return;
-  // Make a local copy of the shared 'master' set of parameters
-  TPublishFilterParams local_params(*params);
-  local_params.dst_instance_id = fragment_instance_id;
-  local_params.__set_bloom_filter(params->bloom_filter);
-  TPublishFilterResult res;
-  backend_client.DoRpc(&ImpalaInternalServiceClient::PublishFilter, local_params, &res);
-};
-
-}
-
 void Coordinator::UpdateFilter(const TUpdateFilterParams& params) {
   DCHECK(exec_complete_barrier_.get() != NULL)
       << "Filters received before fragments started!";
@@ -1984,7 +2256,9 @@ void Coordinator::UpdateFilter(const TUpdateFilterParams& params) {
     if (state->first_arrival_time == 0L) {
       state->first_arrival_time = query_events_->ElapsedTime();
     }
-    --state->pending_count;
+    // The filter may be merged from the filters of several instances on one backend.
+    DCHECK_LE(params.num_producers, state->pending_count);
+    state->pending_count -= params.num_producers;
 
     if (filter_updates_received_->value() == 0) {
       query_events_->MarkEvent("First dynamic filter received");
@@ -1997,6 +2271,17 @@ void Coordinator::UpdateFilter(const TUpdateFilterParams& params) {
       // TODO: Implement BloomFilter::Or(const ThriftBloomFilter&)
       state->bloom_filter->Or(*bloom_filter);
     }
+    // The range is only known if every producer sent one.
+    if (!params.bloom_filter.__isset.min_max) {
+      state->min_max_unknown = true;
+    } else if (!state->min_max_unknown) {
+      MinMaxFilter update(params.bloom_filter.min_max);
+      if (state->min_max_filter == NULL) {
+        state->min_max_filter = obj_pool()->Add(new MinMaxFilter(update));
+      } else {
+        state->min_max_filter->Or(update);
+      }
+    }
 
     if (state->pending_count > 0) return;
     // No more filters are pending on this filter ID. Create a distribution payload and
@@ -2004,17 +2289,33 @@ void Coordinator::UpdateFilter(const TUpdateFilterParams& params) {
     state->completion_time = query_events_->ElapsedTime();
     target_fragment_instance_idxs = state->target_fragment_instance_idxs;
     state->bloom_filter->ToThrift(&rpc_params->bloom_filter);
+    if (!state->min_max_unknown && state->min_max_filter != NULL) {
+      TMinMaxFilter min_max;
+      state->min_max_filter->ToThrift(&min_max);
+      rpc_params->bloom_filter.__set_min_max(min_max);
+    }
   }
 
   rpc_params->filter_id = params.filter_id;
 
+  // Send one rpc per backend, for all of its target instances, and let the backends
+  // forward the filter to each other.
+  vector<TPublishFilterTarget> targets;
+  unordered_map<TNetworkAddress, int> target_idxs;
   for (int idx: target_fragment_instance_idxs) {
     FragmentInstanceState* fragment_inst = fragment_instance_states_[idx];
     DCHECK(fragment_inst != NULL) << "Missing fragment instance: " << idx;
-
-    exec_env_->rpc_pool()->Offer(bind<void>(DistributeFilters, rpc_params,
-        fragment_inst->impalad_address(), fragment_inst->fragment_instance_id()));
+    const TNetworkAddress& address = fragment_inst->impalad_address();
+    unordered_map<TNetworkAddress, int>::iterator it = target_idxs.find(address);
+    if (it == target_idxs.end()) {
+      it = target_idxs.insert(make_pair(address, targets.size())).first;
+      targets.push_back(TPublishFilterTarget());
+      targets.back().address = address;
+    }
+    targets[it->second].dst_instance_ids.push_back(
+        fragment_inst->fragment_instance_id());
   }
+  FragmentMgr::PublishFilterToHosts(rpc_params, targets);
 }
 
 }
@@ -46,6 +46,7 @@ namespace impala {
 
 class CountingBarrier;
 class BloomFilter;
+class MinMaxFilter;
 class DataStreamMgr;
 class DataSink;
 class RowBatch;
@@ -67,6 +68,7 @@ class RuntimeProfile;
 class TablePrinter;
 
 struct DebugOptions;
+struct HdfsPathInfo;
 
 /// Query coordinator: handles execution of plan fragments on remote nodes, given
 /// a TQueryExecRequest. As part of that, it handles all interactions with the
@@ -173,6 +175,14 @@ class Coordinator {
   /// Returns query_status_.
   Status GetStatus();
 
+  /// Returns the largest peak memory usage of this query on any backend, as last
+  /// reported by the fragment instances, or -1 if none reported it.
+  int64_t GetMaxPerNodePeakMemUsage();
+
+  /// Returns the number of bytes this query spilled to disk on all backends, as last
+  /// reported by the fragment instances.
+  int64_t GetTotalSpilledBytes();
+
   /// Returns the exec summary. The exec summary lock must already have been taken.
   /// The caller must not block while holding the lock.
   const TExecSummary& exec_summary() const {
@@ -380,13 +390,22 @@ class Coordinator {
     /// destination plan fragment instances. Owned by the coordinator's object pool.
     BloomFilter* bloom_filter;
 
+    /// Range of the values in 'bloom_filter', aggregated like it. Owned by the
+    /// coordinator's object pool.
+    MinMaxFilter* min_max_filter;
+
+    /// True if some source plan node did not send a range, so the aggregated range is
+    /// unknown.
+    bool min_max_unknown;
+
     /// Time at which first local filter arrived.
     int64_t first_arrival_time;
 
     /// Time at which all local filters arrived.
     int64_t completion_time;
 
-    FilterState() : bloom_filter(NULL), first_arrival_time(0L), completion_time(0L) { }
+    FilterState() : bloom_filter(NULL), min_max_filter(NULL), min_max_unknown(false),
+        first_arrival_time(0L), completion_time(0L) { }
   };
 
   /// Protects filter_routing_table_.
@@ -400,6 +419,11 @@ class Coordinator {
   /// safe to concurrently read from filter_routing_table_.
   bool filter_routing_table_complete_;
 
+  /// In GLOBAL filter mode, the number of instances of each fragment on each backend.
+  /// Set for each fragment before its instances are started. Used to set
+  /// TRuntimeFilterDesc.num_local_producers.
+  std::vector<boost::unordered_map<TNetworkAddress, int> > num_instances_per_host_;
+
   /// Total number of filter updates received (always 0 if filter mode is not
   /// GLOBAL). Excludes repeated broadcast filter updates.
   RuntimeProfile::Counter* filter_updates_received_;
@@ -429,6 +453,23 @@ class Coordinator {
       QuerySchedule* schedule, int fragment_instance_idx, int fragment_idx,
       int per_fragment_instance_idx);
 
+  /// The arguments of ExecRemoteFragment() for one fragment instance.
+  struct RemoteFragmentInstance {
+    const FragmentExecParams* fragment_exec_params;
+    const TPlanFragment* plan_fragment;
+    DebugOptions* debug_options;
+    int fragment_instance_idx;
+    int fragment_idx;
+    int per_fragment_instance_idx;
+  };
+
+  /// Like ExecRemoteFragment(), but starts all 'instances', which run on the same
+  /// impalad, with a single ExecPlanFragments() RPC. The query context is sent once, and
+  /// the fragment and descriptor table once for the instances of each fragment that
+  /// have the same ones.
+  void ExecRemoteFragments(const std::vector<RemoteFragmentInstance>* instances,
+      QuerySchedule* schedule);
+
   /// Determine fragment number, given fragment id.
   int GetFragmentNum(const TUniqueId& fragment_id);
 
@@ -459,6 +500,10 @@ class Coordinator {
   /// reached.
   void CancelRemoteFragments();
 
+  /// Sends the CancelPlanFragment rpc for 'exec_state' and records a failure in its
+  /// status. Runs in fragment_exec_thread_pool() and notifies 'barrier' when done.
+  void CancelRemoteFragment(FragmentInstanceState* exec_state, CountingBarrier* barrier);
+
   /// Acquires lock_ and updates query_status_ with 'status' if it's not already
   /// an error status, and returns the current query_status_.
   /// Calls CancelInternal() when switching to an error status.
@@ -502,6 +547,13 @@ class Coordinator {
   /// a query -- remote fragments' profiles must not be updated while this is running.
   void ReportQuerySummary();
 
+  /// Map from Impalad address to peak memory usage of this query
+  typedef boost::unordered_map<TNetworkAddress, int64_t> PerNodePeakMemoryUsage;
+
+  /// Adds the peak memory usage of this query on each backend to 'usage', as reported
+  /// in the profiles of the fragment instances.
+  void GetPerNodePeakMemUsage(PerNodePeakMemoryUsage* usage);
+
   /// Populates the summary execution stats from the profile. Can only be called when the
   /// query is done.
   void UpdateExecSummary(int fragment_idx, int instance_idx, RuntimeProfile* profile);
@@ -514,11 +566,13 @@ class Coordinator {
   /// the most immediate ancestor of the path that does exist, i.e. the permissions that
   /// the path should inherit when created. Otherwise permissions is set to the actual
   /// permissions of the path. The PermissionCache argument is also used to cache the
-  /// output across repeated calls, to avoid repeatedly calling hdfsGetPathInfo() on the
-  /// same path.
+  /// output across repeated calls. 'path_infos' must contain the results of
+  /// GET_PATH_INFO operations for all prefixes of path_str, which
+  /// FinalizeSuccessfulInsert() looks up in parallel for all partitions.
   typedef boost::unordered_map<std::string, std::pair<bool, short> > PermissionCache;
-  void PopulatePathPermissionCache(hdfsFS fs, const std::string& path_str,
-      PermissionCache* permissions_cache);
+  typedef boost::unordered_map<std::string, HdfsPathInfo> PathInfoMap;
+  void PopulatePathPermissionCache(const std::string& path_str,
+      const PathInfoMap& path_infos, PermissionCache* permissions_cache);
 
   /// Validates that all collection-typed slots in the given batch are set to NULL.
   /// See SubplanNode for details on when collection-typed slots are set to NULL.
@@ -0,0 +1,105 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "testutil/gtest-util.h"
+#include "runtime/data-cache.h"
+#include "util/cpu-info.h"
+#include "util/thread.h"
+
+#include "common/names.h"
+
+namespace impala {
+
+const char* CACHE_DIR = "/tmp/impala-data-cache-test";
+const int ENTRY_LEN = 1024;
+
+class DataCacheTest : public testing::Test {
+ protected:
+  // Fills 'data' with a pattern that depends on 'seed'.
+  void FillData(int seed, uint8_t* data) {
+    for (int i = 0; i < ENTRY_LEN; ++i) data[i] = seed + i;
+  }
+
+  // Stores the entry for 'seed' at offset seed * ENTRY_LEN and waits for it to be
+  // written. Returns the number of evicted entries.
+  int StoreEntry(DataCache* cache, const string& file, int seed) {
+    uint8_t data[ENTRY_LEN];
+    FillData(seed, data);
+    int num_evicted = cache->Store(file, 1, seed * ENTRY_LEN, ENTRY_LEN, data);
+    cache->WaitForPendingWrites();
+    return num_evicted;
+  }
+
+  // Returns true if the entry for 'seed' is in the cache and has the right contents.
+  bool HasEntry(DataCache* cache, const string& file, int seed) {
+    uint8_t expected[ENTRY_LEN];
+    uint8_t data[ENTRY_LEN];
+    FillData(seed, expected);
+    if (!cache->Lookup(file, 1, seed * ENTRY_LEN, ENTRY_LEN, data)) return false;
+    EXPECT_EQ(0, memcmp(expected, data, ENTRY_LEN));
+    return true;
+  }
+};
+
+TEST_F(DataCacheTest, Basic) {
+  DataCache cache(CACHE_DIR, 10 * ENTRY_LEN);
+  ASSERT_OK(cache.Init());
+  EXPECT_FALSE(HasEntry(&cache, "file", 0));
+  EXPECT_EQ(0, StoreEntry(&cache, "file", 0));
+  EXPECT_EQ(0, StoreEntry(&cache, "file", 1));
+  EXPECT_TRUE(HasEntry(&cache, "file", 0));
+  EXPECT_TRUE(HasEntry(&cache, "file", 1));
+  EXPECT_FALSE(HasEntry(&cache, "other_file", 0));
+  EXPECT_EQ(2 * ENTRY_LEN, cache.size());
+
+  // The key includes the mtime and the length.
+  uint8_t data[ENTRY_LEN];
+  EXPECT_FALSE(cache.Lookup("file", 2, 0, ENTRY_LEN, data));
+  EXPECT_FALSE(cache.Lookup("file", 1, 0, ENTRY_LEN - 1, data));
+
+  // Storing an existing entry is a no-op.
+  EXPECT_EQ(0, StoreEntry(&cache, "file", 0));
+  EXPECT_EQ(2 * ENTRY_LEN, cache.size());
+
+  // Entries larger than the cache are not stored.
+  vector<uint8_t> large(11 * ENTRY_LEN);
+  EXPECT_EQ(0, cache.Store("file", 1, 0, large.size(), &large[0]));
+  cache.WaitForPendingWrites();
+  EXPECT_EQ(2 * ENTRY_LEN, cache.size());
+}
+
+TEST_F(DataCacheTest, Eviction) {
+  const int num_entries = 4;
+  DataCache cache(CACHE_DIR, num_entries * ENTRY_LEN);
+  ASSERT_OK(cache.Init());
+  for (int i = 0; i < num_entries; ++i) EXPECT_EQ(0, StoreEntry(&cache, "file", i));
+
+  // Touch entry 0 so that entry 1 is the least recently used one.
+  EXPECT_TRUE(HasEntry(&cache, "file", 0));
+  EXPECT_EQ(1, StoreEntry(&cache, "file", num_entries));
+  EXPECT_FALSE(HasEntry(&cache, "file", 1));
+  EXPECT_TRUE(HasEntry(&cache, "file", 0));
+  for (int i = 2; i <= num_entries; ++i) EXPECT_TRUE(HasEntry(&cache, "file", i));
+  EXPECT_EQ(1, cache.num_evictions());
+  EXPECT_EQ(num_entries * ENTRY_LEN, cache.size());
+}
+
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  impala::CpuInfo::Init();
+  impala::InitThreading();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,227 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "runtime/data-cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sstream>
+#include <boost/functional/hash.hpp>
+#include <gutil/strings/substitute.h>
+
+#include "util/error-util.h"
+#include "util/filesystem-util.h"
+#include "util/thread.h"
+
+#include "common/names.h"
+
+using namespace impala;
+using namespace strings;
+
+const int64_t DataCache::MAX_PENDING_WRITE_BYTES = 64L * 1024L * 1024L;
+
+namespace impala {
+
+size_t hash_value(const DataCache::CacheKey& key) {
+  size_t seed = 0;
+  boost::hash_combine(seed, key.filename);
+  boost::hash_combine(seed, key.mtime);
+  boost::hash_combine(seed, key.offset);
+  boost::hash_combine(seed, key.len);
+  return seed;
+}
+
+}
+
+DataCache::DataCache(const string& dir, int64_t capacity)
+  : dir_(dir),
+    capacity_(capacity),
+    size_(0),
+    pending_write_bytes_(0),
+    next_file_idx_(0),
+    shut_down_(false) {
+}
+
+DataCache::~DataCache() {
+  {
+    lock_guard<mutex> l(lock_);
+    shut_down_ = true;
+  }
+  write_queued_cv_.notify_all();
+  if (writer_thread_.get() != NULL) writer_thread_->Join();
+
+  lock_guard<mutex> l(lock_);
+  while (!pending_writes_.empty()) {
+    free(pending_writes_.front().data);
+    pending_writes_.pop_front();
+  }
+  while (!lru_list_.empty()) RemoveEntry(lru_list_.begin());
+}
+
+Status DataCache::Init() {
+  DCHECK(writer_thread_.get() == NULL);
+  RETURN_IF_ERROR(FileSystemUtil::CreateDirectory(dir_));
+  writer_thread_.reset(
+      new Thread("disk-io-mgr", "data-cache-writer", &DataCache::WriterLoop, this));
+  return Status::OK();
+}
+
+bool DataCache::Lookup(const string& filename, int64_t mtime, int64_t offset,
+    int64_t len, uint8_t* buffer) {
+  CacheKey key = {filename, mtime, offset, len};
+  string path;
+  {
+    lock_guard<mutex> l(lock_);
+    EntryMap::iterator it = entries_.find(key);
+    if (it == entries_.end() || !it->second->ready) return false;
+    // Move to the back, this is now the most recently used entry.
+    lru_list_.splice(lru_list_.end(), lru_list_, it->second);
+    path = it->second->path;
+  }
+
+  // The entry may be evicted concurrently. Once the file is open, the data stays
+  // readable even if it is unlinked.
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) return false;
+  int64_t bytes_read = 0;
+  while (bytes_read < len) {
+    ssize_t n = pread(fd, buffer + bytes_read, len - bytes_read, bytes_read);
+    if (n == -1 && errno == EINTR) continue;
+    if (n <= 0) break;
+    bytes_read += n;
+  }
+  close(fd);
+  if (bytes_read != len) {
+    LOG(WARNING) << "Failed to read data cache file " << path << ": "
+                 << GetStrErrMsg();
+    return false;
+  }
+  return true;
+}
+
+int DataCache::Store(const string& filename, int64_t mtime, int64_t offset,
+    int64_t len, const uint8_t* data) {
+  if (len > capacity_) return 0;
+  CacheKey key = {filename, mtime, offset, len};
+  int num_evicted = 0;
+  PendingWrite write;
+  {
+    lock_guard<mutex> l(lock_);
+    if (shut_down_) return 0;
+    if (entries_.find(key) != entries_.end()) return 0;
+    if (pending_write_bytes_ + len > MAX_PENDING_WRITE_BYTES) return 0;
+
+    // Evict until the new entry fits. Entries that are still being written can't be
+    // evicted, give up if they alone fill the cache.
+    EntryList::iterator it = lru_list_.begin();
+    while (size_ + len > capacity_ && it != lru_list_.end()) {
+      if (!it->ready) {
+        ++it;
+        continue;
+      }
+      EntryList::iterator victim = it++;
+      RemoveEntry(victim);
+      ++num_evicted;
+    }
+    num_evictions_ += num_evicted;
+    if (size_ + len > capacity_) return num_evicted;
+
+    Entry entry;
+    entry.key = key;
+    entry.path = Substitute("$0/entry-$1", dir_, next_file_idx_++);
+    entry.ready = false;
+    entries_[key] = lru_list_.insert(lru_list_.end(), entry);
+    size_ += len;
+
+    write.key = key;
+    write.path = entry.path;
+    write.data = reinterpret_cast<uint8_t*>(malloc(len));
+    memcpy(write.data, data, len);
+    pending_writes_.push_back(write);
+    pending_write_bytes_ += len;
+  }
+  write_queued_cv_.notify_one();
+  return num_evicted;
+}
+
+void DataCache::WaitForPendingWrites() {
+  unique_lock<mutex> l(lock_);
+  while (!pending_writes_.empty()) writes_done_cv_.wait(l);
+}
+
+int64_t DataCache::size() {
+  lock_guard<mutex> l(lock_);
+  return size_;
+}
+
+void DataCache::WriterLoop() {
+  while (true) {
+    PendingWrite write;
+    {
+      unique_lock<mutex> l(lock_);
+      while (pending_writes_.empty() && !shut_down_) write_queued_cv_.wait(l);
+      if (shut_down_) return;
+      // Leave the write on the queue until it is done, so that WaitForPendingWrites()
+      // doesn't return early.
+      write = pending_writes_.front();
+    }
+
+    Status status = WriteFile(write.path, write.data, write.key.len);
+    free(write.data);
+
+    {
+      lock_guard<mutex> l(lock_);
+      pending_writes_.pop_front();
+      pending_write_bytes_ -= write.key.len;
+      EntryMap::iterator it = entries_.find(write.key);
+      DCHECK(it != entries_.end());
+      if (status.ok()) {
+        it->second->ready = true;
+      } else {
+        LOG(WARNING) << "Failed to write to the data cache: " << status.GetDetail();
+        RemoveEntry(it->second);
+      }
+      if (pending_writes_.empty()) writes_done_cv_.notify_all();
+    }
+  }
+}
+
+Status DataCache::WriteFile(const string& path, const uint8_t* data, int64_t len) {
+  int fd = open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
+  if (fd == -1) {
+    return Status(Substitute("Could not create file '$0': $1", path, GetStrErrMsg()));
+  }
+  int64_t bytes_written = 0;
+  while (bytes_written < len) {
+    ssize_t n = write(fd, data + bytes_written, len - bytes_written);
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      string error_msg = GetStrErrMsg();
+      close(fd);
+      unlink(path.c_str());
+      return Status(Substitute("Could not write file '$0': $1", path, error_msg));
+    }
+    bytes_written += n;
+  }
+  close(fd);
+  return Status::OK();
+}
+
+void DataCache::RemoveEntry(EntryList::iterator it) {
+  unlink(it->path.c_str());
+  size_ -= it->key.len;
+  entries_.erase(it->key);
+  lru_list_.erase(it);
+}
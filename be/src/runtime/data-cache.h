@@ -0,0 +1,172 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_RUNTIME_DATA_CACHE_H
+#define IMPALA_RUNTIME_DATA_CACHE_H
+
+#include <list>
+#include <string>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "common/atomic.h"
+#include "common/status.h"
+
+namespace impala {
+
+class Thread;
+
+/// Process-wide cache of file contents on local storage. It is used by the DiskIoMgr to
+/// avoid re-reading hot data from remote filesystems (S3 and remote HDFS).
+///
+/// Entries are keyed by (file name, mtime, offset, length), so a file that is rewritten
+/// with a new mtime misses the cache and its stale entries age out. Each entry is stored
+/// as a separate file in the cache directory and the index is kept in memory only: the
+/// directory is wiped by Init(). When the cache is full, the least recently used entries
+/// are evicted.
+///
+/// Store() only reserves space in the index and copies the data into a queue, a
+/// background thread writes the entries to disk. This keeps local writes off the disk
+/// threads' read path. Stores are dropped if too much data is waiting to be written.
+///
+/// This class is thread-safe.
+class DataCache {
+ public:
+  /// 'dir' is the directory to store the entries in, 'capacity' the maximum number of
+  /// bytes of entries.
+  DataCache(const std::string& dir, int64_t capacity);
+
+  /// Stops the writer thread, dropping pending writes, and deletes all entries.
+  ~DataCache();
+
+  /// Creates a fresh cache directory and starts the writer thread. Must be called once
+  /// before any other method.
+  Status Init();
+
+  /// Looks up the 'len' bytes at 'offset' in 'filename' as of 'mtime'. On a hit, copies
+  /// them to 'buffer' and returns true.
+  bool Lookup(const std::string& filename, int64_t mtime, int64_t offset, int64_t len,
+      uint8_t* buffer);
+
+  /// Inserts the 'len' bytes at 'offset' in 'filename' as of 'mtime', which are in
+  /// 'data'. Returns the number of entries that were evicted to make room. 'data' is
+  /// copied and can be freed once this returns.
+  int Store(const std::string& filename, int64_t mtime, int64_t offset, int64_t len,
+      const uint8_t* data);
+
+  /// Blocks until there are no pending writes. Only used by tests.
+  void WaitForPendingWrites();
+
+  int64_t capacity() const { return capacity_; }
+
+  /// Number of bytes reserved by the entries in the cache, including pending writes.
+  int64_t size();
+
+  /// Total number of entries evicted since Init().
+  int64_t num_evictions() const { return num_evictions_; }
+
+  /// The maximum number of bytes that can be waiting to be written at any time.
+  static const int64_t MAX_PENDING_WRITE_BYTES;
+
+ private:
+  struct CacheKey {
+    std::string filename;
+    int64_t mtime;
+    int64_t offset;
+    int64_t len;
+
+    bool operator==(const CacheKey& other) const {
+      return offset == other.offset && len == other.len && mtime == other.mtime &&
+          filename == other.filename;
+    }
+  };
+  friend std::size_t hash_value(const CacheKey& key);
+
+  struct Entry {
+    CacheKey key;
+
+    /// Path of the file that holds the data.
+    std::string path;
+
+    /// False until the writer thread has written the data to 'path'.
+    bool ready;
+  };
+
+  typedef std::list<Entry> EntryList;
+  typedef boost::unordered_map<CacheKey, EntryList::iterator> EntryMap;
+
+  /// A copy of the data of an entry that still needs to be written.
+  struct PendingWrite {
+    CacheKey key;
+    std::string path;
+    uint8_t* data;
+  };
+
+  /// Loop of the writer thread: writes the pending entries to disk.
+  void WriterLoop();
+
+  /// Writes 'len' bytes of 'data' to a new file at 'path'.
+  Status WriteFile(const std::string& path, const uint8_t* data, int64_t len);
+
+  /// Removes the entry at 'it' from the index and deletes its file. 'lock_' must be
+  /// taken. Entries that are still being written may only be removed by the writer
+  /// thread or after it has stopped.
+  void RemoveEntry(EntryList::iterator it);
+
+  const std::string dir_;
+  const int64_t capacity_;
+
+  /// Written by the writer thread.
+  boost::scoped_ptr<Thread> writer_thread_;
+
+  /// Protects all members below.
+  boost::mutex lock_;
+
+  /// Signalled when a write is queued or the cache shuts down.
+  boost::condition_variable write_queued_cv_;
+
+  /// Signalled when 'pending_writes_' becomes empty.
+  boost::condition_variable writes_done_cv_;
+
+  /// All entries, in least recently used order: new and accessed entries go to the
+  /// back, evictions take from the front.
+  EntryList lru_list_;
+
+  /// Maps each key to its entry in 'lru_list_'.
+  EntryMap entries_;
+
+  /// Sum of the lengths of the entries in 'entries_'.
+  int64_t size_;
+
+  /// Entries waiting to be written by the writer thread, in FIFO order.
+  std::list<PendingWrite> pending_writes_;
+
+  /// Sum of the lengths of 'pending_writes_'.
+  int64_t pending_write_bytes_;
+
+  /// Sequence number used to name the next file.
+  int64_t next_file_idx_;
+
+  /// Set by the destructor to stop the writer thread.
+  bool shut_down_;
+
+  AtomicInt<int64_t> num_evictions_;
+};
+
+}
+
+#endif
@@ -71,14 +71,14 @@ inline uint32_t DataStreamMgr::GetHashValue(
 shared_ptr<DataStreamRecvr> DataStreamMgr::CreateRecvr(RuntimeState* state,
     const RowDescriptor& row_desc, const TUniqueId& fragment_instance_id,
     PlanNodeId dest_node_id, int num_senders, int buffer_size, RuntimeProfile* profile,
-    bool is_merging) {
+    bool is_merging, BufferedBlockMgr::Client* spill_client) {
   DCHECK(profile != NULL);
   VLOG_FILE << "creating receiver for fragment="
             << fragment_instance_id << ", node=" << dest_node_id;
   shared_ptr<DataStreamRecvr> recvr(
       new DataStreamRecvr(this, state->instance_mem_tracker(), row_desc,
           fragment_instance_id, dest_node_id, num_senders, is_merging, buffer_size,
-          profile));
+          profile, spill_client == NULL ? NULL : state, spill_client));
   size_t hash_value = GetHashValue(fragment_instance_id, dest_node_id);
   lock_guard<SpinLock> l(lock_);
   fragment_recvr_set_.insert(make_pair(fragment_instance_id, dest_node_id));
@@ -176,7 +176,11 @@ Status DataStreamMgr::AddData(const TUniqueId& fragment_instance_id,
     // and there's no unexpected error here. If already_unregistered is false,
     // FindRecvrOrWait() timed out, which is unexpected and suggests a query setup error;
     // we return DATASTREAM_SENDER_TIMEOUT to trigger tear-down of the query.
-    return already_unregistered ? Status::OK() :
+    // A receiver that was closed deliberately, e.g. because its exchange node reached
+    // its limit, returns DATASTREAM_RECVR_CLOSED so that the sender stops sending to it.
+    return already_unregistered ?
+        Status(TErrorCode::DATASTREAM_RECVR_CLOSED, PrintId(fragment_instance_id),
+            dest_node_id) :
         Status(TErrorCode::DATASTREAM_SENDER_TIMEOUT, PrintId(fragment_instance_id));
   }
   DCHECK(!already_unregistered);
@@ -184,6 +188,47 @@ Status DataStreamMgr::AddData(const TUniqueId& fragment_instance_id,
   return Status::OK();
 }
 
+Status DataStreamMgr::TryAddData(const TUniqueId& fragment_instance_id,
+    PlanNodeId dest_node_id, const TRowBatch& thrift_batch, int sender_id,
+    bool* accepted) {
+  VLOG_ROW << "TryAddData(): fragment_instance_id=" << fragment_instance_id
+           << " node=" << dest_node_id
+           << " size=" << RowBatch::GetBatchSize(thrift_batch);
+  *accepted = true;
+  bool already_unregistered;
+  shared_ptr<DataStreamRecvr> recvr = FindRecvrOrWait(fragment_instance_id, dest_node_id,
+      &already_unregistered);
+  if (recvr.get() == NULL) {
+    // See AddData().
+    return already_unregistered ?
+        Status(TErrorCode::DATASTREAM_RECVR_CLOSED, PrintId(fragment_instance_id),
+            dest_node_id) :
+        Status(TErrorCode::DATASTREAM_SENDER_TIMEOUT, PrintId(fragment_instance_id));
+  }
+  DCHECK(!already_unregistered);
+  *accepted = recvr->TryAddBatch(thrift_batch, sender_id);
+  return Status::OK();
+}
+
+Status DataStreamMgr::AddData(const TUniqueId& fragment_instance_id,
+    PlanNodeId dest_node_id, RowBatch* batch, int sender_id) {
+  VLOG_ROW << "AddData(): fragment_instance_id=" << fragment_instance_id
+           << " node=" << dest_node_id << " #rows=" << batch->num_rows();
+  bool already_unregistered;
+  shared_ptr<DataStreamRecvr> recvr = FindRecvrOrWait(fragment_instance_id, dest_node_id,
+      &already_unregistered);
+  if (recvr.get() == NULL) {
+    // See AddData().
+    return already_unregistered ?
+        Status(TErrorCode::DATASTREAM_RECVR_CLOSED, PrintId(fragment_instance_id),
+            dest_node_id) :
+        Status(TErrorCode::DATASTREAM_SENDER_TIMEOUT, PrintId(fragment_instance_id));
+  }
+  DCHECK(!already_unregistered);
+  recvr->AddBatch(batch, sender_id);
+  return Status::OK();
+}
+
 Status DataStreamMgr::CloseSender(const TUniqueId& fragment_instance_id,
     PlanNodeId dest_node_id, int sender_id) {
   VLOG_FILE << "CloseSender(): fragment_instance_id=" << fragment_instance_id
@@ -26,6 +26,7 @@
 
 #include "common/status.h"
 #include "common/object-pool.h"
+#include "runtime/buffered-block-mgr.h"
 #include "runtime/descriptors.h"  // for PlanNodeId
 #include "runtime/mem-tracker.h"
 #include "util/promise.h"
@@ -69,13 +70,16 @@ class DataStreamMgr {
   /// If is_merging is true, the receiver maintains a separate queue of incoming row
   /// batches for each sender and merges the sorted streams from each sender into a
   /// single stream.
+  /// If 'spill_client' is non-NULL, the receiver spills batches that arrive while its
+  /// buffer is full to streams of state's block mgr, using that client, rather than
+  /// blocking the senders.
   /// Ownership of the receiver is shared between this DataStream mgr instance and the
   /// caller.
   boost::shared_ptr<DataStreamRecvr> CreateRecvr(
       RuntimeState* state, const RowDescriptor& row_desc,
       const TUniqueId& fragment_instance_id, PlanNodeId dest_node_id,
       int num_senders, int buffer_size, RuntimeProfile* profile,
-      bool is_merging);
+      bool is_merging, BufferedBlockMgr::Client* spill_client = NULL);
 
   /// Adds a row batch to the recvr identified by fragment_instance_id/dest_node_id
   /// if the recvr has not been cancelled. sender_id identifies the sender instance
@@ -85,10 +89,24 @@ class DataStreamMgr {
   /// row_batch.
   /// TODO: enforce per-sender quotas (something like 200% of buffer_size/#senders),
   /// so that a single sender can't flood the buffer and stall everybody else.
-  /// Returns OK if successful, error status otherwise.
+  /// Returns OK if successful, error status otherwise. If the receiver was already
+  /// closed, the batch is dropped and DATASTREAM_RECVR_CLOSED is returned, which tells
+  /// the sender that the receiver needs no more rows rather than that the query failed.
   Status AddData(const TUniqueId& fragment_instance_id, PlanNodeId dest_node_id,
                  const TRowBatch& thrift_batch, int sender_id);
 
+  /// Same as above, but doesn't wait for the receiver's buffer to drain: sets 'accepted'
+  /// to false and leaves the batch to the caller if it would have to wait. Still waits
+  /// for the receiver to be registered, like AddData().
+  Status TryAddData(const TUniqueId& fragment_instance_id, PlanNodeId dest_node_id,
+      const TRowBatch& thrift_batch, int sender_id, bool* accepted);
+
+  /// Same as AddData() for a sender in this process, which passes the batch without
+  /// serializing it. The receiver acquires the rows and resources of 'batch', which is
+  /// left empty, unless the receiver was already closed or cancelled.
+  Status AddData(const TUniqueId& fragment_instance_id, PlanNodeId dest_node_id,
+                 RowBatch* batch, int sender_id);
+
   /// Notifies the recvr associated with the fragment/node id that the specified
   /// sender has closed.
   /// Returns OK if successful, error status otherwise.
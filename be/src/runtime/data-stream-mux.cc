@@ -0,0 +1,192 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "runtime/data-stream-mux.h"
+
+#include <limits>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <gflags/gflags.h>
+#include <gutil/strings/substitute.h>
+
+#include "runtime/row-batch.h"
+#include "util/network-util.h"
+#include "util/thread.h"
+#include "util/time.h"
+
+#include "gen-cpp/ImpalaInternalService.h"
+#include "gen-cpp/ImpalaInternalService_types.h"
+
+#include "common/names.h"
+
+using boost::condition_variable;
+using strings::Substitute;
+
+DEFINE_int64(datastream_mux_max_rpc_bytes, 16L * 1024L * 1024L, "(Advanced) Soft limit "
+    "on the row batch bytes that a multiplexed data stream connection sends in one rpc. "
+    "An rpc always carries at least one row batch.");
+DEFINE_int32(datastream_mux_max_backoff_ms, 100, "(Advanced) The longest time that a "
+    "multiplexed data stream connection waits before it resends a row batch that the "
+    "receiver rejected because its buffer was full.");
+
+namespace impala {
+
+DataStreamMux::DataStreamMux(ImpalaInternalServiceClientCache* client_cache)
+  : client_cache_(client_cache),
+    shutdown_(false) {
+}
+
+DataStreamMux::~DataStreamMux() {
+  {
+    lock_guard<mutex> l(lock_);
+    shutdown_ = true;
+  }
+  for (DestinationMap::iterator it = destinations_.begin(); it != destinations_.end();
+      ++it) {
+    Destination* dest = it->second;
+    {
+      // Holding the lock ensures that the thread either sees 'shutdown_' or waits.
+      lock_guard<mutex> l(dest->lock);
+      DCHECK(dest->requests.empty());
+      dest->request_cv.notify_all();
+    }
+    dest->thread->Join();
+    delete dest;
+  }
+}
+
+Status DataStreamMux::TransmitData(const TNetworkAddress& address,
+    TTransmitDataParams* params) {
+  Destination* dest = GetDestination(address);
+  Request request;
+  request.params = params;
+  request.size =
+      params->__isset.row_batch ? RowBatch::GetBatchSize(params->row_batch) : 0;
+  request.next_attempt_ms = 0;
+  request.backoff_ms = 1;
+  request.done = false;
+
+  unique_lock<mutex> l(dest->lock);
+  dest->requests.push_back(&request);
+  dest->request_cv.notify_one();
+  while (!request.done) dest->done_cv.wait(l);
+  return request.status;
+}
+
+DataStreamMux::Destination* DataStreamMux::GetDestination(
+    const TNetworkAddress& address) {
+  string key = TNetworkAddressToString(address);
+  lock_guard<mutex> l(lock_);
+  DCHECK(!shutdown_);
+  DestinationMap::iterator it = destinations_.find(key);
+  if (it != destinations_.end()) return it->second;
+  Destination* dest = new Destination();
+  dest->address = address;
+  dest->thread.reset(new Thread("data-stream-mux", Substitute("sender-$0", key),
+      &DataStreamMux::SendLoop, this, dest));
+  destinations_[key] = dest;
+  return dest;
+}
+
+void DataStreamMux::SendLoop(Destination* dest) {
+  vector<Request*> requests;
+  while (true) {
+    requests.clear();
+    {
+      unique_lock<mutex> l(dest->lock);
+      while (true) {
+        {
+          lock_guard<mutex> shutdown_lock(lock_);
+          if (shutdown_) return;
+        }
+        // Pick the requests whose backoff has passed, in order, up to the rpc size limit.
+        int64_t now = MonotonicMillis();
+        int64_t next_attempt_ms = numeric_limits<int64_t>::max();
+        int64_t total_size = 0;
+        for (list<Request*>::iterator it = dest->requests.begin();
+            it != dest->requests.end(); ++it) {
+          Request* request = *it;
+          if (request->next_attempt_ms > now) {
+            next_attempt_ms = min(next_attempt_ms, request->next_attempt_ms);
+            continue;
+          }
+          if (!requests.empty() &&
+              total_size + request->size > FLAGS_datastream_mux_max_rpc_bytes) {
+            break;
+          }
+          requests.push_back(request);
+          total_size += request->size;
+        }
+        if (!requests.empty()) break;
+        if (next_attempt_ms == numeric_limits<int64_t>::max()) {
+          dest->request_cv.wait(l);
+        } else {
+          dest->request_cv.timed_wait(l,
+              boost::posix_time::milliseconds(next_attempt_ms - now));
+        }
+      }
+    }
+    SendRequests(dest, requests);
+  }
+}
+
+void DataStreamMux::SendRequests(Destination* dest, const vector<Request*>& requests) {
+  // The senders don't touch their params until their requests are done, so the row
+  // batches can be moved into the rpc params rather than copied.
+  TTransmitDataBatchParams params;
+  params.protocol_version = ImpalaInternalServiceVersion::V1;
+  params.__isset.streams = true;
+  params.streams.resize(requests.size());
+  for (int i = 0; i < requests.size(); ++i) swap(*requests[i]->params, params.streams[i]);
+
+  TTransmitDataBatchResult res;
+  Status status;
+  {
+    ImpalaInternalServiceConnection client(client_cache_, dest->address, &status);
+    if (status.ok()) {
+      status = client.DoRpc(&ImpalaInternalServiceClient::TransmitDataBatch, params,
+          &res);
+    }
+  }
+  for (int i = 0; i < requests.size(); ++i) swap(params.streams[i], *requests[i]->params);
+  if (status.ok() && (res.statuses.size() != requests.size() ||
+      res.accepted.size() != requests.size())) {
+    status = Status(Substitute("TransmitDataBatch() to $0 returned $1 results for $2 "
+        "streams", TNetworkAddressToString(dest->address), res.statuses.size(),
+        requests.size()));
+  }
+
+  int64_t now = MonotonicMillis();
+  {
+    lock_guard<mutex> l(dest->lock);
+    for (int i = 0; i < requests.size(); ++i) {
+      Request* request = requests[i];
+      if (!status.ok()) {
+        request->status = status;
+        request->done = true;
+      } else if (res.accepted[i]) {
+        request->status = Status(res.statuses[i]);
+        request->done = true;
+      } else {
+        request->next_attempt_ms = now + request->backoff_ms;
+        request->backoff_ms =
+            min<int64_t>(request->backoff_ms * 2, FLAGS_datastream_mux_max_backoff_ms);
+        continue;
+      }
+      dest->requests.remove(request);
+    }
+  }
+  dest->done_cv.notify_all();
+}
+
+}
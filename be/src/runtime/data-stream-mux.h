@@ -0,0 +1,119 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_RUNTIME_DATA_STREAM_MUX_H
+#define IMPALA_RUNTIME_DATA_STREAM_MUX_H
+
+#include <list>
+#include <string>
+#include <vector>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "common/status.h"
+#include "runtime/client-cache.h"
+#include "gen-cpp/Types_types.h"  // for TNetworkAddress
+
+namespace impala {
+
+class TTransmitDataParams;
+class Thread;
+
+/// Multiplexes the data streams from this process to each other backend over a single
+/// connection. Instead of each DataStreamSender channel sending its own TransmitData()
+/// rpcs, which occupy a connection and a server thread while the receiver's buffer is
+/// full, channels hand their params to the mux. One thread per destination backend
+/// sends the pending params of all streams to it in TransmitDataBatch() rpcs.
+///
+/// Flow control is per stream: the destination rejects the row batches of receivers
+/// whose buffers are full instead of waiting for them to drain. Rejected batches are
+/// resent with exponential backoff while the batches of the other streams keep flowing.
+/// Batches of a stream that are pending at the same time are sent in the order in which
+/// they were handed to the mux.
+///
+/// Thread-safe.
+class DataStreamMux {
+ public:
+  DataStreamMux(ImpalaInternalServiceClientCache* client_cache);
+
+  /// Stops the sender threads. Must not be called while TransmitData() calls are in
+  /// progress.
+  ~DataStreamMux();
+
+  /// Sends 'params' to the backend at 'address' and blocks until the receiver accepted
+  /// the row batch or the rpc failed. Returns the status of the rpc or of the receiver.
+  /// The row batch is moved out of 'params' while it is being sent and moved back before
+  /// this returns.
+  Status TransmitData(const TNetworkAddress& address, TTransmitDataParams* params);
+
+ private:
+  /// Params handed to TransmitData() and the result once it is 'done'.
+  struct Request {
+    TTransmitDataParams* params;
+    int64_t size;
+    /// Time before which a rejected batch isn't resent, and the backoff for its next
+    /// rejection.
+    int64_t next_attempt_ms;
+    int64_t backoff_ms;
+    bool done;
+    Status status;
+  };
+
+  /// The requests for one destination backend and the thread that sends them.
+  struct Destination {
+    TNetworkAddress address;
+
+    /// Protects 'requests' and the 'done' and 'status' fields of the requests.
+    boost::mutex lock;
+
+    /// Signalled when a request is added, and when requests of this destination are
+    /// done.
+    boost::condition_variable request_cv;
+    boost::condition_variable done_cv;
+
+    /// Requests that aren't done, in the order they were added.
+    std::list<Request*> requests;
+
+    boost::scoped_ptr<Thread> thread;
+  };
+
+  ImpalaInternalServiceClientCache* client_cache_;
+
+  /// Protects 'destinations_' and 'shutdown_'.
+  boost::mutex lock_;
+
+  /// Destinations by TNetworkAddressToString() of their address, created on demand.
+  typedef boost::unordered_map<std::string, Destination*> DestinationMap;
+  DestinationMap destinations_;
+
+  /// Set by the destructor to stop the sender threads.
+  bool shutdown_;
+
+  /// Returns the destination for 'address', starting its sender thread if it is new.
+  Destination* GetDestination(const TNetworkAddress& address);
+
+  /// Loop of the sender thread of 'dest'.
+  void SendLoop(Destination* dest);
+
+  /// Sends 'requests' to 'dest' in one rpc and records their results. Requests whose
+  /// batches were rejected stay pending with a longer backoff.
+  void SendRequests(Destination* dest, const std::vector<Request*>& requests);
+};
+
+}
+
+#endif
@@ -12,25 +12,39 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
+#include <gflags/gflags.h>
 
 #include "runtime/data-stream-recvr.h"
+#include "runtime/buffered-tuple-stream.inline.h"
 #include "runtime/data-stream-mgr.h"
 #include "runtime/row-batch.h"
+#include "runtime/runtime-state.h"
 #include "runtime/sorted-run-merger.h"
 #include "util/runtime-profile.h"
 #include "util/periodic-counter-updater.h"
+#include "util/pretty-printer.h"
+#include "util/stopwatch.h"
 
 #include "common/names.h"
 
 using boost::condition_variable;
 
+DEFINE_int32(exchg_node_merging_min_batches_per_sender, 2, "(Advanced) The number of "
+    "row batches that each sender of a merging exchange may have queued even if the "
+    "exchange's buffer is full. Batches beyond the first are prefetched so that the "
+    "merge doesn't stall waiting for the sender whose rows come next.");
+
 namespace impala {
 
 // Implements a blocking queue of row batches from one or more senders. One queue
 // is maintained per sender if is_merging_ is true for the enclosing receiver, otherwise
 // rows from all senders are placed in the same queue.
+// If the receiver may spill, batches that arrive while the buffer is full are appended
+// to an unpinned BufferedTupleStream instead of blocking the sender. A NULL batch in the
+// queue stands for the next spilled stream, so batches are returned in arrival order.
 class DataStreamRecvr::SenderQueue {
  public:
   SenderQueue(DataStreamRecvr* parent_recvr, int num_senders, RuntimeProfile* profile);
@@ -47,7 +61,14 @@ class DataStreamRecvr::SenderQueue {
   // blocks if this will make the stream exceed its buffer limit.
   // If the total size of the batches in this queue would exceed the allowed buffer size,
   // the queue is considered full and the call blocks until a batch is dequeued.
-  void AddBatch(const TRowBatch& batch);
+  // If 'wait' is false, a batch that would block is rejected instead and false is
+  // returned; otherwise returns true. Batches that are spilled are accepted, even
+  // though spilling may block the caller if the block mgr is out of memory.
+  bool AddBatch(const TRowBatch& batch, bool wait = true);
+
+  // Same as above for a batch from a sender in this process: the queued batch acquires
+  // the state of 'batch' instead of deserializing it, which leaves 'batch' empty.
+  void AddBatch(RowBatch* batch);
 
   // Decrement the number of remaining senders for this queue and signal eos ("new data")
   // if the count drops to 0. The number of senders will be 1 for a merging
@@ -64,6 +85,9 @@ class DataStreamRecvr::SenderQueue {
   // Returns the current batch from this queue being processed by a consumer.
   RowBatch* current_batch() const { return current_batch_.get(); }
 
+  // Total time that GetBatch() waited for a batch to arrive.
+  int64_t stall_time_ns() const { return stall_time_ns_; }
+
  private:
   // Receiver of which this queue is a member.
   DataStreamRecvr* recvr_;
@@ -96,6 +120,58 @@ class DataStreamRecvr::SenderQueue {
 
   // Set to true when the first batch has been received
   bool received_first_batch_;
+
+  // Number of batches that the queue accepts regardless of the buffer limit: one, so
+  // that a merger is never starved by the limit, or more for merging receivers.
+  int min_queued_batches_;
+
+  // Total time that GetBatch() waited for a batch. Only accessed by the consumer.
+  int64_t stall_time_ns_;
+
+  // Returns true if the queue has its minimum number of batches and a batch of
+  // 'batch_size' bytes would exceed the buffer limit. 'lock_' must be held.
+  bool IsFull(int batch_size) {
+    return static_cast<int>(batch_queue_.size()) >= min_queued_batches_ &&
+        recvr_->ExceedsLimit(batch_size);
+  }
+
+  // Streams of spilled rows, in the order of their NULL entries in batch_queue_.
+  list<BufferedTupleStream*> spilled_streams_;
+
+  // The last stream of 'spilled_streams_' if senders may still append to it, i.e. the
+  // consumer didn't start reading it and spilling into it didn't fail. Otherwise NULL.
+  BufferedTupleStream* write_stream_;
+
+  // The spilled stream that GetBatch() returns batches from. Only accessed by the
+  // consumer, which reads it without holding lock_.
+  scoped_ptr<BufferedTupleStream> read_stream_;
+
+  // Batch that rows of 'read_stream_' are read into before they are copied into
+  // 'current_batch_', since the stream reuses their memory on the next read.
+  scoped_ptr<RowBatch> read_batch_;
+
+  // Returns true if a batch of 'batch_size' bytes should be spilled, i.e. spilling is
+  // enabled and the batch doesn't fit into the buffer or a previous batch was spilled
+  // into 'write_stream_'. 'lock_' must be held.
+  bool ShouldSpill(int batch_size);
+
+  // Spills 'batch' of 'batch_size' bytes into 'write_stream_', which is created if
+  // needed. Rows that can't be spilled because the block mgr is out of memory or hit an
+  // error are queued in memory as usual, waiting for space. Takes ownership of 'batch'.
+  // 'l' must hold lock_.
+  void SpillBatch(unique_lock<mutex>* l, RowBatch* batch, int batch_size);
+
+  // Returns the next batch of 'read_stream_' in current_batch_ and 'next_batch'. Sets
+  // 'eos' and closes the stream once all its rows were returned.
+  Status GetSpilledBatch(RowBatch** next_batch, bool* eos);
+
+  // Blocks until a batch of 'batch_size' bytes fits into the buffer limit or the queue
+  // is empty, and counts the bytes as received. 'l' must hold lock_. Returns false if
+  // the stream is cancelled, in which case the batch must be dropped.
+  bool WaitForSpace(unique_lock<mutex>* l, int batch_size);
+
+  // Appends 'batch' of 'batch_size' bytes to batch_queue_ and signals its arrival.
+  void EnqueueBatch(RowBatch* batch, int batch_size);
 };
 
 DataStreamRecvr::SenderQueue::SenderQueue(DataStreamRecvr* parent_recvr, int num_senders,
@@ -103,11 +179,22 @@ DataStreamRecvr::SenderQueue::SenderQueue(DataStreamRecvr* parent_recvr, int num
   : recvr_(parent_recvr),
     is_cancelled_(false),
     num_remaining_senders_(num_senders),
-    received_first_batch_(false) {
+    received_first_batch_(false),
+    min_queued_batches_(parent_recvr->is_merging_ ?
+        max(1, FLAGS_exchg_node_merging_min_batches_per_sender) : 1),
+    stall_time_ns_(0),
+    write_stream_(NULL) {
 }
 
 Status DataStreamRecvr::SenderQueue::GetBatch(RowBatch** next_batch) {
+  if (read_stream_.get() != NULL) {
+    bool eos;
+    RETURN_IF_ERROR(GetSpilledBatch(next_batch, &eos));
+    if (!eos) return Status::OK();
+  }
   unique_lock<mutex> l(lock_);
+  MonotonicStopWatch stall_timer;
+  stall_timer.Start();
   // wait until something shows up or we know we're done
   while (!is_cancelled_ && batch_queue_.empty() && num_remaining_senders_ > 0) {
     VLOG_ROW << "wait arrival fragment_instance_id=" << recvr_->fragment_instance_id()
@@ -119,6 +206,10 @@ Status DataStreamRecvr::SenderQueue::GetBatch(RowBatch** next_batch) {
         &is_cancelled_);
     data_arrival_cv_.wait(l);
   }
+  stall_time_ns_ += stall_timer.ElapsedTime();
+  if (recvr_->is_merging_ && stall_time_ns_ > recvr_->max_sender_stall_timer_->value()) {
+    recvr_->max_sender_stall_timer_->Set(stall_time_ns_);
+  }
 
   // cur_batch_ must be replaced with the returned batch.
   current_batch_.reset();
@@ -135,30 +226,114 @@ Status DataStreamRecvr::SenderQueue::GetBatch(RowBatch** next_batch) {
   DCHECK(!batch_queue_.empty());
   RowBatch* result = batch_queue_.front().second;
   recvr_->num_buffered_bytes_ -= batch_queue_.front().first;
-  VLOG_ROW << "fetched #rows=" << result->num_rows();
   batch_queue_.pop_front();
   data_removal__cv_.notify_one();
+  if (result == NULL) {
+    // The next rows were spilled. Senders append to a new stream from now on.
+    read_stream_.reset(spilled_streams_.front());
+    spilled_streams_.pop_front();
+    if (write_stream_ == read_stream_.get()) write_stream_ = NULL;
+    l.unlock();
+    RETURN_IF_ERROR(read_stream_->PrepareForRead(true));
+    bool eos;
+    RETURN_IF_ERROR(GetSpilledBatch(next_batch, &eos));
+    // Spilling may have failed before the first row of the stream.
+    if (eos) return GetBatch(next_batch);
+    return Status::OK();
+  }
+  VLOG_ROW << "fetched #rows=" << result->num_rows();
   current_batch_.reset(result);
   *next_batch = current_batch_.get();
   return Status::OK();
 }
 
-void DataStreamRecvr::SenderQueue::AddBatch(const TRowBatch& thrift_batch) {
-  unique_lock<mutex> l(lock_);
-  if (is_cancelled_) return;
+Status DataStreamRecvr::SenderQueue::GetSpilledBatch(RowBatch** next_batch,
+    bool* eos) {
+  DCHECK(read_stream_.get() != NULL);
+  current_batch_.reset();
+  *next_batch = NULL;
+  if (is_cancelled_) return Status::CANCELLED;
+  if (read_batch_.get() == NULL) {
+    read_batch_.reset(new RowBatch(recvr_->row_desc(),
+        recvr_->spill_state_->batch_size(), recvr_->mem_tracker()));
+  }
+  read_batch_->Reset();
+  RETURN_IF_ERROR(read_stream_->GetNext(read_batch_.get(), eos));
+  if (*eos) {
+    read_stream_->Close();
+    read_stream_.reset();
+    return Status::OK();
+  }
+  current_batch_.reset(new RowBatch(recvr_->row_desc(), read_batch_->num_rows(),
+      recvr_->mem_tracker()));
+  read_batch_->DeepCopyTo(current_batch_.get());
+  VLOG_ROW << "fetched spilled #rows=" << current_batch_->num_rows();
+  *next_batch = current_batch_.get();
+  return Status::OK();
+}
 
-  int batch_size = RowBatch::GetBatchSize(thrift_batch);
-  COUNTER_ADD(recvr_->bytes_received_counter_, batch_size);
+bool DataStreamRecvr::SenderQueue::ShouldSpill(int batch_size) {
+  if (recvr_->spill_client_ == NULL) return false;
+  return write_stream_ != NULL || IsFull(batch_size);
+}
+
+void DataStreamRecvr::SenderQueue::SpillBatch(unique_lock<mutex>* l, RowBatch* batch,
+    int batch_size) {
+  scoped_ptr<RowBatch> batch_ptr(batch);
+  if (write_stream_ == NULL) {
+    scoped_ptr<BufferedTupleStream> stream(new BufferedTupleStream(recvr_->spill_state_,
+        recvr_->row_desc(), recvr_->spill_state_->block_mgr(), recvr_->spill_client_,
+        false, false));
+    Status status = stream->Init(recvr_->dest_node_id(), NULL, false);
+    if (status.ok()) {
+      write_stream_ = stream.release();
+      spilled_streams_.push_back(write_stream_);
+      EnqueueBatch(NULL, 0);
+    } else {
+      LOG(WARNING) << "Could not spill exchange batch: " << status.GetDetail();
+      stream->Close();
+    }
+  }
+  int num_spilled = 0;
+  if (write_stream_ != NULL) {
+    Status status;
+    while (num_spilled < batch->num_rows() &&
+        write_stream_->AddRow(batch->GetRow(num_spilled), &status)) {
+      ++num_spilled;
+    }
+    COUNTER_ADD(recvr_->rows_spilled_counter_, num_spilled);
+    if (num_spilled < batch->num_rows()) {
+      // Out of memory or an error: the stream takes no more rows.
+      if (!status.ok()) {
+        LOG(WARNING) << "Could not spill exchange batch: " << status.GetDetail();
+      }
+      write_stream_ = NULL;
+    }
+  }
+  if (num_spilled == batch->num_rows()) return;
+
+  // Queue the rows that weren't spilled.
+  int num_rows = batch->num_rows() - num_spilled;
+  batch->CopyRows(0, num_spilled, num_rows);
+  batch->set_num_rows(num_rows);
+  if (!WaitForSpace(l, batch_size)) return;
+  EnqueueBatch(batch_ptr.release(), batch_size);
+}
+
+bool DataStreamRecvr::SenderQueue::WaitForSpace(unique_lock<mutex>* l, int batch_size) {
+  if (is_cancelled_) return false;
   DCHECK_GT(num_remaining_senders_, 0);
 
-  // if there's something in the queue and this batch will push us over the
-  // buffer limit we need to wait until the batch gets drained.
+  // if the queue has its minimum number of batches and this batch will push us over
+  // the buffer limit we need to wait until the batch gets drained.
   // Note: It's important that we enqueue thrift_batch regardless of buffer limit if
   // the queue is currently empty. In the case of a merging receiver, batches are
   // received from a specific queue based on data order, and the pipeline will stall
   // if the merger is waiting for data from an empty queue that cannot be filled because
-  // the limit has been reached.
-  while (!batch_queue_.empty() && recvr_->ExceedsLimit(batch_size) && !is_cancelled_) {
+  // the limit has been reached. Merging receivers accept a few batches per sender for
+  // the same reason, so that the next batch is usually there by the time the merger
+  // wants it.
+  while (IsFull(batch_size) && !is_cancelled_) {
     CANCEL_SAFE_SCOPED_TIMER(recvr_->buffer_full_total_timer_, &is_cancelled_);
     VLOG_ROW << " wait removal: empty=" << (batch_queue_.empty() ? 1 : 0)
              << " #buffered=" << recvr_->num_buffered_bytes_
@@ -172,10 +347,10 @@ void DataStreamRecvr::SenderQueue::AddBatch(const TRowBatch& thrift_batch) {
       try_mutex::scoped_try_lock timer_lock(recvr_->buffer_wall_timer_lock_);
       if (timer_lock) {
         CANCEL_SAFE_SCOPED_TIMER(recvr_->buffer_full_wall_timer_, &is_cancelled_);
-        data_removal__cv_.wait(l);
+        data_removal__cv_.wait(*l);
         got_timer_lock = true;
       } else {
-        data_removal__cv_.wait(l);
+        data_removal__cv_.wait(*l);
         got_timer_lock = false;
       }
     }
@@ -196,21 +371,59 @@ void DataStreamRecvr::SenderQueue::AddBatch(const TRowBatch& thrift_batch) {
     // practice, this time is small relative to the total wait time.
     if (got_timer_lock) data_removal__cv_.notify_one();
   }
+  return !is_cancelled_;
+}
 
-  if (!is_cancelled_) {
-    RowBatch* batch = NULL;
-    {
-      SCOPED_TIMER(recvr_->deserialize_row_batch_timer_);
-      // Note: if this function makes a row batch, the batch *must* be added
-      // to batch_queue_. It is not valid to create the row batch and destroy
-      // it in this thread.
-      batch = new RowBatch(recvr_->row_desc(), thrift_batch, recvr_->mem_tracker());
-    }
-    VLOG_ROW << "added #rows=" << batch->num_rows()
-             << " batch_size=" << batch_size << "\n";
-    batch_queue_.push_back(make_pair(batch_size, batch));
-    recvr_->num_buffered_bytes_ += batch_size;
-    data_arrival_cv_.notify_one();
+void DataStreamRecvr::SenderQueue::EnqueueBatch(RowBatch* batch, int batch_size) {
+  VLOG_ROW << "added #rows=" << (batch == NULL ? -1 : batch->num_rows())
+           << " batch_size=" << batch_size << "\n";
+  batch_queue_.push_back(make_pair(batch_size, batch));
+  recvr_->num_buffered_bytes_ += batch_size;
+  data_arrival_cv_.notify_one();
+}
+
+bool DataStreamRecvr::SenderQueue::AddBatch(const TRowBatch& thrift_batch, bool wait) {
+  unique_lock<mutex> l(lock_);
+  if (is_cancelled_) return true;
+  int batch_size = RowBatch::GetBatchSize(thrift_batch);
+  bool spill = ShouldSpill(batch_size);
+  if (!spill && !wait && IsFull(batch_size)) {
+    return false;
+  }
+  COUNTER_ADD(recvr_->bytes_received_counter_, batch_size);
+  if (!spill && !WaitForSpace(&l, batch_size)) return true;
+  RowBatch* batch = NULL;
+  {
+    SCOPED_TIMER(recvr_->deserialize_row_batch_timer_);
+    // Note: if this function makes a row batch, the batch *must* be added
+    // to batch_queue_ or spilled. It is not valid to create the row batch and destroy
+    // it in this thread otherwise.
+    batch = new RowBatch(recvr_->row_desc(), thrift_batch, recvr_->mem_tracker());
+  }
+  if (spill) {
+    SpillBatch(&l, batch, batch_size);
+  } else {
+    EnqueueBatch(batch, batch_size);
+  }
+  return true;
+}
+
+void DataStreamRecvr::SenderQueue::AddBatch(RowBatch* src) {
+  unique_lock<mutex> l(lock_);
+  // The tuple data is the bulk of the batch, as for serialized batches.
+  int batch_size = src->tuple_data_pool()->total_allocated_bytes();
+  if (is_cancelled_) return;
+  COUNTER_ADD(recvr_->bytes_received_counter_, batch_size);
+  bool spill = ShouldSpill(batch_size);
+  if (!spill && !WaitForSpace(&l, batch_size)) return;
+  // The tuple data memory moves from the sender's mem tracker to the receiver's.
+  RowBatch* batch = new RowBatch(recvr_->row_desc(), src->capacity(),
+      recvr_->mem_tracker());
+  batch->AcquireState(src);
+  if (spill) {
+    SpillBatch(&l, batch, batch_size);
+  } else {
+    EnqueueBatch(batch, batch_size);
   }
 }
 
@@ -252,6 +465,15 @@ void DataStreamRecvr::SenderQueue::Close() {
       it != batch_queue_.end(); ++it) {
     delete it->second;
   }
+  BOOST_FOREACH(BufferedTupleStream* stream, spilled_streams_) {
+    stream->Close();
+    delete stream;
+  }
+  spilled_streams_.clear();
+  write_stream_ = NULL;
+  if (read_stream_.get() != NULL) read_stream_->Close();
+  read_stream_.reset();
+  read_batch_.reset();
   current_batch_.reset();
 }
 
@@ -282,7 +504,8 @@ void DataStreamRecvr::TransferAllResources(RowBatch* transfer_batch) {
 DataStreamRecvr::DataStreamRecvr(DataStreamMgr* stream_mgr, MemTracker* parent_tracker,
     const RowDescriptor& row_desc, const TUniqueId& fragment_instance_id,
     PlanNodeId dest_node_id, int num_senders, bool is_merging, int total_buffer_limit,
-    RuntimeProfile* profile)
+    RuntimeProfile* profile, RuntimeState* spill_state,
+    BufferedBlockMgr::Client* spill_client)
   : mgr_(stream_mgr),
     fragment_instance_id_(fragment_instance_id),
     dest_node_id_(dest_node_id),
@@ -290,7 +513,10 @@ DataStreamRecvr::DataStreamRecvr(DataStreamMgr* stream_mgr, MemTracker* parent_t
     row_desc_(row_desc),
     is_merging_(is_merging),
     num_buffered_bytes_(0),
+    spill_state_(spill_state),
+    spill_client_(spill_client),
     profile_(profile) {
+  DCHECK_EQ(spill_state_ == NULL, spill_client_ == NULL);
   mem_tracker_.reset(new MemTracker(-1, -1, "DataStreamRecvr", parent_tracker));
   // Create one queue per sender if is_merging is true.
   int num_queues = is_merging ? num_senders : 1;
@@ -313,6 +539,9 @@ DataStreamRecvr::DataStreamRecvr(DataStreamMgr* stream_mgr, MemTracker* parent_t
   buffer_full_total_timer_ = ADD_TIMER(profile_, "SendersBlockedTotalTimer(*)");
   data_arrival_timer_ = profile_->inactive_timer();
   first_batch_wait_total_timer_ = ADD_TIMER(profile_, "FirstBatchArrivalWaitTime");
+  rows_spilled_counter_ = ADD_COUNTER(profile_, "RowsSpilled", TUnit::UNIT);
+  max_sender_stall_timer_ =
+      is_merging_ ? ADD_TIMER(profile_, "MaxSenderStallTime") : NULL;
 }
 
 Status DataStreamRecvr::GetNext(RowBatch* output_batch, bool* eos) {
@@ -326,6 +555,16 @@ void DataStreamRecvr::AddBatch(const TRowBatch& thrift_batch, int sender_id) {
   sender_queues_[use_sender_id]->AddBatch(thrift_batch);
 }
 
+bool DataStreamRecvr::TryAddBatch(const TRowBatch& thrift_batch, int sender_id) {
+  int use_sender_id = is_merging_ ? sender_id : 0;
+  return sender_queues_[use_sender_id]->AddBatch(thrift_batch, false);
+}
+
+void DataStreamRecvr::AddBatch(RowBatch* batch, int sender_id) {
+  int use_sender_id = is_merging_ ? sender_id : 0;
+  sender_queues_[use_sender_id]->AddBatch(batch);
+}
+
 void DataStreamRecvr::RemoveSender(int sender_id) {
   int use_sender_id = is_merging_ ? sender_id : 0;
   sender_queues_[use_sender_id]->DecrementSenders();
@@ -342,6 +581,7 @@ void DataStreamRecvr::Close() {
   // TODO: log error msg
   mgr_->DeregisterRecvr(fragment_instance_id(), dest_node_id());
   mgr_ = NULL;
+  if (is_merging_) ReportSenderStallTimes();
   for (int i = 0; i < sender_queues_.size(); ++i) {
     sender_queues_[i]->Close();
   }
@@ -350,6 +590,24 @@ void DataStreamRecvr::Close() {
   mem_tracker_.reset();
 }
 
+void DataStreamRecvr::ReportSenderStallTimes() {
+  vector<pair<int64_t, int> > stall_times;
+  for (int i = 0; i < sender_queues_.size(); ++i) {
+    int64_t stall_time_ns = sender_queues_[i]->stall_time_ns();
+    if (stall_time_ns > 0) stall_times.push_back(make_pair(stall_time_ns, i));
+  }
+  if (stall_times.empty()) return;
+  sort(stall_times.begin(), stall_times.end(), greater<pair<int64_t, int> >());
+  stringstream info;
+  for (int i = 0; i < min<int>(stall_times.size(), MAX_REPORTED_STALLED_SENDERS);
+      ++i) {
+    if (i > 0) info << ", ";
+    info << "sender " << stall_times[i].second << ": "
+         << PrettyPrinter::Print(stall_times[i].first, TUnit::TIME_NS);
+  }
+  profile_->AddInfoString("SenderStallTimes", info.str());
+}
+
 DataStreamRecvr::~DataStreamRecvr() {
   DCHECK(mgr_ == NULL) << "Must call Close()";
 }
@@ -22,6 +22,7 @@
 #include "common/status.h"
 #include "gen-cpp/Types_types.h"   // for TUniqueId
 #include "gen-cpp/Results_types.h" // for TRowBatch
+#include "runtime/buffered-block-mgr.h"
 #include "runtime/descriptors.h"
 #include "util/tuple-row-compare.h"
 
@@ -32,6 +33,7 @@ class SortedRunMerger;
 class MemTracker;
 class RowBatch;
 class RuntimeProfile;
+class RuntimeState;
 
 /// Single receiver of an m:n data stream.
 /// DataStreamRecvr maintains one or more queues of row batches received by a
@@ -55,6 +57,17 @@ class RuntimeProfile;
 /// the input batches from each sender queue to the merger to the output batch by the
 /// merger itself as it processes each run.
 //
+/// A merging receiver accepts up to --exchg_node_merging_min_batches_per_sender
+/// batches from each sender even if its buffer is full, so that the merger rarely waits
+/// for the sender whose rows come next. The time the merger waited for each sender is
+/// reported in the profile.
+//
+/// If the receiver is created with a block mgr client, a batch that arrives while the
+/// buffer limit is exceeded does not block the sender. It is appended to an unpinned
+/// BufferedTupleStream instead, and the queue returns it in order once the consumer
+/// gets to it. The sender only blocks if the block mgr can't provide memory for the
+/// stream.
+//
 /// DataStreamRecvr::Close() must be called by the caller of CreateRecvr() to remove the
 /// recvr instance from the tracking structure of its DataStreamMgr in all cases.
 class DataStreamRecvr {
@@ -97,12 +110,20 @@ class DataStreamRecvr {
   DataStreamRecvr(DataStreamMgr* stream_mgr, MemTracker* parent_tracker,
       const RowDescriptor& row_desc, const TUniqueId& fragment_instance_id,
       PlanNodeId dest_node_id, int num_senders, bool is_merging, int total_buffer_limit,
-      RuntimeProfile* profile);
+      RuntimeProfile* profile, RuntimeState* spill_state,
+      BufferedBlockMgr::Client* spill_client);
 
   /// Add a new batch of rows to the appropriate sender queue, blocking if the queue is
   /// full. Called from DataStreamMgr.
   void AddBatch(const TRowBatch& thrift_batch, int sender_id);
 
+  /// Same as above, but returns false instead of blocking if the queue is full.
+  bool TryAddBatch(const TRowBatch& thrift_batch, int sender_id);
+
+  /// Same as above for a batch from a sender in this process. The queued batch takes
+  /// over the rows and resources of 'batch', which is left empty.
+  void AddBatch(RowBatch* batch, int sender_id);
+
   /// Indicate that a particular sender is done. Delegated to the appropriate
   /// sender queue. Called from DataStreamMgr.
   void RemoveSender(int sender_id);
@@ -110,6 +131,13 @@ class DataStreamRecvr {
   /// Empties the sender queues and notifies all waiting consumers of cancellation.
   void CancelStream();
 
+  /// Adds the senders that the merger waited for longest, and for how long, to the
+  /// profile.
+  void ReportSenderStallTimes();
+
+  /// Maximum number of senders listed by ReportSenderStallTimes().
+  static const int MAX_REPORTED_STALLED_SENDERS = 10;
+
   /// Return true if the addition of a new batch of size 'batch_size' would exceed the
   /// total buffer limit.
   bool ExceedsLimit(int batch_size) {
@@ -141,6 +169,11 @@ class DataStreamRecvr {
   /// Memtracker for batches in the sender queue(s).
   boost::scoped_ptr<MemTracker> mem_tracker_;
 
+  /// Runtime state and block mgr client for the streams that batches are spilled to.
+  /// Both are NULL if the receiver doesn't spill.
+  RuntimeState* spill_state_;
+  BufferedBlockMgr::Client* spill_client_;
+
   /// One or more queues of row batches received from senders. If is_merging_ is true,
   /// there is one SenderQueue for each sender. Otherwise, row batches from all senders
   /// are placed in the same SenderQueue. The SenderQueue instances are owned by the
@@ -186,6 +219,13 @@ class DataStreamRecvr {
 
   /// Total time spent waiting for data to arrive in the recv buffer
   RuntimeProfile::Counter* data_arrival_timer_;
+
+  /// Number of rows that were spilled instead of blocking their sender.
+  RuntimeProfile::Counter* rows_spilled_counter_;
+
+  /// For merging receivers: the longest total time that the merger waited for the
+  /// batches of one sender. NULL otherwise.
+  RuntimeProfile::Counter* max_sender_stall_timer_;
 };
 
 }
@@ -17,6 +17,7 @@
 #include <iostream>
 #include <boost/shared_ptr.hpp>
 #include <thrift/protocol/TDebugProtocol.h>
+#include <gflags/gflags.h>
 
 #include "common/logging.h"
 #include "exprs/expr.h"
@@ -27,6 +28,9 @@
 #include "runtime/raw-value.h"
 #include "runtime/runtime-state.h"
 #include "runtime/client-cache.h"
+#include "runtime/data-stream-mgr.h"
+#include "runtime/data-stream-mux.h"
+#include "runtime/exec-env.h"
 #include "runtime/mem-tracker.h"
 #include "util/debug-util.h"
 #include "util/network-util.h"
@@ -44,15 +48,76 @@ using namespace apache::thrift;
 using namespace apache::thrift::protocol;
 using namespace apache::thrift::transport;
 
+DEFINE_int32(datastream_sender_max_rpcs_in_flight, 1, "(Advanced) The number of row "
+    "batches that each channel of a hash- or range-partitioned data stream sender may "
+    "have in flight to its destination. Batches to a merging exchange are always sent "
+    "one at a time, since they must arrive in order.");
+DEFINE_bool(datastream_mux, false, "(Advanced) If true, the data streams from this "
+    "process to another backend share one connection, which carries the row batches of "
+    "all streams in TransmitDataBatch() rpcs with per-stream flow control.");
+DEFINE_bool(datastream_local_bypass, true, "(Advanced) If true, data stream senders "
+    "hand row batches for receivers in the same process directly to the receiver "
+    "instead of serializing them and sending them by rpc.");
+DEFINE_int32(datastream_target_batch_bytes, 1024 * 1024, "(Advanced) Target size in "
+    "bytes of the tuple data of the row batches that broadcast, random and "
+    "single-destination data stream senders send. Smaller batches are coalesced and "
+    "larger ones are split. Hash- and range-partitioned senders flush each channel's "
+    "buffer once it holds its buffer size of tuple data.");
+DEFINE_int32(datastream_broadcast_fanout, 0, "(Advanced) If greater than 0, broadcast "
+    "data stream senders send each row batch to only this many remote receivers, "
+    "which relay it to as many others each, in a tree. If 0, the sender sends each "
+    "batch to all receivers itself.");
+
 namespace impala {
 
+// Channels to remote destinations try LZ4 and Snappy on two consecutive batches out of
+// every COMPRESSION_PROBE_INTERVAL batches. Until the next probe they use the codec
+// whose output was smaller, or no compression if neither codec saved at least
+// MIN_COMPRESSION_SAVINGS of the bytes.
+static const int COMPRESSION_PROBE_INTERVAL = 64;
+static const double MIN_COMPRESSION_SAVINGS = 0.1;
+
+// Swaps the contents of 'a' and 'b' without copying the tuple data.
+static void SwapRowBatches(TRowBatch* a, TRowBatch* b) {
+  std::swap(a->num_rows, b->num_rows);
+  a->row_tuples.swap(b->row_tuples);
+  a->tuple_offsets.swap(b->tuple_offsets);
+  a->tuple_data.swap(b->tuple_data);
+  std::swap(a->compression_type, b->compression_type);
+  std::swap(a->uncompressed_size, b->uncompressed_size);
+  std::swap(a->__isset, b->__isset);
+}
+
+// Adds a copy of 'row' to 'dest', deep-copying its tuples into dest's tuple data pool.
+// 'dest' must not be at capacity.
+static void DeepCopyRow(TupleRow* row, const RowDescriptor& row_desc, RowBatch* dest) {
+  TupleRow* dest_row = dest->GetRow(dest->AddRow());
+  const vector<TupleDescriptor*>& descs = row_desc.tuple_descriptors();
+  for (int i = 0; i < descs.size(); ++i) {
+    if (UNLIKELY(row->GetTuple(i) == NULL)) {
+      dest_row->SetTuple(i, NULL);
+    } else {
+      dest_row->SetTuple(i, row->GetTuple(i)->DeepCopy(*descs[i],
+          dest->tuple_data_pool()));
+    }
+  }
+  dest->CommitLastRow();
+}
+
 // A channel sends data asynchronously via calls to TransmitData
 // to a single destination ipaddress/node.
-// It has a fixed-capacity buffer and allows the caller either to add rows to
+// It has a buffer of 'buffer_size' bytes of tuple data and allows the caller either to
+// add rows to
 // that buffer individually (AddRow()), or circumvent the buffer altogether and send
-// TRowBatches directly (SendBatch()). Either way, there can only be one in-flight RPC
-// at any one time (ie, sending will block if the most recent rpc hasn't finished,
-// which allows the receiver node to throttle the sender by withholding acks).
+// TRowBatches directly (SendBatch()). SendBatch() blocks until all in-flight RPCs have
+// finished. Batches of added rows are sent by up to 'max_rpcs_in_flight' concurrent
+// RPCs, each on its own connection, and adding rows only blocks once that many RPCs are
+// in flight. Either way, the receiver node throttles the sender by withholding acks
+// once its queues are full. With --datastream_mux, the rpcs are multiplexed over the
+// process' connection to the destination by the DataStreamMux instead.
+// If the destination is in this process, batches of added rows are handed to the
+// receiver by the DataStreamMgr instead, in the calling thread. The receiver then
+// throttles the sender by blocking that call.
 // *Not* thread-safe.
 class DataStreamSender::Channel {
  public:
@@ -60,9 +125,10 @@ class DataStreamSender::Channel {
   // combination. buffer_size is specified in bytes and a soft limit on
   // how much tuple data is getting accumulated before being sent; it only applies
   // when data is added via AddRow() and not sent directly via SendBatch().
+  // 'max_rpcs_in_flight' must be 1 if batches must arrive in the order they are sent.
   Channel(DataStreamSender* parent, const RowDescriptor& row_desc,
           const TNetworkAddress& destination, const TUniqueId& fragment_instance_id,
-          PlanNodeId dest_node_id, int buffer_size)
+          PlanNodeId dest_node_id, int buffer_size, int max_rpcs_in_flight)
     : parent_(parent),
       buffer_size_(buffer_size),
       client_cache_(NULL),
@@ -71,9 +137,25 @@ class DataStreamSender::Channel {
       fragment_instance_id_(fragment_instance_id),
       dest_node_id_(dest_node_id),
       num_data_bytes_sent_(0),
-      rpc_thread_("DataStreamSender", "SenderThread", 1, 1,
-          bind<void>(mem_fn(&Channel::TransmitData), this, _1, _2)),
-      rpc_in_flight_(false) {
+      is_local_(false),
+      stream_mgr_(NULL),
+      stream_mux_(NULL),
+      relay_destinations_(NULL),
+      relay_idx_(-1),
+      relay_fanout_(0),
+      num_batches_serialized_(0),
+      lz4_ratio_(1.0),
+      snappy_ratio_(1.0),
+      compression_(THdfsCompression::LZ4),
+      row_batches_(max_rpcs_in_flight),
+      rpc_thread_("DataStreamSender", "SenderThread", max_rpcs_in_flight,
+          max_rpcs_in_flight, bind<void>(mem_fn(&Channel::TransmitData), this, _1, _2)),
+      num_rpcs_in_flight_(0),
+      batch_is_shared_(false),
+      recvr_closed_(false) {
+    for (int i = 0; i < row_batches_.size(); ++i) {
+      free_row_batches_.push_back(&row_batches_[i]);
+    }
   }
 
   // Initialize channel.
@@ -81,20 +163,31 @@ class DataStreamSender::Channel {
   Status Init(RuntimeState* state);
 
   // Copies a single row into this channel's output buffer and flushes buffer
-  // if it reaches capacity.
+  // if it reaches capacity, i.e. holds buffer_size_ bytes of tuple data, including
+  // the var-len data of the rows, or as many rows as fit fixed-size tuples into it.
   // Returns error status if any of the preceding rpcs failed, OK otherwise.
   Status AddRow(TupleRow* row);
 
+  // Copies the rows of 'batch' with the indices 'row_idxs' into this channel's output
+  // buffer in order, flushing it whenever it reaches capacity.
+  Status AddRows(RowBatch* batch, const int* row_idxs, int num_rows);
+
+  // Copies all rows of 'batch' into this channel's output buffer, as AddRows().
+  Status AddBatch(RowBatch* batch);
+
   // Asynchronously sends a row batch.
   // Returns the status of the most recently finished TransmitData
   // rpc (or OK if there wasn't one that hasn't been reported yet).
-  Status SendBatch(TRowBatch* batch);
+  // 'is_shared' must be true if other channels send 'batch' at the same time. Otherwise
+  // the rpc moves the contents of 'batch' into its parameters rather than copying them,
+  // and moves them back once it is done.
+  Status SendBatch(TRowBatch* batch, bool is_shared = false);
 
   // Return status of last TransmitData rpc (initiated by the most recent call
   // to either SendBatch() or SendCurrentBatch()).
   Status GetSendStatus();
 
-  // Waits for the rpc thread pool to finish the current rpc.
+  // Waits for the rpc thread pool to finish all in-flight rpcs.
   void WaitForRpc();
 
   // Drain and shutdown the rpc thread and free the row batch allocation.
@@ -106,6 +199,36 @@ class DataStreamSender::Channel {
   int64_t num_data_bytes_sent() const { return num_data_bytes_sent_; }
   TRowBatch* thrift_batch() { return &thrift_batch_; }
 
+  // Returns true if the destination is on this host. Sending to it is not worth the
+  // cost of compression. Only valid after Init().
+  bool is_local() const { return is_local_; }
+
+  // Returns true if batches are handed to the receiver in this process rather than
+  // sent by rpc. Such channels only support adding rows, not SendBatch(). Only valid
+  // after Init().
+  bool is_in_process() const { return stream_mgr_ != NULL; }
+
+  // Serializes 'src' into 'dest', compressed with the codec that NextCompression() picks.
+  Status SerializeBatch(RowBatch* src, TRowBatch* dest);
+
+  const TNetworkAddress& address() const { return address_; }
+  const TUniqueId& fragment_instance_id() const { return fragment_instance_id_; }
+
+  // Makes this channel the destination at index 'idx' of the relay tree over
+  // 'destinations' with the given fanout. The channels of the root's children send
+  // their rpcs with the tree, so that the receivers relay them; the other channels
+  // don't send anything. 'destinations' must outlive the channel.
+  void SetRelay(const vector<TPlanFragmentDestination>* destinations, int idx,
+      int fanout);
+
+  // Returns true if the batches and eos of this channel are relayed by its parent in
+  // the relay tree rather than sent by this channel.
+  bool is_relayed() const { return relay_idx_ >= relay_fanout_; }
+
+  // Returns true if the receiver was closed before this channel's eos, i.e. it needs no
+  // more rows. The rows added to the channel since are dropped.
+  bool recvr_closed();
+
  private:
   DataStreamSender* parent_;
   int buffer_size_;
@@ -120,32 +243,92 @@ class DataStreamSender::Channel {
   // the number of TRowBatch.data bytes sent successfully
   int64_t num_data_bytes_sent_;
 
+  bool is_local_;
+
+  // The DataStreamMgr of this process if the receiver is in this process, otherwise
+  // NULL.
+  DataStreamMgr* stream_mgr_;
+
+  // The mux that carries the rpcs of this channel if --datastream_mux is set, otherwise
+  // NULL.
+  DataStreamMux* stream_mux_;
+
+  // The relay tree set by SetRelay() and this channel's index in it. NULL and -1 if
+  // the destination doesn't relay.
+  const vector<TPlanFragmentDestination>* relay_destinations_;
+  int relay_idx_;
+  int relay_fanout_;
+
+  // Sets the relay tree fields of 'params' if the destination relays.
+  void SetRelayParams(TTransmitDataParams* params);
+
+  // Number of batches serialized by SerializeBatch(), and the compressed-to-uncompressed
+  // size ratio of the tuple data for the last probe of LZ4 and Snappy.
+  int64_t num_batches_serialized_;
+  double lz4_ratio_;
+  double snappy_ratio_;
+
+  // Codec for the batches between probes.
+  THdfsCompression::type compression_;
+
+  // Returns the codec to serialize the next batch with.
+  THdfsCompression::type NextCompression() const;
+
   // we're accumulating rows into this batch
   scoped_ptr<RowBatch> batch_;
   TRowBatch thrift_batch_;
 
-  // We want to reuse the rpc thread to prevent creating a thread per rowbatch.
-  // TODO: currently we only have one batch in flight, but we should buffer more
-  // batches. This is a bit tricky since the channels share the outgoing batch
-  // pointer we need some mechanism to coordinate when the batch is all done.
-  // TODO: if the order of row batches does not matter, we can consider increasing
-  // the number of threads.
-  ThreadPool<TRowBatch*> rpc_thread_; // sender thread.
-  condition_variable rpc_done_cv_;   // signaled when rpc_in_flight_ is set to true.
-  mutex rpc_thread_lock_; // Lock with rpc_done_cv_ protecting rpc_in_flight_
-  bool rpc_in_flight_;  // true if the rpc_thread_ is busy sending.
-
-  Status rpc_status_;  // status of most recently finished TransmitData rpc
-
-  // Serialize batch_ into thrift_batch_ and send via SendBatch().
-  // Returns SendBatch() status.
+  // One serialized batch per rpc that may be in flight for the added rows. Those that
+  // no rpc reads are in 'free_row_batches_'.
+  vector<TRowBatch> row_batches_;
+  vector<TRowBatch*> free_row_batches_;
+
+  // We want to reuse the rpc threads to prevent creating a thread per rowbatch. There
+  // is one thread per rpc that may be in flight.
+  // TODO: the channels share the outgoing batch pointer for broadcasts, so those are
+  // still sent one at a time.
+  ThreadPool<TRowBatch*> rpc_thread_; // sender threads.
+  condition_variable rpc_done_cv_;   // signaled when an rpc finished.
+  // Lock with rpc_done_cv_ protecting num_rpcs_in_flight_, free_row_batches_,
+  // rpc_status_ and num_data_bytes_sent_ while rpcs are in flight.
+  mutex rpc_thread_lock_;
+  int num_rpcs_in_flight_;  // number of rpcs that rpc_thread_ is busy sending.
+  // 'is_shared' of the most recent SendBatch() call. Batches of added rows are never
+  // shared and are only sent while no SendBatch() rpc is in flight.
+  bool batch_is_shared_;
+
+  Status rpc_status_;  // first error of the finished TransmitData rpcs
+
+  // Set once an rpc or in-process transfer found the receiver closed. Protected by
+  // rpc_thread_lock_.
+  bool recvr_closed_;
+
+  // Serialize batch_ into a free batch of row_batches_ and start an rpc to send it.
+  // Blocks until a batch is free. Returns the status of the finished rpcs.
+  // In-process channels hand batch_ to the receiver instead.
   Status SendCurrentBatch();
 
+  // Hands the rows and resources of batch_ to the receiver in this process, blocking
+  // while its queue is full.
+  Status SendCurrentBatchInProcess();
+
+  // Hands 'batch' to the rpc thread pool.
+  void StartRpc(TRowBatch* batch, bool is_shared);
+
   // Synchronously call TransmitData() on a client from client_cache_ and update
   // rpc_status_ based on return value (or set to error if RPC failed).
   // Called from a thread from the rpc_thread_ pool.
-  void TransmitData(int thread_id, const TRowBatch*);
-  void TransmitDataHelper(const TRowBatch*);
+  void TransmitData(int thread_id, TRowBatch*);
+  void TransmitDataHelper(TRowBatch*);
+
+  // Sends 'params' to the destination, through stream_mux_ if it is set, and returns
+  // the status of the rpc or, if it succeeded, of the receiver.
+  Status DoTransmitData(TTransmitDataParams* params);
+
+  // Records the result of a finished rpc: the first error is kept in rpc_status_ and
+  // 'num_bytes_sent' is added to num_data_bytes_sent_ on success. A closed receiver is
+  // not an error, it only sets recvr_closed_.
+  void RecordRpcResult(const Status& status, int64_t num_bytes_sent);
 };
 
 Status DataStreamSender::Channel::Init(RuntimeState* state) {
@@ -153,105 +336,252 @@ Status DataStreamSender::Channel::Init(RuntimeState* state) {
   // TODO: figure out how to size batch_
   int capacity = max(1, buffer_size_ / max(row_desc_.GetRowSize(), 1));
   batch_.reset(new RowBatch(row_desc_, capacity, parent_->mem_tracker_.get()));
+  ExecEnv* exec_env = state->exec_env();
+  is_local_ =
+      exec_env != NULL && address_.hostname == exec_env->backend_address().hostname;
+  if (FLAGS_datastream_local_bypass && is_local_ &&
+      address_.port == exec_env->backend_address().port) {
+    stream_mgr_ = exec_env->stream_mgr();
+  }
+  if (FLAGS_datastream_mux && exec_env != NULL) stream_mux_ = exec_env->stream_mux();
+  return Status::OK();
+}
+
+void DataStreamSender::Channel::SetRelay(
+    const vector<TPlanFragmentDestination>* destinations, int idx, int fanout) {
+  DCHECK(!is_in_process());
+  relay_destinations_ = destinations;
+  relay_idx_ = idx;
+  relay_fanout_ = fanout;
+}
+
+void DataStreamSender::Channel::SetRelayParams(TTransmitDataParams* params) {
+  if (relay_destinations_ == NULL) return;
+  params->__set_relay_destinations(*relay_destinations_);
+  params->__set_relay_idx(relay_idx_);
+  params->__set_relay_fanout(relay_fanout_);
+}
+
+THdfsCompression::type DataStreamSender::Channel::NextCompression() const {
+  if (is_local_) return THdfsCompression::NONE;
+  int probe_idx = num_batches_serialized_ % COMPRESSION_PROBE_INTERVAL;
+  if (probe_idx == 0) return THdfsCompression::LZ4;
+  if (probe_idx == 1) return THdfsCompression::SNAPPY;
+  return compression_;
+}
+
+Status DataStreamSender::Channel::SerializeBatch(RowBatch* src, TRowBatch* dest) {
+  THdfsCompression::type compression = NextCompression();
+  RETURN_IF_ERROR(parent_->SerializeBatch(src, dest, 1, compression));
+  int probe_idx = num_batches_serialized_++ % COMPRESSION_PROBE_INTERVAL;
+  if (is_local_ || probe_idx > 1 || dest->uncompressed_size <= 0) return Status::OK();
+  // Serialize() leaves the data uncompressed if the codec didn't make it smaller.
+  double ratio = dest->compression_type == THdfsCompression::NONE ? 1.0 :
+      static_cast<double>(dest->tuple_data.size()) / dest->uncompressed_size;
+  if (probe_idx == 0) {
+    lz4_ratio_ = ratio;
+  } else {
+    snappy_ratio_ = ratio;
+    if (std::min(lz4_ratio_, snappy_ratio_) > 1.0 - MIN_COMPRESSION_SAVINGS) {
+      compression_ = THdfsCompression::NONE;
+    } else {
+      compression_ = lz4_ratio_ <= snappy_ratio_ ?
+          THdfsCompression::LZ4 : THdfsCompression::SNAPPY;
+    }
+  }
   return Status::OK();
 }
 
-Status DataStreamSender::Channel::SendBatch(TRowBatch* batch) {
+Status DataStreamSender::Channel::SendBatch(TRowBatch* batch, bool is_shared) {
+  DCHECK(!is_in_process());
   VLOG_ROW << "Channel::SendBatch() instance_id=" << fragment_instance_id_
            << " dest_node=" << dest_node_id_ << " #rows=" << batch->num_rows;
   // return if the previous batch saw an error
   RETURN_IF_ERROR(GetSendStatus());
+  if (recvr_closed()) return Status::OK();
+  StartRpc(batch, is_shared);
+  return Status::OK();
+}
+
+void DataStreamSender::Channel::StartRpc(TRowBatch* batch, bool is_shared) {
   {
     unique_lock<mutex> l(rpc_thread_lock_);
-    rpc_in_flight_ = true;
+    ++num_rpcs_in_flight_;
+    batch_is_shared_ = is_shared;
   }
   if (!rpc_thread_.Offer(batch)) {
     unique_lock<mutex> l(rpc_thread_lock_);
-    rpc_in_flight_ = false;
+    --num_rpcs_in_flight_;
   }
-  return Status::OK();
 }
 
-void DataStreamSender::Channel::TransmitData(int thread_id, const TRowBatch* batch) {
-  DCHECK(rpc_in_flight_);
+void DataStreamSender::Channel::TransmitData(int thread_id, TRowBatch* batch) {
+  DCHECK_GT(num_rpcs_in_flight_, 0);
   TransmitDataHelper(batch);
 
   {
     unique_lock<mutex> l(rpc_thread_lock_);
-    rpc_in_flight_ = false;
+    --num_rpcs_in_flight_;
+    if (batch >= &row_batches_[0] && batch < &row_batches_[0] + row_batches_.size()) {
+      free_row_batches_.push_back(batch);
+    }
   }
   rpc_done_cv_.notify_one();
 }
 
-void DataStreamSender::Channel::TransmitDataHelper(const TRowBatch* batch) {
+void DataStreamSender::Channel::TransmitDataHelper(TRowBatch* batch) {
   DCHECK(batch != NULL);
   VLOG_ROW << "Channel::TransmitData() instance_id=" << fragment_instance_id_
            << " dest_node=" << dest_node_id_
            << " #rows=" << batch->num_rows;
+  // Other rpcs of this channel may be in flight, so the result is only recorded under
+  // the lock.
   TTransmitDataParams params;
   params.protocol_version = ImpalaInternalServiceVersion::V1;
   params.__set_dest_fragment_instance_id(fragment_instance_id_);
   params.__set_dest_node_id(dest_node_id_);
-  params.__set_row_batch(*batch);  // yet another copy
+  if (batch_is_shared_) {
+    params.__set_row_batch(*batch);  // yet another copy
+  } else {
+    // No other rpc reads 'batch' and the channel doesn't touch it until this rpc is
+    // done, so the tuple data can be lent to the params.
+    SwapRowBatches(batch, &params.row_batch);
+    params.__isset.row_batch = true;
+  }
   params.__set_eos(false);
   params.__set_sender_id(parent_->sender_id_);
+  SetRelayParams(&params);
 
-  ImpalaInternalServiceConnection client(client_cache_, address_, &rpc_status_);
-  if (!rpc_status_.ok()) return;
-
-  TTransmitDataResult res;
+  Status status;
   {
     SCOPED_TIMER(parent_->thrift_transmit_timer_);
-    rpc_status_ =
-        client.DoRpc(&ImpalaInternalServiceClient::TransmitData, params, &res);
-    if (!rpc_status_.ok()) return;
+    status = DoTransmitData(&params);
   }
-
-  if (res.status.status_code != TErrorCode::OK) {
-    rpc_status_ = res.status;
+  // Hand the buffers back so that the next serialization into 'batch' reuses them.
+  if (!batch_is_shared_) SwapRowBatches(&params.row_batch, batch);
+  if (!status.ok()) {
+    RecordRpcResult(status, 0);
   } else {
-    num_data_bytes_sent_ += RowBatch::GetBatchSize(*batch);
-    VLOG_ROW << "incremented #data_bytes_sent="
-             << num_data_bytes_sent_;
+    RecordRpcResult(Status::OK(), RowBatch::GetBatchSize(*batch));
+  }
+}
+
+Status DataStreamSender::Channel::DoTransmitData(TTransmitDataParams* params) {
+  if (stream_mux_ != NULL) return stream_mux_->TransmitData(address_, params);
+  Status status;
+  ImpalaInternalServiceConnection client(client_cache_, address_, &status);
+  RETURN_IF_ERROR(status);
+  TTransmitDataResult res;
+  RETURN_IF_ERROR(
+      client.DoRpc(&ImpalaInternalServiceClient::TransmitData, *params, &res));
+  return Status(res.status);
+}
+
+void DataStreamSender::Channel::RecordRpcResult(const Status& status,
+    int64_t num_bytes_sent) {
+  unique_lock<mutex> l(rpc_thread_lock_);
+  if (status.code() == TErrorCode::DATASTREAM_RECVR_CLOSED) {
+    VLOG_QUERY << "Receiver closed, stopped sending to instance_id="
+               << fragment_instance_id_ << " dest_node=" << dest_node_id_;
+    recvr_closed_ = true;
+    return;
+  }
+  if (!status.ok()) {
+    if (rpc_status_.ok()) rpc_status_ = status;
+    return;
   }
+  num_data_bytes_sent_ += num_bytes_sent;
+  VLOG_ROW << "incremented #data_bytes_sent=" << num_data_bytes_sent_;
+}
+
+bool DataStreamSender::Channel::recvr_closed() {
+  unique_lock<mutex> l(rpc_thread_lock_);
+  return recvr_closed_;
 }
 
 void DataStreamSender::Channel::WaitForRpc() {
   SCOPED_TIMER(parent_->state_->total_network_send_timer());
   unique_lock<mutex> l(rpc_thread_lock_);
-  while (rpc_in_flight_) {
+  while (num_rpcs_in_flight_ > 0) {
     rpc_done_cv_.wait(l);
   }
 }
 
 Status DataStreamSender::Channel::AddRow(TupleRow* row) {
-  if (batch_->AtCapacity()) {
-    // batch_ is full, let's send it; but first wait for an ongoing
-    // transmission to finish before modifying thrift_batch_
+  if (batch_->AtCapacity() ||
+      batch_->tuple_data_pool()->total_allocated_bytes() >= buffer_size_) {
+    // batch_ is full, let's send it; this waits if the maximum number of
+    // transmissions is ongoing
     RETURN_IF_ERROR(SendCurrentBatch());
   }
-  TupleRow* dest = batch_->GetRow(batch_->AddRow());
-  batch_->CopyRow(row, dest);
-  const vector<TupleDescriptor*>& descs = row_desc_.tuple_descriptors();
-  for (int i = 0; i < descs.size(); ++i) {
-    if (UNLIKELY(row->GetTuple(i) == NULL)) {
-      dest->SetTuple(i, NULL);
-    } else {
-      dest->SetTuple(i, row->GetTuple(i)->DeepCopy(*descs[i],
-          batch_->tuple_data_pool()));
-    }
+  DeepCopyRow(row, row_desc_, batch_.get());
+  return Status::OK();
+}
+
+Status DataStreamSender::Channel::AddRows(RowBatch* batch, const int* row_idxs,
+    int num_rows) {
+  for (int i = 0; i < num_rows; ++i) {
+    RETURN_IF_ERROR(AddRow(batch->GetRow(row_idxs[i])));
   }
-  batch_->CommitLastRow();
+  return Status::OK();
+}
+
+Status DataStreamSender::Channel::AddBatch(RowBatch* batch) {
+  for (int i = 0; i < batch->num_rows(); ++i) {
+    RETURN_IF_ERROR(AddRow(batch->GetRow(i)));
+  }
+  return Status::OK();
+}
+
+Status DataStreamSender::Channel::SendCurrentBatchInProcess() {
+  int64_t num_bytes = batch_->tuple_data_pool()->total_allocated_bytes();
+  Status status;
+  {
+    SCOPED_TIMER(parent_->local_transfer_timer_);
+    status = stream_mgr_->AddData(fragment_instance_id_, dest_node_id_, batch_.get(),
+        parent_->sender_id_);
+  }
+  // The receiver left batch_ empty, unless it was closed.
+  batch_->Reset();
+  if (status.code() == TErrorCode::DATASTREAM_RECVR_CLOSED) {
+    RecordRpcResult(status, 0);
+    return Status::OK();
+  }
+  RETURN_IF_ERROR(status);
+  num_data_bytes_sent_ += num_bytes;
+  COUNTER_ADD(parent_->local_bytes_sent_counter_, num_bytes);
   return Status::OK();
 }
 
 Status DataStreamSender::Channel::SendCurrentBatch() {
-  // make sure there's no in-flight TransmitData() call that might still want to
-  // access thrift_batch_
-  WaitForRpc();
-  RETURN_IF_ERROR(parent_->SerializeBatch(batch_.get(), &thrift_batch_));
+  if (recvr_closed()) {
+    batch_->Reset();
+    return Status::OK();
+  }
+  if (is_in_process()) return SendCurrentBatchInProcess();
+  // wait for a batch that no in-flight TransmitData() call still wants to access
+  TRowBatch* thrift_batch;
+  {
+    SCOPED_TIMER(parent_->state_->total_network_send_timer());
+    unique_lock<mutex> l(rpc_thread_lock_);
+    while (free_row_batches_.empty()) {
+      rpc_done_cv_.wait(l);
+    }
+    if (!rpc_status_.ok()) {
+      LOG(ERROR) << "channel send status: " << rpc_status_.GetDetail();
+      return rpc_status_;
+    }
+    thrift_batch = free_row_batches_.back();
+    free_row_batches_.pop_back();
+  }
+  Status status = SerializeBatch(batch_.get(), thrift_batch);
+  if (!status.ok()) {
+    unique_lock<mutex> l(rpc_thread_lock_);
+    free_row_batches_.push_back(thrift_batch);
+    return status;
+  }
   batch_->Reset();
-  RETURN_IF_ERROR(SendBatch(&thrift_batch_));
+  StartRpc(thrift_batch, false);
   return Status::OK();
 }
 
@@ -278,9 +608,11 @@ Status DataStreamSender::Channel::FlushAndSendEos(RuntimeState* state) {
 
   RETURN_IF_ERROR(GetSendStatus());
 
-  Status client_cnxn_status;
-  ImpalaInternalServiceConnection client(client_cache_, address_, &client_cnxn_status);
-  RETURN_IF_ERROR(client_cnxn_status);
+  if (is_in_process()) {
+    VLOG_RPC << "closing in-process channel.";
+    return stream_mgr_->CloseSender(fragment_instance_id_, dest_node_id_,
+        parent_->sender_id_);
+  }
 
   TTransmitDataParams params;
   params.protocol_version = ImpalaInternalServiceVersion::V1;
@@ -288,16 +620,16 @@ Status DataStreamSender::Channel::FlushAndSendEos(RuntimeState* state) {
   params.__set_dest_node_id(dest_node_id_);
   params.__set_sender_id(parent_->sender_id_);
   params.__set_eos(true);
-  TTransmitDataResult res;
+  SetRelayParams(&params);
 
   VLOG_RPC << "calling TransmitData(eos=true) to terminate channel.";
-  rpc_status_ = client.DoRpc(&ImpalaInternalServiceClient::TransmitData, params, &res);
-  if (!rpc_status_.ok()) {
+  Status status = DoTransmitData(&params);
+  if (!status.ok()) {
     stringstream msg;
-    msg << "TransmitData(eos=true) to " << address_ << " failed:\n" << rpc_status_.msg().msg();
-    return Status(rpc_status_.code(), msg.str());
+    msg << "TransmitData(eos=true) to " << address_ << " failed:\n" << status.msg().msg();
+    return Status(status.code(), msg.str());
   }
-  return Status(res.status);
+  return Status::OK();
 }
 
 void DataStreamSender::Channel::Teardown(RuntimeState* state) {
@@ -318,23 +650,38 @@ DataStreamSender::DataStreamSender(ObjectPool* pool, int sender_id,
     flushed_(false),
     closed_(false),
     current_thrift_batch_(&thrift_batch1_),
+    avg_row_bytes_(0),
+    range_is_asc_order_(true),
+    range_nulls_first_(false),
     profile_(NULL),
     serialize_batch_timer_(NULL),
     thrift_transmit_timer_(NULL),
     bytes_sent_counter_(NULL),
+    local_bytes_sent_counter_(NULL),
+    local_transfer_timer_(NULL),
     dest_node_id_(sink.dest_node_id) {
   DCHECK_GT(destinations.size(), 0);
   DCHECK(sink.output_partition.type == TPartitionType::UNPARTITIONED
       || sink.output_partition.type == TPartitionType::HASH_PARTITIONED
+      || sink.output_partition.type == TPartitionType::RANGE_PARTITIONED
       || sink.output_partition.type == TPartitionType::RANDOM);
   broadcast_ = sink.output_partition.type == TPartitionType::UNPARTITIONED;
   random_ = sink.output_partition.type == TPartitionType::RANDOM;
+  range_ = sink.output_partition.type == TPartitionType::RANGE_PARTITIONED;
+  dedup_policy_.reset(new TupleDedupPolicy());
+  // Partitioned batches may be sent concurrently unless the destination needs them in
+  // order, i.e. merges sorted streams. Older plans don't say, so they keep the order.
+  int max_rpcs_in_flight = 1;
+  bool preserve_order = !sink.__isset.preserve_batch_order || sink.preserve_batch_order;
+  if (!broadcast_ && !random_ && !preserve_order) {
+    max_rpcs_in_flight = max(1, FLAGS_datastream_sender_max_rpcs_in_flight);
+  }
   // TODO: use something like google3's linked_ptr here (scoped_ptr isn't copyable)
   for (int i = 0; i < destinations.size(); ++i) {
     channels_.push_back(
         new Channel(this, row_desc, destinations[i].server,
                     destinations[i].fragment_instance_id,
-                    sink.dest_node_id, per_channel_buffer_size));
+                    sink.dest_node_id, per_channel_buffer_size, max_rpcs_in_flight));
   }
 
   if (broadcast_ || random_) {
@@ -343,13 +690,21 @@ DataStreamSender::DataStreamSender(ObjectPool* pool, int sender_id,
     random_shuffle(channels_.begin(), channels_.end());
   }
 
-  if (sink.output_partition.type == TPartitionType::HASH_PARTITIONED) {
+  if (sink.output_partition.type == TPartitionType::HASH_PARTITIONED || range_) {
     // TODO: move this to Init()? would need to save 'sink' somewhere
     Status status =
         Expr::CreateExprTrees(pool, sink.output_partition.partition_exprs,
                               &partition_expr_ctxs_);
     DCHECK(status.ok());
   }
+  if (range_) {
+    DCHECK_EQ(partition_expr_ctxs_.size(), 1);
+    Status status = Expr::CreateExprTrees(pool,
+        sink.output_partition.range_split_points, &range_split_point_ctxs_);
+    DCHECK(status.ok());
+    range_is_asc_order_ = sink.output_partition.range_is_asc_order;
+    range_nulls_first_ = sink.output_partition.range_nulls_first;
+  }
 }
 
 DataStreamSender::~DataStreamSender() {
@@ -372,6 +727,8 @@ Status DataStreamSender::Prepare(RuntimeState* state) {
       state->instance_mem_tracker()));
   RETURN_IF_ERROR(
       Expr::Prepare(partition_expr_ctxs_, state, row_desc_, mem_tracker_.get()));
+  RETURN_IF_ERROR(
+      Expr::Prepare(range_split_point_ctxs_, state, row_desc_, mem_tracker_.get()));
 
   bytes_sent_counter_ =
       ADD_COUNTER(profile(), "BytesSent", TUnit::BYTES);
@@ -380,6 +737,8 @@ Status DataStreamSender::Prepare(RuntimeState* state) {
   serialize_batch_timer_ =
       ADD_TIMER(profile(), "SerializeBatchTime");
   thrift_transmit_timer_ = ADD_TIMER(profile(), "ThriftTransmitTime(*)");
+  local_bytes_sent_counter_ = ADD_COUNTER(profile(), "LocalBytesSent", TUnit::BYTES);
+  local_transfer_timer_ = ADD_TIMER(profile(), "LocalTransferTime");
   network_throughput_ =
       profile()->AddDerivedCounter("NetworkThroughput(*)", TUnit::BYTES_PER_SECOND,
           bind<int64_t>(&RuntimeProfile::UnitsPerSecond, bytes_sent_counter_,
@@ -389,14 +748,67 @@ Status DataStreamSender::Prepare(RuntimeState* state) {
            bind<int64_t>(&RuntimeProfile::UnitsPerSecond, bytes_sent_counter_,
                          profile()->total_time_counter()));
 
+  shared_batch_compression_ = THdfsCompression::NONE;
+  num_rpc_channels_ = 0;
   for (int i = 0; i < channels_.size(); ++i) {
     RETURN_IF_ERROR(channels_[i]->Init(state));
+    if (!channels_[i]->is_local()) shared_batch_compression_ = THdfsCompression::LZ4;
+    if (!channels_[i]->is_in_process()) ++num_rpc_channels_;
+  }
+  int fanout = FLAGS_datastream_broadcast_fanout;
+  if (broadcast_ && fanout > 0 && num_rpc_channels_ > fanout) {
+    // The remote receivers form a tree in the (shuffled) order of the channels, with
+    // this sender as its root. Only the channels of the root's children send.
+    for (int i = 0; i < channels_.size(); ++i) {
+      if (channels_[i]->is_in_process()) continue;
+      TPlanFragmentDestination dest;
+      dest.__set_fragment_instance_id(channels_[i]->fragment_instance_id());
+      dest.__set_server(channels_[i]->address());
+      channels_[i]->SetRelay(&relay_destinations_, relay_destinations_.size(), fanout);
+      relay_destinations_.push_back(dest);
+    }
+    num_rpc_channels_ = fanout;
+  }
+  if (broadcast_ || random_ || channels_.size() == 1) {
+    int capacity = max(1, FLAGS_datastream_target_batch_bytes /
+        max(row_desc_.GetRowSize(), 1));
+    staging_batch_.reset(new RowBatch(row_desc_, capacity, mem_tracker_.get()));
   }
   return Status::OK();
 }
 
 Status DataStreamSender::Open(RuntimeState* state) {
-  return Expr::Open(partition_expr_ctxs_, state);
+  RETURN_IF_ERROR(Expr::Open(partition_expr_ctxs_, state));
+  RETURN_IF_ERROR(Expr::Open(range_split_point_ctxs_, state));
+  // The split points are constants. Each context holds its own value.
+  for (int i = 0; i < range_split_point_ctxs_.size(); ++i) {
+    void* split_point = range_split_point_ctxs_[i]->GetValue(NULL);
+    DCHECK(split_point != NULL);
+    range_split_points_.push_back(split_point);
+  }
+  return Status::OK();
+}
+
+int DataStreamSender::GetRangeIdx(TupleRow* row) {
+  ExprContext* ctx = partition_expr_ctxs_[0];
+  void* value = ctx->GetValue(row);
+  int num_split_points = range_split_points_.size();
+  if (value == NULL) return range_nulls_first_ ? 0 : num_split_points;
+  const ColumnType& type = ctx->root()->type();
+  // Find the first split point that 'value' does not sort after.
+  int lo = 0;
+  int hi = num_split_points;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    int cmp = RawValue::Compare(value, range_split_points_[mid], type);
+    if (!range_is_asc_order_) cmp = -cmp;
+    if (cmp > 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
 }
 
 Status DataStreamSender::Send(RuntimeState* state, RowBatch* batch, bool eos) {
@@ -405,33 +817,30 @@ Status DataStreamSender::Send(RuntimeState* state, RowBatch* batch, bool eos) {
   DCHECK(!flushed_);
 
   if (batch->num_rows() == 0) return Status::OK();
-  if (broadcast_ || channels_.size() == 1) {
-    // current_thrift_batch_ is *not* the one that was written by the last call
-    // to Serialize()
-    RETURN_IF_ERROR(SerializeBatch(batch, current_thrift_batch_, channels_.size()));
-    // SendBatch() will block if there are still in-flight rpcs (and those will
-    // reference the previously written thrift batch)
-    for (int i = 0; i < channels_.size(); ++i) {
-      RETURN_IF_ERROR(channels_[i]->SendBatch(current_thrift_batch_));
+  if (broadcast_ || random_ || channels_.size() == 1) {
+    RETURN_IF_ERROR(SendWholeBatch(batch));
+  } else if (range_) {
+    // range-partition batch's rows across channels; consecutive ranges are assigned to
+    // the same channel, so each channel receives a contiguous part of the key range
+    int num_channels = channels_.size();
+    int num_ranges = range_split_points_.size() + 1;
+    row_channels_.resize(batch->num_rows());
+    for (int i = 0; i < batch->num_rows(); ++i) {
+      int range_idx = GetRangeIdx(batch->GetRow(i));
+      row_channels_[i] = range_idx * num_channels / num_ranges;
     }
-    current_thrift_batch_ =
-        (current_thrift_batch_ == &thrift_batch1_ ? &thrift_batch2_ : &thrift_batch1_);
-  } else if (random_) {
-    // Round-robin batches among channels. Wait for the current channel to finish its
-    // rpc before overwriting its batch.
-    Channel* current_channel = channels_[current_channel_idx_];
-    current_channel->WaitForRpc();
-    RETURN_IF_ERROR(SerializeBatch(batch, current_channel->thrift_batch()));
-    RETURN_IF_ERROR(current_channel->SendBatch(current_channel->thrift_batch()));
-    current_channel_idx_ = (current_channel_idx_ + 1) % channels_.size();
+    ExprContext::FreeLocalAllocations(partition_expr_ctxs_);
+    RETURN_IF_ERROR(AddRowsToChannels(batch));
   } else {
-    // hash-partition batch's rows across channels
+    // hash-partition batch's rows across channels: hash all rows first, then copy the
+    // rows of each channel together
     int num_channels = channels_.size();
+    row_channels_.resize(batch->num_rows());
     for (int i = 0; i < batch->num_rows(); ++i) {
       TupleRow* row = batch->GetRow(i);
       uint32_t hash_val = HashUtil::FNV_SEED;
-      for (int i = 0; i < partition_expr_ctxs_.size(); ++i) {
-        ExprContext* ctx = partition_expr_ctxs_[i];
+      for (int j = 0; j < partition_expr_ctxs_.size(); ++j) {
+        ExprContext* ctx = partition_expr_ctxs_[j];
         void* partition_val = ctx->GetValue(row);
         // We can't use the crc hash function here because it does not result
         // in uncorrelated hashes with different seeds.  Instead we must use
@@ -440,22 +849,135 @@ Status DataStreamSender::Send(RuntimeState* state, RowBatch* batch, bool eos) {
         hash_val =
             RawValue::GetHashValueFnv(partition_val, ctx->root()->type(), hash_val);
       }
-      ExprContext::FreeLocalAllocations(partition_expr_ctxs_);
-      RETURN_IF_ERROR(channels_[hash_val % num_channels]->AddRow(row));
+      row_channels_[i] = hash_val % num_channels;
     }
+    // The partition values were only needed for the hashes.
+    ExprContext::FreeLocalAllocations(partition_expr_ctxs_);
+    RETURN_IF_ERROR(AddRowsToChannels(batch));
   }
   RETURN_IF_ERROR(state->CheckQueryState());
   return Status::OK();
 }
 
+bool DataStreamSender::NeedsMoreRows() {
+  for (int i = 0; i < channels_.size(); ++i) {
+    if (channels_[i]->is_relayed() || !channels_[i]->recvr_closed()) return true;
+  }
+  return false;
+}
+
+Status DataStreamSender::SendWholeBatch(RowBatch* batch) {
+  bool to_all_channels = broadcast_ || channels_.size() == 1;
+  if (to_all_channels) {
+    // In-process channels copy the rows instead, since 'batch' stays owned by the
+    // caller. Their buffers are already sized by bytes.
+    for (int i = 0; i < channels_.size(); ++i) {
+      if (channels_[i]->is_in_process()) RETURN_IF_ERROR(channels_[i]->AddBatch(batch));
+    }
+    if (num_rpc_channels_ == 0) return Status::OK();
+  }
+  // Send batches of about the target size as they are. The size of the others is
+  // estimated from the rows of the last serialized batch; they are coalesced or split
+  // by copying their rows into staging_batch_, which is sent once it reaches the
+  // target size. Rows are sent in order, so nothing bypasses a partly filled
+  // staging_batch_.
+  int64_t target_bytes = FLAGS_datastream_target_batch_bytes;
+  double estimated_bytes = batch->num_rows() * avg_row_bytes_;
+  if (staging_batch_->num_rows() == 0 && (avg_row_bytes_ == 0 ||
+      (estimated_bytes >= target_bytes / 2 && estimated_bytes <= target_bytes * 2))) {
+    return SendBatchToChannels(batch);
+  }
+  for (int i = 0; i < batch->num_rows(); ++i) {
+    DeepCopyRow(batch->GetRow(i), row_desc_, staging_batch_.get());
+    if (staging_batch_->AtCapacity() ||
+        staging_batch_->tuple_data_pool()->total_allocated_bytes() >= target_bytes) {
+      RETURN_IF_ERROR(SendStagingBatch());
+    }
+  }
+  return Status::OK();
+}
+
+Status DataStreamSender::SendStagingBatch() {
+  Status status = SendBatchToChannels(staging_batch_.get());
+  // The rows were serialized or copied by the channels.
+  staging_batch_->Reset();
+  return status;
+}
+
+Status DataStreamSender::SendBatchToChannels(RowBatch* batch) {
+  if (broadcast_ || channels_.size() == 1) {
+    // Serialize the batch once for all channels that send by rpc.
+    // current_thrift_batch_ is *not* the one that was written by the last call
+    // to Serialize()
+    RETURN_IF_ERROR(SerializeBatch(batch, current_thrift_batch_, num_rpc_channels_,
+        shared_batch_compression_));
+    // SendBatch() will block if there are still in-flight rpcs (and those will
+    // reference the previously written thrift batch)
+    bool is_shared = num_rpc_channels_ > 1;
+    for (int i = 0; i < channels_.size(); ++i) {
+      if (channels_[i]->is_in_process() || channels_[i]->is_relayed()) continue;
+      RETURN_IF_ERROR(channels_[i]->SendBatch(current_thrift_batch_, is_shared));
+    }
+    current_thrift_batch_ =
+        (current_thrift_batch_ == &thrift_batch1_ ? &thrift_batch2_ : &thrift_batch1_);
+  } else {
+    // Round-robin batches among channels, skipping those whose receivers need no more
+    // rows. Wait for the current channel to finish its rpc before overwriting its batch.
+    for (int i = 1; i < channels_.size(); ++i) {
+      if (!channels_[current_channel_idx_]->recvr_closed()) break;
+      current_channel_idx_ = (current_channel_idx_ + 1) % channels_.size();
+    }
+    Channel* current_channel = channels_[current_channel_idx_];
+    if (current_channel->is_in_process()) {
+      RETURN_IF_ERROR(current_channel->AddBatch(batch));
+    } else {
+      current_channel->WaitForRpc();
+      RETURN_IF_ERROR(
+          current_channel->SerializeBatch(batch, current_channel->thrift_batch()));
+      RETURN_IF_ERROR(current_channel->SendBatch(current_channel->thrift_batch()));
+    }
+    current_channel_idx_ = (current_channel_idx_ + 1) % channels_.size();
+  }
+  return Status::OK();
+}
+
+Status DataStreamSender::AddRowsToChannels(RowBatch* batch) {
+  int num_rows = batch->num_rows();
+  int num_channels = channels_.size();
+  // Group the row indices by channel, keeping the order of the rows: count the rows of
+  // each channel, turn the counts into the start of each group and then use the starts
+  // as insertion cursors, which leaves them at the end of each group.
+  channel_starts_.assign(num_channels + 1, 0);
+  for (int i = 0; i < num_rows; ++i) ++channel_starts_[row_channels_[i] + 1];
+  for (int c = 0; c < num_channels; ++c) channel_starts_[c + 1] += channel_starts_[c];
+  channel_row_idxs_.resize(num_rows);
+  for (int i = 0; i < num_rows; ++i) {
+    channel_row_idxs_[channel_starts_[row_channels_[i]]++] = i;
+  }
+  int start = 0;
+  for (int c = 0; c < num_channels; ++c) {
+    int end = channel_starts_[c];
+    if (end > start) {
+      RETURN_IF_ERROR(
+          channels_[c]->AddRows(batch, &channel_row_idxs_[start], end - start));
+    }
+    start = end;
+  }
+  return Status::OK();
+}
+
 Status DataStreamSender::FlushFinal(RuntimeState* state) {
   DCHECK(!flushed_);
   DCHECK(!closed_);
   flushed_ = true;
+  if (staging_batch_ != NULL && staging_batch_->num_rows() > 0) {
+    RETURN_IF_ERROR(SendStagingBatch());
+  }
   for (int i = 0; i < channels_.size(); ++i) {
     // If we hit an error here, we can return without closing the remaining channels as
     // the error is propagated back to the coordinator, which in turn cancels the query,
     // which will cause the remaining open channels to be closed.
+    if (channels_[i]->is_relayed()) continue;
     RETURN_IF_ERROR(channels_[i]->FlushAndSendEos(state));
   }
   return Status::OK();
@@ -466,7 +988,9 @@ void DataStreamSender::Close(RuntimeState* state) {
   for (int i = 0; i < channels_.size(); ++i) {
     channels_[i]->Teardown(state);
   }
+  staging_batch_.reset();
   Expr::Close(partition_expr_ctxs_, state);
+  Expr::Close(range_split_point_ctxs_, state);
   if (mem_tracker_.get() != NULL) {
     mem_tracker_->UnregisterFromParent();
     mem_tracker_.reset();
@@ -474,11 +998,12 @@ void DataStreamSender::Close(RuntimeState* state) {
   closed_ = true;
 }
 
-Status DataStreamSender::SerializeBatch(RowBatch* src, TRowBatch* dest, int num_receivers) {
+Status DataStreamSender::SerializeBatch(RowBatch* src, TRowBatch* dest, int num_receivers,
+    THdfsCompression::type compression) {
   VLOG_ROW << "serializing " << src->num_rows() << " rows";
   {
     SCOPED_TIMER(serialize_batch_timer_);
-    RETURN_IF_ERROR(src->Serialize(dest));
+    RETURN_IF_ERROR(src->Serialize(dest, compression, dedup_policy_.get()));
     int bytes = RowBatch::GetBatchSize(*dest);
     int uncompressed_bytes = bytes - dest->tuple_data.size() + dest->uncompressed_size;
     // The size output_batch would be if we didn't compress tuple_data (will be equal to
@@ -487,6 +1012,9 @@ Status DataStreamSender::SerializeBatch(RowBatch* src, TRowBatch* dest, int num_
     COUNTER_ADD(bytes_sent_counter_, bytes * num_receivers);
     COUNTER_ADD(uncompressed_bytes_counter_, uncompressed_bytes * num_receivers);
   }
+  if (src->num_rows() > 0) {
+    avg_row_bytes_ = static_cast<double>(dest->uncompressed_size) / src->num_rows();
+  }
   return Status::OK();
 }
 
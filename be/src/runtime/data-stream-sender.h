@@ -25,6 +25,7 @@
 #include "common/status.h"
 #include "util/runtime-profile.h"
 #include "gen-cpp/Results_types.h" // for TRowBatch
+#include "gen-cpp/ImpalaInternalService_types.h" // for TPlanFragmentDestination
 
 namespace impala {
 
@@ -35,10 +36,13 @@ class MemTracker;
 class TDataStreamSink;
 class TNetworkAddress;
 class TPlanFragmentDestination;
+class TupleDedupPolicy;
+class TupleRow;
 
 /// Single sender of an m:n data stream.
 /// Row batch data is routed to destinations based on the provided
-/// partitioning specification.
+/// partitioning specification. Rows for destinations in this process are not
+/// serialized: they are copied into batches that are handed to the receiver.
 /// *Not* thread-safe.
 //
 /// TODO: capture stats that describe distribution of rows/data volume
@@ -52,7 +56,7 @@ class DataStreamSender : public DataSink {
   /// and is specified in bytes.
   /// The RowDescriptor must live until Close() is called.
   /// NOTE: supported partition types are UNPARTITIONED (broadcast), HASH_PARTITIONED,
-  /// and RANDOM.
+  /// RANGE_PARTITIONED and RANDOM.
   DataStreamSender(ObjectPool* pool, int sender_id,
     const RowDescriptor& row_desc, const TDataStreamSink& sink,
     const std::vector<TPlanFragmentDestination>& destinations,
@@ -79,14 +83,20 @@ class DataStreamSender : public DataSink {
   /// Send() call).
   virtual Status Send(RuntimeState* state, RowBatch* batch, bool eos);
 
+  /// Returns false once all receivers were closed before the eos of their channel.
+  /// Receivers that are relayed to are never considered closed.
+  virtual bool NeedsMoreRows();
+
   /// Shutdown all existing channels to destination hosts. Further FlushFinal() calls are
   /// illegal after calling Close().
   virtual void Close(RuntimeState* state);
 
   /// Serializes the src batch into the dest thrift batch. Maintains metrics.
   /// num_receivers is the number of receivers this batch will be sent to. Only
-  /// used to maintain metrics.
-  Status SerializeBatch(RowBatch* src, TRowBatch* dest, int num_receivers = 1);
+  /// used to maintain metrics. The tuple data is compressed with 'compression' if that
+  /// makes it smaller.
+  Status SerializeBatch(RowBatch* src, TRowBatch* dest, int num_receivers = 1,
+      THdfsCompression::type compression = THdfsCompression::LZ4);
 
   /// Return total number of bytes sent in TRowBatch.data. If batches are
   /// broadcast to multiple receivers, they are counted once per receiver.
@@ -104,6 +114,12 @@ class DataStreamSender : public DataSink {
   const RowDescriptor& row_desc_;
   bool broadcast_;  // if true, send all rows on all channels
   bool random_; // if true, round-robins row batches among channels
+  bool range_; // if true, range-partitions rows among channels
+  // codec of the batches that are broadcast or sent to the only channel: none if all
+  // destinations are on this host
+  THdfsCompression::type shared_batch_compression_;
+  // number of channels that send by rpc rather than to a receiver in this process
+  int num_rpc_channels_;
   int current_channel_idx_; // index of current channel to send to if random_ == true
 
   /// If true, this sender has called FlushFinal() successfully.
@@ -119,14 +135,68 @@ class DataStreamSender : public DataSink {
   TRowBatch thrift_batch2_;
   TRowBatch* current_thrift_batch_;  // the next one to fill in Send()
 
+  /// For broadcast, random and single-channel senders: rows of input batches that are
+  /// far from --datastream_target_batch_bytes, copied to be sent in batches of about
+  /// that size. Only used for channels that send by rpc.
+  boost::scoped_ptr<RowBatch> staging_batch_;
+
+  /// Uncompressed tuple data bytes per row of the last serialized batch, used to
+  /// estimate the size of input batches. 0 until a batch was serialized.
+  double avg_row_bytes_;
+
+  /// Chooses how SerializeBatch() deduplicates the tuples of each batch from the
+  /// duplicates found in the previous ones.
+  boost::scoped_ptr<TupleDedupPolicy> dedup_policy_;
+
   std::vector<ExprContext*> partition_expr_ctxs_;  // compute per-row partition values
   std::vector<Channel*> channels_;
 
+  /// For broadcasts with --datastream_broadcast_fanout: the remote destinations in the
+  /// order of their relay tree, sent along with each rpc.
+  std::vector<TPlanFragmentDestination> relay_destinations_;
+
+  /// For range partitioning: the split points of the ranges, in the order given by
+  /// 'range_is_asc_order_' and 'range_nulls_first_', and their values once opened.
+  std::vector<ExprContext*> range_split_point_ctxs_;
+  std::vector<void*> range_split_points_;
+  bool range_is_asc_order_;
+  bool range_nulls_first_;
+
+  /// Returns the index of the range that 'row' belongs to, in [0, number of split
+  /// points].
+  int GetRangeIdx(TupleRow* row);
+
+  /// Scratch space for hash and range partitioning a batch: the channel of each row,
+  /// the row indices grouped by channel and the bounds of the groups.
+  std::vector<int> row_channels_;
+  std::vector<int> channel_row_idxs_;
+  std::vector<int> channel_starts_;
+
+  /// Sends 'batch' to all channels, or to the next one for random senders, coalescing
+  /// or splitting it through 'staging_batch_' if it is far from the target size.
+  Status SendWholeBatch(RowBatch* batch);
+
+  /// Sends and resets 'staging_batch_'.
+  Status SendStagingBatch();
+
+  /// Serializes 'batch' and sends it to the rpc channels, or to the next channel for
+  /// random senders, without resizing it.
+  Status SendBatchToChannels(RowBatch* batch);
+
+  /// Adds the rows of 'batch' to the channels in 'row_channels_', one channel at a time
+  /// so that each channel's buffer is filled in one go.
+  Status AddRowsToChannels(RowBatch* batch);
+
   RuntimeProfile* profile_; // Allocated from pool_
   RuntimeProfile::Counter* serialize_batch_timer_;
   RuntimeProfile::Counter* thrift_transmit_timer_;
   RuntimeProfile::Counter* bytes_sent_counter_;
   RuntimeProfile::Counter* uncompressed_bytes_counter_;
+
+  /// Tuple data bytes handed to receivers in this process, and the time spent doing so,
+  /// including the time the receivers blocked.
+  RuntimeProfile::Counter* local_bytes_sent_counter_;
+  RuntimeProfile::Counter* local_transfer_timer_;
   boost::scoped_ptr<MemTracker> mem_tracker_;
 
   /// Throughput per time spent in TransmitData
@@ -56,6 +56,8 @@ using namespace apache::thrift::protocol;
 DEFINE_int32(port, 20001, "port on which to run Impala test backend");
 DECLARE_string(principal);
 DECLARE_int32(datastream_sender_timeout_ms);
+DECLARE_bool(datastream_mux);
+DECLARE_int32(datastream_target_batch_bytes);
 
 // We reserve contiguous memory for senders in SetUp. If a test uses more
 // senders, a DCHECK will fail and you should increase this value.
@@ -78,6 +80,9 @@ class ImpalaTestBackend : public ImpalaInternalServiceIf {
   virtual void ExecPlanFragment(
       TExecPlanFragmentResult& return_val, const TExecPlanFragmentParams& params) {}
 
+  virtual void ExecPlanFragments(
+      TExecPlanFragmentsResult& return_val, const TExecPlanFragmentsParams& params) {}
+
   virtual void ReportExecStatus(
       TReportExecStatusResult& return_val, const TReportExecStatusParams& params) {}
 
@@ -101,6 +106,27 @@ class ImpalaTestBackend : public ImpalaInternalServiceIf {
     }
   }
 
+  virtual void TransmitDataBatch(
+      TTransmitDataBatchResult& return_val, const TTransmitDataBatchParams& params) {
+    return_val.statuses.resize(params.streams.size());
+    return_val.accepted.resize(params.streams.size(), true);
+    for (int i = 0; i < params.streams.size(); ++i) {
+      const TTransmitDataParams& stream = params.streams[i];
+      bool accepted = true;
+      Status status;
+      if (stream.row_batch.num_rows > 0) {
+        status = mgr_->TryAddData(stream.dest_fragment_instance_id,
+            stream.dest_node_id, stream.row_batch, stream.sender_id, &accepted);
+      }
+      if (status.ok() && accepted && stream.eos) {
+        status = mgr_->CloseSender(stream.dest_fragment_instance_id,
+            stream.dest_node_id, stream.sender_id);
+      }
+      return_val.accepted[i] = accepted;
+      status.SetTStatus(&return_val.statuses[i]);
+    }
+  }
+
  private:
   DataStreamMgr* mgr_;
 };
@@ -109,7 +135,8 @@ class DataStreamTest : public testing::Test {
  protected:
   DataStreamTest()
     : runtime_state_(TExecPlanFragmentParams(), "", &exec_env_),
-      next_val_(0) {
+      next_val_(0),
+      in_process_(false) {
     // Initialize Mem trackers for use by the data stream receiver.
     exec_env_.InitForFeTests();
     runtime_state_.InitMemTrackers(TUniqueId(), NULL, -1);
@@ -192,6 +219,10 @@ class DataStreamTest : public testing::Test {
   // RowBatch generation
   scoped_ptr<RowBatch> batch_;
   int next_val_;
+
+  // If true, receivers are created in the DataStreamMgr of exec_env_ and the
+  // destinations are its backend address, so senders bypass the rpcs.
+  bool in_process_;
   int64_t* tuple_mem_;
 
   // receiving node
@@ -243,8 +274,12 @@ class DataStreamTest : public testing::Test {
     dest_.push_back(TPlanFragmentDestination());
     TPlanFragmentDestination& dest = dest_.back();
     dest.fragment_instance_id = next_instance_id_;
-    dest.server.hostname = "127.0.0.1";
-    dest.server.port = FLAGS_port;
+    if (in_process_) {
+      dest.server = exec_env_.backend_address();
+    } else {
+      dest.server.hostname = "127.0.0.1";
+      dest.server.port = FLAGS_port;
+    }
     *instance_id = next_instance_id_;
     ++next_instance_id_.lo;
   }
@@ -331,8 +366,9 @@ class DataStreamTest : public testing::Test {
     GetNextInstanceId(&instance_id);
     receiver_info_.push_back(ReceiverInfo(stream_type, num_senders, receiver_num));
     ReceiverInfo& info = receiver_info_.back();
+    DataStreamMgr* stream_mgr = in_process_ ? exec_env_.stream_mgr() : stream_mgr_;
     info.stream_recvr =
-        stream_mgr_->CreateRecvr(&runtime_state_,
+        stream_mgr->CreateRecvr(&runtime_state_,
             *row_desc_, instance_id, DEST_NODE_ID, num_senders, buffer_size, profile,
             is_merging);
     if (!is_merging) {
@@ -496,7 +532,9 @@ class DataStreamTest : public testing::Test {
       if (!info.status.ok()) break;
     }
     VLOG_QUERY << "closing sender" << sender_num;
-    sender.FlushFinal(&state);
+    // Batches may be buffered until FlushFinal(), which then reports the errors.
+    Status flush_status = sender.FlushFinal(&state);
+    if (info.status.ok()) info.status = flush_status;
     sender.Close(&state);
     info.num_bytes_sent = sender.GetNumDataBytesSent();
 
@@ -582,6 +620,52 @@ TEST_F(DataStreamTest, BasicTest) {
   }
 }
 
+// Same as BasicTest with a target batch size below the size of the input batches,
+// which the senders then split. With the default target they coalesce them.
+TEST_F(DataStreamTest, SplitBatchesTest) {
+  int32_t target_batch_bytes = FLAGS_datastream_target_batch_bytes;
+  FLAGS_datastream_target_batch_bytes = BATCH_CAPACITY * PER_ROW_DATA / 4;
+  TPartitionType::type stream_types[] =
+      {TPartitionType::UNPARTITIONED, TPartitionType::RANDOM};
+  bool merging[] = {false, true};
+  for (int i = 0; i < sizeof(stream_types) / sizeof(*stream_types); ++i) {
+    for (int m = 0; m < sizeof(merging) / sizeof(bool); ++m) {
+      TestStream(stream_types[i], 1, 1, 1024, merging[m]);
+      TestStream(stream_types[i], 4, 4, 1024, merging[m]);
+    }
+  }
+  FLAGS_datastream_target_batch_bytes = target_batch_bytes;
+}
+
+// Same as BasicTest with the streams multiplexed over one connection.
+TEST_F(DataStreamTest, MuxTest) {
+  FLAGS_datastream_mux = true;
+  TPartitionType::type stream_types[] =
+      {TPartitionType::UNPARTITIONED, TPartitionType::HASH_PARTITIONED};
+  bool merging[] = {false, true};
+  for (int i = 0; i < sizeof(stream_types) / sizeof(*stream_types); ++i) {
+    for (int m = 0; m < sizeof(merging) / sizeof(bool); ++m) {
+      TestStream(stream_types[i], 4, 4, 1024, merging[m]);
+    }
+  }
+  FLAGS_datastream_mux = false;
+}
+
+// Same as BasicTest for receivers in the sending process, which get the batches
+// without rpcs.
+TEST_F(DataStreamTest, InProcessTest) {
+  in_process_ = true;
+  TPartitionType::type stream_types[] =
+      {TPartitionType::UNPARTITIONED, TPartitionType::RANDOM,
+          TPartitionType::HASH_PARTITIONED};
+  bool merging[] = {false, true};
+  for (int i = 0; i < sizeof(stream_types) / sizeof(*stream_types); ++i) {
+    for (int m = 0; m < sizeof(merging) / sizeof(bool); ++m) {
+      TestStream(stream_types[i], 4, 4, 1024, merging[m]);
+    }
+  }
+}
+
 // This test checks for the avoidance of IMPALA-2931, which is a crash that would occur if
 // the parent memtracker of a DataStreamRecvr's memtracker was deleted before the
 // DataStreamRecvr was destroyed. The fix was to move decoupling the child tracker from
@@ -704,6 +704,39 @@ TEST(DecimalArithmetic, Divide) {
   EXPECT_FALSE(is_nan);
 }
 
+// The 64-bit division and the 128-bit comparison must give the same results as the
+// generic code, including at the limits where they are not used.
+TEST(DecimalArithmetic, FastPaths) {
+  int128_t int64_max = std::numeric_limits<int64_t>::max();
+  int128_t values[] = { 0, 1, -1, 7, -7, 1000000007, int64_max, -int64_max,
+      -int64_max - 1, int64_max + 1, -int64_max - 2, DecimalUtil::MAX_UNSCALED_DECIMAL16,
+      -DecimalUtil::MAX_UNSCALED_DECIMAL16 };
+  int num_values = sizeof(values) / sizeof(values[0]);
+  for (int i = 0; i < num_values; ++i) {
+    for (int j = 0; j < num_values; ++j) {
+      if (values[j] == 0) continue;
+      EXPECT_TRUE(DecimalUtil::Divide<int128_t>(values[i], values[j]) ==
+          values[i] / values[j]) << i << " " << j;
+      EXPECT_TRUE(DecimalUtil::Modulo<int128_t>(values[i], values[j]) ==
+          values[i] % values[j]) << i << " " << j;
+    }
+  }
+
+  Decimal16Value max(DecimalUtil::MAX_UNSCALED_DECIMAL16);
+  Decimal16Value one(1);
+  Decimal16Value e20(DecimalUtil::GetScaleMultiplier<int128_t>(20));
+  Decimal16Value e37(DecimalUtil::GetScaleMultiplier<int128_t>(37));
+  // Scaled in 128 bits.
+  EXPECT_GT(one.Compare(0, max, 38), 0);
+  EXPECT_LT(max.Compare(38, one, 0), 0);
+  EXPECT_EQ(e20.Compare(0, e37, 17), 0);
+  EXPECT_EQ(max.Compare(10, max, 10), 0);
+  // Scaled in 256 bits.
+  EXPECT_GT(max.Compare(0, one, 38), 0);
+  EXPECT_LT((-max).Compare(0, one, 38), 0);
+  EXPECT_GT(e37.Compare(0, e20, 17), 0);
+}
+
 TEST(DecimalArithmetic, DivideLargeScales) {
   ColumnType t1 = ColumnType::CreateDecimalType(38, 8);
   ColumnType t2 = ColumnType::CreateDecimalType(20, 0);
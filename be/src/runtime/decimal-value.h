@@ -267,7 +267,8 @@ class DecimalValue {
       // We cap the resulting scale to the max supported scale (e.g. truncate) in the FE.
       // TODO: we could also return NULL.
       DCHECK_GT(delta_scale, 0);
-      result /= DecimalUtil::GetScaleMultiplier<T>(delta_scale);
+      result = DecimalUtil::Divide<RESULT_T>(result,
+          DecimalUtil::GetScaleMultiplier<T>(delta_scale));
     }
     return DecimalValue<RESULT_T>(result);
   }
@@ -298,7 +299,8 @@ class DecimalValue {
       // We cap the resulting scale to the max supported scale (e.g. truncate) in the FE.
       // TODO: we could also return NULL.
       DCHECK_GT(delta_scale, 0);
-      result /= DecimalUtil::GetScaleMultiplier<T>(delta_scale);
+      result = DecimalUtil::Divide<RESULT_T>(result,
+          DecimalUtil::GetScaleMultiplier<T>(delta_scale));
     }
     return DecimalValue<RESULT_T>(result);
   }
@@ -330,16 +332,29 @@ class DecimalValue {
     // Use higher precision ints for intermediates to avoid overflows. Divides lead to
     // large numbers very quickly (and get eliminated by the int divide).
     if (sizeof(T) == 16) {
+      // The scaled dividend usually still fits into 128 bits, which is much faster than
+      // the 256-bit division. The leading zeros guarantee that the product is below
+      // 2^127.
+      if (LIKELY(scale_by <= ColumnType::MAX_PRECISION)) {
+        int128_t scale_multiplier = DecimalUtil::GetScaleMultiplier<int128_t>(scale_by);
+        if (LIKELY(DecimalUtil::Clz(abs(value())) + DecimalUtil::Clz(scale_multiplier)
+            >= 129)) {
+          int128_t r = DecimalUtil::Divide<int128_t>(value() * scale_multiplier,
+              other.value());
+          *overflow |= abs(r) > DecimalUtil::MAX_UNSCALED_DECIMAL16;
+          return DecimalValue<RESULT_T>(r);
+        }
+      }
       int256_t x = DecimalUtil::MultiplyByScale<int256_t>(
           ConvertToInt256(value()), scale_by);
       int256_t y = ConvertToInt256(other.value());
       int128_t r = ConvertToInt128(x / y, DecimalUtil::MAX_UNSCALED_DECIMAL16, overflow);
       return DecimalValue<RESULT_T>(r);
     } else {
-      int128_t x = DecimalUtil::MultiplyByScale<RESULT_T>(value(), scale_by);
-      int128_t y = other.value();
-      int128_t r = x / y;
-      return DecimalValue<RESULT_T>(static_cast<RESULT_T>(r));
+      // The dividend is scaled in RESULT_T, so the division can be done in it, too.
+      RESULT_T x = DecimalUtil::MultiplyByScale<RESULT_T>(value(), scale_by);
+      RESULT_T y = other.value();
+      return DecimalValue<RESULT_T>(DecimalUtil::Divide<RESULT_T>(x, y));
     }
   }
 
@@ -366,7 +381,7 @@ class DecimalValue {
     RESULT_T y = 1; // Initialize y to avoid mod by 0.
     *overflow |= AdjustToSameScale(*this, this_scale, other, other_scale,
         result_precision, &x, &y);
-    return DecimalValue<RESULT_T>(x % y);
+    return DecimalValue<RESULT_T>(DecimalUtil::Modulo<RESULT_T>(x, y));
   }
 
   /// Compares this and other. Returns 0 if equal, < 0 if this < other and > 0 if
@@ -552,9 +567,22 @@ inline int Decimal8Value::Compare(int this_scale, const Decimal8Value& other,
 template <>
 inline int Decimal16Value::Compare(int this_scale, const Decimal16Value& other,
      int other_scale) const {
+  int delta_scale = this_scale - other_scale;
+  // Like in Divide(), scale in 128 bits if the leading zeros guarantee that the scaled
+  // value fits.
+  int128_t x128 = this->value();
+  int128_t y128 = other.value();
+  int128_t* scaled = delta_scale > 0 ? &y128 : &x128;
+  int128_t scale_multiplier = DecimalUtil::GetScaleMultiplier<int128_t>(abs(delta_scale));
+  if (LIKELY(delta_scale == 0 ||
+      DecimalUtil::Clz(abs(*scaled)) + DecimalUtil::Clz(scale_multiplier) >= 129)) {
+    *scaled *= scale_multiplier;
+    if (x128 == y128) return 0;
+    if (x128 < y128) return -1;
+    return 1;
+  }
   int256_t x = ConvertToInt256(this->value());
   int256_t y = ConvertToInt256(other.value());
-  int delta_scale = this_scale - other_scale;
   if (delta_scale > 0) {
     y = DecimalUtil::MultiplyByScale<int256_t>(y, delta_scale);
   } else if (delta_scale < 0) {
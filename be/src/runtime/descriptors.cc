@@ -28,6 +28,7 @@
 #include "gen-cpp/PlanNodes_types.h"
 #include "exprs/expr.h"
 #include "runtime/runtime-state.h"
+#include "util/bit-util.h"
 
 #include "common/names.h"
 
@@ -288,6 +289,65 @@ void TupleDescriptor::AddSlot(SlotDescriptor* slot) {
   }
 }
 
+/// Returns the log2 of the alignment of a slot of 'slot_size' bytes in the compact
+/// layout.
+static int CompactSlotAlignmentBits(int slot_size) {
+  int bits = 0;
+  while (bits < 3 && slot_size % (2 << bits) == 0) ++bits;
+  return bits;
+}
+
+void TupleDescriptor::ComputeCompactLayout() {
+  if (slots_.empty()) return;
+  // Assign the null indicator bits in slot order and group the slots by alignment.
+  vector<SlotDescriptor*> slots_by_alignment[4];
+  int num_nullable_slots = 0;
+  for (int i = 0; i < slots_.size(); ++i) {
+    SlotDescriptor* slot = slots_[i];
+    if (slot->is_nullable()) {
+      slot->null_indicator_offset_ =
+          NullIndicatorOffset(num_nullable_slots / 8, num_nullable_slots % 8);
+      ++num_nullable_slots;
+    }
+    slots_by_alignment[CompactSlotAlignmentBits(slot->slot_size())].push_back(slot);
+  }
+  num_null_bytes_ = BitUtil::Ceil(num_nullable_slots, 8);
+
+  int offset = num_null_bytes_;
+  int slot_idx = 0;
+  int max_alignment = 1;
+  // Index of the next slot to place of each alignment.
+  int next_slot[4] = {0, 0, 0, 0};
+  // First fill the gap between the null indicators and the first 8-byte boundary with
+  // slots of increasing alignment, then place the rest in order of decreasing alignment.
+  // Only the first of the rest may need padding.
+  for (int bits = 0; bits < 3; ++bits) {
+    const vector<SlotDescriptor*>& slots = slots_by_alignment[bits];
+    while (next_slot[bits] < slots.size() && offset % 8 != 0) {
+      offset = BitUtil::RoundUp(offset, 1 << bits);
+      if (offset % 8 == 0) break;
+      SlotDescriptor* slot = slots[next_slot[bits]++];
+      slot->tuple_offset_ = offset;
+      slot->slot_idx_ = slot_idx++;
+      offset += slot->slot_size();
+    }
+  }
+  for (int bits = 3; bits >= 0; --bits) {
+    const vector<SlotDescriptor*>& slots = slots_by_alignment[bits];
+    if (!slots.empty()) max_alignment = max(max_alignment, 1 << bits);
+    for (; next_slot[bits] < slots.size(); ++next_slot[bits]) {
+      SlotDescriptor* slot = slots[next_slot[bits]];
+      offset = BitUtil::RoundUp(offset, 1 << bits);
+      slot->tuple_offset_ = offset;
+      slot->slot_idx_ = slot_idx++;
+      offset += slot->slot_size();
+    }
+  }
+  // Pad the tuple to the alignment of its slots so that tuples can be laid out back to
+  // back, as in the FE layout.
+  byte_size_ = BitUtil::RoundUp(offset, max_alignment);
+}
+
 bool TupleDescriptor::ContainsStringData() const {
   if (!string_slots_.empty()) return true;
   for (int i = 0; i < collection_slots_.size(); ++i) {
@@ -449,7 +509,7 @@ string RowDescriptor::DebugString() const {
 }
 
 Status DescriptorTbl::Create(ObjectPool* pool, const TDescriptorTable& thrift_tbl,
-                             DescriptorTbl** tbl) {
+                             DescriptorTbl** tbl, bool compact_tuple_layout) {
   *tbl = pool->Add(new DescriptorTbl());
   // deserialize table descriptors first, they are being referenced by tuple descriptors
   for (size_t i = 0; i < thrift_tbl.tableDescriptors.size(); ++i) {
@@ -493,6 +553,13 @@ Status DescriptorTbl::Create(ObjectPool* pool, const TDescriptorTable& thrift_tb
     (*tbl)->slot_desc_map_[tdesc.id] = slot_d;
     parent->AddSlot(slot_d);
   }
+
+  if (compact_tuple_layout) {
+    for (TupleDescriptorMap::iterator it = (*tbl)->tuple_desc_map_.begin();
+         it != (*tbl)->tuple_desc_map_.end(); ++it) {
+      it->second->ComputeCompactLayout();
+    }
+  }
   return Status::OK();
 }
 
@@ -150,12 +150,14 @@ class SlotDescriptor {
   const TupleDescriptor* collection_item_descriptor_;
   // TODO for 2.3: rename to materialized_path_
   const SchemaPath col_path_;
-  const int tuple_offset_;
-  const NullIndicatorOffset null_indicator_offset_;
+  /// The layout is computed by the FE, unless TupleDescriptor::ComputeCompactLayout()
+  /// replaces it.
+  int tuple_offset_;
+  NullIndicatorOffset null_indicator_offset_;
 
   /// the idx of the slot in the tuple descriptor (0-based).
   /// this is provided by the FE
-  const int slot_idx_;
+  int slot_idx_;
 
   /// the byte size of this slot.
   const int slot_size_;
@@ -379,8 +381,8 @@ class TupleDescriptor {
 
   const TupleId id_;
   TableDescriptor* table_desc_;
-  const int byte_size_;
-  const int num_null_bytes_;
+  int byte_size_;
+  int num_null_bytes_;
 
   /// Contains all slots.
   std::vector<SlotDescriptor*> slots_;
@@ -405,14 +407,27 @@ class TupleDescriptor {
 
   TupleDescriptor(const TTupleDescriptor& tdesc);
   void AddSlot(SlotDescriptor* slot);
+
+  /// Replaces the memory layout computed by the FE with one that has as little padding
+  /// as possible. The null indicator bytes stay at the start of the tuple, followed by
+  /// the slots with an alignment of less than 8 bytes that fit before the first 8-byte
+  /// boundary, followed by the remaining slots in order of decreasing alignment. A slot
+  /// is aligned to the largest power of two, up to 8, that divides its size, so unlike
+  /// in the FE layout CHAR slots are byte-aligned. The result only depends on the
+  /// types, nullability and order of the slots, so tuples that have compatible layouts
+  /// in the FE layout also have them in this layout.
+  void ComputeCompactLayout();
 };
 
 class DescriptorTbl {
  public:
   /// Creates a descriptor tbl within 'pool' from thrift_tbl and returns it via 'tbl'.
   /// Returns OK on success, otherwise error (in which case 'tbl' will be unset).
+  /// If 'compact_tuple_layout' is true, the tuples are laid out by
+  /// TupleDescriptor::ComputeCompactLayout(). All fragments of a query must agree on
+  /// it, since tuples are exchanged between them.
   static Status Create(ObjectPool* pool, const TDescriptorTable& thrift_tbl,
-                       DescriptorTbl** tbl);
+                       DescriptorTbl** tbl, bool compact_tuple_layout = false);
 
   TableDescriptor* GetTableDescriptor(TableId id) const;
   TupleDescriptor* GetTupleDescriptor(TupleId id) const;
@@ -0,0 +1,173 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "runtime/disk-io-mgr.h"
+
+#include <cstring>
+#include <boost/foreach.hpp>
+
+#include "util/hash-util.h"
+#include "util/impalad-metrics.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+typedef boost::unordered_multimap<string, DiskIoMgr::HdfsCachedFileHandle*>
+    HandleMap;
+
+DiskIoMgr::FileHandleCache::FileHandleCache(size_t capacity)
+  : shard_capacity_((capacity + NUM_SHARDS - 1) / NUM_SHARDS) {
+}
+
+DiskIoMgr::FileHandleCache::~FileHandleCache() {
+  for (int i = 0; i < NUM_SHARDS; ++i) {
+    BOOST_FOREACH(const HandleMap::value_type& entry, shards_[i].handles) {
+      DCHECK_EQ(entry.second->ref_count_, 0) << "File handle was not released.";
+      delete entry.second;
+    }
+  }
+}
+
+DiskIoMgr::FileHandleCache::Shard* DiskIoMgr::FileHandleCache::GetShard(
+    const char* fname) {
+  return &shards_[HashUtil::Hash(fname, strlen(fname), 0) % NUM_SHARDS];
+}
+
+DiskIoMgr::HdfsCachedFileHandle* DiskIoMgr::FileHandleCache::RemoveLocked(Shard* shard,
+    HdfsCachedFileHandle* handle) {
+  if (handle->lru_pos_ != shard->lru.end()) {
+    shard->lru.erase(handle->lru_pos_);
+    handle->lru_pos_ = shard->lru.end();
+    ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES->Increment(-1L);
+  }
+  pair<HandleMap::iterator, HandleMap::iterator> range =
+      shard->handles.equal_range(handle->fname_);
+  for (HandleMap::iterator it = range.first; it != range.second; ++it) {
+    if (it->second == handle) {
+      shard->handles.erase(it);
+      break;
+    }
+  }
+  return handle;
+}
+
+DiskIoMgr::HdfsCachedFileHandle* DiskIoMgr::FileHandleCache::GetHandle(
+    const hdfsFS& fs, const char* fname, int64_t mtime, bool exclusive) {
+  Shard* shard = GetShard(fname);
+  // Idle handles of an older version of the file, closed once the lock is released.
+  vector<HdfsCachedFileHandle*> stale_handles;
+  HdfsCachedFileHandle* handle = NULL;
+  {
+    lock_guard<mutex> l(shard->lock);
+    HdfsCachedFileHandle* idle_handle = NULL;
+    pair<HandleMap::iterator, HandleMap::iterator> range =
+        shard->handles.equal_range(fname);
+    HandleMap::iterator it = range.first;
+    while (it != range.second) {
+      HdfsCachedFileHandle* candidate = it->second;
+      // Erasing the candidate below must not invalidate 'it'.
+      ++it;
+      if (candidate->mtime_ != mtime) {
+        // The ones in use are still read by ranges created before the file changed.
+        if (candidate->ref_count_ == 0) {
+          stale_handles.push_back(RemoveLocked(shard, candidate));
+        }
+      } else if (candidate->ref_count_ == 0) {
+        if (idle_handle == NULL) idle_handle = candidate;
+      } else if (!exclusive && !candidate->exclusive_) {
+        // Sharing a handle that is already in use keeps the idle ones for others.
+        handle = candidate;
+        break;
+      }
+    }
+    if (handle == NULL) handle = idle_handle;
+    if (handle != NULL) {
+      if (handle->ref_count_ == 0) {
+        shard->lru.erase(handle->lru_pos_);
+        handle->lru_pos_ = shard->lru.end();
+        ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES->Increment(-1L);
+      }
+      ++handle->ref_count_;
+      handle->exclusive_ = exclusive;
+    }
+  }
+  BOOST_FOREACH(HdfsCachedFileHandle* stale_handle, stale_handles) {
+    VLOG_FILE << "mtime mismatch, closing cached file handle. Closing file=" << fname;
+    delete stale_handle;
+  }
+
+  if (handle != NULL) {
+    ImpaladMetrics::IO_MGR_CACHED_FILE_HANDLES_HIT_RATIO->Update(1L);
+    ImpaladMetrics::IO_MGR_CACHED_FILE_HANDLES_HIT_COUNT->Increment(1L);
+    return handle;
+  }
+
+  ImpaladMetrics::IO_MGR_CACHED_FILE_HANDLES_HIT_RATIO->Update(0L);
+  ImpaladMetrics::IO_MGR_CACHED_FILE_HANDLES_MISS_COUNT->Increment(1L);
+  // Opening the file is a NameNode RPC, so it is done without holding the lock.
+  handle = new HdfsCachedFileHandle(fs, fname, mtime);
+  if (!handle->ok()) {
+    delete handle;
+    return NULL;
+  }
+  handle->ref_count_ = 1;
+  handle->exclusive_ = exclusive;
+  lock_guard<mutex> l(shard->lock);
+  handle->lru_pos_ = shard->lru.end();
+  shard->handles.insert(make_pair(handle->fname_, handle));
+  return handle;
+}
+
+void DiskIoMgr::FileHandleCache::ReleaseHandle(HdfsCachedFileHandle* handle, bool close,
+    struct hdfsReadStatistics** stats) {
+  if (stats != NULL) *stats = NULL;
+  Shard* shard = GetShard(handle->fname_.c_str());
+  vector<HdfsCachedFileHandle*> closed_handles;
+  {
+    lock_guard<mutex> l(shard->lock);
+    DCHECK_GT(handle->ref_count_, 0);
+    if (--handle->ref_count_ > 0) return;
+
+    if (stats != NULL && hdfsFileGetReadStatistics(handle->file(), stats) != 0) {
+      *stats = NULL;
+    }
+    // Try to unbuffer the handle, on filesystems that do not support this call a
+    // non-zero return code indicates that the operation was not successful and thus the
+    // file is closed.
+    if (close || shard_capacity_ == 0 || hdfsUnbufferFile(handle->file()) != 0) {
+      if (close) {
+        VLOG_FILE << "Closing file=" << handle->fname_;
+      } else {
+        VLOG_FILE << "File handle caching disabled or not supported, closing file="
+                  << handle->fname_;
+      }
+      closed_handles.push_back(RemoveLocked(shard, handle));
+    } else {
+      // Clear read statistics before the handle is reused.
+      hdfsFileClearReadStatistics(handle->file());
+      handle->lru_pos_ = shard->lru.insert(shard->lru.end(), handle);
+      ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES->Increment(1L);
+      while (shard->lru.size() > shard_capacity_) {
+        HdfsCachedFileHandle* evicted = RemoveLocked(shard, shard->lru.front());
+        VLOG_FILE << "Cached file handle evicted, file=" << evicted->fname_;
+        closed_handles.push_back(evicted);
+        ImpaladMetrics::IO_MGR_CACHED_FILE_HANDLES_EVICTED->Increment(1L);
+      }
+    }
+  }
+  BOOST_FOREACH(HdfsCachedFileHandle* closed_handle, closed_handles) {
+    delete closed_handle;
+  }
+}
@@ -30,6 +30,8 @@
 #include "util/hdfs-util.h"
 #include "util/filesystem-util.h"
 #include "util/impalad-metrics.h"
+#include "util/lock-profiler.h"
+#include "util/time.h"
 
 /// This file contains internal structures to the IoMgr. Users of the IoMgr do
 /// not need to include this file.
@@ -43,6 +45,9 @@ struct DiskIoMgr::DiskQueue {
   /// Lock that protects access to 'request_contexts' and 'work_available'
   boost::mutex lock;
 
+  /// The acquisitions of 'lock' of all disk queues.
+  static LockSite lock_site;
+
   /// Condition variable to signal the disk threads that there is work to do or the
   /// thread should shut down.  A disk thread will be woken up when there is a reader
   /// added to the queue. A reader is only on the queue when it has at least one
@@ -52,19 +57,43 @@ struct DiskIoMgr::DiskQueue {
   /// list of all request contexts that have work queued on this disk
   std::list<RequestContext*> request_contexts;
 
+  /// The virtual time of the context that was picked last. Protected by 'lock'.
+  /// See "Fair sharing" in disk-io-mgr.h.
+  int64_t virtual_time;
+
   /// Enqueue the request context to the disk queue.  The DiskQueue lock must not be taken.
-  inline void EnqueueContext(RequestContext* worker) {
-    {
-      boost::unique_lock<boost::mutex> disk_lock(lock);
-      /// Check that the reader is not already on the queue
-      DCHECK(find(request_contexts.begin(), request_contexts.end(), worker) ==
-          request_contexts.end());
-      request_contexts.push_back(worker);
-    }
-    work_available.notify_all();
+  inline void EnqueueContext(RequestContext* worker);
+
+  /// Number of threads started for this queue.
+  int num_threads;
+
+  /// Only threads with an index below this process ranges, the others wait on
+  /// 'work_available'. Between 1 and 'num_threads'. Protected by 'lock'.
+  int num_active_threads;
+
+  /// Bytes read or written and the total time the threads spent processing ranges since
+  /// the tuner last looked at this queue.
+  AtomicInt<int64_t> bytes_processed;
+  AtomicInt<int64_t> busy_time_ns;
+
+  /// Tuner state, only accessed by the tuner thread.
+  /// The change in active threads to make when throughput doesn't change.
+  int default_step;
+
+  /// The change made by the last tuning step and the throughput, in bytes per second,
+  /// the queue had before it. 'last_throughput' is 0 if the queue was not saturated.
+  int last_step;
+  double last_throughput;
+
+  DiskQueue(int id)
+    : disk_id(id),
+      virtual_time(0),
+      num_threads(0),
+      num_active_threads(0),
+      default_step(0),
+      last_step(0),
+      last_throughput(0) {
   }
-
-  DiskQueue(int id) : disk_id(id) { }
 };
 
 /// Internal per request-context state. This object maintains a lot of state that is
@@ -166,6 +195,7 @@ class DiskIoMgr::RequestContext {
     DCHECK_EQ(state_, Active);
     DCHECK(range != NULL);
     RequestContext::PerDiskState& state = disk_states_[range->disk_id()];
+    range->schedule_time_ns_ = MonotonicNanos();
     state.in_flight_ranges()->Enqueue(range);
     state.ScheduleContext(this, range->disk_id());
   }
@@ -197,6 +227,10 @@ class DiskIoMgr::RequestContext {
   /// Memory used for this reader.  This is unowned by this object.
   MemTracker* mem_tracker_;
 
+  /// Share of the disk queues this context gets relative to the other contexts, see
+  /// "Fair sharing" in disk-io-mgr.h. At least 1.
+  int io_weight_;
+
   /// Total bytes read for this reader
   RuntimeProfile::Counter* bytes_read_counter_;
 
@@ -223,6 +257,13 @@ class DiskIoMgr::RequestContext {
   /// Total number of bytes from remote reads that were expected to be local.
   AtomicInt<int64_t> unexpected_remote_bytes_;
 
+  /// Number of bytes of remote reads that were served from and not found in the
+  /// DiskIoMgr's local data cache, and number of cache entries evicted to make room for
+  /// this reader's data.
+  AtomicInt<int64_t> data_cache_hit_bytes_;
+  AtomicInt<int64_t> data_cache_miss_bytes_;
+  AtomicInt<int64_t> data_cache_num_evictions_;
+
   /// The number of buffers that have been returned to the reader (via GetNext) that the
   /// reader has not returned. Only included for debugging and diagnostics.
   AtomicInt<int> num_buffers_in_reader_;
@@ -266,6 +307,9 @@ class DiskIoMgr::RequestContext {
   /// taken before accessing them.
   boost::mutex lock_;
 
+  /// The acquisitions of lock_ of all request contexts.
+  static LockSite lock_site_;
+
   /// Current state of the reader
   State state_;
 
@@ -276,9 +320,9 @@ class DiskIoMgr::RequestContext {
   /// disks with ranges).
   int num_disks_with_ranges_;
 
-  /// This is the list of ranges that are expected to be cached on the DN.
-  /// When the reader asks for a new range (GetNextScanRange()), we first
-  /// return ranges from this list.
+  /// This is the list of ranges that are expected to be cached on the DN, or that are
+  /// read by mapping a local file. When the reader asks for a new range
+  /// (GetNextScanRange()), we first return ranges from this list.
   InternalQueue<ScanRange> cached_ranges_;
 
   /// A list of ranges that should be returned in subsequent calls to
@@ -343,6 +387,9 @@ class DiskIoMgr::RequestContext {
     }
     InternalQueue<RequestRange>* in_flight_ranges() { return &in_flight_ranges_; }
 
+    int64_t queue_vtime() const { return queue_vtime_; }
+    void set_queue_vtime(int64_t vtime) { queue_vtime_ = vtime; }
+
     PerDiskState() {
       Reset();
     }
@@ -391,6 +438,7 @@ class DiskIoMgr::RequestContext {
       is_on_queue_ = false;
       num_threads_in_op_ = 0;
       next_scan_range_to_start_ = NULL;
+      queue_vtime_ = 0;
     }
 
    private:
@@ -457,6 +505,12 @@ class DiskIoMgr::RequestContext {
     /// in GetNextRequestRange() whenever it is null, repeated calls to
     /// GetNextRequestRange() and GetNextRange() may result in only reads being processed)
     InternalQueue<WriteRange> unstarted_write_ranges_;
+
+    /// Virtual time at which this context is next due on this disk's queue. The disk
+    /// threads pick the queued context with the lowest virtual time and advance it by
+    /// an amount inversely proportional to the context's io_weight_. Unlike the other
+    /// members, this is protected by the disk queue's lock.
+    int64_t queue_vtime_;
   };
 
   /// Per disk states to synchronize multiple disk threads accessing the same request
@@ -464,6 +518,21 @@ class DiskIoMgr::RequestContext {
   std::vector<PerDiskState> disk_states_;
 };
 
+inline void DiskIoMgr::DiskQueue::EnqueueContext(RequestContext* worker) {
+  {
+    ProfiledLock<boost::mutex> disk_lock(lock, &lock_site);
+    /// Check that the reader is not already on the queue
+    DCHECK(find(request_contexts.begin(), request_contexts.end(), worker) ==
+        request_contexts.end());
+    /// A context that was not on the queue doesn't get to catch up on the turns it
+    /// didn't need.
+    RequestContext::PerDiskState& state = worker->disk_states_[disk_id];
+    state.set_queue_vtime(std::max(state.queue_vtime(), virtual_time));
+    request_contexts.push_back(worker);
+  }
+  work_available.notify_all();
+}
+
 }
 
 #endif
@@ -24,7 +24,7 @@ void DiskIoMgr::RequestContext::Cancel(const Status& status) {
   // Callbacks are collected in this vector and invoked while no lock is held.
   vector<WriteRange::WriteDoneCallback> write_callbacks;
   {
-    lock_guard<mutex> lock(lock_);
+    ProfiledLock<mutex> lock(lock_, &lock_site_);
     DCHECK(Validate()) << endl << DebugString();
 
     // Already being cancelled
@@ -128,6 +128,7 @@ void DiskIoMgr::RequestContext::AddRequestRange(
 
 DiskIoMgr::RequestContext::RequestContext(DiskIoMgr* parent, int num_disks)
   : parent_(parent),
+    io_weight_(1),
     bytes_read_counter_(NULL),
     read_timer_(NULL),
     active_read_thread_counter_(NULL),
@@ -148,6 +149,7 @@ void DiskIoMgr::RequestContext::Reset(MemTracker* tracker) {
 
   state_ = Active;
   mem_tracker_ = tracker;
+  io_weight_ = 1;
 
   num_unstarted_scan_ranges_ = 0;
   num_disks_with_ranges_ = 0;
@@ -161,6 +163,9 @@ void DiskIoMgr::RequestContext::Reset(MemTracker* tracker) {
   bytes_read_short_circuit_ = 0;
   bytes_read_dn_cache_ = 0;
   unexpected_remote_bytes_ = 0;
+  data_cache_hit_bytes_ = 0;
+  data_cache_miss_bytes_ = 0;
+  data_cache_num_evictions_ = 0;
   initial_queue_capacity_ = DiskIoMgr::DEFAULT_QUEUE_CAPACITY;
 
   DCHECK(ready_to_start_ranges_.empty());
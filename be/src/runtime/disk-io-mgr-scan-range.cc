@@ -12,6 +12,13 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "runtime/data-cache.h"
 #include "runtime/disk-io-mgr.h"
 #include "runtime/disk-io-mgr-internal.h"
 #include "util/error-util.h"
@@ -21,6 +28,20 @@
 
 using namespace impala;
 
+// Asking the kernel to read ahead lets a single disk thread keep the device busy while
+// it hands the previous buffer to the reader, instead of relying on more threads per
+// disk to get requests queued up.
+DEFINE_bool(local_disk_read_ahead, true, "(Advanced) If true, after each read from a "
+    "local file the io mgr asks the kernel to asynchronously read the next buffer of the "
+    "scan range into the page cache.");
+
+// Mapping local files saves copying every byte from the page cache into an IO buffer,
+// but a file that is truncated while it's mapped makes the readers crash with SIGBUS,
+// so this is off by default.
+DEFINE_bool(mmap_local_reads, false, "(Advanced) If true, scan ranges of files on the "
+    "local filesystem are read by mapping the file into memory, and the scanners are "
+    "handed the mapped pages instead of a copy of them in an IO buffer.");
+
 // A very large max value to prevent things from going out of control. Not
 // expected to ever hit this value (1GB of buffered data per range).
 const int MAX_QUEUE_CAPACITY = 128;
@@ -112,7 +133,7 @@ Status DiskIoMgr::ScanRange::GetNext(BufferDescriptor** buffer) {
     return status;
   }
 
-  unique_lock<mutex> reader_lock(reader_->lock_);
+  ProfiledLock<mutex> reader_lock(reader_->lock_, &RequestContext::lock_site_);
   if (eosr_returned_) {
     reader_->total_range_queue_capacity_ += ready_buffers_capacity_;
     ++reader_->num_finished_ranges_;
@@ -145,6 +166,7 @@ void DiskIoMgr::ScanRange::Cancel(const Status& status) {
   if (io_mgr_ == NULL) return;
 
   DCHECK(!status.ok());
+  vector<ScanRange*> coalesced_ranges;
   {
     // Grab both locks to make sure that all working threads see is_cancelled_.
     unique_lock<mutex> scan_range_lock(lock_);
@@ -153,13 +175,17 @@ void DiskIoMgr::ScanRange::Cancel(const Status& status) {
     if (is_cancelled_) return;
     is_cancelled_ = true;
     status_ = status;
+    // No disk thread will read the coalesced ranges now.
+    coalesced_ranges.swap(coalesced_ranges_);
   }
   buffer_ready_cv_.notify_all();
   CleanupQueuedBuffers();
 
   // For cached buffers, we can't close the range until the cached buffer is returned.
   // Close() is called from DiskIoMgr::ReturnBuffer().
-  if (cached_buffer_ == NULL) Close();
+  if (!has_zero_copy_buffer()) Close();
+
+  for (int i = 0; i < coalesced_ranges.size(); ++i) coalesced_ranges[i]->Cancel(status);
 }
 
 void DiskIoMgr::ScanRange::CleanupQueuedBuffers() {
@@ -209,7 +235,9 @@ DiskIoMgr::ScanRange::ScanRange(int capacity)
 
 DiskIoMgr::ScanRange::~ScanRange() {
   DCHECK(hdfs_file_ == NULL) << "File was not closed.";
+  DCHECK_EQ(local_fd_, -1) << "File was not closed.";
   DCHECK(cached_buffer_ == NULL) << "Cached buffer was not released.";
+  DCHECK(mapped_buffer_ == NULL) << "Mapped buffer was not released.";
 }
 
 void DiskIoMgr::ScanRange::Reset(hdfsFS fs, const char* file, int64_t len, int64_t offset,
@@ -221,26 +249,36 @@ void DiskIoMgr::ScanRange::Reset(hdfsFS fs, const char* file, int64_t len, int64
   offset_ = offset;
   disk_id_ = disk_id;
   try_cache_ = try_cache;
+  try_mmap_ = FLAGS_mmap_local_reads && !try_cache && (fs == NULL || IsLocalPath(file));
   expected_local_ = expected_local;
   meta_data_ = meta_data;
   cached_buffer_ = NULL;
+  mapped_buffer_ = NULL;
+  mapped_len_ = 0;
   io_mgr_ = NULL;
   reader_ = NULL;
   hdfs_file_ = NULL;
+  local_fd_ = -1;
+  needs_seek_ = false;
+  use_pread_ = false;
   mtime_ = mtime;
+  coalesced_ranges_.clear();
 }
 
 void DiskIoMgr::ScanRange::InitInternal(DiskIoMgr* io_mgr, RequestContext* reader) {
   DCHECK(hdfs_file_ == NULL);
   io_mgr_ = io_mgr;
   reader_ = reader;
-  local_file_ = NULL;
+  DCHECK_EQ(local_fd_, -1);
   hdfs_file_ = NULL;
+  needs_seek_ = false;
   bytes_read_ = 0;
   is_cancelled_ = false;
   eosr_queued_= false;
   eosr_returned_= false;
   blocked_on_queue_ = false;
+  coalesced_ranges_.clear();
+  schedule_time_ns_ = 0;
   if (ready_buffers_capacity_ <= 0) {
     ready_buffers_capacity_ = reader->initial_scan_range_queue_capacity();
     DCHECK_GE(ready_buffers_capacity_, MIN_QUEUE_CAPACITY);
@@ -254,13 +292,16 @@ Status DiskIoMgr::ScanRange::Open() {
 
   if (fs_ != NULL) {
     if (hdfs_file_ != NULL) return Status::OK();
-    hdfs_file_ = io_mgr_->OpenHdfsFile(fs_, file(), mtime());
+    // Zero-copy reads from the HDFS cache start at the file position, so they need a
+    // handle of their own.
+    use_pread_ = IsDfsPath(file());
+    hdfs_file_ = io_mgr_->OpenHdfsFile(fs_, file(), mtime(), !use_pread_ || try_cache_);
     if (hdfs_file_ == NULL) {
       return Status(GetHdfsErrorMsg("Failed to open HDFS file ", file_));
     }
 
-    if (hdfsSeek(fs_, hdfs_file_->file(), offset_) != 0) {
-      io_mgr_->CacheOrCloseFileHandle(file(), hdfs_file_, false);
+    if ((!use_pread_ || try_cache_) && hdfsSeek(fs_, hdfs_file_->file(), offset_) != 0) {
+      io_mgr_->CacheOrCloseFileHandle(hdfs_file_, false, NULL);
       hdfs_file_ = NULL;
       string error_msg = GetHdfsErrorMsg("");
       stringstream ss;
@@ -268,24 +309,15 @@ Status DiskIoMgr::ScanRange::Open() {
       return Status(ss.str());
     }
   } else {
-    if (local_file_ != NULL) return Status::OK();
+    if (local_fd_ != -1) return Status::OK();
 
-    local_file_ = fopen(file(), "r");
-    if (local_file_ == NULL) {
+    local_fd_ = open(file(), O_RDONLY);
+    if (local_fd_ == -1) {
       string error_msg = GetStrErrMsg();
       stringstream ss;
       ss << "Could not open file: " << file_ << ": " << error_msg;
       return Status(ss.str());
     }
-    if (fseek(local_file_, offset_, SEEK_SET) == -1) {
-      fclose(local_file_);
-      local_file_ = NULL;
-      string error_msg = GetStrErrMsg();
-      stringstream ss;
-      ss << "Could not seek to " << offset_ << " for file: " << file_
-         << ": " << error_msg;
-      return Status(ss.str());
-    }
   }
   if (ImpaladMetrics::IO_MGR_NUM_OPEN_FILES != NULL) {
     ImpaladMetrics::IO_MGR_NUM_OPEN_FILES->Increment(1L);
@@ -295,46 +327,58 @@ Status DiskIoMgr::ScanRange::Open() {
 
 void DiskIoMgr::ScanRange::Close() {
   unique_lock<mutex> hdfs_lock(hdfs_lock_);
+  // The file itself is not kept open while it's mapped.
+  if (mapped_buffer_ != NULL) {
+    munmap(mapped_buffer_, mapped_len_);
+    mapped_buffer_ = NULL;
+    mapped_len_ = 0;
+  }
   if (fs_ != NULL) {
     if (hdfs_file_ == NULL) return;
 
-    struct hdfsReadStatistics* stats;
-    if (IsDfsPath(file())) {
-      int success = hdfsFileGetReadStatistics(hdfs_file_->file(), &stats);
-      if (success == 0) {
-        reader_->bytes_read_local_ += stats->totalLocalBytesRead;
-        reader_->bytes_read_short_circuit_ += stats->totalShortCircuitBytesRead;
-        reader_->bytes_read_dn_cache_ += stats->totalZeroCopyBytesRead;
-        if (stats->totalLocalBytesRead != stats->totalBytesRead) {
-          ++reader_->num_remote_ranges_;
-          if (expected_local_) {
-            int remote_bytes = stats->totalBytesRead - stats->totalLocalBytesRead;
-            reader_->unexpected_remote_bytes_ += remote_bytes;
-            VLOG_FILE << "Unexpected remote HDFS read of "
-                      << PrettyPrinter::Print(remote_bytes, TUnit::BYTES)
-                      << " for file '" << file_ << "'";
-          }
-        }
-        hdfsFileFreeReadStatistics(stats);
-      }
-    }
     if (cached_buffer_ != NULL) {
       hadoopRzBufferFree(hdfs_file_->file(), cached_buffer_);
       cached_buffer_ = NULL;
     }
-    io_mgr_->CacheOrCloseFileHandle(file(), hdfs_file_, false);
+    // A shared handle only returns its statistics to the last range that releases it,
+    // so they include the bytes read by the other ranges that used it meanwhile.
+    struct hdfsReadStatistics* stats = NULL;
+    io_mgr_->CacheOrCloseFileHandle(hdfs_file_, false, use_pread_ ? &stats : NULL);
     VLOG_FILE << "Cache HDFS file handle file=" << file();
     hdfs_file_ = NULL;
+    if (stats != NULL) {
+      reader_->bytes_read_local_ += stats->totalLocalBytesRead;
+      reader_->bytes_read_short_circuit_ += stats->totalShortCircuitBytesRead;
+      reader_->bytes_read_dn_cache_ += stats->totalZeroCopyBytesRead;
+      if (stats->totalLocalBytesRead != stats->totalBytesRead) {
+        ++reader_->num_remote_ranges_;
+        if (expected_local_) {
+          int remote_bytes = stats->totalBytesRead - stats->totalLocalBytesRead;
+          reader_->unexpected_remote_bytes_ += remote_bytes;
+          VLOG_FILE << "Unexpected remote HDFS read of "
+                    << PrettyPrinter::Print(remote_bytes, TUnit::BYTES)
+                    << " for file '" << file_ << "'";
+        }
+      }
+      hdfsFileFreeReadStatistics(stats);
+    }
   } else {
-    if (local_file_ == NULL) return;
-    fclose(local_file_);
-    local_file_ = NULL;
+    if (local_fd_ == -1) return;
+    close(local_fd_);
+    local_fd_ = -1;
   }
   if (ImpaladMetrics::IO_MGR_NUM_OPEN_FILES != NULL) {
     ImpaladMetrics::IO_MGR_NUM_OPEN_FILES->Increment(-1L);
   }
 }
 
+bool DiskIoMgr::ScanRange::UseDataCache() const {
+  if (io_mgr_->data_cache_.get() == NULL || fs_ == NULL) return false;
+  // The mtime is part of the key, data of files without one may be stale.
+  if (mtime_ == NEVER_CACHE) return false;
+  return disk_id_ == io_mgr_->RemoteDfsDiskId() || disk_id_ == io_mgr_->RemoteS3DiskId();
+}
+
 int64_t DiskIoMgr::ScanRange::MaxReadChunkSize() const {
   // S3 InputStreams don't support DIRECT_READ (i.e. java.nio.ByteBuffer read()
   // interface).  So, hdfsRead() needs to allocate a Java byte[] and copy the data out.
@@ -365,47 +409,108 @@ Status DiskIoMgr::ScanRange::Read(char* buffer, int64_t* bytes_read, bool* eosr)
       min(static_cast<int64_t>(io_mgr_->max_buffer_size_), len_ - bytes_read_);
   DCHECK_GE(bytes_to_read, 0);
 
+  DataCache* data_cache = UseDataCache() ? io_mgr_->data_cache_.get() : NULL;
+  int64_t file_offset = offset_ + bytes_read_;
+  if (data_cache != NULL && data_cache->Lookup(file_, mtime_, file_offset, bytes_to_read,
+      reinterpret_cast<uint8_t*>(buffer))) {
+    reader_->data_cache_hit_bytes_ += bytes_to_read;
+    *bytes_read = bytes_to_read;
+    // The file position did not move.
+    needs_seek_ = true;
+  } else {
+    if (needs_seek_ && !use_pread_) {
+      DCHECK(fs_ != NULL);
+      if (hdfsSeek(fs_, hdfs_file_->file(), file_offset) != 0) {
+        string error_msg = GetHdfsErrorMsg("");
+        stringstream ss;
+        ss << "Error seeking to " << file_offset << " in file: " << file_ << " "
+           << error_msg;
+        return Status(ss.str());
+      }
+      needs_seek_ = false;
+    }
+    RETURN_IF_ERROR(ReadFromFile(buffer, bytes_to_read, bytes_read, eosr));
+    if (data_cache != NULL) {
+      reader_->data_cache_miss_bytes_ += *bytes_read;
+      // Only full reads are cached, the key includes the length.
+      if (*bytes_read == bytes_to_read) {
+        reader_->data_cache_num_evictions_ += data_cache->Store(file_, mtime_,
+            file_offset, bytes_to_read, reinterpret_cast<uint8_t*>(buffer));
+      }
+    }
+  }
+  bytes_read_ += *bytes_read;
+  DCHECK_LE(bytes_read_, len_);
+  if (bytes_read_ == len_) *eosr = true;
+  return Status::OK();
+}
+
+Status DiskIoMgr::ScanRange::ReadCoalesced(char* buffer, int64_t len,
+    int64_t* bytes_read) {
+  unique_lock<mutex> hdfs_lock(hdfs_lock_);
+  if (is_cancelled_) return Status::CANCELLED;
+  DCHECK_EQ(bytes_read_, 0);
+  DCHECK_LE(len, io_mgr_->max_buffer_size_);
+  bool eof;
+  return ReadFromFile(buffer, len, bytes_read, &eof);
+}
+
+Status DiskIoMgr::ScanRange::ReadFromFile(char* buffer, int bytes_to_read,
+    int64_t* bytes_read, bool* eof) {
+  *eof = false;
+  *bytes_read = 0;
   if (fs_ != NULL) {
     DCHECK(hdfs_file_ != NULL);
     int64_t max_chunk_size = MaxReadChunkSize();
     while (*bytes_read < bytes_to_read) {
       int chunk_size = min(bytes_to_read - *bytes_read, max_chunk_size);
-      int last_read = hdfsRead(fs_, hdfs_file_->file(), buffer + *bytes_read, chunk_size);
+      int last_read = use_pread_ ?
+          hdfsPread(fs_, hdfs_file_->file(), offset_ + bytes_read_ + *bytes_read,
+              buffer + *bytes_read, chunk_size) :
+          hdfsRead(fs_, hdfs_file_->file(), buffer + *bytes_read, chunk_size);
       if (last_read == -1) {
         return Status(GetHdfsErrorMsg("Error reading from HDFS file: ", file_));
       } else if (last_read == 0) {
         // No more bytes in the file. The scan range went past the end.
-        *eosr = true;
+        *eof = true;
         break;
       }
       *bytes_read += last_read;
     }
   } else {
-    DCHECK(local_file_ != NULL);
-    *bytes_read = fread(buffer, 1, bytes_to_read, local_file_);
-    DCHECK_GE(*bytes_read, 0);
-    DCHECK_LE(*bytes_read, bytes_to_read);
-    if (*bytes_read < bytes_to_read) {
-      if (ferror(local_file_) != 0) {
+    DCHECK_NE(local_fd_, -1);
+    int64_t file_offset = offset_ + bytes_read_;
+    while (*bytes_read < bytes_to_read) {
+      ssize_t last_read = pread(local_fd_, buffer + *bytes_read,
+          bytes_to_read - *bytes_read, file_offset + *bytes_read);
+      if (last_read == -1) {
+        if (errno == EINTR) continue;
         string error_msg = GetStrErrMsg();
         stringstream ss;
         ss << "Error reading from " << file_ << " at byte offset: "
-           << (offset_ + bytes_read_) << ": " << error_msg;
+           << (file_offset + *bytes_read) << ": " << error_msg;
         return Status(ss.str());
-      } else {
-        // On Linux, we should only get partial reads from block devices on error or eof.
-        DCHECK(feof(local_file_) != 0);
-        *eosr = true;
+      } else if (last_read == 0) {
+        // No more bytes in the file. The scan range went past the end.
+        *eof = true;
+        break;
       }
+      *bytes_read += last_read;
+    }
+    DCHECK_LE(*bytes_read, bytes_to_read);
+    int64_t bytes_remaining = len_ - bytes_read_ - *bytes_read;
+    if (FLAGS_local_disk_read_ahead && !*eof && bytes_remaining > 0) {
+      // Best effort, errors are ignored.
+      posix_fadvise(local_fd_, file_offset + *bytes_read,
+          min(bytes_remaining, static_cast<int64_t>(io_mgr_->max_buffer_size_)),
+          POSIX_FADV_WILLNEED);
     }
   }
-  bytes_read_ += *bytes_read;
-  DCHECK_LE(bytes_read_, len_);
-  if (bytes_read_ == len_) *eosr = true;
   return Status::OK();
 }
 
 Status DiskIoMgr::ScanRange::ReadFromCache(bool* read_succeeded) {
+  if (try_mmap_) return ReadFromMmap(read_succeeded);
   DCHECK(try_cache_);
   DCHECK_EQ(bytes_read_, 0);
   *read_succeeded = false;
@@ -451,3 +556,68 @@ Status DiskIoMgr::ScanRange::ReadFromCache(bool* read_succeeded) {
   ++reader_->num_used_buffers_;
   return Status::OK();
 }
+
+Status DiskIoMgr::ScanRange::ReadFromMmap(bool* read_succeeded) {
+  DCHECK(try_mmap_);
+  DCHECK_EQ(bytes_read_, 0);
+  *read_succeeded = false;
+  // Offset of the range in the mapping, which must start at a page boundary.
+  int64_t buffer_offset;
+  {
+    unique_lock<mutex> hdfs_lock(hdfs_lock_);
+    if (is_cancelled_) return Status::CANCELLED;
+    DCHECK(mapped_buffer_ == NULL);
+
+    // Turn "file:///path" and "file:/path" into "/path".
+    const char* path = file();
+    if (IsLocalPath(path)) {
+      path += 5;
+      if (strncmp(path, "//", 2) == 0) path += 2;
+    }
+    // Errors are reported by the normal read path, if they happen there too.
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return Status::OK();
+    int64_t page_size = sysconf(_SC_PAGESIZE);
+    buffer_offset = offset_ % page_size;
+    struct stat file_stat;
+    // Pages past the end of the file can't be read, let the normal path deal with a
+    // range that goes past it.
+    if (fstat(fd, &file_stat) == 0 && file_stat.st_size >= offset_ + len_) {
+      void* mapping = mmap(NULL, buffer_offset + len_, PROT_READ, MAP_SHARED, fd,
+          offset_ - buffer_offset);
+      if (mapping != MAP_FAILED) {
+        mapped_buffer_ = mapping;
+        mapped_len_ = buffer_offset + len_;
+      }
+    }
+    close(fd);
+    if (mapped_buffer_ == NULL) {
+      VLOG_FILE << "Could not map file=" << file_ << ", reading it into IO buffers.";
+      return Status::OK();
+    }
+
+    // The scanner reads the range front to back, so let the kernel read ahead
+    // aggressively and start reading the first buffer's worth right away. Both are
+    // only hints, errors are ignored.
+    madvise(mapped_buffer_, mapped_len_, MADV_SEQUENTIAL);
+    if (FLAGS_local_disk_read_ahead) {
+      madvise(mapped_buffer_,
+          min(mapped_len_, buffer_offset + io_mgr_->max_buffer_size_), MADV_WILLNEED);
+    }
+  }
+
+  // Hand the whole range to the reader in a single buffer, as for the DN cache.
+  BufferDescriptor* desc = io_mgr_->GetBufferDesc(
+      reader_, this, reinterpret_cast<char*>(mapped_buffer_) + buffer_offset, 0);
+  desc->len_ = len_;
+  desc->scan_range_offset_ = 0;
+  desc->eosr_ = true;
+  bytes_read_ = len_;
+  EnqueueBuffer(desc);
+  if (reader_->bytes_read_counter_ != NULL) {
+    COUNTER_ADD(reader_->bytes_read_counter_, len_);
+  }
+  *read_succeeded = true;
+  ++reader_->num_used_buffers_;
+  return Status::OK();
+}
@@ -19,7 +19,9 @@
 
 #include "testutil/gtest-util.h"
 #include "codegen/llvm-codegen.h"
+#include "runtime/buffer-pool.h"
 #include "runtime/disk-io-mgr.h"
+#include "runtime/disk-io-mgr-internal.h"
 #include "runtime/disk-io-mgr-stress.h"
 #include "runtime/mem-tracker.h"
 #include "runtime/thread-resource-mgr.h"
@@ -29,6 +31,11 @@
 
 #include "common/names.h"
 
+DECLARE_int32(disk_io_thread_tuning_interval_ms);
+DECLARE_int32(disk_io_thread_tuning_max_factor);
+DECLARE_string(disk_io_pool_weights);
+DECLARE_bool(mmap_local_reads);
+
 using boost::condition_variable;
 
 const int MIN_BUFFER_SIZE = 512;
@@ -742,6 +749,57 @@ TEST_F(DiskIoMgrTest, CachedReads) {
   EXPECT_EQ(mem_tracker.consumption(), 0);
 }
 
+// Reads ranges at unaligned offsets of a local file by mapping it. The mapped buffers
+// must not be charged to the readers' mem trackers.
+TEST_F(DiskIoMgrTest, MmapReads) {
+  MemTracker mem_tracker(LARGE_MEM_LIMIT);
+  const char* tmp_file = "/tmp/disk_io_mgr_test.txt";
+  const char* data = "abcdefghijklm";
+  int len = strlen(data);
+  CreateTempFile(tmp_file, data);
+
+  struct stat stat_val;
+  stat(tmp_file, &stat_val);
+
+  FLAGS_mmap_local_reads = true;
+  {
+    pool_.reset(new ObjectPool);
+    DiskIoMgr io_mgr(1, 1, MIN_BUFFER_SIZE, MAX_BUFFER_SIZE);
+    ASSERT_OK(io_mgr.Init(&mem_tracker));
+    MemTracker reader_mem_tracker;
+    DiskIoMgr::RequestContext* reader;
+    ASSERT_OK(io_mgr.RegisterContext(&reader, &reader_mem_tracker));
+
+    vector<DiskIoMgr::ScanRange*> ranges;
+    for (int i = 0; i < len; ++i) {
+      ranges.push_back(InitRange(1, tmp_file, i, len - i, 0, stat_val.st_mtime));
+    }
+    ASSERT_OK(io_mgr.AddScanRanges(reader, ranges));
+
+    for (int i = 0; i < len; ++i) {
+      DiskIoMgr::ScanRange* range;
+      ASSERT_OK(io_mgr.GetNextRange(reader, &range));
+      ASSERT_TRUE(range != NULL);
+      DiskIoMgr::BufferDescriptor* buffer;
+      ASSERT_OK(range->GetNext(&buffer));
+      ASSERT_TRUE(buffer->eosr());
+      EXPECT_EQ(buffer->len(), range->len());
+      EXPECT_EQ(memcmp(buffer->buffer(), data + range->offset(), range->len()), 0);
+      buffer->SetMemTracker(&reader_mem_tracker);
+      EXPECT_EQ(reader_mem_tracker.consumption(), 0);
+      buffer->Return();
+    }
+    DiskIoMgr::ScanRange* range;
+    ASSERT_OK(io_mgr.GetNextRange(reader, &range));
+    EXPECT_TRUE(range == NULL);
+
+    io_mgr.UnregisterContext(reader);
+    EXPECT_EQ(reader_mem_tracker.consumption(), 0);
+  }
+  FLAGS_mmap_local_reads = false;
+  EXPECT_EQ(mem_tracker.consumption(), 0);
+}
+
 TEST_F(DiskIoMgrTest, MultipleReaderWriter) {
   MemTracker mem_tracker(LARGE_MEM_LIMIT);
   const int ITERATIONS = 1;
@@ -944,6 +1002,8 @@ TEST_F(DiskIoMgrTest, Buffers) {
   EXPECT_EQ(buffer_len, min_buffer_size);
   EXPECT_EQ(io_mgr.num_allocated_buffers_, 1);
   io_mgr.ReturnFreeBuffer(buf, buffer_len);
+  EXPECT_EQ(io_mgr.num_allocated_buffers_, 0);
+  EXPECT_EQ(io_mgr.buffer_pool()->num_free_buffers(), 1);
   EXPECT_EQ(mem_tracker.consumption(), min_buffer_size);
 
   // reuse buffer
@@ -958,12 +1018,14 @@ TEST_F(DiskIoMgrTest, Buffers) {
   buffer_len = min_buffer_size + 1;
   buf = io_mgr.GetFreeBuffer(&buffer_len);
   EXPECT_EQ(buffer_len, min_buffer_size * 2);
-  EXPECT_EQ(io_mgr.num_allocated_buffers_, 2);
+  EXPECT_EQ(io_mgr.num_allocated_buffers_, 1);
+  EXPECT_EQ(io_mgr.buffer_pool()->num_free_buffers(), 1);
   EXPECT_EQ(mem_tracker.consumption(), min_buffer_size * 3);
 
   // gc unused buffer
   io_mgr.GcIoBuffers();
   EXPECT_EQ(io_mgr.num_allocated_buffers_, 1);
+  EXPECT_EQ(io_mgr.buffer_pool()->num_free_buffers(), 0);
   EXPECT_EQ(mem_tracker.consumption(), min_buffer_size * 2);
 
   io_mgr.ReturnFreeBuffer(buf, buffer_len);
@@ -972,13 +1034,15 @@ TEST_F(DiskIoMgrTest, Buffers) {
   buffer_len = max_buffer_size;
   buf = io_mgr.GetFreeBuffer(&buffer_len);
   EXPECT_EQ(buffer_len, max_buffer_size);
-  EXPECT_EQ(io_mgr.num_allocated_buffers_, 2);
+  EXPECT_EQ(io_mgr.num_allocated_buffers_, 1);
   io_mgr.ReturnFreeBuffer(buf, buffer_len);
+  EXPECT_EQ(io_mgr.buffer_pool()->num_free_buffers(), 2);
   EXPECT_EQ(mem_tracker.consumption(), min_buffer_size * 2 + max_buffer_size);
 
   // gc buffers
   io_mgr.GcIoBuffers();
   EXPECT_EQ(io_mgr.num_allocated_buffers_, 0);
+  EXPECT_EQ(io_mgr.buffer_pool()->num_free_buffers(), 0);
   EXPECT_EQ(mem_tracker.consumption(), 0);
 }
 
@@ -1019,6 +1083,179 @@ TEST_F(DiskIoMgrTest, PartialRead) {
   EXPECT_EQ(mem_tracker.consumption(), 0);
 }
 
+// Test that small, nearby ranges that are scheduled immediately are read together and
+// that each range still returns exactly its own bytes.
+TEST_F(DiskIoMgrTest, CoalescedReads) {
+  MemTracker mem_tracker(LARGE_MEM_LIMIT);
+  const char* tmp_file = "/tmp/disk_io_mgr_test.txt";
+  const char* data = "the quick brown fox jumped over the lazy dog";
+  int len = strlen(data);
+  CreateTempFile(tmp_file, data);
+
+  // Get mtime for file
+  struct stat stat_val;
+  stat(tmp_file, &stat_val);
+
+  // (offset, len) of each range. The ranges are out of order, some are adjacent, some
+  // have gaps between them and the last one goes past the end of the file.
+  const int range_bounds[][2] = {{10, 5}, {0, 3}, {3, 1}, {20, 6}, {40, 20}};
+  const int num_ranges = sizeof(range_bounds) / sizeof(range_bounds[0]);
+
+  for (int cancel = 0; cancel < 2; ++cancel) {
+    pool_.reset(new ObjectPool);
+    scoped_ptr<DiskIoMgr> io_mgr(new DiskIoMgr(1, 1, MIN_BUFFER_SIZE, MAX_BUFFER_SIZE));
+    ASSERT_OK(io_mgr->Init(&mem_tracker));
+    MemTracker reader_mem_tracker;
+    DiskIoMgr::RequestContext* reader;
+    ASSERT_OK(io_mgr->RegisterContext(&reader, &reader_mem_tracker));
+
+    vector<DiskIoMgr::ScanRange*> ranges;
+    for (int i = 0; i < num_ranges; ++i) {
+      ranges.push_back(InitRange(1, tmp_file, range_bounds[i][0], range_bounds[i][1], 0,
+          stat_val.st_mtime));
+    }
+    ASSERT_OK(io_mgr->AddScanRanges(reader, ranges, true));
+    if (cancel) io_mgr->CancelContext(reader);
+
+    for (int i = 0; i < num_ranges; ++i) {
+      DiskIoMgr::BufferDescriptor* buffer;
+      Status status = ranges[i]->GetNext(&buffer);
+      if (cancel) {
+        // The read may have finished before the context was cancelled.
+        ASSERT_TRUE(status.ok() || status.IsCancelled()) << status.GetDetail();
+        if (buffer != NULL) buffer->Return();
+        continue;
+      }
+      ASSERT_OK(status);
+      ASSERT_TRUE(buffer != NULL);
+      EXPECT_TRUE(buffer->eosr());
+      int expected_len = std::min(range_bounds[i][1], len - range_bounds[i][0]);
+      ASSERT_EQ(expected_len, buffer->len());
+      EXPECT_EQ(0, memcmp(buffer->buffer(), data + range_bounds[i][0], expected_len));
+      buffer->Return();
+    }
+
+    io_mgr->UnregisterContext(reader);
+    pool_.reset();
+    io_mgr.reset();
+    EXPECT_EQ(reader_mem_tracker.consumption(), 0);
+    EXPECT_EQ(mem_tracker.consumption(), 0);
+  }
+}
+
+// Drives the tuner by hand with simulated intervals of the S3 queue.
+TEST_F(DiskIoMgrTest, ThreadTuning) {
+  int32_t old_interval = FLAGS_disk_io_thread_tuning_interval_ms;
+  // Start the threads for tuning, but don't let the tuner thread run during the test.
+  FLAGS_disk_io_thread_tuning_interval_ms = 3600 * 1000;
+  MemTracker mem_tracker(LARGE_MEM_LIMIT);
+  DiskIoMgr io_mgr(1, 1, MIN_BUFFER_SIZE, MAX_BUFFER_SIZE);
+  ASSERT_OK(io_mgr.Init(&mem_tracker));
+  FLAGS_disk_io_thread_tuning_interval_ms = old_interval;
+
+  DiskIoMgr::DiskQueue* queue = io_mgr.disk_queues_[io_mgr.RemoteS3DiskId()];
+  const int initial_threads = queue->num_active_threads;
+  ASSERT_GT(initial_threads, 0);
+  EXPECT_EQ(initial_threads * FLAGS_disk_io_thread_tuning_max_factor,
+      queue->num_threads);
+  const int64_t interval_ns = 1000L * 1000L * 1000L;
+
+  // All threads busy: with no history, the remote queue grows.
+  queue->bytes_processed.Add(1000);
+  queue->busy_time_ns.Add(initial_threads * interval_ns);
+  io_mgr.TuneDiskQueue(queue, interval_ns);
+  EXPECT_EQ(initial_threads + 1, queue->num_active_threads);
+
+  // The extra thread doubled throughput, grow again.
+  queue->bytes_processed.Add(2000);
+  queue->busy_time_ns.Add((initial_threads + 1) * interval_ns);
+  io_mgr.TuneDiskQueue(queue, interval_ns);
+  EXPECT_EQ(initial_threads + 2, queue->num_active_threads);
+
+  // Throughput dropped, undo the last step.
+  queue->bytes_processed.Add(1000);
+  queue->busy_time_ns.Add((initial_threads + 2) * interval_ns);
+  io_mgr.TuneDiskQueue(queue, interval_ns);
+  EXPECT_EQ(initial_threads + 1, queue->num_active_threads);
+
+  // Idle threads: nothing changes.
+  queue->bytes_processed.Add(1000);
+  io_mgr.TuneDiskQueue(queue, interval_ns);
+  EXPECT_EQ(initial_threads + 1, queue->num_active_threads);
+
+  // With flat throughput the remote queue grows up to its number of threads.
+  for (int i = 0; i < 2 * queue->num_threads; ++i) {
+    queue->bytes_processed.Add(1000);
+    queue->busy_time_ns.Add(queue->num_active_threads * interval_ns);
+    io_mgr.TuneDiskQueue(queue, interval_ns);
+  }
+  EXPECT_EQ(queue->num_threads, queue->num_active_threads);
+}
+
+// Returns true for ranges that start at an odd offset.
+static bool HasOddOffset(DiskIoMgr::ScanRange* range) {
+  return range->offset() % 2 == 1;
+}
+
+// Removes some unstarted ranges and checks that only the others are returned.
+TEST_F(DiskIoMgrTest, RemoveUnstartedRanges) {
+  MemTracker mem_tracker(LARGE_MEM_LIMIT);
+  const char* tmp_file = "/tmp/disk_io_mgr_test.txt";
+  const char* data = "abcdefghijklm";
+  int len = strlen(data);
+  CreateTempFile(tmp_file, data);
+
+  // Get mtime for file
+  struct stat stat_val;
+  stat(tmp_file, &stat_val);
+
+  const int num_disks = 2;
+  DiskIoMgr io_mgr(num_disks, 1, MIN_BUFFER_SIZE, MAX_BUFFER_SIZE);
+  ASSERT_OK(io_mgr.Init(&mem_tracker));
+  MemTracker reader_mem_tracker;
+  DiskIoMgr::RequestContext* reader;
+  ASSERT_OK(io_mgr.RegisterContext(&reader, &reader_mem_tracker));
+
+  vector<DiskIoMgr::ScanRange*> ranges;
+  for (int i = 0; i < len; ++i) {
+    ranges.push_back(InitRange(1, tmp_file, i, 1, i % num_disks, stat_val.st_mtime));
+  }
+  ASSERT_OK(io_mgr.AddScanRanges(reader, ranges));
+
+  vector<DiskIoMgr::ScanRange*> removed;
+  io_mgr.RemoveUnstartedRanges(reader, HasOddOffset, &removed);
+  for (int i = 0; i < removed.size(); ++i) EXPECT_TRUE(HasOddOffset(removed[i]));
+
+  // Each disk may already have picked its next range before the removal.
+  int num_returned = 0;
+  int num_returned_odd = 0;
+  while (true) {
+    DiskIoMgr::ScanRange* range;
+    ASSERT_OK(io_mgr.GetNextRange(reader, &range));
+    if (range == NULL) break;
+    ValidateScanRange(range, data, len, Status::OK());
+    ++num_returned;
+    if (HasOddOffset(range)) ++num_returned_odd;
+  }
+  EXPECT_EQ(len, num_returned + removed.size());
+  EXPECT_LE(num_returned_odd, num_disks);
+
+  io_mgr.UnregisterContext(reader);
+  EXPECT_EQ(reader_mem_tracker.consumption(), 0);
+}
+
+TEST_F(DiskIoMgrTest, PoolIoWeights) {
+  string old_weights = FLAGS_disk_io_pool_weights;
+  FLAGS_disk_io_pool_weights = "root.interactive:8, root.etl:1,root.bad:x,root.zero:0";
+  EXPECT_EQ(8, DiskIoMgr::GetPoolIoWeight("root.interactive"));
+  EXPECT_EQ(1, DiskIoMgr::GetPoolIoWeight("root.etl"));
+  EXPECT_EQ(1, DiskIoMgr::GetPoolIoWeight("root.bad"));
+  EXPECT_EQ(1, DiskIoMgr::GetPoolIoWeight("root.zero"));
+  EXPECT_EQ(1, DiskIoMgr::GetPoolIoWeight("root.other"));
+  EXPECT_EQ(1, DiskIoMgr::GetPoolIoWeight(""));
+  FLAGS_disk_io_pool_weights = old_weights;
+}
+
 }
 
 int main(int argc, char **argv) {
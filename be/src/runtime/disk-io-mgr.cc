@@ -13,19 +13,33 @@
 // limitations under the License.
 
 #include "runtime/disk-io-mgr.h"
+#include "runtime/buffer-pool.h"
+#include "runtime/data-cache.h"
 #include "runtime/disk-io-mgr-internal.h"
 #include "util/hdfs-util.h"
+#include "util/histogram-metric.h"
+#include "util/metrics.h"
+#include "util/pretty-printer.h"
+#include "util/string-parser.h"
 
 #include <gutil/strings/substitute.h>
 #include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 DECLARE_bool(disable_mem_pools);
 
 #include "common/names.h"
 
+using boost::algorithm::is_any_of;
+using boost::algorithm::split;
+using boost::algorithm::token_compress_on;
+using boost::algorithm::trim_copy;
+using boost::get_system_time;
 using namespace impala;
 using namespace strings;
 
+namespace posix_time = boost::posix_time;
+
 // Control the number of disks on the machine.  If 0, this comes from the system
 // settings.
 DEFINE_int32(num_disks, 0, "Number of disks on data node.");
@@ -49,17 +63,52 @@ DEFINE_int32(num_s3_io_threads, 16, "number of S3 I/O threads");
 DEFINE_int32(read_size, 8 * 1024 * 1024, "Read Size (in bytes)");
 DEFINE_int32(min_buffer_size, 1024, "The minimum read buffer size (in bytes)");
 
-// With 1024B through 8MB buffers, this is up to ~2GB of buffers.
+// Ranges that are scheduled immediately and lie close together in the same file are
+// read with a single read of up to this many bytes (capped at the max buffer size),
+// skipping over gaps of up to max_coalesced_read_gap bytes between them. Reading a gap
+// is cheaper than a separate seek and request for ranges of this size.
+DEFINE_int32(max_coalesced_read_size, 1024 * 1024, "(Advanced) Maximum size in bytes "
+    "of a read that serves several adjacent scan ranges. Set to 0 to disable "
+    "coalescing.");
+DEFINE_int32(max_coalesced_read_gap, 64 * 1024, "(Advanced) Maximum number of bytes "
+    "between two scan ranges that are read together.");
+
+// Local data cache for reads from remote filesystems.
+DEFINE_string(data_cache_dir, "", "(Advanced) Local directory in which to cache data "
+    "read from S3 and remote HDFS. The directory is wiped at startup. If empty, the data "
+    "cache is disabled.");
+DEFINE_int64(data_cache_capacity, 10L * 1024L * 1024L * 1024L, "(Advanced) Maximum "
+    "number of bytes stored in --data_cache_dir.");
+
+// The thread counts above are starting points that are adjusted to the observed
+// throughput of each disk queue (see "Adaptive disk thread counts" in disk-io-mgr.h).
+DEFINE_int32(disk_io_thread_tuning_interval_ms, 1000, "(Advanced) Interval at which "
+    "the number of active threads of each disk queue is adjusted. Set to 0 to keep the "
+    "thread counts fixed.");
+DEFINE_int32(disk_io_thread_tuning_max_factor, 2, "(Advanced) Maximum factor by which "
+    "the number of threads of a disk queue may grow beyond its configured value.");
+
+// Relative shares of the disk queues for queries from each admission pool (see "Fair
+// sharing" in disk-io-mgr.h).
+DEFINE_string(disk_io_pool_weights, "", "(Advanced) Comma-separated list of "
+    "<pool>:<weight> pairs. Queries in a pool with weight N get N times as many turns on "
+    "each disk as queries with weight 1, which is the weight of unlisted pools, e.g. "
+    "'root.interactive:8,root.etl:1'.");
+
+// With 1024B through 8MB buffers, this is up to ~2GB of buffers per NUMA node.
 DEFINE_int32(max_free_io_buffers, 128,
-    "For each io buffer size, the maximum number of buffers the IoMgr will hold onto");
+    "For each io buffer size, the maximum number of unused buffers that the buffer pool "
+    "shared by the IoMgr and the block managers of all queries holds onto per NUMA node");
 
 // The number of cached file handles defines how much memory can be used per backend for
 // caching frequently used file handles. Currently, we assume that approximately 2kB data
 // are associated with a single file handle. 10k file handles will thus reserve ~20MB
 // data. The actual amount of memory that is associated with a file handle can be larger
 // or smaller, depending on the replication factor for this file or the path name.
-DEFINE_uint64(max_cached_file_handles, 0, "Maximum number of HDFS file handles "
-    "that will be cached. Disabled if set to 0.");
+DEFINE_uint64(max_cached_file_handles, 10000, "Maximum number of idle HDFS file handles "
+    "that are kept open, shared by all queries, so that reading recently read files "
+    "does not need a NameNode RPC to open them again. If set to 0, handles are closed "
+    "once no scan range uses them.");
 
 // Rotational disks should have 1 thread per disk to minimize seeks.  Non-rotational
 // don't have this penalty and benefit from multiple concurrent IO requests.
@@ -71,25 +120,36 @@ static const int THREADS_PER_FLASH_DISK = 8;
 // current queue size.
 static const int LOW_MEMORY = 64 * 1024 * 1024;
 
+// The virtual time a context with weight 1 is charged for a turn on a disk queue.
+static const int64_t VIRTUAL_TIME_PER_TURN = 1024 * 1024;
+
+// Upper bound for the weight of a context.
+static const int MAX_IO_WEIGHT = 1024;
+
+// A disk queue is considered saturated, i.e. its throughput may be limited by the
+// number of active threads, if on average at least this fraction of them were busy.
+static const double TUNING_SATURATION_RATIO = 0.8;
+
+// Relative throughput changes smaller than this are considered noise by the tuner.
+static const double TUNING_THROUGHPUT_TOLERANCE = 0.05;
+
 const int DiskIoMgr::DEFAULT_QUEUE_CAPACITY = 2;
 
-namespace detail {
-// Indicates if file handle caching should be used
-static inline bool is_file_handle_caching_enabled() {
-  return FLAGS_max_cached_file_handles > 0;
-}
-}
+LockSite DiskIoMgr::DiskQueue::lock_site("DiskIoMgr::DiskQueue::lock");
+LockSite DiskIoMgr::RequestContext::lock_site_("DiskIoMgr::RequestContext::lock_");
 
-/// This method is used to clean up resources upon eviction of a cache file handle.
-void DiskIoMgr::HdfsCachedFileHandle::Release(DiskIoMgr::HdfsCachedFileHandle** h) {
-  ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES->Increment(-1L);
-  VLOG_FILE << "Cached file handle evicted, hdfsCloseFile() fid=" << (*h)->hdfs_file_;
-  delete (*h);
-}
+// Highest latency and queue wait time, in ns, tracked by the histograms of
+// RegisterMetrics(). Longer ones are counted as this.
+static const int64_t MAX_TRACKED_LATENCY_NS = 5L * 60L * 1000L * 1000L * 1000L;
+
+// Metric keys of the histograms of RegisterMetrics().
+static const string READ_LATENCY_METRIC_KEY = "impala-server.io-mgr.$0.read-latency";
+static const string QUEUE_WAIT_TIME_METRIC_KEY = "impala-server.io-mgr.queue-wait-time";
 
 DiskIoMgr::HdfsCachedFileHandle::HdfsCachedFileHandle(const hdfsFS& fs, const char* fname,
     int64_t mtime)
-    : fs_(fs), hdfs_file_(hdfsOpenFile(fs, fname, O_RDONLY, 0, 0, 0)), mtime_(mtime) {
+    : fs_(fs), hdfs_file_(hdfsOpenFile(fs, fname, O_RDONLY, 0, 0, 0)), mtime_(mtime),
+      fname_(fname), ref_count_(0), exclusive_(false) {
   VLOG_FILE << "hdfsOpenFile() file=" << fname << " fid=" << hdfs_file_;
 }
 
@@ -175,7 +235,7 @@ string DiskIoMgr::RequestContextCache::DebugString() {
   stringstream ss;
   for (list<RequestContext*>::iterator it = all_contexts_.begin();
       it != all_contexts_.end(); ++it) {
-    unique_lock<mutex> lock((*it)->lock_);
+    ProfiledLock<mutex> lock((*it)->lock_, &RequestContext::lock_site_);
     ss << (*it)->DebugString() << endl;
   }
   return ss.str();
@@ -187,7 +247,7 @@ string DiskIoMgr::DebugString() {
 
   ss << "Disks: " << endl;
   for (int i = 0; i < disk_queues_.size(); ++i) {
-    unique_lock<mutex> lock(disk_queues_[i]->lock);
+    ProfiledLock<mutex> lock(disk_queues_[i]->lock, &DiskQueue::lock_site);
     ss << "  " << (void*) disk_queues_[i] << ":" ;
     if (!disk_queues_[i]->request_contexts.empty()) {
       ss << " Readers: ";
@@ -227,8 +287,8 @@ void DiskIoMgr::BufferDescriptor::Return() {
 }
 
 void DiskIoMgr::BufferDescriptor::SetMemTracker(MemTracker* tracker) {
-  // Cached buffers don't count towards mem usage.
-  if (scan_range_->cached_buffer_ != NULL) return;
+  // Cached and mapped buffers don't count towards mem usage.
+  if (scan_range_->has_zero_copy_buffer()) return;
   if (mem_tracker_ == tracker) return;
   if (mem_tracker_ != NULL) mem_tracker_->Release(buffer_len_);
   mem_tracker_ = tracker;
@@ -266,11 +326,9 @@ DiskIoMgr::DiskIoMgr() :
     shut_down_(false),
     total_bytes_read_counter_(TUnit::BYTES),
     read_timer_(TUnit::TIME_NS),
+    queue_wait_time_metric_(NULL),
     file_handle_cache_(min(FLAGS_max_cached_file_handles,
-        FileSystemUtil::MaxNumFileHandles()),
-        &HdfsCachedFileHandle::Release) {
-  int64_t max_buffer_size_scaled = BitUtil::Ceil(max_buffer_size_, min_buffer_size_);
-  free_buffers_.resize(BitUtil::Log2(max_buffer_size_scaled) + 1);
+        FileSystemUtil::MaxNumFileHandles())) {
   int num_local_disks = FLAGS_num_disks == 0 ? DiskInfo::num_disks() : FLAGS_num_disks;
   disk_queues_.resize(num_local_disks + REMOTE_NUM_DISKS);
   CheckSseSupport();
@@ -285,10 +343,9 @@ DiskIoMgr::DiskIoMgr(int num_local_disks, int threads_per_disk, int min_buffer_s
     shut_down_(false),
     total_bytes_read_counter_(TUnit::BYTES),
     read_timer_(TUnit::TIME_NS),
+    queue_wait_time_metric_(NULL),
     file_handle_cache_(min(FLAGS_max_cached_file_handles,
-            FileSystemUtil::MaxNumFileHandles()), &HdfsCachedFileHandle::Release) {
-  int64_t max_buffer_size_scaled = BitUtil::Ceil(max_buffer_size_, min_buffer_size_);
-  free_buffers_.resize(BitUtil::Log2(max_buffer_size_scaled) + 1);
+        FileSystemUtil::MaxNumFileHandles())) {
   if (num_local_disks == 0) num_local_disks = DiskInfo::num_disks();
   disk_queues_.resize(num_local_disks + REMOTE_NUM_DISKS);
   CheckSseSupport();
@@ -296,6 +353,14 @@ DiskIoMgr::DiskIoMgr(int num_local_disks, int threads_per_disk, int min_buffer_s
 
 DiskIoMgr::~DiskIoMgr() {
   shut_down_ = true;
+  if (tuner_thread_.get() != NULL) {
+    {
+      // The tuner checks shut_down_ under this lock before waiting.
+      lock_guard<mutex> l(tuner_lock_);
+    }
+    tuner_cv_.notify_all();
+    tuner_thread_->Join();
+  }
   // Notify all worker threads and shut them down.
   for (int i = 0; i < disk_queues_.size(); ++i) {
     if (disk_queues_[i] == NULL) continue;
@@ -303,7 +368,7 @@ DiskIoMgr::~DiskIoMgr() {
       // This lock is necessary to properly use the condition var to notify
       // the disk worker threads.  The readers also grab this lock so updates
       // to shut_down_ are protected.
-      unique_lock<mutex> disk_lock(disk_queues_[i]->lock);
+      ProfiledLock<mutex> disk_lock(disk_queues_[i]->lock, &DiskQueue::lock_site);
     }
     disk_queues_[i]->work_available.notify_all();
   }
@@ -326,12 +391,8 @@ DiskIoMgr::~DiskIoMgr() {
   DCHECK_EQ(num_buffers_in_readers_, 0);
 
   // Delete all allocated buffers
-  int num_free_buffers = 0;
-  for (int idx = 0; idx < free_buffers_.size(); ++idx) {
-    num_free_buffers += free_buffers_[idx].size();
-  }
-  DCHECK_EQ(num_allocated_buffers_, num_free_buffers);
-  GcIoBuffers();
+  DCHECK_EQ(num_allocated_buffers_, 0);
+  if (buffer_pool_.get() != NULL) GcIoBuffers();
 
   for (int i = 0; i < disk_queues_.size(); ++i) {
     delete disk_queues_[i];
@@ -340,9 +401,31 @@ DiskIoMgr::~DiskIoMgr() {
   if (cached_read_options_ != NULL) hadoopRzOptionsFree(cached_read_options_);
 }
 
+void DiskIoMgr::RegisterMetrics(MetricGroup* metrics) {
+  DCHECK(read_latency_metrics_.empty());
+  // Two significant digits keep the histograms small enough for one per disk.
+  for (int i = 0; i < disk_queues_.size(); ++i) {
+    string queue_name;
+    if (i == RemoteDfsDiskId()) {
+      queue_name = "remote-dfs";
+    } else if (i == RemoteS3DiskId()) {
+      queue_name = "s3";
+    } else {
+      queue_name = Substitute("disk-$0", i);
+    }
+    read_latency_metrics_.push_back(metrics->RegisterMetric(new HistogramMetric(
+        MetricDefs::Get(READ_LATENCY_METRIC_KEY, queue_name), MAX_TRACKED_LATENCY_NS,
+        2)));
+  }
+  queue_wait_time_metric_ = metrics->RegisterMetric(new HistogramMetric(
+      MetricDefs::Get(QUEUE_WAIT_TIME_METRIC_KEY), MAX_TRACKED_LATENCY_NS, 2));
+}
+
 Status DiskIoMgr::Init(MemTracker* process_mem_tracker) {
   DCHECK(process_mem_tracker != NULL);
   process_mem_tracker_ = process_mem_tracker;
+  buffer_pool_.reset(new BufferPool(min_buffer_size_, max_buffer_size_,
+      FLAGS_disable_mem_pools ? 0 : FLAGS_max_free_io_buffers, process_mem_tracker));
   // If we hit the process limit, see if we can reclaim some memory by removing
   // previously allocated (but unused) io buffers.
   process_mem_tracker->AddGcFunction(bind(&DiskIoMgr::GcIoBuffers, this));
@@ -361,14 +444,34 @@ Status DiskIoMgr::Init(MemTracker* process_mem_tracker) {
     } else {
       num_threads_per_disk = THREADS_PER_FLASH_DISK;
     }
-    for (int j = 0; j < num_threads_per_disk; ++j) {
+    DiskQueue* disk_queue = disk_queues_[i];
+    disk_queue->num_active_threads = num_threads_per_disk;
+    disk_queue->num_threads = num_threads_per_disk;
+    if (FLAGS_disk_io_thread_tuning_interval_ms > 0) {
+      disk_queue->num_threads *= max(1, FLAGS_disk_io_thread_tuning_max_factor);
+    }
+    if (i == RemoteDfsDiskId() || i == RemoteS3DiskId()) {
+      disk_queue->default_step = 1;
+    } else if (DiskInfo::is_rotational(i)) {
+      disk_queue->default_step = -1;
+    }
+    for (int j = 0; j < disk_queue->num_threads; ++j) {
       stringstream ss;
       ss << "work-loop(Disk: " << i << ", Thread: " << j << ")";
       disk_thread_group_.AddThread(new Thread("disk-io-mgr", ss.str(),
-          &DiskIoMgr::WorkLoop, this, disk_queues_[i]));
+          &DiskIoMgr::WorkLoop, this, disk_queue, j));
     }
   }
   request_context_cache_.reset(new RequestContextCache(this));
+  if (FLAGS_disk_io_thread_tuning_interval_ms > 0) {
+    tuner_thread_.reset(
+        new Thread("disk-io-mgr", "thread-tuner", &DiskIoMgr::TunerLoop, this));
+  }
+
+  if (!FLAGS_data_cache_dir.empty()) {
+    data_cache_.reset(new DataCache(FLAGS_data_cache_dir, FLAGS_data_cache_capacity));
+    RETURN_IF_ERROR(data_cache_->Init());
+  }
 
   cached_read_options_ = hadoopRzOptionsAlloc();
   DCHECK(cached_read_options_ != NULL);
@@ -395,7 +498,7 @@ void DiskIoMgr::UnregisterContext(RequestContext* reader) {
   CancelContext(reader, true);
 
   // All the disks are done with clean, validate nothing is leaking.
-  unique_lock<mutex> reader_lock(reader->lock_);
+  ProfiledLock<mutex> reader_lock(reader->lock_, &RequestContext::lock_site_);
   DCHECK_EQ(reader->num_buffers_in_reader_, 0) << endl << reader->DebugString();
   DCHECK_EQ(reader->num_used_buffers_, 0) << endl << reader->DebugString();
 
@@ -427,7 +530,7 @@ void DiskIoMgr::CancelContext(RequestContext* context, bool wait_for_disks_compl
   context->Cancel(Status::CANCELLED);
 
   if (wait_for_disks_completion) {
-    unique_lock<mutex> lock(context->lock_);
+    ProfiledLock<mutex> lock(context->lock_, &RequestContext::lock_site_);
     DCHECK(context->Validate()) << endl << context->DebugString();
     while (context->num_disks_with_ranges_ > 0) {
       context->disks_complete_cond_var_.wait(lock);
@@ -453,12 +556,37 @@ void DiskIoMgr::set_disks_access_bitmap(RequestContext* r,
   r->disks_accessed_bitmap_ = c;
 }
 
+void DiskIoMgr::set_io_weight(RequestContext* r, int weight) {
+  DCHECK_GE(weight, 1);
+  r->io_weight_ = min(weight, MAX_IO_WEIGHT);
+}
+
+int DiskIoMgr::GetPoolIoWeight(const string& pool) {
+  vector<string> entries;
+  split(entries, FLAGS_disk_io_pool_weights, is_any_of(","), token_compress_on);
+  for (int i = 0; i < entries.size(); ++i) {
+    string entry = trim_copy(entries[i]);
+    size_t colon = entry.rfind(':');
+    if (colon == string::npos || trim_copy(entry.substr(0, colon)) != pool) continue;
+    StringParser::ParseResult result;
+    string weight_str = trim_copy(entry.substr(colon + 1));
+    int weight = StringParser::StringToInt<int>(weight_str.c_str(), weight_str.size(),
+        &result);
+    if (result != StringParser::PARSE_SUCCESS || weight < 1) {
+      LOG(WARNING) << "Ignoring invalid --disk_io_pool_weights entry: " << entry;
+      continue;
+    }
+    return min(weight, MAX_IO_WEIGHT);
+  }
+  return 1;
+}
+
 int64_t DiskIoMgr::queue_size(RequestContext* reader) const {
   return reader->num_ready_buffers_;
 }
 
 Status DiskIoMgr::context_status(RequestContext* context) const {
-  unique_lock<mutex> lock(context->lock_);
+  ProfiledLock<mutex> lock(context->lock_, &RequestContext::lock_site_);
   return context->status_;
 }
 
@@ -466,6 +594,15 @@ int DiskIoMgr::num_unstarted_ranges(RequestContext* reader) const {
   return reader->num_unstarted_scan_ranges_;
 }
 
+int DiskIoMgr::num_queued_contexts() const {
+  int num_queued = 0;
+  for (int i = 0; i < disk_queues_.size(); ++i) {
+    ProfiledLock<mutex> lock(disk_queues_[i]->lock, &DiskQueue::lock_site);
+    num_queued += disk_queues_[i]->request_contexts.size();
+  }
+  return num_queued;
+}
+
 int64_t DiskIoMgr::bytes_read_local(RequestContext* reader) const {
   return reader->bytes_read_local_;
 }
@@ -486,6 +623,18 @@ int64_t DiskIoMgr::unexpected_remote_bytes(RequestContext* reader) const {
   return reader->unexpected_remote_bytes_;
 }
 
+int64_t DiskIoMgr::data_cache_hit_bytes(RequestContext* reader) const {
+  return reader->data_cache_hit_bytes_;
+}
+
+int64_t DiskIoMgr::data_cache_miss_bytes(RequestContext* reader) const {
+  return reader->data_cache_miss_bytes_;
+}
+
+int64_t DiskIoMgr::data_cache_num_evictions(RequestContext* reader) const {
+  return reader->data_cache_num_evictions_;
+}
+
 int64_t DiskIoMgr::GetReadThroughput() {
   return RuntimeProfile::UnitsPerSecond(&total_bytes_read_counter_, &read_timer_);
 }
@@ -512,7 +661,7 @@ Status DiskIoMgr::AddScanRanges(RequestContext* reader,
   }
 
   // disks that this reader needs to be scheduled on.
-  unique_lock<mutex> reader_lock(reader->lock_);
+  ProfiledLock<mutex> reader_lock(reader->lock_, &RequestContext::lock_site_);
   DCHECK(reader->Validate()) << endl << reader->DebugString();
 
   if (reader->state_ == RequestContext::Cancelled) {
@@ -520,13 +669,20 @@ Status DiskIoMgr::AddScanRanges(RequestContext* reader,
     return reader->status_;
   }
 
+  vector<ScanRange*> coalesced_ranges;
+  if (schedule_immediately && FLAGS_max_coalesced_read_size > 0) {
+    CoalesceScanRanges(ranges, &coalesced_ranges);
+  }
+  const vector<ScanRange*>& ranges_to_add =
+      coalesced_ranges.empty() ? ranges : coalesced_ranges;
+
   // Add each range to the queue of the disk the range is on
-  for (int i = 0; i < ranges.size(); ++i) {
+  for (int i = 0; i < ranges_to_add.size(); ++i) {
     // Don't add empty ranges.
-    DCHECK_NE(ranges[i]->len(), 0);
-    ScanRange* range = ranges[i];
+    DCHECK_NE(ranges_to_add[i]->len(), 0);
+    ScanRange* range = ranges_to_add[i];
 
-    if (range->try_cache_) {
+    if (range->try_cache_ || range->try_mmap_) {
       if (schedule_immediately) {
         bool cached_read_succeeded;
         RETURN_IF_ERROR(range->ReadFromCache(&cached_read_succeeded));
@@ -544,6 +700,58 @@ Status DiskIoMgr::AddScanRanges(RequestContext* reader,
   return Status::OK();
 }
 
+// Orders ranges by file and offset.
+static bool ScanRangeFileOffsetLt(const DiskIoMgr::ScanRange* a,
+    const DiskIoMgr::ScanRange* b) {
+  int cmp = strcmp(a->file(), b->file());
+  if (cmp != 0) return cmp < 0;
+  return a->offset() < b->offset();
+}
+
+void DiskIoMgr::CoalesceScanRanges(const vector<ScanRange*>& ranges,
+    vector<ScanRange*>* ranges_to_schedule) {
+  int64_t max_read_size =
+      min<int64_t>(FLAGS_max_coalesced_read_size, max_buffer_size_);
+  // Cached and mapped ranges are read without copies, don't fold them into another read.
+  vector<ScanRange*> candidates;
+  for (int i = 0; i < ranges.size(); ++i) {
+    if (!ranges[i]->try_cache_ && !ranges[i]->try_mmap_ &&
+        ranges[i]->len_ < max_read_size) {
+      candidates.push_back(ranges[i]);
+    }
+  }
+  if (candidates.size() < 2) return;
+  sort(candidates.begin(), candidates.end(), ScanRangeFileOffsetLt);
+
+  boost::unordered_set<ScanRange*> coalesced;
+  ScanRange* first = candidates[0];
+  for (int i = 1; i < candidates.size(); ++i) {
+    ScanRange* prev = first->coalesced_ranges_.empty() ?
+        first : first->coalesced_ranges_.back();
+    ScanRange* range = candidates[i];
+    int64_t prev_end = prev->offset_ + prev->len_;
+    if (range->fs_ == first->fs_ && range->file_ == first->file_ &&
+        range->disk_id_ == first->disk_id_ && range->mtime_ == first->mtime_ &&
+        range->offset_ >= prev_end &&
+        range->offset_ - prev_end <= FLAGS_max_coalesced_read_gap &&
+        range->offset_ + range->len_ - first->offset_ <= max_read_size) {
+      first->coalesced_ranges_.push_back(range);
+      coalesced.insert(range);
+    } else {
+      first = range;
+    }
+  }
+  if (coalesced.empty()) return;
+
+  VLOG_FILE << "Coalesced " << coalesced.size() << " of " << ranges.size()
+            << " scan ranges into other reads";
+  for (int i = 0; i < ranges.size(); ++i) {
+    if (coalesced.find(ranges[i]) == coalesced.end()) {
+      ranges_to_schedule->push_back(ranges[i]);
+    }
+  }
+}
+
 // This function returns the next scan range the reader should work on, checking
 // for eos and error cases. If there isn't already a cached scan range or a scan
 // range prepared by the disk threads, the caller waits on the disk threads.
@@ -553,7 +761,7 @@ Status DiskIoMgr::GetNextRange(RequestContext* reader, ScanRange** range) {
   *range = NULL;
   Status status = Status::OK();
 
-  unique_lock<mutex> reader_lock(reader->lock_);
+  ProfiledLock<mutex> reader_lock(reader->lock_, &RequestContext::lock_site_);
   DCHECK(reader->Validate()) << endl << reader->DebugString();
 
   while (true) {
@@ -572,7 +780,7 @@ Status DiskIoMgr::GetNextRange(RequestContext* reader, ScanRange** range) {
     if (!reader->cached_ranges_.empty()) {
       // We have a cached range.
       *range = reader->cached_ranges_.Dequeue();
-      DCHECK((*range)->try_cache_);
+      DCHECK((*range)->try_cache_ || (*range)->try_mmap_);
       bool cached_read_succeeded;
       RETURN_IF_ERROR((*range)->ReadFromCache(&cached_read_succeeded));
       if (cached_read_succeeded) return Status::OK();
@@ -601,6 +809,39 @@ Status DiskIoMgr::GetNextRange(RequestContext* reader, ScanRange** range) {
   return status;
 }
 
+void DiskIoMgr::RemoveUnstartedRanges(RequestContext* reader,
+    const boost::function<bool (ScanRange*)>& should_remove,
+    vector<ScanRange*>* removed) {
+  DCHECK(reader != NULL);
+  ProfiledLock<mutex> reader_lock(reader->lock_, &RequestContext::lock_site_);
+  DCHECK(reader->Validate()) << endl << reader->DebugString();
+  if (reader->state_ == RequestContext::Cancelled) return;
+
+  int num_removed = 0;
+  for (int i = 0; i < reader->disk_states_.size(); ++i) {
+    RequestContext::PerDiskState& state = reader->disk_states_[i];
+    InternalQueue<ScanRange>* unstarted_ranges = state.unstarted_scan_ranges();
+    // Rotate through the queue once, re-enqueuing the ranges to keep in order.
+    int num_ranges = unstarted_ranges->size();
+    for (int j = 0; j < num_ranges; ++j) {
+      ScanRange* range = unstarted_ranges->Dequeue();
+      if (!should_remove(range)) {
+        unstarted_ranges->Enqueue(range);
+        continue;
+      }
+      --state.num_remaining_ranges();
+      --reader->num_unstarted_scan_ranges_;
+      removed->push_back(range);
+      ++num_removed;
+    }
+  }
+  // Wake up the callers of GetNextRange() that are waiting for ranges that won't come.
+  if (num_removed > 0 && reader->num_unstarted_scan_ranges_ == 0) {
+    reader->ready_to_start_ranges_cv_.notify_all();
+  }
+  DCHECK(reader->Validate()) << endl << reader->DebugString();
+}
+
 Status DiskIoMgr::Read(RequestContext* reader,
     ScanRange* range, BufferDescriptor** buffer) {
   DCHECK(range != NULL);
@@ -627,8 +868,8 @@ void DiskIoMgr::ReturnBuffer(BufferDescriptor* buffer_desc) {
 
   RequestContext* reader = buffer_desc->reader_;
   if (buffer_desc->buffer_ != NULL) {
-    if (buffer_desc->scan_range_->cached_buffer_ == NULL) {
-      // Not a cached buffer. Return the io buffer and update mem tracking.
+    if (!buffer_desc->scan_range_->has_zero_copy_buffer()) {
+      // Not a cached or mapped buffer. Return the io buffer and update mem tracking.
       ReturnFreeBuffer(buffer_desc);
     }
     buffer_desc->buffer_ = NULL;
@@ -677,63 +918,27 @@ char* DiskIoMgr::GetFreeBuffer(int64_t* buffer_size) {
   DCHECK_LE(*buffer_size, max_buffer_size_);
   DCHECK_GT(*buffer_size, 0);
   *buffer_size = min(static_cast<int64_t>(max_buffer_size_), *buffer_size);
-  int idx = free_buffers_idx(*buffer_size);
   // Quantize buffer size to nearest power of 2 greater than the specified buffer size and
   // convert to bytes
-  *buffer_size = (1 << idx) * min_buffer_size_;
+  *buffer_size = buffer_pool_->BufferSize(*buffer_size);
 
-  unique_lock<mutex> lock(free_buffers_lock_);
-  char* buffer = NULL;
-  if (free_buffers_[idx].empty()) {
-    ++num_allocated_buffers_;
-    if (ImpaladMetrics::IO_MGR_NUM_BUFFERS != NULL) {
-      ImpaladMetrics::IO_MGR_NUM_BUFFERS->Increment(1L);
-    }
-    if (ImpaladMetrics::IO_MGR_TOTAL_BYTES != NULL) {
-      ImpaladMetrics::IO_MGR_TOTAL_BYTES->Increment(*buffer_size);
-    }
-    // Update the process mem usage.  This is checked the next time we start
-    // a read for the next reader (DiskIoMgr::GetNextScanRange)
-    process_mem_tracker_->Consume(*buffer_size);
-    buffer = new char[*buffer_size];
-  } else {
-    if (ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS != NULL) {
-      ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS->Increment(-1L);
-    }
-    buffer = free_buffers_[idx].front();
-    free_buffers_[idx].pop_front();
+  ++num_allocated_buffers_;
+  if (ImpaladMetrics::IO_MGR_NUM_BUFFERS != NULL) {
+    ImpaladMetrics::IO_MGR_NUM_BUFFERS->Increment(1L);
+  }
+  if (ImpaladMetrics::IO_MGR_TOTAL_BYTES != NULL) {
+    ImpaladMetrics::IO_MGR_TOTAL_BYTES->Increment(*buffer_size);
   }
+  // Update the process mem usage.  This is checked the next time we start
+  // a read for the next reader (DiskIoMgr::GetNextScanRange)
+  process_mem_tracker_->Consume(*buffer_size);
+  char* buffer = reinterpret_cast<char*>(buffer_pool_->Allocate(*buffer_size));
   DCHECK(buffer != NULL);
   return buffer;
 }
 
 void DiskIoMgr::GcIoBuffers() {
-  unique_lock<mutex> lock(free_buffers_lock_);
-  int buffers_freed = 0;
-  int bytes_freed = 0;
-  for (int idx = 0; idx < free_buffers_.size(); ++idx) {
-    for (list<char*>::iterator iter = free_buffers_[idx].begin();
-         iter != free_buffers_[idx].end(); ++iter) {
-      int64_t buffer_size = (1 << idx) * min_buffer_size_;
-      process_mem_tracker_->Release(buffer_size);
-      --num_allocated_buffers_;
-      delete[] *iter;
-
-      ++buffers_freed;
-      bytes_freed += buffer_size;
-    }
-    free_buffers_[idx].clear();
-  }
-
-  if (ImpaladMetrics::IO_MGR_NUM_BUFFERS != NULL) {
-    ImpaladMetrics::IO_MGR_NUM_BUFFERS->Increment(-buffers_freed);
-  }
-  if (ImpaladMetrics::IO_MGR_TOTAL_BYTES != NULL) {
-    ImpaladMetrics::IO_MGR_TOTAL_BYTES->Increment(-bytes_freed);
-  }
-  if (ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS != NULL) {
-    ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS->set_value(0);
-  }
+  buffer_pool_->FreeCachedBuffers();
 }
 
 void DiskIoMgr::ReturnFreeBuffer(BufferDescriptor* desc) {
@@ -744,27 +949,18 @@ void DiskIoMgr::ReturnFreeBuffer(BufferDescriptor* desc) {
 
 void DiskIoMgr::ReturnFreeBuffer(char* buffer, int64_t buffer_size) {
   DCHECK(buffer != NULL);
-  int idx = free_buffers_idx(buffer_size);
-  DCHECK_EQ(BitUtil::Ceil(buffer_size, min_buffer_size_) & ~(1 << idx), 0)
+  DCHECK_EQ(buffer_pool_->BufferSize(buffer_size), buffer_size)
       << "buffer_size_ / min_buffer_size_ should be power of 2, got buffer_size = "
       << buffer_size << ", min_buffer_size_ = " << min_buffer_size_;
-  unique_lock<mutex> lock(free_buffers_lock_);
-  if (!FLAGS_disable_mem_pools && free_buffers_[idx].size() < FLAGS_max_free_io_buffers) {
-    free_buffers_[idx].push_back(buffer);
-    if (ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS != NULL) {
-      ImpaladMetrics::IO_MGR_NUM_UNUSED_BUFFERS->Increment(1L);
-    }
-  } else {
-    process_mem_tracker_->Release(buffer_size);
-    --num_allocated_buffers_;
-    delete[] buffer;
-    if (ImpaladMetrics::IO_MGR_NUM_BUFFERS != NULL) {
-      ImpaladMetrics::IO_MGR_NUM_BUFFERS->Increment(-1L);
-    }
-    if (ImpaladMetrics::IO_MGR_TOTAL_BYTES != NULL) {
-      ImpaladMetrics::IO_MGR_TOTAL_BYTES->Increment(-buffer_size);
-    }
+  process_mem_tracker_->Release(buffer_size);
+  --num_allocated_buffers_;
+  if (ImpaladMetrics::IO_MGR_NUM_BUFFERS != NULL) {
+    ImpaladMetrics::IO_MGR_NUM_BUFFERS->Increment(-1L);
   }
+  if (ImpaladMetrics::IO_MGR_TOTAL_BYTES != NULL) {
+    ImpaladMetrics::IO_MGR_TOTAL_BYTES->Increment(-buffer_size);
+  }
+  buffer_pool_->Free(reinterpret_cast<uint8_t*>(buffer), buffer_size);
 }
 
 // This function gets the next RequestRange to work on for this disk. It checks for
@@ -776,8 +972,8 @@ void DiskIoMgr::ReturnFreeBuffer(char* buffer, int64_t buffer_size) {
 // Work is available if there is a RequestContext with
 //  - A ScanRange with a buffer available, or
 //  - A WriteRange in unstarted_write_ranges_.
-bool DiskIoMgr::GetNextRequestRange(DiskQueue* disk_queue, RequestRange** range,
-    RequestContext** request_context) {
+bool DiskIoMgr::GetNextRequestRange(DiskQueue* disk_queue, int thread_idx,
+    RequestRange** range, RequestContext** request_context) {
   int disk_id = disk_queue->disk_id;
   *range = NULL;
 
@@ -786,10 +982,11 @@ bool DiskIoMgr::GetNextRequestRange(DiskQueue* disk_queue, RequestRange** range,
     *request_context = NULL;
     RequestContext::PerDiskState* request_disk_state = NULL;
     {
-      unique_lock<mutex> disk_lock(disk_queue->lock);
+      ProfiledLock<mutex> disk_lock(disk_queue->lock, &DiskQueue::lock_site);
 
-      while (!shut_down_ && disk_queue->request_contexts.empty()) {
-        // wait if there are no readers on the queue
+      while (!shut_down_ && (disk_queue->request_contexts.empty() ||
+          thread_idx >= disk_queue->num_active_threads)) {
+        // wait if there are no readers on the queue or this thread is not active
         disk_queue->work_available.wait(disk_lock);
       }
       if (shut_down_) break;
@@ -799,12 +996,28 @@ bool DiskIoMgr::GetNextRequestRange(DiskQueue* disk_queue, RequestRange** range,
       // can't pick it up.  It will be enqueued before issuing the read to HDFS
       // so this is not a big deal (i.e. multiple disk threads can read for the
       // same reader).
+      // The next reader is the one with the lowest virtual time, i.e. the one that is
+      // furthest behind its share. Ties go to the reader that was queued first, so this
+      // is round-robin if all readers have the same weight.
       // TODO: revisit.
-      *request_context = disk_queue->request_contexts.front();
-      disk_queue->request_contexts.pop_front();
+      list<RequestContext*>::iterator next_it = disk_queue->request_contexts.begin();
+      int64_t next_vtime = (*next_it)->disk_states_[disk_id].queue_vtime();
+      for (list<RequestContext*>::iterator it = ++disk_queue->request_contexts.begin();
+           it != disk_queue->request_contexts.end(); ++it) {
+        int64_t vtime = (*it)->disk_states_[disk_id].queue_vtime();
+        if (vtime < next_vtime) {
+          next_it = it;
+          next_vtime = vtime;
+        }
+      }
+      *request_context = *next_it;
+      disk_queue->request_contexts.erase(next_it);
       DCHECK(*request_context != NULL);
       request_disk_state = &((*request_context)->disk_states_[disk_id]);
       request_disk_state->IncrementRequestThreadAndDequeue();
+      disk_queue->virtual_time = next_vtime;
+      request_disk_state->set_queue_vtime(
+          next_vtime + VIRTUAL_TIME_PER_TURN / (*request_context)->io_weight_);
     }
 
     // NOTE: no locks were taken in between.  We need to be careful about what state
@@ -824,7 +1037,8 @@ bool DiskIoMgr::GetNextRequestRange(DiskQueue* disk_queue, RequestRange** range,
       (*request_context)->Cancel(Status::MemLimitExceeded());
     }
 
-    unique_lock<mutex> request_lock((*request_context)->lock_);
+    ProfiledLock<mutex> request_lock((*request_context)->lock_,
+        &RequestContext::lock_site_);
     VLOG_FILE << "Disk (id=" << disk_id << ") reading for "
         << (*request_context)->DebugString();
 
@@ -900,7 +1114,7 @@ void DiskIoMgr::HandleWriteFinished(RequestContext* writer, WriteRange* write_ra
   // The status of the write does not affect the status of the writer context.
   write_range->callback_(write_status);
   {
-    unique_lock<mutex> writer_lock(writer->lock_);
+    ProfiledLock<mutex> writer_lock(writer->lock_, &RequestContext::lock_site_);
     DCHECK(writer->Validate()) << endl << writer->DebugString();
     RequestContext::PerDiskState& state = writer->disk_states_[write_range->disk_id_];
     if (writer->state_ == RequestContext::Cancelled) {
@@ -914,7 +1128,7 @@ void DiskIoMgr::HandleWriteFinished(RequestContext* writer, WriteRange* write_ra
 
 void DiskIoMgr::HandleReadFinished(DiskQueue* disk_queue, RequestContext* reader,
     BufferDescriptor* buffer) {
-  unique_lock<mutex> reader_lock(reader->lock_);
+  ProfiledLock<mutex> reader_lock(reader->lock_, &RequestContext::lock_site_);
 
   RequestContext::PerDiskState& state = reader->disk_states_[disk_queue->disk_id];
   DCHECK(reader->Validate()) << endl << reader->DebugString();
@@ -957,7 +1171,7 @@ void DiskIoMgr::HandleReadFinished(DiskQueue* disk_queue, RequestContext* reader
   if (eosr) {
     // For cached buffers, we can't close the range until the cached buffer is returned.
     // Close() is called from DiskIoMgr::ReturnBuffer().
-    if (scan_range->cached_buffer_ == NULL) scan_range->Close();
+    if (!scan_range->has_zero_copy_buffer()) scan_range->Close();
   } else {
     if (queue_full) {
       reader->blocked_ranges_.Enqueue(scan_range);
@@ -968,7 +1182,7 @@ void DiskIoMgr::HandleReadFinished(DiskQueue* disk_queue, RequestContext* reader
   state.DecrementRequestThread();
 }
 
-void DiskIoMgr::WorkLoop(DiskQueue* disk_queue) {
+void DiskIoMgr::WorkLoop(DiskQueue* disk_queue, int thread_idx) {
   // The thread waits until there is work or the entire system is being shut down.
   // If there is work, performs the read or write requested and re-enqueues the
   // requesting context.
@@ -984,26 +1198,115 @@ void DiskIoMgr::WorkLoop(DiskQueue* disk_queue) {
     RequestContext* worker_context = NULL;;
     RequestRange* range = NULL;
 
-    if (!GetNextRequestRange(disk_queue, &range, &worker_context)) {
+    if (!GetNextRequestRange(disk_queue, thread_idx, &range, &worker_context)) {
       DCHECK(shut_down_);
       break;
     }
 
+    MonotonicStopWatch busy_timer;
+    busy_timer.Start();
     if (range->request_type() == RequestType::READ) {
       ReadRange(disk_queue, worker_context, static_cast<ScanRange*>(range));
     } else {
       DCHECK(range->request_type() == RequestType::WRITE);
       Write(worker_context, static_cast<WriteRange*>(range));
     }
+    disk_queue->busy_time_ns.Add(busy_timer.ElapsedTime());
   }
 
   DCHECK(shut_down_);
 }
 
+void DiskIoMgr::TunerLoop() {
+  MonotonicStopWatch interval_timer;
+  interval_timer.Start();
+  unique_lock<mutex> l(tuner_lock_);
+  while (!shut_down_) {
+    // timed_wait() may return early, the elapsed time is measured instead.
+    tuner_cv_.timed_wait(l, get_system_time() +
+        posix_time::milliseconds(FLAGS_disk_io_thread_tuning_interval_ms));
+    if (shut_down_) break;
+    int64_t elapsed_ns = interval_timer.Reset();
+    for (int i = 0; i < disk_queues_.size(); ++i) {
+      TuneDiskQueue(disk_queues_[i], elapsed_ns);
+    }
+  }
+}
+
+void DiskIoMgr::TuneDiskQueue(DiskQueue* disk_queue, int64_t elapsed_ns) {
+  int64_t bytes_processed = disk_queue->bytes_processed.Swap(0);
+  int64_t busy_time_ns = disk_queue->busy_time_ns.Swap(0);
+  if (disk_queue->num_threads <= 1 || elapsed_ns <= 0) return;
+
+  int num_active_threads;
+  {
+    ProfiledLock<mutex> disk_lock(disk_queue->lock, &DiskQueue::lock_site);
+    num_active_threads = disk_queue->num_active_threads;
+  }
+  double avg_busy_threads = static_cast<double>(busy_time_ns) / elapsed_ns;
+  if (bytes_processed == 0 ||
+      avg_busy_threads < num_active_threads * TUNING_SATURATION_RATIO) {
+    // The threads were waiting for work, so their number didn't limit the throughput
+    // and this interval says nothing about the best number of threads.
+    disk_queue->last_step = 0;
+    disk_queue->last_throughput = 0;
+    return;
+  }
+
+  double throughput = bytes_processed * 1000000000.0 / elapsed_ns;
+  int step = disk_queue->default_step;
+  if (disk_queue->last_step != 0 && disk_queue->last_throughput > 0) {
+    // Repeat the last step if it helped, undo it if it hurt.
+    double change = throughput / disk_queue->last_throughput - 1;
+    if (change > TUNING_THROUGHPUT_TOLERANCE) {
+      step = disk_queue->last_step;
+    } else if (change < -TUNING_THROUGHPUT_TOLERANCE) {
+      step = -disk_queue->last_step;
+    }
+  }
+  int new_num_active_threads =
+      max(1, min(disk_queue->num_threads, num_active_threads + step));
+  disk_queue->last_step = new_num_active_threads - num_active_threads;
+  disk_queue->last_throughput = throughput;
+  if (new_num_active_threads == num_active_threads) return;
+
+  VLOG_FILE << "Disk (id=" << disk_queue->disk_id << ") active threads: "
+      << num_active_threads << " -> " << new_num_active_threads << " (throughput="
+      << PrettyPrinter::Print(static_cast<int64_t>(throughput), TUnit::BYTES_PER_SECOND)
+      << ")";
+  {
+    ProfiledLock<mutex> disk_lock(disk_queue->lock, &DiskQueue::lock_site);
+    disk_queue->num_active_threads = new_num_active_threads;
+  }
+  // Wake up the threads that were just activated.
+  if (new_num_active_threads > num_active_threads) {
+    disk_queue->work_available.notify_all();
+  }
+}
+
 // This function reads the specified scan range associated with the
 // specified reader context and disk queue.
+void DiskIoMgr::UpdateReadLatency(DiskQueue* disk_queue, int64_t latency_ns) {
+  if (read_latency_metrics_.empty()) return;
+  read_latency_metrics_[disk_queue->disk_id]->Update(latency_ns);
+}
+
 void DiskIoMgr::ReadRange(DiskQueue* disk_queue, RequestContext* reader,
     ScanRange* range) {
+  if (queue_wait_time_metric_ != NULL && range->schedule_time_ns_ != 0) {
+    queue_wait_time_metric_->Update(MonotonicNanos() - range->schedule_time_ns_);
+  }
+  vector<ScanRange*> coalesced_ranges;
+  {
+    unique_lock<mutex> scan_range_lock(range->lock_);
+    // If the range was cancelled, Cancel() has taken care of the coalesced ranges.
+    if (!range->is_cancelled_) coalesced_ranges.swap(range->coalesced_ranges_);
+  }
+  if (!coalesced_ranges.empty()) {
+    ReadCoalescedRanges(disk_queue, reader, range, coalesced_ranges);
+    return;
+  }
+
   char* buffer = NULL;
   int64_t bytes_remaining = range->len_ - range->bytes_read_;
   DCHECK_GT(bytes_remaining, 0);
@@ -1020,7 +1323,7 @@ void DiskIoMgr::ReadRange(DiskQueue* disk_queue, RequestContext* reader,
 
   if (!enough_memory) {
     RequestContext::PerDiskState& state = reader->disk_states_[disk_queue->disk_id];
-    unique_lock<mutex> reader_lock(reader->lock_);
+    ProfiledLock<mutex> reader_lock(reader->lock_, &RequestContext::lock_site_);
 
     // Just grabbed the reader lock, check for cancellation.
     if (reader->state_ == RequestContext::Cancelled) {
@@ -1072,7 +1375,9 @@ void DiskIoMgr::ReadRange(DiskQueue* disk_queue, RequestContext* reader,
     SCOPED_TIMER(&read_timer_);
     SCOPED_TIMER(reader->read_timer_);
 
+    int64_t read_start_ns = MonotonicNanos();
     buffer_desc->status_ = range->Read(buffer, &buffer_desc->len_, &buffer_desc->eosr_);
+    UpdateReadLatency(disk_queue, MonotonicNanos() - read_start_ns);
     buffer_desc->scan_range_offset_ = range->bytes_read_ - buffer_desc->len_;
 
     if (reader->bytes_read_counter_ != NULL) {
@@ -1080,6 +1385,7 @@ void DiskIoMgr::ReadRange(DiskQueue* disk_queue, RequestContext* reader,
     }
 
     COUNTER_ADD(&total_bytes_read_counter_, buffer_desc->len_);
+    disk_queue->bytes_processed.Add(buffer_desc->len_);
     if (reader->active_read_thread_counter_) {
       reader->active_read_thread_counter_->Add(-1L);
     }
@@ -1089,6 +1395,87 @@ void DiskIoMgr::ReadRange(DiskQueue* disk_queue, RequestContext* reader,
   HandleReadFinished(disk_queue, reader, buffer_desc);
 }
 
+void DiskIoMgr::ReadCoalescedRanges(DiskQueue* disk_queue, RequestContext* reader,
+    ScanRange* range, const vector<ScanRange*>& coalesced_ranges) {
+  DCHECK_EQ(range->bytes_read_, 0);
+  const ScanRange* last_range = coalesced_ranges.back();
+  int64_t read_len = last_range->offset_ + last_range->len_ - range->offset_;
+  int64_t read_buffer_size = read_len;
+  char* read_buffer = GetFreeBuffer(&read_buffer_size);
+  int64_t bytes_read = 0;
+
+  // No locks in this section, as in ReadRange().
+  Status status = range->Open();
+  if (status.ok()) {
+    if (reader->active_read_thread_counter_) {
+      reader->active_read_thread_counter_->Add(1L);
+    }
+    if (reader->disks_accessed_bitmap_) {
+      int64_t disk_bit = 1 << disk_queue->disk_id;
+      reader->disks_accessed_bitmap_->BitOr(disk_bit);
+    }
+    {
+      SCOPED_TIMER(&read_timer_);
+      SCOPED_TIMER(reader->read_timer_);
+      int64_t read_start_ns = MonotonicNanos();
+      status = range->ReadCoalesced(read_buffer, read_len, &bytes_read);
+      UpdateReadLatency(disk_queue, MonotonicNanos() - read_start_ns);
+    }
+    if (reader->bytes_read_counter_ != NULL) {
+      COUNTER_ADD(reader->bytes_read_counter_, bytes_read);
+    }
+    COUNTER_ADD(&total_bytes_read_counter_, bytes_read);
+    disk_queue->bytes_processed.Add(bytes_read);
+    if (reader->active_read_thread_counter_) {
+      reader->active_read_thread_counter_->Add(-1L);
+    }
+  }
+
+  BufferDescriptor* range_buffer =
+      GetCoalescedBuffer(reader, range, range, read_buffer, bytes_read, status);
+  {
+    ProfiledLock<mutex> reader_lock(reader->lock_, &RequestContext::lock_site_);
+    for (int i = 0; i < coalesced_ranges.size(); ++i) {
+      // The coalesced ranges are not on any disk queue so cancellation of the reader
+      // does not reach them.
+      ScanRange* coalesced_range = coalesced_ranges[i];
+      if (reader->state_ == RequestContext::Cancelled) {
+        coalesced_range->Cancel(reader->status_);
+      } else if (!status.ok()) {
+        coalesced_range->Cancel(status);
+      } else {
+        ++reader->num_used_buffers_;
+        coalesced_range->EnqueueBuffer(GetCoalescedBuffer(
+            reader, range, coalesced_range, read_buffer, bytes_read, status));
+      }
+    }
+    ++reader->num_used_buffers_;
+  }
+  ReturnFreeBuffer(read_buffer, read_buffer_size);
+
+  // Finished read, update reader/disk based on the results
+  HandleReadFinished(disk_queue, reader, range_buffer);
+}
+
+DiskIoMgr::BufferDescriptor* DiskIoMgr::GetCoalescedBuffer(RequestContext* reader,
+    ScanRange* first_range, ScanRange* range, const char* read_buffer,
+    int64_t bytes_read, const Status& read_status) {
+  int64_t buffer_size = range->len_;
+  char* buffer = GetFreeBuffer(&buffer_size);
+  BufferDescriptor* desc = GetBufferDesc(reader, range, buffer, buffer_size);
+  desc->status_ = read_status;
+  if (read_status.ok()) {
+    // Ranges that start past the end of the file get an empty buffer.
+    int64_t range_start = range->offset_ - first_range->offset_;
+    desc->len_ = max<int64_t>(0, min(range->len_, bytes_read - range_start));
+    memcpy(buffer, read_buffer + range_start, desc->len_);
+  }
+  desc->scan_range_offset_ = 0;
+  desc->eosr_ = true;
+  range->bytes_read_ = desc->len_;
+  return desc;
+}
+
 void DiskIoMgr::Write(RequestContext* writer_context, WriteRange* write_range) {
   FILE* file_handle = fopen(write_range->file(), "rb+");
   Status ret_status;
@@ -1106,6 +1493,9 @@ void DiskIoMgr::Write(RequestContext* writer_context, WriteRange* write_range) {
     }
   }
 
+  if (ret_status.ok()) {
+    disk_queues_[write_range->disk_id()]->bytes_processed.Add(write_range->len());
+  }
   HandleWriteFinished(writer_context, write_range, ret_status);
 }
 
@@ -1131,17 +1521,9 @@ Status DiskIoMgr::WriteRangeHelper(FILE* file_handle, WriteRange* write_range) {
   return Status::OK();
 }
 
-int DiskIoMgr::free_buffers_idx(int64_t buffer_size) {
-  int64_t buffer_size_scaled = BitUtil::Ceil(buffer_size, min_buffer_size_);
-  int idx = BitUtil::Log2(buffer_size_scaled);
-  DCHECK_GE(idx, 0);
-  DCHECK_LT(idx, free_buffers_.size());
-  return idx;
-}
-
 Status DiskIoMgr::AddWriteRange(RequestContext* writer, WriteRange* write_range) {
   DCHECK_LE(write_range->len(), max_buffer_size_);
-  unique_lock<mutex> writer_lock(writer->lock_);
+  ProfiledLock<mutex> writer_lock(writer->lock_, &RequestContext::lock_site_);
 
   if (writer->state_ == RequestContext::Cancelled) {
     DCHECK(!writer->status_.ok());
@@ -1171,58 +1553,18 @@ int DiskIoMgr::AssignQueue(const char* file, int disk_id, bool expected_local) {
 }
 
 DiskIoMgr::HdfsCachedFileHandle* DiskIoMgr::OpenHdfsFile(const hdfsFS& fs,
-    const char* fname, int64_t mtime) {
-  HdfsCachedFileHandle* fh = NULL;
-
-  // Check if a cached file handle exists and validate the mtime, if the mtime of the
-  // cached handle is not matching the mtime of the requested file, reopen.
-  if (detail::is_file_handle_caching_enabled() && file_handle_cache_.Pop(fname, &fh)) {
-    ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES->Increment(-1L);
-    if (fh->mtime() == mtime) {
-      ImpaladMetrics::IO_MGR_CACHED_FILE_HANDLES_HIT_RATIO->Update(1L);
-      ImpaladMetrics::IO_MGR_CACHED_FILE_HANDLES_HIT_COUNT->Increment(1L);
-      ImpaladMetrics::IO_MGR_NUM_FILE_HANDLES_OUTSTANDING->Increment(1L);
-      return fh;
-    }
-    VLOG_FILE << "mtime mismatch, closing cached file handle. Closing file=" << fname;
-    delete fh;
-  }
-
-  // Update cache hit ratio
-  ImpaladMetrics::IO_MGR_CACHED_FILE_HANDLES_HIT_RATIO->Update(0L);
-  ImpaladMetrics::IO_MGR_CACHED_FILE_HANDLES_MISS_COUNT->Increment(1L);
-  fh = new HdfsCachedFileHandle(fs, fname, mtime);
-
-  // Check if the file handle was opened correctly
-  if (!fh->ok())  {
+    const char* fname, int64_t mtime, bool exclusive) {
+  HdfsCachedFileHandle* fh = file_handle_cache_.GetHandle(fs, fname, mtime, exclusive);
+  if (fh == NULL) {
     VLOG_FILE << "Opening the file " << fname << " failed.";
-    delete fh;
     return NULL;
   }
-
   ImpaladMetrics::IO_MGR_NUM_FILE_HANDLES_OUTSTANDING->Increment(1L);
   return fh;
 }
 
-void DiskIoMgr::CacheOrCloseFileHandle(const char* fname,
-    DiskIoMgr::HdfsCachedFileHandle* fid, bool close) {
+void DiskIoMgr::CacheOrCloseFileHandle(DiskIoMgr::HdfsCachedFileHandle* fid, bool close,
+    struct hdfsReadStatistics** stats) {
   ImpaladMetrics::IO_MGR_NUM_FILE_HANDLES_OUTSTANDING->Increment(-1L);
-  // Try to unbuffer the handle, on filesystems that do not support this call a non-zero
-  // return code indicates that the operation was not successful and thus the file is
-  // closed.
-  if (detail::is_file_handle_caching_enabled() &&
-      !close && hdfsUnbufferFile(fid->file()) == 0) {
-    // Clear read statistics before returning
-    hdfsFileClearReadStatistics(fid->file());
-    file_handle_cache_.Put(fname, fid);
-    ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES->Increment(1L);
-  } else {
-    if (close) {
-      VLOG_FILE << "Closing file=" << fname;
-    } else {
-      VLOG_FILE << "FS does not support file handle unbuffering, closing file="
-                << fname;
-    }
-    delete fid;
-  }
+  file_handle_cache_.ReleaseHandle(fid, close, stats);
 }
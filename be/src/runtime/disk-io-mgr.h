@@ -19,7 +19,9 @@
 #include <list>
 #include <vector>
 
+#include <boost/function.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/unordered_set.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
@@ -33,13 +35,16 @@
 #include "util/bit-util.h"
 #include "util/error-util.h"
 #include "util/internal-queue.h"
-#include "util/lru-cache.h"
 #include "util/runtime-profile.h"
 #include "util/thread.h"
 
 namespace impala {
 
+class BufferPool;
+class DataCache;
+class HistogramMetric;
 class MemTracker;
+class MetricGroup;
 
 /// Manager object that schedules IO for all queries on all disks and remote filesystems
 /// (such as S3). Each query maps to one or more RequestContext objects, each of which
@@ -165,6 +170,16 @@ class MemTracker;
 /// is returned (HDFS does not allow this). We therefore need to defer the close until
 /// the cached buffer is returned (BufferDescriptor::Return()).
 //
+/// Coalesced reads:
+/// Ranges that are scheduled immediately are often small and close together in the same
+/// file (e.g. the column chunks of a Parquet row group). AddScanRanges() groups such
+/// ranges, if their combined span including the gaps between them is within
+/// FLAGS_max_coalesced_read_size and each gap is within FLAGS_max_coalesced_read_gap,
+/// and only schedules the first range of each group. The disk thread reads the whole
+/// span at once and copies each range's bytes into a buffer of its own, so readers see
+/// no difference. This saves a seek and a round trip per range, which dominates for
+/// small reads from spinning disks and remote filesystems.
+//
 /// Remote filesystem support (e.g. S3):
 /// Remote filesystems are modeled as "remote disks". That is, there is a seperate disk
 /// queue for each supported remote filesystem type. In order to maximize throughput,
@@ -173,6 +188,30 @@ class MemTracker;
 /// intensive than local disk/hdfs because of non-direct I/O and SSL processing, and can
 /// be CPU bottlenecked especially if not enough I/O threads for these queues are
 /// started.
+/// If FLAGS_data_cache_dir is set, reads for the remote disks are looked up in a local
+/// DataCache first and the data of reads that missed is added to it.
+//
+/// Fair sharing:
+/// Each disk queue serves the contexts that have work for it in proportion to their
+/// weights. A context's weight comes from its query's admission pool (see
+/// FLAGS_disk_io_pool_weights and GetPoolIoWeight()) and defaults to 1. Every queued
+/// context has a virtual time on each disk; the disk threads pick the context with the
+/// lowest one and advance it by a fixed amount divided by the context's weight. A context
+/// that joins a queue starts at the queue's current virtual time, so it neither starves
+/// the others nor is starved by them. With equal weights this is the original
+/// round-robin. This lets small interactive queries get their ranges read quickly while
+/// a large scan keeps the disks busy.
+//
+/// Adaptive disk thread counts:
+/// The thread counts above are starting points. Each disk queue starts up to
+/// FLAGS_disk_io_thread_tuning_max_factor times as many threads, but only lets the
+/// first 'num_active_threads' of them process ranges. Every
+/// FLAGS_disk_io_thread_tuning_interval_ms, a tuner thread compares the throughput of
+/// each queue whose active threads were (nearly) all busy with the throughput of the
+/// previous interval and climbs towards the concurrency that maximises it: a change that
+/// helped is repeated, one that hurt is undone. When throughput doesn't change, remote
+/// queues add a thread (they are latency bound, so more requests in flight are cheap)
+/// and rotational disks drop one (fewer threads mean fewer seeks).
 //
 /// TODO: IoMgr should be able to request additional scan ranges from the coordinator
 /// to help deal with stragglers.
@@ -188,15 +227,17 @@ class MemTracker;
 ///  - RequestContext APIs are implemented in disk-io-mgr-reader-context.cc
 ///    This contains the logic for picking scan ranges for a reader.
 ///  - Disk Thread and general APIs are implemented in disk-io-mgr.cc.
+///  - The FileHandleCache is implemented in disk-io-mgr-handle-cache.cc.
 class DiskIoMgr {
  public:
+  class FileHandleCache;
   class RequestContext;
   class ScanRange;
 
   /// This class is a small wrapper around the hdfsFile handle and the file system
   /// instance which is needed to close the file handle in case of eviction. It
   /// additionally encapsulates the last modified time of the associated file when it was
-  /// last opened.
+  /// last opened, and the state of the handle in the FileHandleCache.
   class HdfsCachedFileHandle {
    public:
 
@@ -210,16 +251,87 @@ class DiskIoMgr {
 
     int64_t mtime() const { return mtime_; }
 
-    /// This method is called to release acquired resources by the cached handle when it
-    /// is evicted.
-    static void Release(HdfsCachedFileHandle** h);
-
     bool ok() const { return hdfs_file_ != NULL; }
 
    private:
+    friend class FileHandleCache;
+
     hdfsFS fs_;
     hdfsFile hdfs_file_;
     int64_t mtime_;
+
+    /// The fields below are owned by the FileHandleCache and protected by the lock of
+    /// its shard.
+    std::string fname_;
+
+    /// Number of scan ranges using the handle. 0 if it is idle in the cache.
+    int ref_count_;
+
+    /// True if the handle is used by a scan range that depends on the file position,
+    /// so it can't be shared. Only valid if ref_count_ > 0.
+    bool exclusive_;
+
+    /// Position in the LRU list of its shard if the handle is idle.
+    std::list<HdfsCachedFileHandle*>::iterator lru_pos_;
+  };
+
+  /// Cache of the HDFS file handles of all the queries, so that ranges of recently read
+  /// files can be read without going to the NameNode to open them again. It is split
+  /// in NUM_SHARDS shards by file name, each with its own lock and LRU list of idle
+  /// handles. A handle can be shared by any number of concurrent scan ranges that read
+  /// with hdfsPread(), since those don't use the position of the file; ranges that do
+  /// use it (HDFS cached reads and filesystems other than HDFS) get a handle of their
+  /// own. Idle handles are unbuffered, and the least recently used ones are closed
+  /// once there are more than --max_cached_file_handles.
+  ///
+  /// This class is thread-safe.
+  class FileHandleCache {
+   public:
+    FileHandleCache(size_t capacity);
+
+    /// Closes all the idle handles. All the handles must have been released.
+    ~FileHandleCache();
+
+    /// Returns a handle of 'fname' whose mtime is 'mtime', either a cached one, or a new
+    /// one if there is none (or only ones in exclusive use). If 'exclusive' is true, the
+    /// handle is not handed out to anyone else until it's released. Returns NULL if the
+    /// file could not be opened.
+    HdfsCachedFileHandle* GetHandle(const hdfsFS& fs, const char* fname, int64_t mtime,
+        bool exclusive);
+
+    /// Releases a handle returned by GetHandle(). Once nobody uses the handle any more,
+    /// it is unbuffered and kept idle in the cache, unless 'close' is true or the
+    /// filesystem doesn't support unbuffering, in which case it is closed. If 'stats'
+    /// is not NULL and the handle is no longer used, it is set to the read statistics
+    /// of the handle since it was last idle, which the caller must free. Otherwise it
+    /// is set to NULL.
+    void ReleaseHandle(HdfsCachedFileHandle* handle, bool close,
+        struct hdfsReadStatistics** stats);
+
+   private:
+    static const int NUM_SHARDS = 16;
+
+    struct Shard {
+      /// Protects the fields below.
+      boost::mutex lock;
+
+      /// All the open handles of the shard, in use or idle, by file name.
+      boost::unordered_multimap<std::string, HdfsCachedFileHandle*> handles;
+
+      /// Idle handles, from the least to the most recently used.
+      std::list<HdfsCachedFileHandle*> lru;
+    };
+
+    Shard* GetShard(const char* fname);
+
+    /// Removes 'handle' from 'shard' and returns it. The caller must hold the lock of
+    /// the shard and close the handle.
+    HdfsCachedFileHandle* RemoveLocked(Shard* shard, HdfsCachedFileHandle* handle);
+
+    /// Maximum number of idle handles in each shard.
+    const size_t shard_capacity_;
+
+    Shard shards_[NUM_SHARDS];
   };
 
   /// Buffer struct that is used by the caller and IoMgr to pass read buffers.
@@ -367,6 +479,7 @@ class DiskIoMgr {
 
    private:
     friend class DiskIoMgr;
+    friend class RequestContext;
 
     /// Initialize internal fields
     void InitInternal(DiskIoMgr* io_mgr, RequestContext* reader);
@@ -388,6 +501,9 @@ class DiskIoMgr {
     /// Maximum length in bytes for hdfsRead() calls.
     int64_t MaxReadChunkSize() const;
 
+    /// Returns true if reads of this range go through the io mgr's data cache.
+    bool UseDataCache() const;
+
     /// Opens the file for this range. This function only modifies state in this range.
     Status Open();
 
@@ -398,12 +514,36 @@ class DiskIoMgr {
     /// of bytes read. Updates range to keep track of where in the file we are.
     Status Read(char* buffer, int64_t* bytes_read, bool* eosr);
 
-    /// Reads from the DN cache. On success, sets cached_buffer_ to the DN buffer
+    /// Reads 'len' bytes starting at the beginning of this range into 'buffer', which
+    /// may extend past the end of the range. Used to read the span of a range and its
+    /// coalesced_ranges_. Does not update bytes_read_. Returns the number of bytes read
+    /// in 'bytes_read', which is less than 'len' only if the end of the file was hit.
+    Status ReadCoalesced(char* buffer, int64_t len, int64_t* bytes_read);
+
+    /// Reads up to 'bytes_to_read' bytes at the current file position into 'buffer'.
+    /// Sets 'eof' if the end of the file was hit. hdfs_lock_ must be taken by the caller.
+    Status ReadFromFile(char* buffer, int bytes_to_read, int64_t* bytes_read, bool* eof);
+
+    /// Reads from the DN cache, or from a mapping of the file if try_mmap_ is set. On
+    /// success, sets cached_buffer_ to the DN buffer (or mapped_buffer_ to the mapping)
     /// and *read_succeeded to true.
     /// If the data is not cached, returns ok() and *read_succeeded is set to false.
     /// Returns a non-ok status if it ran into a non-continuable error.
     Status ReadFromCache(bool* read_succeeded);
 
+    /// Maps the range of the local file into memory and enqueues a single buffer that
+    /// points into the mapping, so the data is never copied into an IO buffer. Sets
+    /// *read_succeeded to false if the file could not be mapped, in which case the
+    /// range is read on the normal path.
+    Status ReadFromMmap(bool* read_succeeded);
+
+    /// True if the buffer of the range was not copied into an IO buffer, i.e. it was
+    /// read from the DN cache or mapped. Such a buffer does not count towards the
+    /// memory limits, and the range can't be closed until it is returned.
+    bool has_zero_copy_buffer() const {
+      return cached_buffer_ != NULL || mapped_buffer_ != NULL;
+    }
+
     /// Pointer to caller specified metadata. This is untouched by the io manager
     /// and the caller can put whatever auxiliary data in here.
     void* meta_data_;
@@ -413,6 +553,11 @@ class DiskIoMgr {
     /// will fail and we'll just put the scan range on the normal read path.
     bool try_cache_;
 
+    /// If true, the file is on the local filesystem and is read by mapping it into
+    /// memory (see --mmap_local_reads). Like try_cache_, the range goes to the normal
+    /// read path if the file can't be mapped.
+    bool try_mmap_;
+
     /// If true, we expect this scan range to be a local read. Note that if this is false,
     /// it does not necessarily mean we expect the read to be remote, and that we never
     /// create scan ranges where some of the range is expected to be remote and some of it
@@ -425,19 +570,34 @@ class DiskIoMgr {
     /// Reader/owner of the scan range
     RequestContext* reader_;
 
-    /// File handle either to hdfs or local fs (FILE*)
+    /// File handle to hdfs.
     ///
     /// TODO: The pointer to HdfsCachedFileHandle is manually managed and should be
     /// replaced by unique_ptr in C++11
-    union {
-      FILE* local_file_;
-      HdfsCachedFileHandle* hdfs_file_;
-    };
+    HdfsCachedFileHandle* hdfs_file_;
+
+    /// File descriptor for the local fs, or -1 if the file is not open. Local files are
+    /// read with pread() at offset_ + bytes_read_, so no seeks are needed.
+    int local_fd_;
+
+    /// True if a read was served from the data cache, so the position of hdfs_file_ is
+    /// behind offset_ + bytes_read_.
+    bool needs_seek_;
+
+    /// True if the range is on HDFS and is read with hdfsPread() at offset_ +
+    /// bytes_read_, without seeks. Such ranges share hdfs_file_ with the other ranges of
+    /// the file, unless they read from the HDFS cache. Set by Open().
+    bool use_pread_;
 
     /// If non-null, this is DN cached buffer. This means the cached read succeeded
     /// and all the bytes for the range are in this buffer.
     struct hadoopRzBuffer* cached_buffer_;
 
+    /// If non-null, the mapping of the file that holds all the bytes of the range. It
+    /// starts at the page boundary at or before offset_ and is mapped_len_ bytes long.
+    void* mapped_buffer_;
+    int64_t mapped_len_;
+
     /// Lock protecting fields below.
     /// This lock should not be taken during Open/Read/Close.
     boost::mutex lock_;
@@ -484,6 +644,16 @@ class DiskIoMgr {
 
     /// Last modified time of the file associated with the scan range
     int64_t mtime_;
+
+    /// Ranges following this one in the same file whose bytes are read together with
+    /// this range's (see "Coalesced reads" above). These ranges are not on any disk
+    /// queue. Set by AddScanRanges() and handed over under lock_ to either the disk
+    /// thread that reads this range or Cancel(), which cancels them as well.
+    std::vector<ScanRange*> coalesced_ranges_;
+
+    /// Time this range was last put on the in-flight queue of its disk, in
+    /// MonotonicNanos(). Set by RequestContext::ScheduleScanRange().
+    int64_t schedule_time_ns_;
   };
 
   /// Used to specify data to be written to a file and offset.
@@ -538,6 +708,11 @@ class DiskIoMgr {
   /// Initialize the IoMgr. Must be called once before any of the other APIs.
   Status Init(MemTracker* process_mem_tracker);
 
+  /// Registers histograms of the latency of the reads of each disk queue and of the
+  /// time scan ranges wait in the queues before they are read with 'metrics'. Must be
+  /// called before Init(). Without it no latencies are recorded.
+  void RegisterMetrics(MetricGroup* metrics);
+
   /// Allocates tracking structure for a request context.
   /// Register a new request context which is returned in *request_context.
   /// The IoMgr owns the allocated RequestContext object. The caller must call
@@ -587,6 +762,15 @@ class DiskIoMgr {
   /// This call is blocking.
   Status GetNextRange(RequestContext* reader, ScanRange** range);
 
+  /// Removes the ranges of 'reader' that have not been started yet (i.e. that would
+  /// still be returned by GetNextRange()) and for which 'should_remove' returns true,
+  /// and appends them to 'removed'. The removed ranges are never read, the caller is
+  /// responsible for accounting for them as done. 'should_remove' is called with the
+  /// reader lock held. Does nothing if the reader is cancelled.
+  void RemoveUnstartedRanges(RequestContext* reader,
+      const boost::function<bool (ScanRange*)>& should_remove,
+      std::vector<ScanRange*>* removed);
+
   /// Reads the range and returns the result in buffer.
   /// This behaves like the typical synchronous read() api, blocking until the data
   /// is read. This can be called while there are outstanding ScanRanges and is
@@ -612,12 +796,23 @@ class DiskIoMgr {
   void set_active_read_thread_counter(RequestContext*, RuntimeProfile::Counter*);
   void set_disks_access_bitmap(RequestContext*, RuntimeProfile::Counter*);
 
+  /// Sets the weight of 'r' on the disk queues, see "Fair sharing" above. Must be called
+  /// before any ranges are added.
+  void set_io_weight(RequestContext* r, int weight);
+
+  /// Returns the weight of contexts of queries in admission pool 'pool', as configured
+  /// by FLAGS_disk_io_pool_weights.
+  static int GetPoolIoWeight(const std::string& pool);
+
   int64_t queue_size(RequestContext* reader) const;
   int64_t bytes_read_local(RequestContext* reader) const;
   int64_t bytes_read_short_circuit(RequestContext* reader) const;
   int64_t bytes_read_dn_cache(RequestContext* reader) const;
   int num_remote_ranges(RequestContext* reader) const;
   int64_t unexpected_remote_bytes(RequestContext* reader) const;
+  int64_t data_cache_hit_bytes(RequestContext* reader) const;
+  int64_t data_cache_miss_bytes(RequestContext* reader) const;
+  int64_t data_cache_num_evictions(RequestContext* reader) const;
 
   /// Returns the read throughput across all readers.
   /// TODO: should this be a sliding window?  This should report metrics for the
@@ -636,15 +831,23 @@ class DiskIoMgr {
   /// Returns the number of local disks attached to the system.
   int num_local_disks() const { return num_total_disks() - num_remote_disks(); }
 
+  /// Returns the number of request contexts queued on all disk queues, i.e. the sum of
+  /// the queue depths. A context with ranges on several disks is counted once per disk.
+  int num_queued_contexts() const;
+
   /// The disk ID (and therefore disk_queues_ index) used for DFS accesses.
   int RemoteDfsDiskId() const { return num_local_disks() + REMOTE_DFS_DISK_OFFSET; }
 
   /// The disk ID (and therefore disk_queues_ index) used for S3 accesses.
   int RemoteS3DiskId() const { return num_local_disks() + REMOTE_S3_DISK_OFFSET; }
 
-  /// Returns the number of allocated buffers.
+  /// Returns the number of IO buffers that are in use.
   int num_allocated_buffers() const { return num_allocated_buffers_; }
 
+  /// Returns the process-wide pool that the IO buffers are allocated from and that the
+  /// BufferedBlockMgrs share. NULL before Init().
+  BufferPool* buffer_pool() { return buffer_pool_.get(); }
+
   /// Returns the number of buffers currently owned by all readers.
   int num_buffers_in_readers() const { return num_buffers_in_readers_; }
 
@@ -657,14 +860,18 @@ class DiskIoMgr {
 
   /// Given a FS handle, name and last modified time of the file, tries to open that file
   /// and return an instance of HdfsCachedFileHandle. In case of an error returns NULL.
-  HdfsCachedFileHandle* OpenHdfsFile(const hdfsFS& fs, const char* fname, int64_t mtime);
-
-  /// When the file handle is no longer in use by the scan range, return it and try to
-  /// unbuffer the handle. If unbuffering, closing sockets and dropping buffers in the
-  /// libhdfs client, is not supported, close the file handle. If the unbuffer operation
-  /// is supported, put the file handle together with the mtime in the LRU cache for
-  /// later reuse.
-  void CacheOrCloseFileHandle(const char* fname, HdfsCachedFileHandle* fid, bool close);
+  /// If 'exclusive' is false, the handle may be shared with other scan ranges, which
+  /// must then only read it with hdfsPread(). See FileHandleCache::GetHandle().
+  HdfsCachedFileHandle* OpenHdfsFile(const hdfsFS& fs, const char* fname, int64_t mtime,
+      bool exclusive);
+
+  /// When the file handle is no longer in use by the scan range, return it to the
+  /// handle cache, which unbuffers it (closing sockets and dropping buffers in the
+  /// libhdfs client) and keeps it for later reuse once no other range uses it. If
+  /// unbuffering is not supported, or 'close' is true, the file handle is closed.
+  /// 'stats' is set as by FileHandleCache::ReleaseHandle().
+  void CacheOrCloseFileHandle(HdfsCachedFileHandle* fid, bool close,
+      struct hdfsReadStatistics** stats);
 
   /// Default ready buffer queue capacity. This constant doesn't matter too much
   /// since the system dynamically adjusts.
@@ -684,6 +891,7 @@ class DiskIoMgr {
   class RequestContextCache;
 
   friend class DiskIoMgrTest_Buffers_Test;
+  friend class DiskIoMgrTest_ThreadTuning_Test;
 
   /// Pool to allocate BufferDescriptors.
   ObjectPool pool_;
@@ -704,6 +912,14 @@ class DiskIoMgr {
   /// Thread group containing all the worker threads.
   ThreadGroup disk_thread_group_;
 
+  /// Thread that adjusts the number of active threads of each disk queue. NULL if
+  /// FLAGS_disk_io_thread_tuning_interval_ms is 0.
+  boost::scoped_ptr<Thread> tuner_thread_;
+
+  /// Protects 'tuner_cv_', which is signalled to wake the tuner thread for shut down.
+  boost::mutex tuner_lock_;
+  boost::condition_variable tuner_cv_;
+
   /// Options object for cached hdfs reads. Set on startup and never modified.
   struct hadoopRzOptions* cached_read_options_;
 
@@ -723,26 +939,17 @@ class DiskIoMgr {
   /// contention.
   boost::scoped_ptr<RequestContextCache> request_context_cache_;
 
-  /// Protects free_buffers_ and free_buffer_descs_
+  /// Protects free_buffer_descs_
   boost::mutex free_buffers_lock_;
 
-  /// Free buffers that can be handed out to clients. There is one list for each buffer
-  /// size, indexed by the Log2 of the buffer size in units of min_buffer_size_. The
-  /// maximum buffer size is max_buffer_size_, so the maximum index is
-  /// Log2(max_buffer_size_ / min_buffer_size_).
-  //
-  /// E.g. if min_buffer_size_ = 1024 bytes:
-  ///  free_buffers_[0]  => list of free buffers with size 1024 B
-  ///  free_buffers_[1]  => list of free buffers with size 2048 B
-  ///  free_buffers_[10] => list of free buffers with size 1 MB
-  ///  free_buffers_[13] => list of free buffers with size 8 MB
-  ///  free_buffers_[n]  => list of free buffers with size 2^n * 1024 B
-  std::vector<std::list<char*> > free_buffers_;
+  /// Pool that IO buffers are allocated from and returned to. Unused buffers are cached
+  /// there in power-of-two multiples of min_buffer_size_ up to max_buffer_size_.
+  boost::scoped_ptr<BufferPool> buffer_pool_;
 
   /// List of free buffer desc objects that can be handed out to clients
   std::list<BufferDescriptor*> free_buffer_descs_;
 
-  /// Total number of allocated buffers, used for debugging.
+  /// Number of IO buffers that were allocated and not yet returned.
   AtomicInt<int> num_allocated_buffers_;
 
   /// Total number of buffers in readers
@@ -753,13 +960,19 @@ class DiskIoMgr {
   /// It is indexed by disk id.
   std::vector<DiskQueue*> disk_queues_;
 
-  // Caching structure that maps file names to cached file handles. The cache has an upper
-  // limit of entries defined by FLAGS_max_cached_file_handles. Evicted cached file
-  // handles are closed.
-  FifoMultimap<std::string, HdfsCachedFileHandle*> file_handle_cache_;
+  /// Latency of the reads of each disk queue, indexed by disk id, and the time scan
+  /// ranges waited in the disk queues. Empty and NULL unless RegisterMetrics() was
+  /// called.
+  std::vector<HistogramMetric*> read_latency_metrics_;
+  HistogramMetric* queue_wait_time_metric_;
+
+  /// Cache of the HDFS file handles, idle or in use. It holds at most
+  /// FLAGS_max_cached_file_handles idle ones.
+  FileHandleCache file_handle_cache_;
 
-  /// Returns the index into free_buffers_ for a given buffer size
-  int free_buffers_idx(int64_t buffer_size);
+  /// Local cache of data read from remote filesystems. NULL if FLAGS_data_cache_dir is
+  /// not set.
+  boost::scoped_ptr<DataCache> data_cache_;
 
   /// Gets a buffer description object, initialized for this reader, allocating one as
   /// necessary. buffer_size / min_buffer_size_ should be a power of 2, and buffer_size
@@ -777,17 +990,17 @@ class DiskIoMgr {
 
   /// Returns a buffer to read into with size between *buffer_size and max_buffer_size_,
   /// and *buffer_size is set to the size of the buffer. If there is an
-  /// appropriately-sized free buffer in the 'free_buffers_', that is returned, otherwise
+  /// appropriately-sized free buffer in 'buffer_pool_', that is returned, otherwise
   /// a new one is allocated. *buffer_size must be between 0 and max_buffer_size_.
   char* GetFreeBuffer(int64_t* buffer_size);
 
-  /// Garbage collect all unused io buffers. This is currently only triggered when the
-  /// process wide limit is hit. This is not good enough. While it is sufficient for
-  /// the IoMgr, other components do not trigger this GC.
+  /// Garbage collect all unused buffers of 'buffer_pool_', including the ones returned
+  /// by BufferedBlockMgrs. This is currently only triggered when the process wide limit
+  /// is hit or a reader is low on memory.
   /// TODO: make this run periodically?
   void GcIoBuffers();
 
-  /// Returns a buffer to the free list. buffer_size / min_buffer_size_ should be a power
+  /// Returns a buffer to 'buffer_pool_'. buffer_size / min_buffer_size_ should be a power
   /// of 2, and buffer_size should be <= max_buffer_size_. These constraints will be met
   /// if buffer was acquired via GetFreeBuffer() (which it should have been).
   void ReturnFreeBuffer(char* buffer, int64_t buffer_size);
@@ -798,17 +1011,29 @@ class DiskIoMgr {
 
   /// Disk worker thread loop. This function retrieves the next range to process on
   /// the disk queue and invokes ReadRange() or Write() depending on the type of Range().
-  /// There can be multiple threads per disk running this loop.
-  void WorkLoop(DiskQueue* queue);
+  /// There can be multiple threads per disk running this loop, 'thread_idx' is the
+  /// index of the calling thread among them.
+  void WorkLoop(DiskQueue* queue, int thread_idx);
 
   /// This is called from the disk thread to get the next range to process. It will
   /// wait until a scan range and buffer are available, or a write range is available.
+  /// Threads with a 'thread_idx' of at least the queue's 'num_active_threads' wait until
+  /// the tuner activates them.
   /// This functions returns the range to process.
   /// Only returns false if the disk thread should be shut down.
   /// No locks should be taken before this function call and none are left taken after.
-  bool GetNextRequestRange(DiskQueue* disk_queue, RequestRange** range,
+  bool GetNextRequestRange(DiskQueue* disk_queue, int thread_idx, RequestRange** range,
       RequestContext** request_context);
 
+  /// Loop of 'tuner_thread_': calls TuneDiskQueue() for every disk queue each
+  /// FLAGS_disk_io_thread_tuning_interval_ms until the IoMgr shuts down.
+  void TunerLoop();
+
+  /// Adjusts the number of active threads of 'disk_queue' based on the work done in the
+  /// last 'elapsed_ns' (see "Adaptive disk thread counts" above) and resets the queue's
+  /// statistics.
+  void TuneDiskQueue(DiskQueue* disk_queue, int64_t elapsed_ns);
+
   /// Updates disk queue and reader state after a read is complete. The read result
   /// is captured in the buffer descriptor.
   void HandleReadFinished(DiskQueue*, RequestContext*, BufferDescriptor*);
@@ -834,9 +1059,31 @@ class DiskIoMgr {
   /// Does not open or close the file that is written.
   Status WriteRangeHelper(FILE* file_handle, WriteRange* write_range);
 
+  /// Records a read of 'latency_ns' in the read latency histogram of 'disk_queue'.
+  void UpdateReadLatency(DiskQueue* disk_queue, int64_t latency_ns);
+
   /// Reads the specified scan range and calls HandleReadFinished when done.
   void ReadRange(DiskQueue* disk_queue, RequestContext* reader,
       ScanRange* range);
+
+  /// Groups the ranges in 'ranges' that can be read together (see "Coalesced reads"
+  /// above), attaching each group to its first range's coalesced_ranges_. Returns the
+  /// ranges that still need to be scheduled in 'ranges_to_schedule', in the original
+  /// order.
+  void CoalesceScanRanges(const std::vector<ScanRange*>& ranges,
+      std::vector<ScanRange*>* ranges_to_schedule);
+
+  /// Reads 'range' and 'coalesced_ranges' with a single read, then enqueues a buffer with
+  /// the bytes of each range and calls HandleReadFinished() for 'range'.
+  void ReadCoalescedRanges(DiskQueue* disk_queue, RequestContext* reader,
+      ScanRange* range, const std::vector<ScanRange*>& coalesced_ranges);
+
+  /// Returns a buffer for 'range' with its bytes copied out of 'read_buffer', which holds
+  /// the first 'bytes_read' bytes of the span starting at 'first_range'. If 'read_status'
+  /// is an error, the buffer is empty and carries the error.
+  BufferDescriptor* GetCoalescedBuffer(RequestContext* reader, ScanRange* first_range,
+      ScanRange* range, const char* read_buffer, int64_t bytes_read,
+      const Status& read_status);
 };
 
 }
@@ -22,9 +22,11 @@
 
 #include "common/logging.h"
 #include "resourcebroker/resource-broker.h"
+#include "runtime/buffered-block-mgr.h"
 #include "runtime/client-cache.h"
 #include "runtime/coordinator.h"
 #include "runtime/data-stream-mgr.h"
+#include "runtime/data-stream-mux.h"
 #include "runtime/disk-io-mgr.h"
 #include "runtime/hbase-table-factory.h"
 #include "runtime/hdfs-fs-cache.h"
@@ -36,6 +38,7 @@
 #include "service/frontend.h"
 #include "scheduling/simple-scheduler.h"
 #include "statestore/statestore-subscriber.h"
+#include "util/cpu-info.h"
 #include "util/debug-util.h"
 #include "util/default-path-handlers.h"
 #include "util/mem-info.h"
@@ -49,6 +52,8 @@
 #include "util/cgroups-mgr.h"
 #include "util/memory-metrics.h"
 #include "util/pretty-printer.h"
+#include "util/lock-profiler.h"
+#include "util/sampling-profiler.h"
 #include "util/thread-pool.h"
 #include "gen-cpp/ImpalaInternalService.h"
 #include "gen-cpp/CatalogService.h"
@@ -103,11 +108,18 @@ DEFINE_int64(llama_max_request_attempts, 5,
              "(reserve/expand/release, etc.) is retried until the request is aborted. "
              "An attempt is counted once Impala is registered with Llama, i.e., a "
              "request survives at most llama_max_request_attempts-1 re-registrations.");
-DEFINE_string(cgroup_hierarchy_path, "", "If Resource Management is enabled, this must "
-    "be set to the Impala-writeable root of the cgroups hierarchy into which execution "
-    "threads are assigned.");
+DEFINE_string(cgroup_hierarchy_path, "", "If Resource Management or "
+    "--enable_pool_cgroups is enabled, this must be set to the Impala-writeable root of "
+    "the cgroups hierarchy into which execution threads are assigned.");
 DEFINE_string(staging_cgroup, "impala_staging", "Name of the cgroup that a query's "
     "execution threads are moved into once the query completes.");
+DEFINE_bool(enable_pool_cgroups, false, "If true and Resource Management is disabled, "
+    "the fragment and scanner threads of queries are placed into one cgroup per "
+    "admission control pool under --cgroup_hierarchy_path, so that the CPU shares of "
+    "each pool bound the CPU time it gets while other pools compete for the CPUs.");
+DEFINE_string(pool_cpu_shares, "", "Comma-separated list of <pool>:<shares> pairs "
+    "with the CPU shares of the cgroups of admission control pools if "
+    "--enable_pool_cgroups is true. Pools that are not listed get 1024 shares.");
 
 // Use a low default value because the reconnection logic is performed manually
 // for the purpose of faster Llama failover (otherwise we may try to reconnect to the
@@ -125,6 +137,15 @@ DEFINE_int32(resource_broker_recv_timeout, 0, "Time to wait, in ms, "
 
 DEFINE_int32(coordinator_rpc_threads, 12, "(Advanced) Number of threads available to "
     "start fragments on remote Impala daemons.");
+DEFINE_bool(reclaim_block_mgr_memory, true, "(Advanced) If true, when the process "
+    "memory limit is hit, free and spillable buffers are reclaimed from the block mgrs "
+    "of the running queries, largest consumers first, before an allocation fails.");
+
+DEFINE_int32(num_scanner_task_threads, 0, "(Advanced) Number of threads shared by all "
+    "the scan nodes to run their scanners, beyond the first scanner of each scan node "
+    "which still runs on a thread of its own. This bounds the number of scanner threads "
+    "under high concurrency. If 0, one thread per core is started. If negative, every "
+    "scanner runs on a thread of its own.");
 
 DECLARE_string(ssl_client_ca_certificate);
 
@@ -137,12 +158,22 @@ namespace impala {
 
 ExecEnv* ExecEnv::exec_env_ = NULL;
 
+// Returns the scanner task pool configured by --num_scanner_task_threads, or NULL.
+static CallableThreadPool* CreateScannerTaskPool() {
+  if (FLAGS_num_scanner_task_threads < 0) return NULL;
+  int num_threads = FLAGS_num_scanner_task_threads == 0 ?
+      CpuInfo::num_cores() : FLAGS_num_scanner_task_threads;
+  return new CallableThreadPool("hdfs-scan-node", "scanner-task", num_threads,
+      numeric_limits<int32_t>::max());
+}
+
 ExecEnv::ExecEnv()
   : metrics_(new MetricGroup("impala-metrics")),
     stream_mgr_(new DataStreamMgr(metrics_.get())),
     impalad_client_cache_(
         new ImpalaInternalServiceClientCache(
             "", !FLAGS_ssl_client_ca_certificate.empty())),
+    stream_mux_(new DataStreamMux(impalad_client_cache_.get())),
     catalogd_client_cache_(
         new CatalogServiceClientCache(
             "", !FLAGS_ssl_client_ca_certificate.empty())),
@@ -161,6 +192,8 @@ ExecEnv::ExecEnv()
         new CallableThreadPool("coordinator-fragment-rpc", "worker",
             FLAGS_coordinator_rpc_threads, numeric_limits<int32_t>::max())),
     async_rpc_pool_(new CallableThreadPool("rpc-pool", "async-rpc-sender", 8, 10000)),
+    scanner_task_pool_(CreateScannerTaskPool()),
+    fragment_mgr_(NULL),
     enable_webserver_(FLAGS_enable_webserver),
     tz_database_(TimezoneDatabase()),
     is_fe_tests_(false),
@@ -199,6 +232,7 @@ ExecEnv::ExecEnv(const string& hostname, int backend_port, int subscriber_port,
     impalad_client_cache_(
         new ImpalaInternalServiceClientCache(
             "", !FLAGS_ssl_client_ca_certificate.empty())),
+    stream_mux_(new DataStreamMux(impalad_client_cache_.get())),
     catalogd_client_cache_(
         new CatalogServiceClientCache(
             "", !FLAGS_ssl_client_ca_certificate.empty())),
@@ -215,6 +249,8 @@ ExecEnv::ExecEnv(const string& hostname, int backend_port, int subscriber_port,
         new CallableThreadPool("coordinator-fragment-rpc", "worker",
             FLAGS_coordinator_rpc_threads, numeric_limits<int32_t>::max())),
     async_rpc_pool_(new CallableThreadPool("rpc-pool", "async-rpc-sender", 8, 10000)),
+    scanner_task_pool_(CreateScannerTaskPool()),
+    fragment_mgr_(NULL),
     enable_webserver_(FLAGS_enable_webserver && webserver_port > 0),
     tz_database_(TimezoneDatabase()),
     is_fe_tests_(false),
@@ -296,6 +332,18 @@ void ExecEnv::InitRm() {
   }
 }
 
+void ExecEnv::ReclaimBlockMgrMemory() {
+  // Reclaim down to 90% of the limit, so that the allocation that hit the limit and the
+  // ones right after it fit without another round of reclamation.
+  int64_t bytes_to_reclaim = mem_tracker_->consumption() - mem_tracker_->limit() * 9 / 10;
+  if (BufferedBlockMgr::ReclaimMemory(bytes_to_reclaim) == 0) return;
+  // The freed buffers went to the buffer pool and the allocator, release them from there.
+  disk_io_mgr_->GcIoBuffers();
+#ifndef ADDRESS_SANITIZER
+  MallocExtension::instance()->ReleaseFreeMemory();
+#endif
+}
+
 ExecEnv::~ExecEnv() {
 }
 
@@ -315,6 +363,14 @@ Status ExecEnv::StartServices() {
     DCHECK(cgroups_mgr_.get() != NULL);
     RETURN_IF_ERROR(
         cgroups_mgr_->Init(FLAGS_cgroup_hierarchy_path, FLAGS_staging_cgroup));
+  } else if (FLAGS_enable_pool_cgroups) {
+    if (FLAGS_cgroup_hierarchy_path.empty()) {
+      return Status("--cgroup_hierarchy_path must be set if --enable_pool_cgroups is "
+          "true.");
+    }
+    RETURN_IF_ERROR(
+        cgroups_mgr_->Init(FLAGS_cgroup_hierarchy_path, FLAGS_staging_cgroup));
+    RETURN_IF_ERROR(cgroups_mgr_->InitPoolCgroups(FLAGS_pool_cpu_shares));
   }
 
   // Initialize global memory limit.
@@ -366,6 +422,7 @@ Status ExecEnv::StartServices() {
 
   metrics_->Init(enable_webserver_ ? webserver_.get() : NULL);
   impalad_client_cache_->InitMetrics(metrics_.get(), "impala-server.backends");
+  impalad_client_cache_->StartMaintenanceThread();
   catalogd_client_cache_->InitMetrics(metrics_.get(), "catalog.server");
   RETURN_IF_ERROR(RegisterMemoryMetrics(metrics_.get(), true));
 
@@ -396,9 +453,18 @@ Status ExecEnv::StartServices() {
   LOG(INFO) << "Using global memory limit: "
             << PrettyPrinter::Print(bytes_limit, TUnit::BYTES);
 
+  disk_io_mgr_->RegisterMetrics(metrics_->GetChildGroup("impala-server"));
   RETURN_IF_ERROR(disk_io_mgr_->Init(mem_tracker_.get()));
+  // Added after the io mgr's GC function, so that idle io buffers and tcmalloc's free
+  // memory are released before other queries are made to give up their buffers.
+  if (FLAGS_reclaim_block_mgr_memory && mem_tracker_->has_limit()) {
+    mem_tracker_->AddGcFunction(bind(&ExecEnv::ReclaimBlockMgrMemory, this));
+  }
 
-  // Start services in order to ensure that dependencies between them are met
+  // Start services in order to ensure that dependencies between them are met. The
+  // profilers' pages must be registered before the webserver starts.
+  RETURN_IF_ERROR(SamplingProfiler::Init(enable_webserver_ ? webserver_.get() : NULL));
+  LockProfiler::Init(enable_webserver_ ? webserver_.get() : NULL);
   if (enable_webserver_) {
     AddDefaultUrlCallbacks(webserver_.get(), mem_tracker_.get());
     RETURN_IF_ERROR(webserver_->Start());
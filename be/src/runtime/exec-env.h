@@ -30,6 +30,7 @@
 namespace impala {
 
 class DataStreamMgr;
+class DataStreamMux;
 class DiskIoMgr;
 class HBaseTableFactory;
 class HdfsFsCache;
@@ -69,6 +70,7 @@ class ExecEnv {
   virtual ~ExecEnv();
 
   void SetImpalaServer(ImpalaServer* server) { impala_server_ = server; }
+  void SetFragmentMgr(FragmentMgr* fragment_mgr) { fragment_mgr_ = fragment_mgr; }
 
   StatestoreSubscriber* statestore_subscriber() {
     return statestore_subscriber_.get();
@@ -78,6 +80,7 @@ class ExecEnv {
   ImpalaInternalServiceClientCache* impalad_client_cache() {
     return impalad_client_cache_.get();
   }
+  DataStreamMux* stream_mux() { return stream_mux_.get(); }
   CatalogServiceClientCache* catalogd_client_cache() {
     return catalogd_client_cache_.get();
   }
@@ -94,10 +97,18 @@ class ExecEnv {
     return fragment_exec_thread_pool_.get();
   }
   ImpalaServer* impala_server() { return impala_server_; }
+
+  /// Returns NULL if the backend service is not started, e.g. in tests.
+  FragmentMgr* fragment_mgr() { return fragment_mgr_; }
   Frontend* frontend() { return frontend_.get(); };
   RequestPoolService* request_pool_service() { return request_pool_service_.get(); }
   CallableThreadPool* rpc_pool() { return async_rpc_pool_.get(); }
 
+  /// Threads shared by the scan nodes of all the queries to run their optional scanners,
+  /// see HdfsScanNode::ThreadTokenAvailableCb(). NULL if every scanner runs on a thread
+  /// of its own.
+  CallableThreadPool* scanner_task_pool() { return scanner_task_pool_.get(); }
+
   void set_enable_webserver(bool enable) { enable_webserver_ = enable; }
 
   ResourceBroker* resource_broker() { return resource_broker_.get(); }
@@ -130,6 +141,7 @@ class ExecEnv {
   boost::scoped_ptr<Scheduler> scheduler_;
   boost::scoped_ptr<StatestoreSubscriber> statestore_subscriber_;
   boost::scoped_ptr<ImpalaInternalServiceClientCache> impalad_client_cache_;
+  boost::scoped_ptr<DataStreamMux> stream_mux_;
   boost::scoped_ptr<CatalogServiceClientCache> catalogd_client_cache_;
   boost::scoped_ptr<HBaseTableFactory> htable_factory_;
   boost::scoped_ptr<DiskIoMgr> disk_io_mgr_;
@@ -143,9 +155,11 @@ class ExecEnv {
   boost::scoped_ptr<Frontend> frontend_;
   boost::scoped_ptr<CallableThreadPool> fragment_exec_thread_pool_;
   boost::scoped_ptr<CallableThreadPool> async_rpc_pool_;
+  boost::scoped_ptr<CallableThreadPool> scanner_task_pool_;
 
   /// Not owned by this class
   ImpalaServer* impala_server_;
+  FragmentMgr* fragment_mgr_;
 
   bool enable_webserver_;
 
@@ -164,6 +178,10 @@ class ExecEnv {
 
   /// Initialise cgroups manager, detect test RM environment and init resource broker.
   void InitRm();
+
+  /// GC function of the process mem tracker that reclaims memory from the block mgrs of
+  /// the running queries, see BufferedBlockMgr::ReclaimMemory().
+  void ReclaimBlockMgrMemory();
 };
 
 } // namespace impala
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <string>
 #include <gtest/gtest.h>
 
@@ -166,6 +167,59 @@ TEST(FreePoolTest, ReAlloc) {
   mem_pool.FreeAll();
 }
 
+// Test that slabs don't come from the mem pool and that slabs whose allocations were
+// all freed are released, except for the last one of each size class.
+TEST(FreePoolTest, Slabs) {
+  const int64_t slab_size = 64 * 1024;
+  MemTracker tracker;
+  MemPool mem_pool(&tracker);
+  {
+    FreePool pool(&mem_pool, true);
+    vector<uint8_t*> ptrs;
+    for (int i = 0; i < 100; ++i) {
+      ptrs.push_back(pool.Allocate(24));
+      ASSERT_TRUE(ptrs.back() != NULL);
+      memset(ptrs.back(), i, 24);
+    }
+    EXPECT_EQ(pool.slab_bytes(), slab_size);
+    EXPECT_EQ(tracker.consumption(), slab_size);
+    EXPECT_EQ(mem_pool.total_allocated_bytes(), 0);
+    for (int i = 0; i < 100; ++i) EXPECT_EQ(*ptrs[i], i);
+
+    // Fill a second slab of the same size class, then free everything.
+    for (int i = 0; i < 2000; ++i) ptrs.push_back(pool.Allocate(24));
+    EXPECT_EQ(pool.slab_bytes(), 2 * slab_size);
+    for (int i = 0; i < ptrs.size(); ++i) pool.Free(ptrs[i]);
+    EXPECT_EQ(pool.slab_bytes(), slab_size);
+    EXPECT_EQ(pool.net_allocations(), 0);
+
+    // Freed allocations are reused.
+    uint8_t* ptr = pool.Allocate(24);
+    EXPECT_TRUE(find(ptrs.begin(), ptrs.end(), ptr) != ptrs.end());
+    pool.Free(ptr);
+
+    // Large allocations get their own slab, which is released when they are freed.
+    ptr = pool.Allocate(1024 * 1024);
+    ASSERT_TRUE(ptr != NULL);
+    EXPECT_GT(pool.slab_bytes(), slab_size + 1024 * 1024);
+    pool.Free(ptr);
+    EXPECT_EQ(pool.slab_bytes(), slab_size);
+
+    // Reallocate() copies the contents into a bigger allocation.
+    ptr = pool.Allocate(600);
+    memset(ptr, 7, 600);
+    uint8_t* ptr2 = pool.Reallocate(ptr, 2000);
+    ASSERT_TRUE(ptr2 != NULL);
+    EXPECT_TRUE(ptr != ptr2);
+    EXPECT_EQ(ptr2[599], 7);
+    EXPECT_TRUE(pool.Reallocate(ptr2, 1500) == ptr2);
+    pool.Free(ptr2);
+  }
+  // Destroying the pool releases the remaining slabs.
+  EXPECT_EQ(tracker.consumption(), 0);
+  mem_pool.FreeAll();
+}
+
 }
 
 int main(int argc, char **argv) {
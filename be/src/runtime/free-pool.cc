@@ -0,0 +1,129 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "runtime/free-pool.h"
+
+#include <stdlib.h>
+
+#include "runtime/mem-tracker.h"
+
+#include "common/names.h"
+
+namespace impala {
+
+const int64_t FreePool::SLAB_SIZE;
+const int FreePool::MIN_ALLOCATIONS_PER_SLAB;
+
+uint8_t* FreePool::AllocateFromSlab(int size_class) {
+  int64_t node_size = sizeof(FreeListNode) + (1L << size_class);
+  Slab* slab = partial_slabs_[size_class];
+  if (slab == NULL) {
+    int64_t slab_len = sizeof(Slab) + node_size * MIN_ALLOCATIONS_PER_SLAB <= SLAB_SIZE ?
+        SLAB_SIZE : sizeof(Slab) + node_size;
+    slab = reinterpret_cast<Slab*>(malloc(slab_len));
+    if (UNLIKELY(slab == NULL)) return NULL;
+    mem_tracker()->Consume(slab_len);
+    slab_bytes_ += slab_len;
+    slab->free_list = NULL;
+    slab->unused = reinterpret_cast<uint8_t*>(slab) + sizeof(Slab);
+    slab->end = reinterpret_cast<uint8_t*>(slab) + slab_len;
+    slab->len = slab_len;
+    slab->size_class = size_class;
+    slab->capacity = (slab_len - sizeof(Slab)) / node_size;
+    slab->num_allocated = 0;
+    AddSlab(slab, &partial_slabs_[size_class]);
+    ++num_slabs_[size_class];
+  }
+
+  FreeListNode* node = slab->free_list;
+  if (node != NULL) {
+    slab->free_list = node->next;
+  } else {
+    DCHECK_LE(slab->unused + node_size, slab->end);
+    node = reinterpret_cast<FreeListNode*>(slab->unused);
+    slab->unused += node_size;
+  }
+  ++slab->num_allocated;
+  if (slab->num_allocated == slab->capacity) {
+    RemoveSlab(slab, &partial_slabs_[size_class]);
+    AddSlab(slab, &full_slabs_[size_class]);
+  }
+  node->slab = slab;
+  return reinterpret_cast<uint8_t*>(node) + sizeof(FreeListNode);
+}
+
+void FreePool::FreeToSlab(FreeListNode* node) {
+  Slab* slab = node->slab;
+  int size_class = slab->size_class;
+  DCHECK_GE(size_class, 0);
+  DCHECK_LT(size_class, NUM_LISTS);
+  DCHECK_GT(slab->num_allocated, 0) << "Allocation could have already been freed.";
+  if (slab->num_allocated == slab->capacity) {
+    RemoveSlab(slab, &full_slabs_[size_class]);
+    AddSlab(slab, &partial_slabs_[size_class]);
+  }
+  node->next = slab->free_list;
+  slab->free_list = node;
+  --slab->num_allocated;
+  if (slab->num_allocated > 0) return;
+
+  // Keep the last slab of a size class with several allocations per slab, so that
+  // alternating allocations and frees don't allocate and free a slab each time.
+  if (slab->capacity > 1 && num_slabs_[size_class] == 1) return;
+  RemoveSlab(slab, &partial_slabs_[size_class]);
+  --num_slabs_[size_class];
+  slab_bytes_ -= slab->len;
+  mem_tracker()->Release(slab->len);
+  free(slab);
+}
+
+void FreePool::RemoveSlab(Slab* slab, Slab** list) {
+  if (slab->prev != NULL) {
+    slab->prev->next = slab->next;
+  } else {
+    DCHECK_EQ(*list, slab);
+    *list = slab->next;
+  }
+  if (slab->next != NULL) slab->next->prev = slab->prev;
+  slab->prev = NULL;
+  slab->next = NULL;
+}
+
+void FreePool::AddSlab(Slab* slab, Slab** list) {
+  slab->prev = NULL;
+  slab->next = *list;
+  if (*list != NULL) (*list)->prev = slab;
+  *list = slab;
+}
+
+void FreePool::FreeSlabs() {
+  for (int i = 0; i < NUM_LISTS; ++i) {
+    Slab* lists[] = { partial_slabs_[i], full_slabs_[i] };
+    for (int j = 0; j < 2; ++j) {
+      Slab* slab = lists[j];
+      while (slab != NULL) {
+        Slab* next = slab->next;
+        free(slab);
+        slab = next;
+      }
+    }
+    partial_slabs_[i] = NULL;
+    full_slabs_[i] = NULL;
+    num_slabs_[i] = 0;
+  }
+  mem_tracker()->Release(slab_bytes_);
+  slab_bytes_ = 0;
+}
+
+}
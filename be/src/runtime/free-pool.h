@@ -25,6 +25,7 @@
 
 DECLARE_int32(stress_free_pool_alloc);
 DECLARE_bool(disable_mem_pools);
+DECLARE_bool(free_pool_use_slabs);
 
 namespace impala {
 
@@ -38,19 +39,43 @@ namespace impala {
 /// When the allocation is in the pool (i.e. available to be handed out), it
 /// contains the link to the next allocation.
 /// This has O(1) Allocate() and Free().
+///
+/// Memory allocated from the MemPool is only released when the MemPool is, so a pool
+/// that sees a changing mix of sizes accumulates free allocations of sizes that are
+/// no longer used. With slabs, allocations are instead carved out of slabs of
+/// SLAB_SIZE bytes (or one dedicated slab for allocations that don't fit several times
+/// into one) that are malloc()ed outside the MemPool and charged to its tracker. All
+/// allocations of a slab have the same size class; the header of an allocation points
+/// to its slab. A slab whose allocations were all freed is returned to the system,
+/// except for the last one of each size class, to avoid thrashing. Slabs are released
+/// when the FreePool is destroyed.
+///
 /// This is not thread safe.
 /// TODO: consider integrating this with MemPool.
 /// TODO: consider changing to something more granular than doubling.
 class FreePool {
  public:
   /// C'tor, initializes the FreePool to be empty. All allocations come from the
-  /// 'mem_pool'.
+  /// 'mem_pool', or from slabs if --free_pool_use_slabs is set.
   FreePool(MemPool* mem_pool)
+    : FreePool(mem_pool, FLAGS_free_pool_use_slabs) {
+  }
+
+  /// As above, but allocates from slabs if 'use_slabs' is true.
+  FreePool(MemPool* mem_pool, bool use_slabs)
     : mem_pool_(mem_pool),
-      net_allocations_(0) {
+      use_slabs_(use_slabs),
+      net_allocations_(0),
+      slab_bytes_(0) {
     memset(&lists_, 0, sizeof(lists_));
+    memset(&partial_slabs_, 0, sizeof(partial_slabs_));
+    memset(&full_slabs_, 0, sizeof(full_slabs_));
+    memset(&num_slabs_, 0, sizeof(num_slabs_));
   }
 
+  /// Frees the slabs.
+  ~FreePool() { if (use_slabs_) FreeSlabs(); }
+
   /// Allocates a buffer of size.
   uint8_t* Allocate(int size) {
 #ifndef NDEBUG
@@ -69,6 +94,11 @@ class FreePool {
     /// Do ceil(log_2(size))
     int free_list_idx = BitUtil::Log2(size);
     DCHECK_LT(free_list_idx, NUM_LISTS);
+    if (use_slabs_) {
+      uint8_t* result = AllocateFromSlab(free_list_idx);
+      if (UNLIKELY(result == NULL)) --net_allocations_;
+      return result;
+    }
 
     FreeListNode* allocation = lists_[free_list_idx].next;
     if (allocation == NULL) {
@@ -99,6 +129,10 @@ class FreePool {
     }
     if (ptr == NULL || reinterpret_cast<int64_t>(ptr) == 0x1) return;
     FreeListNode* node = reinterpret_cast<FreeListNode*>(ptr - sizeof(FreeListNode));
+    if (use_slabs_) {
+      FreeToSlab(node);
+      return;
+    }
     FreeListNode* list = node->list;
 #ifndef NDEBUG
     CheckValidAllocation(list, ptr);
@@ -127,11 +161,16 @@ class FreePool {
     }
     if (ptr == NULL || reinterpret_cast<int64_t>(ptr) == 0x1) return Allocate(size);
     FreeListNode* node = reinterpret_cast<FreeListNode*>(ptr - sizeof(FreeListNode));
-    FreeListNode* list = node->list;
+    int bucket_idx;
+    if (use_slabs_) {
+      bucket_idx = node->slab->size_class;
+    } else {
+      FreeListNode* list = node->list;
 #ifndef NDEBUG
-    CheckValidAllocation(list, ptr);
+      CheckValidAllocation(list, ptr);
 #endif
-    int bucket_idx = (list - &lists_[0]);
+      bucket_idx = (list - &lists_[0]);
+    }
     // This is the actual size of ptr.
     int allocation_size = 1 << bucket_idx;
 
@@ -151,17 +190,70 @@ class FreePool {
   MemTracker* mem_tracker() { return mem_pool_->mem_tracker(); }
   int64_t net_allocations() const { return net_allocations_; }
 
+  /// Returns the total size of the slabs.
+  int64_t slab_bytes() const { return slab_bytes_; }
+
  private:
   static const int NUM_LISTS = 64;
 
+  /// The size of the slabs of small allocations.
+  static const int64_t SLAB_SIZE = 64 * 1024;
+
+  /// Allocations that don't fit this many times into a SLAB_SIZE slab get their own
+  /// slab.
+  static const int MIN_ALLOCATIONS_PER_SLAB = 4;
+
+  struct Slab;
+
   struct FreeListNode {
     /// Union for clarity when manipulating the node.
     union {
       FreeListNode* next; // Used when it is in the free list
       FreeListNode* list; // Used when it is being used by the caller.
+      Slab* slab; // Used when it is being used by the caller, with slabs.
     };
   };
 
+  /// Header of a slab, followed by its allocations.
+  struct Slab {
+    /// Links in the doubly-linked list of the partial or the full slabs of
+    /// 'size_class'.
+    Slab* prev;
+    Slab* next;
+
+    /// Freed allocations of this slab.
+    FreeListNode* free_list;
+
+    /// Start of the part of the slab from which no allocation was handed out yet.
+    uint8_t* unused;
+    uint8_t* end;
+
+    /// Total bytes of the slab, including this header.
+    int64_t len;
+
+    int size_class;
+
+    /// The number of allocations that fit into the slab, and the number handed out.
+    int capacity;
+    int num_allocated;
+  };
+
+  /// Returns an allocation of size 1 << 'size_class' from a slab, allocating a new
+  /// slab if needed. Returns NULL if the slab could not be allocated.
+  uint8_t* AllocateFromSlab(int size_class);
+
+  /// Returns the allocation 'node' to its slab and frees the slab if it became empty.
+  void FreeToSlab(FreeListNode* node);
+
+  /// Unlinks 'slab' from the list with head 'list'.
+  static void RemoveSlab(Slab* slab, Slab** list);
+
+  /// Links 'slab' into the front of the list with head 'list'.
+  static void AddSlab(Slab* slab, Slab** list);
+
+  /// Frees all slabs.
+  void FreeSlabs();
+
   void CheckValidAllocation(FreeListNode* computed_list_ptr, uint8_t* allocation) const {
     // On debug, check that list is valid.
     bool found = false;
@@ -196,6 +288,9 @@ class FreePool {
   /// MemPool to allocate from. Unowned.
   MemPool* mem_pool_;
 
+  /// True if allocations come from slabs rather than from mem_pool_.
+  const bool use_slabs_;
+
   /// One list head for each allocation size indexed by the LOG_2 of the allocation size.
   /// While it doesn't make too much sense to use this for very small (e.g. 8 byte)
   /// allocations, it makes the indexing easy.
@@ -203,6 +298,15 @@ class FreePool {
 
   /// Diagnostic counter that tracks (# Allocates - # Frees)
   int64_t net_allocations_;
+
+  /// Heads of the lists of slabs with room for more allocations and of the full ones,
+  /// and the number of slabs, indexed by size class. Only used with slabs.
+  Slab* partial_slabs_[NUM_LISTS];
+  Slab* full_slabs_[NUM_LISTS];
+  int num_slabs_[NUM_LISTS];
+
+  /// Sum of the lengths of the slabs.
+  int64_t slab_bytes_;
 };
 
 }
@@ -394,6 +394,42 @@ TEST(MemPoolTest, FragmentationOverhead) {
   p.FreeAll();
 }
 
+// Test that chunks freed by one pool are reused by the next one through a chunk cache
+// of an ancestor tracker, and that only cacheable chunks are kept.
+TEST(MemPoolTest, ChunkCache) {
+  const int chunk_size = MemPoolTest::INITIAL_CHUNK_SIZE;
+  MemTracker root;
+  MemPoolChunkCache cache(4 * chunk_size, &root);
+  root.set_mem_pool_chunk_cache(&cache);
+  MemTracker tracker(-1, -1, "", &root);
+
+  MemPool p(&tracker);
+  uint8_t* first_chunk = p.Allocate(chunk_size);
+  p.Allocate(chunk_size);
+  EXPECT_EQ(tracker.consumption(), 3 * chunk_size);
+  p.FreeAll();
+  // The pool's tracker is released as before, while the cache holds on to the chunks.
+  EXPECT_EQ(tracker.consumption(), 0);
+  EXPECT_EQ(cache.cached_bytes(), 3 * chunk_size);
+  EXPECT_EQ(root.consumption(), 3 * chunk_size);
+
+  MemPool p2(&tracker);
+  EXPECT_EQ(p2.Allocate(chunk_size), first_chunk);
+  EXPECT_EQ(cache.cached_bytes(), 2 * chunk_size);
+  EXPECT_EQ(tracker.consumption(), chunk_size);
+  // Chunks that aren't one of the default sizes aren't cached.
+  p2.Allocate(MemPoolTest::MAX_CHUNK_SIZE + 1);
+  p2.FreeAll();
+  EXPECT_EQ(cache.cached_bytes(), 3 * chunk_size);
+
+  // Chunks that don't fit into the cache any more are freed.
+  MemPool p3(&tracker);
+  for (int i = 0; i < 4; ++i) p3.Allocate(chunk_size);
+  p3.FreeAll();
+  EXPECT_LE(cache.cached_bytes(), 4 * chunk_size);
+  EXPECT_EQ(root.consumption(), cache.cached_bytes());
+}
+
 }
 
 int main(int argc, char **argv) {
@@ -20,6 +20,7 @@
 #include <algorithm>
 #include <stdio.h>
 #include <sstream>
+#include <boost/thread/locks.hpp>
 
 #include "common/names.h"
 
@@ -38,7 +39,8 @@ MemPool::MemPool(MemTracker* mem_tracker)
     total_allocated_bytes_(0),
     peak_allocated_bytes_(0),
     total_reserved_bytes_(0),
-    mem_tracker_(mem_tracker) {
+    mem_tracker_(mem_tracker),
+    chunk_cache_(mem_tracker->GetMemPoolChunkCache()) {
   DCHECK(mem_tracker != NULL);
 }
 
@@ -55,7 +57,7 @@ MemPool::~MemPool() {
   int64_t total_bytes_released = 0;
   for (size_t i = 0; i < chunks_.size(); ++i) {
     total_bytes_released += chunks_[i].size;
-    free(chunks_[i].data);
+    FreeChunk(chunks_[i]);
   }
 
   DCHECK(chunks_.empty()) << "Must call FreeAll() or AcquireData() for this pool";
@@ -78,7 +80,7 @@ void MemPool::FreeAll() {
   int64_t total_bytes_released = 0;
   for (size_t i = 0; i < chunks_.size(); ++i) {
     total_bytes_released += chunks_[i].size;
-    free(chunks_[i].data);
+    FreeChunk(chunks_[i]);
   }
   chunks_.clear();
   next_chunk_size_ = INITIAL_CHUNK_SIZE;
@@ -137,8 +139,10 @@ bool MemPool::FindChunk(int64_t min_size, bool check_limits) {
       mem_tracker_->Consume(chunk_size);
     }
 
-    // Allocate a new chunk. Return early if malloc fails.
-    uint8_t* buf = reinterpret_cast<uint8_t*>(malloc(chunk_size));
+    // Take a chunk from the cache or allocate a new one. Return early if malloc fails.
+    uint8_t* buf = NULL;
+    if (chunk_cache_ != NULL) buf = chunk_cache_->GetChunk(chunk_size);
+    if (buf == NULL) buf = reinterpret_cast<uint8_t*>(malloc(chunk_size));
     if (UNLIKELY(buf == NULL)) {
       mem_tracker_->Release(chunk_size);
       DCHECK_EQ(current_chunk_idx_, static_cast<int>(chunks_.size()));
@@ -215,6 +219,11 @@ void MemPool::AcquireData(MemPool* src, bool keep_current) {
   DCHECK(CheckIntegrity(false));
 }
 
+void MemPool::FreeChunk(const ChunkInfo& chunk) {
+  if (chunk_cache_ != NULL && chunk_cache_->ReturnChunk(chunk.data, chunk.size)) return;
+  free(chunk.data);
+}
+
 string MemPool::DebugString() {
   stringstream out;
   char str[16];
@@ -266,3 +275,54 @@ bool MemPool::CheckIntegrity(bool current_chunk_empty) {
   DCHECK_EQ(total_allocated, total_allocated_bytes_);
   return true;
 }
+
+MemPoolChunkCache::MemPoolChunkCache(int64_t max_bytes, MemTracker* parent)
+  : max_bytes_(max_bytes),
+    free_chunks_(
+        BitUtil::Log2(MemPool::MAX_CHUNK_SIZE / MemPool::INITIAL_CHUNK_SIZE) + 1),
+    cached_bytes_(0),
+    mem_tracker_(new MemTracker(-1, -1, "MemPool Chunk Cache", parent)) {
+}
+
+MemPoolChunkCache::~MemPoolChunkCache() {
+  for (int i = 0; i < free_chunks_.size(); ++i) {
+    for (int j = 0; j < free_chunks_[i].size(); ++j) free(free_chunks_[i][j]);
+  }
+  mem_tracker_->Release(cached_bytes_);
+  mem_tracker_->UnregisterFromParent();
+}
+
+int MemPoolChunkCache::SizeClass(int64_t size) const {
+  if (size < MemPool::INITIAL_CHUNK_SIZE || size > MemPool::MAX_CHUNK_SIZE) return -1;
+  if ((size & (size - 1)) != 0) return -1;
+  return BitUtil::Log2(size / MemPool::INITIAL_CHUNK_SIZE);
+}
+
+uint8_t* MemPoolChunkCache::GetChunk(int64_t size) {
+  int size_class = SizeClass(size);
+  if (size_class == -1) return NULL;
+  uint8_t* chunk;
+  {
+    lock_guard<SpinLock> l(lock_);
+    vector<uint8_t*>* free_chunks = &free_chunks_[size_class];
+    if (free_chunks->empty()) return NULL;
+    chunk = free_chunks->back();
+    free_chunks->pop_back();
+    cached_bytes_ -= size;
+  }
+  mem_tracker_->Release(size);
+  return chunk;
+}
+
+bool MemPoolChunkCache::ReturnChunk(uint8_t* chunk, int64_t size) {
+  int size_class = SizeClass(size);
+  if (size_class == -1) return false;
+  {
+    lock_guard<SpinLock> l(lock_);
+    if (cached_bytes_ + size > max_bytes_) return false;
+    free_chunks_[size_class].push_back(chunk);
+    cached_bytes_ += size;
+  }
+  mem_tracker_->Consume(size);
+  return true;
+}
@@ -21,12 +21,16 @@
 #include <vector>
 #include <string>
 
+#include <boost/scoped_ptr.hpp>
+
 #include "common/logging.h"
 #include "util/bit-util.h"
 #include "util/runtime-profile.h"
+#include "util/spinlock.h"
 
 namespace impala {
 
+class MemPoolChunkCache;
 class MemTracker;
 
 /// A MemPool maintains a list of memory chunks from which it allocates memory in
@@ -138,6 +142,7 @@ class MemPool {
   static const char* LLVM_CLASS_NAME;
 
  private:
+  friend class MemPoolChunkCache;
   friend class MemPoolTest;
   static const int INITIAL_CHUNK_SIZE = 4 * 1024;
 
@@ -185,6 +190,12 @@ class MemPool {
   /// total allocated_bytes_ since it includes bytes in chunks that are not used.
   MemTracker* mem_tracker_;
 
+  /// Cache that chunks are recycled through, or NULL. Not owned.
+  MemPoolChunkCache* chunk_cache_;
+
+  /// Returns 'chunk' to chunk_cache_, or frees it if the cache doesn't take it.
+  void FreeChunk(const ChunkInfo& chunk);
+
   /// Find or allocated a chunk with at least min_size spare capacity and update
   /// current_chunk_idx_. Also updates chunks_, chunk_sizes_ and allocated_bytes_
   /// if a new chunk needs to be created.
@@ -225,6 +236,52 @@ class MemPool {
   }
 };
 
+/// Cache of free MemPool chunks shared by the MemPools of one fragment instance, so
+/// that the chunks released by one row batch are reused by the next instead of going
+/// back to the allocator. This removes malloc() and free() from the steady state of
+/// scans, where every batch's pool grows through the same chunk sizes again.
+///
+/// Only chunks of the power-of-two sizes that MemPools allocate by default are cached,
+/// up to 'max_bytes' in total. The cached bytes are charged to the cache's own tracker,
+/// a child of 'parent', so they stay visible to the query's limits.
+///
+/// Thread-safe.
+class MemPoolChunkCache {
+ public:
+  MemPoolChunkCache(int64_t max_bytes, MemTracker* parent);
+
+  /// Frees the cached chunks. All pools using the cache must have been freed.
+  ~MemPoolChunkCache();
+
+  /// Returns a cached chunk of exactly 'size' bytes, or NULL if there is none.
+  uint8_t* GetChunk(int64_t size);
+
+  /// Takes ownership of 'chunk' of 'size' bytes and returns true if it can be cached.
+  /// Otherwise, returns false and the caller must free it.
+  bool ReturnChunk(uint8_t* chunk, int64_t size);
+
+  int64_t cached_bytes() const { return cached_bytes_; }
+
+ private:
+  const int64_t max_bytes_;
+
+  /// Protects free_chunks_ and cached_bytes_.
+  SpinLock lock_;
+
+  /// Free chunks by size class, the Log2 of the size in units of
+  /// MemPool::INITIAL_CHUNK_SIZE.
+  std::vector<std::vector<uint8_t*> > free_chunks_;
+
+  /// Sum of the sizes of the chunks in free_chunks_.
+  int64_t cached_bytes_;
+
+  /// Tracks the bytes of the cached chunks.
+  boost::scoped_ptr<MemTracker> mem_tracker_;
+
+  /// Returns the size class of chunks of 'size' bytes, or -1 if they aren't cached.
+  int SizeClass(int64_t size) const;
+};
+
 }
 
 #endif
@@ -53,6 +53,36 @@ TEST(MemTestTest, SingleTrackerWithLimit) {
   t.Release(5);
 }
 
+TEST(MemTestTest, ThreadBuffer) {
+  MemTracker p(1024 * 1024);
+  MemTracker c(-1, -1, "", &p);
+  {
+    MemTracker::ThreadBuffer buffer(&c);
+    // The buffer consumes ahead, so the trackers never report less than is used.
+    c.Consume(10);
+    EXPECT_GE(c.consumption(), 10);
+    EXPECT_EQ(c.consumption(), p.consumption());
+    int64_t consumption = c.consumption();
+    c.Consume(10);
+    EXPECT_EQ(c.consumption(), consumption);
+    c.Release(20);
+    EXPECT_EQ(c.consumption(), consumption);
+
+    // TryConsume() only takes from the trackers what the buffer doesn't cover, and
+    // succeeds up to the limit of the parent.
+    EXPECT_TRUE(c.TryConsume(p.limit() - 100));
+    EXPECT_EQ(p.consumption(), p.limit() - 100);
+    EXPECT_FALSE(c.TryConsume(101));
+    EXPECT_EQ(p.consumption(), p.limit() - 100);
+    EXPECT_TRUE(c.TryConsume(100));
+    EXPECT_EQ(p.consumption(), p.limit());
+    c.Release(p.limit());
+  }
+  // The buffer returned what it held.
+  EXPECT_EQ(c.consumption(), 0);
+  EXPECT_EQ(p.consumption(), 0);
+}
+
 TEST(MemTestTest, ConsumptionMetric) {
   TMetricDef md;
   md.__set_key("test");
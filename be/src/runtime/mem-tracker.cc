@@ -40,6 +40,9 @@ mutex MemTracker::static_mem_trackers_lock_;
 
 AtomicInt<int64_t> MemTracker::released_memory_since_gc_;
 
+// Innermost ThreadBuffer of the current thread. The buffers of a thread form a stack.
+static __thread MemTracker::ThreadBuffer* thread_buffer_stack = NULL;
+
 // Name for request pool MemTrackers. '$0' is replaced with the pool name.
 const string REQUEST_POOL_MEM_TRACKER_LABEL_FORMAT = "RequestPool=$0";
 
@@ -60,7 +63,8 @@ MemTracker::MemTracker(int64_t byte_limit, int64_t rm_reserved_limit, const stri
     num_gcs_metric_(NULL),
     bytes_freed_by_last_gc_metric_(NULL),
     bytes_over_limit_metric_(NULL),
-    limit_metric_(NULL) {
+    limit_metric_(NULL),
+    mem_pool_chunk_cache_(NULL) {
   if (parent != NULL) parent_->AddChildTracker(this);
   Init();
 }
@@ -83,7 +87,8 @@ MemTracker::MemTracker(
     num_gcs_metric_(NULL),
     bytes_freed_by_last_gc_metric_(NULL),
     bytes_over_limit_metric_(NULL),
-    limit_metric_(NULL) {
+    limit_metric_(NULL),
+    mem_pool_chunk_cache_(NULL) {
   if (parent != NULL) parent_->AddChildTracker(this);
   Init();
 }
@@ -105,7 +110,8 @@ MemTracker::MemTracker(UIntGauge* consumption_metric,
     num_gcs_metric_(NULL),
     bytes_freed_by_last_gc_metric_(NULL),
     bytes_over_limit_metric_(NULL),
-    limit_metric_(NULL) {
+    limit_metric_(NULL),
+    mem_pool_chunk_cache_(NULL) {
   Init();
 }
 
@@ -226,6 +232,61 @@ MemTracker::~MemTracker() {
   pool_to_mem_trackers_.erase(pool_name_);
 }
 
+MemTracker::ThreadBuffer::ThreadBuffer(MemTracker* tracker)
+  : tracker_(tracker),
+    bytes_(0),
+    prev_(thread_buffer_stack) {
+  DCHECK(tracker->consumption_metric_ == NULL);
+  thread_buffer_stack = this;
+  ++tracker_->num_thread_buffers_;
+}
+
+MemTracker::ThreadBuffer::~ThreadBuffer() {
+  DCHECK_EQ(thread_buffer_stack, this) << "destroyed out of order or by another thread";
+  thread_buffer_stack = prev_;
+  --tracker_->num_thread_buffers_;
+  if (bytes_ > 0) tracker_->ReleaseAll(bytes_);
+}
+
+MemTracker::ThreadBuffer* MemTracker::GetThreadBuffer() {
+  for (ThreadBuffer* buffer = thread_buffer_stack; buffer != NULL;
+      buffer = buffer->prev_) {
+    if (buffer->tracker_ == this) return buffer;
+  }
+  return NULL;
+}
+
+bool MemTracker::ConsumeFromThreadBuffer(int64_t bytes) {
+  ThreadBuffer* buffer = GetThreadBuffer();
+  if (buffer == NULL) return false;
+  if (buffer->bytes_ < bytes) {
+    int64_t refill_bytes = bytes - buffer->bytes_ + THREAD_BUFFER_BYTES;
+    ConsumeAll(refill_bytes);
+    buffer->bytes_ += refill_bytes;
+  }
+  buffer->bytes_ -= bytes;
+  return true;
+}
+
+bool MemTracker::ReleaseToThreadBuffer(int64_t bytes) {
+  ThreadBuffer* buffer = GetThreadBuffer();
+  if (buffer == NULL) return false;
+  buffer->bytes_ += bytes;
+  if (buffer->bytes_ > 2 * THREAD_BUFFER_BYTES) {
+    ReleaseAll(buffer->bytes_ - THREAD_BUFFER_BYTES);
+    buffer->bytes_ = THREAD_BUFFER_BYTES;
+  }
+  return true;
+}
+
+int64_t MemTracker::TakeFromThreadBuffer(int64_t bytes) {
+  ThreadBuffer* buffer = GetThreadBuffer();
+  if (buffer == NULL) return 0;
+  int64_t taken_bytes = min(bytes, buffer->bytes_);
+  buffer->bytes_ -= taken_bytes;
+  return taken_bytes;
+}
+
 void MemTracker::RegisterMetrics(MetricGroup* metrics, const string& prefix) {
   num_gcs_metric_ = metrics->AddCounter<int64_t>(Substitute("$0.num-gcs", prefix), 0);
 
@@ -36,6 +36,7 @@
 
 namespace impala {
 
+class MemPoolChunkCache;
 class MemTracker;
 class QueryResourceMgr;
 
@@ -81,6 +82,30 @@ class MemTracker {
 
   ~MemTracker();
 
+  /// Batches the Consume() and Release() calls that the thread that creates it makes on
+  /// 'tracker', for the lifetime of the object, so that the thread doesn't update the
+  /// consumption of the tracker and its ancestors on every call. The buffer consumes up
+  /// to THREAD_BUFFER_BYTES ahead from the tracker and serves the thread's calls from
+  /// that. The tracker's consumption is therefore never lower than the actual one, and
+  /// TryConsume() is exact: it only consumes from the tracker what the buffer can't
+  /// cover. Must be destroyed by the thread that created it, before 'tracker'.
+  class ThreadBuffer {
+   public:
+    ThreadBuffer(MemTracker* tracker);
+    ~ThreadBuffer();
+
+   private:
+    friend class MemTracker;
+
+    MemTracker* const tracker_;
+
+    /// Bytes consumed from 'tracker_' that the thread didn't use yet.
+    int64_t bytes_;
+
+    /// The thread's buffer that was innermost before this one, or NULL.
+    ThreadBuffer* const prev_;
+  };
+
   /// Removes this tracker from parent_->child_trackers_.
   void UnregisterFromParent();
 
@@ -126,13 +151,8 @@ class MemTracker {
       return;
     }
     if (UNLIKELY(enable_logging_)) LogUpdate(true, bytes);
-    for (std::vector<MemTracker*>::iterator tracker = all_trackers_.begin();
-         tracker != all_trackers_.end(); ++tracker) {
-      (*tracker)->consumption_->Add(bytes);
-      if ((*tracker)->consumption_metric_ == NULL) {
-        DCHECK_GE((*tracker)->consumption_->current_value(), 0);
-      }
-    }
+    if (UNLIKELY(num_thread_buffers_ > 0) && ConsumeFromThreadBuffer(bytes)) return;
+    ConsumeAll(bytes);
   }
 
   /// Increases/Decreases the consumption of this tracker and the ancestors up to (but
@@ -162,6 +182,12 @@ class MemTracker {
     if (consumption_metric_ != NULL) RefreshConsumptionFromMetric();
     if (bytes <= 0) return true;
     if (UNLIKELY(enable_logging_)) LogUpdate(true, bytes);
+    int64_t buffered_bytes = 0;
+    if (UNLIKELY(num_thread_buffers_ > 0)) {
+      buffered_bytes = TakeFromThreadBuffer(bytes);
+      bytes -= buffered_bytes;
+      if (bytes == 0) return true;
+    }
     int i = 0;
     // Walk the tracker tree top-down, to avoid expanding a limit on a child whose parent
     // won't accommodate the change.
@@ -209,6 +235,7 @@ class MemTracker {
     for (int j = all_trackers_.size() - 1; j > i; --j) {
       all_trackers_[j]->consumption_->Add(-bytes);
     }
+    if (buffered_bytes > 0) ReleaseToThreadBuffer(buffered_bytes);
     return false;
   }
 
@@ -229,20 +256,8 @@ class MemTracker {
       return;
     }
     if (UNLIKELY(enable_logging_)) LogUpdate(false, bytes);
-    for (std::vector<MemTracker*>::iterator tracker = all_trackers_.begin();
-         tracker != all_trackers_.end(); ++tracker) {
-      (*tracker)->consumption_->Add(-bytes);
-      /// If a UDF calls FunctionContext::TrackAllocation() but allocates less than the
-      /// reported amount, the subsequent call to FunctionContext::Free() may cause the
-      /// process mem tracker to go negative until it is synced back to the tcmalloc
-      /// metric. Don't blow up in this case. (Note that this doesn't affect non-process
-      /// trackers since we can enforce that the reported memory usage is internally
-      /// consistent.)
-      if ((*tracker)->consumption_metric_ == NULL) {
-        DCHECK_GE((*tracker)->consumption_->current_value(), 0)
-          << std::endl << (*tracker)->LogUsage();
-      }
-    }
+    if (UNLIKELY(num_thread_buffers_ > 0) && ReleaseToThreadBuffer(bytes)) return;
+    ReleaseAll(bytes);
 
     /// TODO: Release brokered memory?
   }
@@ -319,6 +334,22 @@ class MemTracker {
 
   MemTracker* parent() const { return parent_; }
 
+  /// Makes the MemPools that are created afterwards with this tracker or one of its
+  /// descendants as their tracker recycle their chunks through 'cache'. The cache must
+  /// outlive these pools.
+  void set_mem_pool_chunk_cache(MemPoolChunkCache* cache) {
+    mem_pool_chunk_cache_ = cache;
+  }
+
+  /// Returns the chunk cache of this tracker or of its closest ancestor that has one,
+  /// or NULL if there is none.
+  MemPoolChunkCache* GetMemPoolChunkCache() {
+    for (MemTracker* tracker = this; tracker != NULL; tracker = tracker->parent_) {
+      if (tracker->mem_pool_chunk_cache_ != NULL) return tracker->mem_pool_chunk_cache_;
+    }
+    return NULL;
+  }
+
   /// Signature for function that can be called to free some memory after limit is reached.
   typedef boost::function<void ()> GcFunction;
 
@@ -344,6 +375,52 @@ class MemTracker {
  private:
   bool CheckLimitExceeded() const { return limit_ >= 0 && limit_ < consumption(); }
 
+  /// Adds 'bytes' to the consumption of this tracker and its ancestors.
+  void ConsumeAll(int64_t bytes) {
+    for (std::vector<MemTracker*>::iterator tracker = all_trackers_.begin();
+         tracker != all_trackers_.end(); ++tracker) {
+      (*tracker)->consumption_->Add(bytes);
+      if ((*tracker)->consumption_metric_ == NULL) {
+        DCHECK_GE((*tracker)->consumption_->current_value(), 0);
+      }
+    }
+  }
+
+  /// Subtracts 'bytes' from the consumption of this tracker and its ancestors.
+  void ReleaseAll(int64_t bytes) {
+    for (std::vector<MemTracker*>::iterator tracker = all_trackers_.begin();
+         tracker != all_trackers_.end(); ++tracker) {
+      (*tracker)->consumption_->Add(-bytes);
+      /// If a UDF calls FunctionContext::TrackAllocation() but allocates less than the
+      /// reported amount, the subsequent call to FunctionContext::Free() may cause the
+      /// process mem tracker to go negative until it is synced back to the tcmalloc
+      /// metric. Don't blow up in this case. (Note that this doesn't affect non-process
+      /// trackers since we can enforce that the reported memory usage is internally
+      /// consistent.)
+      if ((*tracker)->consumption_metric_ == NULL) {
+        DCHECK_GE((*tracker)->consumption_->current_value(), 0)
+          << std::endl << (*tracker)->LogUsage();
+      }
+    }
+  }
+
+  /// Returns the current thread's innermost ThreadBuffer for this tracker, or NULL.
+  /// Out of line, since codegen'd code can't access thread-local variables.
+  ThreadBuffer* GetThreadBuffer();
+
+  /// If the current thread has a buffer for this tracker, consumes 'bytes' from it,
+  /// refilling it from the tracker if needed, and returns true. Otherwise returns false.
+  bool ConsumeFromThreadBuffer(int64_t bytes);
+
+  /// If the current thread has a buffer for this tracker, adds 'bytes' to it, releasing
+  /// anything beyond 2 * THREAD_BUFFER_BYTES to the tracker, and returns true. Otherwise
+  /// returns false.
+  bool ReleaseToThreadBuffer(int64_t bytes);
+
+  /// Takes up to 'bytes' from the current thread's buffer for this tracker, without
+  /// refilling it, and returns how many it took.
+  int64_t TakeFromThreadBuffer(int64_t bytes);
+
   /// If consumption is higher than max_consumption, attempts to free memory by calling any
   /// added GC functions.  Returns true if max_consumption is still exceeded. Takes
   /// gc_lock. Updates metrics if initialized.
@@ -385,6 +462,9 @@ class MemTracker {
   /// TODO: this is a stopgap.
   static const int64_t GC_RELEASE_SIZE = 128 * 1024L * 1024L;
 
+  /// Bytes that a ThreadBuffer consumes ahead from its tracker.
+  static const int64_t THREAD_BUFFER_BYTES = 256 * 1024L;
+
   /// Total amount of memory from calls to Release() since the last GC. If this
   /// is greater than GC_RELEASE_SIZE, this will trigger a tcmalloc gc.
   static AtomicInt<int64_t> released_memory_since_gc_;
@@ -440,6 +520,10 @@ class MemTracker {
   std::vector<MemTracker*> all_trackers_;  // this tracker plus all of its ancestors
   std::vector<MemTracker*> limit_trackers_;  // all_trackers_ with valid limits
 
+  /// Number of ThreadBuffers for this tracker in any thread. Consume() and Release()
+  /// only look for a buffer of the current thread if it is non-zero.
+  AtomicInt<int> num_thread_buffers_;
+
   /// All the child trackers of this tracker. Used only for computing resource pool mem
   /// reserved and error reporting, i.e., updating a parent tracker does not update its
   /// children.
@@ -491,6 +575,9 @@ class MemTracker {
 
   /// Metric for limit_.
   IntGauge* limit_metric_;
+
+  /// See set_mem_pool_chunk_cache(). Not owned.
+  MemPoolChunkCache* mem_pool_chunk_cache_;
 };
 
 }
@@ -30,6 +30,7 @@
 #include "exec/hdfs-scan-node.h"
 #include "exec/hbase-table-scanner.h"
 #include "exprs/expr.h"
+#include "runtime/buffered-block-mgr.h"
 #include "runtime/descriptors.h"
 #include "runtime/data-stream-mgr.h"
 #include "runtime/row-batch.h"
@@ -42,11 +43,19 @@
 #include "util/mem-info.h"
 #include "util/periodic-counter-updater.h"
 #include "util/llama-util.h"
+#include "util/lock-profiler.h"
 #include "util/pretty-printer.h"
+#include "util/sampling-profiler.h"
 
 DEFINE_bool(serialize_batch, false, "serialize and deserialize each returned row batch");
 DEFINE_int32(status_report_interval, 5, "interval between profile reports; in seconds");
+DEFINE_bool(enforce_fragment_buffer_reservations, false, "(Advanced) If true, a fragment "
+    "instance fails in Prepare() if the block mgr can't reserve the minimum buffers of "
+    "its spilling operators, instead of running oversubscribed and possibly failing "
+    "mid-execution.");
+DECLARE_bool(async_codegen);
 DECLARE_bool(enable_rm);
+DECLARE_bool(enable_pool_cgroups);
 
 #include "common/names.h"
 
@@ -60,13 +69,17 @@ namespace impala {
 
 const string PlanFragmentExecutor::PER_HOST_PEAK_MEM_COUNTER = "PerHostPeakMemUsage";
 
+AtomicInt<int64_t> PlanFragmentExecutor::total_codegen_time_ns_;
+AtomicInt<int64_t> PlanFragmentExecutor::num_codegen_fragments_;
+
 PlanFragmentExecutor::PlanFragmentExecutor(ExecEnv* exec_env,
     const ReportStatusCallback& report_status_cb) :
     exec_env_(exec_env), plan_(NULL), report_status_cb_(report_status_cb),
     report_thread_active_(false), done_(false), closed_(false),
-    has_thread_token_(false), is_prepared_(false), is_cancelled_(false),
+    has_thread_token_(false), num_reserved_buffers_(0), is_prepared_(false),
+    is_cancelled_(false),
     average_thread_tokens_(NULL), mem_usage_sampled_counter_(NULL),
-    thread_usage_sampled_counter_(NULL) {
+    thread_usage_sampled_counter_(NULL), spilled_bytes_sampled_counter_(NULL) {
 }
 
 PlanFragmentExecutor::~PlanFragmentExecutor() {
@@ -88,6 +101,8 @@ Status PlanFragmentExecutor::Prepare(const TExecPlanFragmentParams& request) {
   fragment_sw_.Start();
   const TPlanFragmentExecParams& params = request.params;
   query_id_ = request.fragment_instance_ctx.query_ctx.query_id;
+  SamplingProfiler::ScopedTag sampling_tag(query_id_,
+      request.fragment_instance_ctx.fragment_instance_id);
 
   VLOG_QUERY << "Prepare(): query_id=" << PrintId(query_id_) << " instance_id="
              << PrintId(request.fragment_instance_ctx.fragment_instance_id);
@@ -101,6 +116,16 @@ Status PlanFragmentExecutor::Prepare(const TExecPlanFragmentParams& request) {
   string cgroup = "";
   if (FLAGS_enable_rm && request.__isset.reserved_resource) {
     cgroup = exec_env_->cgroups_mgr()->UniqueIdToCgroup(PrintId(query_id_, "_"));
+  } else if (!FLAGS_enable_rm && FLAGS_enable_pool_cgroups &&
+      params.__isset.request_pool) {
+    Status status =
+        exec_env_->cgroups_mgr()->GetPoolCgroup(params.request_pool, &cgroup);
+    if (!status.ok()) {
+      // The fragment still runs, only without CPU isolation.
+      LOG(WARNING) << "Could not use the cgroup of pool " << params.request_pool
+                   << ": " << status.GetDetail();
+      cgroup = "";
+    }
   }
 
   // Prepare() must not return before runtime_state_ is set if is_prepared_ was
@@ -192,12 +217,16 @@ Status PlanFragmentExecutor::Prepare(const TExecPlanFragmentParams& request) {
       TUnit::UNIT,
       bind<int64_t>(mem_fn(&ThreadResourceMgr::ResourcePool::num_threads),
           runtime_state_->resource_pool()));
+  spilled_bytes_sampled_counter_ = profile()->AddTimeSeriesCounter("SpilledBytes",
+      TUnit::BYTES,
+      bind<int64_t>(mem_fn(&BufferedBlockMgr::bytes_written),
+          runtime_state_->block_mgr()));
 
   // set up desc tbl
   DescriptorTbl* desc_tbl = NULL;
   DCHECK(request.__isset.desc_tbl);
-  RETURN_IF_ERROR(
-      DescriptorTbl::Create(obj_pool(), request.desc_tbl, &desc_tbl));
+  RETURN_IF_ERROR(DescriptorTbl::Create(obj_pool(), request.desc_tbl, &desc_tbl,
+      runtime_state_->query_options().compact_tuple_layout));
   runtime_state_->set_desc_tbl(desc_tbl);
   VLOG_QUERY << "descriptor table for fragment="
              << request.fragment_instance_ctx.fragment_instance_id
@@ -205,6 +234,7 @@ Status PlanFragmentExecutor::Prepare(const TExecPlanFragmentParams& request) {
 
   // set up plan
   DCHECK(request.__isset.fragment);
+  MaybeDisableCodegen(request.fragment.plan);
   RETURN_IF_ERROR(ExecNode::CreateTree(runtime_state_.get(), request.fragment.plan,
       *desc_tbl, &plan_));
   runtime_state_->set_fragment_root_id(plan_->id());
@@ -244,6 +274,7 @@ Status PlanFragmentExecutor::Prepare(const TExecPlanFragmentParams& request) {
     SCOPED_TIMER(prepare_timer);
     RETURN_IF_ERROR(plan_->Prepare(runtime_state_.get()));
   }
+  RETURN_IF_ERROR(ReserveBuffers());
 
   PrintVolumeIds(params.per_node_scan_ranges);
 
@@ -275,13 +306,54 @@ Status PlanFragmentExecutor::Prepare(const TExecPlanFragmentParams& request) {
   return Status::OK();
 }
 
+void PlanFragmentExecutor::MaybeDisableCodegen(const TPlan& plan) {
+  int64_t threshold = runtime_state_->query_options().disable_codegen_rows_threshold;
+  if (threshold <= 0 || !runtime_state_->codegen_enabled()) return;
+  int64_t max_cardinality = 0;
+  for (int i = 0; i < plan.nodes.size(); ++i) {
+    const TPlanNode& node = plan.nodes[i];
+    // Without stats the planner estimates -1, and codegen stays enabled.
+    if (!node.__isset.estimated_stats || !node.estimated_stats.__isset.cardinality ||
+        node.estimated_stats.cardinality < 0) {
+      return;
+    }
+    max_cardinality = max(max_cardinality, node.estimated_stats.cardinality);
+  }
+  if (max_cardinality >= threshold) return;
+  runtime_state_->DisableCodegenForFragment();
+  profile()->AddInfoString("CodegenDisabled", Substitute(
+      "Estimated max rows per node $0 is below the threshold of $1", max_cardinality,
+      threshold));
+  int64_t num_fragments = num_codegen_fragments_.Read();
+  if (num_fragments > 0) {
+    RuntimeProfile::Counter* saved_time =
+        ADD_TIMER(profile(), "EstimatedCodegenTimeSaved");
+    saved_time->Set(total_codegen_time_ns_.Read() / num_fragments);
+  }
+}
+
 void PlanFragmentExecutor::OptimizeLlvmModule() {
   if (!runtime_state_->codegen_created()) return;
   LlvmCodeGen* codegen;
   Status status = runtime_state_->GetCodegen(&codegen, /* initalize */ false);
   DCHECK(status.ok());
   DCHECK(codegen != NULL);
+  if (FLAGS_async_codegen && codegen->CanFinalizeAsync()) {
+    profile()->AddInfoString("AsyncCodegen", "true");
+    codegen_thread_.reset(new Thread("plan-fragment-executor", "codegen",
+        &PlanFragmentExecutor::FinalizeLlvmModule, this));
+    return;
+  }
+  FinalizeLlvmModule();
+}
+
+void PlanFragmentExecutor::FinalizeLlvmModule() {
+  LlvmCodeGen* codegen;
+  Status status = runtime_state_->GetCodegen(&codegen, /* initalize */ false);
+  DCHECK(status.ok());
   status = codegen->FinalizeModule();
+  total_codegen_time_ns_ += codegen->runtime_profile()->total_time_counter()->value();
+  ++num_codegen_fragments_;
   if (!status.ok()) {
     stringstream ss;
     ss << "Error with codegen for this query: " << status.GetDetail();
@@ -310,6 +382,9 @@ void PlanFragmentExecutor::PrintVolumeIds(
 Status PlanFragmentExecutor::Open() {
   VLOG_QUERY << "Open(): instance_id="
       << runtime_state_->fragment_instance_id();
+  SamplingProfiler::ScopedTag sampling_tag(query_id_,
+      runtime_state_->fragment_instance_id());
+  LockProfiler::ScopedWaitCounter lock_wait(runtime_state_->total_lock_wait_timer());
   // we need to start the profile-reporting thread before calling Open(), since it
   // may block
   if (!report_status_cb_.empty() && FLAGS_status_report_interval > 0) {
@@ -373,6 +448,13 @@ Status PlanFragmentExecutor::OpenInternal() {
     }
     SCOPED_TIMER(profile()->total_time_counter());
     RETURN_IF_ERROR(sink_->Send(runtime_state(), batch, done_));
+    if (!done_ && !sink_->NeedsMoreRows()) {
+      // E.g. the exchange nodes receiving from this fragment reached their limits.
+      // Closing the plan afterwards cancels the remaining scans.
+      VLOG_QUERY << "Sink needs no more rows, finishing fragment instance "
+                 << PrintId(runtime_state_->fragment_instance_id()) << " early";
+      break;
+    }
   }
 
   // Flush the sink *before* stopping the report thread. Flush may need to add some
@@ -467,6 +549,9 @@ void PlanFragmentExecutor::StopReportThread() {
 Status PlanFragmentExecutor::GetNext(RowBatch** batch) {
   VLOG_FILE << "GetNext(): instance_id="
       << runtime_state_->fragment_instance_id();
+  SamplingProfiler::ScopedTag sampling_tag(query_id_,
+      runtime_state_->fragment_instance_id());
+  LockProfiler::ScopedWaitCounter lock_wait(runtime_state_->total_lock_wait_timer());
   Status status = GetNextInternal(batch);
   UpdateStatus(status);
   if (done_) {
@@ -578,8 +663,34 @@ void PlanFragmentExecutor::ReleaseThreadToken() {
   }
 }
 
+Status PlanFragmentExecutor::ReserveBuffers() {
+  BufferedBlockMgr* block_mgr = runtime_state_->block_mgr();
+  int min_buffers = 0;
+  int desired_buffers = 0;
+  plan_->CollectBufferRequirements(block_mgr->max_block_size(), &min_buffers,
+      &desired_buffers);
+  if (desired_buffers == 0) return Status::OK();
+  COUNTER_SET(ADD_COUNTER(profile(), "MinBlockMgrBuffers", TUnit::UNIT), min_buffers);
+  COUNTER_SET(ADD_COUNTER(profile(), "DesiredBlockMgrBuffers", TUnit::UNIT),
+      desired_buffers);
+  Status status = block_mgr->ReserveFragmentBuffers(min_buffers, desired_buffers,
+      &num_reserved_buffers_);
+  if (!status.ok()) {
+    if (FLAGS_enforce_fragment_buffer_reservations) return status;
+    // Run oversubscribed, as the operators did before reservations were negotiated.
+    VLOG_QUERY << "Fragment instance " << PrintId(runtime_state_->fragment_instance_id())
+               << " runs oversubscribed: " << status.GetDetail();
+    num_reserved_buffers_ = 0;
+  }
+  COUNTER_SET(ADD_COUNTER(profile(), "ReservedBlockMgrBuffers", TUnit::UNIT),
+      num_reserved_buffers_);
+  return Status::OK();
+}
+
 void PlanFragmentExecutor::Close() {
   if (closed_) return;
+  // The codegen thread writes to the function pointers of the exec nodes.
+  if (codegen_thread_.get() != NULL) codegen_thread_->Join();
   row_batch_.reset();
   // Prepare may not have been called, which sets runtime_state_
   if (runtime_state_.get() != NULL) {
@@ -588,6 +699,10 @@ void PlanFragmentExecutor::Close() {
           runtime_state_->fragment_instance_id(), runtime_state_->cgroup());
     }
     if (plan_ != NULL) plan_->Close(runtime_state_.get());
+    if (num_reserved_buffers_ > 0) {
+      runtime_state_->block_mgr()->ReleaseFragmentBuffers(num_reserved_buffers_);
+      num_reserved_buffers_ = 0;
+    }
     BOOST_FOREACH(DiskIoMgr::RequestContext* context,
         *runtime_state_->reader_contexts()) {
       runtime_state_->io_mgr()->UnregisterContext(context);
@@ -599,6 +714,10 @@ void PlanFragmentExecutor::Close() {
     PeriodicCounterUpdater::StopTimeSeriesCounter(mem_usage_sampled_counter_);
     mem_usage_sampled_counter_ = NULL;
   }
+  if (spilled_bytes_sampled_counter_ != NULL) {
+    PeriodicCounterUpdater::StopTimeSeriesCounter(spilled_bytes_sampled_counter_);
+    spilled_bytes_sampled_counter_ = NULL;
+  }
   closed_ = true;
 }
 
@@ -21,6 +21,7 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
 
+#include "common/atomic.h"
 #include "common/status.h"
 #include "common/object-pool.h"
 #include "runtime/runtime-state.h"
@@ -150,6 +151,16 @@ class PlanFragmentExecutor {
   ExecNode* plan_;  // lives in runtime_state_->obj_pool()
   TUniqueId query_id_;
 
+  /// Sum of the total codegen times of the fragments that finalized a codegen module in
+  /// this process, and their number. Used to estimate the time saved by
+  /// MaybeDisableCodegen().
+  static AtomicInt<int64_t> total_codegen_time_ns_;
+  static AtomicInt<int64_t> num_codegen_fragments_;
+
+  /// Runs FinalizeLlvmModule() if the module is compiled asynchronously. Joined in
+  /// Close().
+  boost::scoped_ptr<Thread> codegen_thread_;
+
   /// profile reporting-related
   ReportStatusCallback report_status_cb_;
   boost::scoped_ptr<Thread> report_thread_;
@@ -173,6 +184,10 @@ class PlanFragmentExecutor {
   /// true if this fragment has not returned the thread token to the thread resource mgr
   bool has_thread_token_;
 
+  /// Number of block mgr buffers reserved up front for this fragment instance with
+  /// BufferedBlockMgr::ReserveFragmentBuffers(). Released in Close().
+  int num_reserved_buffers_;
+
   /// Overall execution status. Either ok() or set to the first error status that
   /// was encountered.
   Status status_;
@@ -239,6 +254,11 @@ class PlanFragmentExecutor {
   /// Sampled thread usage (tokens) at even time intervals.
   RuntimeProfile::TimeSeriesCounter* thread_usage_sampled_counter_;
 
+  /// Sampled number of bytes the block mgr wrote to scratch files at even time
+  /// intervals. The block mgr is shared by the fragment instances of the query on this
+  /// host, so this is the spilling of all of them.
+  RuntimeProfile::TimeSeriesCounter* spilled_bytes_sampled_counter_;
+
   ObjectPool* obj_pool() { return runtime_state_->obj_pool(); }
 
   /// typedef for TPlanFragmentExecParams.per_node_scan_ranges
@@ -268,8 +288,26 @@ class PlanFragmentExecutor {
   /// PlanFragmentExecutor()::Prepare() to allow starting plan fragments more
   /// quickly and in parallel (in a deep plan tree, the fragments are started
   /// in level order).
+  /// With --async_codegen, if the codegen'd functions all have an interpreted fallback,
+  /// the module is finalized on codegen_thread_ instead and the fragment starts
+  /// executing with the interpreted functions.
   void OptimizeLlvmModule();
 
+  /// Calls FinalizeModule() on the codegen object and logs errors.
+  void FinalizeLlvmModule();
+
+  /// Negotiates the block mgr buffers that the spilling nodes of plan_ need with
+  /// BufferedBlockMgr::ReserveFragmentBuffers() and records the result in the profile.
+  /// Only fails if the minimum can't be reserved and
+  /// --enforce_fragment_buffer_reservations is set. Called after plan_ is prepared.
+  Status ReserveBuffers();
+
+  /// Disables codegen for this fragment if the planner estimates that every node of
+  /// 'plan' produces fewer rows than the disable_codegen_rows_threshold query option.
+  /// Records the decision and the average codegen time of earlier fragments, which it
+  /// is expected to save, in the profile. Called before plan_ is prepared.
+  void MaybeDisableCodegen(const TPlan& plan);
+
   /// Executes Open() logic and returns resulting status. Does not set status_.
   /// If this plan fragment has no sink, OpenInternal() does nothing.
   /// If this plan fragment has a sink and OpenInternal() returns without an
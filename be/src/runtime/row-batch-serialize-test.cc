@@ -48,10 +48,16 @@ class RowBatchSerializeTest : public testing::Test {
   // and has the same contents as 'batch'.
   void TestRowBatch(const RowDescriptor& row_desc, RowBatch* batch, bool print_batches,
       bool full_dedup = false) {
+    TestRowBatch(row_desc, batch, print_batches,
+        full_dedup ? RowBatch::FULL_DEDUP : RowBatch::ADJACENT_DEDUP);
+  }
+
+  void TestRowBatch(const RowDescriptor& row_desc, RowBatch* batch, bool print_batches,
+      RowBatch::DedupMode dedup_mode) {
     if (print_batches) cout << PrintBatch(batch) << endl;
 
     TRowBatch trow_batch;
-    EXPECT_OK(batch->Serialize(&trow_batch, full_dedup));
+    EXPECT_OK(batch->Serialize(&trow_batch, dedup_mode));
 
     RowBatch deserialized_batch(row_desc, trow_batch, tracker_.get());
     if (print_batches) cout << PrintBatch(&deserialized_batch) << endl;
@@ -273,7 +279,7 @@ class RowBatchSerializeTest : public testing::Test {
   // Helper to access internal state of batch (this class is friend of RowBatch).
   bool UseFullDedup(RowBatch* batch) { return batch->UseFullDedup(); }
 
-  void TestDupCorrectness(bool full_dedup);
+  void TestDupCorrectness(RowBatch::DedupMode dedup_mode);
 
   void TestDupRemoval(bool full_dedup);
 
@@ -312,6 +318,45 @@ TEST_F(RowBatchSerializeTest, String) {
   TestRowBatch(row_desc, batch, true);
 }
 
+TEST_F(RowBatchSerializeTest, CompactLayout) {
+  // tuple 0: (tinyint, bigint, int, string, smallint, boolean)
+  // tuple 1: (int, string, int)
+  DescriptorTblBuilder builder(&pool_);
+  builder.DeclareTuple() << TYPE_TINYINT << TYPE_BIGINT << TYPE_INT << TYPE_STRING
+                         << TYPE_SMALLINT << TYPE_BOOLEAN;
+  builder.DeclareTuple() << TYPE_INT << TYPE_STRING << TYPE_INT;
+  DescriptorTbl* desc_tbl = builder.Build(true);
+
+  // The null byte is followed by the tinyint, boolean and smallint. The int doesn't fit
+  // before the first 8-byte boundary and is placed after the 8-byte aligned slots.
+  TupleDescriptor* tuple_desc = desc_tbl->GetTupleDescriptor(0);
+  const vector<SlotDescriptor*>& slots = tuple_desc->slots();
+  EXPECT_EQ(tuple_desc->num_null_bytes(), 1);
+  EXPECT_EQ(slots[0]->tuple_offset(), 1);
+  EXPECT_EQ(slots[5]->tuple_offset(), 2);
+  EXPECT_EQ(slots[4]->tuple_offset(), 4);
+  EXPECT_EQ(slots[1]->tuple_offset(), 8);
+  EXPECT_EQ(slots[3]->tuple_offset(), 16);
+  EXPECT_EQ(slots[2]->tuple_offset(), 32);
+  EXPECT_EQ(tuple_desc->byte_size(), 40);
+  for (int i = 0; i < slots.size(); ++i) {
+    EXPECT_EQ(slots[i]->null_indicator_offset().byte_offset, 0);
+    EXPECT_EQ(slots[i]->null_indicator_offset().bit_mask, 1 << i);
+  }
+
+  // Tuples with the compact layout round-trip.
+  TupleDescriptor* tuple_desc1 = desc_tbl->GetTupleDescriptor(1);
+  EXPECT_EQ(tuple_desc1->slots()[0]->tuple_offset(), 4);
+  EXPECT_EQ(tuple_desc1->slots()[1]->tuple_offset(), 8);
+  EXPECT_EQ(tuple_desc1->slots()[2]->tuple_offset(), 24);
+  EXPECT_EQ(tuple_desc1->byte_size(), 32);
+  vector<bool> nullable_tuples(1, false);
+  vector<TTupleId> tuple_id(1, (TTupleId) 1);
+  RowDescriptor row_desc(*desc_tbl, tuple_id, nullable_tuples);
+  RowBatch* batch = CreateRowBatch(row_desc);
+  TestRowBatch(row_desc, batch, true);
+}
+
 TEST_F(RowBatchSerializeTest, BasicArray) {
   // tuple: (int, string, array<int>)
   ColumnType array_type;
@@ -401,15 +446,19 @@ TEST_F(RowBatchSerializeTest, NestedArrays) {
 }
 
 // Test that we get correct result when serializing/deserializing with duplicates
+TEST_F(RowBatchSerializeTest, DupCorrectnessNone) {
+  TestDupCorrectness(RowBatch::NO_DEDUP);
+}
+
 TEST_F(RowBatchSerializeTest, DupCorrectnessAdjacent) {
-  TestDupCorrectness(false);
+  TestDupCorrectness(RowBatch::ADJACENT_DEDUP);
 }
 
 TEST_F(RowBatchSerializeTest, DupCorrectnessFull) {
-  TestDupCorrectness(true);
+  TestDupCorrectness(RowBatch::FULL_DEDUP);
 }
 
-void RowBatchSerializeTest::TestDupCorrectness(bool full_dedup) {
+void RowBatchSerializeTest::TestDupCorrectness(RowBatch::DedupMode dedup_mode) {
   // tuples: (int), (string)
   DescriptorTblBuilder builder(&pool_);
   builder.DeclareTuple() << TYPE_INT;
@@ -438,7 +487,7 @@ void RowBatchSerializeTest::TestDupCorrectness(bool full_dedup) {
   CreateTuples(*row_desc.tuple_descriptors()[1], batch->tuple_data_pool(),
       distinct_string_tuples, 0, 10, &distinct_tuples[1]);
   AddTuplesToRowBatch(num_rows, distinct_tuples, repeats, batch);
-  TestRowBatch(row_desc, batch, false, full_dedup);
+  TestRowBatch(row_desc, batch, false, dedup_mode);
 }
 
 TEST_F(RowBatchSerializeTest, DupRemovalAdjacent) {
@@ -480,6 +529,51 @@ void RowBatchSerializeTest::TestDupRemoval(bool full_dedup) {
   TestRowBatch(row_desc, batch, false, full_dedup);
 }
 
+// Test that the deduplication mode follows the duplicates found in measured batches.
+TEST_F(RowBatchSerializeTest, DedupPolicy) {
+  TupleDedupPolicy policy;
+  // The first batch is measured.
+  EXPECT_EQ(policy.NextMode(), RowBatch::FULL_DEDUP);
+  RowBatch::DedupStats no_dups;
+  no_dups.num_tuples = 1000;
+  policy.Update(RowBatch::FULL_DEDUP, no_dups);
+  EXPECT_EQ(policy.mode(), RowBatch::NO_DEDUP);
+
+  // Measuring a batch again that confirms the mode doubles the sampling interval.
+  RowBatch::DedupStats empty;
+  for (int interval = 4; interval <= 8; interval *= 2) {
+    for (int i = 0; i < interval; ++i) {
+      EXPECT_EQ(policy.NextMode(), RowBatch::NO_DEDUP);
+      policy.Update(RowBatch::NO_DEDUP, empty);
+    }
+    EXPECT_EQ(policy.NextMode(), RowBatch::FULL_DEDUP);
+    if (interval == 4) policy.Update(RowBatch::FULL_DEDUP, no_dups);
+  }
+
+  // Only adjacent duplicates.
+  RowBatch::DedupStats adjacent_dups;
+  adjacent_dups.num_tuples = 1000;
+  adjacent_dups.num_adjacent_dups = 500;
+  adjacent_dups.num_dups = 550;
+  policy.Update(RowBatch::FULL_DEDUP, adjacent_dups);
+  EXPECT_EQ(policy.mode(), RowBatch::ADJACENT_DEDUP);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(policy.NextMode(), RowBatch::ADJACENT_DEDUP);
+    policy.Update(RowBatch::ADJACENT_DEDUP, empty);
+  }
+  EXPECT_EQ(policy.NextMode(), RowBatch::FULL_DEDUP);
+
+  // Many non-adjacent duplicates: every batch is deduplicated fully until they stop.
+  RowBatch::DedupStats full_dups = adjacent_dups;
+  full_dups.num_dups = 800;
+  policy.Update(RowBatch::FULL_DEDUP, full_dups);
+  EXPECT_EQ(policy.mode(), RowBatch::FULL_DEDUP);
+  policy.Update(RowBatch::FULL_DEDUP, full_dups);
+  EXPECT_EQ(policy.NextMode(), RowBatch::FULL_DEDUP);
+  policy.Update(RowBatch::FULL_DEDUP, no_dups);
+  EXPECT_EQ(policy.NextMode(), RowBatch::NO_DEDUP);
+}
+
 TEST_F(RowBatchSerializeTest, ConsecutiveNullsAdjacent) {
   TestConsecutiveNulls(false);
 }
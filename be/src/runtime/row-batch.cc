@@ -34,6 +34,8 @@ DECLARE_bool(enable_partitioned_aggregation);
 
 namespace impala {
 
+const int TupleDedupPolicy::MAX_SAMPLE_INTERVAL;
+
 RowBatch::RowBatch(const RowDescriptor& row_desc, int capacity,
     MemTracker* mem_tracker)
   : num_rows_(0),
@@ -42,6 +44,8 @@ RowBatch::RowBatch(const RowDescriptor& row_desc, int capacity,
     num_tuples_per_row_(row_desc.tuple_descriptors().size()),
     auxiliary_mem_usage_(0),
     tuple_data_pool_(mem_tracker),
+    has_selection_(false),
+    num_selected_rows_(0),
     row_desc_(row_desc),
     mem_tracker_(mem_tracker) {
   DCHECK(mem_tracker_ != NULL);
@@ -72,6 +76,8 @@ RowBatch::RowBatch(const RowDescriptor& row_desc, const TRowBatch& input_batch,
     num_tuples_per_row_(input_batch.row_tuples.size()),
     auxiliary_mem_usage_(0),
     tuple_data_pool_(mem_tracker),
+    has_selection_(false),
+    num_selected_rows_(0),
     row_desc_(row_desc),
     mem_tracker_(mem_tracker) {
   DCHECK(mem_tracker_ != NULL);
@@ -159,10 +165,37 @@ RowBatch::~RowBatch() {
 }
 
 Status RowBatch::Serialize(TRowBatch* output_batch) {
-  return Serialize(output_batch, UseFullDedup());
+  return Serialize(output_batch, THdfsCompression::LZ4);
+}
+
+Status RowBatch::Serialize(TRowBatch* output_batch,
+    THdfsCompression::type compression) {
+  return Serialize(output_batch, UseFullDedup() ? FULL_DEDUP : ADJACENT_DEDUP,
+      compression, NULL);
+}
+
+Status RowBatch::Serialize(TRowBatch* output_batch, THdfsCompression::type compression,
+    TupleDedupPolicy* dedup_policy) {
+  DCHECK(dedup_policy != NULL);
+  DedupMode dedup_mode = dedup_policy->NextMode();
+  DedupStats stats;
+  RETURN_IF_ERROR(Serialize(output_batch, dedup_mode, compression, &stats));
+  dedup_policy->Update(dedup_mode, stats);
+  return Status::OK();
 }
 
 Status RowBatch::Serialize(TRowBatch* output_batch, bool full_dedup) {
+  return Serialize(output_batch, full_dedup ? FULL_DEDUP : ADJACENT_DEDUP);
+}
+
+Status RowBatch::Serialize(TRowBatch* output_batch, DedupMode dedup_mode) {
+  return Serialize(output_batch, dedup_mode, THdfsCompression::LZ4, NULL);
+}
+
+Status RowBatch::Serialize(TRowBatch* output_batch, DedupMode dedup_mode,
+    THdfsCompression::type compression, DedupStats* stats) {
+  DCHECK(compression == THdfsCompression::NONE || compression == THdfsCompression::LZ4
+      || compression == THdfsCompression::SNAPPY);
   // why does Thrift not generate a Clear() function?
   output_batch->row_tuples.clear();
   output_batch->tuple_offsets.clear();
@@ -176,25 +209,26 @@ Status RowBatch::Serialize(TRowBatch* output_batch, bool full_dedup) {
   // in adjacent rows only. If full deduplication is enabled, we will build a
   // map to detect non-adjacent duplicates. Building this map comes with significant
   // overhead, so is only worthwhile in the uncommon case of many non-adjacent duplicates.
+  DedupStats local_stats;
+  if (stats == NULL) stats = &local_stats;
   int64_t size;
-  if (full_dedup) {
+  if (dedup_mode == FULL_DEDUP) {
     // Maps from tuple to offset of its serialized data in output_batch->tuple_data.
     DedupMap distinct_tuples;
     RETURN_IF_ERROR(distinct_tuples.Init(num_rows_ * num_tuples_per_row_ * 2, 0));
-    size = TotalByteSize(&distinct_tuples);
+    size = TotalByteSize(dedup_mode, &distinct_tuples);
     distinct_tuples.Clear(); // Reuse allocated hash table.
-    SerializeInternal(size, &distinct_tuples, output_batch);
+    SerializeInternal(size, dedup_mode, &distinct_tuples, output_batch, stats);
   } else {
-    size = TotalByteSize(NULL);
-    SerializeInternal(size, NULL, output_batch);
+    size = TotalByteSize(dedup_mode, NULL);
+    SerializeInternal(size, dedup_mode, NULL, output_batch, stats);
   }
 
-  if (size > 0) {
+  if (size > 0 && compression != THdfsCompression::NONE) {
     // Try compressing tuple_data to compression_scratch_, swap if compressed data is
     // smaller
     scoped_ptr<Codec> compressor;
-    RETURN_IF_ERROR(Codec::CreateCompressor(NULL, false, THdfsCompression::LZ4,
-                                            &compressor));
+    RETURN_IF_ERROR(Codec::CreateCompressor(NULL, false, compression, &compressor));
 
     int64_t compressed_size = compressor->MaxOutputLen(size);
     if (compression_scratch_.size() < compressed_size) {
@@ -207,7 +241,7 @@ Status RowBatch::Serialize(TRowBatch* output_batch, bool full_dedup) {
     if (LIKELY(compressed_size < size)) {
       compression_scratch_.resize(compressed_size);
       output_batch->tuple_data.swap(compression_scratch_);
-      output_batch->compression_type = THdfsCompression::LZ4;
+      output_batch->compression_type = compression;
     }
     VLOG_ROW << "uncompressed size: " << size << ", compressed size: " << compressed_size;
   }
@@ -228,9 +262,11 @@ bool RowBatch::UseFullDedup() {
   return false;
 }
 
-void RowBatch::SerializeInternal(int64_t size, DedupMap* distinct_tuples,
-    TRowBatch* output_batch) {
+void RowBatch::SerializeInternal(int64_t size, DedupMode dedup_mode,
+    DedupMap* distinct_tuples, TRowBatch* output_batch, DedupStats* stats) {
+  DCHECK_EQ(dedup_mode == FULL_DEDUP, distinct_tuples != NULL);
   DCHECK(distinct_tuples == NULL || distinct_tuples->size() == 0);
+  bool adjacent_dedup = dedup_mode != NO_DEDUP;
   // TODO: max_size() is much larger than the amount of memory we could feasibly
   // allocate. Need better way to detect problem.
   DCHECK_LE(size, output_batch->tuple_data.max_size());
@@ -245,6 +281,10 @@ void RowBatch::SerializeInternal(int64_t size, DedupMap* distinct_tuples,
   // string pointers into offsets in the process).
   int offset = 0; // current offset into output_batch->tuple_data
   char* tuple_data = const_cast<char*>(output_batch->tuple_data.c_str());
+  // Tuple counts of this batch, added to 'stats' at the end.
+  int64_t num_tuples = 0;
+  int64_t num_adjacent_dups = 0;
+  int64_t num_dups = 0;
 
   for (int i = 0; i < num_rows_; ++i) {
     vector<TupleDescriptor*>::const_iterator desc = row_desc_.tuple_descriptors().begin();
@@ -254,11 +294,18 @@ void RowBatch::SerializeInternal(int64_t size, DedupMap* distinct_tuples,
         // NULLs are encoded as -1
         output_batch->tuple_offsets.push_back(-1);
         continue;
-      } else if (LIKELY(i > 0) && UNLIKELY(GetRow(i - 1)->GetTuple(j) == tuple)) {
+      }
+      if ((*desc)->byte_size() != 0) ++num_tuples;
+      if (adjacent_dedup && LIKELY(i > 0) &&
+          UNLIKELY(GetRow(i - 1)->GetTuple(j) == tuple)) {
         // Fast tuple deduplication for adjacent rows.
         int prev_row_idx = output_batch->tuple_offsets.size() - num_tuples_per_row_;
         output_batch->tuple_offsets.push_back(
             output_batch->tuple_offsets[prev_row_idx]);
+        if ((*desc)->byte_size() != 0) {
+          ++num_adjacent_dups;
+          ++num_dups;
+        }
         continue;
       } else if (UNLIKELY(distinct_tuples != NULL)) {
         if ((*desc)->byte_size() == 0) {
@@ -271,6 +318,7 @@ void RowBatch::SerializeInternal(int64_t size, DedupMap* distinct_tuples,
           // Repeat of tuple
           DCHECK_GE(*dedupd_offset, 0);
           output_batch->tuple_offsets.push_back(*dedupd_offset);
+          ++num_dups;
           continue;
         }
       }
@@ -281,6 +329,41 @@ void RowBatch::SerializeInternal(int64_t size, DedupMap* distinct_tuples,
     }
   }
   DCHECK_EQ(offset, size);
+  stats->num_tuples += num_tuples;
+  stats->num_adjacent_dups += num_adjacent_dups;
+  stats->num_dups += num_dups;
+}
+
+void TupleDedupPolicy::Update(RowBatch::DedupMode mode,
+    const RowBatch::DedupStats& stats) {
+  if (mode != RowBatch::FULL_DEDUP) {
+    DCHECK_GT(batches_until_sample_, 0);
+    --batches_until_sample_;
+    return;
+  }
+  // Batches without tuples say nothing about the stream, measure the next one instead.
+  if (stats.num_tuples == 0) return;
+  int64_t num_non_adjacent_dups = stats.num_dups - stats.num_adjacent_dups;
+  DCHECK_GE(num_non_adjacent_dups, 0);
+  RowBatch::DedupMode new_mode;
+  if (num_non_adjacent_dups > 0 &&
+      num_non_adjacent_dups * FULL_DEDUP_MIN_DUP_RATIO >= stats.num_tuples) {
+    new_mode = RowBatch::FULL_DEDUP;
+  } else if (stats.num_adjacent_dups > 0) {
+    new_mode = RowBatch::ADJACENT_DEDUP;
+  } else {
+    new_mode = RowBatch::NO_DEDUP;
+  }
+  if (new_mode == mode_) {
+    sample_interval_ = min(sample_interval_ * 2, MAX_SAMPLE_INTERVAL);
+  } else {
+    VLOG_ROW << "Switching tuple deduplication mode from " << mode_ << " to "
+             << new_mode;
+    sample_interval_ = MIN_SAMPLE_INTERVAL;
+    mode_ = new_mode;
+  }
+  // In full deduplication mode every batch is measured.
+  batches_until_sample_ = mode_ == RowBatch::FULL_DEDUP ? 0 : sample_interval_;
 }
 
 void RowBatch::AddIoBuffer(DiskIoMgr::BufferDescriptor* buffer) {
@@ -306,6 +389,7 @@ void RowBatch::AddBlock(BufferedBlockMgr::Block* block) {
 
 void RowBatch::Reset() {
   num_rows_ = 0;
+  has_selection_ = false;
   capacity_ = tuple_ptrs_size_ / (num_tuples_per_row_ * sizeof(Tuple*));
   // TODO: Change this to Clear() and investigate the repercussions.
   tuple_data_pool_.FreeAll();
@@ -369,6 +453,8 @@ void RowBatch::AcquireState(RowBatch* src) {
 
   // The destination row batch should be empty.
   DCHECK(!need_to_return_);
+  DCHECK(!has_selection_);
+  DCHECK(!src->has_selection_);
   DCHECK_EQ(num_rows_, 0);
   DCHECK_EQ(auxiliary_mem_usage_, 0);
 
@@ -385,6 +471,25 @@ void RowBatch::AcquireState(RowBatch* src) {
   src->TransferResourceOwnership(this);
 }
 
+void RowBatch::SelectAllRows() {
+  if (selection_.size() < capacity_) selection_.resize(capacity_);
+  for (int i = 0; i < num_rows_; ++i) {
+    selection_[i] = i;
+  }
+  num_selected_rows_ = num_rows_;
+  has_selection_ = true;
+}
+
+void RowBatch::CompactSelection() {
+  DCHECK(has_selection_);
+  for (int i = 0; i < num_selected_rows_; ++i) {
+    // The selected indexes increase, so rows are only ever moved towards the front.
+    if (selection_[i] != i) CopyRow(GetRow(selection_[i]), GetRow(i));
+  }
+  num_rows_ = num_selected_rows_;
+  has_selection_ = false;
+}
+
 void RowBatch::DeepCopyTo(RowBatch* dst) {
   DCHECK(dst->row_desc_.Equals(row_desc_));
   DCHECK_EQ(dst->num_rows_, 0);
@@ -401,8 +506,10 @@ void RowBatch::DeepCopyTo(RowBatch* dst) {
 }
 
 // TODO: consider computing size of batches as they are built up
-int64_t RowBatch::TotalByteSize(DedupMap* distinct_tuples) {
+int64_t RowBatch::TotalByteSize(DedupMode dedup_mode, DedupMap* distinct_tuples) {
+  DCHECK_EQ(dedup_mode == FULL_DEDUP, distinct_tuples != NULL);
   DCHECK(distinct_tuples == NULL || distinct_tuples->size() == 0);
+  bool adjacent_dedup = dedup_mode != NO_DEDUP;
   int64_t result = 0;
   vector<int> tuple_count(row_desc_.tuple_descriptors().size(), 0);
 
@@ -412,7 +519,8 @@ int64_t RowBatch::TotalByteSize(DedupMap* distinct_tuples) {
       Tuple* tuple = GetRow(i)->GetTuple(j);
       if (UNLIKELY(tuple == NULL)) continue;
       // Only count the data of unique tuples.
-      if (LIKELY(i > 0) && UNLIKELY(GetRow(i - 1)->GetTuple(j) == tuple)) {
+      if (adjacent_dedup && LIKELY(i > 0) &&
+          UNLIKELY(GetRow(i - 1)->GetTuple(j) == tuple)) {
         // Fast tuple deduplication for adjacent rows.
         continue;
       } else if (UNLIKELY(distinct_tuples != NULL)) {
@@ -26,6 +26,7 @@
 #include "runtime/disk-io-mgr.h"
 #include "runtime/mem-pool.h"
 #include "runtime/mem-tracker.h"
+#include "gen-cpp/CatalogObjects_types.h"  // for THdfsCompression
 
 namespace impala {
 
@@ -35,6 +36,7 @@ class MemTracker;
 class RowBatchSerializeTest;
 class TRowBatch;
 class Tuple;
+class TupleDedupPolicy;
 class TupleRow;
 class TupleDescriptor;
 
@@ -190,6 +192,51 @@ class RowBatch {
     memset(row, 0, num_tuples_per_row_ * sizeof(Tuple*));
   }
 
+  /// The selection vector optionally lists, in increasing order, the indexes of the rows
+  /// that passed the filters applied to the batch so far. Filtering a batch refines the
+  /// selection instead of moving the rows that pass, so several predicates can be
+  /// applied one after the other and the rows are compacted at most once. Operators that
+  /// read a batch produced by another one iterate over [0, num_selected_rows()) and use
+  /// selected_row_idx() to find the rows, which also works for batches without a
+  /// selection. Before a batch with a selection is returned from GetNext(),
+  /// CompactSelection() must be called. Reset() drops the selection.
+
+  /// Starts a selection that contains all committed rows.
+  void SelectAllRows();
+
+  bool has_selection() const { return has_selection_; }
+
+  /// Number of selected rows, num_rows() if there is no selection.
+  int num_selected_rows() const {
+    return has_selection_ ? num_selected_rows_ : num_rows_;
+  }
+
+  /// Index of the i-th selected row in the batch.
+  int selected_row_idx(int i) const {
+    DCHECK_GE(i, 0);
+    DCHECK_LT(i, num_selected_rows());
+    return has_selection_ ? selection_[i] : i;
+  }
+
+  /// Direct access to the selection vector, for filters that refine it in place. Only
+  /// the first num_selected_rows() entries are valid.
+  int* selection() {
+    DCHECK(has_selection_);
+    return &selection_[0];
+  }
+
+  /// Shrinks the selection to its first 'num_selected_rows' entries.
+  void set_num_selected_rows(int num_selected_rows) {
+    DCHECK(has_selection_);
+    DCHECK_GE(num_selected_rows, 0);
+    DCHECK_LE(num_selected_rows, num_selected_rows_);
+    num_selected_rows_ = num_selected_rows;
+  }
+
+  /// Moves the selected rows to the front of the batch, drops the others and clears the
+  /// selection.
+  void CompactSelection();
+
   /// Acquires state from the 'src' row batch into this row batch. This includes all IO
   /// buffers and tuple data.
   /// This row batch must be empty and have the same row descriptor as the src batch.
@@ -207,12 +254,44 @@ class RowBatch {
   /// Create a serialized version of this row batch in output_batch, attaching all of the
   /// data it references to output_batch.tuple_data. This function attempts to
   /// detect duplicate tuples in the row batch to reduce the serialized size.
-  /// output_batch.tuple_data will be snappy-compressed unless the compressed data is
-  /// larger than the uncompressed data. Use output_batch.is_compressed to determine
+  /// output_batch.tuple_data will be LZ4-compressed unless the compressed data is
+  /// larger than the uncompressed data. Use output_batch.compression_type to determine
   /// whether tuple_data is compressed. If an in-flight row is present in this row batch,
   /// it is ignored. This function does not Reset().
   Status Serialize(TRowBatch* output_batch);
 
+  /// Same as above, but tries to compress tuple_data with 'compression', which may be
+  /// NONE, LZ4 or SNAPPY.
+  Status Serialize(TRowBatch* output_batch, THdfsCompression::type compression);
+
+  /// Same as above, but the way duplicate tuples are detected is chosen by
+  /// 'dedup_policy' from the duplicates found in the batches it serialized before.
+  /// Used by senders, which serialize every batch of a stream with the same policy.
+  Status Serialize(TRowBatch* output_batch, THdfsCompression::type compression,
+      TupleDedupPolicy* dedup_policy);
+
+  /// How Serialize() detects duplicate tuples. NO_DEDUP copies every tuple,
+  /// ADJACENT_DEDUP only detects tuples shared with the previous row and FULL_DEDUP
+  /// also detects non-adjacent duplicates with a hash table of the tuple pointers.
+  enum DedupMode {
+    NO_DEDUP,
+    ADJACENT_DEDUP,
+    FULL_DEDUP
+  };
+
+  /// Tuple counts of one serialized batch. Zero-length tuples are not counted.
+  struct DedupStats {
+    /// Number of non-NULL tuples referenced by the rows, including duplicates.
+    int64_t num_tuples;
+    /// Number of those that were the same as the tuple in the previous row.
+    int64_t num_adjacent_dups;
+    /// Number of those that were not copied because they were detected as duplicates,
+    /// including the adjacent ones.
+    int64_t num_dups;
+
+    DedupStats() : num_tuples(0), num_adjacent_dups(0), num_dups(0) { }
+  };
+
   /// Utility function: returns total size of batch.
   static int GetBatchSize(const TRowBatch& batch);
 
@@ -239,20 +318,29 @@ class RowBatch {
   /// much larger than in-memory size due to non-adjacent duplicate tuples.
   bool UseFullDedup();
 
-  /// Overload for testing that allows the test to force the deduplication level.
+  /// Overloads for testing that allow the test to force the deduplication level.
   Status Serialize(TRowBatch* output_batch, bool full_dedup);
+  Status Serialize(TRowBatch* output_batch, DedupMode dedup_mode);
+
+  /// Serializes with 'dedup_mode' and, if 'stats' is non-NULL, returns the tuple counts
+  /// in it.
+  Status Serialize(TRowBatch* output_batch, DedupMode dedup_mode,
+      THdfsCompression::type compression, DedupStats* stats);
 
   typedef FixedSizeHashTable<Tuple*, int> DedupMap;
 
   /// The total size of all data represented in this row batch (tuples and referenced
   /// string and collection data). This is the size of the row batch after removing all
   /// gaps in the auxiliary and deduplicated tuples (i.e. the smallest footprint for the
-  /// row batch). If the distinct_tuples argument is non-null, full deduplication is
-  /// enabled. The distinct_tuples map must be empty.
-  int64_t TotalByteSize(DedupMap* distinct_tuples);
+  /// row batch). Tuples shared with the previous row are only counted once unless
+  /// 'dedup_mode' is NO_DEDUP. The distinct_tuples argument must be non-null and empty
+  /// iff 'dedup_mode' is FULL_DEDUP.
+  int64_t TotalByteSize(DedupMode dedup_mode, DedupMap* distinct_tuples);
 
-  void SerializeInternal(int64_t size, DedupMap* distinct_tuples,
-      TRowBatch* output_batch);
+  /// Copies the tuples into output_batch, deduplicating them like TotalByteSize(),
+  /// and adds the tuple counts to 'stats'.
+  void SerializeInternal(int64_t size, DedupMode dedup_mode, DedupMap* distinct_tuples,
+      TRowBatch* output_batch, DedupStats* stats);
 
   /// Close owned tuple streams and delete if needed.
   void CloseTupleStreams();
@@ -303,6 +391,12 @@ class RowBatch {
   /// holding (some of the) data referenced by rows
   MemPool tuple_data_pool_;
 
+  /// The selection vector, see SelectAllRows(). 'selection_' is only allocated when a
+  /// selection is made for the first time and is kept across Reset().
+  bool has_selection_;
+  int num_selected_rows_;
+  std::vector<int> selection_;
+
   // Less frequently used members that are not accessed on performance-critical paths
   // should go below here.
 
@@ -333,6 +427,51 @@ class RowBatch {
   std::string compression_scratch_;
 };
 
+/// Chooses the RowBatch::DedupMode for the batches of one stream from the duplicates
+/// found in its earlier batches, so that streams with non-adjacent duplicate tuples,
+/// e.g. join outputs that fan out build tuples, get full deduplication while streams
+/// without duplicates, e.g. plain scans, skip the work. Every few batches a batch is
+/// serialized with full deduplication to measure the duplicate rates, and the mode for
+/// the following batches is chosen from them. The sampling interval grows while the
+/// samples keep confirming the chosen mode. Batches serialized with full deduplication
+/// are always measured.
+/// Not thread-safe.
+class TupleDedupPolicy {
+ public:
+  TupleDedupPolicy()
+    : mode_(RowBatch::ADJACENT_DEDUP),
+      sample_interval_(MIN_SAMPLE_INTERVAL),
+      batches_until_sample_(0) {
+  }
+
+  /// Returns the mode to serialize the next batch with.
+  RowBatch::DedupMode NextMode() const {
+    return batches_until_sample_ == 0 ? RowBatch::FULL_DEDUP : mode_;
+  }
+
+  /// Records the tuple counts of a batch serialized with 'mode'.
+  void Update(RowBatch::DedupMode mode, const RowBatch::DedupStats& stats);
+
+  RowBatch::DedupMode mode() const { return mode_; }
+
+ private:
+  /// Bounds of the number of batches between two measured batches.
+  static const int MIN_SAMPLE_INTERVAL = 4;
+  static const int MAX_SAMPLE_INTERVAL = 64;
+
+  /// Full deduplication is chosen if at least one in this many tuples is a non-adjacent
+  /// duplicate.
+  static const int FULL_DEDUP_MIN_DUP_RATIO = 10;
+
+  /// Mode for batches that are not measured.
+  RowBatch::DedupMode mode_;
+
+  int sample_interval_;
+
+  /// Number of batches to serialize with 'mode_' before the next measured batch.
+  int batches_until_sample_;
+};
+
 }
 
 #endif
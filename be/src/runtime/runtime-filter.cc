@@ -19,6 +19,7 @@
 #include "common/names.h"
 #include "runtime/client-cache.h"
 #include "runtime/exec-env.h"
+#include "service/fragment-mgr.h"
 #include "service/impala-server.h"
 #include "util/bloom-filter.h"
 
@@ -82,18 +83,21 @@ void SendFilterToCoordinator(TNetworkAddress address, TUpdateFilterParams params
 }
 
 void RuntimeFilterBank::UpdateFilterFromLocal(uint32_t filter_id,
-    BloomFilter* bloom_filter) {
+    BloomFilter* bloom_filter, MinMaxFilter* min_max_filter) {
   DCHECK_NE(state_->query_options().runtime_filter_mode, TRuntimeFilterMode::OFF)
       << "Should not be calling UpdateFilterFromLocal() if filtering is disabled";
   TUpdateFilterParams params;
   bool has_local_target = false;
+  int num_local_producers = 1;
   {
     lock_guard<SpinLock> l(runtime_filter_lock_);
     RuntimeFilterMap::iterator it = produced_filters_.find(filter_id);
     DCHECK(it != produced_filters_.end()) << "Tried to update unregistered filter: "
                                           << filter_id;
-    it->second->SetBloomFilter(bloom_filter);
-    has_local_target = it->second->filter_desc().has_local_target;
+    it->second->SetBloomFilter(bloom_filter, min_max_filter);
+    const TRuntimeFilterDesc& desc = it->second->filter_desc();
+    has_local_target = desc.has_local_target;
+    if (desc.__isset.num_local_producers) num_local_producers = desc.num_local_producers;
   }
 
   if (has_local_target) {
@@ -112,19 +116,38 @@ void RuntimeFilterBank::UpdateFilterFromLocal(uint32_t filter_id,
     BloomFilter* copy = AllocateScratchBloomFilter();
     if (copy == NULL) return;
     copy->Or(*bloom_filter);
+    MinMaxFilter* min_max_copy = NULL;
+    if (min_max_filter != NULL) {
+      min_max_copy = AllocateScratchMinMaxFilter();
+      if (min_max_copy != NULL) min_max_copy->Or(*min_max_filter);
+    }
     {
       // Take lock only to ensure no race with PublishGlobalFilter() - there's no need for
       // coordination with readers of the filter.
       lock_guard<SpinLock> l(runtime_filter_lock_);
       if (filter->GetBloomFilter() == NULL) {
-        filter->SetBloomFilter(copy);
+        filter->SetBloomFilter(copy, min_max_copy);
         state_->runtime_profile()->AddInfoString(
             Substitute("Filter $0 arrival", filter_id),
             PrettyPrinter::Print(filter->arrival_delay(), TUnit::TIME_MS));
       }
     }
   } else if (state_->query_options().runtime_filter_mode == TRuntimeFilterMode::GLOBAL) {
-      bloom_filter->ToThrift(&params.bloom_filter);
+      FragmentMgr* fragment_mgr = ExecEnv::GetInstance()->fragment_mgr();
+      if (num_local_producers > 1 && fragment_mgr != NULL) {
+        // Only the last of the instances on this backend sends the merged filter.
+        if (!fragment_mgr->MergeLocalFilter(query_ctx_.query_id, filter_id,
+                num_local_producers, *bloom_filter, min_max_filter, &params)) {
+          return;
+        }
+      } else {
+        bloom_filter->ToThrift(&params.bloom_filter);
+        if (min_max_filter != NULL) {
+          TMinMaxFilter min_max;
+          min_max_filter->ToThrift(&min_max);
+          params.bloom_filter.__set_min_max(min_max);
+        }
+      }
       params.filter_id = filter_id;
       params.query_id = query_ctx_.query_id;
 
@@ -153,7 +176,11 @@ void RuntimeFilterBank::PublishGlobalFilter(uint32_t filter_id,
   BloomFilter* bloom_filter = obj_pool_.Add(new BloomFilter(thrift_filter, NULL, NULL));
   DCHECK_EQ(required_space, bloom_filter->GetHeapSpaceUsed());
   memory_allocated_->Add(bloom_filter->GetHeapSpaceUsed());
-  it->second->SetBloomFilter(bloom_filter);
+  MinMaxFilter* min_max_filter = NULL;
+  if (thrift_filter.__isset.min_max) {
+    min_max_filter = obj_pool_.Add(new MinMaxFilter(thrift_filter.min_max));
+  }
+  it->second->SetBloomFilter(bloom_filter, min_max_filter);
   state_->runtime_profile()->AddInfoString(Substitute("Filter $0 arrival", filter_id),
       PrettyPrinter::Print(it->second->arrival_delay(), TUnit::TIME_MS));
 }
@@ -172,6 +199,13 @@ BloomFilter* RuntimeFilterBank::AllocateScratchBloomFilter() {
   return bloom_filter;
 }
 
+MinMaxFilter* RuntimeFilterBank::AllocateScratchMinMaxFilter() {
+  lock_guard<SpinLock> l(runtime_filter_lock_);
+  if (closed_) return NULL;
+  // These are small enough not to be tracked.
+  return obj_pool_.Add(new MinMaxFilter());
+}
+
 bool RuntimeFilterBank::ShouldDisableFilter(uint64_t max_ndv) {
   double fpp = BloomFilter::FalsePositiveProb(max_ndv, log_filter_size_);
   return fpp > FLAGS_max_filter_error_rate;
@@ -19,6 +19,7 @@
 #include "runtime/raw-value.h"
 #include "runtime/types.h"
 #include "util/bloom-filter.h"
+#include "util/min-max-filter.h"
 #include "util/spinlock.h"
 
 #include <boost/thread.hpp>
@@ -42,7 +43,9 @@ class RuntimeFilter;
 /// (UpdateFilterFromLocal() may only be called once per filter ID per filter bank). The
 /// bloom_filter that is passed into UpdateFilterFromLocal() must have been allocated by
 /// AllocateScratchBloomFilter(); this allows RuntimeFilterBank to manage all memory
-/// associated with filters.
+/// associated with filters. Filters with integer-typed exprs can also carry a
+/// MinMaxFilter, allocated by AllocateScratchMinMaxFilter(), which is published along
+/// with the bloom filter.
 ///
 /// Filters are aggregated at the coordinator, and then made available to consumers after
 /// PublishGlobalFilter() has been called.
@@ -62,8 +65,10 @@ class RuntimeFilterBank {
   RuntimeFilter* RegisterFilter(const TRuntimeFilterDesc& filter_desc, bool is_producer);
 
   /// Updates a filter's bloom_filter with 'bloom_filter' which has been produced by some
-  /// operator in the local fragment instance.
-  void UpdateFilterFromLocal(uint32_t filter_id, BloomFilter* bloom_filter);
+  /// operator in the local fragment instance. 'min_max_filter' holds the range of the
+  /// same values, or is NULL if it was not computed.
+  void UpdateFilterFromLocal(uint32_t filter_id, BloomFilter* bloom_filter,
+      MinMaxFilter* min_max_filter);
 
   /// Makes a bloom_filter (aggregated globally from all producer fragments) available for
   /// consumption by operators that wish to use it for filtering.
@@ -93,6 +98,10 @@ class RuntimeFilterBank {
   /// If there is not enough memory, or if Close() has been called first, returns NULL.
   BloomFilter* AllocateScratchBloomFilter();
 
+  /// Same as AllocateScratchBloomFilter() for MinMaxFilters. Returns NULL if Close() has
+  /// been called first.
+  MinMaxFilter* AllocateScratchMinMaxFilter();
+
   /// Default hash seed to use when computing hashed values to insert into filters.
   static const uint32_t DefaultHashSeed() { return 1234; }
 
@@ -145,19 +154,29 @@ class RuntimeFilterBank {
 class RuntimeFilter {
  public:
   RuntimeFilter(const TRuntimeFilterDesc& filter)
-      : bloom_filter_(NULL), filter_desc_(filter), arrival_time_(0L) {
+      : bloom_filter_(NULL), min_max_filter_(NULL), filter_desc_(filter),
+        arrival_time_(0L) {
     registration_time_ = MonotonicMillis();
   }
 
   /// Returns NULL if no calls to SetBloomFilter() have been made yet.
   const BloomFilter* GetBloomFilter() const { return bloom_filter_; }
 
+  /// Returns the range of the filter's values. Returns NULL if no calls to
+  /// SetBloomFilter() have been made yet, or if the filter has no range.
+  const MinMaxFilter* GetMinMaxFilter() const {
+    return bloom_filter_ == NULL ? NULL : min_max_filter_;
+  }
+
   const TRuntimeFilterDesc& filter_desc() const { return filter_desc_; }
 
-  /// Sets the internal filter bloom_filter to 'bloom_filter'. Can only legally be called
-  /// once per filter. Does not acquire the memory associated with 'bloom_filter'.
-  void SetBloomFilter(BloomFilter* bloom_filter) {
+  /// Sets the internal filter bloom_filter to 'bloom_filter', and its range to
+  /// 'min_max_filter', which may be NULL. Can only legally be called once per filter.
+  /// Does not acquire the memory associated with either filter.
+  void SetBloomFilter(BloomFilter* bloom_filter, MinMaxFilter* min_max_filter) {
     DCHECK(bloom_filter_ == NULL);
+    // Readers only look at 'min_max_filter_' once 'bloom_filter_' is set.
+    min_max_filter_ = min_max_filter;
     // TODO: Barrier required here to ensure compiler does not both inline and re-order
     // this assignment. Not an issue for correctness (as assignment is atomic), but
     // potentially confusing.
@@ -175,6 +194,8 @@ class RuntimeFilter {
     // Safe to read bloom_filter_ concurrently with any ongoing SetBloomFilter() thanks
     // to a) the atomicity of / pointer assignments and b) the x86 TSO memory model.
     if (bloom_filter_ == NULL) return true;
+    // The range check is cheaper than the bloom filter probe, and exact for small sets.
+    if (min_max_filter_ != NULL && !min_max_filter_->Find(val, col_type)) return false;
 
     uint32_t h = RawValue::GetHashValue(val, col_type,
         RuntimeFilterBank::DefaultHashSeed());
@@ -200,6 +221,9 @@ class RuntimeFilter {
   /// Membership bloom_filter.
   BloomFilter* bloom_filter_;
 
+  /// Range of the filter's values, NULL if unknown.
+  MinMaxFilter* min_max_filter_;
+
   /// Descriptor of the filter.
   TRuntimeFilterDesc filter_desc_;
 
@@ -27,6 +27,7 @@
 #include "exprs/expr.h"
 #include "runtime/buffered-block-mgr.h"
 #include "runtime/descriptors.h"
+#include "runtime/mem-pool.h"
 #include "runtime/runtime-state.h"
 #include "runtime/timestamp-value.h"
 #include "runtime/data-stream-mgr.h"
@@ -38,6 +39,7 @@
 #include "util/disk-info.h"
 #include "util/error-util.h"
 #include "util/jni-util.h"
+#include "util/lock-profiler.h"
 #include "util/mem-info.h"
 #include "util/pretty-printer.h"
 
@@ -46,6 +48,11 @@
 using namespace llvm;
 
 DECLARE_int32(max_errors);
+DECLARE_bool(disable_mem_pools);
+
+DEFINE_int64(mem_pool_chunk_cache_size, 8L * 1024L * 1024L, "(Advanced) The maximum "
+    "number of bytes of free MemPool chunks that each fragment instance caches for "
+    "reuse by its row batches. 0 disables the cache.");
 
 // The fraction of the query mem limit that is used for the block mgr. Operators
 // that accumulate memory all use the block mgr so the majority of the memory should
@@ -70,6 +77,8 @@ RuntimeState::RuntimeState(const TExecPlanFragmentParams& fragment_params,
         fragment_ctx().query_ctx.now_string.size())),
     cgroup_(cgroup),
     codegen_expr_(false),
+    codegen_disabled_for_fragment_(false),
+    numa_node_(-1),
     profile_(obj_pool_.get(),
         "Fragment " + PrintId(fragment_ctx().fragment_instance_id)),
     is_cancelled_(false),
@@ -86,6 +95,8 @@ RuntimeState::RuntimeState(const TQueryCtx& query_ctx)
         query_ctx.now_string.size())),
     exec_env_(ExecEnv::GetInstance()),
     codegen_expr_(false),
+    codegen_disabled_for_fragment_(false),
+    numa_node_(-1),
     profile_(obj_pool_.get(), "<unnamed>"),
     is_cancelled_(false),
     query_resource_mgr_(NULL),
@@ -98,6 +109,9 @@ RuntimeState::RuntimeState(const TQueryCtx& query_ctx)
 
 RuntimeState::~RuntimeState() {
   block_mgr_.reset();
+  // All of the fragment's MemPools have been freed by now. The cache's tracker is a
+  // child of instance_mem_tracker_, so it must go first.
+  mem_pool_chunk_cache_.reset();
 
   // query_mem_tracker_ must be valid as long as instance_mem_tracker_ is so
   // delete instance_mem_tracker_ first.
@@ -141,6 +155,8 @@ Status RuntimeState::Init(ExecEnv* exec_env) {
   total_storage_wait_timer_ = ADD_TIMER(runtime_profile(), "TotalStorageWaitTime");
   total_network_send_timer_ = ADD_TIMER(runtime_profile(), "TotalNetworkSendTime");
   total_network_receive_timer_ = ADD_TIMER(runtime_profile(), "TotalNetworkReceiveTime");
+  total_lock_wait_timer_ = LockProfiler::enabled() ?
+      ADD_TIMER(runtime_profile(), "TotalLockWaitTime") : NULL;
 
   return Status::OK();
 }
@@ -157,6 +173,11 @@ void RuntimeState::InitMemTrackers(const TUniqueId& query_id, const string* pool
           query_rm_reservation_limit_bytes, query_parent_tracker, query_resource_mgr());
   instance_mem_tracker_.reset(new MemTracker(runtime_profile(), -1, -1,
       runtime_profile()->name(), query_mem_tracker_.get()));
+  if (!FLAGS_disable_mem_pools && FLAGS_mem_pool_chunk_cache_size > 0) {
+    mem_pool_chunk_cache_.reset(new MemPoolChunkCache(FLAGS_mem_pool_chunk_cache_size,
+        instance_mem_tracker_.get()));
+    instance_mem_tracker_->set_mem_pool_chunk_cache(mem_pool_chunk_cache_.get());
+  }
 }
 
 Status RuntimeState::CreateBlockMgr() {
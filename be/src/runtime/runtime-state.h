@@ -48,6 +48,7 @@ class Status;
 class ExecEnv;
 class Expr;
 class LlvmCodeGen;
+class MemPoolChunkCache;
 class TimestampValue;
 class DataStreamRecvr;
 
@@ -127,6 +128,11 @@ class RuntimeState {
     return fragment_ctx().fragment_instance_id;
   }
   const std::string& cgroup() const { return cgroup_; }
+
+  /// The NUMA node that the threads of this fragment instance are pinned to, or -1 if
+  /// they aren't pinned.
+  int numa_node() const { return numa_node_; }
+  void set_numa_node(int numa_node) { numa_node_ = numa_node; }
   ExecEnv* exec_env() { return exec_env_; }
   DataStreamMgr* stream_mgr() { return exec_env_->stream_mgr(); }
   HBaseTableFactory* htable_factory() { return exec_env_->htable_factory(); }
@@ -160,8 +166,14 @@ class RuntimeState {
   /// Returns runtime state profile
   RuntimeProfile* runtime_profile() { return &profile_; }
 
-  /// Returns true if codegen is enabled for this query.
-  bool codegen_enabled() const { return !query_options().disable_codegen; }
+  /// Returns true if codegen is enabled for this fragment.
+  bool codegen_enabled() const {
+    return !query_options().disable_codegen && !codegen_disabled_for_fragment_;
+  }
+
+  /// Disables codegen for this fragment only. Must be called before the exec nodes are
+  /// prepared.
+  void DisableCodegenForFragment() { codegen_disabled_for_fragment_ = true; }
 
   /// Returns true if the codegen object has been created. Note that this may return false
   /// even when codegen is enabled if nothing has been codegen'd.
@@ -224,6 +236,7 @@ class RuntimeState {
   void set_is_cancelled(bool v) { is_cancelled_ = v; }
 
   RuntimeProfile::Counter* total_cpu_timer() { return total_cpu_timer_; }
+  RuntimeProfile::Counter* total_lock_wait_timer() { return total_lock_wait_timer_; }
   RuntimeProfile::Counter* total_storage_wait_timer() {
     return total_storage_wait_timer_;
   }
@@ -314,6 +327,12 @@ class RuntimeState {
   /// True if this fragment should force codegen for expr evaluation.
   bool codegen_expr_;
 
+  /// True if codegen was disabled for this fragment, see DisableCodegenForFragment().
+  bool codegen_disabled_for_fragment_;
+
+  /// See numa_node().
+  int numa_node_;
+
   /// Thread resource management object for this fragment's execution.  The runtime
   /// state is responsible for returning this pool to the thread mgr.
   ThreadResourceMgr::ResourcePool* resource_pool_;
@@ -333,6 +352,10 @@ class RuntimeState {
   /// Total time waiting in storage (across all threads)
   RuntimeProfile::Counter* total_storage_wait_timer_;
 
+  /// Total time waiting for profiled locks (across all threads), see LockProfiler.
+  /// NULL unless lock profiling is enabled.
+  RuntimeProfile::Counter* total_lock_wait_timer_;
+
   /// Total time spent sending over the network (across all threads)
   RuntimeProfile::Counter* total_network_send_timer_;
 
@@ -346,6 +369,11 @@ class RuntimeState {
   /// Memory usage of this fragment instance
   boost::scoped_ptr<MemTracker> instance_mem_tracker_;
 
+  /// Recycles the chunks of the MemPools of this fragment instance, whose trackers
+  /// descend from instance_mem_tracker_. NULL if --disable_mem_pools is set or
+  /// InitMemTrackers() wasn't called.
+  boost::scoped_ptr<MemPoolChunkCache> mem_pool_chunk_cache_;
+
   /// if true, execution should stop with a CANCELLED status
   bool is_cancelled_;
 
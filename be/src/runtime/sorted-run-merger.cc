@@ -18,6 +18,7 @@
 #include "runtime/row-batch.h"
 #include "runtime/sorter.h"
 #include "runtime/tuple-row.h"
+#include "util/key-normalizer.inline.h"
 #include "util/runtime-profile.h"
 
 #include "common/names.h"
@@ -25,7 +26,7 @@
 namespace impala {
 
 /// BatchedRowSupplier returns individual rows in a batch obtained from a sorted input
-/// run (a RunBatchSupplier). Used as the heap element in the min heap maintained by the
+/// run (a RunBatchSupplier). Used as the leaves of the tournament tree maintained by the
 /// merger.
 /// Next() advances the row supplier to the next row in the input batch and retrieves
 /// the next batch from the input if the current input batch is exhausted. Transfers
@@ -37,7 +38,9 @@ class SortedRunMerger::BatchedRowSupplier {
     : sorted_run_(sorted_run),
       input_row_batch_(NULL),
       input_row_batch_index_(-1),
-      parent_(parent) {
+      parent_(parent),
+      done_(false),
+      key_over_budget_(true) {
   }
 
   /// Retrieves the first batch of sorted rows from the run.
@@ -91,68 +94,110 @@ class SortedRunMerger::BatchedRowSupplier {
 
   /// The parent merger instance.
   SortedRunMerger* parent_;
+
+  /// True if the run is exhausted.
+  bool done_;
+
+  /// Normalized prefix of the sort key of current_row(), if the parent uses prefixes.
+  uint8_t key_prefix_[KEY_PREFIX_LEN];
+
+  /// True if the sort key of current_row() did not fit into key_prefix_.
+  bool key_over_budget_;
 };
 
-void SortedRunMerger::Heapify(int parent_index) {
-  int left_index = 2 * parent_index + 1;
-  int right_index = left_index + 1;
-  if (left_index >= min_heap_.size()) return;
-  int least_child;
-  // Find the least child of parent.
-  if (right_index >= min_heap_.size() ||
-      compare_less_than_(min_heap_[left_index]->current_row(),
-          min_heap_[right_index]->current_row())) {
-    least_child = left_index;
-  } else {
-    least_child = right_index;
+inline bool SortedRunMerger::RunLess(int lhs, int rhs) {
+  BatchedRowSupplier* lhs_run = runs_[lhs];
+  BatchedRowSupplier* rhs_run = runs_[rhs];
+  if (lhs_run->done_) return false;
+  if (rhs_run->done_) return true;
+  if (key_normalizer_.get() != NULL) {
+    int result = memcmp(lhs_run->key_prefix_, rhs_run->key_prefix_, KEY_PREFIX_LEN);
+    if (result != 0) return result < 0;
+    // Equal prefixes of complete keys are equal keys.
+    if (!lhs_run->key_over_budget_ && !rhs_run->key_over_budget_) return false;
+  }
+  return compare_less_than_(lhs_run->current_row(), rhs_run->current_row());
+}
+
+int SortedRunMerger::BuildTree(int node) {
+  if (node >= runs_.size()) return node - runs_.size();
+  int left = BuildTree(2 * node);
+  int right = BuildTree(2 * node + 1);
+  if (RunLess(right, left)) {
+    tree_[node] = left;
+    return right;
   }
+  tree_[node] = right;
+  return left;
+}
 
-  // If the parent is out of place, swap it with the least child and invoke
-  // Heapify recursively.
-  if (compare_less_than_(min_heap_[least_child]->current_row(),
-      min_heap_[parent_index]->current_row())) {
-    iter_swap(min_heap_.begin() + least_child, min_heap_.begin() + parent_index);
-    Heapify(least_child);
+inline void SortedRunMerger::ReplayMatches(int run_idx) {
+  int winner = run_idx;
+  for (int node = (runs_.size() + run_idx) / 2; node > 0; node /= 2) {
+    if (RunLess(tree_[node], winner)) std::swap(tree_[node], winner);
   }
+  tree_[0] = winner;
+}
+
+inline void SortedRunMerger::UpdateKeyPrefix(BatchedRowSupplier* run) {
+  if (key_normalizer_.get() == NULL || run->done_) return;
+  run->key_over_budget_ =
+      key_normalizer_->NormalizeKey(run->current_row(), run->key_prefix_);
 }
 
 SortedRunMerger::SortedRunMerger(const TupleRowComparator& compare_less_than,
     RowDescriptor* row_desc, RuntimeProfile* profile, bool deep_copy_input)
-  : compare_less_than_(compare_less_than),
+  : num_active_runs_(0),
+    compare_less_than_(compare_less_than),
     input_row_desc_(row_desc),
     deep_copy_input_(deep_copy_input) {
   get_next_timer_ = ADD_TIMER(profile, "MergeGetNext");
   get_next_batch_timer_ = ADD_TIMER(profile, "MergeGetNextBatch");
+
+  const vector<ExprContext*>& key_expr_ctxs = compare_less_than_.key_expr_ctxs_lhs();
+  vector<bool> nulls_first;
+  for (int i = 0; i < key_expr_ctxs.size(); ++i) {
+    if (!KeyNormalizer::IsSupportedType(key_expr_ctxs[i]->root()->type())) return;
+    nulls_first.push_back(compare_less_than_.nulls_first(i));
+  }
+  if (key_expr_ctxs.empty()) return;
+  key_normalizer_.reset(new KeyNormalizer(key_expr_ctxs, KEY_PREFIX_LEN,
+      compare_less_than_.is_asc(), nulls_first));
+}
+
+SortedRunMerger::~SortedRunMerger() {
 }
 
 Status SortedRunMerger::Prepare(const vector<RunBatchSupplier>& input_runs) {
-  DCHECK_EQ(min_heap_.size(), 0);
-  min_heap_.reserve(input_runs.size());
+  DCHECK_EQ(runs_.size(), 0);
+  runs_.reserve(input_runs.size());
   BOOST_FOREACH(const RunBatchSupplier& input_run, input_runs) {
     BatchedRowSupplier* new_elem = pool_.Add(new BatchedRowSupplier(this, input_run));
     DCHECK(new_elem != NULL);
     bool empty;
     RETURN_IF_ERROR(new_elem->Init(&empty));
-    if (!empty) min_heap_.push_back(new_elem);
+    if (empty) continue;
+    UpdateKeyPrefix(new_elem);
+    runs_.push_back(new_elem);
   }
 
-  // Construct the min heap from the sorted runs.
-  const int last_parent = (min_heap_.size() / 2) - 1;
-  for (int i = last_parent; i >= 0; --i) {
-    Heapify(i);
-  }
+  num_active_runs_ = runs_.size();
+  if (runs_.empty()) return Status::OK();
+  tree_.resize(runs_.size());
+  tree_[0] = BuildTree(1);
   return Status::OK();
 }
 
 Status SortedRunMerger::GetNext(RowBatch* output_batch, bool* eos) {
   ScopedTimer<MonotonicStopWatch> timer(get_next_timer_);
-  if (min_heap_.empty()) {
+  if (num_active_runs_ == 0) {
     *eos = true;
     return Status::OK();
   }
 
   while (!output_batch->AtCapacity()) {
-    BatchedRowSupplier* min = min_heap_[0];
+    int min_idx = tree_[0];
+    BatchedRowSupplier* min = runs_[min_idx];
     int output_row_index = output_batch->AddRow();
     TupleRow* output_row = output_batch->GetRow(output_row_index);
     if (deep_copy_input_) {
@@ -172,16 +217,17 @@ Status SortedRunMerger::GetNext(RowBatch* output_batch, bool* eos) {
     RETURN_IF_ERROR(min->Next(deep_copy_input_ ? NULL : output_batch,
         &min_run_complete));
     if (min_run_complete) {
-      // Remove the element from the heap.
-      iter_swap(min_heap_.begin(), min_heap_.end() - 1);
-      min_heap_.pop_back();
-      if (min_heap_.empty()) break;
+      // The exhausted run loses all matches from now on.
+      min->done_ = true;
+      if (--num_active_runs_ == 0) break;
+    } else {
+      UpdateKeyPrefix(min);
     }
 
-    Heapify(0);
+    ReplayMatches(min_idx);
   }
 
-  *eos = min_heap_.empty();
+  *eos = num_active_runs_ == 0;
   return Status::OK();
 }
 
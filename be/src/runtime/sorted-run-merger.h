@@ -24,14 +24,22 @@
 
 namespace impala {
 
+class KeyNormalizer;
 class RowBatch;
 class RowDescriptor;
 class RuntimeProfile;
 
 /// SortedRunMerger is used to merge multiple sorted runs of tuples. A run is a sorted
 /// sequence of row batches, which are fetched from a RunBatchSupplier function object.
-/// Merging is implemented using a binary min-heap that maintains the run with the next
-/// tuple in sorted order at the top of the heap.
+/// Merging is implemented using a tournament tree of losers: each inner node holds the
+/// run that lost the comparison at that node, so replacing the current row of the
+/// winning run only needs one comparison per level on the path from its leaf to the root,
+/// instead of two per level when sifting down a binary heap.
+//
+/// If all sort keys can be normalized (see KeyNormalizer), the merger caches a fixed
+/// length normalized prefix of the sort key of the current row of each run. Rows are
+/// compared with memcmp() on the prefixes and the comparator is only called if the
+/// prefixes are equal and at least one of the keys did not fit into its prefix.
 ///
 /// Merged batches of rows are retrieved from SortedRunMerger via calls to GetNext().
 /// The merger is constructed with a boolean flag deep_copy_input.
@@ -49,9 +57,10 @@ class SortedRunMerger {
   SortedRunMerger(const TupleRowComparator& compare_less_than, RowDescriptor* row_desc,
       RuntimeProfile* profile, bool deep_copy_input);
 
+  ~SortedRunMerger();
+
   /// Prepare this merger to merge and return rows from the sorted runs in 'input_runs'.
-  /// Retrieves the first batch from each run and sets up the binary heap implementing
-  /// the priority queue.
+  /// Retrieves the first batch from each run and sets up the tournament tree.
   Status Prepare(const std::vector<RunBatchSupplier>& input_runs);
 
   /// Return the next batch of sorted rows from this merger.
@@ -64,22 +73,44 @@ class SortedRunMerger {
  private:
   class BatchedRowSupplier;
 
-  /// Assuming the element at parent_index is the only out of place element in the heap,
-  /// restore the heap property (i.e. swap elements so parent <= children).
-  void Heapify(int parent_index);
+  /// Number of bytes of the normalized sort key of the current rows that are cached.
+  static const int KEY_PREFIX_LEN = 16;
+
+  /// Returns true if the current row of runs_[lhs] sorts before the current row of
+  /// runs_[rhs]. Runs that are exhausted sort after all other runs.
+  bool RunLess(int lhs, int rhs);
+
+  /// Returns the index of the winning run of the subtree of the tournament tree rooted
+  /// at 'node' and stores the losers of its inner nodes in tree_.
+  int BuildTree(int node);
+
+  /// Replays the matches on the path from the leaf of runs_[run_idx] to the root after
+  /// the current row of the run changed. Updates tree_[0] to the new winner.
+  void ReplayMatches(int run_idx);
 
-  /// The binary min-heap used to merge rows from the sorted input runs. Since the heap is
-  /// stored in a 0-indexed array, the 0-th element is the minimum element in the heap,
-  /// and the children of the element at index i are 2*i+1 and 2*i+2. The heap property is
-  /// that row of the parent element is <= the rows of the child elements according to the
-  /// comparator compare_less_than_.
-  /// The BatchedRowSupplier objects used in the min_heap_ are owned by this
-  /// SortedRunMerger instance.
-  std::vector<BatchedRowSupplier*> min_heap_;
+  /// Updates the cached key prefix of the current row of 'run'.
+  void UpdateKeyPrefix(BatchedRowSupplier* run);
+
+  /// The non-empty input runs. The BatchedRowSupplier objects are owned by pool_.
+  std::vector<BatchedRowSupplier*> runs_;
+
+  /// The tournament tree over runs_, stored as an implicit binary tree: node 1 is the
+  /// root, the children of node i are 2*i and 2*i+1, and the leaf of run i is node
+  /// runs_.size() + i. Only the inner nodes 1 to runs_.size() - 1 are stored, each holds
+  /// the index of the run that lost the comparison at that node. tree_[0] holds the
+  /// index of the overall winner, i.e. the run with the next row in sorted order.
+  std::vector<int> tree_;
+
+  /// Number of runs in runs_ that are not yet exhausted.
+  int num_active_runs_;
 
   /// Row comparator. Returns true if lhs < rhs.
   TupleRowComparator compare_less_than_;
 
+  /// Normalizes the sort keys of the current rows into key prefixes. NULL if the prefixes
+  /// are not used because some sort key can't be normalized.
+  boost::scoped_ptr<KeyNormalizer> key_normalizer_;
+
   /// Descriptor for the rows provided by the input runs. Owned by the exec-node through
   /// which this merger was created.
   RowDescriptor* input_row_desc_;
@@ -13,18 +13,39 @@
 // limitations under the License.
 
 #include "runtime/sorter.h"
+
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <gflags/gflags.h>
 #include <gutil/strings/substitute.h>
 
+#include "common/atomic.h"
+#include "exec/exec-node.h"
+#include "exprs/expr.h"
 #include "runtime/buffered-block-mgr.h"
+#include "runtime/exec-env.h"
+#include "runtime/mem-tracker.h"
 #include "runtime/row-batch.h"
 #include "runtime/runtime-state.h"
 #include "runtime/sorted-run-merger.h"
+#include "util/bit-util.h"
+#include "util/key-normalizer.inline.h"
 #include "util/runtime-profile.h"
+#include "util/thread.h"
 
 #include "common/names.h"
 
 using namespace strings;
 
+DEFINE_bool(sort_with_normalized_keys, true, "(Advanced) If true, in-memory runs are "
+    "sorted with a radix sort over a fixed-length prefix of the normalized sort keys if "
+    "all sort exprs have a supported type. The comparator is only used for rows with "
+    "equal prefixes.");
+DEFINE_int32(sort_threads, 4, "(Advanced) Maximum number of threads that sort an "
+    "in-memory run. Extra threads are only used for large runs and if thread tokens "
+    "are available.");
+
 namespace impala {
 
 // Number of pinned blocks required for a merge.
@@ -66,9 +87,12 @@ class Sorter::Run {
   /// of rows actually added in num_processed. If the run is full (no more blocks can
   /// be allocated), num_processed may be less than the number of rows in the batch.
   /// If materialize_slots_ is true, materializes the input rows using the expressions
-  /// in sorter_->sort_tuple_slot_expr_ctxs_, else just copies the input rows.
+  /// in sorter_->sort_tuple_slot_expr_ctxs_, else just copies the input rows. If
+  /// 'input_materialized' is true, the input rows of an unsorted run already consist of
+  /// sort tuples and are copied as well.
   template <bool has_var_len_data>
-  Status AddBatch(RowBatch* batch, int start_index, int* num_processed);
+  Status AddBatch(RowBatch* batch, int start_index, int* num_processed,
+      bool input_materialized = false);
 
   /// Attaches all fixed-len and var-len blocks to the given row batch.
   void TransferResources(RowBatch* row_batch);
@@ -215,22 +239,89 @@ class Sorter::Run {
 /// Quick sort is used for sequences of tuples larger that 16 elements, and insertion sort
 /// is used for smaller sequences. The TupleSorter is initialized with a RuntimeState
 /// instance to check for cancellation during an in-memory sort.
+//
+/// If all sort exprs have types that KeyNormalizer supports, runs are instead sorted by
+/// their normalized keys: an array of entries, each holding the first
+/// normalized_key_len_ bytes of the normalized key of a tuple and the index of the
+/// tuple, is sorted with an MSD radix sort. Groups of entries with equal keys are then
+/// sorted with the comparator if any key did not fit in the prefix, and finally the
+/// tuples are moved to their sorted positions. The entries are allocated outside of the
+/// block mgr, if the mem tracker does not allow them the quicksort is used.
+//
+/// Large runs are sorted with up to --sort_threads threads if thread tokens are
+/// available. The run is split into independent parts (SortTasks): the quicksort
+/// partitions the largest part around a pivot, the radix sort distributes the entries of
+/// the largest part into buckets. The parts are then sorted by the threads, each with
+/// its own TupleSorter and clones of the sort exprs.
 class Sorter::TupleSorter {
  public:
   TupleSorter(const TupleRowComparator& less_than_comp, int64_t block_size,
-      int tuple_size, RuntimeState* state);
+      int tuple_size, MemTracker* mem_tracker, RuntimeState* state);
 
   ~TupleSorter();
 
-  /// Performs a quicksort for tuples in 'run' followed by an insertion sort to
-  /// finish smaller blocks.
-  /// Returns early if stste_->is_cancelled() is true. No status
+  /// Performs a radix sort of the normalized keys if possible, otherwise a quicksort
+  /// for tuples in 'run' followed by an insertion sort to finish smaller blocks.
+  /// Runs that are already in order, e.g. because the input was presorted, are left
+  /// as they are. Returns early if stste_->is_cancelled() is true. No status
   /// is returned - the caller must check for cancellation.
   void Sort(Run* run);
 
  private:
   static const int INSERTION_THRESHOLD = 16;
 
+  /// Buckets of at most this many entries are finished with an insertion sort.
+  static const int RADIX_INSERTION_THRESHOLD = 32;
+
+  /// Maximum number of bytes of a normalized key that are sorted on.
+  static const int MAX_NORMALIZED_KEY_LEN = 32;
+
+  /// Runs with fewer tuples are sorted on a single thread.
+  static const int64_t MIN_TUPLES_PER_PARALLEL_SORT = 64 * 1024;
+
+  /// Parts of a run are not split further for a parallel sort below this size.
+  static const int64_t MIN_TUPLES_PER_SORT_TASK = 4 * 1024;
+
+  /// Number of parts per thread that a run is split into for a parallel sort, so that
+  /// threads which finish early can pick up more work.
+  static const int SORT_TASKS_PER_THREAD = 4;
+
+  /// What a thread does with the parts of a run it claims in RunSortTasks().
+  enum SortTaskType {
+    /// Write the radix sort entries of the tuples.
+    NORMALIZE_KEYS,
+    /// Radix sort the entries, then sort the ties.
+    RADIX_SORT,
+    /// Quicksort the tuples.
+    QUICK_SORT
+  };
+
+  /// A part of a run that can be handled independently of the other parts: the tuples
+  /// or entries with indexes [start, start + n). For RADIX_SORT, the key bytes before
+  /// byte_idx are equal for all of them.
+  struct SortTask {
+    int64_t start;
+    int64_t n;
+    int byte_idx;
+  };
+
+  /// Helper thread of a parallel sort, with clones of the sort exprs.
+  struct SortThread {
+    std::vector<ExprContext*> lhs_expr_ctxs;
+    std::vector<ExprContext*> rhs_expr_ctxs;
+    boost::scoped_ptr<TupleRowComparator> less_than_comp;
+    boost::scoped_ptr<TupleSorter> sorter;
+  };
+
+  /// Orders tuple indexes of run_ with less_than_comp_.
+  struct TupleIndexLess {
+    const TupleSorter* sorter;
+    bool operator()(int64_t lhs, int64_t rhs) const {
+      return sorter->less_than_comp_(reinterpret_cast<Tuple*>(sorter->GetTuple(lhs)),
+          reinterpret_cast<Tuple*>(sorter->GetTuple(rhs)));
+    }
+  };
+
   /// Helper class used to iterate over tuples in a run during quick sort and insertion
   /// sort.
   class TupleIterator {
@@ -344,8 +435,92 @@ class Sorter::TupleSorter {
   /// Checks state_->is_cancelled() and returns early if true.
   void SortHelper(TupleIterator first, TupleIterator last);
 
+  /// Returns true if the tuples of run_ are in order. Stops at the first pair of
+  /// tuples that is out of order.
+  bool IsRunSorted();
+
   /// Swaps tuples pointed to by left and right using the swap buffer.
   void Swap(uint8_t* left, uint8_t* right);
+
+  /// Normalizes the sort keys. NULL if the runs are sorted with the quicksort.
+  boost::scoped_ptr<KeyNormalizer> key_normalizer_;
+
+  /// Number of normalized key bytes per entry, a multiple of 8 so that the tuple index
+  /// that follows the key is aligned.
+  int normalized_key_len_;
+
+  /// Size of an entry: the normalized key followed by the int64_t tuple index.
+  int entry_size_;
+
+  /// Tracks the memory of the entries. Not owned.
+  MemTracker* const mem_tracker_;
+
+  /// Temporary space for one entry, used to swap and insert entries.
+  uint8_t* entry_buffer_;
+
+  /// True if the normalized key of a tuple of run_ did not fit in normalized_key_len_.
+  bool key_over_budget_;
+
+  /// Returns the tuple at index 'idx' of run_.
+  uint8_t* GetTuple(int64_t idx) const;
+
+  /// Returns the tuple index of entry 'i' of 'entries'.
+  int64_t* EntryIndex(uint8_t* entries, int64_t i) const {
+    return reinterpret_cast<int64_t*>(entries + i * entry_size_ + normalized_key_len_);
+  }
+
+  /// Sorts run_ by the normalized keys of its tuples, with the helper 'threads'.
+  /// Returns false without modifying run_ if the memory for the entries could not be
+  /// obtained.
+  bool RadixSortRun(boost::ptr_vector<SortThread>* threads);
+
+  /// Quicksorts run_ with the helper 'threads'.
+  void QuickSortRun(boost::ptr_vector<SortThread>* threads);
+
+  /// Acquires thread tokens and prepares up to --sort_threads - 1 helper threads for
+  /// sorting run_, if it is large enough.
+  void AcquireSortThreads(boost::ptr_vector<SortThread>* threads);
+
+  /// Clones the sort exprs for 'thread' and creates its TupleSorter.
+  Status PrepareSortThread(SortThread* thread);
+
+  /// Closes the expr clones of 'thread' and releases its thread token.
+  void ReleaseSortThread(SortThread* thread);
+
+  /// Handles 'tasks' of 'type' with this thread and the helper 'threads'.
+  void RunSortTasks(boost::ptr_vector<SortThread>* threads,
+      const vector<SortTask>& tasks, SortTaskType type, uint8_t* entries);
+
+  /// Claims tasks with 'next_task' and handles them until all are claimed.
+  void SortTasksThread(const vector<SortTask>* tasks, SortTaskType type,
+      uint8_t* entries, AtomicInt<int>* next_task);
+
+  /// Returns the index in 'tasks' of the task with the most tuples.
+  static int LargestSortTask(const vector<SortTask>& tasks);
+
+  /// Writes the entries for the 'n' tuples of run_ from index 'start' on. Sets
+  /// key_over_budget_ if a key did not fit.
+  void NormalizeKeys(uint8_t* entries, int64_t start, int64_t n);
+
+  /// Moves the 'n' entries starting at 'entries' into buckets by their key byte at the
+  /// first index from *byte_idx on at which they differ. Sets *byte_idx to that index and
+  /// the bucket sizes in 'counts'. Returns false if the keys are equal from *byte_idx on.
+  bool DistributeEntries(uint8_t* entries, int64_t n, int* byte_idx, int64_t* counts);
+
+  /// Sorts the 'n' entries starting at 'entries' by their normalized keys with an MSD
+  /// radix sort. The key bytes before byte_idx are equal for all of them.
+  /// Checks state_->is_cancelled() and returns early if true.
+  void RadixSort(uint8_t* entries, int64_t n, int byte_idx);
+
+  /// Sorts the 'n' entries starting at 'entries' with an insertion sort that compares
+  /// the key bytes from byte_idx on.
+  void EntryInsertionSort(uint8_t* entries, int64_t n, int byte_idx);
+
+  /// Sorts groups of adjacent entries with equal normalized keys with less_than_comp_.
+  void SortTies(uint8_t* entries, int64_t n);
+
+  /// Moves each tuple of run_ to the position of the entry holding its index.
+  void PermuteTuples(uint8_t* entries, int64_t n);
 }; // class TupleSorter
 
 // Sorter::Run methods
@@ -397,13 +572,16 @@ Status Sorter::Run::Init() {
 }
 
 template <bool has_var_len_data>
-Status Sorter::Run::AddBatch(RowBatch* batch, int start_index, int* num_processed) {
+Status Sorter::Run::AddBatch(RowBatch* batch, int start_index, int* num_processed,
+    bool input_materialized) {
   DCHECK(!fixed_len_blocks_.empty());
   *num_processed = 0;
   BufferedBlockMgr::Block* cur_fixed_len_block = fixed_len_blocks_.back();
 
   DCHECK_EQ(materialize_slots_, !is_sorted_);
-  if (!materialize_slots_) {
+  DCHECK(!input_materialized || materialize_slots_);
+  const bool materialize = materialize_slots_ && !input_materialized;
+  if (!materialize) {
     // If materialize slots is false the run is being constructed for an
     // intermediate merge and the sort tuples have already been materialized.
     // The input row should have the same schema as the sort tuples.
@@ -433,7 +611,7 @@ Status Sorter::Run::AddBatch(RowBatch* batch, int start_index, int* num_processe
       int total_var_len = 0;
       TupleRow* input_row = batch->GetRow(cur_input_index);
       Tuple* new_tuple = cur_fixed_len_block->Allocate<Tuple>(sort_tuple_size_);
-      if (materialize_slots_) {
+      if (materialize) {
         new_tuple->MaterializeExprs<has_var_len_data>(input_row, *sort_tuple_desc_,
             sorter_->sort_tuple_slot_expr_ctxs_, NULL, &string_values, &total_var_len);
         if (total_var_len > sorter_->block_mgr_->max_block_size()) {
@@ -831,28 +1009,379 @@ void Sorter::Run::CopyVarLenDataConvertOffset(char* dest, int64_t offset,
 
 // Sorter::TupleSorter methods.
 Sorter::TupleSorter::TupleSorter(const TupleRowComparator& comp, int64_t block_size,
-    int tuple_size, RuntimeState* state)
+    int tuple_size, MemTracker* mem_tracker, RuntimeState* state)
   : tuple_size_(tuple_size),
     block_capacity_(block_size / tuple_size),
     last_tuple_block_offset_(tuple_size * ((block_size / tuple_size) - 1)),
     less_than_comp_(comp),
-    state_(state) {
+    state_(state),
+    normalized_key_len_(0),
+    entry_size_(0),
+    mem_tracker_(mem_tracker),
+    entry_buffer_(NULL),
+    key_over_budget_(false) {
   temp_tuple_buffer_ = new uint8_t[tuple_size];
   temp_tuple_row_ = reinterpret_cast<TupleRow*>(&temp_tuple_buffer_);
   swap_buffer_ = new uint8_t[tuple_size];
+
+  if (!FLAGS_sort_with_normalized_keys) return;
+  const vector<ExprContext*>& key_expr_ctxs = comp.key_expr_ctxs_lhs();
+  vector<bool> nulls_first;
+  int key_len = 0;
+  for (int i = 0; i < key_expr_ctxs.size(); ++i) {
+    const ColumnType& type = key_expr_ctxs[i]->root()->type();
+    if (!KeyNormalizer::IsSupportedType(type)) return;
+    if (type.IsVarLenStringType()) {
+      key_len += MAX_NORMALIZED_KEY_LEN;
+    } else {
+      // The null byte followed by the value.
+      key_len += 1 + type.GetByteSize();
+    }
+    nulls_first.push_back(comp.nulls_first(i));
+  }
+  if (key_expr_ctxs.empty()) return;
+  normalized_key_len_ = BitUtil::RoundUp(
+      key_len < MAX_NORMALIZED_KEY_LEN ? key_len : MAX_NORMALIZED_KEY_LEN, 8);
+  entry_size_ = normalized_key_len_ + sizeof(int64_t);
+  key_normalizer_.reset(new KeyNormalizer(key_expr_ctxs, normalized_key_len_,
+      comp.is_asc(), nulls_first));
+  entry_buffer_ = new uint8_t[entry_size_];
 }
 
 Sorter::TupleSorter::~TupleSorter() {
   delete[] temp_tuple_buffer_;
   delete[] swap_buffer_;
+  delete[] entry_buffer_;
 }
 
 void Sorter::TupleSorter::Sort(Run* run) {
   run_ = run;
-  SortHelper(TupleIterator(this, 0), TupleIterator(this, run_->num_tuples_));
+  if (IsRunSorted()) {
+    run->is_sorted_ = true;
+    return;
+  }
+  boost::ptr_vector<SortThread> threads;
+  AcquireSortThreads(&threads);
+  if (key_normalizer_.get() == NULL || !RadixSortRun(&threads)) QuickSortRun(&threads);
+  for (int i = 0; i < threads.size(); ++i) ReleaseSortThread(&threads[i]);
   run->is_sorted_ = true;
 }
 
+bool Sorter::TupleSorter::IsRunSorted() {
+  if (run_->num_tuples_ < 2) return true;
+  TupleIterator prev(this, 0);
+  TupleIterator next(this, 1);
+  for (int64_t i = 1; i < run_->num_tuples_; ++i) {
+    if (less_than_comp_(reinterpret_cast<Tuple*>(next.current_tuple_),
+        reinterpret_cast<Tuple*>(prev.current_tuple_))) {
+      return false;
+    }
+    prev.Next();
+    next.Next();
+  }
+  return true;
+}
+
+void Sorter::TupleSorter::AcquireSortThreads(boost::ptr_vector<SortThread>* threads) {
+  if (run_->num_tuples_ < MIN_TUPLES_PER_PARALLEL_SORT) return;
+  for (int i = 1; i < FLAGS_sort_threads; ++i) {
+    if (!state_->resource_pool()->TryAcquireThreadToken()) break;
+    threads->push_back(new SortThread());
+    Status status = PrepareSortThread(&threads->back());
+    if (!status.ok()) {
+      VLOG_QUERY << "Failed to prepare sort thread: " << status.GetDetail();
+      ReleaseSortThread(&threads->back());
+      threads->pop_back();
+      break;
+    }
+  }
+}
+
+Status Sorter::TupleSorter::PrepareSortThread(SortThread* thread) {
+  RETURN_IF_ERROR(Expr::CloneIfNotExists(less_than_comp_.key_expr_ctxs_lhs(), state_,
+      &thread->lhs_expr_ctxs));
+  RETURN_IF_ERROR(Expr::CloneIfNotExists(less_than_comp_.key_expr_ctxs_rhs(), state_,
+      &thread->rhs_expr_ctxs));
+  thread->less_than_comp.reset(new TupleRowComparator(less_than_comp_,
+      thread->lhs_expr_ctxs, thread->rhs_expr_ctxs));
+  thread->sorter.reset(new TupleSorter(*thread->less_than_comp,
+      block_capacity_ * tuple_size_, tuple_size_, mem_tracker_, state_));
+  thread->sorter->run_ = run_;
+  return Status::OK();
+}
+
+void Sorter::TupleSorter::ReleaseSortThread(SortThread* thread) {
+  Expr::Close(thread->lhs_expr_ctxs, state_);
+  Expr::Close(thread->rhs_expr_ctxs, state_);
+  state_->resource_pool()->ReleaseThreadToken(false);
+}
+
+void Sorter::TupleSorter::RunSortTasks(boost::ptr_vector<SortThread>* threads,
+    const vector<SortTask>& tasks, SortTaskType type, uint8_t* entries) {
+  AtomicInt<int> next_task(0);
+  ThreadGroup sort_threads;
+  if (!state_->cgroup().empty()) {
+    sort_threads.SetCgroupsMgr(state_->exec_env()->cgroups_mgr());
+    sort_threads.SetCgroup(state_->cgroup());
+  }
+  for (int i = 0; i < threads->size(); ++i) {
+    TupleSorter* sorter = (*threads)[i].sorter.get();
+    sorter->key_over_budget_ = key_over_budget_;
+    sort_threads.AddThread(new Thread("sorter", Substitute("sort thread $0", i),
+        bind(&TupleSorter::SortTasksThread, sorter, &tasks, type, entries,
+            &next_task)));
+  }
+  SortTasksThread(&tasks, type, entries, &next_task);
+  sort_threads.JoinAll();
+  for (int i = 0; i < threads->size(); ++i) {
+    key_over_budget_ |= (*threads)[i].sorter->key_over_budget_;
+  }
+}
+
+void Sorter::TupleSorter::SortTasksThread(const vector<SortTask>* tasks,
+    SortTaskType type, uint8_t* entries, AtomicInt<int>* next_task) {
+  while (true) {
+    int idx = next_task->FetchAndUpdate(1);
+    if (idx >= tasks->size() || UNLIKELY(state_->is_cancelled())) break;
+    const SortTask& task = (*tasks)[idx];
+    switch (type) {
+      case NORMALIZE_KEYS:
+        NormalizeKeys(entries, task.start, task.n);
+        break;
+      case RADIX_SORT: {
+        uint8_t* task_entries = entries + task.start * entry_size_;
+        RadixSort(task_entries, task.n, task.byte_idx);
+        // Entries with equal keys can't be in different tasks.
+        if (key_over_budget_) SortTies(task_entries, task.n);
+        break;
+      }
+      case QUICK_SORT:
+        SortHelper(TupleIterator(this, task.start),
+            TupleIterator(this, task.start + task.n));
+        break;
+    }
+  }
+}
+
+int Sorter::TupleSorter::LargestSortTask(const vector<SortTask>& tasks) {
+  int largest = 0;
+  for (int i = 1; i < tasks.size(); ++i) {
+    if (tasks[i].n > tasks[largest].n) largest = i;
+  }
+  return largest;
+}
+
+void Sorter::TupleSorter::QuickSortRun(boost::ptr_vector<SortThread>* threads) {
+  SortTask run_task = {0, run_->num_tuples_, 0};
+  vector<SortTask> tasks(1, run_task);
+  int num_tasks = threads->empty() ? 1 : SORT_TASKS_PER_THREAD * (threads->size() + 1);
+  while (tasks.size() < num_tasks) {
+    int largest = LargestSortTask(tasks);
+    SortTask task = tasks[largest];
+    if (task.n < MIN_TUPLES_PER_SORT_TASK) break;
+    TupleIterator pivot(this, task.start + task.n / 2);
+    TupleIterator cut = Partition(TupleIterator(this, task.start),
+        TupleIterator(this, task.start + task.n),
+        reinterpret_cast<Tuple*>(pivot.current_tuple_));
+    if (UNLIKELY(state_->is_cancelled())) return;
+    int64_t first_n = cut.index_ - task.start;
+    if (first_n <= 0 || first_n >= task.n) break;
+    tasks[largest].n = first_n;
+    SortTask second = {cut.index_, task.n - first_n, 0};
+    tasks.push_back(second);
+  }
+  RunSortTasks(threads, tasks, QUICK_SORT, NULL);
+}
+
+inline uint8_t* Sorter::TupleSorter::GetTuple(int64_t idx) const {
+  return run_->fixed_len_blocks_[idx / block_capacity_]->buffer() +
+      (idx % block_capacity_) * tuple_size_;
+}
+
+bool Sorter::TupleSorter::RadixSortRun(boost::ptr_vector<SortThread>* threads) {
+  const int64_t n = run_->num_tuples_;
+  const int64_t entries_size = n * entry_size_;
+  if (!mem_tracker_->TryConsume(entries_size)) return false;
+  uint8_t* entries = reinterpret_cast<uint8_t*>(malloc(entries_size));
+  if (UNLIKELY(entries == NULL && n > 0)) {
+    mem_tracker_->Release(entries_size);
+    return false;
+  }
+
+  key_over_budget_ = false;
+  int num_tasks = threads->empty() ? 1 : SORT_TASKS_PER_THREAD * (threads->size() + 1);
+  vector<SortTask> tasks;
+  for (int i = 0; i < num_tasks; ++i) {
+    SortTask task;
+    task.start = n * i / num_tasks;
+    task.n = n * (i + 1) / num_tasks - task.start;
+    task.byte_idx = 0;
+    tasks.push_back(task);
+  }
+  RunSortTasks(threads, tasks, NORMALIZE_KEYS, entries);
+
+  SortTask run_task = {0, n, 0};
+  tasks.assign(1, run_task);
+  while (!tasks.empty() && tasks.size() < num_tasks && !state_->is_cancelled()) {
+    int largest = LargestSortTask(tasks);
+    SortTask task = tasks[largest];
+    if (task.n < MIN_TUPLES_PER_SORT_TASK) break;
+    int64_t counts[256];
+    int byte_idx = task.byte_idx;
+    if (!DistributeEntries(entries + task.start * entry_size_, task.n, &byte_idx,
+        counts)) {
+      break;
+    }
+    // Replace the task by its buckets. Single entries are already in place.
+    tasks.erase(tasks.begin() + largest);
+    int64_t start = task.start;
+    for (int b = 0; b < 256; ++b) {
+      if (counts[b] > 1) {
+        SortTask bucket = {start, counts[b], byte_idx + 1};
+        tasks.push_back(bucket);
+      }
+      start += counts[b];
+    }
+  }
+  // The run is discarded if the query was cancelled, it doesn't need to be sorted.
+  if (LIKELY(!state_->is_cancelled())) {
+    RunSortTasks(threads, tasks, RADIX_SORT, entries);
+    if (LIKELY(!state_->is_cancelled())) PermuteTuples(entries, n);
+  }
+  free(entries);
+  mem_tracker_->Release(entries_size);
+  return true;
+}
+
+void Sorter::TupleSorter::NormalizeKeys(uint8_t* entries, int64_t start, int64_t n) {
+  if (n == 0) return;
+  TupleIterator iter(this, start);
+  for (int64_t idx = start; idx < start + n; ++idx, iter.Next()) {
+    key_over_budget_ |= key_normalizer_->NormalizeKey(
+        reinterpret_cast<TupleRow*>(&iter.current_tuple_), entries + idx * entry_size_);
+    *EntryIndex(entries, idx) = idx;
+  }
+}
+
+bool Sorter::TupleSorter::DistributeEntries(uint8_t* entries, int64_t n, int* byte_idx,
+    int64_t* counts) {
+  while (true) {
+    if (*byte_idx == normalized_key_len_) return false;
+    memset(counts, 0, 256 * sizeof(int64_t));
+    for (int64_t i = 0; i < n; ++i) ++counts[entries[i * entry_size_ + *byte_idx]];
+    if (counts[entries[*byte_idx]] < n) break;
+    // All entries have the same byte, sort on the next one.
+    ++*byte_idx;
+  }
+
+  // Move the entries to their buckets in place (American flag sort). heads[b] is the
+  // next unsorted entry of bucket b, tails[b] the end of bucket b.
+  int64_t heads[256];
+  int64_t tails[256];
+  int64_t offset = 0;
+  for (int b = 0; b < 256; ++b) {
+    heads[b] = offset;
+    offset += counts[b];
+    tails[b] = offset;
+  }
+  for (int b = 0; b < 256; ++b) {
+    while (heads[b] < tails[b]) {
+      uint8_t* entry = entries + heads[b] * entry_size_;
+      int entry_bucket = entry[*byte_idx];
+      if (entry_bucket == b) {
+        ++heads[b];
+        continue;
+      }
+      uint8_t* dst = entries + heads[entry_bucket] * entry_size_;
+      memcpy(entry_buffer_, dst, entry_size_);
+      memcpy(dst, entry, entry_size_);
+      memcpy(entry, entry_buffer_, entry_size_);
+      ++heads[entry_bucket];
+    }
+  }
+  return true;
+}
+
+void Sorter::TupleSorter::RadixSort(uint8_t* entries, int64_t n, int byte_idx) {
+  if (n <= RADIX_INSERTION_THRESHOLD) {
+    EntryInsertionSort(entries, n, byte_idx);
+    return;
+  }
+  int64_t counts[256];
+  if (!DistributeEntries(entries, n, &byte_idx, counts)) return;
+  if (UNLIKELY(state_->is_cancelled())) return;
+  uint8_t* bucket = entries;
+  for (int b = 0; b < 256; ++b) {
+    if (counts[b] > 1) RadixSort(bucket, counts[b], byte_idx + 1);
+    bucket += counts[b] * entry_size_;
+  }
+}
+
+void Sorter::TupleSorter::EntryInsertionSort(uint8_t* entries, int64_t n,
+    int byte_idx) {
+  const int len = normalized_key_len_ - byte_idx;
+  if (len == 0) return;
+  for (int64_t i = 1; i < n; ++i) {
+    uint8_t* insert = entries + i * entry_size_;
+    if (memcmp(insert - entry_size_ + byte_idx, insert + byte_idx, len) <= 0) continue;
+    memcpy(entry_buffer_, insert, entry_size_);
+    uint8_t* copy_to = insert;
+    while (copy_to > entries &&
+        memcmp(copy_to - entry_size_ + byte_idx, entry_buffer_ + byte_idx, len) > 0) {
+      memcpy(copy_to, copy_to - entry_size_, entry_size_);
+      copy_to -= entry_size_;
+    }
+    memcpy(copy_to, entry_buffer_, entry_size_);
+  }
+}
+
+void Sorter::TupleSorter::SortTies(uint8_t* entries, int64_t n) {
+  TupleIndexLess less;
+  less.sorter = this;
+  vector<int64_t> tuple_idxs;
+  int64_t group_start = 0;
+  while (group_start < n) {
+    uint8_t* key = entries + group_start * entry_size_;
+    int64_t group_end = group_start + 1;
+    while (group_end < n &&
+        memcmp(key, entries + group_end * entry_size_, normalized_key_len_) == 0) {
+      ++group_end;
+    }
+    if (group_end - group_start > 1) {
+      tuple_idxs.clear();
+      for (int64_t i = group_start; i < group_end; ++i) {
+        tuple_idxs.push_back(*EntryIndex(entries, i));
+      }
+      std::sort(tuple_idxs.begin(), tuple_idxs.end(), less);
+      for (int64_t i = group_start; i < group_end; ++i) {
+        *EntryIndex(entries, i) = tuple_idxs[i - group_start];
+      }
+    }
+    group_start = group_end;
+  }
+}
+
+void Sorter::TupleSorter::PermuteTuples(uint8_t* entries, int64_t n) {
+  // Follow each cycle of the permutation, moving the tuple at the source index of an
+  // entry to the position of the entry. Entries that were handled get their own index.
+  for (int64_t i = 0; i < n; ++i) {
+    if (*EntryIndex(entries, i) == i) continue;
+    memcpy(temp_tuple_buffer_, GetTuple(i), tuple_size_);
+    int64_t dst = i;
+    while (true) {
+      int64_t* src_idx = EntryIndex(entries, dst);
+      int64_t src = *src_idx;
+      *src_idx = dst;
+      if (src == i) {
+        memcpy(GetTuple(dst), temp_tuple_buffer_, tuple_size_);
+        break;
+      }
+      memcpy(GetTuple(dst), GetTuple(src), tuple_size_);
+      dst = src;
+    }
+  }
+}
+
 // Sort the sequence of tuples from [first, last).
 // Begin with a sorted sequence of size 1 [first, first+1).
 // During each pass of the outermost loop, add the next tuple (at position 'i') to
@@ -977,12 +1506,22 @@ Sorter::~Sorter() {
   block_mgr_->ClearReservations(block_mgr_client_);
 }
 
+int Sorter::MinRequiredBuffers() const {
+  int min_blocks_required = BLOCKS_REQUIRED_FOR_MERGE;
+  // Fixed and var-length blocks are separate, so we need BLOCKS_REQUIRED_FOR_MERGE
+  // blocks for both if there is var-length data.
+  if (output_row_desc_->tuple_descriptors()[0]->HasVarlenSlots()) {
+    min_blocks_required *= 2;
+  }
+  return min_blocks_required;
+}
+
 Status Sorter::Init() {
   DCHECK(unsorted_run_ == NULL) << "Already initialized";
   TupleDescriptor* sort_tuple_desc = output_row_desc_->tuple_descriptors()[0];
   has_var_len_slots_ = sort_tuple_desc->HasVarlenSlots();
   in_mem_tuple_sorter_.reset(new TupleSorter(compare_less_than_,
-      block_mgr_->max_block_size(), sort_tuple_desc->byte_size(), state_));
+      block_mgr_->max_block_size(), sort_tuple_desc->byte_size(), mem_tracker_, state_));
   unsorted_run_ = obj_pool_.Add(new Run(this, sort_tuple_desc, true));
 
   initial_runs_counter_ = ADD_COUNTER(profile_, "InitialRunsCreated", TUnit::UNIT);
@@ -990,14 +1529,10 @@ Status Sorter::Init() {
   in_mem_sort_timer_ = ADD_TIMER(profile_, "InMemorySortTime");
   sorted_data_size_ = ADD_COUNTER(profile_, "SortDataSize", TUnit::BYTES);
 
-  int min_blocks_required = BLOCKS_REQUIRED_FOR_MERGE;
-  // Fixed and var-length blocks are separate, so we need BLOCKS_REQUIRED_FOR_MERGE
-  // blocks for both if there is var-length data.
-  if (output_row_desc_->tuple_descriptors()[0]->HasVarlenSlots()) {
-    min_blocks_required *= 2;
-  }
   RETURN_IF_ERROR(block_mgr_->RegisterClient(Substitute("Sorter ptr=$0", this),
-      min_blocks_required, false, mem_tracker_, state_, &block_mgr_client_));
+      MinRequiredBuffers(), false, mem_tracker_, state_, &block_mgr_client_));
+  block_mgr_->SetClientWaitTimer(block_mgr_client_,
+      ADD_TIMER(profile_, ExecNode::SPILL_WAIT_TIMER));
 
   DCHECK(unsorted_run_ != NULL);
   RETURN_IF_ERROR(unsorted_run_->Init());
@@ -1005,6 +1540,14 @@ Status Sorter::Init() {
 }
 
 Status Sorter::AddBatch(RowBatch* batch) {
+  return AddBatchInternal(batch, false);
+}
+
+Status Sorter::AddMaterializedBatch(RowBatch* batch) {
+  return AddBatchInternal(batch, true);
+}
+
+Status Sorter::AddBatchInternal(RowBatch* batch, bool input_materialized) {
   DCHECK(unsorted_run_ != NULL);
   DCHECK(batch != NULL);
   int num_processed = 0;
@@ -1012,10 +1555,10 @@ Status Sorter::AddBatch(RowBatch* batch) {
   while (cur_batch_index < batch->num_rows()) {
     if (has_var_len_slots_) {
       RETURN_IF_ERROR(unsorted_run_->AddBatch<true>(
-          batch, cur_batch_index, &num_processed));
+          batch, cur_batch_index, &num_processed, input_materialized));
     } else {
       RETURN_IF_ERROR(unsorted_run_->AddBatch<false>(
-          batch, cur_batch_index, &num_processed));
+          batch, cur_batch_index, &num_processed, input_materialized));
     }
     cur_batch_index += num_processed;
     if (cur_batch_index < batch->num_rows()) {
@@ -1060,12 +1603,15 @@ Status Sorter::InputDone() {
     // For an intermediate merge, intermediate_merge_batch contains deep-copied rows from
     // the input runs. If (unmerged_sorted_runs_.size() > max_runs_per_final_merge),
     // one or more intermediate merges are required.
-    // TODO: Attempt to allocate more memory before doing intermediate merges. This may
-    // be possible if other operators have relinquished memory after the sort has built
-    // its runs.
     if (min_buffers_for_merge > block_mgr_->available_allocated_buffers()) {
       DCHECK(unpinned_final);
-      RETURN_IF_ERROR(MergeIntermediateRuns());
+      // Other operators may have relinquished memory after the sort has built its runs.
+      // Try to reserve enough buffers to merge all runs at once, each intermediate merge
+      // rewrites all of its input to scratch.
+      if (!block_mgr_->TryAcquireTmpReservation(block_mgr_client_,
+          min_buffers_for_merge)) {
+        RETURN_IF_ERROR(MergeIntermediateRuns());
+      }
     }
 
     // Create the final merger.
@@ -1161,12 +1707,12 @@ Status Sorter::MergeIntermediateRuns() {
   // the input runs. If (sorted_runs_.size() > max_runs_per_final_merge),
   // one or more intermediate merges are required.
   scoped_ptr<RowBatch> intermediate_merge_batch;
+  int num_runs_to_merge = FirstIntermediateMergeFanIn(sorted_runs_.size(),
+      max_runs_per_final_merge, max_runs_per_intermediate_merge);
   while (sorted_runs_.size() > max_runs_per_final_merge) {
-    // An intermediate merge adds one merge to unmerged_sorted_runs_.
-    // Merging 'runs - (max_runs_final_ - 1)' number of runs is sifficient to guarantee
-    // that the final merge can be performed.
-    int num_runs_to_merge = min<int>(max_runs_per_intermediate_merge,
-        sorted_runs_.size() - max_runs_per_intermediate_merge);
+    // An intermediate merge replaces 'num_runs_to_merge' runs in sorted_runs_ with the
+    // merged run, which is appended at the back. The initial runs at the front are
+    // merged first, so every run takes part in as few merges as possible.
     RETURN_IF_ERROR(CreateMerger(num_runs_to_merge));
     RowBatch intermediate_merge_batch(*output_row_desc_, state_->batch_size(),
         mem_tracker_);
@@ -1212,11 +1758,25 @@ Status Sorter::MergeIntermediateRuns() {
     }
     merged_run->is_pinned_ = false;
     sorted_runs_.push_back(merged_run);
+    num_runs_to_merge = max_runs_per_intermediate_merge;
   }
 
   return Status::OK();
 }
 
+int Sorter::FirstIntermediateMergeFanIn(int num_runs, int max_runs_per_final_merge,
+    int max_runs_per_intermediate_merge) {
+  DCHECK_GT(num_runs, max_runs_per_final_merge);
+  DCHECK_GT(max_runs_per_intermediate_merge, 1);
+  // Each merge of k runs reduces the number of runs by k - 1. The runs that are in excess
+  // of the final fan-in are removed by full intermediate merges, which remove
+  // max_runs_per_intermediate_merge - 1 runs each, and one smaller merge for the
+  // remainder. The smaller merge goes first, so that less data is rewritten by it.
+  int excess_runs = num_runs - max_runs_per_final_merge;
+  int full_merge_reduction = max_runs_per_intermediate_merge - 1;
+  return (excess_runs - 1) % full_merge_reduction + 2;
+}
+
 Status Sorter::CreateMerger(int num_runs) {
   DCHECK_GT(num_runs, 1);
 
@@ -55,7 +55,9 @@ class RowBatch;
 /// converted to offsets from the start of the first var-len data block. When a block is
 /// read back, these offsets are converted back to pointers.
 /// The in-memory sorter sorts the fixed-length tuples in-place. The output rows have the
-/// same schema as the materialized sort tuples.
+/// same schema as the materialized sort tuples. If the sort exprs can be normalized
+/// into memcmp-comparable keys (see KeyNormalizer), the in-memory sorter radix sorts a
+/// fixed-length prefix of the keys instead of calling the comparator for every pair.
 //
 /// After the input is consumed, the sorter is left with one or more sorted runs. The
 /// client calls GetNext(output_batch) to retrieve batches of sorted rows. If there are
@@ -100,9 +102,17 @@ class Sorter {
   /// of the unsorted_run_, both of these may fail.
   Status Init();
 
+  /// Returns the number of block mgr buffers that the sorter reserves: enough to merge
+  /// runs.
+  int MinRequiredBuffers() const;
+
   /// Adds a batch of input rows to the current unsorted run.
   Status AddBatch(RowBatch* batch);
 
+  /// Same as AddBatch() for a batch of rows that consist of already materialized sort
+  /// tuples, which are copied as they are.
+  Status AddMaterializedBatch(RowBatch* batch);
+
   /// Called to indicate there is no more input. Triggers the creation of merger(s) if
   /// necessary.
   Status InputDone();
@@ -142,8 +152,19 @@ class Sorter {
   /// a merge. If the number of sorted runs is too large, merge sets of smaller runs
   /// into large runs until a final merge can be performed. An intermediate row batch
   /// containing deep copied rows is used for the output of each intermediate merge.
+  /// The merges are planned so that every run is rewritten as few times as possible:
+  /// the first merge combines just enough runs that all later merges, including the
+  /// final one, can use the maximum fan-in.
   Status MergeIntermediateRuns();
 
+  /// Returns the number of runs to merge in the first intermediate merge, given the
+  /// number of sorted runs and the maximum fan-in of the final and intermediate merges.
+  static int FirstIntermediateMergeFanIn(int num_runs, int max_runs_per_final_merge,
+      int max_runs_per_intermediate_merge);
+
+  /// Implements AddBatch() and AddMaterializedBatch().
+  Status AddBatchInternal(RowBatch* batch, bool input_materialized);
+
   /// Sorts unsorted_run_ and appends it to the list of sorted runs. Deletes any empty
   /// blocks at the end of the run. Updates the sort bytes counter if necessary.
   Status SortRun();
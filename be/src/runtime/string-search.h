@@ -22,14 +22,18 @@
 
 #include "common/logging.h"
 #include "runtime/string-value.h"
+#include "util/sse-util.h"
 
 namespace impala {
 
-/// TODO: This can be sped up with SIDD_CMP_EQUAL_ORDERED or at the very least rewritten
-/// from published algorithms.
+/// Strings with at least 16 candidate positions are first scanned with SSE2, 16
+/// positions at a time: a position is only a candidate if both the first and the last
+/// character of the pattern match there, and only candidates are compared in full (see
+/// SearchSSE()). This only needs SSE2, which all x86-64 CPUs support, so it needs no
+/// runtime check. The remaining positions are searched with the scalar algorithm.
 //
-/// This is taken from the python search string function doing string search (substring)
-/// using an optimized boyer-moore-horspool algorithm.
+/// The scalar algorithm is taken from the python search string function doing string
+/// search (substring) using an optimized boyer-moore-horspool algorithm.
 /// http://hg.python.org/cpython/file/6b6c79eba944/Objects/stringlib/fastsearch.h
 //
 /// PYTHON SOFTWARE FOUNDATION LICENSE VERSION 2
@@ -127,12 +131,19 @@ class StringSearch {
       return -1;
     }
 
+    // Scan most of the string with SSE.
+    int start = 0;
+    if (w + 1 >= SSEUtil::CHARS_PER_128_BIT_REGISTER) {
+      int result = SearchSSE(s, n, &start);
+      if (result != -1) return result;
+    }
+
     // General case.
     int j;
     // TODO: the original code seems to have an off by one error. It is possible
     // to index at w + m which is the length of the input string. Checks have
     // been added to make sure that w + m < str->len.
-    for (int i = 0; i <= w; i++) {
+    for (int i = start; i <= w; i++) {
       // note: using mlast in the skip path slows things down on x86
       if (s[i+m-1] == p[m-1]) {
         // candidate match
@@ -159,6 +170,35 @@ class StringSearch {
  private:
   static const int BLOOM_WIDTH = 64;
 
+  /// Searches the pattern, which must have at least 2 characters, at the positions of
+  /// the 'n' characters 's' that can be checked with whole 16 byte blocks. Returns the
+  /// offset of the first match, or -1 if there is none, in which case '*end' is set to
+  /// the first position that wasn't checked.
+  int SearchSSE(const char* s, int n, int* end) const {
+    const int m = pattern_->len;
+    const char* p = pattern_->ptr;
+    const __m128i first = _mm_set1_epi8(p[0]);
+    const __m128i last = _mm_set1_epi8(p[m - 1]);
+    int i = 0;
+    for (; i + m - 1 + SSEUtil::CHARS_PER_128_BIT_REGISTER <= n;
+         i += SSEUtil::CHARS_PER_128_BIT_REGISTER) {
+      // Bit k of 'candidates' is set if the first and last character match at i + k.
+      const __m128i block_first =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+      const __m128i block_last =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i + m - 1));
+      int candidates = _mm_movemask_epi8(_mm_and_si128(
+          _mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+      while (candidates != 0) {
+        int k = __builtin_ctz(candidates);
+        if (memcmp(s + i + k + 1, p + 1, m - 2) == 0) return i + k;
+        candidates &= candidates - 1;
+      }
+    }
+    *end = i;
+    return -1;
+  }
+
   void BloomAdd(char c) {
     mask_ |= (1UL << (c & (BLOOM_WIDTH - 1)));
   }
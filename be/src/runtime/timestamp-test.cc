@@ -19,6 +19,7 @@
 #include <gtest/gtest.h>
 
 #include "common/init.h"
+#include "runtime/civil-time.h"
 #include "runtime/raw-value.h"
 #include "runtime/timestamp-value.h"
 #include "util/string-parser.h"
@@ -618,6 +619,51 @@ TEST(TimestampTest, Basic) {
   EXPECT_EQ("1970-01-01 00:00:00.008000000", TimestampValue(0.008).DebugString());
 }
 
+// Compares CivilTime with boost for every supported date.
+TEST(TimestampTest, CivilTime) {
+  uint32_t min_day = date(1400, 1, 1).day_number();
+  uint32_t max_day = date(9999, Dec, 31).day_number();
+  for (uint32_t day_number = min_day; day_number <= max_day; ++day_number) {
+    date d(day_number);
+    int year, month, day;
+    CivilTime::ToYearMonthDay(day_number, &year, &month, &day);
+    ASSERT_EQ(d.year(), year) << day_number;
+    ASSERT_EQ(d.month(), month) << day_number;
+    ASSERT_EQ(d.day(), day) << day_number;
+    ASSERT_EQ(day_number, CivilTime::ToDayNumber(year, month, day));
+    ASSERT_EQ(d.day_of_year(), CivilTime::DayOfYear(year, month, day)) << day_number;
+    ASSERT_EQ(d.day_of_week(), CivilTime::DayOfWeek(day_number)) << day_number;
+    ASSERT_EQ(d.end_of_month().day(), CivilTime::DaysInMonth(year, month));
+  }
+
+  EXPECT_TRUE(CivilTime::IsSpecialDate(date(not_a_date_time).day_number()));
+  EXPECT_TRUE(CivilTime::IsSpecialDate(date(boost::date_time::pos_infin).day_number()));
+  EXPECT_TRUE(CivilTime::IsSpecialDate(date(boost::date_time::neg_infin).day_number()));
+  EXPECT_FALSE(CivilTime::IsSpecialDate(min_day));
+  EXPECT_FALSE(CivilTime::IsSpecialDate(max_day));
+  EXPECT_TRUE(CivilTime::IsSpecialTime(time_duration(not_a_date_time).ticks()));
+  EXPECT_TRUE(CivilTime::IsSpecialTime(
+      time_duration(boost::date_time::pos_infin).ticks()));
+  EXPECT_TRUE(CivilTime::IsSpecialTime(
+      time_duration(boost::date_time::neg_infin).ticks()));
+  EXPECT_FALSE(CivilTime::IsSpecialTime(0));
+  EXPECT_FALSE(CivilTime::IsSpecialTime(CivilTime::NANOS_PER_DAY - 1));
+
+  const int64_t unix_times[] = { -12219292800L, -86401, -1, 0, 1, 86399, 86400,
+      1382337792, 253402300799L };
+  for (int i = 0; i < sizeof(unix_times) / sizeof(unix_times[0]); ++i) {
+    uint32_t day_number;
+    int64_t nanos;
+    CivilTime::FromUnixTime(unix_times[i], &day_number, &nanos);
+    EXPECT_GE(nanos, 0);
+    EXPECT_LT(nanos, CivilTime::NANOS_PER_DAY);
+    EXPECT_EQ(unix_times[i], CivilTime::ToUnixTime(day_number, nanos + 1));
+    time_t expected;
+    EXPECT_TRUE(TimestampValue(unix_times[i]).ToUnixTime(&expected));
+    EXPECT_EQ(unix_times[i], expected);
+  }
+}
+
 }
 
 int main(int argc, char **argv) {
@@ -105,6 +105,15 @@ ptime TimestampValue::UnixTimeToPtime(time_t unix_time) const {
       return ptime(not_a_date_time);
     }
   } else {
+    // Convert UTC times arithmetically. Times outside of the years that every boost
+    // version supports take the gmtime_r() path, which handles the range errors.
+    uint32_t day_number;
+    int64_t nanos;
+    CivilTime::FromUnixTime(unix_time, &day_number, &nanos);
+    if (LIKELY(day_number >= CivilTime::ToDayNumber(1400, 1, 1) &&
+        day_number <= CivilTime::ToDayNumber(9999, 12, 31))) {
+      return ptime(date(day_number), nanoseconds(nanos));
+    }
     if (UNLIKELY(gmtime_r(&unix_time, &temp_tm) == NULL)) {
       return ptime(not_a_date_time);
     }
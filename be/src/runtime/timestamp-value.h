@@ -23,6 +23,7 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <gflags/gflags.h>
 
+#include "runtime/civil-time.h"
 #include "runtime/timestamp-parse-util.h"
 #include "udf/udf.h"
 #include "util/hash-util.h"
@@ -167,13 +168,13 @@ class TimestampValue {
   bool ToUnixTime(time_t* unix_time) const {
     DCHECK(unix_time != NULL);
     if (UNLIKELY(!HasDateAndTime())) return false;
+    if (!FLAGS_use_local_tz_for_unix_timestamp_conversions) {
+      *unix_time = CivilTime::ToUnixTime(date_.day_number(), time_.ticks());
+      return true;
+    }
     const boost::posix_time::ptime temp(date_, time_);
     tm temp_tm = boost::posix_time::to_tm(temp);
-    if (FLAGS_use_local_tz_for_unix_timestamp_conversions) {
-      *unix_time = mktime(&temp_tm);
-    } else {
-      *unix_time = timegm(&temp_tm);
-    }
+    *unix_time = mktime(&temp_tm);
     return true;
   }
 
@@ -23,6 +23,7 @@
 #include "service/fe-support.h"
 #include "util/filesystem-util.h"
 #include "util/metrics.h"
+#include "util/time.h"
 
 #include "gen-cpp/Types_types.h"  // for TUniqueId
 
@@ -97,6 +98,25 @@ TEST_F(TmpFileMgrTest, TestFileAllocation) {
   CheckMetrics(&tmp_file_mgr);
 }
 
+/// Test that files removed in the background are gone once the TmpFileMgr is destroyed.
+TEST_F(TmpFileMgrTest, TestRemoveAsync) {
+  scoped_ptr<TmpFileMgr> tmp_file_mgr(new TmpFileMgr());
+  EXPECT_TRUE(tmp_file_mgr->Init(metrics_.get()).ok());
+  vector<TmpFileMgr::DeviceId> tmp_devices = tmp_file_mgr->active_tmp_devices();
+  ASSERT_EQ(1, tmp_devices.size());
+  TUniqueId id;
+  TmpFileMgr::File* file;
+  EXPECT_TRUE(tmp_file_mgr->GetFile(tmp_devices[0], id, &file).ok());
+  scoped_ptr<TmpFileMgr::File> file_ptr(file);
+  int64_t offset;
+  EXPECT_TRUE(file->AllocateSpace(1024, &offset).ok());
+  string file_path = file->path();
+  EXPECT_TRUE(boost::filesystem::exists(file_path));
+  file->RemoveAsync();
+  tmp_file_mgr.reset();
+  EXPECT_FALSE(boost::filesystem::exists(file_path));
+}
+
 /// Test that we can do initialization with two directories on same device and
 /// that validations prevents duplication of directories.
 TEST_F(TmpFileMgrTest, TestOneDirPerDevice) {
@@ -149,6 +169,57 @@ TEST_F(TmpFileMgrTest, TestMultiDirsPerDevice) {
   CheckMetrics(&tmp_file_mgr);
 }
 
+/// Test that the expected write time of a device reflects its outstanding writes and
+/// its observed throughput.
+TEST_F(TmpFileMgrTest, TestWriteTimeEstimate) {
+  vector<string> tmp_dirs;
+  tmp_dirs.push_back("/tmp/tmp-file-mgr-test.1");
+  tmp_dirs.push_back("/tmp/tmp-file-mgr-test.2");
+  for (int i = 0; i < tmp_dirs.size(); ++i) {
+    EXPECT_TRUE(FileSystemUtil::CreateDirectory(tmp_dirs[i]).ok());
+  }
+  TmpFileMgr tmp_file_mgr;
+  tmp_file_mgr.InitCustom(tmp_dirs, false, metrics_.get());
+  vector<TmpFileMgr::DeviceId> devices = tmp_file_mgr.active_tmp_devices();
+  ASSERT_EQ(2, devices.size());
+  TUniqueId id;
+  scoped_ptr<TmpFileMgr::File> fast_file;
+  scoped_ptr<TmpFileMgr::File> slow_file;
+  TmpFileMgr::File* file;
+  EXPECT_TRUE(tmp_file_mgr.GetFile(devices[0], id, &file).ok());
+  fast_file.reset(file);
+  EXPECT_TRUE(tmp_file_mgr.GetFile(devices[1], id, &file).ok());
+  slow_file.reset(file);
+
+  const int64_t write_size = 8L * 1024L * 1024L;
+  EXPECT_EQ(fast_file->EstimateWriteTimeNs(write_size),
+      slow_file->EstimateWriteTimeNs(write_size));
+
+  // Outstanding writes make a device more expensive.
+  fast_file->WriteIssued();
+  EXPECT_EQ(2 * slow_file->EstimateWriteTimeNs(write_size),
+      fast_file->EstimateWriteTimeNs(write_size));
+
+  // A write that took 1ms vs. one that took 1s.
+  slow_file->WriteIssued();
+  fast_file->WriteComplete(write_size, MonotonicNanos() - 1000L * 1000L, true);
+  slow_file->WriteComplete(write_size, MonotonicNanos() - 1000L * 1000L * 1000L, true);
+  int64_t fast_estimate = fast_file->EstimateWriteTimeNs(write_size);
+  int64_t slow_estimate = slow_file->EstimateWriteTimeNs(write_size);
+  EXPECT_LT(fast_estimate, slow_estimate);
+
+  // A queued write on the fast device still beats the slow one.
+  fast_file->WriteIssued();
+  EXPECT_LT(fast_file->EstimateWriteTimeNs(write_size), slow_estimate);
+
+  // Failed writes don't affect the observed throughput.
+  fast_file->WriteComplete(write_size, 0, false);
+  EXPECT_EQ(fast_estimate, fast_file->EstimateWriteTimeNs(write_size));
+
+  FileSystemUtil::RemovePaths(tmp_dirs);
+  CheckMetrics(&tmp_file_mgr);
+}
+
 /// Test that reporting a write error is possible but does not result in
 /// blacklisting, which is disabled.
 TEST_F(TmpFileMgrTest, TestReportError) {
@@ -26,6 +26,7 @@
 #include "util/debug-util.h"
 #include "util/disk-info.h"
 #include "util/filesystem-util.h"
+#include "util/time.h"
 
 #include "common/names.h"
 
@@ -47,6 +48,15 @@ namespace impala {
 const string TMP_SUB_DIR_NAME = "impala-scratch";
 const uint64_t AVAILABLE_SPACE_THRESHOLD_MB = 1024;
 
+// 100MB/s, a conservative estimate for a rotational disk.
+const double TmpFileMgr::DEFAULT_WRITE_BYTES_PER_NS = 0.1;
+
+// Weight of the most recent write in the moving average of a device's throughput.
+static const double WRITE_THROUGHPUT_SMOOTHING = 0.2;
+
+// Number of files waiting to be deleted in the background before RemoveAsync() blocks.
+static const uint32_t FILE_REMOVAL_QUEUE_SIZE = 1024;
+
 // Metric keys
 const string TMP_FILE_MGR_ACTIVE_SCRATCH_DIRS = "tmp-file-mgr.active-scratch-dirs";
 const string TMP_FILE_MGR_ACTIVE_SCRATCH_DIRS_LIST =
@@ -55,6 +65,10 @@ const string TMP_FILE_MGR_ACTIVE_SCRATCH_DIRS_LIST =
 TmpFileMgr::TmpFileMgr() : initialized_(false), dir_status_lock_(), tmp_dirs_(),
   num_active_scratch_dirs_metric_(NULL), active_scratch_dirs_metric_(NULL) {}
 
+TmpFileMgr::~TmpFileMgr() {
+  if (file_removal_pool_.get() != NULL) file_removal_pool_->DrainAndShutdown();
+}
+
 Status TmpFileMgr::Init(MetricGroup* metrics) {
   string tmp_dirs_spec = FLAGS_scratch_dirs;
   vector<string> all_tmp_dirs;
@@ -124,6 +138,12 @@ Status TmpFileMgr::InitCustom(const vector<string>& tmp_dirs, bool one_dir_per_d
     active_scratch_dirs_metric_->Add(tmp_dirs_[i].path());
   }
 
+  if (!tmp_dirs_.empty()) {
+    file_removal_pool_.reset(new ThreadPool<string>("tmp-file-mgr", "file-removal", 1,
+        FILE_REMOVAL_QUEUE_SIZE,
+        bind<void>(mem_fn(&TmpFileMgr::RemoveFile), this, _1, _2)));
+  }
+
   initialized_ = true;
 
   if (tmp_dirs_.empty() && !tmp_dirs.empty()) {
@@ -207,6 +227,51 @@ vector<TmpFileMgr::DeviceId> TmpFileMgr::active_tmp_devices() {
   return devices;
 }
 
+void TmpFileMgr::RemoveFile(int thread_id, const string& path) {
+  Status status = FileSystemUtil::RemovePaths(vector<string>(1, path));
+  if (!status.ok()) LOG(WARNING) << status.GetDetail();
+}
+
+void TmpFileMgr::WriteIssued(DeviceId device_id) {
+  DCHECK(device_id >= 0 && device_id < tmp_dirs_.size());
+  lock_guard<SpinLock> l(dir_status_lock_);
+  ++tmp_dirs_[device_id].outstanding_writes_;
+}
+
+void TmpFileMgr::WriteComplete(DeviceId device_id, int64_t bytes,
+    int64_t issue_time_ns, bool succeeded) {
+  DCHECK(device_id >= 0 && device_id < tmp_dirs_.size());
+  int64_t now = MonotonicNanos();
+  lock_guard<SpinLock> l(dir_status_lock_);
+  Dir* dir = &tmp_dirs_[device_id];
+  DCHECK_GT(dir->outstanding_writes_, 0);
+  --dir->outstanding_writes_;
+  if (!succeeded) return;
+  // Writes to a device are mostly serviced one after the other, so the time spent on
+  // this write started when it was issued or when the previous write finished,
+  // whichever is later. This excludes the time the write spent queued.
+  int64_t service_time_ns = now - max(issue_time_ns, dir->last_write_done_ns_);
+  dir->last_write_done_ns_ = now;
+  double bytes_per_ns = static_cast<double>(bytes) / max<int64_t>(service_time_ns, 1);
+  if (dir->write_bytes_per_ns_ == 0) {
+    dir->write_bytes_per_ns_ = bytes_per_ns;
+  } else {
+    dir->write_bytes_per_ns_ = WRITE_THROUGHPUT_SMOOTHING * bytes_per_ns +
+        (1 - WRITE_THROUGHPUT_SMOOTHING) * dir->write_bytes_per_ns_;
+  }
+}
+
+int64_t TmpFileMgr::EstimateWriteTimeNs(DeviceId device_id, int64_t bytes) {
+  DCHECK(device_id >= 0 && device_id < tmp_dirs_.size());
+  lock_guard<SpinLock> l(dir_status_lock_);
+  const Dir& dir = tmp_dirs_[device_id];
+  double bytes_per_ns = dir.write_bytes_per_ns_ == 0 ?
+      DEFAULT_WRITE_BYTES_PER_NS : dir.write_bytes_per_ns_;
+  // The new write has to wait for the outstanding ones, assume they are of the same
+  // size.
+  return (dir.outstanding_writes_ + 1) * bytes / bytes_per_ns;
+}
+
 TmpFileMgr::File::File(TmpFileMgr* mgr, DeviceId device_id, const string& path)
   : mgr_(mgr),
     path_(path),
@@ -254,4 +319,12 @@ Status TmpFileMgr::File::Remove() {
   return Status::OK();
 }
 
+void TmpFileMgr::File::RemoveAsync() {
+  if (current_size_ == 0) return;
+  // Offer() only fails once the pool is shut down, i.e. while 'mgr_' is destroyed.
+  if (mgr_->file_removal_pool_.get() == NULL || !mgr_->file_removal_pool_->Offer(path_)) {
+    Remove();
+  }
+}
+
 } //namespace impala
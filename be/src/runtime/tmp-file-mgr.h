@@ -15,10 +15,13 @@
 #ifndef IMPALA_RUNTIME_TMP_FILE_MGR_H
 #define IMPALA_RUNTIME_TMP_FILE_MGR_H
 
+#include <boost/scoped_ptr.hpp>
+
 #include "common/status.h"
 #include "gen-cpp/Types_types.h"  // for TUniqueId
 #include "util/collection-metrics.h"
 #include "util/spinlock.h"
+#include "util/thread-pool.h"
 
 namespace impala {
 
@@ -55,6 +58,24 @@ class TmpFileMgr {
     /// It is not valid to read or write to a file after calling Remove().
     Status Remove();
 
+    /// Same as Remove(), but the file is deleted later by a TmpFileMgr thread so that
+    /// the caller does not wait for the filesystem to free the file's blocks.
+    void RemoveAsync();
+
+    /// Called when a write to this file is issued and when it completes. 'issue_time_ns'
+    /// is the MonotonicNanos() time at which the write of 'bytes' was issued. Used to
+    /// track the load and the observed write throughput of the file's device.
+    void WriteIssued() { mgr_->WriteIssued(device_id_); }
+    void WriteComplete(int64_t bytes, int64_t issue_time_ns, bool succeeded) {
+      mgr_->WriteComplete(device_id_, bytes, issue_time_ns, succeeded);
+    }
+
+    /// Returns the expected time in nanoseconds until a write of 'bytes' issued now to
+    /// this file would complete.
+    int64_t EstimateWriteTimeNs(int64_t bytes) {
+      return mgr_->EstimateWriteTimeNs(device_id_, bytes);
+    }
+
     const std::string& path() const { return path_; }
     int disk_id() const { return disk_id_; }
     bool is_blacklisted() const { return blacklisted_; }
@@ -96,6 +117,9 @@ class TmpFileMgr {
 
   TmpFileMgr();
 
+  /// Waits for the files passed to File::RemoveAsync() to be deleted.
+  ~TmpFileMgr();
+
   /// Creates the configured tmp directories. If multiple directories are specified per
   /// disk, only one is created and used. Must be called after DiskInfo::Init().
   Status Init(MetricGroup* metrics);
@@ -124,6 +148,9 @@ class TmpFileMgr {
   /// I.e. those that haven't been blacklisted.
   std::vector<DeviceId> active_tmp_devices();
 
+  /// Write throughput assumed for a device until a write to it has completed.
+  static const double DEFAULT_WRITE_BYTES_PER_NS;
+
  private:
   /// Dir stores information about a temporary directory.
   class Dir {
@@ -143,22 +170,42 @@ class TmpFileMgr {
 
     /// path should be a absolute path to a writable scratch directory.
     Dir(const std::string& path, bool blacklisted)
-        : path_(path), blacklisted_(blacklisted) {}
+        : path_(path), blacklisted_(blacklisted), outstanding_writes_(0),
+          last_write_done_ns_(0), write_bytes_per_ns_(0) {}
 
     std::string path_;
 
     bool blacklisted_;
+
+    /// Number of writes to this directory issued by all queries that haven't completed.
+    int outstanding_writes_;
+
+    /// MonotonicNanos() time of the last completed write.
+    int64_t last_write_done_ns_;
+
+    /// Moving average of the observed write throughput. 0 if no write has completed.
+    double write_bytes_per_ns_;
   };
 
+  /// Implementations of the corresponding File functions.
+  void WriteIssued(DeviceId device_id);
+  void WriteComplete(DeviceId device_id, int64_t bytes, int64_t issue_time_ns,
+      bool succeeded);
+  int64_t EstimateWriteTimeNs(DeviceId device_id, int64_t bytes);
+
   /// Remove a device from the rotation. Subsequent attempts to allocate a file on that
   /// device will fail and the device will not be included in active tmp devices.
   void BlacklistDevice(DeviceId device_id);
 
   bool IsBlacklisted(DeviceId device_id);
 
+  /// Work function of 'file_removal_pool_'. Deletes the file at 'path'.
+  void RemoveFile(int thread_id, const std::string& path);
+
   bool initialized_;
 
-  /// Protects the status of tmp dirs (i.e. whether they're blacklisted).
+  /// Protects the status of tmp dirs (i.e. whether they're blacklisted and their write
+  /// statistics).
   SpinLock dir_status_lock_;
 
   /// The created tmp directories.
@@ -167,6 +214,10 @@ class TmpFileMgr {
   /// Metrics to track active scratch directories.
   IntGauge* num_active_scratch_dirs_metric_;
   SetMetric<std::string>* active_scratch_dirs_metric_;
+
+  /// Deletes the files passed to File::RemoveAsync(). Created by InitCustom() if there
+  /// is any scratch directory.
+  boost::scoped_ptr<ThreadPool<std::string> > file_removal_pool_;
 };
 
 }
@@ -25,16 +25,35 @@
 #include "runtime/exec-env.h"
 #include "runtime/mem-tracker.h"
 #include "util/debug-util.h"
+#include "util/hash-util.h"
 #include "util/time.h"
 #include "util/runtime-profile.h"
 #include "util/pretty-printer.h"
 
 #include "common/names.h"
 
+using namespace rapidjson;
 using namespace strings;
 
 DEFINE_int64(queue_wait_timeout_ms, 60 * 1000, "Maximum amount of time (in "
     "milliseconds) that a request will wait to be admitted before timing out.");
+DEFINE_int32(mem_estimate_history_size, 1000, "(Advanced) Number of statements for "
+    "which the admission controller remembers how much memory they actually used "
+    "compared to the per-host estimate from planning, to correct the estimate of later "
+    "runs of the same statement. 0 disables the correction.");
+DEFINE_double(mem_estimate_correction_margin, 1.25, "(Advanced) Safety factor by which "
+    "the admission controller scales the learned memory need of a statement, to allow "
+    "for variation between runs.");
+DEFINE_string(admission_dequeue_policy, "fifo", "(Advanced) Order in which the queued "
+    "requests of a pool are admitted. 'fifo' admits them in arrival order, so that a "
+    "request that does not fit blocks the ones behind it. 'backfill' admits later "
+    "requests that fit while the oldest one does not. 'sjf' admits the request with the "
+    "smallest memory estimate first.");
+DEFINE_int64(admission_max_head_delay_ms, 10 * 1000, "(Advanced) With the 'backfill' "
+    "and 'sjf' admission dequeue policies, maximum amount of time (in milliseconds) "
+    "that the oldest queued request of a pool may wait while later requests are "
+    "admitted. After that, requests are admitted in arrival order until it is "
+    "admitted.");
 
 namespace impala {
 
@@ -98,6 +117,22 @@ const string POOL_MAX_QUEUED_METRIC_KEY_FORMAT =
 const string QUERY_EVENT_SUBMIT_FOR_ADMISSION = "Submit for admission";
 const string QUERY_EVENT_COMPLETED_ADMISSION = "Completed admission";
 
+// Bounds of the factor by which a memory estimate from planning is corrected.
+const double MIN_MEM_ESTIMATE_CORRECTION = 0.01;
+const double MAX_MEM_ESTIMATE_CORRECTION = 100;
+
+// Number of characters of a statement shown on the admission web page.
+const int MAX_DISPLAYED_STMT_LENGTH = 250;
+
+const string ADMISSION_WEB_PAGE = "/admission";
+const string ADMISSION_TEMPLATE = "admission.tmpl";
+
+// Returns the correction of a memory estimate for the learned 'peak_to_estimate_ratio'.
+static double MemEstimateCorrection(double peak_to_estimate_ratio) {
+  double correction = peak_to_estimate_ratio * FLAGS_mem_estimate_correction_margin;
+  return min(max(correction, MIN_MEM_ESTIMATE_CORRECTION), MAX_MEM_ESTIMATE_CORRECTION);
+}
+
 // Profile info strings
 const string PROFILE_INFO_KEY_ADMISSION_RESULT = "Admission result";
 const string PROFILE_INFO_VAL_ADMIT_IMMEDIATELY = "Admitted immediately";
@@ -106,6 +141,11 @@ const string PROFILE_INFO_VAL_REJECTED = "Rejected";
 const string PROFILE_INFO_VAL_TIME_OUT = "Timed out (queued)";
 const string PROFILE_INFO_KEY_QUEUE_DETAIL = "Admission queue details";
 const string PROFILE_INFO_VAL_QUEUE_DETAIL = "waited $0 ms, reason: $1";
+const string PROFILE_INFO_KEY_MEM_ESTIMATE_CORRECTION =
+    "Admission memory estimate correction";
+// $0 = correction factor, $1 = corrected per-host estimate
+const string PROFILE_INFO_VAL_MEM_ESTIMATE_CORRECTION =
+    "$0 (per-host memory estimate $1), learned from earlier runs";
 
 // Error status string formats
 // $0 = pool, $1 = rejection reason (see REASON_XXX below)
@@ -201,7 +241,16 @@ AdmissionController::AdmissionController(RequestPoolService* request_pool_servic
       metrics_group_(metrics),
       host_id_(TNetworkAddressToString(host_addr)),
       thrift_serializer_(false),
-      done_(false) {
+      done_(false),
+      dequeue_policy_(DEQUEUE_FIFO) {
+  if (boost::iequals(FLAGS_admission_dequeue_policy, "backfill")) {
+    dequeue_policy_ = DEQUEUE_BACKFILL;
+  } else if (boost::iequals(FLAGS_admission_dequeue_policy, "sjf")) {
+    dequeue_policy_ = DEQUEUE_SJF;
+  } else if (!boost::iequals(FLAGS_admission_dequeue_policy, "fifo")) {
+    LOG(WARNING) << "Unknown --admission_dequeue_policy '"
+                 << FLAGS_admission_dequeue_policy << "', using 'fifo'";
+  }
   dequeue_thread_.reset(new Thread("scheduling", "admission-thread",
         &AdmissionController::DequeueLoop, this));
 }
@@ -230,6 +279,55 @@ Status AdmissionController::Init(StatestoreSubscriber* subscriber) {
   return status;
 }
 
+void AdmissionController::RegisterWebpage(Webserver* webserver) {
+  Webserver::UrlCallback callback =
+      bind<void>(mem_fn(&AdmissionController::AdmissionUrlCallback), this, _1, _2);
+  webserver->RegisterUrlCallback(ADMISSION_WEB_PAGE, ADMISSION_TEMPLATE, callback);
+}
+
+void AdmissionController::AdmissionUrlCallback(const Webserver::ArgumentMap& args,
+    Document* document) {
+  lock_guard<mutex> lock(admission_ctrl_lock_);
+  Value pools(kArrayType);
+  BOOST_FOREACH(const PoolStatsMap::value_type& entry, pool_stats_) {
+    Value pool(kObjectType);
+    Value name(entry.first.c_str(), document->GetAllocator());
+    pool.AddMember("name", name, document->GetAllocator());
+    pool.AddMember("num_running", entry.second.agg_num_running(),
+        document->GetAllocator());
+    pool.AddMember("num_queued", entry.second.agg_num_queued(),
+        document->GetAllocator());
+    Value mem_reserved(PrintBytes(entry.second.EffectiveMemReserved()).c_str(),
+        document->GetAllocator());
+    pool.AddMember("mem_reserved", mem_reserved, document->GetAllocator());
+    pools.PushBack(pool, document->GetAllocator());
+  }
+  document->AddMember("pools", pools, document->GetAllocator());
+
+  // Most recently updated first.
+  Value corrections(kArrayType);
+  for (MemEstimateHistory::const_reverse_iterator it = mem_estimate_history_.rbegin();
+       it != mem_estimate_history_.rend(); ++it) {
+    const MemEstimateHistoryEntry& entry = *it;
+    Value correction(kObjectType);
+    Value stmt(entry.stmt.c_str(), document->GetAllocator());
+    correction.AddMember("stmt", stmt, document->GetAllocator());
+    correction.AddMember("num_samples", entry.num_samples, document->GetAllocator());
+    Value last_estimate(PrintBytes(entry.last_estimate).c_str(),
+        document->GetAllocator());
+    correction.AddMember("last_estimate", last_estimate, document->GetAllocator());
+    Value last_peak(PrintBytes(entry.last_peak).c_str(), document->GetAllocator());
+    correction.AddMember("last_peak", last_peak, document->GetAllocator());
+    Value factor_str(
+        Substitute("$0", MemEstimateCorrection(entry.peak_to_estimate_ratio)).c_str(),
+        document->GetAllocator());
+    correction.AddMember("correction", factor_str, document->GetAllocator());
+    corrections.PushBack(correction, document->GetAllocator());
+  }
+  document->AddMember("mem_estimate_corrections", corrections,
+      document->GetAllocator());
+}
+
 void AdmissionController::PoolStats::Admit(const QuerySchedule& schedule) {
   int64_t mem_admitted = schedule.GetClusterMemoryEstimate();
   local_mem_admitted_ += mem_admitted;
@@ -301,6 +399,65 @@ void AdmissionController::UpdateHostMemAdmitted(const QuerySchedule& schedule,
   }
 }
 
+uint64_t AdmissionController::GetStatementFingerprint(const QuerySchedule& schedule) {
+  const string& stmt = schedule.request().query_ctx.request.stmt;
+  return HashUtil::MurmurHash2_64(stmt.data(), stmt.size(), 0);
+}
+
+double AdmissionController::GetMemEstimateCorrection(const QuerySchedule& schedule) {
+  if (FLAGS_mem_estimate_history_size <= 0 || !schedule.UsesPlannerMemoryEstimate()) {
+    return 1.0;
+  }
+  unordered_map<uint64_t, MemEstimateHistory::iterator>::const_iterator it =
+      mem_estimate_history_map_.find(GetStatementFingerprint(schedule));
+  if (it == mem_estimate_history_map_.end()) return 1.0;
+  return MemEstimateCorrection(it->second->peak_to_estimate_ratio);
+}
+
+void AdmissionController::UpdateMemEstimateHistory(const QuerySchedule& schedule) {
+  if (FLAGS_mem_estimate_history_size <= 0 || schedule.peak_per_host_mem() < 0
+      || !schedule.UsesPlannerMemoryEstimate()) {
+    return;
+  }
+  int64_t estimate = schedule.request().per_host_mem_req;
+  DCHECK_GT(estimate, 0);
+  double sample = static_cast<double>(schedule.peak_per_host_mem()) / estimate;
+  uint64_t fingerprint = GetStatementFingerprint(schedule);
+  unordered_map<uint64_t, MemEstimateHistory::iterator>::iterator it =
+      mem_estimate_history_map_.find(fingerprint);
+  MemEstimateHistory::iterator entry;
+  if (it == mem_estimate_history_map_.end()) {
+    if (mem_estimate_history_.size() >= FLAGS_mem_estimate_history_size) {
+      mem_estimate_history_map_.erase(mem_estimate_history_.front().fingerprint);
+      mem_estimate_history_.pop_front();
+    }
+    MemEstimateHistoryEntry new_entry;
+    new_entry.fingerprint = fingerprint;
+    new_entry.stmt = schedule.request().query_ctx.request.stmt.substr(0,
+        MAX_DISPLAYED_STMT_LENGTH);
+    new_entry.num_samples = 0;
+    new_entry.peak_to_estimate_ratio = sample;
+    entry = mem_estimate_history_.insert(mem_estimate_history_.end(), new_entry);
+    mem_estimate_history_map_[fingerprint] = entry;
+  } else {
+    entry = it->second;
+    // Move to the back, this is now the most recently updated entry.
+    mem_estimate_history_.splice(mem_estimate_history_.end(), mem_estimate_history_,
+        entry);
+    // Underestimating leads to overadmission and queries running out of memory, so a
+    // larger ratio is taken over immediately, while a smaller one only lowers the ratio
+    // gradually.
+    entry->peak_to_estimate_ratio =
+        max(sample, 0.75 * entry->peak_to_estimate_ratio + 0.25 * sample);
+  }
+  ++entry->num_samples;
+  entry->last_estimate = estimate;
+  entry->last_peak = schedule.peak_per_host_mem();
+  VLOG_QUERY << "Recorded peak per-host memory " << PrintBytes(entry->last_peak)
+             << " for estimate " << PrintBytes(estimate) << " of query id="
+             << schedule.query_id() << ", ratio=" << entry->peak_to_estimate_ratio;
+}
+
 bool AdmissionController::HasAvailableMemResources(const QuerySchedule& schedule,
     const TPoolConfig& pool_cfg, string* mem_unavailable_reason) {
   const string& pool_name = schedule.request_pool();
@@ -433,6 +590,15 @@ Status AdmissionController::AdmitQuery(QuerySchedule* schedule) {
     pool_config_map_[pool_name] = pool_cfg;
     PoolStats* stats = GetPoolStats(pool_name);
     stats->UpdateConfigMetrics(pool_cfg);
+    // The correction must not change while the query is admitted, so that the same
+    // memory is released as was admitted.
+    schedule->set_mem_estimate_correction(GetMemEstimateCorrection(*schedule));
+    if (schedule->mem_estimate_correction() != 1.0) {
+      schedule->summary_profile()->AddInfoString(PROFILE_INFO_KEY_MEM_ESTIMATE_CORRECTION,
+          Substitute(PROFILE_INFO_VAL_MEM_ESTIMATE_CORRECTION,
+              schedule->mem_estimate_correction(),
+              PrintBytes(schedule->GetPerHostMemoryEstimate())));
+    }
     VLOG_QUERY << "Schedule for id=" << schedule->query_id()
                << " in pool_name=" << pool_name << " PoolConfig: max_requests="
                << max_requests << " max_queued=" << max_queued
@@ -521,6 +687,7 @@ Status AdmissionController::ReleaseQuery(QuerySchedule* schedule) {
     PoolStats* stats = GetPoolStats(pool_name);
     stats->Release(*schedule);
     UpdateHostMemAdmitted(*schedule, -schedule->GetPerHostMemoryEstimate());
+    UpdateMemEstimateHistory(*schedule);
     pools_for_updates_.insert(pool_name);
     VLOG_RPC << "Released query id=" << schedule->query_id() << " "
              << stats->DebugString();
@@ -782,20 +949,12 @@ void AdmissionController::DequeueLoop() {
                << stats->local_stats().num_queued;
 
       while (max_to_dequeue > 0 && !queue.empty()) {
-        QueueNode* queue_node = queue.head();
-        DCHECK(queue_node != NULL);
+        QueueNode* queue_node = GetNextToAdmit(queue, pool_config);
+        if (queue_node == NULL) break;
         DCHECK(!queue_node->is_admitted.IsSet());
         const QuerySchedule& schedule = queue_node->schedule;
-        string not_admitted_reason;
-        // TODO: Requests further in the queue may be blocked unnecessarily. Consider a
-        // better policy once we have better test scenarios.
-        if (!CanAdmitRequest(schedule, pool_config, true, &not_admitted_reason)) {
-          VLOG_RPC << "Could not dequeue query id=" << schedule.query_id()
-                   << " reason: " << not_admitted_reason;
-          break;
-        }
         VLOG_RPC << "Dequeuing query=" << schedule.query_id();
-        queue.Dequeue();
+        queue.Remove(queue_node);
         stats->Dequeue(schedule, false);
         stats->Admit(schedule);
         UpdateHostMemAdmitted(schedule, schedule.GetPerHostMemoryEstimate());
@@ -807,6 +966,62 @@ void AdmissionController::DequeueLoop() {
   }
 }
 
+AdmissionController::QueueNode* AdmissionController::GetNextToAdmit(
+    const RequestQueue& queue, const TPoolConfig& pool_cfg) {
+  QueueNode* head = queue.head();
+  DCHECK(head != NULL);
+  string not_admitted_reason;
+  bool head_delayed =
+      MonotonicMillis() - head->enqueue_time_ms >= FLAGS_admission_max_head_delay_ms;
+  if (dequeue_policy_ == DEQUEUE_FIFO || head_delayed) {
+    if (CanAdmitRequest(head->schedule, pool_cfg, true, &not_admitted_reason)) {
+      return head;
+    }
+    VLOG_RPC << "Could not dequeue query id=" << head->schedule.query_id()
+             << " reason: " << not_admitted_reason;
+    return NULL;
+  }
+
+  if (dequeue_policy_ == DEQUEUE_SJF) {
+    // Ties go to the request that was queued first.
+    QueueNode* smallest = head;
+    int64_t smallest_mem = head->schedule.GetClusterMemoryEstimate();
+    for (QueueNode* node = head->Next(); node != NULL; node = node->Next()) {
+      int64_t mem = node->schedule.GetClusterMemoryEstimate();
+      if (mem < smallest_mem) {
+        smallest = node;
+        smallest_mem = mem;
+      }
+    }
+    if (CanAdmitRequest(smallest->schedule, pool_cfg, true, &not_admitted_reason)) {
+      return smallest;
+    }
+    VLOG_RPC << "Could not dequeue query id=" << smallest->schedule.query_id()
+             << " reason: " << not_admitted_reason;
+    return NULL;
+  }
+
+  DCHECK_EQ(dequeue_policy_, DEQUEUE_BACKFILL);
+  for (QueueNode* node = head; node != NULL; node = node->Next()) {
+    if (CanAdmitRequest(node->schedule, pool_cfg, true, &not_admitted_reason)) {
+      if (node != head) {
+        VLOG_RPC << "Backfilling query id=" << node->schedule.query_id()
+                 << " ahead of query id=" << head->schedule.query_id();
+      }
+      return node;
+    }
+    // The limit on the number of running requests applies to all requests alike.
+    if (pool_cfg.max_requests >= 0 &&
+        GetPoolStats(node->schedule.request_pool())->agg_num_running() >=
+        pool_cfg.max_requests) {
+      break;
+    }
+  }
+  VLOG_RPC << "Could not dequeue any query behind query id="
+           << head->schedule.query_id() << " reason: " << not_admitted_reason;
+  return NULL;
+}
+
 AdmissionController::PoolStats*
 AdmissionController::GetPoolStats(const string& pool_name) {
   PoolStatsMap::iterator it = pool_stats_.find(pool_name);
@@ -30,6 +30,9 @@
 #include "statestore/statestore-subscriber.h"
 #include "util/internal-queue.h"
 #include "util/thread.h"
+#include "util/time.h"
+#include "util/webserver.h"
+#include "rapidjson/rapidjson.h"
 
 namespace impala {
 
@@ -166,7 +169,27 @@ class ExecEnv;
 /// queues at the beginning. Requests across queues may be competing for the same
 /// resources on particular hosts, i.e. #2 in the description of memory-based admission
 /// above. Note the pool's max_mem_resources (#1) is not contented.
-/// TODO: Improve the dequeuing policy. IMPALA-2968.
+/// Within a pool, the order in which queued requests are admitted is chosen by
+/// --admission_dequeue_policy:
+///   fifo: (default) Only the head of the queue is admitted. A request that does not fit
+///         blocks all requests behind it.
+///   backfill: The head is admitted if it fits, otherwise the first request behind it
+///         that fits.
+///   sjf: The request with the smallest cluster memory estimate is admitted if it fits.
+/// Under the latter two, the head may be starved by a stream of smaller requests. Once
+/// it has been queued for --admission_max_head_delay_ms, the pool falls back to fifo
+/// until the head is admitted, so that the resources released by running requests go
+/// to it.
+/// TODO: Improve the dequeuing policy across pools. IMPALA-2968.
+///
+/// Memory estimate correction:
+/// The per-host memory estimate from planning is often far off. When a query that was
+/// admitted with that estimate (i.e. without a MEM_LIMIT) finishes successfully, the
+/// ratio of its actual peak memory on any backend to the estimate is remembered for its
+/// statement text, see UpdateMemEstimateHistory(). Later runs of the same statement are
+/// admitted with the estimate scaled by that ratio plus a safety margin, see
+/// GetMemEstimateCorrection() and QuerySchedule::mem_estimate_correction(). The
+/// corrections are shown on the /admission web page.
 ///
 /// TODO: Assumes all impalads have the same proc mem limit. Should send proc mem limit
 ///       via statestore (e.g. ideally in TBackendDescriptor) and check per-node
@@ -196,6 +219,10 @@ class AdmissionController {
   /// Registers with the subscription manager.
   Status Init(StatestoreSubscriber* subscriber);
 
+  /// Registers the /admission web page, which shows the pools and the memory estimate
+  /// corrections.
+  void RegisterWebpage(Webserver* webserver);
+
  private:
   class PoolStats;
   friend class PoolStats;
@@ -368,7 +395,12 @@ class AdmissionController {
   /// Structure stored in a QueryQueue representing a request. This struct lives only
   /// during the call to AdmitQuery().
   struct QueueNode : public InternalQueue<QueueNode>::Node {
-    QueueNode(const QuerySchedule& query_schedule) : schedule(query_schedule) { }
+    QueueNode(const QuerySchedule& query_schedule)
+      : enqueue_time_ms(MonotonicMillis()), schedule(query_schedule) { }
+
+    /// When the request was queued, used to bound how long it may stay at the head of
+    /// the queue while requests behind it are admitted.
+    int64_t enqueue_time_ms;
 
     /// Set when the request is admitted or rejected by the dequeuing thread. Used
     /// by AdmitQuery() to wait for admission or until the timeout is reached.
@@ -385,7 +417,7 @@ class AdmissionController {
 
   /// Queue for the queries waiting to be admitted for execution. Once the
   /// maximum number of concurrently executing queries has been reached,
-  /// incoming queries are queued and admitted FCFS.
+  /// incoming queries are queued and admitted in the order of dequeue_policy_.
   typedef InternalQueue<QueueNode> RequestQueue;
 
   /// Map of pool names to request queues.
@@ -398,6 +430,37 @@ class AdmissionController {
   typedef boost::unordered_map<std::string, TPoolConfig> PoolConfigMap;
   PoolConfigMap pool_config_map_;
 
+  /// What was learned about the memory use of earlier runs of a statement.
+  struct MemEstimateHistoryEntry {
+    /// Hash of the statement text.
+    uint64_t fingerprint;
+
+    /// The beginning of the statement, for display.
+    std::string stmt;
+
+    /// Number of runs that were recorded.
+    int64_t num_samples;
+
+    /// Ratio of the actual peak per-host memory to the per-host estimate from planning.
+    /// Follows increases immediately and decreases slowly, see
+    /// UpdateMemEstimateHistory().
+    double peak_to_estimate_ratio;
+
+    /// Estimate and actual peak per-host memory of the last recorded run.
+    int64_t last_estimate;
+    int64_t last_peak;
+  };
+
+  /// The statements with a memory estimate correction, from least to most recently
+  /// updated. At most --mem_estimate_history_size entries are kept. Protected by
+  /// admission_ctrl_lock_.
+  typedef std::list<MemEstimateHistoryEntry> MemEstimateHistory;
+  MemEstimateHistory mem_estimate_history_;
+
+  /// Maps each fingerprint to its entry in 'mem_estimate_history_'. Protected by
+  /// admission_ctrl_lock_.
+  boost::unordered_map<uint64_t, MemEstimateHistory::iterator> mem_estimate_history_map_;
+
   /// Notifies the dequeuing thread that pool stats have changed and it may be
   /// possible to dequeue and admit queries.
   boost::condition_variable dequeue_cv_;
@@ -405,6 +468,16 @@ class AdmissionController {
   /// If true, tear down the dequeuing thread. This only happens in unit tests.
   bool done_;
 
+  /// The order in which queued requests of a pool are admitted, see "Queuing Behavior".
+  enum DequeuePolicy {
+    DEQUEUE_FIFO,
+    DEQUEUE_BACKFILL,
+    DEQUEUE_SJF,
+  };
+
+  /// Set from --admission_dequeue_policy.
+  DequeuePolicy dequeue_policy_;
+
   /// Statestore subscriber callback that sends outgoing topic deltas (see
   /// AddPoolUpdates()) and processes incoming topic deltas, updating the PoolStats
   /// state.
@@ -434,6 +507,11 @@ class AdmissionController {
   /// Dequeues and admits queued queries when notified by dequeue_cv_.
   void DequeueLoop();
 
+  /// Returns the request in 'queue' to admit next according to dequeue_policy_, or NULL
+  /// if none can be admitted to the pool with pool_cfg. 'queue' must not be empty. Must
+  /// hold admission_ctrl_lock_.
+  QueueNode* GetNextToAdmit(const RequestQueue& queue, const TPoolConfig& pool_cfg);
+
   /// Returns true if schedule can be admitted to the pool with pool_cfg.
   /// admit_from_queue is true if attempting to admit from the queue. Otherwise, returns
   /// false and not_admitted_reason specifies why the request can not be admitted
@@ -459,6 +537,23 @@ class AdmissionController {
 
   /// Gets or creates the PoolStats for pool_name. Must hold admission_ctrl_lock_.
   PoolStats* GetPoolStats(const std::string& pool_name);
+
+  /// Returns the factor by which the per-host memory estimate from planning of
+  /// 'schedule' should be scaled, or 1 if nothing is known about its statement. Must
+  /// hold admission_ctrl_lock_.
+  double GetMemEstimateCorrection(const QuerySchedule& schedule);
+
+  /// Records the peak per-host memory of the released query of 'schedule', if it is
+  /// known and the query was admitted with the estimate from planning. Must hold
+  /// admission_ctrl_lock_.
+  void UpdateMemEstimateHistory(const QuerySchedule& schedule);
+
+  /// Returns the key of the statement of 'schedule' in mem_estimate_history_map_.
+  static uint64_t GetStatementFingerprint(const QuerySchedule& schedule);
+
+  /// Webserver callback for the /admission page.
+  void AdmissionUrlCallback(const Webserver::ArgumentMap& args,
+      rapidjson::Document* document);
 };
 
 }
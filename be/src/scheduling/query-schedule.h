@@ -50,6 +50,10 @@ struct FragmentExecParams {
   std::vector<TPlanFragmentDestination> destinations;
   std::map<PlanNodeId, int> per_exch_num_senders;
   FragmentScanRangeAssignment scan_range_assignment;
+  /// If not empty, the scan ranges of each instance, indexed like 'hosts'. Set if a
+  /// host runs several instances of a fragment with scans, which split its share of
+  /// 'scan_range_assignment'. Otherwise each instance reads the ranges of its host.
+  std::vector<PerNodeScanRanges> per_instance_scan_ranges;
   /// In its role as a data sender, a fragment instance is assigned a "sender id" to
   /// uniquely identify it to a receiver. The id that a particular fragment instance
   /// is assigned ranges from [sender_id_base, sender_id_base + N - 1], where
@@ -88,9 +92,25 @@ class QuerySchedule {
 
   /// Gets the estimated memory (bytes) and vcores per-node. Returns the user specified
   /// estimate (MEM_LIMIT query parameter) if provided or the estimate from planning if
-  /// available, but is capped at the amount of physical memory to avoid problems if
-  /// either estimate is unreasonably large.
+  /// available, scaled by mem_estimate_correction(), but is capped at the amount of
+  /// physical memory to avoid problems if either estimate is unreasonably large.
   int64_t GetPerHostMemoryEstimate() const;
+
+  /// True if GetPerHostMemoryEstimate() is based on the estimate from planning.
+  bool UsesPlannerMemoryEstimate() const;
+
+  /// Factor by which GetPerHostMemoryEstimate() scales the estimate from planning. Set
+  /// by the admission controller before admission from what it learned about earlier
+  /// runs of the same statement, and not changed afterwards.
+  double mem_estimate_correction() const { return mem_estimate_correction_; }
+  void set_mem_estimate_correction(double correction) {
+    mem_estimate_correction_ = correction;
+  }
+
+  /// The largest peak memory consumption of the query on any backend, or -1 if unknown.
+  /// Set when the query finished successfully, before it is released.
+  int64_t peak_per_host_mem() const { return peak_per_host_mem_; }
+  void set_peak_per_host_mem(int64_t peak_mem) { peak_per_host_mem_ = peak_mem; }
   int16_t GetPerHostVCores() const;
   /// Total estimated memory for all nodes. set_num_hosts() must be set before calling.
   int64_t GetClusterMemoryEstimate() const;
@@ -171,6 +191,10 @@ class QuerySchedule {
   /// Indicates if the query has been admitted for execution.
   bool is_admitted_;
 
+  /// See mem_estimate_correction() and peak_per_host_mem().
+  double mem_estimate_correction_;
+  int64_t peak_per_host_mem_;
+
   /// Resolves unique_hosts_ to node mgr addresses. Valid only after SetUniqueHosts() has
   /// been called.
   boost::scoped_ptr<ResourceResolver> resource_resolver_;
@@ -21,6 +21,7 @@
 
 #include "common/logging.h"
 #include "simple-scheduler.h"
+#include "util/network-util.h"
 
 #include "common/names.h"
 
@@ -150,6 +151,51 @@ TEST_F(SimpleSchedulerTest, NonLocalHost) {
   EXPECT_EQ(backends.at(4).address.port, 1000);
 }
 
+TEST_F(SimpleSchedulerTest, NonLocalHostAvoidsLoadedBackend) {
+  // If one ipaddress is loaded, expect all non-local assignments to go to the other
+  // one, still round robin on port.
+  local_remote_scheduler_->host_load_["127.0.0.1"] = 1.0;
+  vector<TNetworkAddress> data_locations;
+  data_locations.resize(4);
+  for (int i = 0; i < 4; ++i) {
+    data_locations.at(i).hostname = "non exists ipaddress";
+    data_locations.at(i).port = 0;
+  }
+  SimpleScheduler::BackendList backends;
+
+  local_remote_scheduler_->GetBackends(data_locations, &backends);
+
+  EXPECT_EQ(4, backends.size());
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(backends.at(i).address.hostname, "127.0.0.0");
+    EXPECT_EQ(backends.at(i).address.port, base_port_ + i % 2);
+  }
+}
+
+TEST_F(SimpleSchedulerTest, SplitScanRangesAcrossInstances) {
+  // Host 0 has five ranges of equal length, host 1 a single one.
+  FragmentExecParams params;
+  params.hosts.resize(2);
+  params.hosts[0] = MakeNetworkAddress("127.0.0.0", base_port_);
+  params.hosts[1] = MakeNetworkAddress("127.0.0.1", base_port_);
+  TScanRangeParams range;
+  range.scan_range.__isset.hdfs_file_split = true;
+  range.scan_range.hdfs_file_split.length = 100;
+  params.scan_range_assignment[params.hosts[0]][0].resize(5, range);
+  params.scan_range_assignment[params.hosts[1]][0].resize(1, range);
+
+  hostname_scheduler_->SplitScanRangesAcrossInstances(3, &params);
+
+  // Expect three instances on host 0 with 2, 2 and 1 ranges, and one on host 1.
+  ASSERT_EQ(4, params.hosts.size());
+  ASSERT_EQ(4, params.per_instance_scan_ranges.size());
+  int expected_ranges[] = {2, 2, 1, 1};
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(params.hosts[i].hostname, i < 3 ? "127.0.0.0" : "127.0.0.1");
+    EXPECT_EQ(expected_ranges[i], params.per_instance_scan_ranges[i][0].size());
+  }
+}
+
 class SimpleAssignmentTest : public SimpleSchedulerTest {
  protected:
   SimpleAssignmentTest() : num_runs_(200) {
@@ -218,6 +264,24 @@ TEST_F(SimpleAssignmentTest, ComputeAssignmentRandomNonCached) {
   EXPECT_GT(picked_hosts.size(), 1U);
 }
 
+
+TEST_F(SimpleAssignmentTest, ComputeAssignmentAvoidsLoadedReplica) {
+  TQueryOptions query_options;
+  query_options.random_replica = false;
+  query_options.replica_preference = TReplicaPreference::DISK_LOCAL;
+
+  // Without load the first replica is picked, see above. Verify that the second one is
+  // picked if the first one is loaded.
+  local_remote_scheduler_->host_load_["127.0.0.0"] = 1.0;
+  for (int i = 0; i < num_runs_; ++i) {
+    FragmentScanRangeAssignment assignment;
+    local_remote_scheduler_->ComputeScanRangeAssignment(
+        0, NULL, false, locations_, host_list_, false,
+        query_options, &assignment);
+    ASSERT_EQ(assignment.size(), 1U);
+    EXPECT_EQ(assignment.begin()->first.hostname, "127.0.0.1");
+  }
+}
 }
 
 int main(int argc, char **argv) {
@@ -14,6 +14,7 @@
 
 #include "scheduling/simple-scheduler.h"
 
+#include <algorithm>
 #include <vector>
 
 #include <boost/algorithm/string.hpp>
@@ -27,6 +28,8 @@
 #include "util/metrics.h"
 #include "runtime/exec-env.h"
 #include "runtime/coordinator.h"
+#include "runtime/disk-io-mgr.h"
+#include "runtime/mem-tracker.h"
 #include "service/impala-server.h"
 
 #include "statestore/statestore-subscriber.h"
@@ -36,8 +39,10 @@
 #include "util/network-util.h"
 #include "util/uid-util.h"
 #include "util/container-util.h"
+#include "util/cpu-info.h"
 #include "util/debug-util.h"
 #include "util/error-util.h"
+#include "util/impalad-metrics.h"
 #include "util/llama-util.h"
 #include "util/mem-info.h"
 #include "util/parse-util.h"
@@ -57,6 +62,20 @@ DECLARE_int32(rm_default_cpu_vcores);
 DECLARE_string(rm_default_memory);
 
 DEFINE_bool(disable_admission_control, true, "Disables admission control.");
+DEFINE_int32(analytic_instances_per_host, 1, "(Advanced) Number of instances per host "
+    "of fragments that evaluate analytic functions over partitioned input. The input "
+    "is hash-partitioned on the PARTITION BY exprs, so more instances spread the "
+    "partitions, and the sort that precedes the evaluation, across more cores.");
+DEFINE_double(scheduler_load_weight, 1.0, "(Advanced) Weight of the load of backends, "
+    "which they publish through the statestore, in scan range assignment. Replicas on "
+    "loaded backends count as having more bytes assigned, and remote reads go to the "
+    "less loaded of the next two backends in round-robin order. Set to 0 to ignore the "
+    "load.");
+DEFINE_int32(backend_client_warm_connections, 2, "(Advanced) Number of idle connections "
+    "to every backend that are opened in the background as soon as it joins the "
+    "cluster, and kept open, so that the first fragments sent to it don't have to wait "
+    "for the connection to be established. If 0, connections are only opened on "
+    "demand.");
 
 namespace impala {
 
@@ -69,6 +88,7 @@ static const string BACKENDS_WEB_PAGE = "/backends";
 static const string BACKENDS_TEMPLATE = "backends.tmpl";
 
 const string SimpleScheduler::IMPALA_MEMBERSHIP_TOPIC("impala-membership");
+const string SimpleScheduler::IMPALA_BACKEND_LOAD_TOPIC("impala-backend-load");
 
 SimpleScheduler::SimpleScheduler(StatestoreSubscriber* subscriber,
     const string& backend_id, const TNetworkAddress& backend_address,
@@ -174,6 +194,9 @@ Status SimpleScheduler::Init() {
         bind<void>(mem_fn(&SimpleScheduler::BackendsUrlCallback), this, _1, _2);
     webserver_->RegisterUrlCallback(BACKENDS_WEB_PAGE, BACKENDS_TEMPLATE,
         backends_callback);
+    if (admission_controller_.get() != NULL) {
+      admission_controller_->RegisterWebpage(webserver_);
+    }
   }
 
   if (statestore_subscriber_ != NULL) {
@@ -184,6 +207,15 @@ Status SimpleScheduler::Init() {
       status.AddDetail("SimpleScheduler failed to register membership topic");
       return status;
     }
+    if (FLAGS_scheduler_load_weight > 0) {
+      StatestoreSubscriber::UpdateCallback load_cb =
+          bind<void>(mem_fn(&SimpleScheduler::UpdateBackendLoad), this, _1, _2);
+      status = statestore_subscriber_->AddTopic(IMPALA_BACKEND_LOAD_TOPIC, true, load_cb);
+      if (!status.ok()) {
+        status.AddDetail("SimpleScheduler failed to register backend load topic");
+        return status;
+      }
+    }
     if (!FLAGS_disable_admission_control) {
       RETURN_IF_ERROR(admission_controller_->Init(statestore_subscriber_));
     }
@@ -261,6 +293,9 @@ void SimpleScheduler::UpdateMembership(
 
   if (topic != incoming_topic_deltas.end()) {
     const TTopicDelta& delta = topic->second;
+    // Addresses of the backends that joined and left the cluster with this update.
+    vector<TNetworkAddress> added_backends;
+    vector<TNetworkAddress> removed_backends;
 
     // This function needs to handle both delta and non-delta updates. For delta
     // updates, it is desireable to minimize the number of copies to only
@@ -270,6 +305,9 @@ void SimpleScheduler::UpdateMembership(
     {
       lock_guard<mutex> lock(backend_map_lock_);
       if (!delta.is_delta) {
+        BOOST_FOREACH(const BackendIdMap::value_type& backend, current_membership_) {
+          removed_backends.push_back(backend.second.address);
+        }
         current_membership_.clear();
         backend_map_.clear();
         backend_ip_map_.clear();
@@ -302,6 +340,7 @@ void SimpleScheduler::UpdateMembership(
         }
         backend_ip_map_[be_desc.address.hostname] = be_desc.ip_address;
         current_membership_.insert(make_pair(item.key, be_desc));
+        added_backends.push_back(be_desc.address);
       }
       // Process deletions from the topic
       BOOST_FOREACH(const string& backend_id, delta.topic_deletions) {
@@ -312,11 +351,13 @@ void SimpleScheduler::UpdateMembership(
           be_descs->erase(
               remove(be_descs->begin(), be_descs->end(), be_desc), be_descs->end());
           if (be_descs->empty()) backend_map_.erase(be_desc.ip_address);
+          removed_backends.push_back(be_desc.address);
           current_membership_.erase(backend_id);
         }
       }
       next_nonlocal_backend_entry_ = backend_map_.begin();
     }
+    WarmUpBackendClients(added_backends, removed_backends);
 
     // If this impalad is not in our view of the membership list, we should add it and
     // tell the statestore.
@@ -351,6 +392,108 @@ void SimpleScheduler::UpdateMembership(
   }
 }
 
+void SimpleScheduler::WarmUpBackendClients(const vector<TNetworkAddress>& added_backends,
+    const vector<TNetworkAddress>& removed_backends) {
+  if (FLAGS_backend_client_warm_connections <= 0) return;
+  ImpalaInternalServiceClientCache* client_cache =
+      ExecEnv::GetInstance()->impalad_client_cache();
+  if (client_cache == NULL) return;
+  // Backends that are re-added by a full update are in both lists, so the removals go
+  // first. WarmUp() does not block, the connections are opened in the background.
+  BOOST_FOREACH(const TNetworkAddress& address, removed_backends) {
+    client_cache->WarmUp(address, 0);
+  }
+  BOOST_FOREACH(const TNetworkAddress& address, added_backends) {
+    client_cache->WarmUp(address, FLAGS_backend_client_warm_connections);
+  }
+}
+
+void SimpleScheduler::UpdateBackendLoad(
+    const StatestoreSubscriber::TopicDeltaMap& incoming_topic_deltas,
+    vector<TTopicDelta>* subscriber_topic_updates) {
+  // Publish the load of this backend with every heartbeat, it changes constantly.
+  if (!backend_descriptor_.ip_address.empty()) {
+    subscriber_topic_updates->push_back(TTopicDelta());
+    TTopicDelta& update = subscriber_topic_updates->back();
+    update.topic_name = IMPALA_BACKEND_LOAD_TOPIC;
+    update.topic_entries.push_back(TTopicItem());
+    TTopicItem& item = update.topic_entries.back();
+    item.key = backend_id_;
+    TBackendLoad local_load;
+    GetLocalLoad(&local_load);
+    Status status = thrift_serializer_.Serialize(&local_load, &item.value);
+    if (!status.ok()) {
+      LOG(WARNING) << "Failed to serialize backend load for statestore topic: "
+                   << status.GetDetail();
+      subscriber_topic_updates->pop_back();
+    }
+  }
+
+  StatestoreSubscriber::TopicDeltaMap::const_iterator topic =
+      incoming_topic_deltas.find(IMPALA_BACKEND_LOAD_TOPIC);
+  if (topic == incoming_topic_deltas.end()) return;
+  const TTopicDelta& delta = topic->second;
+  if (!delta.is_delta) backend_loads_.clear();
+  BOOST_FOREACH(const TTopicItem& item, delta.topic_entries) {
+    TBackendLoad load;
+    uint32_t len = item.value.size();
+    Status status = DeserializeThriftMsg(reinterpret_cast<const uint8_t*>(
+        item.value.data()), &len, false, &load);
+    if (!status.ok()) {
+      VLOG(2) << "Error deserializing backend load topic item with key: " << item.key;
+      continue;
+    }
+    backend_loads_[item.key] = load;
+  }
+  BOOST_FOREACH(const string& backend_id, delta.topic_deletions) {
+    backend_loads_.erase(backend_id);
+  }
+
+  HostLoadMap host_load;
+  BOOST_FOREACH(const BackendLoadMap::value_type& entry, backend_loads_) {
+    host_load[entry.second.ip_address] += ComputeLoad(entry.second);
+  }
+  lock_guard<mutex> lock(backend_map_lock_);
+  host_load_.swap(host_load);
+}
+
+void SimpleScheduler::GetLocalLoad(TBackendLoad* load) {
+  ExecEnv* exec_env = ExecEnv::GetInstance();
+  load->ip_address = backend_descriptor_.ip_address;
+  load->num_fragments_in_flight =
+      ImpaladMetrics::IMPALA_SERVER_NUM_FRAGMENTS_IN_FLIGHT == NULL ? 0 :
+      ImpaladMetrics::IMPALA_SERVER_NUM_FRAGMENTS_IN_FLIGHT->value();
+  MemTracker* mem_tracker = exec_env->process_mem_tracker();
+  load->mem_consumption = mem_tracker == NULL ? 0 : mem_tracker->consumption();
+  load->mem_limit = mem_tracker == NULL ? -1 : mem_tracker->limit();
+  DiskIoMgr* io_mgr = exec_env->disk_io_mgr();
+  load->io_queue_depth = io_mgr == NULL ? 0 : io_mgr->num_queued_contexts();
+  load->num_cores = CpuInfo::num_cores();
+  load->num_disks = io_mgr == NULL ? 1 : io_mgr->num_total_disks();
+}
+
+double SimpleScheduler::ComputeLoad(const TBackendLoad& load) {
+  double result = load.num_fragments_in_flight / static_cast<double>(
+      max(load.num_cores, 1));
+  result += load.io_queue_depth / static_cast<double>(max(load.num_disks, 1));
+  if (load.mem_limit > 0) {
+    result += load.mem_consumption / static_cast<double>(load.mem_limit);
+  }
+  return result;
+}
+
+double SimpleScheduler::GetHostLoad(const string& host) const {
+  if (host_load_.empty()) return 0;
+  HostLoadMap::const_iterator it = host_load_.find(host);
+  if (it == host_load_.end()) {
+    BackendIpAddressMap::const_iterator ip = backend_ip_map_.find(host);
+    if (ip == backend_ip_map_.end()) return 0;
+    it = host_load_.find(ip->second);
+    if (it == host_load_.end()) return 0;
+  }
+  return it->second;
+}
+
 Status SimpleScheduler::GetBackends(
     const vector<TNetworkAddress>& data_locations, BackendList* backendports) {
   backendports->clear();
@@ -390,6 +533,16 @@ Status SimpleScheduler::GetBackend(const TNetworkAddress& data_location,
     if (next_nonlocal_backend_entry_ == backend_map_.end()) {
       next_nonlocal_backend_entry_ = backend_map_.begin();
     }
+    // Of the next two ipaddresses, take the less loaded one. Skipping over a loaded
+    // backend still advances the round robin, so that idle backends share the reads.
+    if (FLAGS_scheduler_load_weight > 0 && next_nonlocal_backend_entry_ != entry &&
+        GetHostLoad(next_nonlocal_backend_entry_->first) < GetHostLoad(entry->first)) {
+      entry = next_nonlocal_backend_entry_;
+      ++next_nonlocal_backend_entry_;
+      if (next_nonlocal_backend_entry_ == backend_map_.end()) {
+        next_nonlocal_backend_entry_ = backend_map_.begin();
+      }
+    }
   } else {
     local_assignment = true;
   }
@@ -490,8 +643,10 @@ Status SimpleScheduler::ComputeScanRangeAssignment(
   BOOST_FOREACH(const TScanRangeLocations& scan_range_locations, locations) {
     // Assign scans to replica with smallest memory distance.
     TReplicaPreference::type min_distance = TReplicaPreference::REMOTE;
-    // Assign this scan range to the host w/ the fewest assigned bytes.
+    // Assign this scan range to the host w/ the fewest assigned bytes, weighted by the
+    // load of the host, and among those to the least loaded one.
     uint64_t min_assigned_bytes = numeric_limits<uint64_t>::max();
+    double min_load = 0;
     const TNetworkAddress* data_host = NULL;  // data server; not necessarily backend
     int volume_id = -1;
     bool is_cached = false;
@@ -527,6 +682,15 @@ Status SimpleScheduler::ComputeScanRangeAssignment(
       uint64_t initial_bytes = 0L;
       uint64_t assigned_bytes =
           *FindOrInsert(&assigned_bytes_per_host, replica_host, initial_bytes);
+      double load = 0;
+      if (FLAGS_scheduler_load_weight > 0) {
+        {
+          lock_guard<mutex> l(backend_map_lock_);
+          load = GetHostLoad(replica_host.hostname);
+        }
+        assigned_bytes = static_cast<uint64_t>(
+            assigned_bytes * (1 + FLAGS_scheduler_load_weight * load));
+      }
 
       bool found_new_replica = false;
 
@@ -541,10 +705,11 @@ Status SimpleScheduler::ComputeScanRangeAssignment(
         // then cached_replica will be different from is_cached.
         bool cached_replica = memory_distance == TReplicaPreference::CACHE_LOCAL;
         // Load based scheduling
-        if (assigned_bytes < min_assigned_bytes) {
+        if (assigned_bytes < min_assigned_bytes ||
+            (assigned_bytes == min_assigned_bytes && load < min_load)) {
           num_equivalent_replicas = 1;
           found_new_replica = true;
-        } else if (assigned_bytes == min_assigned_bytes &&
+        } else if (assigned_bytes == min_assigned_bytes && load == min_load &&
             (random_non_cached_tiebreak || cached_replica)) {
           // We do reservoir sampling: assume we have k equivalent replicas and encounter
           // another equivalent one. Then we want to select the new one with probability
@@ -560,6 +725,7 @@ Status SimpleScheduler::ComputeScanRangeAssignment(
 
       if (found_new_replica) {
         min_assigned_bytes = assigned_bytes;
+        min_load = load;
         data_host = &replica_host;
         volume_id = location.volume_id;
       }
@@ -671,10 +837,11 @@ void SimpleScheduler::ComputeFragmentExecParams(const TQueryExecRequest& exec_re
     // set # of senders
     DCHECK(exec_request.fragments[i].output_sink.__isset.stream_sink);
     const TDataStreamSink& sink = exec_request.fragments[i].output_sink.stream_sink;
-    // we can only handle unpartitioned (= broadcast), random-partitioned or
-    // hash-partitioned output at the moment
+    // we can only handle unpartitioned (= broadcast), random-partitioned,
+    // hash-partitioned or range-partitioned output at the moment
     DCHECK(sink.output_partition.type == TPartitionType::UNPARTITIONED
            || sink.output_partition.type == TPartitionType::HASH_PARTITIONED
+           || sink.output_partition.type == TPartitionType::RANGE_PARTITIONED
            || sink.output_partition.type == TPartitionType::RANDOM);
     PlanNodeId exch_id = sink.dest_node_id;
     // we might have multiple fragments sending to this exchange node
@@ -704,6 +871,7 @@ void SimpleScheduler::ComputeFragmentHosts(const TQueryExecRequest& exec_request
   scan_node_types.push_back(TPlanNodeType::HDFS_SCAN_NODE);
   scan_node_types.push_back(TPlanNodeType::HBASE_SCAN_NODE);
   scan_node_types.push_back(TPlanNodeType::DATA_SOURCE_NODE);
+  const int instances_per_host = max(1, schedule->query_options().instances_per_host);
 
   // compute hosts of producer fragment before those of consumer fragment(s),
   // the latter might inherit the set of hosts from the former
@@ -761,12 +929,44 @@ void SimpleScheduler::ComputeFragmentHosts(const TQueryExecRequest& exec_request
       params.hosts = (*fragment_exec_params)[input_fragment_idx].hosts;
       // TODO: switch to unpartitioned/coord execution if our input fragment
       // is executed that way (could have been downgraded from distributed)
+      int num_instances = instances_per_host;
+      if (ContainsNode(fragment.plan, TPlanNodeType::ANALYTIC_EVAL_NODE)) {
+        num_instances = max(num_instances, FLAGS_analytic_instances_per_host);
+      }
+      // The exec nodes run on a single thread per instance. The hash-partitioned input
+      // is split across any number of instances, so the instances are multiplied from
+      // the distinct hosts of the input fragment, which may run several instances per
+      // host itself. Scans in this fragment would be read by every instance.
+      vector<TPlanNodeId> scan_nodes;
+      FindNodes(fragment.plan, scan_node_types, &scan_nodes);
+      if (num_instances > 1 &&
+          fragment.partition.type == TPartitionType::HASH_PARTITIONED &&
+          scan_nodes.empty()) {
+        vector<TNetworkAddress> hosts;
+        unordered_set<TNetworkAddress> unique_hosts;
+        BOOST_FOREACH(const TNetworkAddress& host, params.hosts) {
+          if (unique_hosts.insert(host).second) hosts.push_back(host);
+        }
+        params.hosts.clear();
+        for (int j = 0; j < num_instances; ++j) {
+          params.hosts.insert(params.hosts.end(), hosts.begin(), hosts.end());
+        }
+      }
       continue;
     }
 
     // This fragment is executed on those hosts that have scan ranges
     // for the leftmost scan.
     GetScanHosts(leftmost_scan_id, exec_request, params, &params.hosts);
+    // Only the ranges of a single scan can be split: the ranges of any other scan, e.g.
+    // of the build side of a join, would have to be read by all instances of the host.
+    if (instances_per_host > 1) {
+      vector<TPlanNodeId> scan_nodes;
+      FindNodes(fragment.plan, scan_node_types, &scan_nodes);
+      if (scan_nodes.size() == 1) {
+        SplitScanRangesAcrossInstances(instances_per_host, &params);
+      }
+    }
   }
 
   unordered_set<TNetworkAddress> unique_hosts;
@@ -777,6 +977,48 @@ void SimpleScheduler::ComputeFragmentHosts(const TQueryExecRequest& exec_request
   schedule->SetUniqueHosts(unique_hosts);
 }
 
+void SimpleScheduler::SplitScanRangesAcrossInstances(int instances_per_host,
+    FragmentExecParams* params) {
+  DCHECK(params->per_instance_scan_ranges.empty());
+  vector<TNetworkAddress> hosts;
+  hosts.swap(params->hosts);
+  BOOST_FOREACH(const TNetworkAddress& host, hosts) {
+    FragmentScanRangeAssignment::const_iterator it =
+        params->scan_range_assignment.find(host);
+    if (it == params->scan_range_assignment.end() || it->second.empty()) {
+      // E.g. the coordinator of a scan without scan ranges.
+      params->hosts.push_back(host);
+      params->per_instance_scan_ranges.push_back(PerNodeScanRanges());
+      continue;
+    }
+    DCHECK_EQ(it->second.size(), 1);
+    TPlanNodeId node_id = it->second.begin()->first;
+    const vector<TScanRangeParams>& ranges = it->second.begin()->second;
+    int num_instances = max(1, min<int>(instances_per_host, ranges.size()));
+    int first_instance = params->hosts.size();
+    for (int i = 0; i < num_instances; ++i) {
+      params->hosts.push_back(host);
+      params->per_instance_scan_ranges.push_back(PerNodeScanRanges());
+      params->per_instance_scan_ranges.back()[node_id];
+    }
+    // Each range goes to the instance with the fewest assigned bytes. Ranges without a
+    // length, e.g. HBase key ranges, count as one byte, so that they are spread evenly.
+    vector<int64_t> assigned_bytes(num_instances, 0);
+    BOOST_FOREACH(const TScanRangeParams& range, ranges) {
+      int min_idx = min_element(assigned_bytes.begin(), assigned_bytes.end()) -
+          assigned_bytes.begin();
+      int64_t length = 1;
+      if (range.scan_range.__isset.hdfs_file_split) {
+        length += range.scan_range.hdfs_file_split.length;
+      }
+      assigned_bytes[min_idx] += length;
+      PerNodeScanRanges* instance_ranges =
+          &params->per_instance_scan_ranges[first_instance + min_idx];
+      (*instance_ranges)[node_id].push_back(range);
+    }
+  }
+}
+
 PlanNodeId SimpleScheduler::FindLeftmostNode(
     const TPlan& plan, const vector<TPlanNodeType::type>& types) {
   // the first node with num_children == 0 is the leftmost node
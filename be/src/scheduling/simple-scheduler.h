@@ -47,6 +47,7 @@ class Coordinator;
 class SimpleScheduler : public Scheduler {
  public:
   static const std::string IMPALA_MEMBERSHIP_TOPIC;
+  static const std::string IMPALA_BACKEND_LOAD_TOPIC;
 
   /// Initialize with a subscription manager that we can register with for updates to the
   /// set of available backends.
@@ -96,9 +97,9 @@ class SimpleScheduler : public Scheduler {
   virtual void HandleLostResource(const TUniqueId& client_resource_id);
 
  private:
-  /// Protects access to backend_map_ and backend_ip_map_, which might otherwise be
-  /// updated asynchronously with respect to reads. Also protects the locality
-  /// counters, which are updated in GetBackends.
+  /// Protects access to backend_map_, backend_ip_map_ and host_load_, which might
+  /// otherwise be updated asynchronously with respect to reads. Also protects the
+  /// locality counters, which are updated in GetBackends.
   boost::mutex backend_map_lock_;
 
   /// Map from a datanode's IP address to a list of backend addresses running on that
@@ -119,6 +120,17 @@ class SimpleScheduler : public Scheduler {
   typedef boost::unordered_map<std::string, TBackendDescriptor> BackendIdMap;
   BackendIdMap current_membership_;
 
+  /// Map from unique backend id to the last load that backend published in
+  /// IMPALA_BACKEND_LOAD_TOPIC. Only read/modified from within UpdateBackendLoad().
+  typedef boost::unordered_map<std::string, TBackendLoad> BackendLoadMap;
+  BackendLoadMap backend_loads_;
+
+  /// Map from a backend's IP address to the sum of the loads, see ComputeLoad(), of the
+  /// backends running on it. Hosts without an entry count as idle. Rebuilt from
+  /// backend_loads_ on every update of IMPALA_BACKEND_LOAD_TOPIC.
+  typedef boost::unordered_map<std::string, double> HostLoadMap;
+  HostLoadMap host_load_;
+
   /// MetricGroup subsystem access
   MetricGroup* metrics_;
 
@@ -195,6 +207,28 @@ class SimpleScheduler : public Scheduler {
   void UpdateMembership(const StatestoreSubscriber::TopicDeltaMap& incoming_topic_deltas,
       std::vector<TTopicDelta>* subscriber_topic_updates);
 
+  /// Called by UpdateMembership() to ask the impalad client cache to keep
+  /// --backend_client_warm_connections idle connections to the backends that joined the
+  /// cluster, and to stop doing so for the ones that left.
+  void WarmUpBackendClients(const std::vector<TNetworkAddress>& added_backends,
+      const std::vector<TNetworkAddress>& removed_backends);
+
+  /// Called asynchronously with updates of IMPALA_BACKEND_LOAD_TOPIC. Publishes the load
+  /// of this backend and rebuilds host_load_ from the loads of all backends.
+  void UpdateBackendLoad(const StatestoreSubscriber::TopicDeltaMap& incoming_topic_deltas,
+      std::vector<TTopicDelta>* subscriber_topic_updates);
+
+  /// Fills 'load' with the current load of this backend.
+  void GetLocalLoad(TBackendLoad* load);
+
+  /// Returns the load of a backend as the sum of its fragment instances per core, its
+  /// queued disk io requests per disk and the fraction of its memory limit in use.
+  static double ComputeLoad(const TBackendLoad& load);
+
+  /// Returns the load of the backends on 'host', a hostname or IP address, or 0 if it is
+  /// unknown. backend_map_lock_ must be taken.
+  double GetHostLoad(const std::string& host) const;
+
   /// Webserver callback that produces a list of known backends.
   /// Example output:
   /// "backends": [
@@ -231,6 +265,11 @@ class SimpleScheduler : public Scheduler {
   void ComputeFragmentHosts(const TQueryExecRequest& exec_request,
       QuerySchedule* schedule);
 
+  /// Replaces each host in params->hosts with up to 'instances_per_host' instances, at
+  /// most one per scan range of the host, and splits the scan ranges of the host's
+  /// single scan node across them by bytes. Fills params->per_instance_scan_ranges.
+  void SplitScanRangesAcrossInstances(int instances_per_host, FragmentExecParams* params);
+
   /// Returns the id of the leftmost node of any of the given types in 'plan',
   /// or INVALID_PLAN_NODE_ID if no such node present.
   PlanNodeId FindLeftmostNode(
@@ -260,6 +299,9 @@ class SimpleScheduler : public Scheduler {
 
   FRIEND_TEST(SimpleAssignmentTest, ComputeAssignmentDeterministicNonCached);
   FRIEND_TEST(SimpleAssignmentTest, ComputeAssignmentRandomNonCached);
+  FRIEND_TEST(SimpleAssignmentTest, ComputeAssignmentAvoidsLoadedReplica);
+  FRIEND_TEST(SimpleSchedulerTest, NonLocalHostAvoidsLoadedBackend);
+  FRIEND_TEST(SimpleSchedulerTest, SplitScanRangesAcrossInstances);
 };
 
 }
@@ -0,0 +1,63 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "service/exec-request-cache.h"
+
+#include "common/logging.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+ImpalaServer::ExecRequestCache::ExecRequestCache(int capacity)
+  : capacity_(capacity) {
+  DCHECK_GT(capacity, 0);
+}
+
+shared_ptr<const ImpalaServer::ExecRequestCache::Entry>
+ImpalaServer::ExecRequestCache::Lookup(const string& key) {
+  lock_guard<mutex> l(lock_);
+  EntryMap::iterator it = entries_.find(key);
+  if (it == entries_.end()) return shared_ptr<const Entry>();
+  // Move to the back, this is now the most recently used entry.
+  lru_list_.splice(lru_list_.end(), lru_list_, it->second);
+  return it->second->entry;
+}
+
+void ImpalaServer::ExecRequestCache::Insert(const string& key,
+    const shared_ptr<const Entry>& entry) {
+  DCHECK(entry.get() != NULL);
+  LruEntry lru_entry;
+  lru_entry.key = key;
+  lru_entry.entry = entry;
+  lock_guard<mutex> l(lock_);
+  EntryMap::iterator existing = entries_.find(key);
+  if (existing != entries_.end()) RemoveEntry(existing->second);
+  while (entries_.size() >= capacity_) {
+    DCHECK(!lru_list_.empty());
+    RemoveEntry(lru_list_.begin());
+  }
+  entries_[key] = lru_list_.insert(lru_list_.end(), lru_entry);
+}
+
+void ImpalaServer::ExecRequestCache::Clear() {
+  lock_guard<mutex> l(lock_);
+  entries_.clear();
+  lru_list_.clear();
+}
+
+void ImpalaServer::ExecRequestCache::RemoveEntry(EntryList::iterator it) {
+  entries_.erase(it->key);
+  lru_list_.erase(it);
+}
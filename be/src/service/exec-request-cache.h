@@ -0,0 +1,95 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef IMPALA_SERVICE_EXEC_REQUEST_CACHE_H
+#define IMPALA_SERVICE_EXEC_REQUEST_CACHE_H
+
+#include <list>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "service/impala-server.h"
+#include "gen-cpp/Frontend_types.h"
+
+namespace impala {
+
+/// Impalad-wide cache of the plans of queries, so that repeated identical queries skip
+/// the call into the frontend's planner.
+///
+/// Entries are keyed by ImpalaServer::GetExecRequestCacheKey(), which includes the
+/// normalized statement, the session's database and user and the query options. Each
+/// entry records the catalog versions of the tables and views the plan was created for;
+/// the caller must only reuse a plan while the frontend's catalog still has these
+/// versions. Entries are evicted in least recently used order once there are more than
+/// 'capacity' of them.
+///
+/// This class is thread-safe.
+class ImpalaServer::ExecRequestCache {
+ public:
+  /// A plan and the catalog state it was created for. Not modified once inserted into
+  /// the cache.
+  struct Entry {
+    TExecRequest exec_request;
+
+    /// Id of the catalog service the plan's metadata came from.
+    TUniqueId catalog_service_id;
+
+    /// The catalog version of each table and view the plan references, keyed by
+    /// "<db>.<table>".
+    std::vector<std::pair<std::string, int64_t> > table_versions;
+  };
+
+  ExecRequestCache(int capacity);
+
+  /// Returns the entry for 'key', or NULL if there is none.
+  boost::shared_ptr<const Entry> Lookup(const std::string& key);
+
+  /// Inserts 'entry' for 'key'. Replaces an existing entry for the same key.
+  void Insert(const std::string& key, const boost::shared_ptr<const Entry>& entry);
+
+  /// Removes all entries.
+  void Clear();
+
+ private:
+  struct LruEntry {
+    std::string key;
+    boost::shared_ptr<const Entry> entry;
+  };
+
+  typedef std::list<LruEntry> EntryList;
+  typedef boost::unordered_map<std::string, EntryList::iterator> EntryMap;
+
+  /// Removes the entry at 'it'. 'lock_' must be taken.
+  void RemoveEntry(EntryList::iterator it);
+
+  const int capacity_;
+
+  /// Protects all members below.
+  boost::mutex lock_;
+
+  /// All entries, in least recently used order: new and accessed entries go to the
+  /// back, evictions take from the front.
+  EntryList lru_list_;
+
+  /// Maps each key to its entry in 'lru_list_'.
+  EntryMap entries_;
+};
+
+}
+
+#endif
@@ -211,6 +211,8 @@ static void ResolveSymbolLookup(const TSymbolLookupParams params,
   if (params.symbol_type == TSymbolType::UDF_EVALUATE) {
     symbol = SymbolsUtil::MangleUserFunction(params.symbol,
         arg_types, params.has_var_args, params.__isset.ret_arg_type ? &ret_type : NULL);
+  } else if (params.symbol_type == TSymbolType::UDF_BATCH) {
+    symbol = SymbolsUtil::MangleBatchFunction(params.symbol);
   } else {
     DCHECK(params.symbol_type == TSymbolType::UDF_PREPARE ||
            params.symbol_type == TSymbolType::UDF_CLOSE);
@@ -229,6 +231,8 @@ static void ResolveSymbolLookup(const TSymbolLookupParams params,
         ss << arg_types[i].DebugString();
         if (i != arg_types.size() - 1) ss << ", ";
       }
+    } else if (params.symbol_type == TSymbolType::UDF_BATCH) {
+      ss << "impala_udf::FunctionContext*, int, const void* const*, void*";
     } else {
       ss << "impala_udf::FunctionContext*, "
          << "impala_udf::FunctionContext::FunctionStateScope";
@@ -15,15 +15,23 @@
 #include "service/fragment-exec-state.h"
 
 #include <sstream>
+#include <gflags/gflags.h>
 
 #include "codegen/llvm-codegen.h"
 #include "gen-cpp/ImpalaInternalService.h"
 #include "rpc/thrift-util.h"
+#include "runtime/exec-env.h"
 #include "gutil/strings/substitute.h"
 #include "util/bloom-filter.h"
+#include "util/cgroups-mgr.h"
 
 #include "common/names.h"
 
+DEFINE_bool(delta_exec_status_reports, true, "(Advanced) If true, the periodic status "
+    "reports of fragment instances only contain the profile counters and info strings "
+    "that changed since the previous report. The final report always contains the "
+    "full profile.");
+
 using namespace apache::thrift;
 using namespace strings;
 using namespace impala;
@@ -43,6 +51,15 @@ Status FragmentMgr::FragmentExecState::Cancel() {
 
 Status FragmentMgr::FragmentExecState::Prepare() {
   Status status = executor_.Prepare(exec_params_);
+  if (status.ok()) executor_.runtime_state()->set_numa_node(numa_node_);
+  if (status.ok() && !executor_.runtime_state()->cgroup().empty()) {
+    // Prepare() is called from the fragment's own thread, which joins the cgroup like
+    // the threads the fragment starts.
+    Status cgroup_status =
+        executor_.runtime_state()->exec_env()->cgroups_mgr()->AssignCurrentThreadToCgroup(
+            executor_.runtime_state()->cgroup());
+    if (!cgroup_status.ok()) LOG(WARNING) << cgroup_status.GetDetail();
+  }
   if (!status.ok()) ReportStatusCb(status, NULL, true);
   prepare_promise_.Set(status);
   return status;
@@ -82,7 +99,13 @@ void FragmentMgr::FragmentExecState::ReportStatusCb(
   params.__set_done(done);
 
   if (profile != NULL) {
-    profile->ToThrift(&params.profile);
+    // The coordinator merges each report into its copy of the profile, so intermediate
+    // reports can leave out the values it already has.
+    if (FLAGS_delta_exec_status_reports && !done) {
+      profile->ToThriftDelta(&params.profile);
+    } else {
+      profile->ToThrift(&params.profile);
+    }
     params.__isset.profile = true;
   }
 
@@ -33,7 +33,8 @@ class FragmentMgr::FragmentExecState {
       executor_(exec_env, boost::bind<void>(
           boost::mem_fn(&FragmentMgr::FragmentExecState::ReportStatusCb),
               this, _1, _2, _3)),
-      client_cache_(exec_env->impalad_client_cache()), exec_params_(params) {
+      client_cache_(exec_env->impalad_client_cache()), exec_params_(params),
+      numa_node_(-1) {
   }
 
   /// Calling the d'tor releases all memory and closes all data streams
@@ -62,6 +63,11 @@ class FragmentMgr::FragmentExecState {
     return fragment_instance_ctx_.query_ctx.coord_address;
   }
 
+  /// Sets the NUMA node that the fragment's threads are pinned to. Must be called
+  /// before Prepare().
+  void set_numa_node(int numa_node) { numa_node_ = numa_node; }
+  int numa_node() const { return numa_node_; }
+
   /// Set the execution thread, taking ownership of the object.
   void set_exec_thread(Thread* exec_thread) { exec_thread_.reset(exec_thread); }
 
@@ -77,6 +83,9 @@ class FragmentMgr::FragmentExecState {
   /// the thread executing this plan fragment
   boost::scoped_ptr<Thread> exec_thread_;
 
+  /// The NUMA node that the fragment's threads are pinned to, or -1 if they aren't.
+  int numa_node_;
+
   /// protects exec_status_
   boost::mutex status_lock_;
 
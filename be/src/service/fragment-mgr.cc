@@ -14,13 +14,19 @@
 
 #include "service/fragment-mgr.h"
 
+#include <algorithm>
+#include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
 #include <google/malloc_extension.h>
 #include <gutil/strings/substitute.h>
 
 #include "service/fragment-exec-state.h"
+#include "runtime/client-cache.h"
 #include "runtime/exec-env.h"
+#include "util/bloom-filter.h"
+#include "util/cpu-info.h"
 #include "util/impalad-metrics.h"
+#include "util/min-max-filter.h"
 #include "util/uid-util.h"
 
 #include "common/names.h"
@@ -31,6 +37,15 @@ using namespace strings;
 // TODO: this logging should go into a per query log.
 DEFINE_int32(log_mem_usage_interval, 0, "If non-zero, impalad will output memory usage "
     "every log_mem_usage_interval'th fragment completion.");
+DEFINE_bool(numa_pin_fragment_instances, false, "(Advanced) If true, on machines with "
+    "more than one NUMA node, the threads of each remote fragment instance are pinned "
+    "to the cores of one node and prefer its memory. Instances are spread round-robin "
+    "over the nodes. This avoids cross-socket memory traffic at the cost of balancing "
+    "load across the sockets less evenly.");
+DEFINE_int32(runtime_filter_publish_fanout, 16, "(Advanced) Maximum number of backends "
+    "that the coordinator, and each backend that forwards a global runtime filter, send "
+    "the filter to. The other backends receive it from these in further hops. If 0, the "
+    "coordinator sends each filter to all backends itself.");
 
 Status FragmentMgr::ExecPlanFragment(const TExecPlanFragmentParams& exec_params) {
   VLOG_QUERY << "ExecPlanFragment() instance_id="
@@ -57,6 +72,12 @@ Status FragmentMgr::ExecPlanFragment(const TExecPlanFragmentParams& exec_params)
 
   shared_ptr<FragmentExecState> exec_state(
       new FragmentExecState(exec_params, ExecEnv::GetInstance()));
+  if (FLAGS_numa_pin_fragment_instances && CpuInfo::num_numa_nodes() > 1) {
+    int numa_node = (next_numa_node_.UpdateAndFetch(1) - 1) % CpuInfo::num_numa_nodes();
+    // The counter may wrap around.
+    if (numa_node < 0) numa_node += CpuInfo::num_numa_nodes();
+    exec_state->set_numa_node(numa_node);
+  }
 
   // Register exec_state before this RPC returns so that async Cancel() calls (which can
   // only happen after this RPC returns) can always find this fragment.
@@ -64,6 +85,7 @@ Status FragmentMgr::ExecPlanFragment(const TExecPlanFragmentParams& exec_params)
     lock_guard<SpinLock> l(fragment_exec_state_map_lock_);
     fragment_exec_state_map_.insert(
         make_pair(exec_state->fragment_instance_id(), exec_state));
+    ++num_query_instances_[exec_state->query_id()];
   }
 
   ImpaladMetrics::IMPALA_SERVER_NUM_FRAGMENTS_IN_FLIGHT->Increment(1L);
@@ -79,18 +101,64 @@ Status FragmentMgr::ExecPlanFragment(const TExecPlanFragmentParams& exec_params)
   return Status::OK();
 }
 
+void FragmentMgr::ExecPlanFragments(TExecPlanFragmentsResult& return_val,
+    const TExecPlanFragmentsParams& params) {
+  return_val.__isset.statuses = true;
+  return_val.statuses.resize(params.instances.size());
+  for (int i = 0; i < params.instances.size(); ++i) {
+    const TExecPlanFragmentInstance& instance = params.instances[i];
+    DCHECK_LT(instance.fragment_idx, params.fragments.size());
+    DCHECK_LT(instance.fragment_idx, params.desc_tbls.size());
+    TExecPlanFragmentParams exec_params;
+    exec_params.__set_protocol_version(params.protocol_version);
+    exec_params.__set_fragment(params.fragments[instance.fragment_idx]);
+    exec_params.__set_desc_tbl(params.desc_tbls[instance.fragment_idx]);
+    exec_params.__set_params(instance.params);
+    TPlanFragmentInstanceCtx* ctx = &exec_params.fragment_instance_ctx;
+    ctx->__set_query_ctx(params.query_ctx);
+    ctx->fragment_instance_id = instance.fragment_instance_id;
+    ctx->per_fragment_instance_idx = instance.per_fragment_instance_idx;
+    ctx->num_fragment_instances = instance.num_fragment_instances;
+    ctx->fragment_instance_idx = instance.fragment_instance_idx;
+    exec_params.__isset.fragment_instance_ctx = true;
+    if (instance.__isset.reserved_resource) {
+      exec_params.__set_reserved_resource(instance.reserved_resource);
+    }
+    if (instance.__isset.local_resource_address) {
+      exec_params.__set_local_resource_address(instance.local_resource_address);
+    }
+    ExecPlanFragment(exec_params).ToThrift(&return_val.statuses[i]);
+  }
+}
+
 void FragmentMgr::FragmentThread(TUniqueId fragment_instance_id) {
   shared_ptr<FragmentExecState> exec_state = GetFragmentExecState(fragment_instance_id);
   if (exec_state.get() == NULL) return;
+  if (exec_state->numa_node() != -1) {
+    // Pin before Prepare() so that the fragment's memory is first touched on the node.
+    Status pin_status = CpuInfo::PinThreadToNumaNode(exec_state->numa_node());
+    if (!pin_status.ok()) LOG(WARNING) << pin_status.GetDetail();
+  }
   Status status = exec_state->Prepare();
   if (status.ok()) exec_state->Exec();
 
   // We're done with this plan fragment
+  bool last_query_instance;
   {
     lock_guard<SpinLock> l(fragment_exec_state_map_lock_);
     size_t num_erased =
         fragment_exec_state_map_.erase(exec_state->fragment_instance_id());
     DCHECK_EQ(num_erased, 1);
+    unordered_map<TUniqueId, int>::iterator it =
+        num_query_instances_.find(exec_state->query_id());
+    DCHECK(it != num_query_instances_.end());
+    last_query_instance = --it->second == 0;
+    if (last_query_instance) num_query_instances_.erase(it);
+  }
+  if (last_query_instance) {
+    // Filters that some local producer never sent are not needed anymore.
+    lock_guard<mutex> l(pending_filters_lock_);
+    pending_filters_.erase(exec_state->query_id());
   }
   // TODO: this might be imprecise, if another client of FragmentMgr has a reference to
   // the fragment exec state.
@@ -140,12 +208,121 @@ void FragmentMgr::CancelPlanFragment(TCancelPlanFragmentResult& return_val,
 
 void FragmentMgr::PublishFilter(TPublishFilterResult& return_val,
     const TPublishFilterParams& params) {
-  shared_ptr<FragmentExecState> fragment_exec_state =
-      GetFragmentExecState(params.dst_instance_id);
-  if (fragment_exec_state.get() == NULL) {
-    LOG(INFO) << "Unknown fragment (ID: " << params.dst_instance_id
-              << ") for filter (ID: " << params.filter_id << ")";
-    return;
+  // Forward first, the local instances may have to wait until they are prepared.
+  if (params.__isset.forward_targets && !params.forward_targets.empty()) {
+    shared_ptr<TPublishFilterParams> forward_params(new TPublishFilterParams());
+    forward_params->filter_id = params.filter_id;
+    forward_params->bloom_filter = params.bloom_filter;
+    PublishFilterToHosts(forward_params, params.forward_targets);
+  }
+
+  vector<TUniqueId> dst_instance_ids(1, params.dst_instance_id);
+  if (params.__isset.other_dst_instance_ids) {
+    dst_instance_ids.insert(dst_instance_ids.end(), params.other_dst_instance_ids.begin(),
+        params.other_dst_instance_ids.end());
+  }
+  BOOST_FOREACH(const TUniqueId& dst_instance_id, dst_instance_ids) {
+    shared_ptr<FragmentExecState> fragment_exec_state =
+        GetFragmentExecState(dst_instance_id);
+    if (fragment_exec_state.get() == NULL) {
+      LOG(INFO) << "Unknown fragment (ID: " << dst_instance_id
+                << ") for filter (ID: " << params.filter_id << ")";
+      continue;
+    }
+    fragment_exec_state->PublishFilter(params.filter_id, params.bloom_filter);
+  }
+}
+
+namespace {
+
+/// Sends the filter in 'params' to the instances of 'target', which forwards it to
+/// 'forward_targets'. Executed asynchronously in the context of ExecEnv::rpc_pool().
+void SendPublishFilter(shared_ptr<const TPublishFilterParams> params,
+    TPublishFilterTarget target, vector<TPublishFilterTarget> forward_targets) {
+  DCHECK(!target.dst_instance_ids.empty());
+  Status status;
+  ImpalaInternalServiceConnection backend_client(
+      ExecEnv::GetInstance()->impalad_client_cache(), target.address, &status);
+  if (!status.ok()) return;
+  // Make a local copy of the shared 'master' set of parameters
+  TPublishFilterParams local_params;
+  local_params.filter_id = params->filter_id;
+  local_params.__set_bloom_filter(params->bloom_filter);
+  local_params.dst_instance_id = target.dst_instance_ids[0];
+  if (target.dst_instance_ids.size() > 1) {
+    local_params.__set_other_dst_instance_ids(vector<TUniqueId>(
+        target.dst_instance_ids.begin() + 1, target.dst_instance_ids.end()));
+  }
+  if (!forward_targets.empty()) local_params.__set_forward_targets(forward_targets);
+  TPublishFilterResult res;
+  status = backend_client.DoRpc(&ImpalaInternalServiceClient::PublishFilter,
+      local_params, &res);
+  // Failing to publish a filter is not a query-wide error, but the backends that this
+  // one should have forwarded the filter to do not receive it either.
+  if (!status.ok() && !forward_targets.empty()) {
+    LOG(INFO) << "Couldn't publish filter to " << target.address << ", not forwarded "
+              << "to " << forward_targets.size() << " more backends: "
+              << status.GetDetail();
+  }
+}
+
+}
+
+void FragmentMgr::PublishFilterToHosts(
+    const shared_ptr<const TPublishFilterParams>& params,
+    const vector<TPublishFilterTarget>& targets) {
+  int num_targets = targets.size();
+  int num_groups = FLAGS_runtime_filter_publish_fanout > 0 ?
+      min(FLAGS_runtime_filter_publish_fanout, num_targets) : num_targets;
+  // Split the targets into 'num_groups' contiguous groups of nearly equal size. The
+  // first target of each group receives the filter and forwards it to the rest.
+  int begin = 0;
+  for (int i = 0; i < num_groups; ++i) {
+    int end = begin + num_targets / num_groups + (i < num_targets % num_groups ? 1 : 0);
+    DCHECK_LT(begin, end);
+    vector<TPublishFilterTarget> forward_targets(
+        targets.begin() + begin + 1, targets.begin() + end);
+    ExecEnv::GetInstance()->rpc_pool()->Offer(bind<void>(SendPublishFilter, params,
+        targets[begin], forward_targets));
+    begin = end;
+  }
+  DCHECK_EQ(begin, num_targets);
+}
+
+bool FragmentMgr::MergeLocalFilter(const TUniqueId& query_id, int32_t filter_id,
+    int num_local_producers, const BloomFilter& bloom_filter,
+    const MinMaxFilter* min_max_filter, TUpdateFilterParams* params) {
+  DCHECK_GT(num_local_producers, 1);
+  lock_guard<mutex> l(pending_filters_lock_);
+  shared_ptr<PendingFilter>& filter = pending_filters_[query_id][filter_id];
+  if (filter.get() == NULL) {
+    filter.reset(new PendingFilter());
+    TBloomFilter thrift_filter;
+    bloom_filter.ToThrift(&thrift_filter);
+    filter->bloom_filter.reset(new BloomFilter(thrift_filter, NULL, NULL));
+  } else {
+    filter->bloom_filter->Or(bloom_filter);
+  }
+  // The range is only known if every producer computed one.
+  if (min_max_filter == NULL) {
+    filter->min_max_unknown = true;
+  } else if (!filter->min_max_unknown) {
+    if (filter->min_max_filter.get() == NULL) {
+      filter->min_max_filter.reset(new MinMaxFilter(*min_max_filter));
+    } else {
+      filter->min_max_filter->Or(*min_max_filter);
+    }
+  }
+  if (++filter->num_merged < num_local_producers) return false;
+
+  DCHECK_EQ(filter->num_merged, num_local_producers);
+  filter->bloom_filter->ToThrift(&params->bloom_filter);
+  if (!filter->min_max_unknown && filter->min_max_filter.get() != NULL) {
+    TMinMaxFilter min_max;
+    filter->min_max_filter->ToThrift(&min_max);
+    params->bloom_filter.__set_min_max(min_max);
   }
-  fragment_exec_state->PublishFilter(params.filter_id, params.bloom_filter);
+  params->__set_num_producers(num_local_producers);
+  pending_filters_[query_id].erase(filter_id);
+  return true;
 }
@@ -15,16 +15,22 @@
 #ifndef IMPALA_SERVICE_FRAGMENT_MGR_H
 #define IMPALA_SERVICE_FRAGMENT_MGR_H
 
+#include <vector>
+#include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/unordered_map.hpp>
 
 #include "gen-cpp/ImpalaInternalService.h"
+#include "common/atomic.h"
 #include "common/status.h"
 #include "util/spinlock.h"
 
 namespace impala {
 
+class BloomFilter;
+class MinMaxFilter;
+
 /// Manages execution of individual plan fragment instances, which are typically run as a
 /// result of ExecPlanFragment() RPCs that arrive via the internal Impala interface.
 //
@@ -38,6 +44,8 @@ namespace impala {
 /// does for ExecPlanFragment()'s return value.
 class FragmentMgr {
  public:
+  FragmentMgr() : next_numa_node_(0) { }
+
   /// Registers a new FragmentExecState and launches the thread that calls Prepare() and
   /// Exec() on it.
   ///
@@ -50,6 +58,12 @@ class FragmentMgr {
   /// (because the fragment is unregistered).
   Status ExecPlanFragment(const TExecPlanFragmentParams& params);
 
+  /// Calls ExecPlanFragment() for each instance in 'params' and returns the status of
+  /// each in 'return_val'. The instances are started independently: an error for one
+  /// does not prevent the others from starting.
+  void ExecPlanFragments(TExecPlanFragmentsResult& return_val,
+      const TExecPlanFragmentsParams& params);
+
   /// Cancels a plan fragment that is running asynchronously.
   void CancelPlanFragment(TCancelPlanFragmentResult& return_val,
       const TCancelPlanFragmentParams& params);
@@ -61,11 +75,45 @@ class FragmentMgr {
   boost::shared_ptr<FragmentExecState> GetFragmentExecState(
       const TUniqueId& fragment_instance_id);
 
-  /// Publishes a global runtime filter to a local fragment.
+  /// Publishes a global runtime filter to the local fragments in 'params', after
+  /// offering the rpcs that forward it to the backends in params.forward_targets.
   void PublishFilter(TPublishFilterResult& return_val,
       const TPublishFilterParams& params);
 
+  /// Asynchronously publishes the filter in 'params' to the fragment instances of
+  /// 'targets'. The rpcs go to at most --runtime_filter_publish_fanout backends, each of
+  /// which forwards the filter to its share of the remaining ones in the same way, so
+  /// that the filter reaches all targets in a logarithmic number of hops and no backend
+  /// sends it more than that number of times. Only the filter_id and bloom_filter of
+  /// 'params' are used.
+  static void PublishFilterToHosts(
+      const boost::shared_ptr<const TPublishFilterParams>& params,
+      const std::vector<TPublishFilterTarget>& targets);
+
+  /// Merges a filter that a fragment instance of query 'query_id' produced with the
+  /// filters of the other 'num_local_producers' instances on this backend that produce
+  /// it, see TRuntimeFilterDesc.num_local_producers. 'min_max_filter' may be NULL.
+  /// Returns true and sets the filter, its range and num_producers of 'params' to the
+  /// merged result if this was the last of these instances, false otherwise.
+  bool MergeLocalFilter(const TUniqueId& query_id, int32_t filter_id,
+      int num_local_producers, const BloomFilter& bloom_filter,
+      const MinMaxFilter* min_max_filter, TUpdateFilterParams* params);
+
  private:
+  /// A filter of a query that is merged from the local instances that produce it.
+  struct PendingFilter {
+    boost::scoped_ptr<BloomFilter> bloom_filter;
+    boost::scoped_ptr<MinMaxFilter> min_max_filter;
+
+    /// True if some instance did not compute a range.
+    bool min_max_unknown;
+
+    /// Number of filters merged so far.
+    int num_merged;
+
+    PendingFilter() : min_max_unknown(false), num_merged(0) { }
+  };
+
   /// protects fragment_exec_state_map_
   SpinLock fragment_exec_state_map_lock_;
 
@@ -75,10 +123,28 @@ class FragmentMgr {
   FragmentExecStateMap;
   FragmentExecStateMap fragment_exec_state_map_;
 
+  /// Number of registered fragment instances of each query. Protected by
+  /// fragment_exec_state_map_lock_.
+  boost::unordered_map<TUniqueId, int> num_query_instances_;
+
+  /// Protects pending_filters_. A mutex since merging large filters takes a while.
+  boost::mutex pending_filters_lock_;
+
+  /// The filters that are merged by MergeLocalFilter(), by query and filter id. The
+  /// entries of a query are removed when its last instance on this backend finishes.
+  typedef boost::unordered_map<int32_t, boost::shared_ptr<PendingFilter> >
+      PendingFilterMap;
+  boost::unordered_map<TUniqueId, PendingFilterMap> pending_filters_;
+
+  /// With --numa_pin_fragment_instances, fragment instances are pinned to the NUMA
+  /// nodes round-robin. This is the node of the next instance, modulo the node count.
+  AtomicInt<int> next_numa_node_;
+
   /// Retrieves the 'exec_state' corresponding to fragment_instance_id. Calls
   /// exec_state->Prepare() and then exec_state->Exec(). Finally unregisters the
   /// exec_state from fragment_exec_state_map_. The exec_state must previously have been
-  /// registered in fragment_exec_state_map_. Runs in the fragment's execution thread.
+  /// registered in fragment_exec_state_map_. Runs in the fragment's execution thread,
+  /// which is first pinned to the fragment's NUMA node, if it has one.
   void FragmentThread(TUniqueId fragment_instance_id);
 };
 
@@ -15,7 +15,9 @@
 #include "service/hs2-util.h"
 
 #include "common/logging.h"
+#include "exprs/expr-context.h"
 #include "runtime/raw-value.h"
+#include "runtime/row-batch.h"
 #include "runtime/types.h"
 
 #include <gutil/strings/substitute.h>
@@ -216,6 +218,146 @@ void impala::ExprValueToHS2TColumn(const void* value, const TColumnType& type,
   SetNullBit(row_idx, (value == NULL), nulls);
 }
 
+// Converters from a non-NULL expr value of 'type' to a value of a TColumn, for
+// ExprValuesToHS2Values(). 'out' is a reference into the value list, so that strings
+// are written in place and the bit references of list<bool> work.
+template<typename T, typename ValueT>
+static inline void CopyValue(const void* value, const ColumnType& type,
+    typename vector<ValueT>::reference out) {
+  out = *reinterpret_cast<const T*>(value);
+}
+
+static inline void StringToHS2Value(const void* value, const ColumnType& type,
+    string& out) {
+  const StringValue* str_val = reinterpret_cast<const StringValue*>(value);
+  out.assign(static_cast<char*>(str_val->ptr), str_val->len);
+}
+
+static inline void CharToHS2Value(const void* value, const ColumnType& type,
+    string& out) {
+  out.assign(StringValue::CharSlotToPtr(value, type), type.len);
+}
+
+static inline void TimestampToHS2Value(const void* value, const ColumnType& type,
+    string& out) {
+  out.clear();
+  RawValue::PrintValue(value, TYPE_TIMESTAMP, -1, &out);
+}
+
+template<typename T>
+static inline void DecimalToHS2Value(const void* value, const ColumnType& type,
+    string& out) {
+  out = reinterpret_cast<const T*>(value)->ToString(type);
+}
+
+// Appends the values of 'expr_ctx' over the rows [start_idx, start_idx + num_rows) of
+// 'batch' to 'values' and 'nulls', which hold 'row_idx' rows. The null bitmap is
+// extended with zeroes first, so only the bits of NULL rows need to be set.
+template<typename ValueT,
+    void (*Convert)(const void*, const ColumnType&, typename vector<ValueT>::reference)>
+static void ExprValuesToHS2Values(ExprContext* expr_ctx, const ColumnType& type,
+    RowBatch* batch, int start_idx, int num_rows, uint32_t row_idx,
+    vector<ValueT>* values, string* nulls) {
+  DCHECK_EQ(values->size(), row_idx);
+  DCHECK_EQ(nulls->size(), (row_idx + 7) / 8);
+  values->resize(row_idx + num_rows);
+  nulls->resize((row_idx + num_rows + 7) / 8, '\0');
+  for (int i = 0; i < num_rows; ++i, ++row_idx) {
+    void* value = expr_ctx->GetValue(batch->GetRow(start_idx + i));
+    if (value == NULL) {
+      (*values)[row_idx] = ValueT();
+      (*nulls)[row_idx / 8] |= 1 << (row_idx % 8);
+    } else {
+      Convert(value, type, (*values)[row_idx]);
+    }
+  }
+}
+
+// For V6 and above
+void impala::ExprValuesToHS2TColumn(ExprContext* expr_ctx, const TColumnType& type,
+    RowBatch* batch, int start_idx, int num_rows, uint32_t row_idx,
+    thrift::TColumn* column) {
+  const ColumnType& col_type = ColumnType::FromThrift(type);
+  switch (type.types[0].scalar_type.type) {
+    case TPrimitiveType::NULL_TYPE:
+    case TPrimitiveType::BOOLEAN:
+      ExprValuesToHS2Values<bool, CopyValue<bool, bool> >(expr_ctx, col_type, batch,
+          start_idx, num_rows, row_idx, &column->boolVal.values, &column->boolVal.nulls);
+      break;
+    case TPrimitiveType::TINYINT:
+      ExprValuesToHS2Values<int8_t, CopyValue<int8_t, int8_t> >(expr_ctx, col_type,
+          batch, start_idx, num_rows, row_idx, &column->byteVal.values,
+          &column->byteVal.nulls);
+      break;
+    case TPrimitiveType::SMALLINT:
+      ExprValuesToHS2Values<int16_t, CopyValue<int16_t, int16_t> >(expr_ctx, col_type,
+          batch, start_idx, num_rows, row_idx, &column->i16Val.values,
+          &column->i16Val.nulls);
+      break;
+    case TPrimitiveType::INT:
+      ExprValuesToHS2Values<int32_t, CopyValue<int32_t, int32_t> >(expr_ctx, col_type,
+          batch, start_idx, num_rows, row_idx, &column->i32Val.values,
+          &column->i32Val.nulls);
+      break;
+    case TPrimitiveType::BIGINT:
+      ExprValuesToHS2Values<int64_t, CopyValue<int64_t, int64_t> >(expr_ctx, col_type,
+          batch, start_idx, num_rows, row_idx, &column->i64Val.values,
+          &column->i64Val.nulls);
+      break;
+    case TPrimitiveType::FLOAT:
+      ExprValuesToHS2Values<double, CopyValue<float, double> >(expr_ctx, col_type,
+          batch, start_idx, num_rows, row_idx, &column->doubleVal.values,
+          &column->doubleVal.nulls);
+      break;
+    case TPrimitiveType::DOUBLE:
+      ExprValuesToHS2Values<double, CopyValue<double, double> >(expr_ctx, col_type,
+          batch, start_idx, num_rows, row_idx, &column->doubleVal.values,
+          &column->doubleVal.nulls);
+      break;
+    case TPrimitiveType::TIMESTAMP:
+      ExprValuesToHS2Values<string, TimestampToHS2Value>(expr_ctx, col_type, batch,
+          start_idx, num_rows, row_idx, &column->stringVal.values,
+          &column->stringVal.nulls);
+      break;
+    case TPrimitiveType::STRING:
+    case TPrimitiveType::VARCHAR:
+      ExprValuesToHS2Values<string, StringToHS2Value>(expr_ctx, col_type, batch,
+          start_idx, num_rows, row_idx, &column->stringVal.values,
+          &column->stringVal.nulls);
+      break;
+    case TPrimitiveType::CHAR:
+      ExprValuesToHS2Values<string, CharToHS2Value>(expr_ctx, col_type, batch,
+          start_idx, num_rows, row_idx, &column->stringVal.values,
+          &column->stringVal.nulls);
+      break;
+    case TPrimitiveType::DECIMAL:
+      // HiveServer2 requires decimal to be presented as string.
+      switch (col_type.GetByteSize()) {
+        case 4:
+          ExprValuesToHS2Values<string, DecimalToHS2Value<Decimal4Value> >(expr_ctx,
+              col_type, batch, start_idx, num_rows, row_idx, &column->stringVal.values,
+              &column->stringVal.nulls);
+          break;
+        case 8:
+          ExprValuesToHS2Values<string, DecimalToHS2Value<Decimal8Value> >(expr_ctx,
+              col_type, batch, start_idx, num_rows, row_idx, &column->stringVal.values,
+              &column->stringVal.nulls);
+          break;
+        case 16:
+          ExprValuesToHS2Values<string, DecimalToHS2Value<Decimal16Value> >(expr_ctx,
+              col_type, batch, start_idx, num_rows, row_idx, &column->stringVal.values,
+              &column->stringVal.nulls);
+          break;
+        default:
+          DCHECK(false) << "bad type: " << col_type;
+      }
+      break;
+    default:
+      DCHECK(false) << "Unhandled type: "
+                    << TypeToString(ThriftToType(type.types[0].scalar_type.type));
+  }
+}
+
 // For V1 -> V5
 void impala::TColumnValueToHS2TColumnValue(const TColumnValue& col_val,
     const TColumnType& type, thrift::TColumnValue* hs2_col_val) {
@@ -149,7 +149,7 @@ class ImpalaServer::AsciiQueryResultSet : public ImpalaServer::QueryResultSet {
     int64_t bytes = 0;
     const int end = min(static_cast<size_t>(num_rows), result_set_->size() - start_idx);
     for (int i = start_idx; i < start_idx + end; ++i) {
-      bytes += sizeof(result_set_[i]) + result_set_[i].capacity();
+      bytes += sizeof((*result_set_)[i]) + (*result_set_)[i].capacity();
     }
     return bytes;
   }
@@ -168,6 +168,11 @@ class ImpalaServer::AsciiQueryResultSet : public ImpalaServer::QueryResultSet {
   scoped_ptr<vector<string> > owned_result_set_;
 };
 
+ImpalaServer::QueryResultSet* ImpalaServer::CreateBeeswaxResultSet(
+    const TResultSetMetadata& metadata) {
+  return new AsciiQueryResultSet(metadata);
+}
+
 void ImpalaServer::query(QueryHandle& query_handle, const Query& query) {
   VLOG_QUERY << "query(): query=" << query.query;
   ScopedSessionState session_handle(this);
@@ -360,10 +365,9 @@ QueryState::type ImpalaServer::get_state(const QueryHandle& handle) {
   QueryHandleToTUniqueId(handle, &query_id);
   VLOG_ROW << "get_state(): query_id=" << PrintId(query_id);
 
-  lock_guard<mutex> l(query_exec_state_map_lock_);
-  QueryExecStateMap::iterator entry = query_exec_state_map_.find(query_id);
-  if (entry != query_exec_state_map_.end()) {
-    return entry->second->query_state();
+  shared_ptr<QueryExecState> exec_state = GetQueryExecState(query_id, false);
+  if (exec_state != NULL) {
+    return exec_state->query_state();
   } else {
     VLOG_QUERY << "ImpalaServer::get_state invalid handle";
     RaiseBeeswaxException("Invalid query handle", SQLSTATE_GENERAL_ERROR);
@@ -162,6 +162,18 @@ class ImpalaServer::HS2ColumnarResultSet : public ImpalaServer::QueryResultSet {
     return Status::OK();
   }
 
+  // Add rows of a batch, converting them one column at a time
+  virtual Status AddRowBatch(const vector<ExprContext*>& expr_ctxs, RowBatch* batch,
+      int start_idx, int num_rows) {
+    DCHECK_EQ(expr_ctxs.size(), metadata_.columns.size());
+    for (int i = 0; i < expr_ctxs.size(); ++i) {
+      ExprValuesToHS2TColumn(expr_ctxs[i], metadata_.columns[i].columnType, batch,
+          start_idx, num_rows, num_rows_, &(result_set_->columns[i]));
+    }
+    num_rows_ += num_rows;
+    return Status::OK();
+  }
+
   // Copy all columns starting at 'start_idx' and proceeding for a maximum of 'num_rows'
   // from 'other' into this result set
   virtual int AddRows(const QueryResultSet* other, int start_idx, int num_rows) {
@@ -655,8 +667,9 @@ void ImpalaServer::OpenSession(TOpenSessionResp& return_val,
 
   // Put the session state in session_state_map_
   {
-    lock_guard<mutex> l(session_state_map_lock_);
-    session_state_map_.insert(make_pair(session_id, state));
+    SessionStateMapShard* shard = GetSessionStateMapShard(session_id);
+    lock_guard<shared_mutex> l(shard->lock);
+    shard->map.insert(make_pair(session_id, state));
   }
 
   {
@@ -933,10 +946,9 @@ void ImpalaServer::GetOperationStatus(TGetOperationStatusResp& return_val,
       request.operationHandle.operationId, &query_id, &secret), SQLSTATE_GENERAL_ERROR);
   VLOG_ROW << "GetOperationStatus(): query_id=" << PrintId(query_id);
 
-  lock_guard<mutex> l(query_exec_state_map_lock_);
-  QueryExecStateMap::iterator entry = query_exec_state_map_.find(query_id);
-  if (entry != query_exec_state_map_.end()) {
-    QueryState::type query_state = entry->second->query_state();
+  shared_ptr<QueryExecState> exec_state = GetQueryExecState(query_id, false);
+  if (exec_state != NULL) {
+    QueryState::type query_state = exec_state->query_state();
     TOperationState::type operation_state = QueryStateToTOperationState(query_state);
     return_val.__set_operationState(operation_state);
     return;
@@ -1000,8 +1012,8 @@ void ImpalaServer::GetResultSetMetadata(TGetResultSetMetadataResp& return_val,
       request.operationHandle.operationId, &query_id, &secret), SQLSTATE_GENERAL_ERROR);
   VLOG_QUERY << "GetResultSetMetadata(): query_id=" << PrintId(query_id);
 
-  // Look up the session ID (which takes session_state_map_lock_) before taking the query
-  // exec state lock.
+  // Look up the session ID (which takes a lock of query_exec_state_map_) before taking
+  // the query exec state lock.
   TUniqueId session_id;
   if (!GetSessionIdForQuery(query_id, &session_id)) {
     HS2_RETURN_ERROR(return_val, "Invalid query handle", SQLSTATE_GENERAL_ERROR);
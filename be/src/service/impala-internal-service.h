@@ -37,6 +37,11 @@ class ImpalaInternalService : public ImpalaInternalServiceIf {
     fragment_mgr_->ExecPlanFragment(params).SetTStatus(&return_val);
   }
 
+  virtual void ExecPlanFragments(TExecPlanFragmentsResult& return_val,
+      const TExecPlanFragmentsParams& params) {
+    fragment_mgr_->ExecPlanFragments(return_val, params);
+  }
+
   virtual void CancelPlanFragment(TCancelPlanFragmentResult& return_val,
       const TCancelPlanFragmentParams& params) {
     fragment_mgr_->CancelPlanFragment(return_val, params);
@@ -52,6 +57,11 @@ class ImpalaInternalService : public ImpalaInternalServiceIf {
     impala_server_->TransmitData(return_val, params);
   }
 
+  virtual void TransmitDataBatch(TTransmitDataBatchResult& return_val,
+      const TTransmitDataBatchParams& params) {
+    impala_server_->TransmitDataBatch(return_val, params);
+  }
+
   virtual void UpdateFilter(TUpdateFilterResult& return_val,
       const TUpdateFilterParams& params) {
       impala_server_->UpdateFilter(return_val, params);
@@ -15,15 +15,18 @@
 #include "service/impala-server.h"
 
 #include <sstream>
+#include <boost/algorithm/string/join.hpp>
 #include <boost/thread/mutex.hpp>
 #include <gutil/strings/substitute.h>
 
 #include "catalog/catalog-util.h"
+#include "service/plan-history.h"
 #include "service/query-exec-state.h"
 #include "util/webserver.h"
 
 #include "gen-cpp/beeswax_types.h"
 #include "thrift/protocol/TDebugProtocol.h"
+#include "util/debug-util.h"
 #include "util/redactor.h"
 #include "util/summary-util.h"
 #include "util/url-coding.h"
@@ -31,6 +34,7 @@
 #include "common/names.h"
 
 using boost::adopt_lock_t;
+using boost::algorithm::join;
 using namespace apache::thrift;
 using namespace beeswax;
 using namespace impala;
@@ -103,6 +107,13 @@ void ImpalaServer::RegisterWebserverCallbacks(Webserver* webserver) {
       query_plan_text_callback, false);
   webserver->RegisterUrlCallback("/query_stmt", "query_stmt.tmpl",
       query_plan_text_callback, false);
+
+  if (plan_history_ != NULL) {
+    Webserver::UrlCallback plan_history_callback = bind<void>(
+        mem_fn(&PlanHistory::PlanHistoryUrlCallback), plan_history_.get(), _1, _2);
+    webserver->RegisterUrlCallback("/plan_history", "plan_history.tmpl",
+        plan_history_callback);
+  }
 }
 
 void ImpalaServer::HadoopVarzUrlCallback(const Webserver::ArgumentMap& args,
@@ -178,6 +189,30 @@ void ImpalaServer::QueryProfileUrlCallback(const Webserver::ArgumentMap& args,
   document->AddMember("profile", profile, document->GetAllocator());
   document->AddMember("query_id", args.find("query_id")->second.c_str(),
       document->GetAllocator());
+
+  vector<ProfileTimeSeries> time_series;
+  status = GetRuntimeProfileTimeSeries(unique_id, &time_series);
+  if (!status.ok()) return;
+  Value time_series_json(kArrayType);
+  BOOST_FOREACH(const ProfileTimeSeries& series, time_series) {
+    Value series_json(kObjectType);
+    Value path(join(series.profile_path, " / ").c_str(), document->GetAllocator());
+    series_json.AddMember("profile", path, document->GetAllocator());
+    Value name(series.counter.name.c_str(), document->GetAllocator());
+    series_json.AddMember("name", name, document->GetAllocator());
+    Value unit(PrintTUnit(series.counter.unit).c_str(), document->GetAllocator());
+    series_json.AddMember("unit", unit, document->GetAllocator());
+    series_json.AddMember("period_ms", series.counter.period_ms,
+        document->GetAllocator());
+    Value values(kArrayType);
+    BOOST_FOREACH(int64_t value, series.counter.values) {
+      Value sample(value);
+      values.PushBack(sample, document->GetAllocator());
+    }
+    series_json.AddMember("values", values, document->GetAllocator());
+    time_series_json.PushBack(series_json, document->GetAllocator());
+  }
+  document->AddMember("time_series", time_series_json, document->GetAllocator());
 }
 
 void ImpalaServer::QueryProfileEncodedUrlCallback(const Webserver::ArgumentMap& args,
@@ -201,10 +236,13 @@ void ImpalaServer::QueryProfileEncodedUrlCallback(const Webserver::ArgumentMap&
 
 void ImpalaServer::InflightQueryIdsUrlCallback(const Webserver::ArgumentMap& args,
     Document* document) {
-  lock_guard<mutex> l(query_exec_state_map_lock_);
   stringstream ss;
-  BOOST_FOREACH(const QueryExecStateMap::value_type& exec_state, query_exec_state_map_) {
-    ss << exec_state.second->query_id() << "\n";
+  for (int i = 0; i < NUM_STATE_MAP_SHARDS; ++i) {
+    shared_lock<shared_mutex> l(query_exec_state_map_[i].lock);
+    BOOST_FOREACH(const QueryExecStateMap::value_type& exec_state,
+        query_exec_state_map_[i].map) {
+      ss << exec_state.second->query_id() << "\n";
+    }
   }
   document->AddMember(Webserver::ENABLE_RAW_JSON_KEY, true, document->GetAllocator());
   Value query_ids(ss.str().c_str(), document->GetAllocator());
@@ -280,10 +318,10 @@ void ImpalaServer::QueryStateToJson(const ImpalaServer::QueryStateRecord& record
 void ImpalaServer::QueryStateUrlCallback(const Webserver::ArgumentMap& args,
     Document* document) {
   set<QueryStateRecord, QueryStateRecord> sorted_query_records;
-  {
-    lock_guard<mutex> l(query_exec_state_map_lock_);
+  for (int i = 0; i < NUM_STATE_MAP_SHARDS; ++i) {
+    shared_lock<shared_mutex> l(query_exec_state_map_[i].lock);
     BOOST_FOREACH(
-        const QueryExecStateMap::value_type& exec_state, query_exec_state_map_) {
+        const QueryExecStateMap::value_type& exec_state, query_exec_state_map_[i].map) {
       // TODO: Do this in the browser so that sorts on other keys are possible.
       sorted_query_records.insert(QueryStateRecord(*exec_state.second));
     }
@@ -332,9 +370,15 @@ void ImpalaServer::QueryStateUrlCallback(const Webserver::ArgumentMap& args,
 
 void ImpalaServer::SessionsUrlCallback(const Webserver::ArgumentMap& args,
     Document* document) {
-  lock_guard<mutex> l(session_state_map_lock_);
+  // Take a snapshot of the sessions, the JSON is built without holding the shard locks.
+  SessionStateMap all_sessions;
+  for (int i = 0; i < NUM_STATE_MAP_SHARDS; ++i) {
+    SessionStateMapShard* shard = &session_state_map_[i];
+    shared_lock<shared_mutex> l(shard->lock);
+    all_sessions.insert(shard->map.begin(), shard->map.end());
+  }
   Value sessions(kArrayType);
-  BOOST_FOREACH(const SessionStateMap::value_type& session, session_state_map_) {
+  BOOST_FOREACH(const SessionStateMap::value_type& session, all_sessions) {
     shared_ptr<SessionState> state = session.second;
     Value session_json(kObjectType);
     Value type(PrintTSessionType(state->session_type).c_str(),
@@ -380,7 +424,7 @@ void ImpalaServer::SessionsUrlCallback(const Webserver::ArgumentMap& args,
   }
 
   document->AddMember("sessions", sessions, document->GetAllocator());
-  document->AddMember("num_sessions", static_cast<uint64_t>(session_state_map_.size()),
+  document->AddMember("num_sessions", static_cast<uint64_t>(all_sessions.size()),
       document->GetAllocator());
 }
 
@@ -474,6 +518,7 @@ void PlanToJsonHelper(const map<TPlanNodeId, TPlanNodeExecSummary>& summaries,
     int64_t cardinality = 0;
     int64_t max_time = 0L;
     int64_t total_time = 0;
+    TExecStats total_stats;
     BOOST_FOREACH(const TExecStats& stat, summary->second.exec_stats) {
       if (summary->second.is_broadcast) {
         // Avoid multiple-counting for recipients of broadcasts.
@@ -483,6 +528,12 @@ void PlanToJsonHelper(const map<TPlanNodeId, TPlanNodeExecSummary>& summaries,
       }
       total_time += stat.latency_ns;
       max_time = ::max(max_time, stat.latency_ns);
+      total_stats.user_cpu_time_ns += stat.user_cpu_time_ns;
+      total_stats.sys_cpu_time_ns += stat.sys_cpu_time_ns;
+      total_stats.io_wait_ns += stat.io_wait_ns;
+      total_stats.exchange_wait_ns += stat.exchange_wait_ns;
+      total_stats.runtime_filter_wait_ns += stat.runtime_filter_wait_ns;
+      total_stats.spill_wait_ns += stat.spill_wait_ns;
     }
     value->AddMember("output_card", cardinality, document->GetAllocator());
     value->AddMember("num_instances",
@@ -505,6 +556,31 @@ void PlanToJsonHelper(const map<TPlanNodeId, TPlanNodeExecSummary>& summaries,
         TUnit::TIME_NS);
     Value avg_time_str_json(avg_time_str.c_str(), document->GetAllocator());
     value->AddMember("avg_time", avg_time_str_json, document->GetAllocator());
+
+    // The average CPU time split into user and system time, and the average wait time
+    // by reason, leaving out the reasons the node did not wait for.
+    int num_instances = ::max(static_cast<int>(summary->second.exec_stats.size()), 1);
+    const string& avg_cpu_time_str = Substitute("user: $0, sys: $1",
+        PrettyPrinter::Print(total_stats.user_cpu_time_ns / num_instances,
+            TUnit::TIME_NS),
+        PrettyPrinter::Print(total_stats.sys_cpu_time_ns / num_instances,
+            TUnit::TIME_NS));
+    Value avg_cpu_time_str_json(avg_cpu_time_str.c_str(), document->GetAllocator());
+    value->AddMember("avg_cpu_time", avg_cpu_time_str_json, document->GetAllocator());
+    vector<string> wait_times;
+    const pair<const char*, int64_t> waits[] = {
+        make_pair("io", total_stats.io_wait_ns),
+        make_pair("exchange", total_stats.exchange_wait_ns),
+        make_pair("runtime filters", total_stats.runtime_filter_wait_ns),
+        make_pair("spilling", total_stats.spill_wait_ns)};
+    for (int i = 0; i < sizeof(waits) / sizeof(waits[0]); ++i) {
+      if (waits[i].second == 0) continue;
+      wait_times.push_back(Substitute("$0: $1", waits[i].first,
+          PrettyPrinter::Print(waits[i].second / num_instances, TUnit::TIME_NS)));
+    }
+    const string& avg_wait_time_str = join(wait_times, ", ");
+    Value avg_wait_time_str_json(avg_wait_time_str.c_str(), document->GetAllocator());
+    value->AddMember("avg_wait_time", avg_wait_time_str_json, document->GetAllocator());
   }
 
   int num_children = (*it)->num_children;
@@ -527,6 +603,8 @@ void PlanToJsonHelper(const map<TPlanNodeId, TPlanNodeExecSummary>& summaries,
 //       "num_instances": 34,
 //       "max_time": "1m23s",
 //       "avg_time": "1.3ms",
+//       "avg_cpu_time": "user: 1.1ms, sys: 20us",
+//       "avg_wait_time": "exchange: 150us",
 //       "children": [
 //           {
 //             "label": "11:EXCHANGE",
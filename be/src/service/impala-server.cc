@@ -54,7 +54,10 @@
 #include "runtime/tmp-file-mgr.h"
 #include "service/fragment-exec-state.h"
 #include "service/impala-internal-service.h"
+#include "service/exec-request-cache.h"
+#include "service/plan-history.h"
 #include "service/query-exec-state.h"
+#include "service/query-result-cache.h"
 #include "scheduling/simple-scheduler.h"
 #include "util/bit-util.h"
 #include "util/cgroups-mgr.h"
@@ -85,6 +88,7 @@ using boost::algorithm::is_any_of;
 using boost::algorithm::istarts_with;
 using boost::algorithm::replace_all_copy;
 using boost::algorithm::split;
+using boost::algorithm::to_lower_copy;
 using boost::algorithm::token_compress_on;
 using boost::get_system_time;
 using boost::system_time;
@@ -110,6 +114,12 @@ DEFINE_int32(fe_service_threads, 64,
     "number of threads available to serve client requests");
 DEFINE_int32(be_service_threads, 64,
     "(Advanced) number of threads available to serve backend execution requests");
+DEFINE_bool(use_event_loop_rpc_servers, false, "(Advanced) If true, the backend and "
+    "HiveServer2 services watch their connections with an epoll event loop, so that "
+    "idle connections don't hold a service thread, and --be_service_threads and "
+    "--fe_service_threads bound the number of requests that are processed concurrently "
+    "rather than the number of connections. Services that use SSL or Kerberos/LDAP keep "
+    "a thread per connection.");
 DEFINE_string(default_query_options, "", "key=value pair of default query options for"
     " impalad, separated by ','");
 DEFINE_int32(query_log_size, 25, "Number of queries to retain in the query log. If -1, "
@@ -120,6 +130,19 @@ DEFINE_int64(max_result_cache_size, 100000L, "Maximum number of query results a
     "may request to be cached on a per-query basis to support restarting fetches. This "
     "option guards against unreasonably large result caches requested by clients. "
     "Requests exceeding this maximum will be rejected.");
+DEFINE_int32(result_prefetch_batches, 0, "(Advanced) Number of result batches of a "
+    "query that are fetched from the coordinator fragment and converted for the client "
+    "protocol ahead of the client's fetch requests, so that the query keeps executing "
+    "during client round trips. Set to 0 to only execute while the client fetches.");
+DEFINE_int64(query_result_cache_capacity, 0, "(Advanced) Maximum size in bytes of the "
+    "results of queries that are kept in memory to answer later identical queries "
+    "without executing them. Results are only reused while none of the queried tables "
+    "changed. Queries that call user-defined functions with nondeterministic results "
+    "must not be run while this is enabled. Set to 0 to disable the cache.");
+DEFINE_int32(exec_request_cache_capacity, 0, "(Advanced) Maximum number of query plans "
+    "that are kept in memory to skip planning of later identical queries. Plans are "
+    "only reused while none of the queried tables changed. Set to 0 to disable the "
+    "cache.");
 
 DEFINE_int32(max_audit_event_log_file_size, 5000, "The maximum size (in queries) of the "
     "audit event log file before a new one is created (if event logging is enabled)");
@@ -143,6 +166,10 @@ DEFINE_int32(max_profile_log_file_size, 5000, "The maximum size (in queries) of
 
 DEFINE_int32(cancellation_thread_pool_size, 5,
     "(Advanced) Size of the thread-pool processing cancellations due to node failure");
+DEFINE_bool(prewarm_udf_libs, false, "(Advanced) If true, the native and IR libraries "
+    "of the UDFs in the catalog are copied from HDFS into the local library cache in the "
+    "background as soon as they are received from the catalog, instead of by the first "
+    "query that calls them.");
 
 DEFINE_string(ssl_server_certificate, "", "The full path to the SSL certificate file used"
     " to authenticate Impala to clients. If set, both Beeswax and HiveServer2 ports will "
@@ -175,6 +202,7 @@ DEFINE_string(local_nodemanager_url, "", "The URL of the local Yarn Node Manager
     "interface, used to detect if the Node Manager fails");
 DECLARE_bool(enable_rm);
 DECLARE_bool(compact_catalog_topic);
+DECLARE_int32(plan_history_max_fingerprints);
 
 namespace impala {
 
@@ -192,6 +220,9 @@ const string LINEAGE_LOG_FILE_PREFIX = "impala_lineage_log_1.0-";
 
 const uint32_t MAX_CANCELLATION_QUEUE_SIZE = 65536;
 
+// Libraries beyond this many pending ones are loaded by the first query that needs them.
+const uint32_t MAX_UDF_LIB_PREWARM_QUEUE_SIZE = 1024;
+
 const string BEESWAX_SERVER_NAME = "beeswax-frontend";
 const string HS2_SERVER_NAME = "hiveserver2-frontend";
 
@@ -238,7 +269,14 @@ class CancellationWork {
 };
 
 ImpalaServer::ImpalaServer(ExecEnv* exec_env)
-    : exec_env_(exec_env) {
+    : exec_env_(exec_env),
+      table_versions_generation_(0) {
+  if (FLAGS_query_result_cache_capacity > 0) {
+    query_result_cache_.reset(new QueryResultCache(FLAGS_query_result_cache_capacity));
+  }
+  if (FLAGS_exec_request_cache_capacity > 0) {
+    exec_request_cache_.reset(new ExecRequestCache(FLAGS_exec_request_cache_capacity));
+  }
   // Initialize default config
   InitializeConfigVariables();
 
@@ -266,6 +304,14 @@ ImpalaServer::ImpalaServer(ExecEnv* exec_env)
     FLAGS_log_query_to_file = false;
   }
 
+  if (FLAGS_plan_history_max_fingerprints > 0) {
+    plan_history_.reset(new PlanHistory());
+    status = plan_history_->Init();
+    if (!status.ok()) {
+      LOG(ERROR) << "Plan history is not persisted: " << status.GetDetail();
+    }
+  }
+
   if (!InitAuditEventLogging().ok()) {
     LOG(ERROR) << "Aborting Impala Server startup due to failure initializing "
                << "audit event logging";
@@ -323,6 +369,13 @@ ImpalaServer::ImpalaServer(ExecEnv* exec_env)
 
   EXIT_IF_ERROR(ExternalDataSourceExecutor::InitJNI(exec_env->metrics()));
 
+  // Created before the catalog topic is subscribed to, CatalogUpdateCallback() uses it.
+  if (FLAGS_prewarm_udf_libs) {
+    udf_lib_prewarm_pool_.reset(new ThreadPool<TFunction>("impala-server",
+        "udf-lib-prewarm", 1, MAX_UDF_LIB_PREWARM_QUEUE_SIZE,
+        bind<void>(&ImpalaServer::PrewarmUdfLib, this, _1, _2)));
+  }
+
   // Register the membership callback if required
   if (exec_env->subscriber() != NULL) {
     StatestoreSubscriber::UpdateCallback cb =
@@ -566,34 +619,78 @@ Status ImpalaServer::GetRuntimeProfileStr(const TUniqueId& query_id,
     bool base64_encoded, stringstream* output) {
   DCHECK(output != NULL);
   // Search for the query id in the active query map
-  {
-    lock_guard<mutex> l(query_exec_state_map_lock_);
-    QueryExecStateMap::const_iterator exec_state = query_exec_state_map_.find(query_id);
-    if (exec_state != query_exec_state_map_.end()) {
-      if (base64_encoded) {
-        exec_state->second->profile().SerializeToArchiveString(output);
-      } else {
-        exec_state->second->profile().PrettyPrint(output);
-      }
-      return Status::OK();
+  shared_ptr<QueryExecState> exec_state = GetQueryExecState(query_id, false);
+  if (exec_state != NULL) {
+    if (base64_encoded) {
+      exec_state->profile().SerializeToArchiveString(output);
+    } else {
+      exec_state->profile().PrettyPrint(output);
     }
+    return Status::OK();
   }
 
   // The query was not found the active query map, search the query log.
-  {
-    lock_guard<mutex> l(query_log_lock_);
-    QueryLogIndex::const_iterator query_record = query_log_index_.find(query_id);
-    if (query_record == query_log_index_.end()) {
-      stringstream ss;
-      ss << "Query id " << PrintId(query_id) << " not found.";
-      return Status(ss.str());
+  string encoded_profile;
+  RETURN_IF_ERROR(GetArchivedProfile(query_id, &encoded_profile));
+  if (base64_encoded) {
+    (*output) << encoded_profile;
+    return Status::OK();
+  }
+  TRuntimeProfileTree tree;
+  RETURN_IF_ERROR(RuntimeProfile::DeserializeFromArchiveString(encoded_profile, &tree));
+  ObjectPool pool;
+  RuntimeProfile* profile = RuntimeProfile::CreateFromThrift(&pool, tree);
+  if (profile != NULL) profile->PrettyPrint(output);
+  return Status::OK();
+}
+
+Status ImpalaServer::GetArchivedProfile(const TUniqueId& query_id,
+    string* encoded_profile) {
+  lock_guard<mutex> l(query_log_lock_);
+  QueryLogIndex::const_iterator query_record = query_log_index_.find(query_id);
+  if (query_record == query_log_index_.end()) {
+    stringstream ss;
+    ss << "Query id " << PrintId(query_id) << " not found.";
+    return Status(ss.str());
+  }
+  *encoded_profile = query_record->second->encoded_profile_str;
+  return Status::OK();
+}
+
+void ImpalaServer::CollectTimeSeries(const TRuntimeProfileTree& tree,
+    vector<ProfileTimeSeries>* time_series) {
+  // The nodes are in pre-order. 'path' holds the names of the ancestors of the current
+  // node and 'children_left' how many children each of them has still to be visited.
+  vector<string> path;
+  vector<int> children_left;
+  BOOST_FOREACH(const TRuntimeProfileNode& node, tree.nodes) {
+    path.push_back(node.name);
+    BOOST_FOREACH(const TTimeSeriesCounter& counter, node.time_series_counters) {
+      time_series->push_back(ProfileTimeSeries());
+      time_series->back().profile_path = path;
+      time_series->back().counter = counter;
     }
-    if (base64_encoded) {
-      (*output) << query_record->second->encoded_profile_str;
-    } else {
-      (*output) << query_record->second->profile_str;
+    children_left.push_back(node.num_children);
+    while (!children_left.empty() && children_left.back() == 0) {
+      children_left.pop_back();
+      path.pop_back();
+      if (!children_left.empty()) --children_left.back();
     }
   }
+}
+
+Status ImpalaServer::GetRuntimeProfileTimeSeries(const TUniqueId& query_id,
+    vector<ProfileTimeSeries>* time_series) {
+  TRuntimeProfileTree tree;
+  shared_ptr<QueryExecState> exec_state = GetQueryExecState(query_id, false);
+  if (exec_state != NULL) {
+    exec_state->profile().ToThrift(&tree);
+  } else {
+    string encoded_profile;
+    RETURN_IF_ERROR(GetArchivedProfile(query_id, &encoded_profile));
+    RETURN_IF_ERROR(RuntimeProfile::DeserializeFromArchiveString(encoded_profile, &tree));
+  }
+  CollectTimeSeries(tree, time_series);
   return Status::OK();
 }
 
@@ -689,6 +786,29 @@ void ImpalaServer::ArchiveQuery(const QueryExecState& query) {
     }
   }
 
+  // Only successful queries are representative of the performance of their plan.
+  if (plan_history_ != NULL && query.coord() != NULL &&
+      !query.plan_fingerprint().empty() && query.query_status().ok()) {
+    PlanHistory::QueryRecord plan_record;
+    plan_record.fingerprint = query.plan_fingerprint();
+    plan_record.version = GetVersionString(/* compact */ true);
+    plan_record.stmt = query.sql_stmt();
+    plan_record.end_time_ms = UnixMillis();
+    double start_time, end_time;
+    if (query.start_time().ToSubsecondUnixTime(&start_time) &&
+        query.end_time().ToSubsecondUnixTime(&end_time)) {
+      plan_record.latency_ms = (end_time - start_time) * 1000;
+    }
+    // -1 if no backend reported its peak memory usage.
+    plan_record.peak_mem_usage = max(query.coord()->GetMaxPerNodePeakMemUsage(), 0L);
+    plan_record.spilled_bytes = query.coord()->GetTotalSpilledBytes();
+    {
+      lock_guard<SpinLock> lock(query.coord()->GetExecSummaryLock());
+      PlanHistory::GetNodeRows(query.coord()->exec_summary(), &plan_record.node_rows);
+    }
+    plan_history_->AddQuery(plan_record);
+  }
+
   if (FLAGS_query_log_size == 0) return;
   QueryStateRecord record(query, true, encoded_profile_str);
   if (query.coord() != NULL) {
@@ -791,14 +911,11 @@ Status ImpalaServer::ExecuteInternal(
     // Keep a lock on exec_state so that registration and setting
     // result_metadata are atomic.
     //
-    // Note: this acquires the exec_state lock *before* the
-    // query_exec_state_map_ lock. This is the opposite of
-    // GetQueryExecState(..., true), and therefore looks like a
-    // candidate for deadlock. The reason this works here is that
-    // GetQueryExecState cannot find exec_state (under the exec state
-    // map lock) and take it's lock until RegisterQuery has
-    // finished. By that point, the exec state map lock will have been
-    // given up, so the classic deadlock interleaving is not possible.
+    // Note: this acquires the exec_state lock *before* the lock of its
+    // query_exec_state_map_ shard. This cannot deadlock because no
+    // thread waits for an exec state lock while holding a shard lock:
+    // GetQueryExecState(..., true) releases the shard lock before it
+    // locks the exec state.
     lock_guard<mutex> l(*(*exec_state)->lock());
 
     // register exec state as early as possible so that queries that
@@ -807,14 +924,34 @@ Status ImpalaServer::ExecuteInternal(
     RETURN_IF_ERROR(RegisterQuery(session_state, *exec_state));
     *registered_exec_state = true;
 
-    RETURN_IF_ERROR((*exec_state)->UpdateQueryStatus(
-        exec_env_->frontend()->GetExecRequest(query_ctx, &result)));
-    (*exec_state)->query_events()->MarkEvent("Planning finished");
+    int64_t table_versions_generation;
+    {
+      lock_guard<mutex> l(catalog_version_lock_);
+      table_versions_generation = table_versions_generation_;
+    }
+    string exec_request_cache_key;
+    if (exec_request_cache_ != NULL &&
+        GetExecRequestCacheKey(query_ctx, &exec_request_cache_key) &&
+        LookupExecRequestCache(exec_request_cache_key, query_ctx, &result)) {
+      (*exec_state)->query_events()->MarkEvent("Reused cached plan");
+    } else {
+      RETURN_IF_ERROR((*exec_state)->UpdateQueryStatus(
+          exec_env_->frontend()->GetExecRequest(query_ctx, &result)));
+      (*exec_state)->query_events()->MarkEvent("Planning finished");
+      if (!exec_request_cache_key.empty()) {
+        InsertExecRequestCache(exec_request_cache_key, result, table_versions_generation);
+      }
+    }
     (*exec_state)->summary_profile()->AddEventSequence(
         result.timeline.name, result.timeline);
     if (result.__isset.result_set_metadata) {
       (*exec_state)->set_result_metadata(result.result_set_metadata);
     }
+    string result_cache_key;
+    if (query_result_cache_ != NULL && GetQueryResultCacheKey(query_ctx,
+        *session_state, result, table_versions_generation, &result_cache_key)) {
+      (*exec_state)->set_result_cache_key(result_cache_key);
+    }
   }
   VLOG(2) << "Execution request: " << ThriftDebugString(result);
 
@@ -840,6 +977,168 @@ Status ImpalaServer::ExecuteInternal(
   return Status::OK();
 }
 
+bool ImpalaServer::GetQueryResultCacheKey(const TQueryCtx& query_ctx,
+    const SessionState& session, const TExecRequest& exec_request,
+    int64_t table_versions_generation, string* key) {
+  if (exec_request.stmt_type != TStmtType::QUERY) return false;
+  set<string> tables;
+  if (!GetReferencedTables(exec_request, &tables)) return false;
+  // Queries without tables are cheap to execute.
+  if (tables.empty()) return false;
+  string stmt = QueryResultCache::NormalizeStatement(query_ctx.request.stmt);
+  if (QueryResultCache::CallsNondeterministicFunction(stmt)) return false;
+
+  stringstream ss;
+  ss << stmt << "\n" << query_ctx.session.database << "\n"
+     << session.session_type << ":" << session.hs2_version << "\n"
+     << ThriftDebugString(exec_request.query_options);
+  {
+    lock_guard<mutex> l(catalog_version_lock_);
+    if (table_versions_generation_ != table_versions_generation) return false;
+    ss << "\n" << PrintId(catalog_update_info_.catalog_service_id);
+    BOOST_FOREACH(const string& table, tables) {
+      TableVersionMap::const_iterator it = table_versions_.find(table);
+      if (it == table_versions_.end()) return false;
+      ss << "\n" << table << "@" << it->second;
+    }
+  }
+  *key = ss.str();
+  return true;
+}
+
+bool ImpalaServer::GetReferencedTables(const TExecRequest& exec_request,
+    set<string>* tables) {
+  // The tables that are scanned, which include the base tables of views, and the
+  // referenced views.
+  const TQueryExecRequest& query_exec_request = exec_request.query_exec_request;
+  if (query_exec_request.__isset.desc_tbl) {
+    BOOST_FOREACH(const TTableDescriptor& table,
+        query_exec_request.desc_tbl.tableDescriptors) {
+      if (table.tableType != TTableType::HDFS_TABLE) return false;
+      tables->insert(to_lower_copy(table.dbName + "." + table.tableName));
+    }
+  }
+  BOOST_FOREACH(const TAccessEvent& event, exec_request.access_events) {
+    if (event.object_type == TCatalogObjectType::TABLE ||
+        event.object_type == TCatalogObjectType::VIEW) {
+      tables->insert(to_lower_copy(event.name));
+    }
+  }
+  return true;
+}
+
+bool ImpalaServer::GetExecRequestCacheKey(const TQueryCtx& query_ctx, string* key) {
+  string stmt = QueryResultCache::NormalizeStatement(query_ctx.request.stmt);
+  if (QueryResultCache::CallsNondeterministicFunction(stmt)) return false;
+  // Authorization and the resolution of unqualified names depend on the session.
+  stringstream ss;
+  ss << stmt << "\n" << query_ctx.session.database << "\n"
+     << query_ctx.session.connected_user << ":" << query_ctx.session.delegated_user
+     << "\n" << ThriftDebugString(query_ctx.request.query_options);
+  *key = ss.str();
+  return true;
+}
+
+bool ImpalaServer::LookupExecRequestCache(const string& key, const TQueryCtx& query_ctx,
+    TExecRequest* exec_request) {
+  shared_ptr<const ExecRequestCache::Entry> entry = exec_request_cache_->Lookup(key);
+  if (entry == NULL) return false;
+  {
+    lock_guard<mutex> l(catalog_version_lock_);
+    if (entry->catalog_service_id != catalog_update_info_.catalog_service_id) {
+      return false;
+    }
+    typedef pair<string, int64_t> TableVersion;
+    BOOST_FOREACH(const TableVersion& table_version, entry->table_versions) {
+      TableVersionMap::const_iterator it = table_versions_.find(table_version.first);
+      if (it == table_versions_.end() || it->second != table_version.second) {
+        return false;
+      }
+    }
+  }
+  *exec_request = entry->exec_request;
+  // Keep what the planner added to the query context of the cached plan.
+  const TQueryCtx& planned_ctx = entry->exec_request.query_exec_request.query_ctx;
+  TQueryCtx* ctx = &exec_request->query_exec_request.query_ctx;
+  *ctx = query_ctx;
+  if (planned_ctx.__isset.tables_missing_stats) {
+    ctx->__set_tables_missing_stats(planned_ctx.tables_missing_stats);
+  }
+  if (planned_ctx.__isset.tables_with_corrupt_stats) {
+    ctx->__set_tables_with_corrupt_stats(planned_ctx.tables_with_corrupt_stats);
+  }
+  if (planned_ctx.__isset.disable_spilling) {
+    ctx->__set_disable_spilling(planned_ctx.disable_spilling);
+  }
+  // The planning timeline is that of the query that created the plan.
+  exec_request->timeline.timestamps.clear();
+  exec_request->timeline.labels.clear();
+  return true;
+}
+
+void ImpalaServer::InsertExecRequestCache(const string& key,
+    const TExecRequest& exec_request, int64_t table_versions_generation) {
+  if (exec_request.stmt_type != TStmtType::QUERY) return;
+  // The lineage graph records the start time and id of the query.
+  if (exec_request.query_exec_request.__isset.lineage_graph) return;
+  set<string> tables;
+  if (!GetReferencedTables(exec_request, &tables)) return;
+  shared_ptr<ExecRequestCache::Entry> entry(new ExecRequestCache::Entry());
+  {
+    lock_guard<mutex> l(catalog_version_lock_);
+    if (table_versions_generation_ != table_versions_generation) return;
+    entry->catalog_service_id = catalog_update_info_.catalog_service_id;
+    BOOST_FOREACH(const string& table, tables) {
+      TableVersionMap::const_iterator it = table_versions_.find(table);
+      if (it == table_versions_.end()) return;
+      entry->table_versions.push_back(*it);
+    }
+  }
+  entry->exec_request = exec_request;
+  exec_request_cache_->Insert(key, entry);
+}
+
+// Returns true if 'object' is a table or view, whose changes are tracked by
+// table_versions_, or another object that no plan depends on.
+static bool IsTableOrCatalogObject(const TCatalogObject& object) {
+  return object.type == TCatalogObjectType::TABLE ||
+      object.type == TCatalogObjectType::VIEW ||
+      object.type == TCatalogObjectType::CATALOG ||
+      object.type == TCatalogObjectType::HDFS_CACHE_POOL;
+}
+
+void ImpalaServer::UpdateTableVersions(const TUpdateCatalogCacheRequest& update_req) {
+  if (query_result_cache_ == NULL && exec_request_cache_ == NULL) return;
+  if (!update_req.is_delta) table_versions_.clear();
+  if (exec_request_cache_ != NULL) {
+    // Plans are only validated against the versions of the tables they reference.
+    bool clear_plans = !update_req.is_delta;
+    BOOST_FOREACH(const TCatalogObject& object, update_req.removed_objects) {
+      if (!IsTableOrCatalogObject(object)) clear_plans = true;
+    }
+    BOOST_FOREACH(const TCatalogObject& object, update_req.updated_objects) {
+      if (!IsTableOrCatalogObject(object)) clear_plans = true;
+    }
+    if (clear_plans) exec_request_cache_->Clear();
+  }
+  BOOST_FOREACH(const TCatalogObject& object, update_req.removed_objects) {
+    if (object.type != TCatalogObjectType::TABLE &&
+        object.type != TCatalogObjectType::VIEW) {
+      continue;
+    }
+    table_versions_.erase(object.table.db_name + "." + object.table.tbl_name);
+  }
+  BOOST_FOREACH(const TCatalogObject& object, update_req.updated_objects) {
+    if (object.type != TCatalogObjectType::TABLE &&
+        object.type != TCatalogObjectType::VIEW) {
+      continue;
+    }
+    table_versions_[object.table.db_name + "." + object.table.tbl_name] =
+        object.catalog_version;
+  }
+  ++table_versions_generation_;
+}
+
 void ImpalaServer::PrepareQueryContext(TQueryCtx* query_ctx) {
   query_ctx->__set_pid(getpid());
   query_ctx->__set_now_string(TimestampValue::LocalTime().DebugString());
@@ -864,16 +1163,17 @@ Status ImpalaServer::RegisterQuery(shared_ptr<SessionState> session_state,
   if (session_state->closed) return Status("Session has been closed, ignoring query.");
   const TUniqueId& query_id = exec_state->query_id();
   {
-    lock_guard<mutex> l(query_exec_state_map_lock_);
-    QueryExecStateMap::iterator entry = query_exec_state_map_.find(query_id);
-    if (entry != query_exec_state_map_.end()) {
+    QueryExecStateMapShard* shard = GetQueryExecStateMapShard(query_id);
+    lock_guard<shared_mutex> l(shard->lock);
+    QueryExecStateMap::iterator entry = shard->map.find(query_id);
+    if (entry != shard->map.end()) {
       // There shouldn't be an active query with that same id.
       // (query_id is globally unique)
       stringstream ss;
       ss << "query id " << PrintId(query_id) << " already exists";
       return Status(ErrorMsg(TErrorCode::INTERNAL_ERROR, ss.str()));
     }
-    query_exec_state_map_.insert(make_pair(query_id, exec_state));
+    shard->map.insert(make_pair(query_id, exec_state));
   }
   return Status::OK();
 }
@@ -918,14 +1218,15 @@ Status ImpalaServer::UnregisterQuery(const TUniqueId& query_id, bool check_infli
 
   shared_ptr<QueryExecState> exec_state;
   {
-    lock_guard<mutex> l(query_exec_state_map_lock_);
-    QueryExecStateMap::iterator entry = query_exec_state_map_.find(query_id);
-    if (entry == query_exec_state_map_.end()) {
+    QueryExecStateMapShard* shard = GetQueryExecStateMapShard(query_id);
+    lock_guard<shared_mutex> l(shard->lock);
+    QueryExecStateMap::iterator entry = shard->map.find(query_id);
+    if (entry == shard->map.end()) {
       return Status("Invalid or unknown query handle");
     } else {
       exec_state = entry->second;
     }
-    query_exec_state_map_.erase(entry);
+    shard->map.erase(entry);
   }
 
   exec_state->Done();
@@ -1019,9 +1320,10 @@ Status ImpalaServer::CloseSessionInternal(const TUniqueId& session_id,
   // Find the session_state and remove it from the map.
   shared_ptr<SessionState> session_state;
   {
-    lock_guard<mutex> l(session_state_map_lock_);
-    SessionStateMap::iterator entry = session_state_map_.find(session_id);
-    if (entry == session_state_map_.end()) {
+    SessionStateMapShard* shard = GetSessionStateMapShard(session_id);
+    lock_guard<shared_mutex> l(shard->lock);
+    SessionStateMap::iterator entry = shard->map.find(session_id);
+    if (entry == shard->map.end()) {
       if (ignore_if_absent) {
         return Status::OK();
       } else {
@@ -1029,7 +1331,7 @@ Status ImpalaServer::CloseSessionInternal(const TUniqueId& session_id,
       }
     }
     session_state = entry->second;
-    session_state_map_.erase(session_id);
+    shard->map.erase(entry);
   }
   DCHECK(session_state != NULL);
   if (session_state->session_type == TSessionType::BEESWAX) {
@@ -1065,9 +1367,12 @@ Status ImpalaServer::CloseSessionInternal(const TUniqueId& session_id,
 
 Status ImpalaServer::GetSessionState(const TUniqueId& session_id,
     shared_ptr<SessionState>* session_state, bool mark_active) {
-  lock_guard<mutex> l(session_state_map_lock_);
-  SessionStateMap::iterator i = session_state_map_.find(session_id);
-  if (i == session_state_map_.end()) {
+  // Marking the session active only takes the session's lock, so the shard's lock is
+  // shared.
+  SessionStateMapShard* shard = GetSessionStateMapShard(session_id);
+  shared_lock<shared_mutex> l(shard->lock);
+  SessionStateMap::iterator i = shard->map.find(session_id);
+  if (i == shard->map.end()) {
     *session_state = boost::shared_ptr<SessionState>();
     return Status("Invalid session id");
   } else {
@@ -1130,6 +1435,11 @@ void ImpalaServer::TransmitData(
     Status status = exec_env_->stream_mgr()->AddData(
         params.dest_fragment_instance_id, params.dest_node_id, params.row_batch,
         params.sender_id);
+    // The receivers this one relays to may still need the batch.
+    if (status.code() == TErrorCode::DATASTREAM_RECVR_CLOSED &&
+        params.__isset.relay_destinations) {
+      status = Status::OK();
+    }
     status.SetTStatus(&return_val);
     if (!status.ok()) {
       // should we close the channel here as well?
@@ -1138,9 +1448,72 @@ void ImpalaServer::TransmitData(
   }
 
   if (params.eos) {
-    exec_env_->stream_mgr()->CloseSender(
-        params.dest_fragment_instance_id, params.dest_node_id,
-        params.sender_id).SetTStatus(&return_val);
+    Status status = exec_env_->stream_mgr()->CloseSender(
+        params.dest_fragment_instance_id, params.dest_node_id, params.sender_id);
+    status.SetTStatus(&return_val);
+    if (!status.ok()) return;
+  }
+  RelayTransmitData(params).SetTStatus(&return_val);
+}
+
+Status ImpalaServer::RelayTransmitData(const TTransmitDataParams& params) {
+  if (!params.__isset.relay_destinations) return Status::OK();
+  int num_destinations = params.relay_destinations.size();
+  int first_child = (params.relay_idx + 1) * params.relay_fanout;
+  if (first_child >= num_destinations) return Status::OK();
+  // The children are relayed to one at a time, each returning once its subtree has
+  // the batch, so the receivers throttle the sender as for direct broadcasts.
+  TTransmitDataParams child_params = params;
+  for (int i = first_child;
+      i < min(first_child + params.relay_fanout, num_destinations); ++i) {
+    const TPlanFragmentDestination& dest = params.relay_destinations[i];
+    child_params.__set_dest_fragment_instance_id(dest.fragment_instance_id);
+    child_params.__set_relay_idx(i);
+    Status status;
+    ImpalaInternalServiceConnection client(exec_env_->impalad_client_cache(),
+        dest.server, &status);
+    RETURN_IF_ERROR(status);
+    TTransmitDataResult res;
+    RETURN_IF_ERROR(
+        client.DoRpc(&ImpalaInternalServiceClient::TransmitData, child_params, &res));
+    // The other receivers of the broadcast still need the batches, so a closed one is
+    // not reported to the sender.
+    Status child_status(res.status);
+    if (child_status.code() == TErrorCode::DATASTREAM_RECVR_CLOSED) continue;
+    RETURN_IF_ERROR(child_status);
+  }
+  return Status::OK();
+}
+
+void ImpalaServer::TransmitDataBatch(TTransmitDataBatchResult& return_val,
+    const TTransmitDataBatchParams& params) {
+  VLOG_ROW << "TransmitDataBatch(): #streams=" << params.streams.size();
+  return_val.statuses.resize(params.streams.size());
+  return_val.accepted.resize(params.streams.size(), true);
+  return_val.__isset.statuses = true;
+  return_val.__isset.accepted = true;
+  for (int i = 0; i < params.streams.size(); ++i) {
+    const TTransmitDataParams& stream = params.streams[i];
+    Status status;
+    if (stream.row_batch.num_rows > 0) {
+      bool accepted;
+      status = exec_env_->stream_mgr()->TryAddData(stream.dest_fragment_instance_id,
+          stream.dest_node_id, stream.row_batch, stream.sender_id, &accepted);
+      return_val.accepted[i] = accepted;
+      // The sender resends a rejected batch together with its eos.
+      if (!accepted) continue;
+      // See TransmitData().
+      if (status.code() == TErrorCode::DATASTREAM_RECVR_CLOSED &&
+          stream.__isset.relay_destinations) {
+        status = Status::OK();
+      }
+    }
+    if (status.ok() && stream.eos) {
+      status = exec_env_->stream_mgr()->CloseSender(stream.dest_fragment_instance_id,
+          stream.dest_node_id, stream.sender_id);
+    }
+    if (status.ok()) status = RelayTransmitData(stream);
+    status.SetTStatus(&return_val.statuses[i]);
   }
 }
 
@@ -1184,6 +1557,26 @@ void ImpalaServer::SessionState::ToThrift(const TUniqueId& session_id,
   state->network_address = network_address;
 }
 
+void ImpalaServer::PrewarmUdfLib(uint32_t thread_id, const TFunction& fn) {
+  LibCache::LibType type;
+  if (fn.binary_type == TFunctionBinaryType::NATIVE) {
+    type = LibCache::TYPE_SO;
+  } else if (fn.binary_type == TFunctionBinaryType::IR) {
+    type = LibCache::TYPE_IR;
+  } else {
+    // Builtins have no library and Java UDFs are loaded by the frontend.
+    return;
+  }
+  if (!fn.__isset.hdfs_location || fn.hdfs_location.empty()) return;
+  string local_path;
+  Status status = LibCache::instance()->GetLocalLibPath(fn.hdfs_location, type,
+      &local_path);
+  if (!status.ok()) {
+    LOG(WARNING) << "Could not prewarm library " << fn.hdfs_location << ": "
+                 << status.GetDetail();
+  }
+}
+
 void ImpalaServer::CancelFromThreadPool(uint32_t thread_id,
     const CancellationWork& cancellation_work) {
   if (cancellation_work.unregister()) {
@@ -1246,15 +1639,38 @@ void ImpalaServer::CatalogUpdateCallback(
   if (topic == incoming_topic_deltas.end()) return;
   const TTopicDelta& delta = topic->second;
 
+  if (!delta.is_delta) catalog_partition_entries_.clear();
 
   // Process any updates
   if (delta.topic_entries.size() != 0 || delta.topic_deletions.size() != 0)  {
+    // The partitions of large HDFS tables are separate topic entries, see
+    // CatalogServer::BuildPartitionTopicUpdates(). Apply them first, so that the tables
+    // in this update can be reassembled from them.
+    string table_key;
+    int64_t partition_id;
+    BOOST_FOREACH(const TTopicItem& item, delta.topic_entries) {
+      if (!ParsePartitionEntryKey(item.key, &table_key, &partition_id)) continue;
+      catalog_partition_entries_[table_key][partition_id] = item.value;
+    }
+    BOOST_FOREACH(const string& key, delta.topic_deletions) {
+      if (!ParsePartitionEntryKey(key, &table_key, &partition_id)) continue;
+      CatalogPartitionEntries::iterator it = catalog_partition_entries_.find(table_key);
+      if (it == catalog_partition_entries_.end()) continue;
+      it->second.erase(partition_id);
+      if (it->second.empty()) catalog_partition_entries_.erase(it);
+    }
+
     TUpdateCatalogCacheRequest update_req;
     update_req.__set_is_delta(delta.is_delta);
+    // The added and changed functions, their libraries are loaded by
+    // udf_lib_prewarm_pool_.
+    vector<TFunction> prewarm_fns;
+    Status assemble_status;
     // Process all Catalog updates (new and modified objects) and determine what the
     // new catalog version will be.
     int64_t new_catalog_version = catalog_update_info_.catalog_version;
     BOOST_FOREACH(const TTopicItem& item, delta.topic_entries) {
+      if (ParsePartitionEntryKey(item.key, &table_key, &partition_id)) continue;
       uint32_t len = item.value.size();
       TCatalogObject catalog_object;
       Status status = DeserializeThriftMsg(reinterpret_cast<const uint8_t*>(
@@ -1267,11 +1683,21 @@ void ImpalaServer::CatalogUpdateCallback(
         update_req.__set_catalog_service_id(catalog_object.catalog.catalog_service_id);
         new_catalog_version = catalog_object.catalog_version;
       }
+      if (catalog_object.type == TCatalogObjectType::TABLE &&
+          catalog_object.table.__isset.hdfs_table &&
+          catalog_object.table.hdfs_table.__isset.partition_ids) {
+        Status status = AssemblePartitions(item.key, &catalog_object.table.hdfs_table);
+        if (!status.ok()) {
+          assemble_status = status;
+          continue;
+        }
+      }
 
       // Refresh the lib cache entries of any added functions and data sources
       if (catalog_object.type == TCatalogObjectType::FUNCTION) {
         DCHECK(catalog_object.__isset.fn);
         LibCache::instance()->SetNeedsRefresh(catalog_object.fn.hdfs_location);
+        if (udf_lib_prewarm_pool_ != NULL) prewarm_fns.push_back(catalog_object.fn);
       }
       if (catalog_object.type == TCatalogObjectType::DATA_SOURCE) {
         DCHECK(catalog_object.__isset.data_source);
@@ -1290,7 +1716,9 @@ void ImpalaServer::CatalogUpdateCallback(
     // Process all Catalog deletions (dropped objects). We only know the keys (object
     // names) so must parse each key to determine the TCatalogObject.
     BOOST_FOREACH(const string& key, delta.topic_deletions) {
+      if (ParsePartitionEntryKey(key, &table_key, &partition_id)) continue;
       LOG(INFO) << "Catalog topic entry deletion: " << key;
+      catalog_partition_entries_.erase(key);
       TCatalogObject catalog_object;
       Status status = TCatalogObjectFromEntryKey(key, &catalog_object);
       if (!status.ok()) {
@@ -1318,9 +1746,12 @@ void ImpalaServer::CatalogUpdateCallback(
       }
     }
 
-    // Call the FE to apply the changes to the Impalad Catalog.
+    // Call the FE to apply the changes to the Impalad Catalog. An update that is missing
+    // partitions cannot be applied consistently, so a full topic update is requested as
+    // for any other error.
     TUpdateCatalogCacheResponse resp;
-    Status s = exec_env_->frontend()->UpdateCatalogCache(update_req, &resp);
+    Status s = assemble_status;
+    if (s.ok()) s = exec_env_->frontend()->UpdateCatalogCache(update_req, &resp);
     if (!s.ok()) {
       LOG(ERROR) << "There was an error processing the impalad catalog update. Requesting"
                  << " a full topic update to recover: " << s.GetDetail();
@@ -1338,6 +1769,7 @@ void ImpalaServer::CatalogUpdateCallback(
         catalog_update_info_.catalog_version = new_catalog_version;
         catalog_update_info_.catalog_topic_version = delta.to_version;
         catalog_update_info_.catalog_service_id = resp.catalog_service_id;
+        UpdateTableVersions(update_req);
       }
       ImpaladMetrics::CATALOG_READY->set_value(new_catalog_version > 0);
       UpdateCatalogMetrics();
@@ -1352,6 +1784,10 @@ void ImpalaServer::CatalogUpdateCallback(
           DCHECK(false);
         }
       }
+      BOOST_FOREACH(const TFunction& fn, prewarm_fns) {
+        // If the queue is full, the first query that calls 'fn' loads its library.
+        udf_lib_prewarm_pool_->Offer(fn);
+      }
     }
   }
 
@@ -1363,6 +1799,27 @@ void ImpalaServer::CatalogUpdateCallback(
   catalog_version_update_cv_.notify_all();
 }
 
+Status ImpalaServer::AssemblePartitions(const string& table_key,
+    THdfsTable* hdfs_table) {
+  CatalogPartitionEntries::const_iterator table_it =
+      catalog_partition_entries_.find(table_key);
+  BOOST_FOREACH(int64_t partition_id, hdfs_table->partition_ids) {
+    map<int64_t, string>::const_iterator it;
+    if (table_it == catalog_partition_entries_.end() ||
+        (it = table_it->second.find(partition_id)) == table_it->second.end()) {
+      return Status(Substitute("Catalog topic entry of partition $0 of $1 is missing",
+          partition_id, table_key));
+    }
+    // Partition entries are always serialized with the compact protocol.
+    uint32_t len = it->second.size();
+    RETURN_IF_ERROR(DeserializeThriftMsg(reinterpret_cast<const uint8_t*>(
+        it->second.data()), &len, true, &hdfs_table->partitions[partition_id]));
+  }
+  hdfs_table->partition_ids.clear();
+  hdfs_table->__isset.partition_ids = false;
+  return Status::OK();
+}
+
 Status ImpalaServer::ProcessCatalogUpdateResult(
     const TCatalogUpdateResult& catalog_update_result, bool wait_for_all_subscribers) {
   // If this this update result contains a catalog object to add or remove, directly apply
@@ -1385,6 +1842,10 @@ Status ImpalaServer::ProcessCatalogUpdateResult(
     Status status = exec_env_->frontend()->UpdateCatalogCache(update_req, &resp);
     if (!status.ok()) LOG(ERROR) << status.GetDetail();
     RETURN_IF_ERROR(status);
+    {
+      unique_lock<mutex> unique_lock(catalog_version_lock_);
+      UpdateTableVersions(update_req);
+    }
     if (!wait_for_all_subscribers) return Status::OK();
   }
 
@@ -1557,9 +2018,6 @@ ImpalaServer::QueryStateRecord::QueryStateRecord(const QueryExecState& exec_stat
   exec_state.query_events()->ToThrift(&event_sequence);
 
   if (copy_profile) {
-    stringstream ss;
-    exec_state.profile().PrettyPrint(&ss);
-    profile_str = ss.str();
     if (encoded_profile.empty()) {
       encoded_profile_str = exec_state.profile().SerializeToArchiveString();
     } else {
@@ -1600,9 +2058,9 @@ void ImpalaServer::ConnectionStart(
     RegisterSessionTimeout(session_state->session_timeout);
 
     {
-      lock_guard<mutex> l(session_state_map_lock_);
-      bool success =
-          session_state_map_.insert(make_pair(session_id, session_state)).second;
+      SessionStateMapShard* shard = GetSessionStateMapShard(session_id);
+      lock_guard<shared_mutex> l(shard->lock);
+      bool success = shard->map.insert(make_pair(session_id, session_state)).second;
       // The session should not have already existed.
       DCHECK(success);
     }
@@ -1658,37 +2116,41 @@ void ImpalaServer::ExpireSessions() {
       }
     }
 
-    lock_guard<mutex> map_lock(session_state_map_lock_);
     int64_t now = UnixMillis();
     VLOG(3) << "Session expiration thread waking up";
-    // TODO: If holding session_state_map_lock_ for the duration of this loop is too
-    // expensive, consider a priority queue.
-    BOOST_FOREACH(SessionStateMap::value_type& session_state, session_state_map_) {
-      unordered_set<TUniqueId> inflight_queries;
-      {
-        lock_guard<mutex> state_lock(session_state.second->lock);
-        if (session_state.second->ref_count > 0) continue;
-        // A session closed by other means is in the process of being removed, and it's
-        // best not to interfere.
-        if (session_state.second->closed || session_state.second->expired) continue;
-        if (session_state.second->session_timeout == 0) continue;
-
-        int64_t last_accessed_ms = session_state.second->last_accessed_ms;
-        int64_t session_timeout_ms = session_state.second->session_timeout * 1000;
-        if (now - last_accessed_ms <= session_timeout_ms) continue;
-        LOG(INFO) << "Expiring session: " << session_state.first << ", user:"
-                  << session_state.second->connected_user << ", last active: "
-                  << TimestampValue(last_accessed_ms / 1000).DebugString();
-        session_state.second->expired = true;
-        ImpaladMetrics::NUM_SESSIONS_EXPIRED->Increment(1L);
-        // Since expired is true, no more queries will be added to the inflight list.
-        inflight_queries.insert(session_state.second->inflight_queries.begin(),
-            session_state.second->inflight_queries.end());
-      }
-      // Unregister all open queries from this session.
-      Status status("Session expired due to inactivity");
-      BOOST_FOREACH(const TUniqueId& query_id, inflight_queries) {
-        cancellation_thread_pool_->Offer(CancellationWork(query_id, status, true));
+    // Sessions are only marked as expired here, so the locks of the shards are shared.
+    // TODO: If holding them for the duration of this loop is too expensive, consider a
+    // priority queue.
+    for (int i = 0; i < NUM_STATE_MAP_SHARDS; ++i) {
+      SessionStateMapShard* shard = &session_state_map_[i];
+      shared_lock<shared_mutex> map_lock(shard->lock);
+      BOOST_FOREACH(SessionStateMap::value_type& session_state, shard->map) {
+        unordered_set<TUniqueId> inflight_queries;
+        {
+          lock_guard<mutex> state_lock(session_state.second->lock);
+          if (session_state.second->ref_count > 0) continue;
+          // A session closed by other means is in the process of being removed, and it's
+          // best not to interfere.
+          if (session_state.second->closed || session_state.second->expired) continue;
+          if (session_state.second->session_timeout == 0) continue;
+
+          int64_t last_accessed_ms = session_state.second->last_accessed_ms;
+          int64_t session_timeout_ms = session_state.second->session_timeout * 1000;
+          if (now - last_accessed_ms <= session_timeout_ms) continue;
+          LOG(INFO) << "Expiring session: " << session_state.first << ", user:"
+                    << session_state.second->connected_user << ", last active: "
+                    << TimestampValue(last_accessed_ms / 1000).DebugString();
+          session_state.second->expired = true;
+          ImpaladMetrics::NUM_SESSIONS_EXPIRED->Increment(1L);
+          // Since expired is true, no more queries will be added to the inflight list.
+          inflight_queries.insert(session_state.second->inflight_queries.begin(),
+              session_state.second->inflight_queries.end());
+        }
+        // Unregister all open queries from this session.
+        Status status("Session expired due to inactivity");
+        BOOST_FOREACH(const TUniqueId& query_id, inflight_queries) {
+          cancellation_thread_pool_->Offer(CancellationWork(query_id, status, true));
+        }
       }
     }
   }
@@ -1811,7 +2273,8 @@ Status CreateImpalaServer(ExecEnv* exec_env, int beeswax_port, int hs2_port, int
   }
 
   if (hs2_port != 0 && hs2_server != NULL) {
-    // HiveServer2 JDBC driver does not support non-blocking server.
+    // HiveServer2 JDBC driver does not support non-blocking server, which requires
+    // framed transports. The event loop server keeps the transport unchanged.
     shared_ptr<TProcessor> hs2_fe_processor(
         new ImpalaHiveServer2ServiceProcessor(handler));
     shared_ptr<TProcessorEventHandler> event_handler(
@@ -1820,7 +2283,8 @@ Status CreateImpalaServer(ExecEnv* exec_env, int beeswax_port, int hs2_port, int
 
     *hs2_server = new ThriftServer(HS2_SERVER_NAME, hs2_fe_processor, hs2_port,
         AuthManager::GetInstance()->GetExternalAuthProvider(), exec_env->metrics(),
-        FLAGS_fe_service_threads, ThriftServer::ThreadPool);
+        FLAGS_fe_service_threads, FLAGS_use_event_loop_rpc_servers ?
+            ThriftServer::EventLoop : ThriftServer::ThreadPool);
 
     (*hs2_server)->SetConnectionHandler(handler.get());
     if (!FLAGS_ssl_server_certificate.empty()) {
@@ -1834,6 +2298,7 @@ Status CreateImpalaServer(ExecEnv* exec_env, int beeswax_port, int hs2_port, int
 
   if (be_port != 0 && be_server != NULL) {
     shared_ptr<FragmentMgr> fragment_mgr(new FragmentMgr());
+    exec_env->SetFragmentMgr(fragment_mgr.get());
     shared_ptr<ImpalaInternalService> thrift_if(
         new ImpalaInternalService(handler, fragment_mgr));
     shared_ptr<TProcessor> be_processor(new ImpalaInternalServiceProcessor(thrift_if));
@@ -1842,7 +2307,8 @@ Status CreateImpalaServer(ExecEnv* exec_env, int beeswax_port, int hs2_port, int
     be_processor->setEventHandler(event_handler);
 
     *be_server = new ThriftServer("backend", be_processor, be_port, NULL,
-        exec_env->metrics(), FLAGS_be_service_threads);
+        exec_env->metrics(), FLAGS_be_service_threads, FLAGS_use_event_loop_rpc_servers ?
+            ThriftServer::EventLoop : ThriftServer::Threaded);
     if (EnableInternalSslConnections()) {
       LOG(INFO) << "Enabling SSL for backend";
       RETURN_IF_ERROR((*be_server)->EnableSsl(FLAGS_ssl_server_certificate,
@@ -1859,26 +2325,24 @@ Status CreateImpalaServer(ExecEnv* exec_env, int beeswax_port, int hs2_port, int
 bool ImpalaServer::GetSessionIdForQuery(const TUniqueId& query_id,
     TUniqueId* session_id) {
   DCHECK(session_id != NULL);
-  lock_guard<mutex> l(query_exec_state_map_lock_);
-  QueryExecStateMap::iterator i = query_exec_state_map_.find(query_id);
-  if (i == query_exec_state_map_.end()) {
-    return false;
-  } else {
-    *session_id = i->second->session_id();
-    return true;
-  }
+  shared_ptr<QueryExecState> exec_state = GetQueryExecState(query_id, false);
+  if (exec_state == NULL) return false;
+  *session_id = exec_state->session_id();
+  return true;
 }
 
 shared_ptr<ImpalaServer::QueryExecState> ImpalaServer::GetQueryExecState(
     const TUniqueId& query_id, bool lock) {
-  lock_guard<mutex> l(query_exec_state_map_lock_);
-  QueryExecStateMap::iterator i = query_exec_state_map_.find(query_id);
-  if (i == query_exec_state_map_.end()) {
-    return shared_ptr<QueryExecState>();
-  } else {
-    if (lock) i->second->lock()->lock();
-    return i->second;
-  }
+  shared_ptr<QueryExecState> exec_state;
+  {
+    QueryExecStateMapShard* shard = GetQueryExecStateMapShard(query_id);
+    shared_lock<shared_mutex> l(shard->lock);
+    QueryExecStateMap::iterator i = shard->map.find(query_id);
+    if (i == shard->map.end()) return shared_ptr<QueryExecState>();
+    exec_state = i->second;
+  }
+  if (lock) exec_state->lock()->lock();
+  return exec_state;
 }
 
 void ImpalaServer::SetOffline(bool is_offline) {
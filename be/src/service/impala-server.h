@@ -16,6 +16,7 @@
 #define IMPALA_SERVICE_IMPALA_SERVER_H
 
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/unordered_map.hpp>
@@ -48,7 +49,10 @@ namespace impala {
 
 class ExecEnv;
 class DataSink;
+class PlanHistory;
 class CancellationWork;
+class ExprContext;
+class RowBatch;
 class Coordinator;
 class RowDescriptor;
 class TCatalogUpdate;
@@ -59,6 +63,8 @@ class TReportExecStatusArgs;
 class TReportExecStatusResult;
 class TTransmitDataArgs;
 class TTransmitDataResult;
+class TTransmitDataBatchParams;
+class TTransmitDataBatchResult;
 class TNetworkAddress;
 class TClientRequest;
 class TExecRequest;
@@ -207,6 +213,8 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
       const TReportExecStatusParams& params);
   void TransmitData(TTransmitDataResult& return_val,
       const TTransmitDataParams& params);
+  void TransmitDataBatch(TTransmitDataBatchResult& return_val,
+      const TTransmitDataBatchParams& params);
   void UpdateFilter(TUpdateFilterResult& return_val,
       const TUpdateFilterParams& params);
 
@@ -269,6 +277,12 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
     /// operation, the row in the form of TResultRow.
     virtual Status AddOneRow(const TResultRow& row) = 0;
 
+    /// Evaluates 'expr_ctxs' over the rows [start_idx, start_idx + num_rows) of 'batch'
+    /// and adds the results to this result set. The default implementation adds them one
+    /// row at a time with AddOneRow(); subclasses may convert them column by column.
+    virtual Status AddRowBatch(const std::vector<ExprContext*>& expr_ctxs,
+        RowBatch* batch, int start_idx, int num_rows);
+
     /// Copies rows in the range [start_idx, start_idx + num_rows) from the other result
     /// set into this result set. Returns the number of rows added to this result set.
     /// Returns 0 if the given range is out of bounds of the other result set.
@@ -294,6 +308,12 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   /// Execution state of a query.
   class QueryExecState;
 
+  /// Cache of the results of repeated queries, see query-result-cache.h.
+  class QueryResultCache;
+
+  /// Cache of the plans of repeated queries, see exec-request-cache.h.
+  class ExecRequestCache;
+
   /// Relevant ODBC SQL State code; for more info,
   /// goto http://msdn.microsoft.com/en-us/library/ms714687.aspx
   static const char* SQLSTATE_SYNTAX_ERROR_OR_ACCESS_VIOLATION;
@@ -308,9 +328,52 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
       const TResultSetMetadata& metadata,
       apache::hive::service::cli::thrift::TRowSet* rowset = NULL);
 
+  QueryResultSet* CreateBeeswaxResultSet(const TResultSetMetadata& metadata);
+
+  /// Returns true and sets 'key' to the key of the results of 'exec_request' in
+  /// query_result_cache_ if they can be cached. 'table_versions_generation' is the
+  /// value of table_versions_generation_ before 'exec_request' was planned; if the
+  /// catalog changed since, the key might not match the planned state and false is
+  /// returned. Results are not cached for statements other than queries, for queries of
+  /// tables other than HDFS tables and for queries that call nondeterministic functions.
+  bool GetQueryResultCacheKey(const TQueryCtx& query_ctx,
+      const SessionState& session, const TExecRequest& exec_request,
+      int64_t table_versions_generation, std::string* key);
+
+  /// Adds the tables and views referenced by 'exec_request' to 'tables' as
+  /// "<db>.<table>". Returns false if it references a table other than an HDFS table,
+  /// since the data and metadata of their scans can change without a change of the
+  /// table's catalog version.
+  static bool GetReferencedTables(const TExecRequest& exec_request,
+      std::set<std::string>* tables);
+
+  /// Returns true and sets 'key' to the key of the plan of 'query_ctx' in
+  /// exec_request_cache_ if it can be cached. Plans of statements that call
+  /// nondeterministic functions are not cached, the planner folds them into constants.
+  bool GetExecRequestCacheKey(const TQueryCtx& query_ctx, std::string* key);
+
+  /// Returns true and sets 'exec_request' to a copy of the cached plan for 'key' with
+  /// 'query_ctx' as its query context, if there is one that was created for the
+  /// current catalog versions of all the tables it references.
+  bool LookupExecRequestCache(const std::string& key, const TQueryCtx& query_ctx,
+      TExecRequest* exec_request);
+
+  /// Inserts the plan 'exec_request' for 'key' into exec_request_cache_, unless it is
+  /// not a query plan or the catalog changed since it was planned, i.e.
+  /// table_versions_generation_ is no longer 'table_versions_generation'.
+  void InsertExecRequestCache(const std::string& key, const TExecRequest& exec_request,
+      int64_t table_versions_generation);
+
+  /// Applies the table and view changes in 'update_req', which was successfully applied
+  /// to the frontend's catalog, to table_versions_. Clears exec_request_cache_ if other
+  /// objects that plans depend on, e.g. functions or privileges, changed.
+  /// catalog_version_lock_ must be taken.
+  void UpdateTableVersions(const TUpdateCatalogCacheRequest& update_req);
+
   /// Return exec state for given query_id, or NULL if not found.
-  /// If 'lock' is true, the returned exec state's lock() will be acquired before
-  /// the query_exec_state_map_lock_ is released.
+  /// If 'lock' is true, the returned exec state's lock() will be acquired. It is taken
+  /// after the lock of the query's shard of query_exec_state_map_ is released, so that
+  /// waiting for a busy query does not block requests for other queries.
   boost::shared_ptr<QueryExecState> GetQueryExecState(
       const TUniqueId& query_id, bool lock);
 
@@ -321,6 +384,10 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   /// Updates the number of databases / tables metrics from the FE catalog
   Status UpdateCatalogMetrics();
 
+  /// Sends 'params' on to the children of its destination in the relay tree of a
+  /// broadcast, if it has any, and returns the first error.
+  Status RelayTransmitData(const TTransmitDataParams& params);
+
   /// Starts asynchronous execution of query. Creates QueryExecState (returned
   /// in exec_state), registers it and calls Coordinator::Execute().
   /// If it returns with an error status, exec_state will be NULL and nothing
@@ -390,6 +457,27 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   Status GetRuntimeProfileStr(const TUniqueId& query_id, bool base64_encoded,
       std::stringstream* output);
 
+  /// A time series counter of a query profile, with the names of the profiles from the
+  /// root of the query profile down to the one the counter belongs to.
+  struct ProfileTimeSeries {
+    std::vector<std::string> profile_path;
+    TTimeSeriesCounter counter;
+  };
+
+  /// Appends the time series counters of the profile serialized to 'profile' and its
+  /// children to 'time_series'.
+  static void CollectTimeSeries(const TRuntimeProfileTree& profile,
+      std::vector<ProfileTimeSeries>* time_series);
+
+  /// Gets the time series counters of the profile of 'query_id', searching the in-flight
+  /// queries and then the query log like GetRuntimeProfileStr().
+  Status GetRuntimeProfileTimeSeries(const TUniqueId& query_id,
+      std::vector<ProfileTimeSeries>* time_series);
+
+  /// Copies the encoded profile of 'query_id' in the query log to 'encoded_profile'.
+  /// Returns an error if the query is not in the log.
+  Status GetArchivedProfile(const TUniqueId& query_id, std::string* encoded_profile);
+
   /// Returns the exec summary for this query.
   Status GetExecSummary(const TUniqueId& query_id, TExecSummary* result);
 
@@ -428,7 +516,8 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
       rapidjson::Document* document);
 
   /// Json callback for /query_profile. Expects query_id as an argument, produces Json with
-  /// 'profile' set to the profile string, and 'query_id' set to the query ID.
+  /// 'profile' set to the profile string, 'time_series' to the list of the time series
+  /// counters of the profile, and 'query_id' set to the query ID.
   void QueryProfileUrlCallback(const Webserver::ArgumentMap& args,
       rapidjson::Document* document);
 
@@ -540,7 +629,6 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
 
   /// Copies a query's state into the query log. Called immediately prior to a
   /// QueryExecState's deletion. Also writes the query profile to the profile log on disk.
-  /// Must be called with query_exec_state_map_lock_ held
   void ArchiveQuery(const QueryExecState& query);
 
   /// Checks whether the given user is allowed to delegate as the specified do_as_user.
@@ -550,10 +638,9 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
 
   /// Snapshot of a query's state, archived in the query log.
   struct QueryStateRecord {
-    /// Pretty-printed runtime profile. TODO: Copy actual profile object
-    std::string profile_str;
-
-    /// Base64 encoded runtime profile
+    /// Base64 encoded runtime profile (see RuntimeProfile::SerializeToArchiveString()).
+    /// The pretty-printed profile and its time series counters are only decoded from it
+    /// when they are requested, most archived profiles are never looked at.
     std::string encoded_profile_str;
 
     /// Query id
@@ -606,10 +693,9 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
     /// webpages.
     vector<TPlanFragment> fragments;
 
-    /// Initialise from an exec_state. If copy_profile is true, print the query
-    /// profile to a string and copy that into this.profile (which is expensive),
-    /// otherwise leave this.profile empty.
-    /// If encoded_str is non-empty, it is the base64 encoded string for
+    /// Initialise from an exec_state. If copy_profile is true, encode the query
+    /// profile into this.encoded_profile_str (which is expensive), otherwise leave it
+    /// empty. If encoded_str is non-empty, it is the base64 encoded string for
     /// exec_state->profile.
     QueryStateRecord(const QueryExecState& exec_state, bool copy_profile = false,
         const std::string& encoded_str = "");
@@ -684,6 +770,10 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   void CancelFromThreadPool(uint32_t thread_id,
       const CancellationWork& cancellation_work);
 
+  /// Copies the library of the UDF 'fn' from HDFS into the local LibCache, so that the
+  /// first query that calls it does not have to. Called from udf_lib_prewarm_pool_.
+  void PrewarmUdfLib(uint32_t thread_id, const TFunction& fn);
+
   /// Helper method to add any pool query options to the query_ctx. Must be called before
   /// ExecuteInternal() at which point the TQueryCtx is const and cannot be mutated.
   /// override_options_mask indicates which query options can be overridden by the pool
@@ -771,6 +861,10 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   /// avoid blocking the statestore callback.
   boost::scoped_ptr<ThreadPool<CancellationWork> > cancellation_thread_pool_;
 
+  /// Thread pool that loads the libraries of the UDFs received with catalog updates. NULL
+  /// if --prewarm_udf_libs is false.
+  boost::scoped_ptr<ThreadPool<TFunction> > udf_lib_prewarm_pool_;
+
   /// Thread that runs ExpireSessions. It will wake up periodically to check for sessions
   /// which are idle for more their timeout values.
   boost::scoped_ptr<Thread> session_timeout_thread_;
@@ -785,12 +879,31 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   /// on every poll period expiration or when the poll period changes.
   boost::condition_variable session_timeout_cv_;
 
+  /// Number of shards of query_exec_state_map_ and session_state_map_. Each shard has its
+  /// own lock, so that the many requests of clients polling different queries and
+  /// sessions rarely contend.
+  static const int NUM_STATE_MAP_SHARDS = 16;
+
   /// map from query id to exec state; QueryExecState is owned by us and referenced
   /// as a shared_ptr to allow asynchronous deletion
   typedef boost::unordered_map<TUniqueId, boost::shared_ptr<QueryExecState> >
       QueryExecStateMap;
-  QueryExecStateMap query_exec_state_map_;
-  boost::mutex query_exec_state_map_lock_;  // protects query_exec_state_map_
+
+  /// The queries whose ids hash to one shard of query_exec_state_map_.
+  struct QueryExecStateMapShard {
+    /// Protects 'map'. Only taken exclusively to register and unregister queries; lookups
+    /// share it.
+    boost::shared_mutex lock;
+    QueryExecStateMap map;
+  };
+
+  /// All registered queries, sharded by the hash of their query id.
+  QueryExecStateMapShard query_exec_state_map_[NUM_STATE_MAP_SHARDS];
+
+  /// Returns the shard of query_exec_state_map_ for 'query_id'.
+  QueryExecStateMapShard* GetQueryExecStateMapShard(const TUniqueId& query_id) {
+    return &query_exec_state_map_[hash_value(query_id) % NUM_STATE_MAP_SHARDS];
+  }
 
   /// Default query options in the form of TQueryOptions and beeswax::ConfigVariable
   TQueryOptions default_query_options_;
@@ -824,7 +937,8 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
     TNetworkAddress network_address;
 
     /// Protects all fields below.
-    /// If this lock has to be taken with query_exec_state_map_lock, take this lock first.
+    /// If this lock has to be taken with a lock of query_exec_state_map_, take this lock
+    /// first.
     boost::mutex lock;
 
     /// If true, the session has been closed.
@@ -913,17 +1027,29 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   /// For access to GetSessionState() / MarkSessionInactive()
   friend class ScopedSessionState;
 
-  /// Protects session_state_map_. Should be taken before any query exec-state locks,
-  /// including query_exec_state_map_lock_. Should be taken before individual session-state
-  /// locks.
-  boost::mutex session_state_map_lock_;
-
   /// A map from session identifier to a structure containing per-session information
   typedef boost::unordered_map<TUniqueId, boost::shared_ptr<SessionState> >
     SessionStateMap;
-  SessionStateMap session_state_map_;
 
-  /// Protects connection_to_sessions_map_. May be taken before session_state_map_lock_.
+  /// The sessions whose ids hash to one shard of session_state_map_.
+  struct SessionStateMapShard {
+    /// Protects 'map'. Only taken exclusively to add and remove sessions; lookups share
+    /// it. Should be taken before any query exec-state locks, including the locks of
+    /// query_exec_state_map_. Should be taken before individual session-state locks.
+    boost::shared_mutex lock;
+    SessionStateMap map;
+  };
+
+  /// All open sessions, sharded by the hash of their session id.
+  SessionStateMapShard session_state_map_[NUM_STATE_MAP_SHARDS];
+
+  /// Returns the shard of session_state_map_ for 'session_id'.
+  SessionStateMapShard* GetSessionStateMapShard(const TUniqueId& session_id) {
+    return &session_state_map_[hash_value(session_id) % NUM_STATE_MAP_SHARDS];
+  }
+
+  /// Protects connection_to_sessions_map_. May be taken before the locks of
+  /// session_state_map_.
   boost::mutex connection_to_sessions_map_lock_;
 
   /// Map from a connection ID to the associated list of sessions so that all can be closed
@@ -951,7 +1077,7 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   }
 
   /// protects query_locations_. Must always be taken after
-  /// query_exec_state_map_lock_ if both are required.
+  /// the locks of query_exec_state_map_ if both are required.
   boost::mutex query_locations_lock_;
 
   /// A map from backend to the list of queries currently running there.
@@ -1002,6 +1128,40 @@ class ImpalaServer : public ImpalaServiceIf, public ImpalaHiveServer2ServiceIf,
   /// The version information from the last successfull call to UpdateCatalog().
   CatalogUpdateVersionInfo catalog_update_info_;
 
+  /// The serialized partitions of the HDFS tables whose partitions are published as
+  /// separate catalog topic entries (see THdfsTable.partition_ids), keyed by the topic
+  /// entry key of the table and the partition id. Kept across catalog updates, because
+  /// only the changed partitions of a table are sent with it. Only accessed by
+  /// CatalogUpdateCallback().
+  typedef boost::unordered_map<std::string, std::map<int64_t, std::string> >
+      CatalogPartitionEntries;
+  CatalogPartitionEntries catalog_partition_entries_;
+
+  /// Fills in the partitions of 'hdfs_table', the table with topic entry key 'table_key',
+  /// from catalog_partition_entries_. Returns an error if any of its partition_ids is
+  /// missing.
+  Status AssemblePartitions(const std::string& table_key, THdfsTable* hdfs_table);
+
+  /// The catalog version of each table and view in the frontend's catalog, keyed by
+  /// "<db>.<table>". Only maintained if query_result_cache_ or exec_request_cache_ is
+  /// set. Protected by catalog_version_lock_.
+  typedef boost::unordered_map<std::string, int64_t> TableVersionMap;
+  TableVersionMap table_versions_;
+
+  /// Incremented with every change to table_versions_. Protected by
+  /// catalog_version_lock_.
+  int64_t table_versions_generation_;
+
+  /// Results of earlier queries. NULL if --query_result_cache_capacity is 0.
+  boost::scoped_ptr<QueryResultCache> query_result_cache_;
+
+  /// Plans of earlier queries. NULL if --exec_request_cache_capacity is 0.
+  boost::scoped_ptr<ExecRequestCache> exec_request_cache_;
+
+  /// Statistics of the completed queries per plan fingerprint. NULL if
+  /// --plan_history_max_fingerprints is 0.
+  boost::scoped_ptr<PlanHistory> plan_history_;
+
   /// The current minimum topic version processed across all subscribers of the catalog
   /// topic. Used to determine when other nodes have successfully processed a catalog
   /// update. Updated with each catalog topic heartbeat from the statestore.
@@ -54,7 +54,11 @@ DECLARE_string(principal);
 int ImpaladMain(int argc, char** argv) {
   InitCommonRuntime(argc, argv, true);
 
-  LlvmCodeGen::InitializeLlvm();
+  // Initializing LLVM does not depend on the JVM and the services that are started
+  // below, so it runs in parallel with them. It only has to finish before fragments can
+  // be executed.
+  Thread llvm_init_thread("impalad-main", "llvm-init", &LlvmCodeGen::InitializeLlvm,
+      false);
   JniUtil::InitLibhdfs();
   EXIT_IF_ERROR(HBaseTableScanner::Init());
   EXIT_IF_ERROR(HBaseTable::InitJNI());
@@ -73,6 +77,7 @@ int ImpaladMain(int argc, char** argv) {
   EXIT_IF_ERROR(CreateImpalaServer(&exec_env, FLAGS_beeswax_port, FLAGS_hs2_port,
       FLAGS_be_port, &beeswax_server, &hs2_server, &be_server, &server));
 
+  llvm_init_thread.Join();
   EXIT_IF_ERROR(be_server->Start());
 
   Status status = exec_env.StartServices();
@@ -0,0 +1,97 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "service/plan-history.h"
+
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "common/names.h"
+
+namespace impala {
+
+static TPlanNode MakeNode(int id, const string& label, const string& detail,
+    int num_children) {
+  TPlanNode node;
+  node.node_id = id;
+  node.num_children = num_children;
+  node.__set_label(label);
+  node.__set_label_detail(detail);
+  return node;
+}
+
+// Returns a plan with a scan of 'table' below an aggregation.
+static vector<TPlanFragment> MakePlan(const string& table, int first_node_id) {
+  vector<TPlanFragment> fragments(1);
+  fragments[0].__isset.plan = true;
+  fragments[0].plan.nodes.push_back(
+      MakeNode(first_node_id, "AGGREGATE", "FINALIZE", 1));
+  fragments[0].plan.nodes.push_back(MakeNode(first_node_id + 1, "SCAN HDFS", table, 0));
+  return fragments;
+}
+
+TEST(PlanHistoryTest, Fingerprint) {
+  string fingerprint = PlanHistory::ComputeFingerprint(MakePlan("db.t", 0));
+  EXPECT_EQ(fingerprint.size(), 16);
+  // Node ids and estimates do not matter.
+  vector<TPlanFragment> plan = MakePlan("db.t", 5);
+  plan[0].plan.nodes[1].__set_limit(10);
+  EXPECT_EQ(PlanHistory::ComputeFingerprint(plan), fingerprint);
+  // Tables, operators and the shape of the plan do.
+  EXPECT_NE(PlanHistory::ComputeFingerprint(MakePlan("db.u", 0)), fingerprint);
+  plan = MakePlan("db.t", 0);
+  plan[0].plan.nodes[0].label = "SORT";
+  EXPECT_NE(PlanHistory::ComputeFingerprint(plan), fingerprint);
+  plan = MakePlan("db.t", 0);
+  plan.insert(plan.begin(), TPlanFragment());
+  EXPECT_NE(PlanHistory::ComputeFingerprint(plan), fingerprint);
+}
+
+TEST(PlanHistoryTest, SerializeRecord) {
+  PlanHistory::QueryRecord record;
+  record.fingerprint = "0123456789abcdef";
+  record.stmt = "select count(*)\nfrom t where s = 'a b:c'";
+  record.end_time_ms = 1456789012345;
+  record.latency_ms = 1234;
+  record.peak_mem_usage = 1L << 32;
+  record.spilled_bytes = 0;
+  record.node_rows.push_back(make_pair("AGGREGATE [FINALIZE]", 1));
+  record.node_rows.push_back(make_pair("SCAN HDFS [db.t]", 123456));
+
+  string line = PlanHistory::SerializeRecord(record);
+  EXPECT_EQ(line.find('\n'), string::npos);
+  PlanHistory::QueryRecord parsed;
+  ASSERT_TRUE(PlanHistory::ParseRecord(line, &parsed));
+  EXPECT_EQ(parsed.fingerprint, record.fingerprint);
+  EXPECT_EQ(parsed.version, "");
+  EXPECT_EQ(parsed.stmt, record.stmt);
+  EXPECT_EQ(parsed.end_time_ms, record.end_time_ms);
+  EXPECT_EQ(parsed.latency_ms, record.latency_ms);
+  EXPECT_EQ(parsed.peak_mem_usage, record.peak_mem_usage);
+  EXPECT_EQ(parsed.spilled_bytes, record.spilled_bytes);
+  EXPECT_EQ(parsed.node_rows, record.node_rows);
+
+  EXPECT_FALSE(PlanHistory::ParseRecord("", &parsed));
+  EXPECT_FALSE(PlanHistory::ParseRecord(line.substr(0, line.find(' ', 30)), &parsed));
+  EXPECT_FALSE(PlanHistory::ParseRecord(line + " xyz", &parsed));
+  EXPECT_FALSE(PlanHistory::ParseRecord("x" + line, &parsed));
+}
+
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,439 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "service/plan-history.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <gflags/gflags.h>
+#include <gutil/strings/substitute.h>
+
+#include "runtime/timestamp-value.h"
+#include "util/filesystem-util.h"
+#include "util/hash-util.h"
+#include "util/pretty-printer.h"
+#include "util/string-parser.h"
+#include "util/thread.h"
+#include "util/time.h"
+#include "util/url-coding.h"
+
+#include "common/names.h"
+
+using boost::algorithm::is_any_of;
+using boost::algorithm::split;
+using boost::algorithm::starts_with;
+using boost::algorithm::token_compress_on;
+using boost::filesystem::directory_iterator;
+using namespace impala;
+using namespace rapidjson;
+using namespace strings;
+
+DEFINE_int32(plan_history_max_fingerprints, 1000, "(Advanced) Maximum number of plan "
+    "fingerprints whose query statistics are kept on the /plan_history page. If 0, no "
+    "plan history is kept.");
+DEFINE_string(plan_history_dir, "", "The directory in which the plan history files are "
+    "written. If blank, defaults to <log_file_dir>/plan_history");
+DEFINE_int32(max_plan_history_file_size, 5000, "The maximum size (in queries) of a plan "
+    "history file before a new one is created");
+DEFINE_int32(max_plan_history_files, 10, "The maximum number of plan history files "
+    "that are kept, the oldest are removed. If 0, the plan history is not persisted and "
+    "starts empty on every restart.");
+
+DECLARE_string(log_dir);
+
+// Prefix of the names of the history files. The version number changes with the format
+// of the records.
+static const string PLAN_HISTORY_FILE_PREFIX = "impala_plan_history_1.0-";
+
+// Maximum number of characters of the statement kept per record.
+static const int MAX_STMT_LENGTH = 500;
+
+// Number of fields of a record before the plan nodes.
+static const int NUM_RECORD_FIELDS = 7;
+
+PlanHistory::PlanStats::PlanStats()
+  : num_queries(0), first_seen_ms(0), last_seen_ms(0), total_latency_ms(0),
+    min_latency_ms(0), max_latency_ms(0), total_peak_mem_usage(0),
+    max_peak_mem_usage(0), total_spilled_bytes(0), num_spilled(0) {
+}
+
+PlanHistory::PlanHistory() {
+}
+
+PlanHistory::~PlanHistory() {
+}
+
+Status PlanHistory::Init() {
+  if (FLAGS_max_plan_history_files <= 0) return Status::OK();
+  dir_ = FLAGS_plan_history_dir.empty() ? FLAGS_log_dir + "/plan_history" :
+      FLAGS_plan_history_dir;
+  logger_.reset(new SimpleLogger(dir_, PLAN_HISTORY_FILE_PREFIX,
+      FLAGS_max_plan_history_file_size));
+  Status status = logger_->Init();
+  if (status.ok()) status = RemoveOldFiles();
+  if (status.ok()) status = LoadFiles();
+  if (!status.ok()) {
+    logger_.reset();
+    dir_.clear();
+    return status;
+  }
+  flush_thread_.reset(new Thread("impala-server", "plan-history-flush-thread",
+      &PlanHistory::FlushLoop, this));
+  return Status::OK();
+}
+
+// Adds 'str' and a separator to 'hash'.
+static uint64_t HashString(const string& str, uint64_t hash) {
+  hash = HashUtil::FnvHash64(str.data(), str.size(), hash);
+  return HashUtil::FnvHash64("", 1, hash);
+}
+
+string PlanHistory::ComputeFingerprint(const vector<TPlanFragment>& fragments) {
+  uint64_t hash = HashUtil::FNV64_SEED;
+  for (int i = 0; i < fragments.size(); ++i) {
+    if (!fragments[i].__isset.plan) continue;
+    hash = HashUtil::FnvHash64(&i, sizeof(i), hash);
+    BOOST_FOREACH(const TPlanNode& node, fragments[i].plan.nodes) {
+      hash = HashString(node.label, hash);
+      hash = HashString(node.label_detail, hash);
+      hash = HashUtil::FnvHash64(&node.num_children, sizeof(node.num_children), hash);
+    }
+  }
+  stringstream ss;
+  ss << hex << setw(16) << setfill('0') << hash;
+  return ss.str();
+}
+
+void PlanHistory::GetNodeRows(const TExecSummary& summary,
+    vector<PlanNodeRows>* node_rows) {
+  node_rows->clear();
+  BOOST_FOREACH(const TPlanNodeExecSummary& node, summary.nodes) {
+    string label = node.label;
+    if (!node.label_detail.empty()) label += " [" + node.label_detail + "]";
+    int64_t rows = 0;
+    BOOST_FOREACH(const TExecStats& stats, node.exec_stats) rows += stats.cardinality;
+    node_rows->push_back(make_pair(label, rows));
+  }
+}
+
+void PlanHistory::AddQuery(const QueryRecord& record) {
+  {
+    lock_guard<mutex> l(lock_);
+    AddRecordLocked(record);
+  }
+  if (logger_ == NULL) return;
+  Status status = logger_->AppendEntry(SerializeRecord(record));
+  if (!status.ok()) {
+    LOG_EVERY_N(WARNING, 1000) << "Could not write to plan history file ("
+                               << google::COUNTER << " attempts failed): "
+                               << status.GetDetail();
+  }
+}
+
+void PlanHistory::AddRecordLocked(const QueryRecord& record) {
+  PlanStats& plan = plans_[record.fingerprint];
+  if (plan.num_queries == 0) {
+    plan.first_seen_ms = record.end_time_ms;
+    plan.min_latency_ms = record.latency_ms;
+    BOOST_FOREACH(const PlanNodeRows& node, record.node_rows) {
+      plan.node_rows.push_back(make_pair(node.first, 0));
+    }
+  }
+  plan.stmt = record.stmt.substr(0, MAX_STMT_LENGTH);
+  ++plan.num_queries;
+  plan.last_seen_ms = max(plan.last_seen_ms, record.end_time_ms);
+  plan.total_latency_ms += record.latency_ms;
+  plan.min_latency_ms = min(plan.min_latency_ms, record.latency_ms);
+  plan.max_latency_ms = max(plan.max_latency_ms, record.latency_ms);
+  plan.total_peak_mem_usage += record.peak_mem_usage;
+  plan.max_peak_mem_usage = max(plan.max_peak_mem_usage, record.peak_mem_usage);
+  plan.total_spilled_bytes += record.spilled_bytes;
+  if (record.spilled_bytes > 0) ++plan.num_spilled;
+  // Same fingerprint means same plan shape, so the nodes line up.
+  for (int i = 0; i < plan.node_rows.size() && i < record.node_rows.size(); ++i) {
+    plan.node_rows[i].second += record.node_rows[i].second;
+  }
+  VersionStats& version = plan.versions[record.version];
+  ++version.num_queries;
+  version.total_latency_ms += record.latency_ms;
+  version.total_peak_mem_usage += record.peak_mem_usage;
+
+  while (plans_.size() > max<size_t>(FLAGS_plan_history_max_fingerprints, 1)) {
+    PlanStatsMap::iterator oldest = plans_.begin();
+    for (PlanStatsMap::iterator it = plans_.begin(); it != plans_.end(); ++it) {
+      if (it->second.last_seen_ms < oldest->second.last_seen_ms) oldest = it;
+    }
+    plans_.erase(oldest);
+  }
+}
+
+bool PlanHistory::GetMaxPeakMemUsage(const string& fingerprint,
+    int64_t* peak_mem_usage) {
+  lock_guard<mutex> l(lock_);
+  PlanStatsMap::const_iterator it = plans_.find(fingerprint);
+  if (it == plans_.end()) return false;
+  *peak_mem_usage = it->second.max_peak_mem_usage;
+  return true;
+}
+
+// Strings are base64 encoded so that records stay on a single line and fields never
+// contain spaces. Empty strings are written as "-" so that no field is empty.
+static void AppendString(const string& str, stringstream* ss) {
+  if (str.empty()) {
+    *ss << "-";
+  } else {
+    Base64Encode(str, ss);
+  }
+}
+
+static bool ParseString(const string& field, string* str) {
+  if (field == "-") {
+    str->clear();
+    return true;
+  }
+  return Base64Decode(field, str);
+}
+
+static bool ParseInt(const string& field, int64_t* value) {
+  StringParser::ParseResult result;
+  *value = StringParser::StringToInt<int64_t>(field.c_str(), field.size(), &result);
+  return result == StringParser::PARSE_SUCCESS;
+}
+
+string PlanHistory::SerializeRecord(const QueryRecord& record) {
+  stringstream ss;
+  ss << record.end_time_ms << " " << record.fingerprint << " " << record.latency_ms
+     << " " << record.peak_mem_usage << " " << record.spilled_bytes << " ";
+  AppendString(record.version, &ss);
+  ss << " ";
+  AppendString(record.stmt.substr(0, MAX_STMT_LENGTH), &ss);
+  BOOST_FOREACH(const PlanNodeRows& node, record.node_rows) {
+    ss << " ";
+    AppendString(node.first, &ss);
+    ss << ":" << node.second;
+  }
+  return ss.str();
+}
+
+bool PlanHistory::ParseRecord(const string& line, QueryRecord* record) {
+  vector<string> fields;
+  split(fields, line, is_any_of(" "), token_compress_on);
+  if (fields.size() < NUM_RECORD_FIELDS) return false;
+  record->fingerprint = fields[1];
+  if (!ParseInt(fields[0], &record->end_time_ms) ||
+      !ParseInt(fields[2], &record->latency_ms) ||
+      !ParseInt(fields[3], &record->peak_mem_usage) ||
+      !ParseInt(fields[4], &record->spilled_bytes) ||
+      !ParseString(fields[5], &record->version) ||
+      !ParseString(fields[6], &record->stmt)) {
+    return false;
+  }
+  record->node_rows.clear();
+  for (int i = NUM_RECORD_FIELDS; i < fields.size(); ++i) {
+    size_t colon = fields[i].rfind(':');
+    if (colon == string::npos) return false;
+    PlanNodeRows node;
+    if (!ParseString(fields[i].substr(0, colon), &node.first) ||
+        !ParseInt(fields[i].substr(colon + 1), &node.second)) {
+      return false;
+    }
+    record->node_rows.push_back(node);
+  }
+  return true;
+}
+
+Status PlanHistory::ListFiles(vector<string>* files) {
+  files->clear();
+  try {
+    for (directory_iterator it(dir_); it != directory_iterator(); ++it) {
+      if (starts_with(it->path().filename().string(), PLAN_HISTORY_FILE_PREFIX)) {
+        files->push_back(it->path().string());
+      }
+    }
+  } catch (const std::exception& e) {
+    return Status(Substitute("Could not list plan history directory $0: $1", dir_,
+        e.what()));
+  }
+  // The file names end in their creation time in ms, so the oldest sort first.
+  sort(files->begin(), files->end());
+  return Status::OK();
+}
+
+Status PlanHistory::LoadFiles() {
+  vector<string> files;
+  RETURN_IF_ERROR(ListFiles(&files));
+  int64_t num_loaded = 0;
+  int64_t num_malformed = 0;
+  lock_guard<mutex> l(lock_);
+  BOOST_FOREACH(const string& file, files) {
+    ifstream in(file.c_str());
+    string line;
+    while (getline(in, line)) {
+      if (line.empty()) continue;
+      QueryRecord record;
+      if (ParseRecord(line, &record)) {
+        AddRecordLocked(record);
+        ++num_loaded;
+      } else {
+        ++num_malformed;
+      }
+    }
+  }
+  LOG(INFO) << "Loaded " << num_loaded << " queries of " << plans_.size()
+            << " plans from the plan history in " << dir_ << " (" << num_malformed
+            << " malformed records skipped)";
+  return Status::OK();
+}
+
+Status PlanHistory::RemoveOldFiles() {
+  vector<string> files;
+  RETURN_IF_ERROR(ListFiles(&files));
+  if (files.size() <= static_cast<size_t>(FLAGS_max_plan_history_files)) {
+    return Status::OK();
+  }
+  files.resize(files.size() - FLAGS_max_plan_history_files);
+  return FileSystemUtil::RemovePaths(files);
+}
+
+void PlanHistory::FlushLoop() {
+  while (true) {
+    SleepForMs(5000);
+    Status status = logger_->Flush();
+    if (status.ok()) status = RemoveOldFiles();
+    if (!status.ok()) {
+      LOG_EVERY_N(WARNING, 100) << "Error maintaining plan history files: "
+                                << status.GetDetail();
+    }
+  }
+}
+
+// Adds the fingerprint and the aggregates shown for all queries, for the queries of one
+// version or in the list of fingerprints, to 'value'.
+static void PlanStatsToJson(const string& fingerprint, int64_t num_queries,
+    int64_t total_latency_ms, int64_t max_latency_ms, int64_t total_peak_mem_usage,
+    int64_t max_peak_mem_usage, Value* value, Document* document) {
+  Value fingerprint_json(fingerprint.c_str(), document->GetAllocator());
+  value->AddMember("fingerprint", fingerprint_json, document->GetAllocator());
+  value->AddMember("num_queries", num_queries, document->GetAllocator());
+  int64_t n = max<int64_t>(num_queries, 1);
+  Value avg_latency(PrettyPrinter::Print(total_latency_ms / n, TUnit::TIME_MS).c_str(),
+      document->GetAllocator());
+  value->AddMember("avg_latency", avg_latency, document->GetAllocator());
+  Value max_latency(PrettyPrinter::Print(max_latency_ms, TUnit::TIME_MS).c_str(),
+      document->GetAllocator());
+  value->AddMember("max_latency", max_latency, document->GetAllocator());
+  Value avg_mem(PrettyPrinter::Print(total_peak_mem_usage / n, TUnit::BYTES).c_str(),
+      document->GetAllocator());
+  value->AddMember("avg_peak_mem", avg_mem, document->GetAllocator());
+  Value max_mem(PrettyPrinter::Print(max_peak_mem_usage, TUnit::BYTES).c_str(),
+      document->GetAllocator());
+  value->AddMember("max_peak_mem", max_mem, document->GetAllocator());
+}
+
+// Orders fingerprints by decreasing time they were last seen.
+static bool LastSeenGt(const pair<int64_t, string>& a, const pair<int64_t, string>& b) {
+  return a.first > b.first;
+}
+
+void PlanHistory::PlanHistoryUrlCallback(const Webserver::ArgumentMap& args,
+    Document* document) {
+  document->AddMember("max_fingerprints", FLAGS_plan_history_max_fingerprints,
+      document->GetAllocator());
+  Value dir(dir_.c_str(), document->GetAllocator());
+  document->AddMember("dir", dir, document->GetAllocator());
+  lock_guard<mutex> l(lock_);
+  Webserver::ArgumentMap::const_iterator arg = args.find("fingerprint");
+  if (arg == args.end()) {
+    vector<pair<int64_t, string> > fingerprints;
+    BOOST_FOREACH(const PlanStatsMap::value_type& entry, plans_) {
+      fingerprints.push_back(make_pair(entry.second.last_seen_ms, entry.first));
+    }
+    sort(fingerprints.begin(), fingerprints.end(), LastSeenGt);
+    Value plans(kArrayType);
+    for (int i = 0; i < fingerprints.size(); ++i) {
+      const PlanStats& plan = plans_[fingerprints[i].second];
+      Value plan_json(kObjectType);
+      PlanStatsToJson(fingerprints[i].second, plan.num_queries, plan.total_latency_ms,
+          plan.max_latency_ms, plan.total_peak_mem_usage, plan.max_peak_mem_usage,
+          &plan_json, document);
+      Value stmt(plan.stmt.c_str(), document->GetAllocator());
+      plan_json.AddMember("stmt", stmt, document->GetAllocator());
+      plan_json.AddMember("num_spilled", plan.num_spilled, document->GetAllocator());
+      Value last_seen(TimestampValue(plan.last_seen_ms / 1000).DebugString().c_str(),
+          document->GetAllocator());
+      plan_json.AddMember("last_seen", last_seen, document->GetAllocator());
+      plans.PushBack(plan_json, document->GetAllocator());
+    }
+    document->AddMember("plans", plans, document->GetAllocator());
+    return;
+  }
+
+  PlanStatsMap::const_iterator it = plans_.find(arg->second);
+  if (it == plans_.end()) {
+    Value error(Substitute("Unknown plan fingerprint: $0", arg->second).c_str(),
+        document->GetAllocator());
+    document->AddMember("error", error, document->GetAllocator());
+    return;
+  }
+  const PlanStats& plan = it->second;
+  Value details(kObjectType);
+  PlanStatsToJson(it->first, plan.num_queries, plan.total_latency_ms,
+      plan.max_latency_ms, plan.total_peak_mem_usage, plan.max_peak_mem_usage,
+      &details, document);
+  Value stmt(plan.stmt.c_str(), document->GetAllocator());
+  details.AddMember("stmt", stmt, document->GetAllocator());
+  Value min_latency(PrettyPrinter::Print(plan.min_latency_ms, TUnit::TIME_MS).c_str(),
+      document->GetAllocator());
+  details.AddMember("min_latency", min_latency, document->GetAllocator());
+  details.AddMember("num_spilled", plan.num_spilled, document->GetAllocator());
+  Value spilled(PrettyPrinter::Print(plan.total_spilled_bytes, TUnit::BYTES).c_str(),
+      document->GetAllocator());
+  details.AddMember("total_spilled", spilled, document->GetAllocator());
+  Value first_seen(TimestampValue(plan.first_seen_ms / 1000).DebugString().c_str(),
+      document->GetAllocator());
+  details.AddMember("first_seen", first_seen, document->GetAllocator());
+  Value last_seen(TimestampValue(plan.last_seen_ms / 1000).DebugString().c_str(),
+      document->GetAllocator());
+  details.AddMember("last_seen", last_seen, document->GetAllocator());
+  document->AddMember("details", details, document->GetAllocator());
+
+  Value versions(kArrayType);
+  typedef map<string, VersionStats>::value_type VersionEntry;
+  BOOST_FOREACH(const VersionEntry& entry, plan.versions) {
+    Value version(kObjectType);
+    PlanStatsToJson(it->first, entry.second.num_queries, entry.second.total_latency_ms,
+        0, entry.second.total_peak_mem_usage, 0, &version, document);
+    Value name(entry.first.c_str(), document->GetAllocator());
+    version.AddMember("version", name, document->GetAllocator());
+    versions.PushBack(version, document->GetAllocator());
+  }
+  document->AddMember("versions", versions, document->GetAllocator());
+
+  Value nodes(kArrayType);
+  BOOST_FOREACH(const PlanNodeRows& node_rows, plan.node_rows) {
+    Value node(kObjectType);
+    Value label(node_rows.first.c_str(), document->GetAllocator());
+    node.AddMember("label", label, document->GetAllocator());
+    Value avg_rows(PrettyPrinter::Print(node_rows.second / plan.num_queries,
+        TUnit::UNIT).c_str(), document->GetAllocator());
+    node.AddMember("avg_rows", avg_rows, document->GetAllocator());
+    nodes.PushBack(node, document->GetAllocator());
+  }
+  document->AddMember("nodes", nodes, document->GetAllocator());
+}
@@ -0,0 +1,188 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_SERVICE_PLAN_HISTORY_H
+#define IMPALA_SERVICE_PLAN_HISTORY_H
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "common/status.h"
+#include "gen-cpp/ExecStats_types.h"
+#include "gen-cpp/Planner_types.h"
+#include "util/simple-logger.h"
+#include "util/webserver.h"
+
+namespace impala {
+
+class Thread;
+
+/// Impalad-wide history of the performance of completed queries, aggregated per plan
+/// fingerprint. The fingerprint of a plan only depends on the shape of its plan trees,
+/// the operators and the tables they read (see ComputeFingerprint()), so repeated runs
+/// of a query, even with different literals, share their statistics: latency, peak
+/// memory, spilled bytes and rows returned per plan node, plus the latency and peak
+/// memory broken down by the Impala version that ran the query, to spot regressions
+/// after an upgrade.
+///
+/// At most --plan_history_max_fingerprints fingerprints are kept; the ones seen least
+/// recently are evicted. Unless --max_plan_history_files is 0, every completed query is
+/// also appended as a single line to the files in --plan_history_dir, which are rolled
+/// every --max_plan_history_file_size queries, and of which only the newest
+/// --max_plan_history_files are kept. The statistics are rebuilt from these files on
+/// startup. The /plan_history page of the webserver lists the fingerprints.
+///
+/// This class is thread-safe.
+class PlanHistory {
+ public:
+  /// Label of a plan node and number of rows it returned.
+  typedef std::pair<std::string, int64_t> PlanNodeRows;
+
+  /// The statistics of one completed query.
+  struct QueryRecord {
+    std::string fingerprint;
+
+    /// Version string of the impalad that ran the query.
+    std::string version;
+
+    /// SQL statement. Only its first few hundred characters are kept.
+    std::string stmt;
+
+    int64_t end_time_ms;
+    int64_t latency_ms;
+    int64_t peak_mem_usage;
+    int64_t spilled_bytes;
+
+    /// Label and number of rows returned of each plan node, in exec summary order.
+    std::vector<PlanNodeRows> node_rows;
+
+    QueryRecord()
+      : end_time_ms(0), latency_ms(0), peak_mem_usage(0), spilled_bytes(0) { }
+  };
+
+  PlanHistory();
+  ~PlanHistory();
+
+  /// Loads the records that are left in --plan_history_dir, opens a new file for the
+  /// records of this process and starts flushing it periodically. If this fails, the
+  /// history is still kept in memory but not persisted.
+  Status Init();
+
+  /// Returns a hex string that only depends on the labels, details and number of
+  /// children of the plan nodes of 'fragments' and the fragments they belong to. It
+  /// does not change with literals, cardinality estimates or node ids.
+  static std::string ComputeFingerprint(const std::vector<TPlanFragment>& fragments);
+
+  /// Sets 'node_rows' to the labels and total number of rows returned by the plan nodes
+  /// of 'summary', as expected by QueryRecord.
+  static void GetNodeRows(const TExecSummary& summary,
+      std::vector<PlanNodeRows>* node_rows);
+
+  /// Adds 'record' to the statistics of its fingerprint and to the current file.
+  void AddQuery(const QueryRecord& record);
+
+  /// Returns true and sets 'peak_mem_usage' to the largest peak memory usage of the
+  /// completed queries with 'fingerprint', if there are any.
+  bool GetMaxPeakMemUsage(const std::string& fingerprint, int64_t* peak_mem_usage);
+
+  /// Returns 'record' as a single line of text, which ParseRecord() reads back.
+  static std::string SerializeRecord(const QueryRecord& record);
+
+  /// Parses a line written by SerializeRecord(). Returns false if it is malformed.
+  static bool ParseRecord(const std::string& line, QueryRecord* record);
+
+  /// Webserver callback. Lists the fingerprints, or the statistics of the fingerprint
+  /// given by the 'fingerprint' argument.
+  void PlanHistoryUrlCallback(const Webserver::ArgumentMap& args,
+      rapidjson::Document* document);
+
+ private:
+  /// Latency and peak memory of the queries run by one version of Impala.
+  struct VersionStats {
+    int64_t num_queries;
+    int64_t total_latency_ms;
+    int64_t total_peak_mem_usage;
+
+    VersionStats() : num_queries(0), total_latency_ms(0), total_peak_mem_usage(0) { }
+  };
+
+  /// The statistics of all the recorded queries with one fingerprint.
+  struct PlanStats {
+    /// Statement of the latest query.
+    std::string stmt;
+
+    int64_t num_queries;
+    int64_t first_seen_ms;
+    int64_t last_seen_ms;
+    int64_t total_latency_ms;
+    int64_t min_latency_ms;
+    int64_t max_latency_ms;
+    int64_t total_peak_mem_usage;
+    int64_t max_peak_mem_usage;
+    int64_t total_spilled_bytes;
+
+    /// Number of queries that spilled to disk.
+    int64_t num_spilled;
+
+    /// Label and total number of rows returned of each plan node, over all queries.
+    std::vector<PlanNodeRows> node_rows;
+
+    std::map<std::string, VersionStats> versions;
+
+    PlanStats();
+  };
+  typedef boost::unordered_map<std::string, PlanStats> PlanStatsMap;
+
+  /// Adds 'record' to plans_ and evicts fingerprints if there are too many. Called with
+  /// lock_ held.
+  void AddRecordLocked(const QueryRecord& record);
+
+  /// Reads the records of all the files in the directory, from the oldest to the
+  /// newest.
+  Status LoadFiles();
+
+  /// Sets 'files' to the paths of the history files in the directory, from the oldest to
+  /// the newest.
+  Status ListFiles(std::vector<std::string>* files);
+
+  /// Removes the oldest files until at most --max_plan_history_files are left.
+  Status RemoveOldFiles();
+
+  /// Flushes the current file and removes old files every few seconds. Runs in
+  /// flush_thread_.
+  void FlushLoop();
+
+  /// Directory of the history files, empty if the history is not persisted.
+  std::string dir_;
+
+  /// Writes the current file. NULL if the history is not persisted.
+  boost::scoped_ptr<SimpleLogger> logger_;
+
+  boost::scoped_ptr<Thread> flush_thread_;
+
+  /// Protects plans_.
+  boost::mutex lock_;
+
+  PlanStatsMap plans_;
+};
+
+}
+
+#endif
@@ -22,9 +22,11 @@
 #include "runtime/runtime-state.h"
 #include "service/impala-server.h"
 #include "service/frontend.h"
+#include "service/plan-history.h"
 #include "service/query-options.h"
 #include "util/debug-util.h"
 #include "util/impalad-metrics.h"
+#include "util/pretty-printer.h"
 #include "util/time.h"
 
 #include "gen-cpp/CatalogService.h"
@@ -44,6 +46,7 @@ DECLARE_int32(catalog_service_port);
 DECLARE_string(catalog_service_host);
 DECLARE_bool(enable_rm);
 DECLARE_int64(max_result_cache_size);
+DECLARE_int32(result_prefetch_batches);
 
 namespace impala {
 
@@ -53,6 +56,7 @@ static const string PER_HOST_MEM_KEY = "Estimated Per-Host Mem";
 static const string PER_HOST_VCORES_KEY = "Estimated Per-Host VCores";
 static const string TABLES_MISSING_STATS_KEY = "Tables Missing Stats";
 static const string TABLES_WITH_CORRUPT_STATS_KEY = "Tables With Corrupt Table Stats";
+static const string QUERY_RESULT_CACHE_KEY = "Query Result Cache";
 
 ImpalaServer::QueryExecState::QueryExecState(
     const TQueryCtx& query_ctx, ExecEnv* exec_env, Frontend* frontend,
@@ -75,6 +79,9 @@ ImpalaServer::QueryExecState::QueryExecState(
     current_batch_row_(0),
     num_rows_fetched_(0),
     fetched_rows_(false),
+    prefetched_row_idx_(0),
+    prefetch_done_(false),
+    prefetch_cancelled_(false),
     frontend_(frontend),
     parent_server_(server),
     start_time_(TimestampValue::LocalTime()) {
@@ -140,6 +147,7 @@ Status ImpalaServer::QueryExecState::Exec(TExecRequest* exec_request) {
     case TStmtType::QUERY:
     case TStmtType::DML:
       DCHECK(exec_request_.__isset.query_exec_request);
+      if (LookupQueryResultCache()) return Status::OK();
       return ExecQueryOrDmlRequest(exec_request_.query_exec_request);
     case TStmtType::EXPLAIN: {
       request_result_set_.reset(new vector<TResultRow>(
@@ -369,6 +377,16 @@ Status ImpalaServer::QueryExecState::ExecQueryOrDmlRequest(
   // we always need at least one plan fragment
   DCHECK_GT(query_exec_request.fragments.size(), 0);
 
+  plan_fingerprint_ = PlanHistory::ComputeFingerprint(query_exec_request.fragments);
+  summary_profile_.AddInfoString("Plan Fingerprint", plan_fingerprint_);
+  int64_t historical_peak_mem;
+  if (parent_server_->plan_history_ != NULL &&
+      parent_server_->plan_history_->GetMaxPeakMemUsage(plan_fingerprint_,
+          &historical_peak_mem)) {
+    summary_profile_.AddInfoString("Historical Peak Memory",
+        PrettyPrinter::Print(historical_peak_mem, TUnit::BYTES));
+  }
+
   if (query_exec_request.__isset.query_plan) {
     stringstream plan_ss;
     // Add some delimiters to make it clearer where the plan
@@ -461,6 +479,37 @@ Status ImpalaServer::QueryExecState::ExecQueryOrDmlRequest(
   return Status::OK();
 }
 
+bool ImpalaServer::QueryExecState::LookupQueryResultCache() {
+  if (result_cache_key_.empty()) return false;
+  QueryResultCache* cache = parent_server_->query_result_cache_.get();
+  DCHECK(cache != NULL);
+  cached_results_ = cache->Lookup(result_cache_key_);
+  if (cached_results_ != NULL) {
+    summary_profile_.AddInfoString(QUERY_RESULT_CACHE_KEY, "Hit");
+    query_events_->MarkEvent("Results found in query result cache");
+    return true;
+  }
+  summary_profile_.AddInfoString(QUERY_RESULT_CACHE_KEY, "Miss");
+  captured_results_.reset(new QueryResultCache::Entry());
+  captured_results_->metadata = result_metadata_;
+  captured_results_->results.reset(CreateResultSet(captured_results_->metadata));
+  return false;
+}
+
+void ImpalaServer::QueryExecState::CaptureResults(QueryResultSet* fetched_rows,
+    int start_idx) {
+  int num_rows = fetched_rows->size() - start_idx;
+  if (num_rows <= 0) return;
+  int64_t bytes = fetched_rows->ByteSize(start_idx, num_rows);
+  if (captured_results_->byte_size + bytes >
+      parent_server_->query_result_cache_->capacity()) {
+    captured_results_.reset();
+    return;
+  }
+  captured_results_->results->AddRows(fetched_rows, start_idx, num_rows);
+  captured_results_->byte_size += bytes;
+}
+
 Status ImpalaServer::QueryExecState::ExecDdlRequest() {
   string op_type = catalog_op_type() == TCatalogOpType::DDL ?
       PrintTDdlType(ddl_type()) : PrintTCatalogOpType(catalog_op_type());
@@ -531,6 +580,18 @@ void ImpalaServer::QueryExecState::Done() {
   // Make sure we join on wait_thread_ before we finish (and especially before this object
   // is destroyed).
   BlockOnWait();
+  // The prefetch thread is started by wait_thread_. If it is still fetching, the query
+  // is cancelled so that Coordinator::GetNext() returns.
+  if (prefetch_thread_.get() != NULL) {
+    StopPrefetch();
+    bool prefetch_done;
+    {
+      lock_guard<mutex> l(prefetch_lock_);
+      prefetch_done = prefetch_done_;
+    }
+    if (!prefetch_done) coord_->Cancel();
+    prefetch_thread_->Join();
+  }
   unique_lock<mutex> l(lock_);
   end_time_ = TimestampValue::LocalTime();
   summary_profile_.AddInfoString("End Time", end_time().DebugString());
@@ -539,6 +600,10 @@ void ImpalaServer::QueryExecState::Done() {
 
   if (coord_.get() != NULL) {
     Expr::Close(output_expr_ctxs_, coord_->runtime_state());
+    // Let the admission controller learn how much memory a complete run needed.
+    if (query_status_.ok() && eos_ && schedule_->UsesPlannerMemoryEstimate()) {
+      schedule_->set_peak_per_host_mem(coord_->GetMaxPerNodePeakMemUsage());
+    }
     // Release any reserved resources.
     Status status = exec_env_->scheduler()->Release(schedule_.get());
     if (!status.ok()) {
@@ -604,7 +669,106 @@ void ImpalaServer::QueryExecState::Wait() {
   }
   if (status.ok()) {
     UpdateQueryState(QueryState::FINISHED);
+    if (FLAGS_result_prefetch_batches > 0 && stmt_type() == TStmtType::QUERY &&
+        coord_.get() != NULL && returns_result_set()) {
+      prefetch_thread_.reset(new Thread("query-exec-state", "prefetch-thread",
+          &ImpalaServer::QueryExecState::PrefetchResults, this));
+    }
+  }
+}
+
+void ImpalaServer::QueryExecState::PrefetchResults() {
+  RuntimeState* state = coord_->runtime_state();
+  while (true) {
+    {
+      unique_lock<mutex> l(prefetch_lock_);
+      while (prefetched_results_.size() >=
+          static_cast<size_t>(FLAGS_result_prefetch_batches) &&
+          !prefetch_cancelled_) {
+        prefetch_cv_.wait(l);
+      }
+      if (prefetch_cancelled_) break;
+    }
+    RowBatch* batch = NULL;
+    Status status = coord_->GetNext(&batch, state);
+    shared_ptr<QueryResultSet> results;
+    if (status.ok() && batch != NULL) {
+      SCOPED_TIMER(row_materialization_timer_);
+      results.reset(CreateResultSet(result_metadata_));
+      status = results->AddRowBatch(output_expr_ctxs_, batch, 0, batch->num_rows());
+      ExprContext::FreeLocalAllocations(output_expr_ctxs_);
+      // Check if there was an error evaluating a row value.
+      if (status.ok()) status = state->CheckQueryState();
+    }
+    bool done = !status.ok() || batch == NULL;
+    {
+      lock_guard<mutex> l(prefetch_lock_);
+      if (done) {
+        prefetch_status_ = status;
+        prefetch_done_ = true;
+      } else {
+        prefetched_results_.push_back(results);
+      }
+    }
+    prefetch_cv_.notify_all();
+    if (done) break;
+  }
+}
+
+Status ImpalaServer::QueryExecState::FetchPrefetchedRows(int32_t max_rows,
+    QueryResultSet* fetched_rows) {
+  shared_ptr<QueryResultSet> results;
+  Status status;
+  // Temporarily release lock_ so calls to Cancel() are not blocked while waiting for the
+  // prefetch thread. fetch_rows_lock_ ensures that there is only one fetching thread.
+  lock_.unlock();
+  {
+    unique_lock<mutex> l(prefetch_lock_);
+    while (prefetched_results_.empty() && !prefetch_done_) prefetch_cv_.wait(l);
+    if (!prefetched_results_.empty()) {
+      results = prefetched_results_.front();
+    } else {
+      status = prefetch_status_;
+    }
+  }
+  lock_.lock();
+  // Check if query status has changed while waiting
+  if (!query_status_.ok()) return query_status_;
+  if (results == NULL) {
+    eos_ = status.ok();
+    return status;
   }
+
+  // Only this thread removes results, so the front of the queue is still 'results'.
+  int fetch_size = (max_rows <= 0) ? results->size() : max_rows;
+  int num_rows = fetched_rows->AddRows(results.get(), prefetched_row_idx_, fetch_size);
+  num_rows_fetched_ += num_rows;
+  prefetched_row_idx_ += num_rows;
+  if (prefetched_row_idx_ >= results->size()) {
+    {
+      lock_guard<mutex> l(prefetch_lock_);
+      prefetched_results_.pop_front();
+    }
+    prefetch_cv_.notify_all();
+    prefetched_row_idx_ = 0;
+  }
+  return Status::OK();
+}
+
+void ImpalaServer::QueryExecState::StopPrefetch() {
+  {
+    lock_guard<mutex> l(prefetch_lock_);
+    prefetch_cancelled_ = true;
+  }
+  prefetch_cv_.notify_all();
+}
+
+ImpalaServer::QueryResultSet* ImpalaServer::QueryExecState::CreateResultSet(
+    const TResultSetMetadata& metadata) {
+  if (session_type() == TSessionType::BEESWAX) {
+    return parent_server_->CreateBeeswaxResultSet(metadata);
+  }
+  return parent_server_->CreateHS2ResultSet(session_->hs2_version, metadata);
 }
 
 Status ImpalaServer::QueryExecState::WaitInternal() {
@@ -648,12 +812,21 @@ Status ImpalaServer::QueryExecState::FetchRows(const int32_t max_rows,
 
   // ImpalaServer::FetchInternal has already taken our lock_
   UpdateQueryStatus(FetchRowsInternal(max_rows, fetched_rows));
+  if (eos_ && captured_results_ != NULL && query_status_.ok()) {
+    parent_server_->query_result_cache_->Insert(result_cache_key_, captured_results_);
+    captured_results_.reset();
+  }
 
   MarkInactive();
   return query_status_;
 }
 
 Status ImpalaServer::QueryExecState::RestartFetch() {
+  if (cached_results_ != NULL) {
+    eos_ = false;
+    num_rows_fetched_ = 0;
+    return Status::OK();
+  }
   // No result caching for this query. Restart is invalid.
   if (result_cache_max_size_ <= 0) {
     return Status(ErrorMsg(TErrorCode::RECOVERABLE_ERROR,
@@ -709,6 +882,15 @@ Status ImpalaServer::QueryExecState::FetchRowsInternal(const int32_t max_rows,
     return Status::OK();
   }
 
+  if (cached_results_ != NULL) {
+    query_state_ = QueryState::FINISHED;
+    QueryResultSet* results = cached_results_->results.get();
+    int fetch_size = (max_rows <= 0) ? results->size() : max_rows;
+    num_rows_fetched_ += fetched_rows->AddRows(results, num_rows_fetched_, fetch_size);
+    eos_ = (num_rows_fetched_ == results->size());
+    return Status::OK();
+  }
+
   int32_t num_rows_fetched_from_cache = 0;
   if (result_cache_max_size_ > 0 && result_cache_ != NULL) {
     // Satisfy the fetch from the result cache if possible.
@@ -719,14 +901,6 @@ Status ImpalaServer::QueryExecState::FetchRowsInternal(const int32_t max_rows,
     if (num_rows_fetched_from_cache >= max_rows) return Status::OK();
   }
 
-  // List of expr values to hold evaluated rows from the query
-  vector<void*> result_row;
-  result_row.resize(output_expr_ctxs_.size());
-
-  // List of scales for floating point values in result_row
-  vector<int> scales;
-  scales.resize(result_row.size());
-
   if (coord_ == NULL) {
     // Query with LIMIT 0.
     query_state_ = QueryState::FINISHED;
@@ -735,36 +909,42 @@ Status ImpalaServer::QueryExecState::FetchRowsInternal(const int32_t max_rows,
   }
 
   query_state_ = QueryState::FINISHED;  // results will be ready after this call
-  // Fetch the next batch if we've returned the current batch entirely
-  if (current_batch_ == NULL || current_batch_row_ >= current_batch_->num_rows()) {
-    RETURN_IF_ERROR(FetchNextBatch());
-  }
-  if (current_batch_ == NULL) return Status::OK();
-
   // Maximum number of rows to be fetched from the coord.
   int32_t max_coord_rows = max_rows;
   if (max_rows > 0) {
     DCHECK_LE(num_rows_fetched_from_cache, max_rows);
     max_coord_rows = max_rows - num_rows_fetched_from_cache;
   }
-  {
-    SCOPED_TIMER(row_materialization_timer_);
-    // Convert the available rows, limited by max_coord_rows
-    int available = current_batch_->num_rows() - current_batch_row_;
-    int fetched_count = available;
-    // max_coord_rows <= 0 means no limit
-    if (max_coord_rows > 0 && max_coord_rows < available) fetched_count = max_coord_rows;
-    for (int i = 0; i < fetched_count; ++i) {
-      TupleRow* row = current_batch_->GetRow(current_batch_row_);
-      RETURN_IF_ERROR(GetRowValue(row, &result_row, &scales));
-      RETURN_IF_ERROR(fetched_rows->AddOneRow(result_row, scales));
-      ++num_rows_fetched_;
-      ++current_batch_row_;
+  if (prefetch_thread_.get() != NULL) {
+    RETURN_IF_ERROR(FetchPrefetchedRows(max_coord_rows, fetched_rows));
+  } else {
+    // Fetch the next batch if we've returned the current batch entirely
+    if (current_batch_ == NULL || current_batch_row_ >= current_batch_->num_rows()) {
+      RETURN_IF_ERROR(FetchNextBatch());
+    }
+    if (current_batch_ == NULL) return Status::OK();
+    {
+      SCOPED_TIMER(row_materialization_timer_);
+      // Convert the available rows, limited by max_coord_rows
+      int available = current_batch_->num_rows() - current_batch_row_;
+      int fetched_count = available;
+      // max_coord_rows <= 0 means no limit
+      if (max_coord_rows > 0 && max_coord_rows < available) {
+        fetched_count = max_coord_rows;
+      }
+      RETURN_IF_ERROR(fetched_rows->AddRowBatch(output_expr_ctxs_, current_batch_,
+          current_batch_row_, fetched_count));
+      num_rows_fetched_ += fetched_count;
+      current_batch_row_ += fetched_count;
     }
+    ExprContext::FreeLocalAllocations(output_expr_ctxs_);
+    // Check if there was an error evaluating a row value.
+    RETURN_IF_ERROR(coord_->runtime_state()->CheckQueryState());
+  }
+
+  if (captured_results_ != NULL) {
+    CaptureResults(fetched_rows, num_rows_fetched_from_cache);
   }
-  ExprContext::FreeLocalAllocations(output_expr_ctxs_);
-  // Check if there was an error evaluating a row value.
-  RETURN_IF_ERROR(coord_->runtime_state()->CheckQueryState());
 
   // Update the result cache if necessary.
   if (result_cache_max_size_ > 0 && result_cache_.get() != NULL) {
@@ -822,12 +1002,20 @@ Status ImpalaServer::QueryExecState::FetchRowsInternal(const int32_t max_rows,
   return Status::OK();
 }
 
-Status ImpalaServer::QueryExecState::GetRowValue(TupleRow* row, vector<void*>* result,
-                                                 vector<int>* scales) {
-  DCHECK(result->size() >= output_expr_ctxs_.size());
-  for (int i = 0; i < output_expr_ctxs_.size(); ++i) {
-    (*result)[i] = output_expr_ctxs_[i]->GetValue(row);
-    (*scales)[i] = output_expr_ctxs_[i]->root()->output_scale();
+Status ImpalaServer::QueryResultSet::AddRowBatch(const vector<ExprContext*>& expr_ctxs,
+    RowBatch* batch, int start_idx, int num_rows) {
+  vector<void*> result_row(expr_ctxs.size());
+  // The values' scales (# of digits after decimal).
+  vector<int> scales(expr_ctxs.size());
+  for (int i = 0; i < expr_ctxs.size(); ++i) {
+    scales[i] = expr_ctxs[i]->root()->output_scale();
+  }
+  for (int i = start_idx; i < start_idx + num_rows; ++i) {
+    TupleRow* row = batch->GetRow(i);
+    for (int j = 0; j < expr_ctxs.size(); ++j) {
+      result_row[j] = expr_ctxs[j]->GetValue(row);
+    }
+    RETURN_IF_ERROR(AddOneRow(result_row, scales));
   }
   return Status::OK();
 }
@@ -847,6 +1035,7 @@ void ImpalaServer::QueryExecState::Cancel(const Status* cause) {
     query_state_ = QueryState::EXCEPTION;
   }
   if (coord_.get() != NULL) coord_->Cancel(cause);
+  StopPrefetch();
 }
 
 Status ImpalaServer::QueryExecState::UpdateCatalog() {
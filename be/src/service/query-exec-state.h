@@ -23,11 +23,13 @@
 #include "scheduling/query-schedule.h"
 #include "gen-cpp/Frontend_types.h"
 #include "service/impala-server.h"
+#include "service/query-result-cache.h"
 #include "gen-cpp/Frontend_types.h"
 #include "util/auth-util.h"
 
 #include <boost/thread.hpp>
 #include <boost/unordered_set.hpp>
+#include <deque>
 #include <vector>
 
 namespace impala {
@@ -47,8 +49,9 @@ class QueryExecStateCleaner;
 /// servicing query-related requests from the client.
 /// Thread safety: this class is generally not thread-safe, callers need to
 /// synchronize access explicitly via lock().
-/// To avoid deadlocks, the caller must *not* acquire query_exec_state_map_lock_
-/// while holding the exec state's lock.
+/// To avoid deadlocks, the caller must *not* acquire the locks of
+/// ImpalaServer::query_exec_state_map_ while holding the exec state's lock, except to
+/// register the query (see ImpalaServer::ExecuteInternal()).
 /// TODO: Consider renaming to RequestExecState for consistency.
 /// TODO: Compute stats is the only stmt that requires child queries. Once the
 /// CatalogService performs background stats gathering the concept of child queries
@@ -166,6 +169,8 @@ class ImpalaServer::QueryExecState {
   void set_query_state(beeswax::QueryState::type state) { query_state_ = state; }
   const Status& query_status() const { return query_status_; }
   void set_result_metadata(const TResultSetMetadata& md) { result_metadata_ = md; }
+  void set_result_cache_key(const std::string& key) { result_cache_key_ = key; }
+  const std::string& plan_fingerprint() const { return plan_fingerprint_; }
   const RuntimeProfile& profile() const { return profile_; }
   const RuntimeProfile& summary_profile() const { return summary_profile_; }
   const TimestampValue& start_time() const { return start_time_; }
@@ -226,6 +231,11 @@ class ImpalaServer::QueryExecState {
   /// Used in conjunction with block_on_wait_cv_ to make BlockOnWait() thread-safe.
   bool is_block_on_wait_joining_;
 
+  /// Thread running PrefetchResults(). Started by Wait() if --result_prefetch_batches
+  /// is > 0 and this is a query that returns rows; then all rows from the coordinator
+  /// are fetched through it. Joined in Done().
+  boost::scoped_ptr<Thread> prefetch_thread_;
+
   /// Session that this query is from
   boost::shared_ptr<SessionState> session_;
 
@@ -252,6 +262,22 @@ class ImpalaServer::QueryExecState {
   /// Max size of the result_cache_ in number of rows. A value <= 0 means no caching.
   int64_t result_cache_max_size_;
 
+  /// Key of the results of this query in the server's query result cache, see
+  /// ImpalaServer::GetQueryResultCacheKey(). Empty if they cannot be cached.
+  std::string result_cache_key_;
+
+  /// Fingerprint of the plan of a query or DML statement, see
+  /// PlanHistory::ComputeFingerprint(). Empty for other statements.
+  std::string plan_fingerprint_;
+
+  /// The cached results of an earlier identical query, if this query is answered from
+  /// the server's query result cache instead of being executed.
+  boost::shared_ptr<QueryResultCache::Entry> cached_results_;
+
+  /// The results fetched so far, which are added to the server's query result cache once
+  /// all are fetched. Set to NULL if they exceed its capacity.
+  boost::shared_ptr<QueryResultCache::Entry> captured_results_;
+
   /// local runtime_state_ in case we don't have a coord_
   boost::scoped_ptr<RuntimeState> local_runtime_state_;
   ObjectPool profile_pool_;
@@ -294,6 +320,30 @@ class ImpalaServer::QueryExecState {
   /// (or error) was returned to the client.
   bool fetched_rows_;
 
+  /// Number of rows of the first result set in prefetched_results_ that were fetched by
+  /// the client. Only accessed by the fetching thread.
+  int prefetched_row_idx_;
+
+  /// Protects the members below, which are shared with prefetch_thread_. lock_ must
+  /// not be taken while holding it.
+  boost::mutex prefetch_lock_;
+
+  /// Signalled when a result set is added to or removed from prefetched_results_, and
+  /// when prefetching ends.
+  boost::condition_variable prefetch_cv_;
+
+  /// Batches from the coordinator, converted by the prefetch thread and waiting to be
+  /// fetched.
+  std::deque<boost::shared_ptr<QueryResultSet> > prefetched_results_;
+
+  /// Set to true once PrefetchResults() reached eos or an error, which is stored in
+  /// prefetch_status_.
+  bool prefetch_done_;
+  Status prefetch_status_;
+
+  /// Set by StopPrefetch().
+  bool prefetch_cancelled_;
+
   /// To get access to UpdateCatalog, LOAD, and DDL methods. Not owned.
   Frontend* frontend_;
 
@@ -354,10 +404,30 @@ class ImpalaServer::QueryExecState {
   /// released.
   Status FetchNextBatch();
 
-  /// Evaluates 'output_expr_ctxs_' against 'row' and output the evaluated row in
-  /// 'result'. The values' scales (# of digits after decimal) are stored in 'scales'.
-  /// result and scales must have been resized to the number of columns before call.
-  Status GetRowValue(TupleRow* row, std::vector<void*>* result, std::vector<int>* scales);
+  /// Looks up result_cache_key_ in the server's query result cache and sets
+  /// cached_results_ if there is an entry. Otherwise prepares captured_results_.
+  /// Returns true if the query is answered from the cache.
+  bool LookupQueryResultCache();
+
+  /// Adds the rows of 'fetched_rows' from 'start_idx' on to captured_results_.
+  void CaptureResults(QueryResultSet* fetched_rows, int start_idx);
+
+  /// Returns a new, empty result set of the client protocol of this query.
+  QueryResultSet* CreateResultSet(const TResultSetMetadata& metadata);
+
+  /// Run by prefetch_thread_. Fetches batches from the coordinator and converts them
+  /// into prefetched_results_ while fewer than --result_prefetch_batches are queued.
+  /// Returns at eos, on an error or once StopPrefetch() was called.
+  void PrefetchResults();
+
+  /// Adds up to 'max_rows' rows (<= 0 means no limit) of the first result set in
+  /// prefetched_results_ to 'fetched_rows', waiting for one if the queue is empty. Sets
+  /// eos_ once all results were fetched. Releases and re-takes lock_, which must be
+  /// held, while waiting.
+  Status FetchPrefetchedRows(int32_t max_rows, QueryResultSet* fetched_rows);
+
+  /// Makes PrefetchResults() return once it is no longer blocked in the coordinator.
+  void StopPrefetch();
 
   /// Gather and publish all required updates to the metastore
   Status UpdateCatalog();
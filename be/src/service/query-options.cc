@@ -36,6 +36,10 @@ using boost::algorithm::trim;
 using namespace impala;
 using namespace strings;
 
+// Upper bound of INSTANCES_PER_HOST, to catch typos before they start thousands of
+// fragment instances.
+static const int32_t MAX_INSTANCES_PER_HOST = 128;
+
 // Utility method to wrap ParseUtil::ParseMemSpec() by returning a Status instead of an
 // int.
 static Status ParseMemValue(const string& value, const string& key, int64_t* result) {
@@ -176,6 +180,8 @@ Status impala::SetQueryOption(const string& key, const string& value,
           query_options->__set_compression_codec(THdfsCompression::SNAPPY);
         } else if (iequals(value, "snappy_blocked")) {
           query_options->__set_compression_codec(THdfsCompression::SNAPPY_BLOCKED);
+        } else if (iequals(value, "zstd")) {
+          query_options->__set_compression_codec(THdfsCompression::ZSTD);
         } else {
           stringstream ss;
           ss << "Invalid compression codec: " << value;
@@ -362,6 +368,44 @@ Status impala::SetQueryOption(const string& key, const string& value,
         query_options->__set_max_num_runtime_filters(val);
         break;
       }
+      case TImpalaQueryOptions::RANGE_PARTITIONED_SORT:
+        query_options->__set_range_partitioned_sort(
+            iequals(value, "true") || iequals(value, "1"));
+        break;
+      case TImpalaQueryOptions::COMPACT_TUPLE_LAYOUT:
+        query_options->__set_compact_tuple_layout(
+            iequals(value, "true") || iequals(value, "1"));
+        break;
+      case TImpalaQueryOptions::DISABLE_CODEGEN_ROWS_THRESHOLD: {
+        StringParser::ParseResult result;
+        const int64_t threshold =
+            StringParser::StringToInt<int64_t>(value.c_str(), value.length(), &result);
+        if (result != StringParser::PARSE_SUCCESS || threshold < 0) {
+          return Status(Substitute("Invalid codegen rows threshold: '$0'. Only "
+              "non-negative numbers are allowed.", value));
+        }
+        query_options->__set_disable_codegen_rows_threshold(threshold);
+        break;
+      }
+      case TImpalaQueryOptions::INSTANCES_PER_HOST: {
+        StringParser::ParseResult result;
+        const int32_t instances =
+            StringParser::StringToInt<int32_t>(value.c_str(), value.length(), &result);
+        if (result != StringParser::PARSE_SUCCESS || instances < 1 ||
+            instances > MAX_INSTANCES_PER_HOST) {
+          return Status(Substitute("Invalid number of instances per host: '$0'. Only "
+              "values from 1 to $1 are allowed.", value, MAX_INSTANCES_PER_HOST));
+        }
+        query_options->__set_instances_per_host(instances);
+        break;
+      }
+      case TImpalaQueryOptions::PARQUET_BLOOM_FILTER_COLUMNS:
+        query_options->__set_parquet_bloom_filter_columns(value);
+        break;
+      case TImpalaQueryOptions::ENABLE_HW_PERF_COUNTERS:
+        query_options->__set_enable_hw_perf_counters(
+            iequals(value, "true") || iequals(value, "1"));
+        break;
       default:
         // We hit this DCHECK(false) if we forgot to add the corresponding entry here
         // when we add a new query option.
@@ -32,7 +32,7 @@ class TQueryOptions;
 // the DCHECK.
 #define QUERY_OPTS_TABLE\
   DCHECK_EQ(_TImpalaQueryOptions_VALUES_TO_NAMES.size(),\
-      TImpalaQueryOptions::MAX_NUM_RUNTIME_FILTERS + 1);\
+      TImpalaQueryOptions::ENABLE_HW_PERF_COUNTERS + 1);\
   QUERY_OPT_FN(abort_on_default_limit_exceeded, ABORT_ON_DEFAULT_LIMIT_EXCEEDED)\
   QUERY_OPT_FN(abort_on_error, ABORT_ON_ERROR)\
   QUERY_OPT_FN(allow_unsupported_formats, ALLOW_UNSUPPORTED_FORMATS)\
@@ -73,7 +73,13 @@ class TQueryOptions;
   QUERY_OPT_FN(runtime_bloom_filter_size, RUNTIME_BLOOM_FILTER_SIZE)\
   QUERY_OPT_FN(runtime_filter_wait_time_ms, RUNTIME_FILTER_WAIT_TIME_MS)\
   QUERY_OPT_FN(disable_row_runtime_filtering, DISABLE_ROW_RUNTIME_FILTERING)\
-  QUERY_OPT_FN(max_num_runtime_filters, MAX_NUM_RUNTIME_FILTERS);
+  QUERY_OPT_FN(max_num_runtime_filters, MAX_NUM_RUNTIME_FILTERS)\
+  QUERY_OPT_FN(range_partitioned_sort, RANGE_PARTITIONED_SORT)\
+  QUERY_OPT_FN(compact_tuple_layout, COMPACT_TUPLE_LAYOUT)\
+  QUERY_OPT_FN(disable_codegen_rows_threshold, DISABLE_CODEGEN_ROWS_THRESHOLD)\
+  QUERY_OPT_FN(instances_per_host, INSTANCES_PER_HOST)\
+  QUERY_OPT_FN(parquet_bloom_filter_columns, PARQUET_BLOOM_FILTER_COLUMNS)\
+  QUERY_OPT_FN(enable_hw_perf_counters, ENABLE_HW_PERF_COUNTERS);
 
 /// Converts a TQueryOptions struct into a map of key, value pairs.
 void TQueryOptionsToMap(const TQueryOptions& query_options,
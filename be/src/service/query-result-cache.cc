@@ -0,0 +1,131 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "service/query-result-cache.h"
+
+#include <ctype.h>
+
+#include "common/logging.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+// Builtin functions whose results depend on more than their arguments.
+static const char* NONDETERMINISTIC_FUNCTIONS[] = {
+  "current_database", "current_timestamp", "effective_user", "now", "pid", "rand",
+  "random", "sleep", "timeofday", "unix_timestamp", "user", "uuid", NULL
+};
+
+ImpalaServer::QueryResultCache::QueryResultCache(int64_t capacity)
+  : capacity_(capacity),
+    size_(0) {
+}
+
+shared_ptr<ImpalaServer::QueryResultCache::Entry> ImpalaServer::QueryResultCache::Lookup(
+    const string& key) {
+  lock_guard<mutex> l(lock_);
+  EntryMap::iterator it = entries_.find(key);
+  if (it == entries_.end()) return shared_ptr<Entry>();
+  // Move to the back, this is now the most recently used entry.
+  lru_list_.splice(lru_list_.end(), lru_list_, it->second);
+  return it->second->entry;
+}
+
+void ImpalaServer::QueryResultCache::Insert(const string& key,
+    const shared_ptr<Entry>& entry) {
+  DCHECK(entry.get() != NULL);
+  LruEntry lru_entry;
+  lru_entry.key = key;
+  lru_entry.entry = entry;
+  int64_t charge = Charge(lru_entry);
+  if (charge > capacity_) return;
+  lock_guard<mutex> l(lock_);
+  EntryMap::iterator existing = entries_.find(key);
+  if (existing != entries_.end()) RemoveEntry(existing->second);
+  while (size_ + charge > capacity_) {
+    DCHECK(!lru_list_.empty());
+    RemoveEntry(lru_list_.begin());
+  }
+  entries_[key] = lru_list_.insert(lru_list_.end(), lru_entry);
+  size_ += charge;
+}
+
+void ImpalaServer::QueryResultCache::RemoveEntry(EntryList::iterator it) {
+  size_ -= Charge(*it);
+  entries_.erase(it->key);
+  lru_list_.erase(it);
+}
+
+string ImpalaServer::QueryResultCache::NormalizeStatement(const string& stmt) {
+  string result;
+  result.reserve(stmt.size());
+  int i = 0;
+  while (i < stmt.size()) {
+    char c = stmt[i];
+    if (c == '\'' || c == '"' || c == '`') {
+      // Copy quoted literals and identifiers verbatim, including escaped characters.
+      int end = i + 1;
+      while (end < stmt.size() && stmt[end] != c) end += (stmt[end] == '\\') ? 2 : 1;
+      end = min<int>(end + 1, stmt.size());
+      result.append(stmt, i, end - i);
+      i = end;
+    } else if (c == '-' && i + 1 < stmt.size() && stmt[i + 1] == '-') {
+      // Comments are treated as whitespace.
+      while (i < stmt.size() && stmt[i] != '\n') ++i;
+      c = ' ';
+    } else if (c == '/' && i + 1 < stmt.size() && stmt[i + 1] == '*') {
+      size_t end = stmt.find("*/", i + 2);
+      i = (end == string::npos) ? stmt.size() : end + 2;
+      c = ' ';
+    } else {
+      ++i;
+    }
+    if (isspace(c)) {
+      if (!result.empty() && result[result.size() - 1] != ' ') result += ' ';
+    } else if (c != '\'' && c != '"' && c != '`') {
+      result += tolower(c);
+    }
+  }
+  while (!result.empty() &&
+      (result[result.size() - 1] == ' ' || result[result.size() - 1] == ';')) {
+    result.erase(result.size() - 1);
+  }
+  return result;
+}
+
+bool ImpalaServer::QueryResultCache::CallsNondeterministicFunction(const string& stmt) {
+  int i = 0;
+  while (i < stmt.size()) {
+    char c = stmt[i];
+    if (c == '\'' || c == '"' || c == '`') {
+      ++i;
+      while (i < stmt.size() && stmt[i] != c) i += (stmt[i] == '\\') ? 2 : 1;
+      ++i;
+      continue;
+    }
+    if (!isalnum(c) && c != '_') {
+      ++i;
+      continue;
+    }
+    int start = i;
+    while (i < stmt.size() && (isalnum(stmt[i]) || stmt[i] == '_')) ++i;
+    int paren = (i < stmt.size() && stmt[i] == ' ') ? i + 1 : i;
+    if (paren >= stmt.size() || stmt[paren] != '(') continue;
+    for (const char** fn = NONDETERMINISTIC_FUNCTIONS; *fn != NULL; ++fn) {
+      if (stmt.compare(start, i - start, *fn) == 0) return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,110 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_SERVICE_QUERY_RESULT_CACHE_H
+#define IMPALA_SERVICE_QUERY_RESULT_CACHE_H
+
+#include <list>
+#include <string>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+#include "service/impala-server.h"
+#include "gen-cpp/Results_types.h"
+
+namespace impala {
+
+/// Impalad-wide cache of the complete results of queries, so that repeated identical
+/// queries, e.g. of dashboards, are answered without executing them again.
+///
+/// Entries are keyed by ImpalaServer::GetQueryResultCacheKey(), which includes the
+/// normalized statement, the query options, the client protocol the results were
+/// converted for and the catalog versions of all tables and views the query references.
+/// Any change to one of these tables results in a different key, so outdated entries are
+/// never returned; they are evicted in least recently used order once the total size of
+/// the entries exceeds the capacity.
+///
+/// This class is thread-safe.
+class ImpalaServer::QueryResultCache {
+ public:
+  /// The results of one query, converted for the client protocol they were fetched
+  /// with. Not modified once inserted into the cache.
+  struct Entry {
+    /// Owned here because 'results' refers to it.
+    TResultSetMetadata metadata;
+    boost::scoped_ptr<QueryResultSet> results;
+
+    /// Approximate size of 'results' in bytes.
+    int64_t byte_size;
+
+    Entry() : byte_size(0) { }
+  };
+
+  QueryResultCache(int64_t capacity);
+
+  int64_t capacity() const { return capacity_; }
+
+  /// Returns the entry for 'key', or NULL if there is none.
+  boost::shared_ptr<Entry> Lookup(const std::string& key);
+
+  /// Inserts 'entry' for 'key'. Replaces an existing entry for the same key.
+  void Insert(const std::string& key, const boost::shared_ptr<Entry>& entry);
+
+  /// Returns 'stmt' with comments removed, runs of whitespace replaced by a single space
+  /// and everything but quoted literals and identifiers in lower case, so that statements
+  /// that only differ in formatting have the same key.
+  static std::string NormalizeStatement(const std::string& stmt);
+
+  /// Returns true if the normalized statement 'stmt' calls a builtin function whose
+  /// result does not only depend on its arguments, e.g. now() or rand(). The results of
+  /// such statements must not be cached.
+  static bool CallsNondeterministicFunction(const std::string& stmt);
+
+ private:
+  struct LruEntry {
+    std::string key;
+    boost::shared_ptr<Entry> entry;
+  };
+
+  typedef std::list<LruEntry> EntryList;
+  typedef boost::unordered_map<std::string, EntryList::iterator> EntryMap;
+
+  /// Returns the charge of an entry against the capacity.
+  static int64_t Charge(const LruEntry& e) { return e.key.size() + e.entry->byte_size; }
+
+  /// Removes the entry at 'it'. 'lock_' must be taken.
+  void RemoveEntry(EntryList::iterator it);
+
+  const int64_t capacity_;
+
+  /// Protects all members below.
+  boost::mutex lock_;
+
+  /// All entries, in least recently used order: new and accessed entries go to the
+  /// back, evictions take from the front.
+  EntryList lru_list_;
+
+  /// Maps each key to its entry in 'lru_list_'.
+  EntryMap entries_;
+
+  /// Sum of the charges of the entries in 'entries_'.
+  int64_t size_;
+};
+
+}
+
+#endif
@@ -22,6 +22,7 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/thread/shared_mutex.hpp>
 #include <gutil/strings/substitute.h>
+#include <snappy.h>
 
 #include "common/logging.h"
 #include "common/status.h"
@@ -44,6 +45,10 @@ DEFINE_int32(statestore_subscriber_cnxn_attempts, 10, "The number of times to re
     "RPC connection to the statestore. A setting of 0 means retry indefinitely");
 DEFINE_int32(statestore_subscriber_cnxn_retry_interval_ms, 3000, "The interval, in ms, "
     "to wait between attempts to make an RPC connection to the statestore.");
+DEFINE_int32(statestore_compression_threshold_bytes, 4 * 1024, "(Advanced) Topic entry "
+    "values of at least this size that this subscriber publishes are compressed before "
+    "they are sent to the statestore, which forwards them compressed to the other "
+    "subscribers. A value of 0 disables compression.");
 DECLARE_string(ssl_client_ca_certificate);
 
 namespace impala {
@@ -283,6 +288,55 @@ void StatestoreSubscriber::Heartbeat(const TUniqueId& registration_id) {
   }
 }
 
+// Returns true if any entry in 'topic_deltas' has a compressed value.
+static bool HasCompressedValues(const StatestoreSubscriber::TopicDeltaMap& topic_deltas) {
+  BOOST_FOREACH(const StatestoreSubscriber::TopicDeltaMap::value_type& delta,
+      topic_deltas) {
+    BOOST_FOREACH(const TTopicItem& item, delta.second.topic_entries) {
+      if (item.__isset.compressed && item.compressed) return true;
+    }
+  }
+  return false;
+}
+
+// Decompresses all compressed values in 'topic_deltas' in place.
+static Status DecompressValues(StatestoreSubscriber::TopicDeltaMap* topic_deltas) {
+  BOOST_FOREACH(StatestoreSubscriber::TopicDeltaMap::value_type& delta, *topic_deltas) {
+    BOOST_FOREACH(TTopicItem& item, delta.second.topic_entries) {
+      if (!item.__isset.compressed || !item.compressed) continue;
+      string value;
+      if (!snappy::Uncompress(item.value.data(), item.value.size(), &value)) {
+        return Status(Substitute("Could not decompress the value of entry '$0' of topic "
+            "'$1'", item.key, delta.first));
+      }
+      item.value.swap(value);
+      item.__isset.compressed = false;
+      item.compressed = false;
+    }
+  }
+  return Status::OK();
+}
+
+// Compresses the values in 'topic_updates' of at least
+// --statestore_compression_threshold_bytes, if that makes them smaller.
+static void CompressValues(vector<TTopicDelta>* topic_updates) {
+  if (FLAGS_statestore_compression_threshold_bytes <= 0) return;
+  BOOST_FOREACH(TTopicDelta& update, *topic_updates) {
+    BOOST_FOREACH(TTopicItem& item, update.topic_entries) {
+      if (static_cast<int64_t>(item.value.size()) <
+          FLAGS_statestore_compression_threshold_bytes) {
+        continue;
+      }
+      if (item.__isset.compressed && item.compressed) continue;
+      string compressed;
+      snappy::Compress(item.value.data(), item.value.size(), &compressed);
+      if (compressed.size() >= item.value.size()) continue;
+      item.value.swap(compressed);
+      item.__set_compressed(true);
+    }
+  }
+}
+
 Status StatestoreSubscriber::UpdateState(const TopicDeltaMap& incoming_topic_deltas,
     const TUniqueId& registration_id, vector<TTopicDelta>* subscriber_topic_updates,
     bool* skipped) {
@@ -304,6 +358,16 @@ Status StatestoreSubscriber::UpdateState(const TopicDeltaMap& incoming_topic_del
     *skipped = false;
     RETURN_IF_ERROR(CheckRegistrationId(registration_id));
 
+    // Values that were compressed by their publisher are passed to the callbacks
+    // decompressed. Only then is a copy of the deltas needed.
+    const TopicDeltaMap* topic_deltas = &incoming_topic_deltas;
+    TopicDeltaMap decompressed_topic_deltas;
+    if (HasCompressedValues(incoming_topic_deltas)) {
+      decompressed_topic_deltas = incoming_topic_deltas;
+      RETURN_IF_ERROR(DecompressValues(&decompressed_topic_deltas));
+      topic_deltas = &decompressed_topic_deltas;
+    }
+
     // Only record updates received when not in recovery mode
     topic_update_interval_metric_->Update(
         topic_update_interval_timer_.Reset() / (1000.0 * 1000.0 * 1000.0));
@@ -343,11 +407,12 @@ Status StatestoreSubscriber::UpdateState(const TopicDeltaMap& incoming_topic_del
         BOOST_FOREACH(const UpdateCallback& callback, callbacks.second.callbacks) {
           // TODO: Consider filtering the topics to only send registered topics to
           // callbacks
-          callback(incoming_topic_deltas, subscriber_topic_updates);
+          callback(*topic_deltas, subscriber_topic_updates);
         }
         callbacks.second.processing_time_metric->Update(
             sw.ElapsedTime() / (1000.0 * 1000.0 * 1000.0));
       }
+      CompressValues(subscriber_topic_updates);
     }
     sw.Stop();
     topic_update_duration_metric_->Update(sw.ElapsedTime() / (1000.0 * 1000.0 * 1000.0));
@@ -43,6 +43,11 @@ DEFINE_int32(statestore_num_update_threads, 10, "(Advanced) Number of threads us
     " send topic updates in parallel to all registered subscribers.");
 DEFINE_int32(statestore_update_frequency_ms, 2000, "(Advanced) Frequency (in ms) with"
     " which the statestore sends topic updates to subscribers.");
+DEFINE_int32(statestore_min_update_interval_ms, 100, "(Advanced) Minimum interval (in "
+    "ms) between two topic updates to the same subscriber. When a topic changes, its "
+    "subscribers are sent an update as soon as this much time has passed since their "
+    "previous one, rather than waiting for --statestore_update_frequency_ms. Set to "
+    "--statestore_update_frequency_ms or larger to only send updates periodically.");
 
 DEFINE_int32(statestore_num_heartbeat_threads, 10, "(Advanced) Number of threads used to "
     " send heartbeats in parallel to all registered subscribers.");
@@ -118,14 +123,15 @@ class StatestoreThriftIf : public StatestoreServiceIf {
 };
 
 void Statestore::TopicEntry::SetValue(const Statestore::TopicEntry::Value& bytes,
-    TopicEntry::Version version) {
+    bool compressed, TopicEntry::Version version) {
   DCHECK(bytes == Statestore::TopicEntry::NULL_VALUE || bytes.size() > 0);
   value_ = bytes;
+  compressed_ = compressed;
   version_ = version;
 }
 
 Statestore::TopicEntry::Version Statestore::Topic::Put(const string& key,
-    const Statestore::TopicEntry::Value& bytes) {
+    const Statestore::TopicEntry::Value& bytes, bool compressed) {
   TopicEntryMap::iterator entry_it = entries_.find(key);
   int64_t key_size_delta = 0;
   int64_t value_size_delta = 0;
@@ -141,8 +147,9 @@ Statestore::TopicEntry::Version Statestore::Topic::Put(const string& key,
   }
   value_size_delta += bytes.size();
 
-  entry_it->second.SetValue(bytes, ++last_version_);
+  entry_it->second.SetValue(bytes, compressed, ++last_version_);
   topic_update_log_.insert(make_pair(entry_it->second.version(), key));
+  snapshot_.reset();
 
   total_key_size_bytes_ += key_size_delta;
   total_value_size_bytes_ += value_size_delta;
@@ -168,8 +175,40 @@ void Statestore::Topic::DeleteIfVersionsMatch(TopicEntry::Version version,
 
     value_size_metric_->Increment(entry_it->second.value().size());
     topic_size_metric_->Increment(entry_it->second.value().size());
-    entry_it->second.SetValue(Statestore::TopicEntry::NULL_VALUE, last_version_);
+    entry_it->second.SetValue(Statestore::TopicEntry::NULL_VALUE, false, last_version_);
+    snapshot_.reset();
+  }
+}
+
+shared_ptr<const TTopicDelta> Statestore::Topic::GetSnapshot() {
+  if (snapshot_.get() != NULL) {
+    DCHECK_EQ(snapshot_->to_version, static_cast<int64_t>(last_version_));
+    return snapshot_;
+  }
+  shared_ptr<TTopicDelta> snapshot(new TTopicDelta());
+  snapshot->topic_name = topic_id_;
+  snapshot->is_delta = false;
+  snapshot->__set_from_version(Subscriber::TOPIC_INITIAL_VERSION);
+  snapshot->topic_entries.reserve(entries_.size());
+  BOOST_FOREACH(const TopicUpdateLog::value_type& update, topic_update_log_) {
+    TopicEntryMap::const_iterator itr = entries_.find(update.second);
+    DCHECK(itr != entries_.end());
+    const TopicEntry& topic_entry = itr->second;
+    if (topic_entry.value() == Statestore::TopicEntry::NULL_VALUE) {
+      snapshot->topic_deletions.push_back(itr->first);
+    } else {
+      snapshot->topic_entries.push_back(TTopicItem());
+      TTopicItem& topic_item = snapshot->topic_entries.back();
+      topic_item.key = itr->first;
+      topic_item.value = topic_entry.value();
+      if (topic_entry.compressed()) topic_item.__set_compressed(true);
+    }
   }
+  // The largest version in the update log is last_version_, or there are no updates.
+  snapshot->__set_to_version(topic_update_log_.empty() ?
+      Subscriber::TOPIC_INITIAL_VERSION : topic_update_log_.rbegin()->first);
+  snapshot_ = snapshot;
+  return snapshot_;
 }
 
 Statestore::Subscriber::Subscriber(const SubscriberId& subscriber_id,
@@ -268,27 +307,29 @@ void Statestore::TopicsHandler(const Webserver::ArgumentMap& args,
 
   Value topics(kArrayType);
 
-  BOOST_FOREACH(const TopicMap::value_type& topic, topics_) {
+  BOOST_FOREACH(const TopicMap::value_type& topic_it, topics_) {
+    const Topic& topic = *topic_it.second;
+    lock_guard<mutex> topic_lock(*topic_it.second->lock());
     Value topic_json(kObjectType);
 
-    Value topic_id(topic.second.id().c_str(), document->GetAllocator());
+    Value topic_id(topic.id().c_str(), document->GetAllocator());
     topic_json.AddMember("topic_id", topic_id, document->GetAllocator());
     topic_json.AddMember("num_entries",
-        static_cast<uint64_t>(topic.second.entries().size()),
+        static_cast<uint64_t>(topic.entries().size()),
         document->GetAllocator());
-    topic_json.AddMember("version", topic.second.last_version(), document->GetAllocator());
+    topic_json.AddMember("version", topic.last_version(), document->GetAllocator());
 
     SubscriberId oldest_subscriber_id;
     TopicEntry::Version oldest_subscriber_version =
-        GetMinSubscriberTopicVersion(topic.first, &oldest_subscriber_id);
+        GetMinSubscriberTopicVersion(topic.id(), &oldest_subscriber_id);
 
     topic_json.AddMember("oldest_version", oldest_subscriber_version,
         document->GetAllocator());
     Value oldest_id(oldest_subscriber_id.c_str(), document->GetAllocator());
     topic_json.AddMember("oldest_id", oldest_id, document->GetAllocator());
 
-    int64_t key_size = topic.second.total_key_size_bytes();
-    int64_t value_size = topic.second.total_value_size_bytes();
+    int64_t key_size = topic.total_key_size_bytes();
+    int64_t value_size = topic.total_value_size_bytes();
     Value key_size_json(PrettyPrinter::Print(key_size, TUnit::BYTES).c_str(),
         document->GetAllocator());
     topic_json.AddMember("key_size", key_size_json, document->GetAllocator());
@@ -365,8 +406,9 @@ Status Statestore::RegisterSubscriber(const SubscriberId& subscriber_id,
       if (topic_it == topics_.end()) {
         LOG(INFO) << "Creating new topic: ''" << topic.topic_name
                   << "' on behalf of subscriber: '" << subscriber_id;
-        topics_.insert(make_pair(topic.topic_name, Topic(topic.topic_name,
-            key_size_metric_, value_size_metric_, topic_size_metric_)));
+        topics_.insert(make_pair(topic.topic_name, shared_ptr<Topic>(new Topic(
+            topic.topic_name, key_size_metric_, value_size_metric_,
+            topic_size_metric_))));
       }
     }
   }
@@ -447,109 +489,119 @@ Status Statestore::SendTopicUpdate(Subscriber* subscriber, bool* update_skipped)
   }
 
   // Thirdly: perform any / all updates returned by the subscriber
-  {
-    lock_guard<mutex> l(topic_lock_);
-    BOOST_FOREACH(const TTopicDelta& update, response.topic_updates) {
-      TopicMap::iterator topic_it = topics_.find(update.topic_name);
-      if (topic_it == topics_.end()) {
-        VLOG(1) << "Received update for unexpected topic:" << update.topic_name;
-        continue;
-      }
-
-      VLOG_RPC << "Received update for topic " << update.topic_name
-               << " from  " << subscriber->id() << ", number of entries: "
-               << update.topic_entries.size();
-
-      // The subscriber sent back their from_version which indicates that they want to
-      // reset their max version for this topic to this value. The next update sent will
-      // be from this version.
-      if (update.__isset.from_version) {
-        LOG(INFO) << "Received request for different delta base of topic: "
-                  << update.topic_name << " from: " << subscriber->id()
-                  << " subscriber from_version: " << update.from_version;
-        subscriber->SetLastTopicVersionProcessed(topic_it->first, update.from_version);
-      }
+  bool topic_changed = false;
+  BOOST_FOREACH(const TTopicDelta& update, response.topic_updates) {
+    shared_ptr<Topic> topic = GetTopic(update.topic_name);
+    if (topic.get() == NULL) {
+      VLOG(1) << "Received update for unexpected topic:" << update.topic_name;
+      continue;
+    }
+    lock_guard<mutex> l(*topic->lock());
+
+    VLOG_RPC << "Received update for topic " << update.topic_name
+             << " from  " << subscriber->id() << ", number of entries: "
+             << update.topic_entries.size();
+
+    // The subscriber sent back their from_version which indicates that they want to
+    // reset their max version for this topic to this value. The next update sent will
+    // be from this version.
+    if (update.__isset.from_version) {
+      LOG(INFO) << "Received request for different delta base of topic: "
+                << update.topic_name << " from: " << subscriber->id()
+                << " subscriber from_version: " << update.from_version;
+      subscriber->SetLastTopicVersionProcessed(topic->id(), update.from_version);
+    }
 
-      Topic* topic = &topic_it->second;
-      BOOST_FOREACH(const TTopicItem& item, update.topic_entries) {
-        TopicEntry::Version version = topic->Put(item.key, item.value);
-        subscriber->AddTransientUpdate(update.topic_name, item.key, version);
-      }
+    BOOST_FOREACH(const TTopicItem& item, update.topic_entries) {
+      TopicEntry::Version version = topic->Put(item.key, item.value,
+          item.__isset.compressed && item.compressed);
+      subscriber->AddTransientUpdate(update.topic_name, item.key, version);
+    }
 
-      BOOST_FOREACH(const string& key, update.topic_deletions) {
-        TopicEntry::Version version =
-            topic->Put(key, Statestore::TopicEntry::NULL_VALUE);
-        subscriber->AddTransientUpdate(update.topic_name, key, version);
-      }
+    BOOST_FOREACH(const string& key, update.topic_deletions) {
+      TopicEntry::Version version =
+          topic->Put(key, Statestore::TopicEntry::NULL_VALUE, false);
+      subscriber->AddTransientUpdate(update.topic_name, key, version);
+    }
+    if (!update.topic_entries.empty() || !update.topic_deletions.empty()) {
+      topic_changed = true;
     }
   }
+  if (topic_changed) NotifyTopicChanged();
   topic_update_duration_metric_->Update(sw.ElapsedTime() / (1000.0 * 1000.0 * 1000.0));
   return Status::OK();
 }
 
 void Statestore::GatherTopicUpdates(const Subscriber& subscriber,
     TUpdateStateRequest* update_state_request) {
-  {
-    lock_guard<mutex> l(topic_lock_);
-    BOOST_FOREACH(const Subscriber::Topics::value_type& subscribed_topic,
-        subscriber.subscribed_topics()) {
-      TopicMap::const_iterator topic_it = topics_.find(subscribed_topic.first);
-      DCHECK(topic_it != topics_.end());
-
-      TopicEntry::Version last_processed_version =
-          subscriber.LastTopicVersionProcessed(topic_it->first);
-      const Topic& topic = topic_it->second;
-
-      TTopicDelta& topic_delta =
-          update_state_request->topic_deltas[subscribed_topic.first];
-      topic_delta.topic_name = subscribed_topic.first;
-
-      // If the subscriber version is > 0, send this update as a delta. Otherwise, this is
-      // a new subscriber so send them a non-delta update that includes all items in the
-      // topic.
-      topic_delta.is_delta = last_processed_version > Subscriber::TOPIC_INITIAL_VERSION;
-      topic_delta.__set_from_version(last_processed_version);
-
-      if (!topic_delta.is_delta &&
-          topic.last_version() > Subscriber::TOPIC_INITIAL_VERSION) {
+  // Non-delta updates of topics, which are copied into the request after releasing the
+  // topic locks.
+  vector<shared_ptr<const TTopicDelta> > snapshots;
+  BOOST_FOREACH(const Subscriber::Topics::value_type& subscribed_topic,
+      subscriber.subscribed_topics()) {
+    shared_ptr<Topic> topic_ptr = GetTopic(subscribed_topic.first);
+    DCHECK(topic_ptr.get() != NULL);
+    Topic& topic = *topic_ptr;
+    lock_guard<mutex> l(*topic.lock());
+    TopicEntry::Version last_processed_version =
+        subscriber.LastTopicVersionProcessed(topic.id());
+
+    // If the subscriber version is > 0, send this update as a delta. Otherwise, this is
+    // a new subscriber so send them a non-delta update that includes all items in the
+    // topic.
+    if (last_processed_version == Subscriber::TOPIC_INITIAL_VERSION) {
+      if (topic.last_version() > Subscriber::TOPIC_INITIAL_VERSION) {
         int64_t topic_size =
             topic.total_key_size_bytes() + topic.total_value_size_bytes();
-        VLOG_QUERY << "Preparing initial " << topic_delta.topic_name
+        VLOG_QUERY << "Preparing initial " << topic.id()
                    << " topic update for " << subscriber.id() << ". Size = "
                    << PrettyPrinter::Print(topic_size, TUnit::BYTES);
       }
+      snapshots.push_back(topic.GetSnapshot());
+      continue;
+    }
 
-      TopicUpdateLog::const_iterator next_update =
-          topic.topic_update_log().upper_bound(last_processed_version);
-
-      for (; next_update != topic.topic_update_log().end(); ++next_update) {
-        TopicEntryMap::const_iterator itr = topic.entries().find(next_update->second);
-        DCHECK(itr != topic.entries().end());
-        const TopicEntry& topic_entry = itr->second;
-        if (topic_entry.value() == Statestore::TopicEntry::NULL_VALUE) {
-          topic_delta.topic_deletions.push_back(itr->first);
-        } else {
-          topic_delta.topic_entries.push_back(TTopicItem());
-          TTopicItem& topic_item = topic_delta.topic_entries.back();
-          topic_item.key = itr->first;
-          // TODO: Does this do a needless copy?
-          topic_item.value = topic_entry.value();
-        }
-      }
-
-      if (topic.topic_update_log().size() > 0) {
-        // The largest version for this topic will be the last item in the version history
-        // map.
-        topic_delta.__set_to_version(topic.topic_update_log().rbegin()->first);
+    TTopicDelta& topic_delta =
+        update_state_request->topic_deltas[subscribed_topic.first];
+    topic_delta.topic_name = subscribed_topic.first;
+    topic_delta.is_delta = true;
+    topic_delta.__set_from_version(last_processed_version);
+
+    TopicUpdateLog::const_iterator next_update =
+        topic.topic_update_log().upper_bound(last_processed_version);
+
+    for (; next_update != topic.topic_update_log().end(); ++next_update) {
+      TopicEntryMap::const_iterator itr = topic.entries().find(next_update->second);
+      DCHECK(itr != topic.entries().end());
+      const TopicEntry& topic_entry = itr->second;
+      if (topic_entry.value() == Statestore::TopicEntry::NULL_VALUE) {
+        topic_delta.topic_deletions.push_back(itr->first);
       } else {
-        // There are no updates in the version history
-        topic_delta.__set_to_version(Subscriber::TOPIC_INITIAL_VERSION);
+        topic_delta.topic_entries.push_back(TTopicItem());
+        TTopicItem& topic_item = topic_delta.topic_entries.back();
+        topic_item.key = itr->first;
+        // TODO: Does this do a needless copy?
+        topic_item.value = topic_entry.value();
+        if (topic_entry.compressed()) topic_item.__set_compressed(true);
       }
     }
+
+    if (topic.topic_update_log().size() > 0) {
+      // The largest version for this topic will be the last item in the version history
+      // map.
+      topic_delta.__set_to_version(topic.topic_update_log().rbegin()->first);
+    } else {
+      // There are no updates in the version history
+      topic_delta.__set_to_version(Subscriber::TOPIC_INITIAL_VERSION);
+    }
   }
 
-  // Fill in the min subscriber topic version. This must be done after releasing
-  // topic_lock_.
+  BOOST_FOREACH(const shared_ptr<const TTopicDelta>& snapshot, snapshots) {
+    update_state_request->topic_deltas[snapshot->topic_name] = *snapshot;
+  }
+
+  // Fill in the min subscriber topic version. This must be done after releasing the
+  // topic locks.
   lock_guard<mutex> l(subscribers_lock_);
   typedef map<TopicId, TTopicDelta> TopicDeltaMap;
   BOOST_FOREACH(TopicDeltaMap::value_type& topic_delta,
@@ -609,18 +661,72 @@ Status Statestore::SendHeartbeat(Subscriber* subscriber) {
   return Status::OK();
 }
 
+void Statestore::WaitForTopicUpdate(const SubscriberId& subscriber_id,
+    int64_t deadline_ms) {
+  shared_ptr<Subscriber> subscriber;
+  {
+    lock_guard<mutex> l(subscribers_lock_);
+    SubscriberMap::iterator it = subscribers_.find(subscriber_id);
+    if (it == subscribers_.end()) return;
+    subscriber = it->second;
+  }
+  // The deadline was set one update interval after the previous update. Subscribers that
+  // skipped the previous update have a longer interval and are not pushed to as early.
+  int64_t earliest_push_ms = min<int64_t>(deadline_ms,
+      deadline_ms - FLAGS_statestore_update_frequency_ms +
+      FLAGS_statestore_min_update_interval_ms);
+  unique_lock<mutex> l(topic_changed_lock_);
+  while (true) {
+    int64_t now_ms = UnixMillis();
+    if (now_ms >= deadline_ms) return;
+    if (now_ms >= earliest_push_ms && HasPendingTopicUpdates(*subscriber)) return;
+    int64_t wait_until_ms = now_ms < earliest_push_ms ? earliest_push_ms : deadline_ms;
+    topic_changed_cv_.timed_wait(l,
+        boost::posix_time::milliseconds(wait_until_ms - now_ms));
+  }
+}
+
+bool Statestore::HasPendingTopicUpdates(const Subscriber& subscriber) {
+  BOOST_FOREACH(const Subscriber::Topics::value_type& subscribed_topic,
+      subscriber.subscribed_topics()) {
+    shared_ptr<Topic> topic = GetTopic(subscribed_topic.first);
+    DCHECK(topic.get() != NULL);
+    lock_guard<mutex> l(*topic->lock());
+    if (topic->last_version() > subscribed_topic.second.last_version) return true;
+  }
+  return false;
+}
+
+void Statestore::NotifyTopicChanged() {
+  // Taking the lock ensures that no thread in WaitForTopicUpdate() is between checking
+  // for changes and waiting, in which case it would miss this notification.
+  { lock_guard<mutex> l(topic_changed_lock_); }
+  topic_changed_cv_.notify_all();
+}
+
+shared_ptr<Statestore::Topic> Statestore::GetTopic(const TopicId& topic_id) {
+  lock_guard<mutex> l(topic_lock_);
+  TopicMap::iterator topic_it = topics_.find(topic_id);
+  if (topic_it == topics_.end()) return shared_ptr<Topic>();
+  return topic_it->second;
+}
+
 void Statestore::DoSubscriberUpdate(bool is_heartbeat, int thread_id,
     const ScheduledSubscriberUpdate& update) {
   int64_t update_deadline = update.first;
   const string hb_type = is_heartbeat ? "heartbeat" : "topic update";
   if (update_deadline != 0) {
-    // Wait until deadline.
-    int64_t diff_ms = update_deadline - UnixMillis();
-    while (diff_ms > 0) {
-      SleepForMs(diff_ms);
-      diff_ms = update_deadline - UnixMillis();
+    // Wait until deadline. Topic updates may be sent earlier if a topic has changed.
+    if (is_heartbeat) {
+      int64_t diff_ms = update_deadline - UnixMillis();
+      while (diff_ms > 0) {
+        SleepForMs(diff_ms);
+        diff_ms = update_deadline - UnixMillis();
+      }
+    } else {
+      WaitForTopicUpdate(update.second, update_deadline);
     }
-    diff_ms = abs(diff_ms);
+    int64_t diff_ms = max<int64_t>(0, UnixMillis() - update_deadline);
     VLOG(3) << "Sending " << hb_type << " message to: " << update.second
             << " (deadline accuracy: " << diff_ms << "ms)";
 
@@ -733,14 +839,15 @@ void Statestore::UnregisterSubscriber(Subscriber* subscriber) {
   failure_detector_->EvictPeer(PrintId(subscriber->registration_id()));
 
   // Delete all transient entries
-  lock_guard<mutex> topic_lock(topic_lock_);
   BOOST_FOREACH(Statestore::Subscriber::TransientEntryMap::value_type entry,
       subscriber->transient_entries()) {
-    Statestore::TopicMap::iterator topic_it = topics_.find(entry.first.first);
-    DCHECK(topic_it != topics_.end());
-    topic_it->second.DeleteIfVersionsMatch(entry.second, // version
+    shared_ptr<Topic> topic = GetTopic(entry.first.first);
+    DCHECK(topic.get() != NULL);
+    lock_guard<mutex> topic_lock(*topic->lock());
+    topic->DeleteIfVersionsMatch(entry.second, // version
         entry.first.second); // key
   }
+  if (!subscriber->transient_entries().empty()) NotifyTopicChanged();
   num_subscribers_metric_->Increment(-1L);
   subscriber_set_metric_->Remove(subscriber->id());
   subscribers_.erase(subscriber->id());
@@ -75,7 +75,14 @@ class Status;
 /// Subscribers also track the max version of each topic which they have have successfully
 /// processed. The statestore can use this information to send a delta of updates to a
 /// subscriber, rather than all items in the topic.  For non-delta updates, the statestore
-/// will send an update that includes all values in the topic.
+/// will send an update that includes all values in the topic. That update is built once
+/// per topic version and shared by all subscribers that bootstrap from it, see
+/// Topic::GetSnapshot().
+//
+/// Topic updates are also sent before their deadline when a subscribed topic has changed,
+/// but no sooner than --statestore_min_update_interval_ms after the previous update to
+/// the same subscriber, so that bursts of changes are coalesced into a single update.
+/// See WaitForTopicUpdate().
 class Statestore {
  public:
   /// A SubscriberId uniquely identifies a single subscriber, and is
@@ -143,12 +150,15 @@ class Statestore {
     /// Sets the value of this entry to the byte / length pair. NULL_VALUE implies this
     /// entry has been deleted.  The caller is responsible for ensuring, if required, that
     /// the version parameter is larger than the current version() TODO: Consider enforcing
-    /// version monotonicity here.
-    void SetValue(const Value& bytes, Version version);
+    /// version monotonicity here. 'compressed' is true if the publisher compressed the
+    /// value, see TTopicItem.compressed.
+    void SetValue(const Value& bytes, bool compressed, Version version);
 
-    TopicEntry() : value_(NULL_VALUE), version_(TOPIC_ENTRY_INITIAL_VERSION) { }
+    TopicEntry()
+      : value_(NULL_VALUE), compressed_(false), version_(TOPIC_ENTRY_INITIAL_VERSION) { }
 
     const Value& value() const { return value_; }
+    bool compressed() const { return compressed_; }
     uint64_t version() const { return version_; }
     uint32_t length() const { return value_.size(); }
 
@@ -157,6 +167,9 @@ class Statestore {
     /// and is interpreted only by subscribers.
     Value value_;
 
+    /// True if value_ was compressed by the subscriber that published it.
+    bool compressed_;
+
     /// The version of this entry. Every update is assigned a monotonically increasing
     /// version number so that only the minimal set of changes can be sent from the
     /// statestore to a subscriber.
@@ -175,6 +188,9 @@ class Statestore {
   //
   /// Each topic has a unique version number that tracks the number of updates made to the
   /// topic. This is to support sending only the delta of changes on every update.
+  //
+  /// Each topic is protected by its own lock, so that sending a large topic (e.g. the
+  /// catalog) to a subscriber does not hold up the updates of other topics.
   class Topic {
    public:
     Topic(const TopicId& topic_id, IntGauge* key_size_metric,
@@ -188,7 +204,8 @@ class Statestore {
     /// version number by the Topic, and that version number is returned.
     //
     /// Must be called holding the topic lock
-    TopicEntry::Version Put(const TopicEntryKey& key, const TopicEntry::Value& bytes);
+    TopicEntry::Version Put(const TopicEntryKey& key, const TopicEntry::Value& bytes,
+        bool compressed);
 
     /// Utility method to support removing transient entries. We track the version numbers
     /// of entries added by subscribers, and remove entries with the same version number
@@ -201,6 +218,18 @@ class Statestore {
     /// Must be called holding the topic lock
     void DeleteIfVersionsMatch(TopicEntry::Version version, const TopicEntryKey& key);
 
+    /// Returns the non-delta update of this topic at last_version(), which contains all
+    /// entries of the topic. It is built on the first call after the topic changed, and
+    /// shared by all callers until the topic changes again, so that bootstrapping many
+    /// subscribers at once does not traverse a large topic for each of them. Callers
+    /// should copy it after releasing the topic lock.
+    //
+    /// Must be called holding the topic lock
+    boost::shared_ptr<const TTopicDelta> GetSnapshot();
+
+    /// The topic lock, which protects all members below except topic_id_.
+    boost::mutex* lock() { return &lock_; }
+
     const TopicId& id() const { return topic_id_; }
     const TopicEntryMap& entries() const { return entries_; }
     TopicEntry::Version last_version() const { return last_version_; }
@@ -209,6 +238,8 @@ class Statestore {
     int64_t total_value_size_bytes() const { return total_value_size_bytes_; }
 
    private:
+    boost::mutex lock_;
+
     /// Map from topic entry key to topic entry.
     TopicEntryMap entries_;
 
@@ -229,6 +260,9 @@ class Statestore {
     /// this to find a way to do the look up using a single read.
     TopicUpdateLog topic_update_log_;
 
+    /// The result of GetSnapshot(), or NULL if it was not built since the last change.
+    boost::shared_ptr<const TTopicDelta> snapshot_;
+
     /// Total memory occupied by the key strings, in bytes
     int64_t total_key_size_bytes_;
 
@@ -250,13 +284,22 @@ class Statestore {
   boost::mutex exit_flag_lock_;
   bool exit_flag_;
 
-  /// Controls access to topics_. Cannot take subscribers_lock_ after acquiring this lock.
+  /// Controls access to topics_, but not to the topics themselves, which have their own
+  /// locks (see Topic::lock()) that must be taken after this one, if at all. Cannot take
+  /// subscribers_lock_ after acquiring either.
   boost::mutex topic_lock_;
 
-  /// The entire set of topics tracked by the statestore
-  typedef boost::unordered_map<TopicId, Topic> TopicMap;
+  /// The entire set of topics tracked by the statestore. Topics are created when they
+  /// are first subscribed to, and never removed.
+  typedef boost::unordered_map<TopicId, boost::shared_ptr<Topic> > TopicMap;
   TopicMap topics_;
 
+  /// Signalled by NotifyTopicChanged() whenever entries of any topic have changed. Wakes
+  /// up the topic update threads waiting in WaitForTopicUpdate(), which hold
+  /// topic_changed_lock_ while checking for changes. Must be taken before topic_lock_.
+  boost::mutex topic_changed_lock_;
+  boost::condition_variable topic_changed_cv_;
+
   /// The statestore-side representation of an individual subscriber client, which tracks a
   /// variety of bookkeeping information. This includes the list of subscribed topics (and
   /// whether updates to them should be deleted on failure), the list of updates made by
@@ -457,13 +500,30 @@ class Statestore {
   /// performing the RPC.
   Status SendHeartbeat(Subscriber* subscriber);
 
+  /// Blocks until the topic update to the subscriber with 'subscriber_id' that is due at
+  /// 'deadline_ms' should be sent. Returns earlier if one of its topics has changed, but
+  /// not before --statestore_min_update_interval_ms have passed since the previous
+  /// update. Returns immediately if the subscriber is no longer registered.
+  void WaitForTopicUpdate(const SubscriberId& subscriber_id, int64_t deadline_ms);
+
+  /// Returns true if any topic that 'subscriber' subscribes to has a version that it has
+  /// not processed yet. Takes the topic locks.
+  bool HasPendingTopicUpdates(const Subscriber& subscriber);
+
+  /// Wakes up the threads in WaitForTopicUpdate(). Must be called after changing a topic,
+  /// without holding topic_lock_ or any topic lock.
+  void NotifyTopicChanged();
+
+  /// Returns the topic with 'topic_id', or NULL if there is none. Takes topic_lock_.
+  boost::shared_ptr<Topic> GetTopic(const TopicId& topic_id);
+
   /// Unregister a subscriber, removing all of its transient entries and evicting it from
   /// the subscriber map. Callers must hold subscribers_lock_ prior to calling this method.
   void UnregisterSubscriber(Subscriber* subscriber);
 
   /// Populates a TUpdateStateRequest with the update state for this subscriber. Iterates
   /// over all updates in all subscribed topics, populating the given TUpdateStateRequest
-  /// object. Takes the topic_lock_ and subscribers_lock_.
+  /// object. Takes the topic locks and subscribers_lock_.
   void GatherTopicUpdates(const Subscriber& subscriber,
       TUpdateStateRequest* update_state_request);
 
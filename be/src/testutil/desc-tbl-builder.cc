@@ -58,7 +58,7 @@ static TTupleDescriptor MakeTupleDescriptor(int id, int byte_size, int num_null_
   return tuple_desc;
 }
 
-DescriptorTbl* DescriptorTblBuilder::Build() {
+DescriptorTbl* DescriptorTblBuilder::Build(bool compact_tuple_layout) {
   DescriptorTbl* desc_tbl;
   TDescriptorTable thrift_desc_tbl;
   int tuple_id = 0;
@@ -68,7 +68,8 @@ DescriptorTbl* DescriptorTblBuilder::Build() {
     BuildTuple(tuples_descs_[i]->slot_types(), &thrift_desc_tbl, &tuple_id, &slot_id);
   }
 
-  Status status = DescriptorTbl::Create(obj_pool_, thrift_desc_tbl, &desc_tbl);
+  Status status = DescriptorTbl::Create(obj_pool_, thrift_desc_tbl, &desc_tbl,
+      compact_tuple_layout);
   DCHECK(status.ok());
   return desc_tbl;
 }
@@ -38,7 +38,10 @@ class DescriptorTblBuilder {
   DescriptorTblBuilder(ObjectPool* object_pool);
 
   TupleDescBuilder& DeclareTuple();
-  DescriptorTbl* Build();
+
+  /// If 'compact_tuple_layout' is true, the tuples get the compact layout of
+  /// TupleDescriptor::ComputeCompactLayout() instead of the unpadded layout.
+  DescriptorTbl* Build(bool compact_tuple_layout = false);
 
  private:
   /// Owned by caller.
@@ -21,6 +21,7 @@
 #include "transport/config.h"
 #ifdef HAVE_SASL_SASL_H
 
+#include <climits>
 #include <cstring>
 #include <sstream>
 #include <transport/TSasl.h>
@@ -30,6 +31,12 @@
 
 #include "common/names.h"
 
+DEFINE_string(sasl_qop, "auth", "Quality of protection of the SASL (Kerberos) "
+    "connections: 'auth' only authenticates the peer, 'auth-int' also protects the "
+    "integrity of the data and 'auth-conf' also encrypts it. Wrapping the data in SASL "
+    "is slow: to encrypt the traffic, prefer 'auth' together with TLS, see "
+    "--ssl_server_certificate and --ssl_client_ca_certificate.");
+
 DEFINE_bool(force_lowercase_usernames, false, "If true, all principals and usernames are"
     " mapped to lowercase shortnames before being passed to any components (Sentry, "
     "admission control) for authorization");
@@ -41,6 +48,9 @@ using boost::algorithm::to_lower;
 
 namespace sasl {
 
+// The largest buffer size that GSSAPI can negotiate, its length field has 24 bits.
+static const unsigned MAX_WRAPPED_BUF_SIZE = 0xFFFFFF;
+
 uint8_t* TSasl::unwrap(const uint8_t* incoming,
                        const int offset, const uint32_t len, uint32_t* outLen) {
   uint32_t outputlen;
@@ -100,6 +110,38 @@ string TSasl::getUsername() {
   return ret;
 }
 
+uint32_t TSasl::getSsf() {
+  const sasl_ssf_t* ssf;
+  int result = sasl_getprop(conn, SASL_SSF, reinterpret_cast<const void **>(&ssf));
+  if (result != SASL_OK) throw SaslException(sasl_errdetail(conn));
+  return *ssf;
+}
+
+uint32_t TSasl::getMaxOutBuf() {
+  const unsigned* maxOutBuf;
+  int result =
+      sasl_getprop(conn, SASL_MAXOUTBUF, reinterpret_cast<const void **>(&maxOutBuf));
+  if (result != SASL_OK) throw SaslException(sasl_errdetail(conn));
+  return *maxOutBuf;
+}
+
+void TSasl::setSecurityProperties() {
+  sasl_security_properties_t secprops;
+  memset(&secprops, 0, sizeof(secprops));
+  if (FLAGS_sasl_qop == "auth-int") {
+    secprops.min_ssf = 1;
+    secprops.max_ssf = 1;
+  } else if (FLAGS_sasl_qop == "auth-conf") {
+    // Any strength above 1 means confidentiality.
+    secprops.min_ssf = 2;
+    secprops.max_ssf = UINT_MAX;
+  }
+  // Largest buffer the peer may send us wrapped.
+  if (secprops.max_ssf > 0) secprops.maxbufsize = MAX_WRAPPED_BUF_SIZE;
+  int result = sasl_setprop(conn, SASL_SEC_PROPS, &secprops);
+  if (result != SASL_OK) throw SaslException(sasl_errdetail(conn));
+}
+
 TSaslClient::TSaslClient(const string& mechanisms, const string& authenticationId,
     const string& protocol, const string& serverName, const map<string,string>& props,
     sasl_callback_t* callbacks) {
@@ -126,6 +168,8 @@ TSaslClient::TSaslClient(const string& mechanisms, const string& authenticationI
     */
   }
 
+  setSecurityProperties();
+
   chosenMech = mechList = mechanisms;
   authComplete = false;
   clientStarted = false;
@@ -203,6 +247,8 @@ TSaslServer::TSaslServer(const string& service, const string& serverFQDN,
     }
   }
 
+  setSecurityProperties();
+
   authComplete = false;
   serverStarted = false;
 }
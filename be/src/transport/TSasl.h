@@ -103,7 +103,22 @@ class TSasl {
   /* Returns the username from the underlying sasl connection. */
   std::string getUsername();
 
+  /*
+   * Returns the strength of the negotiated security layer: 0 if the data does not need
+   * to be wrapped, 1 for integrity protection, more for confidentiality.
+   */
+  uint32_t getSsf();
+
+  /* Returns the largest number of bytes that can be wrapped at once. */
+  uint32_t getMaxOutBuf();
+
   protected:
+   /*
+    * Restricts the security layers that may be negotiated to the --sasl_qop ones. Must
+    * be called before the authentication exchange starts.
+    */
+   void setSecurityProperties();
+
    /* Authorization is complete. */
    bool authComplete;
    /* Sasl Connection. */
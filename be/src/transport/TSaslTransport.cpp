@@ -22,6 +22,8 @@
 
 #ifdef HAVE_SASL_SASL_H
 #include <stdint.h>
+#include <algorithm>
+#include <cstring>
 #include <sstream>
 #include <boost/shared_ptr.hpp>
 #include <boost/scoped_ptr.hpp>
@@ -31,29 +33,47 @@
 
 #include "common/names.h"
 
-// Default size, in bytes, for the memory buffer used to stage reads.
-const int32_t DEFAULT_MEM_BUF_SIZE = 32 * 1024;
+using std::max;
+using std::min;
+
+// Size, in bytes, of the read and write buffers that are kept between messages. Larger
+// buffers, needed for larger frames, are freed once the frame was consumed or sent.
+const uint32_t DEFAULT_BUF_SIZE = 32 * 1024;
+
+// Largest payload, in bytes, of the frames this transport writes. Everything written
+// between two flushes goes out in as few frames as possible, since each frame has a
+// header and, if it is wrapped, a SASL call and a security layer token.
+const uint32_t MAX_FRAME_SIZE = 1024 * 1024;
 
 namespace apache { namespace thrift { namespace transport {
 
   TSaslTransport::TSaslTransport(boost::shared_ptr<TTransport> transport)
       : transport_(transport),
-        memBuf_(new TMemoryBuffer(DEFAULT_MEM_BUF_SIZE)),
         shouldWrap_(false),
         isClient_(false) {
+    init();
   }
 
   TSaslTransport::TSaslTransport(boost::shared_ptr<sasl::TSasl> saslClient,
                                  boost::shared_ptr<TTransport> transport)
       : transport_(transport),
-        memBuf_(new TMemoryBuffer()),
         sasl_(saslClient),
         shouldWrap_(false),
         isClient_(true) {
+    init();
+  }
+
+  void TSaslTransport::init() {
+    writeBufSize_ = 0;
+    writeBufLen_ = PAYLOAD_LENGTH_BYTES;
+    readBufSize_ = 0;
+    readData_ = NULL;
+    readDataLen_ = 0;
+    readDataPos_ = 0;
+    maxFrameSize_ = MAX_FRAME_SIZE;
   }
 
   TSaslTransport::~TSaslTransport() {
-    delete memBuf_;
   }
 
   bool TSaslTransport::isOpen() {
@@ -61,7 +81,7 @@ namespace apache { namespace thrift { namespace transport {
   }
 
   bool TSaslTransport::peek(){
-    return (transport_->peek());
+    return readDataPos_ < readDataLen_ || transport_->peek();
   }
 
   string TSaslTransport::getUsername() {
@@ -123,12 +143,14 @@ namespace apache { namespace thrift { namespace transport {
       }
     }
 
-    // TODO : need to set the shouldWrap_ based on QOP
-    /*
-    String qop = (String) sasl.getNegotiatedProperty(Sasl.QOP);
-    if (qop != null && !qop.equalsIgnoreCase("auth"))
-      shouldWrap_ = true;
-    */
+    // The data is only wrapped if a security layer (auth-int or auth-conf) was
+    // negotiated, see --sasl_qop. The payload of a wrapped frame must not exceed the
+    // largest buffer that the peer can unwrap.
+    shouldWrap_ = sasl_->getSsf() > 0;
+    if (shouldWrap_) {
+      uint32_t maxOutBuf = sasl_->getMaxOutBuf();
+      if (maxOutBuf > 0) maxFrameSize_ = min(MAX_FRAME_SIZE, maxOutBuf);
+    }
   }
 
   void TSaslTransport::close() {
@@ -146,64 +168,42 @@ namespace apache { namespace thrift { namespace transport {
     return static_cast<uint32_t>(len);
   }
 
-  void TSaslTransport::shrinkBuffer() {
-    // readEnd() returns the number of bytes already read, i.e. the number of 'junk' bytes
-    // taking up space at the front of the memory buffer.
-    uint32_t read_end = memBuf_->readEnd();
-
-    // If the size of the junk space at the beginning of the buffer is too large, and
-    // there's no data left in the buffer to read (number of bytes read == number of bytes
-    // written), then shrink the buffer back to the default. We don't want to do this on
-    // every read that exhausts the buffer, since the layer above often reads in small
-    // chunks, which is why we only resize if there's too much junk. The write and read
-    // pointers will eventually catch up after every RPC, so we will always take this path
-    // eventually once the buffer becomes sufficiently full.
-    //
-    // readEnd() may reset the write / read pointers (but only once if there's no
-    // intervening read or write between calls), so needs to be called a second time to
-    // get their current position.
-    if (read_end > DEFAULT_MEM_BUF_SIZE && memBuf_->writeEnd() == memBuf_->readEnd()) {
-      memBuf_->resetBuffer(DEFAULT_MEM_BUF_SIZE);
-    }
-  }
-
   uint32_t TSaslTransport::read(uint8_t* buf, uint32_t len) {
-    uint32_t read_bytes = memBuf_->read(buf, len);
-
-    if (read_bytes > 0) {
-      shrinkBuffer();
-      return read_bytes;
-    }
-
-    // if there's not enough data in cache, read from underlying transport
-    uint32_t dataLength = readLength();
-
-    // Fast path
-    if (len == dataLength && !shouldWrap_) {
-      transport_->readAll(buf, len);
-      return len;
-    }
+    while (readDataPos_ == readDataLen_) {
+      uint32_t frameLength = readLength();
+
+      // Fast path: an unwrapped frame that fits is read directly into 'buf'. Returning
+      // less than 'len' is fine, readAll() calls read() again.
+      if (!shouldWrap_ && frameLength > 0 && frameLength <= len) {
+        transport_->readAll(buf, frameLength);
+        return frameLength;
+      }
 
-    uint8_t* tmpBuf = new uint8_t[dataLength];
-    transport_->readAll(tmpBuf, dataLength);
-    if (shouldWrap_) {
-      tmpBuf = sasl_->unwrap(tmpBuf, 0, dataLength, &dataLength);
+      if (frameLength > readBufSize_) {
+        readBufSize_ = max(frameLength, DEFAULT_BUF_SIZE);
+        readBuf_.reset(new uint8_t[readBufSize_]);
+      }
+      transport_->readAll(readBuf_.get(), frameLength);
+      if (shouldWrap_) {
+        // The unwrapped data is owned by the SASL connection and stays valid until the
+        // next frame is unwrapped, so it is not copied.
+        readData_ = sasl_->unwrap(readBuf_.get(), 0, frameLength, &readDataLen_);
+      } else {
+        readData_ = readBuf_.get();
+        readDataLen_ = frameLength;
+      }
+      readDataPos_ = 0;
     }
 
-    // We will consume all the data, no need to put it in the memory buffer.
-    if (len == dataLength) {
-      memcpy(buf, tmpBuf, len);
-      delete[] tmpBuf;
-      return len;
+    uint32_t bytes = min(len, readDataLen_ - readDataPos_);
+    memcpy(buf, readData_ + readDataPos_, bytes);
+    readDataPos_ += bytes;
+    if (readDataPos_ == readDataLen_ && readBufSize_ > DEFAULT_BUF_SIZE) {
+      // Don't hold on to the buffer of an unusually large frame.
+      readBuf_.reset();
+      readBufSize_ = 0;
     }
-
-    memBuf_->write(tmpBuf, dataLength);
-    memBuf_->flush();
-    delete[] tmpBuf;
-
-    uint32_t ret = memBuf_->read(buf, len);
-    shrinkBuffer();
-    return ret;
+    return bytes;
   }
 
   void TSaslTransport::writeLength(uint32_t length) {
@@ -214,18 +214,51 @@ namespace apache { namespace thrift { namespace transport {
   }
 
   void TSaslTransport::write(const uint8_t* buf, uint32_t len) {
-    const uint8_t* newBuf;
+    while (len > 0) {
+      uint32_t bytes = min(len, maxFrameSize_ - (writeBufLen_ - PAYLOAD_LENGTH_BYTES));
+      if (writeBufLen_ + bytes > writeBufSize_) {
+        // Grow the buffer geometrically, up to the size of a full frame.
+        uint32_t newSize = max(writeBufLen_ + bytes,
+            min(max(2 * writeBufSize_, DEFAULT_BUF_SIZE),
+                maxFrameSize_ + PAYLOAD_LENGTH_BYTES));
+        uint8_t* newBuf = new uint8_t[newSize];
+        if (writeBuf_.get() != NULL) memcpy(newBuf, writeBuf_.get(), writeBufLen_);
+        writeBuf_.reset(newBuf);
+        writeBufSize_ = newSize;
+      }
+      memcpy(writeBuf_.get() + writeBufLen_, buf, bytes);
+      writeBufLen_ += bytes;
+      buf += bytes;
+      len -= bytes;
+      if (writeBufLen_ - PAYLOAD_LENGTH_BYTES == maxFrameSize_) writeFrame();
+    }
+  }
 
-    if (shouldWrap_) {
-      newBuf = sasl_->wrap((uint8_t*)buf, 0, len, &len);
+  void TSaslTransport::writeFrame() {
+    uint32_t payloadLength = writeBufLen_ - PAYLOAD_LENGTH_BYTES;
+    if (payloadLength == 0) return;
+    if (!shouldWrap_) {
+      // The length goes in the space left for it at the front of the buffer, so that the
+      // frame is a single write to the underlying transport.
+      encodeInt(payloadLength, writeBuf_.get(), 0);
+      transport_->write(writeBuf_.get(), writeBufLen_);
     } else {
-      newBuf = buf;
+      uint32_t wrappedLength;
+      uint8_t* wrapped = sasl_->wrap(writeBuf_.get(), PAYLOAD_LENGTH_BYTES, payloadLength,
+          &wrappedLength);
+      writeLength(wrappedLength);
+      transport_->write(wrapped, wrappedLength);
     }
-    writeLength(len);
-    transport_->write(newBuf, len);
+    writeBufLen_ = PAYLOAD_LENGTH_BYTES;
   }
 
   void TSaslTransport::flush() {
+    writeFrame();
+    if (writeBufSize_ > DEFAULT_BUF_SIZE) {
+      // Don't hold on to the buffer of an unusually large message.
+      writeBuf_.reset();
+      writeBufSize_ = 0;
+    }
     transport_->flush();
   }
 
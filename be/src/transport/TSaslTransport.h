@@ -52,6 +52,8 @@ static const int HEADER_LENGTH = STATUS_BYTES + PAYLOAD_LENGTH_BYTES;
  * see: http://www.ietf.org/rfc/rfc2222.txt.  It is based on and depends
  * on the presence of the cyrus-sasl library.
  *
+ * Writes are buffered until flush(), and sent in frames of up to 1MB, which are only
+ * wrapped if the negotiated quality of protection requires it (see --sasl_qop).
  */
 class TSaslTransport : public TVirtualTransport<TSaslTransport> {
  public:
@@ -148,8 +150,25 @@ class TSaslTransport : public TVirtualTransport<TSaslTransport> {
   /// Underlying transport
   boost::shared_ptr<TTransport> transport_;
 
-  /// Buffer for reading and writing.
-  TMemoryBuffer* memBuf_;
+  /// Frame being written: PAYLOAD_LENGTH_BYTES reserved for the length of the frame,
+  /// followed by the writeBufLen_ - PAYLOAD_LENGTH_BYTES bytes of its payload.
+  boost::scoped_array<uint8_t> writeBuf_;
+  uint32_t writeBufSize_;
+  uint32_t writeBufLen_;
+
+  /// Payload of the last frame that was read, if it didn't fit in the caller's buffer.
+  boost::scoped_array<uint8_t> readBuf_;
+  uint32_t readBufSize_;
+
+  /// Data of the last frame read: points into readBuf_, or to the unwrapped data owned by
+  /// sasl_. The bytes up to readDataPos_ were already returned by read().
+  const uint8_t* readData_;
+  uint32_t readDataLen_;
+  uint32_t readDataPos_;
+
+  /// Largest payload of the frames written. Capped by the largest buffer the peer can
+  /// unwrap if the data is wrapped.
+  uint32_t maxFrameSize_;
 
   /// Sasl implementation class. This is passed in to the transport constructor
   /// initialized for either a client or a server.
@@ -213,9 +232,12 @@ class TSaslTransport : public TVirtualTransport<TSaslTransport> {
   void writeLength(uint32_t length);
   virtual void handleSaslStartMessage() = 0;
 
-  /// If memBuf_ is filled with bytes that are already read, and has crossed a size
-  /// threshold (see implementation for exact value), resize the buffer to a default value.
-  void shrinkBuffer();
+  /// Sets up the buffers. Called by the constructors.
+  void init();
+
+  /// Writes the frame in writeBuf_, if it isn't empty, to the underlying transport,
+  /// wrapping it if needed.
+  void writeFrame();
 };
 
 }}} // apache::thrift::transport
@@ -276,7 +276,64 @@ class UdfTestHarness {
     return Validate(context.get(), expected, ret);
   }
 
+  /// Executes a batch UDF, see UdfBatchFn, over expected.size() rows and validates the
+  /// result of each row. 'args' contains one array of expected.size() values per
+  /// argument of the UDF, args[i] corresponds to the i-th argument.
+  template<typename RET>
+  static bool ValidateBatchUdf(UdfBatchFn fn, const std::vector<const void*>& args,
+      const std::vector<RET>& expected, UdfPrepare init_fn = NULL,
+      UdfClose close_fn = NULL,
+      const std::vector<AnyVal*>& constant_args = std::vector<AnyVal*>()) {
+    FunctionContext::TypeDesc return_type; // TODO
+    std::vector<FunctionContext::TypeDesc> arg_types; // TODO
+    boost::scoped_ptr<FunctionContext> context(CreateTestContext(return_type, arg_types));
+    SetConstantArgs(context.get(), constant_args);
+    if (!RunPrepareFn(init_fn, context.get())) return false;
+    std::vector<RET> results(expected.size());
+    if (!expected.empty()) {
+      fn(context.get(), expected.size(), args.empty() ? NULL : &args[0], &results[0]);
+    }
+    RunCloseFn(close_fn, context.get());
+    return ValidateBatch(context.get(), expected, results);
+  }
+
+  /// Batch UDFs with one or two arguments can be tested with the values of each
+  /// argument:
+  ///   ValidateBatchUdf(batch_fn, vector<arg1>, vector<arg2>, vector<expected_result>);
+  template<typename RET, typename A1>
+  static bool ValidateBatchUdf(UdfBatchFn fn, const std::vector<A1>& a1,
+      const std::vector<RET>& expected, UdfPrepare init_fn = NULL,
+      UdfClose close_fn = NULL,
+      const std::vector<AnyVal*>& constant_args = std::vector<AnyVal*>()) {
+    if (!ValidateNumRows(a1.size(), expected.size())) return false;
+    std::vector<const void*> args;
+    args.push_back(a1.empty() ? NULL : &a1[0]);
+    return ValidateBatchUdf<RET>(fn, args, expected, init_fn, close_fn, constant_args);
+  }
+
+  template<typename RET, typename A1, typename A2>
+  static bool ValidateBatchUdf(UdfBatchFn fn, const std::vector<A1>& a1,
+      const std::vector<A2>& a2, const std::vector<RET>& expected,
+      UdfPrepare init_fn = NULL, UdfClose close_fn = NULL,
+      const std::vector<AnyVal*>& constant_args = std::vector<AnyVal*>()) {
+    if (!ValidateNumRows(a1.size(), expected.size())) return false;
+    if (!ValidateNumRows(a2.size(), expected.size())) return false;
+    std::vector<const void*> args;
+    args.push_back(a1.empty() ? NULL : &a1[0]);
+    args.push_back(a2.empty() ? NULL : &a2[0]);
+    return ValidateBatchUdf<RET>(fn, args, expected, init_fn, close_fn, constant_args);
+  }
+
  private:
+  static bool ValidateNumRows(int num_args, int num_expected) {
+    if (num_args != num_expected) {
+      std::cerr << "Batch UDF argument has " << num_args << " values, expected "
+                << num_expected << std::endl;
+      return false;
+    }
+    return true;
+  }
+
   static bool ValidateError(FunctionContext* context) {
     if (context->has_error()) {
       std::cerr << "Udf Failed: " << context->error_msg() << std::endl;
@@ -299,6 +356,23 @@ class UdfTestHarness {
     return valid;
   }
 
+  template<typename RET>
+  static bool ValidateBatch(FunctionContext* context, const std::vector<RET>& expected,
+      const std::vector<RET>& actual) {
+    bool valid = true;
+    for (int i = 0; !context->has_error() && i < expected.size(); ++i) {
+      if (actual[i] == expected[i]) continue;
+      std::cerr << "UDF did not return the correct result for row " << i << ":"
+                << std::endl
+                << "  Expected: " << DebugString(expected[i]) << std::endl
+                << "  Actual: " << DebugString(actual[i]) << std::endl;
+      valid = false;
+    }
+    CloseContext(context);
+    if (!ValidateError(context)) valid = false;
+    return valid;
+  }
+
   static bool RunPrepareFn(UdfPrepare prepare_fn, FunctionContext* context) {
     if (prepare_fn != NULL) {
       // TODO: FRAGMENT_LOCAL
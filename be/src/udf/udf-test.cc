@@ -130,6 +130,31 @@ IntVal ValidateMem(FunctionContext* context) {
   return IntVal::null();
 }
 
+void AddOneBatch(FunctionContext* context, int num_rows, const void* const* args,
+    void* results) {
+  const IntVal* vals = reinterpret_cast<const IntVal*>(args[0]);
+  IntVal* out = reinterpret_cast<IntVal*>(results);
+  for (int i = 0; i < num_rows; ++i) {
+    out[i] = vals[i].is_null ? IntVal::null() : IntVal(vals[i].val + 1);
+  }
+}
+
+void ConcatBatch(FunctionContext* context, int num_rows, const void* const* args,
+    void* results) {
+  const StringVal* a = reinterpret_cast<const StringVal*>(args[0]);
+  const StringVal* b = reinterpret_cast<const StringVal*>(args[1]);
+  StringVal* out = reinterpret_cast<StringVal*>(results);
+  for (int i = 0; i < num_rows; ++i) {
+    if (a[i].is_null || b[i].is_null) {
+      out[i] = StringVal::null();
+      continue;
+    }
+    out[i] = StringVal(context, a[i].len + b[i].len);
+    memcpy(out[i].ptr, a[i].ptr, a[i].len);
+    memcpy(out[i].ptr + a[i].len, b[i].ptr, b[i].len);
+  }
+}
+
 StringVal TimeToString(FunctionContext* context, const TimestampVal& time) {
   ptime t(*(date*)&time.date);
   t += nanoseconds(time.time_of_day);
@@ -276,6 +301,40 @@ TEST(UdfTest, MemTest) {
 
 }
 
+TEST(UdfTest, TestBatchUdf) {
+  vector<IntVal> ints;
+  ints.push_back(IntVal(1));
+  ints.push_back(IntVal::null());
+  ints.push_back(IntVal(-1));
+  vector<IntVal> expected_ints;
+  expected_ints.push_back(IntVal(2));
+  expected_ints.push_back(IntVal::null());
+  expected_ints.push_back(IntVal(0));
+  EXPECT_TRUE((UdfTestHarness::ValidateBatchUdf<IntVal, IntVal>(
+      AddOneBatch, ints, expected_ints)));
+  expected_ints[2] = IntVal(-1);
+  EXPECT_FALSE((UdfTestHarness::ValidateBatchUdf<IntVal, IntVal>(
+      AddOneBatch, ints, expected_ints)));
+  expected_ints.pop_back();
+  EXPECT_FALSE((UdfTestHarness::ValidateBatchUdf<IntVal, IntVal>(
+      AddOneBatch, ints, expected_ints)));
+
+  vector<StringVal> a;
+  a.push_back(StringVal("ab"));
+  a.push_back(StringVal(""));
+  a.push_back(StringVal::null());
+  vector<StringVal> b;
+  b.push_back(StringVal("cd"));
+  b.push_back(StringVal("x"));
+  b.push_back(StringVal("y"));
+  vector<StringVal> expected_strings;
+  expected_strings.push_back(StringVal("abcd"));
+  expected_strings.push_back(StringVal("x"));
+  expected_strings.push_back(StringVal::null());
+  EXPECT_TRUE((UdfTestHarness::ValidateBatchUdf<StringVal, StringVal, StringVal>(
+      ConcatBatch, a, b, expected_strings)));
+}
+
 int main(int argc, char** argv) {
   impala::InitGoogleLoggingSafe(argv[0]);
   ::testing::InitGoogleTest(&argc, argv);
@@ -305,6 +305,36 @@ typedef void (*UdfPrepare)(FunctionContext* context,
 typedef void (*UdfClose)(FunctionContext* context,
                          FunctionContext::FunctionStateScope scope);
 
+/// --- Batch Functions ---
+/// -----------------------
+/// The UDF can optionally include a batch version of its scalar function, specified in
+/// the "CREATE FUNCTION" statement using "batch_fn=<batch function symbol>". The batch
+/// function evaluates the UDF over 'num_rows' rows in one call, which saves the
+/// per-row call overhead and lets the compiler vectorize the loop over the rows.
+///
+/// 'args' has one entry per argument of the UDF. args[i] points to an array of
+/// 'num_rows' values of the i-th argument's *Val type, e.g. a const IntVal* for an INT
+/// argument. 'results' points to an array of 'num_rows' values of the return type's
+/// *Val type, to which the results must be written; the null flag of each result is
+/// part of its *Val. For example, the batch version of
+///   IntVal AddOne(FunctionContext* context, const IntVal& arg);
+/// is
+///   void AddOneBatch(FunctionContext* context, int num_rows,
+///       const void* const* args, void* results) {
+///     const IntVal* vals = reinterpret_cast<const IntVal*>(args[0]);
+///     IntVal* out = reinterpret_cast<IntVal*>(results);
+///     for (int i = 0; i < num_rows; ++i) {
+///       out[i] = vals[i].is_null ? IntVal::null() : IntVal(vals[i].val + 1);
+///     }
+///   }
+///
+/// The batch function must return the same results as the scalar function, which is
+/// still called where rows are evaluated one at a time. As for the scalar function,
+/// StringVal results can be allocated with the StringVal(FunctionContext*, int) ctor.
+/// Batch functions are not supported for UDFs with variable arguments.
+typedef void (*UdfBatchFn)(FunctionContext* context, int num_rows,
+    const void* const* args, void* results);
+
 //----------------------------------------------------------------------------
 //------------------------------- UDAs ---------------------------------------
 //----------------------------------------------------------------------------
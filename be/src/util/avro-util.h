@@ -22,6 +22,7 @@
 /// From avro/schema.h (copied here to avoid pulling in avro header)
 struct avro_obj_t;
 typedef struct avro_obj_t* avro_schema_t;
+typedef struct avro_obj_t* avro_datum_t;
 
 namespace impala {
 
@@ -77,6 +78,34 @@ struct ScopedAvroSchemaElement {
   DISALLOW_COPY_AND_ASSIGN(ScopedAvroSchemaElement);
 };
 
+/// A file schema resolved against the table schema (see HdfsAvroScanner::
+/// ResolveSchemas()). Files written with the same schema share one of these so that the
+/// schema is parsed and resolved only once per scan node.
+struct AvroResolvedSchema {
+  /// A materialized slot that is missing from the file schema and is populated with the
+  /// default value given by the table schema.
+  struct DefaultValue {
+    SlotDescriptor* slot_desc;
+
+    /// The value and the field name are owned by the table schema.
+    avro_datum_t value;
+    const char* field_name;
+  };
+
+  /// The root of the file schema tree, with 'slot_desc' set on the elements that
+  /// populate materialized slots.
+  ScopedAvroSchemaElement schema;
+
+  /// Default values to write to the template tuple of every file with this schema.
+  std::vector<DefaultValue> default_values;
+
+  /// True if files with this schema can use the codegen'd version of
+  /// HdfsAvroScanner::DecodeAvroData().
+  bool use_codegend_decode_avro_data;
+
+  AvroResolvedSchema() : use_codegend_decode_avro_data(false) { }
+};
+
 ColumnType AvroSchemaToColumnType(const avro_schema_t& schema);
 
 }
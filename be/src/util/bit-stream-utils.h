@@ -53,6 +53,13 @@ class BitWriter {
   /// packed.  Returns false if there was not enough space. num_bits must be <= 32.
   bool PutValue(uint64_t v, int num_bits);
 
+  /// Bit packs the 'num_values' values in 'v', each with 'num_bits' bits, as if by
+  /// calling PutValue() for each of them. The space is checked once for the whole batch
+  /// and the packing loop works on local state, so this is much faster than PutValue()
+  /// for long arrays. Returns false and writes nothing if there was not enough space.
+  template<typename T>
+  bool PutValues(int num_bits, int num_values, const T* v);
+
   /// Writes v to the next aligned byte using num_bytes. If T is larger than num_bytes, the
   /// extra high-order bytes will be ignored. Returns false if there was not enough space.
   template<typename T>
@@ -112,6 +119,14 @@ class BitReader {
   template<typename T>
   bool GetValue(int num_bits, T* v);
 
+  /// Unpacks up to 'num_values' consecutive 'num_bits'-wide values into 'v'. Returns the
+  /// number of values unpacked, which is less than 'num_values' only if the end of the
+  /// buffer was reached. num_bits must be <= 32. This is equivalent to calling GetValue()
+  /// 'num_values' times but avoids the per-value bookkeeping, so it should be preferred
+  /// for long runs of bit-packed values.
+  template<typename T>
+  int UnpackBatch(int num_bits, int num_values, T* v);
+
   /// Reads a 'num_bytes'-sized value from the buffer and stores it in 'v'. T needs to be a
   /// little-endian native type and big enough to store 'num_bytes'. The value is assumed
   /// to be byte-aligned so the stream will be advanced to the start of the next byte
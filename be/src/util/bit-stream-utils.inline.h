@@ -42,6 +42,38 @@ inline bool BitWriter::PutValue(uint64_t v, int num_bits) {
   return true;
 }
 
+template<typename T>
+inline bool BitWriter::PutValues(int num_bits, int num_values, const T* v) {
+  DCHECK_LE(num_bits, 32);
+  DCHECK_GE(num_values, 0);
+  if (UNLIKELY(byte_offset_ * 8L + bit_offset_ + static_cast<int64_t>(num_bits) *
+      num_values > max_bytes_ * 8L)) {
+    return false;
+  }
+
+  // Same as PutValue(), but with the writer's state kept in registers.
+  uint64_t buffered_values = buffered_values_;
+  int bit_offset = bit_offset_;
+  uint8_t* out = buffer_ + byte_offset_;
+  for (int i = 0; i < num_values; ++i) {
+    uint64_t value = static_cast<uint64_t>(v[i]);
+    DCHECK_EQ(value >> num_bits, 0) << "v = " << value << ", num_bits = " << num_bits;
+    buffered_values |= value << bit_offset;
+    bit_offset += num_bits;
+    if (bit_offset >= 64) {
+      memcpy(out, &buffered_values, 8);
+      out += 8;
+      bit_offset -= 64;
+      buffered_values = value >> (num_bits - bit_offset);
+    }
+  }
+  buffered_values_ = buffered_values;
+  bit_offset_ = bit_offset;
+  byte_offset_ = out - buffer_;
+  DCHECK_LT(bit_offset_, 64);
+  return true;
+}
+
 inline void BitWriter::Flush(bool align) {
   int num_bytes = BitUtil::Ceil(bit_offset_, 8);
   DCHECK_LE(byte_offset_ + num_bytes, max_bytes_);
@@ -112,6 +144,54 @@ inline bool BitReader::GetValue(int num_bits, T* v) {
   return true;
 }
 
+template<typename T>
+inline int BitReader::UnpackBatch(int num_bits, int num_values, T* v) {
+  DCHECK(buffer_ != NULL);
+  DCHECK_LE(num_bits, 32);
+  DCHECK_LE(num_bits, sizeof(T) * 8);
+  DCHECK_GE(num_values, 0);
+
+  int64_t bit_pos = byte_offset_ * 8L + bit_offset_;
+  int64_t max_bits = max_bytes_ * 8L;
+  if (num_bits == 0) {
+    memset(v, 0, num_values * sizeof(T));
+    return num_values;
+  }
+  num_values = std::min<int64_t>(num_values, (max_bits - bit_pos) / num_bits);
+
+  // Values that start at least 8 bytes before the end of the buffer can be extracted
+  // with a single unaligned 64-bit load: a value is at most 32 bits wide and starts at
+  // most 7 bits into the loaded word. The remaining values go through GetValue().
+  int64_t num_fast_values = 0;
+  if (max_bytes_ >= 8) {
+    int64_t last_fast_bit = (max_bytes_ - 8) * 8L + 7;
+    if (last_fast_bit >= bit_pos) {
+      num_fast_values =
+          std::min<int64_t>(num_values, (last_fast_bit - bit_pos) / num_bits + 1);
+    }
+  }
+  const uint64_t mask = (1ULL << num_bits) - 1;
+  for (int64_t i = 0; i < num_fast_values; ++i) {
+    int64_t value_bit_pos = bit_pos + i * num_bits;
+    uint64_t word;
+    memcpy(&word, buffer_ + (value_bit_pos >> 3), 8);
+    v[i] = static_cast<T>((word >> (value_bit_pos & 7)) & mask);
+  }
+
+  // Reposition the reader after the last unpacked value.
+  bit_pos += num_fast_values * num_bits;
+  byte_offset_ = bit_pos >> 3;
+  bit_offset_ = bit_pos & 7;
+  int bytes_remaining = max_bytes_ - byte_offset_;
+  memcpy(&buffered_values_, buffer_ + byte_offset_, std::min(8, bytes_remaining));
+
+  for (int64_t i = num_fast_values; i < num_values; ++i) {
+    bool result = GetValue(num_bits, &v[i]);
+    DCHECK(result);
+  }
+  return num_values;
+}
+
 template<typename T>
 inline bool BitReader::GetAligned(int num_bytes, T* v) {
   DCHECK_LE(num_bytes, sizeof(T));
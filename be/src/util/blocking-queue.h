@@ -21,6 +21,7 @@
 #include <deque>
 #include <unistd.h>
 
+#include "util/lock-profiler.h"
 #include "util/stopwatch.h"
 
 namespace impala {
@@ -33,9 +34,12 @@ namespace impala {
 template <typename T>
 class BlockingQueue {
  public:
-  BlockingQueue(size_t max_elements)
+  /// If 'lock_site' is not NULL, the acquisitions of the queue's lock by BlockingGet()
+  /// and BlockingPut() are profiled there.
+  BlockingQueue(size_t max_elements, LockSite* lock_site = NULL)
     : shutdown_(false),
       max_elements_(max_elements),
+      lock_site_(lock_site),
       total_get_wait_time_(0),
       total_put_wait_time_(0) {
   }
@@ -45,7 +49,7 @@ class BlockingQueue {
   /// are no more elements available.
   bool BlockingGet(T* out) {
     MonotonicStopWatch timer;
-    boost::unique_lock<boost::mutex> unique_lock(lock_);
+    ProfiledLock<boost::mutex> unique_lock(lock_, lock_site_);
 
     while (true) {
       if (!list_.empty()) {
@@ -68,7 +72,7 @@ class BlockingQueue {
   /// If the queue is shut down, returns false.
   bool BlockingPut(const T& val) {
     MonotonicStopWatch timer;
-    boost::unique_lock<boost::mutex> unique_lock(lock_);
+    ProfiledLock<boost::mutex> unique_lock(lock_, lock_site_);
 
     while (list_.size() >= max_elements_ && !shutdown_) {
       timer.Start();
@@ -120,6 +124,7 @@ class BlockingQueue {
   boost::condition_variable put_cv_;   // 'put' callers wait on this
   /// lock_ guards access to list_, total_get_wait_time, and total_put_wait_time
   mutable boost::mutex lock_;
+  LockSite* lock_site_;
   std::deque<T> list_;
   uint64_t total_get_wait_time_;
   uint64_t total_put_wait_time_;
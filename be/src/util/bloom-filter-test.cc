@@ -20,6 +20,8 @@
 
 #include <gtest/gtest.h>
 
+#include "util/cpu-info.h"
+
 using namespace std;
 
 namespace {
@@ -220,9 +222,31 @@ TEST(BloomFilter, Or) {
   ASSERT_FALSE(bf2.Find(81));
 }
 
+// FindBatch() returns the same results as Find(), for both the AVX2 and the scalar
+// implementation.
+TEST(BloomFilter, FindBatch) {
+  srand(0);
+  BloomFilter bf(BloomFilter::MinLogSpace(1000, 0.1), NULL, NULL);
+  vector<uint32_t> hashes;
+  for (int i = 0; i < 1000; ++i) {
+    hashes.push_back(MakeRand());
+    bf.Insert(hashes.back());
+    hashes.push_back(MakeRand());
+  }
+  vector<uint8_t> found(hashes.size());
+  // Ends with AVX2 enabled again if it is supported.
+  const bool has_avx2 = CpuInfo::IsSupported(CpuInfo::AVX2);
+  for (int avx2 = 0; avx2 <= has_avx2; ++avx2) {
+    CpuInfo::EnableFeature(CpuInfo::AVX2, avx2);
+    bf.FindBatch(&hashes[0], hashes.size(), &found[0]);
+    for (int i = 0; i < hashes.size(); ++i) EXPECT_EQ(bf.Find(hashes[i]), found[i]);
+  }
+}
+
 }  // namespace impala
 
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
+  impala::CpuInfo::Init();
   return RUN_ALL_TESTS();
 }
@@ -14,12 +14,14 @@
 
 #include "util/bloom-filter.h"
 
+#include <immintrin.h>
 #include <stdlib.h>
 
 #include <algorithm>
 
 #include "common/logging.h"
 #include "runtime/runtime-state.h"
+#include "util/cpu-info.h"
 #include "util/hash-util.h"
 
 using namespace std;
@@ -88,6 +90,43 @@ void BloomFilter::Or(const BloomFilter& other) {
   for (int i = 0; i < directory_size_in_words; ++i) dir_ptr[i] |= other_dir_ptr[i];
 }
 
+void BloomFilter::FindBatch(const uint32_t* hashes, int num_hashes,
+    uint8_t* found) const {
+  if (CpuInfo::IsSupported(CpuInfo::AVX2)) {
+    FindBatchAvx2(hashes, num_hashes, found);
+    return;
+  }
+  for (int i = 0; i < num_hashes; ++i) found[i] = Find(hashes[i]);
+}
+
+// The rest of the binary is not built for AVX2, so only this function is compiled for it.
+// It is only called after checking for AVX2 support at runtime.
+void __attribute__((target("avx2"))) BloomFilter::FindBatchAvx2(
+    const uint32_t* hashes, int num_hashes, uint8_t* found) const {
+  // The amounts to shift the hash data by to get the bit index within each of the
+  // BUCKET_WORDS words of a bucket, as in Find(). Each 256-bit vector covers half of a
+  // bucket.
+  const __m256i shifts_lo = _mm256_setr_epi64x(0, LOG_BUCKET_WORD_BITS,
+      2 * LOG_BUCKET_WORD_BITS, 3 * LOG_BUCKET_WORD_BITS);
+  const __m256i shifts_hi = _mm256_add_epi64(shifts_lo,
+      _mm256_set1_epi64x(4 * LOG_BUCKET_WORD_BITS));
+  const __m256i word_mask = _mm256_set1_epi64x(BUCKET_WORD_MASK);
+  const __m256i ones = _mm256_set1_epi64x(1);
+  for (int i = 0; i < num_hashes; ++i) {
+    const uint32_t bucket_idx = HashUtil::Rehash32to32(hashes[i]) & directory_mask_;
+    const __m256i bits = _mm256_set1_epi64x(HashUtil::Rehash32to64(hashes[i]));
+    // One bit set in each word, at the position Insert() sets.
+    const __m256i mask_lo = _mm256_sllv_epi64(ones,
+        _mm256_and_si256(_mm256_srlv_epi64(bits, shifts_lo), word_mask));
+    const __m256i mask_hi = _mm256_sllv_epi64(ones,
+        _mm256_and_si256(_mm256_srlv_epi64(bits, shifts_hi), word_mask));
+    const __m256i* bucket = reinterpret_cast<const __m256i*>(directory_[bucket_idx]);
+    // _mm256_testc_si256(a, b) is 1 iff all the bits set in 'b' are set in 'a'.
+    found[i] = _mm256_testc_si256(_mm256_loadu_si256(bucket), mask_lo) &
+        _mm256_testc_si256(_mm256_loadu_si256(bucket + 1), mask_hi);
+  }
+}
+
 // The following three methods are derived from
 //
 // fpp = (1 - exp(-BUCKET_WORDS * ndv/space))^BUCKET_WORDS
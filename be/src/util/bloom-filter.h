@@ -73,6 +73,11 @@ class BloomFilter {
   /// high probabilty) if it is not.
   bool Find(const uint32_t hash) const;
 
+  /// Batch version of Find(): sets found[i] to Find(hashes[i]) for each of the
+  /// 'num_hashes' hashes. If the CPU supports AVX2, each bucket is tested with two
+  /// 256-bit operations instead of eight dependent word tests.
+  void FindBatch(const uint32_t* hashes, int num_hashes, uint8_t* found) const;
+
   /// Computes the logical OR of this filter with 'other' and stores the result in 'this'.
   void Or(const BloomFilter& other);
 
@@ -126,6 +131,9 @@ class BloomFilter {
   typedef BucketWord Bucket[BUCKET_WORDS];
   Bucket* directory_;
 
+  /// AVX2 implementation of FindBatch(). Must only be called if the CPU supports AVX2.
+  void FindBatchAvx2(const uint32_t* hashes, int num_hashes, uint8_t* found) const;
+
   /// Used only for tracking memory. If both are non-NULL,
   /// BufferedBlockMgr::{Acquire,Release}Memory() are called when this object allocates
   /// and frees heap memory. These objects pointed to by state_ and client_ are not owned
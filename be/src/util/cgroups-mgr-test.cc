@@ -0,0 +1,52 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+
+#include "util/cgroups-mgr.h"
+
+#include "common/names.h"
+
+namespace impala {
+
+TEST(CgroupsMgrTest, PoolToCgroup) {
+  EXPECT_EQ("impala_pool_root.default", CgroupsMgr::PoolToCgroup("root.default"));
+  EXPECT_EQ("impala_pool_root.etl-jobs_1", CgroupsMgr::PoolToCgroup("root.etl-jobs_1"));
+  EXPECT_EQ("impala_pool_a_b_c", CgroupsMgr::PoolToCgroup("a/b c"));
+}
+
+TEST(CgroupsMgrTest, ParsePoolCpuShares) {
+  unordered_map<string, int32_t> shares;
+  ASSERT_TRUE(CgroupsMgr::ParsePoolCpuShares("", &shares).ok());
+  EXPECT_TRUE(shares.empty());
+
+  ASSERT_TRUE(CgroupsMgr::ParsePoolCpuShares(
+      "root.dashboards:8192, root.etl : 256,", &shares).ok());
+  EXPECT_EQ(2, shares.size());
+  EXPECT_EQ(8192, shares["root.dashboards"]);
+  EXPECT_EQ(256, shares["root.etl"]);
+
+  EXPECT_FALSE(CgroupsMgr::ParsePoolCpuShares("root.etl", &shares).ok());
+  EXPECT_FALSE(CgroupsMgr::ParsePoolCpuShares(":100", &shares).ok());
+  EXPECT_FALSE(CgroupsMgr::ParsePoolCpuShares("root.etl:0", &shares).ok());
+  EXPECT_FALSE(CgroupsMgr::ParsePoolCpuShares("root.etl:12x", &shares).ok());
+}
+
+}
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
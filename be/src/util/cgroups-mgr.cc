@@ -16,12 +16,19 @@
 
 #include <fstream>
 #include <sstream>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
 #include "util/debug-util.h"
 #include <gutil/strings/substitute.h>
 
 #include "common/names.h"
 
+using boost::algorithm::is_any_of;
+using boost::algorithm::split;
+using boost::algorithm::trim_copy;
 using boost::filesystem::create_directory;
 using boost::filesystem::exists;
 using boost::filesystem::remove;
@@ -33,6 +40,9 @@ namespace impala {
 // Suffix appended to Yarn resource ids to form an Impala-internal cgroups.
 const std::string IMPALA_CGROUP_SUFFIX = "_impala";
 
+// Prefix of the cgroups of admission control pools.
+const std::string POOL_CGROUP_PREFIX = "impala_pool_";
+
 // Yarn's default multiplier for translating virtual CPU cores into cgroup CPU shares.
 // See Yarn's CgroupsLCEResourcesHandler.java for more details.
 const int32_t CPU_DEFAULT_WEIGHT = 1024;
@@ -55,6 +65,57 @@ string CgroupsMgr::UniqueIdToCgroup(const string& unique_id) const {
   return unique_id + IMPALA_CGROUP_SUFFIX;
 }
 
+Status CgroupsMgr::InitPoolCgroups(const string& pool_cpu_shares) {
+  return ParsePoolCpuShares(pool_cpu_shares, &pool_cpu_shares_);
+}
+
+string CgroupsMgr::PoolToCgroup(const string& pool) {
+  string cgroup = POOL_CGROUP_PREFIX + pool;
+  for (int i = POOL_CGROUP_PREFIX.size(); i < cgroup.size(); ++i) {
+    char c = cgroup[i];
+    if (!isalnum(c) && c != '.' && c != '-' && c != '_') cgroup[i] = '_';
+  }
+  return cgroup;
+}
+
+Status CgroupsMgr::ParsePoolCpuShares(const string& pool_cpu_shares,
+    unordered_map<string, int32_t>* shares) {
+  vector<string> entries;
+  split(entries, pool_cpu_shares, is_any_of(","));
+  BOOST_FOREACH(const string& entry, entries) {
+    if (trim_copy(entry).empty()) continue;
+    size_t colon = entry.rfind(':');
+    string pool = trim_copy(entry.substr(0, colon));
+    int32_t num_shares = 0;
+    if (colon != string::npos) {
+      stringstream ss(entry.substr(colon + 1));
+      ss >> num_shares;
+      if (ss.fail() || !(ss >> ws).eof()) num_shares = 0;
+    }
+    if (pool.empty() || num_shares <= 0) {
+      return Status(Substitute("Invalid pool CPU shares '$0', expected "
+          "<pool>:<positive number of shares>", entry));
+    }
+    (*shares)[pool] = num_shares;
+  }
+  return Status::OK();
+}
+
+Status CgroupsMgr::GetPoolCgroup(const string& pool, string* cgroup) {
+  *cgroup = PoolToCgroup(pool);
+  lock_guard<mutex> l(pool_cgroups_lock_);
+  if (created_pool_cgroups_.find(*cgroup) != created_pool_cgroups_.end()) {
+    return Status::OK();
+  }
+  // The cgroup may be left over from an earlier run of this impalad.
+  RETURN_IF_ERROR(CreateCgroup(*cgroup, true));
+  unordered_map<string, int32_t>::const_iterator it = pool_cpu_shares_.find(pool);
+  RETURN_IF_ERROR(SetCpuShares(*cgroup,
+      it != pool_cpu_shares_.end() ? it->second : CPU_DEFAULT_WEIGHT));
+  created_pool_cgroups_.insert(*cgroup);
+  return Status::OK();
+}
+
 int32_t CgroupsMgr::VirtualCoresToCpuShares(int16_t v_cpu_cores) {
   if (v_cpu_cores <= 0) return -1;
   return CPU_DEFAULT_WEIGHT * v_cpu_cores;
@@ -103,7 +164,7 @@ Status CgroupsMgr::SetCpuShares(const string& cgroup, int32_t num_shares) {
   RETURN_IF_ERROR(GetCgroupPaths(cgroup, &cgroup_path, &tasks_path));
 
   const string& cpu_shares_path = Substitute("$0/$1", cgroup_path, "cpu.shares");
-  ofstream cpu_shares(tasks_path.c_str(), ios::out | ios::trunc);
+  ofstream cpu_shares(cpu_shares_path.c_str(), ios::out | ios::trunc);
   if (!cpu_shares.is_open()) {
     stringstream err_msg;
     err_msg << "CGroup CPU shares file: " << cpu_shares_path
@@ -140,6 +201,14 @@ Status CgroupsMgr::GetCgroupPaths(const std::string& cgroup,
 
 Status CgroupsMgr::AssignThreadToCgroup(const Thread& thread,
     const string& cgroup) const {
+  return AssignTidToCgroup(thread.tid(), cgroup);
+}
+
+Status CgroupsMgr::AssignCurrentThreadToCgroup(const string& cgroup) const {
+  return AssignTidToCgroup(syscall(SYS_gettid), cgroup);
+}
+
+Status CgroupsMgr::AssignTidToCgroup(int64_t tid, const string& cgroup) const {
   string cgroup_path;
   string tasks_path;
   RETURN_IF_ERROR(GetCgroupPaths(cgroup, &cgroup_path, &tasks_path));
@@ -150,9 +219,9 @@ Status CgroupsMgr::AssignThreadToCgroup(const Thread& thread,
     err_msg << "CGroup tasks file: " << tasks_path << " is not writable by Impala";
     return Status(err_msg.str());
   }
-  tasks << thread.tid() << endl;
+  tasks << tid << endl;
 
-  VLOG_ROW << "Thread " << thread.tid() << " moved to CGroup " << cgroup_path;
+  VLOG_ROW << "Thread " << tid << " moved to CGroup " << cgroup_path;
   tasks.close();
   return Status::OK();
 }
@@ -18,6 +18,7 @@
 #include <string>
 #include <boost/thread/mutex.hpp>
 #include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
 #include "common/status.h"
 #include "util/metrics.h"
 #include "util/thread.h"
@@ -76,6 +77,11 @@ namespace impala {
 ///    from that CGroup are relocated into a special staging CGroup, so that the now
 ///    unused CGroup can safely be deleted (otherwise, we'd have to wait for the OS to
 ///    drain all entries from the CGroup's tasks file)
+//
+/// Without resource management, the threads of queries can instead be placed into one
+/// cgroup per admission control pool, see InitPoolCgroups(). These cgroups are created
+/// the first time a fragment of the pool runs and are never dropped, so the CPU shares
+/// of each pool bound the CPU time it gets while other pools compete for the CPUs.
 class CgroupsMgr {
  public:
   CgroupsMgr(MetricGroup* metrics);
@@ -95,6 +101,25 @@ class CgroupsMgr {
   /// Returns -1 if v_cpu_cores is <= 0 (which is invalid).
   int32_t VirtualCoresToCpuShares(int16_t v_cpu_cores);
 
+  /// Enables the cgroups of admission control pools. 'pool_cpu_shares' is a
+  /// comma-separated list of <pool>:<shares> pairs with the CPU shares of the cgroups of
+  /// the listed pools. The cgroups of other pools get the CPU shares of one virtual core.
+  /// Must be called after Init(). Returns an error if 'pool_cpu_shares' is malformed.
+  Status InitPoolCgroups(const std::string& pool_cpu_shares);
+
+  /// Returns the cgroup of the admission control pool 'pool'. Characters of the pool
+  /// name that are not valid in a file name are replaced by '_'.
+  static std::string PoolToCgroup(const std::string& pool);
+
+  /// Parses 'pool_cpu_shares', see InitPoolCgroups(), into 'shares'. Returns an error if
+  /// an entry is malformed or its shares are not positive.
+  static Status ParsePoolCpuShares(const std::string& pool_cpu_shares,
+      boost::unordered_map<std::string, int32_t>* shares);
+
+  /// Sets 'cgroup' to the cgroup of 'pool'. Creates the cgroup and sets its CPU shares
+  /// the first time it is requested. InitPoolCgroups() must have been called.
+  Status GetPoolCgroup(const std::string& pool, std::string* cgroup);
+
   /// Informs the cgroups mgr that a plan fragment intends to use the given cgroup.
   /// If this is the first fragment requesting use of cgroup, then the cgroup will
   /// be created and *is_first will be set to true (otherwise to false). In any case the
@@ -134,6 +159,9 @@ class CgroupsMgr {
   /// cgroup information from the filesystem.
   Status AssignThreadToCgroup(const Thread& thread, const std::string& cgroup) const;
 
+  /// Assigns the calling thread to a cgroup, see AssignThreadToCgroup().
+  Status AssignCurrentThreadToCgroup(const std::string& cgroup) const;
+
   /// Reads the <cgroups_hierarchy_path_>/<src_cgroup>/tasks file and writing all the
   /// contained thread ids to <cgroups_hierarchy_path_>/<dst_cgroup>/tasks.
   /// Assumes that the destination cgroup has already been created. Returns a non-OK
@@ -148,6 +176,9 @@ class CgroupsMgr {
   Status GetCgroupPaths(const std::string& cgroup,
       std::string* cgroup_path, std::string* tasks_path) const;
 
+  /// Assigns the thread with the system thread id 'tid' to 'cgroup'.
+  Status AssignTidToCgroup(int64_t tid, const std::string& cgroup) const;
+
   /// Number of currently active Impala-managed cgroups.
   IntGauge* active_cgroups_metric_;
 
@@ -165,6 +196,16 @@ class CgroupsMgr {
   /// A cgroup can be safely dropped once the number of fragments in the cgroup,
   /// according to this map, reaches zero.
   boost::unordered_map<std::string, int32_t> active_cgroups_;
+
+  /// CPU shares of the pools listed in the argument of InitPoolCgroups(). Not modified
+  /// after InitPoolCgroups().
+  boost::unordered_map<std::string, int32_t> pool_cpu_shares_;
+
+  /// Protects created_pool_cgroups_.
+  boost::mutex pool_cgroups_lock_;
+
+  /// The pool cgroups that were created and had their CPU shares set.
+  boost::unordered_set<std::string> created_pool_cgroups_;
 };
 
 }
@@ -26,6 +26,8 @@
 
 #include "common/names.h"
 
+DECLARE_int32(zstd_compression_level);
+
 using boost::assign::map_list_of;
 using namespace impala;
 using namespace strings;
@@ -106,6 +108,10 @@ Status Codec::CreateCompressor(MemPool* mem_pool, bool reuse,
     case THdfsCompression::LZ4:
       compressor->reset(new Lz4Compressor(mem_pool, reuse));
       break;
+    case THdfsCompression::ZSTD:
+      compressor->reset(
+          new ZstandardCompressor(mem_pool, reuse, FLAGS_zstd_compression_level));
+      break;
     default: {
       if (format == THdfsCompression::LZO) return Status(NO_LZO_MSG);
       return Status(Substitute("Unsupported codec: $0", format));
@@ -152,6 +158,9 @@ Status Codec::CreateDecompressor(MemPool* mem_pool, bool reuse,
     case THdfsCompression::LZ4:
       decompressor->reset(new Lz4Decompressor(mem_pool, reuse));
       break;
+    case THdfsCompression::ZSTD:
+      decompressor->reset(new ZstandardDecompressor(mem_pool, reuse));
+      break;
     default: {
       if (format == THdfsCompression::LZO) return Status(NO_LZO_MSG);
       return Substitute("Unsupported codec: $0", format);
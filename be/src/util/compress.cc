@@ -21,6 +21,7 @@
 #include <bzlib.h>
 #include <snappy.h>
 #include <lz4.h>
+#include <zstd.h>
 
 #include <boost/crc.hpp>
 #include <gutil/strings/substitute.h>
@@ -31,6 +32,9 @@ using boost::crc_32_type;
 using namespace impala;
 using namespace strings;
 
+DEFINE_int32(zstd_compression_level, 3, "Compression level used when writing Zstandard "
+    "compressed data, from 1 (fastest) to 22 (smallest output).");
+
 GzipCompressor::GzipCompressor(Format format, MemPool* mem_pool, bool reuse_buffer)
   : Codec(mem_pool, reuse_buffer),
     format_(format) {
@@ -294,3 +298,47 @@ Status Lz4Compressor::ProcessBlock(bool output_preallocated, int64_t input_lengt
                        reinterpret_cast<char*>(*output), input_length);
   return Status::OK();
 }
+
+ZstandardCompressor::ZstandardCompressor(MemPool* mem_pool, bool reuse_buffer,
+    int compression_level)
+  : Codec(mem_pool, reuse_buffer),
+    compression_level_(compression_level) {
+}
+
+Status ZstandardCompressor::Init() {
+  if (compression_level_ < 1 || compression_level_ > ZSTD_maxCLevel()) {
+    return Status(Substitute("Invalid Zstandard compression level $0, must be between 1 "
+        "and $1", compression_level_, ZSTD_maxCLevel()));
+  }
+  return Status::OK();
+}
+
+int64_t ZstandardCompressor::MaxOutputLen(int64_t input_len, const uint8_t* input) {
+  return ZSTD_compressBound(input_len);
+}
+
+Status ZstandardCompressor::ProcessBlock(bool output_preallocated, int64_t input_length,
+    const uint8_t* input, int64_t* output_length, uint8_t** output) {
+  int64_t max_compressed_len = MaxOutputLen(input_length);
+  if (output_preallocated && *output_length < max_compressed_len) {
+    return Status("ZstandardCompressor::ProcessBlock: output length too small");
+  }
+
+  if (!output_preallocated) {
+    if ((!reuse_buffer_ || buffer_length_ < max_compressed_len)) {
+      DCHECK(memory_pool_ != NULL) << "Can't allocate without passing in a mem pool";
+      buffer_length_ = max_compressed_len;
+      out_buffer_ = memory_pool_->Allocate(buffer_length_);
+    }
+    *output = out_buffer_;
+    *output_length = buffer_length_;
+  }
+
+  size_t ret = ZSTD_compress(*output, *output_length, input, input_length,
+      compression_level_);
+  if (ZSTD_isError(ret)) {
+    return Status(Substitute("Zstandard compression failed: $0", ZSTD_getErrorName(ret)));
+  }
+  *output_length = ret;
+  return Status::OK();
+}
@@ -132,5 +132,24 @@ class Lz4Compressor : public Codec {
   virtual Status Init() { return Status::OK(); }
 };
 
+/// Zstandard compresses close to gzip with decompression speeds close to snappy. The
+/// compression level trades compression ratio for speed, it is set by
+/// --zstd_compression_level.
+class ZstandardCompressor : public Codec {
+ public:
+  virtual ~ZstandardCompressor() { }
+  virtual int64_t MaxOutputLen(int64_t input_len, const uint8_t* input = NULL);
+  virtual Status ProcessBlock(bool output_preallocated, int64_t input_length,
+      const uint8_t* input, int64_t* output_length, uint8_t** output);
+  virtual std::string file_extension() const { return "zst"; }
+
+ private:
+  friend class Codec;
+  ZstandardCompressor(MemPool* mem_pool, bool reuse_buffer, int compression_level);
+  virtual Status Init();
+
+  const int compression_level_;
+};
+
 }
 #endif
@@ -26,9 +26,10 @@ class CountingBarrier {
     DCHECK_GT(count, 0);
   }
 
-  /// Sends one notification, decrementing the number of pending notifications by one.
-  void Notify() {
-    if (count_.UpdateAndFetch(-1) == 0) promise_.Set(true);
+  /// Sends 'num' notifications, decrementing the number of pending notifications by
+  /// 'num'.
+  void Notify(int32_t num = 1) {
+    if (count_.UpdateAndFetch(-num) == 0) promise_.Set(true);
   }
 
   /// Blocks until all notifications are received.
@@ -52,16 +53,17 @@ class CountingBarrier {
 /// worry about notifying on every possible path out of a scope.
 class NotifyBarrierOnExit {
  public:
-  NotifyBarrierOnExit(CountingBarrier* b) : barrier(b) {
+  NotifyBarrierOnExit(CountingBarrier* b, int32_t n = 1) : barrier(b), num(n) {
     DCHECK(b != NULL);
   }
 
   ~NotifyBarrierOnExit() {
-    barrier->Notify();
+    barrier->Notify(num);
   }
 
  private:
   CountingBarrier* barrier;
+  int32_t num;
 };
 
 }
@@ -16,9 +16,14 @@
 
 #ifdef __APPLE__
 #include <sys/sysctl.h>
+#else
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
 #endif
 
 #include <boost/algorithm/string.hpp>
+#include <gutil/strings/substitute.h>
 #include <iostream>
 #include <fstream>
 #include <mmintrin.h>
@@ -27,13 +32,17 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "util/error-util.h"
 #include "util/pretty-printer.h"
 
 #include "common/names.h"
 
 using boost::algorithm::contains;
+using boost::algorithm::split;
 using boost::algorithm::trim;
+using boost::algorithm::is_any_of;
 using std::max;
+using strings::Substitute;
 
 DECLARE_bool(abort_on_config_error);
 DEFINE_int32(num_cores, 0, "(Advanced) If > 0, it sets the number of cores available to"
@@ -49,6 +58,7 @@ long CpuInfo::cache_sizes_[L3_CACHE + 1];
 int64_t CpuInfo::cycles_per_ms_;
 int CpuInfo::num_cores_ = 1;
 string CpuInfo::model_name_ = "unknown";
+vector<vector<int> > CpuInfo::numa_node_cores_;
 
 static struct {
   string name;
@@ -59,6 +69,7 @@ static struct {
   { "sse4_1", CpuInfo::SSE4_1 },
   { "sse4_2", CpuInfo::SSE4_2 },
   { "popcnt", CpuInfo::POPCNT },
+  { "avx2",   CpuInfo::AVX2 },
 };
 static const long num_flags = sizeof(flag_mappings) / sizeof(flag_mappings[0]);
 
@@ -147,9 +158,90 @@ void CpuInfo::Init() {
 
   if (FLAGS_num_cores > 0) num_cores_ = FLAGS_num_cores;
 
+  InitNumaNodes();
+
   initialized_ = true;
 }
 
+// Parses a sysfs cpu list like "0-7,16-23" into 'cores'.
+static void ParseCpuList(const string& list, vector<int>* cores) {
+  vector<string> ranges;
+  split(ranges, list, is_any_of(","));
+  for (int i = 0; i < ranges.size(); ++i) {
+    if (ranges[i].empty()) continue;
+    size_t dash = ranges[i].find('-');
+    int first = atoi(ranges[i].substr(0, dash).c_str());
+    int last = dash == string::npos ? first : atoi(ranges[i].substr(dash + 1).c_str());
+    for (int core = first; core <= last; ++core) cores->push_back(core);
+  }
+}
+
+void CpuInfo::InitNumaNodes() {
+  numa_node_cores_.clear();
+#ifndef __APPLE__
+  // Nodes are numbered densely from 0. Stop at the first one that doesn't exist.
+  for (int node = 0; ; ++node) {
+    ifstream cpulist(
+        Substitute("/sys/devices/system/node/node$0/cpulist", node).c_str(), ios::in);
+    if (!cpulist.is_open()) break;
+    string line;
+    getline(cpulist, line);
+    trim(line);
+    numa_node_cores_.push_back(vector<int>());
+    ParseCpuList(line, &numa_node_cores_.back());
+  }
+#endif
+  if (numa_node_cores_.empty()) {
+    // Not a NUMA machine, or the topology isn't exposed: treat it as a single node.
+    numa_node_cores_.push_back(vector<int>());
+    for (int core = 0; core < num_cores_; ++core) {
+      numa_node_cores_.back().push_back(core);
+    }
+  }
+}
+
+int CpuInfo::GetCurrentNumaNode() {
+  DCHECK(initialized_);
+  if (numa_node_cores_.size() == 1) return 0;
+#ifndef __APPLE__
+  unsigned cpu;
+  unsigned node;
+  if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0 && node < numa_node_cores_.size()) {
+    return node;
+  }
+#endif
+  return 0;
+}
+
+Status CpuInfo::PinThreadToNumaNode(int node) {
+  DCHECK(initialized_);
+  DCHECK_GE(node, 0);
+  DCHECK_LT(node, numa_node_cores_.size());
+#ifdef __APPLE__
+  return Status("Pinning threads to NUMA nodes is not supported on this platform");
+#else
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  const vector<int>& cores = numa_node_cores_[node];
+  for (int i = 0; i < cores.size(); ++i) CPU_SET(cores[i], &cpus);
+  if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+    return Status(Substitute("Could not pin thread to the cores of NUMA node $0: $1",
+        node, GetStrErrMsg()));
+  }
+  if (numa_node_cores_.size() > 1 && node < sizeof(unsigned long) * 8) {
+    // Only a preference: allocations fall back to other nodes when this one is full.
+    // Failure is harmless, since the pages are still first touched on this node.
+    unsigned long node_mask = 1UL << node;
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &node_mask,
+        sizeof(node_mask) * 8) != 0) {
+      VLOG_QUERY << "Could not prefer the memory of NUMA node " << node << ": "
+                 << GetStrErrMsg();
+    }
+  }
+  return Status::OK();
+#endif
+}
+
 void CpuInfo::VerifyCpuRequirements() {
   if (!CpuInfo::IsSupported(CpuInfo::SSSE3)) {
     LOG(ERROR) << "CPU does not support the Supplemental SSE3 (SSSE3) instruction set, "
@@ -177,6 +269,7 @@ string CpuInfo::DebugString() {
   stream << "Cpu Info:" << endl
          << "  Model: " << model_name_ << endl
          << "  Cores: " << num_cores_ << endl
+         << "  NUMA Nodes: " << numa_node_cores_.size() << endl
          << "  L1 Cache: " << PrettyPrinter::Print(L1, TUnit::BYTES) << endl
          << "  L2 Cache: " << PrettyPrinter::Print(L2, TUnit::BYTES) << endl
          << "  L3 Cache: " << PrettyPrinter::Print(L3, TUnit::BYTES) << endl
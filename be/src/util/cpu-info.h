@@ -17,9 +17,11 @@
 #define IMPALA_UTIL_CPU_INFO_H
 
 #include <string>
+#include <vector>
 #include <boost/cstdint.hpp>
 
 #include "common/logging.h"
+#include "common/status.h"
 
 namespace impala {
 
@@ -33,6 +35,7 @@ class CpuInfo {
   static const int64_t SSE4_1  = (1 << 2);
   static const int64_t SSE4_2  = (1 << 3);
   static const int64_t POPCNT  = (1 << 4);
+  static const int64_t AVX2    = (1 << 5);
 
   /// Cache enums for L1 (data), L2 and L3
   enum CacheLevel {
@@ -88,6 +91,28 @@ class CpuInfo {
     return model_name_;
   }
 
+  /// Returns the number of NUMA nodes on this machine, 1 if it isn't a NUMA machine.
+  static int num_numa_nodes() {
+    DCHECK(initialized_);
+    return numa_node_cores_.size();
+  }
+
+  /// Returns the cores of NUMA node 'node'.
+  static const std::vector<int>& numa_node_cores(int node) {
+    DCHECK(initialized_);
+    DCHECK_GE(node, 0);
+    DCHECK_LT(node, numa_node_cores_.size());
+    return numa_node_cores_[node];
+  }
+
+  /// Returns the NUMA node of the core that the calling thread is running on.
+  static int GetCurrentNumaNode();
+
+  /// Restricts the calling thread to the cores of NUMA node 'node' and makes the kernel
+  /// prefer that node's memory for the pages that the thread faults in. Threads that it
+  /// starts afterwards inherit both. Returns an error if the affinity couldn't be set.
+  static Status PinThreadToNumaNode(int node);
+
   static std::string DebugString();
 
  private:
@@ -98,6 +123,12 @@ class CpuInfo {
   static int64_t cycles_per_ms_;
   static int num_cores_;
   static std::string model_name_;
+
+  /// The cores of each NUMA node, indexed by node.
+  static std::vector<std::vector<int> > numa_node_cores_;
+
+  /// Reads the NUMA topology from /sys/devices/system/node into numa_node_cores_.
+  static void InitNumaNodes();
 };
 
 }
@@ -228,6 +228,10 @@ TEST_F(DecompressorTest, LZ4) {
   RunTest(THdfsCompression::LZ4);
 }
 
+TEST_F(DecompressorTest, Zstd) {
+  RunTest(THdfsCompression::ZSTD);
+}
+
 TEST_F(DecompressorTest, Gzip) {
   RunTest(THdfsCompression::GZIP);
   RunTestStreaming(THdfsCompression::GZIP);
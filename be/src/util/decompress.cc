@@ -24,6 +24,7 @@
 #include <bzlib.h>
 #include <snappy.h>
 #include <lz4.h>
+#include <zstd.h>
 
 #include "common/names.h"
 
@@ -557,3 +558,40 @@ Status Lz4Decompressor::ProcessBlock(bool output_preallocated, int64_t input_len
 
   return Status::OK();
 }
+
+ZstandardDecompressor::ZstandardDecompressor(MemPool* mem_pool, bool reuse_buffer)
+  : Codec(mem_pool, reuse_buffer) {
+}
+
+int64_t ZstandardDecompressor::MaxOutputLen(int64_t input_len, const uint8_t* input) {
+  DCHECK(input != NULL) << "Passed null input to Zstandard Decompressor";
+  // Returns 0 if the frame header does not contain the size. Empty frames are the only
+  // ones we write without the size.
+  return ZSTD_getDecompressedSize(input, input_len);
+}
+
+Status ZstandardDecompressor::ProcessBlock(bool output_preallocated,
+    int64_t input_length, const uint8_t* input, int64_t* output_length,
+    uint8_t** output) {
+  if (!output_preallocated) {
+    int64_t uncompressed_length = MaxOutputLen(input_length, input);
+    if (!reuse_buffer_ || out_buffer_ == NULL || buffer_length_ < uncompressed_length) {
+      buffer_length_ = uncompressed_length;
+      if (buffer_length_ > MAX_BLOCK_SIZE) {
+        return Status("Decompressor: block size is too big");
+      }
+      out_buffer_ = memory_pool_->Allocate(buffer_length_);
+    }
+    *output = out_buffer_;
+    *output_length = uncompressed_length;
+  }
+
+  size_t ret = ZSTD_decompress(*output, *output_length, input, input_length);
+  if (ZSTD_isError(ret)) {
+    stringstream ss;
+    ss << "Zstandard decompression failed: " << ZSTD_getErrorName(ret);
+    return Status(ss.str());
+  }
+  *output_length = ret;
+  return Status::OK();
+}
@@ -110,6 +110,22 @@ class Lz4Decompressor : public Codec {
   virtual Status Init() { return Status::OK(); }
 };
 
+/// Decompresses Zstandard frames. Allocating the output requires the frame header to
+/// contain the decompressed size, which our compressor always writes.
+class ZstandardDecompressor : public Codec {
+ public:
+  virtual ~ZstandardDecompressor() { }
+  virtual int64_t MaxOutputLen(int64_t input_len, const uint8_t* input = NULL);
+  virtual Status ProcessBlock(bool output_preallocated, int64_t input_length,
+      const uint8_t* input, int64_t* output_length, uint8_t** output);
+  virtual std::string file_extension() const { return "zst"; }
+
+ private:
+  friend class Codec;
+  ZstandardDecompressor(MemPool* mem_pool, bool reuse_buffer);
+  virtual Status Init() { return Status::OK(); }
+};
+
 class SnappyBlockDecompressor : public Codec {
  public:
   virtual ~SnappyBlockDecompressor() { }
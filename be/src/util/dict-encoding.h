@@ -206,6 +206,28 @@ class DictDecoder : public DictDecoderBase {
   /// the string data is from the dictionary buffer passed into the c'tor.
   bool GetValue(T* value);
 
+  /// Decodes the next 'num_values' values into 'values'. Returns the number of values
+  /// decoded, which is less than 'num_values' only if the end of the data was reached,
+  /// or -1 if the data is invalid. The indices are decoded in bulk and then looked up
+  /// in the dictionary, which is much cheaper than calling GetValue() per value.
+  int GetValues(T* values, int num_values) { return GetValues(values, NULL, num_values); }
+
+  /// Same as above, but if 'indices' is not NULL, also stores the dictionary index of
+  /// each decoded value in it.
+  int GetValues(T* values, int* indices, int num_values);
+
+  /// Copies the dictionary entry at 'index' into 'value'. 'index' must be valid.
+  void GetDictValue(int index, T* value) const {
+    DCHECK_GE(index, 0);
+    DCHECK_LT(index, dict_.size());
+    // Use memcpy so that 'value' does not need to be 16 byte aligned for Decimal16Value
+    // (see IMPALA-959).
+    memcpy(value, &dict_[index], sizeof(T));
+  }
+
+  /// Maximum number of indices decoded at once by GetValues().
+  static const int DECODE_BATCH_SIZE = 128;
+
  private:
   std::vector<T> dict_;
 };
@@ -291,6 +313,37 @@ inline bool DictDecoder<Decimal16Value>::GetValue(Decimal16Value* value) {
   return true;
 }
 
+template<typename T>
+const int DictDecoder<T>::DECODE_BATCH_SIZE;
+
+template<typename T>
+inline int DictDecoder<T>::GetValues(T* values, int* out_indices, int num_values) {
+  int indices[DECODE_BATCH_SIZE];
+  int num_decoded = 0;
+  const uint8_t* dict_base = reinterpret_cast<const uint8_t*>(dict_.data());
+  while (num_decoded < num_values) {
+    int batch_size = std::min(num_values - num_decoded, DECODE_BATCH_SIZE);
+    int num_indices = data_decoder_.GetValues(batch_size, indices);
+    // Check all indices before doing any lookups. Use | to avoid branches.
+    bool invalid = false;
+    for (int i = 0; i < num_indices; ++i) {
+      invalid |= (indices[i] < 0) | (indices[i] >= dict_.size());
+    }
+    if (UNLIKELY(invalid)) return -1;
+    // Use memcpy instead of '=' so Decimal16Value addresses do not need to be 16 byte
+    // aligned (see IMPALA-959).
+    for (int i = 0; i < num_indices; ++i) {
+      memcpy(&values[num_decoded + i], dict_base + indices[i] * sizeof(T), sizeof(T));
+    }
+    if (out_indices != NULL) {
+      memcpy(out_indices + num_decoded, indices, num_indices * sizeof(int));
+    }
+    num_decoded += num_indices;
+    if (num_indices < batch_size) break;
+  }
+  return num_decoded;
+}
+
 template<typename T>
 inline void DictEncoder<T>::WriteDict(uint8_t* buffer) {
   BOOST_FOREACH(const Node& node, nodes_) {
@@ -305,8 +358,10 @@ inline int DictEncoderBase::WriteData(uint8_t* buffer, int buffer_len) {
   --buffer_len;
 
   RleEncoder encoder(buffer, buffer_len, bit_width());
-  BOOST_FOREACH(int index, buffered_indices_) {
-    if (!encoder.Put(index)) return -1;
+  int num_indices = buffered_indices_.size();
+  if (num_indices > 0 &&
+      encoder.PutValues(&buffered_indices_[0], num_indices) < num_indices) {
+    return -1;
   }
   encoder.Flush();
   return 1 + encoder.len();
@@ -58,6 +58,26 @@ void ValidateDict(const vector<T>& values, int fixed_buffer_byte_size) {
     decoder.GetValue(&j);
     EXPECT_EQ(i, j);
   }
+
+  // Decode the same data again in bulk.
+  decoder.SetData(data_buffer, data_len);
+  vector<T> decoded(values.size());
+  int num_decoded = decoded.empty() ? 0 : decoder.GetValues(&decoded[0], decoded.size());
+  EXPECT_EQ(num_decoded, values.size());
+  for (int i = 0; i < num_decoded; ++i) EXPECT_EQ(values[i], decoded[i]);
+
+  // Decode it once more, also returning the dictionary indices of the values.
+  decoder.SetData(data_buffer, data_len);
+  vector<int> indices(values.size());
+  num_decoded = decoded.empty() ? 0 :
+      decoder.GetValues(&decoded[0], &indices[0], decoded.size());
+  EXPECT_EQ(num_decoded, values.size());
+  for (int i = 0; i < num_decoded; ++i) {
+    EXPECT_EQ(values[i], decoded[i]);
+    T dict_value;
+    decoder.GetDictValue(indices[i], &dict_value);
+    EXPECT_EQ(values[i], dict_value);
+  }
   pool.FreeAll();
 }
 
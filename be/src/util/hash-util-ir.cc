@@ -37,6 +37,20 @@ uint32_t IrCrcHash(const void* data, int32_t bytes, uint32_t hash) {
   return HashUtil::FnvHash64to32(data, bytes, hash);
 #endif
 }
+
+// Must match HashUtil::VarLenHash(). This is only used if SSE4.2 is supported, see
+// LlvmCodeGen::GetVarLenHashFunction().
+extern "C"
+uint32_t IrVarLenHash(const void* data, int32_t bytes, uint32_t hash) {
+#ifdef __SSE4_2__
+  if (bytes > HashUtil::VAR_LEN_XXHASH_MIN_BYTES) {
+    return HashUtil::XxHash64(data, bytes, hash);
+  }
+  return HashUtil::CrcHash(data, bytes, hash);
+#else
+  return HashUtil::FnvHash64to32(data, bytes, hash);
+#endif
+}
 #else
 #error "This file should only be compiled by clang."
 #endif
@@ -34,16 +34,24 @@ class HashUtil {
   /// NOTE: Any changes made to this function need to be reflected in Codegen::GetHashFn.
   /// TODO: crc32 hashes with different seeds do not result in different hash functions.
   /// The resulting hashes are correlated.
-  /// TODO: update this to also use SSE4_crc32_u64 and SSE4_crc32_u16 where appropriate.
   static uint32_t CrcHash(const void* data, int32_t bytes, uint32_t hash) {
     DCHECK(CpuInfo::IsSupported(CpuInfo::SSE4_2));
-    uint32_t words = bytes / sizeof(uint32_t);
-    bytes = bytes % sizeof(uint32_t);
+    // The CRC of a sequence of bytes does not depend on the width of the steps it is
+    // computed in, so this matches the 8 byte steps of the codegen'd version.
+    uint32_t words = bytes / sizeof(uint64_t);
+    bytes = bytes % sizeof(uint64_t);
 
-    const uint32_t* p = reinterpret_cast<const uint32_t*>(data);
+    const uint64_t* p64 = reinterpret_cast<const uint64_t*>(data);
     while (words--) {
+      hash = SSE4_crc32_u64(hash, *p64);
+      ++p64;
+    }
+
+    const uint32_t* p = reinterpret_cast<const uint32_t*>(p64);
+    if (bytes >= 4) {
       hash = SSE4_crc32_u32(hash, *p);
       ++p;
+      bytes -= 4;
     }
 
     const uint8_t* s = reinterpret_cast<const uint8_t*>(p);
@@ -153,6 +161,81 @@ class HashUtil {
     return h;
   }
 
+  static const uint64_t XXH_PRIME1 = 0x9e3779b185ebca87ULL;
+  static const uint64_t XXH_PRIME2 = 0xc2b2ae3d27d4eb4fULL;
+  static const uint64_t XXH_PRIME3 = 0x165667b19e3779f9ULL;
+  static const uint64_t XXH_PRIME4 = 0x85ebca77c2b2ae63ULL;
+  static const uint64_t XXH_PRIME5 = 0x27d4eb2f165667c5ULL;
+
+  /// Implementation of the 64-bit xxHash (XXH64) function, see
+  /// https://github.com/Cyan4973/xxHash. Inputs of 32 bytes or more are consumed in
+  /// 32 byte stripes by four independent accumulators, so that the multiplications of
+  /// consecutive 8 byte words overlap. On long inputs this is faster than CrcHash(),
+  /// whose steps depend on each other, and its output is well distributed in all bits.
+  static uint64_t XxHash64(const void* input, int32_t len, uint64_t seed) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(input);
+    const uint8_t* end = p + len;
+    uint64_t h;
+    if (len >= 32) {
+      uint64_t v1 = seed + XXH_PRIME1 + XXH_PRIME2;
+      uint64_t v2 = seed + XXH_PRIME2;
+      uint64_t v3 = seed;
+      uint64_t v4 = seed - XXH_PRIME1;
+      const uint8_t* limit = end - 32;
+      do {
+        v1 = XxRound(v1, *reinterpret_cast<const uint64_t*>(p));
+        v2 = XxRound(v2, *reinterpret_cast<const uint64_t*>(p + 8));
+        v3 = XxRound(v3, *reinterpret_cast<const uint64_t*>(p + 16));
+        v4 = XxRound(v4, *reinterpret_cast<const uint64_t*>(p + 24));
+        p += 32;
+      } while (p <= limit);
+      h = Rotl64(v1, 1) + Rotl64(v2, 7) + Rotl64(v3, 12) + Rotl64(v4, 18);
+      h = XxMergeRound(h, v1);
+      h = XxMergeRound(h, v2);
+      h = XxMergeRound(h, v3);
+      h = XxMergeRound(h, v4);
+    } else {
+      h = seed + XXH_PRIME5;
+    }
+    h += static_cast<uint64_t>(len);
+
+    for (; p + 8 <= end; p += 8) {
+      h ^= XxRound(0, *reinterpret_cast<const uint64_t*>(p));
+      h = Rotl64(h, 27) * XXH_PRIME1 + XXH_PRIME4;
+    }
+    if (p + 4 <= end) {
+      h ^= static_cast<uint64_t>(*reinterpret_cast<const uint32_t*>(p)) * XXH_PRIME1;
+      h = Rotl64(h, 23) * XXH_PRIME2 + XXH_PRIME3;
+      p += 4;
+    }
+    for (; p < end; ++p) {
+      h ^= *p * XXH_PRIME5;
+      h = Rotl64(h, 11) * XXH_PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME2;
+    h ^= h >> 29;
+    h *= XXH_PRIME3;
+    h ^= h >> 32;
+    return h;
+  }
+
+  /// Inputs longer than this are hashed with XxHash64() by VarLenHash().
+  static const int32_t VAR_LEN_XXHASH_MIN_BYTES = 16;
+
+  /// Computes the hash value for variable-length data such as strings. Short inputs
+  /// are hashed like Hash() does, longer ones with XxHash64() if SSE4.2 is supported.
+  /// NOTE: Any changes made to this function need to be reflected in IrVarLenHash().
+  static uint32_t VarLenHash(const void* data, int32_t bytes, uint32_t seed) {
+    if (LIKELY(CpuInfo::IsSupported(CpuInfo::SSE4_2))) {
+      if (bytes > VAR_LEN_XXHASH_MIN_BYTES) return XxHash64(data, bytes, seed);
+      return CrcHash(data, bytes, seed);
+    } else {
+      return MurmurHash2_64(data, bytes, seed);
+    }
+  }
+
   /// default values recommended by http://isthe.com/chongo/tech/comp/fnv/
   static const uint32_t FNV_PRIME = 0x01000193; //   16777619
   static const uint32_t FNV_SEED = 0x811C9DC5; // 2166136261
@@ -236,6 +319,24 @@ class HashUtil {
     const uint64_t hash2 = (static_cast<uint64_t>(hash) * m2 + a2) >> 32;
     return hash1 | (hash2 << 32);
   }
+
+ private:
+  static inline uint64_t Rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+  }
+
+  /// Mixes the 8 byte word 'input' into the accumulator 'acc' of XxHash64().
+  static inline uint64_t XxRound(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME2;
+    acc = Rotl64(acc, 31);
+    return acc * XXH_PRIME1;
+  }
+
+  /// Merges the final value of accumulator 'acc' into the hash 'h' in XxHash64().
+  static inline uint64_t XxMergeRound(uint64_t h, uint64_t acc) {
+    h ^= XxRound(0, acc);
+    return h * XXH_PRIME1 + XXH_PRIME4;
+  }
 };
 
 }
@@ -26,13 +26,14 @@
 using namespace impala;
 
 HdfsOp::HdfsOp(HdfsOpType op, const std::string& src, HdfsOperationSet* op_set)
-    : op_(op), src_(src), op_set_(op_set) {
+    : op_(op), src_(src), path_info_(NULL), op_set_(op_set) {
   DCHECK(op != RENAME);
   DCHECK(!src_.empty());
 }
 
 HdfsOp::HdfsOp(HdfsOpType op, const std::string& src, const std::string& dst,
-    HdfsOperationSet* op_set) : op_(op), src_(src), dst_(dst), op_set_(op_set) {
+    HdfsOperationSet* op_set)
+    : op_(op), src_(src), dst_(dst), path_info_(NULL), op_set_(op_set) {
   DCHECK(op == RENAME);
   DCHECK(!src_.empty());
   DCHECK(!dst_.empty());
@@ -40,11 +41,20 @@ HdfsOp::HdfsOp(HdfsOpType op, const std::string& src, const std::string& dst,
 
 HdfsOp::HdfsOp(HdfsOpType op, const string& src, short permissions,
     HdfsOperationSet* op_set)
-    : op_(op), src_(src), permissions_(permissions), op_set_(op_set) {
+    : op_(op), src_(src), permissions_(permissions), path_info_(NULL),
+      op_set_(op_set) {
   DCHECK(op == CHMOD);
   DCHECK(!src_.empty());
 }
 
+HdfsOp::HdfsOp(HdfsOpType op, const string& src, HdfsPathInfo* path_info,
+    HdfsOperationSet* op_set)
+    : op_(op), src_(src), path_info_(path_info), op_set_(op_set) {
+  DCHECK(op == GET_PATH_INFO);
+  DCHECK(!src_.empty());
+  DCHECK(path_info_ != NULL);
+}
+
 // Required for ThreadPool
 HdfsOp::HdfsOp() { }
 
@@ -78,6 +88,16 @@ void HdfsOp::Execute() const {
       err = hdfsChmod(*hdfs_connection, src_.c_str(), permissions_);
       VLOG_FILE << "hdfsChmod() file=" << src_.c_str();
       break;
+    case GET_PATH_INFO: {
+      hdfsFileInfo* info = hdfsGetPathInfo(*hdfs_connection, src_.c_str());
+      VLOG_FILE << "hdfsGetPathInfo() file=" << src_.c_str();
+      path_info_->exists = info != NULL;
+      if (info != NULL) {
+        path_info_->permissions = info->mPermissions;
+        hdfsFreeFileInfo(info, 1);
+      }
+      break;
+    }
   }
 
   if (err == -1) {
@@ -100,6 +120,9 @@ void HdfsOp::Execute() const {
       case CHMOD:
         ss << "CHMOD " << src_ << " " << oct << permissions_;
         break;
+      case GET_PATH_INFO:
+        ss << "GET_PATH_INFO " << src_;
+        break;
     }
     ss << ") failed, error was: " << error_msg;
 
@@ -154,6 +177,10 @@ void HdfsOperationSet::Add(HdfsOpType op, const string& src, short permissions)
   ops_.push_back(HdfsOp(op, src, permissions, this));
 }
 
+void HdfsOperationSet::Add(HdfsOpType op, const string& src, HdfsPathInfo* path_info) {
+  ops_.push_back(HdfsOp(op, src, path_info, this));
+}
+
 void HdfsOperationSet::AddError(const string& err, const HdfsOp* op) {
   lock_guard<mutex> l(errors_lock_);
   errors_.push_back(make_pair(op, err));
@@ -30,11 +30,24 @@ enum HdfsOpType {
   CREATE_DIR,
   RENAME,
   DELETE_THEN_CREATE,
-  CHMOD
+  CHMOD,
+  GET_PATH_INFO
 };
 
 class HdfsOperationSet;
 
+/// Result of a GET_PATH_INFO operation.
+struct HdfsPathInfo {
+  /// False if hdfsGetPathInfo() failed, which usually means that the path does not
+  /// exist.
+  bool exists;
+
+  /// Permissions of the path. Only set if 'exists' is true.
+  short permissions;
+
+  HdfsPathInfo() : exists(false), permissions(0) { }
+};
+
 /// Container class that encapsulates a single HDFS operation. Used only internally by
 /// HdfsOperationSet, but visible because it parameterises HdfsOpThreadPool.
 class HdfsOp {
@@ -47,6 +60,9 @@ class HdfsOp {
   HdfsOp(HdfsOpType op, const std::string& src, short permissions,
       HdfsOperationSet* op_set);
 
+  HdfsOp(HdfsOpType op, const std::string& src, HdfsPathInfo* path_info,
+      HdfsOperationSet* op_set);
+
   /// Required for ThreadPool
   HdfsOp();
 
@@ -71,6 +87,9 @@ class HdfsOp {
   /// Permission operand, ignored except for CHMOD
   short permissions_;
 
+  /// Output of GET_PATH_INFO, not owned. NULL for other operations.
+  HdfsPathInfo* path_info_;
+
   /// Containing operation set, used to record errors and to signal completion.
   HdfsOperationSet* op_set_;
 };
@@ -101,6 +120,11 @@ class HdfsOperationSet {
   /// Add an operation that takes a permission argument (i.e. CHMOD)
   void Add(HdfsOpType op, const std::string& src, short permissions);
 
+  /// Add an operation that returns information about 'src' (i.e. GET_PATH_INFO) in
+  /// 'path_info', which must stay valid until Execute() returns. A path that does not
+  /// exist is not an error.
+  void Add(HdfsOpType op, const std::string& src, HdfsPathInfo* path_info);
+
   /// Run all operations on the given pool, blocking until all are complete. Returns false
   /// if there were any errors, true otherwise.
   /// If abort_on_error is true, execution will finish after the first error seen.
@@ -73,4 +73,8 @@ bool IsS3APath(const char* path) {
   return strncmp(path, "s3a://", 6) == 0;
 }
 
+bool IsLocalPath(const char* path) {
+  return strncmp(path, "file:", 5) == 0;
+}
+
 }
@@ -46,5 +46,9 @@ bool IsDfsPath(const char* path);
 
 /// Returns true iff the path refers to a location on an S3A filesystem.
 bool IsS3APath(const char* path);
+
+/// Returns true iff the path refers to a location on the local filesystem, i.e. it
+/// starts with "file:".
+bool IsLocalPath(const char* path);
 }
 #endif // IMPALA_UTIL_HDFS_UTIL_H
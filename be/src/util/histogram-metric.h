@@ -15,6 +15,8 @@
 #ifndef IMPALA_UTIL_HISTOGRAM_METRIC
 #define IMPALA_UTIL_HISTOGRAM_METRIC
 
+#include <algorithm>
+
 #include "util/hdr-histogram.h"
 #include "util/metrics.h"
 
@@ -58,7 +60,11 @@ class HistogramMetric : public Metric {
     *value = container;
   }
 
-  void Update(int64_t val) { histogram_.Increment(val); }
+  /// Adds 'val' to the histogram. Values above the highest trackable value are recorded
+  /// as that value.
+  void Update(int64_t val) {
+    histogram_.Increment(std::min<uint64_t>(val, histogram_.highest_trackable_value()));
+  }
 
   virtual void ToLegacyJson(rapidjson::Document*) { }
 
@@ -0,0 +1,68 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/huge-page-allocator.h"
+
+#include <string.h>
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include "common/names.h"
+
+DECLARE_string(huge_pages);
+DECLARE_int64(huge_page_alloc_threshold);
+
+namespace impala {
+
+// Allocates buffers below and above the threshold, writes to all their bytes and frees
+// them.
+void TestAllocations(bool expect_aligned) {
+  const int NUM_LENS = 4;
+  int64_t lens[NUM_LENS] = { 1, 4096, FLAGS_huge_page_alloc_threshold,
+      3 * HugePageAllocator::HUGE_PAGE_SIZE + 1 };
+  for (int i = 0; i < NUM_LENS; ++i) {
+    uint8_t* buffer = HugePageAllocator::Allocate(lens[i]);
+    ASSERT_TRUE(buffer != NULL);
+    if (expect_aligned && lens[i] >= FLAGS_huge_page_alloc_threshold) {
+      EXPECT_EQ(reinterpret_cast<uintptr_t>(buffer) % HugePageAllocator::HUGE_PAGE_SIZE,
+          0);
+    }
+    memset(buffer, i, lens[i]);
+    EXPECT_EQ(buffer[lens[i] - 1], i);
+    HugePageAllocator::Free(buffer, lens[i]);
+  }
+}
+
+TEST(HugePageAllocatorTest, None) {
+  FLAGS_huge_pages = "none";
+  TestAllocations(false);
+}
+
+TEST(HugePageAllocatorTest, Transparent) {
+  FLAGS_huge_pages = "transparent";
+  TestAllocations(true);
+}
+
+// Falls back to transparent huge pages if no huge pages were preallocated.
+TEST(HugePageAllocatorTest, Explicit) {
+  FLAGS_huge_pages = "explicit";
+  TestAllocations(true);
+}
+
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,115 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/huge-page-allocator.h"
+
+#include <new>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <gflags/gflags.h>
+
+#include "common/logging.h"
+#include "util/bit-util.h"
+#include "util/error-util.h"
+#include "util/impalad-metrics.h"
+
+#include "common/names.h"
+
+DEFINE_string(huge_pages, "none", "(Advanced) Whether large hash table bucket arrays "
+    "and buffers are backed by 2MB huge pages: 'none', 'transparent' to request "
+    "transparent huge pages with madvise(), or 'explicit' to map them from the "
+    "preallocated huge page pool, falling back to transparent huge pages if it is "
+    "exhausted.");
+DEFINE_int64(huge_page_alloc_threshold, 2L * 1024L * 1024L, "(Advanced) Allocations "
+    "of at least this many bytes are backed by huge pages if --huge_pages is set.");
+
+namespace impala {
+
+const int64_t HugePageAllocator::HUGE_PAGE_SIZE;
+
+HugePageAllocator::Mode HugePageAllocator::GetMode() {
+  if (FLAGS_huge_pages == "transparent") return TRANSPARENT;
+  if (FLAGS_huge_pages == "explicit") return EXPLICIT;
+  DCHECK(FLAGS_huge_pages == "none") << "Invalid --huge_pages: " << FLAGS_huge_pages;
+  return NONE;
+}
+
+uint8_t* HugePageAllocator::Allocate(int64_t len) {
+  bool large = len >= FLAGS_huge_page_alloc_threshold;
+  Mode mode = GetMode();
+  if (!large || mode == NONE) {
+    uint8_t* buffer = reinterpret_cast<uint8_t*>(malloc(len));
+    if (buffer == NULL) throw std::bad_alloc();
+    if (large && ImpaladMetrics::HUGE_PAGE_ELIGIBLE_BYTES != NULL) {
+      ImpaladMetrics::HUGE_PAGE_ELIGIBLE_BYTES->Increment(len);
+    }
+    return buffer;
+  }
+
+  int64_t mapped_len = BitUtil::RoundUp(len, HUGE_PAGE_SIZE);
+  uint8_t* buffer = NULL;
+  if (mode == EXPLICIT) {
+    void* mem = mmap(NULL, mapped_len, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mem != MAP_FAILED) buffer = reinterpret_cast<uint8_t*>(mem);
+  }
+  if (buffer == NULL) {
+    buffer = MapAligned(mapped_len);
+    if (buffer == NULL) throw std::bad_alloc();
+    // This is only a hint: the kernel may not have huge pages to back the mapping.
+    madvise(buffer, mapped_len, MADV_HUGEPAGE);
+  }
+  if (ImpaladMetrics::HUGE_PAGE_ELIGIBLE_BYTES != NULL) {
+    ImpaladMetrics::HUGE_PAGE_ELIGIBLE_BYTES->Increment(len);
+  }
+  if (ImpaladMetrics::HUGE_PAGE_TOTAL_BYTES != NULL) {
+    ImpaladMetrics::HUGE_PAGE_TOTAL_BYTES->Increment(len);
+  }
+  return buffer;
+}
+
+uint8_t* HugePageAllocator::MapAligned(int64_t mapped_len) {
+  // Map an extra huge page so that an aligned range of 'mapped_len' bytes is in the
+  // mapping, then unmap the unaligned head and tail.
+  void* mem = mmap(NULL, mapped_len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) return NULL;
+  uint8_t* start = reinterpret_cast<uint8_t*>(mem);
+  uint8_t* aligned = reinterpret_cast<uint8_t*>(
+      BitUtil::RoundUp(reinterpret_cast<uintptr_t>(start), HUGE_PAGE_SIZE));
+  int64_t head_len = aligned - start;
+  if (head_len > 0) munmap(start, head_len);
+  int64_t tail_len = HUGE_PAGE_SIZE - head_len;
+  if (tail_len > 0) munmap(aligned + mapped_len, tail_len);
+  return aligned;
+}
+
+void HugePageAllocator::Free(uint8_t* buffer, int64_t len) {
+  if (buffer == NULL) return;
+  bool large = len >= FLAGS_huge_page_alloc_threshold;
+  if (large && ImpaladMetrics::HUGE_PAGE_ELIGIBLE_BYTES != NULL) {
+    ImpaladMetrics::HUGE_PAGE_ELIGIBLE_BYTES->Increment(-len);
+  }
+  if (!large || GetMode() == NONE) {
+    free(buffer);
+    return;
+  }
+  if (ImpaladMetrics::HUGE_PAGE_TOTAL_BYTES != NULL) {
+    ImpaladMetrics::HUGE_PAGE_TOTAL_BYTES->Increment(-len);
+  }
+  int rc = munmap(buffer, BitUtil::RoundUp(len, HUGE_PAGE_SIZE));
+  DCHECK_EQ(rc, 0) << "munmap() failed: " << GetStrErrMsg();
+}
+
+}
@@ -0,0 +1,72 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_UTIL_HUGE_PAGE_ALLOCATOR_H
+#define IMPALA_UTIL_HUGE_PAGE_ALLOCATOR_H
+
+#include <boost/cstdint.hpp>
+
+namespace impala {
+
+/// Allocator for large, randomly accessed memory such as hash table bucket arrays and
+/// block buffers. With 4KB pages, random probes into multi-GB arrays miss the TLB on
+/// nearly every access. Depending on --huge_pages, allocations of at least
+/// --huge_page_alloc_threshold bytes are mapped directly with mmap() and backed by 2MB
+/// huge pages:
+///  - 'transparent': the mapping is aligned to 2MB and madvise(MADV_HUGEPAGE)d, so
+///    that the kernel backs it with transparent huge pages if it can.
+///  - 'explicit': the mapping comes from the preallocated huge page pool
+///    (MAP_HUGETLB, see /proc/sys/vm/nr_hugepages). If the pool is exhausted, falls
+///    back to transparent huge pages.
+/// Other allocations, and all allocations with --huge_pages=none, use malloc().
+/// Memory that is mapped directly is not included in the tcmalloc metrics, so callers
+/// must account for it in their MemTrackers, as the hash tables and the buffer users
+/// already do.
+///
+/// The bytes of large allocations and of the ones that were given huge pages are
+/// reported in the impala-server.huge-pages.* metrics, whose ratio is the huge page
+/// coverage.
+///
+/// Thread-safe.
+class HugePageAllocator {
+ public:
+  /// Size of a huge page.
+  static const int64_t HUGE_PAGE_SIZE = 2L * 1024L * 1024L;
+
+  /// Returns a buffer of 'len' bytes. Throws std::bad_alloc if there is no memory.
+  static uint8_t* Allocate(int64_t len);
+
+  /// Frees 'buffer', which was returned by Allocate() for 'len' bytes.
+  static void Free(uint8_t* buffer, int64_t len);
+
+ private:
+  /// Values of --huge_pages.
+  enum Mode {
+    NONE,
+    TRANSPARENT,
+    EXPLICIT,
+  };
+
+  /// Returns the mode set by --huge_pages.
+  static Mode GetMode();
+
+  /// Maps 'mapped_len' bytes, a multiple of HUGE_PAGE_SIZE, aligned to HUGE_PAGE_SIZE.
+  /// Returns NULL if that failed.
+  static uint8_t* MapAligned(int64_t mapped_len);
+};
+
+}
+
+#endif
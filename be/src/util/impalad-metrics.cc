@@ -43,6 +43,14 @@ const char* ImpaladMetricKeys::MEM_POOL_TOTAL_BYTES =
     "impala-server.mem-pool.total-bytes";
 const char* ImpaladMetricKeys::HASH_TABLE_TOTAL_BYTES =
     "impala-server.hash-table.total-bytes";
+const char* ImpaladMetricKeys::HUGE_PAGE_ELIGIBLE_BYTES =
+    "impala-server.huge-pages.eligible-bytes";
+const char* ImpaladMetricKeys::HUGE_PAGE_TOTAL_BYTES =
+    "impala-server.huge-pages.total-bytes";
+const char* ImpaladMetricKeys::REGEX_CACHE_NUM_ENTRIES =
+    "impala-server.regex-cache.num-entries";
+const char* ImpaladMetricKeys::REGEX_CACHE_MEM_BUDGET_BYTES =
+    "impala-server.regex-cache.mem-budget-bytes";
 const char* ImpaladMetricKeys::IO_MGR_NUM_OPEN_FILES =
     "impala-server.io-mgr.num-open-files";
 const char* ImpaladMetricKeys::IO_MGR_NUM_BUFFERS =
@@ -71,6 +79,8 @@ const char* ImpaladMetricKeys::IO_MGR_CACHED_FILE_HANDLES_HIT_COUNT =
     "impala-server.io.mgr.cached-file-handles-hit-count";
 const char* ImpaladMetricKeys::IO_MGR_CACHED_FILE_HANDLES_MISS_COUNT =
     "impala-server.io.mgr.cached-file-handles-miss-count";
+const char* ImpaladMetricKeys::IO_MGR_CACHED_FILE_HANDLES_EVICTED =
+    "impala-server.io.mgr.cached-file-handles-evicted";
 const char* ImpaladMetricKeys::CATALOG_NUM_DBS =
     "catalog.num-databases";
 const char* ImpaladMetricKeys::CATALOG_NUM_TABLES =
@@ -102,6 +112,10 @@ const char* ImpaladMetricKeys::DDL_DURATIONS =
 // =======
 // Counters
 IntGauge* ImpaladMetrics::HASH_TABLE_TOTAL_BYTES = NULL;
+IntGauge* ImpaladMetrics::HUGE_PAGE_ELIGIBLE_BYTES = NULL;
+IntGauge* ImpaladMetrics::HUGE_PAGE_TOTAL_BYTES = NULL;
+IntGauge* ImpaladMetrics::REGEX_CACHE_NUM_ENTRIES = NULL;
+IntGauge* ImpaladMetrics::REGEX_CACHE_MEM_BUDGET_BYTES = NULL;
 IntCounter* ImpaladMetrics::IMPALA_SERVER_NUM_FRAGMENTS = NULL;
 IntGauge* ImpaladMetrics::IMPALA_SERVER_NUM_FRAGMENTS_IN_FLIGHT = NULL;
 IntCounter* ImpaladMetrics::IMPALA_SERVER_NUM_QUERIES = NULL;
@@ -128,6 +142,7 @@ IntGauge* ImpaladMetrics::IO_MGR_NUM_CACHED_FILE_HANDLES = NULL;
 IntGauge* ImpaladMetrics::IO_MGR_NUM_FILE_HANDLES_OUTSTANDING = NULL;
 IntGauge* ImpaladMetrics::IO_MGR_CACHED_FILE_HANDLES_HIT_COUNT = NULL;
 IntGauge* ImpaladMetrics::IO_MGR_CACHED_FILE_HANDLES_MISS_COUNT = NULL;
+IntGauge* ImpaladMetrics::IO_MGR_CACHED_FILE_HANDLES_EVICTED = NULL;
 IntGauge* ImpaladMetrics::IO_MGR_TOTAL_BYTES = NULL;
 IntGauge* ImpaladMetrics::MEM_POOL_TOTAL_BYTES = NULL;
 IntGauge* ImpaladMetrics::NUM_FILES_OPEN_FOR_INSERT = NULL;
@@ -189,6 +204,14 @@ void ImpaladMetrics::CreateMetrics(MetricGroup* m) {
       ImpaladMetricKeys::MEM_POOL_TOTAL_BYTES, 0);
   HASH_TABLE_TOTAL_BYTES = m->AddGauge<int64_t>(
       ImpaladMetricKeys::HASH_TABLE_TOTAL_BYTES, 0);
+  HUGE_PAGE_ELIGIBLE_BYTES = m->AddGauge<int64_t>(
+      ImpaladMetricKeys::HUGE_PAGE_ELIGIBLE_BYTES, 0);
+  HUGE_PAGE_TOTAL_BYTES = m->AddGauge<int64_t>(
+      ImpaladMetricKeys::HUGE_PAGE_TOTAL_BYTES, 0);
+  REGEX_CACHE_NUM_ENTRIES = m->AddGauge<int64_t>(
+      ImpaladMetricKeys::REGEX_CACHE_NUM_ENTRIES, 0);
+  REGEX_CACHE_MEM_BUDGET_BYTES = m->AddGauge<int64_t>(
+      ImpaladMetricKeys::REGEX_CACHE_MEM_BUDGET_BYTES, 0);
 
   // Initialize insert metrics
   NUM_FILES_OPEN_FOR_INSERT = m->AddGauge<int64_t>(
@@ -212,6 +235,9 @@ void ImpaladMetrics::CreateMetrics(MetricGroup* m) {
   IO_MGR_CACHED_FILE_HANDLES_MISS_COUNT = m->AddGauge<int64_t>(
       ImpaladMetricKeys::IO_MGR_CACHED_FILE_HANDLES_MISS_COUNT, 0);
 
+  IO_MGR_CACHED_FILE_HANDLES_EVICTED = m->AddGauge<int64_t>(
+      ImpaladMetricKeys::IO_MGR_CACHED_FILE_HANDLES_EVICTED, 0);
+
   IO_MGR_BYTES_READ = m->AddCounter<int64_t>(ImpaladMetricKeys::IO_MGR_BYTES_READ, 0);
   IO_MGR_LOCAL_BYTES_READ = m->AddCounter<int64_t>(
       ImpaladMetricKeys::IO_MGR_LOCAL_BYTES_READ, 0);
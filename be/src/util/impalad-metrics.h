@@ -64,6 +64,15 @@ class ImpaladMetricKeys {
   /// Number of bytes currently in use across all hash tables
   static const char* HASH_TABLE_TOTAL_BYTES;
 
+  /// Number of bytes currently allocated by the HugePageAllocator in allocations that
+  /// are large enough for huge pages, and the number of those bytes backed by them
+  static const char* HUGE_PAGE_ELIGIBLE_BYTES;
+  static const char* HUGE_PAGE_TOTAL_BYTES;
+
+  /// Number of regexes in the RegexCache and the sum of their memory budgets
+  static const char* REGEX_CACHE_NUM_ENTRIES;
+  static const char* REGEX_CACHE_MEM_BUDGET_BYTES;
+
   /// Number of files currently opened by the io mgr
   static const char* IO_MGR_NUM_OPEN_FILES;
 
@@ -106,6 +115,9 @@ class ImpaladMetricKeys {
   /// Number of cache misses for cached HDFS file handles
   static const char* IO_MGR_CACHED_FILE_HANDLES_MISS_COUNT;
 
+  /// Number of idle HDFS file handles closed because the cache was full
+  static const char* IO_MGR_CACHED_FILE_HANDLES_EVICTED;
+
   /// Number of DBs in the catalog
   static const char* CATALOG_NUM_DBS;
 
@@ -149,6 +161,10 @@ class ImpaladMetrics {
  public:
   // Counters
   static IntGauge* HASH_TABLE_TOTAL_BYTES;
+  static IntGauge* HUGE_PAGE_ELIGIBLE_BYTES;
+  static IntGauge* HUGE_PAGE_TOTAL_BYTES;
+  static IntGauge* REGEX_CACHE_NUM_ENTRIES;
+  static IntGauge* REGEX_CACHE_MEM_BUDGET_BYTES;
   static IntCounter* IMPALA_SERVER_NUM_FRAGMENTS;
   static IntGauge* IMPALA_SERVER_NUM_FRAGMENTS_IN_FLIGHT;
   static IntCounter* IMPALA_SERVER_NUM_QUERIES;
@@ -175,6 +191,7 @@ class ImpaladMetrics {
   static IntGauge* IO_MGR_NUM_FILE_HANDLES_OUTSTANDING;
   static IntGauge* IO_MGR_CACHED_FILE_HANDLES_HIT_COUNT;
   static IntGauge* IO_MGR_CACHED_FILE_HANDLES_MISS_COUNT;
+  static IntGauge* IO_MGR_CACHED_FILE_HANDLES_EVICTED;
   static IntGauge* IO_MGR_TOTAL_BYTES;
   static IntGauge* MEM_POOL_TOTAL_BYTES;
   static IntGauge* NUM_FILES_OPEN_FOR_INSERT;
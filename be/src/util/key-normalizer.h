@@ -19,6 +19,8 @@
 
 namespace impala {
 
+struct StringValue;
+
 /// Provides support for normalizing Impala expr values into a memcmp-able,
 /// fixed-length format.
 //
@@ -44,16 +46,18 @@ namespace impala {
 /// Strings:
 ///     Write one character at a time with a null byte at the end (inverted if
 ///     sort descending). Unlike other data types, we may write partial strings.
-///     NOTE: This assumes strings do not contain null characters.
+///     Null and 0x01 characters are escaped as 0x01 0x01 and 0x01 0x02, so that the
+///     terminating null byte sorts before any character.
 /// Booleans/Nulls:
 ///     Left as-is.
 //
-/// Finally, we pad any remaining bytes of the key with zeroes.
+/// Finally, we pad any remaining bytes of the key with zeroes. This includes the unused
+/// bytes of timestamp slots and the bytes after a key that went over the budget.
 class KeyNormalizer {
  public:
   /// Initializes the normalizer with the key exprs and length alloted to each normalized
   /// key.
-  KeyNormalizer(const std::vector<ExprContext*>& key_exprs_ctxs, int key_len,
+  KeyNormalizer(const std::vector<ExprContext*>& key_expr_ctxs, int key_len,
       const std::vector<bool>& is_asc, const std::vector<bool>& nulls_first)
       : key_expr_ctxs_(key_expr_ctxs), key_len_(key_len), is_asc_(is_asc),
         nulls_first_(nulls_first) {
@@ -66,6 +70,26 @@ class KeyNormalizer {
   /// TODO: Handle non-nullable columns
   bool NormalizeKey(TupleRow* tuple_row, uint8_t* dst, int* key_idx_over_budget = NULL);
 
+  /// Returns true if values of 'type' can be normalized.
+  static bool IsSupportedType(const ColumnType& type) {
+    switch (type.type) {
+      case TYPE_NULL:
+      case TYPE_BOOLEAN:
+      case TYPE_TINYINT:
+      case TYPE_SMALLINT:
+      case TYPE_INT:
+      case TYPE_BIGINT:
+      case TYPE_FLOAT:
+      case TYPE_DOUBLE:
+      case TYPE_TIMESTAMP:
+      case TYPE_STRING:
+      case TYPE_VARCHAR:
+        return true;
+      default:
+        return false;
+    }
+  }
+
  private:
   /// Returns true if we went over the max key size while writing the null bit.
   static bool WriteNullBit(uint8_t null_bit, uint8_t* value, uint8_t* dst,
@@ -87,6 +111,11 @@ class KeyNormalizer {
 
   static void NormalizeTimestamp(uint8_t* src, uint8_t* dst, bool is_asc);
 
+  /// Writes the escaped characters of 'string_val' followed by the terminating null byte
+  /// to dst. Returns true if the string did not fit in bytes_left.
+  static bool NormalizeString(const StringValue* string_val, bool is_asc, uint8_t* dst,
+      int* bytes_left);
+
   /// Normalizes a sort key value and writes it to dst.
   /// Updates bytes_left and returns true if we went over the max key size.
   static bool WriteNormalizedKey(const ColumnType& type, bool is_asc,
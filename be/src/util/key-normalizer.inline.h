@@ -19,6 +19,7 @@
 
 #include <boost/date_time/gregorian/gregorian_types.hpp>
 
+#include "exprs/expr-context.h"
 #include "runtime/descriptors.h"
 #include "runtime/string-value.h"
 #include "runtime/timestamp-value.h"
@@ -83,6 +84,28 @@ inline void KeyNormalizer::NormalizeTimestamp(uint8_t* src, uint8_t* dst, bool i
   StoreFinalValue<uint64_t>(time_ns, dst + sizeof(date), is_asc);
 }
 
+inline bool KeyNormalizer::NormalizeString(const StringValue* string_val, bool is_asc,
+    uint8_t* dst, int* bytes_left) {
+  int written = 0;
+  for (int i = 0; i < string_val->len; ++i) {
+    uint8_t c = string_val->ptr[i];
+    if (LIKELY(c > 1)) {
+      if (written == *bytes_left) break;
+      StoreFinalValue<uint8_t>(c, dst + written++, is_asc);
+    } else {
+      // A partially written escape sequence is still a prefix of the key.
+      if (written == *bytes_left) break;
+      StoreFinalValue<uint8_t>(1, dst + written++, is_asc);
+      if (written == *bytes_left) break;
+      StoreFinalValue<uint8_t>(c + 1, dst + written++, is_asc);
+    }
+  }
+  bool went_over = written == *bytes_left;
+  if (!went_over) StoreFinalValue<uint8_t>(0, dst + written++, is_asc);
+  *bytes_left -= written;
+  return went_over;
+}
+
 inline bool KeyNormalizer::WriteNormalizedKey(const ColumnType& type, bool is_asc,
     uint8_t* value, uint8_t* dst, int* bytes_left) {
   // Expend bytes_left or fail if we don't have enough.
@@ -122,22 +145,9 @@ inline bool KeyNormalizer::WriteNormalizedKey(const ColumnType& type, bool is_as
       break;
 
     case TYPE_STRING:
-    case TYPE_VARCHAR: {
-      StringValue* string_val = reinterpret_cast<StringValue*>(value);
-
-      // Copy the string over, with an additional NULL at the end.
-      int size = std::min(string_val->len, *bytes_left);
-      for (int i = 0; i < size; ++i) {
-        StoreFinalValue<uint8_t>(string_val->ptr[i], dst + i, is_asc);
-      }
-      *bytes_left -= size;
-
-      if (*bytes_left == 0) return true;
-
-      StoreFinalValue<uint8_t>(0, dst + size, is_asc);
-      --*bytes_left;
-      return false;
-    }
+    case TYPE_VARCHAR:
+      return NormalizeString(reinterpret_cast<StringValue*>(value), is_asc, dst,
+          bytes_left);
 
     case TYPE_BOOLEAN:
       StoreFinalValue<uint8_t>(*reinterpret_cast<uint8_t*>(value), dst, is_asc);
@@ -162,6 +172,8 @@ inline bool KeyNormalizer::NormalizeKeyColumn(const ColumnType& type, uint8_t nu
 inline bool KeyNormalizer::NormalizeKey(TupleRow* row, uint8_t* dst,
     int* key_idx_over_budget) {
   int bytes_left = key_len_;
+  // Zero the key up front, some types don't write all the bytes they account for.
+  bzero(dst, key_len_);
   for (int i = 0; i < key_expr_ctxs_.size(); ++i) {
     uint8_t* key = reinterpret_cast<uint8_t*>(key_expr_ctxs_[i]->GetValue(row));
     int offset = key_len_ - bytes_left;
@@ -172,11 +184,6 @@ inline bool KeyNormalizer::NormalizeKey(TupleRow* row, uint8_t* dst,
       return true;
     }
   }
-
-  // Zero out any unused bytes of the sort key.
-  int offset = key_len_ - bytes_left;
-  bzero(dst + offset, bytes_left);
-
   return false;
 }
 
@@ -0,0 +1,83 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include "util/lock-profiler.h"
+#include "util/runtime-profile.h"
+
+#include "common/names.h"
+
+DECLARE_bool(enable_lock_profiling);
+
+namespace impala {
+
+static void HoldLock(mutex* m, LockSite* site, AtomicInt<int>* locked) {
+  ProfiledLock<mutex> l(*m, site);
+  ++*locked;
+  SleepForMs(100);
+}
+
+TEST(LockProfilerTest, Disabled) {
+  FLAGS_enable_lock_profiling = false;
+  LockProfiler::Init(NULL);
+  LockSite site("Disabled");
+  mutex m;
+  for (int i = 0; i < 10; ++i) {
+    ProfiledLock<mutex> l(m, &site);
+    EXPECT_TRUE(l.owns_lock());
+  }
+  EXPECT_EQ(site.num_acquisitions(), 0);
+}
+
+TEST(LockProfilerTest, Contended) {
+  FLAGS_enable_lock_profiling = true;
+  LockProfiler::Init(NULL);
+  LockSite site("Contended");
+  ObjectPool pool;
+  RuntimeProfile profile(&pool, "LockProfilerTest");
+  RuntimeProfile::Counter* wait_counter =
+      ADD_TIMER(&profile, "TotalLockWaitTime");
+  mutex m;
+  {
+    ProfiledLock<mutex> l(m, &site);
+    EXPECT_TRUE(l.owns_lock());
+  }
+  EXPECT_EQ(site.num_acquisitions(), 1);
+  EXPECT_EQ(site.num_contended(), 0);
+
+  // Wait for a thread that holds the lock.
+  AtomicInt<int> locked;
+  thread holder(HoldLock, &m, &site, &locked);
+  while (locked.Read() == 0) SleepForMs(1);
+  {
+    LockProfiler::ScopedWaitCounter lock_wait(wait_counter);
+    ProfiledLock<mutex> l(m, &site);
+  }
+  holder.join();
+  EXPECT_EQ(site.num_acquisitions(), 3);
+  EXPECT_EQ(site.num_contended(), 1);
+  EXPECT_GT(site.wait_time_ns(), 0);
+  EXPECT_EQ(wait_counter->value(), site.wait_time_ns());
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,112 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/lock-profiler.h"
+
+#include <algorithm>
+#include <vector>
+#include <boost/foreach.hpp>
+#include <gflags/gflags.h>
+
+#include "util/pretty-printer.h"
+#include "util/spinlock.h"
+#include "util/webserver.h"
+
+#include "common/names.h"
+
+using namespace impala;
+using namespace rapidjson;
+
+DEFINE_bool(enable_lock_profiling, false, "(Advanced) If true, the acquisitions of "
+    "the locks on hot paths, e.g. of the buffered block mgr and the io mgr, are counted "
+    "and the time spent waiting for them is recorded. The results are shown on the "
+    "/locks page and as TotalLockWaitTime in the fragment profiles.");
+
+bool LockProfiler::enabled_ = false;
+__thread RuntimeProfile::Counter* LockProfiler::wait_counter_ = NULL;
+
+// All the lock sites, which are never destroyed. Function-local so that static sites
+// can register themselves during static initialization.
+static SpinLock* SitesLock() {
+  static SpinLock lock;
+  return &lock;
+}
+static vector<LockSite*>* Sites() {
+  static vector<LockSite*> sites;
+  return &sites;
+}
+
+LockSite::LockSite(const char* name) : name_(name) {
+  lock_guard<SpinLock> l(*SitesLock());
+  Sites()->push_back(this);
+}
+
+void LockSite::RecordContended(int64_t wait_time_ns) {
+  ++num_acquisitions_;
+  ++num_contended_;
+  wait_time_ns_.Add(wait_time_ns);
+  if (LockProfiler::wait_counter_ != NULL) {
+    LockProfiler::wait_counter_->Add(wait_time_ns);
+  }
+}
+
+LockProfiler::ScopedWaitCounter::ScopedWaitCounter(RuntimeProfile::Counter* counter)
+  : prev_counter_(wait_counter_) {
+  wait_counter_ = counter;
+}
+
+LockProfiler::ScopedWaitCounter::~ScopedWaitCounter() {
+  wait_counter_ = prev_counter_;
+}
+
+// Orders lock sites by decreasing wait time.
+static bool WaitTimeGt(const LockSite* a, const LockSite* b) {
+  return a->wait_time_ns() > b->wait_time_ns();
+}
+
+// Webserver callback for /locks. Lists the lock sites by decreasing wait time.
+static void LocksUrlCallback(const Webserver::ArgumentMap& args, Document* document) {
+  document->AddMember("enabled", LockProfiler::enabled(), document->GetAllocator());
+  vector<LockSite*> sites;
+  {
+    lock_guard<SpinLock> l(*SitesLock());
+    sites = *Sites();
+  }
+  sort(sites.begin(), sites.end(), WaitTimeGt);
+  Value sites_json(kArrayType);
+  BOOST_FOREACH(const LockSite* site, sites) {
+    Value site_json(kObjectType);
+    site_json.AddMember("name", site->name(), document->GetAllocator());
+    site_json.AddMember("num_acquisitions", site->num_acquisitions(),
+        document->GetAllocator());
+    site_json.AddMember("num_contended", site->num_contended(),
+        document->GetAllocator());
+    Value wait_time(PrettyPrinter::Print(site->wait_time_ns(), TUnit::TIME_NS).c_str(),
+        document->GetAllocator());
+    site_json.AddMember("wait_time", wait_time, document->GetAllocator());
+    int64_t avg_wait_ns = site->num_contended() == 0 ? 0 :
+        site->wait_time_ns() / site->num_contended();
+    Value avg_wait_time(PrettyPrinter::Print(avg_wait_ns, TUnit::TIME_NS).c_str(),
+        document->GetAllocator());
+    site_json.AddMember("avg_wait_time", avg_wait_time, document->GetAllocator());
+    sites_json.PushBack(site_json, document->GetAllocator());
+  }
+  document->AddMember("sites", sites_json, document->GetAllocator());
+}
+
+void LockProfiler::Init(Webserver* webserver) {
+  enabled_ = FLAGS_enable_lock_profiling;
+  if (webserver == NULL) return;
+  webserver->RegisterUrlCallback("/locks", "locks.tmpl", LocksUrlCallback);
+}
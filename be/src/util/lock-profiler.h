@@ -0,0 +1,118 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_UTIL_LOCK_PROFILER_H
+#define IMPALA_UTIL_LOCK_PROFILER_H
+
+#include <boost/thread/locks.hpp>
+
+#include "common/atomic.h"
+#include "common/compiler-util.h"
+#include "util/runtime-profile.h"
+#include "util/time.h"
+
+namespace impala {
+
+class Webserver;
+
+/// A named place in the code where a lock is acquired, e.g. all the acquisitions of a
+/// particular member lock. While lock profiling is enabled, ProfiledLock counts the
+/// acquisitions of its site, how many of them found the lock held, and the time spent
+/// waiting for it. Sites must outlive all their ProfiledLocks and are typically static
+/// objects; they register themselves with the /locks page of the webserver.
+class LockSite {
+ public:
+  explicit LockSite(const char* name);
+
+  const char* name() const { return name_; }
+  int64_t num_acquisitions() const { return num_acquisitions_.Read(); }
+  int64_t num_contended() const { return num_contended_.Read(); }
+  int64_t wait_time_ns() const { return wait_time_ns_.Read(); }
+
+  /// Counts an acquisition that did not have to wait.
+  void RecordUncontended() { ++num_acquisitions_; }
+
+  /// Counts an acquisition that waited 'wait_time_ns' for the lock. Also adds the wait
+  /// to the counter of the calling thread's ScopedWaitCounter, if there is one.
+  void RecordContended(int64_t wait_time_ns);
+
+ private:
+  const char* name_;
+  AtomicInt<int64_t> num_acquisitions_;
+  AtomicInt<int64_t> num_contended_;
+  AtomicInt<int64_t> wait_time_ns_;
+};
+
+/// Lock profiling is off unless --enable_lock_profiling is set, in which case
+/// ProfiledLocks first try to take their lock without blocking and only time the
+/// acquisitions that have to wait.
+class LockProfiler {
+ public:
+  /// Reads --enable_lock_profiling and registers the /locks page with 'webserver',
+  /// which may be NULL.
+  static void Init(Webserver* webserver);
+
+  static bool enabled() { return enabled_; }
+
+  /// Adds the time the calling thread waits for profiled locks to 'counter' while in
+  /// scope, e.g. to the lock wait time of the fragment instance the thread works for.
+  /// 'counter' may be NULL. Scopes may be nested, the innermost one applies.
+  class ScopedWaitCounter {
+   public:
+    ScopedWaitCounter(RuntimeProfile::Counter* counter);
+    ~ScopedWaitCounter();
+
+   private:
+    RuntimeProfile::Counter* prev_counter_;
+  };
+
+ private:
+  friend class LockSite;
+
+  static bool enabled_;
+
+  /// The counter of the innermost ScopedWaitCounter of the thread.
+  static __thread RuntimeProfile::Counter* wait_counter_;
+};
+
+/// A unique_lock that records its acquisition at a LockSite, unless the site is NULL.
+/// Since it is a boost::unique_lock<Mutex>, condition variables can wait on it; the
+/// reacquisitions after those waits are not profiled.
+template <typename Mutex>
+class ProfiledLock : public boost::unique_lock<Mutex> {
+ public:
+  ProfiledLock(Mutex& mutex, LockSite* site)
+    : boost::unique_lock<Mutex>(Acquire(mutex, site), boost::adopt_lock) {
+  }
+
+ private:
+  /// Locks 'mutex', recording the acquisition at 'site' if profiling is enabled.
+  static Mutex& Acquire(Mutex& mutex, LockSite* site) {
+    if (LIKELY(!LockProfiler::enabled()) || site == NULL) {
+      mutex.lock();
+    } else if (mutex.try_lock()) {
+      site->RecordUncontended();
+    } else {
+      int64_t start_ns = MonotonicNanos();
+      mutex.lock();
+      site->RecordContended(MonotonicNanos() - start_ns);
+    }
+    return mutex;
+  }
+};
+
+}
+
+#endif
@@ -0,0 +1,68 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/min-max-filter.h"
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+DECLARE_int32(runtime_filter_max_in_list_values);
+
+using namespace std;
+
+namespace impala {
+
+TEST(MinMaxFilter, Empty) {
+  MinMaxFilter filter;
+  int32_t v = 0;
+  EXPECT_FALSE(filter.Find(&v, TYPE_INT));
+  EXPECT_FALSE(filter.Find(NULL, TYPE_INT));
+  EXPECT_FALSE(filter.OverlapsRange(numeric_limits<int64_t>::min(),
+      numeric_limits<int64_t>::max()));
+}
+
+TEST(MinMaxFilter, InList) {
+  FLAGS_runtime_filter_max_in_list_values = 4;
+  MinMaxFilter filter;
+  int16_t values[] = { 10, -5, 10, 20 };
+  for (int i = 0; i < 4; ++i) filter.Insert(&values[i], TYPE_SMALLINT);
+  // The values are kept exactly.
+  for (int16_t v = -10; v <= 30; ++v) {
+    EXPECT_EQ(v == -5 || v == 10 || v == 20, filter.Find(&v, TYPE_SMALLINT)) << v;
+  }
+  EXPECT_FALSE(filter.Find(NULL, TYPE_SMALLINT));
+  EXPECT_TRUE(filter.OverlapsRange(20, 25));
+  EXPECT_FALSE(filter.OverlapsRange(21, 25));
+
+  // Round-trip through thrift, then add too many values to keep them.
+  TMinMaxFilter thrift;
+  filter.ToThrift(&thrift);
+  MinMaxFilter copy(thrift);
+  MinMaxFilter other;
+  int16_t more[] = { 0, 1, 2 };
+  for (int i = 0; i < 3; ++i) other.Insert(&more[i], TYPE_SMALLINT);
+  other.Insert(NULL, TYPE_SMALLINT);
+  copy.Or(other);
+  for (int16_t v = -5; v <= 20; ++v) EXPECT_TRUE(copy.Find(&v, TYPE_SMALLINT)) << v;
+  int16_t out_of_range = 21;
+  EXPECT_FALSE(copy.Find(&out_of_range, TYPE_SMALLINT));
+  EXPECT_TRUE(copy.Find(NULL, TYPE_SMALLINT));
+}
+
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,120 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/min-max-filter.h"
+
+#include <algorithm>
+#include <limits>
+#include <gflags/gflags.h>
+
+#include "common/logging.h"
+
+#include "common/names.h"
+
+using namespace impala;
+
+DEFINE_int32(runtime_filter_max_in_list_values, 16, "(Advanced) Maximum number of "
+    "distinct values for which integer runtime filters keep the exact set of values, "
+    "in addition to their range.");
+
+MinMaxFilter::MinMaxFilter()
+  : min_(numeric_limits<int64_t>::max()),
+    max_(numeric_limits<int64_t>::min()),
+    has_null_(false),
+    has_values_(FLAGS_runtime_filter_max_in_list_values > 0) {
+}
+
+MinMaxFilter::MinMaxFilter(const TMinMaxFilter& thrift)
+  : min_(thrift.min),
+    max_(thrift.max),
+    has_null_(thrift.has_null),
+    has_values_(thrift.__isset.values),
+    values_(thrift.values) {
+  DCHECK(is_sorted(values_.begin(), values_.end()));
+}
+
+bool MinMaxFilter::SupportsType(const ColumnType& type) {
+  switch (type.type) {
+    case TYPE_TINYINT:
+    case TYPE_SMALLINT:
+    case TYPE_INT:
+    case TYPE_BIGINT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+int64_t MinMaxFilter::GetValue(const void* val, const ColumnType& type) {
+  switch (type.type) {
+    case TYPE_TINYINT: return *reinterpret_cast<const int8_t*>(val);
+    case TYPE_SMALLINT: return *reinterpret_cast<const int16_t*>(val);
+    case TYPE_INT: return *reinterpret_cast<const int32_t*>(val);
+    case TYPE_BIGINT: return *reinterpret_cast<const int64_t*>(val);
+    default:
+      DCHECK(false) << type;
+      return 0;
+  }
+}
+
+void MinMaxFilter::Insert(const void* val, const ColumnType& type) {
+  if (val == NULL) {
+    has_null_ = true;
+    return;
+  }
+  InsertValue(GetValue(val, type));
+}
+
+bool MinMaxFilter::Find(const void* val, const ColumnType& type) const {
+  if (val == NULL) return has_null_;
+  int64_t v = GetValue(val, type);
+  if (v < min_ || v > max_) return false;
+  return !has_values_ || binary_search(values_.begin(), values_.end(), v);
+}
+
+void MinMaxFilter::Or(const MinMaxFilter& other) {
+  min_ = min(min_, other.min_);
+  max_ = max(max_, other.max_);
+  has_null_ |= other.has_null_;
+  if (!other.has_values_) {
+    has_values_ = false;
+    values_.clear();
+    return;
+  }
+  for (int i = 0; has_values_ && i < other.values_.size(); ++i) {
+    InsertValue(other.values_[i]);
+  }
+}
+
+void MinMaxFilter::ToThrift(TMinMaxFilter* thrift) const {
+  thrift->min = min_;
+  thrift->max = max_;
+  thrift->has_null = has_null_;
+  if (has_values_) thrift->__set_values(values_);
+}
+
+void MinMaxFilter::InsertValue(int64_t v) {
+  min_ = min(min_, v);
+  max_ = max(max_, v);
+  if (!has_values_) return;
+  vector<int64_t>::iterator it = lower_bound(values_.begin(), values_.end(), v);
+  if (it != values_.end() && *it == v) return;
+  if (values_.size() >= FLAGS_runtime_filter_max_in_list_values) {
+    // Too many values, only keep the range from now on.
+    has_values_ = false;
+    values_.clear();
+    return;
+  }
+  values_.insert(it, v);
+}
@@ -0,0 +1,81 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_UTIL_MIN_MAX_FILTER_H
+#define IMPALA_UTIL_MIN_MAX_FILTER_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "gen-cpp/ImpalaInternalService_types.h"
+#include "runtime/types.h"
+
+namespace impala {
+
+/// A MinMaxFilter stores the range of a set of integer values, and whether the set
+/// contains NULL. While the set has at most --runtime_filter_max_in_list_values distinct
+/// values it also stores all of them, so that Find() is exact. Unlike a BloomFilter, the
+/// range can also be compared against the min/max statistics of a file or row group.
+///
+/// Values are passed as native slots of their column type and stored as int64_t. Only
+/// the types for which SupportsType() returns true can be used.
+class MinMaxFilter {
+ public:
+  /// An empty filter, which finds no values.
+  MinMaxFilter();
+  explicit MinMaxFilter(const TMinMaxFilter& thrift);
+
+  /// Returns true if values of 'type' can be inserted.
+  static bool SupportsType(const ColumnType& type);
+
+  /// Returns the value of the slot 'val' of 'type' as an int64_t.
+  static int64_t GetValue(const void* val, const ColumnType& type);
+
+  /// Adds 'val', a slot of 'type' or NULL, to the set.
+  void Insert(const void* val, const ColumnType& type);
+
+  /// Returns false if 'val', a slot of 'type' or NULL, is definitely not in the set.
+  bool Find(const void* val, const ColumnType& type) const;
+
+  /// Returns false if no non-NULL value in the set lies in [min_value, max_value].
+  bool OverlapsRange(int64_t min_value, int64_t max_value) const {
+    return min_ <= max_value && max_ >= min_value;
+  }
+
+  /// Adds all values of 'other' to the set.
+  void Or(const MinMaxFilter& other);
+
+  void ToThrift(TMinMaxFilter* thrift) const;
+
+  bool has_null() const { return has_null_; }
+
+ private:
+  /// Adds a non-NULL value to the set.
+  void InsertValue(int64_t v);
+
+  int64_t min_;
+  int64_t max_;
+  bool has_null_;
+
+  /// True while 'values_' holds all distinct non-NULL values of the set.
+  bool has_values_;
+
+  /// The distinct non-NULL values of the set in ascending order, if 'has_values_'.
+  std::vector<int64_t> values_;
+};
+
+}
+
+#endif
@@ -0,0 +1,125 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <boost/thread.hpp>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include "util/mpsc-blocking-queue.h"
+#include "util/time.h"
+
+#include "common/names.h"
+
+namespace impala {
+
+TEST(MpscBlockingQueueTest, TestBasic) {
+  int32_t i;
+  MpscBlockingQueue<int32_t> test_queue(5);
+  ASSERT_TRUE(test_queue.BlockingPut(1));
+  ASSERT_TRUE(test_queue.BlockingPut(2));
+  ASSERT_TRUE(test_queue.BlockingPut(3));
+  ASSERT_EQ(3, test_queue.GetSize());
+  ASSERT_TRUE(test_queue.BlockingGet(&i));
+  ASSERT_EQ(1, i);
+  ASSERT_TRUE(test_queue.BlockingGet(&i));
+  ASSERT_EQ(2, i);
+  ASSERT_TRUE(test_queue.BlockingGet(&i));
+  ASSERT_EQ(3, i);
+  ASSERT_EQ(0, test_queue.GetSize());
+}
+
+TEST(MpscBlockingQueueTest, TestGetFromShutdownQueue) {
+  int64_t i;
+  MpscBlockingQueue<int64_t> test_queue(2);
+  ASSERT_TRUE(test_queue.BlockingPut(123));
+  test_queue.Shutdown();
+  ASSERT_FALSE(test_queue.BlockingPut(456));
+  ASSERT_TRUE(test_queue.BlockingGet(&i));
+  ASSERT_EQ(123, i);
+  ASSERT_FALSE(test_queue.BlockingGet(&i));
+}
+
+// The capacity is not a power of two, so the queue is full before the ring buffer.
+TEST(MpscBlockingQueueTest, TestFull) {
+  MpscBlockingQueue<int32_t> test_queue(3);
+  for (int i = 0; i < 3; ++i) ASSERT_TRUE(test_queue.BlockingPut(i));
+  thread producer(bind(&MpscBlockingQueue<int32_t>::BlockingPut, &test_queue, 3));
+  SleepForMs(100);
+  ASSERT_EQ(3, test_queue.GetSize());
+  for (int i = 0; i < 4; ++i) {
+    int32_t val;
+    ASSERT_TRUE(test_queue.BlockingGet(&val));
+    ASSERT_EQ(i, val);
+  }
+  producer.join();
+  ASSERT_GT(test_queue.total_put_wait_time(), 0U);
+}
+
+// Checks that the elements of each of many producers are all received, in order, by
+// the single consumer, while the queue is mostly full or empty.
+class MultiProducerTest {
+ public:
+  MultiProducerTest(int queue_size)
+    : iterations_(10000),
+      nthreads_(32),
+      queue_(queue_size) {
+  }
+
+  void ProducerThread(int id) {
+    for (int i = 0; i < iterations_; ++i) {
+      ASSERT_TRUE(queue_.BlockingPut(id * iterations_ + i));
+    }
+  }
+
+  void Run() {
+    thread_group producers;
+    for (int i = 0; i < nthreads_; ++i) {
+      producers.add_thread(
+          new thread(bind(&MultiProducerTest::ProducerThread, this, i)));
+    }
+    vector<int> next(nthreads_, 0);
+    for (int i = 0; i < nthreads_ * iterations_; ++i) {
+      int32_t val;
+      ASSERT_TRUE(queue_.BlockingGet(&val));
+      int id = val / iterations_;
+      ASSERT_EQ(next[id], val % iterations_);
+      ++next[id];
+    }
+    producers.join_all();
+    ASSERT_EQ(0, queue_.GetSize());
+    queue_.Shutdown();
+    int32_t val;
+    ASSERT_FALSE(queue_.BlockingGet(&val));
+  }
+
+ private:
+  int iterations_;
+  int nthreads_;
+  MpscBlockingQueue<int32_t> queue_;
+};
+
+TEST(MpscBlockingQueueTest, TestMultipleProducers) {
+  MultiProducerTest small_queue(1);
+  small_queue.Run();
+  MultiProducerTest large_queue(1000);
+  large_queue.Run();
+}
+
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  impala::OsInfo::Init();
+  return RUN_ALL_TESTS();
+}
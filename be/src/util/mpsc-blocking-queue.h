@@ -0,0 +1,237 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_UTIL_MPSC_BLOCKING_QUEUE_H
+#define IMPALA_UTIL_MPSC_BLOCKING_QUEUE_H
+
+#include <algorithm>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <boost/scoped_array.hpp>
+
+#include "common/atomic.h"
+#include "common/logging.h"
+#include "util/bit-util.h"
+#include "util/stopwatch.h"
+
+namespace impala {
+
+/// Fixed capacity FIFO queue with the same interface as BlockingQueue, for any number of
+/// producers but a single consumer: only one thread at a time may call BlockingGet().
+/// The elements are kept in a ring buffer, in which producers claim a slot with a
+/// compare-and-swap, so neither side takes a lock while the queue is neither empty nor
+/// full. Only then do BlockingGet() and BlockingPut() sleep on a futex, and the other
+/// side only makes the futex system call to wake them up if one of them is sleeping.
+///
+/// An element whose BlockingPut() races with Shutdown() may still be added, so the
+/// consumer must not rely on BlockingGet() having returned false while producers are
+/// running.
+template <typename T>
+class MpscBlockingQueue {
+ public:
+  MpscBlockingQueue(size_t max_elements)
+    : max_elements_(max_elements),
+      mask_(BitUtil::NextPowerOfTwo(std::max<int64_t>(max_elements, 1)) - 1),
+      slots_(new Slot[mask_ + 1]),
+      head_(0),
+      tail_(0),
+      shutdown_(false),
+      consumer_waiting_(0),
+      num_waiting_producers_(0),
+      get_futex_(0),
+      put_futex_(0),
+      total_get_wait_time_(0),
+      total_put_wait_time_(0) {
+    for (int64_t i = 0; i <= mask_; ++i) slots_[i].sequence = i;
+  }
+
+  /// Get an element from the queue, waiting indefinitely for one to become available.
+  /// Returns false if we were shut down prior to getting the element, and there
+  /// are no more elements available.
+  bool BlockingGet(T* out) {
+    if (TryGet(out)) return true;
+    MonotonicStopWatch timer;
+    timer.Start();
+    while (true) {
+      int32_t futex_val = __sync_fetch_and_add(&get_futex_, 0);
+      // Announced before looking at the queue again, so that a producer either sees the
+      // consumer waiting or its element is seen here.
+      __sync_lock_test_and_set(&consumer_waiting_, 1);
+      bool shutdown = IsShutdown();
+      bool got = TryGet(out);
+      if (!got && !shutdown) FutexWait(&get_futex_, futex_val);
+      __sync_lock_test_and_set(&consumer_waiting_, 0);
+      if (got || shutdown) {
+        total_get_wait_time_ += timer.ElapsedTime();
+        return got;
+      }
+    }
+  }
+
+  /// Puts an element into the queue, waiting indefinitely until there is space.
+  /// If the queue is shut down, returns false.
+  bool BlockingPut(const T& val) {
+    if (IsShutdown()) return false;
+    if (TryPut(val)) {
+      WakeConsumer();
+      return true;
+    }
+    MonotonicStopWatch timer;
+    timer.Start();
+    while (true) {
+      int32_t futex_val = __sync_fetch_and_add(&put_futex_, 0);
+      // Announced before trying again, so that the consumer either sees a producer
+      // waiting or has made room for this element.
+      __sync_add_and_fetch(&num_waiting_producers_, 1);
+      bool shutdown = IsShutdown();
+      bool put = !shutdown && TryPut(val);
+      if (!put && !shutdown) FutexWait(&put_futex_, futex_val);
+      __sync_add_and_fetch(&num_waiting_producers_, -1);
+      if (put || shutdown) {
+        total_put_wait_time_ += timer.ElapsedTime();
+        if (put) WakeConsumer();
+        return put;
+      }
+    }
+  }
+
+  /// Shut down the queue. Wakes up all threads waiting on BlockingGet or BlockingPut.
+  void Shutdown() {
+    shutdown_ = true;
+    AtomicUtil::MemoryBarrier();
+    __sync_add_and_fetch(&get_futex_, 1);
+    __sync_add_and_fetch(&put_futex_, 1);
+    FutexWake(&get_futex_, INT_MAX);
+    FutexWake(&put_futex_, INT_MAX);
+  }
+
+  /// Returns the number of elements in the queue, which may be out of date as soon as
+  /// it returns.
+  uint32_t GetSize() const {
+    AtomicUtil::MemoryBarrier();
+    return std::max<int64_t>(tail_ - head_, 0);
+  }
+
+  /// Returns the total amount of time threads have blocked in BlockingGet.
+  uint64_t total_get_wait_time() const { return total_get_wait_time_; }
+
+  /// Returns the total amount of time threads have blocked in BlockingPut.
+  uint64_t total_put_wait_time() const { return total_put_wait_time_; }
+
+ private:
+  /// Slot of the ring buffer. 'sequence' is the position of the next element to be
+  /// put in the slot while it is free, and that position + 1 once the element has been
+  /// put and until it is taken.
+  struct Slot {
+    AtomicInt<int64_t> sequence;
+    T value;
+  };
+
+  /// Puts 'val' in the slot at the tail if the queue isn't full.
+  bool TryPut(const T& val) {
+    int64_t pos = tail_.Read();
+    while (true) {
+      if (pos - head_.Read() >= max_elements_) return false;
+      Slot* slot = &slots_[pos & mask_];
+      int64_t diff = slot->sequence.Read() - pos;
+      if (diff == 0) {
+        if (tail_.CompareAndSwap(pos, pos + 1)) {
+          slot->value = val;
+          AtomicUtil::MemoryBarrier();
+          slot->sequence = pos + 1;
+          return true;
+        }
+      } else if (diff < 0) {
+        // The consumer hasn't taken the element of the previous round yet.
+        return false;
+      }
+      pos = tail_.Read();
+    }
+  }
+
+  /// Takes the element at the head if it has been put, and wakes up a producer if any
+  /// is waiting for room. Only called by the consumer.
+  bool TryGet(T* out) {
+    int64_t pos = head_;
+    Slot* slot = &slots_[pos & mask_];
+    if (slot->sequence.Read() != pos + 1) return false;
+    *out = slot->value;
+    AtomicUtil::MemoryBarrier();
+    slot->sequence = pos + mask_ + 1;
+    head_ = pos + 1;
+    AtomicUtil::MemoryBarrier();
+    if (num_waiting_producers_ > 0) {
+      __sync_add_and_fetch(&put_futex_, 1);
+      FutexWake(&put_futex_, 1);
+    }
+    return true;
+  }
+
+  /// Wakes up the consumer if it is waiting for an element.
+  void WakeConsumer() {
+    AtomicUtil::MemoryBarrier();
+    if (consumer_waiting_ == 0) return;
+    __sync_add_and_fetch(&get_futex_, 1);
+    FutexWake(&get_futex_, 1);
+  }
+
+  bool IsShutdown() const {
+    AtomicUtil::MemoryBarrier();
+    return shutdown_;
+  }
+
+  /// Sleeps until 'futex' is woken up, unless it doesn't hold 'val' anymore. May return
+  /// spuriously.
+  static void FutexWait(volatile int32_t* futex, int32_t val) {
+    syscall(SYS_futex, futex, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+  }
+
+  /// Wakes up at most 'num_waiters' threads sleeping on 'futex'.
+  static void FutexWake(volatile int32_t* futex, int num_waiters) {
+    syscall(SYS_futex, futex, FUTEX_WAKE_PRIVATE, num_waiters, NULL, NULL, 0);
+  }
+
+  const int64_t max_elements_;
+
+  /// The capacity of the ring buffer, a power of two that is at least max_elements_,
+  /// minus 1.
+  const int64_t mask_;
+  boost::scoped_array<Slot> slots_;
+
+  /// Positions of the next element to get and of the next one to put. An element's
+  /// slot is its position modulo the capacity of the ring buffer.
+  AtomicInt<int64_t> head_;
+  AtomicInt<int64_t> tail_;
+
+  volatile bool shutdown_;
+
+  /// 1 while the consumer may be sleeping on get_futex_, and the number of producers
+  /// that may be sleeping on put_futex_.
+  volatile int32_t consumer_waiting_;
+  volatile int32_t num_waiting_producers_;
+
+  /// Futex words, incremented before waking up the threads sleeping on them.
+  volatile int32_t get_futex_;
+  volatile int32_t put_futex_;
+
+  AtomicInt<int64_t> total_get_wait_time_;
+  AtomicInt<int64_t> total_put_wait_time_;
+};
+
+}
+
+#endif
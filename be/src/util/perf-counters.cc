@@ -17,10 +17,12 @@
 
 #include "util/perf-counters.h"
 #include "util/debug-util.h"
+#include "common/logging.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <fstream>
 #include <iomanip>
@@ -29,6 +31,7 @@
 
 #include <sys/syscall.h>
 #include <linux/perf_event.h>
+#include <boost/thread/tss.hpp>
 
 #define COUNTER_SIZE (sizeof(void*))
 #define BUFFER_SIZE 256
@@ -424,5 +427,61 @@ void PerfCounters::PrettyPrint(ostream* s) const {
   stream << endl;
 }
 
+static boost::thread_specific_ptr<ThreadHwCounters> thread_hw_counters;
+
+ThreadHwCounters::ThreadHwCounters() {
+  static const uint64_t CONFIGS[NUM_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+  };
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = CONFIGS[i];
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+        PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // pid 0 and cpu -1 count the calling thread on any cpu.
+    int fd = sys_perf_event_open(&attr, 0, -1, fds_.empty() ? -1 : fds_[0], 0);
+    if (fd < 0) {
+      for (int j = 0; j < fds_.size(); ++j) close(fds_[j]);
+      fds_.clear();
+      return;
+    }
+    fds_.push_back(fd);
+  }
+}
+
+ThreadHwCounters::~ThreadHwCounters() {
+  for (int i = 0; i < fds_.size(); ++i) close(fds_[i]);
+}
+
+ThreadHwCounters* ThreadHwCounters::Get() {
+  if (thread_hw_counters.get() == NULL) thread_hw_counters.reset(new ThreadHwCounters());
+  return thread_hw_counters.get();
 }
 
+bool ThreadHwCounters::Read(int64_t* values) {
+  ThreadHwCounters* counters = Get();
+  if (counters->fds_.empty()) return false;
+  // The group leader returns the number of counters, the times the group was enabled
+  // and running, and the value of each counter.
+  uint64_t buffer[3 + NUM_COUNTERS];
+  if (read(counters->fds_[0], buffer, sizeof(buffer)) != sizeof(buffer)) return false;
+  DCHECK_EQ(buffer[0], NUM_COUNTERS);
+  uint64_t time_enabled = buffer[1];
+  uint64_t time_running = buffer[2];
+  for (int i = 0; i < NUM_COUNTERS; ++i) {
+    values[i] = buffer[3 + i];
+    if (time_running > 0 && time_running < time_enabled) {
+      values[i] = static_cast<double>(values[i]) * time_enabled / time_running;
+    }
+  }
+  return true;
+}
+
+}
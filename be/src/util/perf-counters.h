@@ -135,6 +135,40 @@ class PerfCounters {
   int group_fd_;
 };
 
+/// Hardware counters of the calling thread, which are read together with a single system
+/// call. Unlike PerfCounters, which counts the events of the main thread, each thread
+/// opens its own counters the first time it reads them and closes them when it exits.
+/// The counters exclude events in the kernel.
+class ThreadHwCounters {
+ public:
+  enum Counter {
+    CYCLES,
+    INSTRUCTIONS,
+    LLC_MISSES,
+    BRANCH_MISSES,
+    NUM_COUNTERS,
+  };
+
+  /// Reads the counters of the calling thread into 'values', which must have
+  /// NUM_COUNTERS entries. Counts of counters that the kernel multiplexed with other
+  /// events are extrapolated to the whole time they were enabled. Returns false if the
+  /// counters are not available, e.g. because the hardware does not have them or
+  /// kernel.perf_event_paranoid does not allow this process to read them.
+  static bool Read(int64_t* values);
+
+  ~ThreadHwCounters();
+
+ private:
+  ThreadHwCounters();
+
+  /// Returns the counters of the calling thread, which are opened on the first call.
+  static ThreadHwCounters* Get();
+
+  /// File descriptors of the counters, in the order of Counter. The first one is the
+  /// group leader. Empty if the counters could not be opened.
+  std::vector<int> fds_;
+};
+
 }
 
 #endif
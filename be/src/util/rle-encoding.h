@@ -16,6 +16,7 @@
 #define IMPALA_RLE_ENCODING_H
 
 #include <math.h>
+#include <algorithm>
 
 #include "common/compiler-util.h"
 #include "util/bit-stream-utils.inline.h"
@@ -104,6 +105,13 @@ class RleDecoder {
   template<typename T>
   bool Get(T* val);
 
+  /// Gets the next 'num_values' values into 'values'. Returns the number of values read,
+  /// which is less than 'num_values' only if there are no more values. Repeated runs are
+  /// expanded and literal runs are bit-unpacked in bulk, so this is considerably cheaper
+  /// per value than Get().
+  template<typename T>
+  int GetValues(int num_values, T* values);
+
  protected:
   BitReader bit_reader_;
   /// Number of bits needed to encode the value. Must be between 0 and 64.
@@ -166,6 +174,15 @@ class RleEncoder {
   /// This value must be representable with bit_width_ bits.
   bool Put(uint64_t value);
 
+  /// Encodes the 'num_values' values in 'values', producing the same output as calling
+  /// Put() for each of them. Continuations of repeated runs are counted with a single
+  /// scan and groups of 8 values that cannot start a repeated run are bit packed
+  /// directly into the current literal run, instead of being buffered one at a time.
+  /// Returns the number of values encoded, which is less than 'num_values' if the
+  /// buffer filled up.
+  template<typename T>
+  int PutValues(const T* values, int num_values);
+
   /// Flushes any pending values to the underlying buffer.
   /// Returns the total number of bytes written
   int Flush();
@@ -188,6 +205,14 @@ class RleEncoder {
   /// buffered.
   void FlushBufferedValues(bool done);
 
+  /// Bit packs as many complete groups of 8 values from 'values' as possible directly
+  /// into the current literal run, stopping at the first group whose values are all
+  /// equal, since that may start a repeated run, or when the literal run is full. Must
+  /// only be called at a group boundary outside of a repeated run. Returns the number of
+  /// values written.
+  template<typename T>
+  int PutLiteralGroups(const T* values, int num_values);
+
   /// Flushes literal values to the underlying buffer.  If update_indicator_byte,
   /// then the current literal run is complete and the indicator byte is updated.
   void FlushLiteralRun(bool update_indicator_byte);
@@ -261,6 +286,37 @@ inline bool RleDecoder::Get(T* val) {
   return true;
 }
 
+template<typename T>
+inline int RleDecoder::GetValues(int num_values, T* values) {
+  DCHECK_GE(bit_width_, 0);
+  int num_read = 0;
+  while (num_read < num_values) {
+    if (UNLIKELY(literal_count_ == 0 && repeat_count_ == 0)) {
+      if (!NextCounts<T>()) break;
+    }
+    int remaining = num_values - num_read;
+    if (repeat_count_ > 0) {
+      int n = std::min<uint32_t>(remaining, repeat_count_);
+      T val = current_value_;
+      std::fill(values + num_read, values + num_read + n, val);
+      repeat_count_ -= n;
+      num_read += n;
+    } else {
+      DCHECK_GT(literal_count_, 0);
+      int n = std::min<uint32_t>(remaining, literal_count_);
+      int num_unpacked = bit_reader_.UnpackBatch(bit_width_, n, values + num_read);
+      num_read += num_unpacked;
+      if (UNLIKELY(num_unpacked < n)) {
+        // The literal run was truncated.
+        literal_count_ = 0;
+        break;
+      }
+      literal_count_ -= n;
+    }
+  }
+  return num_read;
+}
+
 template<typename T>
 bool RleDecoder::NextCounts() {
   // Read the next run's indicator int, it could be a literal or repeated run.
@@ -315,6 +371,65 @@ inline bool RleEncoder::Put(uint64_t value) {
   return true;
 }
 
+template<typename T>
+inline int RleEncoder::PutValues(const T* values, int num_values) {
+  int i = 0;
+  while (i < num_values) {
+    if (UNLIKELY(buffer_full_)) break;
+    if (repeat_count_ >= 8) {
+      // The current repeated run has no buffered values, so its continuation only needs
+      // to be counted.
+      DCHECK_EQ(num_buffered_values_, 0);
+      int run_end = i;
+      while (run_end < num_values &&
+          static_cast<uint64_t>(values[run_end]) == current_value_) {
+        ++run_end;
+      }
+      repeat_count_ += run_end - i;
+      i = run_end;
+      if (i == num_values) break;
+    } else if (num_buffered_values_ == 0 && num_values - i >= 8) {
+      int num_written = PutLiteralGroups(values + i, num_values - i);
+      i += num_written;
+      if (num_written > 0) continue;
+    }
+    bool result = Put(values[i]);
+    DCHECK(result);
+    ++i;
+  }
+  return i;
+}
+
+template<typename T>
+inline int RleEncoder::PutLiteralGroups(const T* values, int num_values) {
+  DCHECK_EQ(num_buffered_values_, 0);
+  DCHECK_EQ(repeat_count_, 0);
+  DCHECK_EQ(literal_count_ % 8, 0);
+  // FlushBufferedValues() completes a literal run once it reaches (1 << 6) - 1 groups.
+  int max_groups = std::min(num_values / 8, (1 << 6) - 1 - literal_count_ / 8);
+  int num_groups = 0;
+  for (; num_groups < max_groups; ++num_groups) {
+    const T* group = values + num_groups * 8;
+    uint64_t diff = 0;
+    for (int i = 1; i < 8; ++i) diff |= static_cast<uint64_t>(group[i] ^ group[0]);
+    if (diff == 0) break;
+  }
+  if (num_groups == 0) return 0;
+
+  if (literal_indicator_byte_ == NULL) {
+    literal_indicator_byte_ = bit_writer_.GetNextBytePtr();
+    DCHECK(literal_indicator_byte_ != NULL);
+  }
+  int num_written = num_groups * 8;
+  bool success = bit_writer_.PutValues(bit_width_, num_written, values);
+  DCHECK(success) << "There is a bug in using CheckBufferFull()";
+  literal_count_ += num_written;
+  current_value_ = values[num_written - 1];
+  // Complete the literal run the same way FlushBufferedValues() would.
+  if (literal_count_ / 8 + 1 >= (1 << 6)) FlushLiteralRun(true);
+  return num_written;
+}
+
 inline void RleEncoder::FlushLiteralRun(bool update_indicator_byte) {
   if (literal_indicator_byte_ == NULL) {
     // The literal indicator byte has not been reserved yet, get one now.
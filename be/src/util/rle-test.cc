@@ -111,6 +111,21 @@ void TestBitArrayValues(int bit_width, int num_vals) {
   writer.Flush();
   EXPECT_EQ(writer.bytes_written(), len);
 
+  // Bulk packing, in batches of an odd size so that they start at different bit
+  // offsets, must produce the same bytes.
+  vector<int64_t> values(num_vals);
+  for (int i = 0; i < num_vals; ++i) values[i] = i % mod;
+  uint8_t batch_buffer[len];
+  BitWriter batch_writer(batch_buffer, len);
+  for (int i = 0; i < num_vals; i += 7) {
+    int batch_size = std::min(7, num_vals - i);
+    EXPECT_TRUE(batch_writer.PutValues(bit_width, batch_size, &values[i]));
+  }
+  EXPECT_FALSE(batch_writer.PutValues(bit_width == 0 ? 1 : bit_width, 8, &values[0]));
+  batch_writer.Flush();
+  EXPECT_EQ(batch_writer.bytes_written(), len);
+  EXPECT_EQ(memcmp(buffer, batch_buffer, len), 0);
+
   BitReader reader(buffer, len);
   // Ensure it returns the same results after Reset().
   for (int trial = 0; trial < 2; ++trial) {
@@ -123,6 +138,26 @@ void TestBitArrayValues(int bit_width, int num_vals) {
     EXPECT_EQ(reader.bytes_left(), 0);
     reader.Reset(buffer, len);
   }
+
+  // Read the values back in batches of an odd size so that batches start at
+  // different bit offsets, interleaved with single GetValue() calls.
+  vector<int64_t> batch(7);
+  int i = 0;
+  while (i < num_vals) {
+    if (i % 3 == 0) {
+      int64_t val;
+      EXPECT_TRUE(reader.GetValue(bit_width, &val));
+      EXPECT_EQ(val, i % mod);
+      ++i;
+      continue;
+    }
+    int batch_size = std::min<int>(batch.size(), num_vals - i);
+    int num_unpacked = reader.UnpackBatch(bit_width, batch_size, &batch[0]);
+    EXPECT_EQ(num_unpacked, batch_size);
+    for (int j = 0; j < num_unpacked; ++j) EXPECT_EQ(batch[j], (i + j) % mod);
+    i += num_unpacked;
+  }
+  EXPECT_EQ(reader.bytes_left(), 0);
 }
 
 TEST(BitArray, TestValues) {
@@ -200,6 +235,17 @@ void ValidateRle(const vector<int>& values, int bit_width,
     EXPECT_TRUE(memcmp(buffer, expected_encoding, expected_len) == 0);
   }
 
+  // Bulk encoding must produce the same runs, also when the values are passed in
+  // batches that do not line up with the groups of 8.
+  uint8_t batch_buffer[len];
+  RleEncoder batch_encoder(batch_buffer, len, bit_width);
+  for (int i = 0; i < values.size(); i += 75) {
+    int batch_size = std::min<int>(75, values.size() - i);
+    EXPECT_EQ(batch_encoder.PutValues(&values[i], batch_size), batch_size);
+  }
+  EXPECT_EQ(batch_encoder.Flush(), encoded_len);
+  EXPECT_EQ(memcmp(buffer, batch_buffer, encoded_len), 0);
+
   // Verify read
   RleDecoder decoder(buffer, len, bit_width);
   // Ensure it returns the same results after Reset().
@@ -212,6 +258,18 @@ void ValidateRle(const vector<int>& values, int bit_width,
     }
     decoder.Reset(buffer, len, bit_width);
   }
+
+  // Verify batched read, using a batch size that does not line up with the run
+  // boundaries.
+  vector<uint64_t> batch(13);
+  int i = 0;
+  while (i < values.size()) {
+    int batch_size = std::min<int>(batch.size(), values.size() - i);
+    int num_read = decoder.GetValues(batch_size, &batch[0]);
+    EXPECT_EQ(num_read, batch_size);
+    for (int j = 0; j < num_read; ++j) EXPECT_EQ(values[i + j], batch[j]);
+    i += batch_size;
+  }
 }
 
 TEST(Rle, SpecificSequences) {
@@ -416,6 +474,19 @@ TEST(BitRle, Overflow) {
       EXPECT_FALSE(decoder.Get(&v));
       decoder.Reset(buffer, bytes_written, bit_width);
     }
+
+    // A batched read past the end returns only the values that are there. The last
+    // literal run may be padded up to a multiple of 8 values.
+    vector<uint32_t> values(num_added + 16);
+    int num_read = decoder.GetValues(values.size(), &values[0]);
+    EXPECT_GE(num_read, num_added);
+    EXPECT_LT(num_read, values.size());
+    parity = true;
+    for (int i = 0; i < num_added; ++i) {
+      EXPECT_EQ(values[i], parity);
+      parity = !parity;
+    }
+    EXPECT_EQ(decoder.GetValues(values.size(), &values[0]), 0);
   }
 }
 
@@ -334,6 +334,64 @@ TEST(CountersTest, InfoStringTest) {
   EXPECT_EQ(*update_dst_profile.GetInfoString("Foo"), "Bar");
 }
 
+TEST(CountersTest, DeltaUpdate) {
+  ObjectPool pool;
+  RuntimeProfile profile(&pool, "Profile");
+  RuntimeProfile child(&pool, "Child");
+  profile.AddChild(&child);
+  RuntimeProfile::Counter* changed = child.AddCounter("Changed", TUnit::UNIT);
+  RuntimeProfile::Counter* unchanged = child.AddCounter("Unchanged", TUnit::UNIT);
+  changed->Set(1L);
+  unchanged->Set(2L);
+  profile.AddInfoString("Key", "Value");
+
+  // The first delta contains everything.
+  TRuntimeProfileTree full_tprofile;
+  profile.ToThrift(&full_tprofile);
+  TRuntimeProfileTree tprofile;
+  profile.ToThriftDelta(&tprofile);
+  EXPECT_EQ(tprofile, full_tprofile);
+  RuntimeProfile dst_profile(&pool, "Profile");
+  dst_profile.Update(tprofile);
+
+  // The second one only the changed counter.
+  changed->Set(3L);
+  profile.ToThriftDelta(&tprofile);
+  ASSERT_EQ(tprofile.nodes.size(), 2);
+  EXPECT_EQ(tprofile.nodes[0].info_strings.size(), 0);
+  ASSERT_EQ(tprofile.nodes[1].counters.size(), 1);
+  EXPECT_EQ(tprofile.nodes[1].counters[0].name, "Changed");
+  dst_profile.Update(tprofile);
+
+  vector<RuntimeProfile*> dst_children;
+  dst_profile.GetChildren(&dst_children);
+  ASSERT_EQ(dst_children.size(), 1);
+  RuntimeProfile* dst_child = dst_children[0];
+  EXPECT_EQ(dst_child->GetCounter("Changed")->value(), 3);
+  EXPECT_EQ(dst_child->GetCounter("Unchanged")->value(), 2);
+  EXPECT_EQ(*dst_profile.GetInfoString("Key"), "Value");
+}
+
+TEST(CountersTest, ArchiveString) {
+  ObjectPool pool;
+  RuntimeProfile profile(&pool, "Profile");
+  RuntimeProfile child(&pool, "Child");
+  profile.AddChild(&child);
+  child.AddCounter("Counter", TUnit::BYTES)->Set(10L);
+  profile.AddInfoString("Key", "Value");
+
+  TRuntimeProfileTree tprofile;
+  profile.ToThrift(&tprofile);
+  string archive_str = profile.SerializeToArchiveString();
+  TRuntimeProfileTree deserialized;
+  EXPECT_TRUE(RuntimeProfile::DeserializeFromArchiveString(archive_str,
+      &deserialized).ok());
+  EXPECT_EQ(tprofile, deserialized);
+
+  EXPECT_FALSE(RuntimeProfile::DeserializeFromArchiveString("not an archive",
+      &deserialized).ok());
+}
+
 TEST(CountersTest, RateCounters) {
   ObjectPool pool;
   RuntimeProfile profile(&pool, "Profile");
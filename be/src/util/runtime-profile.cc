@@ -24,6 +24,9 @@
 
 #include "common/object-pool.h"
 #include "rpc/thrift-util.h"
+#include "runtime/mem-pool.h"
+#include "runtime/mem-tracker.h"
+#include "util/codec.h"
 #include "util/compress.h"
 #include "util/container-util.h"
 #include "util/cpu-info.h"
@@ -637,9 +640,14 @@ string RuntimeProfile::SerializeToArchiveString() const {
 void RuntimeProfile::SerializeToArchiveString(stringstream* out) const {
   TRuntimeProfileTree thrift_object;
   const_cast<RuntimeProfile*>(this)->ToThrift(&thrift_object);
+  SerializeToArchiveString(thrift_object, out);
+}
+
+void RuntimeProfile::SerializeToArchiveString(const TRuntimeProfileTree& tree,
+    stringstream* out) {
   ThriftSerializer serializer(true);
   vector<uint8_t> serialized_buffer;
-  Status status = serializer.Serialize(&thrift_object, &serialized_buffer);
+  Status status = serializer.Serialize(&tree, &serialized_buffer);
   if (!status.ok()) return;
 
   // Compress the serialized thrift string.  This uses string keys and is very
@@ -661,12 +669,48 @@ void RuntimeProfile::SerializeToArchiveString(stringstream* out) const {
   compressor->Close();
 }
 
+Status RuntimeProfile::DeserializeFromArchiveString(const string& archive_str,
+    TRuntimeProfileTree* tree) {
+  string compressed_str;
+  if (!Base64Decode(archive_str, &compressed_str)) {
+    return Status("Runtime profile archive string is not valid base64");
+  }
+  MemTracker mem_tracker;
+  MemPool mem_pool(&mem_tracker);
+  scoped_ptr<Codec> decompressor;
+  Status status = Codec::CreateDecompressor(&mem_pool, false, THdfsCompression::DEFAULT,
+      &decompressor);
+  if (status.ok()) {
+    int64_t serialized_len = 0;
+    uint8_t* serialized_buffer = NULL;
+    status = decompressor->ProcessBlock(false, compressed_str.size(),
+        reinterpret_cast<const uint8_t*>(compressed_str.data()), &serialized_len,
+        &serialized_buffer);
+    if (status.ok()) {
+      uint32_t len = serialized_len;
+      status = DeserializeThriftMsg(serialized_buffer, &len, true, tree);
+    }
+    decompressor->Close();
+  }
+  mem_pool.FreeAll();
+  return status;
+}
+
 void RuntimeProfile::ToThrift(TRuntimeProfileTree* tree) const {
   tree->nodes.clear();
   ToThrift(&tree->nodes);
 }
 
 void RuntimeProfile::ToThrift(vector<TRuntimeProfileNode>* nodes) const {
+  ToThrift(nodes, false);
+}
+
+void RuntimeProfile::ToThriftDelta(TRuntimeProfileTree* tree) {
+  tree->nodes.clear();
+  ToThrift(&tree->nodes, true);
+}
+
+void RuntimeProfile::ToThrift(vector<TRuntimeProfileNode>* nodes, bool delta) const {
   nodes->reserve(nodes->size() + children_.size());
 
   int index = nodes->size();
@@ -689,13 +733,39 @@ void RuntimeProfile::ToThrift(vector<TRuntimeProfileNode>* nodes) const {
     counter.name = iter->first;
     counter.value = iter->second->value();
     counter.unit = iter->second->unit();
+    if (delta) {
+      map<string, int64_t>::iterator reported =
+          reported_counter_values_.find(counter.name);
+      if (reported != reported_counter_values_.end()) {
+        if (reported->second == counter.value) continue;
+        reported->second = counter.value;
+      } else {
+        reported_counter_values_.insert(make_pair(counter.name, counter.value));
+      }
+    }
     node.counters.push_back(counter);
   }
 
   {
     lock_guard<SpinLock> l(info_strings_lock_);
-    node.info_strings = info_strings_;
-    node.info_strings_display_order = info_strings_display_order_;
+    if (!delta) {
+      node.info_strings = info_strings_;
+      node.info_strings_display_order = info_strings_display_order_;
+    } else {
+      BOOST_FOREACH(const string& key, info_strings_display_order_) {
+        InfoStrings::const_iterator it = info_strings_.find(key);
+        DCHECK(it != info_strings_.end());
+        InfoStrings::iterator reported = reported_info_strings_.find(key);
+        if (reported != reported_info_strings_.end()) {
+          if (reported->second == it->second) continue;
+          reported->second = it->second;
+        } else {
+          reported_info_strings_.insert(*it);
+        }
+        node.info_strings.insert(*it);
+        node.info_strings_display_order.push_back(key);
+      }
+    }
   }
 
   {
@@ -737,7 +807,7 @@ void RuntimeProfile::ToThrift(vector<TRuntimeProfileNode>* nodes) const {
   }
   for (int i = 0; i < children.size(); ++i) {
     int child_idx = nodes->size();
-    children[i].first->ToThrift(nodes);
+    children[i].first->ToThrift(nodes, delta);
     // fix up indentation flag
     (*nodes)[child_idx].indent = children[i].second;
   }
@@ -26,6 +26,7 @@
 #include "common/atomic.h"
 #include "common/logging.h"
 #include "common/object-pool.h"
+#include "common/status.h"
 #include "util/stopwatch.h"
 #include "util/streaming-sampler.h"
 #include "gen-cpp/RuntimeProfile_types.h"
@@ -471,6 +472,13 @@ class RuntimeProfile {
   void ToThrift(TRuntimeProfileTree* tree) const;
   void ToThrift(std::vector<TRuntimeProfileNode>* nodes) const;
 
+  /// Like ToThrift(), but only serializes the counters and info strings whose values
+  /// changed since the previous call. Update() keeps the values of the others, so a
+  /// profile that was updated with all deltas in order equals this one. All nodes are
+  /// serialized, so that the tree structures match. The first call serializes
+  /// everything. Must not be called concurrently with itself.
+  void ToThriftDelta(TRuntimeProfileTree* tree);
+
   /// Serializes the runtime profile to a string.  This first serializes the
   /// object using thrift compact binary format, then gzip compresses it and
   /// finally encodes it as base64.  This is not a lightweight operation and
@@ -478,6 +486,16 @@ class RuntimeProfile {
   std::string SerializeToArchiveString() const;
   void SerializeToArchiveString(std::stringstream* out) const;
 
+  /// Same as above for a profile that was already serialized to 'tree', so that the
+  /// caller can use 'tree' for other purposes as well without serializing it again.
+  static void SerializeToArchiveString(const TRuntimeProfileTree& tree,
+      std::stringstream* out);
+
+  /// Reverses SerializeToArchiveString(). Returns an error if 'archive_str' is not a
+  /// valid archive string.
+  static Status DeserializeFromArchiveString(const std::string& archive_str,
+      TRuntimeProfileTree* tree);
+
   /// Divides all counters by n
   void Divide(int n);
 
@@ -607,6 +625,11 @@ class RuntimeProfile {
   /// Protects info_strings_ and info_strings_display_order_.
   mutable SpinLock info_strings_lock_;
 
+  /// The values of the counters and info strings as of the last ToThriftDelta(). Only
+  /// accessed by ToThriftDelta().
+  mutable std::map<std::string, int64_t> reported_counter_values_;
+  mutable InfoStrings reported_info_strings_;
+
   typedef std::map<std::string, EventSequence*> EventSequenceMap;
   EventSequenceMap event_sequence_map_;
 
@@ -648,6 +671,9 @@ class RuntimeProfile {
   static const std::string LOCAL_TIME_COUNTER_NAME;
   static const std::string INACTIVE_TIME_COUNTER_NAME;
 
+  /// Implements ToThrift() and, if 'delta' is true, ToThriftDelta().
+  void ToThrift(std::vector<TRuntimeProfileNode>* nodes, bool delta) const;
+
   /// Create a subtree of runtime profiles from nodes, starting at *node_idx.
   /// On return, *node_idx is the index one past the end of this subtree
   static RuntimeProfile* CreateFromThrift(ObjectPool* pool,
@@ -0,0 +1,303 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "util/sampling-profiler.h"
+
+#include <algorithm>
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <string.h>
+#include <time.h>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <gflags/gflags.h>
+#include <gutil/strings/substitute.h>
+
+#include "common/logging.h"
+#include "util/debug-util.h"
+#include "util/error-util.h"
+#include "util/symbols-util.h"
+#include "util/thread.h"
+#include "util/time.h"
+
+#include "common/names.h"
+
+using namespace impala;
+using namespace rapidjson;
+using namespace strings;
+
+DEFINE_int32(cpu_sampling_interval_ms, 20, "(Advanced) Milliseconds of CPU time used "
+    "by the process between two samples of the stack of the running thread, which are "
+    "attributed to the query the thread works for and shown on the /cpu_samples page. "
+    "Set to 0 to disable the sampling.");
+DEFINE_int32(cpu_sampling_max_queries, 100, "(Advanced) Maximum number of queries whose "
+    "CPU samples are kept. The samples of the queries sampled least recently are "
+    "discarded first.");
+
+// The signal the CPU timer sends. SIGPROF is left to the pprof CPU profiler, and the
+// JVM uses some of the lower real-time signals.
+static const int SAMPLING_SIGNAL_OFFSET = 6;
+
+// Frames of the signal handler and the kernel's signal trampoline on top of each
+// recorded stack.
+static const int NUM_HANDLER_FRAMES = 2;
+
+// How often the aggregation thread drains the sample buffer.
+static const int AGGREGATION_INTERVAL_MS = 250;
+
+SamplingProfiler::Sample SamplingProfiler::sample_slots_[NUM_SAMPLE_SLOTS];
+AtomicInt<int64_t> SamplingProfiler::next_slot_;
+AtomicInt<int64_t> SamplingProfiler::num_dropped_samples_;
+__thread int64_t SamplingProfiler::tag_query_id_hi_ = 0;
+__thread int64_t SamplingProfiler::tag_query_id_lo_ = 0;
+__thread int64_t SamplingProfiler::tag_instance_id_hi_ = 0;
+__thread int64_t SamplingProfiler::tag_instance_id_lo_ = 0;
+
+SamplingProfiler::ScopedTag::ScopedTag(const TUniqueId& query_id,
+    const TUniqueId& fragment_instance_id) {
+  prev_query_id_.hi = tag_query_id_hi_;
+  prev_query_id_.lo = tag_query_id_lo_;
+  prev_instance_id_.hi = tag_instance_id_hi_;
+  prev_instance_id_.lo = tag_instance_id_lo_;
+  tag_query_id_hi_ = query_id.hi;
+  tag_query_id_lo_ = query_id.lo;
+  tag_instance_id_hi_ = fragment_instance_id.hi;
+  tag_instance_id_lo_ = fragment_instance_id.lo;
+}
+
+SamplingProfiler::ScopedTag::~ScopedTag() {
+  tag_query_id_hi_ = prev_query_id_.hi;
+  tag_query_id_lo_ = prev_query_id_.lo;
+  tag_instance_id_hi_ = prev_instance_id_.hi;
+  tag_instance_id_lo_ = prev_instance_id_.lo;
+}
+
+SamplingProfiler::SamplingProfiler() {
+}
+
+Status SamplingProfiler::Init(Webserver* webserver) {
+  if (FLAGS_cpu_sampling_interval_ms <= 0) return Status::OK();
+  static SamplingProfiler profiler;
+  if (profiler.aggregation_thread_.get() != NULL) {
+    // Already started, e.g. by another ExecEnv of an in-process test cluster.
+    RegisterUrlCallback(&profiler, webserver);
+    return Status::OK();
+  }
+
+  // backtrace() loads libgcc on its first call, which must not happen in the signal
+  // handler.
+  void* frames[1];
+  backtrace(frames, 1);
+
+  int signum = SIGRTMIN + SAMPLING_SIGNAL_OFFSET;
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = &SamplingProfiler::SignalHandler;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(signum, &action, NULL) != 0) {
+    return Status(Substitute("Could not install the CPU sampling signal handler: $0",
+        GetStrErrMsg()));
+  }
+
+  profiler.aggregation_thread_.reset(new Thread("sampling-profiler", "aggregation",
+      &SamplingProfiler::AggregationLoop, &profiler));
+
+  struct sigevent event;
+  memset(&event, 0, sizeof(event));
+  event.sigev_notify = SIGEV_SIGNAL;
+  event.sigev_signo = signum;
+  timer_t timer;
+  if (timer_create(CLOCK_PROCESS_CPUTIME_ID, &event, &timer) != 0) {
+    return Status(Substitute("Could not create the CPU sampling timer: $0",
+        GetStrErrMsg()));
+  }
+  struct itimerspec interval;
+  interval.it_interval.tv_sec = FLAGS_cpu_sampling_interval_ms / 1000;
+  interval.it_interval.tv_nsec = (FLAGS_cpu_sampling_interval_ms % 1000) * 1000L * 1000L;
+  interval.it_value = interval.it_interval;
+  if (timer_settime(timer, 0, &interval, NULL) != 0) {
+    return Status(Substitute("Could not start the CPU sampling timer: $0",
+        GetStrErrMsg()));
+  }
+
+  RegisterUrlCallback(&profiler, webserver);
+  LOG(INFO) << "Sampling the CPU usage every " << FLAGS_cpu_sampling_interval_ms
+            << "ms of CPU time";
+  return Status::OK();
+}
+
+void SamplingProfiler::RegisterUrlCallback(SamplingProfiler* profiler,
+    Webserver* webserver) {
+  if (webserver == NULL) return;
+  Webserver::UrlCallback callback =
+      bind<void>(mem_fn(&SamplingProfiler::CpuSamplesUrlCallback), profiler, _1, _2);
+  webserver->RegisterUrlCallback("/cpu_samples", "cpu_samples.tmpl", callback);
+}
+
+void SamplingProfiler::SignalHandler(int signum, siginfo_t* info, void* context) {
+  int saved_errno = errno;
+  Sample* sample = &sample_slots_[next_slot_.FetchAndUpdate(1) % NUM_SAMPLE_SLOTS];
+  if (sample->state.CompareAndSwap(FREE, WRITING)) {
+    sample->query_id_hi = tag_query_id_hi_;
+    sample->query_id_lo = tag_query_id_lo_;
+    sample->instance_id_hi = tag_instance_id_hi_;
+    sample->instance_id_lo = tag_instance_id_lo_;
+    sample->depth = backtrace(sample->frames, MAX_STACK_DEPTH);
+    // The compare-and-swap is a full barrier, so the sample is complete once the
+    // aggregation thread sees it READY.
+    sample->state.CompareAndSwap(WRITING, READY);
+  } else {
+    ++num_dropped_samples_;
+  }
+  errno = saved_errno;
+}
+
+void SamplingProfiler::AggregationLoop() {
+  while (true) {
+    SleepForMs(AGGREGATION_INTERVAL_MS);
+    int64_t now_ms = UnixMillis();
+    for (int i = 0; i < NUM_SAMPLE_SLOTS; ++i) {
+      Sample* sample = &sample_slots_[i];
+      if (sample->state.Read() != READY) continue;
+      AddSample(*sample, now_ms);
+      sample->state.CompareAndSwap(READY, FREE);
+    }
+  }
+}
+
+void SamplingProfiler::AddSample(const Sample& sample, int64_t now_ms) {
+  // Fold the stack from the outermost frame to the innermost one. The frames below the
+  // innermost hold return addresses, which are looked up one byte earlier so that calls
+  // at the end of a function are not attributed to the next one.
+  string stack;
+  for (int i = sample.depth - 1; i >= NUM_HANDLER_FRAMES; --i) {
+    void* pc = sample.frames[i];
+    if (i > NUM_HANDLER_FRAMES) pc = reinterpret_cast<char*>(pc) - 1;
+    if (!stack.empty()) stack += ';';
+    stack += Symbolize(pc);
+  }
+  TUniqueId query_id;
+  query_id.hi = sample.query_id_hi;
+  query_id.lo = sample.query_id_lo;
+  TUniqueId instance_id;
+  instance_id.hi = sample.instance_id_hi;
+  instance_id.lo = sample.instance_id_lo;
+
+  lock_guard<mutex> l(lock_);
+  QuerySamples* query_samples = &samples_[query_id];
+  ++query_samples->num_samples;
+  query_samples->last_sample_ms = now_ms;
+  if (query_id.hi != 0 || query_id.lo != 0) {
+    ++query_samples->instance_samples[instance_id];
+  }
+  map<string, int64_t>::iterator it = query_samples->stack_samples.find(stack);
+  if (it != query_samples->stack_samples.end()) {
+    ++it->second;
+  } else if (query_samples->stack_samples.size() < MAX_STACKS_PER_QUERY) {
+    query_samples->stack_samples[stack] = 1;
+  } else {
+    ++query_samples->stack_samples["[other stacks]"];
+  }
+  if (samples_.size() > FLAGS_cpu_sampling_max_queries) EvictQueries();
+}
+
+void SamplingProfiler::EvictQueries() {
+  vector<pair<int64_t, TUniqueId> > queries;
+  BOOST_FOREACH(const QuerySamplesMap::value_type& entry, samples_) {
+    queries.push_back(make_pair(entry.second.last_sample_ms, entry.first));
+  }
+  sort(queries.begin(), queries.end());
+  int num_evicted = queries.size() - FLAGS_cpu_sampling_max_queries;
+  for (int i = 0; i < num_evicted; ++i) {
+    samples_.erase(queries[i].second);
+  }
+}
+
+const string& SamplingProfiler::Symbolize(void* pc) {
+  // Functions are looked up in the dynamic symbol table, which holds all of them since
+  // impalad is linked with -rdynamic.
+  boost::unordered_map<void*, string>::iterator it = symbols_.find(pc);
+  if (it != symbols_.end()) return it->second;
+  string name;
+  Dl_info info;
+  if (dladdr(pc, &info) != 0 && info.dli_sname != NULL) {
+    name = SymbolsUtil::DemangleNoArgs(info.dli_sname);
+  } else {
+    name = Substitute("$0", pc);
+  }
+  return symbols_[pc] = name;
+}
+
+void SamplingProfiler::CpuSamplesUrlCallback(const Webserver::ArgumentMap& args,
+    Document* document) {
+  document->AddMember("sampling_interval_ms", FLAGS_cpu_sampling_interval_ms,
+      document->GetAllocator());
+  document->AddMember("num_dropped_samples", num_dropped_samples_.Read(),
+      document->GetAllocator());
+  Webserver::ArgumentMap::const_iterator query_id_arg = args.find("query_id");
+  lock_guard<mutex> l(lock_);
+  if (query_id_arg == args.end()) {
+    Value queries(kArrayType);
+    BOOST_FOREACH(const QuerySamplesMap::value_type& entry, samples_) {
+      Value query(kObjectType);
+      Value query_id(PrintId(entry.first).c_str(), document->GetAllocator());
+      query.AddMember("query_id", query_id, document->GetAllocator());
+      query.AddMember("num_samples", entry.second.num_samples, document->GetAllocator());
+      query.AddMember("num_instances",
+          static_cast<uint64_t>(entry.second.instance_samples.size()),
+          document->GetAllocator());
+      queries.PushBack(query, document->GetAllocator());
+    }
+    document->AddMember("queries", queries, document->GetAllocator());
+    return;
+  }
+
+  TUniqueId query_id;
+  if (!ParseId(query_id_arg->second, &query_id)) {
+    Value error(Substitute("Could not parse 'query_id' argument: $0",
+        query_id_arg->second).c_str(), document->GetAllocator());
+    document->AddMember("error", error, document->GetAllocator());
+    return;
+  }
+  Value query_id_json(PrintId(query_id).c_str(), document->GetAllocator());
+  document->AddMember("query_id", query_id_json, document->GetAllocator());
+  QuerySamplesMap::const_iterator query_samples = samples_.find(query_id);
+  if (query_samples == samples_.end()) return;
+  document->AddMember("num_samples", query_samples->second.num_samples,
+      document->GetAllocator());
+
+  Value instances(kArrayType);
+  typedef boost::unordered_map<TUniqueId, int64_t>::value_type InstanceEntry;
+  BOOST_FOREACH(const InstanceEntry& entry, query_samples->second.instance_samples) {
+    Value instance(kObjectType);
+    Value instance_id(PrintId(entry.first).c_str(), document->GetAllocator());
+    instance.AddMember("instance_id", instance_id, document->GetAllocator());
+    instance.AddMember("num_samples", entry.second, document->GetAllocator());
+    instances.PushBack(instance, document->GetAllocator());
+  }
+  document->AddMember("instances", instances, document->GetAllocator());
+
+  Value stacks(kArrayType);
+  typedef map<string, int64_t>::value_type StackEntry;
+  BOOST_FOREACH(const StackEntry& entry, query_samples->second.stack_samples) {
+    Value stack(kObjectType);
+    Value frames(entry.first.c_str(), document->GetAllocator());
+    stack.AddMember("stack", frames, document->GetAllocator());
+    stack.AddMember("num_samples", entry.second, document->GetAllocator());
+    stacks.PushBack(stack, document->GetAllocator());
+  }
+  document->AddMember("stacks", stacks, document->GetAllocator());
+}
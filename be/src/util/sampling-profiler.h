@@ -0,0 +1,172 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef IMPALA_UTIL_SAMPLING_PROFILER_H
+#define IMPALA_UTIL_SAMPLING_PROFILER_H
+
+#include <map>
+#include <string>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <signal.h>
+
+#include "common/atomic.h"
+#include "common/status.h"
+#include "gen-cpp/Types_types.h"
+#include "util/uid-util.h"
+#include "util/webserver.h"
+
+namespace impala {
+
+class Thread;
+
+/// Always-on CPU profiler that attributes its samples to queries. A timer on the CPU
+/// time of the process sends a signal every --cpu_sampling_interval_ms of CPU time used,
+/// which the kernel delivers to the thread that is running. The signal handler records
+/// the thread's stack, together with the query and fragment instance the thread is
+/// tagged with by a ScopedTag, in a fixed-size buffer of samples. A background thread
+/// drains the buffer, symbolizes the stacks and adds them up per query, and the
+/// /cpu_samples page of the webserver shows them as a flame graph. Samples of threads
+/// that are not tagged, e.g. of RPC or io mgr threads, are attributed to no query.
+///
+/// Unlike the pprof handlers, the profiler only takes a few dozen samples per second
+/// of CPU time and is meant to run all the time. It only sees the threads of this
+/// process, i.e. the flame graph of a query covers the fragment instances that ran on
+/// this host.
+class SamplingProfiler {
+ public:
+  /// Starts the profiler, unless it is already running, and registers its page with
+  /// 'webserver', which may be NULL. Does nothing if --cpu_sampling_interval_ms is 0.
+  static Status Init(Webserver* webserver);
+
+  /// Tags the calling thread with a fragment instance of a query while in scope. Scopes
+  /// may be nested, the innermost one applies.
+  class ScopedTag {
+   public:
+    ScopedTag(const TUniqueId& query_id, const TUniqueId& fragment_instance_id);
+    ~ScopedTag();
+
+   private:
+    /// The tag of the enclosing scope, restored when this one ends.
+    TUniqueId prev_query_id_;
+    TUniqueId prev_instance_id_;
+  };
+
+ private:
+  /// Maximum number of frames recorded per sample.
+  static const int MAX_STACK_DEPTH = 48;
+
+  /// Number of samples the buffer holds. Samples taken while the buffer is full are
+  /// dropped.
+  static const int NUM_SAMPLE_SLOTS = 4096;
+
+  /// Maximum number of distinct stacks kept per query. The samples of further stacks
+  /// are added to a single "[other stacks]" entry.
+  static const int MAX_STACKS_PER_QUERY = 20000;
+
+  /// A sample in the buffer. The signal handler claims a FREE slot by setting it to
+  /// WRITING, fills it in and marks it READY; the aggregation thread reads READY slots
+  /// and frees them again. The tag is stored as plain integers, which the signal handler
+  /// can copy from thread-local storage.
+  enum SlotState { FREE, WRITING, READY };
+  struct Sample {
+    AtomicInt<int32_t> state;
+    int64_t query_id_hi;
+    int64_t query_id_lo;
+    int64_t instance_id_hi;
+    int64_t instance_id_lo;
+    int depth;
+    void* frames[MAX_STACK_DEPTH];
+  };
+
+  /// The samples of one query.
+  struct QuerySamples {
+    QuerySamples() : num_samples(0), last_sample_ms(0) { }
+
+    int64_t num_samples;
+
+    /// Time of the latest sample, used to discard the samples of the queries that were
+    /// sampled least recently.
+    int64_t last_sample_ms;
+
+    /// Number of samples per fragment instance.
+    boost::unordered_map<TUniqueId, int64_t> instance_samples;
+
+    /// Number of samples per stack. The key lists the function names from the
+    /// outermost to the innermost frame, separated by ';', which is the input format of
+    /// common flame graph tools.
+    std::map<std::string, int64_t> stack_samples;
+  };
+  typedef boost::unordered_map<TUniqueId, QuerySamples> QuerySamplesMap;
+
+  SamplingProfiler();
+
+  /// Registers the /cpu_samples page of 'profiler' with 'webserver' if it is not NULL.
+  static void RegisterUrlCallback(SamplingProfiler* profiler, Webserver* webserver);
+
+  /// Records a sample of the calling thread. Async-signal-safe.
+  static void SignalHandler(int signum, siginfo_t* info, void* context);
+
+  /// Drains the sample buffer every few hundred ms. Runs in aggregation_thread_.
+  void AggregationLoop();
+
+  /// Symbolizes 'sample' and adds it to samples_.
+  void AddSample(const Sample& sample, int64_t now_ms);
+
+  /// Discards the samples of the queries sampled least recently until at most
+  /// --cpu_sampling_max_queries are left. Called with lock_ held.
+  void EvictQueries();
+
+  /// Returns the name of the function containing 'pc', caching the result.
+  const std::string& Symbolize(void* pc);
+
+  /// Webserver callback. Lists the sampled queries, or the samples of the query given
+  /// by the 'query_id' argument.
+  void CpuSamplesUrlCallback(const Webserver::ArgumentMap& args,
+      rapidjson::Document* document);
+
+  /// The sample buffer, written by SignalHandler().
+  static Sample sample_slots_[NUM_SAMPLE_SLOTS];
+
+  /// Index of the slot the next sample is written to, modulo NUM_SAMPLE_SLOTS.
+  static AtomicInt<int64_t> next_slot_;
+
+  /// Number of samples dropped because their slot was still in use.
+  static AtomicInt<int64_t> num_dropped_samples_;
+
+  /// The tag of the calling thread, see ScopedTag.
+  static __thread int64_t tag_query_id_hi_;
+  static __thread int64_t tag_query_id_lo_;
+  static __thread int64_t tag_instance_id_hi_;
+  static __thread int64_t tag_instance_id_lo_;
+
+  /// Protects samples_.
+  boost::mutex lock_;
+
+  /// The samples per query. The samples of untagged threads are kept under the query id
+  /// 0:0.
+  QuerySamplesMap samples_;
+
+  /// Cache of the function names of Symbolize(). Only accessed by the aggregation
+  /// thread.
+  boost::unordered_map<void*, std::string> symbols_;
+
+  boost::scoped_ptr<Thread> aggregation_thread_;
+};
+
+}
+
+#endif
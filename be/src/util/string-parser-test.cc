@@ -211,6 +211,26 @@ TEST(StringToInt, Overflow) {
       StringParser::PARSE_OVERFLOW);
 }
 
+// Exercises the path that consumes 8 digits at a time.
+TEST(StringToInt, LongDigitRuns) {
+  TestIntValue<int32_t>("00000000", 0, StringParser::PARSE_SUCCESS);
+  TestIntValue<int32_t>("98765432", 98765432, StringParser::PARSE_SUCCESS);
+  TestIntValue<int32_t>("-123456789", -123456789, StringParser::PARSE_SUCCESS);
+  TestIntValue<int32_t>("12345678  ", 12345678, StringParser::PARSE_SUCCESS);
+  TestIntValue<int64_t>("1234567890123456", 1234567890123456LL,
+      StringParser::PARSE_SUCCESS);
+  TestIntValue<int64_t>("-123456789012345678", -123456789012345678LL,
+      StringParser::PARSE_SUCCESS);
+  TestIntValue<int64_t>("1234567890123 ", 1234567890123LL, StringParser::PARSE_SUCCESS);
+
+  // A non-digit inside or right after a run of 8 digits.
+  TestIntValue<int32_t>("1234x678", 0, StringParser::PARSE_FAILURE);
+  TestIntValue<int32_t>("1234567/", 0, StringParser::PARSE_FAILURE);
+  TestIntValue<int32_t>("12345678:", 0, StringParser::PARSE_FAILURE);
+  TestIntValue<int64_t>("12345678 9", 0, StringParser::PARSE_FAILURE);
+  TestIntValue<int64_t>("12345678123456-8", 0, StringParser::PARSE_FAILURE);
+}
+
 TEST(StringToInt, Int8_Exhaustive) {
   char buffer[5];
   for (int i = -256; i <= 256; ++i) {
@@ -45,7 +45,8 @@ void PrintExecSummary(const TExecSummary& exec_summary, int indent_level,
   agg_stats.NAME += node.exec_stats[i].NAME;\
   max_stats.NAME = std::max(max_stats.NAME, node.exec_stats[i].NAME)
 
-  // Compute avg and max of each used stat (cpu_time_ns is unused in the summary output).
+  // Compute avg and max of each used stat (the CPU and wait times are unused in the
+  // summary output, they are shown by the web UI).
   for (int i = 0; i < node.exec_stats.size(); ++i) {
     COMPUTE_MAX_SUM_STATS(latency_ns);
     COMPUTE_MAX_SUM_STATS(cardinality);
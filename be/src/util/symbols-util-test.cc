@@ -64,6 +64,17 @@ void TestManglingPrepareOrClose(const string& name, const string& expected_mangl
   EXPECT_EQ(demangled, expected_demangled);
 }
 
+void TestManglingBatch(const string& name, const string& expected_mangled,
+    const string& expected_demangled) {
+  string mangled = SymbolsUtil::MangleBatchFunction(name);
+  string demangled = SymbolsUtil::Demangle(mangled);
+
+  // Check we could demangle it.
+  EXPECT_TRUE(!demangled.empty()) << demangled;
+  EXPECT_EQ(mangled, expected_mangled);
+  EXPECT_EQ(demangled, expected_demangled);
+}
+
 // Not very thoroughly tested since our implementation is just a wrapper around
 // the gcc library.
 TEST(SymbolsUtil, Demangling) {
@@ -320,6 +331,15 @@ TEST(SymbolsUtil, ManglingPrepareOrClose) {
       " impala_udf::FunctionContext::FunctionStateScope)");
 }
 
+TEST(SymbolsUtil, ManglingBatch) {
+  TestManglingBatch("CountBatch",
+      "_Z10CountBatchPN10impala_udf15FunctionContextEiPKPKvPv",
+      "CountBatch(impala_udf::FunctionContext*, int, void const* const*, void*)");
+  TestManglingBatch("foo::bar",
+      "_ZN3foo3barEPN10impala_udf15FunctionContextEiPKPKvPv",
+      "foo::bar(impala_udf::FunctionContext*, int, void const* const*, void*)");
+}
+
 }
 
 int main(int argc, char **argv) {
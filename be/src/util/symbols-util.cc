@@ -271,3 +271,26 @@ string SymbolsUtil::ManglePrepareOrCloseFunction(const string& fn_name) {
 
   return ss.str();
 }
+
+string SymbolsUtil::MangleBatchFunction(const string& fn_name) {
+  vector<string> name_tokens;
+  split_regex(name_tokens, fn_name, regex("::"));
+
+  stringstream ss;
+  ss << MANGLE_PREFIX;
+  if (name_tokens.size() > 1) ss << "N";  // Start namespace
+  for (int i = 0; i < name_tokens.size(); ++i) {
+    AppendMangledToken(name_tokens[i], &ss);
+  }
+  if (name_tokens.size() > 1) ss << "E"; // End fn namespace
+
+  ss << "PN"; // FunctionContext* argument and start of FunctionContext namespace
+  AppendMangledToken("impala_udf", &ss);
+  AppendMangledToken("FunctionContext", &ss);
+  ss << "E"; // E indicates end of namespace
+
+  // int num_rows, const void* const* args, void* results. None of these types is
+  // repeated, so there are no substitutions.
+  ss << "i" << "PKPKv" << "Pv";
+  return ss.str();
+}
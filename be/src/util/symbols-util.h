@@ -60,6 +60,10 @@ class SymbolsUtil {
   /// Mangles fn_name assuming arguments
   /// (impala_udf::FunctionContext*, impala_udf::FunctionContext::FunctionStateScope).
   static std::string ManglePrepareOrCloseFunction(const std::string& fn_name);
+
+  /// Mangles fn_name assuming the arguments of a UdfBatchFn
+  /// (impala_udf::FunctionContext*, int, const void* const*, void*).
+  static std::string MangleBatchFunction(const std::string& fn_name);
 };
 
 }
@@ -18,8 +18,10 @@
 #include <gtest/gtest.h>
 #include <unistd.h>
 
+#include "common/atomic.h"
 #include "common/logging.h"
 #include "util/thread-pool.h"
+#include "util/time.h"
 
 #include "common/names.h"
 
@@ -64,6 +66,60 @@ TEST(ThreadPoolTest, BasicTest) {
   EXPECT_EQ(expected_count, count);
 }
 
+TEST(ThreadPoolTest, WorkStealingBasicTest) {
+  const int OFFERED_RANGE = 10000;
+  for (int i = 0; i < NUM_THREADS; ++i) {
+    thread_counters[i] = 0;
+  }
+
+  // A small queue, so that Offer() blocks while it is full.
+  WorkStealingThreadPool<int> thread_pool("thread-pool", "worker", 5, 100, Count);
+  for (int i = 0; i <= OFFERED_RANGE; ++i) {
+    ASSERT_TRUE(thread_pool.Offer(i));
+  }
+
+  thread_pool.DrainAndShutdown();
+  ASSERT_FALSE(thread_pool.Offer(-1));
+  EXPECT_EQ(0, thread_pool.GetQueueSize());
+
+  int expected_count = (OFFERED_RANGE * (OFFERED_RANGE + 1)) / 2;
+  int count = 0;
+  for (int i = 0; i < NUM_THREADS; ++i) {
+    lock_guard<mutex> l(thread_mutexes[i]);
+    count += thread_counters[i];
+  }
+  EXPECT_EQ(expected_count, count);
+}
+
+WorkStealingThreadPool<int>* spawning_pool;
+AtomicInt<int> num_spawned_processed;
+
+// Offers two items of depth 'depth' - 1 from the worker thread, which go on its own
+// deque and are stolen by the other workers.
+void Spawn(int thread_id, const int& depth) {
+  ++num_spawned_processed;
+  if (depth == 0) return;
+  ASSERT_TRUE(spawning_pool->Offer(depth - 1));
+  ASSERT_TRUE(spawning_pool->Offer(depth - 1));
+}
+
+TEST(ThreadPoolTest, WorkStealingSpawnTest) {
+  const int DEPTH = 14;
+  const int EXPECTED_ITEMS = (1 << (DEPTH + 1)) - 1;
+  num_spawned_processed = 0;
+  WorkStealingThreadPool<int> thread_pool("thread-pool", "worker", 5, 16, Spawn);
+  spawning_pool = &thread_pool;
+  ASSERT_TRUE(thread_pool.Offer(DEPTH));
+
+  // DrainAndShutdown() may return while an item is about to offer its children, so wait
+  // for all of them to be processed first.
+  for (int i = 0; i < 1000 && num_spawned_processed.Read() < EXPECTED_ITEMS; ++i) {
+    SleepForMs(10);
+  }
+  thread_pool.DrainAndShutdown();
+  EXPECT_EQ(EXPECTED_ITEMS, num_spawned_processed.Read());
+}
+
 }
 
 int main(int argc, char** argv) {
@@ -17,9 +17,17 @@
 
 #include "util/blocking-queue.h"
 
+#include <algorithm>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/bind/mem_fn.hpp>
 
+#include "common/atomic.h"
+#include "common/logging.h"
+#include "util/bit-util.h"
 #include "util/thread.h"
 
 namespace impala {
@@ -175,6 +183,377 @@ class CallableThreadPool : public ThreadPool<boost::function<void()> > {
   }
 };
 
+/// Fixed-capacity work-stealing deque of pointers (Chase and Lev, "Dynamic Circular
+/// Work-Stealing Deque", without the resizing). Only the thread that owns the deque may
+/// call Push() and Pop(), which work on the bottom end. Any thread may call Steal(),
+/// which takes from the top end. None of them take locks.
+template <typename T>
+class WorkStealingDeque {
+ public:
+  /// 'capacity' must be a power of two.
+  explicit WorkStealingDeque(int64_t capacity)
+    : mask_(capacity - 1), items_(new T*[capacity]), top_(0), bottom_(0) {
+    DCHECK_EQ(capacity & mask_, 0);
+  }
+
+  /// Adds 'item' at the bottom. Returns false if the deque is full.
+  bool Push(T* item) {
+    int64_t b = bottom_;
+    int64_t t = top_.Read();
+    if (b - t > mask_) return false;
+    items_[b & mask_] = item;
+    // The item must be visible to the thieves before the new bottom.
+    AtomicUtil::MemoryBarrier();
+    bottom_ = b + 1;
+    return true;
+  }
+
+  /// Removes the item at the bottom, i.e. the newest one. Returns NULL if the deque is
+  /// empty.
+  T* Pop() {
+    int64_t b = bottom_ - 1;
+    bottom_ = b;
+    // The new bottom must be visible to the thieves before top is read.
+    AtomicUtil::MemoryBarrier();
+    int64_t t = top_.Read();
+    if (t > b) {
+      bottom_ = b + 1;
+      return NULL;
+    }
+    T* item = items_[b & mask_];
+    if (t == b) {
+      // This is the last item, which a thief may be taking at the same time.
+      if (!top_.CompareAndSwap(t, t + 1)) item = NULL;
+      bottom_ = b + 1;
+    }
+    return item;
+  }
+
+  /// Removes the item at the top, i.e. the oldest one. Returns NULL if the deque is
+  /// empty or if another thread took the item first.
+  T* Steal() {
+    int64_t t = top_.Read();
+    int64_t b = bottom_.Read();
+    if (t >= b) return NULL;
+    T* item = items_[t & mask_];
+    if (!top_.CompareAndSwap(t, t + 1)) return NULL;
+    return item;
+  }
+
+ private:
+  const int64_t mask_;
+  boost::scoped_array<T*> items_;
+
+  /// Index of the next item to steal and of the next item to push. Items are stored at
+  /// their index modulo the capacity.
+  AtomicInt<int64_t> top_;
+  AtomicInt<int64_t> bottom_;
+};
+
+/// Bounded multi-producer, multi-consumer FIFO queue of pointers that doesn't take
+/// locks (Vyukov's bounded MPMC queue). Each slot carries a sequence number that tells
+/// the producers and the consumers whose turn it is to use the slot.
+template <typename T>
+class MpmcQueue {
+ public:
+  /// 'capacity' must be a power of two.
+  explicit MpmcQueue(int64_t capacity)
+    : mask_(capacity - 1), slots_(new Slot[capacity]), head_(0), tail_(0) {
+    DCHECK_EQ(capacity & mask_, 0);
+    for (int64_t i = 0; i < capacity; ++i) slots_[i].sequence = i;
+  }
+
+  /// Adds 'item' at the tail. Returns false if the queue is full.
+  bool Put(T* item) {
+    int64_t pos = tail_.Read();
+    while (true) {
+      Slot* slot = &slots_[pos & mask_];
+      int64_t diff = slot->sequence.Read() - pos;
+      if (diff == 0) {
+        if (tail_.CompareAndSwap(pos, pos + 1)) {
+          slot->item = item;
+          AtomicUtil::MemoryBarrier();
+          slot->sequence = pos + 1;
+          return true;
+        }
+      } else if (diff < 0) {
+        // The slot still holds the item of the previous round.
+        return false;
+      }
+      pos = tail_.Read();
+    }
+  }
+
+  /// Removes the item at the head. Returns NULL if the queue is empty.
+  T* Get() {
+    int64_t pos = head_.Read();
+    while (true) {
+      Slot* slot = &slots_[pos & mask_];
+      int64_t diff = slot->sequence.Read() - (pos + 1);
+      if (diff == 0) {
+        if (head_.CompareAndSwap(pos, pos + 1)) {
+          T* item = slot->item;
+          AtomicUtil::MemoryBarrier();
+          slot->sequence = pos + mask_ + 1;
+          return item;
+        }
+      } else if (diff < 0) {
+        // The slot's item of this round hasn't been put yet.
+        return NULL;
+      }
+      pos = head_.Read();
+    }
+  }
+
+ private:
+  struct Slot {
+    AtomicInt<int64_t> sequence;
+    T* item;
+  };
+
+  const int64_t mask_;
+  boost::scoped_array<Slot> slots_;
+
+  /// Positions of the next Get() and of the next Put(), on separate cache lines so that
+  /// producers and consumers don't invalidate each other's.
+  AtomicInt<int64_t> head_;
+  char padding_[64];
+  AtomicInt<int64_t> tail_;
+};
+
+/// Thread pool with the same interface as ThreadPool, which avoids contending on a
+/// single queue lock under heavy load. Each worker thread has its own WorkStealingDeque
+/// on which it pushes the items that it offers itself, e.g. follow-up work. The items
+/// offered by other threads go to a shared MpmcQueue. An idle worker takes the newest
+/// item of its own deque, then the oldest item of the shared queue, and otherwise
+/// steals the oldest item of another worker's deque. Locks are only taken to put idle
+/// workers to sleep and to wake them up, and to block Offer() while the shared queue
+/// is full.
+///
+/// Unlike ThreadPool, items are not processed in FIFO order, and they are copied to the
+/// heap when they are offered. The capacity of the shared queue is 'queue_size' rounded
+/// up to a power of two, but at most MAX_QUEUE_CAPACITY.
+template <typename T>
+class WorkStealingThreadPool {
+ public:
+  typedef typename ThreadPool<T>::WorkFunction WorkFunction;
+
+  /// Largest capacity of the shared queue.
+  static const int64_t MAX_QUEUE_CAPACITY = 64 * 1024;
+
+  /// Capacity of the deque of each worker. Once it is full, the worker offers items to
+  /// the shared queue.
+  static const int64_t DEQUE_CAPACITY = 1024;
+
+  /// Creates a new thread pool and starts num_threads threads. The arguments are the same
+  /// as ThreadPool's.
+  WorkStealingThreadPool(const std::string& group, const std::string& thread_prefix,
+      uint32_t num_threads, uint32_t queue_size, const WorkFunction& work_function)
+    : work_function_(work_function),
+      queue_(std::min(BitUtil::NextPowerOfTwo(std::max<int64_t>(queue_size, 2)),
+          MAX_QUEUE_CAPACITY)),
+      num_queued_(0),
+      num_sleeping_workers_(0),
+      num_blocked_offers_(0),
+      shutdown_(false) {
+    for (int i = 0; i < num_threads; ++i) {
+      deques_.push_back(new WorkStealingDeque<T>(DEQUE_CAPACITY));
+    }
+    for (int i = 0; i < num_threads; ++i) {
+      std::stringstream threadname;
+      threadname << thread_prefix << "(" << i + 1 << ":" << num_threads << ")";
+      threads_.AddThread(new Thread(group, threadname.str(), boost::bind<void>(
+          boost::mem_fn(&WorkStealingThreadPool<T>::WorkerThread), this, i)));
+    }
+  }
+
+  /// Terminates the threads and frees the items that were never processed.
+  virtual ~WorkStealingThreadPool() {
+    Shutdown();
+    Join();
+    T* item;
+    while ((item = queue_.Get()) != NULL) delete item;
+    for (int i = 0; i < deques_.size(); ++i) {
+      while ((item = deques_[i].Pop()) != NULL) delete item;
+    }
+  }
+
+  /// Puts a copy of 'work' on the deque of the calling worker thread, or on the shared
+  /// queue if it is called by another thread. Blocks while the shared queue is full.
+  /// The same requirements as for ThreadPool::Offer() apply to the data that 'work'
+  /// references. Returns false if the pool has already been shut down.
+  bool Offer(const T& work) {
+    if (IsShutdown()) return false;
+    T* item = new T(work);
+    // Counted before the item is visible, so that a worker never sees more items than
+    // num_queued_.
+    ++num_queued_;
+    bool pushed = current_pool_ == this && deques_[current_worker_].Push(item);
+    if (!pushed && !PutInQueue(item)) {
+      --num_queued_;
+      delete item;
+      return false;
+    }
+    if (num_sleeping_workers_.Read() > 0) {
+      boost::lock_guard<boost::mutex> l(lock_);
+      work_cv_.notify_one();
+    }
+    return true;
+  }
+
+  /// Shuts the thread pool down, causing Offer() to fail and the worker threads to
+  /// terminate once they have processed their current work item. Returns once the
+  /// shutdown flag has been set, does not wait for the threads to terminate.
+  void Shutdown() {
+    boost::lock_guard<boost::mutex> l(lock_);
+    shutdown_ = true;
+    work_cv_.notify_all();
+    not_full_cv_.notify_all();
+  }
+
+  /// Blocks until all threads are finished.
+  void Join() {
+    threads_.JoinAll();
+  }
+
+  /// Returns the number of offered items that haven't been taken by a worker yet.
+  uint32_t GetQueueSize() {
+    return num_queued_.Read();
+  }
+
+  /// Blocks until all offered items have been taken by a worker, and then calls Shutdown
+  /// and Join. Any work Offer()'ed during DrainAndShutdown may or may not be processed.
+  void DrainAndShutdown() {
+    {
+      boost::unique_lock<boost::mutex> l(lock_);
+      while (num_queued_.Read() != 0) empty_cv_.wait(l);
+    }
+    Shutdown();
+    Join();
+  }
+
+  Status AssignToCgroup(const std::string& cgroup) {
+    return threads_.SetCgroup(cgroup);
+  }
+
+ private:
+  /// Driver method for each thread in the pool. Processes items until the pool is shut
+  /// down, and sleeps while there are none.
+  void WorkerThread(int thread_id) {
+    current_pool_ = this;
+    current_worker_ = thread_id;
+    while (!IsShutdown()) {
+      boost::scoped_ptr<T> item(NextItem(thread_id));
+      if (item.get() == NULL) {
+        boost::unique_lock<boost::mutex> l(lock_);
+        // Announced before checking for items, so that Offer() either sees a sleeping
+        // worker to wake up or its item is seen here.
+        ++num_sleeping_workers_;
+        while (!shutdown_ && num_queued_.Read() == 0) work_cv_.wait(l);
+        --num_sleeping_workers_;
+        continue;
+      }
+      work_function_(thread_id, *item);
+      if (num_queued_.Read() == 0) {
+        // Take lock to ensure that DrainAndShutdown() cannot be between checking
+        // num_queued_ and wait()'ing when the condition variable is notified.
+        boost::lock_guard<boost::mutex> l(lock_);
+        empty_cv_.notify_all();
+      }
+    }
+    current_pool_ = NULL;
+  }
+
+  /// Returns the next item for worker 'thread_id' to process, or NULL if there is none
+  /// or if another thread won the race for it.
+  T* NextItem(int thread_id) {
+    T* item = deques_[thread_id].Pop();
+    if (item == NULL) {
+      item = queue_.Get();
+      if (item != NULL && num_blocked_offers_.Read() > 0) {
+        boost::lock_guard<boost::mutex> l(lock_);
+        not_full_cv_.notify_all();
+      }
+    }
+    for (int i = 1; item == NULL && i < deques_.size(); ++i) {
+      item = deques_[(thread_id + i) % deques_.size()].Steal();
+    }
+    if (item != NULL) --num_queued_;
+    return item;
+  }
+
+  /// Puts 'item' on the shared queue, blocking while it is full. Returns false if the
+  /// pool was shut down first.
+  bool PutInQueue(T* item) {
+    if (queue_.Put(item)) return true;
+    boost::unique_lock<boost::mutex> l(lock_);
+    // Announced before trying again, so that a worker that takes an item either sees a
+    // blocked offer to wake up or has made room for this one.
+    ++num_blocked_offers_;
+    bool put = queue_.Put(item);
+    while (!put && !shutdown_) {
+      not_full_cv_.wait(l);
+      put = queue_.Put(item);
+    }
+    --num_blocked_offers_;
+    return put;
+  }
+
+  bool IsShutdown() {
+    AtomicUtil::MemoryBarrier();
+    return shutdown_;
+  }
+
+  /// User-supplied method to call to process each work item.
+  WorkFunction work_function_;
+
+  /// Items offered by threads that are not workers of this pool.
+  MpmcQueue<T> queue_;
+
+  /// The deque of each worker thread, indexed by thread id.
+  boost::ptr_vector<WorkStealingDeque<T> > deques_;
+
+  /// Collection of worker threads that process work.
+  ThreadGroup threads_;
+
+  /// Number of offered items that haven't been taken by a worker yet.
+  AtomicInt<int64_t> num_queued_;
+
+  /// Number of workers sleeping on work_cv_ and of Offer() calls waiting on
+  /// not_full_cv_.
+  AtomicInt<int32_t> num_sleeping_workers_;
+  AtomicInt<int32_t> num_blocked_offers_;
+
+  /// Guards shutdown_ and the condition variables. Not taken on the fast paths.
+  boost::mutex lock_;
+
+  /// Set to true when threads should stop doing work and terminate. Written with lock_
+  /// held.
+  volatile bool shutdown_;
+
+  /// Signalled when items are offered while workers are sleeping.
+  boost::condition_variable work_cv_;
+
+  /// Signalled when items are taken from the shared queue while offers are blocked.
+  boost::condition_variable not_full_cv_;
+
+  /// Signalled when no items are left.
+  boost::condition_variable empty_cv_;
+
+  /// The pool and id of the worker that runs on the current thread, if any.
+  static __thread WorkStealingThreadPool<T>* current_pool_;
+  static __thread int current_worker_;
+};
+
+template <typename T>
+const int64_t WorkStealingThreadPool<T>::MAX_QUEUE_CAPACITY;
+template <typename T>
+const int64_t WorkStealingThreadPool<T>::DEQUE_CAPACITY;
+template <typename T>
+__thread WorkStealingThreadPool<T>* WorkStealingThreadPool<T>::current_pool_ = NULL;
+template <typename T>
+__thread int WorkStealingThreadPool<T>::current_worker_ = 0;
+
 }
 
 #endif
@@ -31,7 +31,8 @@ Status TupleRowComparator::Codegen(RuntimeState* state) {
   bool got_codegen = state->GetCodegen(&codegen).ok();
   DCHECK(got_codegen);
   codegend_compare_fn_ = state->obj_pool()->Add(new CompareFn);
-  codegen->AddFunctionToJit(fn, reinterpret_cast<void**>(codegend_compare_fn_));
+  codegen->AddFunctionToJit(fn, reinterpret_cast<void**>(codegend_compare_fn_),
+      /* has_interpreted_fallback */ true);
   return Status::OK();
 }
 
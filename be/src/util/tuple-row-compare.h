@@ -57,6 +57,21 @@ class TupleRowComparator {
         codegend_compare_fn_(NULL) {
   }
 
+  /// Creates a comparator with the same ordering and codegen'd function as 'other' that
+  /// evaluates 'lhs_expr_ctxs' and 'rhs_expr_ctxs', e.g. clones of the exprs of 'other'
+  /// for use by another thread. The vectors must outlive this comparator.
+  TupleRowComparator(const TupleRowComparator& other,
+      const std::vector<ExprContext*>& lhs_expr_ctxs,
+      const std::vector<ExprContext*>& rhs_expr_ctxs)
+      : key_expr_ctxs_lhs_(lhs_expr_ctxs),
+        key_expr_ctxs_rhs_(rhs_expr_ctxs),
+        is_asc_(other.is_asc_),
+        nulls_first_(other.nulls_first_),
+        codegend_compare_fn_(other.codegend_compare_fn_) {
+    DCHECK_EQ(key_expr_ctxs_lhs_.size(), other.key_expr_ctxs_lhs_.size());
+    DCHECK_EQ(key_expr_ctxs_rhs_.size(), other.key_expr_ctxs_rhs_.size());
+  }
+
   /// Codegens a Compare() function for this comparator that is used in the () operator.
   /// Returns Status::OK() iff the codegen was successful.
   Status Codegen(RuntimeState* state);
@@ -89,7 +104,10 @@ class TupleRowComparator {
   /// All exprs (key_exprs_lhs_ and key_exprs_rhs_) must have been prepared and opened
   /// before calling this.
   bool operator() (TupleRow* lhs, TupleRow* rhs) const {
-    int result = codegend_compare_fn_ == NULL ? Compare(lhs, rhs) :
+    // The codegen'd function may not be compiled yet, see
+    // LlvmCodeGen::CanFinalizeAsync().
+    int result = codegend_compare_fn_ == NULL || *codegend_compare_fn_ == NULL ?
+        Compare(lhs, rhs) :
         (*codegend_compare_fn_)(&key_expr_ctxs_lhs_[0], &key_expr_ctxs_rhs_[0], lhs, rhs);
     if (result < 0) return true;
     return false;
@@ -101,6 +119,17 @@ class TupleRowComparator {
     return (*this)(lhs_row, rhs_row);
   }
 
+  const std::vector<ExprContext*>& key_expr_ctxs_lhs() const {
+    return key_expr_ctxs_lhs_;
+  }
+  const std::vector<ExprContext*>& key_expr_ctxs_rhs() const {
+    return key_expr_ctxs_rhs_;
+  }
+  const std::vector<bool>& is_asc() const { return is_asc_; }
+
+  /// Returns true if NULLs come before all other values for the i-th expr.
+  bool nulls_first(int i) const { return nulls_first_[i] < 0; }
+
  private:
   const std::vector<ExprContext*>& key_expr_ctxs_lhs_;
   const std::vector<ExprContext*>& key_expr_ctxs_rhs_;
@@ -181,5 +181,6 @@ def unpack_name_and_version(package):
 if __name__ == "__main__":
   packages = ["avro", "boost", "bzip2", "gcc", "gflags", "glog",
               "gperftools", "gtest", "llvm", ("llvm", "3.3-p1"), ("llvm", "3.7.0"),
-              "lz4", "openldap", "rapidjson", "re2", "snappy", "thrift", "zlib"]
+              "lz4", "openldap", "rapidjson", "re2", "snappy", "thrift", "zlib",
+              "zstd"]
   bootstrap(packages)
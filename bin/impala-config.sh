@@ -163,6 +163,7 @@ export IMPALA_SQUEASEL_VERSION=3.3
 export IMPALA_THRIFT_VERSION=0.9.0
 export IMPALA_THRIFT_JAVA_VERSION=0.9.0
 export IMPALA_ZLIB_VERSION=1.2.8
+export IMPALA_ZSTD_VERSION=1.1.0
 
 # Some of the variables need to be overwritten to explicitely mark the patch level
 if [[ -n "$IMPALA_TOOLCHAIN" ]]; then
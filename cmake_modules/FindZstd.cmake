@@ -0,0 +1,54 @@
+# - Find ZSTD (zstd.h, libzstd.a, libzstd.so, and libzstd.so.1)
+# ZSTD_ROOT hints the location
+#
+# This module defines
+# ZSTD_INCLUDE_DIR, directory containing headers
+# ZSTD_LIBS, directory containing zstd libraries
+# ZSTD_STATIC_LIB, path to libzstd.a
+# zstd - static library
+
+set(ZSTD_SEARCH_LIB_PATH
+  ${ZSTD_ROOT}/lib
+  $ENV{IMPALA_HOME}/thirdparty/zstd
+)
+
+set(ZSTD_SEARCH_INCLUDE_DIR
+  ${ZSTD_ROOT}/include
+  $ENV{IMPALA_HOME}/thirdparty/zstd
+)
+
+find_path(ZSTD_INCLUDE_DIR zstd.h
+  PATHS ${ZSTD_SEARCH_INCLUDE_DIR}
+  NO_DEFAULT_PATH
+  DOC "Path to ZSTD headers"
+  )
+
+find_library(ZSTD_LIBS NAMES zstd
+  PATHS ${ZSTD_SEARCH_LIB_PATH}
+        NO_DEFAULT_PATH
+  DOC "Path to ZSTD library"
+)
+
+find_library(ZSTD_STATIC_LIB NAMES libzstd.a
+  PATHS ${ZSTD_SEARCH_LIB_PATH}
+        NO_DEFAULT_PATH
+  DOC "Path to ZSTD static library"
+)
+
+if (NOT ZSTD_LIBS OR NOT ZSTD_STATIC_LIB)
+  message(FATAL_ERROR "Zstd includes and libraries NOT found. "
+    "Looked for headers in ${ZSTD_SEARCH_INCLUDE_DIR}, "
+    "and for libs in ${ZSTD_SEARCH_LIB_PATH}")
+  set(ZSTD_FOUND FALSE)
+else()
+  set(ZSTD_FOUND TRUE)
+  add_library(zstd STATIC IMPORTED)
+  set_target_properties(zstd PROPERTIES IMPORTED_LOCATION "${ZSTD_STATIC_LIB}")
+endif ()
+
+mark_as_advanced(
+  ZSTD_INCLUDE_DIR
+  ZSTD_LIBS
+  ZSTD_STATIC_LIB
+  zstd
+)
@@ -218,9 +218,13 @@ visible_functions = [
       '_ZN6impala18TimestampFunctions20UnixAndFromUnixCloseEPN10impala_udf15FunctionContextENS2_18FunctionStateScopeE'],
   [['now', 'current_timestamp'], 'TIMESTAMP', [], '_ZN6impala18TimestampFunctions3NowEPN10impala_udf15FunctionContextE'],
   [['from_utc_timestamp'], 'TIMESTAMP', ['TIMESTAMP', 'STRING'],
-   "impala::TimestampFunctions::FromUtc"],
+   "impala::TimestampFunctions::FromUtc",
+   '_ZN6impala18TimestampFunctions20UtcConversionPrepareEPN10impala_udf15FunctionContextENS2_18FunctionStateScopeE',
+   '_ZN6impala18TimestampFunctions18UtcConversionCloseEPN10impala_udf15FunctionContextENS2_18FunctionStateScopeE'],
   [['to_utc_timestamp'], 'TIMESTAMP', ['TIMESTAMP', 'STRING'],
-   "impala::TimestampFunctions::ToUtc"],
+   "impala::TimestampFunctions::ToUtc",
+   '_ZN6impala18TimestampFunctions20UtcConversionPrepareEPN10impala_udf15FunctionContextENS2_18FunctionStateScopeE',
+   '_ZN6impala18TimestampFunctions18UtcConversionCloseEPN10impala_udf15FunctionContextENS2_18FunctionStateScopeE'],
   [['timeofday'], 'STRING', [],"impala::TimestampFunctions::TimeOfDay"],
   [['timestamp_cmp'], 'INT', ['TIMESTAMP', 'TIMESTAMP'],
    "impala::TimestampFunctions::TimestampCmp"],
@@ -62,7 +62,8 @@ enum THdfsCompression {
   SNAPPY,
   SNAPPY_BLOCKED,
   LZO,
-  LZ4
+  LZ4,
+  ZSTD
 }
 
 enum THdfsSeqCompressionMode {
@@ -91,7 +92,8 @@ const map<string, THdfsCompression> COMPRESSION_MAP = {
   "deflate": THdfsCompression.DEFAULT,
   "gzip": THdfsCompression.GZIP,
   "bzip2": THdfsCompression.BZIP2,
-  "snappy": THdfsCompression.SNAPPY
+  "snappy": THdfsCompression.SNAPPY,
+  "zstd": THdfsCompression.ZSTD
 }
 
 // Represents a single item in a partition spec (column name + value)
@@ -277,6 +279,12 @@ struct THdfsTable {
   // Indicates that this table's partitions reside on more than one filesystem.
   // TODO: remove once INSERT across filesystems is supported.
   8: optional bool multiple_filesystems
+
+  // Set only in the catalog topic, for tables whose partitions are published as separate
+  // topic entries rather than in 'partitions', which is then empty. Contains the ids of
+  // all partitions of the table. Impalads reassemble 'partitions' from those entries
+  // before passing the table to the frontend.
+  9: optional list<i64> partition_ids
 }
 
 struct THBaseTable {
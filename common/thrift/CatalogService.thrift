@@ -156,6 +156,11 @@ struct TUpdateCatalogRequest {
   // List of partitions that are new and need to be created. May
   // include the root partition (represented by the empty string).
   5: required set<string> created_partitions;
+
+  // Incremental stats gathered while writing, keyed by the names in
+  // 'created_partitions'. Partitions that are created by this update store them, so
+  // that COMPUTE INCREMENTAL STATS doesn't need to scan them.
+  6: optional map<string, CatalogObjects.TPartitionStats> partition_stats;
 }
 
 // Response from a TUpdateCatalogRequest
@@ -41,6 +41,10 @@ struct TDataStreamSink {
   // If the partitioning type is UNPARTITIONED, the output is broadcast
   // to each destination host.
   2: required Partitions.TDataPartition output_partition
+
+  // True if the batches must arrive in the order they were sent, i.e. if the
+  // destination exchange merges sorted streams.
+  3: optional bool preserve_batch_order
 }
 
 // Creates a new Hdfs files according to the evaluation of the partitionKeyExprs,
@@ -48,6 +52,10 @@ struct TDataStreamSink {
 struct THdfsTableSink {
   1: required list<Exprs.TExpr> partition_key_exprs
   2: required bool overwrite
+
+  // True if the input is sorted by the partition keys, in which case the sink keeps
+  // only the partition of the current rows open.
+  3: optional bool input_is_clustered
 }
 
 // Union type of all table sinks.
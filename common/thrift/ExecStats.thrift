@@ -47,6 +47,18 @@ struct TExecStats {
 
   // Peak memory used (in bytes).
   4: optional i64 memory_used
+
+  // The user and system CPU time that add up to cpu_time_ns.
+  5: optional i64 user_cpu_time_ns
+  6: optional i64 sys_cpu_time_ns
+
+  // The wall clock time the "main" thread was blocked, by reason: waiting for scanner
+  // threads to read and materialize rows, for rows from an exchange, for runtime
+  // filters to arrive, and for spilled data to be read or written.
+  7: optional i64 io_wait_ns
+  8: optional i64 exchange_wait_ns
+  9: optional i64 runtime_filter_wait_ns
+  10: optional i64 spill_wait_ns
 }
 
 // Summary for a single plan node. This includes labels for how to display the
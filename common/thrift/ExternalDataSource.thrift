@@ -48,6 +48,39 @@ struct TRowBatch {
   2: optional i64 num_rows
 }
 
+// A column of a TColumnarRowBatch. There is a value for every row, including the null
+// ones, whose bytes are ignored. Numbers are in little-endian byte order.
+struct TColumnBuffer {
+  // One bit per row that is set if the value is null. The bit of row i is bit (i % 8)
+  // of byte (i / 8). May be unset if none of the values are null.
+  1: optional binary null_bitmap
+
+  // The values of a column that is not a STRING column, back to back. The size of a
+  // value is 1 byte for BOOLEAN (0 or 1) and TINYINT, 2 for SMALLINT, 4 for INT and
+  // FLOAT, 8 for BIGINT and DOUBLE, and 12 for TIMESTAMP, which is encoded as by
+  // SerializationUtils.encodeTimestamp(). A DECIMAL is its unscaled value in two's
+  // complement, taking 4 bytes if its precision is at most 9, 8 if it is at most 18,
+  // and 16 otherwise.
+  2: optional binary fixed_vals
+
+  // The values of a STRING column. string_offsets holds num_rows + 1 int32 offsets
+  // into string_data and the value of row i is
+  // string_data[string_offsets[i], string_offsets[i + 1]).
+  3: optional binary string_offsets
+  4: optional binary string_data
+}
+
+// Columnar alternative to TRowBatch, which Impala copies into its tuples a column at a
+// time rather than value by value.
+struct TColumnarRowBatch {
+  // One TColumnBuffer per column of TOpenParams.row_schema, in the same order. Always
+  // set, empty if no columns are materialized.
+  1: optional list<TColumnBuffer> cols
+
+  // The number of rows returned. Always set.
+  2: optional i64 num_rows
+}
+
 // Comparison operators used in predicates.
 enum TComparisonOp {
   LT, LE, EQ, NE, GE, GT, DISTINCT_FROM, NOT_DISTINCT
@@ -156,6 +189,10 @@ struct TGetNextResult {
   // A batch of rows to return, if any exist. The number of rows in the batch
   // should be less than or equal to the batch_size specified in TOpenParams.
   3: optional TRowBatch rows
+
+  // The same as 'rows' in the faster columnar format. At most one of 'rows' and
+  // 'columnar_rows' may be set.
+  4: optional TColumnarRowBatch columnar_rows
 }
 
 // Parameters to close()
@@ -575,6 +575,7 @@ enum TSymbolType {
   UDF_EVALUATE,
   UDF_PREPARE,
   UDF_CLOSE,
+  UDF_BATCH,
 }
 
 // Parameters to pass to validate that the binary contains the symbol. If the
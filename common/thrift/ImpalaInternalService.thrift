@@ -163,6 +163,28 @@ struct TQueryOptions {
 
   // Maximum number of runtime filters allowed per query
   41: optional i32 max_num_runtime_filters = 10
+
+  // If true, the planner range-partitions the input of an ORDER BY without a limit
+  // across the sort instances when the first ordering expr is a partition column.
+  42: optional bool range_partitioned_sort = 0
+
+  // If true, the backends lay out tuples with as little padding as possible.
+  43: optional bool compact_tuple_layout = false
+
+  // If > 0, codegen is disabled for fragments whose plan nodes all have an estimated
+  // cardinality below this.
+  44: optional i64 disable_codegen_rows_threshold = 0
+
+  // Number of instances per host of fragments that can be split, see
+  // SimpleScheduler::ComputeFragmentHosts().
+  45: optional i32 instances_per_host = 1
+
+  // Columns for which the Parquet writer writes Bloom filters, see
+  // HdfsParquetTableWriter::BaseColumnWriter::bloom_filter_.
+  46: optional string parquet_bloom_filter_columns = ""
+
+  // If true, plan nodes count hardware events, see ExecNode::ScopedHwCounters.
+  47: optional bool enable_hw_perf_counters = false
 }
 
 // Impala currently has two types of sessions: Beeswax and HiveServer2
@@ -346,6 +368,55 @@ struct TExecPlanFragmentResult {
   1: optional Status.TStatus status
 }
 
+// ExecPlanFragments
+
+// One fragment instance of a TExecPlanFragmentsParams. Holds the parts of
+// TExecPlanFragmentParams that differ between the instances.
+struct TExecPlanFragmentInstance {
+  // Index into TExecPlanFragmentsParams.fragments and desc_tbls of the fragment of which
+  // this is an instance
+  1: required i32 fragment_idx
+
+  2: required TPlanFragmentExecParams params
+
+  // The fields of TPlanFragmentInstanceCtx other than the query context
+  3: required Types.TUniqueId fragment_instance_id
+  4: required i32 per_fragment_instance_idx
+  5: required i32 num_fragment_instances
+  6: required i32 fragment_instance_idx
+
+  // Resource reservation to run this plan fragment in.
+  7: optional Llama.TAllocatedResource reserved_resource
+
+  // Address of local node manager (used for expanding resource allocations)
+  8: optional Types.TNetworkAddress local_resource_address
+}
+
+// All fragment instances of a query that the coordinator starts on one backend. The
+// query context, fragments and descriptor tables, which are the same for many instances,
+// are sent once.
+struct TExecPlanFragmentsParams {
+  1: required ImpalaInternalServiceVersion protocol_version
+
+  // required in V1
+  2: optional TQueryCtx query_ctx
+
+  // required in V1
+  // The distinct fragments of the instances with their descriptor tables, see
+  // TExecPlanFragmentParams.
+  3: optional list<Planner.TPlanFragment> fragments
+  4: optional list<Descriptors.TDescriptorTable> desc_tbls
+
+  // required in V1
+  5: optional list<TExecPlanFragmentInstance> instances
+}
+
+struct TExecPlanFragmentsResult {
+  // required in V1
+  // The status of each instance, in the order of TExecPlanFragmentsParams.instances
+  1: optional list<Status.TStatus> statuses
+}
+
 // ReportExecStatus
 struct TParquetInsertStats {
   // For each column, the on disk byte size
@@ -357,6 +428,11 @@ struct TParquetInsertStats {
 struct TInsertStats {
   1: required i64 bytes_written
   2: optional TParquetInsertStats parquet_stats
+
+  // Incremental stats of the written non-partition columns, keyed by column name, in
+  // the form COMPUTE INCREMENTAL STATS stores them. Only set if the table sink gathers
+  // column stats (see --compute_stats_on_insert).
+  3: optional map<string, CatalogObjects.TIntermediateColumnStats> column_stats
 }
 
 const string ROOT_PARTITION_KEY = ''
@@ -472,6 +548,14 @@ struct TTransmitDataParams {
   // if set to true, indicates that no more row batches will be sent
   // for this dest_node_id
   6: optional bool eos
+
+  // Set for broadcasts that the receivers relay in a tree: all destinations of the
+  // broadcast, the index of this rpc's destination in them and the fanout. The
+  // destination relays the rpc to the destinations at indexes
+  // (relay_idx + 1) * relay_fanout to (relay_idx + 2) * relay_fanout - 1.
+  7: optional list<TPlanFragmentDestination> relay_destinations
+  8: optional i32 relay_idx
+  9: optional i32 relay_fanout
 }
 
 struct TTransmitDataResult {
@@ -479,6 +563,25 @@ struct TTransmitDataResult {
   1: optional Status.TStatus status
 }
 
+// TransmitDataBatch
+
+struct TTransmitDataBatchParams {
+  1: required ImpalaInternalServiceVersion protocol_version
+
+  // required in V1; the data of several streams to the same backend. Each element is
+  // handled as by TransmitData(), except that a row batch for a receiver whose buffer is
+  // full is rejected rather than waited for. The eos of a rejected element is ignored.
+  2: optional list<TTransmitDataParams> streams
+}
+
+struct TTransmitDataBatchResult {
+  // required in V1; one per element of TTransmitDataBatchParams.streams
+  1: optional list<Status.TStatus> statuses
+
+  // required in V1; false for the elements that were rejected and must be sent again
+  2: optional list<bool> accepted
+}
+
 // Parameters for RequestPoolService.resolveRequestPool()
 struct TResolveRequestPoolParams {
   // User to resolve to a pool via the allocation placement policy and
@@ -533,6 +636,20 @@ struct TPoolConfig {
   5: required string default_query_options;
 }
 
+// Range of the values of an integer-typed runtime filter. See MinMaxFilter.
+struct TMinMaxFilter {
+  // Smallest and largest value inserted. min > max if no non-NULL value was inserted.
+  1: required i64 min
+  2: required i64 max
+
+  // True if a NULL was inserted.
+  3: required bool has_null
+
+  // All distinct non-NULL values inserted, in ascending order. Only set while there are
+  // few of them.
+  4: optional list<i64> values
+}
+
 struct TBloomFilter {
   // Log_2 of the heap space required for this filter. See BloomFilter::BloomFilter() for
   // details.
@@ -542,6 +659,10 @@ struct TBloomFilter {
   // string for efficiency of (de)serialisation. See BloomFilter::Bucket and
   // BloomFilter::directory_.
   2: binary directory
+
+  // Range of the inserted values, if the filter expr has an integer type and all
+  // producers computed it.
+  3: optional TMinMaxFilter min_max
 }
 
 struct TUpdateFilterResult {
@@ -556,12 +677,21 @@ struct TUpdateFilterParams {
   2: required Types.TUniqueId query_id
 
   3: required TBloomFilter bloom_filter
+
+  // Number of producer fragment instances whose filters were merged into bloom_filter.
+  4: optional i32 num_producers = 1
 }
 
 struct TPublishFilterResult {
 
 }
 
+// The fragment instances on one backend that a runtime filter is published to.
+struct TPublishFilterTarget {
+  1: required Types.TNetworkAddress address
+  2: required list<Types.TUniqueId> dst_instance_ids
+}
+
 struct TPublishFilterParams {
   // Filter ID to update
   1: required i32 filter_id
@@ -571,6 +701,13 @@ struct TPublishFilterParams {
 
   // Actual bloom_filter payload
   3: required TBloomFilter bloom_filter
+
+  // Further fragment instances on the receiving backend that receive this filter
+  4: optional list<Types.TUniqueId> other_dst_instance_ids
+
+  // Backends that the receiver forwards this filter to, so that the coordinator does not
+  // have to send it to every backend itself. See FragmentMgr::PublishFilterToHosts().
+  5: optional list<TPublishFilterTarget> forward_targets
 }
 
 service ImpalaInternalService {
@@ -578,6 +715,10 @@ service ImpalaInternalService {
   // Returns as soon as all incoming data streams have been set up.
   TExecPlanFragmentResult ExecPlanFragment(1:TExecPlanFragmentParams params);
 
+  // Called by coord to start several plan fragment instances of a query in the backend.
+  // Returns as soon as all incoming data streams of the instances have been set up.
+  TExecPlanFragmentsResult ExecPlanFragments(1:TExecPlanFragmentsParams params);
+
   // Periodically called by backend to report status of plan fragment execution
   // back to coord; also called when execution is finished, for whatever reason.
   TReportExecStatusResult ReportExecStatus(1:TReportExecStatusParams params);
@@ -591,6 +732,11 @@ service ImpalaInternalService {
   // if params.fragmentId or params.destNodeId are unknown or if data couldn't be read.
   TTransmitDataResult TransmitData(1:TTransmitDataParams params);
 
+  // Called by senders to transmit row batches of several data streams to this backend
+  // at once. Never waits for a receiver's buffer to drain, so one connection can carry
+  // all streams between two backends.
+  TTransmitDataBatchResult TransmitDataBatch(1:TTransmitDataBatchParams params);
+
   // Called by fragment instances that produce local runtime filters to deliver them to
   // the coordinator for aggregation and broadcast.
   TUpdateFilterResult UpdateFilter(1:TUpdateFilterParams params);
@@ -200,7 +200,36 @@ enum TImpalaQueryOptions {
   DISABLE_ROW_RUNTIME_FILTERING,
 
   // Maximum number of runtime filters allowed per query.
-  MAX_NUM_RUNTIME_FILTERS
+  MAX_NUM_RUNTIME_FILTERS,
+
+  // If true, sorts the input of an ORDER BY without a limit in parallel across the
+  // cluster by range-partitioning it on the first ordering expr, if that is a partition
+  // column of a scanned table.
+  RANGE_PARTITIONED_SORT,
+
+  // If true, the backends lay out tuples with as little padding as possible instead of
+  // using the layout computed by the planner.
+  COMPACT_TUPLE_LAYOUT,
+
+  // If > 0, codegen is disabled for the plan fragments in which the planner estimates
+  // every plan node to produce fewer rows than this. 0 disables the check.
+  DISABLE_CODEGEN_ROWS_THRESHOLD,
+
+  // Number of instances per host of hash-partitioned fragments and of fragments with a
+  // single scan, whose scan ranges are then split across the instances of each host.
+  // Lets joins and aggregations use more than one core per host.
+  INSTANCES_PER_HOST
+
+  // Comma-separated list of the columns for which Parquet inserts write a Bloom filter
+  // into each row group. Scans skip row groups whose filter rules out all values of an
+  // equality or IN predicate on such a column. Only integer and string columns are
+  // supported, others are ignored.
+  PARQUET_BLOOM_FILTER_COLUMNS,
+
+  // If true, each plan node records the CPU cycles, instructions, last level cache misses
+  // and branch misses of its Open() and GetNext() calls in its profile. Needs hardware
+  // performance counters that the impalad is allowed to read.
+  ENABLE_HW_PERF_COUNTERS
 }
 
 // The summary of an insert.
@@ -39,4 +39,14 @@ enum TPartitionType {
 struct TDataPartition {
   1: required TPartitionType type
   2: optional list<Exprs.TExpr> partition_exprs
+
+  // For range partitions: constant exprs that split the value range of the single
+  // partition expr, listed in the order given by range_is_asc_order and
+  // range_nulls_first. Range i holds the values that sort after split point i - 1 and
+  // not after split point i; NULLs belong to the first range if range_nulls_first is
+  // true and to the last one otherwise. Consecutive ranges are assigned to the
+  // destinations in order.
+  3: optional list<Exprs.TExpr> range_split_points
+  4: optional bool range_is_asc_order
+  5: optional bool range_nulls_first
 }
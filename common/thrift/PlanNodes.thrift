@@ -96,6 +96,12 @@ struct TRuntimeFilterDesc {
   // is produced by a broadcast join and the target scan node is in the same fragment
   // as the join.
   7: optional bool has_local_target
+
+  // Set by the coordinator on the source of a partitioned join filter that is sent to
+  // it, if several instances of the join's fragment run on the same backend: their
+  // number. These instances merge their filters, and only the last one sends the result
+  // to the coordinator. See FragmentMgr::MergeLocalFilter().
+  8: optional i32 num_local_producers
 }
 
 // The information contained in subclasses of ScanNode captured in two separate
@@ -242,6 +248,12 @@ struct THashJoinNode {
   // If true, this join node can (but may choose not to) generate slot filters
   // after constructing the build side that can be applied to the probe side.
   4: optional bool add_probe_filters
+
+  // Set if both inputs are sorted on the operands of eq_join_conjuncts, in the order of
+  // eq_join_conjuncts, with the given direction and NULL ordering for each of them. The
+  // backend then joins the inputs by merging them instead of building a hash table.
+  5: optional list<bool> merge_is_asc_order
+  6: optional list<bool> merge_nulls_first
 }
 
 struct TNestedLoopJoinNode {
@@ -274,6 +286,11 @@ struct TAggregationNode {
 
   // Estimate of number of input rows from the planner.
   7: required i64 estimated_input_cardinality
+
+  // Set to true if the input is sorted on the grouping exprs, i.e. the rows of each
+  // group are adjacent. The backend then aggregates one group at a time without a hash
+  // table. Only set for aggregations with grouping exprs.
+  8: optional bool input_is_sorted
 }
 
 struct TSortInfo {
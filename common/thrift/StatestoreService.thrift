@@ -60,6 +60,31 @@ struct TBackendDescriptor {
   4: optional bool secure_webserver;
 }
 
+// Structure serialized for the topic SimpleScheduler::IMPALA_BACKEND_LOAD_TOPIC. Each
+// Impalad periodically publishes its current load, keyed by its backend id, so that
+// coordinators can steer scan ranges away from busy backends. All values are
+// instantaneous.
+struct TBackendLoad {
+  // IP address of the backend, as in its TBackendDescriptor
+  1: required string ip_address;
+
+  // Number of plan fragment instances executing on this backend
+  2: required i64 num_fragments_in_flight;
+
+  // Memory (in bytes) consumed by the process and the process memory limit, or -1 if
+  // there is no limit
+  3: required i64 mem_consumption;
+  4: required i64 mem_limit;
+
+  // Number of request contexts with ranges queued on the disks of the DiskIoMgr
+  5: required i32 io_queue_depth;
+
+  // Number of cores and of local disks of the backend, used to normalize the values
+  // above
+  6: required i32 num_cores;
+  7: required i32 num_disks;
+}
+
 // Description of a single entry in a topic
 struct TTopicItem {
   // Human-readable topic entry identifier
@@ -68,6 +93,11 @@ struct TTopicItem {
   // Byte-string value for this topic entry. May not be null-terminated (in that it may
   // contain null bytes)
   2: required string value;
+
+  // True if 'value' was compressed with snappy by the subscriber that published it. The
+  // statestore stores and forwards it as is, and receiving subscribers decompress it
+  // before passing it to their callbacks.
+  3: optional bool compressed
 }
 
 // Set of changes to a single topic, sent from the statestore to a subscriber as well as
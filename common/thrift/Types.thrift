@@ -168,6 +168,9 @@ struct TScalarFunction {
   1: required string symbol;
   2: optional string prepare_fn_symbol
   3: optional string close_fn_symbol
+
+  // Batch version of 'symbol', see UdfBatchFn in udf/udf.h
+  4: optional string batch_fn_symbol
 }
 
 struct TAggregateFunction {
@@ -226,7 +226,10 @@ error_codes = (
    "Unexpected end of compressed file. File may be truncated. file=$0"),
 
   ("DATASTREAM_SENDER_TIMEOUT", 72, "Sender timed out waiting for receiver fragment "
-   "instance: $0")
+   "instance: $0"),
+
+  ("DATASTREAM_RECVR_CLOSED", 73, "Receiver of fragment instance $0, node $1 was closed "
+   "and needs no more rows")
 )
 
 import sys
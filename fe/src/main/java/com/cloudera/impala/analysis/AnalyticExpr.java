@@ -530,10 +530,10 @@ public class AnalyticExpr extends Expr {
 
     standardize(analyzer);
 
-    // min/max is not currently supported on sliding windows (i.e. start bound is not
-    // unbounded).
-    if (window_ != null && isMinMax(fn) &&
-        window_.getLeftBoundary().getType() != BoundaryType.UNBOUNDED_PRECEDING) {
+    // min/max is not currently supported on sliding RANGE windows (i.e. start bound is
+    // not unbounded). ROWS windows are evaluated with a monotonic deque in the BE.
+    if (window_ != null && isMinMax(fn) && window_.getType() == AnalyticWindow.Type.RANGE
+        && window_.getLeftBoundary().getType() != BoundaryType.UNBOUNDED_PRECEDING) {
       throw new AnalysisException(
           "'" + getFnCall().toSql() + "' is only supported with an "
             + "UNBOUNDED PRECEDING start bound.");
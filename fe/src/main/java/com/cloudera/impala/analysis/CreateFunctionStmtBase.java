@@ -44,6 +44,7 @@ public abstract class CreateFunctionStmtBase extends StatementBase {
     SYMBOL,           // Only used for Udfs
     PREPARE_FN,       // Only used for Udfs
     CLOSE_FN,         // Only used for Udfs
+    BATCH_FN,         // Only used for Udfs
     UPDATE_FN,        // Only used for Udas
     INIT_FN,          // Only used for Udas
     SERIALIZE_FN,     // Only used for Udas
@@ -136,6 +136,7 @@ public class CreateUdaStmt extends CreateFunctionStmtBase {
     checkOptArgNotSet(OptArg.SYMBOL);
     checkOptArgNotSet(OptArg.PREPARE_FN);
     checkOptArgNotSet(OptArg.CLOSE_FN);
+    checkOptArgNotSet(OptArg.BATCH_FN);
 
     // The user must provide the symbol for Update.
     uda.setUpdateFnSymbol(uda.lookupSymbol(
@@ -103,6 +103,19 @@ public class CreateUdfStmt extends CreateFunctionStmtBase {
       udf.setCloseFnSymbol(udf.lookupSymbol(closeFn, TSymbolType.UDF_CLOSE));
     }
 
+    // Set the optional batch function, see UdfBatchFn in udf/udf.h
+    String batchFn = optArgs_.get(OptArg.BATCH_FN);
+    if (batchFn != null) {
+      if (udf.getBinaryType() == TFunctionBinaryType.JAVA) {
+        throw new AnalysisException("BATCH_FN is not supported for Java UDFs.");
+      }
+      if (udf.hasVarArgs()) {
+        throw new AnalysisException(
+            "BATCH_FN is not supported for UDFs with variable arguments.");
+      }
+      udf.setBatchFnSymbol(udf.lookupSymbol(batchFn, TSymbolType.UDF_BATCH));
+    }
+
     // Udfs should not set any of these
     checkOptArgNotSet(OptArg.UPDATE_FN);
     checkOptArgNotSet(OptArg.INIT_FN);
@@ -443,6 +443,16 @@ public class FunctionCallExpr extends Expr {
         throw new AnalysisException("count() is not allowed.");
       }
 
+      // The backend reads the second parameter of these functions once per group, when
+      // it initializes the intermediate state.
+      String fnName = fnName_.getFunction();
+      if ((fnName.equalsIgnoreCase("appx_topk")
+          || fnName.equalsIgnoreCase("appx_quantile"))
+          && children_.size() == 2 && !getChild(1).isConstant()) {
+        throw new AnalysisException("Second parameter of " + fnName.toUpperCase() +
+            "() must be a constant expression: " + this.toSql());
+      }
+
       // TODO: the distinct rewrite does not handle this but why?
       if (params_.isDistinct()) {
         // The second argument in group_concat(distinct) must be a constant expr that
@@ -107,6 +107,10 @@ public class InsertStmt extends StatementBase {
   // should decide whether to re-partition or not).
   private Boolean isRepartition_ = null;
 
+  // True if the input of the table sink is to be sorted by the partition keys, so that
+  // the sink writes one partition at a time. Set in analyze() based on planHints_.
+  private boolean hasClusteredHint_ = false;
+
   // Output expressions that produce the final results to write to the target table. May
   // include casts, and NullLiterals where an output column isn't explicitly mentioned.
   // Set in prepareExpressions(). The i'th expr produces the i'th column of the target
@@ -157,6 +161,7 @@ public class InsertStmt extends StatementBase {
     table_ = null;
     partitionKeyExprs_.clear();
     isRepartition_ = null;
+    hasClusteredHint_ = false;
     resultExprs_.clear();
   }
 
@@ -625,6 +630,9 @@ public class InsertStmt extends StatementBase {
         }
         isRepartition_ = Boolean.FALSE;
         analyzer.setHasPlanHints();
+      } else if (hint.equalsIgnoreCase("CLUSTERED")) {
+        hasClusteredHint_ = true;
+        analyzer.setHasPlanHints();
       } else {
         analyzer.addWarning("INSERT hint not recognized: " + hint);
       }
@@ -644,12 +652,14 @@ public class InsertStmt extends StatementBase {
   public void setQueryStmt(QueryStmt stmt) { queryStmt_ = stmt; }
   public List<Expr> getPartitionKeyExprs() { return partitionKeyExprs_; }
   public Boolean isRepartition() { return isRepartition_; }
+  public boolean hasClusteredHint() { return hasClusteredHint_; }
   public ArrayList<Expr> getResultExprs() { return resultExprs_; }
 
   public DataSink createDataSink() {
     // analyze() must have been called before.
     Preconditions.checkState(table_ != null);
-    return DataSink.createDataSink(table_, partitionKeyExprs_, overwrite_);
+    return DataSink.createDataSink(table_, partitionKeyExprs_, overwrite_,
+        hasClusteredHint_);
   }
 
   /**
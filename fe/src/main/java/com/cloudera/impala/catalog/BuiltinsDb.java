@@ -233,6 +233,126 @@ public class BuiltinsDb extends Db {
              "17HistogramFinalizeIN10impala_udf10DecimalValEEENS2_9StringValEPNS2_15FunctionContextERKS4_")
         .build();
 
+  private static final Map<Type, String> TOPK_INIT_SYMBOL =
+      ImmutableMap.<Type, String>builder()
+        .put(Type.BOOLEAN,
+            "8TopKInitIN10impala_udf10BooleanValEEEvPNS2_15FunctionContextEPNS2_9StringValE")
+        .put(Type.TINYINT,
+            "8TopKInitIN10impala_udf10TinyIntValEEEvPNS2_15FunctionContextEPNS2_9StringValE")
+        .put(Type.SMALLINT,
+            "8TopKInitIN10impala_udf11SmallIntValEEEvPNS2_15FunctionContextEPNS2_9StringValE")
+        .put(Type.INT,
+            "8TopKInitIN10impala_udf6IntValEEEvPNS2_15FunctionContextEPNS2_9StringValE")
+        .put(Type.BIGINT,
+            "8TopKInitIN10impala_udf9BigIntValEEEvPNS2_15FunctionContextEPNS2_9StringValE")
+        .put(Type.FLOAT,
+            "8TopKInitIN10impala_udf8FloatValEEEvPNS2_15FunctionContextEPNS2_9StringValE")
+        .put(Type.DOUBLE,
+            "8TopKInitIN10impala_udf9DoubleValEEEvPNS2_15FunctionContextEPNS2_9StringValE")
+        .put(Type.STRING,
+            "8TopKInitIN10impala_udf9StringValEEEvPNS2_15FunctionContextEPS3_")
+        .put(Type.TIMESTAMP,
+            "8TopKInitIN10impala_udf12TimestampValEEEvPNS2_15FunctionContextEPNS2_9StringValE")
+        .put(Type.DECIMAL,
+            "8TopKInitIN10impala_udf10DecimalValEEEvPNS2_15FunctionContextEPNS2_9StringValE")
+        .build();
+
+  private static final Map<Type, String> TOPK_UPDATE_SYMBOL =
+      ImmutableMap.<Type, String>builder()
+        .put(Type.BOOLEAN,
+            "10TopKUpdateIN10impala_udf10BooleanValEEEvPNS2_15FunctionContextERKT_RKNS2_9BigIntValEPNS2_9StringValE")
+        .put(Type.TINYINT,
+            "10TopKUpdateIN10impala_udf10TinyIntValEEEvPNS2_15FunctionContextERKT_RKNS2_9BigIntValEPNS2_9StringValE")
+        .put(Type.SMALLINT,
+            "10TopKUpdateIN10impala_udf11SmallIntValEEEvPNS2_15FunctionContextERKT_RKNS2_9BigIntValEPNS2_9StringValE")
+        .put(Type.INT,
+            "10TopKUpdateIN10impala_udf6IntValEEEvPNS2_15FunctionContextERKT_RKNS2_9BigIntValEPNS2_9StringValE")
+        .put(Type.BIGINT,
+            "10TopKUpdateIN10impala_udf9BigIntValEEEvPNS2_15FunctionContextERKT_RKS3_PNS2_9StringValE")
+        .put(Type.FLOAT,
+            "10TopKUpdateIN10impala_udf8FloatValEEEvPNS2_15FunctionContextERKT_RKNS2_9BigIntValEPNS2_9StringValE")
+        .put(Type.DOUBLE,
+            "10TopKUpdateIN10impala_udf9DoubleValEEEvPNS2_15FunctionContextERKT_RKNS2_9BigIntValEPNS2_9StringValE")
+        .put(Type.STRING,
+            "10TopKUpdateIN10impala_udf9StringValEEEvPNS2_15FunctionContextERKT_RKNS2_9BigIntValEPS3_")
+        .put(Type.TIMESTAMP,
+            "10TopKUpdateIN10impala_udf12TimestampValEEEvPNS2_15FunctionContextERKT_RKNS2_9BigIntValEPNS2_9StringValE")
+        .put(Type.DECIMAL,
+            "10TopKUpdateIN10impala_udf10DecimalValEEEvPNS2_15FunctionContextERKT_RKNS2_9BigIntValEPNS2_9StringValE")
+        .build();
+
+  private static final Map<Type, String> TOPK_MERGE_SYMBOL =
+      ImmutableMap.<Type, String>builder()
+        .put(Type.BOOLEAN,
+            "9TopKMergeIN10impala_udf10BooleanValEEEvPNS2_15FunctionContextERKNS2_9StringValEPS6_")
+        .put(Type.TINYINT,
+            "9TopKMergeIN10impala_udf10TinyIntValEEEvPNS2_15FunctionContextERKNS2_9StringValEPS6_")
+        .put(Type.SMALLINT,
+            "9TopKMergeIN10impala_udf11SmallIntValEEEvPNS2_15FunctionContextERKNS2_9StringValEPS6_")
+        .put(Type.INT,
+            "9TopKMergeIN10impala_udf6IntValEEEvPNS2_15FunctionContextERKNS2_9StringValEPS6_")
+        .put(Type.BIGINT,
+            "9TopKMergeIN10impala_udf9BigIntValEEEvPNS2_15FunctionContextERKNS2_9StringValEPS6_")
+        .put(Type.FLOAT,
+            "9TopKMergeIN10impala_udf8FloatValEEEvPNS2_15FunctionContextERKNS2_9StringValEPS6_")
+        .put(Type.DOUBLE,
+            "9TopKMergeIN10impala_udf9DoubleValEEEvPNS2_15FunctionContextERKNS2_9StringValEPS6_")
+        .put(Type.STRING,
+            "9TopKMergeIN10impala_udf9StringValEEEvPNS2_15FunctionContextERKS3_PS3_")
+        .put(Type.TIMESTAMP,
+            "9TopKMergeIN10impala_udf12TimestampValEEEvPNS2_15FunctionContextERKNS2_9StringValEPS6_")
+        .put(Type.DECIMAL,
+            "9TopKMergeIN10impala_udf10DecimalValEEEvPNS2_15FunctionContextERKNS2_9StringValEPS6_")
+        .build();
+
+  private static final Map<Type, String> TOPK_SERIALIZE_SYMBOL =
+      ImmutableMap.<Type, String>builder()
+        .put(Type.BOOLEAN,
+            "13TopKSerializeIN10impala_udf10BooleanValEEENS2_9StringValEPNS2_15FunctionContextERKS4_")
+        .put(Type.TINYINT,
+            "13TopKSerializeIN10impala_udf10TinyIntValEEENS2_9StringValEPNS2_15FunctionContextERKS4_")
+        .put(Type.SMALLINT,
+            "13TopKSerializeIN10impala_udf11SmallIntValEEENS2_9StringValEPNS2_15FunctionContextERKS4_")
+        .put(Type.INT,
+            "13TopKSerializeIN10impala_udf6IntValEEENS2_9StringValEPNS2_15FunctionContextERKS4_")
+        .put(Type.BIGINT,
+            "13TopKSerializeIN10impala_udf9BigIntValEEENS2_9StringValEPNS2_15FunctionContextERKS4_")
+        .put(Type.FLOAT,
+            "13TopKSerializeIN10impala_udf8FloatValEEENS2_9StringValEPNS2_15FunctionContextERKS4_")
+        .put(Type.DOUBLE,
+            "13TopKSerializeIN10impala_udf9DoubleValEEENS2_9StringValEPNS2_15FunctionContextERKS4_")
+        .put(Type.STRING,
+            "13TopKSerializeIN10impala_udf9StringValEEES3_PNS2_15FunctionContextERKS3_")
+        .put(Type.TIMESTAMP,
+            "13TopKSerializeIN10impala_udf12TimestampValEEENS2_9StringValEPNS2_15FunctionContextERKS4_")
+        .put(Type.DECIMAL,
+            "13TopKSerializeIN10impala_udf10DecimalValEEENS2_9StringValEPNS2_15FunctionContextERKS4_")
+        .build();
+
+  private static final Map<Type, String> TOPK_FINALIZE_SYMBOL =
+      ImmutableMap.<Type, String>builder()
+        .put(Type.BOOLEAN,
+            "12TopKFinalizeIN10impala_udf10BooleanValEEENS2_9StringValEPNS2_15FunctionContextERKS4_")
+        .put(Type.TINYINT,
+            "12TopKFinalizeIN10impala_udf10TinyIntValEEENS2_9StringValEPNS2_15FunctionContextERKS4_")
+        .put(Type.SMALLINT,
+            "12TopKFinalizeIN10impala_udf11SmallIntValEEENS2_9StringValEPNS2_15FunctionContextERKS4_")
+        .put(Type.INT,
+            "12TopKFinalizeIN10impala_udf6IntValEEENS2_9StringValEPNS2_15FunctionContextERKS4_")
+        .put(Type.BIGINT,
+            "12TopKFinalizeIN10impala_udf9BigIntValEEENS2_9StringValEPNS2_15FunctionContextERKS4_")
+        .put(Type.FLOAT,
+            "12TopKFinalizeIN10impala_udf8FloatValEEENS2_9StringValEPNS2_15FunctionContextERKS4_")
+        .put(Type.DOUBLE,
+            "12TopKFinalizeIN10impala_udf9DoubleValEEENS2_9StringValEPNS2_15FunctionContextERKS4_")
+        .put(Type.STRING,
+            "12TopKFinalizeIN10impala_udf9StringValEEES3_PNS2_15FunctionContextERKS3_")
+        .put(Type.TIMESTAMP,
+            "12TopKFinalizeIN10impala_udf12TimestampValEEENS2_9StringValEPNS2_15FunctionContextERKS4_")
+        .put(Type.DECIMAL,
+            "12TopKFinalizeIN10impala_udf10DecimalValEEENS2_9StringValEPNS2_15FunctionContextERKS4_")
+        .build();
+
   private static final Map<Type, String> HLL_UPDATE_SYMBOL =
       ImmutableMap.<Type, String>builder()
         .put(Type.BOOLEAN,
@@ -600,6 +720,16 @@ public class BuiltinsDb extends Db {
           prefix + HISTOGRAM_FINALIZE_SYMBOL.get(t),
           false, false, true));
 
+      // Approximate top-k
+      db.addBuiltin(AggregateFunction.createBuiltin(db, "appx_topk",
+          Lists.<Type>newArrayList(t, Type.BIGINT), Type.STRING, Type.STRING,
+          prefix + TOPK_INIT_SYMBOL.get(t),
+          prefix + TOPK_UPDATE_SYMBOL.get(t),
+          prefix + TOPK_MERGE_SYMBOL.get(t),
+          prefix + TOPK_SERIALIZE_SYMBOL.get(t),
+          prefix + TOPK_FINALIZE_SYMBOL.get(t),
+          false, false, true));
+
       // NDV
       // TODO: this needs to switch to CHAR(64) as the intermediate type
       db.addBuiltin(AggregateFunction.createBuiltin(db, "ndv",
@@ -801,6 +931,20 @@ public class BuiltinsDb extends Db {
             "20StringConcatFinalizeEPN10impala_udf15FunctionContextERKNS1_9StringValE",
         false, false, false));
 
+    // Approximate quantile
+    db.addBuiltin(AggregateFunction.createBuiltin(db, "appx_quantile",
+        Lists.<Type>newArrayList(Type.DOUBLE, Type.DOUBLE), Type.DOUBLE, Type.STRING,
+        prefix + "11TDigestInitEPN10impala_udf15FunctionContextEPNS1_9StringValE",
+        prefix +
+            "13TDigestUpdateEPN10impala_udf15FunctionContextERKNS1_9DoubleValES6_PNS1_9StringValE",
+        prefix +
+            "12TDigestMergeEPN10impala_udf15FunctionContextERKNS1_9StringValEPS4_",
+        prefix +
+            "16TDigestSerializeEPN10impala_udf15FunctionContextERKNS1_9StringValE",
+        prefix +
+            "15TDigestFinalizeEPN10impala_udf15FunctionContextERKNS1_9StringValE",
+        false, false, true));
+
     // analytic functions
     // Rank
     db.addBuiltin(AggregateFunction.createAnalyticBuiltin(db, "rank",
@@ -354,6 +354,9 @@ public class Function implements CatalogObject {
           Type.fromThrift(fn.getRet_type()), new HdfsUri(fn.getHdfs_location()),
           scalarFn.getSymbol(), scalarFn.getPrepare_fn_symbol(),
           scalarFn.getClose_fn_symbol());
+      if (scalarFn.isSetBatch_fn_symbol()) {
+        ((ScalarFunction) function).setBatchFnSymbol(scalarFn.getBatch_fn_symbol());
+      }
     } else if (fn.isSetAggregate_fn()) {
       TAggregateFunction aggFn = fn.getAggregate_fn();
       function = new AggregateFunction(FunctionName.fromThrift(fn.getName()), argTypes,
@@ -430,8 +433,8 @@ public class Function implements CatalogObject {
 
   public String lookupSymbol(String symbol, TSymbolType symbolType)
       throws AnalysisException {
-    Preconditions.checkState(
-        symbolType == TSymbolType.UDF_PREPARE || symbolType == TSymbolType.UDF_CLOSE);
+    Preconditions.checkState(symbolType == TSymbolType.UDF_PREPARE ||
+        symbolType == TSymbolType.UDF_CLOSE || symbolType == TSymbolType.UDF_BATCH);
     return lookupSymbol(symbol, symbolType, null, false);
   }
 
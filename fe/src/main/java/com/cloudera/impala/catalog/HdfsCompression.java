@@ -20,7 +20,8 @@ public enum HdfsCompression {
   BZIP2,
   SNAPPY,
   LZO,
-  LZO_INDEX; //Lzo index file.
+  LZO_INDEX, //Lzo index file.
+  ZSTD;
 
   /* Map from a suffix to a compression type */
   private static final ImmutableMap<String, HdfsCompression> SUFFIX_MAP =
@@ -31,6 +32,7 @@ public enum HdfsCompression {
           put("snappy", SNAPPY).
           put("lzo", LZO).
           put("index", LZO_INDEX).
+          put("zst", ZSTD).
           build();
 
   /* Given a file name return its compression type, if any. */
@@ -53,6 +55,7 @@ public enum HdfsCompression {
     case BZIP2: return THdfsCompression.BZIP2;
     case SNAPPY: return THdfsCompression.SNAPPY_BLOCKED;
     case LZO: return THdfsCompression.LZO;
+    case ZSTD: return THdfsCompression.ZSTD;
     default: throw new IllegalStateException("Unexpected codec: " + this);
     }
   }
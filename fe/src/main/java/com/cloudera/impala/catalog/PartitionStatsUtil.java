@@ -87,6 +87,15 @@ public class PartitionStatsUtil {
       return;
     }
 
+    partStatsToParameters(partStats, partition.getParameters());
+  }
+
+  /**
+   * Serialises a non-null TPartitionStats object to the given HMS parameter map.
+   */
+  public static void partStatsToParameters(TPartitionStats partStats,
+      Map<String, String> hmsParameters) {
+    Preconditions.checkNotNull(partStats);
     // The HMS has a 4k (as of CDH5.2) limit on the length of any parameter string. The
     // serialised version of the partition stats is often larger than this. Therefore, we
     // naively 'chunk' the byte string into 4k pieces, and store the number of pieces in a
@@ -103,10 +112,9 @@ public class PartitionStatsUtil {
       String base64 = new String(Base64.encodeBase64(serialized));
       List<String> chunks =
           chunkStringForHms(base64, MetaStoreUtil.MAX_PROPERTY_VALUE_LENGTH);
-      partition.putToParameters(
-          INCREMENTAL_STATS_NUM_CHUNKS, Integer.toString(chunks.size()));
+      hmsParameters.put(INCREMENTAL_STATS_NUM_CHUNKS, Integer.toString(chunks.size()));
       for (int i = 0; i < chunks.size(); ++i) {
-        partition.putToParameters(INCREMENTAL_STATS_CHUNK_PREFIX + i, chunks.get(i));
+        hmsParameters.put(INCREMENTAL_STATS_CHUNK_PREFIX + i, chunks.get(i));
       }
     } catch (TException e) {
       LOG.info("Error saving partition stats: ", e);
@@ -42,6 +42,8 @@ public class ScalarFunction extends Function {
   private String symbolName_;
   private String prepareFnSymbol_;
   private String closeFnSymbol_;
+  // Optional batch version of the function, see UdfBatchFn in udf/udf.h.
+  private String batchFnSymbol_;
 
   public ScalarFunction(FunctionName fnName, ArrayList<Type> argTypes, Type retType,
       boolean hasVarArgs) {
@@ -264,10 +266,12 @@ public class ScalarFunction extends Function {
   public void setSymbolName(String s) { symbolName_ = s; }
   public void setPrepareFnSymbol(String s) { prepareFnSymbol_ = s; }
   public void setCloseFnSymbol(String s) { closeFnSymbol_ = s; }
+  public void setBatchFnSymbol(String s) { batchFnSymbol_ = s; }
 
   public String getSymbolName() { return symbolName_; }
   public String getPrepareFnSymbol() { return prepareFnSymbol_; }
   public String getCloseFnSymbol() { return closeFnSymbol_; }
+  public String getBatchFnSymbol() { return batchFnSymbol_; }
 
   @Override
   public String toSql(boolean ifNotExists) {
@@ -277,6 +281,7 @@ public class ScalarFunction extends Function {
       .append(" RETURNS " + getReturnType() + "\n")
       .append(" LOCATION '" + getLocation() + "'\n")
       .append(" SYMBOL='" + getSymbolName() + "'\n");
+    if (batchFnSymbol_ != null) sb.append(" BATCH_FN='" + batchFnSymbol_ + "'\n");
     return sb.toString();
   }
 
@@ -287,6 +292,7 @@ public class ScalarFunction extends Function {
     fn.getScalar_fn().setSymbol(symbolName_);
     if (prepareFnSymbol_ != null) fn.getScalar_fn().setPrepare_fn_symbol(prepareFnSymbol_);
     if (closeFnSymbol_ != null) fn.getScalar_fn().setClose_fn_symbol(closeFnSymbol_);
+    if (batchFnSymbol_ != null) fn.getScalar_fn().setBatch_fn_symbol(batchFnSymbol_);
     return fn;
   }
 }
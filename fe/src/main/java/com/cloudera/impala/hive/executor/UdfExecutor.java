@@ -94,6 +94,15 @@ public class UdfExecutor {
   // Size of outBufferStringPtr_.
   private int outBufferCapacity_;
 
+  // Slot sizes of the arguments and of the return type, used by evaluateBatch().
+  private int[] argSlotSizes_;
+  private int retSlotSize_;
+
+  // Native buffer for the string results of evaluateBatch(). The StringValues in the
+  // batch output point into it until the next call. It grows as necessary.
+  private long batchStringDataPtr_;
+  private long batchStringDataCapacity_;
+
   // Preconstructed input objects for the UDF. This minimizes object creation overhead
   // as these objects are reused across calls to evaluate().
   private Object[] inputObjects_;
@@ -215,6 +224,7 @@ public class UdfExecutor {
     for (int i = 0; i < request.input_byte_offsets.size(); ++i) {
       inputBufferOffsets_[i] = request.input_byte_offsets.get(i).intValue();
     }
+    setSlotSizes(retType, parameterTypes);
 
     init(jarFile, className, retType, parameterTypes);
   }
@@ -249,6 +259,7 @@ public class UdfExecutor {
     allocations_.add(outputNullPtr_);
     outBufferStringPtr_ = 0;
     outBufferCapacity_ = 0;
+    setSlotSizes(retType, parameterTypes);
 
     init(jarFile, udfPath, retType, parameterTypes);
   }
@@ -267,6 +278,9 @@ public class UdfExecutor {
     UnsafeUtil.UNSAFE.freeMemory(outBufferStringPtr_);
     outBufferStringPtr_ = 0;
     outBufferCapacity_ = 0;
+    UnsafeUtil.UNSAFE.freeMemory(batchStringDataPtr_);
+    batchStringDataPtr_ = 0;
+    batchStringDataCapacity_ = 0;
 
     for (long ptr: allocations_) {
       UnsafeUtil.UNSAFE.freeMemory(ptr);
@@ -333,6 +347,78 @@ public class UdfExecutor {
     }
   }
 
+  /**
+   * Batched version of evaluate() called by the backend, which evaluates the UDF for
+   * 'numRows' rows with a single JNI call. The arguments are read from the columnar
+   * buffers 'inputNullsPtr' and 'inputValuesPtr' and the results are written to
+   * 'outputNullsPtr' and 'outputValuesPtr'. See HiveUdfCall::EvalBatch() for the layout.
+   * If the UDF fails for some rows, their results are NULL, the other rows are still
+   * evaluated and the first failure is thrown at the end.
+   */
+  public void evaluateBatch(int numRows, long inputNullsPtr, long inputValuesPtr,
+      long outputNullsPtr, long outputValuesPtr) throws ImpalaRuntimeException {
+    long[] inputColumnPtrs = new long[argTypes_.length];
+    long columnPtr = inputValuesPtr;
+    for (int i = 0; i < argTypes_.length; ++i) {
+      inputColumnPtrs[i] = columnPtr;
+      // Each column starts at a multiple of 8 bytes.
+      columnPtr += ((long)numRows * argSlotSizes_[i] + 7) / 8 * 8;
+    }
+    boolean isStringResult = isStringType(retType_);
+    long stringDataLen = 0;
+    ImpalaRuntimeException firstException = null;
+    for (int row = 0; row < numRows; ++row) {
+      for (int i = 0; i < argTypes_.length; ++i) {
+        byte isNull = UnsafeUtil.UNSAFE.getByte(inputNullsPtr + (long)i * numRows + row);
+        UnsafeUtil.UNSAFE.putByte(inputNullsPtr_ + i, isNull);
+        if (isNull != 0) continue;
+        UnsafeUtil.UNSAFE.copyMemory(
+            inputColumnPtrs[i] + (long)row * argSlotSizes_[i],
+            inputBufferPtr_ + inputBufferOffsets_[i], argSlotSizes_[i]);
+      }
+      try {
+        evaluate();
+      } catch (ImpalaRuntimeException e) {
+        if (firstException == null) firstException = e;
+        UnsafeUtil.UNSAFE.putByte(outputNullsPtr + row, (byte)1);
+        continue;
+      }
+      byte isNull = UnsafeUtil.UNSAFE.getByte(outputNullPtr_);
+      UnsafeUtil.UNSAFE.putByte(outputNullsPtr + row, isNull);
+      if (isNull != 0) continue;
+      long outputPtr = outputValuesPtr + (long)row * retSlotSize_;
+      if (!isStringResult) {
+        UnsafeUtil.UNSAFE.copyMemory(outputBufferPtr_, outputPtr, retSlotSize_);
+        continue;
+      }
+      // The string data can move while the buffer grows, so the offset is stored for
+      // now and replaced by the pointer below.
+      int len = UnsafeUtil.UNSAFE.getInt(
+          outputBufferPtr_ + ImpalaStringWritable.STRING_VALUE_LEN_OFFSET);
+      if (stringDataLen + len > batchStringDataCapacity_) {
+        batchStringDataCapacity_ = Math.max(2 * batchStringDataCapacity_,
+            stringDataLen + len);
+        batchStringDataPtr_ = UnsafeUtil.UNSAFE.reallocateMemory(
+            batchStringDataPtr_, batchStringDataCapacity_);
+      }
+      UnsafeUtil.UNSAFE.copyMemory(UnsafeUtil.UNSAFE.getLong(outputBufferPtr_),
+          batchStringDataPtr_ + stringDataLen, len);
+      UnsafeUtil.UNSAFE.putLong(outputPtr, stringDataLen);
+      UnsafeUtil.UNSAFE.putInt(
+          outputPtr + ImpalaStringWritable.STRING_VALUE_LEN_OFFSET, len);
+      stringDataLen += len;
+    }
+    if (isStringResult) {
+      for (int row = 0; row < numRows; ++row) {
+        if (UnsafeUtil.UNSAFE.getByte(outputNullsPtr + row) != 0) continue;
+        long outputPtr = outputValuesPtr + (long)row * retSlotSize_;
+        UnsafeUtil.UNSAFE.putLong(outputPtr,
+            batchStringDataPtr_ + UnsafeUtil.UNSAFE.getLong(outputPtr));
+      }
+    }
+    if (firstException != null) throw firstException;
+  }
+
   /**
    * Evalutes the UDF with 'args' as the input to the UDF. This is exposed
    * for testing and not the version of evaluate() the backend uses.
@@ -573,6 +659,20 @@ public class UdfExecutor {
     }
   }
 
+  private void setSlotSizes(Type retType, Type[] parameterTypes) {
+    argSlotSizes_ = new int[parameterTypes.length];
+    for (int i = 0; i < parameterTypes.length; ++i) {
+      argSlotSizes_[i] = parameterTypes[i].getSlotSize();
+    }
+    retSlotSize_ = retType.getSlotSize();
+    batchStringDataPtr_ = 0;
+    batchStringDataCapacity_ = 0;
+  }
+
+  private static boolean isStringType(JavaUdfDataType type) {
+    return type.getPrimitiveType() == TPrimitiveType.STRING;
+  }
+
   /**
    * Sets the return type of a Java UDF. Returns true if the return type is compatible
    * with the return type from the function definition. Throws an ImpalaRuntimeException
@@ -26,6 +26,7 @@ import com.cloudera.impala.analysis.Analyzer;
 import com.cloudera.impala.analysis.Expr;
 import com.cloudera.impala.analysis.FunctionCallExpr;
 import com.cloudera.impala.analysis.SlotId;
+import com.cloudera.impala.analysis.SortInfo;
 import com.cloudera.impala.common.InternalException;
 import com.cloudera.impala.thrift.TAggregationNode;
 import com.cloudera.impala.thrift.TExplainLevel;
@@ -226,6 +227,36 @@ public class AggregationNode extends PlanNode {
     if (groupingExprs != null) {
       msg.agg_node.setGrouping_exprs(Expr.treesToThrift(groupingExprs));
     }
+    msg.agg_node.setInput_is_sorted(isInputSortedOnGroupingExprs());
+  }
+
+  /**
+   * Returns true if the input is a sort or a merging exchange whose leading ordering
+   * exprs are the grouping exprs, in any order. The rows of each group are then
+   * adjacent in the input. Only checked when the plan is final, because the distributed
+   * planner may change the input of this node.
+   */
+  private boolean isInputSortedOnGroupingExprs() {
+    List<Expr> groupingExprs = aggInfo_.getGroupingExprs();
+    if (groupingExprs == null || groupingExprs.isEmpty()) return false;
+    SortInfo sortInfo = null;
+    PlanNode input = getChild(0);
+    if (input instanceof SortNode) {
+      sortInfo = ((SortNode) input).getSortInfo();
+    } else if (input instanceof ExchangeNode) {
+      sortInfo = ((ExchangeNode) input).getMergeInfo();
+    }
+    if (sortInfo == null) return false;
+    List<Expr> orderingExprs = sortInfo.getOrderingExprs();
+    if (orderingExprs.size() < groupingExprs.size()) return false;
+    List<Expr> leadingExprs = orderingExprs.subList(0, groupingExprs.size());
+    for (Expr e: groupingExprs) {
+      if (!leadingExprs.contains(e)) return false;
+    }
+    for (Expr e: leadingExprs) {
+      if (!groupingExprs.contains(e)) return false;
+    }
+    return true;
   }
 
   @Override
@@ -22,6 +22,7 @@ import org.slf4j.LoggerFactory;
 import com.cloudera.impala.analysis.Analyzer;
 import com.cloudera.impala.analysis.Expr;
 import com.cloudera.impala.analysis.ExprSubstitutionMap;
+import com.cloudera.impala.analysis.LiteralExpr;
 import com.cloudera.impala.thrift.TDataPartition;
 import com.cloudera.impala.thrift.TPartitionType;
 import com.google.common.base.Joiner;
@@ -44,6 +45,12 @@ public class DataPartition {
   // for hash partition: exprs used to compute hash value
   private List<Expr> partitionExprs_;
 
+  // for range partition: literals that split the value range of the single partition
+  // expr, listed in the order given by rangeIsAscOrder_ and rangeNullsFirst_
+  private List<LiteralExpr> rangeSplitPoints_;
+  private boolean rangeIsAscOrder_;
+  private boolean rangeNullsFirst_;
+
   public DataPartition(TPartitionType type, List<Expr> exprs) {
     Preconditions.checkNotNull(exprs);
     Preconditions.checkState(!exprs.isEmpty());
@@ -60,6 +67,22 @@ public class DataPartition {
     partitionExprs_ = Lists.newArrayList();
   }
 
+  /**
+   * Returns a range partition on 'expr'. Range i holds the values that sort after
+   * split point i - 1 and not after split point i in the given order. NULLs belong to
+   * the first range if 'nullsFirst' is true and to the last one otherwise.
+   */
+  public static DataPartition createRangePartition(Expr expr,
+      List<LiteralExpr> splitPoints, boolean isAscOrder, boolean nullsFirst) {
+    Preconditions.checkState(!splitPoints.isEmpty());
+    DataPartition result =
+        new DataPartition(TPartitionType.RANGE_PARTITIONED, Lists.newArrayList(expr));
+    result.rangeSplitPoints_ = splitPoints;
+    result.rangeIsAscOrder_ = isAscOrder;
+    result.rangeNullsFirst_ = nullsFirst;
+    return result;
+  }
+
   public final static DataPartition UNPARTITIONED =
       new DataPartition(TPartitionType.UNPARTITIONED);
 
@@ -80,6 +103,11 @@ public class DataPartition {
     if (partitionExprs_ != null) {
       result.setPartition_exprs(Expr.treesToThrift(partitionExprs_));
     }
+    if (rangeSplitPoints_ != null) {
+      result.setRange_split_points(Expr.treesToThrift(rangeSplitPoints_));
+      result.setRange_is_asc_order(rangeIsAscOrder_);
+      result.setRange_nulls_first(rangeNullsFirst_);
+    }
     return result;
   }
 
@@ -89,6 +117,12 @@ public class DataPartition {
     if (obj.getClass() != this.getClass()) return false;
     DataPartition other = (DataPartition) obj;
     if (type_ != other.type_) return false;
+    if (rangeSplitPoints_ != null || other.rangeSplitPoints_ != null) {
+      if (rangeSplitPoints_ == null || other.rangeSplitPoints_ == null) return false;
+      if (rangeIsAscOrder_ != other.rangeIsAscOrder_) return false;
+      if (rangeNullsFirst_ != other.rangeNullsFirst_) return false;
+      if (!Expr.equalLists(rangeSplitPoints_, other.rangeSplitPoints_)) return false;
+    }
     return Expr.equalLists(partitionExprs_, other.partitionExprs_);
   }
 
@@ -57,9 +57,9 @@ public abstract class DataSink {
    * Returns an output sink appropriate for writing to the given table.
    */
   public static DataSink createDataSink(Table table, List<Expr> partitionKeyExprs,
-      boolean overwrite) {
+      boolean overwrite, boolean inputIsClustered) {
     if (table instanceof HdfsTable) {
-      return new HdfsTableSink(table, partitionKeyExprs, overwrite);
+      return new HdfsTableSink(table, partitionKeyExprs, overwrite, inputIsClustered);
     } else if (table instanceof HBaseTable) {
       // Partition clause doesn't make sense for an HBase table.
       Preconditions.checkState(partitionKeyExprs.isEmpty());
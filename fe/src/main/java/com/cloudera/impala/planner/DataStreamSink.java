@@ -50,6 +50,7 @@ public class DataStreamSink extends DataSink {
     TDataSink result = new TDataSink(TDataSinkType.DATA_STREAM_SINK);
     TDataStreamSink tStreamSink =
         new TDataStreamSink(exchNode_.getId().asInt(), outputPartition_.toThrift());
+    tStreamSink.setPreserve_batch_order(exchNode_.getMergeInfo() != null);
     result.setStream_sink(tStreamSink);
     return result;
   }
@@ -16,6 +16,9 @@ package com.cloudera.impala.planner;
 
 import java.util.ArrayList;
 import java.util.List;
+import java.util.Map;
+import java.util.NavigableMap;
+import java.util.TreeMap;
 
 import org.slf4j.Logger;
 import org.slf4j.LoggerFactory;
@@ -26,7 +29,15 @@ import com.cloudera.impala.analysis.Analyzer;
 import com.cloudera.impala.analysis.Expr;
 import com.cloudera.impala.analysis.InsertStmt;
 import com.cloudera.impala.analysis.JoinOperator;
+import com.cloudera.impala.analysis.LiteralExpr;
+import com.cloudera.impala.analysis.NullLiteral;
 import com.cloudera.impala.analysis.QueryStmt;
+import com.cloudera.impala.analysis.SlotDescriptor;
+import com.cloudera.impala.analysis.SlotRef;
+import com.cloudera.impala.analysis.SortInfo;
+import com.cloudera.impala.catalog.Column;
+import com.cloudera.impala.catalog.HdfsPartition;
+import com.cloudera.impala.catalog.HdfsTable;
 import com.cloudera.impala.common.ImpalaException;
 import com.cloudera.impala.common.InternalException;
 import com.cloudera.impala.common.TreeNode;
@@ -44,6 +55,10 @@ import com.google.common.collect.Lists;
 public class DistributedPlanner {
   private final static Logger LOG = LoggerFactory.getLogger(DistributedPlanner.class);
 
+  // Number of ranges per sort instance that the input of a range-partitioned sort is
+  // split into. More ranges than instances even out the ranges' differing sizes.
+  private final static int RANGES_PER_SORT_INSTANCE = 4;
+
   private final PlannerContext ctx_;
 
   public DistributedPlanner(PlannerContext ctx) {
@@ -906,10 +921,22 @@ public class DistributedPlanner {
    * sort-merging exchange that merges the results of the partitioned sorts.
    * The offset and limit are adjusted in the child and parent plan nodes to produce
    * the correct result.
+   * If the range_partitioned_sort query option is set, the input of a sort without
+   * a TopN may first be range-partitioned on its first ordering expr, see
+   * getSortRangePartition(). Each partitioned sort then sorts a disjoint range of the
+   * keys and the merging exchange only interleaves their output at range boundaries.
    */
   private PlanFragment createOrderByFragment(SortNode node,
       PlanFragment childFragment, ArrayList<PlanFragment> fragments)
       throws ImpalaException {
+    if (childFragment.isPartitioned() && !node.useTopN()
+        && ctx_.getQueryOptions().isRange_partitioned_sort()) {
+      DataPartition rangePartition = getSortRangePartition(node, childFragment);
+      if (rangePartition != null) {
+        childFragment = createParentFragment(childFragment, rangePartition);
+        fragments.add(childFragment);
+      }
+    }
     node.setChild(0, childFragment.getPlanRoot());
     childFragment.addPlanRoot(node);
     if (!childFragment.isPartitioned()) return childFragment;
@@ -943,4 +970,72 @@ public class DistributedPlanner {
 
     return mergeFragment;
   }
+
+  /**
+   * Returns a range partition for the input of 'node', produced by 'childFragment',
+   * on its first ordering expr, or null if no good split points are known. The split
+   * points are only known if the ordering expr is a partition column of a scanned
+   * HDFS table: they are chosen from the column's values in the scanned partitions so
+   * that the ranges hold about the same number of bytes. There are no key samples or
+   * histograms to choose them for other exprs.
+   */
+  private DataPartition getSortRangePartition(SortNode node,
+      PlanFragment childFragment) {
+    int numNodes = childFragment.getNumNodes();
+    if (numNodes < 2) return null;
+    Expr orderingExpr = node.getOrderingInputExpr(0);
+    if (!(orderingExpr instanceof SlotRef)) return null;
+    SlotDescriptor slotDesc = ((SlotRef) orderingExpr).getDesc();
+    Column col = slotDesc.getColumn();
+    if (col == null || !(slotDesc.getParent().getTable() instanceof HdfsTable)) {
+      return null;
+    }
+    if (col.getPosition() >= slotDesc.getParent().getTable().getNumClusteringCols()) {
+      return null;
+    }
+    List<HdfsScanNode> scanNodes = Lists.newArrayList();
+    childFragment.getPlanRoot().collect(HdfsScanNode.class, scanNodes);
+    HdfsScanNode scanNode = null;
+    for (HdfsScanNode candidate: scanNodes) {
+      if (candidate.getTupleIds().get(0).equals(slotDesc.getParent().getId())) {
+        scanNode = candidate;
+      }
+    }
+    if (scanNode == null) return null;
+
+    // Bytes of the scanned partitions per value of the column.
+    TreeMap<LiteralExpr, Long> bytesPerValue = new TreeMap<LiteralExpr, Long>();
+    long totalBytes = 0;
+    for (HdfsPartition partition: scanNode.getPartitions()) {
+      LiteralExpr value = partition.getPartitionValue(col.getPosition());
+      if (value instanceof NullLiteral) continue;
+      Long bytes = bytesPerValue.get(value);
+      bytesPerValue.put(value, (bytes == null ? 0 : bytes) + partition.getSize());
+      totalBytes += partition.getSize();
+    }
+    if (bytesPerValue.size() < 2) return null;
+
+    SortInfo sortInfo = node.getSortInfo();
+    boolean isAscOrder = sortInfo.getIsAscOrder().get(0);
+    NavigableMap<LiteralExpr, Long> orderedValues =
+        isAscOrder ? bytesPerValue : bytesPerValue.descendingMap();
+    int numRanges = (int) Math.min(bytesPerValue.size(),
+        (long) numNodes * RANGES_PER_SORT_INSTANCE);
+    List<LiteralExpr> splitPoints = Lists.newArrayList();
+    long cumulativeBytes = 0;
+    int numValues = 0;
+    for (Map.Entry<LiteralExpr, Long> entry: orderedValues.entrySet()) {
+      // The last value never ends a range that is followed by a non-empty one.
+      if (++numValues == orderedValues.size()) break;
+      cumulativeBytes += entry.getValue();
+      // End the current range once it holds its share of the bytes.
+      if (splitPoints.size() < numRanges - 1 &&
+          cumulativeBytes * numRanges >= totalBytes * (splitPoints.size() + 1)) {
+        splitPoints.add(entry.getKey());
+      }
+    }
+    if (splitPoints.isEmpty()) return null;
+    return DataPartition.createRangePartition(orderingExpr, splitPoints, isAscOrder,
+        sortInfo.getNullsFirst().get(0));
+  }
 }
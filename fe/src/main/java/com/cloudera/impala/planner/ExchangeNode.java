@@ -116,6 +116,12 @@ public class ExchangeNode extends PlanNode {
     }
   }
 
+  /**
+   * Returns the ordering of the merged input streams, or null if this exchange does
+   * not merge its input.
+   */
+  public SortInfo getMergeInfo() { return mergeInfo_; }
+
   /**
    * Set the parameters used to merge sorted input streams. This can be called
    * after init().
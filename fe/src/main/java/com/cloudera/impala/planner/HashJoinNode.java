@@ -24,6 +24,7 @@ import com.cloudera.impala.analysis.BinaryPredicate;
 import com.cloudera.impala.analysis.Expr;
 import com.cloudera.impala.analysis.ExprSubstitutionMap;
 import com.cloudera.impala.analysis.JoinOperator;
+import com.cloudera.impala.analysis.SortInfo;
 import com.cloudera.impala.catalog.Type;
 import com.cloudera.impala.common.AnalysisException;
 import com.cloudera.impala.common.ImpalaException;
@@ -126,7 +127,19 @@ public class HashJoinNode extends JoinNode {
     msg.node_type = TPlanNodeType.HASH_JOIN_NODE;
     msg.hash_join_node = new THashJoinNode();
     msg.hash_join_node.join_op = joinOp_.toThrift();
-    for (Expr entry: eqJoinConjuncts_) {
+    List<BinaryPredicate> eqJoinConjuncts = eqJoinConjuncts_;
+    List<Integer> mergeOrder = getMergeOrder();
+    if (mergeOrder != null) {
+      // The backend merges the inputs on the keys in the order of the conjuncts.
+      SortInfo sortInfo = getInputSortInfo(getChild(0));
+      eqJoinConjuncts = Lists.newArrayList();
+      for (int i = 0; i < mergeOrder.size(); ++i) {
+        eqJoinConjuncts.add(eqJoinConjuncts_.get(mergeOrder.get(i)));
+        msg.hash_join_node.addToMerge_is_asc_order(sortInfo.getIsAscOrder().get(i));
+        msg.hash_join_node.addToMerge_nulls_first(sortInfo.getNullsFirst().get(i));
+      }
+    }
+    for (Expr entry: eqJoinConjuncts) {
       BinaryPredicate bp = (BinaryPredicate)entry;
       TEqJoinCondition eqJoinCondition =
           new TEqJoinCondition(bp.getChild(0).treeToThrift(),
@@ -140,6 +153,59 @@ public class HashJoinNode extends JoinNode {
     msg.hash_join_node.setAdd_probe_filters(addProbeFilters_);
   }
 
+  /**
+   * Returns the ordering of 'input' if it is a sort or a merging exchange, otherwise
+   * null.
+   */
+  private static SortInfo getInputSortInfo(PlanNode input) {
+    if (input instanceof SortNode) return ((SortNode) input).getSortInfo();
+    if (input instanceof ExchangeNode) return ((ExchangeNode) input).getMergeInfo();
+    return null;
+  }
+
+  /**
+   * Returns the positions of the equi-join conjuncts in the order of the leading
+   * ordering exprs of both inputs, if the inputs are sorted on the operands of the
+   * conjuncts in the same direction. The backend can then join the inputs by merging
+   * them. Returns null otherwise, or if the join requires something the merge join
+   * doesn't support: null-aware anti joins, IS NOT DISTINCT FROM predicates and runtime
+   * filters, which are built from a hash table. Only checked when the plan is final,
+   * because the distributed planner may change the inputs of this node.
+   */
+  private List<Integer> getMergeOrder() {
+    if (joinOp_ == JoinOperator.NULL_AWARE_LEFT_ANTI_JOIN) return null;
+    if (!runtimeFilters_.isEmpty() || eqJoinConjuncts_.isEmpty()) return null;
+    SortInfo leftSortInfo = getInputSortInfo(getChild(0));
+    SortInfo rightSortInfo = getInputSortInfo(getChild(1));
+    if (leftSortInfo == null || rightSortInfo == null) return null;
+    int numKeys = eqJoinConjuncts_.size();
+    List<Expr> leftExprs = leftSortInfo.getOrderingExprs();
+    List<Expr> rightExprs = rightSortInfo.getOrderingExprs();
+    if (leftExprs.size() < numKeys || rightExprs.size() < numKeys) return null;
+    List<Integer> result = Lists.newArrayList();
+    for (int i = 0; i < numKeys; ++i) {
+      if (!leftSortInfo.getIsAscOrder().get(i).equals(
+              rightSortInfo.getIsAscOrder().get(i)) ||
+          !leftSortInfo.getNullsFirst().get(i).equals(
+              rightSortInfo.getNullsFirst().get(i))) {
+        return null;
+      }
+      int conjunctIdx = -1;
+      for (int j = 0; j < numKeys; ++j) {
+        BinaryPredicate eqPred = eqJoinConjuncts_.get(j);
+        if (eqPred.getOp() != BinaryPredicate.Operator.EQ) return null;
+        if (eqPred.getChild(0).equals(leftExprs.get(i)) &&
+            eqPred.getChild(1).equals(rightExprs.get(i))) {
+          conjunctIdx = j;
+          break;
+        }
+      }
+      if (conjunctIdx == -1 || result.contains(conjunctIdx)) return null;
+      result.add(conjunctIdx);
+    }
+    return result;
+  }
+
   @Override
   protected String getNodeExplainString(String prefix, String detailPrefix,
       TExplainLevel detailLevel) {
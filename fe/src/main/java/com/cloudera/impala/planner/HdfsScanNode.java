@@ -217,6 +217,8 @@ public class HdfsScanNode extends ScanNode {
     }
   }
 
+  public List<HdfsPartition> getPartitions() { return partitions_; }
+
   public boolean isPartitionedTable() {
     return desc_.getTable().getNumClusteringCols() > 0;
   }
@@ -41,13 +41,17 @@ public class HdfsTableSink extends TableSink {
   protected final List<Expr> partitionKeyExprs_;
   // Whether to overwrite the existing partition(s).
   protected final boolean overwrite_;
+  // Whether the input is sorted by the partition keys, so that only one partition is
+  // written at a time.
+  protected final boolean inputIsClustered_;
 
   public HdfsTableSink(Table targetTable, List<Expr> partitionKeyExprs,
-      boolean overwrite) {
+      boolean overwrite, boolean inputIsClustered) {
     super(targetTable);
     Preconditions.checkState(targetTable instanceof HdfsTable);
     partitionKeyExprs_ = partitionKeyExprs;
     overwrite_ = overwrite;
+    inputIsClustered_ = inputIsClustered;
   }
 
   @Override
@@ -61,6 +65,8 @@ public class HdfsTableSink extends TableSink {
     // and the data partition of the fragment executing this sink into account.
     long numPartitions = fragment_.getNumDistinctValues(partitionKeyExprs_);
     if (numPartitions == -1) numPartitions = DEFAULT_NUM_PARTITIONS;
+    // Clustered input is written one partition at a time.
+    if (inputIsClustered_) numPartitions = 1;
     long perPartitionMemReq = getPerPartitionMemReq(format);
 
     // The estimate is based purely on the per-partition mem req if the input cardinality_
@@ -100,6 +106,7 @@ public class HdfsTableSink extends TableSink {
       TExplainLevel explainLevel) {
     StringBuilder output = new StringBuilder();
     String overwriteStr = ", OVERWRITE=" + (overwrite_ ? "true" : "false");
+    if (inputIsClustered_) overwriteStr += ", CLUSTERED";
     String partitionKeyStr = "";
     if (!partitionKeyExprs_.isEmpty()) {
       StringBuilder tmpBuilder = new StringBuilder(", PARTITION-KEYS=(");
@@ -137,6 +144,7 @@ public class HdfsTableSink extends TableSink {
     TDataSink result = new TDataSink(TDataSinkType.TABLE_SINK);
     THdfsTableSink hdfsTableSink = new THdfsTableSink(
         Expr.treesToThrift(partitionKeyExprs_), overwrite_);
+    hdfsTableSink.setInput_is_clustered(inputIsClustered_);
     TTableSink tTableSink = new TTableSink(targetTable_.getId().asInt(),
         TTableSinkType.HDFS);
     tTableSink.hdfs_table_sink = hdfsTableSink;
@@ -3,21 +3,28 @@ package com.cloudera.impala.planner;
 import java.util.ArrayList;
 import java.util.Collections;
 import java.util.List;
+import java.util.Set;
 
 import org.slf4j.Logger;
 import org.slf4j.LoggerFactory;
 
 import com.cloudera.impala.analysis.AnalysisContext;
+import com.cloudera.impala.analysis.Analyzer;
 import com.cloudera.impala.analysis.ColumnLineageGraph;
 import com.cloudera.impala.analysis.Expr;
 import com.cloudera.impala.analysis.ExprSubstitutionMap;
 import com.cloudera.impala.analysis.InsertStmt;
 import com.cloudera.impala.analysis.QueryStmt;
+import com.cloudera.impala.analysis.SlotDescriptor;
+import com.cloudera.impala.analysis.SlotRef;
+import com.cloudera.impala.analysis.SortInfo;
+import com.cloudera.impala.analysis.TupleDescriptor;
 import com.cloudera.impala.catalog.HBaseTable;
 import com.cloudera.impala.catalog.Table;
 import com.cloudera.impala.common.ImpalaException;
 import com.cloudera.impala.common.PrintUtils;
 import com.cloudera.impala.common.RuntimeEnv;
+import com.cloudera.impala.common.TreeNode;
 import com.cloudera.impala.thrift.TExplainLevel;
 import com.cloudera.impala.thrift.TRuntimeFilterMode;
 import com.cloudera.impala.thrift.TQueryCtx;
@@ -26,7 +33,9 @@ import com.cloudera.impala.thrift.TTableName;
 import com.cloudera.impala.util.MaxRowsProcessedVisitor;
 import com.google.common.base.Joiner;
 import com.google.common.base.Preconditions;
+import com.google.common.base.Predicates;
 import com.google.common.collect.Lists;
+import com.google.common.collect.Sets;
 
 /**
  * Creates an executable plan from an analyzed parse tree and query options.
@@ -111,6 +120,10 @@ public class Planner {
         rootFragment = distributedPlanner.createInsertFragment(
             rootFragment, insertStmt, ctx_.getRootAnalyzer(), fragments);
       }
+      if (insertStmt.hasClusteredHint()) {
+        createClusteringSort(insertStmt, rootFragment, ctx_.getRootAnalyzer());
+        resultExprs = insertStmt.getResultExprs();
+      }
       // set up table sink for root fragment
       rootFragment.setSink(insertStmt.createDataSink());
     } else {
@@ -223,6 +236,51 @@ public class Planner {
     return str.toString();
   }
 
+  /**
+   * Adds a SortNode on the non-constant partition key exprs of 'insertStmt' as the new
+   * root of 'inputFragment', so that its table sink receives the rows of each partition
+   * consecutively and only needs to keep one partition open. The sort tuple
+   * materializes all slots referenced by the result and partition key exprs, which are
+   * substituted to refer to it.
+   */
+  private void createClusteringSort(InsertStmt insertStmt, PlanFragment inputFragment,
+      Analyzer analyzer) throws ImpalaException {
+    List<Expr> orderingExprs = Lists.newArrayList(insertStmt.getPartitionKeyExprs());
+    Expr.removeConstants(orderingExprs);
+    if (orderingExprs.isEmpty()) return;
+
+    Set<SlotRef> sourceSlots = Sets.newHashSet();
+    TreeNode.collect(insertStmt.getResultExprs(), Predicates.instanceOf(SlotRef.class),
+        sourceSlots);
+    TreeNode.collect(insertStmt.getPartitionKeyExprs(),
+        Predicates.instanceOf(SlotRef.class), sourceSlots);
+    TupleDescriptor sortTupleDesc = analyzer.getDescTbl().createTupleDescriptor("sort");
+    sortTupleDesc.setIsMaterialized(true);
+    List<Expr> sortTupleExprs = Lists.newArrayList();
+    ExprSubstitutionMap sortSmap = new ExprSubstitutionMap();
+    for (SlotRef sourceSlot: sourceSlots) {
+      SlotDescriptor slotDesc =
+          analyzer.copySlotDescriptor(sourceSlot.getDesc(), sortTupleDesc);
+      slotDesc.setIsMaterialized(true);
+      sortSmap.put(sourceSlot, new SlotRef(slotDesc));
+      sortTupleExprs.add(sourceSlot);
+    }
+
+    // The order of the partitions does not matter.
+    List<Boolean> isAsc =
+        Lists.newArrayList(Collections.nCopies(orderingExprs.size(), Boolean.TRUE));
+    List<Boolean> nullsFirst =
+        Lists.newArrayList(Collections.nCopies(orderingExprs.size(), Boolean.TRUE));
+    SortInfo sortInfo = new SortInfo(
+        Expr.substituteList(orderingExprs, sortSmap, analyzer, false), isAsc, nullsFirst);
+    sortInfo.setMaterializedTupleInfo(sortTupleDesc, sortTupleExprs);
+    SortNode sortNode = new SortNode(ctx_.getNextNodeId(), inputFragment.getPlanRoot(),
+        sortInfo, false, 0);
+    sortNode.init(analyzer);
+    inputFragment.setPlanRoot(sortNode);
+    insertStmt.substituteResultExprs(sortNode.getOutputSmap(), analyzer);
+  }
+
   /**
    * Returns true if the fragments are for a trivial, coordinator-only query:
    * Case 1: Only an EmptySetNode, e.g. query has a limit 0.
@@ -23,6 +23,7 @@ import com.cloudera.impala.analysis.Analyzer;
 import com.cloudera.impala.analysis.Expr;
 import com.cloudera.impala.analysis.ExprSubstitutionMap;
 import com.cloudera.impala.analysis.SlotDescriptor;
+import com.cloudera.impala.analysis.SlotId;
 import com.cloudera.impala.analysis.SlotRef;
 import com.cloudera.impala.analysis.SortInfo;
 import com.cloudera.impala.common.InternalException;
@@ -84,6 +85,24 @@ public class SortNode extends PlanNode {
   public boolean isAnalyticSort() { return isAnalyticSort_; }
   public void setIsAnalyticSort(boolean v) { isAnalyticSort_ = v; }
 
+  /**
+   * Returns the expr over the output of the child that the i-th ordering expr is
+   * computed from, or null if the ordering expr is not a slot of the sort tuple.
+   * Must be called after init().
+   */
+  public Expr getOrderingInputExpr(int i) {
+    Expr orderingExpr = info_.getOrderingExprs().get(i);
+    if (!(orderingExpr instanceof SlotRef)) return null;
+    SlotId slotId = ((SlotRef) orderingExpr).getSlotId();
+    int resolvedIdx = 0;
+    for (SlotDescriptor slotDesc: info_.getSortTupleDescriptor().getSlots()) {
+      if (!slotDesc.isMaterialized()) continue;
+      if (slotDesc.getId().equals(slotId)) return resolvedTupleExprs_.get(resolvedIdx);
+      ++resolvedIdx;
+    }
+    return null;
+  }
+
   @Override
   public boolean isBlockingNode() { return true; }
 
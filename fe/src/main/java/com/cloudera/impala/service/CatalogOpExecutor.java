@@ -2784,6 +2784,16 @@ public class CatalogOpExecutor {
               partition.getSd().setLocation(msTbl.getSd().getLocation() + "/" +
                   partName.substring(0, partName.length() - 1));
               MetaStoreUtils.updatePartitionStatsFast(partition, warehouse);
+
+              // Store the stats that were gathered while writing the partition.
+              TPartitionStats partStats = update.isSetPartition_stats() ?
+                  update.getPartition_stats().get(partName) : null;
+              if (partStats != null) {
+                PartitionStatsUtil.partStatsToParameters(partStats,
+                    partition.getParameters());
+                partition.putToParameters(StatsSetupConst.ROW_COUNT,
+                    String.valueOf(partStats.getStats().getNum_rows()));
+              }
             }
 
             // First add_partitions and then alter_partitions the successful ones with
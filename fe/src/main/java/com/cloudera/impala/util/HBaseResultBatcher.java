@@ -0,0 +1,130 @@
+// Copyright 2016 Cloudera Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.cloudera.impala.util;
+
+import java.io.IOException;
+
+import org.apache.hadoop.hbase.Cell;
+import org.apache.hadoop.hbase.client.Result;
+import org.apache.hadoop.hbase.client.ResultScanner;
+import org.apache.hadoop.hbase.client.ScannerTimeoutException;
+
+/**
+ * Copies the rows returned by an HBase ResultScanner into native memory, so that the
+ * backend's HBaseTableScanner fetches many rows with a single JNI call instead of making
+ * several calls per cell. Only used by the backend.
+ *
+ * Rows are written back to back in native byte order:
+ *   int32 row key length, row key, int32 number of cells,
+ *   and for every cell: int32 family length, family, int32 qualifier length, qualifier,
+ *   int32 value length, value.
+ * Empty results are skipped.
+ */
+public class HBaseResultBatcher {
+  // Bytes of the fixed-size fields in front of the row key and the cells.
+  private static final int ROW_HEADER_SIZE = 8;
+  private static final int CELL_HEADER_SIZE = 12;
+
+  private final ResultScanner scanner_;
+
+  // Row that did not fit into the buffer passed to the last fill() call.
+  private Result pendingRow_;
+
+  // Timeout hit by the last fill() call after it had already written rows. Thrown by the
+  // next call so that the caller sees the rows before it restarts the scan after them.
+  private ScannerTimeoutException pendingTimeout_;
+
+  public HBaseResultBatcher(ResultScanner scanner) {
+    scanner_ = scanner;
+  }
+
+  /**
+   * Writes up to 'maxRows' rows into the 'capacity' bytes starting at 'address' and
+   * returns the number of rows written, which is 0 once the scanner is exhausted. If the
+   * next row alone needs more than 'capacity' bytes, nothing is written and minus the
+   * number of bytes it needs is returned, so that the caller can retry with a larger
+   * buffer.
+   */
+  public int fill(long address, int capacity, int maxRows) throws IOException {
+    if (pendingTimeout_ != null) {
+      ScannerTimeoutException e = pendingTimeout_;
+      pendingTimeout_ = null;
+      throw e;
+    }
+    long pos = address;
+    long end = address + capacity;
+    int numRows = 0;
+    while (numRows < maxRows) {
+      Result result = pendingRow_;
+      pendingRow_ = null;
+      if (result == null) {
+        try {
+          result = scanner_.next();
+        } catch (ScannerTimeoutException e) {
+          if (numRows == 0) throw e;
+          pendingTimeout_ = e;
+          break;
+        }
+        if (result == null) break;
+        if (result.isEmpty()) continue;
+      }
+      Cell[] cells = result.rawCells();
+      int rowSize = getSerializedSize(cells);
+      if (rowSize > end - pos) {
+        pendingRow_ = result;
+        if (numRows == 0) return -rowSize;
+        break;
+      }
+      pos = writeRow(pos, cells);
+      ++numRows;
+    }
+    return numRows;
+  }
+
+  private static int getSerializedSize(Cell[] cells) {
+    int size = ROW_HEADER_SIZE + cells[0].getRowLength();
+    for (Cell cell: cells) {
+      size += CELL_HEADER_SIZE + cell.getFamilyLength() + cell.getQualifierLength() +
+          cell.getValueLength();
+    }
+    return size;
+  }
+
+  // Writes the row made up of 'cells' at 'pos' and returns the position after it.
+  private static long writeRow(long pos, Cell[] cells) {
+    Cell first = cells[0];
+    pos = writeBytes(pos, first.getRowArray(), first.getRowOffset(),
+        first.getRowLength());
+    UnsafeUtil.UNSAFE.putInt(pos, cells.length);
+    pos += 4;
+    for (Cell cell: cells) {
+      pos = writeBytes(pos, cell.getFamilyArray(), cell.getFamilyOffset(),
+          cell.getFamilyLength());
+      pos = writeBytes(pos, cell.getQualifierArray(), cell.getQualifierOffset(),
+          cell.getQualifierLength());
+      pos = writeBytes(pos, cell.getValueArray(), cell.getValueOffset(),
+          cell.getValueLength());
+    }
+    return pos;
+  }
+
+  // Writes 'len' as an int32 followed by src[offset, offset + len) at 'pos' and returns
+  // the position after them.
+  private static long writeBytes(long pos, byte[] src, int offset, int len) {
+    UnsafeUtil.UNSAFE.putInt(pos, len);
+    UnsafeUtil.Copy(pos + 4, src, offset, len);
+    return pos + 4 + len;
+  }
+}
@@ -1695,6 +1695,9 @@ public class AnalyzeStmtsTest extends AnalyzerTest {
       AnalyzesOk(String.format("insert into table functional.alltypessmall " +
           "partition (year, month) %snoshuffle%s select * from functional.alltypes",
           prefix, suffix));
+      AnalyzesOk(String.format("insert into table functional.alltypessmall " +
+          "partition (year, month) %sclustered%s select * from functional.alltypes",
+          prefix, suffix));
       // Only warn on unrecognized hints.
       AnalyzesOk(String.format("insert into functional.alltypessmall " +
           "partition (year, month) %sbadhint%s select * from functional.alltypes",
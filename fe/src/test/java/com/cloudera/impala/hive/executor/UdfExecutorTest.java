@@ -384,4 +384,63 @@ public class UdfExecutorTest {
         createBoolean(true));
     freeAllocations();
   }
+
+  @Test
+  // Tests evaluateBatch() with the columnar buffers laid out like HiveUdfCall does.
+  public void BatchTest() throws ImpalaRuntimeException, MalformedURLException {
+    int numRows = 4;
+    UdfExecutor e = new UdfExecutor(null, TestUdf.class.getName(), Type.INT,
+        Type.INT, Type.INT);
+    long inputNulls = allocate(2 * numRows);
+    // The int columns are 16 bytes each, so the second one starts at offset 16.
+    long inputValues = allocate(2 * 16);
+    long outputNulls = allocate(numRows);
+    long outputValues = allocate(numRows * 4);
+    int[] a = { 1, 2, 0, 4 };
+    int[] b = { 10, 20, 30, 40 };
+    for (int row = 0; row < numRows; ++row) {
+      UnsafeUtil.UNSAFE.putByte(inputNulls + row, (byte)(row == 2 ? 1 : 0));
+      UnsafeUtil.UNSAFE.putByte(inputNulls + numRows + row, (byte)0);
+      UnsafeUtil.UNSAFE.putInt(inputValues + row * 4, a[row]);
+      UnsafeUtil.UNSAFE.putInt(inputValues + 16 + row * 4, b[row]);
+    }
+    e.evaluateBatch(numRows, inputNulls, inputValues, outputNulls, outputValues);
+    int[] expected = { 11, 22, -1, 44 };
+    for (int row = 0; row < numRows; ++row) {
+      assertEquals(0, UnsafeUtil.UNSAFE.getByte(outputNulls + row));
+      assertEquals(expected[row], UnsafeUtil.UNSAFE.getInt(outputValues + row * 4));
+    }
+    e.close();
+
+    // Returns NULL if either argument is NULL.
+    numRows = 3;
+    e = new UdfExecutor(null, TestUdf.class.getName(), Type.STRING, Type.STRING,
+        Type.STRING);
+    String[] c = { "ab", null, "" };
+    String[] d = { "cd", "x", "e" };
+    inputNulls = allocate(2 * numRows);
+    inputValues = allocate(2 * numRows * 16);
+    outputNulls = allocate(numRows);
+    outputValues = allocate(numRows * 16);
+    for (int row = 0; row < numRows; ++row) {
+      UnsafeUtil.UNSAFE.putByte(inputNulls + row, (byte)(c[row] == null ? 1 : 0));
+      UnsafeUtil.UNSAFE.putByte(inputNulls + numRows + row, (byte)0);
+      if (c[row] != null) {
+        UnsafeUtil.UNSAFE.copyMemory(createStringValue(c[row]),
+            inputValues + row * 16, 16);
+      }
+      UnsafeUtil.UNSAFE.copyMemory(createStringValue(d[row]),
+          inputValues + (numRows + row) * 16, 16);
+    }
+    e.evaluateBatch(numRows, inputNulls, inputValues, outputNulls, outputValues);
+    assertEquals(0, UnsafeUtil.UNSAFE.getByte(outputNulls));
+    assertArrayEquals("abcd".getBytes(),
+        new ImpalaStringWritable(outputValues).getBytes());
+    assertEquals(1, UnsafeUtil.UNSAFE.getByte(outputNulls + 1));
+    assertEquals(0, UnsafeUtil.UNSAFE.getByte(outputNulls + 2));
+    assertArrayEquals("e".getBytes(),
+        new ImpalaStringWritable(outputValues + 32).getBytes());
+    e.close();
+    freeAllocations();
+  }
 }
@@ -0,0 +1,534 @@
+#!/usr/bin/env impala-python
+# Copyright (c) 2016 Cloudera, Inc. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# This script replays a workload that was captured on a cluster against another cluster
+# or build and compares the performance of the replay with the recorded baseline.
+#
+# The workload is read from the profile logs that impalads write for every completed
+# query (see --profile_log_dir), which hold the statement, default database, non-default
+# query options, start and end time and peak memory usage of each query. Only successful
+# SELECT queries are replayed unless --include-dml is given. The parsed workload can be
+# saved with --save-workload and replayed later with --workload, e.g. to replay the same
+# workload against several builds.
+#
+# Queries are submitted through HiveServer2:
+#   - By default at the same offsets from the start of the workload as they were
+#     recorded, i.e. at the original concurrency. --speedup divides the offsets and so
+#     scales the concurrency up (or down if it is below 1).
+#   - With --concurrency=N, by N clients that each submit their next query as soon as the
+#     previous one finished, in the recorded order.
+#
+# After the replay the latency distributions, peak memory usage and the number of queries
+# that spilled are compared with the baseline, and the plans (by the plan fingerprint of
+# the recorded profile, or the statement if there is none) whose average latency changed
+# the most are listed. --results-json-file saves the comparison.
+#
+# Example:
+#   replay_workload.py --profile-logs=/var/log/impalad/profiles/impala_profile_log_1.1-* \
+#       --impalads=host1:21050,host2:21050 --speedup=2 --results-json-file=replay.json
+
+from __future__ import division, print_function
+
+import base64
+import json
+import logging
+import prettytable
+import re
+import sys
+import threading
+import zlib
+from collections import defaultdict
+from datetime import datetime
+from optparse import OptionParser
+from Queue import Queue
+from time import sleep, time
+
+from impala.dbapi import connect
+from RuntimeProfile.ttypes import TRuntimeProfileTree
+from thrift.protocol import TCompactProtocol
+from thrift.transport import TTransport
+
+LOG = logging.getLogger('replay_workload')
+
+DEFAULT_HS2_PORT = 21050
+
+# Info strings of the summary profile of a query.
+SQL_STATEMENT = "Sql Statement"
+DEFAULT_DB = "Default Db"
+QUERY_TYPE = "Query Type"
+QUERY_STATE = "Query State"
+QUERY_OPTIONS = "Query Options (non default)"
+START_TIME = "Start Time"
+END_TIME = "End Time"
+PLAN_FINGERPRINT = "Plan Fingerprint"
+
+# Counters of the fragment instance profiles.
+PEAK_MEM_COUNTER = "PerHostPeakMemUsage"
+SPILLED_BYTES_COUNTER = "BytesWritten"
+BLOCK_MGR_PROFILE = "BlockMgr"
+AVERAGED_FRAGMENT_PREFIX = "Averaged Fragment"
+
+# Patterns of the same counters in the text profile returned by HiveServer2, e.g.
+# "- PerHostPeakMemUsage: 1.23 MB (1289748)".
+PEAK_MEM_PATTERN = re.compile(r"- %s: .*\((\d+)\)" % PEAK_MEM_COUNTER)
+SPILLED_PATTERN = re.compile("ExecOption:.*Spilled")
+
+FETCH_SIZE = 1024
+PERCENTILES = (50, 90, 95, 99, 100)
+
+
+class RecordedQuery(object):
+  """A query of the captured workload, with its recorded performance."""
+
+  def __init__(self, query_id, stmt, db=None, options=None, query_type="QUERY",
+      start_time=0, latency_secs=0, peak_mem_bytes=0, spilled=False, fingerprint=None):
+    self.query_id = query_id
+    self.stmt = stmt
+    self.db = db
+    self.options = options or {}
+    self.query_type = query_type
+    # Seconds since the epoch.
+    self.start_time = start_time
+    self.latency_secs = latency_secs
+    self.peak_mem_bytes = peak_mem_bytes
+    self.spilled = spilled
+    self.fingerprint = fingerprint
+
+  @property
+  def plan_key(self):
+    """The key the per-plan comparison groups by."""
+    return self.fingerprint or self.stmt
+
+  def to_json(self):
+    return self.__dict__
+
+  @staticmethod
+  def from_json(obj):
+    return RecordedQuery(**obj)
+
+
+class ReplayResult(object):
+  """The outcome of replaying one RecordedQuery."""
+
+  def __init__(self, query):
+    self.query = query
+    self.latency_secs = None
+    self.peak_mem_bytes = None
+    self.spilled = False
+    self.error = None
+    # How much later than scheduled the query was submitted, because all clients were
+    # busy.
+    self.submit_delay_secs = 0
+
+
+def parse_timestamp(value):
+  """Parses a TimestampValue::DebugString(), e.g. '2016-03-01 12:34:56.123456789', into
+     seconds since the epoch in local time. Returns None if it is empty or malformed."""
+  if not value:
+    return None
+  # strptime only parses up to microseconds.
+  value = value[:26]
+  for fmt in ("%Y-%m-%d %H:%M:%S.%f", "%Y-%m-%d %H:%M:%S"):
+    try:
+      dt = datetime.strptime(value, fmt)
+      return (dt - datetime(1970, 1, 1)).total_seconds()
+    except ValueError:
+      pass
+  return None
+
+
+def parse_query_options(value):
+  """Parses the 'Query Options (non default)' info string, e.g.
+     'MEM_LIMIT=1000,NUM_NODES=1'."""
+  options = {}
+  for option in (value or "").split(","):
+    if "=" in option:
+      key, _, val = option.partition("=")
+      options[key.strip()] = val.strip()
+  return options
+
+
+def decode_profile(encoded_profile):
+  """Decodes a profile of the profile log, see
+     RuntimeProfile::SerializeToArchiveString()."""
+  compressed = base64.b64decode(encoded_profile)
+  # Accept both zlib and gzip headers.
+  serialized = zlib.decompress(compressed, 32 + zlib.MAX_WBITS)
+  transport = TTransport.TMemoryBuffer(serialized)
+  tree = TRuntimeProfileTree()
+  tree.read(TCompactProtocol.TCompactProtocol(transport))
+  return tree
+
+
+def recorded_query_from_profile(query_id, tree):
+  """Returns the RecordedQuery of the profile 'tree', or None if it is not the profile of
+     a query that finished successfully."""
+  info_strings = {}
+  peak_mem_bytes = 0
+  spilled_bytes = 0
+  # The nodes are in preorder. Skip the averaged fragment profiles, whose counters
+  # duplicate those of the fragment instances.
+  averaged_nodes_left = 0
+  for node in tree.nodes:
+    if averaged_nodes_left > 0:
+      averaged_nodes_left += node.num_children - 1
+      continue
+    if node.name.startswith(AVERAGED_FRAGMENT_PREFIX):
+      averaged_nodes_left = node.num_children
+      continue
+    for key, value in node.info_strings.iteritems():
+      info_strings.setdefault(key, value)
+    for counter in node.counters:
+      if counter.name == PEAK_MEM_COUNTER:
+        peak_mem_bytes = max(peak_mem_bytes, counter.value)
+      elif counter.name == SPILLED_BYTES_COUNTER and node.name == BLOCK_MGR_PROFILE:
+        spilled_bytes += counter.value
+  if SQL_STATEMENT not in info_strings:
+    return None
+  start_time = parse_timestamp(info_strings.get(START_TIME))
+  end_time = parse_timestamp(info_strings.get(END_TIME))
+  if start_time is None or end_time is None or \
+      info_strings.get(QUERY_STATE) != "FINISHED":
+    return None
+  return RecordedQuery(query_id, info_strings[SQL_STATEMENT],
+      db=info_strings.get(DEFAULT_DB) or None,
+      options=parse_query_options(info_strings.get(QUERY_OPTIONS)),
+      query_type=info_strings.get(QUERY_TYPE, "QUERY"),
+      start_time=start_time,
+      latency_secs=end_time - start_time,
+      peak_mem_bytes=peak_mem_bytes,
+      spilled=spilled_bytes > 0,
+      fingerprint=info_strings.get(PLAN_FINGERPRINT))
+
+
+def load_profile_logs(paths):
+  """Returns the RecordedQueries of the profile log files 'paths', by start time. Each
+     line of a profile log is '<unix time ms> <query id> <encoded profile>'."""
+  queries = []
+  for path in paths:
+    with open(path) as log_file:
+      for line_num, line in enumerate(log_file):
+        fields = line.strip().split(" ", 2)
+        if len(fields) != 3:
+          continue
+        try:
+          query = recorded_query_from_profile(fields[1], decode_profile(fields[2]))
+        except Exception as e:
+          LOG.warn("Skipping malformed profile at %s:%s: %s", path, line_num + 1, e)
+          continue
+        if query is not None:
+          queries.append(query)
+  queries.sort(key=lambda q: q.start_time)
+  return queries
+
+
+def save_workload(queries, path):
+  with open(path, "w") as workload_file:
+    json.dump([q.to_json() for q in queries], workload_file, indent=2)
+
+
+def load_workload(path):
+  with open(path) as workload_file:
+    return [RecordedQuery.from_json(obj) for obj in json.load(workload_file)]
+
+
+class WorkloadReplayer(object):
+  """Replays RecordedQueries against a set of impalads through HiveServer2."""
+
+  def __init__(self, impalads, use_kerberos=False):
+    self.impalads = impalads
+    self.use_kerberos = use_kerberos
+    self._next_impalad = 0
+    self._lock = threading.Lock()
+
+  def replay(self, queries, concurrency=None, speedup=1.0, max_clients=64):
+    """Replays 'queries' and returns their ReplayResults in the same order. If
+       'concurrency' is set, runs them in a closed loop with that many clients, otherwise
+       at their recorded start offsets divided by 'speedup', with up to 'max_clients'
+       queries in flight."""
+    results = [ReplayResult(q) for q in queries]
+    work = Queue()
+    num_clients = concurrency or max_clients
+    clients = [threading.Thread(target=self._client_loop, args=(work,),
+        name="replay-client-%s" % i) for i in xrange(num_clients)]
+    for client in clients:
+      client.daemon = True
+      client.start()
+
+    replay_start = time()
+    first_start = queries[0].start_time if queries else 0
+    for i, result in enumerate(results):
+      if concurrency is None:
+        due = replay_start + (result.query.start_time - first_start) / speedup
+        wait = due - time()
+        if wait > 0:
+          sleep(wait)
+        work.put((result, due))
+      else:
+        work.put((result, None))
+      if len(results) >= 10 and i % (len(results) // 10) == 0:
+        LOG.info("Submitted %s of %s queries", i, len(results))
+    for _ in clients:
+      work.put(None)
+    for client in clients:
+      client.join()
+    LOG.info("Replayed %s queries in %.1fs", len(results), time() - replay_start)
+    return results
+
+  def _connect(self):
+    with self._lock:
+      impalad = self.impalads[self._next_impalad % len(self.impalads)]
+      self._next_impalad += 1
+    host, _, port = impalad.partition(":")
+    return connect(host=host, port=int(port or DEFAULT_HS2_PORT),
+        auth_mechanism="GSSAPI" if self.use_kerberos else "NOSASL")
+
+  def _client_loop(self, work):
+    conn = None
+    # The query options set in the session of 'conn'. Options cannot be reset to their
+    # defaults, so queries with different options get a new session.
+    conn_options = None
+    while True:
+      item = work.get()
+      if item is None:
+        break
+      result, due = item
+      if due is not None:
+        result.submit_delay_secs = max(time() - due, 0)
+      try:
+        if conn is not None and conn_options != result.query.options:
+          conn.close()
+          conn = None
+        if conn is None:
+          conn = self._connect()
+          conn_options = None
+          self._set_options(conn, result.query.options)
+          conn_options = result.query.options
+        self._run_query(conn, result)
+      except Exception as e:
+        result.error = str(e)
+        LOG.debug("Query %s failed: %s", result.query.query_id, e)
+        # The connection may be broken, open a new one for the next query.
+        try:
+          if conn is not None:
+            conn.close()
+        except Exception:
+          pass
+        conn = None
+    if conn is not None:
+      conn.close()
+
+  def _set_options(self, conn, options):
+    cursor = conn.cursor()
+    try:
+      for key, value in options.iteritems():
+        cursor.execute("SET %s=%s" % (key, value))
+    finally:
+      cursor.close()
+
+  def _run_query(self, conn, result):
+    query = result.query
+    cursor = conn.cursor()
+    try:
+      if query.db:
+        cursor.execute("USE %s" % query.db)
+      start = time()
+      cursor.execute(query.stmt)
+      if cursor.has_result_set:
+        while cursor.fetchmany(FETCH_SIZE):
+          pass
+      result.latency_secs = time() - start
+      profile = cursor.get_profile()
+      peak_mem = [int(m) for m in PEAK_MEM_PATTERN.findall(profile)]
+      result.peak_mem_bytes = max(peak_mem) if peak_mem else 0
+      result.spilled = SPILLED_PATTERN.search(profile) is not None
+    finally:
+      cursor.close()
+
+
+def percentile(values, pct):
+  """Returns the 'pct' percentile of 'values' by the nearest rank method."""
+  if not values:
+    return None
+  values = sorted(values)
+  rank = max(int(round(pct / 100 * len(values))), 1)
+  return values[rank - 1]
+
+
+def delta_pct(baseline, value):
+  if not baseline or value is None:
+    return None
+  return (value - baseline) / baseline * 100
+
+
+def compare(results):
+  """Returns a dict with the comparison of the replay 'results' with their baseline."""
+  ok = [r for r in results if r.error is None]
+  comparison = {"num_queries": len(results), "num_errors": len(results) - len(ok),
+      "errors": [{"query_id": r.query.query_id, "error": r.error}
+          for r in results if r.error is not None],
+      "max_submit_delay_secs": max([r.submit_delay_secs for r in results] or [0])}
+  baseline_latencies = [r.query.latency_secs for r in ok]
+  replay_latencies = [r.latency_secs for r in ok]
+  metrics = []
+  for pct in PERCENTILES:
+    name = "max latency" if pct == 100 else "p%s latency" % pct
+    metrics.append((name, percentile(baseline_latencies, pct),
+        percentile(replay_latencies, pct)))
+  metrics.append(("total latency", sum(baseline_latencies), sum(replay_latencies)))
+  metrics.append(("avg peak memory (MB)",
+      sum(r.query.peak_mem_bytes for r in ok) / max(len(ok), 1) / 2**20,
+      sum(r.peak_mem_bytes for r in ok) / max(len(ok), 1) / 2**20))
+  metrics.append(("max peak memory (MB)",
+      max([r.query.peak_mem_bytes for r in ok] or [0]) / 2**20,
+      max([r.peak_mem_bytes for r in ok] or [0]) / 2**20))
+  metrics.append(("queries that spilled", sum(1 for r in ok if r.query.spilled),
+      sum(1 for r in ok if r.spilled)))
+  comparison["metrics"] = [{"name": name, "baseline": baseline, "replay": replay,
+      "delta_pct": delta_pct(baseline, replay)} for name, baseline, replay in metrics]
+
+  by_plan = defaultdict(list)
+  for r in ok:
+    by_plan[r.query.plan_key].append(r)
+  plans = []
+  for key, plan_results in by_plan.iteritems():
+    baseline_avg = sum(r.query.latency_secs for r in plan_results) / len(plan_results)
+    replay_avg = sum(r.latency_secs for r in plan_results) / len(plan_results)
+    plans.append({"plan": key, "stmt": plan_results[-1].query.stmt,
+        "num_queries": len(plan_results), "baseline_avg_latency": baseline_avg,
+        "replay_avg_latency": replay_avg,
+        "delta_pct": delta_pct(baseline_avg, replay_avg)})
+  plans.sort(key=lambda p: p["replay_avg_latency"] - p["baseline_avg_latency"],
+      reverse=True)
+  comparison["plans"] = plans
+  return comparison
+
+
+def format_value(value):
+  if value is None:
+    return "-"
+  if isinstance(value, float):
+    return "%.2f" % value
+  return str(value)
+
+
+def print_comparison(comparison, num_plans, min_latency_secs):
+  print("Replayed %s queries, %s failed. Max submission delay: %.2fs" % (
+      comparison["num_queries"], comparison["num_errors"],
+      comparison["max_submit_delay_secs"]))
+  table = prettytable.PrettyTable(["Metric", "Baseline", "Replay", "Delta (%)"])
+  table.align = "r"
+  table.align["Metric"] = "l"
+  for metric in comparison["metrics"]:
+    table.add_row([metric["name"], format_value(metric["baseline"]),
+        format_value(metric["replay"]), format_value(metric["delta_pct"])])
+  print(table)
+
+  # Very short queries are too noisy to compare.
+  plans = [p for p in comparison["plans"]
+      if max(p["baseline_avg_latency"], p["replay_avg_latency"]) >= min_latency_secs]
+  if not plans:
+    return
+  table = prettytable.PrettyTable(["Plan", "Queries", "Baseline avg (s)",
+      "Replay avg (s)", "Delta (%)", "Statement"])
+  table.align = "r"
+  table.align["Statement"] = "l"
+  for title, selected in (
+      ("Largest regressions", [p for p in plans[:num_plans] if p["delta_pct"] > 0]),
+      ("Largest improvements",
+          [p for p in reversed(plans[-num_plans:]) if p["delta_pct"] < 0])):
+    if not selected:
+      continue
+    table.clear_rows()
+    for plan in selected:
+      stmt = " ".join(plan["stmt"].split())
+      table.add_row([plan["plan"][:16], plan["num_queries"],
+          format_value(plan["baseline_avg_latency"]),
+          format_value(plan["replay_avg_latency"]), format_value(plan["delta_pct"]),
+          stmt[:60] + ("..." if len(stmt) > 60 else "")])
+    print(title)
+    print(table)
+
+
+def main():
+  parser = OptionParser()
+  parser.add_option("--profile-logs", dest="profile_logs", default="",
+      help="Comma-separated list of impalad profile log files to read the workload from.")
+  parser.add_option("--workload", dest="workload", default=None,
+      help="A workload saved with --save-workload, instead of --profile-logs.")
+  parser.add_option("--save-workload", dest="save_workload", default=None,
+      help="Saves the workload read from --profile-logs to this JSON file.")
+  parser.add_option("--impalads", dest="impalads", default="localhost",
+      help="Comma-separated list of impalads ('host' or 'host:hs2 port') to replay the "
+      "workload against. Clients connect to them in turn.")
+  parser.add_option("--use-kerberos", dest="use_kerberos", action="store_true",
+      default=False, help="Connect to the impalads with Kerberos.")
+  parser.add_option("--include-dml", dest="include_dml", action="store_true",
+      default=False, help="Also replay DML statements, which modify tables.")
+  parser.add_option("--max-queries", dest="max_queries", type="int", default=None,
+      help="Only replay the first N queries of the workload.")
+  parser.add_option("--speedup", dest="speedup", type="float", default=1.0,
+      help="Divides the recorded offsets between query submissions by this factor.")
+  parser.add_option("--concurrency", dest="concurrency", type="int", default=None,
+      help="Ignore the recorded submission times and run the queries with this many "
+      "clients in a closed loop.")
+  parser.add_option("--max-clients", dest="max_clients", type="int", default=64,
+      help="Maximum number of queries in flight when replaying at the recorded times. "
+      "Queries are submitted late if all clients are busy.")
+  parser.add_option("--num-plans", dest="num_plans", type="int", default=10,
+      help="Number of the most regressed and improved plans to list.")
+  parser.add_option("--min-latency-secs", dest="min_latency_secs", type="float",
+      default=0.5, help="Plans that run faster than this are not listed.")
+  parser.add_option("--results-json-file", dest="results_json_file", default=None,
+      help="Saves the comparison to this JSON file.")
+  parser.add_option("-v", "--verbose", dest="verbose", action="store_true",
+      default=False, help="Logs every failed query.")
+  options, _ = parser.parse_args()
+
+  logging.basicConfig(level=logging.DEBUG if options.verbose else logging.INFO,
+      format='[%(name)s] %(threadName)s: %(message)s')
+
+  if options.workload:
+    queries = load_workload(options.workload)
+  elif options.profile_logs:
+    queries = load_profile_logs(options.profile_logs.split(","))
+  else:
+    parser.error("One of --profile-logs or --workload is required")
+  if options.save_workload:
+    save_workload(queries, options.save_workload)
+    LOG.info("Saved %s queries to %s", len(queries), options.save_workload)
+  if not options.include_dml:
+    queries = [q for q in queries if q.query_type == "QUERY"]
+  if options.max_queries is not None:
+    queries = queries[:options.max_queries]
+  if not queries:
+    LOG.error("The workload has no queries to replay")
+    return 1
+  LOG.info("Replaying %s queries recorded over %.1fs", len(queries),
+      queries[-1].start_time - queries[0].start_time)
+
+  replayer = WorkloadReplayer(options.impalads.split(","), options.use_kerberos)
+  results = replayer.replay(queries, concurrency=options.concurrency,
+      speedup=options.speedup, max_clients=options.max_clients)
+  comparison = compare(results)
+  print_comparison(comparison, options.num_plans, options.min_latency_secs)
+  if options.results_json_file:
+    with open(options.results_json_file, "w") as results_file:
+      json.dump(comparison, results_file, indent=2)
+  return 0
+
+
+if __name__ == "__main__":
+  sys.exit(main())